@@ -43,7 +43,8 @@ do
         descriptors2=`printf $descriptors_format $view2 $t2`
         matches=`printf $matches_format $view1 $view2 $t1 $t2`
 
-        ./match-features $descriptors1 $descriptors2 $matches
+        # Each file is searched many times, keep its index.
+        ./match-features --cache_index $descriptors1 $descriptors2 $matches
       done
     done
   done
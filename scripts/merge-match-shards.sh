@@ -0,0 +1,50 @@
+#!/bin/bash
+
+# Merges the match lists of the shards of match-features-batch, e.g.
+#   ./match-features-batch views.txt 3000 descriptors/%s/%07d.bin \
+#     matches/%s-%s-%d-%d.yaml --num_shards=16 --shard=$k \
+#     --match_list=shard-$k.txt --ledger=ledger-$k.txt
+# on each of 16 machines which share the matches directory.
+#
+# Checks that no pair was matched by two shards and that every listed file
+# exists, then writes one list sorted by name, which does not depend on the
+# number of shards. The merged list can be packed with
+#   ./pack-files merged.txt matches.archive
+# and the ledgers combined with cat, e.g. for --schedule_ledger.
+
+if [ $# -lt 2 ]
+then
+  echo "usage: $0 merged-list shard-list..." >&2
+  exit 1
+fi
+
+merged=$1
+shift
+
+duplicates=`cat "$@" | sort | uniq -d | head -n 5`
+if [ -n "$duplicates" ]
+then
+  echo "Matched by more than one shard:" >&2
+  echo "$duplicates" >&2
+  exit 1
+fi
+
+cat "$@" | sort > $merged
+
+num_missing=0
+while read file
+do
+  if [ ! -e $file ]
+  then
+    echo "Missing $file" >&2
+    (( num_missing += 1 ))
+  fi
+done < $merged
+
+if [ $num_missing -gt 0 ]
+then
+  echo "$num_missing match files are missing" >&2
+  exit 1
+fi
+
+echo "Merged `wc -l < $merged` match files of $# shards into $merged"
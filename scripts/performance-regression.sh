@@ -0,0 +1,298 @@
+#!/bin/bash
+
+# Runs fixed end-to-end scenarios on a synthetic dataset and compares the time
+# and peak memory of each stage against a baseline.
+#
+# Stage timings come from the trace summary and stage memory from the memory
+# accounting, so build with -DWITH_TRACE=ON -DWITH_MEMORY_ACCOUNTING=ON to see
+# more than the "total" of each scenario. Each scenario is repeated and the
+# least time is kept. Results are one JSON object per stage, e.g.
+#   {"scenario": "tracking", "stage": "total", "seconds": 1.5, "peak_mb": 40}
+#
+# After a deliberate change in performance, record a new baseline on the
+# reference machine with "update" and check it in.
+
+if [ $# -lt 3 -o $# -gt 6 ]
+then
+  echo "usage: $0 run|update bin-dir work-dir baseline [time-tolerance] [memory-tolerance]" >&2
+  echo "       $0 compare results baseline [time-tolerance] [memory-tolerance]" >&2
+  echo "" >&2
+  echo "Tolerances are fractions of the baseline, 0.1 and 0.05 by default." >&2
+  exit 1
+fi
+
+mode=$1
+
+# Prints the stages of two result files which got slower or larger.
+compare() {
+  results=$1
+  baseline=$2
+  time_tolerance=$3
+  memory_tolerance=$4
+
+  if [ ! -e $baseline ]
+  then
+    echo "No baseline $baseline, record one with update" >&2
+    return 1
+  fi
+
+  awk -v time_tolerance=$time_tolerance -v memory_tolerance=$memory_tolerance '
+    function field(line, name,    pattern, value) {
+      pattern = "\"" name "\": *(\"[^\"]*\"|[-0-9.e+]+)"
+      if (!match(line, pattern)) {
+        return ""
+      }
+      value = substr(line, RSTART, RLENGTH)
+      sub("^\"" name "\": *", "", value)
+      gsub("\"", "", value)
+      return value
+    }
+
+    /"scenario"/ {
+      key = field($0, "scenario") " / " field($0, "stage")
+      # Missing fields are empty, others are compared as numbers.
+      seconds = field($0, "seconds")
+      peak_mb = field($0, "peak_mb")
+      if (seconds != "") {
+        seconds += 0
+      }
+      if (peak_mb != "") {
+        peak_mb += 0
+      }
+      if (FNR == NR) {
+        base_seconds[key] = seconds
+        base_peak_mb[key] = peak_mb
+        next
+      }
+
+      seen[key] = 1
+      if (!(key in base_seconds)) {
+        printf "new       %-48s\n", key
+        next
+      }
+      if (seconds != "" && base_seconds[key] != "" &&
+          seconds > base_seconds[key] * (1 + time_tolerance)) {
+        printf "SLOWER    %-48s %10.3f s -> %10.3f s (%+.0f%%)\n", key,
+            base_seconds[key], seconds,
+            100 * (seconds / base_seconds[key] - 1)
+        num_regressions += 1
+      }
+      if (peak_mb != "" && base_peak_mb[key] != "" &&
+          peak_mb > base_peak_mb[key] * (1 + memory_tolerance)) {
+        printf "LARGER    %-48s %10.1f MB -> %10.1f MB (%+.0f%%)\n", key,
+            base_peak_mb[key], peak_mb,
+            100 * (peak_mb / base_peak_mb[key] - 1)
+        num_regressions += 1
+      }
+    }
+
+    END {
+      for (key in base_seconds) {
+        if (!(key in seen)) {
+          printf "missing   %-48s\n", key
+        }
+      }
+      printf "%d regressions\n", num_regressions
+      exit (num_regressions > 0)
+    }' $baseline $results
+}
+
+if [ $mode == "compare" ]
+then
+  compare $2 $3 ${4:-0.1} ${5:-0.05}
+  exit
+fi
+
+if [ $mode != "run" -a $mode != "update" ]
+then
+  echo "Unknown mode $mode" >&2
+  exit 1
+fi
+
+if [ $# -lt 4 ]
+then
+  echo "Missing baseline" >&2
+  exit 1
+fi
+
+bin_dir=$2
+work_dir=$3
+baseline=$4
+time_tolerance=${5:-0.1}
+memory_tolerance=${6:-0.05}
+
+repeats=3
+num_views=4
+num_frames=10
+num_points=500
+
+data_dir=$work_dir/data
+results=$work_dir/results.json
+records=$work_dir/records.tsv
+
+# Careful..
+rm -rf $work_dir
+mkdir -p $data_dir
+
+# Appends a record for each stage of one run to the records file.
+parse_run() {
+  scenario=$1
+  log=$2
+  time_file=$3
+
+  # Wall time and maximum resident set in kilobytes.
+  read seconds peak_kb < $time_file
+  awk -v scenario=$scenario -v seconds=$seconds -v peak_kb=$peak_kb \
+      'BEGIN { printf "%s\ttotal\t%s\t%s\n", scenario, seconds, peak_kb / 1024 }' \
+      >> $records
+
+  awk -v scenario=$scenario '
+    /^scope +count/ { summary = 1; next }
+    /^counter +total/ { summary = 0; next }
+
+    # name, count, total, mean and max in milliseconds.
+    summary && NF >= 5 {
+      name = $1
+      for (i = 2; i <= NF - 4; i += 1) {
+        name = name " " $i
+      }
+      printf "%s\t%s\t%s\t\n", scenario, name, $(NF - 2) / 1000
+    }
+
+    # memory <name>: heap <x> MB (peak <y> MB, ...
+    /^memory .*: heap / {
+      name = $0
+      sub("^memory ", "", name)
+      sub(": heap .*", "", name)
+      # The first peak is of the heap, the second of the resident set.
+      match($0, /\(peak [0-9.]+/)
+      peak = substr($0, RSTART + 6, RLENGTH - 6)
+      printf "%s\t%s\t\t%s\n", scenario, name, peak
+    }' $log >> $records
+}
+
+# Runs a command the given number of times, recording each run.
+run_scenario() {
+  scenario=$1
+  shift
+
+  echo "$scenario"
+  for r in `seq 1 $repeats`
+  do
+    log=$work_dir/$scenario.$r.log
+    time_file=$work_dir/$scenario.$r.time
+    /usr/bin/time -f "%e %M" -o $time_file "$@" > /dev/null 2> $log
+    if [ $? -ne 0 ]
+    then
+      echo "Scenario $scenario failed, see $log" >&2
+      exit 1
+    fi
+    parse_run $scenario $log $time_file
+  done
+}
+
+# Generate dataset.
+views_file=$data_dir/views.txt
+image_format=$data_dir/images/%s/%07d.png
+keypoints_format=$data_dir/keypoints/%s/%07d.yaml
+matches_format=$data_dir/matches/%s-%s-%d-%d.yaml
+
+for v in `seq 1 $num_views`
+do
+  view=`printf view%02d $v`
+  mkdir -p $data_dir/images/$view $data_dir/keypoints/$view
+done
+mkdir -p $data_dir/intrinsics $data_dir/extrinsics $data_dir/cameras
+mkdir -p $data_dir/matches
+
+$bin_dir/generate-synthetic-multiview \
+  $views_file \
+  $image_format \
+  $keypoints_format \
+  $data_dir/intrinsics/%s.yaml \
+  $data_dir/extrinsics/%s.yaml \
+  $data_dir/cameras/%s.yaml \
+  $data_dir/true-tracks.yaml \
+  --num_views=$num_views \
+  --num_frames=$num_frames \
+  --num_points=$num_points \
+  --noisy_matches_format=$matches_format \
+  --exhaustive \
+  --seed=0 || exit 1
+
+# Scenarios.
+rm -f $records
+
+run_scenario tracking \
+  $bin_dir/detect-and-track \
+  $data_dir/images/view01/%07d.png \
+  $work_dir/tracks.yaml \
+  --display=false
+
+run_scenario matching \
+  $bin_dir/matches-to-multiview-tracks \
+  $matches_format \
+  $views_file \
+  $num_frames \
+  $work_dir/multiview-tracks.yaml \
+  --simultaneous \
+  --consistent
+
+run_scenario clustering \
+  $bin_dir/agglomerative-cluster \
+  $work_dir/multiview-tracks.yaml \
+  $matches_format \
+  $keypoints_format \
+  $data_dir/cameras/%s.yaml \
+  $views_file \
+  $num_frames \
+  $work_dir/clustered-tracks.yaml
+
+# Keep the least time and memory of each stage over the repeats.
+awk -F '\t' '
+  BEGIN { n = 0 }
+
+  {
+    key = $1 "\t" $2
+    if (!(key in order)) {
+      order[key] = n
+      keys[n] = key
+      n += 1
+    }
+    if ($3 != "" && (!(key in seconds) || $3 < seconds[key])) {
+      seconds[key] = $3
+    }
+    if ($4 != "" && (!(key in peak_mb) || $4 < peak_mb[key])) {
+      peak_mb[key] = $4
+    }
+  }
+
+  END {
+    print "["
+    for (i = 0; i < n; i += 1) {
+      key = keys[i]
+      split(key, parts, "\t")
+      line = sprintf("  {\"scenario\": \"%s\", \"stage\": \"%s\"", parts[1],
+          parts[2])
+      if (key in seconds) {
+        line = line sprintf(", \"seconds\": %.4f", seconds[key])
+      }
+      if (key in peak_mb) {
+        line = line sprintf(", \"peak_mb\": %.1f", peak_mb[key])
+      }
+      line = line "}"
+      print line (i + 1 < n ? "," : "")
+    }
+    print "]"
+  }' $records > $results
+
+echo "Wrote $results"
+
+if [ $mode == "update" ]
+then
+  cp $results $baseline
+  echo "Updated baseline $baseline"
+  exit
+fi
+
+compare $results $baseline $time_tolerance $memory_tolerance
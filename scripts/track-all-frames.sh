@@ -13,18 +13,7 @@ image_format=$1
 keypoints_format=$2
 tracks_format=$3
 
-(( i = 1 ))
-while [ -e `printf $image_format $i` ]
-do
-  keypoints=`printf $keypoints_format $i`
-  tracks=`printf $tracks_format $i`
-
-  echo $i
-  (( n = i - 1 ))
-  ./track-features-bidirectional $image_format $n $keypoints $tracks
-
-  # Get some whitespace up in here.
-  echo ""
-
-  (( i += 1 ))
-done
+# One process tracks from every frame which has keypoints, so that each image
+# is only read and differentiated once.
+./track-features-bidir --all_frames --num_threads=`nproc` \
+  $image_format $keypoints_format $tracks_format
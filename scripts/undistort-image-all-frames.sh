@@ -11,17 +11,7 @@ calib=$2
 frame_format=$3
 movie=$4
 
-(( i = 1 ))
-while [ -e `printf $image_format $i` ]
-do
-  echo $i
-
-  image=`printf $image_format $i`
-  frame=`printf $frame_format $i`
-
-  ./undistort-image $image $calib -nodisplay -save -output_file=$frame
-
-  (( i += 1 ))
-done
+# Computes the undistortion maps once for every frame.
+./undistort-image -all_frames $image_format $calib $frame_format
 
 ffmpeg -y -sameq -i $frame_format $movie
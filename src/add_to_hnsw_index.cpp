@@ -0,0 +1,107 @@
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "descriptor_matrix.hpp"
+#include "hnsw_index.hpp"
+#include "feature_files.hpp"
+#include "read_lines.hpp"
+
+DEFINE_int32(max_neighbors, 16,
+    "Neighbours of each descriptor in the graph, if the index is new");
+DEFINE_int32(construction_ef, 200,
+    "Candidates explored when adding each descriptor, if the index is new");
+DEFINE_int32(search_ef, 64,
+    "Candidates explored by each search, if the index is new");
+DEFINE_int32(seed, 0, "Seed of the levels of the graph, if the index is new");
+DEFINE_string(sources, "",
+    "Append the file, first number and count of each set of descriptors to "
+    "this list");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Adds descriptors to a graph index, which is created if it does "
+      "not exist. Descriptors are numbered in the order they are added." <<
+      std::endl;
+  usage << std::endl;
+  usage << argv[0] << " descriptor-files index" << std::endl;
+  usage << std::endl;
+  usage << "descriptor-files -- Input. One descriptor file per line." <<
+      std::endl;
+  usage << "index -- Input and output. HNSW index." << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string descriptor_files_file = argv[1];
+  std::string index_file = argv[2];
+
+  bool ok;
+
+  std::vector<std::string> descriptor_files;
+  ok = readLines(descriptor_files_file, descriptor_files);
+  CHECK(ok) << "Could not load list of descriptor files";
+
+  HnswIndex index;
+  if (std::ifstream(index_file.c_str())) {
+    ok = index.load(index_file);
+    CHECK(ok) << "Could not load index";
+    LOG(INFO) << "Loaded index of " << index.size() << " descriptors";
+  }
+
+  std::ofstream sources;
+  if (!FLAGS_sources.empty()) {
+    sources.open(FLAGS_sources.c_str(), std::ios::app);
+    CHECK(sources) << "Could not open list of sources";
+  }
+
+  std::vector<std::string>::const_iterator file;
+  for (file = descriptor_files.begin(); file != descriptor_files.end();
+       ++file) {
+    DescriptorMatrix descriptors;
+    ok = loadDescriptorMatrix(*file, descriptors);
+    CHECK(ok) << "Could not load descriptors \"" << *file << "\"";
+
+    if (index.dimension() == 0 && !descriptors.empty()) {
+      HnswOptions options;
+      options.max_neighbors = FLAGS_max_neighbors;
+      options.construction_ef = FLAGS_construction_ef;
+      options.search_ef = FLAGS_search_ef;
+      options.seed = FLAGS_seed;
+      index = HnswIndex(descriptors.cols(), options);
+    }
+
+    int first = index.size();
+    index.add(descriptors);
+    LOG(INFO) << "Added " << descriptors.rows() << " descriptors of \"" <<
+        *file << "\"";
+    if (sources.is_open()) {
+      sources << *file << " " << first << " " << descriptors.rows() <<
+          std::endl;
+    }
+  }
+
+  // Write to a temporary file so that a crash leaves the previous index.
+  std::string temporary = index_file + ".tmp";
+  ok = index.save(temporary) &&
+      std::rename(temporary.c_str(), index_file.c_str()) == 0;
+  CHECK(ok) << "Could not save index";
+  LOG(INFO) << "Saved index of " << index.size() << " descriptors";
+
+  return 0;
+}
@@ -18,6 +18,7 @@
 #include "track_list_writer.hpp"
 #include "sift_position_reader.hpp"
 #include "writer.hpp"
+#include "util/thread-pool.hpp"
 
 typedef std::vector<SiftPosition> KeypointList;
 
@@ -50,6 +51,65 @@ std::string makeFilename(const std::string& format, int n) {
   return boost::str(boost::format(format) % (n + 1));
 }
 
+// Keypoints in frame u and matches between frames (u - 1, u).
+struct Frame {
+  KeypointList keypoints;
+  std::vector<Match> matches;
+  bool ok;
+
+  Frame() : keypoints(), matches(), ok(false) {}
+
+  void swap(Frame& other) {
+    keypoints.swap(other.keypoints);
+    matches.swap(other.matches);
+    std::swap(ok, other.ok);
+  }
+};
+
+// Loads a frame, which is not complete unless ok is set.
+void loadFrame(const std::string& keypoints_format,
+               const std::string& matches_format,
+               int u,
+               Frame* frame) {
+  frame->keypoints.clear();
+  frame->matches.clear();
+  frame->ok = false;
+
+  std::string keypoints_file = makeFilename(keypoints_format, u);
+  SiftPositionReader feature_reader;
+  if (!loadList(keypoints_file, frame->keypoints, feature_reader)) {
+    std::cerr << "could not load keypoints" << std::endl;
+    return;
+  }
+
+  if (u > 0) {
+    std::string matches_file = makeFilename(matches_format, u - 1);
+    MatchReader match_reader;
+    if (!loadList(matches_file, frame->matches, match_reader)) {
+      return;
+    }
+  }
+
+  frame->ok = true;
+}
+
+typedef Track<IndexedFeature> IndexedTrack;
+// Active tracks indexed by their keypoint in the latest frame. Empty if the
+// keypoint is not in a track.
+typedef std::vector<IndexedTrack> ActiveTracks;
+
+// Writes every track which is still active and empties them.
+void flushTracks(ActiveTracks& active_tracks,
+                 TrackListStreamWriter<IndexedFeature>& writer) {
+  ActiveTracks::iterator track;
+  for (track = active_tracks.begin(); track != active_tracks.end(); ++track) {
+    if (!track->empty()) {
+      writer.write(*track);
+      track->clear();
+    }
+  }
+}
+
 int main(int argc, char** argv) {
   std::ostringstream usage;
   usage << "Creates tracks from matches between adjacent frames." << std::endl;
@@ -73,79 +133,78 @@ int main(int argc, char** argv) {
   std::string keypoints_format = argv[2];
   std::string tracks_file = argv[3];
 
-  TrackList<IndexedFeature> tracks;
+  IndexedFeatureWriter feature_writer;
+  TrackListStreamWriter<IndexedFeature> writer(feature_writer);
+  bool ok = writer.open(tracks_file);
+  CHECK(ok) << "Could not save tracks to file";
+
+  // Frame u + 1 is read in the background while frame u is chained.
+  ThreadPool prefetch(1);
+  Frame frame;
+  Frame next_frame;
+  loadFrame(keypoints_format, matches_format, 0, &next_frame);
 
-  bool ok = true;
   // Examine frames (u - 1, u).
   int u = 0;
 
-  typedef std::map<int, int> Lookup;
-  Lookup previous_active_tracks;
+  ActiveTracks previous_active_tracks;
   KeypointList previous_keypoints;
 
-  while (ok) {
-    // Load keypoints.
-    KeypointList keypoints;
-    std::string keypoints_file = makeFilename(keypoints_format, u);
-    SiftPositionReader feature_reader;
-    ok = loadList(keypoints_file, keypoints, feature_reader);
-    if (!ok) {
-      std::cerr << "could not load keypoints" << std::endl;
-      continue;
+  while (true) {
+    prefetch.wait();
+    frame.swap(next_frame);
+    if (!frame.ok) {
+      break;
     }
+    prefetch.schedule(boost::bind(loadFrame, keypoints_format,
+        matches_format, u + 1, &next_frame));
 
+    const KeypointList& keypoints = frame.keypoints;
     int t = u - 1;
+    ActiveTracks active_tracks(keypoints.size());
 
     if (t >= 0) {
       std::cout << "(" << t << ", " << u << ")" << std::endl;
 
-      // Load matches.
-      typedef std::vector<Match> MatchList;
-      MatchList matches;
-      std::string matches_file = makeFilename(matches_format, t);
-
-      MatchReader match_reader;
-      ok = loadList(matches_file, matches, match_reader);
-      if (!ok) {
-        continue;
-      }
-
-      Lookup active_tracks;
-
       // Iterate through the matches.
-      MatchList::const_iterator match;
-      for (match = matches.begin(); match != matches.end(); ++match) {
+      std::vector<Match>::const_iterator match;
+      for (match = frame.matches.begin(); match != frame.matches.end();
+          ++match) {
         // Match associates keypoints (a, b).
         int a = match->first;
         int b = match->second;
 
+        IndexedTrack& track = active_tracks[b];
+        if (!track.empty()) {
+          // Keypoint was already matched in this frame: keep the last.
+          writer.write(track);
+          track.clear();
+        }
+
         // Find whether keypoint was matched in the previous frame.
-        Lookup::const_iterator previous_track = previous_active_tracks.find(a);
-        if (previous_track != previous_active_tracks.end()) {
+        IndexedTrack& previous_track = previous_active_tracks[a];
+        if (!previous_track.empty()) {
           // It was: extend the track.
-          int index = previous_track->second;
-          tracks[index][u] = IndexedFeature(b, keypoints[b]);
-          active_tracks[b] = index;
+          track.swap(previous_track);
         } else {
           // It wasn't: create a new track.
-          tracks.push_back(Track<IndexedFeature>());
-          tracks.back()[t] = IndexedFeature(a, previous_keypoints[a]);
-          tracks.back()[u] = IndexedFeature(b, keypoints[b]);
-          active_tracks[b] = tracks.size() - 1;
+          track[t] = IndexedFeature(a, previous_keypoints[a]);
         }
+        track.insert(track.end(),
+            std::make_pair(u, IndexedFeature(b, keypoints[b])));
       }
-
-      previous_active_tracks.swap(active_tracks);
     }
 
-    previous_keypoints.swap(keypoints);
+    // Tracks which were not extended have ended.
+    flushTracks(previous_active_tracks, writer);
+    previous_active_tracks.swap(active_tracks);
+    previous_keypoints.swap(frame.keypoints);
     u += 1;
   }
 
-  // Write out matches.
-  IndexedFeatureWriter writer;
-  ok = saveTrackList(tracks_file, tracks, writer);
-  CHECK(ok) << "Could not save tracks to file";
+  flushTracks(previous_active_tracks, writer);
+  writer.close();
+  LOG(INFO) << "Wrote " << writer.size() << " tracks";
 
   return 0;
 }
@@ -1,115 +1,380 @@
 #include "admm_tracking.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <glog/logging.h>
 #include "util.hpp"
+#include "viterbi.hpp"
+#include "util/thread-pool.hpp"
 
-#include <opencv2/highgui/highgui.hpp>
-
-void findBestResponse(const cv::Point2d& z,
-                      const cv::Point2d& u,
-                      const cv::Mat& response,
-                      double rho,
-                      cv::Point2d& x) {
-  cv::Size size = response.size();
-
-  cv::Point2d v = z - u;
-
-  // Compute distance from v.
-  cv::Mat distance = cv::Mat_<double>(size);
-  for (int i = 0; i < size.height; i += 1) {
-    for (int j = 0; j < size.width; j += 1) {
-      distance.at<double>(i, j) = sqr(v.x - j) + sqr(v.y - i);
-    }
-  }
-
-  // Add distance to response.
-  cv::Mat cost = response + rho / 2. * distance;
-
-  // Find minimum.
-  double min;
-  cv::Point loc;
-  cv::minMaxLoc(cost, &min, NULL, &loc, NULL);
-  cv::Point2d p = loc;
+namespace {
 
+// Limits the step from the best pixel p towards v to half a pixel.
+cv::Point2d restrictToTrustRegion(const cv::Point2d& p, const cv::Point2d& v) {
   // Vector from p to v.
   cv::Point2d r = v - p;
 
-  // Restrict to half-pixel trust region.
   double d = cv::norm(r);
   if (d > 0.5) {
-    x = p + 0.5 / d * r;
+    return p + 0.5 / d * r;
   } else {
-    x = v;
+    return v;
   }
 }
 
-// x is nx1, u is nx1, z is nx1
-void findSmoothestPath(const cv::Mat& x,
-                       const cv::Mat& u,
-                       double rho,
-                       double lambda,
-                       cv::Mat& z) {
-  int n = x.total();
+// What is kept about each frame between iterations.
+struct AdmmFrame {
+  double minimum;
+  // Minimizer of response(p) + rho / 2 |p - q|^2 for every pixel q.
+  cv::Mat args;
+  // Penalty for which args was computed, zero if it has not been.
+  double args_rho;
 
-  // Set up big linear system.
-  cv::Mat D = cv::Mat_<double>(n - 1, n, 0.);
-  for (int t = 0; t < n; t += 1) {
-    D.at<double>(t, t) = 1;
-    D.at<double>(t, t + 1) = -1;
-  }
+  AdmmFrame() : minimum(0), args(), args_rho(0) {}
+};
 
-  cv::Mat I = cv::Mat_<double>::eye(n, n);
-  cv::Mat A = I + 2. * lambda / rho * D.t() * D;
-  cv::Mat v = x + u;
+// Computes the x-update of one frame, argmin_p response(p) + rho/2 |p - v|^2
+// with v = z - u.
+//
+// Searches a window around v first. The minimum over the window is exact if
+// it is no greater than the minimum of the response plus the cost of
+// reaching the nearest pixel outside. Otherwise the minimizer for the pixel
+// nearest v is taken from a distance transform of the response, which is
+// re-computed only when rho changes.
+class UpdateFrame {
+  public:
+    UpdateFrame(const std::vector<cv::Mat>& responses,
+                std::vector<AdmmFrame>& frames,
+                const cv::Mat& z,
+                const cv::Mat& u,
+                double rho,
+                int window_radius,
+                cv::Mat& x)
+        : responses_(&responses),
+          frames_(&frames),
+          z_(&z),
+          u_(&u),
+          rho_(rho),
+          window_radius_(window_radius),
+          x_(&x) {}
+
+    void operator()(int t) const {
+      const cv::Mat& response = (*responses_)[t];
+      AdmmFrame& frame = (*frames_)[t];
+      int width = response.cols;
+      int height = response.rows;
+
+      cv::Point2d v(z_->at<double>(t, 0) - u_->at<double>(t, 0),
+                    z_->at<double>(t, 1) - u_->at<double>(t, 1));
+      // Nearest pixel.
+      int j = std::min(std::max(int(std::floor(v.x + 0.5)), 0), width - 1);
+      int i = std::min(std::max(int(std::floor(v.y + 0.5)), 0), height - 1);
+
+      bool found = false;
+      cv::Point p;
+
+      if (window_radius_ > 0) {
+        int j0 = std::max(j - window_radius_, 0);
+        int j1 = std::min(j + window_radius_, width - 1);
+        int i0 = std::max(i - window_radius_, 0);
+        int i1 = std::min(i + window_radius_, height - 1);
+
+        double best = 0;
+        for (int y = i0; y <= i1; y += 1) {
+          const double* row = response.ptr<double>(y);
+          for (int x = j0; x <= j1; x += 1) {
+            double cost = row[x] + rho_ / 2. * (sqr(v.x - x) + sqr(v.y - y));
+            if ((y == i0 && x == j0) || cost < best) {
+              best = cost;
+              p = cv::Point(x, y);
+            }
+          }
+        }
+
+        // Distance from v to the nearest pixel outside the window.
+        double distance = std::numeric_limits<double>::infinity();
+        if (j0 > 0) {
+          distance = std::min(distance, std::max(v.x - (j0 - 1), 0.));
+        }
+        if (j1 < width - 1) {
+          distance = std::min(distance, std::max((j1 + 1) - v.x, 0.));
+        }
+        if (i0 > 0) {
+          distance = std::min(distance, std::max(v.y - (i0 - 1), 0.));
+        }
+        if (i1 < height - 1) {
+          distance = std::min(distance, std::max((i1 + 1) - v.y, 0.));
+        }
+
+        found = (best <= frame.minimum + rho_ / 2. * sqr(distance));
+      }
+
+      if (!found) {
+        if (frame.args_rho != rho_) {
+          cv::Mat d;
+          gridDistanceTransform2D(response,
+              GridCost(GridCost::QUADRATIC, rho_ / 2.), d, frame.args);
+          frame.args_rho = rho_;
+        }
+        const cv::Vec2i& arg = frame.args.at<cv::Vec2i>(i, j);
+        p = cv::Point(arg[1], arg[0]);
+      }
+
+      cv::Point2d x_t = restrictToTrustRegion(p, v);
+      x_->at<double>(t, 0) = x_t.x;
+      x_->at<double>(t, 1) = x_t.y;
+    }
+
+  private:
+    const std::vector<cv::Mat>* responses_;
+    std::vector<AdmmFrame>* frames_;
+    const cv::Mat* z_;
+    const cv::Mat* u_;
+    double rho_;
+    int window_radius_;
+    cv::Mat* x_;
+};
 
-  z = A.inv() * v;
 }
 
-double findClassifierTrackAdmm(const std::vector<cv::Mat>& responses,
+namespace {
+
+// Solves (I + c D^T D) z = v, where D is the n - 1 x n difference operator,
+// for many v. The matrix is tridiagonal, so it is factored as L diag(d) L^T
+// with L unit lower bidiagonal once and each solve is O(n).
+class SmoothPathSolver {
+  public:
+    SmoothPathSolver() : l_(), d_() {}
+
+    void factor(int n, double c) {
+      l_.assign(n, 0);
+      d_.assign(n, 0);
+
+      for (int t = 0; t < n; t += 1) {
+        // Number of differences which involve z_t.
+        int degree = (t > 0 ? 1 : 0) + (t < n - 1 ? 1 : 0);
+        double a = 1 + c * degree;
+
+        if (t == 0) {
+          d_[t] = a;
+        } else {
+          l_[t] = -c / d_[t - 1];
+          d_[t] = a - c * c / d_[t - 1];
+        }
+      }
+    }
+
+    // v and z are n x 1 and may be columns of larger matrices.
+    void solve(const cv::Mat& v, cv::Mat& z) const {
+      int n = d_.size();
+      std::vector<double> y(n);
+
+      for (int t = 0; t < n; t += 1) {
+        y[t] = v.at<double>(t, 0);
+        if (t > 0) {
+          y[t] -= l_[t] * y[t - 1];
+        }
+      }
+
+      for (int t = n - 1; t >= 0; t -= 1) {
+        double z_t = y[t] / d_[t];
+        if (t < n - 1) {
+          z_t -= l_[t + 1] * z.at<double>(t + 1, 0);
+        }
+        z.at<double>(t, 0) = z_t;
+      }
+    }
+
+  private:
+    std::vector<double> l_;
+    std::vector<double> d_;
+};
+
+}
+
+AdmmTrackingOptions::AdmmTrackingOptions()
+    : window_radius(8),
+      max_iterations(1000),
+      absolute_tolerance(1e-4),
+      relative_tolerance(1e-3),
+      adapt_rho(true),
+      residual_ratio(10),
+      rho_factor(2) {}
+
+AdmmTrackingState::AdmmTrackingState() : z(), u(), rho(0) {}
+
+namespace {
+
+// Starts from and updates the state. Runs the x-update in parallel if a pool
+// is given.
+bool resumeClassifierTrackAdmm(const std::vector<cv::Mat>& responses,
                                std::vector<cv::Point2d>& positions,
                                double lambda,
-                               double rho) {
+                               double rho,
+                               const AdmmTrackingOptions& options,
+                               AdmmTrackingState& state,
+                               ThreadPool* pool) {
   int n = responses.size();
+  CHECK(n > 0);
+  if (!state.z.empty()) {
+    CHECK(state.z.cols == 2);
+    CHECK(state.u.rows == state.z.rows && state.u.cols == 2);
+    rho = state.rho;
+  }
+  CHECK(rho > 0);
 
-  // Guess Lagrange multipliers to all be zero.
+  // Frames which are not in the state start from their best response.
+  int m = std::min(n, state.z.rows);
+  std::vector<AdmmFrame> frames(n);
   cv::Mat x = cv::Mat_<double>(n, 2, 0.);
-  // Initialize track positions to origin.
-  cv::Mat z = cv::Mat_<double>(n, 2, 0.);
-  // Smoothest path will also be origin.
+  for (int t = 0; t < n; t += 1) {
+    CHECK(responses[t].type() == cv::DataType<double>::type);
+    cv::Point loc;
+    cv::minMaxLoc(responses[t], &frames[t].minimum, NULL, &loc, NULL);
+    x.at<double>(t, 0) = loc.x;
+    x.at<double>(t, 1) = loc.y;
+  }
+  cv::Mat z = x.clone();
+  // Scaled Lagrange multipliers.
   cv::Mat u = cv::Mat_<double>(n, 2, 0.);
+  if (m > 0) {
+    cv::Mat z_m = z.rowRange(0, m);
+    cv::Mat u_m = u.rowRange(0, m);
+    state.z.rowRange(0, m).copyTo(z_m);
+    state.u.rowRange(0, m).copyTo(u_m);
+  }
 
-  while (true) {
-    // Solve first sub-problem.
-    for (int t = 0; t < n; t += 1) {
-      cv::Point2d z_t(z.at<double>(t, 0), z.at<double>(t, 1));
-      cv::Point2d u_t(u.at<double>(t, 0), u.at<double>(t, 1));
+  // The same factorization solves for both coordinates until rho changes.
+  SmoothPathSolver solver;
+  solver.factor(n, 2. * lambda / rho);
 
-      cv::Point2d x_t;
-      findBestResponse(z_t, u_t, responses[t], rho, x_t);
+  double tolerance = std::sqrt(2. * n) * options.absolute_tolerance;
+  bool converged = false;
+  int iteration = 0;
 
-      x.at<double>(t, 0) = x_t.x;
-      x.at<double>(t, 1) = x_t.y;
+  while (!converged && iteration < options.max_iterations) {
+    // Solve first sub-problem.
+    UpdateFrame update(responses, frames, z, u, rho, options.window_radius, x);
+    if (pool == NULL || pool->numThreads() == 0) {
+      for (int t = 0; t < n; t += 1) {
+        update(t);
+      }
+    } else {
+      pool->parallelFor(0, n, update);
     }
-    LOG(INFO) << "x-update:";
-    LOG(INFO) << "norm(x - z) => " << cv::norm(x - z) / n;
 
     // Solve second sub-problem.
+    cv::Mat z_old = z.clone();
+    cv::Mat v = x + u;
     for (int d = 0; d < 2; d += 1) {
-      cv::Mat dst = z.col(d);
-      findSmoothestPath(x.col(d), u.col(d), rho, lambda, dst);
+      cv::Mat z_d = z.col(d);
+      solver.solve(v.col(d), z_d);
     }
-    LOG(INFO) << "z-update:";
-    LOG(INFO) << "norm(x - z) => " << cv::norm(x - z);
 
     // Update multipliers.
     u += x - z;
+    iteration += 1;
+
+    double r = cv::norm(x - z);
+    double s = rho * cv::norm(z - z_old);
+    double epsilon_primal = tolerance + options.relative_tolerance *
+        std::max(cv::norm(x), cv::norm(z));
+    double epsilon_dual = tolerance + options.relative_tolerance * rho *
+        cv::norm(u);
+    DLOG(INFO) << "iteration " << iteration << ": rho => " << rho <<
+        ", norm(r) => " << r << ", norm(s) => " << s;
+
+    if (r <= epsilon_primal && s <= epsilon_dual) {
+      converged = true;
+    } else if (options.adapt_rho) {
+      // Balance the residuals. The scaled multipliers change with rho.
+      if (r > options.residual_ratio * s) {
+        rho *= options.rho_factor;
+        u /= options.rho_factor;
+        solver.factor(n, 2. * lambda / rho);
+      } else if (s > options.residual_ratio * r) {
+        rho /= options.rho_factor;
+        u *= options.rho_factor;
+        solver.factor(n, 2. * lambda / rho);
+      }
+    }
+  }
 
-    LOG(INFO) << "x[0] => " << x.row(0);
-    LOG(INFO) << "z[0] => " << z.row(0);
-    LOG(INFO);
-    LOG(INFO) << "x[1] => " << x.row(1);
-    LOG(INFO) << "z[1] => " << z.row(1);
-    LOG(INFO);
-    LOG(INFO) << "x[2] => " << x.row(2);
-    LOG(INFO) << "z[2] => " << z.row(2);
-    LOG(INFO);
+  if (converged) {
+    LOG(INFO) << "ADMM converged after " << iteration << " iterations";
+  } else {
+    LOG(WARNING) << "ADMM did not converge in " << iteration << " iterations";
   }
+
+  positions.clear();
+  for (int t = 0; t < n; t += 1) {
+    positions.push_back(cv::Point2d(z.at<double>(t, 0), z.at<double>(t, 1)));
+  }
+
+  state.z = z;
+  state.u = u;
+  state.rho = rho;
+
+  return converged;
+}
+
+bool findClassifierTrackAdmm(const std::vector<cv::Mat>& responses,
+                             std::vector<cv::Point2d>& positions,
+                             double lambda,
+                             double rho,
+                             const AdmmTrackingOptions& options,
+                             ThreadPool* pool) {
+  AdmmTrackingState state;
+  return resumeClassifierTrackAdmm(responses, positions, lambda, rho, options,
+      state, pool);
+}
+
+}
+
+bool findClassifierTrackAdmm(const std::vector<cv::Mat>& responses,
+                             std::vector<cv::Point2d>& positions,
+                             double lambda,
+                             double rho,
+                             const AdmmTrackingOptions& options) {
+  return findClassifierTrackAdmm(responses, positions, lambda, rho, options,
+      NULL);
+}
+
+bool findClassifierTrackAdmm(const std::vector<cv::Mat>& responses,
+                             std::vector<cv::Point2d>& positions,
+                             double lambda,
+                             double rho,
+                             const AdmmTrackingOptions& options,
+                             ThreadPool& pool) {
+  return findClassifierTrackAdmm(responses, positions, lambda, rho, options,
+      &pool);
+}
+
+bool findClassifierTrackAdmm(const std::vector<cv::Mat>& responses,
+                             std::vector<cv::Point2d>& positions,
+                             double lambda,
+                             double rho) {
+  return findClassifierTrackAdmm(responses, positions, lambda, rho,
+      AdmmTrackingOptions(), NULL);
+}
+
+bool resumeClassifierTrackAdmm(const std::vector<cv::Mat>& responses,
+                               std::vector<cv::Point2d>& positions,
+                               double lambda,
+                               double rho,
+                               const AdmmTrackingOptions& options,
+                               AdmmTrackingState& state) {
+  return resumeClassifierTrackAdmm(responses, positions, lambda, rho, options,
+      state, NULL);
+}
+
+bool resumeClassifierTrackAdmm(const std::vector<cv::Mat>& responses,
+                               std::vector<cv::Point2d>& positions,
+                               double lambda,
+                               double rho,
+                               const AdmmTrackingOptions& options,
+                               AdmmTrackingState& state,
+                               ThreadPool& pool) {
+  return resumeClassifierTrackAdmm(responses, positions, lambda, rho, options,
+      state, &pool);
 }
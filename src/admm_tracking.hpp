@@ -4,9 +4,87 @@
 #include <vector>
 #include <opencv2/core/core.hpp>
 
-double findClassifierTrackAdmm(const std::vector<cv::Mat>& responses,
+class ThreadPool;
+
+struct AdmmTrackingOptions {
+  // The x-update searches this far around the previous iterate before
+  // falling back to a distance transform of the whole response. Zero always
+  // uses the distance transform.
+  int window_radius;
+  // Gives up after this many iterations.
+  int max_iterations;
+  // Converged when the primal and dual residuals are below
+  // sqrt(2n) absolute_tolerance + relative_tolerance * (size of iterates).
+  double absolute_tolerance;
+  double relative_tolerance;
+  // Multiply or divide rho by rho_factor whenever one residual is more than
+  // residual_ratio times the other.
+  bool adapt_rho;
+  double residual_ratio;
+  double rho_factor;
+
+  AdmmTrackingOptions();
+};
+
+// Iterates and penalty of a previous solve, from which the next solve starts.
+//
+// z is the smoothed track and u the scaled multipliers, one row (x, y) per
+// frame. Both are empty before the first solve.
+struct AdmmTrackingState {
+  cv::Mat z;
+  cv::Mat u;
+  double rho;
+
+  AdmmTrackingState();
+};
+
+// Finds the track which minimizes
+//   sum_t response_t(x_t) + lambda sum_t |x_{t + 1} - x_t|^2
+// using ADMM with penalty rho. Positions are (x, y) in the response images.
+//
+// The smoothing step of each iteration is O(n). The x-update of each frame
+// searches a window, or looks up a distance transform of the response which
+// is computed once for each value of rho. Returns false if the residuals did
+// not converge, in which case positions is the last iterate.
+bool findClassifierTrackAdmm(const std::vector<cv::Mat>& responses,
+                             std::vector<cv::Point2d>& positions,
+                             double lambda,
+                             double rho,
+                             const AdmmTrackingOptions& options);
+// Updates the frames in parallel.
+bool findClassifierTrackAdmm(const std::vector<cv::Mat>& responses,
+                             std::vector<cv::Point2d>& positions,
+                             double lambda,
+                             double rho,
+                             const AdmmTrackingOptions& options,
+                             ThreadPool& pool);
+// Uses the default options.
+bool findClassifierTrackAdmm(const std::vector<cv::Mat>& responses,
+                             std::vector<cv::Point2d>& positions,
+                             double lambda,
+                             double rho);
+
+// Like findClassifierTrackAdmm() but starts from a previous solution, which is
+// then replaced with the new one. After a seed or a few responses change,
+// far fewer iterations are needed than from scratch.
+//
+// If the state holds fewer frames than there are responses, the new frames
+// at the end start from their best response with zero multipliers, so a
+// window can grow as frames arrive. Extra frames in the state are dropped.
+// rho is only used if the state is empty.
+bool resumeClassifierTrackAdmm(const std::vector<cv::Mat>& responses,
+                               std::vector<cv::Point2d>& positions,
+                               double lambda,
+                               double rho,
+                               const AdmmTrackingOptions& options,
+                               AdmmTrackingState& state);
+// Updates the frames in parallel.
+bool resumeClassifierTrackAdmm(const std::vector<cv::Mat>& responses,
                                std::vector<cv::Point2d>& positions,
                                double lambda,
-                               double rho);
+                               double rho,
+                               const AdmmTrackingOptions& options,
+                               AdmmTrackingState& state,
+                               ThreadPool& pool);
 
 #endif
@@ -1,29 +1,21 @@
 #include <iostream>
 #include <string>
 #include <sstream>
-#include <stack>
-#include <map>
-#include <set>
-#include <algorithm>
+#include <vector>
 #include <glog/logging.h>
 #include <gflags/gflags.h>
 #include <boost/lexical_cast.hpp>
 #include <boost/format.hpp>
-#include <boost/bind.hpp>
-#include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/graph_traits.hpp>
-#include <boost/property_map/property_map.hpp>
-#include <opencv2/core/core.hpp>
 
+#include "agglomerative_clustering.hpp"
+#include "camera.hpp"
 #include "match_result.hpp"
 #include "multiview_track.hpp"
 #include "multiview_track_list.hpp"
-#include "feature_index.hpp"
-#include "match_graph.hpp"
-#include "feature_sets.hpp"
-#include "find_smooth_trajectory.hpp"
 #include "sift_position.hpp"
-#include "camera.hpp"
+#include "util/memory.hpp"
+#include "util/thread-pool.hpp"
+#include "util/trace.hpp"
 
 #include "read_lines.hpp"
 #include "multiview_track_list_reader.hpp"
@@ -38,16 +30,30 @@
 #include "iterator_writer.hpp"
 #include "default_writer.hpp"
 
-typedef boost::property_map<MatchGraph, boost::edge_weight_t>::const_type
-        EdgeWeightMap;
-
-typedef MatchGraph::vertex_descriptor Vertex;
-typedef std::map<FeatureIndex, int> VertexLookup;
-typedef std::set<Vertex> VertexSet;
-
-typedef std::vector<SiftPosition> FeatureList;
-typedef std::deque<FeatureList> MultiviewFeatureList;
-typedef std::deque<MultiviewFeatureList> MultiviewVideoFeatureList;
+DEFINE_int32(num_threads, 4,
+    "Number of worker threads to load files and connect sets with, 0 for "
+    "none");
+DEFINE_int32(max_files_in_flight, 64,
+    "Maximum number of files which are loaded at once");
+DEFINE_string(checkpoint, "",
+    "Periodically save the state of clustering to this file");
+DEFINE_int32(checkpoint_interval, 600,
+    "Minimum number of seconds between checkpoints");
+DEFINE_bool(resume, false,
+    "Resume clustering from the checkpoint file, if it exists");
+DEFINE_int32(num_partitions, 1,
+    "Number of windows of frames to split clustering into, e.g. one per "
+    "machine");
+DEFINE_int32(partition, -1,
+    "Cluster only the matches within this window of frames, from zero");
+DEFINE_string(partition_tracks_format, "",
+    "Tracks of every partition, taking the partition number. If given, "
+    "clusters only the matches between partitions, starting from these");
+DEFINE_int32(memory_budget, 0,
+    "Megabytes which the pairs of sets may take before they are sorted on "
+    "disk, 0 for no limit");
+DEFINE_string(trace, "",
+    "File to write a trace of memory use to, if built with tracing");
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -57,6 +63,9 @@ void init(int& argc, char**& argv) {
   usage << std::endl;
   usage << argv[0] << " initial-tracks matches-format keypoints-format "
       "cameras-format view-names num-frames tracks" << std::endl;
+  usage << std::endl;
+  usage << "With --num_partitions, run once with each --partition, then once "
+      "with --partition_tracks_format to join the partitions." << std::endl;
   google::SetUsageMessage(usage.str());
 
   google::InitGoogleLogging(argv[0]);
@@ -66,6 +75,18 @@ void init(int& argc, char**& argv) {
     google::ShowUsageWithFlags(argv[0]);
     std::exit(1);
   }
+  CHECK(!FLAGS_resume || !FLAGS_checkpoint.empty()) <<
+      "Resuming requires a checkpoint file";
+  CHECK(FLAGS_memory_budget >= 0) << "Memory budget must not be negative";
+  if (FLAGS_num_partitions > 1) {
+    CHECK((FLAGS_partition >= 0) != !FLAGS_partition_tracks_format.empty()) <<
+        "Partitions need either --partition or --partition_tracks_format";
+    CHECK(FLAGS_partition < FLAGS_num_partitions) <<
+        "Partition is out of range";
+  } else {
+    CHECK(FLAGS_partition < 0 && FLAGS_partition_tracks_format.empty()) <<
+        "Partitions need --num_partitions";
+  }
 }
 
 std::string makeMatchFilename(const std::string& format,
@@ -88,303 +109,79 @@ std::string makeViewFilename(const std::string& format,
   return boost::str(boost::format(format) % view);
 }
 
-Vertex findOrInsert(MatchGraph& graph,
-                    VertexLookup& vertices,
-                    const FeatureIndex& feature) {
-  Vertex vertex;
-
-  // Try to find feature in lookup map.
-  VertexLookup::const_iterator mapping = vertices.find(feature);
-
-  if (mapping != vertices.end()) {
-    // Found the vertex, it already exists.
-    vertex = mapping->second;
-  } else {
-    // Did not find it, create an entry.
-    vertex = boost::add_vertex(graph);
-    graph[vertex] = feature;
-    // Create an entry in the lookup table too.
-    vertices[feature] = vertex;
-  }
-
-  return vertex;
+std::string makePartitionFilename(const std::string& format, int partition) {
+  return boost::str(boost::format(format) % partition);
 }
 
-void loadAllMatches(const std::string& matches_format,
-                    const std::vector<std::string>& views,
-                    int num_frames,
-                    MatchGraph& graph,
-                    VertexLookup& vertices) {
-  vertices.clear();
-
-  int num_views = views.size();
-  int n = num_views * num_frames;
-  int num_matches = 0;
-
-  for (int i1 = 0; i1 < n; i1 += 1) {
-    // Match all unique pairs.
-    for (int i2 = i1 + 1; i2 < n; i2 += 1) {
-      // Extract view and time indices.
-      int t1 = i1 % num_frames;
-      int t2 = i2 % num_frames;
-      int v1 = i1 / num_frames;
-      int v2 = i2 / num_frames;
-
-      // Construct filename.
-      std::string matches_file = makeMatchFilename(matches_format, views[v1],
-          views[v2], t1, t2);
-
-      // Load matches from file.
-      std::vector<MatchResult> match_list;
-      MatchResultReader reader;
-      bool ok = loadList(matches_file, match_list, reader);
-      CHECK(ok) << "Could not load matches";
-      DLOG(INFO) << "Loaded " << match_list.size() << " matches for (" <<
-          views[v1] << ", " << t1 << "), (" << views[v2] << ", " << t2 << ")";
-      num_matches += match_list.size();
-
-      // Add matches to map.
-      ImageIndex frame1(v1, t1);
-      ImageIndex frame2(v2, t2);
-
-      std::vector<MatchResult>::const_iterator match;
-      for (match = match_list.begin(); match != match_list.end(); ++match) {
-        FeatureIndex feature1(frame1, match->index1);
-        FeatureIndex feature2(frame2, match->index2);
-
-        // Find existing vertex for feature, or insert one.
-        Vertex vertex1 = findOrInsert(graph, vertices, feature1);
-        Vertex vertex2 = findOrInsert(graph, vertices, feature2);
-
-        // Add vertex to graph. Set edge weight to distance.
-        MatchGraphEdgeProperty edge(match->distance);
-        boost::add_edge(vertex1, vertex2, edge, graph);
-      }
+// Appends the tracks of every partition.
+bool loadPartitionTracks(const std::string& format,
+                         int num_partitions,
+                         MultiviewTrackList<int>& tracks) {
+  for (int k = 0; k < num_partitions; k += 1) {
+    std::string file = makePartitionFilename(format, k);
+    MultiviewTrackList<int> partition_tracks;
+    DefaultReader<int> reader;
+    if (!loadMultiviewTrackList(file, partition_tracks, reader)) {
+      LOG(WARNING) << "Could not load tracks of partition `" << file << "'";
+      return false;
     }
-  }
-}
 
-class CompareEdges {
-  public:
-    CompareEdges(const MatchGraph& graph) : weights_() {
-      weights_ = boost::get(boost::edge_weight_t(), graph);
+    if (k == 0) {
+      tracks = MultiviewTrackList<int>(partition_tracks.numViews());
     }
-
-    bool operator()(const MatchGraph::edge_descriptor& lhs,
-                    const MatchGraph::edge_descriptor& rhs) {
-      return weights_[lhs] > weights_[rhs];
+    for (int i = 0; i < partition_tracks.numTracks(); i += 1) {
+      tracks.push_back(MultiviewTrack<int>());
+      tracks.back().swap(partition_tracks.track(i));
     }
-
-  private:
-    EdgeWeightMap weights_;
-};
-
-void subsetToTrack(const MatchGraph& graph,
-                   const std::map<ImageIndex, int>& set,
-                   MultiviewTrack<int>& track,
-                   int num_views) {
-  track = MultiviewTrack<int>(num_views);
-
-  std::map<ImageIndex, int>::const_iterator feature;
-  for (feature = set.begin(); feature != set.end(); ++feature) {
-    const FeatureIndex& index = graph[feature->second];
-    track.view(index.view)[index.time] = index.id;
-  }
-}
-
-// The set property is not important.
-// TODO: Is there a way to avoid templating this code?
-template<class T>
-void subsetsToTracks(const MatchGraph& graph,
-                     const FeatureSets<T>& sets,
-                     MultiviewTrackList<int>& tracks,
-                     int num_views) {
-  tracks = MultiviewTrackList<int>(num_views);
-
-  typename FeatureSets<T>::const_iterator set;
-  for (set = sets.begin(); set != sets.end(); ++set) {
-    MultiviewTrack<int> track;
-    subsetToTrack(graph, set->second.elements, track, num_views);
-
-    tracks.push_back(MultiviewTrack<int>());
-    tracks.back().swap(track);
   }
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-struct Edge {
-  Vertex source;
-  Vertex target;
-  double weight;
-
-  Edge(Vertex source, Vertex target, double weight);
-
-  bool operator<(const Edge& other) const;
-
-  static Edge make(MatchGraph::edge_descriptor edge, const MatchGraph& graph);
-};
-
-Edge::Edge(Vertex source, Vertex target, double weight)
-    : source(source), target(target), weight(weight) {}
-
-bool Edge::operator<(const Edge& other) const {
-  return weight > other.weight;
-}
-
-Edge Edge::make(MatchGraph::edge_descriptor edge, const MatchGraph& graph) {
-  EdgeWeightMap weights = boost::get(boost::edge_weight_t(), graph);
 
-  Vertex source = boost::source(edge, graph);
-  Vertex target = boost::target(edge, graph);
-  double weight = weights[edge];
-
-  return Edge(source, target, weight);
+  return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-// The properties of joining two sets.
-struct TrackProperties {
-  double appearance;
-  double reprojection_error;
-  double non_smoothness;
-  double uncertainty;
-};
-
-// The properties associated with a set.
-struct SetProperties {
-  // Each set has an index.
-  int index;
-  // For each set, store a compatibility with connected sets.
-  std::map<int, TrackProperties> merges;
-};
-
-TrackProperties computeTrackProperties(
-    const MultiviewTrack<PointObservation>& observations) {
-  return TrackProperties();
-}
-
-TrackProperties computeVertexSetProperties(
-    const MultiviewTrack<Camera>& cameras,
-    const MultiviewVideoFeatureList& positions,
-    const MatchGraph& graph,
-    const std::set<int>& vertices) {
-  int num_views = cameras.numViews();
-  MultiviewTrack<PointObservation> observations(num_views);
-
-  // Assemble cameras and points into "observations" structure.
-  std::set<int>::const_iterator vertex;
-  for (vertex = vertices.begin(); vertex != vertices.end(); ++vertex) {
-    const FeatureIndex& feature = graph[*vertex];
-
-    // Get cameras for this view.
-    const Track<Camera>& view_cameras = cameras.view(feature.view);
-    // Get camera for this (view, time).
-    Track<Camera>::const_iterator camera = view_cameras.find(feature.time);
-    // Ensure that the camera is defined.
-    if (camera == view_cameras.end()) {
-      LOG(WARNING) << "Skipping frame with undefined camera";
-    } else {
-      cv::Matx34d matrix = camera->second.matrix();
-
-      // Get points for this time.
-      CHECK(0 <= feature.time && feature.time < int(positions.size()));
-      const MultiviewFeatureList& frame_points = positions[feature.time];
-      // Get points for this (view, time).
-      CHECK(0 <= feature.view && feature.view < int(frame_points.size()));
-      const FeatureList& image_points = frame_points[feature.view];
-      // Get point.
-      CHECK(0 <= feature.id && feature.id < int(image_points.size()));
-      cv::Point2d point = image_points[feature.id].point();
-
-      PointObservation observation;
-      observation.P = matrix;
-      observation.w = point;
-
-      observations.view(feature.view)[feature.time] = observation;
-    }
-  }
-
-  return computeTrackProperties(observations);
-}
-
-template<class Key, class Value>
-void addMapValuesToSet(const std::map<Key, Value>& map, std::set<Value>& set) {
-  typename std::map<Key, Value>::const_iterator pair;
-  for (pair = map.begin(); pair != map.end(); ++pair) {
-    set.insert(pair->second);
-  }
-}
-
-TrackProperties computeMergeProperties(
-    const MultiviewTrack<Camera>& cameras,
-    const MultiviewVideoFeatureList& positions,
-    const MatchGraph& graph,
-    const std::map<ImageIndex, int>& vertices1,
-    const std::map<ImageIndex, int>& vertices2) {
-  std::set<int> vertices;
-
-  addMapValuesToSet(vertices1, vertices);
-  addMapValuesToSet(vertices1, vertices);
-
-  return computeVertexSetProperties(cameras, positions, graph, vertices);
-}
-
-bool loadFeatures(const std::string& view,
-                  int time,
-                  FeatureList& features,
-                  const std::string& format) {
-  features.clear();
-  std::string file = makeImageFilename(format, view, time);
-  SiftPositionReader reader;
-  return loadList(file, features, reader);
-}
-
-bool loadMultiviewFeatures(const std::vector<std::string>& views,
-                           int time,
-                           MultiviewFeatureList& multiview_features,
-                           const std::string& format) {
-  multiview_features.clear();
+// Reads the matches and keypoints of clustering from files.
+class FileClusteringInput : public ClusteringInput {
+  public:
+    FileClusteringInput(const std::vector<std::string>& views,
+                        const std::string& matches_format,
+                        const std::string& keypoints_format)
+        : views_(&views),
+          matches_format_(&matches_format),
+          keypoints_format_(&keypoints_format) {}
+
+    bool loadMatches(const ImagePair& pair,
+                     std::vector<MatchResult>& matches) const {
+      std::string file = makeMatchFilename(*matches_format_,
+          (*views_)[pair.first.view], (*views_)[pair.second.view],
+          pair.first.time, pair.second.time);
 
-  std::vector<std::string>::const_iterator view;
-  for (view = views.begin(); view != views.end(); ++view) {
-    // Load features for this (view, time).
-    FeatureList features;
-    bool ok = loadFeatures(*view, time, features, format);
-    if (!ok) {
-      return false;
+      MatchResultReader reader;
+      if (!loadList(file, matches, reader)) {
+        LOG(WARNING) << "Could not load matches from `" << file << "'";
+        return false;
+      }
+      return true;
     }
 
-    // Swap into list.
-    multiview_features.push_back(FeatureList());
-    multiview_features.back().swap(features);
-  }
-
-  return true;
-}
-
-bool loadMultiviewVideoFeatures(const std::vector<std::string>& views,
-                                int num_frames,
-                                MultiviewVideoFeatureList& video_features,
-                                const std::string& format) {
-  video_features.clear();
-
-  for (int t = 0; t < num_frames; t += 1) {
-    // Load features for this time.
-    MultiviewFeatureList features;
-    bool ok = loadMultiviewFeatures(views, t, features, format);
-    if (!ok) {
-      return false;
+    bool loadKeypoints(const ImageIndex& image,
+                       std::vector<SiftPosition>& keypoints) const {
+      keypoints.clear();
+      std::string file = makeImageFilename(*keypoints_format_,
+          (*views_)[image.view], image.time);
+      SiftPositionReader reader;
+      if (!loadList(file, keypoints, reader)) {
+        LOG(WARNING) << "Could not load keypoints from `" << file << "'";
+        return false;
+      }
+      return true;
     }
 
-    // Swap into list.
-    video_features.push_back(MultiviewFeatureList());
-    video_features.back().swap(features);
-  }
-
-  return true;
-}
+  private:
+    const std::vector<std::string>* views_;
+    const std::string* matches_format_;
+    const std::string* keypoints_format_;
+};
 
 bool loadCameras(const std::vector<std::string>& views,
                  const std::string& format,
@@ -419,6 +216,8 @@ bool loadCameras(const std::vector<std::string>& views,
 
 int main(int argc, char** argv) {
   init(argc, argv);
+  TRACE_INIT(FLAGS_trace);
+  MEMORY_STAGES(stages);
 
   std::string initial_tracks_file = argv[1];
   std::string matches_format = argv[2];
@@ -434,170 +233,57 @@ int main(int argc, char** argv) {
   std::vector<std::string> views;
   ok = readLines(view_names_file, views);
   CHECK(ok) << "Could not load view names";
-  int num_views = views.size();
 
-  // Load position of every feature in every frame.
-  LOG(INFO) << "Loading keypoints for all frames";
-  MultiviewVideoFeatureList positions;
-  ok = loadMultiviewVideoFeatures(views, num_frames, positions,
-      keypoints_format);
-  CHECK(ok) << "Could not load keypoints";
+  ClusteringOptions options;
+  options.num_partitions = FLAGS_num_partitions;
+  options.partition = FLAGS_partition;
+  options.memory_budget = size_t(FLAGS_memory_budget) << 20;
+  options.max_files_in_flight = FLAGS_max_files_in_flight;
+  options.checkpoint = FLAGS_checkpoint;
+  options.checkpoint_interval = FLAGS_checkpoint_interval;
+  options.resume = FLAGS_resume;
+  if (FLAGS_partition >= 0) {
+    LOG(INFO) << "Clustering partition " << FLAGS_partition << " of " <<
+        FLAGS_num_partitions << ", frames " <<
+        firstFrameOfPartition(FLAGS_partition, num_frames,
+            FLAGS_num_partitions) + 1 << " to " <<
+        firstFrameOfPartition(FLAGS_partition + 1, num_frames,
+            FLAGS_num_partitions);
+  }
 
   // Load cameras.
+  MEMORY_NEXT_STAGE(stages, "load cameras");
   MultiviewTrack<Camera> cameras;
   LOG(INFO) << "Loading cameras for all frames";
   ok = loadCameras(views, cameras_format, cameras);
   CHECK(ok) << "Could not load cameras";
 
   // Load initial tracks.
+  MEMORY_NEXT_STAGE(stages, "load initial track list");
   MultiviewTrackList<int> initial_tracks;
   DefaultReader<int> int_reader;
   ok = loadMultiviewTrackList(initial_tracks_file, initial_tracks, int_reader);
   CHECK(ok) << "Could not load initial tracks";
 
-  // Load all matches into graph.
-  MatchGraph graph;
-  VertexLookup lookup;
-  LOG(INFO) << "Loading matches between image";
-  loadAllMatches(matches_format, views, num_frames, graph, lookup);
-  int num_vertices = boost::num_vertices(graph);
-  int num_edges = boost::num_edges(graph);
-  LOG(INFO) << "Loaded " << num_edges << " matches between " << num_vertices <<
-      " features";
-
-  FeatureSets<SetProperties> sets;
-
-  // Build a list containing the frame of every vertex.
-  std::vector<ImageIndex> frames;
-  {
-    MatchGraph::vertex_iterator vertex;
-    MatchGraph::vertex_iterator end;
-    boost::tie(vertex, end) = boost::vertices(graph);
-
-    for(; vertex != end; ++vertex) {
-      const FeatureIndex& feature = graph[*vertex];
-      frames.push_back(ImageIndex(feature.view, feature.time));
-    }
-  }
-
-  sets.init(frames, initial_tracks, lookup);
-
-  LOG(INFO) << "Initially " << num_vertices << " vertices amongst " <<
-      sets.count() << " sets";
-
-  LOG(INFO) << "Building edge list";
-  std::vector<Edge> edges;
-  {
-    MatchGraph::edge_iterator begin;
-    MatchGraph::edge_iterator end;
-    boost::tie(begin, end) = boost::edges(graph);
-    std::transform(begin, end, std::back_inserter(edges),
-        boost::bind(Edge::make, _1, graph));
+  // The boundary pass starts from the tracks of every partition.
+  MultiviewTrackList<int> partition_tracks;
+  if (!FLAGS_partition_tracks_format.empty()) {
+    ok = loadPartitionTracks(FLAGS_partition_tracks_format,
+        FLAGS_num_partitions, partition_tracks);
+    CHECK(ok) << "Could not load tracks of partitions";
   }
 
-  // Initialize index of every set.
-  LOG(INFO) << "Initializing set indices";
-  {
-    FeatureSets<SetProperties>::const_iterator set;
-    int index = 0;
-
-    for (set = sets.begin(); set != sets.end(); ++set) {
-      // Get one vertex in the set.
-      int vertex = set->second.elements.begin()->second;
-      // Obtain write-access to the set properties using the vertex.
-      SetProperties& properties = sets.property(vertex);
-
-      properties.index = index;
-
-      index += 1;
-    }
-  }
-
-  // Set the appearance of each pair of sets to the minimum edge distance.
-  LOG(INFO) << "Initializing connectivity of sets";
-  {
-    std::vector<Edge>::const_iterator edge;
-    for (edge = edges.begin(); edge != edges.end(); ++edge) {
-      // Only proceed if the edge joins two sets.
-      if (!sets.together(edge->source, edge->target)) {
-        // Get the two sets which the edge joins.
-        SetProperties& properties1 = sets.property(edge->source);
-        SetProperties& properties2 = sets.property(edge->target);
-
-        std::map<int, TrackProperties>& merges1 = properties1.merges;
-        std::map<int, TrackProperties>& merges2 = properties2.merges;
-
-        // Check if the two sets have already been connected by an edge.
-        if (merges1.find(properties2.index) == merges1.end()) {
-          // Not connected yet.
-          CHECK(merges2.find(properties1.index) == merges2.end());
-
-          // Compute merge properties.
-          TrackProperties properties = computeMergeProperties(cameras,
-              positions, graph, sets.find(edge->source).elements,
-              sets.find(edge->target).elements);
-
-          // Create connection.
-          TrackProperties& merge1 = merges1[properties2.index];
-          TrackProperties& merge2 = merges2[properties1.index];
-
-          merge1.appearance = edge->weight;
-          merge2.appearance = edge->weight;
-        } else {
-          // Already connected.
-          CHECK(merges2.find(properties1.index) != merges2.end());
-          TrackProperties& merge1 = merges1[properties2.index];
-          TrackProperties& merge2 = merges2[properties1.index];
-
-          // Check if this appearance is better.
-          CHECK(merge1.appearance == merge2.appearance);
-          if (edge->weight < merge1.appearance) {
-            merge1.appearance = edge->weight;
-            merge2.appearance = edge->weight;
-          }
-        }
-      }
-    }
-  }
-
-  LOG(INFO) << "Building heap";
-  std::make_heap(edges.begin(), edges.end());
-
-  LOG(INFO) << "Begin clustering";
-  while (!edges.empty()) {
-    // Pull the first edge off the heap.
-    Edge edge = edges.front();
-    std::pop_heap(edges.begin(), edges.end());
-    edges.pop_back();
-
-    // Skip if elements are already in the same set.
-    if (!sets.together(edge.source, edge.target)) {
-      DLOG(INFO) << "(" << edge.source << ", " << edge.target << ") => " <<
-          edge.weight;
-
-      // Only merge if sets are compatible.
-      if (sets.compatible(edge.source, edge.target)) {
-        sets.join(edge.source, edge.target);
-        DLOG(INFO) << "Merged: " << sets.count() << " sets";
-
-        // TODO: Compute set properties...
-      } else {
-        DLOG(INFO) << "Inconsistent";
-      }
-    }
-  }
-
-  LOG(INFO) << "Split " << num_vertices << " vertices into " << sets.count() <<
-      " sets";
-
-  // Convert each consistent subgraph to a multi-view track of indices.
+  MEMORY_NEXT_STAGE(stages, "cluster");
+  FileClusteringInput input(views, matches_format, keypoints_format);
+  ThreadPool pool(FLAGS_num_threads);
   MultiviewTrackList<int> tracks;
-  subsetsToTracks(graph, sets, tracks, num_views);
+  clusterTracks(input, cameras, num_frames, initial_tracks, partition_tracks,
+      options, pool, tracks);
 
   // Save.
   DefaultWriter<int> writer;
   ok = saveMultiviewTrackList(tracks_file, tracks, writer);
   CHECK(ok) << "Could not save tracks file";
-  
+
   return 0;
 }
@@ -0,0 +1,1098 @@
+#include "agglomerative_clustering.hpp"
+#include <algorithm>
+#include <ctime>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <glog/logging.h>
+#include "clustering_checkpoint.hpp"
+#include "external_sort.hpp"
+#include "feature_index.hpp"
+#include "feature_index_map.hpp"
+#include "feature_sets.hpp"
+#include "find_smooth_trajectory.hpp"
+#include "match_graph.hpp"
+#include "parallel_load.hpp"
+#include "util/memory.hpp"
+
+typedef FeatureIndexMap<int> VertexLookup;
+typedef std::vector<SiftPosition> FeatureList;
+
+// Edges or pairs of sets per task.
+const int PAIR_GRAIN_SIZE = 4096;
+
+ClusteringOptions::ClusteringOptions()
+    : num_partitions(1),
+      partition(-1),
+      memory_budget(0),
+      max_files_in_flight(64),
+      checkpoint(),
+      checkpoint_interval(600),
+      resume(false) {}
+
+int partitionOfFrame(int time, int num_frames, int num_partitions) {
+  return int(int64_t(time) * num_partitions / num_frames);
+}
+
+int firstFrameOfPartition(int partition, int num_frames, int num_partitions) {
+  return int((int64_t(partition) * num_frames + num_partitions - 1) /
+      num_partitions);
+}
+
+void listPartitionPairs(int num_views,
+                        int num_frames,
+                        int num_partitions,
+                        int p,
+                        int q,
+                        std::vector<ImagePair>& pairs) {
+  pairs.clear();
+
+  // Images are numbered view-major. Each is paired with the later images
+  // of the other partition, so that every pair is listed once.
+  int n = num_views * num_frames;
+  for (int i1 = 0; i1 < n; i1 += 1) {
+    ImageIndex frame1(i1 / num_frames, i1 % num_frames);
+    int partition = partitionOfFrame(frame1.time, num_frames, num_partitions);
+    if (partition != p && partition != q) {
+      continue;
+    }
+    int other = (partition == p) ? q : p;
+    int first = firstFrameOfPartition(other, num_frames, num_partitions);
+    int last = firstFrameOfPartition(other + 1, num_frames, num_partitions);
+
+    for (int view = frame1.view; view < num_views; view += 1) {
+      for (int time = first; time < last; time += 1) {
+        if (view * num_frames + time > i1) {
+          pairs.push_back(ImagePair(frame1, ImageIndex(view, time)));
+        }
+      }
+    }
+  }
+}
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Removes the features which are not vertices, and the tracks left empty.
+void keepTrackVertices(const VertexLookup& vertices,
+                       MultiviewTrackList<int>& tracks) {
+  MultiviewTrackList<int> kept(tracks.numViews());
+
+  for (int i = 0; i < tracks.numTracks(); i += 1) {
+    const MultiviewTrack<int>& track = tracks.track(i);
+    MultiviewTrack<int> subset(tracks.numViews());
+
+    MultiviewTrack<int>::ConstFeatureIterator iter(track);
+    for (iter.begin(); !iter.end(); iter.next()) {
+      ImageIndex frame = iter.get().first;
+      int id = *iter.get().second;
+      if (vertices.find(FeatureIndex(frame, id)) != NULL) {
+        subset.view(frame.view)[frame.time] = id;
+      }
+    }
+
+    if (subset.numImageFeatures() > 0) {
+      kept.push_back(MultiviewTrack<int>());
+      kept.back().swap(subset);
+    }
+  }
+
+  tracks.swap(kept);
+}
+
+// Makes every feature of the tracks a vertex, with or without matches.
+void addTrackVertices(const MultiviewTrackList<int>& tracks,
+                      std::vector<FeatureIndex>& features,
+                      VertexLookup& vertices) {
+  MultiviewTrackList<int>::const_iterator track;
+  for (track = tracks.begin(); track != tracks.end(); ++track) {
+    MultiviewTrack<int>::ConstFeatureIterator iter(*track);
+    for (iter.begin(); !iter.end(); iter.next()) {
+      FeatureIndex feature(iter.get().first, *iter.get().second);
+      if (vertices.insert(feature, features.size()).second) {
+        features.push_back(feature);
+      }
+    }
+  }
+}
+
+// Loads the matches of one pair of images per index.
+class MatchResultLoader : public IndexedLoader<std::vector<MatchResult> > {
+  public:
+    MatchResultLoader(const ClusteringInput& input,
+                      const std::vector<ImagePair>& pairs)
+        : input_(&input), pairs_(&pairs) {}
+
+    bool load(int index, std::vector<MatchResult>& matches) const {
+      const ImagePair& pair = (*pairs_)[index];
+      if (!input_->loadMatches(pair, matches)) {
+        return false;
+      }
+      DLOG(INFO) << "Loaded " << matches.size() << " matches for " <<
+          pair.first << ", " << pair.second;
+      return true;
+    }
+
+  private:
+    const ClusteringInput* input_;
+    const std::vector<ImagePair>* pairs_;
+};
+
+// Assigns a vertex to every feature and appends the matches of each pair as
+// edges, in order.
+class MatchEdgeSink : public SequenceSink<std::vector<MatchResult> > {
+  public:
+    MatchEdgeSink(const std::vector<ImagePair>& pairs,
+                  std::vector<FeatureIndex>& features,
+                  std::vector<MatchGraphEdge>& edges,
+                  VertexLookup& vertices)
+        : pairs_(&pairs),
+          index_(0),
+          features_(&features),
+          edges_(&edges),
+          vertices_(&vertices) {}
+
+    void add(std::vector<MatchResult>& matches) {
+      const ImagePair& pair = (*pairs_)[index_];
+      index_ += 1;
+
+      std::vector<MatchResult>::const_iterator match;
+      for (match = matches.begin(); match != matches.end(); ++match) {
+        // Find existing vertex for feature, or insert one.
+        int vertex1 = findOrInsert(FeatureIndex(pair.first, match->index1));
+        int vertex2 = findOrInsert(FeatureIndex(pair.second, match->index2));
+
+        // Set edge weight to distance.
+        edges_->push_back(MatchGraphEdge(vertex1, vertex2, match->distance));
+      }
+    }
+
+  private:
+    int findOrInsert(const FeatureIndex& feature) {
+      // Reserve an entry in the lookup table, filled in if the feature is new.
+      std::pair<int*, bool> mapping = vertices_->insert(feature, 0);
+
+      if (mapping.second) {
+        *mapping.first = features_->size();
+        features_->push_back(feature);
+      }
+
+      return *mapping.first;
+    }
+
+    const std::vector<ImagePair>* pairs_;
+    int index_;
+    std::vector<FeatureIndex>* features_;
+    std::vector<MatchGraphEdge>* edges_;
+    VertexLookup* vertices_;
+};
+
+// Loads the matches between the pairs of images as edges. Files are parsed
+// by the threads of the pool. Features which are not yet vertices become
+// vertices.
+void loadMatchEdges(const ClusteringInput& input,
+                    const std::vector<ImagePair>& pairs,
+                    int max_files_in_flight,
+                    std::vector<FeatureIndex>& features,
+                    VertexLookup& vertices,
+                    std::vector<MatchGraphEdge>& edges,
+                    ThreadPool& pool) {
+  edges.clear();
+  MatchResultLoader loader(input, pairs);
+  MatchEdgeSink sink(pairs, features, edges, vertices);
+  bool ok = loadInParallel(pool, pairs.size(), loader, sink,
+      max_files_in_flight);
+  CHECK(ok) << "Could not load matches";
+}
+
+// Orders vertices by image, time-major, as the keypoints are loaded.
+class EarlierImage {
+  public:
+    explicit EarlierImage(const std::vector<FeatureIndex>& features)
+        : features_(&features) {}
+
+    bool operator()(int lhs, int rhs) const {
+      const FeatureIndex& a = (*features_)[lhs];
+      const FeatureIndex& b = (*features_)[rhs];
+      if (a.time != b.time) {
+        return a.time < b.time;
+      }
+      return a.view < b.view;
+    }
+
+  private:
+    const std::vector<FeatureIndex>* features_;
+};
+
+// Loads the keypoints of image (v, first_frame + t) as item t * num_views + v.
+class KeypointLoader : public IndexedLoader<FeatureList> {
+  public:
+    KeypointLoader(const ClusteringInput& input,
+                   int num_views,
+                   int first_frame)
+        : input_(&input), num_views_(num_views), first_frame_(first_frame) {}
+
+    bool load(int index, FeatureList& keypoints) const {
+      ImageIndex image(index % num_views_, first_frame_ + index / num_views_);
+      return input_->loadKeypoints(image, keypoints);
+    }
+
+  private:
+    const ClusteringInput* input_;
+    int num_views_;
+    int first_frame_;
+};
+
+// Takes the position of each vertex from the keypoints of its image as the
+// images arrive, then lets the keypoints go.
+class VertexPositionSink : public SequenceSink<FeatureList> {
+  public:
+    VertexPositionSink(const std::vector<FeatureIndex>& features,
+                       const std::vector<int>& order,
+                       int num_views,
+                       int first_frame,
+                       std::vector<SiftPosition>& positions)
+        : features_(&features),
+          order_(&order),
+          num_views_(num_views),
+          first_frame_(first_frame),
+          index_(0),
+          next_(0),
+          positions_(&positions) {}
+
+    void add(FeatureList& keypoints) {
+      ImageIndex image(index_ % num_views_, first_frame_ + index_ / num_views_);
+      index_ += 1;
+
+      while (next_ < int(order_->size())) {
+        int vertex = (*order_)[next_];
+        const FeatureIndex& feature = (*features_)[vertex];
+        if (feature.view != image.view || feature.time != image.time) {
+          break;
+        }
+        CHECK(0 <= feature.id && feature.id < int(keypoints.size())) <<
+            "Feature " << feature.id << " is not a keypoint of image " <<
+            image;
+        (*positions_)[vertex] = keypoints[feature.id];
+        next_ += 1;
+      }
+    }
+
+    int numFound() const {
+      return next_;
+    }
+
+  private:
+    const std::vector<FeatureIndex>* features_;
+    const std::vector<int>* order_;
+    int num_views_;
+    int first_frame_;
+    int index_;
+    int next_;
+    std::vector<SiftPosition>* positions_;
+};
+
+// Finds the position of every vertex. The keypoints of frames [first_frame,
+// last_frame) are streamed, so that only those of the files in flight are
+// held at once.
+void loadVertexPositions(const ClusteringInput& input,
+                         const std::vector<FeatureIndex>& features,
+                         int num_views,
+                         int first_frame,
+                         int last_frame,
+                         int max_files_in_flight,
+                         std::vector<SiftPosition>& positions,
+                         ThreadPool& pool) {
+  int num_vertices = features.size();
+  std::vector<int> order(num_vertices);
+  for (int i = 0; i < num_vertices; i += 1) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), EarlierImage(features));
+
+  positions.assign(num_vertices, SiftPosition());
+  KeypointLoader loader(input, num_views, first_frame);
+  VertexPositionSink sink(features, order, num_views, first_frame,
+      positions);
+  bool ok = loadInParallel(pool, num_views * (last_frame - first_frame),
+      loader, sink, max_files_in_flight);
+  CHECK(ok) << "Could not load keypoints";
+  CHECK(sink.numFound() == num_vertices) <<
+      "Some features are not in the frames which were loaded";
+}
+
+void subsetToTrack(const std::vector<FeatureIndex>& features,
+                   const std::map<ImageIndex, int>& set,
+                   MultiviewTrack<int>& track,
+                   int num_views) {
+  track = MultiviewTrack<int>(num_views);
+
+  std::map<ImageIndex, int>::const_iterator feature;
+  for (feature = set.begin(); feature != set.end(); ++feature) {
+    const FeatureIndex& index = features[feature->second];
+    track.view(index.view)[index.time] = index.id;
+  }
+}
+
+// The set property is not important.
+template<class T>
+void subsetsToTracks(const std::vector<FeatureIndex>& features,
+                     const FeatureSets<T>& sets,
+                     MultiviewTrackList<int>& tracks,
+                     int num_views) {
+  tracks = MultiviewTrackList<int>(num_views);
+
+  typename FeatureSets<T>::const_iterator set;
+  for (set = sets.begin(); set != sets.end(); ++set) {
+    MultiviewTrack<int> track;
+    subsetToTrack(features, set->second.elements, track, num_views);
+
+    tracks.push_back(MultiviewTrack<int>());
+    tracks.back().swap(track);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The closest match between two sets, identified by their initial indices.
+struct SetPair {
+  int set1;
+  int set2;
+  double weight;
+
+  SetPair() : set1(-1), set2(-1), weight(0) {}
+  SetPair(int set1, int set2, double weight)
+      : set1(set1), set2(set2), weight(weight) {}
+};
+
+// Orders by pair then weight, so that the closest match of each pair is first.
+bool pairThenWeight(const SetPair& lhs, const SetPair& rhs) {
+  if (lhs.set1 != rhs.set1) {
+    return lhs.set1 < rhs.set1;
+  } else if (lhs.set2 != rhs.set2) {
+    return lhs.set2 < rhs.set2;
+  } else {
+    return lhs.weight < rhs.weight;
+  }
+}
+
+bool samePair(const SetPair& lhs, const SetPair& rhs) {
+  return lhs.set1 == rhs.set1 && lhs.set2 == rhs.set2;
+}
+
+// Orders pairs so that the top of a heap is the closest match.
+bool longerPair(const SetPair& lhs, const SetPair& rhs) {
+  return lhs.weight > rhs.weight;
+}
+
+bool shorterPair(const SetPair& lhs, const SetPair& rhs) {
+  return lhs.weight < rhs.weight;
+}
+
+typedef bool (*SetPairOrder)(const SetPair&, const SetPair&);
+typedef ExternalSorter<SetPair, SetPairOrder> SetPairSorter;
+
+bool isWithinSet(const SetPair& pair) {
+  return pair.set1 < 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The properties of joining two sets.
+struct TrackProperties {
+  double appearance;
+  double reprojection_error;
+  double non_smoothness;
+  double uncertainty;
+};
+
+// The properties associated with a set.
+struct SetProperties {
+  // Each set has an index.
+  int index;
+  // For each set, store a compatibility with connected sets.
+  std::map<int, TrackProperties> merges;
+};
+
+TrackProperties computeTrackProperties(
+    const MultiviewTrack<PointObservation>& observations) {
+  return TrackProperties();
+}
+
+TrackProperties computeVertexSetProperties(
+    const MultiviewTrack<Camera>& cameras,
+    const std::vector<FeatureIndex>& features,
+    const std::vector<SiftPosition>& positions,
+    const std::set<int>& vertices) {
+  int num_views = cameras.numViews();
+  MultiviewTrack<PointObservation> observations(num_views);
+
+  // Assemble cameras and points into "observations" structure.
+  std::set<int>::const_iterator vertex;
+  for (vertex = vertices.begin(); vertex != vertices.end(); ++vertex) {
+    const FeatureIndex& feature = features[*vertex];
+
+    // Get cameras for this view.
+    const Track<Camera>& view_cameras = cameras.view(feature.view);
+    // Get camera for this (view, time).
+    Track<Camera>::const_iterator camera = view_cameras.find(feature.time);
+    // Ensure that the camera is defined.
+    if (camera == view_cameras.end()) {
+      LOG(WARNING) << "Skipping frame with undefined camera";
+    } else {
+      PointObservation observation;
+      observation.P = camera->second.matrix();
+      observation.w = positions[*vertex].point();
+
+      observations.view(feature.view)[feature.time] = observation;
+    }
+  }
+
+  return computeTrackProperties(observations);
+}
+
+template<class Key, class Value>
+void addMapValuesToSet(const std::map<Key, Value>& map, std::set<Value>& set) {
+  typename std::map<Key, Value>::const_iterator pair;
+  for (pair = map.begin(); pair != map.end(); ++pair) {
+    set.insert(pair->second);
+  }
+}
+
+TrackProperties computeMergeProperties(
+    const MultiviewTrack<Camera>& cameras,
+    const std::vector<FeatureIndex>& features,
+    const std::vector<SiftPosition>& positions,
+    const std::map<ImageIndex, int>& vertices1,
+    const std::map<ImageIndex, int>& vertices2) {
+  std::set<int> vertices;
+
+  addMapValuesToSet(vertices1, vertices);
+  addMapValuesToSet(vertices2, vertices);
+
+  return computeVertexSetProperties(cameras, features, positions, vertices);
+}
+
+// Combines the properties of joining a set to each of two sets which are
+// being joined. The appearance is the closest match.
+void combineMergeProperties(TrackProperties& merge,
+                            const TrackProperties& other) {
+  if (other.appearance < merge.appearance) {
+    merge = other;
+  }
+}
+
+// Labels the edges which join two sets with the pair of sets. Edges within a
+// set are labelled with no pair.
+// Edges from first on are labelled into pairs from zero.
+class LabelEdges {
+  public:
+    LabelEdges(const std::vector<MatchGraphEdge>& edges,
+               const std::vector<int>& set_indices,
+               int first,
+               std::vector<SetPair>& pairs)
+        : edges_(&edges), set_indices_(&set_indices), first_(first),
+          pairs_(&pairs) {}
+
+    void operator()(int i) const {
+      const MatchGraphEdge& edge = (*edges_)[i];
+      int set1 = (*set_indices_)[edge.source];
+      int set2 = (*set_indices_)[edge.target];
+      SetPair& pair = (*pairs_)[i - first_];
+      if (set1 == set2) {
+        pair = SetPair();
+      } else {
+        pair = SetPair(std::min(set1, set2), std::max(set1, set2),
+            edge.weight);
+      }
+    }
+
+  private:
+    const std::vector<MatchGraphEdge>* edges_;
+    const std::vector<int>* set_indices_;
+    int first_;
+    std::vector<SetPair>* pairs_;
+};
+
+// Labels edges [first, first + num_edges) and keeps the closest match of
+// each pair of sets amongst them, sorted.
+void findSetPairsOfEdges(const std::vector<MatchGraphEdge>& edges,
+                         const std::vector<int>& set_indices,
+                         int first,
+                         int num_edges,
+                         std::vector<SetPair>& pairs,
+                         ThreadPool& pool) {
+  pairs.assign(num_edges, SetPair());
+  pool.parallelFor(first, first + num_edges,
+      LabelEdges(edges, set_indices, first, pairs), PAIR_GRAIN_SIZE);
+
+  std::vector<SetPair>::iterator end = std::remove_if(pairs.begin(),
+      pairs.end(), isWithinSet);
+  std::sort(pairs.begin(), end, pairThenWeight);
+  end = std::unique(pairs.begin(), end, samePair);
+  pairs.erase(end, pairs.end());
+}
+
+// Collects the closest match between every pair of sets joined by an edge,
+// from one group of edges after another. Labelling is parallel. Pairs are
+// sorted and unique.
+//
+// With a budget in bytes, the edges are labelled a budget at a time and
+// their pairs sorted on disk, instead of labelling every edge at once. The
+// pairs are then read back one at a time instead of all being taken.
+class SetPairFinder {
+  public:
+    SetPairFinder(size_t budget, ThreadPool& pool)
+        : budget_(budget),
+          pool_(&pool),
+          num_groups_(0),
+          pairs_(),
+          sorter_(budget / 2, pairThenWeight),
+          last_() {}
+
+    void add(const std::vector<MatchGraphEdge>& edges,
+             const std::vector<int>& set_indices) {
+      int num_edges = edges.size();
+      num_groups_ += 1;
+      if (budget_ == 0) {
+        std::vector<SetPair> pairs;
+        findSetPairsOfEdges(edges, set_indices, 0, num_edges, pairs, *pool_);
+        pairs_.insert(pairs_.end(), pairs.begin(), pairs.end());
+        return;
+      }
+
+      // Half for the edges being labelled, half for the buffer of the sorter.
+      int chunk = std::max(budget_ / 2 / sizeof(SetPair), size_t(1));
+      std::vector<SetPair> pairs;
+      for (int first = 0; first < num_edges; first += chunk) {
+        int n = std::min(chunk, num_edges - first);
+        findSetPairsOfEdges(edges, set_indices, first, n, pairs, *pool_);
+
+        std::vector<SetPair>::const_iterator pair;
+        for (pair = pairs.begin(); pair != pairs.end(); ++pair) {
+          sorter_.add(*pair);
+        }
+      }
+    }
+
+    // Ends adding.
+    void finish() {
+      if (budget_ == 0) {
+        // The pairs of one group are already sorted and unique.
+        if (num_groups_ > 1) {
+          std::sort(pairs_.begin(), pairs_.end(), pairThenWeight);
+          pairs_.erase(std::unique(pairs_.begin(), pairs_.end(), samePair),
+              pairs_.end());
+        }
+        return;
+      }
+
+      bool ok = sorter_.finish();
+      CHECK(ok) << "Could not sort pairs of sets on disk";
+    }
+
+    // Without a budget, takes every pair.
+    void take(std::vector<SetPair>& pairs) {
+      CHECK(budget_ == 0);
+      pairs.swap(pairs_);
+      std::vector<SetPair>().swap(pairs_);
+    }
+
+    // With a budget, returns the next pair, or false after the last.
+    bool next(SetPair& pair) {
+      CHECK(budget_ > 0);
+      // The closest match of each pair comes first.
+      while (sorter_.next(pair)) {
+        if (last_.set1 < 0 || !samePair(last_, pair)) {
+          last_ = pair;
+          return true;
+        }
+      }
+      return false;
+    }
+
+  private:
+    size_t budget_;
+    ThreadPool* pool_;
+    int num_groups_;
+    std::vector<SetPair> pairs_;
+    SetPairSorter sorter_;
+    // The last pair returned.
+    SetPair last_;
+};
+
+// Computes the properties of joining each pair of sets.
+class ComputeMergeProperties {
+  public:
+    ComputeMergeProperties(
+        const MultiviewTrack<Camera>& cameras,
+        const std::vector<FeatureIndex>& features,
+        const std::vector<SiftPosition>& positions,
+        const std::vector<const std::map<ImageIndex, int>*>& elements,
+        const std::vector<SetPair>& pairs,
+        std::vector<TrackProperties>& properties)
+        : cameras_(&cameras),
+          features_(&features),
+          positions_(&positions),
+          elements_(&elements),
+          pairs_(&pairs),
+          properties_(&properties) {}
+
+    void operator()(int i) const {
+      const SetPair& pair = (*pairs_)[i];
+      TrackProperties& properties = (*properties_)[i];
+      properties = computeMergeProperties(*cameras_, *features_, *positions_,
+          *(*elements_)[pair.set1], *(*elements_)[pair.set2]);
+      properties.appearance = pair.weight;
+    }
+
+  private:
+    const MultiviewTrack<Camera>* cameras_;
+    const std::vector<FeatureIndex>* features_;
+    const std::vector<SiftPosition>* positions_;
+    const std::vector<const std::map<ImageIndex, int>*>* elements_;
+    const std::vector<SetPair>* pairs_;
+    std::vector<TrackProperties>* properties_;
+};
+
+// Gives every set an index. The sets are not joined until the connections
+// are built, so their elements can be read concurrently.
+void indexSets(FeatureSets<SetProperties>& sets,
+               std::vector<int>& set_indices,
+               std::vector<int>& representatives,
+               std::vector<const std::map<ImageIndex, int>*>& elements) {
+  representatives.clear();
+  elements.clear();
+
+  FeatureSets<SetProperties>::const_iterator set;
+  for (set = sets.begin(); set != sets.end(); ++set) {
+    int index = representatives.size();
+    const std::map<ImageIndex, int>& members = set->second.elements;
+
+    std::map<ImageIndex, int>::const_iterator member;
+    for (member = members.begin(); member != members.end(); ++member) {
+      set_indices[member->second] = index;
+    }
+    representatives.push_back(members.begin()->second);
+    elements.push_back(&members);
+  }
+
+  for (int index = 0; index < int(representatives.size()); index += 1) {
+    sets.property(representatives[index]).index = index;
+  }
+}
+
+// Adds each of vertices [first, features.size()) in a set of its own, with
+// the next index.
+void addSingletonSets(const std::vector<FeatureIndex>& features,
+                      int first,
+                      FeatureSets<SetProperties>& sets,
+                      std::vector<int>& set_indices,
+                      std::vector<int>& representatives,
+                      std::vector<const std::map<ImageIndex, int>*>& elements) {
+  for (int vertex = first; vertex < int(features.size()); vertex += 1) {
+    const FeatureIndex& feature = features[vertex];
+    int added = sets.add(ImageIndex(feature.view, feature.time));
+    CHECK(added == vertex);
+
+    int index = representatives.size();
+    set_indices.push_back(index);
+    representatives.push_back(vertex);
+    elements.push_back(&sets.find(vertex).elements);
+    sets.property(vertex).index = index;
+  }
+}
+
+// Connects the sets which are joined by an edge. The properties of each
+// connection are computed once, in parallel.
+void initConnections(const MultiviewTrack<Camera>& cameras,
+                     const std::vector<FeatureIndex>& features,
+                     const std::vector<SiftPosition>& positions,
+                     const std::vector<const std::map<ImageIndex, int>*>&
+                         elements,
+                     const std::vector<int>& representatives,
+                     const std::vector<SetPair>& pairs,
+                     FeatureSets<SetProperties>& sets,
+                     ThreadPool& pool) {
+  int num_pairs = pairs.size();
+  std::vector<TrackProperties> properties(num_pairs);
+  pool.parallelFor(0, num_pairs, ComputeMergeProperties(cameras, features,
+        positions, elements, pairs, properties), PAIR_GRAIN_SIZE);
+
+  for (int i = 0; i < num_pairs; i += 1) {
+    const SetPair& pair = pairs[i];
+    sets.property(representatives[pair.set1]).merges[pair.set2] =
+        properties[i];
+    sets.property(representatives[pair.set2]).merges[pair.set1] =
+        properties[i];
+  }
+}
+
+// Index of the set which now contains the set with this initial index.
+int currentIndex(FeatureSets<SetProperties>& sets,
+                 const std::vector<int>& representatives,
+                 int index) {
+  return sets.property(representatives[index]).index;
+}
+
+// Joins the sets containing two vertices and combines their connections.
+//
+// The connections of other sets to the two are not updated. Their keys are
+// initial indices, which currentIndex() resolves, and connections which
+// resolve to the set itself are stale.
+void joinSets(FeatureSets<SetProperties>& sets,
+              const std::vector<int>& representatives,
+              int u,
+              int v) {
+  std::map<int, TrackProperties> merges1;
+  std::map<int, TrackProperties> merges2;
+  merges1.swap(sets.property(u).merges);
+  merges2.swap(sets.property(v).merges);
+  if (merges1.size() < merges2.size()) {
+    merges1.swap(merges2);
+  }
+
+  sets.join(u, v);
+  SetProperties& joined = sets.property(u);
+
+  // Insert the smaller list into the larger.
+  std::map<int, TrackProperties>::const_iterator merge;
+  for (merge = merges2.begin(); merge != merges2.end(); ++merge) {
+    int index = currentIndex(sets, representatives, merge->first);
+    if (index == joined.index) {
+      continue;
+    }
+
+    std::map<int, TrackProperties>::iterator existing = merges1.find(index);
+    if (existing == merges1.end()) {
+      merges1[index] = merge->second;
+    } else {
+      combineMergeProperties(existing->second, merge->second);
+    }
+  }
+  joined.merges.swap(merges1);
+}
+
+// Progress counters of a checkpoint.
+enum ClusteringCounter {
+  NUM_PAIRS_POPPED = 0,
+  NUM_SETS_JOINED = 1,
+  NUM_COUNTERS = 2
+};
+
+// Records the set of every vertex and the heap.
+void takeCheckpoint(const FeatureSets<SetProperties>& sets,
+                    const std::vector<SetPair>& pairs,
+                    const std::vector<uint64_t>& counters,
+                    size_t num_edges,
+                    ClusteringCheckpoint& checkpoint) {
+  checkpoint = ClusteringCheckpoint();
+  checkpoint.program = AGGLOMERATIVE_CLUSTER;
+  checkpoint.counters = counters;
+
+  int num_vertices = 0;
+  FeatureSets<SetProperties>::const_iterator set;
+  for (set = sets.begin(); set != sets.end(); ++set) {
+    num_vertices += set->second.elements.size();
+  }
+  checkpoint.num_vertices = num_vertices;
+  checkpoint.num_edges = num_edges;
+
+  checkpoint.labels.assign(num_vertices, -1);
+  for (set = sets.begin(); set != sets.end(); ++set) {
+    int index = set->second.property.index;
+    const std::map<ImageIndex, int>& elements = set->second.elements;
+
+    std::map<ImageIndex, int>::const_iterator element;
+    for (element = elements.begin(); element != elements.end(); ++element) {
+      checkpoint.labels[element->second] = index;
+    }
+  }
+
+  checkpoint.setRecords(pairs);
+}
+
+// Joins the sets as they were when the checkpoint was taken and restores
+// the heap. The connections must have been initialized.
+void resumeFromCheckpoint(const ClusteringCheckpoint& checkpoint,
+                          FeatureSets<SetProperties>& sets,
+                          const std::vector<int>& representatives,
+                          std::vector<SetPair>& pairs,
+                          std::vector<uint64_t>& counters) {
+  CHECK(checkpoint.counters.size() == NUM_COUNTERS) <<
+      "Checkpoint has the wrong number of counters";
+  counters = checkpoint.counters;
+  bool ok = checkpoint.getRecords(pairs);
+  CHECK(ok) << "Checkpoint does not contain pairs of sets";
+
+  // One vertex in each joined set.
+  std::map<int, int> firsts;
+  int num_vertices = checkpoint.labels.size();
+  for (int vertex = 0; vertex < num_vertices; vertex += 1) {
+    int label = checkpoint.labels[vertex];
+    CHECK(label >= 0 && label < int(representatives.size())) <<
+        "Vertex has no set in checkpoint";
+
+    std::pair<std::map<int, int>::iterator, bool> first =
+        firsts.insert(std::make_pair(label, vertex));
+    if (!first.second && !sets.together(first.first->second, vertex)) {
+      CHECK(sets.compatible(first.first->second, vertex)) <<
+          "Checkpoint joins inconsistent sets";
+      joinSets(sets, representatives, first.first->second, vertex);
+    }
+  }
+}
+
+}
+
+void clusterTracks(const ClusteringInput& input,
+                   const MultiviewTrack<Camera>& cameras,
+                   int num_frames,
+                   MultiviewTrackList<int>& initial_tracks,
+                   MultiviewTrackList<int>& partition_tracks,
+                   const ClusteringOptions& options,
+                   ThreadPool& pool,
+                   MultiviewTrackList<int>& tracks) {
+  MEMORY_STAGES(stages);
+  int num_views = cameras.numViews();
+  int num_partitions = options.num_partitions;
+  bool partitioned = (num_partitions > 1);
+  bool boundary = (partitioned && options.partition < 0);
+
+  // A window needs only its own frames. The last pass loads the pairs of
+  // one pair of windows at a time, in any order.
+  int first_frame = 0;
+  int last_frame = num_frames;
+  std::vector<std::pair<int, int> > blocks;
+  if (!partitioned) {
+    blocks.push_back(std::make_pair(0, 0));
+  } else if (!boundary) {
+    first_frame = firstFrameOfPartition(options.partition, num_frames,
+        num_partitions);
+    last_frame = firstFrameOfPartition(options.partition + 1, num_frames,
+        num_partitions);
+    blocks.push_back(std::make_pair(options.partition, options.partition));
+  } else {
+    for (int p = 0; p < num_partitions; p += 1) {
+      for (int q = p + 1; q < num_partitions; q += 1) {
+        blocks.push_back(std::make_pair(p, q));
+      }
+    }
+  }
+
+  std::vector<FeatureIndex> features;
+  VertexLookup lookup;
+  FeatureSets<SetProperties> sets;
+  std::vector<int> set_indices;
+  std::vector<int> representatives;
+  std::vector<const std::map<ImageIndex, int>*> elements;
+  SetPairFinder finder(options.memory_budget, pool);
+  size_t num_edges = 0;
+
+  // The last pass starts from the tracks of every window. Their features are
+  // vertices even where they have no match between windows, so that the
+  // frames of each set are all known. So are the features of the initial
+  // tracks, which every window cut.
+  if (boundary) {
+    addTrackVertices(partition_tracks, features, lookup);
+    addTrackVertices(initial_tracks, features, lookup);
+    for (int i = 0; i < partition_tracks.numTracks(); i += 1) {
+      initial_tracks.push_back(MultiviewTrack<int>());
+      initial_tracks.back().swap(partition_tracks.track(i));
+    }
+    partition_tracks.clear();
+  }
+
+  MEMORY_NEXT_STAGE(stages, "load matches and pair sets");
+  for (int b = 0; b < int(blocks.size()); b += 1) {
+    std::vector<ImagePair> image_pairs;
+    listPartitionPairs(num_views, num_frames, num_partitions,
+        blocks[b].first, blocks[b].second, image_pairs);
+    int num_known = features.size();
+    std::vector<MatchGraphEdge> edges;
+    loadMatchEdges(input, image_pairs, options.max_files_in_flight, features,
+        lookup, edges, pool);
+    LOG(INFO) << "Loaded " << edges.size() << " matches between " <<
+        image_pairs.size() << " pairs of images";
+    std::vector<ImagePair>().swap(image_pairs);
+    num_edges += edges.size();
+
+    if (b == 0) {
+      // Initial tracks cross windows. Each window keeps the part it has.
+      if (partitioned) {
+        keepTrackVertices(lookup, initial_tracks);
+      }
+
+      // Build a list containing the frame of every vertex.
+      std::vector<ImageIndex> frames;
+      frames.reserve(features.size());
+      std::vector<FeatureIndex>::const_iterator feature;
+      for (feature = features.begin(); feature != features.end(); ++feature) {
+        frames.push_back(ImageIndex(feature->view, feature->time));
+      }
+      sets.init(frames, initial_tracks, lookup);
+      MultiviewTrackList<int>(num_views).swap(initial_tracks);
+
+      set_indices.assign(features.size(), -1);
+      indexSets(sets, set_indices, representatives, elements);
+      LOG(INFO) << "Initially " << features.size() << " vertices amongst " <<
+          sets.count() << " sets";
+    } else {
+      addSingletonSets(features, num_known, sets, set_indices,
+          representatives, elements);
+    }
+
+    finder.add(edges, set_indices);
+  }
+  std::vector<int>().swap(set_indices);
+  int num_vertices = features.size();
+
+  // Find the closest match between every pair of sets.
+  MEMORY_NEXT_STAGE(stages, "init pairs of sets");
+  LOG(INFO) << "Initializing connectivity of sets";
+  finder.finish();
+  std::vector<SiftPosition> positions;
+  loadVertexPositions(input, features, num_views, first_frame, last_frame,
+      options.max_files_in_flight, positions, pool);
+
+  // Pairs are only ever popped, so taking them in sorted order from disk
+  // does the same as the heap. With a budget, the pairs are connected a
+  // budget at a time as they are read, and go to disk once they exceed it.
+  // The remainder is then not in memory to checkpoint.
+  size_t budget = options.memory_budget;
+  std::vector<SetPair> pairs;
+  SetPairSorter sorted_pairs(budget, shorterPair);
+  bool spilled = false;
+  size_t num_pairs = 0;
+  if (budget == 0) {
+    finder.take(pairs);
+    num_pairs = pairs.size();
+    initConnections(cameras, features, positions, elements, representatives,
+        pairs, sets, pool);
+  } else {
+    size_t capacity = std::max(budget / sizeof(SetPair), size_t(1));
+    pairs.reserve(capacity);
+    SetPair found;
+    bool more = finder.next(found);
+    while (more) {
+      pairs.push_back(found);
+      num_pairs += 1;
+      more = finder.next(found);
+      if (pairs.size() == capacity && (more || spilled)) {
+        initConnections(cameras, features, positions, elements,
+            representatives, pairs, sets, pool);
+        std::vector<SetPair>::const_iterator pair;
+        for (pair = pairs.begin(); pair != pairs.end(); ++pair) {
+          sorted_pairs.add(*pair);
+        }
+        pairs.clear();
+        spilled = true;
+      }
+    }
+    initConnections(cameras, features, positions, elements, representatives,
+        pairs, sets, pool);
+
+    if (spilled) {
+      LOG(INFO) << "Sorting " << num_pairs << " pairs of sets on disk";
+      std::vector<SetPair>::const_iterator pair;
+      for (pair = pairs.begin(); pair != pairs.end(); ++pair) {
+        sorted_pairs.add(*pair);
+      }
+      std::vector<SetPair>().swap(pairs);
+      bool ok = sorted_pairs.finish();
+      CHECK(ok) << "Could not sort pairs of sets on disk";
+
+      if (!options.checkpoint.empty()) {
+        LOG(WARNING) << "Checkpoints are not taken while pairs are on disk";
+      }
+    }
+  }
+  LOG(INFO) << "Found " << num_pairs << " pairs of connected sets";
+  std::vector<SiftPosition>().swap(positions);
+  std::vector<const std::map<ImageIndex, int>*>().swap(elements);
+
+  // Pairs are never pushed. The closest match between two joined sets is
+  // the closest match of one of their pairs, which is already in the heap,
+  // and pairs of sets which have since been joined are skipped when popped.
+  std::vector<uint64_t> counters(NUM_COUNTERS, 0);
+  ClusteringCheckpoint checkpoint;
+  if (options.resume && spilled) {
+    LOG(WARNING) << "Checkpoints are not resumed while pairs are on disk";
+  } else if (options.resume &&
+      loadClusteringCheckpoint(options.checkpoint, checkpoint)) {
+    CHECK(checkpoint.program == AGGLOMERATIVE_CLUSTER &&
+        checkpoint.num_vertices == uint64_t(num_vertices) &&
+        checkpoint.num_edges == uint64_t(num_edges)) <<
+        "Checkpoint is not of this clustering";
+    LOG(INFO) << "Resuming from checkpoint";
+    resumeFromCheckpoint(checkpoint, sets, representatives, pairs, counters);
+    ClusteringCheckpoint().swap(checkpoint);
+    LOG(INFO) << "Resumed with " << pairs.size() << " pairs of sets remaining";
+  } else {
+    // The heap is saved in heap order.
+    LOG(INFO) << "Building heap";
+    std::make_heap(pairs.begin(), pairs.end(), longerPair);
+  }
+
+  CheckpointWriter checkpoint_writer(options.checkpoint);
+  std::time_t last_checkpoint = std::time(NULL);
+
+  MEMORY_NEXT_STAGE(stages, "cluster");
+  LOG(INFO) << "Begin clustering";
+  while (spilled || !pairs.empty()) {
+    // Copying the state is fast. The writer saves it in the background.
+    if (!spilled && !options.checkpoint.empty() &&
+        std::difftime(std::time(NULL), last_checkpoint) >=
+        options.checkpoint_interval) {
+      LOG(INFO) << "Checkpoint after " << counters[NUM_PAIRS_POPPED] <<
+          " pairs, " << counters[NUM_SETS_JOINED] << " joins";
+      takeCheckpoint(sets, pairs, counters, num_edges, checkpoint);
+      checkpoint_writer.write(checkpoint);
+      last_checkpoint = std::time(NULL);
+    }
+
+    // Pull the closest pair off the heap.
+    SetPair pair;
+    if (spilled) {
+      if (!sorted_pairs.next(pair)) {
+        break;
+      }
+    } else {
+      pair = pairs.front();
+      std::pop_heap(pairs.begin(), pairs.end(), longerPair);
+      pairs.pop_back();
+    }
+    counters[NUM_PAIRS_POPPED] += 1;
+
+    int u = representatives[pair.set1];
+    int v = representatives[pair.set2];
+
+    // Skip if the sets have already been joined.
+    if (!sets.together(u, v)) {
+      DLOG(INFO) << "(" << pair.set1 << ", " << pair.set2 << ") => " <<
+          pair.weight;
+
+      // Only merge if sets are compatible.
+      if (sets.compatible(u, v)) {
+        joinSets(sets, representatives, u, v);
+        counters[NUM_SETS_JOINED] += 1;
+        DLOG(INFO) << "Merged: " << sets.count() << " sets";
+
+        // TODO: Compute set properties...
+      } else {
+        DLOG(INFO) << "Inconsistent";
+      }
+    }
+  }
+
+  LOG(INFO) << "Split " << num_vertices << " vertices into " << sets.count() <<
+      " sets";
+  if (!checkpoint_writer.wait()) {
+    LOG(WARNING) << "Some checkpoints could not be saved";
+  }
+
+  // Convert each consistent subgraph to a multi-view track of indices.
+  MEMORY_NEXT_STAGE(stages, "convert to track list");
+  subsetsToTracks(features, sets, tracks, num_views);
+}
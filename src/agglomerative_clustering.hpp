@@ -0,0 +1,87 @@
+#ifndef AGGLOMERATIVE_CLUSTERING_HPP_
+#define AGGLOMERATIVE_CLUSTERING_HPP_
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+#include "camera.hpp"
+#include "image_index.hpp"
+#include "match_result.hpp"
+#include "multiview_track.hpp"
+#include "multiview_track_list.hpp"
+#include "sift_position.hpp"
+#include "util/thread-pool.hpp"
+
+typedef std::pair<ImageIndex, ImageIndex> ImagePair;
+
+// Partitions are windows of consecutive frames of about the same length.
+int partitionOfFrame(int time, int num_frames, int num_partitions);
+// First frame of a partition, or the number of frames after the last.
+int firstFrameOfPartition(int partition, int num_frames, int num_partitions);
+
+// Lists the pairs of images within partition p if q is p, otherwise the
+// pairs with one image in each. Pairs are in the order in which every pair
+// of images would be listed.
+void listPartitionPairs(int num_views,
+                        int num_frames,
+                        int num_partitions,
+                        int p,
+                        int q,
+                        std::vector<ImagePair>& pairs);
+
+// Where clustering reads its input. Called from several threads at once.
+class ClusteringInput {
+  public:
+    virtual ~ClusteringInput() {}
+    virtual bool loadMatches(const ImagePair& pair,
+                             std::vector<MatchResult>& matches) const = 0;
+    virtual bool loadKeypoints(const ImageIndex& image,
+                               std::vector<SiftPosition>& keypoints) const = 0;
+};
+
+struct ClusteringOptions {
+  // Number of windows of frames to split clustering into.
+  int num_partitions;
+  // The window whose matches are clustered. If negative, with more than one
+  // partition, the matches between windows are clustered instead.
+  int partition;
+  // Bytes which the pairs of sets may take before they are sorted on disk,
+  // 0 for no limit.
+  size_t memory_budget;
+  // Maximum number of files which are loaded at once.
+  int max_files_in_flight;
+  // File to periodically save the state of clustering to, if not empty.
+  std::string checkpoint;
+  // Minimum number of seconds between checkpoints.
+  int checkpoint_interval;
+  // Resume from the checkpoint, if it exists.
+  bool resume;
+
+  ClusteringOptions();
+};
+
+// Finds tracks by agglomerative clustering of the matches between images.
+// Every feature with a match starts in a set of its own, or in the set of
+// its initial track. The two sets with the closest match are joined first,
+// unless they share an image.
+//
+// With partitions, each window of frames is clustered on its own, then
+// the tracks of every window are joined by clustering the matches between
+// windows. That pass loads the matches of one pair of windows at a time,
+// and keeps them only until they are reduced to the closest match of each
+// pair of sets. Initial tracks which cross windows are cut to the part
+// which each window has, and the last pass rejoins the parts.
+//
+// Takes the initial tracks, and the tracks of every window for the last
+// pass.
+void clusterTracks(const ClusteringInput& input,
+                   const MultiviewTrack<Camera>& cameras,
+                   int num_frames,
+                   MultiviewTrackList<int>& initial_tracks,
+                   MultiviewTrackList<int>& partition_tracks,
+                   const ClusteringOptions& options,
+                   ThreadPool& pool,
+                   MultiviewTrackList<int>& tracks);
+
+#endif
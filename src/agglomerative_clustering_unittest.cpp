@@ -0,0 +1,237 @@
+#include "agglomerative_clustering.hpp"
+#include <algorithm>
+#include <set>
+#include <vector>
+#include "feature_index.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+const int NUM_VIEWS = 2;
+const int NUM_FRAMES = 7;
+const int NUM_TRACKS = 4;
+
+typedef std::vector<FeatureIndex> FeatureList;
+
+// Each image has a feature of every true track which it sees, numbered
+// differently in every image.
+int featureOfTrack(int track, const ImageIndex& image) {
+  return (3 * track + image.view + 2 * image.time) % NUM_TRACKS;
+}
+
+// Distances in [0, 1) which differ between pairs and tracks.
+double spread(const ImagePair& pair, int track) {
+  int x = ((pair.first.view * 31 + pair.first.time) * 17 +
+      pair.second.view * 13 + pair.second.time) * 7 + track;
+  return ((x * 7919) % 1009) / 1009.;
+}
+
+// The last track is not seen in frames 3 and 4, so that its parts are only
+// joined by the matches between the first and last windows.
+bool isVisible(int track, const ImageIndex& image) {
+  return track < NUM_TRACKS - 1 || image.time < 3 || image.time > 4;
+}
+
+// Every pair of images matches the features of each true track, and wrongly
+// matches every track to the next. Wrong matches are further than any true
+// match, so that clustering finds the true tracks in any partition.
+class SyntheticInput : public ClusteringInput {
+  public:
+    bool loadMatches(const ImagePair& pair,
+                     std::vector<MatchResult>& matches) const {
+      matches.clear();
+      for (int track = 0; track < NUM_TRACKS; track += 1) {
+        int other = (track + 1) % NUM_TRACKS;
+        if (!isVisible(track, pair.first)) {
+          continue;
+        }
+        if (isVisible(track, pair.second)) {
+          matches.push_back(MatchResult(featureOfTrack(track, pair.first),
+              featureOfTrack(track, pair.second), spread(pair, track)));
+        }
+        if (isVisible(other, pair.second)) {
+          matches.push_back(MatchResult(featureOfTrack(track, pair.first),
+              featureOfTrack(other, pair.second), 2 + spread(pair, other)));
+        }
+      }
+      return true;
+    }
+
+    bool loadKeypoints(const ImageIndex& image,
+                       std::vector<SiftPosition>& keypoints) const {
+      keypoints.clear();
+      for (int id = 0; id < NUM_TRACKS; id += 1) {
+        keypoints.push_back(SiftPosition(10 * id + image.view,
+            10 * image.time, 2, 0));
+      }
+      return true;
+    }
+};
+
+MultiviewTrack<Camera> makeCameras() {
+  CameraProperties intrinsics;
+  intrinsics.image_size = cv::Size(64, 48);
+  intrinsics.focal_x = 50;
+  intrinsics.focal_y = 50;
+  intrinsics.principal_point = cv::Point2d(32, 24);
+  // Almost no distortion. Zero is not defined.
+  intrinsics.distort_w = 1e-3;
+
+  MultiviewTrack<Camera> cameras(NUM_VIEWS);
+  for (int view = 0; view < NUM_VIEWS; view += 1) {
+    for (int time = 0; time < NUM_FRAMES; time += 1) {
+      CameraPose extrinsics;
+      extrinsics.rotation = cv::Matx33d::eye();
+      extrinsics.center = cv::Point3d(view, 0, time);
+      cameras.view(view)[time] = Camera(intrinsics, extrinsics);
+    }
+  }
+  return cameras;
+}
+
+// The tracks as sets of features, independent of their order.
+std::vector<FeatureList> canonical(const MultiviewTrackList<int>& tracks) {
+  std::vector<FeatureList> sets;
+  for (int i = 0; i < tracks.numTracks(); i += 1) {
+    FeatureList features;
+    MultiviewTrack<int>::ConstFeatureIterator point(tracks.track(i));
+    for (point.begin(); !point.end(); point.next()) {
+      features.push_back(FeatureIndex(point.get().first,
+          *point.get().second));
+    }
+    std::sort(features.begin(), features.end());
+    sets.push_back(features);
+  }
+  std::sort(sets.begin(), sets.end());
+  return sets;
+}
+
+MultiviewTrackList<int> trueTracks() {
+  MultiviewTrackList<int> tracks(NUM_VIEWS);
+  for (int track = 0; track < NUM_TRACKS; track += 1) {
+    MultiviewTrack<int> features(NUM_VIEWS);
+    for (int view = 0; view < NUM_VIEWS; view += 1) {
+      for (int time = 0; time < NUM_FRAMES; time += 1) {
+        ImageIndex image(view, time);
+        if (isVisible(track, image)) {
+          features.view(view)[time] = featureOfTrack(track, image);
+        }
+      }
+    }
+    tracks.push_back(features);
+  }
+  return tracks;
+}
+
+// Part of true track 0, across the first boundary of every partition
+// below.
+MultiviewTrackList<int> initialTracks() {
+  MultiviewTrackList<int> tracks(NUM_VIEWS);
+  MultiviewTrack<int> track(NUM_VIEWS);
+  for (int time = 1; time < 5; time += 1) {
+    track.view(0)[time] = featureOfTrack(0, ImageIndex(0, time));
+  }
+  tracks.push_back(track);
+  return tracks;
+}
+
+MultiviewTrackList<int> cluster(int num_partitions, size_t memory_budget) {
+  SyntheticInput input;
+  MultiviewTrack<Camera> cameras = makeCameras();
+  ThreadPool pool(0);
+  ClusteringOptions options;
+  options.num_partitions = num_partitions;
+  options.memory_budget = memory_budget;
+
+  // Every partition, then the boundaries between them.
+  MultiviewTrackList<int> partition_tracks(NUM_VIEWS);
+  if (num_partitions > 1) {
+    for (int k = 0; k < num_partitions; k += 1) {
+      options.partition = k;
+      MultiviewTrackList<int> initial = initialTracks();
+      MultiviewTrackList<int> none(NUM_VIEWS);
+      MultiviewTrackList<int> tracks;
+      clusterTracks(input, cameras, NUM_FRAMES, initial, none, options, pool,
+          tracks);
+      for (int i = 0; i < tracks.numTracks(); i += 1) {
+        partition_tracks.push_back(tracks.track(i));
+      }
+    }
+    options.partition = -1;
+  }
+
+  MultiviewTrackList<int> initial = initialTracks();
+  MultiviewTrackList<int> tracks;
+  clusterTracks(input, cameras, NUM_FRAMES, initial, partition_tracks,
+      options, pool, tracks);
+  return tracks;
+}
+
+}
+
+TEST(ListPartitionPairs, ListsEveryPairOnce) {
+  std::vector<ImagePair> all;
+  listPartitionPairs(NUM_VIEWS, NUM_FRAMES, 1, 0, 0, all);
+  int n = NUM_VIEWS * NUM_FRAMES;
+  EXPECT_EQ(n * (n - 1) / 2, int(all.size()));
+
+  int num_partitions = 3;
+  std::set<std::pair<ImageIndex, ImageIndex> > found;
+  int num_found = 0;
+  for (int p = 0; p < num_partitions; p += 1) {
+    for (int q = p; q < num_partitions; q += 1) {
+      std::vector<ImagePair> pairs;
+      listPartitionPairs(NUM_VIEWS, NUM_FRAMES, num_partitions, p, q, pairs);
+      for (int i = 0; i < int(pairs.size()); i += 1) {
+        const ImagePair& pair = pairs[i];
+        int a = partitionOfFrame(pair.first.time, NUM_FRAMES, num_partitions);
+        int b = partitionOfFrame(pair.second.time, NUM_FRAMES,
+            num_partitions);
+        EXPECT_EQ(std::min(p, q), std::min(a, b));
+        EXPECT_EQ(std::max(p, q), std::max(a, b));
+        found.insert(pair);
+      }
+      num_found += pairs.size();
+    }
+  }
+
+  EXPECT_EQ(int(all.size()), num_found);
+  EXPECT_EQ(all.size(), found.size());
+  for (int i = 0; i < int(all.size()); i += 1) {
+    EXPECT_EQ(1, int(found.count(all[i])));
+  }
+}
+
+TEST(ListPartitionPairs, KeepsOrderOfAllPairs) {
+  std::vector<ImagePair> all;
+  listPartitionPairs(NUM_VIEWS, NUM_FRAMES, 1, 0, 0, all);
+  std::vector<ImagePair> pairs;
+  listPartitionPairs(NUM_VIEWS, NUM_FRAMES, 2, 1, 1, pairs);
+
+  std::vector<ImagePair> expected;
+  for (int i = 0; i < int(all.size()); i += 1) {
+    if (partitionOfFrame(all[i].first.time, NUM_FRAMES, 2) == 1 &&
+        partitionOfFrame(all[i].second.time, NUM_FRAMES, 2) == 1) {
+      expected.push_back(all[i]);
+    }
+  }
+  EXPECT_TRUE(pairs == expected);
+}
+
+TEST(ClusterTracks, FindsTrueTracks) {
+  EXPECT_TRUE(canonical(cluster(1, 0)) == canonical(trueTracks()));
+}
+
+TEST(ClusterTracks, PartitionsGiveSameTracks) {
+  std::vector<FeatureList> expected = canonical(cluster(1, 0));
+  EXPECT_TRUE(canonical(cluster(2, 0)) == expected);
+  EXPECT_TRUE(canonical(cluster(3, 0)) == expected);
+}
+
+TEST(ClusterTracks, SortingOnDiskGivesSameTracks) {
+  std::vector<FeatureList> expected = canonical(cluster(1, 0));
+  // A few pairs of sets at a time.
+  size_t budget = 256;
+  EXPECT_TRUE(canonical(cluster(1, budget)) == expected);
+  EXPECT_TRUE(canonical(cluster(3, budget)) == expected);
+}
@@ -0,0 +1,71 @@
+#include "batch_jobs.hpp"
+#include <algorithm>
+#include <sstream>
+#include <glog/logging.h>
+#include "read_lines.hpp"
+#include "util/thread-pool.hpp"
+
+namespace {
+
+// For use with ThreadPool::parallelFor().
+class RunFunction {
+  public:
+    RunFunction(const BatchJobFunction& run, std::vector<char>& ok)
+        : run_(&run), ok_(&ok) {}
+
+    void operator()(int i) const {
+      // Each thread writes to a different element.
+      (*ok_)[i] = (*run_)(i);
+    }
+
+  private:
+    const BatchJobFunction* run_;
+    std::vector<char>* ok_;
+};
+
+}
+
+bool readBatchJobs(const std::string& filename,
+                   int num_fields,
+                   std::vector<BatchJob>& jobs) {
+  std::vector<std::string> lines;
+  if (!readLines(filename, lines)) {
+    LOG(WARNING) << "Could not read jobs \"" << filename << "\"";
+    return false;
+  }
+  return parseBatchJobs(lines, num_fields, jobs);
+}
+
+bool parseBatchJobs(const std::vector<std::string>& lines,
+                    int num_fields,
+                    std::vector<BatchJob>& jobs) {
+  jobs.clear();
+
+  std::vector<std::string>::const_iterator line;
+  for (line = lines.begin(); line != lines.end(); ++line) {
+    std::istringstream stream(*line);
+    BatchJob job;
+    std::string field;
+    while (stream >> field) {
+      job.push_back(field);
+    }
+
+    if (job.empty()) {
+      continue;
+    }
+    if (int(job.size()) != num_fields) {
+      LOG(WARNING) << "Expected " << num_fields << " fields in \"" << *line <<
+          "\"";
+      return false;
+    }
+    jobs.push_back(job);
+  }
+
+  return true;
+}
+
+int runBatchJobs(int num_jobs, const BatchJobFunction& run, ThreadPool& pool) {
+  std::vector<char> ok(num_jobs, 0);
+  pool.parallelFor(0, num_jobs, RunFunction(run, ok));
+  return std::count(ok.begin(), ok.end(), 0);
+}
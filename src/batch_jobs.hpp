@@ -0,0 +1,31 @@
+#ifndef BATCH_JOBS_HPP_
+#define BATCH_JOBS_HPP_
+
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+
+class ThreadPool;
+
+// The fields of one line of a batch file.
+typedef std::vector<std::string> BatchJob;
+
+// Reads a batch file of one job per line, as whitespace-separated fields.
+// Blank lines are skipped. Returns false if the file could not be read or a
+// line does not have num_fields fields.
+bool readBatchJobs(const std::string& filename,
+                   int num_fields,
+                   std::vector<BatchJob>& jobs);
+
+// Same as above for lines which were already read.
+bool parseBatchJobs(const std::vector<std::string>& lines,
+                    int num_fields,
+                    std::vector<BatchJob>& jobs);
+
+// Calls run(i) for every job in [0, num_jobs) on the pool and returns the
+// number of jobs for which it returned false. A failed job does not stop the
+// others.
+typedef boost::function<bool(int)> BatchJobFunction;
+int runBatchJobs(int num_jobs, const BatchJobFunction& run, ThreadPool& pool);
+
+#endif
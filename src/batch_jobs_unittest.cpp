@@ -0,0 +1,56 @@
+#include "batch_jobs.hpp"
+#include <string>
+#include <vector>
+#include "util/thread-pool.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+TEST(ParseBatchJobs, SplitsFieldsAndSkipsBlankLines) {
+  std::vector<std::string> lines;
+  lines.push_back("a b  c");
+  lines.push_back("");
+  lines.push_back("   ");
+  lines.push_back("d\te f");
+
+  std::vector<BatchJob> jobs;
+  ASSERT_TRUE(parseBatchJobs(lines, 3, jobs));
+  ASSERT_EQ(2, int(jobs.size()));
+  EXPECT_EQ("c", jobs[0][2]);
+  EXPECT_EQ("e", jobs[1][1]);
+}
+
+TEST(ParseBatchJobs, RejectsWrongNumberOfFields) {
+  std::vector<std::string> lines;
+  lines.push_back("a b c");
+  lines.push_back("a b");
+
+  std::vector<BatchJob> jobs;
+  EXPECT_FALSE(parseBatchJobs(lines, 3, jobs));
+}
+
+// Fails the odd jobs and records which ran.
+class OddFails {
+  public:
+    explicit OddFails(std::vector<char>& ran) : ran_(&ran) {}
+
+    bool operator()(int i) const {
+      (*ran_)[i] = 1;
+      return i % 2 == 0;
+    }
+
+  private:
+    std::vector<char>* ran_;
+};
+
+TEST(RunBatchJobs, CountsFailuresAndRunsEveryJob) {
+  const int NUM_JOBS = 101;
+  for (int num_threads = 0; num_threads <= 4; num_threads += 4) {
+    ThreadPool pool(num_threads);
+    std::vector<char> ran(NUM_JOBS, 0);
+    EXPECT_EQ(NUM_JOBS / 2, runBatchJobs(NUM_JOBS, OddFails(ran), pool));
+    EXPECT_EQ(std::vector<char>(NUM_JOBS, 1), ran);
+  }
+}
+
+}
@@ -0,0 +1,452 @@
+#include "binary_file.hpp"
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glog/logging.h>
+
+const char BINARY_EXTENSION[] = ".bin";
+
+namespace {
+
+const char MAGIC[4] = { 'T', 'R', 'K', 'B' };
+
+// Releases a mapping when the last copy is destroyed.
+class Unmapper {
+  public:
+    explicit Unmapper(size_t size) : size_(size) {}
+
+    void operator()(void* data) const {
+      munmap(data, size_);
+    }
+
+  private:
+    size_t size_;
+};
+
+uint64_t alignOffset(uint64_t offset) {
+  uint64_t alignment = BinaryFileHeader::ALIGNMENT;
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+bool writePadding(std::ofstream& file, uint64_t offset) {
+  std::vector<char> zeros(offset - uint64_t(file.tellp()), 0);
+  if (!zeros.empty()) {
+    file.write(&zeros.front(), zeros.size());
+  }
+  return file.good();
+}
+
+}
+
+bool isBinaryFilename(const std::string& filename) {
+  size_t n = std::strlen(BINARY_EXTENSION);
+  return filename.size() >= n &&
+      filename.compare(filename.size() - n, n, BINARY_EXTENSION) == 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const uint32_t BinaryFileHeader::VERSION;
+
+const int BinaryFileHeader::VERSION_1_SIZE;
+
+BinaryFile::BinaryFile() : mapping_(), header_(), groups_(NULL) {}
+
+bool BinaryFile::open(const std::string& filename) {
+  mapping_.reset();
+  groups_ = NULL;
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(WARNING) << "Could not open `" << filename << "' for reading";
+    return false;
+  }
+
+  struct stat status;
+  if (fstat(fd, &status) != 0 ||
+      size_t(status.st_size) < size_t(BinaryFileHeader::VERSION_1_SIZE)) {
+    LOG(WARNING) << "`" << filename << "' is too small to be a binary file";
+    ::close(fd);
+    return false;
+  }
+  size_t size = status.st_size;
+
+  // Private so that descriptors can be modified in memory.
+  void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    LOG(WARNING) << "Could not map `" << filename << "'";
+    return false;
+  }
+  boost::shared_ptr<void> mapping(data, Unmapper(size));
+
+  BinaryFileHeader copy;
+  BinaryFileHeader* header = &copy;
+  std::memset(header, 0, sizeof(*header));
+  std::memcpy(header, data, BinaryFileHeader::VERSION_1_SIZE);
+  if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0) {
+    LOG(WARNING) << "`" << filename << "' is not a binary file";
+    return false;
+  }
+  if (header->version == BinaryFileHeader::VERSION) {
+    if (size < sizeof(BinaryFileHeader)) {
+      LOG(WARNING) << "`" << filename << "' is truncated";
+      return false;
+    }
+    std::memcpy(header, data, sizeof(BinaryFileHeader));
+  } else if (header->version != 1) {
+    LOG(WARNING) << "`" << filename << "' has unsupported version " <<
+        header->version;
+    return false;
+  }
+
+  uint64_t records_end = header->records_offset +
+      header->num_records * header->record_size;
+  if (records_end > size) {
+    LOG(WARNING) << "`" << filename << "' is truncated";
+    return false;
+  }
+
+  if (header->descriptor_type >= 0) {
+    // Keys are only for groups, one row each.
+    bool keys = (header->descriptor_type == CV_32S &&
+        header->num_groups > 0 &&
+        header->num_descriptors == header->num_groups);
+    if (header->descriptor_type != CV_32F &&
+        header->descriptor_type != CV_16U &&
+        header->descriptor_type != CV_8U && !keys) {
+      LOG(WARNING) << "Unsupported descriptor type in `" << filename << "'";
+      return false;
+    }
+    if (header->descriptors_offset % BinaryFileHeader::ALIGNMENT != 0) {
+      LOG(WARNING) << "Descriptors are not aligned in `" << filename << "'";
+      return false;
+    }
+
+    uint64_t row_size = header->descriptor_cols *
+        CV_ELEM_SIZE(header->descriptor_type);
+    uint64_t descriptors_end = header->descriptors_offset +
+        header->num_descriptors * row_size;
+    if (descriptors_end > size) {
+      LOG(WARNING) << "`" << filename << "' is truncated";
+      return false;
+    }
+  }
+
+  if (header->norms_offset != 0) {
+    if (header->descriptor_type < 0 || header->descriptor_type == CV_32S ||
+        header->norms_offset % BinaryFileHeader::ALIGNMENT != 0) {
+      LOG(WARNING) << "Invalid norms in `" << filename << "'";
+      return false;
+    }
+    uint64_t norms_end = header->norms_offset +
+        header->num_descriptors * sizeof(float);
+    if (norms_end > size) {
+      LOG(WARNING) << "`" << filename << "' is truncated";
+      return false;
+    }
+  }
+
+  const uint64_t* groups = NULL;
+  if (header->num_groups > 0) {
+    uint64_t groups_offset = alignOffset(records_end);
+    uint64_t groups_end = groups_offset +
+        (uint64_t(header->num_groups) + 1) * sizeof(uint64_t);
+    if (groups_end > size) {
+      LOG(WARNING) << "`" << filename << "' is truncated";
+      return false;
+    }
+    if (header->group_size == 0 ||
+        header->num_groups % header->group_size != 0) {
+      LOG(WARNING) << "Invalid group size in `" << filename << "'";
+      return false;
+    }
+
+    groups = reinterpret_cast<const uint64_t*>(
+        static_cast<const char*>(data) + groups_offset);
+    bool valid = (groups[0] == 0 &&
+        groups[header->num_groups] == header->num_records);
+    for (uint32_t i = 0; valid && i < header->num_groups; i += 1) {
+      valid = (groups[i] <= groups[i + 1]);
+    }
+    if (!valid) {
+      LOG(WARNING) << "Invalid group table in `" << filename << "'";
+      return false;
+    }
+  }
+
+  mapping_ = mapping;
+  header_ = *header;
+  groups_ = groups;
+  return true;
+}
+
+bool BinaryFile::isOpen() const {
+  return bool(mapping_);
+}
+
+const BinaryFileHeader& BinaryFile::header() const {
+  CHECK(isOpen());
+  return header_;
+}
+
+int BinaryFile::numRecords() const {
+  return header().num_records;
+}
+
+const void* BinaryFile::recordData(BinaryRecordType type, size_t size) const {
+  CHECK(header().record_type == uint32_t(type)) << "Unexpected record type";
+  CHECK(header().record_size == size) << "Unexpected record size";
+
+  return static_cast<const char*>(mapping_.get()) + header_.records_offset;
+}
+
+int BinaryFile::numGroups() const {
+  return header().num_groups;
+}
+
+int BinaryFile::groupSize() const {
+  return header().group_size;
+}
+
+const uint64_t* BinaryFile::groups() const {
+  CHECK(numGroups() > 0) << "Records are not grouped";
+  return groups_;
+}
+
+bool BinaryFile::hasGroupKeys() const {
+  return header().descriptor_type == CV_32S;
+}
+
+int BinaryFile::groupKeySize() const {
+  return hasGroupKeys() ? int(header_.descriptor_cols) : 0;
+}
+
+const int32_t* BinaryFile::groupKeys() const {
+  CHECK(hasGroupKeys()) << "Groups have no keys";
+  return reinterpret_cast<const int32_t*>(
+      static_cast<const char*>(mapping_.get()) + header_.descriptors_offset);
+}
+
+bool BinaryFile::hasDescriptors() const {
+  return header().descriptor_type >= 0 && !hasGroupKeys();
+}
+
+boost::shared_ptr<void> BinaryFile::descriptorData() const {
+  CHECK(hasDescriptors());
+  char* data = static_cast<char*>(mapping_.get()) +
+      header_.descriptors_offset;
+  // Shares ownership of the whole mapping.
+  return boost::shared_ptr<void>(mapping_, data);
+}
+
+bool BinaryFile::hasNorms() const {
+  return hasDescriptors() && header_.norms_offset != 0;
+}
+
+boost::shared_ptr<const float> BinaryFile::normData() const {
+  CHECK(hasNorms());
+  const float* norms = reinterpret_cast<const float*>(
+      static_cast<const char*>(mapping_.get()) + header_.norms_offset);
+  return boost::shared_ptr<const float>(mapping_, norms);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+bool writeFile(const std::string& filename,
+               const BinaryFileHeader& header,
+               const void* records,
+               const std::vector<uint64_t>& groups,
+               const cv::Mat& descriptors,
+               const float* norms) {
+  std::ofstream file(filename.c_str(), std::ios::binary);
+  if (!file) {
+    LOG(WARNING) << "Could not open `" << filename << "' for writing";
+    return false;
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  writePadding(file, header.records_offset);
+  if (header.num_records > 0) {
+    file.write(static_cast<const char*>(records),
+        header.num_records * header.record_size);
+  }
+
+  if (groups.size() > 1) {
+    writePadding(file, alignOffset(uint64_t(file.tellp())));
+    file.write(reinterpret_cast<const char*>(&groups.front()),
+        groups.size() * sizeof(uint64_t));
+  }
+
+  if (!descriptors.empty()) {
+    writePadding(file, header.descriptors_offset);
+    file.write(reinterpret_cast<const char*>(descriptors.data),
+        descriptors.total() * descriptors.elemSize());
+  }
+
+  if (header.norms_offset != 0) {
+    writePadding(file, header.norms_offset);
+    file.write(reinterpret_cast<const char*>(norms),
+        header.num_descriptors * sizeof(float));
+  }
+
+  if (!file.good()) {
+    LOG(WARNING) << "Could not write to `" << filename << "'";
+    return false;
+  }
+
+  return true;
+}
+
+void initHeader(BinaryFileHeader& header,
+                BinaryRecordType type,
+                size_t record_size,
+                size_t num_records) {
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = BinaryFileHeader::VERSION;
+  header.record_type = type;
+  header.record_size = record_size;
+  header.num_records = num_records;
+  header.records_offset = alignOffset(sizeof(header));
+  header.descriptor_type = -1;
+}
+
+}
+
+bool writeBinaryFile(const std::string& filename,
+                     BinaryRecordType type,
+                     size_t record_size,
+                     size_t num_records,
+                     const void* records,
+                     const cv::Mat& descriptors,
+                     const float* norms) {
+  CHECK(descriptors.empty() || descriptors.isContinuous());
+  CHECK(descriptors.empty() || descriptors.type() == CV_32F ||
+      descriptors.type() == CV_16U || descriptors.type() == CV_8U) <<
+      "Unsupported descriptor type";
+
+  BinaryFileHeader header;
+  initHeader(header, type, record_size, num_records);
+
+  uint64_t records_end = header.records_offset + num_records * record_size;
+  if (!descriptors.empty()) {
+    header.descriptor_type = descriptors.type();
+    header.descriptor_cols = descriptors.cols;
+    header.num_descriptors = descriptors.rows;
+    header.descriptors_offset = alignOffset(records_end);
+    if (norms != NULL) {
+      header.norms_offset = alignOffset(header.descriptors_offset +
+          descriptors.total() * descriptors.elemSize());
+    }
+  }
+
+  return writeFile(filename, header, records, std::vector<uint64_t>(),
+      descriptors, norms);
+}
+
+bool writeBinaryFile(const std::string& filename,
+                     BinaryRecordType type,
+                     size_t record_size,
+                     size_t num_records,
+                     const void* records,
+                     const std::vector<uint64_t>& groups,
+                     int group_size) {
+  CHECK(!groups.empty()) << "Group table is empty";
+  CHECK(groups.front() == 0 && groups.back() == num_records) <<
+      "Group table does not cover records";
+  CHECK(group_size > 0 && (groups.size() - 1) % group_size == 0) <<
+      "Number of groups is not a multiple of group size";
+
+  BinaryFileHeader header;
+  initHeader(header, type, record_size, num_records);
+  header.num_groups = groups.size() - 1;
+  header.group_size = group_size;
+
+  return writeFile(filename, header, records, groups, cv::Mat(), NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+BinaryGroupWriter::BinaryGroupWriter()
+    : filename_(), file_(), header_(), key_size_(0), groups_(), keys_() {}
+
+bool BinaryGroupWriter::open(const std::string& filename,
+                             BinaryRecordType type,
+                             size_t record_size,
+                             int key_size) {
+  CHECK(key_size >= 0);
+  filename_ = filename;
+  file_.open(filename.c_str(), std::ios::binary);
+  if (!file_) {
+    LOG(WARNING) << "Could not open `" << filename << "' for writing";
+    return false;
+  }
+
+  initHeader(header_, type, record_size, 0);
+  key_size_ = key_size;
+  groups_.assign(1, 0);
+  keys_.clear();
+
+  // The header is written again once the groups are known.
+  file_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+  return writePadding(file_, header_.records_offset);
+}
+
+void BinaryGroupWriter::setRecordFlags(uint32_t flags) {
+  header_.record_flags = flags;
+}
+
+void BinaryGroupWriter::beginGroup(const int32_t* key) {
+  if (header_.num_groups > 0) {
+    groups_.push_back(header_.num_records);
+  }
+  header_.num_groups += 1;
+  keys_.insert(keys_.end(), key, key + key_size_);
+}
+
+void BinaryGroupWriter::write(const void* records, size_t num_records) {
+  CHECK(header_.num_groups > 0) << "No group has begun";
+  if (num_records > 0) {
+    file_.write(static_cast<const char*>(records),
+        num_records * header_.record_size);
+    header_.num_records += num_records;
+  }
+}
+
+bool BinaryGroupWriter::close() {
+  if (header_.num_groups > 0) {
+    groups_.push_back(header_.num_records);
+    header_.group_size = 1;
+
+    writePadding(file_, alignOffset(uint64_t(file_.tellp())));
+    file_.write(reinterpret_cast<const char*>(&groups_.front()),
+        groups_.size() * sizeof(uint64_t));
+
+    if (key_size_ > 0) {
+      header_.descriptor_type = CV_32S;
+      header_.descriptor_cols = key_size_;
+      header_.num_descriptors = header_.num_groups;
+      header_.descriptors_offset = alignOffset(uint64_t(file_.tellp()));
+      writePadding(file_, header_.descriptors_offset);
+      file_.write(reinterpret_cast<const char*>(&keys_.front()),
+          keys_.size() * sizeof(int32_t));
+    }
+  }
+
+  file_.seekp(0);
+  file_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+  bool ok = file_.good();
+  file_.close();
+
+  if (!ok) {
+    LOG(WARNING) << "Could not write to `" << filename_ << "'";
+  }
+  return ok;
+}
@@ -0,0 +1,183 @@
+#ifndef BINARY_FILE_HPP_
+#define BINARY_FILE_HPP_
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include <opencv2/core/core.hpp>
+
+// Files with this extension are read and written in the binary format below
+// instead of by cv::FileStorage.
+extern const char BINARY_EXTENSION[];
+
+bool isBinaryFilename(const std::string& filename);
+
+// What the records of a file contain.
+enum BinaryRecordType {
+  BINARY_NO_RECORDS = 0,
+  BINARY_SIFT_POSITIONS = 1,
+  BINARY_MATCH_RESULTS = 2,
+  // Frame and SiftPosition, grouped by track.
+  BINARY_SIFT_POSITION_TRACKS = 3,
+  // Dimensions of images whose pixels are in the descriptor block.
+  BINARY_IMAGE_PLANES = 4,
+  // Matches grouped by pair of images (see match_store.hpp).
+  BINARY_MATCH_STORE = 5
+};
+
+// The first 128 bytes of a binary file.
+//
+// The header is followed by an array of fixed-size records and then an
+// optional block of descriptors, one row each, and their squared norms.
+// Each starts on a 64-byte boundary of the file. Values are in the byte order
+// of the machine which wrote them.
+//
+// Records may be divided into contiguous groups, such as the points of each
+// track. The groups are described by num_groups + 1 record indices (uint64)
+// which start on the first boundary after the records, and the descriptors
+// then follow the group table.
+//
+// Instead of descriptors, grouped records may have a key of a few int32 for
+// each group, such as the pair of images whose matches the group holds. The
+// keys are a CV_32S block with one row per group.
+//
+// Version 1 headers are the first 64 bytes, up to norms_offset, and are read
+// as having no norms.
+struct BinaryFileHeader {
+  static const uint32_t VERSION = 2;
+  static const int VERSION_1_SIZE = 64;
+  static const int ALIGNMENT = 64;
+
+  char magic[4];
+  uint32_t version;
+  uint32_t record_type;
+  uint32_t record_size;
+  uint64_t num_records;
+  uint64_t records_offset;
+  // CV_32F, CV_16U (half floats), CV_8U or -1 if there are no descriptors.
+  // CV_32S for the keys of groups.
+  int32_t descriptor_type;
+  uint32_t descriptor_cols;
+  uint64_t num_descriptors;
+  uint64_t descriptors_offset;
+  // Zero if the records are not grouped.
+  uint32_t num_groups;
+  // Number of consecutive groups which describe one element, for example
+  // the views of a multiview track.
+  uint32_t group_size;
+  // One float per descriptor, or zero if the norms are not stored.
+  uint64_t norms_offset;
+  // Flags whose meaning depends on the record type. Zero in files written
+  // before there were any.
+  uint32_t record_flags;
+  char reserved[52];
+};
+
+// A binary file mapped into memory.
+// Records and descriptors are exposed without copying. The mapping is private,
+// so writing to it does not modify the file. Copies share the mapping.
+class BinaryFile {
+  public:
+    BinaryFile();
+
+    // Returns false if the file could not be mapped or is malformed.
+    bool open(const std::string& filename);
+    bool isOpen() const;
+
+    const BinaryFileHeader& header() const;
+    int numRecords() const;
+
+    // Checks the record type and size.
+    template<class T> const T* records(BinaryRecordType type) const;
+
+    int numGroups() const;
+    int groupSize() const;
+    // Group i is records [groups()[i], groups()[i + 1]).
+    const uint64_t* groups() const;
+
+    bool hasGroupKeys() const;
+    int groupKeySize() const;
+    // The key of group i starts at groupKeys() + i * groupKeySize().
+    const int32_t* groupKeys() const;
+
+    bool hasDescriptors() const;
+    // Wraps the descriptor block. The matrix keeps the mapping alive.
+    boost::shared_ptr<void> descriptorData() const;
+
+    bool hasNorms() const;
+    // The squared norm of each descriptor, which keeps the mapping alive.
+    boost::shared_ptr<const float> normData() const;
+
+  private:
+    const void* recordData(BinaryRecordType type, size_t size) const;
+
+    boost::shared_ptr<void> mapping_;
+    // A copy, so that version 1 headers can be extended.
+    BinaryFileHeader header_;
+    const uint64_t* groups_;
+};
+
+// Writes a header, records and, unless it is empty, a descriptor block.
+// Writes the squared norms of the descriptors too if they are given.
+bool writeBinaryFile(const std::string& filename,
+                     BinaryRecordType type,
+                     size_t record_size,
+                     size_t num_records,
+                     const void* records,
+                     const cv::Mat& descriptors,
+                     const float* norms = NULL);
+
+// Writes a header and grouped records, without descriptors.
+// The group table must start at 0 and end at num_records. The group size is
+// kept even if there are no groups.
+bool writeBinaryFile(const std::string& filename,
+                     BinaryRecordType type,
+                     size_t record_size,
+                     size_t num_records,
+                     const void* records,
+                     const std::vector<uint64_t>& groups,
+                     int group_size);
+
+// Writes grouped records as they are produced, a group at a time, so that
+// they need not all be held in memory. The header, group table and keys are
+// written by close(). Groups may be empty.
+class BinaryGroupWriter {
+  public:
+    BinaryGroupWriter();
+
+    // Key size may be zero for groups without keys.
+    bool open(const std::string& filename,
+              BinaryRecordType type,
+              size_t record_size,
+              int key_size);
+    // Written to the header by close().
+    void setRecordFlags(uint32_t flags);
+    // Key has key_size values.
+    void beginGroup(const int32_t* key);
+    void write(const void* records, size_t num_records);
+    // Returns false if anything could not be written.
+    bool close();
+
+  private:
+    std::string filename_;
+    std::ofstream file_;
+    BinaryFileHeader header_;
+    int key_size_;
+    std::vector<uint64_t> groups_;
+    std::vector<int32_t> keys_;
+
+    // Non-copyable.
+    BinaryGroupWriter(const BinaryGroupWriter&);
+    BinaryGroupWriter& operator=(const BinaryGroupWriter&);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+template<class T>
+const T* BinaryFile::records(BinaryRecordType type) const {
+  return static_cast<const T*>(recordData(type, sizeof(T)));
+}
+
+#endif
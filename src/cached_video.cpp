@@ -0,0 +1,233 @@
+#include "cached_video.hpp"
+#include <cstdlib>
+#include <boost/bind.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <glog/logging.h>
+
+namespace {
+
+size_t imageBytes(const cv::Mat& image) {
+  return image.total() * image.elemSize();
+}
+
+}
+
+GrayGradientPlanes::~GrayGradientPlanes() {}
+
+void GrayGradientPlanes::compute(const cv::Mat& image,
+                                 std::vector<cv::Mat>& planes) const {
+  cv::Mat gray;
+  if (image.channels() == 3) {
+    cv::cvtColor(image, gray, CV_BGR2GRAY);
+  } else {
+    gray = image;
+  }
+
+  planes.assign(3, cv::Mat());
+  gray.convertTo(planes[0], cv::DataType<float>::type);
+  cv::Sobel(planes[0], planes[1], -1, 1, 0);
+  cv::Sobel(planes[0], planes[2], -1, 0, 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CachedVideo::CachedVideo(const Video& video,
+                         size_t max_bytes,
+                         int read_ahead,
+                         const FramePlanes* planes)
+    : video_(&video),
+      max_bytes_(max_bytes),
+      read_ahead_(read_ahead),
+      planes_(planes),
+      mutex_(),
+      requested_(),
+      decoded_(),
+      frames_(),
+      recency_(),
+      bytes_(0),
+      pending_(),
+      decoding_(-1),
+      last_time_(-1),
+      direction_(1),
+      stop_(false),
+      thread_() {
+  CHECK(read_ahead >= 0);
+
+  if (read_ahead_ > 0) {
+    thread_.reset(new boost::thread(boost::bind(&CachedVideo::readAhead,
+        this)));
+  }
+}
+
+CachedVideo::~CachedVideo() {
+  if (thread_) {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      stop_ = true;
+      requested_.notify_all();
+    }
+    thread_->join();
+  }
+}
+
+bool CachedVideo::get(int t, cv::Mat& image) const {
+  boost::mutex::scoped_lock lock(mutex_);
+  const Frame* frame = access(t, lock);
+  if (frame == NULL) {
+    return false;
+  }
+
+  frame->image.copyTo(image);
+  return true;
+}
+
+int CachedVideo::length() const {
+  return video_->length();
+}
+
+bool CachedVideo::getPlanes(int t, std::vector<cv::Mat>& planes) const {
+  CHECK(planes_ != NULL) << "No planes are computed";
+
+  boost::mutex::scoped_lock lock(mutex_);
+  const Frame* frame = access(t, lock);
+  if (frame == NULL) {
+    return false;
+  }
+
+  // Matrices are reference counted, so eviction does not free them.
+  planes = frame->planes;
+  return true;
+}
+
+const CachedVideo::Frame* CachedVideo::access(
+    int t,
+    boost::mutex::scoped_lock& lock) const {
+  // Do not decode the same frame twice.
+  while (decoding_ == t) {
+    decoded_.wait(lock);
+  }
+
+  FrameMap::iterator frame = frames_.find(t);
+  if (frame != frames_.end()) {
+    // Move to front.
+    recency_.splice(recency_.begin(), recency_, frame->second.position);
+  } else {
+    lock.unlock();
+    Frame decoded;
+    bool ok = decode(t, decoded);
+    lock.lock();
+
+    if (!ok) {
+      return NULL;
+    }
+
+    // The read-ahead thread may have added it in the meantime.
+    frame = frames_.find(t);
+    if (frame == frames_.end()) {
+      insert(t, decoded);
+      frame = frames_.find(t);
+    }
+  }
+
+  scheduleReadAhead(t);
+  return &frame->second;
+}
+
+bool CachedVideo::decode(int t, Frame& frame) const {
+  if (!video_->get(t, frame.image)) {
+    return false;
+  }
+
+  frame.bytes = imageBytes(frame.image);
+  if (planes_ != NULL) {
+    planes_->compute(frame.image, frame.planes);
+    std::vector<cv::Mat>::const_iterator plane;
+    for (plane = frame.planes.begin(); plane != frame.planes.end(); ++plane) {
+      frame.bytes += imageBytes(*plane);
+    }
+  }
+
+  return true;
+}
+
+void CachedVideo::insert(int t, Frame& frame) const {
+  recency_.push_front(t);
+
+  Frame& entry = frames_[t];
+  entry.image = frame.image;
+  entry.planes.swap(frame.planes);
+  entry.bytes = frame.bytes;
+  entry.position = recency_.begin();
+  bytes_ += entry.bytes;
+
+  // Discard least recent frames, but never the one which was just added.
+  while (bytes_ > max_bytes_ && recency_.size() > 1) {
+    int oldest = recency_.back();
+    recency_.pop_back();
+
+    FrameMap::iterator old = frames_.find(oldest);
+    bytes_ -= old->second.bytes;
+    frames_.erase(old);
+  }
+}
+
+void CachedVideo::scheduleReadAhead(int t) const {
+  if (read_ahead_ == 0) {
+    return;
+  }
+
+  int n = length();
+  if (last_time_ >= 0 && t != last_time_) {
+    int step = t - last_time_;
+    // A large step is a wrap around the ends.
+    if (2 * std::abs(step) > n) {
+      step = -step;
+    }
+    direction_ = (step > 0) ? 1 : -1;
+  }
+  last_time_ = t;
+
+  // Replace any frames which were queued for an earlier access.
+  pending_.clear();
+  for (int i = 1; i <= read_ahead_ && i < n; i += 1) {
+    int u = ((t + direction_ * i) % n + n) % n;
+    if (u != decoding_ && frames_.find(u) == frames_.end()) {
+      pending_.push_back(u);
+    }
+  }
+
+  if (!pending_.empty()) {
+    requested_.notify_one();
+  }
+}
+
+void CachedVideo::readAhead() {
+  boost::mutex::scoped_lock lock(mutex_);
+
+  while (true) {
+    while (!stop_ && pending_.empty()) {
+      requested_.wait(lock);
+    }
+    if (stop_) {
+      break;
+    }
+
+    int t = pending_.front();
+    pending_.pop_front();
+    if (frames_.find(t) != frames_.end()) {
+      continue;
+    }
+
+    decoding_ = t;
+    lock.unlock();
+    Frame frame;
+    bool ok = decode(t, frame);
+    lock.lock();
+    decoding_ = -1;
+
+    if (ok && frames_.find(t) == frames_.end()) {
+      insert(t, frame);
+    }
+    decoded_.notify_all();
+  }
+}
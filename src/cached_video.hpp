@@ -0,0 +1,109 @@
+#ifndef CACHED_VIDEO_HPP_
+#define CACHED_VIDEO_HPP_
+
+#include <deque>
+#include <list>
+#include <map>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <opencv2/core/core.hpp>
+#include "video.hpp"
+
+// Computes images derived from a frame, such as its gradients, which are
+// cached alongside it.
+class FramePlanes {
+  public:
+    virtual ~FramePlanes() {}
+    virtual void compute(const cv::Mat& image,
+                         std::vector<cv::Mat>& planes) const = 0;
+};
+
+// Grayscale intensity, and its x and y derivatives, as CV_32F.
+class GrayGradientPlanes : public FramePlanes {
+  public:
+    ~GrayGradientPlanes();
+    void compute(const cv::Mat& image, std::vector<cv::Mat>& planes) const;
+};
+
+// Keeps recently accessed frames of another video in memory.
+//
+// Frames are discarded in least-recently-used order once their total size
+// exceeds a number of bytes. After each access, a background thread decodes
+// the next few frames in the direction of the last step, wrapping around at
+// the ends, so that stepping back and forth rarely waits for the disk. The
+// underlying video must allow get() from two threads at once.
+class CachedVideo : public Video {
+  public:
+    // Does not take ownership of the video or planes. With read_ahead zero,
+    // frames are only decoded when they are requested.
+    CachedVideo(const Video& video,
+                size_t max_bytes,
+                int read_ahead,
+                const FramePlanes* planes = NULL);
+    // Stops the read-ahead thread.
+    ~CachedVideo();
+
+    // Copies the image out of the cache.
+    bool get(int t, cv::Mat& image) const;
+    int length() const;
+
+    // Accesses the planes computed for frame t. The planes share memory with
+    // the cache and must not be modified.
+    bool getPlanes(int t, std::vector<cv::Mat>& planes) const;
+
+  private:
+    struct Frame {
+      cv::Mat image;
+      std::vector<cv::Mat> planes;
+      size_t bytes;
+      // Position in the recency list.
+      std::list<int>::iterator position;
+    };
+
+    typedef std::map<int, Frame> FrameMap;
+
+    // Finds or decodes a frame and marks it as most recent. Must be locked.
+    const Frame* access(int t, boost::mutex::scoped_lock& lock) const;
+    // Decodes a frame without holding the lock.
+    bool decode(int t, Frame& frame) const;
+    // Adds a decoded frame and discards old ones. Must be locked.
+    void insert(int t, Frame& frame) const;
+    // Queues frames after t in the direction of access. Must be locked.
+    void scheduleReadAhead(int t) const;
+    // Body of the read-ahead thread.
+    void readAhead();
+
+    const Video* video_;
+    size_t max_bytes_;
+    int read_ahead_;
+    const FramePlanes* planes_;
+
+    mutable boost::mutex mutex_;
+    // Signalled when frames are queued or the thread should stop.
+    mutable boost::condition_variable requested_;
+    // Signalled when the read-ahead thread finishes a frame.
+    mutable boost::condition_variable decoded_;
+
+    mutable FrameMap frames_;
+    // Most recent first.
+    mutable std::list<int> recency_;
+    mutable size_t bytes_;
+
+    mutable std::deque<int> pending_;
+    // Frame being decoded by the read-ahead thread, or -1.
+    mutable int decoding_;
+    mutable int last_time_;
+    mutable int direction_;
+    bool stop_;
+
+    boost::scoped_ptr<boost::thread> thread_;
+
+    // Non-copyable.
+    CachedVideo(const CachedVideo&);
+    CachedVideo& operator=(const CachedVideo&);
+};
+
+#endif
@@ -1,4 +1,56 @@
 #include "camera.hpp"
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Points are projected in blocks whose intermediate co-ordinates stay in L1
+// cache between the passes of projectBatch().
+const int PROJECT_BLOCK_SIZE = 256;
+
+// Applies the extrinsic matrix to n points and divides by depth.
+void projectToPlane(const cv::Matx34d& P,
+                    const double* x,
+                    const double* y,
+                    const double* z,
+                    int n,
+                    double* a,
+                    double* b) {
+  int i = 0;
+
+#ifdef __SSE2__
+  for (; i + 2 <= n; i += 2) {
+    __m128d X = _mm_loadu_pd(x + i);
+    __m128d Y = _mm_loadu_pd(y + i);
+    __m128d Z = _mm_loadu_pd(z + i);
+
+    __m128d rows[3];
+    for (int j = 0; j < 3; j += 1) {
+      __m128d r = _mm_mul_pd(_mm_set1_pd(P(j, 0)), X);
+      r = _mm_add_pd(r, _mm_mul_pd(_mm_set1_pd(P(j, 1)), Y));
+      r = _mm_add_pd(r, _mm_mul_pd(_mm_set1_pd(P(j, 2)), Z));
+      rows[j] = _mm_add_pd(r, _mm_set1_pd(P(j, 3)));
+    }
+
+    _mm_storeu_pd(a + i, _mm_div_pd(rows[0], rows[2]));
+    _mm_storeu_pd(b + i, _mm_div_pd(rows[1], rows[2]));
+  }
+#endif
+
+  for (; i < n; i += 1) {
+    double r0 = P(0, 0) * x[i] + P(0, 1) * y[i] + P(0, 2) * z[i] + P(0, 3);
+    double r1 = P(1, 0) * x[i] + P(1, 1) * y[i] + P(1, 2) * z[i] + P(1, 3);
+    double r2 = P(2, 0) * x[i] + P(2, 1) * y[i] + P(2, 2) * z[i] + P(2, 3);
+    a[i] = r0 / r2;
+    b[i] = r1 / r2;
+  }
+}
+
+}
+
 
 Camera::Camera() : intrinsics_(), extrinsics_() {}
 
@@ -24,3 +76,42 @@ cv::Point2d Camera::project(const cv::Point3d& x) const {
   cv::Point2d w = extrinsics_.project(x);
   return intrinsics_.distortAndUncalibrate(w);
 }
+
+void Camera::projectBatch(const double* x,
+                          const double* y,
+                          const double* z,
+                          int n,
+                          double* u,
+                          double* v) const {
+  cv::Matx34d P = extrinsics_.matrix();
+
+  // Terms of distort() and the intrinsic matrix.
+  double w = intrinsics_.distort_w;
+  double tan_half_w = std::tan(w / 2.);
+  double fx = intrinsics_.focal_x;
+  double fy = intrinsics_.focal_y;
+  double px = intrinsics_.principal_point.x;
+  double py = intrinsics_.principal_point.y;
+
+  double a[PROJECT_BLOCK_SIZE];
+  double b[PROJECT_BLOCK_SIZE];
+
+  for (int begin = 0; begin < n; begin += PROJECT_BLOCK_SIZE) {
+    int m = std::min(PROJECT_BLOCK_SIZE, n - begin);
+    projectToPlane(P, x + begin, y + begin, z + begin, m, a, b);
+
+    // Distort. The arctangent has no vector form, so this pass is scalar.
+    for (int i = 0; i < m; i += 1) {
+      double r = std::sqrt(a[i] * a[i] + b[i] * b[i]);
+      double scale = 1. / w * std::atan(2. * r * tan_half_w) / r;
+      a[i] *= scale;
+      b[i] *= scale;
+    }
+
+    // Multiply by K.
+    for (int i = 0; i < m; i += 1) {
+      u[begin + i] = -fx * a[i] + px;
+      v[begin + i] = fy * b[i] + py;
+    }
+  }
+}
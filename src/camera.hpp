@@ -16,6 +16,14 @@ class Camera {
     cv::Matx34d matrix() const;
 
     cv::Point2d project(const cv::Point3d& x) const;
+    // Projects n points given as separate arrays of co-ordinates. Gives the
+    // same result as project() for each point.
+    void projectBatch(const double* x,
+                      const double* y,
+                      const double* z,
+                      int n,
+                      double* u,
+                      double* v) const;
 
   private:
     CameraProperties intrinsics_;
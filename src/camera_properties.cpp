@@ -1,8 +1,31 @@
 #include "camera_properties.hpp"
+#include <algorithm>
 #include <cmath>
 #include "distortion.hpp"
 #include "util.hpp"
 
+// Samples of the undistortion table used for many points.
+const int UNDISTORTION_TABLE_SIZE = 1 << 14;
+
+namespace {
+
+cv::Point2d transformPoint(const cv::Matx33d& A, const cv::Point2d& x) {
+  cv::Vec3d y = A * cv::Vec3d(x.x, x.y, 1);
+  return cv::Point2d(y[0] / y[2], y[1] / y[2]);
+}
+
+void transformPoints(const cv::Matx33d& A,
+                     const std::vector<cv::Point2d>& x,
+                     std::vector<cv::Point2d>& y) {
+  int n = x.size();
+  y.resize(n);
+  for (int i = 0; i < n; i += 1) {
+    y[i] = transformPoint(A, x[i]);
+  }
+}
+
+}
+
 cv::Matx33d CameraProperties::matrix() const {
   const double& fx = focal_x;
   const double& fy = focal_y;
@@ -46,6 +69,75 @@ cv::Point2d CameraProperties::distortAndUncalibrate(
   return imagePointFromHomogeneous(cv::Mat(matrix()) * Y);
 }
 
+void CameraProperties::calibrate(const std::vector<cv::Point2d>& y,
+                                 std::vector<cv::Point2d>& x) const {
+  transformPoints(matrix().inv(), y, x);
+}
+
+void CameraProperties::uncalibrate(const std::vector<cv::Point2d>& x,
+                                   std::vector<cv::Point2d>& y) const {
+  transformPoints(matrix(), x, y);
+}
+
+void CameraProperties::calibrateAndUndistort(
+    const std::vector<cv::Point2d>& y,
+    std::vector<cv::Point2d>& x) const {
+  // Tabulate only as far as the points reach, and only if there are more
+  // points than samples. An empty table undistorts every point exactly.
+  double max_radius = 0;
+  if (y.size() >= size_t(UNDISTORTION_TABLE_SIZE)) {
+    // Not into x, which may be the same vector as y.
+    std::vector<cv::Point2d> calibrated;
+    calibrate(y, calibrated);
+    std::vector<cv::Point2d>::const_iterator point;
+    for (point = calibrated.begin(); point != calibrated.end(); ++point) {
+      max_radius = std::max(max_radius, cv::norm(*point));
+    }
+  }
+  UndistortionTable table(distort_w, max_radius, UNDISTORTION_TABLE_SIZE);
+  calibrateAndUndistort(table, y, x);
+}
+
+void CameraProperties::calibrateAndUndistort(
+    const UndistortionTable& table,
+    const std::vector<cv::Point2d>& y,
+    std::vector<cv::Point2d>& x) const {
+  calibrate(y, x);
+
+  std::vector<cv::Point2d>::iterator out;
+  for (out = x.begin(); out != x.end(); ++out) {
+    *out = table.undistort(*out);
+  }
+}
+
+UndistortionTable CameraProperties::undistortionTable() const {
+  // The radius is greatest at one of the corners.
+  std::vector<cv::Point2d> corners;
+  corners.push_back(cv::Point2d(0, 0));
+  corners.push_back(cv::Point2d(image_size.width, 0));
+  corners.push_back(cv::Point2d(0, image_size.height));
+  corners.push_back(cv::Point2d(image_size.width, image_size.height));
+  calibrate(corners, corners);
+
+  double max_radius = 0;
+  std::vector<cv::Point2d>::const_iterator corner;
+  for (corner = corners.begin(); corner != corners.end(); ++corner) {
+    max_radius = std::max(max_radius, cv::norm(*corner));
+  }
+  return UndistortionTable(distort_w, max_radius, UNDISTORTION_TABLE_SIZE);
+}
+
+void CameraProperties::distortAndUncalibrate(
+    const std::vector<cv::Point2d>& x,
+    std::vector<cv::Point2d>& y) const {
+  cv::Matx33d K = matrix();
+  int n = x.size();
+  y.resize(n);
+  for (int i = 0; i < n; i += 1) {
+    y[i] = transformPoint(K, distort(x[i], distort_w));
+  }
+}
+
 AxisAlignedEllipse CameraProperties::undistortableRegion() const {
   // Get the circular bounds in the calibrated, distorted image.
   double r = maxDistortedRadius(distort_w);
@@ -1,9 +1,12 @@
 #ifndef CAMERA_PROPERTIES_HPP_
 #define CAMERA_PROPERTIES_HPP_
 
+#include <vector>
 #include <opencv2/core/core.hpp>
 #include "axis_aligned_ellipse.hpp"
 
+class UndistortionTable;
+
 struct CameraProperties {
   cv::Size image_size;
   double focal_x;
@@ -18,6 +21,27 @@ struct CameraProperties {
   cv::Point2d calibrateAndUndistort(const cv::Point2d& y) const;
   cv::Point2d distortAndUncalibrate(const cv::Point2d& x) const;
 
+  // The same for many points, with the intrinsics inverted once. Input and
+  // output may be the same vector.
+  void calibrate(const std::vector<cv::Point2d>& y,
+                 std::vector<cv::Point2d>& x) const;
+  void uncalibrate(const std::vector<cv::Point2d>& x,
+                   std::vector<cv::Point2d>& y) const;
+  // Interpolates an UndistortionTable over the radii of the points if there
+  // are enough of them to be worth it.
+  void calibrateAndUndistort(const std::vector<cv::Point2d>& y,
+                             std::vector<cv::Point2d>& x) const;
+  // Interpolates a table which was built once for the camera.
+  void calibrateAndUndistort(const UndistortionTable& table,
+                             const std::vector<cv::Point2d>& y,
+                             std::vector<cv::Point2d>& x) const;
+  void distortAndUncalibrate(const std::vector<cv::Point2d>& x,
+                             std::vector<cv::Point2d>& y) const;
+
+  // Tabulates the undistortion of every radius within the image, for
+  // callers which undistort points many times with the same camera.
+  UndistortionTable undistortionTable() const;
+
   // Returns the undistortable region of the uncalibrated, distorted image.
   AxisAlignedEllipse undistortableRegion() const;
 
@@ -19,5 +19,7 @@ bool CameraReader::read(const cv::FileNode& node, Camera& camera) {
     return false;
   }
 
+  camera = Camera(intrinsics, extrinsics);
+
   return true;
 }
@@ -0,0 +1,76 @@
+#include "camera_rig.hpp"
+#include <glog/logging.h>
+#include "geometry.hpp"
+
+CameraRig::ViewPair::ViewPair() : F(), epipole(), computed(false) {}
+
+CameraRig::CameraRig() : cameras_(), regions_(), masks_(), pairs_(), mutex_() {}
+
+CameraRig::CameraRig(const std::vector<Camera>& cameras)
+    : cameras_(cameras), regions_(), masks_(), pairs_(), mutex_() {
+  int n = cameras_.size();
+
+  std::vector<Camera>::const_iterator camera;
+  for (camera = cameras_.begin(); camera != cameras_.end(); ++camera) {
+    regions_.push_back(camera->intrinsics().undistortableRegion());
+    masks_.push_back(UndistortableMask(camera->intrinsics()));
+  }
+
+  // Allocate every pair up front so that references to them stay valid.
+  pairs_.resize(n * n);
+}
+
+int CameraRig::numViews() const {
+  return cameras_.size();
+}
+
+const Camera& CameraRig::camera(int view) const {
+  return cameras_[view];
+}
+
+const AxisAlignedEllipse& CameraRig::undistortableRegion(int view) const {
+  return regions_[view];
+}
+
+const UndistortableMask& CameraRig::undistortableMask(int view) const {
+  return masks_[view];
+}
+
+const cv::Matx33d& CameraRig::fundamentalMatrix(int view1, int view2) const {
+  return viewPair(view1, view2).F;
+}
+
+const cv::Vec3d& CameraRig::epipole(int view1, int view2) const {
+  return viewPair(view1, view2).epipole;
+}
+
+const CameraRig::ViewPair& CameraRig::viewPair(int view1, int view2) const {
+  int n = numViews();
+  CHECK(0 <= view1 && view1 < n);
+  CHECK(0 <= view2 && view2 < n);
+  CHECK(view1 != view2) << "Pair must be two different views";
+
+  boost::mutex::scoped_lock lock(mutex_);
+  ViewPair& forward = pairs_[view1 * n + view2];
+
+  if (!forward.computed) {
+    ViewPair& backward = pairs_[view2 * n + view1];
+
+    cv::Matx34d P1 = cameras_[view1].matrix();
+    cv::Matx34d P2 = cameras_[view2].matrix();
+
+    // The pair in the other order has the transposed matrix.
+    forward.F = computeFundMatFromCameras(P1, P2);
+    backward.F = forward.F.t();
+
+    cv::Point3d c1 = cameras_[view1].extrinsics().center;
+    cv::Point3d c2 = cameras_[view2].extrinsics().center;
+    forward.epipole = P2 * cv::Vec4d(c1.x, c1.y, c1.z, 1);
+    backward.epipole = P1 * cv::Vec4d(c2.x, c2.y, c2.z, 1);
+
+    forward.computed = true;
+    backward.computed = true;
+  }
+
+  return forward;
+}
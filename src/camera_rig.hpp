@@ -0,0 +1,59 @@
+#ifndef CAMERA_RIG_HPP_
+#define CAMERA_RIG_HPP_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <boost/thread/mutex.hpp>
+#include "axis_aligned_ellipse.hpp"
+#include "camera.hpp"
+#include "undistortable_mask.hpp"
+
+// The geometry of a set of static cameras.
+//
+// The fundamental matrix and epipoles of each pair of views are computed from
+// the cameras the first time they are needed and kept for later. The rig may
+// be shared between threads.
+class CameraRig {
+  public:
+    CameraRig();
+    explicit CameraRig(const std::vector<Camera>& cameras);
+
+    int numViews() const;
+    const Camera& camera(int view) const;
+    // Region of the distorted image which can be undistorted.
+    const AxisAlignedEllipse& undistortableRegion(int view) const;
+    // Pixels of the image which are in its undistortable region.
+    const UndistortableMask& undistortableMask(int view) const;
+
+    // Fundamental matrix mapping undistorted points in view1 to lines in
+    // view2, as computeFundMatFromCameras(P1, P2).
+    const cv::Matx33d& fundamentalMatrix(int view1, int view2) const;
+    // Image of the center of camera view1 in view2, in homogeneous
+    // undistorted co-ordinates.
+    const cv::Vec3d& epipole(int view1, int view2) const;
+
+  private:
+    // Geometry of an ordered pair of views.
+    struct ViewPair {
+      cv::Matx33d F;
+      cv::Vec3d epipole;
+      bool computed;
+
+      ViewPair();
+    };
+
+    const ViewPair& viewPair(int view1, int view2) const;
+
+    std::vector<Camera> cameras_;
+    std::vector<AxisAlignedEllipse> regions_;
+    std::vector<UndistortableMask> masks_;
+    // Pair (i, j) is at i * numViews() + j.
+    mutable std::vector<ViewPair> pairs_;
+    mutable boost::mutex mutex_;
+
+    // Not copyable.
+    CameraRig(const CameraRig&);
+    CameraRig& operator=(const CameraRig&);
+};
+
+#endif
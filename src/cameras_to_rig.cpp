@@ -0,0 +1,89 @@
+#include <sstream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+#include <boost/format.hpp>
+
+#include "camera.hpp"
+
+#include "read_lines.hpp"
+#include "camera_properties_reader.hpp"
+#include "camera_pose_reader.hpp"
+
+#include "iterator_writer.hpp"
+#include "camera_writer.hpp"
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Collects the cameras of every view into one file, which can be "
+      "loaded as a CameraRig." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " intrinsics-format extrinsics-format views rig" <<
+      std::endl;
+  usage << std::endl;
+  usage << "Parameters:" << std::endl;
+  usage << "intrinsics-format -- e.g. intrinsics/%s.yaml" << std::endl;
+  usage << "extrinsics-format -- e.g. extrinsics/%s.yaml" << std::endl;
+  usage << "views -- Text file whose lines are the view names" << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 5) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+std::string makeViewFilename(const std::string& format,
+                             const std::string& name) {
+  return boost::str(boost::format(format) % name);
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string intrinsics_format = argv[1];
+  std::string extrinsics_format = argv[2];
+  std::string views_file = argv[3];
+  std::string rig_file = argv[4];
+
+  bool ok;
+
+  // Load names of views.
+  std::vector<std::string> view_names;
+  ok = readLines(views_file, view_names);
+  CHECK(ok) << "Could not load view names";
+  int num_views = view_names.size();
+
+  // Load camera of each view.
+  std::vector<Camera> cameras;
+  CameraPropertiesReader intrinsics_reader;
+  CameraPoseReader extrinsics_reader;
+
+  for (int view = 0; view < num_views; view += 1) {
+    const std::string& name = view_names[view];
+
+    CameraProperties intrinsics;
+    std::string intrinsics_file = makeViewFilename(intrinsics_format, name);
+    ok = load(intrinsics_file, intrinsics, intrinsics_reader);
+    CHECK(ok) << "Could not load intrinsics for view " << name;
+
+    CameraPose extrinsics;
+    std::string extrinsics_file = makeViewFilename(extrinsics_format, name);
+    ok = load(extrinsics_file, extrinsics, extrinsics_reader);
+    CHECK(ok) << "Could not load extrinsics for view " << name;
+
+    cameras.push_back(Camera(intrinsics, extrinsics));
+  }
+
+  CameraWriter camera_writer;
+  ok = saveList(rig_file, cameras, camera_writer);
+  CHECK(ok) << "Could not save cameras";
+  LOG(INFO) << "Saved " << num_views << " cameras";
+
+  return 0;
+}
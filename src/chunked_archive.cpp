@@ -0,0 +1,437 @@
+#include "chunked_archive.hpp"
+#include <cstring>
+#include <boost/format.hpp>
+#include <lz4.h>
+#include <zstd.h>
+#include <glog/logging.h>
+
+namespace {
+
+const uint32_t VERSION = 1;
+const int ZSTD_LEVEL = 3;
+
+template<class T>
+void writeValue(std::ofstream& file, const T& x) {
+  file.write(reinterpret_cast<const char*>(&x), sizeof(x));
+}
+
+template<class T>
+bool readValue(std::ifstream& file, T& x) {
+  file.read(reinterpret_cast<char*>(&x), sizeof(x));
+  return file.good();
+}
+
+bool readType(std::ifstream& file, const char* type) {
+  char buffer[4];
+  file.read(buffer, 4);
+  return file.good() && std::memcmp(buffer, type, 4) == 0;
+}
+
+// Returns the codec which was used. Chunks which do not get smaller are left
+// uncompressed.
+ArchiveCodec compress(ArchiveCodec codec,
+                      const std::string& src,
+                      std::string& dst) {
+  if (codec == ARCHIVE_LZ4) {
+    CHECK(src.size() <= size_t(LZ4_MAX_INPUT_SIZE)) << "Chunk is too large";
+    int bound = LZ4_compressBound(src.size());
+    dst.resize(bound);
+    int size = LZ4_compress_default(src.data(), &dst[0], src.size(), bound);
+    if (size > 0 && size_t(size) < src.size()) {
+      dst.resize(size);
+      return ARCHIVE_LZ4;
+    }
+  } else if (codec == ARCHIVE_ZSTD) {
+    size_t bound = ZSTD_compressBound(src.size());
+    dst.resize(bound);
+    size_t size = ZSTD_compress(&dst[0], bound, src.data(), src.size(),
+        ZSTD_LEVEL);
+    if (!ZSTD_isError(size) && size < src.size()) {
+      dst.resize(size);
+      return ARCHIVE_ZSTD;
+    }
+  }
+
+  dst = src;
+  return ARCHIVE_UNCOMPRESSED;
+}
+
+bool decompress(ArchiveCodec codec,
+                const std::string& src,
+                size_t size,
+                std::string& dst) {
+  dst.resize(size);
+  if (size == 0) {
+    return true;
+  }
+
+  if (codec == ARCHIVE_UNCOMPRESSED) {
+    if (src.size() != size) {
+      return false;
+    }
+    dst = src;
+    return true;
+  } else if (codec == ARCHIVE_LZ4) {
+    int n = LZ4_decompress_safe(src.data(), &dst[0], src.size(), size);
+    return n >= 0 && size_t(n) == size;
+  } else if (codec == ARCHIVE_ZSTD) {
+    size_t n = ZSTD_decompress(&dst[0], size, src.data(), src.size());
+    return !ZSTD_isError(n) && n == size;
+  }
+
+  return false;
+}
+
+}
+
+bool parseArchiveCodec(const std::string& name, ArchiveCodec& codec) {
+  if (name == "none") {
+    codec = ARCHIVE_UNCOMPRESSED;
+  } else if (name == "lz4") {
+    codec = ARCHIVE_LZ4;
+  } else if (name == "zstd") {
+    codec = ARCHIVE_ZSTD;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+ChunkedArchiveWriter::ChunkedArchiveWriter(ArchiveCodec codec,
+                                           size_t chunk_size)
+    : codec_(codec),
+      chunk_size_(chunk_size),
+      filename_(),
+      file_(),
+      chunk_(),
+      num_chunk_entries_(0),
+      chunk_offsets_(),
+      entries_(),
+      keys_() {}
+
+ChunkedArchiveWriter::~ChunkedArchiveWriter() {
+  if (isOpen()) {
+    close();
+  }
+}
+
+bool ChunkedArchiveWriter::open(const std::string& filename) {
+  filename_ = filename;
+  chunk_.clear();
+  num_chunk_entries_ = 0;
+  chunk_offsets_.clear();
+  entries_.clear();
+  keys_.clear();
+
+  file_.open(filename.c_str(),
+      std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+  if (!file_) {
+    LOG(WARNING) << "Could not open `" << filename << "' for writing";
+    return false;
+  }
+
+  file_.write("TRKA", 4);
+  writeValue(file_, VERSION);
+  return file_.good();
+}
+
+bool ChunkedArchiveWriter::isOpen() const {
+  return file_.is_open();
+}
+
+bool ChunkedArchiveWriter::add(const std::string& key,
+                               const std::string& data) {
+  return add(key, data.data(), data.size());
+}
+
+bool ChunkedArchiveWriter::add(const std::string& key,
+                               const char* data,
+                               size_t size) {
+  CHECK(isOpen());
+
+  if (keys_.find(key) != keys_.end()) {
+    LOG(WARNING) << "Archive already contains `" << key << "'";
+    return false;
+  }
+
+  Entry entry;
+  entry.chunk = chunk_offsets_.size();
+  entry.offset = chunk_.size();
+  entry.size = size;
+  keys_[key] = entries_.size();
+  entries_.push_back(std::make_pair(key, entry));
+
+  chunk_.append(data, size);
+  num_chunk_entries_ += 1;
+
+  if (chunk_.size() >= chunk_size_) {
+    return writeChunk();
+  }
+  return true;
+}
+
+bool ChunkedArchiveWriter::writeChunk() {
+  if (num_chunk_entries_ == 0) {
+    return true;
+  }
+
+  std::string compressed;
+  int32_t codec = compress(codec_, chunk_, compressed);
+  int32_t chunk_id = chunk_offsets_.size();
+  int32_t num_entries = num_chunk_entries_;
+  int64_t size = chunk_.size();
+  int64_t compressed_size = compressed.size();
+
+  chunk_offsets_.push_back(file_.tellp());
+  file_.write("CHNK", 4);
+  writeValue(file_, chunk_id);
+  writeValue(file_, codec);
+  writeValue(file_, num_entries);
+  writeValue(file_, size);
+  writeValue(file_, compressed_size);
+  file_.write(compressed.data(), compressed.size());
+
+  chunk_.clear();
+  num_chunk_entries_ = 0;
+
+  if (!file_.good()) {
+    LOG(WARNING) << "Could not write to `" << filename_ << "'";
+    return false;
+  }
+  return true;
+}
+
+bool ChunkedArchiveWriter::close() {
+  CHECK(isOpen());
+  bool ok = writeChunk();
+
+  int64_t index_offset = file_.tellp();
+  file_.write("INDX", 4);
+
+  int32_t num_chunks = chunk_offsets_.size();
+  writeValue(file_, num_chunks);
+  for (int i = 0; i < num_chunks; i += 1) {
+    writeValue(file_, chunk_offsets_[i]);
+  }
+
+  int32_t num_entries = entries_.size();
+  writeValue(file_, num_entries);
+  for (int i = 0; i < num_entries; i += 1) {
+    const std::string& key = entries_[i].first;
+    const Entry& entry = entries_[i].second;
+
+    int32_t key_size = key.size();
+    writeValue(file_, key_size);
+    file_.write(key.data(), key.size());
+    int32_t chunk = entry.chunk;
+    writeValue(file_, chunk);
+    writeValue(file_, entry.offset);
+    writeValue(file_, entry.size);
+  }
+
+  file_.write("TERM", 4);
+  writeValue(file_, index_offset);
+
+  ok = ok && file_.good();
+  file_.close();
+  if (!ok) {
+    LOG(WARNING) << "Could not write to `" << filename_ << "'";
+  }
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+ChunkedArchiveReader::ChunkedArchiveReader()
+    : filename_(),
+      file_(),
+      chunk_offsets_(),
+      entries_(),
+      current_chunk_(-1),
+      chunk_() {}
+
+bool ChunkedArchiveReader::open(const std::string& filename) {
+  filename_ = filename;
+  chunk_offsets_.clear();
+  entries_.clear();
+  current_chunk_ = -1;
+  chunk_.clear();
+  if (file_.is_open()) {
+    file_.close();
+  }
+  file_.clear();
+
+  file_.open(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+  if (!file_) {
+    LOG(WARNING) << "Could not open `" << filename << "' for reading";
+    return false;
+  }
+
+  uint32_t version;
+  if (!readType(file_, "TRKA") || !readValue(file_, version)) {
+    LOG(WARNING) << "`" << filename << "' is not an archive";
+    file_.close();
+    return false;
+  }
+  if (version != VERSION) {
+    LOG(WARNING) << "`" << filename << "' has unsupported version " <<
+        version;
+    file_.close();
+    return false;
+  }
+
+  // Find the index from the terminating header.
+  int64_t term_size = 4 + sizeof(int64_t);
+  file_.seekg(0, std::ios_base::end);
+  int64_t file_size = file_.tellg();
+  int64_t index_offset;
+  bool ok = file_size >= 8 + term_size;
+  if (ok) {
+    file_.seekg(file_size - term_size);
+    ok = readType(file_, "TERM") && readValue(file_, index_offset) &&
+        index_offset >= 8 && index_offset < file_size - term_size;
+  }
+
+  int32_t num_chunks = 0;
+  if (ok) {
+    file_.seekg(index_offset);
+    ok = readType(file_, "INDX") && readValue(file_, num_chunks) &&
+        num_chunks >= 0;
+  }
+
+  for (int i = 0; ok && i < num_chunks; i += 1) {
+    int64_t offset;
+    ok = readValue(file_, offset) && offset >= 8 && offset < index_offset;
+    chunk_offsets_.push_back(offset);
+  }
+
+  int32_t num_entries = 0;
+  if (ok) {
+    ok = readValue(file_, num_entries) && num_entries >= 0;
+  }
+
+  for (int i = 0; ok && i < num_entries; i += 1) {
+    int32_t key_size;
+    ok = readValue(file_, key_size) && key_size >= 0 &&
+        key_size < index_offset;
+    if (!ok) {
+      break;
+    }
+
+    std::string key(key_size, '\0');
+    if (key_size > 0) {
+      file_.read(&key[0], key_size);
+    }
+
+    int32_t chunk;
+    Entry entry;
+    ok = readValue(file_, chunk) && readValue(file_, entry.offset) &&
+        readValue(file_, entry.size);
+    ok = ok && chunk >= 0 && chunk < num_chunks && entry.offset >= 0 &&
+        entry.size >= 0;
+    entry.chunk = chunk;
+    entries_[key] = entry;
+  }
+
+  if (!ok) {
+    LOG(WARNING) << "Could not read index of `" << filename << "'";
+    chunk_offsets_.clear();
+    entries_.clear();
+    file_.close();
+    return false;
+  }
+
+  return true;
+}
+
+bool ChunkedArchiveReader::isOpen() const {
+  return file_.is_open();
+}
+
+int ChunkedArchiveReader::size() const {
+  return entries_.size();
+}
+
+bool ChunkedArchiveReader::contains(const std::string& key) const {
+  return entries_.find(key) != entries_.end();
+}
+
+void ChunkedArchiveReader::keys(std::vector<std::string>& keys) const {
+  keys.clear();
+  std::map<std::string, Entry>::const_iterator entry;
+  for (entry = entries_.begin(); entry != entries_.end(); ++entry) {
+    keys.push_back(entry->first);
+  }
+}
+
+bool ChunkedArchiveReader::loadChunk(int chunk) {
+  if (chunk == current_chunk_) {
+    return true;
+  }
+  current_chunk_ = -1;
+
+  file_.clear();
+  file_.seekg(chunk_offsets_[chunk]);
+
+  int32_t chunk_id;
+  int32_t codec;
+  int32_t num_entries;
+  int64_t size;
+  int64_t compressed_size;
+  bool ok = readType(file_, "CHNK") && readValue(file_, chunk_id) &&
+      readValue(file_, codec) && readValue(file_, num_entries) &&
+      readValue(file_, size) && readValue(file_, compressed_size);
+  ok = ok && chunk_id == chunk && size >= 0 && compressed_size >= 0;
+
+  std::string compressed;
+  if (ok) {
+    compressed.resize(compressed_size);
+    if (compressed_size > 0) {
+      file_.read(&compressed[0], compressed_size);
+    }
+    ok = file_.good() &&
+        decompress(ArchiveCodec(codec), compressed, size, chunk_);
+  }
+
+  if (!ok) {
+    LOG(WARNING) << "Chunk " << chunk << " of `" << filename_ <<
+        "' is corrupt";
+    return false;
+  }
+
+  current_chunk_ = chunk;
+  return true;
+}
+
+bool ChunkedArchiveReader::read(const std::string& key, std::string& data) {
+  CHECK(isOpen());
+
+  std::map<std::string, Entry>::const_iterator it = entries_.find(key);
+  if (it == entries_.end()) {
+    LOG(WARNING) << "`" << filename_ << "' does not contain `" << key << "'";
+    return false;
+  }
+  const Entry& entry = it->second;
+
+  if (!loadChunk(entry.chunk)) {
+    return false;
+  }
+  if (uint64_t(entry.offset + entry.size) > chunk_.size()) {
+    LOG(WARNING) << "Entry `" << key << "' is outside its chunk";
+    return false;
+  }
+
+  data.assign(chunk_, entry.offset, entry.size);
+  return true;
+}
+
+int countFrameEntries(const ChunkedArchiveReader& archive,
+                      const std::string& format) {
+  int n = 0;
+  while (archive.contains(boost::str(boost::format(format) % (n + 1)))) {
+    n += 1;
+  }
+  return n;
+}
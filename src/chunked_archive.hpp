@@ -0,0 +1,168 @@
+#ifndef CHUNKED_ARCHIVE_HPP_
+#define CHUNKED_ARCHIVE_HPP_
+
+// Stores many small files, such as the keypoints of every frame, in one file.
+//
+// Modelled on the chunk headers of videoseg/io.hpp, with compressed chunks and
+// an index of keys at the end so that any entry can be found without reading
+// the chunks before it. Values are in the byte order of the machine which
+// wrote them.
+//
+// ARCHIVE_HEADER {
+//   type                                         : char[4] = "TRKA"
+//   version                                      : uint32
+// }
+//
+// followed by chunks
+// CHUNK {
+//   type                                         : char[4] = "CHNK"
+//   chunk id                                     : int32
+//   codec of this chunk                          : int32
+//   number of entries                            : int32
+//   uncompressed size                            : int64
+//   compressed size (sz)                         : int64
+//   entries concatenated and compressed          : char[sz]
+// }
+//
+// followed by the index
+// INDEX {
+//   type                                         : char[4] = "INDX"
+//   number of chunks (C)                         : int32
+//   C FileOffsets of chunk headers               : int64
+//   number of entries (N)                        : int32
+//   N times {
+//     key size (k)                               : int32
+//     key                                        : char[k]
+//     chunk id                                   : int32
+//     offset in uncompressed chunk               : int64
+//     size                                       : int64
+//   }
+// }
+//
+// with terminating header at the end
+// TERM_HEADER {
+//   type                                         : char[4] = "TERM"
+//   FileOffset of index                          : int64
+// }
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "reader.hpp"
+#include "writer.hpp"
+
+enum ArchiveCodec {
+  ARCHIVE_UNCOMPRESSED = 0,
+  // Fast to decompress.
+  ARCHIVE_LZ4 = 1,
+  // Smaller but slower.
+  ARCHIVE_ZSTD = 2
+};
+
+// Returns false if the name is not one of none, lz4 or zstd.
+bool parseArchiveCodec(const std::string& name, ArchiveCodec& codec);
+
+// Usage:
+// ChunkedArchiveWriter archive(ARCHIVE_LZ4);
+// archive.open(FILENAME);
+// for (...) {
+//   archive.add(KEY, DATA);
+// }
+// archive.close();
+class ChunkedArchiveWriter {
+  public:
+    static const size_t DEFAULT_CHUNK_SIZE = 1 << 20;
+
+    // Entries are buffered until there are at least chunk_size bytes.
+    explicit ChunkedArchiveWriter(ArchiveCodec codec = ARCHIVE_LZ4,
+                                  size_t chunk_size = DEFAULT_CHUNK_SIZE);
+    // Closes the file if it is open.
+    ~ChunkedArchiveWriter();
+
+    // Returns false if the file could not be opened.
+    bool open(const std::string& filename);
+    bool isOpen() const;
+
+    // Keys must be unique.
+    bool add(const std::string& key, const std::string& data);
+    bool add(const std::string& key, const char* data, size_t size);
+
+    // Writes the last chunk and the index.
+    bool close();
+
+  private:
+    struct Entry {
+      int chunk;
+      int64_t offset;
+      int64_t size;
+    };
+
+    bool writeChunk();
+
+    ArchiveCodec codec_;
+    size_t chunk_size_;
+
+    std::string filename_;
+    std::ofstream file_;
+
+    // Entries of the current chunk.
+    std::string chunk_;
+    int num_chunk_entries_;
+
+    std::vector<int64_t> chunk_offsets_;
+    std::vector<std::pair<std::string, Entry> > entries_;
+    std::map<std::string, int> keys_;
+};
+
+// Reads entries in any order. Only the index is read by open(), and the last
+// chunk which was decompressed is kept for entries which are near each other.
+// Not safe to use from multiple threads.
+class ChunkedArchiveReader {
+  public:
+    ChunkedArchiveReader();
+
+    // Returns false if the file could not be opened or is malformed.
+    bool open(const std::string& filename);
+    bool isOpen() const;
+
+    int size() const;
+    bool contains(const std::string& key) const;
+    // Lists the keys in order.
+    void keys(std::vector<std::string>& keys) const;
+
+    // Returns false if the key is not present or the chunk is corrupt.
+    bool read(const std::string& key, std::string& data);
+
+  private:
+    struct Entry {
+      int chunk;
+      int64_t offset;
+      int64_t size;
+    };
+
+    bool loadChunk(int chunk);
+
+    std::string filename_;
+    std::ifstream file_;
+    std::vector<int64_t> chunk_offsets_;
+    std::map<std::string, Entry> entries_;
+
+    int current_chunk_;
+    std::string chunk_;
+};
+
+// Counts the consecutive entries FORMAT % 1, FORMAT % 2, ... using only the
+// index, like countFrameFiles() for a directory of images.
+int countFrameEntries(const ChunkedArchiveReader& archive,
+                      const std::string& format);
+
+// Serializes anything which has a Writer into the data of one entry, so that
+// this can be done away from the thread which owns the archive.
+template<class T>
+std::string serializeEntry(const T& x, Writer<T>& writer);
+
+#include "chunked_archive.inl"
+
+#endif
@@ -0,0 +1,8 @@
+template<class T>
+std::string serializeEntry(const T& x, Writer<T>& writer) {
+  // The extension selects the format.
+  cv::FileStorage file(".yml",
+      cv::FileStorage::WRITE + cv::FileStorage::MEMORY);
+  writer.write(file, x);
+  return file.releaseAndGetString();
+}
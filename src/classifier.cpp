@@ -1,4 +1,34 @@
 #include "classifier.hpp"
+#include <glog/logging.h>
+#include "fixed_descriptor.hpp"
+
+namespace {
+
+// Computes w . x + b for the dimension of the classifier.
+class LinearScore {
+  public:
+    LinearScore(const Classifier& classifier, const std::vector<double>& x)
+        : classifier_(&classifier), x_(&x), score_(0) {}
+
+    template<int N>
+    void operator()(Dimension<N> dimension) {
+      score_ = classifier_->b;
+      if (dimension.size() > 0) {
+        score_ += dot(dimension, &classifier_->w.front(), &x_->front());
+      }
+    }
+
+    double score() const {
+      return score_;
+    }
+
+  private:
+    const Classifier* classifier_;
+    const std::vector<double>* x_;
+    double score_;
+};
+
+}
 
 void Classifier::swap(Classifier& other) {
   w.swap(other.w);
@@ -14,7 +44,11 @@ bool Classifier::classify(const Descriptor& descriptor) const {
 }
 
 double Classifier::score(const std::vector<double>& x) const {
-  return score(x.begin(), x.end());
+  CHECK(x.size() == w.size()) << "Descriptor differs in size";
+
+  LinearScore linear(*this, x);
+  dispatchDimension(w.size(), linear);
+  return linear.score();
 }
 
 double Classifier::score(const Descriptor& descriptor) const {
@@ -0,0 +1,99 @@
+#include "classifier_bank.hpp"
+#include <algorithm>
+#include <glog/logging.h>
+
+ClassifierBank::ClassifierBank(const std::deque<Classifier>& classifiers)
+    : weights_(), biases_(), gpu_() {
+  CHECK(!classifiers.empty());
+  int num_classifiers = classifiers.size();
+  int num_dimensions = classifiers.front().w.size();
+
+  weights_.create(num_classifiers, num_dimensions, cv::DataType<float>::type);
+  biases_.create(num_classifiers, 1, cv::DataType<float>::type);
+
+  for (int i = 0; i < num_classifiers; i += 1) {
+    const Classifier& classifier = classifiers[i];
+    CHECK(int(classifier.w.size()) == num_dimensions) <<
+        "Classifiers differ in dimension";
+
+    std::copy(classifier.w.begin(), classifier.w.end(),
+        weights_.ptr<float>(i));
+    biases_.at<float>(i) = classifier.b;
+  }
+}
+
+int ClassifierBank::size() const {
+  return weights_.rows;
+}
+
+int ClassifierBank::dimension() const {
+  return weights_.cols;
+}
+
+const float* ClassifierBank::weights(int i) const {
+  return weights_.ptr<float>(i);
+}
+
+float ClassifierBank::bias(int i) const {
+  return biases_.at<float>(i);
+}
+
+void ClassifierBank::score(const cv::Mat& points,
+                           int begin,
+                           int end,
+                           cv::Mat& scores) const {
+  score(ClassifierPoints(*this, points), begin, end, scores);
+}
+
+void ClassifierBank::score(const ClassifierPoints& points,
+                           int begin,
+                           int end,
+                           cv::Mat& scores) const {
+  CHECK(points.cols() == dimension()) << "Points differ in dimension";
+  CHECK(0 <= begin && begin <= end && end <= size());
+
+  if (points.rows() == 0 || begin == end) {
+    scores.create(end - begin, points.rows(), cv::DataType<float>::type);
+    return;
+  }
+
+  if (gpu_) {
+    CHECK(points.gpu_) << "Points were prepared before the upload";
+    gpu_->score(*points.gpu_, begin, end, scores);
+    return;
+  }
+
+  // Put the bias of each classifier in every column, then add W X^T.
+  cv::repeat(biases_.rowRange(begin, end), 1, points.rows(), scores);
+  cv::gemm(weights_.rowRange(begin, end), points.points_, 1., scores, 1.,
+      scores, cv::GEMM_2_T);
+}
+
+void ClassifierBank::upload() {
+  gpu_.reset(new GpuClassifierScorer(weights_, biases_));
+}
+
+bool ClassifierBank::usesGpu() const {
+  return gpu_.get() != NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+ClassifierPoints::ClassifierPoints(const ClassifierBank& classifiers,
+                                   const cv::Mat& points)
+    : points_(points), gpu_() {
+  if (points.type() != cv::DataType<float>::type) {
+    points.convertTo(points_, cv::DataType<float>::type);
+  }
+  if (classifiers.usesGpu()) {
+    gpu_.reset(new GpuPoints(points_));
+  }
+}
+
+int ClassifierPoints::rows() const {
+  return points_.rows;
+}
+
+int ClassifierPoints::cols() const {
+  return points_.cols;
+}
@@ -0,0 +1,68 @@
+#ifndef CLASSIFIER_BANK_HPP_
+#define CLASSIFIER_BANK_HPP_
+
+#include <deque>
+#include <boost/shared_ptr.hpp>
+#include <opencv2/core/core.hpp>
+#include "classifier.hpp"
+#include "gpu_matcher.hpp"
+
+class ClassifierBank;
+
+// Points to be scored by many blocks of classifiers. They are converted to
+// float once and, if the bank uses a CUDA device, uploaded to it once.
+class ClassifierPoints {
+  public:
+    ClassifierPoints(const ClassifierBank& classifiers,
+                     const cv::Mat& points);
+
+    int rows() const;
+    int cols() const;
+
+  private:
+    friend class ClassifierBank;
+
+    cv::Mat points_;
+    boost::shared_ptr<GpuPoints> gpu_;
+};
+
+// A set of linear classifiers of the same dimension, stacked into a matrix so
+// that they can score many points with one matrix product.
+class ClassifierBank {
+  public:
+    explicit ClassifierBank(const std::deque<Classifier>& classifiers);
+
+    int size() const;
+    int dimension() const;
+
+    // Weights of classifier i, contiguous in memory.
+    const float* weights(int i) const;
+    float bias(int i) const;
+
+    // Computes scores(i - begin, j) = w_i . x_j + b_i for classifiers i in
+    // [begin, end) and every row x_j of points.
+    // Points are converted to float if necessary.
+    void score(const cv::Mat& points,
+               int begin,
+               int end,
+               cv::Mat& scores) const;
+    // Scores points which were prepared once for every block.
+    void score(const ClassifierPoints& points,
+               int begin,
+               int end,
+               cv::Mat& scores) const;
+
+    // Keeps a copy of the classifiers on a CUDA device, which then computes
+    // every score. Fatal unless built with WITH_GPU.
+    void upload();
+    bool usesGpu() const;
+
+  private:
+    // One classifier per row.
+    cv::Mat weights_;
+    cv::Mat biases_;
+    // Shared by copies.
+    boost::shared_ptr<GpuClassifierScorer> gpu_;
+};
+
+#endif
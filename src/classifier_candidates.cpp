@@ -0,0 +1,230 @@
+#include "classifier_candidates.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include <glog/logging.h>
+#include "util/thread-pool.hpp"
+
+namespace {
+
+// Number of classifiers scored by each matrix product.
+const int CLASSIFIER_BLOCK_SIZE = 64;
+
+// (-score, index) to sort by distance.
+typedef std::pair<float, int> Candidate;
+
+float dotProduct(const float* x, const float* y, int n) {
+  float sum = 0;
+  for (int d = 0; d < n; d += 1) {
+    sum += x[d] * y[d];
+  }
+  return sum;
+}
+
+// Scores the candidates of one classifier exactly and selects its matches as
+// findMatchesUsingClassifierBank() does.
+void selectMatchesFromCandidates(const ClassifierBank& classifiers,
+                                 int i,
+                                 const cv::Mat& points,
+                                 std::vector<Candidate>& candidates,
+                                 QueryResultList& matches,
+                                 bool use_max_num,
+                                 int max_num,
+                                 bool use_threshold,
+                                 double threshold) {
+  const float* w = classifiers.weights(i);
+  float b = classifiers.bias(i);
+  int dimension = classifiers.dimension();
+
+  std::vector<Candidate> kept;
+  kept.reserve(candidates.size());
+  float max_negative_score = 0;
+  if (use_threshold && threshold > 0) {
+    max_negative_score = std::log(threshold);
+  }
+
+  if (!use_threshold || threshold > 0) {
+    std::vector<Candidate>::const_iterator candidate;
+    for (candidate = candidates.begin(); candidate != candidates.end();
+        ++candidate) {
+      int j = candidate->second;
+      float score = dotProduct(w, points.ptr<float>(j), dimension) + b;
+      if (!use_threshold || -score <= max_negative_score) {
+        kept.push_back(Candidate(-score, j));
+      }
+    }
+  }
+
+  int num_matches = kept.size();
+  if (use_max_num) {
+    num_matches = std::min(num_matches, max_num);
+  }
+  std::partial_sort(kept.begin(), kept.begin() + num_matches, kept.end());
+
+  matches.clear();
+  for (int n = 0; n < num_matches; n += 1) {
+    matches.push_back(QueryResult(kept[n].second, std::exp(kept[n].first)));
+  }
+}
+
+// Ranks the points using one block of projected classifiers, then scores the
+// candidates of each exactly.
+// For use with ThreadPool::parallelFor().
+class CandidateBlockFunction {
+  public:
+    CandidateBlockFunction(const ClassifierBank& classifiers,
+                           const ProjectedClassifierBank& projected_classifiers,
+                           const cv::Mat& points,
+                           const cv::Mat& projected_points,
+                           int num_candidates,
+                           std::deque<QueryResultList>& matches,
+                           bool use_max_num,
+                           int max_num,
+                           bool use_threshold,
+                           double threshold)
+        : classifiers_(&classifiers),
+          projected_classifiers_(&projected_classifiers),
+          points_(&points),
+          projected_points_(&projected_points),
+          num_candidates_(num_candidates),
+          matches_(&matches),
+          use_max_num_(use_max_num),
+          max_num_(max_num),
+          use_threshold_(use_threshold),
+          threshold_(threshold) {}
+
+    void operator()(int block) const {
+      int begin = block * CLASSIFIER_BLOCK_SIZE;
+      int end = std::min(begin + CLASSIFIER_BLOCK_SIZE, classifiers_->size());
+      int num_points = points_->rows;
+      int num_candidates = std::min(num_candidates_, num_points);
+
+      cv::Mat scores;
+      projected_classifiers_->score(*projected_points_, begin, end, scores);
+      std::vector<Candidate> candidates;
+
+      for (int i = begin; i < end; i += 1) {
+        const float* approximate = scores.ptr<float>(i - begin);
+        candidates.clear();
+        for (int j = 0; j < num_points; j += 1) {
+          candidates.push_back(Candidate(-approximate[j], j));
+        }
+        std::nth_element(candidates.begin(),
+            candidates.begin() + num_candidates, candidates.end());
+        candidates.resize(num_candidates);
+
+        selectMatchesFromCandidates(*classifiers_, i, *points_, candidates,
+            (*matches_)[i], use_max_num_, max_num_, use_threshold_,
+            threshold_);
+      }
+    }
+
+  private:
+    const ClassifierBank* classifiers_;
+    const ProjectedClassifierBank* projected_classifiers_;
+    const cv::Mat* points_;
+    const cv::Mat* projected_points_;
+    int num_candidates_;
+    std::deque<QueryResultList>* matches_;
+    bool use_max_num_;
+    int max_num_;
+    bool use_threshold_;
+    double threshold_;
+};
+
+}
+
+ProjectedClassifierBank::ProjectedClassifierBank(
+    const ClassifierBank& classifiers,
+    const PcaProjection& projection)
+    : weights_(), biases_() {
+  CHECK(!projection.empty()) << "Projection has not been trained";
+  CHECK(projection.dimension() == classifiers.dimension()) <<
+      "Projection differs in dimension from classifiers";
+
+  int num_classifiers = classifiers.size();
+  int num_dimensions = classifiers.dimension();
+  cv::Mat W(num_classifiers, num_dimensions, cv::DataType<float>::type);
+  cv::Mat b(num_classifiers, 1, cv::DataType<float>::type);
+  for (int i = 0; i < num_classifiers; i += 1) {
+    const float* w = classifiers.weights(i);
+    std::copy(w, w + num_dimensions, W.ptr<float>(i));
+    b.at<float>(i) = classifiers.bias(i);
+  }
+
+  // B w for each classifier, and w . mean + b.
+  cv::gemm(W, projection.basis(), 1., cv::Mat(), 0., weights_, cv::GEMM_2_T);
+  cv::gemm(W, projection.mean(), 1., b, 1., biases_, cv::GEMM_2_T);
+}
+
+int ProjectedClassifierBank::size() const {
+  return weights_.rows;
+}
+
+int ProjectedClassifierBank::dimension() const {
+  return weights_.cols;
+}
+
+void ProjectedClassifierBank::score(const cv::Mat& projected,
+                                    int begin,
+                                    int end,
+                                    cv::Mat& scores) const {
+  CHECK(projected.cols == dimension()) << "Points differ in dimension";
+  CHECK(projected.type() == cv::DataType<float>::type);
+  CHECK(0 <= begin && begin <= end && end <= size());
+
+  if (projected.rows == 0 || begin == end) {
+    scores.create(end - begin, projected.rows, cv::DataType<float>::type);
+    return;
+  }
+
+  cv::repeat(biases_.rowRange(begin, end), 1, projected.rows, scores);
+  cv::gemm(weights_.rowRange(begin, end), projected, 1., scores, 1., scores,
+      cv::GEMM_2_T);
+}
+
+void findMatchesUsingClassifierCandidates(
+    const ClassifierBank& classifiers,
+    const PcaProjection& projection,
+    const DescriptorMatrix& points,
+    int num_candidates,
+    std::deque<QueryResultList>& matches,
+    bool use_max_num,
+    int max_num,
+    bool use_threshold,
+    double threshold,
+    ThreadPool* pool) {
+  if (use_max_num) {
+    CHECK(max_num > 0);
+  }
+  CHECK(num_candidates > 0);
+
+  // Every block writes to its own elements.
+  matches.assign(classifiers.size(), QueryResultList());
+  if (points.empty()) {
+    return;
+  }
+  CHECK(points.cols() == classifiers.dimension()) <<
+      "Points differ in dimension";
+
+  ProjectedClassifierBank projected_classifiers(classifiers, projection);
+  DescriptorMatrix projected_points;
+  projection.project(points, projected_points);
+
+  cv::Mat converted = points.toFloat();
+
+  int num_blocks = (classifiers.size() + CLASSIFIER_BLOCK_SIZE - 1) /
+      CLASSIFIER_BLOCK_SIZE;
+  CandidateBlockFunction function(classifiers, projected_classifiers,
+      converted, projected_points.mat(), num_candidates, matches, use_max_num,
+      max_num, use_threshold, threshold);
+
+  if (pool != NULL) {
+    pool->parallelFor(0, num_blocks, function);
+  } else {
+    for (int block = 0; block < num_blocks; block += 1) {
+      function(block);
+    }
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef CLASSIFIER_CANDIDATES_HPP_
+#define CLASSIFIER_CANDIDATES_HPP_
+
+#include <deque>
+#include <opencv2/core/core.hpp>
+#include "classifier_bank.hpp"
+#include "descriptor_matrix.hpp"
+#include "find_matches.hpp"
+#include "pca_projection.hpp"
+
+class ThreadPool;
+
+// Approximates the scores of a bank of linear classifiers in the subspace of
+// a PCA projection of the descriptors.
+//
+// Each point x is replaced by its reconstruction mean + B^T y from its
+// projection y = B (x - mean), so that w . x + b is approximately
+// (B w) . y + (w . mean + b), which costs one product of low dimension.
+class ProjectedClassifierBank {
+  public:
+    // Neither is kept.
+    ProjectedClassifierBank(const ClassifierBank& classifiers,
+                            const PcaProjection& projection);
+
+    int size() const;
+    // Number of components of the projection.
+    int dimension() const;
+
+    // Computes scores(i - begin, j) for classifiers i in [begin, end) and
+    // every row of the projected points.
+    void score(const cv::Mat& projected,
+               int begin,
+               int end,
+               cv::Mat& scores) const;
+
+  private:
+    cv::Mat weights_;
+    cv::Mat biases_;
+};
+
+// Same as findMatchesUsingClassifierBank() except that each classifier first
+// ranks the points by its approximate score, and only the best num_candidates
+// are scored exactly. The matches are exact if they are among the candidates.
+//
+// Ranking all points costs about num_components / dimension of an exhaustive
+// search, since the points are projected only once.
+void findMatchesUsingClassifierCandidates(
+    const ClassifierBank& classifiers,
+    const PcaProjection& projection,
+    const DescriptorMatrix& points,
+    int num_candidates,
+    std::deque<QueryResultList>& matches,
+    bool use_max_num,
+    int max_num,
+    bool use_threshold,
+    double threshold,
+    ThreadPool* pool);
+
+#endif
@@ -1,7 +1,6 @@
 #include <deque>
 #include <vector>
 #include <algorithm>
-#include <stack>
 #include <set>
 #include <string>
 #include <cstdlib>
@@ -15,17 +14,56 @@
 #include "sift_feature.hpp"
 #include "multiview_track_list.hpp"
 #include "kmeans.hpp"
-#include "util.hpp"
+#include "vocabulary_tree.hpp"
+#include "parallel_load.hpp"
+#include "random.hpp"
+#include "util/memory.hpp"
+#include "util/thread-pool.hpp"
+#include "util/trace.hpp"
 
 #include "read_lines.hpp"
-#include "sift_feature_reader.hpp"
-#include "iterator_reader.hpp"
+#include "feature_files.hpp"
 #include "multiview_track_list_writer.hpp"
 #include "default_writer.hpp"
+#include "vocabulary_tree_writer.hpp"
 
 const int MIN_TRACK_SIZE = 2;
 
 DEFINE_int32(k, 2, "Branching factor");
+DEFINE_string(vocabulary_tree, "",
+    "Also save the tree of clusters for retrieval to this file");
+DEFINE_int32(num_threads, 4,
+    "Number of worker threads to load files and cluster with, 0 for none");
+DEFINE_int32(max_files_in_flight, 64,
+    "Maximum number of files which are loaded at once");
+DEFINE_int32(mini_batch_size, 0,
+    "Stream descriptors from the files in batches of this many to learn "
+    "coarse clusters with mini-batch k-means, instead of loading them all. "
+    "0 to load every descriptor");
+DEFINE_int32(num_coarse_clusters, 64,
+    "Number of clusters to learn from the stream, each of which is then "
+    "divided in memory");
+DEFINE_int32(mini_batch_passes, 1,
+    "Number of passes of mini-batch k-means over the files");
+DEFINE_int32(max_resident_features, 1000000,
+    "When streaming, coarse clusters are loaded in groups of at most this "
+    "many descriptors, unless one cluster is larger");
+DEFINE_bool(kmeans_plus_plus, false,
+    "Seed k-means with k-means|| instead of uniformly random descriptors");
+DEFINE_int32(num_restarts, 1,
+    "Number of times to run k-means at each node, keeping the best. Restarts "
+    "run concurrently");
+DEFINE_string(trace, "",
+    "File to write a trace of memory use to, if built with tracing");
+
+KMeansOptions kMeansOptions() {
+  KMeansOptions options;
+  if (FLAGS_kmeans_plus_plus) {
+    options.seeding = KMeansOptions::SCALABLE_PLUS_PLUS_SEEDING;
+  }
+  options.num_restarts = FLAGS_num_restarts;
+  return options;
+}
 
 class Feature : public KMeansPoint {
   public:
@@ -96,37 +134,209 @@ void addImageFeaturesToList(std::deque<SiftFeature>& features,
   }
 }
 
+typedef std::deque<SiftFeature> ImageFeatureList;
+
+// Loads the features of image (v, t) as item v * num_frames + t.
+class ImageFeatureLoader : public IndexedLoader<ImageFeatureList> {
+  public:
+    ImageFeatureLoader(const std::string& format,
+                       const std::vector<std::string>& views,
+                       int num_frames)
+        : format_(&format), views_(&views), num_frames_(num_frames) {}
+
+    bool load(int index, ImageFeatureList& features) const {
+      int view = index / num_frames_;
+      int time = index % num_frames_;
+      // Binary files may hold halves or bytes, which are widened.
+      std::string file = makeFilename(*format_, (*views_)[view], time);
+      return loadSiftFeatures(file, features);
+    }
+
+  private:
+    const std::string* format_;
+    const std::vector<std::string>* views_;
+    int num_frames_;
+};
+
+// Copies features into one big list in order of image.
+class FeatureListSink : public SequenceSink<ImageFeatureList> {
+  public:
+    FeatureListSink(int num_frames, std::deque<Feature>& features)
+        : num_frames_(num_frames), index_(0), features_(&features) {}
+
+    void add(ImageFeatureList& image_features) {
+      ImageIndex frame(index_ / num_frames_, index_ % num_frames_);
+      DLOG(INFO) << "Loaded " << image_features.size() << " features for (" <<
+          frame.view << ", " << frame.time << ")";
+      addImageFeaturesToList(image_features, frame, *features_);
+      index_ += 1;
+    }
+
+  private:
+    int num_frames_;
+    int index_;
+    std::deque<Feature>* features_;
+};
+
 bool loadFeatures(const std::string& format,
                   const std::vector<std::string>& views,
                   int num_frames,
-                  std::deque<Feature>& features) {
+                  std::deque<Feature>& features,
+                  ThreadPool& pool) {
   features.clear();
 
-  int v = 0;
-  std::vector<std::string>::const_iterator view;
-  for (view = views.begin(); view != views.end(); ++view) {
-    for (int t = 0; t < num_frames; t += 1) {
-      // Load features for this image.
-      std::deque<SiftFeature> image_features;
-      SiftFeatureReader reader;
-      std::string file = makeFilename(format, *view, t);
-      bool ok = loadList(file, image_features, reader);
-      if (!ok) {
+  int num_images = views.size() * num_frames;
+  ImageFeatureLoader loader(format, views, num_frames);
+  FeatureListSink sink(num_frames, features);
+  return loadInParallel(pool, num_images, loader, sink,
+      FLAGS_max_files_in_flight);
+}
+
+// Loads images in another order, such that item i is image order[i].
+class PermutedImageLoader : public IndexedLoader<ImageFeatureList> {
+  public:
+    PermutedImageLoader(const IndexedLoader<ImageFeatureList>& loader,
+                        const std::vector<int>& order)
+        : loader_(&loader), order_(&order) {}
+
+    bool load(int index, ImageFeatureList& features) const {
+      return loader_->load((*order_)[index], features);
+    }
+
+  private:
+    const IndexedLoader<ImageFeatureList>* loader_;
+    const std::vector<int>* order_;
+};
+
+// Gathers the descriptors of successive images into batches and updates
+// mini-batch k-means with each. The first batch picks the initial centers.
+class MiniBatchSink : public SequenceSink<ImageFeatureList> {
+  public:
+    MiniBatchSink(int batch_size,
+                  int k,
+                  MiniBatchKMeans& kmeans,
+                  boost::random::mt19937& generator)
+        : batch_size_(batch_size),
+          k_(k),
+          kmeans_(&kmeans),
+          generator_(&generator),
+          batch_() {}
+
+    void add(ImageFeatureList& image_features) {
+      // The frame is not needed to learn the centers.
+      addImageFeaturesToList(image_features, ImageIndex(), batch_);
+      if (int(batch_.size()) >= batch_size_) {
+        flush();
+      }
+    }
+
+    // Updates the centers with what remains of the last batch.
+    void flush() {
+      if (batch_.empty()) {
+        return;
+      }
+
+      std::vector<const KMeansPoint*> points;
+      std::deque<Feature>::const_iterator feature;
+      for (feature = batch_.begin(); feature != batch_.end(); ++feature) {
+        points.push_back(&*feature);
+      }
+
+      if (kmeans_->empty()) {
+        std::deque<std::vector<double> > centers;
+        if (FLAGS_kmeans_plus_plus) {
+          scalableClusterCenters(points, k_, kMeansOptions(), centers,
+              *generator_);
+        } else {
+          randomClusterCenters(points, k_, centers, *generator_);
+        }
+        kmeans_->init(centers);
+      }
+      kmeans_->update(points);
+
+      batch_.clear();
+    }
+
+  private:
+    int batch_size_;
+    int k_;
+    MiniBatchKMeans* kmeans_;
+    boost::random::mt19937* generator_;
+    std::deque<Feature> batch_;
+};
+
+// Loads the coarse cluster of every descriptor of an image.
+class CoarseLabelLoader : public IndexedLoader<std::vector<int> > {
+  public:
+    CoarseLabelLoader(const IndexedLoader<ImageFeatureList>& loader,
+                      const MiniBatchKMeans& kmeans)
+        : loader_(&loader), kmeans_(&kmeans) {}
+
+    bool load(int index, std::vector<int>& labels) const {
+      ImageFeatureList features;
+      if (!loader_->load(index, features)) {
         return false;
       }
-      DLOG(INFO) << "Loaded " << image_features.size() << " features for (" <<
-          v << ", " << t << ")";
 
-      // Copy features into big list.
-      ImageIndex frame(v, t);
-      addImageFeaturesToList(image_features, frame, features);
+      labels.clear();
+      ImageFeatureList::const_iterator feature;
+      for (feature = features.begin(); feature != features.end(); ++feature) {
+        labels.push_back(kmeans_->nearest(feature->descriptor.data));
+      }
+      return true;
     }
 
-    v += 1;
-  }
+  private:
+    const IndexedLoader<ImageFeatureList>* loader_;
+    const MiniBatchKMeans* kmeans_;
+};
 
-  return true;
-}
+// Keeps the features of images, in order of image, whose coarse cluster is
+// in [begin, end).
+class CoarseGroupSink : public SequenceSink<ImageFeatureList> {
+  public:
+    CoarseGroupSink(int num_frames,
+                    const std::deque<std::vector<int> >& labels,
+                    int begin,
+                    int end,
+                    std::vector<std::deque<Feature> >& clusters)
+        : num_frames_(num_frames),
+          index_(0),
+          labels_(&labels),
+          begin_(begin),
+          end_(end),
+          clusters_(&clusters) {}
+
+    void add(ImageFeatureList& image_features) {
+      ImageIndex frame(index_ / num_frames_, index_ % num_frames_);
+      const std::vector<int>& labels = (*labels_)[index_];
+      CHECK(labels.size() == image_features.size()) <<
+          "Number of features changed between passes";
+
+      int i = 0;
+      ImageFeatureList::iterator feature;
+      for (feature = image_features.begin(); feature != image_features.end();
+           ++feature) {
+        int label = labels[i];
+        if (label >= begin_ && label < end_) {
+          std::deque<Feature>& cluster = (*clusters_)[label - begin_];
+          cluster.push_back(Feature(frame, i));
+          cluster.back().descriptor.swap(feature->descriptor);
+        }
+        i += 1;
+      }
+
+      index_ += 1;
+    }
+
+  private:
+    int num_frames_;
+    int index_;
+    const std::deque<std::vector<int> >* labels_;
+    int begin_;
+    int end_;
+    std::vector<std::deque<Feature> >* clusters_;
+};
 
 bool isConsistent(const FeatureSubset& features) {
   std::set<ImageIndex> visible;
@@ -149,55 +359,42 @@ bool isConsistent(const FeatureSubset& features) {
   return true;
 }
 
-std::string splitReport(const FeatureSubset& features,
-                        int k,
-                        const std::deque<FeatureSubset>& children) {
-  std::ostringstream ss;
-  ss << "Divided " << features.size() << " features into (";
-
-  std::deque<FeatureSubset>::const_iterator child;
-  for (child = children.begin(); child != children.end(); ++child) {
-    if (child != children.begin()) {
-      ss << ", ";
-    }
-    ss << child->size();
-  }
-  ss << ")";
-
-  return ss.str();
-}
-
-void split(const FeatureSubset& features,
-           int k,
-           std::deque<FeatureSubset>& children,
-           boost::random::mt19937& generator) {
-  // Convert to k-means-compatible interface.
-  std::vector<const KMeansPoint*> points;
-  std::transform(features.begin(), features.end(), std::back_inserter(points),
-      cast<const KMeansPoint*, const Feature*>);
+// Divides clusters until they are consistent or too small to be tracks.
+class TrackLeafTest : public VocabularyTree::LeafTest {
+  public:
+    explicit TrackLeafTest(const std::deque<Feature>& features)
+        : features_(&features) {}
 
-  // Cluster descriptors with random initialization.
-  std::deque<std::vector<double> > centers;
-  std::vector<int> labels;
-  randomKMeans(points, k, centers, labels, generator);
+    bool isLeaf(const int* first, const int* last) const {
+      int num_features = last - first;
 
-  // Sort into children using labels.
-  children.assign(k, FeatureSubset());
+      // Check that cluster is large enough to constitute a track.
+      if (num_features < MIN_TRACK_SIZE) {
+        DLOG(INFO) << "Cluster too small (" << num_features << " < " <<
+            MIN_TRACK_SIZE << ")";
+        return true;
+      }
 
-  CHECK(labels.size() == features.size());
-  FeatureSubset::const_iterator feature = features.begin();
-  std::vector<int>::const_iterator label = labels.begin();
+      if (isConsistent(subset(first, last))) {
+        DLOG(INFO) << "Found consistent cluster (" << num_features <<
+            " features)";
+        return true;
+      }
 
-  while (feature != features.end()) {
-    children[*label].push_back(*feature);
+      return false;
+    }
 
-    ++feature;
-    ++label;
-  }
+    FeatureSubset subset(const int* first, const int* last) const {
+      FeatureSubset features;
+      for (const int* point = first; point != last; ++point) {
+        features.push_back(&(*features_)[*point]);
+      }
+      return features;
+    }
 
-  // Print report.
-  LOG(INFO) << splitReport(features, k, children);
-}
+  private:
+    const std::deque<Feature>* features_;
+};
 
 void featuresToTrack(const FeatureSubset& features,
                      MultiviewTrack<int>& track,
@@ -211,23 +408,153 @@ void featuresToTrack(const FeatureSubset& features,
   }
 }
 
-void subsetsToTracks(const std::deque<FeatureSubset>& subsets,
-                     MultiviewTrackList<int>& tracks,
-                     int num_views) {
-  tracks = MultiviewTrackList<int>(num_views);
+// Divides features into clusters, each of which is a word of the tree, and
+// appends the clusters which are valid tracks.
+void clusterIntoTracks(const std::deque<Feature>& features,
+                       int num_frames,
+                       int num_views,
+                       boost::random::mt19937& generator,
+                       ThreadPool& pool,
+                       VocabularyTree& tree,
+                       MultiviewTrackList<int>& tracks) {
+  // Convert to k-means-compatible interface.
+  std::vector<const KMeansPoint*> points;
+  std::vector<VocabularyPosting> postings;
+  std::deque<Feature>::const_iterator feature;
+  for (feature = features.begin(); feature != features.end(); ++feature) {
+    points.push_back(&*feature);
+    int image = feature->frame.view * num_frames + feature->frame.time;
+    postings.push_back(VocabularyPosting(image, feature->id));
+  }
 
+  TrackLeafTest leaf_test(features);
+  std::vector<std::vector<int> > words;
+  tree.build(points, postings, FLAGS_k, leaf_test, generator, words,
+      kMeansOptions(), pool);
+
+  // Keep the words which are valid tracks.
+  std::deque<FeatureSubset> valid;
+  std::vector<std::vector<int> >::const_iterator word;
+  for (word = words.begin(); word != words.end(); ++word) {
+    const int* first = word->empty() ? NULL : &word->front();
+    FeatureSubset subset = leaf_test.subset(first, first + word->size());
+    if (int(subset.size()) >= MIN_TRACK_SIZE && isConsistent(subset)) {
+      valid.push_back(FeatureSubset());
+      valid.back().swap(subset);
+    }
+  }
+
+  LOG(INFO) << "Found " << valid.size() << " valid clusters";
+
+  // Write subsets out as index tracks.
   std::deque<FeatureSubset>::const_iterator subset;
-  for (subset = subsets.begin(); subset != subsets.end(); ++subset) {
+  for (subset = valid.begin(); subset != valid.end(); ++subset) {
     MultiviewTrack<int> track;
     featuresToTrack(*subset, track, num_views);
-
     tracks.push_back(MultiviewTrack<int>());
     tracks.back().swap(track);
   }
 }
 
+// Finds tracks without holding every descriptor in memory.
+//
+// Learns coarse clusters with mini-batch k-means over the images in a random
+// order, labels every descriptor with its nearest coarse cluster, then loads
+// the coarse clusters a group at a time and divides each as above. Apart from
+// one label per descriptor, memory is bounded by the batch size, the files in
+// flight and the largest group.
+bool streamTracks(const std::string& format,
+                  const std::vector<std::string>& views,
+                  int num_frames,
+                  boost::random::mt19937& generator,
+                  ThreadPool& pool,
+                  MultiviewTrackList<int>& tracks) {
+  int num_views = views.size();
+  int num_images = num_views * num_frames;
+  ImageFeatureLoader loader(format, views, num_frames);
+
+  MiniBatchKMeans kmeans;
+  MiniBatchSink batches(FLAGS_mini_batch_size, FLAGS_num_coarse_clusters,
+      kmeans, generator);
+  std::vector<int> order;
+  for (int i = 0; i < num_images; i += 1) {
+    order.push_back(i);
+  }
+
+  for (int pass = 0; pass < FLAGS_mini_batch_passes; pass += 1) {
+    // Consecutive frames are alike, which would bias each batch.
+    randomShuffle(order.begin(), order.end(), generator);
+    PermutedImageLoader permuted(loader, order);
+    if (!loadInParallel(pool, num_images, permuted, batches,
+          FLAGS_max_files_in_flight)) {
+      return false;
+    }
+    batches.flush();
+    LOG(INFO) << "Finished pass " << pass + 1 << " of mini-batch k-means";
+  }
+  CHECK(!kmeans.empty()) << "Found no descriptors";
+
+  std::deque<std::vector<int> > labels;
+  CoarseLabelLoader label_loader(loader, kmeans);
+  ContainerSink<std::vector<int>, std::deque<std::vector<int> > > label_sink(
+      labels);
+  if (!loadInParallel(pool, num_images, label_loader, label_sink,
+        FLAGS_max_files_in_flight)) {
+    return false;
+  }
+
+  int k = kmeans.numCenters();
+  std::vector<int> sizes(k, 0);
+  std::deque<std::vector<int> >::const_iterator image;
+  for (image = labels.begin(); image != labels.end(); ++image) {
+    std::vector<int>::const_iterator label;
+    for (label = image->begin(); label != image->end(); ++label) {
+      sizes[*label] += 1;
+    }
+  }
+
+  tracks = MultiviewTrackList<int>(num_views);
+  int begin = 0;
+  while (begin < k) {
+    // Take as many clusters as fit, and at least one.
+    int end = begin;
+    int total = 0;
+    while (end < k &&
+        (end == begin || total + sizes[end] <= FLAGS_max_resident_features)) {
+      total += sizes[end];
+      end += 1;
+    }
+
+    std::vector<std::deque<Feature> > clusters(end - begin);
+    CoarseGroupSink sink(num_frames, labels, begin, end, clusters);
+    if (!loadInParallel(pool, num_images, loader, sink,
+          FLAGS_max_files_in_flight)) {
+      return false;
+    }
+    LOG(INFO) << "Loaded coarse clusters " << begin << " to " << end - 1 <<
+        " (" << total << " features)";
+
+    for (int c = 0; c < end - begin; c += 1) {
+      if (clusters[c].empty()) {
+        continue;
+      }
+      VocabularyTree tree;
+      clusterIntoTracks(clusters[c], num_frames, num_views, generator, pool,
+          tree, tracks);
+      // Release the descriptors before the next cluster.
+      std::deque<Feature>().swap(clusters[c]);
+    }
+
+    begin = end;
+  }
+
+  return true;
+}
+
 int main(int argc, char** argv) {
   init(argc, argv);
+  TRACE_INIT(FLAGS_trace);
+  MEMORY_STAGES(stages);
 
   std::string descriptors_format = argv[1];
   std::string views_file = argv[2];
@@ -241,72 +568,39 @@ int main(int argc, char** argv) {
   ok = readLines(views_file, views);
   CHECK(ok) << "Could not load view names";
 
-  // Load descriptors for every feature.
-  std::deque<Feature> features;
-  ok = loadFeatures(descriptors_format, views, num_frames, features);
-  CHECK(ok) << "Could not load features";
+  ThreadPool pool(FLAGS_num_threads);
 
   boost::random::mt19937 generator;
-
-  // Divide the features into validsets.
-  std::deque<FeatureSubset> valid;
-
-  // Maintin a queue of subsets which need to be clustered.
-  std::stack<FeatureSubset> pending;
-  // Initially put all features in one set.
-  pending.push(FeatureSubset());
-  std::transform(features.begin(), features.end(),
-      std::back_inserter(pending.top()), takeAddress<const Feature>);
-
-  while (!pending.empty()) {
-    // Remove next element from the waiting list.
-    FeatureSubset subset;
-    subset.swap(pending.top());
-    pending.pop();
-
-    int num_features = subset.size();
-
-    // Check that cluster is large enough to constitute a track.
-    if (num_features < MIN_TRACK_SIZE) {
-      DLOG(INFO) << "Cluster too small (" << num_features << " < " <<
-          MIN_TRACK_SIZE << ")";
-      continue;
-    }
-
-    if (isConsistent(subset)) {
-      // Move to valid list.
-      valid.push_back(FeatureSubset());
-      valid.back().swap(subset);
-      DLOG(INFO) << "Found consistent cluster (" << num_features <<
-          " features)";
-      continue;
-    }
-
-    // Check that cluster is large enough to split.
-    if (num_features < FLAGS_k) {
-      DLOG(INFO) << "Less points than branching factor";
-      continue;
-    }
-
-    // Inconsistent. Run k-means.
-    std::deque<FeatureSubset> children;
-    split(subset, FLAGS_k, children, generator);
-
-    // Add every child to the stack (by swapping).
-    std::deque<FeatureSubset>::iterator child;
-    for (child = children.begin(); child != children.end(); ++child) {
-      pending.push(FeatureSubset());
-      pending.top().swap(*child);
+  int num_views = views.size();
+  MultiviewTrackList<int> tracks(num_views);
+
+  if (FLAGS_mini_batch_size > 0) {
+    CHECK(FLAGS_vocabulary_tree.empty()) <<
+        "Cannot save a vocabulary tree of streamed descriptors";
+    MEMORY_NEXT_STAGE(stages, "stream and cluster descriptors");
+    ok = streamTracks(descriptors_format, views, num_frames, generator, pool,
+        tracks);
+    CHECK(ok) << "Could not load features";
+  } else {
+    // Load descriptors for every feature.
+    MEMORY_NEXT_STAGE(stages, "load descriptor list");
+    std::deque<Feature> features;
+    ok = loadFeatures(descriptors_format, views, num_frames, features, pool);
+    CHECK(ok) << "Could not load features";
+
+    MEMORY_NEXT_STAGE(stages, "cluster into track list");
+    VocabularyTree tree;
+    clusterIntoTracks(features, num_frames, num_views, generator, pool, tree,
+        tracks);
+
+    if (!FLAGS_vocabulary_tree.empty()) {
+      VocabularyTreeWriter tree_writer;
+      ok = save(FLAGS_vocabulary_tree, tree, tree_writer);
+      CHECK(ok) << "Could not save vocabulary tree";
     }
   }
 
-  LOG(INFO) << "Found " << valid.size() << " valid clusters";
-
-  // Write subsets out as index tracks.
-  MultiviewTrackList<int> tracks;
-  int num_views = views.size();
-  subsetsToTracks(valid, tracks, num_views);
-
+  MEMORY_NEXT_STAGE(stages, "save tracks");
   DefaultWriter<int> writer;
   ok = saveMultiviewTrackList(tracks_file, tracks, writer);
   CHECK(ok) << "Could not save tracks";
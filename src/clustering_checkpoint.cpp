@@ -0,0 +1,227 @@
+#include "clustering_checkpoint.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <boost/bind.hpp>
+#include <glog/logging.h>
+
+namespace {
+
+const char MAGIC[4] = { 'T', 'R', 'K', 'C' };
+
+// Writes the length then the values.
+template<class T>
+void writeArray(std::ofstream& file, const std::vector<T>& values) {
+  uint64_t n = values.size();
+  file.write(reinterpret_cast<const char*>(&n), sizeof(n));
+  if (n > 0) {
+    file.write(reinterpret_cast<const char*>(&values.front()),
+        n * sizeof(T));
+  }
+}
+
+template<class T>
+bool readArray(std::ifstream& file, std::vector<T>& values) {
+  uint64_t n;
+  if (!file.read(reinterpret_cast<char*>(&n), sizeof(n))) {
+    return false;
+  }
+  values.resize(n);
+  if (n > 0) {
+    file.read(reinterpret_cast<char*>(&values.front()), n * sizeof(T));
+  }
+  return file.good();
+}
+
+template<class T>
+void writeValue(std::ofstream& file, const T& value) {
+  file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<class T>
+bool readValue(std::ifstream& file, T& value) {
+  return bool(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+VertexGroups::VertexGroups() : vertices(), offsets(1, 0) {}
+
+int VertexGroups::numGroups() const {
+  return offsets.size() - 1;
+}
+
+void VertexGroups::clear() {
+  vertices.clear();
+  offsets.assign(1, 0);
+}
+
+void VertexGroups::close() {
+  offsets.push_back(vertices.size());
+}
+
+void VertexGroups::swap(VertexGroups& other) {
+  vertices.swap(other.vertices);
+  offsets.swap(other.offsets);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+ClusteringCheckpoint::ClusteringCheckpoint()
+    : program(0),
+      num_vertices(0),
+      num_edges(0),
+      counters(),
+      labels(),
+      groups(),
+      record_size(0),
+      records() {}
+
+void ClusteringCheckpoint::swap(ClusteringCheckpoint& other) {
+  std::swap(program, other.program);
+  std::swap(num_vertices, other.num_vertices);
+  std::swap(num_edges, other.num_edges);
+  counters.swap(other.counters);
+  labels.swap(other.labels);
+  groups.swap(other.groups);
+  std::swap(record_size, other.record_size);
+  records.swap(other.records);
+}
+
+bool saveClusteringCheckpoint(const std::string& filename,
+                              const ClusteringCheckpoint& checkpoint) {
+  std::ofstream file(filename.c_str(), std::ios::binary);
+  if (!file) {
+    return false;
+  }
+
+  uint32_t version = ClusteringCheckpoint::VERSION;
+  file.write(MAGIC, sizeof(MAGIC));
+  writeValue(file, version);
+  writeValue(file, checkpoint.program);
+  writeValue(file, checkpoint.num_vertices);
+  writeValue(file, checkpoint.num_edges);
+
+  writeArray(file, checkpoint.counters);
+  writeArray(file, checkpoint.labels);
+
+  uint64_t num_lists = checkpoint.groups.size();
+  writeValue(file, num_lists);
+  std::vector<VertexGroups>::const_iterator groups;
+  for (groups = checkpoint.groups.begin(); groups != checkpoint.groups.end();
+       ++groups) {
+    writeArray(file, groups->offsets);
+    writeArray(file, groups->vertices);
+  }
+
+  writeValue(file, checkpoint.record_size);
+  writeArray(file, checkpoint.records);
+
+  return file.good();
+}
+
+bool loadClusteringCheckpoint(const std::string& filename,
+                              ClusteringCheckpoint& checkpoint) {
+  std::ifstream file(filename.c_str(), std::ios::binary);
+  if (!file) {
+    return false;
+  }
+
+  char magic[sizeof(MAGIC)];
+  uint32_t version;
+  if (!file.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+    LOG(WARNING) << "Not a checkpoint";
+    return false;
+  }
+  if (!readValue(file, version) || version != ClusteringCheckpoint::VERSION) {
+    LOG(WARNING) << "Unsupported version of checkpoint";
+    return false;
+  }
+
+  ClusteringCheckpoint loaded;
+  if (!readValue(file, loaded.program) ||
+      !readValue(file, loaded.num_vertices) ||
+      !readValue(file, loaded.num_edges) ||
+      !readArray(file, loaded.counters) ||
+      !readArray(file, loaded.labels)) {
+    return false;
+  }
+
+  uint64_t num_lists;
+  if (!readValue(file, num_lists)) {
+    return false;
+  }
+  loaded.groups.resize(num_lists);
+  std::vector<VertexGroups>::iterator groups;
+  for (groups = loaded.groups.begin(); groups != loaded.groups.end();
+       ++groups) {
+    if (!readArray(file, groups->offsets) ||
+        !readArray(file, groups->vertices)) {
+      return false;
+    }
+    // Offsets must increase from zero to the number of vertices.
+    if (groups->offsets.empty() || groups->offsets.front() != 0 ||
+        groups->offsets.back() != groups->vertices.size()) {
+      LOG(WARNING) << "Malformed groups in checkpoint";
+      return false;
+    }
+    for (int i = 1; i < int(groups->offsets.size()); i += 1) {
+      if (groups->offsets[i] < groups->offsets[i - 1]) {
+        LOG(WARNING) << "Malformed groups in checkpoint";
+        return false;
+      }
+    }
+  }
+
+  if (!readValue(file, loaded.record_size) ||
+      !readArray(file, loaded.records)) {
+    return false;
+  }
+
+  checkpoint.swap(loaded);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CheckpointWriter::CheckpointWriter(const std::string& filename)
+    : filename_(filename), checkpoint_(), thread_(), ok_(true) {}
+
+CheckpointWriter::~CheckpointWriter() {
+  wait();
+}
+
+void CheckpointWriter::write(ClusteringCheckpoint& checkpoint) {
+  wait();
+  checkpoint_.swap(checkpoint);
+  thread_.reset(new boost::thread(boost::bind(&CheckpointWriter::save,
+          this)));
+}
+
+bool CheckpointWriter::wait() {
+  if (thread_) {
+    thread_->join();
+    thread_.reset();
+  }
+  return ok_;
+}
+
+void CheckpointWriter::save() {
+  std::string temporary = filename_ + ".tmp";
+  bool ok = saveClusteringCheckpoint(temporary, checkpoint_);
+  if (ok) {
+    ok = (std::rename(temporary.c_str(), filename_.c_str()) == 0);
+  }
+
+  if (ok) {
+    LOG(INFO) << "Saved checkpoint to `" << filename_ << "'";
+  } else {
+    LOG(WARNING) << "Could not save checkpoint to `" << filename_ << "'";
+  }
+  ok_ = ok_ && ok;
+  // Release the memory while the job runs.
+  ClusteringCheckpoint().swap(checkpoint_);
+}
@@ -0,0 +1,122 @@
+#ifndef CLUSTERING_CHECKPOINT_HPP_
+#define CLUSTERING_CHECKPOINT_HPP_
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+// Identifies the program which wrote a checkpoint.
+enum ClusteringProgram {
+  AGGLOMERATIVE_CLUSTER = 1,
+  PARTITION_GRAPH = 2,
+  SPECTRAL_PARTITION_GRAPH = 3
+};
+
+// Vertices divided into groups, such as subgraphs.
+// Group i is vertices [offsets[i], offsets[i + 1]).
+struct VertexGroups {
+  std::vector<int32_t> vertices;
+  std::vector<uint64_t> offsets;
+
+  VertexGroups();
+
+  int numGroups() const;
+  void clear();
+  // Appends a group. Use vertices.push_back() then close().
+  void close();
+  void swap(VertexGroups& other);
+};
+
+// The state of a clustering job, from which it can be resumed.
+//
+// A checkpoint is written as a header followed by arrays of fixed-width
+// values, each preceded by its length. Values are in the byte order of the
+// machine which wrote them. The arrays are copied from the job without
+// conversion, so taking a checkpoint is cheap and writing it can be left to
+// a CheckpointWriter.
+struct ClusteringCheckpoint {
+  static const uint32_t VERSION = 1;
+
+  uint32_t program;
+  // Describe the input, so that a checkpoint is not resumed with another.
+  uint64_t num_vertices;
+  uint64_t num_edges;
+  // Progress, as defined by the program.
+  std::vector<uint64_t> counters;
+  // A value per vertex, such as its set.
+  std::vector<int32_t> labels;
+  // Lists of groups of vertices, such as the subgraphs which remain.
+  std::vector<VertexGroups> groups;
+  // Opaque fixed-size records, such as the entries of a heap.
+  uint32_t record_size;
+  std::vector<char> records;
+
+  ClusteringCheckpoint();
+
+  void swap(ClusteringCheckpoint& other);
+
+  // Records must be plain data.
+  template<class T> void setRecords(const std::vector<T>& values);
+  // Returns false if the records are not of this size.
+  template<class T> bool getRecords(std::vector<T>& values) const;
+};
+
+bool saveClusteringCheckpoint(const std::string& filename,
+                              const ClusteringCheckpoint& checkpoint);
+
+// Returns false if the file could not be read or is malformed.
+bool loadClusteringCheckpoint(const std::string& filename,
+                              ClusteringCheckpoint& checkpoint);
+
+// Saves checkpoints in a background thread.
+//
+// The file is written under a temporary name and renamed, so that a crash
+// while saving leaves the previous checkpoint.
+class CheckpointWriter {
+  public:
+    explicit CheckpointWriter(const std::string& filename);
+    // Waits for the last checkpoint.
+    ~CheckpointWriter();
+
+    // Takes the contents of the checkpoint and returns. Waits first if the
+    // previous checkpoint is still being saved.
+    void write(ClusteringCheckpoint& checkpoint);
+    // Waits for the last checkpoint. Returns false if any failed to save.
+    bool wait();
+
+  private:
+    void save();
+
+    std::string filename_;
+    ClusteringCheckpoint checkpoint_;
+    boost::scoped_ptr<boost::thread> thread_;
+    bool ok_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+template<class T>
+void ClusteringCheckpoint::setRecords(const std::vector<T>& values) {
+  record_size = sizeof(T);
+  records.resize(values.size() * sizeof(T));
+  if (!values.empty()) {
+    std::memcpy(&records.front(), &values.front(), records.size());
+  }
+}
+
+template<class T>
+bool ClusteringCheckpoint::getRecords(std::vector<T>& values) const {
+  if (record_size != sizeof(T) || records.size() % sizeof(T) != 0) {
+    return false;
+  }
+  values.resize(records.size() / sizeof(T));
+  if (!values.empty()) {
+    std::memcpy(&values.front(), &records.front(), records.size());
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef COLUMNAR_MULTIVIEW_TRACK_LIST_HPP_
+#define COLUMNAR_MULTIVIEW_TRACK_LIST_HPP_
+
+#include <vector>
+#include "multiview_track_list.hpp"
+
+// Stores the points of a list of multiview tracks as columns of track, time
+// and value, in order of view, then time, then track. The view column is
+// kept as the offset at which each view starts.
+//
+// Passes which visit one view of every track read contiguous memory, where a
+// MultiviewTrackList would visit a map per track. Points cannot be added
+// individually: convert from a MultiviewTrackList, operate on whole columns,
+// then convert back if necessary.
+//
+// Usage:
+// ColumnarMultiviewTrackList<T> columns(tracks);
+// for (int i = columns.viewBegin(view); i < columns.viewEnd(view); i += 1) {
+//   PROCESS(columns.track(i), columns.time(i), columns.value(i));
+// }
+// columns.copyTo(tracks);
+template<class T>
+class ColumnarMultiviewTrackList {
+  public:
+    ColumnarMultiviewTrackList();
+    explicit ColumnarMultiviewTrackList(const MultiviewTrackList<T>& tracks);
+
+    // Replaces the contents with the points of a track list.
+    void assign(const MultiviewTrackList<T>& tracks);
+    // Takes the tracks, views and times of another list. Values are T().
+    template<class U>
+    void assignKeys(const ColumnarMultiviewTrackList<U>& other);
+    // Replaces the contents of a track list.
+    void copyTo(MultiviewTrackList<T>& tracks) const;
+
+    int numTracks() const;
+    int numViews() const;
+    int numPoints() const;
+    bool empty() const;
+
+    // The points of a view are [viewBegin(view), viewEnd(view)).
+    int viewBegin(int view) const;
+    int viewEnd(int view) const;
+    // The points of a view at a time are [frameBegin(), frameEnd()).
+    // Found by binary search.
+    int frameBegin(int view, int time) const;
+    int frameEnd(int view, int time) const;
+
+    int track(int i) const;
+    int time(int i) const;
+    const T& value(int i) const;
+    T& value(int i);
+
+    // Replaces every value x with f(x).
+    template<class Function>
+    void transform(Function f);
+    // Replaces every value x in one view with f(x).
+    template<class Function>
+    void transformView(int view, Function f);
+    // Assigns the points to another list with values f(x).
+    template<class U, class Function>
+    void transform(Function f, ColumnarMultiviewTrackList<U>& output) const;
+
+    // Removes every point whose value x does not satisfy keep(x).
+    // The order of the remaining points is unchanged.
+    template<class Predicate>
+    void filter(Predicate keep);
+
+    void swap(ColumnarMultiviewTrackList<T>& other);
+    void clear();
+
+  private:
+    int num_tracks_;
+    // Points of view v are [view_offsets_[v], view_offsets_[v + 1]).
+    std::vector<int> view_offsets_;
+    std::vector<int> tracks_;
+    std::vector<int> times_;
+    std::vector<T> values_;
+
+    template<class> friend class ColumnarMultiviewTrackList;
+};
+
+template<class T>
+void swap(ColumnarMultiviewTrackList<T>& lhs,
+          ColumnarMultiviewTrackList<T>& rhs);
+
+#include "columnar_multiview_track_list.inl"
+
+#endif
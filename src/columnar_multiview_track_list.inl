@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <numeric>
+#include <utility>
+#include <glog/logging.h>
+
+template<class T>
+ColumnarMultiviewTrackList<T>::ColumnarMultiviewTrackList()
+    : num_tracks_(0),
+      view_offsets_(1, 0),
+      tracks_(),
+      times_(),
+      values_() {}
+
+template<class T>
+ColumnarMultiviewTrackList<T>::ColumnarMultiviewTrackList(
+    const MultiviewTrackList<T>& tracks)
+    : num_tracks_(0),
+      view_offsets_(1, 0),
+      tracks_(),
+      times_(),
+      values_() {
+  assign(tracks);
+}
+
+template<class T>
+void ColumnarMultiviewTrackList<T>::assign(
+    const MultiviewTrackList<T>& tracks) {
+  int num_views = tracks.numViews();
+  typename MultiviewTrackList<T>::const_iterator track;
+
+  // Count the points of each view at each time, as in MultiviewTimeIndex.
+  std::vector<std::vector<int> > counts(num_views);
+  for (int view = 0; view < num_views; view += 1) {
+    std::vector<int>& count = counts[view];
+
+    for (track = tracks.begin(); track != tracks.end(); ++track) {
+      const Track<T>& points = track->view(view);
+      if (points.empty()) {
+        continue;
+      }
+      CHECK(points.begin()->first >= 0) << "Negative time in track";
+      int last = points.rbegin()->first;
+      if (int(count.size()) < last + 1) {
+        count.resize(last + 1, 0);
+      }
+
+      typename Track<T>::const_iterator point;
+      for (point = points.begin(); point != points.end(); ++point) {
+        count[point->first] += 1;
+      }
+    }
+  }
+
+  // Convert counts into the position of the first point of each frame.
+  view_offsets_.assign(num_views + 1, 0);
+  int n = 0;
+  for (int view = 0; view < num_views; view += 1) {
+    view_offsets_[view] = n;
+    std::vector<int>& count = counts[view];
+    for (int t = 0; t < int(count.size()); t += 1) {
+      int size = count[t];
+      count[t] = n;
+      n += size;
+    }
+  }
+  view_offsets_[num_views] = n;
+
+  num_tracks_ = tracks.numTracks();
+  tracks_.resize(n);
+  times_.resize(n);
+  values_.assign(n, T());
+
+  // Visiting tracks in order leaves each frame sorted by track.
+  for (int view = 0; view < num_views; view += 1) {
+    std::vector<int>& next = counts[view];
+
+    int id = 0;
+    for (track = tracks.begin(); track != tracks.end(); ++track) {
+      const Track<T>& points = track->view(view);
+
+      typename Track<T>::const_iterator point;
+      for (point = points.begin(); point != points.end(); ++point) {
+        int i = next[point->first];
+        next[point->first] += 1;
+
+        tracks_[i] = id;
+        times_[i] = point->first;
+        values_[i] = point->second;
+      }
+
+      id += 1;
+    }
+  }
+}
+
+template<class T>
+template<class U>
+void ColumnarMultiviewTrackList<T>::assignKeys(
+    const ColumnarMultiviewTrackList<U>& other) {
+  num_tracks_ = other.num_tracks_;
+  view_offsets_ = other.view_offsets_;
+  tracks_ = other.tracks_;
+  times_ = other.times_;
+  values_.assign(other.values_.size(), T());
+}
+
+template<class T>
+void ColumnarMultiviewTrackList<T>::copyTo(
+    MultiviewTrackList<T>& tracks) const {
+  int num_views = numViews();
+  MultiviewTrackList<T>(num_tracks_, num_views).swap(tracks);
+
+  // Points of each view are in time order, so every point is inserted at the
+  // end of its track.
+  for (int view = 0; view < num_views; view += 1) {
+    for (int i = viewBegin(view); i < viewEnd(view); i += 1) {
+      Track<T>& points = tracks.track(tracks_[i]).view(view);
+      points.insert(points.end(), std::make_pair(times_[i], values_[i]));
+    }
+  }
+}
+
+template<class T>
+int ColumnarMultiviewTrackList<T>::numTracks() const {
+  return num_tracks_;
+}
+
+template<class T>
+int ColumnarMultiviewTrackList<T>::numViews() const {
+  return int(view_offsets_.size()) - 1;
+}
+
+template<class T>
+int ColumnarMultiviewTrackList<T>::numPoints() const {
+  return values_.size();
+}
+
+template<class T>
+bool ColumnarMultiviewTrackList<T>::empty() const {
+  return values_.empty();
+}
+
+template<class T>
+int ColumnarMultiviewTrackList<T>::viewBegin(int view) const {
+  return view_offsets_[view];
+}
+
+template<class T>
+int ColumnarMultiviewTrackList<T>::viewEnd(int view) const {
+  return view_offsets_[view + 1];
+}
+
+template<class T>
+int ColumnarMultiviewTrackList<T>::frameBegin(int view, int time) const {
+  std::vector<int>::const_iterator first = times_.begin() + viewBegin(view);
+  std::vector<int>::const_iterator last = times_.begin() + viewEnd(view);
+  return std::lower_bound(first, last, time) - times_.begin();
+}
+
+template<class T>
+int ColumnarMultiviewTrackList<T>::frameEnd(int view, int time) const {
+  std::vector<int>::const_iterator first = times_.begin() + viewBegin(view);
+  std::vector<int>::const_iterator last = times_.begin() + viewEnd(view);
+  return std::upper_bound(first, last, time) - times_.begin();
+}
+
+template<class T>
+int ColumnarMultiviewTrackList<T>::track(int i) const {
+  return tracks_[i];
+}
+
+template<class T>
+int ColumnarMultiviewTrackList<T>::time(int i) const {
+  return times_[i];
+}
+
+template<class T>
+const T& ColumnarMultiviewTrackList<T>::value(int i) const {
+  return values_[i];
+}
+
+template<class T>
+T& ColumnarMultiviewTrackList<T>::value(int i) {
+  return values_[i];
+}
+
+template<class T>
+template<class Function>
+void ColumnarMultiviewTrackList<T>::transform(Function f) {
+  std::transform(values_.begin(), values_.end(), values_.begin(), f);
+}
+
+template<class T>
+template<class Function>
+void ColumnarMultiviewTrackList<T>::transformView(int view, Function f) {
+  typename std::vector<T>::iterator first = values_.begin() + viewBegin(view);
+  typename std::vector<T>::iterator last = values_.begin() + viewEnd(view);
+  std::transform(first, last, first, f);
+}
+
+template<class T>
+template<class U, class Function>
+void ColumnarMultiviewTrackList<T>::transform(
+    Function f,
+    ColumnarMultiviewTrackList<U>& output) const {
+  output.num_tracks_ = num_tracks_;
+  output.view_offsets_ = view_offsets_;
+  output.tracks_ = tracks_;
+  output.times_ = times_;
+  output.values_.resize(values_.size());
+  std::transform(values_.begin(), values_.end(), output.values_.begin(), f);
+}
+
+template<class T>
+template<class Predicate>
+void ColumnarMultiviewTrackList<T>::filter(Predicate keep) {
+  int num_views = numViews();
+  int n = 0;
+
+  // Compact the columns in place.
+  for (int view = 0; view < num_views; view += 1) {
+    int begin = viewBegin(view);
+    int end = viewEnd(view);
+    view_offsets_[view] = n;
+
+    for (int i = begin; i < end; i += 1) {
+      if (keep(values_[i])) {
+        if (i != n) {
+          tracks_[n] = tracks_[i];
+          times_[n] = times_[i];
+          std::swap(values_[n], values_[i]);
+        }
+        n += 1;
+      }
+    }
+  }
+  view_offsets_[num_views] = n;
+
+  tracks_.resize(n);
+  times_.resize(n);
+  values_.resize(n);
+}
+
+template<class T>
+void ColumnarMultiviewTrackList<T>::swap(
+    ColumnarMultiviewTrackList<T>& other) {
+  std::swap(num_tracks_, other.num_tracks_);
+  view_offsets_.swap(other.view_offsets_);
+  tracks_.swap(other.tracks_);
+  times_.swap(other.times_);
+  values_.swap(other.values_);
+}
+
+template<class T>
+void ColumnarMultiviewTrackList<T>::clear() {
+  num_tracks_ = 0;
+  view_offsets_.assign(1, 0);
+  tracks_.clear();
+  times_.clear();
+  values_.clear();
+}
+
+template<class T>
+void swap(ColumnarMultiviewTrackList<T>& lhs,
+          ColumnarMultiviewTrackList<T>& rhs) {
+  lhs.swap(rhs);
+}
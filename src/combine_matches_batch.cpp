@@ -0,0 +1,200 @@
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cstdlib>
+#include <boost/format.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "match.hpp"
+#include "match_result.hpp"
+#include "match_combination.hpp"
+#include "read_lines.hpp"
+#include "batch_jobs.hpp"
+
+#include "iterator_reader.hpp"
+#include "match_reader.hpp"
+#include "match_result_reader.hpp"
+
+#include "iterator_writer.hpp"
+#include "match_writer.hpp"
+#include "match_result_writer.hpp"
+#include "util/thread-pool.hpp"
+
+DEFINE_bool(reciprocal, false, "Require matches to be reciprocal?");
+DEFINE_bool(directed_consistent, false,
+    "Find matches which are consistent in the first image only");
+DEFINE_bool(keep_distance, false,
+    "Keep distance labels? (Fails if distance is not symmetric)");
+
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads to combine with, 0 to combine serially");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Combines the matches in both directions between many pairs of "
+      "images." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " pairs input-format output-format" << std::endl;
+  usage << std::endl;
+  usage << "pairs -- Input. One \"view1 time1 view2 time2\" per line, as "
+      "written by scripts/generate-*-image-pairs.sh." << std::endl;
+  usage << "input-format -- Input. Takes two view names and two frames." <<
+      std::endl;
+  usage << "output-format -- Output. Takes two view names and two frames." <<
+      std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 4) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+// Frames are used as they appear in the list of pairs, like
+// scripts/combine-matches.sh.
+struct ImagePair {
+  std::string view1;
+  std::string view2;
+  int time1;
+  int time2;
+};
+
+bool parseImagePairs(const std::vector<std::string>& lines,
+                     std::vector<ImagePair>& pairs) {
+  pairs.clear();
+
+  std::vector<std::string>::const_iterator line;
+  for (line = lines.begin(); line != lines.end(); ++line) {
+    if (line->empty()) {
+      continue;
+    }
+
+    ImagePair pair;
+    std::istringstream stream(*line);
+    if (!(stream >> pair.view1 >> pair.time1 >> pair.view2 >> pair.time2)) {
+      LOG(WARNING) << "Could not parse pair \"" << *line << "\"";
+      return false;
+    }
+    pairs.push_back(pair);
+  }
+
+  return true;
+}
+
+std::string makeMatchFilename(const std::string& format,
+                              const std::string& view1,
+                              const std::string& view2,
+                              int time1,
+                              int time2) {
+  return boost::str(boost::format(format) % view1 % view2 % time1 % time2);
+}
+
+MatchCombination chooseCombination() {
+  if (FLAGS_reciprocal) {
+    return MATCH_RECIPROCAL;
+  } else if (FLAGS_directed_consistent && !FLAGS_keep_distance) {
+    return MATCH_FORWARD_CONSISTENT;
+  } else {
+    return MATCH_UNION;
+  }
+}
+
+// Loads, combines and saves one pair as combine-matches does.
+template<class T>
+bool combinePair(const std::string& forward_file,
+                 const std::string& reverse_file,
+                 const std::string& matches_file,
+                 Reader<T>& reader,
+                 Writer<T>& writer,
+                 void (*combine)(std::vector<T>&,
+                                 std::vector<T>&,
+                                 MatchCombination,
+                                 std::vector<T>&)) {
+  std::vector<T> forward;
+  std::vector<T> reverse;
+  if (!loadList(forward_file, forward, reader)) {
+    LOG(WARNING) << "Could not load forward matches \"" << forward_file <<
+        "\"";
+    return false;
+  }
+  if (!loadList(reverse_file, reverse, reader)) {
+    LOG(WARNING) << "Could not load reverse matches \"" << reverse_file <<
+        "\"";
+    return false;
+  }
+
+  // Flip order of reverse matches.
+  flipMatches(reverse);
+
+  std::vector<T> matches;
+  combine(forward, reverse, chooseCombination(), matches);
+
+  return saveList(matches_file, matches, writer);
+}
+
+// For use with runBatchJobs().
+class CombinePairFunction {
+  public:
+    CombinePairFunction(const std::string& input_format,
+                        const std::string& output_format,
+                        const std::vector<ImagePair>& pairs)
+        : input_format_(&input_format),
+          output_format_(&output_format),
+          pairs_(&pairs) {}
+
+    bool operator()(int i) const {
+      const ImagePair& pair = (*pairs_)[i];
+      std::string forward_file = makeMatchFilename(*input_format_,
+          pair.view1, pair.view2, pair.time1, pair.time2);
+      std::string reverse_file = makeMatchFilename(*input_format_,
+          pair.view2, pair.view1, pair.time2, pair.time1);
+      std::string matches_file = makeMatchFilename(*output_format_,
+          pair.view1, pair.view2, pair.time1, pair.time2);
+
+      if (FLAGS_keep_distance) {
+        MatchResultReader reader;
+        MatchResultWriter writer;
+        return combinePair(forward_file, reverse_file, matches_file, reader,
+            writer, combineMatchResults);
+      } else {
+        MatchReader reader;
+        MatchWriter writer;
+        return combinePair(forward_file, reverse_file, matches_file, reader,
+            writer, combineMatches);
+      }
+    }
+
+  private:
+    const std::string* input_format_;
+    const std::string* output_format_;
+    const std::vector<ImagePair>* pairs_;
+};
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string pairs_file = argv[1];
+  std::string input_format = argv[2];
+  std::string output_format = argv[3];
+
+  bool ok;
+
+  std::vector<std::string> lines;
+  ok = readLines(pairs_file, lines);
+  CHECK(ok) << "Could not load pairs";
+  std::vector<ImagePair> pairs;
+  ok = parseImagePairs(lines, pairs);
+  CHECK(ok) << "Could not parse pairs";
+  LOG(INFO) << "Combining matches of " << pairs.size() << " pairs of images";
+
+  ThreadPool pool(FLAGS_num_threads);
+  int num_failed = runBatchJobs(pairs.size(),
+      CombinePairFunction(input_format, output_format, pairs), pool);
+  CHECK(num_failed == 0) << "Could not combine " << num_failed << " pairs";
+
+  return 0;
+}
@@ -0,0 +1,110 @@
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdlib>
+#include <sstream>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "descriptor_matrix.hpp"
+#include "sift_position.hpp"
+#include "match_result.hpp"
+#include "track_list.hpp"
+#include "multiview_track_list.hpp"
+#include "feature_files.hpp"
+
+DEFINE_string(descriptor_type, "",
+    "Type to store descriptors as: float, half or byte. Empty keeps the type "
+    "of the input");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Converts between text and binary feature files." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " type input output" << std::endl;
+  usage << std::endl;
+  usage << "type -- One of descriptors, features, keypoints, matches, tracks "
+    "or multiview-tracks." << std::endl;
+  usage << "input, output -- Files ending in .bin are binary." << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 4) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+
+  int type;
+  CHECK(parseDescriptorType(FLAGS_descriptor_type, type)) <<
+      "Unknown descriptor type `" << FLAGS_descriptor_type << "'";
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string type = argv[1];
+  std::string input_file = argv[2];
+  std::string output_file = argv[3];
+
+  int descriptor_type;
+  parseDescriptorType(FLAGS_descriptor_type, descriptor_type);
+
+  bool ok;
+
+  if (type == "descriptors") {
+    DescriptorMatrix descriptors;
+    ok = loadDescriptorMatrix(input_file, descriptors, descriptor_type);
+    CHECK(ok) << "Could not load descriptors";
+    ok = saveDescriptorMatrix(output_file, descriptors);
+    CHECK(ok) << "Could not save descriptors";
+  } else if (type == "features") {
+    // Features are read as doubles, so there is no type to keep.
+    std::deque<SiftFeature> features;
+    ok = loadSiftFeatures(input_file, features);
+    CHECK(ok) << "Could not load features";
+    std::vector<SiftFeature> list(features.begin(), features.end());
+    ok = saveSiftFeatures(output_file, list,
+        descriptor_type == ANY_DESCRIPTOR_TYPE ? CV_32F : descriptor_type);
+    CHECK(ok) << "Could not save features";
+  } else if (type == "keypoints") {
+    std::vector<SiftPosition> keypoints;
+    ok = loadSiftPositions(input_file, keypoints);
+    CHECK(ok) << "Could not load keypoints";
+    ok = saveSiftPositions(output_file, keypoints);
+    CHECK(ok) << "Could not save keypoints";
+  } else if (type == "matches") {
+    std::vector<MatchResult> matches;
+    ok = loadMatchResults(input_file, matches);
+    CHECK(ok) << "Could not load matches";
+    ok = saveMatchResults(output_file, matches);
+    CHECK(ok) << "Could not save matches";
+  } else if (type == "tracks") {
+    TrackListView<SiftPosition> view;
+    ok = loadSiftPositionTracks(input_file, view);
+    CHECK(ok) << "Could not load tracks";
+    TrackList<SiftPosition> tracks(view.size());
+    for (int i = 0; i < view.size(); i += 1) {
+      view[i].copyTo(tracks[i]);
+    }
+    ok = saveSiftPositionTracks(output_file, tracks);
+    CHECK(ok) << "Could not save tracks";
+  } else if (type == "multiview-tracks") {
+    MultiviewTrackListView<SiftPosition> view;
+    ok = loadSiftPositionMultiviewTracks(input_file, view);
+    CHECK(ok) << "Could not load tracks";
+    MultiviewTrackList<SiftPosition> tracks(view.numViews());
+    for (int i = 0; i < view.numTracks(); i += 1) {
+      MultiviewTrack<SiftPosition> track;
+      view.track(i).copyTo(track);
+      tracks.push_back(track);
+    }
+    ok = saveSiftPositionMultiviewTracks(output_file, tracks);
+    CHECK(ok) << "Could not save tracks";
+  } else {
+    LOG(FATAL) << "Unknown type `" << type << "'";
+  }
+
+  return 0;
+}
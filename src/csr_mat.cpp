@@ -0,0 +1,407 @@
+#include "csr_mat.hpp"
+#include <algorithm>
+#include <cmath>
+#include <glog/logging.h>
+#include "match_graph.hpp"
+#include "util/thread-pool.hpp"
+
+// Below this many entries, a product is not worth dividing amongst threads.
+const size_t PARALLEL_MULTIPLY_MIN_NON_ZEROS = 1 << 15;
+// Blocks of rows per thread, for balance.
+const int MULTIPLY_BLOCKS_PER_THREAD = 4;
+
+CsrEntry::CsrEntry() : row(-1), col(-1), value(0) {}
+
+CsrEntry::CsrEntry(int row, int col, double value)
+    : row(row), col(col), value(value) {}
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+bool positionBefore(const CsrEntry& lhs, const CsrEntry& rhs) {
+  if (lhs.row != rhs.row) {
+    return lhs.row < rhs.row;
+  } else {
+    return lhs.col < rhs.col;
+  }
+}
+
+// Multiplies blocks of rows with about the same number of entries.
+// For use with ThreadPool::parallelFor().
+class MultiplyBlockFunction {
+  public:
+    MultiplyBlockFunction(const CsrMat& A,
+                          const std::vector<int>& blocks,
+                          const double* x,
+                          double* y)
+        : A_(&A), blocks_(&blocks), x_(x), y_(y) {}
+
+    void operator()(int block) const {
+      A_->multiplyRows(x_, y_, (*blocks_)[block], (*blocks_)[block + 1]);
+    }
+
+  private:
+    const CsrMat* A_;
+    const std::vector<int>* blocks_;
+    const double* x_;
+    double* y_;
+};
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CsrMat::CsrMat()
+    : rows_(0), cols_(0), offsets_(1, 0), columns_(), values_() {}
+
+void CsrMat::build(int rows, int cols, const std::vector<CsrEntry>& entries) {
+  CHECK(rows >= 0 && cols >= 0);
+  std::vector<CsrEntry> sorted(entries);
+  // Stable, so that the last entry at each position can be kept.
+  std::stable_sort(sorted.begin(), sorted.end(), positionBefore);
+
+  rows_ = rows;
+  cols_ = cols;
+  offsets_.assign(rows + 1, 0);
+  columns_.clear();
+  values_.clear();
+  columns_.reserve(sorted.size());
+  values_.reserve(sorted.size());
+
+  std::vector<CsrEntry>::const_iterator entry;
+  for (entry = sorted.begin(); entry != sorted.end(); ++entry) {
+    CHECK(0 <= entry->row && entry->row < rows);
+    CHECK(0 <= entry->col && entry->col < cols);
+
+    std::vector<CsrEntry>::const_iterator next = entry + 1;
+    if (next != sorted.end() && !positionBefore(*entry, *next)) {
+      // Replaced by a later entry.
+      continue;
+    }
+
+    columns_.push_back(entry->col);
+    values_.push_back(entry->value);
+    offsets_[entry->row + 1] += 1;
+  }
+
+  for (int i = 0; i < rows; i += 1) {
+    offsets_[i + 1] += offsets_[i];
+  }
+}
+
+void CsrMat::build(const cv::SparseMat& A) {
+  CHECK(A.dims() == 2);
+  CHECK(A.type() == cv::DataType<double>::type);
+
+  std::vector<CsrEntry> entries;
+  entries.reserve(A.nzcount());
+  cv::SparseMatConstIterator a;
+  for (a = A.begin(); a != A.end(); ++a) {
+    const int* idx = a.node()->idx;
+    entries.push_back(CsrEntry(idx[0], idx[1], a.value<double>()));
+  }
+
+  build(A.size(0), A.size(1), entries);
+}
+
+int CsrMat::rows() const {
+  return rows_;
+}
+
+int CsrMat::cols() const {
+  return cols_;
+}
+
+size_t CsrMat::numNonZeros() const {
+  return values_.size();
+}
+
+size_t CsrMat::rowBegin(int i) const {
+  return offsets_[i];
+}
+
+const int* CsrMat::columns() const {
+  return columns_.empty() ? NULL : &columns_.front();
+}
+
+const double* CsrMat::values() const {
+  return values_.empty() ? NULL : &values_.front();
+}
+
+double* CsrMat::values() {
+  return values_.empty() ? NULL : &values_.front();
+}
+
+void CsrMat::multiply(const double* x, double* y) const {
+  multiplyRows(x, y, 0, rows_);
+}
+
+void CsrMat::multiply(const double* x, double* y, ThreadPool& pool) const {
+  size_t nnz = numNonZeros();
+  if (pool.numThreads() == 0 || nnz < PARALLEL_MULTIPLY_MIN_NON_ZEROS) {
+    multiply(x, y);
+    return;
+  }
+
+  // Divide the entries evenly, at row boundaries.
+  int num_blocks = MULTIPLY_BLOCKS_PER_THREAD * (pool.numThreads() + 1);
+  std::vector<int> blocks(num_blocks + 1, 0);
+  for (int b = 1; b < num_blocks; b += 1) {
+    size_t target = nnz * b / num_blocks;
+    blocks[b] = std::upper_bound(offsets_.begin(), offsets_.end(), target) -
+        offsets_.begin() - 1;
+  }
+  blocks[num_blocks] = rows_;
+
+  pool.parallelFor(0, num_blocks, MultiplyBlockFunction(*this, blocks, x, y));
+}
+
+void CsrMat::multiplyRows(const double* x,
+                          double* y,
+                          int begin,
+                          int end) const {
+  const int* columns = this->columns();
+  const double* values = this->values();
+
+  for (int i = begin; i < end; i += 1) {
+    size_t k = offsets_[i];
+    size_t last = offsets_[i + 1];
+    // Four partial sums do not wait on each other's additions.
+    double sum0 = 0;
+    double sum1 = 0;
+    double sum2 = 0;
+    double sum3 = 0;
+
+    for (; k + 4 <= last; k += 4) {
+      sum0 += values[k] * x[columns[k]];
+      sum1 += values[k + 1] * x[columns[k + 1]];
+      sum2 += values[k + 2] * x[columns[k + 2]];
+      sum3 += values[k + 3] * x[columns[k + 3]];
+    }
+    for (; k < last; k += 1) {
+      sum0 += values[k] * x[columns[k]];
+    }
+
+    y[i] = (sum0 + sum1) + (sum2 + sum3);
+  }
+}
+
+void CsrMat::leftMultiplyByDiag(const double* d) {
+  for (int i = 0; i < rows_; i += 1) {
+    for (size_t k = offsets_[i]; k < offsets_[i + 1]; k += 1) {
+      values_[k] *= d[i];
+    }
+  }
+}
+
+void CsrMat::rightMultiplyByDiag(const double* d) {
+  std::vector<double>::iterator value = values_.begin();
+  std::vector<int>::const_iterator column = columns_.begin();
+  for (; value != values_.end(); ++value, ++column) {
+    *value *= d[*column];
+  }
+}
+
+void CsrMat::rowSums(std::vector<double>& sums) const {
+  sums.assign(rows_, 0.);
+  for (int i = 0; i < rows_; i += 1) {
+    for (size_t k = offsets_[i]; k < offsets_[i + 1]; k += 1) {
+      sums[i] += values_[k];
+    }
+  }
+}
+
+void CsrMat::diagonalBlocks(const std::vector<int>& parts,
+                            int num_parts,
+                            std::vector<CsrMat>& blocks) const {
+  CHECK(rows_ == cols_);
+  CHECK(int(parts.size()) == rows_);
+
+  // Position of each row within its block.
+  std::vector<int> index(rows_);
+  std::vector<int> sizes(num_parts, 0);
+  for (int i = 0; i < rows_; i += 1) {
+    CHECK(0 <= parts[i] && parts[i] < num_parts);
+    index[i] = sizes[parts[i]];
+    sizes[parts[i]] += 1;
+  }
+
+  blocks.assign(num_parts, CsrMat());
+  for (int p = 0; p < num_parts; p += 1) {
+    blocks[p].rows_ = sizes[p];
+    blocks[p].cols_ = sizes[p];
+    blocks[p].offsets_.reserve(sizes[p] + 1);
+  }
+
+  // Positions increase with the columns of each part, so the entries of
+  // each row stay ordered.
+  for (int i = 0; i < rows_; i += 1) {
+    CsrMat& block = blocks[parts[i]];
+    for (size_t k = offsets_[i]; k < offsets_[i + 1]; k += 1) {
+      int j = columns_[k];
+      if (parts[j] == parts[i]) {
+        block.columns_.push_back(index[j]);
+        block.values_.push_back(values_[k]);
+      }
+    }
+    block.offsets_.push_back(block.columns_.size());
+  }
+}
+
+void CsrMat::toSparseMat(cv::SparseMat& A) const {
+  const int ndims = 2;
+  const int dims[ndims] = { rows_, cols_ };
+  A.create(ndims, dims, cv::DataType<double>::type);
+
+  for (int i = 0; i < rows_; i += 1) {
+    for (size_t k = offsets_[i]; k < offsets_[i + 1]; k += 1) {
+      A.ref<double>(i, columns_[k]) = values_[k];
+    }
+  }
+}
+
+void CsrMat::swap(CsrMat& other) {
+  std::swap(rows_, other.rows_);
+  std::swap(cols_, other.cols_);
+  offsets_.swap(other.offsets_);
+  columns_.swap(other.columns_);
+  values_.swap(other.values_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void add(const CsrMat& A, const CsrMat& B, CsrMat& C) {
+  CHECK(A.rows() == B.rows());
+  CHECK(A.cols() == B.cols());
+
+  // Merge each pair of rows, which are ordered by column.
+  std::vector<CsrEntry> entries;
+  entries.reserve(A.numNonZeros() + B.numNonZeros());
+  for (int i = 0; i < A.rows(); i += 1) {
+    size_t a = A.rowBegin(i);
+    size_t a_end = A.rowBegin(i + 1);
+    size_t b = B.rowBegin(i);
+    size_t b_end = B.rowBegin(i + 1);
+
+    while (a < a_end || b < b_end) {
+      if (b == b_end || (a < a_end && A.columns()[a] < B.columns()[b])) {
+        entries.push_back(CsrEntry(i, A.columns()[a], A.values()[a]));
+        a += 1;
+      } else if (a == a_end || B.columns()[b] < A.columns()[a]) {
+        entries.push_back(CsrEntry(i, B.columns()[b], B.values()[b]));
+        b += 1;
+      } else {
+        entries.push_back(CsrEntry(i, A.columns()[a],
+              A.values()[a] + B.values()[b]));
+        a += 1;
+        b += 1;
+      }
+    }
+  }
+
+  C.build(A.rows(), A.cols(), entries);
+}
+
+void addTo(const CsrMat& A, CsrMat& B) {
+  CsrMat C;
+  add(A, B, C);
+  B.swap(C);
+}
+
+void leftMultiplyByDiag(CsrMat& A, const std::vector<double>& d) {
+  CHECK(int(d.size()) == A.rows()) << "Incorrect number of diagonal elements";
+  if (!d.empty()) {
+    A.leftMultiplyByDiag(&d.front());
+  }
+}
+
+void rightMultiplyByDiag(CsrMat& A, const std::vector<double>& d) {
+  CHECK(int(d.size()) == A.cols()) << "Incorrect number of diagonal elements";
+  if (!d.empty()) {
+    A.rightMultiplyByDiag(&d.front());
+  }
+}
+
+void normalizedLaplacian(const CsrMat& W,
+                         CsrMat& L,
+                         std::vector<double>& degrees) {
+  CHECK(W.rows() == W.cols());
+  int n = W.rows();
+  W.rowSums(degrees);
+
+  // D - W, without the diagonal of vertices without edges.
+  std::vector<CsrEntry> entries;
+  entries.reserve(W.numNonZeros() + n);
+  for (int i = 0; i < n; i += 1) {
+    if (degrees[i] != 0) {
+      entries.push_back(CsrEntry(i, i, degrees[i]));
+    }
+  }
+  CsrMat D;
+  D.build(n, n, entries);
+
+  L = W;
+  for (size_t k = 0; k < L.numNonZeros(); k += 1) {
+    L.values()[k] = -L.values()[k];
+  }
+  addTo(D, L);
+
+  // Scale by D^{-1/2} on both sides.
+  std::vector<double> inv_root_degrees(n, 0.);
+  for (int i = 0; i < n; i += 1) {
+    if (degrees[i] != 0) {
+      inv_root_degrees[i] = 1. / std::sqrt(degrees[i]);
+    }
+  }
+  leftMultiplyByDiag(L, inv_root_degrees);
+  rightMultiplyByDiag(L, inv_root_degrees);
+}
+
+void affinityMatrix(const MatchGraph& graph,
+                    const std::vector<int>& vertices,
+                    CsrMat& W) {
+  int n = vertices.size();
+  for (int i = 1; i < n; i += 1) {
+    CHECK(vertices[i - 1] < vertices[i]) << "Vertices must be sorted";
+  }
+
+  // Each edge is in the neighbours of both ends, so both entries appear.
+  std::vector<CsrEntry> entries;
+  for (int i = 0; i < n; i += 1) {
+    int vertex = vertices[i];
+    int degree = graph.degree(vertex);
+    const int* neighbors = graph.neighbors(vertex);
+    const double* weights = graph.weights(vertex);
+
+    for (int k = 0; k < degree; k += 1) {
+      std::vector<int>::const_iterator j = std::lower_bound(vertices.begin(),
+          vertices.end(), neighbors[k]);
+      if (j != vertices.end() && *j == neighbors[k]) {
+        entries.push_back(CsrEntry(i, j - vertices.begin(), weights[k]));
+      }
+    }
+  }
+
+  // Parallel matches between two features are summed.
+  std::vector<CsrEntry> merged;
+  std::sort(entries.begin(), entries.end(), positionBefore);
+  std::vector<CsrEntry>::const_iterator entry;
+  for (entry = entries.begin(); entry != entries.end(); ++entry) {
+    if (!merged.empty() && !positionBefore(merged.back(), *entry)) {
+      merged.back().value += entry->value;
+    } else {
+      merged.push_back(*entry);
+    }
+  }
+  W.build(n, n, merged);
+}
+
+void normalizedLaplacian(const MatchGraph& graph,
+                         const std::vector<int>& vertices,
+                         CsrMat& L,
+                         std::vector<double>& degrees) {
+  CsrMat W;
+  affinityMatrix(graph, vertices, W);
+  normalizedLaplacian(W, L, degrees);
+}
@@ -0,0 +1,114 @@
+#ifndef CSR_MAT_HPP_
+#define CSR_MAT_HPP_
+
+#include <cstddef>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+class MatchGraph;
+class ThreadPool;
+
+// An entry of a sparse matrix.
+struct CsrEntry {
+  int row;
+  int col;
+  double value;
+
+  CsrEntry();
+  CsrEntry(int row, int col, double value);
+};
+
+// A sparse matrix in compressed sparse row form.
+//
+// The entries of each row are contiguous and ordered by column, and each
+// position appears at most once. Multiplication by a vector reads the
+// matrix in order, unlike cv::SparseMat, whose entries are kept in a hash
+// table.
+class CsrMat {
+  public:
+    CsrMat();
+
+    // Where several entries have the same position, the last is kept, as
+    // if each were assigned in turn.
+    void build(int rows, int cols, const std::vector<CsrEntry>& entries);
+    // Takes a two-dimensional CV_64F matrix.
+    void build(const cv::SparseMat& A);
+
+    int rows() const;
+    int cols() const;
+    size_t numNonZeros() const;
+
+    // Entries of row i are [rowBegin(i), rowBegin(i + 1)).
+    size_t rowBegin(int i) const;
+    const int* columns() const;
+    const double* values() const;
+    double* values();
+
+    // Computes y = A x. The vectors must not overlap.
+    void multiply(const double* x, double* y) const;
+    // Divides the rows amongst the threads of the pool.
+    void multiply(const double* x, double* y, ThreadPool& pool) const;
+    // Computes rows [begin, end) of y = A x.
+    void multiplyRows(const double* x, double* y, int begin, int end) const;
+
+    // Computes A = diag(d) A.
+    void leftMultiplyByDiag(const double* d);
+    // Computes A = A diag(d).
+    void rightMultiplyByDiag(const double* d);
+
+    // Sum of each row.
+    void rowSums(std::vector<double>& sums) const;
+
+    // Splits a square matrix into the diagonal blocks of a partition of its
+    // rows and columns, e.g. the affinities within each subset of vertices.
+    // Parts are numbered from zero. Rows keep their order within each block.
+    void diagonalBlocks(const std::vector<int>& parts,
+                        int num_parts,
+                        std::vector<CsrMat>& blocks) const;
+
+    void toSparseMat(cv::SparseMat& A) const;
+
+    void swap(CsrMat& other);
+
+  private:
+    int rows_;
+    int cols_;
+    // Start of each row, and the number of entries at the end.
+    std::vector<size_t> offsets_;
+    std::vector<int> columns_;
+    std::vector<double> values_;
+};
+
+// Computes C = A + B.
+void add(const CsrMat& A, const CsrMat& B, CsrMat& C);
+// Adds A to B.
+void addTo(const CsrMat& A, CsrMat& B);
+
+// Same as the methods of CsrMat, with the interface of sparse_mat.hpp.
+void leftMultiplyByDiag(CsrMat& A, const std::vector<double>& d);
+void rightMultiplyByDiag(CsrMat& A, const std::vector<double>& d);
+
+// Builds the affinity matrix of a subset of the vertices of a MatchGraph,
+// whose weights are the affinities. Vertices must be sorted and unique.
+// Edges to other vertices are ignored, and parallel edges are summed.
+void affinityMatrix(const MatchGraph& graph,
+                    const std::vector<int>& vertices,
+                    CsrMat& W);
+
+// Builds L = D^{-1/2} (D - W) D^{-1/2}, where W is the affinity of each pair
+// of vertices and D the diagonal matrix of the rows of W. Outputs the
+// diagonal of D. Rows of vertices without edges are empty.
+//
+// The graph is a subset of the vertices of a MatchGraph, whose weights are
+// the affinities. Vertices must be sorted and unique. Edges to other vertices
+// are ignored.
+void normalizedLaplacian(const MatchGraph& graph,
+                         const std::vector<int>& vertices,
+                         CsrMat& L,
+                         std::vector<double>& degrees);
+// Builds from the affinity matrix directly.
+void normalizedLaplacian(const CsrMat& W,
+                         CsrMat& L,
+                         std::vector<double>& degrees);
+
+#endif
@@ -8,6 +8,8 @@ class DefaultReader : public Reader<T> {
   public:
     ~DefaultReader();
     bool read(const cv::FileNode& node, T& x);
+    bool fields(std::vector<std::string>& keys) const;
+    bool readFields(const FieldValues& values, T& x);
 };
 
 template<class T>
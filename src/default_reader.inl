@@ -6,6 +6,17 @@ bool DefaultReader<T>::read(const cv::FileNode& node, T& x) {
   return ::read<T>(node["x"], x);
 }
 
+template<class T>
+bool DefaultReader<T>::fields(std::vector<std::string>& keys) const {
+  keys.assign(1, "x");
+  return true;
+}
+
+template<class T>
+bool DefaultReader<T>::readFields(const FieldValues& values, T& x) {
+  return readField<T>(values, 0, x);
+}
+
 template<class T>
 InlineDefaultReader<T>::~InlineDefaultReader() {}
 
@@ -1,5 +1,5 @@
 # Boost
-find_package(Boost REQUIRED)
+find_package(Boost REQUIRED COMPONENTS thread system)
 
 # OpenCV
 find_package(OpenCV REQUIRED
@@ -7,7 +7,8 @@ find_package(OpenCV REQUIRED
 include_directories(${OpenCV_INCLUDE_DIRS})
 
 # Protocol Buffers (required by Ceres)
-find_package(Protobuf REQUIRED)
+# At least 3.0 for arena allocation of messages.
+find_package(Protobuf 3.0 REQUIRED)
 include_directories(${PROTOBUF_INCLUDE_DIRS})
 
 # Ceres
@@ -51,11 +52,21 @@ include_directories(${GLOG_INCLUDE_DIRS})
 find_package(GFlags REQUIRED)
 include_directories(${GFLAGS_INCLUDE_DIRS})
 
-# liblinear
-find_path(LIBLINEAR_INCLUDE_DIRS NAMES linear.h)
-include_directories(${LIBLINEAR_INCLUDE_DIRS})
-find_library(LIBLINEAR_LIBRARIES NAMES linear)
-set(LIBLINEAR_LIBRARIES ${LIBLINEAR_LIBRARIES} ${BLAS_LIBRARIES})
-
 # GNU Scientific Library (GSL)
 find_library(GSL_LIBRARIES NAMES gsl)
+
+# LZ4 and Zstandard (for chunked archives)
+find_path(LZ4_INCLUDE_DIRS NAMES lz4.h)
+include_directories(${LZ4_INCLUDE_DIRS})
+find_library(LZ4_LIBRARIES NAMES lz4)
+find_path(ZSTD_INCLUDE_DIRS NAMES zstd.h)
+include_directories(${ZSTD_INCLUDE_DIRS})
+find_library(ZSTD_LIBRARIES NAMES zstd)
+
+# arpack++ and ARPACK (optional, for the ARPACK eigensolver of
+# spectral-partition-graph)
+find_path(ARPACKPP_INCLUDE_DIRS NAMES arssym.h PATH_SUFFIXES arpack++ arpackpp)
+find_library(ARPACK_LIBRARIES NAMES arpack)
+
+# Google Benchmark (optional, for the benchmarks target)
+find_package(benchmark QUIET)
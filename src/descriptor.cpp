@@ -13,3 +13,7 @@ void Descriptor::swap(Descriptor& other) {
 void Descriptor::clear() {
   data.clear();
 }
+
+void swap(Descriptor& lhs, Descriptor& rhs) {
+  lhs.swap(rhs);
+}
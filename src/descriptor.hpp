@@ -15,4 +15,6 @@ struct Descriptor {
   void clear();
 };
 
+void swap(Descriptor& lhs, Descriptor& rhs);
+
 #endif
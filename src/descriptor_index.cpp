@@ -0,0 +1,326 @@
+#include "descriptor_index.hpp"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+#include <boost/format.hpp>
+#include <glog/logging.h>
+#include "util/hash.hpp"
+
+namespace {
+
+// Same parameters as cv::FlannBasedMatcher by default.
+const int NUM_KD_TREES = 4;
+const int NUM_CHECKS = 32;
+
+const char* const INDEX_EXTENSION = ".flann";
+// Beside the index, the hash of the descriptors it was built from.
+const char* const SOURCE_EXTENSION = ".source";
+
+// Identifies the descriptors which an index was built from.
+std::string hashDescriptors(const DescriptorMatrix& descriptors) {
+  Hash hash;
+  hash.add(int32_t(descriptors.rows()));
+  hash.add(int32_t(descriptors.cols()));
+  hash.add(int32_t(descriptors.type()));
+  const cv::Mat& mat = descriptors.mat();
+  size_t row_bytes = mat.cols * mat.elemSize();
+  for (int i = 0; i < mat.rows; i += 1) {
+    hash.add(mat.ptr(i), row_bytes);
+  }
+
+  return boost::str(boost::format("%016x") % hash.value());
+}
+
+// FLANN reports squared Euclidean distance.
+void addFlannResults(const cv::Mat& indices,
+                     const cv::Mat& squared_distances,
+                     int row,
+                     int num_results,
+                     int query,
+                     MatchSink& matches) {
+  const int* index = indices.ptr<int>(row);
+  const float* distance = squared_distances.ptr<float>(row);
+
+  for (int j = 0; j < num_results; j += 1) {
+    if (index[j] < 0) {
+      break;
+    }
+    matches.add(query, index[j], std::sqrt(distance[j]));
+  }
+}
+
+// FLANN searches require float queries.
+cv::Mat convertQuery(const cv::Mat& query) {
+  if (query.type() == cv::DataType<float>::type) {
+    return query;
+  }
+
+  cv::Mat converted;
+  query.convertTo(converted, cv::DataType<float>::type);
+  return converted;
+}
+
+}
+
+DescriptorIndex::DescriptorIndex()
+    : descriptors_(), flann_(), exact_(), gpu_() {}
+
+DescriptorIndex::~DescriptorIndex() {}
+
+void DescriptorIndex::setDescriptors(const DescriptorMatrix& descriptors,
+                                     bool use_flann) {
+  if (descriptors.type() == cv::DataType<float>::type || !use_flann) {
+    descriptors_ = descriptors;
+  } else {
+    copyToDescriptorMatrix(descriptors, descriptors_,
+        cv::DataType<float>::type);
+  }
+
+  flann_.reset();
+  exact_.reset();
+  gpu_.reset();
+}
+
+void DescriptorIndex::build(const std::deque<Descriptor>& descriptors,
+                            bool use_flann) {
+  DescriptorMatrix matrix;
+  listToMatrix(descriptors, matrix);
+  build(matrix, use_flann);
+}
+
+void DescriptorIndex::build(const DescriptorMatrix& descriptors,
+                            bool use_flann) {
+  setDescriptors(descriptors, use_flann);
+
+  if (use_flann) {
+    flann_.reset(new cv::flann::Index(descriptors_.mat(),
+          cv::flann::KDTreeIndexParams(NUM_KD_TREES)));
+  } else {
+    exact_.reset(new ExactMatcher(descriptors_));
+  }
+}
+
+void DescriptorIndex::buildOnGpu(const DescriptorMatrix& descriptors) {
+  setDescriptors(descriptors, false);
+  gpu_.reset(new GpuMatcher(descriptors_));
+}
+
+bool DescriptorIndex::load(const DescriptorMatrix& descriptors,
+                           const std::string& filename) {
+  if (!std::ifstream(filename.c_str())) {
+    return false;
+  }
+
+  setDescriptors(descriptors, true);
+
+  // The index stores only the tree, check that it was built from these
+  // points and not, for example, from an earlier projection of them.
+  std::string source;
+  std::ifstream source_file((filename + SOURCE_EXTENSION).c_str());
+  if (!(source_file >> source) || source != hashDescriptors(descriptors_)) {
+    LOG(WARNING) << "Index \"" << filename << "\" is out of date";
+    return false;
+  }
+
+  try {
+    flann_.reset(new cv::flann::Index(descriptors_.mat(),
+          cv::flann::SavedIndexParams(filename)));
+  } catch (cv::Exception& e) {
+    LOG(WARNING) << "Could not load index \"" << filename << "\": " <<
+        e.what();
+    flann_.reset();
+    return false;
+  }
+
+  if (int(flann_->size()) != descriptors_.rows() ||
+      flann_->veclen() != descriptors_.cols()) {
+    LOG(WARNING) << "Index \"" << filename << "\" does not match descriptors";
+    flann_.reset();
+    return false;
+  }
+
+  return true;
+}
+
+bool DescriptorIndex::save(const std::string& filename) const {
+  if (!flann_) {
+    return false;
+  }
+
+  // Write to temporary files so that another process never loads a partial
+  // index. The hash is renamed last, so an index is only accepted once both
+  // are complete.
+  std::string source = filename + SOURCE_EXTENSION;
+  std::string temporary = filename + ".tmp";
+  std::string temporary_source = source + ".tmp";
+  flann_->save(temporary);
+  {
+    std::ofstream file(temporary_source.c_str());
+    file << hashDescriptors(descriptors_) << std::endl;
+    if (!file) {
+      return false;
+    }
+  }
+  return std::rename(temporary.c_str(), filename.c_str()) == 0 &&
+      std::rename(temporary_source.c_str(), source.c_str()) == 0;
+}
+
+bool DescriptorIndex::usesFlann() const {
+  return flann_.get() != NULL;
+}
+
+bool DescriptorIndex::usesGpu() const {
+  return gpu_.get() != NULL;
+}
+
+int DescriptorIndex::size() const {
+  return descriptors_.rows();
+}
+
+cv::Mat DescriptorIndex::descriptors() const {
+  return descriptors(0, size());
+}
+
+cv::Mat DescriptorIndex::descriptors(int begin, int end) const {
+  cv::Mat buffer;
+  return descriptors_.toFloat(begin, end, buffer);
+}
+
+const DescriptorMatrix& DescriptorIndex::descriptorMatrix() const {
+  return descriptors_;
+}
+
+void DescriptorIndex::knnMatch(const cv::Mat& query,
+                               MatchSink& matches,
+                               int k) const {
+  CHECK(flann_ || exact_ || gpu_) << "Index has not been built";
+
+  if (gpu_) {
+    gpu_->knnMatch(convertQuery(query), matches, k);
+    return;
+  } else if (!flann_) {
+    exact_->knnMatch(convertQuery(query), matches, k);
+    return;
+  }
+
+  k = std::max(std::min(k, size()), 1);
+  cv::Mat indices(query.rows, k, cv::DataType<int>::type);
+  cv::Mat distances(query.rows, k, cv::DataType<float>::type);
+  indices.setTo(-1);
+  flann_->knnSearch(convertQuery(query), indices, distances, k,
+      cv::flann::SearchParams(NUM_CHECKS));
+
+  matches.begin(query.rows);
+  for (int i = 0; i < query.rows; i += 1) {
+    addFlannResults(indices, distances, i, k, i, matches);
+  }
+  matches.end();
+}
+
+void DescriptorIndex::radiusMatch(const cv::Mat& query,
+                                  MatchSink& matches,
+                                  double radius) const {
+  CHECK(flann_ || exact_ || gpu_) << "Index has not been built";
+
+  if (gpu_) {
+    gpu_->radiusMatch(convertQuery(query), matches, radius);
+    return;
+  } else if (!flann_) {
+    exact_->radiusMatch(convertQuery(query), matches, radius);
+    return;
+  }
+
+  cv::Mat converted = convertQuery(query);
+  int max_results = std::max(size(), 1);
+  cv::Mat indices(1, max_results, cv::DataType<int>::type);
+  cv::Mat distances(1, max_results, cv::DataType<float>::type);
+
+  matches.begin(query.rows);
+  for (int i = 0; i < query.rows; i += 1) {
+    indices.setTo(-1);
+    // Results are sorted with the default search parameters.
+    int n = flann_->radiusSearch(converted.row(i), indices, distances,
+        radius * radius, max_results, cv::flann::SearchParams(NUM_CHECKS));
+    addFlannResults(indices, distances, 0, n, i, matches);
+  }
+  matches.end();
+}
+
+void DescriptorIndex::knnMatchBothDirections(const DescriptorIndex& other,
+                                             MatchSink& forward,
+                                             MatchSink& reverse,
+                                             int k) const {
+  if (exact_ && other.exact_) {
+    exact_->knnMatchBothDirections(*other.exact_, forward, reverse, k);
+  } else {
+    other.knnMatch(descriptors(), forward, k);
+    knnMatch(other.descriptors(), reverse, k);
+  }
+}
+
+void DescriptorIndex::radiusMatchBothDirections(const DescriptorIndex& other,
+                                                MatchSink& forward,
+                                                MatchSink& reverse,
+                                                double radius) const {
+  if (exact_ && other.exact_) {
+    exact_->radiusMatchBothDirections(*other.exact_, forward, reverse, radius);
+  } else {
+    other.radiusMatch(descriptors(), forward, radius);
+    radiusMatch(other.descriptors(), reverse, radius);
+  }
+}
+
+void DescriptorIndex::knnMatch(const cv::Mat& query,
+                               std::vector<RawMatchList>& matches,
+                               int k) const {
+  RawMatchListSink sink(matches);
+  knnMatch(query, sink, k);
+}
+
+void DescriptorIndex::radiusMatch(const cv::Mat& query,
+                                  std::vector<RawMatchList>& matches,
+                                  double radius) const {
+  RawMatchListSink sink(matches);
+  radiusMatch(query, sink, radius);
+}
+
+void DescriptorIndex::knnMatchBothDirections(
+    const DescriptorIndex& other,
+    std::vector<RawMatchList>& forward,
+    std::vector<RawMatchList>& reverse,
+    int k) const {
+  RawMatchListSink forward_sink(forward);
+  RawMatchListSink reverse_sink(reverse);
+  knnMatchBothDirections(other, forward_sink, reverse_sink, k);
+}
+
+void DescriptorIndex::radiusMatchBothDirections(
+    const DescriptorIndex& other,
+    std::vector<RawMatchList>& forward,
+    std::vector<RawMatchList>& reverse,
+    double radius) const {
+  RawMatchListSink forward_sink(forward);
+  RawMatchListSink reverse_sink(reverse);
+  radiusMatchBothDirections(other, forward_sink, reverse_sink, radius);
+}
+
+std::string makeDescriptorIndexFilename(const std::string& descriptors_file) {
+  return descriptors_file + INDEX_EXTENSION;
+}
+
+void loadOrBuildDescriptorIndex(const DescriptorMatrix& descriptors,
+                                const std::string& descriptors_file,
+                                DescriptorIndex& index) {
+  std::string filename = makeDescriptorIndexFilename(descriptors_file);
+
+  if (index.load(descriptors, filename)) {
+    DLOG(INFO) << "Loaded index \"" << filename << "\"";
+    return;
+  }
+
+  index.build(descriptors, true);
+  if (!index.save(filename)) {
+    LOG(WARNING) << "Could not save index \"" << filename << "\"";
+  }
+}
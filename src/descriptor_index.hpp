@@ -0,0 +1,118 @@
+#ifndef DESCRIPTOR_INDEX_HPP_
+#define DESCRIPTOR_INDEX_HPP_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <boost/scoped_ptr.hpp>
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+#include <opencv2/flann/flann.hpp>
+#include "descriptor.hpp"
+#include "descriptor_matrix.hpp"
+#include "exact_matcher.hpp"
+#include "gpu_matcher.hpp"
+#include "match_sink.hpp"
+
+// Nearest-neighbour search structure over one set of descriptors.
+//
+// Building a FLANN index costs far more than a query, so build one index per
+// set of descriptors and use it for every query against that set. A FLANN
+// index can also be saved next to its descriptor file and loaded instead of
+// being rebuilt. Without FLANN, the search is exact (see ExactMatcher), and
+// may instead run on a CUDA device (see GpuMatcher).
+//
+// Distances are Euclidean, as reported by cv::DescriptorMatcher. The index
+// shares the data of a DescriptorMatrix. FLANN requires floats, so other
+// types are converted for it, whereas the exact search keeps halves and bytes
+// and widens them as it reads.
+class DescriptorIndex {
+  public:
+    typedef std::vector<cv::DMatch> RawMatchList;
+
+    DescriptorIndex();
+    ~DescriptorIndex();
+
+    void build(const DescriptorMatrix& descriptors, bool use_flann);
+    void build(const std::deque<Descriptor>& descriptors, bool use_flann);
+    // Searches exactly on a CUDA device. Fatal unless built with WITH_GPU.
+    void buildOnGpu(const DescriptorMatrix& descriptors);
+
+    // Loads a FLANN index which was saved for the same descriptors.
+    // Returns false if there is no such file or it was built from other
+    // descriptors, as recorded by a hash of them beside the index.
+    bool load(const DescriptorMatrix& descriptors,
+              const std::string& filename);
+    // Only FLANN indices can be saved. Also saves the hash of the
+    // descriptors.
+    bool save(const std::string& filename) const;
+
+    bool usesFlann() const;
+    bool usesGpu() const;
+    int size() const;
+    // One descriptor per row as floats, for using the set as queries.
+    // Copied unless the descriptors are floats.
+    cv::Mat descriptors() const;
+    cv::Mat descriptors(int begin, int end) const;
+    const DescriptorMatrix& descriptorMatrix() const;
+
+    // Finds the k nearest descriptors to each row, sorted by distance.
+    void knnMatch(const cv::Mat& query, MatchSink& matches, int k) const;
+    // Finds all descriptors within a radius of each row, sorted by distance.
+    void radiusMatch(const cv::Mat& query,
+                     MatchSink& matches,
+                     double radius) const;
+
+    // Matches the descriptors of this index against another and vice versa.
+    // When both searches are exact on the host, every distance is computed
+    // only once.
+    void knnMatchBothDirections(const DescriptorIndex& other,
+                                MatchSink& forward,
+                                MatchSink& reverse,
+                                int k) const;
+    void radiusMatchBothDirections(const DescriptorIndex& other,
+                                   MatchSink& forward,
+                                   MatchSink& reverse,
+                                   double radius) const;
+
+    // Same as above but collect a list of matches for each query.
+    void knnMatch(const cv::Mat& query,
+                  std::vector<RawMatchList>& matches,
+                  int k) const;
+    void radiusMatch(const cv::Mat& query,
+                     std::vector<RawMatchList>& matches,
+                     double radius) const;
+    void knnMatchBothDirections(const DescriptorIndex& other,
+                                std::vector<RawMatchList>& forward,
+                                std::vector<RawMatchList>& reverse,
+                                int k) const;
+    void radiusMatchBothDirections(const DescriptorIndex& other,
+                                   std::vector<RawMatchList>& forward,
+                                   std::vector<RawMatchList>& reverse,
+                                   double radius) const;
+
+  private:
+    // Converts to floats if FLANN is to be used.
+    void setDescriptors(const DescriptorMatrix& descriptors, bool use_flann);
+
+    DescriptorMatrix descriptors_;
+    // Exactly one is not null once built.
+    boost::scoped_ptr<cv::flann::Index> flann_;
+    boost::scoped_ptr<ExactMatcher> exact_;
+    boost::scoped_ptr<GpuMatcher> gpu_;
+
+    // Non-copyable.
+    DescriptorIndex(const DescriptorIndex&);
+    DescriptorIndex& operator=(const DescriptorIndex&);
+};
+
+// File to which the index of a descriptor file is saved.
+std::string makeDescriptorIndexFilename(const std::string& descriptors_file);
+
+// Loads the FLANN index saved next to a descriptor file. If there is none, or
+// it was built from different descriptors, builds the index and saves it.
+void loadOrBuildDescriptorIndex(const DescriptorMatrix& descriptors,
+                                const std::string& descriptors_file,
+                                DescriptorIndex& index);
+
+#endif
@@ -0,0 +1,114 @@
+#include "descriptor_index.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <opencv2/core/core.hpp>
+#include "gtest/gtest.h"
+
+namespace {
+
+const int NUM_DESCRIPTORS = 200;
+const int DIMENSION = 16;
+
+void randomDescriptors(int seed, DescriptorMatrix& descriptors) {
+  descriptors.create(NUM_DESCRIPTORS, DIMENSION, CV_32F);
+  cv::RNG rng(seed);
+  rng.fill(descriptors.mat(), cv::RNG::UNIFORM, 0., 1.);
+}
+
+// Descriptor file in a fresh temporary directory, removed with the fixture.
+class DescriptorIndexTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      char directory[] = "/tmp/descriptor-index-XXXXXX";
+      ASSERT_TRUE(mkdtemp(directory) != NULL);
+      directory_ = directory;
+      descriptors_file_ = directory_ + "/descriptors.yaml";
+      index_file_ = makeDescriptorIndexFilename(descriptors_file_);
+    }
+
+    virtual void TearDown() {
+      std::remove(index_file_.c_str());
+      std::remove((index_file_ + ".source").c_str());
+      rmdir(directory_.c_str());
+    }
+
+    std::string directory_;
+    std::string descriptors_file_;
+    std::string index_file_;
+};
+
+TEST_F(DescriptorIndexTest, LoadsIndexOfSameDescriptors) {
+  DescriptorMatrix descriptors;
+  randomDescriptors(1, descriptors);
+
+  DescriptorIndex built;
+  built.build(descriptors, true);
+  ASSERT_TRUE(built.save(index_file_));
+
+  DescriptorIndex loaded;
+  ASSERT_TRUE(loaded.load(descriptors, index_file_));
+  EXPECT_TRUE(loaded.usesFlann());
+  EXPECT_EQ(NUM_DESCRIPTORS, loaded.size());
+}
+
+TEST_F(DescriptorIndexTest, MissingIndexIsNotLoaded) {
+  DescriptorMatrix descriptors;
+  randomDescriptors(1, descriptors);
+
+  DescriptorIndex index;
+  EXPECT_FALSE(index.load(descriptors, index_file_));
+}
+
+// Descriptors of the same size and length, as after a new PCA projection,
+// must not reuse the index of the old ones.
+TEST_F(DescriptorIndexTest, RejectsIndexOfOtherDescriptors) {
+  DescriptorMatrix old_descriptors;
+  randomDescriptors(1, old_descriptors);
+  DescriptorIndex built;
+  built.build(old_descriptors, true);
+  ASSERT_TRUE(built.save(index_file_));
+
+  DescriptorMatrix new_descriptors;
+  randomDescriptors(2, new_descriptors);
+  DescriptorIndex loaded;
+  EXPECT_FALSE(loaded.load(new_descriptors, index_file_));
+
+  // A change to a single element is enough.
+  DescriptorMatrix changed;
+  randomDescriptors(1, changed);
+  changed.mat().at<float>(NUM_DESCRIPTORS - 1, DIMENSION - 1) += 1;
+  EXPECT_FALSE(loaded.load(changed, index_file_));
+}
+
+TEST_F(DescriptorIndexTest, RejectsIndexWithoutHash) {
+  DescriptorMatrix descriptors;
+  randomDescriptors(1, descriptors);
+  DescriptorIndex built;
+  built.build(descriptors, true);
+  ASSERT_TRUE(built.save(index_file_));
+  ASSERT_EQ(0, std::remove((index_file_ + ".source").c_str()));
+
+  DescriptorIndex loaded;
+  EXPECT_FALSE(loaded.load(descriptors, index_file_));
+}
+
+TEST_F(DescriptorIndexTest, RebuildsStaleIndex) {
+  DescriptorMatrix old_descriptors;
+  randomDescriptors(1, old_descriptors);
+  DescriptorIndex index;
+  loadOrBuildDescriptorIndex(old_descriptors, descriptors_file_, index);
+
+  DescriptorMatrix new_descriptors;
+  randomDescriptors(2, new_descriptors);
+  DescriptorIndex rebuilt;
+  loadOrBuildDescriptorIndex(new_descriptors, descriptors_file_, rebuilt);
+
+  // The index was saved again for the new descriptors.
+  DescriptorIndex loaded;
+  EXPECT_TRUE(loaded.load(new_descriptors, index_file_));
+  EXPECT_FALSE(loaded.load(old_descriptors, index_file_));
+}
+
+}
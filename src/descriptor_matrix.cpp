@@ -0,0 +1,256 @@
+#include "descriptor_matrix.hpp"
+#include <cstdlib>
+#include <algorithm>
+#include <boost/checked_delete.hpp>
+#include <glog/logging.h>
+#include "fixed_descriptor.hpp"
+
+namespace {
+
+bool isDescriptorType(int type) {
+  return type == CV_32F || type == DescriptorMatrix::HALF_TYPE ||
+      type == CV_8U;
+}
+
+template<class T>
+void copyDescriptors(const std::deque<Descriptor>& list,
+                     DescriptorMatrix& matrix) {
+  int num_descriptors = list.size();
+
+  for (int i = 0; i < num_descriptors; i += 1) {
+    const Descriptor::Data& data = list[i].data;
+    CHECK(int(data.size()) == matrix.cols()) << "Descriptors differ in size";
+
+    T* row = matrix.row<T>(i);
+    for (int j = 0; j < matrix.cols(); j += 1) {
+      row[j] = descriptorElement<T>(data[j]);
+    }
+  }
+}
+
+template<class T>
+void widenRows(const DescriptorMatrix& src, int begin, int end, cv::Mat& dst) {
+  int cols = src.cols();
+  for (int i = begin; i < end; i += 1) {
+    const T* in = src.row<T>(i);
+    float* out = dst.ptr<float>(i - begin);
+    for (int j = 0; j < cols; j += 1) {
+      out[j] = float(in[j]);
+    }
+  }
+}
+
+// Rows of src are floats.
+void narrowRowsToHalf(const cv::Mat& src, DescriptorMatrix& dst) {
+  for (int i = 0; i < src.rows; i += 1) {
+    const float* in = src.ptr<float>(i);
+    HalfFloat* out = dst.row<HalfFloat>(i);
+    for (int j = 0; j < src.cols; j += 1) {
+      out[j] = HalfFloat(in[j]);
+    }
+  }
+}
+
+template<class T>
+void computeRowNorms(const DescriptorMatrix& matrix, float* norms) {
+  Dimension<DYNAMIC_DIMENSION> dimension(matrix.cols());
+  for (int i = 0; i < matrix.rows(); i += 1) {
+    const T* row = matrix.row<T>(i);
+    norms[i] = dot(dimension, row, row);
+  }
+}
+
+}
+
+const int DescriptorMatrix::ALIGNMENT;
+
+const int DescriptorMatrix::HALF_TYPE;
+
+DescriptorMatrix::DescriptorMatrix() : data_(), header_(), norms_() {}
+
+DescriptorMatrix::DescriptorMatrix(int rows, int cols, int type)
+    : data_(), header_(), norms_() {
+  create(rows, cols, type);
+}
+
+DescriptorMatrix::DescriptorMatrix(int rows,
+                                   int cols,
+                                   int type,
+                                   const boost::shared_ptr<void>& data)
+    : data_(data), header_(), norms_() {
+  CHECK(isDescriptorType(type)) << "Unsupported descriptor type";
+  CHECK(rows >= 0 && cols > 0);
+  CHECK(data);
+  CHECK(reinterpret_cast<size_t>(data.get()) % ALIGNMENT == 0) <<
+      "Descriptor data is not aligned";
+
+  header_ = cv::Mat(rows, cols, type, data.get(), cols * CV_ELEM_SIZE(type));
+}
+
+void DescriptorMatrix::create(int rows, int cols, int type) {
+  CHECK(isDescriptorType(type)) << "Unsupported descriptor type";
+  CHECK(rows >= 0 && cols > 0);
+  // The rows are about to be written.
+  norms_.reset();
+
+  if (data_ && header_.rows == rows && header_.cols == cols &&
+      header_.type() == type) {
+    return;
+  }
+
+  size_t step = cols * CV_ELEM_SIZE(type);
+  void* data = NULL;
+  // Allocate at least one row so that the pointer is never null.
+  size_t size = std::max(rows, 1) * step;
+  CHECK(posix_memalign(&data, ALIGNMENT, size) == 0) <<
+      "Could not allocate " << size << " bytes";
+
+  data_.reset(data, std::free);
+  header_ = cv::Mat(rows, cols, type, data, step);
+}
+
+void DescriptorMatrix::release() {
+  header_ = cv::Mat();
+  data_.reset();
+  norms_.reset();
+}
+
+DescriptorMatrix DescriptorMatrix::clone() const {
+  DescriptorMatrix copy;
+  if (!data_) {
+    return copy;
+  }
+
+  copy.create(rows(), cols(), type());
+  cv::Mat header = copy.header_;
+  header_.copyTo(header);
+  DCHECK(header.data == copy.header_.data);
+
+  if (norms_) {
+    float* norms = new float[std::max(rows(), 1)];
+    std::copy(norms_.get(), norms_.get() + rows(), norms);
+    copy.norms_.reset(norms, boost::checked_array_deleter<float>());
+  }
+  return copy;
+}
+
+bool DescriptorMatrix::empty() const {
+  return header_.rows == 0;
+}
+
+int DescriptorMatrix::rows() const {
+  return header_.rows;
+}
+
+int DescriptorMatrix::cols() const {
+  return header_.cols;
+}
+
+int DescriptorMatrix::type() const {
+  return header_.type();
+}
+
+cv::Mat DescriptorMatrix::mat() {
+  return header_;
+}
+
+const cv::Mat& DescriptorMatrix::mat() const {
+  return header_;
+}
+
+cv::Mat DescriptorMatrix::toFloat(int begin, int end, cv::Mat& buffer) const {
+  CHECK(0 <= begin && begin <= end && end <= rows());
+  if (type() == cv::DataType<float>::type) {
+    return header_.rowRange(begin, end);
+  }
+
+  int n = end - begin;
+  if (buffer.type() != cv::DataType<float>::type || buffer.cols != cols() ||
+      buffer.rows < n || !buffer.isContinuous()) {
+    buffer.create(n, cols(), cv::DataType<float>::type);
+  }
+  cv::Mat rows = buffer.rowRange(0, n);
+
+  if (type() == HALF_TYPE) {
+    widenRows<HalfFloat>(*this, begin, end, rows);
+  } else {
+    widenRows<uchar>(*this, begin, end, rows);
+  }
+  return rows;
+}
+
+cv::Mat DescriptorMatrix::toFloat() const {
+  cv::Mat buffer;
+  return toFloat(0, rows(), buffer);
+}
+
+void DescriptorMatrix::computeNorms() {
+  // At least one, so that the pointer is never null.
+  float* norms = new float[std::max(rows(), 1)];
+  norms_.reset(norms, boost::checked_array_deleter<float>());
+  if (type() == cv::DataType<float>::type) {
+    computeRowNorms<float>(*this, norms);
+  } else if (type() == HALF_TYPE) {
+    computeRowNorms<HalfFloat>(*this, norms);
+  } else {
+    computeRowNorms<uchar>(*this, norms);
+  }
+}
+
+void DescriptorMatrix::setNorms(const boost::shared_ptr<const float>& norms) {
+  CHECK(norms);
+  norms_ = norms;
+}
+
+bool DescriptorMatrix::hasNorms() const {
+  return bool(norms_);
+}
+
+const float* DescriptorMatrix::norms() const {
+  CHECK(hasNorms()) << "Norms have not been computed";
+  return norms_.get();
+}
+
+void listToMatrix(const std::deque<Descriptor>& list,
+                  DescriptorMatrix& matrix,
+                  int type) {
+  CHECK(!list.empty());
+  matrix.create(list.size(), list.front().data.size(), type);
+
+  if (type == CV_8U) {
+    copyDescriptors<uchar>(list, matrix);
+  } else if (type == DescriptorMatrix::HALF_TYPE) {
+    copyDescriptors<HalfFloat>(list, matrix);
+  } else {
+    copyDescriptors<float>(list, matrix);
+  }
+  matrix.computeNorms();
+}
+
+void copyToDescriptorMatrix(const cv::Mat& src,
+                            DescriptorMatrix& dst,
+                            int type) {
+  CHECK(src.channels() == 1);
+  dst.create(src.rows, src.cols, type);
+  if (type == DescriptorMatrix::HALF_TYPE) {
+    cv::Mat floats = src;
+    if (src.type() != cv::DataType<float>::type) {
+      src.convertTo(floats, cv::DataType<float>::type);
+    }
+    narrowRowsToHalf(floats, dst);
+  } else {
+    cv::Mat header = dst.mat();
+    src.convertTo(header, type);
+  }
+  dst.computeNorms();
+}
+
+void copyToDescriptorMatrix(const DescriptorMatrix& src,
+                            DescriptorMatrix& dst,
+                            int type) {
+  if (src.type() == DescriptorMatrix::HALF_TYPE) {
+    copyToDescriptorMatrix(src.toFloat(), dst, type);
+  } else {
+    copyToDescriptorMatrix(src.mat(), dst, type);
+  }
+}
@@ -0,0 +1,123 @@
+#ifndef DESCRIPTOR_MATRIX_HPP_
+#define DESCRIPTOR_MATRIX_HPP_
+
+#include <deque>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <opencv2/core/core.hpp>
+#include "descriptor.hpp"
+#include "half_float.hpp"
+
+// A set of descriptors stored as one contiguous row-major matrix.
+//
+// Elements are 32-bit floats, half floats (HalfFloat, in a CV_16U matrix) or
+// bytes for descriptors such as SIFT which have been quantized. The data
+// starts on a 64-byte boundary, and rows are not padded so that the matrix is
+// continuous as FLANN requires. 128-dimensional descriptors therefore start
+// every row on a cache line, or every other line for halves and bytes.
+//
+// The squared norm of each row may be stored beside the elements, for
+// distances computed as |a|^2 + |b|^2 - 2 a.b. They are computed from the
+// elements as stored, or mapped from a file with them, and are not updated if
+// the rows are written to.
+//
+// Copies share data, like cv::Mat.
+class DescriptorMatrix {
+  public:
+    static const int ALIGNMENT = 64;
+    // Type of half-precision matrices.
+    static const int HALF_TYPE = CV_16U;
+
+    DescriptorMatrix();
+    DescriptorMatrix(int rows, int cols, int type = CV_32F);
+    // Uses existing data, such as a mapped file, which must be aligned.
+    DescriptorMatrix(int rows,
+                     int cols,
+                     int type,
+                     const boost::shared_ptr<void>& data);
+
+    // Allocates new data unless the size and type are the same.
+    void create(int rows, int cols, int type = CV_32F);
+    void release();
+    // Copies the rows and norms into new data, which is not shared. Pages of
+    // a mapped file are wherever the page cache put them, whereas a copy is
+    // in the memory of the thread which writes it.
+    DescriptorMatrix clone() const;
+
+    bool empty() const;
+    int rows() const;
+    int cols() const;
+    // CV_32F, HALF_TYPE or CV_8U.
+    int type() const;
+
+    // Returns a header for the data, which is not copied.
+    // Half-precision data must not be converted with cv::Mat::convertTo().
+    cv::Mat mat();
+    const cv::Mat& mat() const;
+
+    template<class T> T* row(int i);
+    template<class T> const T* row(int i) const;
+
+    // Returns rows [begin, end) as floats. Float rows are not copied, others
+    // are widened into the buffer, which is re-used if it is large enough.
+    cv::Mat toFloat(int begin, int end, cv::Mat& buffer) const;
+    // Returns every row as floats, copying unless they are floats.
+    cv::Mat toFloat() const;
+
+    // Computes and stores the squared norm of every row.
+    void computeNorms();
+    // Uses norms which were computed before, one per row, such as those
+    // mapped from a file.
+    void setNorms(const boost::shared_ptr<const float>& norms);
+    bool hasNorms() const;
+    // One per row.
+    const float* norms() const;
+
+  private:
+    boost::shared_ptr<void> data_;
+    cv::Mat header_;
+    boost::shared_ptr<const float> norms_;
+};
+
+// Converts a value to an element of a descriptor, rounding and saturating
+// bytes and rounding halves.
+template<class T> T descriptorElement(double x);
+
+// Copies a list of descriptors into a matrix and computes its norms.
+void listToMatrix(const std::deque<Descriptor>& list,
+                  DescriptorMatrix& matrix,
+                  int type = CV_32F);
+
+// Converts a matrix of descriptor rows, which may be of any depth but holds
+// values rather than half floats, and computes the norms of the result.
+// Values are rounded and saturated when converting to bytes.
+void copyToDescriptorMatrix(const cv::Mat& src, DescriptorMatrix& dst,
+                            int type = CV_32F);
+// Converts between any of the types of descriptor matrix.
+void copyToDescriptorMatrix(const DescriptorMatrix& src,
+                            DescriptorMatrix& dst,
+                            int type = CV_32F);
+
+////////////////////////////////////////////////////////////////////////////////
+
+template<class T>
+T* DescriptorMatrix::row(int i) {
+  return header_.ptr<T>(i);
+}
+
+template<class T>
+const T* DescriptorMatrix::row(int i) const {
+  return header_.ptr<T>(i);
+}
+
+template<class T>
+T descriptorElement(double x) {
+  return cv::saturate_cast<T>(x);
+}
+
+template<>
+inline HalfFloat descriptorElement<HalfFloat>(double x) {
+  return HalfFloat(float(x));
+}
+
+#endif
@@ -0,0 +1,81 @@
+#include "descriptor_matrix_reader.hpp"
+#include <glog/logging.h>
+
+namespace {
+
+template<class T>
+bool readRow(const cv::FileNode& node, T* row, int cols) {
+  const cv::FileNode& list = node["list"];
+  if (list.type() != cv::FileNode::SEQ || int(list.size()) != cols) {
+    LOG(WARNING) << "Expected descriptor of length " << cols;
+    return false;
+  }
+
+  cv::FileNodeIterator it = list.begin();
+  for (int j = 0; j < cols; j += 1) {
+    row[j] = descriptorElement<T>(double(*it));
+    ++it;
+  }
+
+  return true;
+}
+
+template<class T>
+bool readRows(const cv::FileNode& list, DescriptorMatrix& matrix) {
+  int i = 0;
+  for (cv::FileNodeIterator it = list.begin(); it != list.end(); ++it) {
+    if (!readRow(*it, matrix.row<T>(i), matrix.cols())) {
+      return false;
+    }
+    i += 1;
+  }
+
+  return true;
+}
+
+}
+
+DescriptorMatrixReader::DescriptorMatrixReader(int type) : type_(type) {}
+
+DescriptorMatrixReader::~DescriptorMatrixReader() {}
+
+bool DescriptorMatrixReader::read(const cv::FileNode& node,
+                                  DescriptorMatrix& matrix) {
+  if (node.type() != cv::FileNode::MAP) {
+    LOG(WARNING) << "Expected file node to be a map";
+    return false;
+  }
+
+  const cv::FileNode& list = node["list"];
+  if (list.type() != cv::FileNode::SEQ) {
+    LOG(WARNING) << "Expected file node to be a sequence";
+    return false;
+  }
+
+  int rows = list.size();
+  if (rows == 0) {
+    matrix.release();
+    return true;
+  }
+
+  // Take the dimension from the first descriptor.
+  int cols = (*list.begin())["list"].size();
+  if (cols == 0) {
+    LOG(WARNING) << "Empty descriptor";
+    return false;
+  }
+  matrix.create(rows, cols, type_);
+
+  bool ok;
+  if (type_ == CV_8U) {
+    ok = readRows<uchar>(list, matrix);
+  } else if (type_ == DescriptorMatrix::HALF_TYPE) {
+    ok = readRows<HalfFloat>(list, matrix);
+  } else {
+    ok = readRows<float>(list, matrix);
+  }
+  if (ok) {
+    matrix.computeNorms();
+  }
+  return ok;
+}
@@ -0,0 +1,19 @@
+#ifndef DESCRIPTOR_MATRIX_READER_HPP_
+#define DESCRIPTOR_MATRIX_READER_HPP_
+
+#include "descriptor_matrix.hpp"
+#include "reader.hpp"
+
+// Reads a list of descriptors, as written by DescriptorWriter, straight into a
+// matrix. Avoids constructing a Descriptor for every row.
+class DescriptorMatrixReader : public Reader<DescriptorMatrix> {
+  public:
+    explicit DescriptorMatrixReader(int type = CV_32F);
+    ~DescriptorMatrixReader();
+    bool read(const cv::FileNode& node, DescriptorMatrix& matrix);
+
+  private:
+    int type_;
+};
+
+#endif
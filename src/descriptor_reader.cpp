@@ -9,3 +9,15 @@ bool DescriptorReader::read(const cv::FileNode& node, Descriptor& descriptor) {
   InlineDefaultReader<double> reader;
   return readSequence(node, reader, std::back_inserter(descriptor.data));
 }
+
+bool DescriptorReader::fields(std::vector<std::string>& keys) const {
+  keys.assign(1, "list");
+  return true;
+}
+
+bool DescriptorReader::readFields(const FieldValues& values,
+                                  Descriptor& descriptor) {
+  const double* begin = values.begin(0);
+  descriptor.data.assign(begin, begin + values.size(0));
+  return true;
+}
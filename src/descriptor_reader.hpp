@@ -8,6 +8,8 @@ class DescriptorReader : public Reader<Descriptor> {
   public:
     ~DescriptorReader();
     bool read(const cv::FileNode& node, Descriptor& descriptor);
+    bool fields(std::vector<std::string>& keys) const;
+    bool readFields(const FieldValues& values, Descriptor& descriptor);
 };
 
 #endif
@@ -1,5 +1,7 @@
 #include "descriptor_writer.hpp"
 #include <boost/bind.hpp>
+#include <glog/logging.h>
+#include "descriptor_matrix.hpp"
 
 namespace {
 
@@ -9,15 +11,36 @@ bool writeToFile(cv::FileStorage& file, const T& x) {
   return true;
 }
 
+// Rounds to an element of the type, then writes it.
+template<typename T>
+bool writeRounded(cv::FileStorage& file, const double& x) {
+  return writeToFile<double>(file, double(descriptorElement<T>(x)));
+}
+
+}
+
+DescriptorWriter::DescriptorWriter(int type) : type_(type) {
+  CHECK(type == CV_32F || type == DescriptorMatrix::HALF_TYPE ||
+      type == CV_8U) << "Unknown descriptor type";
 }
 
 DescriptorWriter::~DescriptorWriter() {}
 
 void DescriptorWriter::write(cv::FileStorage& file,
                              const Descriptor& descriptor) {
+  bool (*write_element)(cv::FileStorage&, const double&);
+  if (type_ == CV_8U) {
+    write_element = writeRounded<uchar>;
+  } else if (type_ == DescriptorMatrix::HALF_TYPE) {
+    write_element = writeRounded<HalfFloat>;
+  } else {
+    // Floats are written as they are, as they always were.
+    write_element = writeToFile<double>;
+  }
+
   file << "list";
   file << "[:";
   std::for_each(descriptor.data.begin(), descriptor.data.end(),
-      boost::bind(writeToFile<double>, boost::ref(file), _1));
+      boost::bind(write_element, boost::ref(file), _1));
   file << "]";
 }
@@ -1,13 +1,20 @@
 #ifndef DESCRIPTOR_WRITER_HPP_
 #define DESCRIPTOR_WRITER_HPP_
 
+#include <opencv2/core/core.hpp>
 #include "descriptor.hpp"
 #include "writer.hpp"
 
+// Writes the elements of descriptors rounded to a type of DescriptorMatrix,
+// so that text files hold the values which a binary file of that type would.
 class DescriptorWriter : public Writer<Descriptor> {
   public:
+    explicit DescriptorWriter(int type = CV_32F);
     ~DescriptorWriter();
     void write(cv::FileStorage& file, const Descriptor& descriptor);
+
+  private:
+    int type_;
 };
 
 #endif
@@ -8,21 +8,9 @@ SiftPosition keypointToSiftPosition(const cv::KeyPoint& keypoint) {
   return SiftPosition(keypoint.pt.x, keypoint.pt.y, keypoint.size, theta);
 }
 
-void extractFeatures(const cv::Mat& image,
-                     std::vector<SiftFeature>& features,
-                     const SiftOptions& options) {
-  // Clear list.
-  features.clear();
-
-  // SIFT settings.
-  cv::SIFT sift(options.max_num_features, options.num_octave_layers,
-      options.contrast_threshold, options.edge_threshold, options.sigma);
-
-  // Extract SIFT keypoints and descriptors.
-  std::vector<cv::KeyPoint> keypoints;
-  cv::Mat descriptors;
-  sift(image, cv::noArray(), keypoints, descriptors, false);
-
+void keypointsToFeatures(const std::vector<cv::KeyPoint>& keypoints,
+                         const cv::Mat& descriptors,
+                         std::vector<SiftFeature>& features) {
   // Ensure that descriptors are 32-bit floats.
   CHECK(descriptors.type() == cv::DataType<float>::type);
 
@@ -43,3 +31,71 @@ void extractFeatures(const cv::Mat& image,
     features.push_back(feature);
   }
 }
+
+void extractFeatures(const cv::Mat& image,
+                     std::vector<SiftFeature>& features,
+                     const SiftOptions& options) {
+  std::vector<double> contrasts;
+  extractFeatures(image, features, contrasts, options);
+}
+
+void extractFeatures(const cv::Mat& image,
+                     std::vector<SiftFeature>& features,
+                     std::vector<double>& contrasts,
+                     const SiftOptions& options) {
+  // Clear lists.
+  features.clear();
+  contrasts.clear();
+
+  // SIFT settings.
+  cv::SIFT sift(options.max_num_features, options.num_octave_layers,
+      options.contrast_threshold, options.edge_threshold, options.sigma);
+
+  // Extract SIFT keypoints and descriptors.
+  std::vector<cv::KeyPoint> keypoints;
+  cv::Mat descriptors;
+  sift(image, cv::noArray(), keypoints, descriptors, false);
+
+  keypointsToFeatures(keypoints, descriptors, features);
+
+  // cv::SIFT keeps an extremum if its response times the number of layers
+  // reaches the threshold.
+  std::vector<cv::KeyPoint>::const_iterator keypoint;
+  for (keypoint = keypoints.begin(); keypoint != keypoints.end(); ++keypoint) {
+    contrasts.push_back(keypoint->response * options.num_octave_layers);
+  }
+}
+
+void extractFeatures(const SiftPyramid& pyramid,
+                     std::vector<SiftFeature>& features,
+                     const SiftOptions& options) {
+  CHECK(pyramid.numOctaveLayers() == options.num_octave_layers) <<
+      "Pyramid has " << pyramid.numOctaveLayers() << " layers per octave";
+  CHECK(pyramid.sigma() == options.sigma) << "Pyramid has sigma " <<
+      pyramid.sigma();
+
+  // Clear list.
+  features.clear();
+
+  // SIFT settings.
+  cv::SIFT sift(options.max_num_features, options.num_octave_layers,
+      options.contrast_threshold, options.edge_threshold, options.sigma);
+
+  // Find extrema of the difference of Gaussians, as cv::SIFT does.
+  std::vector<cv::Mat> dog_pyramid;
+  sift.buildDoGPyramid(pyramid.levels(), dog_pyramid);
+  std::vector<cv::KeyPoint> keypoints;
+  sift.findScaleSpaceExtrema(pyramid.levels(), dog_pyramid, keypoints);
+  cv::KeyPointsFilter::removeDuplicated(keypoints);
+  if (options.max_num_features > 0) {
+    cv::KeyPointsFilter::retainBest(keypoints, options.max_num_features);
+  }
+
+  // Note: This is not part of the API. Manually exposed by modifying OpenCV.
+  // Tested with OpenCV 2.4.1 only.
+  cv::Mat descriptors = cv::Mat_<float>(keypoints.size(), 128);
+  cv::calcSiftDescriptors(pyramid.levels(), keypoints, descriptors,
+      options.num_octave_layers);
+
+  keypointsToFeatures(keypoints, descriptors, features);
+}
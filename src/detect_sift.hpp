@@ -4,6 +4,7 @@
 #include <opencv2/core/core.hpp>
 #include <vector>
 #include "sift_feature.hpp"
+#include "sift_pyramid.hpp"
 
 struct SiftOptions {
   int max_num_features;
@@ -17,4 +18,23 @@ void extractFeatures(const cv::Mat& image,
                      std::vector<SiftFeature>& features,
                      const SiftOptions& options);
 
+// Also returns the contrast of each feature, in the units of
+// contrast_threshold. The features which a higher threshold would keep are
+// approximately those whose contrast reaches it. Detection at a higher
+// threshold also discards some of them before refining their position.
+void extractFeatures(const cv::Mat& image,
+                     std::vector<SiftFeature>& features,
+                     std::vector<double>& contrasts,
+                     const SiftOptions& options);
+
+// Detects features in a pyramid which was built for the image, and extracts
+// their descriptors from it, so that the pyramid can be shared with later
+// extraction. The pyramid must have the layers and sigma of the options.
+//
+// Unlike cv::SIFT, which doubles the image first, the pyramid starts at the
+// original resolution, so fewer of the smallest features are found.
+void extractFeatures(const SiftPyramid& pyramid,
+                     std::vector<SiftFeature>& features,
+                     const SiftOptions& options);
+
 #endif
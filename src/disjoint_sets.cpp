@@ -0,0 +1,85 @@
+#include "disjoint_sets.hpp"
+#include <algorithm>
+#include <glog/logging.h>
+
+DisjointSets::DisjointSets() : parents_(), sizes_(), num_sets_(0) {}
+
+void DisjointSets::grow(int n) {
+  int m = parents_.size();
+  if (n <= m) {
+    return;
+  }
+
+  parents_.resize(n);
+  sizes_.resize(n, 1);
+  for (int x = m; x < n; x += 1) {
+    parents_[x] = x;
+  }
+  num_sets_ += n - m;
+}
+
+int DisjointSets::size() const {
+  return parents_.size();
+}
+
+int DisjointSets::numSets() const {
+  return num_sets_;
+}
+
+int DisjointSets::find(int x) {
+  CHECK(0 <= x && x < size());
+  while (parents_[x] != x) {
+    // Point every other element on the path at its grandparent.
+    parents_[x] = parents_[parents_[x]];
+    x = parents_[x];
+  }
+  return x;
+}
+
+bool DisjointSets::join(int x, int y) {
+  x = find(x);
+  y = find(y);
+  if (x == y) {
+    return false;
+  }
+
+  // Hang the smaller tree from the larger.
+  if (sizes_[x] < sizes_[y]) {
+    std::swap(x, y);
+  }
+  parents_[y] = x;
+  sizes_[x] += sizes_[y];
+  num_sets_ -= 1;
+  return true;
+}
+
+int DisjointSets::label(std::vector<int>& labels) {
+  int n = size();
+  labels.assign(n, -1);
+  // Label of each representative.
+  std::vector<int> roots(n, -1);
+
+  int num_labels = 0;
+  for (int x = 0; x < n; x += 1) {
+    int root = find(x);
+    if (roots[root] < 0) {
+      roots[root] = num_labels;
+      num_labels += 1;
+    }
+    labels[x] = roots[root];
+  }
+
+  return num_labels;
+}
+
+void DisjointSets::clear() {
+  parents_.clear();
+  sizes_.clear();
+  num_sets_ = 0;
+}
+
+void DisjointSets::swap(DisjointSets& other) {
+  parents_.swap(other.parents_);
+  sizes_.swap(other.sizes_);
+  std::swap(num_sets_, other.num_sets_);
+}
@@ -0,0 +1,40 @@
+#ifndef DISJOINT_SETS_HPP_
+#define DISJOINT_SETS_HPP_
+
+#include <vector>
+
+// A partition of the elements [0, size()) into disjoint sets.
+//
+// Finds the connected components of a graph from a stream of its edges with
+// memory proportional to the number of vertices. Union by size with path
+// halving.
+class DisjointSets {
+  public:
+    DisjointSets();
+
+    // Adds singletons until there are n elements.
+    void grow(int n);
+    int size() const;
+    int numSets() const;
+
+    // Returns the representative of the set which contains x.
+    int find(int x);
+    // Merges the sets which contain x and y.
+    // Returns false if they were already the same.
+    bool join(int x, int y);
+
+    // Labels every element with the index of its set. Sets are numbered in
+    // order of their first element. Returns the number of sets.
+    int label(std::vector<int>& labels);
+
+    void clear();
+    void swap(DisjointSets& other);
+
+  private:
+    std::vector<int> parents_;
+    // Number of elements in each set, at its representative.
+    std::vector<int> sizes_;
+    int num_sets_;
+};
+
+#endif
@@ -31,7 +31,7 @@ struct State {
   cv::Point2d* point;
   int* selected_view;
   const std::vector<Camera>* cameras;
-  std::map<double, cv::Point3d>* points;
+  QuantizedRay* points;
 };
 
 struct Params {
@@ -143,7 +143,7 @@ int main(int argc, char** argv) {
   bool have_point = false;
   cv::Point2d point;
   int selected_view = 0;
-  std::map<double, cv::Point3d> points;
+  QuantizedRay points;
 
   // Program state for use by event handlers.
   State state;
@@ -197,7 +197,7 @@ int main(int argc, char** argv) {
               FLAGS_thickness);
         } else {
           // Show line in other images.
-          std::map<double, cv::Point3d>::const_iterator point;
+          QuantizedRay::const_iterator point;
           for (point = points.begin(); point != points.end(); ++point) {
             int thickness = std::max(1, int(FLAGS_thickness / 2.));
 
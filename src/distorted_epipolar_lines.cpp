@@ -1,11 +1,14 @@
 #include "distorted_epipolar_lines.hpp"
+#include <algorithm>
+#include <cmath>
 #include <set>
 #include <stack>
 #include <numeric>
 #include <utility>
-#include <boost/bind.hpp>
+#include <glog/logging.h>
 #include "distortion.hpp"
 #include "util.hpp"
+#include "util/thread-pool.hpp"
 
 struct ComparePoints {
   bool operator()(const cv::Point& p, const cv::Point& q);
@@ -79,30 +82,20 @@ bool fourConnected(const cv::Point2d& p, const cv::Point2d& q) {
   return connected;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-
-DistortedEpipolarRasterizer::DistortedEpipolarRasterizer(
-    const CameraProperties& camera,
-    const cv::Matx33d& F) : camera_(&camera), F_(F) {}
-
-void DistortedEpipolarRasterizer::init() {
-  // Get the four points at the bounds of image 2.
+// Returns the radius of the circle in the calibrated, undistorted image which
+// contains the image.
+double maxUndistortedRadius(const CameraProperties& camera) {
+  // Get the four points at the bounds of the image.
   std::vector<cv::Point2d> corners;
-  int w = camera_->image_size.width;
-  int h = camera_->image_size.width;
+  int w = camera.image_size.width;
+  int h = camera.image_size.height;
   corners.push_back(cv::Point2d(    0,     0));
   corners.push_back(cv::Point2d(w - 1,     0));
   corners.push_back(cv::Point2d(    0, h - 1));
   corners.push_back(cv::Point2d(w - 1, h - 1));
 
-  // Convert to homogeneous co-ordinates.
-  cv::Mat X;
-  imagePointsToHomogeneous(corners, X);
   // Undo intrinsics.
-  cv::Mat K2(camera_->matrix());
-  X = K2.inv() * X;
-  // Convert back to inhomogeneous co-ordinates.
-  imagePointsFromHomogeneous(X, corners);
+  camera.calibrate(corners, corners);
 
   // Find radius of each distorted point.
   std::vector<double> lengths;
@@ -114,40 +107,35 @@ void DistortedEpipolarRasterizer::init() {
       std::max<double>);
 
   // Check if corner radius exceeds maximum radius.
-  double max_distorted_radius = 0.99 * maxDistortedRadius(camera_->distort_w);
+  double max_distorted_radius = 0.99 * maxDistortedRadius(camera.distort_w);
   if (distorted_radius > max_distorted_radius) {
     LOG(WARNING) << "Clipping radius from " << distorted_radius << " to " <<
         max_distorted_radius;
     distorted_radius = max_distorted_radius;
   }
 
-  radius_ = undistortRadius(distorted_radius, camera_->distort_w);
-}
-
-bool notInside(const cv::Point& pixel, const cv::Rect& bounds) {
-  return !bounds.contains(pixel);
+  return undistortRadius(distorted_radius, camera.distort_w);
 }
 
-// x1 must be undistorted.
-void DistortedEpipolarRasterizer::compute(const cv::Point2d& x1,
-                                          std::vector<cv::Point>& line) const {
+// Rasterizes a line in the calibrated, undistorted second image, from one
+// edge of the circle of the given radius to the other. Only pixels in the
+// mask are kept.
+void rasterizeLine(const cv::Vec3d& e,
+                   const CameraProperties& camera,
+                   const UndistortableMask& mask,
+                   double radius,
+                   std::vector<cv::Point>& line) {
   typedef std::pair<double, double> Interval;
 
   // Maintain vector to preserve ordering of epipolar line.
   PixelSet pixels;
   line.clear();
 
-  // Find co-ordinates of epipolar line. Given an uncalibrated point in image 1,
-  // we want an equation for the calibrated point in image 2.
-  cv::Mat K2(camera_->matrix());
-  cv::Mat X1 = imagePointToHomogeneous(x1);
-  cv::Mat e = K2.t() * F_ * X1;
-  // May as well normalize for numeric nicety.
-  e = e / cv::norm(e);
+  cv::Matx33d K2 = camera.matrix();
 
   // Find intersections.
-  std::vector<cv::Point2d> roots = lineCircleIntersection(radius_,
-      e.at<double>(0, 0), e.at<double>(1, 0), e.at<double>(2, 0));
+  std::vector<cv::Point2d> roots = lineCircleIntersection(radius,
+      e[0], e[1], e[2]);
 
   if (roots.size() == 2) {
     const cv::Point2d& a = roots[0];
@@ -166,15 +154,15 @@ void DistortedEpipolarRasterizer::compute(const cv::Point2d& x1,
       cv::Point2d u = (1 - s) * a + s * b;
       cv::Point2d v = (1 - t) * a + t * b;
       // Apply distortion.
-      u = distort(u, camera_->distort_w);
-      v = distort(v, camera_->distort_w);
+      u = distort(u, camera.distort_w);
+      v = distort(v, camera.distort_w);
       // Apply intrinsics.
-      u = imagePointFromHomogeneous(K2 * imagePointToHomogeneous(u));
-      v = imagePointFromHomogeneous(K2 * imagePointToHomogeneous(v));
+      cv::Vec3d U = K2 * cv::Vec3d(u.x, u.y, 1);
+      cv::Vec3d V = K2 * cv::Vec3d(v.x, v.y, 1);
 
       // Quantize to pixels.
-      cv::Point p = u;
-      cv::Point q = v;
+      cv::Point p = cv::Point2d(U[0] / U[2], U[1] / U[2]);
+      cv::Point q = cv::Point2d(V[0] / V[2], V[1] / V[2]);
 
       // Add to line.
       if (pixels.find(p) == pixels.end()) {
@@ -195,12 +183,201 @@ void DistortedEpipolarRasterizer::compute(const cv::Point2d& x1,
     }
   }
 
-  // Remove pixels which are not inside the image.
-  cv::Rect bounds(cv::Point(0, 0), camera_->image_size);
+  // Remove pixels which are not inside the image and its undistortable
+  // region.
+  mask.filter(line);
+}
+
+// Rasterizes the lines of a list of angles.
+// For use with ThreadPool::parallelFor().
+class RasterizeAngleFunction {
+  public:
+    RasterizeAngleFunction(const DistortedEpipolarLineIndex& index,
+                           const std::vector<int>& angles,
+                           std::vector<std::vector<cv::Point> >& lines)
+        : index_(&index), angles_(&angles), lines_(&lines) {}
+
+    void operator()(int i) const {
+      index_->rasterize((*angles_)[i], (*lines_)[i]);
+    }
+
+  private:
+    const DistortedEpipolarLineIndex* index_;
+    const std::vector<int>* angles_;
+    std::vector<std::vector<cv::Point> >* lines_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+DistortedEpipolarRasterizer::DistortedEpipolarRasterizer(
+    const CameraProperties& camera,
+    const cv::Matx33d& F) : camera_(&camera), F_(F), mask_(), radius_(0) {}
+
+void DistortedEpipolarRasterizer::init() {
+  mask_ = UndistortableMask(*camera_);
+  radius_ = maxUndistortedRadius(*camera_);
+}
+
+// x1 must be undistorted.
+void DistortedEpipolarRasterizer::compute(const cv::Point2d& x1,
+                                          std::vector<cv::Point>& line) const {
+  // Find co-ordinates of epipolar line. Given an uncalibrated point in image 1,
+  // we want an equation for the calibrated point in image 2.
+  cv::Vec3d e = camera_->matrix().t() * F_ * cv::Vec3d(x1.x, x1.y, 1);
+  // May as well normalize for numeric nicety.
+  e = e * (1. / cv::norm(e));
+
+  rasterizeLine(e, *camera_, mask_, radius_, line);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+EpipolarLineSet::EpipolarLineSet() : pixels_(), offsets_(1, 0), blocks_() {}
+
+int EpipolarLineSet::size() const {
+  return blocks_.size();
+}
+
+const cv::Point* EpipolarLineSet::begin(int i) const {
+  return pixels_.empty() ? NULL : &pixels_.front() + offsets_[blocks_[i]];
+}
+
+const cv::Point* EpipolarLineSet::end(int i) const {
+  return pixels_.empty() ? NULL : &pixels_.front() + offsets_[blocks_[i] + 1];
+}
+
+int EpipolarLineSet::length(int i) const {
+  return offsets_[blocks_[i] + 1] - offsets_[blocks_[i]];
+}
+
+int EpipolarLineSet::addBlock(const std::vector<cv::Point>& pixels) {
+  pixels_.insert(pixels_.end(), pixels.begin(), pixels.end());
+  offsets_.push_back(pixels_.size());
+  return offsets_.size() - 2;
+}
+
+void EpipolarLineSet::addLine(int block) {
+  CHECK(0 <= block && block + 1 < int(offsets_.size())) << "No such block";
+  blocks_.push_back(block);
+}
+
+void EpipolarLineSet::clear() {
+  pixels_.clear();
+  offsets_.assign(1, 0);
+  blocks_.clear();
+}
+
+void EpipolarLineSet::swap(EpipolarLineSet& other) {
+  pixels_.swap(other.pixels_);
+  offsets_.swap(other.offsets_);
+  blocks_.swap(other.blocks_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+DistortedEpipolarLineIndex::DistortedEpipolarLineIndex(
+    const CameraProperties& camera2,
+    const cv::Matx33d& F,
+    double max_offset)
+    : camera_(&camera2),
+      G_(camera2.matrix().t() * F),
+      basis1_(),
+      basis2_(),
+      mask_(camera2),
+      radius_(maxUndistortedRadius(camera2)),
+      angle_step_(0),
+      num_angles_(0) {
+  CHECK(max_offset > 0) << "Offset between lines must be positive";
+
+  // The lines are the span of the first two left singular vectors.
+  cv::Mat G(G_, true);
+  cv::SVD svd(G);
+  for (int i = 0; i < 3; i += 1) {
+    basis1_[i] = svd.u.at<double>(i, 0);
+    basis2_[i] = svd.u.at<double>(i, 1);
+  }
+
+  // A unit line which meets the circle has a^2 + b^2 >= 1 / (1 + r^2), so
+  // that turning it by d moves it at most 2 d (1 + r^2) within the circle.
+  // Distortion scales this by at most its slope at the centre, and the
+  // intrinsics by the focal length.
+  double w = camera2.distort_w;
+  double slope = 2. * std::tan(w / 2.) / w;
+  double focal = std::max(std::abs(camera2.focal_x),
+      std::abs(camera2.focal_y));
+  double max_step = max_offset /
+      (2. * (1. + radius_ * radius_) * slope * focal);
+
+  num_angles_ = std::ceil(M_PI / max_step);
+  angle_step_ = M_PI / num_angles_;
+}
+
+int DistortedEpipolarLineIndex::numAngles() const {
+  return num_angles_;
+}
+
+int DistortedEpipolarLineIndex::angleIndex(const cv::Point2d& x1) const {
+  cv::Vec3d e = G_ * cv::Vec3d(x1.x, x1.y, 1);
+  // A line and its negation are the same.
+  double angle = std::atan2(e.dot(basis2_), e.dot(basis1_));
+  if (angle < 0) {
+    angle += M_PI;
+  }
+
+  int index = std::floor(angle / angle_step_ + 0.5);
+  return index % num_angles_;
+}
+
+void DistortedEpipolarLineIndex::rasterize(int angle,
+                                           std::vector<cv::Point>& line) const {
+  double theta = angle * angle_step_;
+  cv::Vec3d e = basis1_ * std::cos(theta) + basis2_ * std::sin(theta);
+  rasterizeLine(e, *camera_, mask_, radius_, line);
+}
+
+void DistortedEpipolarLineIndex::compute(const std::vector<cv::Point2d>& x1,
+                                         EpipolarLineSet& lines,
+                                         ThreadPool* pool) const {
+  int n = x1.size();
+  std::vector<int> point_angles(n);
+  for (int i = 0; i < n; i += 1) {
+    point_angles[i] = angleIndex(x1[i]);
+  }
+
+  // Rasterize each angle once.
+  std::vector<int> angles(point_angles);
+  std::sort(angles.begin(), angles.end());
+  angles.erase(std::unique(angles.begin(), angles.end()), angles.end());
+  int num_angles = angles.size();
+
+  std::vector<std::vector<cv::Point> > rasters(num_angles);
+  RasterizeAngleFunction function(*this, angles, rasters);
+  if (pool == NULL) {
+    for (int i = 0; i < num_angles; i += 1) {
+      function(i);
+    }
+  } else {
+    pool->parallelFor(0, num_angles, function);
+  }
+
+  lines.clear();
+  for (int i = 0; i < num_angles; i += 1) {
+    lines.addBlock(rasters[i]);
+  }
+  for (int i = 0; i < n; i += 1) {
+    int block = std::lower_bound(angles.begin(), angles.end(),
+        point_angles[i]) - angles.begin();
+    lines.addLine(block);
+  }
+}
 
-  std::vector<cv::Point> internal;
-  std::remove_copy_if(line.begin(), line.end(), std::back_inserter(internal),
-      boost::bind(notInside, _1, bounds));
-  line.swap(internal);
+void DistortedEpipolarLineIndex::compute(const std::vector<cv::Point2d>& x1,
+                                         EpipolarLineSet& lines) const {
+  compute(x1, lines, NULL);
 }
 
+void DistortedEpipolarLineIndex::compute(const std::vector<cv::Point2d>& x1,
+                                         EpipolarLineSet& lines,
+                                         ThreadPool& pool) const {
+  compute(x1, lines, &pool);
+}
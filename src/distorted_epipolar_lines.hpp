@@ -1,6 +1,12 @@
+#ifndef DISTORTED_EPIPOLAR_LINES_HPP_
+#define DISTORTED_EPIPOLAR_LINES_HPP_
+
 #include <vector>
 #include <opencv2/core/core.hpp>
 #include "camera_properties.hpp"
+#include "undistortable_mask.hpp"
+
+class ThreadPool;
 
 class DistortedEpipolarRasterizer {
   public:
@@ -14,7 +20,83 @@ class DistortedEpipolarRasterizer {
 
   private:
     const CameraProperties* camera_;
-    cv::Mat F_;
+    cv::Matx33d F_;
+    UndistortableMask mask_;
+    double radius_;
+};
+
+// Pixels of many epipolar lines, stored contiguously. Lines with the same
+// pixels share them.
+class EpipolarLineSet {
+  public:
+    EpipolarLineSet();
+
+    // Number of lines.
+    int size() const;
+    // Pixels of line i are [begin(i), end(i)).
+    const cv::Point* begin(int i) const;
+    const cv::Point* end(int i) const;
+    int length(int i) const;
+
+    // Appends a block of pixels and returns its index.
+    int addBlock(const std::vector<cv::Point>& pixels);
+    // Appends a line whose pixels are a block.
+    void addLine(int block);
+
+    void clear();
+    void swap(EpipolarLineSet& other);
+
+  private:
+    std::vector<cv::Point> pixels_;
+    // Start of each block, and the number of pixels at the end.
+    std::vector<int> offsets_;
+    std::vector<int> blocks_;
+};
+
+// Rasterizes the epipolar lines of many points for one pair of cameras.
+//
+// The epipolar lines in the calibrated second image form a pencil through
+// its epipole, so that each is identified by an angle. Angles are quantized
+// finely enough that the lines of neighbouring angles are within max_offset
+// pixels of each other inside the image. Each point takes the line of its
+// nearest angle, and each angle is rasterized once per batch.
+class DistortedEpipolarLineIndex {
+  public:
+    DistortedEpipolarLineIndex(const CameraProperties& camera2,
+                               const cv::Matx33d& F,
+                               double max_offset);
+
+    int numAngles() const;
+    // Returns the quantized angle of the epipolar line of an undistorted
+    // point in the first image.
+    int angleIndex(const cv::Point2d& x1) const;
+
+    // Points must be undistorted. Lines are in the order of the points.
+    void compute(const std::vector<cv::Point2d>& x1,
+                 EpipolarLineSet& lines) const;
+    // Rasterizes the angles in parallel.
+    void compute(const std::vector<cv::Point2d>& x1,
+                 EpipolarLineSet& lines,
+                 ThreadPool& pool) const;
+
+    // Rasterizes the line of one angle.
+    void rasterize(int angle, std::vector<cv::Point>& line) const;
+
+  private:
+    void compute(const std::vector<cv::Point2d>& x1,
+                 EpipolarLineSet& lines,
+                 ThreadPool* pool) const;
+
+    const CameraProperties* camera_;
+    // Takes points in the first image to lines in the calibrated second.
+    cv::Matx33d G_;
+    // Orthonormal basis of the lines through the epipole.
+    cv::Vec3d basis1_;
+    cv::Vec3d basis2_;
+    UndistortableMask mask_;
     double radius_;
+    double angle_step_;
+    int num_angles_;
 };
 
+#endif
@@ -1,7 +1,12 @@
 #include "distortion.hpp"
 #include <glog/logging.h>
+#include <algorithm>
 #include <cmath>
 
+// Fraction of the maximum distorted radius beyond which the table is not
+// accurate enough to interpolate.
+const double MAX_TABLE_RADIUS_FRACTION = 0.9;
+
 cv::Point2d distort(const cv::Point2d& x, double w) {
   double r = cv::norm(x);
   return distortRadius(r, w) / r * x;
@@ -33,3 +38,53 @@ cv::Point2d distortPointAtInfinity(const cv::Point2d& x, double w) {
   double r = cv::norm(x);
   return maxDistortedRadius(w) / r * x;
 }
+
+namespace {
+
+// Returns undistortRadius(q, w) / q, including its limit at the origin.
+double undistortionScale(double q, double w) {
+  if (q == 0) {
+    return w / (2. * std::tan(w / 2.));
+  }
+  return undistortRadius(q, w) / q;
+}
+
+}
+
+UndistortionTable::UndistortionTable() : w_(0), step_(0), scales_() {}
+
+UndistortionTable::UndistortionTable(double w, double max_radius, int size)
+    : w_(w), step_(0), scales_() {
+  CHECK(size >= 2) << "Table must have at least two samples";
+  max_radius = std::min(max_radius,
+      MAX_TABLE_RADIUS_FRACTION * maxDistortedRadius(w));
+  if (max_radius <= 0) {
+    return;
+  }
+
+  step_ = max_radius / (size - 1);
+  scales_.resize(size);
+  for (int i = 0; i < size; i += 1) {
+    scales_[i] = undistortionScale(i * step_, w);
+  }
+}
+
+double UndistortionTable::scale(double q) const {
+  double u = (scales_.empty() ? -1 : q / step_);
+  int i = static_cast<int>(u);
+  if (u < 0 || i + 1 >= int(scales_.size())) {
+    CHECK(q < maxDistortedRadius(w_)) << "This point cannot be undistorted";
+    return undistortionScale(q, w_);
+  }
+
+  double t = u - i;
+  return (1. - t) * scales_[i] + t * scales_[i + 1];
+}
+
+double UndistortionTable::undistortRadius(double q) const {
+  return scale(q) * q;
+}
+
+cv::Point2d UndistortionTable::undistort(const cv::Point2d& y) const {
+  return scale(cv::norm(y)) * y;
+}
@@ -1,6 +1,7 @@
 #ifndef DISTORTION_HPP_
 #define DISTORTION_HPP_
 
+#include <vector>
 #include <opencv2/core/core.hpp>
 
 // Applies lens distortion to an undistorted point.
@@ -21,4 +22,27 @@ double maxDistortedRadius(double w);
 // Distort a point at infinity.
 cv::Point2d distortPointAtInfinity(const cv::Point2d& x, double w);
 
+// Tabulates the ratio of undistorted to distorted radius for one camera, to
+// undistort many points by linear interpolation instead of evaluating the
+// model for each. Radii beyond the table are undistorted exactly.
+class UndistortionTable {
+  public:
+    UndistortionTable();
+    // Tabulates radii [0, max_radius] at size samples. The table stops short
+    // of maxDistortedRadius(w), where the ratio is unbounded.
+    UndistortionTable(double w, double max_radius, int size);
+
+    double undistortRadius(double q) const;
+    // Unlike undistort(), defined at the origin.
+    cv::Point2d undistort(const cv::Point2d& y) const;
+
+  private:
+    // Returns undistortRadius(q, w) / q.
+    double scale(double q) const;
+
+    double w_;
+    double step_;
+    std::vector<double> scales_;
+};
+
 #endif
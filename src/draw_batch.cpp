@@ -0,0 +1,177 @@
+#include "draw_batch.hpp"
+#include <algorithm>
+#include <cmath>
+#include <opencv2/imgproc/imgproc.hpp>
+
+const double NUM_STDDEV = 2.;
+
+namespace {
+
+// Returns true if a box around the points of size margin touches the image.
+bool isVisible(const cv::Point2d& a,
+               const cv::Point2d& b,
+               double margin,
+               const cv::Size& size) {
+  return std::max(a.x, b.x) + margin >= 0 &&
+         std::min(a.x, b.x) - margin < size.width &&
+         std::max(a.y, b.y) + margin >= 0 &&
+         std::min(a.y, b.y) - margin < size.height;
+}
+
+cv::Point roundPoint(const cv::Point2d& x) {
+  return cv::Point(cvRound(x.x), cvRound(x.y));
+}
+
+template<class T>
+bool colorLess(const T& lhs, const T& rhs) {
+  return lhs.color < rhs.color;
+}
+
+}
+
+DrawBatch::DrawBatch() : circles_(), lines_() {}
+
+void DrawBatch::clear() {
+  circles_.clear();
+  lines_.clear();
+}
+
+bool DrawBatch::empty() const {
+  return circles_.empty() && lines_.empty();
+}
+
+void DrawBatch::addCircle(const cv::Point2d& center,
+                          double radius,
+                          int color) {
+  Circle circle;
+  circle.center = center;
+  circle.radius = radius;
+  circle.color = color;
+  circles_.push_back(circle);
+}
+
+void DrawBatch::addLine(const cv::Point2d& a,
+                        const cv::Point2d& b,
+                        int color) {
+  Line line;
+  line.a = a;
+  line.b = b;
+  line.color = color;
+  lines_.push_back(line);
+}
+
+void DrawBatch::addSiftPosition(const SiftPosition& feature, int color) {
+  double radius = NUM_STDDEV * SIFT_SIZE_TO_SIGMA * feature.size;
+
+  cv::Point2d c(feature.x, feature.y);
+  cv::Point2d j(radius * std::cos(feature.theta),
+                radius * std::sin(feature.theta));
+
+  addCircle(c, radius, color);
+  addLine(c, c + j, color);
+}
+
+void DrawBatch::draw(cv::Mat& image,
+                     const std::vector<cv::Scalar>& colors,
+                     int line_thickness) const {
+  cv::Size size = image.size();
+  double margin = line_thickness;
+
+  std::vector<Circle>::const_iterator circle;
+  for (circle = circles_.begin(); circle != circles_.end(); ++circle) {
+    if (!isVisible(circle->center, circle->center, circle->radius + margin,
+          size)) {
+      continue;
+    }
+
+    const cv::Scalar& color = colors[circle->color];
+    cv::Point c = roundPoint(circle->center);
+
+    if (circle->radius < 1) {
+      // Less than a pixel. Assumes an 8-bit BGR image.
+      if (c.x >= 0 && c.x < size.width && c.y >= 0 && c.y < size.height) {
+        image.at<cv::Vec3b>(c.y, c.x) = cv::Vec3b(cv::saturate_cast<uchar>(
+              color[0]), cv::saturate_cast<uchar>(color[1]),
+            cv::saturate_cast<uchar>(color[2]));
+      }
+    } else {
+      cv::circle(image, c, int(circle->radius), color, line_thickness);
+    }
+  }
+
+  // Sort the visible lines by color so that each color is one call.
+  std::vector<Line> visible;
+  visible.reserve(lines_.size());
+
+  std::vector<Line>::const_iterator line;
+  for (line = lines_.begin(); line != lines_.end(); ++line) {
+    if (!isVisible(line->a, line->b, margin, size)) {
+      continue;
+    }
+    // Shorter than a pixel, and covered by its circle.
+    cv::Point2d d = line->b - line->a;
+    if (d.dot(d) < 1) {
+      continue;
+    }
+    visible.push_back(*line);
+  }
+  std::stable_sort(visible.begin(), visible.end(), colorLess<Line>);
+
+  // Each line is a polyline of two vertices.
+  int n = visible.size();
+  std::vector<cv::Point> vertices(2 * n);
+  std::vector<const cv::Point*> polylines(n);
+  std::vector<int> num_vertices(n, 2);
+
+  for (int i = 0; i < n; i += 1) {
+    vertices[2 * i] = roundPoint(visible[i].a);
+    vertices[2 * i + 1] = roundPoint(visible[i].b);
+    polylines[i] = &vertices[2 * i];
+  }
+
+  int begin = 0;
+  while (begin < n) {
+    int color = visible[begin].color;
+    int end = begin + 1;
+    while (end < n && visible[end].color == color) {
+      end += 1;
+    }
+
+    cv::polylines(image, &polylines[begin], &num_vertices[begin], end - begin,
+        false, colors[color], line_thickness);
+    begin = end;
+  }
+}
+
+cv::Rect DrawBatch::bounds(const cv::Size& size, int line_thickness) const {
+  double margin = line_thickness + 1;
+  double x1 = size.width;
+  double y1 = size.height;
+  double x2 = 0;
+  double y2 = 0;
+
+  std::vector<Circle>::const_iterator circle;
+  for (circle = circles_.begin(); circle != circles_.end(); ++circle) {
+    double r = circle->radius + margin;
+    x1 = std::min(x1, circle->center.x - r);
+    y1 = std::min(y1, circle->center.y - r);
+    x2 = std::max(x2, circle->center.x + r);
+    y2 = std::max(y2, circle->center.y + r);
+  }
+
+  std::vector<Line>::const_iterator line;
+  for (line = lines_.begin(); line != lines_.end(); ++line) {
+    x1 = std::min(x1, std::min(line->a.x, line->b.x) - margin);
+    y1 = std::min(y1, std::min(line->a.y, line->b.y) - margin);
+    x2 = std::max(x2, std::max(line->a.x, line->b.x) + margin);
+    y2 = std::max(y2, std::max(line->a.y, line->b.y) + margin);
+  }
+
+  if (x2 <= x1 || y2 <= y1) {
+    return cv::Rect();
+  }
+
+  cv::Rect rect(cv::Point(std::floor(x1), std::floor(y1)),
+                cv::Point(std::ceil(x2) + 1, std::ceil(y2) + 1));
+  return rect & cv::Rect(cv::Point(0, 0), size);
+}
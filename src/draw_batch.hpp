@@ -0,0 +1,51 @@
+#ifndef DRAW_BATCH_HPP_
+#define DRAW_BATCH_HPP_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "sift_position.hpp"
+
+// Accumulates the circles and lines of one image and draws them in a single
+// pass, for visualizations with too many features to draw one at a time.
+//
+// Primitives which are entirely outside the image are culled. Circles smaller
+// than a pixel are drawn as a single pixel, and lines of the same color are
+// drawn with one call.
+class DrawBatch {
+  public:
+    DrawBatch();
+
+    void clear();
+    bool empty() const;
+
+    // Colors are indices into the list given to draw().
+    void addCircle(const cv::Point2d& center, double radius, int color);
+    void addLine(const cv::Point2d& a, const cv::Point2d& b, int color);
+    // Adds the same circle and orientation line as drawSiftPosition().
+    void addSiftPosition(const SiftPosition& feature, int color);
+
+    void draw(cv::Mat& image,
+              const std::vector<cv::Scalar>& colors,
+              int line_thickness) const;
+
+    // Returns the region which draw() may change, clipped to the image size.
+    cv::Rect bounds(const cv::Size& size, int line_thickness) const;
+
+  private:
+    struct Circle {
+      cv::Point2d center;
+      double radius;
+      int color;
+    };
+
+    struct Line {
+      cv::Point2d a;
+      cv::Point2d b;
+      int color;
+    };
+
+    std::vector<Circle> circles_;
+    std::vector<Line> lines_;
+};
+
+#endif
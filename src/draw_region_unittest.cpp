@@ -0,0 +1,143 @@
+#include "videoseg/draw-region.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "util/thread-pool.hpp"
+#include "gtest/gtest.h"
+
+using videoseg::Rasterization;
+using videoseg::RegionDrawing;
+using videoseg::ScanInterval;
+
+namespace {
+
+const int ROWS = 64;
+const int COLS = 80;
+
+// One interval per row, of every length from 1 to ROWS and at various
+// offsets, so that the vector kernels meet whole blocks and tails of every
+// length as well as spans too short for a block.
+Rasterization makeRegion() {
+  Rasterization region;
+  for (int y = 0; y < ROWS; y += 1) {
+    ScanInterval* interval = region.add_scan_inter();
+    interval->set_y(y);
+    interval->set_left_x(y % 7);
+    interval->set_right_x(y % 7 + y);
+  }
+  return region;
+}
+
+cv::Mat randomImage(int seed) {
+  cv::Mat image(ROWS, COLS, cv::DataType<cv::Vec3b>::type);
+  cv::RNG rng(seed);
+  rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+  return image;
+}
+
+// The blend of one pixel, one channel at a time, as the scalar path does.
+cv::Vec3b blendPixel(cv::Vec3b src, cv::Vec3b color, double alpha) {
+  alpha = std::min(std::max(alpha, 0.), 1.);
+  int weight = std::floor(256 * alpha + 0.5);
+  cv::Vec3b result;
+  for (int c = 0; c < 3; c += 1) {
+    result[c] = (src[c] * (256 - weight) + color[c] * weight + 128) >> 8;
+  }
+  return result;
+}
+
+bool inRegion(const Rasterization& region, int x, int y) {
+  const ScanInterval& interval = region.scan_inter(y);
+  return interval.left_x() <= x && x <= interval.right_x();
+}
+
+// Expects every pixel of actual to be the same as expected.
+void expectSameImage(const cv::Mat& expected, const cv::Mat& actual) {
+  ASSERT_EQ(expected.size(), actual.size());
+  for (int y = 0; y < expected.rows; y += 1) {
+    for (int x = 0; x < expected.cols; x += 1) {
+      ASSERT_EQ(expected.at<cv::Vec3b>(y, x), actual.at<cv::Vec3b>(y, x))
+          << "Pixel (" << x << ", " << y << ")";
+    }
+  }
+}
+
+}
+
+TEST(DrawRegion, FillMatchesScalarFill) {
+  Rasterization region = makeRegion();
+  cv::Mat image = randomImage(1);
+  cv::Mat expected = image.clone();
+  cv::Vec3b color(12, 200, 77);
+
+  for (int y = 0; y < ROWS; y += 1) {
+    for (int x = 0; x < COLS; x += 1) {
+      if (inRegion(region, x, y)) {
+        expected.at<cv::Vec3b>(y, x) = color;
+      }
+    }
+  }
+
+  videoseg::fillRegion(region, image, color);
+  expectSameImage(expected, image);
+}
+
+TEST(DrawRegion, BlendMatchesScalarBlend) {
+  Rasterization region = makeRegion();
+  cv::Mat src = randomImage(1);
+  cv::Vec3b color(255, 0, 131);
+
+  // Including weights of nothing and everything, and alphas out of range.
+  double alphas[] = { 0, 0.3, 0.5, 0.999, 1, -0.2, 1.5 };
+  for (int i = 0; i < int(sizeof(alphas) / sizeof(alphas[0])); i += 1) {
+    cv::Mat image = randomImage(2);
+    cv::Mat expected = image.clone();
+    for (int y = 0; y < ROWS; y += 1) {
+      for (int x = 0; x < COLS; x += 1) {
+        if (inRegion(region, x, y)) {
+          expected.at<cv::Vec3b>(y, x) = blendPixel(src.at<cv::Vec3b>(y, x),
+              color, alphas[i]);
+        }
+      }
+    }
+
+    videoseg::copyAndBlendRegion(region, src, color, alphas[i], image);
+    SCOPED_TRACE(alphas[i]);
+    expectSameImage(expected, image);
+  }
+}
+
+TEST(DrawRegion, BatchMatchesOneRegionAtATime) {
+  // Overlapping regions, so that the order matters.
+  Rasterization region = makeRegion();
+  Rasterization shifted = makeRegion();
+  for (int y = 0; y < ROWS; y += 1) {
+    ScanInterval* interval = shifted.mutable_scan_inter(y);
+    interval->set_left_x(interval->left_x() + 5);
+    interval->set_right_x(std::min(interval->right_x() + 5, COLS - 1));
+  }
+  cv::Mat src = randomImage(1);
+  cv::Vec3b red(0, 0, 255);
+  cv::Vec3b green(0, 255, 0);
+
+  cv::Mat expected = randomImage(2);
+  cv::Mat image = expected.clone();
+  videoseg::copyRegion(region, src, expected);
+  videoseg::copyAndBlendRegion(shifted, src, red, 0.4, expected);
+  videoseg::fillRegion(region, expected, green);
+
+  std::vector<RegionDrawing> regions;
+  regions.push_back(RegionDrawing(region, RegionDrawing::COPY, cv::Vec3b(),
+        0));
+  regions.push_back(RegionDrawing(shifted, RegionDrawing::BLEND, red, 0.4));
+  regions.push_back(RegionDrawing(region, RegionDrawing::FILL, green, 0));
+
+  cv::Mat sequential = image.clone();
+  videoseg::drawRegions(regions, src, sequential, NULL);
+  expectSameImage(expected, sequential);
+
+  ThreadPool pool(3);
+  videoseg::drawRegions(regions, src, image, &pool);
+  expectSameImage(expected, image);
+}
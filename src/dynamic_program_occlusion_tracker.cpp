@@ -1,28 +1,49 @@
 #include "dynamic_program_occlusion_tracker.hpp"
 #include <cmath>
+#include <glog/logging.h>
 #include <opencv2/imgproc/imgproc.hpp>
 #include "viterbi.hpp"
+#include "frame_correlator.hpp"
+#include "template_response_terms.hpp"
+#include "util/thread-pool.hpp"
 
 DynamicProgramOcclusionTracker::DynamicProgramOcclusionTracker(
     double lambda,
     double penalty,
     int radius,
-    bool fix_seed) : video_(NULL),
-                     lambda_(lambda),
-                     penalty_(penalty),
-                     radius_(radius),
-                     fix_seed_(fix_seed) {}
+    bool fix_seed,
+    bool checkpoint,
+    ThreadPool& pool,
+    const FrameCorrelator* correlator) : video_(NULL),
+                                         lambda_(lambda),
+                                         penalty_(penalty),
+                                         radius_(radius),
+                                         fix_seed_(fix_seed),
+                                         checkpoint_(checkpoint),
+                                         pool_(&pool),
+                                         correlator_(correlator) {}
 
 DynamicProgramOcclusionTracker::~DynamicProgramOcclusionTracker() {}
 
 void DynamicProgramOcclusionTracker::init(const Video& video) {
   video_ = &video;
+  CHECK(correlator_ == NULL || correlator_->length() == video.length())
+      << "Correlator was initialized with another video";
 }
 
 bool DynamicProgramOcclusionTracker::track(const SpaceTimeImagePoint& point,
                                            Track<cv::Point2d>& track) const {
+  return this->track(point, track, *pool_);
+}
+
+bool DynamicProgramOcclusionTracker::track(const SpaceTimeImagePoint& point,
+                                           Track<cv::Point2d>& track,
+                                           ThreadPool& pool) const {
   cv::Mat initial_image;
-  video_->get(point.t, initial_image);
+  if (!video_->get(point.t, initial_image)) {
+    LOG(WARNING) << "Could not get frame " << point.t;
+    return false;
+  }
   cv::Size size = initial_image.size();
 
   // Sample template from image.
@@ -30,45 +51,27 @@ bool DynamicProgramOcclusionTracker::track(const SpaceTimeImagePoint& point,
   cv::Point corner(point.x() - radius_, point.y() - radius_);
   int diameter = 2 * radius_ + 1;
   cv::Rect region(corner, cv::Size(diameter, diameter));
+  if ((region & cv::Rect(cv::Point(), size)) != region) {
+    LOG(WARNING) << "Point " << point.p << " of frame " << point.t <<
+        " is too close to the border to be tracked";
+    return false;
+  }
   templ = initial_image(region).clone();
 
   // Region of image in which template can be matched.
   cv::Rect interior(cv::Point(radius_, radius_),
       cv::Size(size.width - diameter + 1, size.height - diameter + 1));
-
-  // Match the template to every image.
-  std::vector<cv::Mat> appearance_costs;
   int n = video_->length();
 
-  LOG(INFO) << "Performing cross-correlation";
-
-  for (int t = 0; t < n; t += 1) {
-    cv::Mat response;
-
-    if (fix_seed_ && t == point.t) {
-      // Set all other positions to +inf.
-      response = cv::Mat_<double>(interior.size(),
-          std::numeric_limits<double>::infinity());
-      cv::Point center = cv::Point(std::floor(point.x() + 0.5),
-                                   std::floor(point.y() + 0.5));
-      cv::Point corner = center - cv::Point(radius_, radius_);
-      response.at<double>(corner) = 0; // any finite constant
-    } else {
-      cv::Mat image;
-      bool ok = video_->get(t, image);
-      if (!ok) {
-        return false;
-      }
-      // Evaluate response to template.
-      cv::matchTemplate(image, templ, response, cv::TM_CCORR_NORMED);
-      // Convert to 64-bit.
-      response = cv::Mat_<double>(response);
-      // Negate (minimizing not maximizing) and normalize.
-      response = -1. / lambda_ * response;
+  // Cost of matching the template to every image.
+  TemplateResponseTerms appearance(*video_, correlator_, templ, size, lambda_,
+      radius_, fix_seed_ ? &point : NULL);
+  // Without checkpoints, the whole table is kept anyway.
+  std::vector<cv::Mat> appearance_costs;
+  if (!checkpoint_) {
+    if (!appearance.getAll(appearance_costs, pool)) {
+      return false;
     }
-
-    // Add to list.
-    appearance_costs.push_back(response);
   }
 
   // Cost of occlusion is uniform.
@@ -83,9 +86,18 @@ bool DynamicProgramOcclusionTracker::track(const SpaceTimeImagePoint& point,
   occlusion_costs[point.t] = cv::Mat_<double>(interior.size(),
       std::numeric_limits<double>::infinity());
 
-  LOG(INFO) << "Solving dynamic program";
+  DLOG(INFO) << "Solving dynamic program";
   std::vector<SplitVariable> solution;
-  solveViterbiSplitQuadratic2D(appearance_costs, occlusion_costs, solution);
+  if (checkpoint_) {
+    solveViterbiSplitQuadratic2DCheckpointed(appearance,
+        VectorUnaryTerms2D(occlusion_costs), solution, pool);
+    if (appearance.failed()) {
+      return false;
+    }
+  } else {
+    solveViterbiSplitQuadratic2D(appearance_costs, occlusion_costs, solution,
+        pool);
+  }
 
   // Convert to a track.
   track.clear();
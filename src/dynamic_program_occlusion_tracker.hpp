@@ -3,6 +3,9 @@
 
 #include "offline_tracker.hpp"
 
+class FrameCorrelator;
+class ThreadPool;
+
 class DynamicProgramOcclusionTracker : public OfflineTracker {
   public:
     // Parameters:
@@ -10,16 +13,26 @@ class DynamicProgramOcclusionTracker : public OfflineTracker {
     // penalty -- Paid for claiming an occlusion.
     // radius -- Tracked region will be (2 * radius + 1) x (2 * radius + 1).
     // fix_seed -- Should the point which seeded the track be constrained?
+    // checkpoint -- Recompute the dynamic program instead of storing it all?
+    // pool -- Used to solve the dynamic program in parallel.
+    // correlator -- Matches templates to the transformed frames of the video,
+    //   or NULL to call cv::matchTemplate() on every frame.
     DynamicProgramOcclusionTracker(double lambda,
                                    double penalty,
                                    int radius,
-                                   bool fix_seed);
+                                   bool fix_seed,
+                                   bool checkpoint,
+                                   ThreadPool& pool,
+                                   const FrameCorrelator* correlator = NULL);
 
     ~DynamicProgramOcclusionTracker();
 
     void init(const Video& video);
     bool track(const SpaceTimeImagePoint& point,
                Track<cv::Point2d>& track) const;
+    bool track(const SpaceTimeImagePoint& point,
+               Track<cv::Point2d>& track,
+               ThreadPool& pool) const;
 
   private:
     const Video* video_;
@@ -27,6 +40,9 @@ class DynamicProgramOcclusionTracker : public OfflineTracker {
     double penalty_;
     int radius_;
     bool fix_seed_;
+    bool checkpoint_;
+    ThreadPool* pool_;
+    const FrameCorrelator* correlator_;
 };
 
 #endif
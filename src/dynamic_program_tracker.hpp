@@ -3,24 +3,42 @@
 
 #include "offline_tracker.hpp"
 
+class FrameCorrelator;
+class ThreadPool;
+
 class DynamicProgramTracker : public OfflineTracker {
   public:
     // Parameters:
     // lambda -- Weighting of pairwise change relative to detector response.
     // radius -- Tracked region will be (2 * radius + 1) x (2 * radius + 1).
     // fix_seed -- Should the point which seeded the track be constrained?
-    DynamicProgramTracker(double lambda, int radius, bool fix_seed);
+    // checkpoint -- Recompute the dynamic program instead of storing it all?
+    // pool -- Used to solve the dynamic program in parallel.
+    // correlator -- Matches templates to the transformed frames of the video,
+    //   or NULL to call cv::matchTemplate() on every frame.
+    DynamicProgramTracker(double lambda,
+                          int radius,
+                          bool fix_seed,
+                          bool checkpoint,
+                          ThreadPool& pool,
+                          const FrameCorrelator* correlator = NULL);
     ~DynamicProgramTracker();
 
     void init(const Video& video);
     bool track(const SpaceTimeImagePoint& point,
                Track<cv::Point2d>& track) const;
+    bool track(const SpaceTimeImagePoint& point,
+               Track<cv::Point2d>& track,
+               ThreadPool& pool) const;
 
   private:
     const Video* video_;
     double lambda_;
     int radius_;
     bool fix_seed_;
+    bool checkpoint_;
+    ThreadPool* pool_;
+    const FrameCorrelator* correlator_;
 };
 
 #endif
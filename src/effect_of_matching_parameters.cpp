@@ -14,15 +14,34 @@
 #include "default_reader.hpp"
 #include "lexical_cast_parser.hpp"
 #include "stats.hpp"
+#include "util/thread-pool.hpp"
 
 DEFINE_double(max_residual, 1.,
     "Maximum sum-of-squares pixel error to be an inlier.");
+DEFINE_int32(num_threads, 4,
+    "Number of worker threads to load residuals with, 0 for none");
+DEFINE_string(cdf, "",
+    "Also write the distribution of the residuals of each pair of thresholds "
+    "over every frame to this file, as the residual at --num_quantiles evenly "
+    "spaced quantiles");
+DEFINE_int32(num_quantiles, 20, "Number of quantiles to write to --cdf");
+
+// Statistics of the residuals of one frame.
+struct FrameStats {
+  double num_matches;
+  double num_correct;
+  double mean_residual;
+  double median_residual;
+};
 
+// Means over frames.
 struct Stats {
   double num_matches;
   double num_correct;
   double mean_residual;
   double median_residual;
+  // Every residual of every frame.
+  QuantileSketch residuals;
 };
 
 void writeStats(std::ostream& os, const Stats& stats) {
@@ -36,47 +55,89 @@ bool fileExists(const std::string& filename) {
   return std::ifstream(filename.c_str()).good();
 }
 
+std::string makeResidualsFilename(const std::string& format, int i) {
+  return boost::str(boost::format(format) % (i + 1));
+}
+
+// Loads the residuals of each frame, reduces them and adds them to the sketch
+// of the thread. For use with ThreadPool::parallelFor().
+class ReduceFrameFunction {
+  public:
+    ReduceFrameFunction(const std::string& residuals_format,
+                        double max_residual,
+                        std::vector<FrameStats>& frames,
+                        PerThread<QuantileSketch>& sketches)
+        : residuals_format_(&residuals_format),
+          max_residual_(max_residual),
+          frames_(&frames),
+          sketches_(&sketches) {}
+
+    void operator()(int i) const {
+      std::vector<double> residuals;
+      DefaultReader<double> reader;
+      bool ok = loadList(makeResidualsFilename(*residuals_format_, i),
+          residuals, reader);
+      CHECK(ok) << "Could not load residuals";
+
+      FrameStats& stats = (*frames_)[i];
+      stats.num_matches = residuals.size();
+      stats.num_correct = countLessThanEqualTo(residuals, max_residual_);
+      stats.mean_residual = computeMean(residuals);
+      stats.median_residual = computeMedian(residuals);
+
+      QuantileSketch& sketch = sketches_->local();
+      std::vector<double>::const_iterator residual;
+      for (residual = residuals.begin(); residual != residuals.end();
+          ++residual) {
+        sketch.add(*residual);
+      }
+    }
+
+  private:
+    const std::string* residuals_format_;
+    double max_residual_;
+    std::vector<FrameStats>* frames_;
+    PerThread<QuantileSketch>* sketches_;
+};
+
 void reduceResidualsOverFrames(const std::string& residuals_format,
                                Stats& stats,
-                               double max_residual) {
-  int i = 0;
-  bool finished = false;
-  DefaultReader<double> reader;
+                               double max_residual,
+                               ThreadPool& pool) {
+  int n = 0;
+  while (fileExists(makeResidualsFilename(residuals_format, n))) {
+    n += 1;
+  }
+
+  // Frames are loaded in parallel into one sketch per thread.
+  std::vector<FrameStats> frames(n);
+  PerThread<QuantileSketch> sketches;
+  pool.parallelFor(0, n, ReduceFrameFunction(residuals_format, max_residual,
+        frames, sketches));
 
   // Take mean over all frames.
   double num_matches = 0;
   double num_correct = 0;
   double mean_residual = 0;
   double median_residual = 0;
+  for (int i = 0; i < n; i += 1) {
+    num_matches += frames[i].num_matches;
+    num_correct += frames[i].num_correct;
+    mean_residual += frames[i].mean_residual;
+    median_residual += frames[i].median_residual;
+  }
 
-  while (!finished) {
-    // Form file name.
-    std::string residuals_file = boost::str(
-        boost::format(residuals_format) % (i + 1));
-
-    if (!fileExists(residuals_file)) {
-      finished = true;
-      continue;
-    }
-
-    // Load residuals.
-    std::vector<double> residuals;
-    bool ok = loadList(residuals_file, residuals, reader);
-    CHECK(ok) << "Could not load residuals";
-
-    // Count number of matches.
-    num_matches += residuals.size();
-    num_correct += countLessThanEqualTo(residuals, max_residual);
-    mean_residual += computeMean(residuals);
-    median_residual += computeMedian(residuals);
+  stats.num_matches = num_matches / n;
+  stats.num_correct = num_correct / n;
+  stats.mean_residual = mean_residual / n;
+  stats.median_residual = median_residual / n;
 
-    i += 1;
+  stats.residuals = QuantileSketch();
+  PerThread<QuantileSketch>::Values::const_iterator sketch;
+  for (sketch = sketches.values().begin(); sketch != sketches.values().end();
+      ++sketch) {
+    stats.residuals.merge(sketch->second);
   }
-
-  stats.num_matches = num_matches / i;
-  stats.num_correct = num_correct / i;
-  stats.mean_residual = mean_residual / i;
-  stats.median_residual = median_residual / i;
 }
 
 void init(int& argc, char**& argv) {
@@ -132,6 +193,7 @@ int main(int argc, char** argv) {
   int num_contrast_thresholds = contrast_thresholds.size();
   int num_distance_thresholds = distance_thresholds.size();
 
+  ThreadPool pool(FLAGS_num_threads);
   std::vector<std::vector<Stats> > stats;
 
   // Initialize 2D vector.
@@ -157,7 +219,7 @@ int main(int argc, char** argv) {
                                                  % distance_thresholds[j]);
 
       reduceResidualsOverFrames(residuals_format, stats[i][j],
-          FLAGS_max_residual);
+          FLAGS_max_residual, pool);
     }
   }
 
@@ -196,5 +258,18 @@ int main(int argc, char** argv) {
     }
   }
 
+  if (!FLAGS_cdf.empty()) {
+    std::ofstream ofs(FLAGS_cdf.c_str());
+    CHECK(ofs.is_open()) << "Could not write to CDF file";
+    for (int i = 0; i < num_contrast_thresholds; i += 1) {
+      for (int j = 0; j < num_distance_thresholds; j += 1) {
+        ofs << contrast_thresholds[i] << "\t";
+        ofs << distance_thresholds[j] << "\t";
+        writeQuantiles(ofs, stats[i][j].residuals, FLAGS_num_quantiles);
+        ofs << std::endl;
+      }
+    }
+  }
+
   return 0;
 }
@@ -13,10 +13,21 @@
 #include <glog/logging.h>
 #include "read_image.hpp"
 #include "descriptor.hpp"
+#include "detect_sift.hpp"
 #include "match.hpp"
 #include "iterator_reader.hpp"
 #include "descriptor_reader.hpp"
 
+const int MAX_NUM_FEATURES = 0;
+const int NUM_OCTAVE_LAYERS = 3;
+const double EDGE_THRESHOLD = 10;
+const double SIGMA = 1.6;
+
+DEFINE_bool(sweep, false,
+    "Detect features in pairs of images once, at the lowest threshold, and "
+    "find those of the other thresholds by their contrast? Arguments are then "
+    "image formats which take the frame number.");
+
 typedef std::vector<Descriptor> DescriptorList;
 typedef std::vector<cv::DMatch> MatchResultList;
 typedef std::vector<Match> MatchList;
@@ -25,6 +36,10 @@ std::string makeFilename(const std::string& format, double threshold, int n) {
   return boost::str(boost::format(format) % threshold % (n + 1));
 }
 
+std::string makeImageFilename(const std::string& format, int n) {
+  return boost::str(boost::format(format) % (n + 1));
+}
+
 void listToMatrix(const DescriptorList& list, cv::Mat& matrix) {
   int rows = list.size();
   CHECK(rows != 0);
@@ -136,52 +151,81 @@ void match(const DescriptorList& descriptors1,
   LOG(INFO) << matches.size() << " consistent matches";
 }
 
-int main(int argc, char** argv) {
-  std::ostringstream usage;
-  usage << "Evaluates effect of SIFT threshold on matches and speed." <<
-    std::endl;
-  usage << std::endl;
-  usage << "Sample usage:" << std::endl;
-  usage << argv[0] << " descriptors1-format descriptors2-format base-threshold "
-    "threshold-step num-thresholds" << std::endl;
-
-  google::SetUsageMessage(usage.str());
-  google::ParseCommandLineFlags(&argc, &argv, true);
-  google::InitGoogleLogging(argv[0]);
+// Totals over the frames of one threshold.
+struct MatchStatistics {
+  int num_frames;
+  double num_descriptors;
+  double num_exhaustive_matches;
+  double exhaustive_time;
+  double num_flann_matches;
+  double flann_time;
+
+  MatchStatistics()
+      : num_frames(0),
+        num_descriptors(0),
+        num_exhaustive_matches(0),
+        exhaustive_time(0),
+        num_flann_matches(0),
+        flann_time(0) {}
+};
 
-  if (argc != 6) {
-    google::ShowUsageWithFlags(argv[0]);
-    return 1;
+// Matches the two lists of descriptors using brute force and FLANN.
+void matchFrame(const DescriptorList& descriptors1,
+                const DescriptorList& descriptors2,
+                MatchStatistics& statistics) {
+  double exhaustive_time = 0;
+  double flann_time = 0;
+  MatchList exhaustive_matches;
+  MatchList flann_matches;
+
+  // A high threshold may leave no features to match.
+  if (!descriptors1.empty() && !descriptors2.empty()) {
+    match(descriptors1, descriptors2, exhaustive_matches, false,
+        exhaustive_time);
+    match(descriptors1, descriptors2, flann_matches, true, flann_time);
   }
 
-  std::string descriptors_format1 = argv[1];
-  std::string descriptors_format2 = argv[2];
-  double base_threshold = boost::lexical_cast<double>(argv[3]);
-  double threshold_step = boost::lexical_cast<double>(argv[4]);
-  int num_thresholds = boost::lexical_cast<int>(argv[5]);
+  statistics.num_descriptors += descriptors1.size();
+  statistics.num_descriptors += descriptors2.size();
+  statistics.num_exhaustive_matches += exhaustive_matches.size();
+  statistics.exhaustive_time += exhaustive_time;
+  statistics.num_flann_matches += flann_matches.size();
+  statistics.flann_time += flann_time;
+  statistics.num_frames += 1;
+}
 
+void printStatistics(double threshold, const MatchStatistics& statistics) {
+  int t = statistics.num_frames;
+
+  std::cout << threshold << "\t";
+  std::cout << statistics.num_descriptors / (2 * t) << "\t";
+  std::cout << statistics.num_exhaustive_matches / t << "\t";
+  std::cout << statistics.exhaustive_time / t << "\t";
+  std::cout << statistics.num_flann_matches / t << "\t";
+  std::cout << statistics.flann_time / t << std::endl;
+}
+
+// Evaluates descriptors which were found separately for each threshold.
+void evaluateDescriptorFiles(const std::string& descriptors_format1,
+                             const std::string& descriptors_format2,
+                             const std::vector<double>& thresholds) {
   // Really this should be farmed out MapReduce style.
   // No machine available at the moment though so why bother.
-  for (int i = 0; i < num_thresholds; i += 1) {
-    double threshold = base_threshold * std::pow(threshold_step, i);
-
-    LOG(INFO) << "Threshold: " << threshold << std::endl;
+  std::vector<double>::const_iterator threshold;
+  for (threshold = thresholds.begin(); threshold != thresholds.end();
+      ++threshold) {
+    LOG(INFO) << "Threshold: " << *threshold << std::endl;
 
     int t = 0;
-    double mean_num_descriptors = 0;
-    double mean_num_exhaustive_matches = 0;
-    double mean_exhaustive_time = 0;
-    double mean_num_flann_matches = 0;
-    double mean_flann_time = 0;
-
+    MatchStatistics statistics;
     bool have_frames = true;
 
     while (have_frames) {
       // Build filenames.
       std::string descriptors_file1 = makeFilename(descriptors_format1,
-          threshold, t);
+          *threshold, t);
       std::string descriptors_file2 = makeFilename(descriptors_format2,
-          threshold, t);
+          *threshold, t);
 
       // Load descriptors.
       DescriptorList descriptors1;
@@ -205,38 +249,116 @@ int main(int argc, char** argv) {
       }
       LOG(INFO) << "Loaded " << descriptors2.size() << " descriptors";
 
-      double exhaustive_time;
-      double flann_time;
-      MatchList exhaustive_matches;
-      MatchList flann_matches;
+      matchFrame(descriptors1, descriptors2, statistics);
+      t += 1;
+    }
 
-      // Match the two lists of descriptors using brute force and FLANN.
-      match(descriptors1, descriptors2, exhaustive_matches, false,
-          exhaustive_time);
-      match(descriptors1, descriptors2, flann_matches, true, flann_time);
+    printStatistics(*threshold, statistics);
+  }
+}
 
-      mean_num_descriptors += descriptors1.size();
-      mean_num_descriptors += descriptors2.size();
-      mean_num_exhaustive_matches += exhaustive_matches.size();
-      mean_exhaustive_time += exhaustive_time;
-      mean_num_flann_matches += flann_matches.size();
-      mean_flann_time += flann_time;
+// Copies the descriptors of the features which a threshold would keep.
+void selectDescriptors(const std::vector<SiftFeature>& features,
+                       const std::vector<double>& contrasts,
+                       double threshold,
+                       DescriptorList& descriptors) {
+  int num_features = features.size();
+  for (int i = 0; i < num_features; i += 1) {
+    if (contrasts[i] >= threshold) {
+      descriptors.push_back(features[i].descriptor);
+    }
+  }
+}
 
-      t += 1;
+// Detects features in each pair of images once at the lowest threshold and
+// evaluates every threshold by filtering them on contrast.
+void sweepImages(const std::string& image_format1,
+                 const std::string& image_format2,
+                 const std::vector<double>& thresholds) {
+  int num_thresholds = thresholds.size();
+  std::vector<MatchStatistics> statistics(num_thresholds);
+
+  SiftOptions options;
+  options.max_num_features = MAX_NUM_FEATURES;
+  options.num_octave_layers = NUM_OCTAVE_LAYERS;
+  options.contrast_threshold = *std::min_element(thresholds.begin(),
+      thresholds.end());
+  options.edge_threshold = EDGE_THRESHOLD;
+  options.sigma = SIGMA;
+
+  for (int t = 0; ; t += 1) {
+    cv::Mat color_image;
+    cv::Mat image1;
+    cv::Mat image2;
+    if (!readImage(makeImageFilename(image_format1, t), color_image,
+          image1)) {
+      break;
     }
+    if (!readImage(makeImageFilename(image_format2, t), color_image,
+          image2)) {
+      break;
+    }
+
+    std::vector<SiftFeature> features1;
+    std::vector<SiftFeature> features2;
+    std::vector<double> contrasts1;
+    std::vector<double> contrasts2;
+    extractFeatures(image1, features1, contrasts1, options);
+    extractFeatures(image2, features2, contrasts2, options);
+    LOG(INFO) << "Frame " << t + 1 << ": " << features1.size() << ", " <<
+        features2.size() << " features at threshold " <<
+        options.contrast_threshold;
+
+    for (int i = 0; i < num_thresholds; i += 1) {
+      DescriptorList descriptors1;
+      DescriptorList descriptors2;
+      selectDescriptors(features1, contrasts1, thresholds[i], descriptors1);
+      selectDescriptors(features2, contrasts2, thresholds[i], descriptors2);
+      matchFrame(descriptors1, descriptors2, statistics[i]);
+    }
+  }
+
+  for (int i = 0; i < num_thresholds; i += 1) {
+    printStatistics(thresholds[i], statistics[i]);
+  }
+}
 
-    mean_num_descriptors /= 2 * t;
-    mean_num_exhaustive_matches /= t;
-    mean_exhaustive_time /= t;
-    mean_num_flann_matches /= t;
-    mean_flann_time /= t;
-
-    std::cout << threshold << "\t";
-    std::cout << mean_num_descriptors << "\t";
-    std::cout << mean_num_exhaustive_matches << "\t";
-    std::cout << mean_exhaustive_time << "\t";
-    std::cout << mean_num_flann_matches << "\t";
-    std::cout << mean_flann_time << std::endl;
+int main(int argc, char** argv) {
+  std::ostringstream usage;
+  usage << "Evaluates effect of SIFT threshold on matches and speed." <<
+    std::endl;
+  usage << std::endl;
+  usage << "Sample usage:" << std::endl;
+  usage << argv[0] << " descriptors1-format descriptors2-format base-threshold "
+    "threshold-step num-thresholds" << std::endl;
+  usage << argv[0] << " -sweep image1-format image2-format base-threshold "
+    "threshold-step num-thresholds" << std::endl;
+
+  google::SetUsageMessage(usage.str());
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  if (argc != 6) {
+    google::ShowUsageWithFlags(argv[0]);
+    return 1;
+  }
+
+  std::string format1 = argv[1];
+  std::string format2 = argv[2];
+  double base_threshold = boost::lexical_cast<double>(argv[3]);
+  double threshold_step = boost::lexical_cast<double>(argv[4]);
+  int num_thresholds = boost::lexical_cast<int>(argv[5]);
+  CHECK(num_thresholds > 0);
+
+  std::vector<double> thresholds;
+  for (int i = 0; i < num_thresholds; i += 1) {
+    thresholds.push_back(base_threshold * std::pow(threshold_step, i));
+  }
+
+  if (FLAGS_sweep) {
+    sweepImages(format1, format2, thresholds);
+  } else {
+    evaluateDescriptorFiles(format1, format2, thresholds);
   }
 
   return 0;
@@ -0,0 +1,77 @@
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <sstream>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "descriptor_matrix.hpp"
+#include "product_quantizer.hpp"
+
+#include "read_lines.hpp"
+#include "descriptor_matrix_reader.hpp"
+#include "product_quantizer_reader.hpp"
+#include "matrix_writer.hpp"
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Compresses descriptors using a product quantizer." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " quantizer descriptors-files" << std::endl;
+  usage << std::endl;
+  usage << "quantizer -- Input." << std::endl;
+  usage << "descriptors-files -- Input. One descriptors file per line." <<
+      std::endl;
+  usage << std::endl;
+  usage << "The codes of each file are saved beside it." << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string quantizer_file = argv[1];
+  std::string descriptors_files_file = argv[2];
+
+  bool ok;
+
+  ProductQuantizer quantizer;
+  ProductQuantizerReader quantizer_reader;
+  ok = load(quantizer_file, quantizer, quantizer_reader);
+  CHECK(ok) << "Could not load quantizer";
+
+  std::vector<std::string> descriptors_files;
+  ok = readLines(descriptors_files_file, descriptors_files);
+  CHECK(ok) << "Could not load list of descriptors files";
+
+  std::vector<std::string>::const_iterator file;
+  for (file = descriptors_files.begin();
+       file != descriptors_files.end();
+       ++file) {
+    DescriptorMatrixReader reader;
+    DescriptorMatrix descriptors;
+    ok = load(*file, descriptors, reader);
+    CHECK(ok) << "Could not load descriptors \"" << *file << "\"";
+
+    DescriptorMatrix codes;
+    if (!descriptors.empty()) {
+      quantizer.encode(descriptors, codes);
+    }
+
+    std::string codes_file = makeProductCodesFilename(*file);
+    MatrixWriter writer;
+    ok = save(codes_file, codes.mat(), writer);
+    CHECK(ok) << "Could not save codes \"" << codes_file << "\"";
+    DLOG(INFO) << "Encoded " << descriptors.rows() << " descriptors";
+  }
+
+  return 0;
+}
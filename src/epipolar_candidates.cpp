@@ -0,0 +1,166 @@
+#include "epipolar_candidates.hpp"
+#include <set>
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include <glog/logging.h>
+#include "distortion.hpp"
+#include "util.hpp"
+
+// Greatest distance in pixels between a keypoint's epipolar line and the line
+// which is searched instead.
+const double EPIPOLAR_LINE_OFFSET = 0.5;
+
+EpipolarCandidateFinder::EpipolarCandidateFinder(
+    const CameraProperties& camera1,
+    const CameraProperties& camera2,
+    const cv::Matx33d& F,
+    const std::vector<cv::Point2d>& points2,
+    double band_width)
+    : camera1_(&camera1),
+      table1_(camera1.undistortionTable()),
+      lines_(camera2, F, EPIPOLAR_LINE_OFFSET),
+      points2_(points2),
+      band_width_(band_width),
+      cell_size_(std::max(band_width, 1.)),
+      grid_size_(),
+      cells_() {
+  grid_size_ = cv::Size(
+      std::ceil(camera2.image_size.width / cell_size_) + 1,
+      std::ceil(camera2.image_size.height / cell_size_) + 1);
+  cells_.assign(grid_size_.area(), std::vector<int>());
+
+  int num_points = points2_.size();
+  for (int j = 0; j < num_points; j += 1) {
+    int index = cellIndex(cellOf(points2_[j]));
+    if (index >= 0) {
+      cells_[index].push_back(j);
+    }
+  }
+}
+
+cv::Point EpipolarCandidateFinder::cellOf(const cv::Point2d& point) const {
+  return cv::Point(std::floor(point.x / cell_size_),
+      std::floor(point.y / cell_size_));
+}
+
+bool EpipolarCandidateFinder::nearLine(
+    const cv::Point2d& point,
+    const cv::Point& cell,
+    const std::map<int, std::vector<cv::Point> >& line_cells,
+    double squared_band) const {
+  for (int v = -1; v <= 1; v += 1) {
+    for (int u = -1; u <= 1; u += 1) {
+      int index = cellIndex(cell + cv::Point(u, v));
+      std::map<int, std::vector<cv::Point> >::const_iterator pixels =
+          line_cells.find(index);
+      if (index < 0 || pixels == line_cells.end()) {
+        continue;
+      }
+
+      std::vector<cv::Point>::const_iterator pixel;
+      for (pixel = pixels->second.begin();
+           pixel != pixels->second.end();
+           ++pixel) {
+        cv::Point2d delta = point - cv::Point2d(*pixel);
+        if (delta.dot(delta) <= squared_band) {
+          return true;
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+int EpipolarCandidateFinder::cellIndex(const cv::Point& cell) const {
+  if (cell.x < 0 || cell.x >= grid_size_.width ||
+      cell.y < 0 || cell.y >= grid_size_.height) {
+    return -1;
+  }
+  return cell.y * grid_size_.width + cell.x;
+}
+
+void EpipolarCandidateFinder::find(const cv::Point2d& point1,
+                                   std::vector<int>& candidates) const {
+  std::vector<std::vector<int> > all_candidates;
+  find(std::vector<cv::Point2d>(1, point1), all_candidates);
+  candidates.swap(all_candidates.front());
+}
+
+void EpipolarCandidateFinder::find(
+    const std::vector<cv::Point2d>& points1,
+    std::vector<std::vector<int> >& candidates) const {
+  // Undo intrinsics, undistort, and re-apply intrinsics.
+  std::vector<cv::Point2d> x1;
+  camera1_->calibrateAndUndistort(table1_, points1, x1);
+  camera1_->uncalibrate(x1, x1);
+
+  EpipolarLineSet lines;
+  lines_.compute(x1, lines);
+
+  int num_points = points1.size();
+  candidates.assign(num_points, std::vector<int>());
+  for (int i = 0; i < num_points; i += 1) {
+    findNearLine(lines.begin(i), lines.end(i), candidates[i]);
+  }
+}
+
+void EpipolarCandidateFinder::findNearLine(
+    const cv::Point* begin,
+    const cv::Point* end,
+    std::vector<int>& candidates) const {
+  candidates.clear();
+
+  // Bucket the pixels of the line by cell.
+  typedef std::map<int, std::vector<cv::Point> > PixelCells;
+  PixelCells line_cells;
+  for (const cv::Point* pixel = begin; pixel != end; ++pixel) {
+    int index = cellIndex(cellOf(*pixel));
+    if (index >= 0) {
+      line_cells[index].push_back(*pixel);
+    }
+  }
+
+  // Any point within the band of a pixel is in a neighbouring cell, since
+  // cells are at least as large as the band.
+  std::set<int> visited;
+  PixelCells::const_iterator line_cell;
+  for (line_cell = line_cells.begin();
+       line_cell != line_cells.end();
+       ++line_cell) {
+    cv::Point cell(line_cell->first % grid_size_.width,
+        line_cell->first / grid_size_.width);
+
+    for (int v = -1; v <= 1; v += 1) {
+      for (int u = -1; u <= 1; u += 1) {
+        int index = cellIndex(cell + cv::Point(u, v));
+        if (index >= 0) {
+          visited.insert(index);
+        }
+      }
+    }
+  }
+
+  double squared_band = band_width_ * band_width_;
+  std::set<int>::const_iterator index;
+  for (index = visited.begin(); index != visited.end(); ++index) {
+    const std::vector<int>& cell_points = cells_[*index];
+    cv::Point cell(*index % grid_size_.width, *index / grid_size_.width);
+
+    std::vector<int>::const_iterator j;
+    for (j = cell_points.begin(); j != cell_points.end(); ++j) {
+      if (nearLine(points2_[*j], cell, line_cells, squared_band)) {
+        candidates.push_back(*j);
+      }
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end());
+}
+
+void findEpipolarCandidates(const EpipolarCandidateFinder& finder,
+                            const std::vector<cv::Point2d>& points1,
+                            std::vector<std::vector<int> >& candidates) {
+  finder.find(points1, candidates);
+}
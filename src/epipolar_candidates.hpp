@@ -0,0 +1,64 @@
+#ifndef EPIPOLAR_CANDIDATES_HPP_
+#define EPIPOLAR_CANDIDATES_HPP_
+
+#include <vector>
+#include <map>
+#include <opencv2/core/core.hpp>
+#include "camera_properties.hpp"
+#include "distortion.hpp"
+#include "distorted_epipolar_lines.hpp"
+
+// Finds the keypoints in the second image which could match a keypoint in the
+// first, being within a band around its distorted epipolar line.
+//
+// Keypoints in the second image are bucketed into a grid of cells the size of
+// the band, so that only cells which the line passes near are examined. Lines
+// come from a DistortedEpipolarLineIndex, so that points whose lines are the
+// same to within half a pixel share one rasterization.
+class EpipolarCandidateFinder {
+  public:
+    // Keypoints are in uncalibrated, distorted image co-ordinates.
+    EpipolarCandidateFinder(const CameraProperties& camera1,
+                            const CameraProperties& camera2,
+                            const cv::Matx33d& F,
+                            const std::vector<cv::Point2d>& points2,
+                            double band_width);
+
+    // Returns the indices of keypoints in ascending order.
+    void find(const cv::Point2d& point1, std::vector<int>& candidates) const;
+    // Finds the candidates of many keypoints together.
+    void find(const std::vector<cv::Point2d>& points1,
+              std::vector<std::vector<int> >& candidates) const;
+
+  private:
+    // Finds the keypoints near the pixels [begin, end) of a line.
+    void findNearLine(const cv::Point* begin,
+                      const cv::Point* end,
+                      std::vector<int>& candidates) const;
+    cv::Point cellOf(const cv::Point2d& point) const;
+    // Returns -1 if the cell is outside the grid.
+    int cellIndex(const cv::Point& cell) const;
+    // Checks the pixels of the line in the neighbourhood of a cell.
+    bool nearLine(const cv::Point2d& point,
+                  const cv::Point& cell,
+                  const std::map<int, std::vector<cv::Point> >& line_cells,
+                  double squared_band) const;
+
+    const CameraProperties* camera1_;
+    // Built once rather than for every call to find().
+    UndistortionTable table1_;
+    DistortedEpipolarLineIndex lines_;
+    std::vector<cv::Point2d> points2_;
+    double band_width_;
+    double cell_size_;
+    cv::Size grid_size_;
+    // Keypoint indices in each cell.
+    std::vector<std::vector<int> > cells_;
+};
+
+// Finds the candidates of every keypoint in the first image.
+void findEpipolarCandidates(const EpipolarCandidateFinder& finder,
+                            const std::vector<cv::Point2d>& points1,
+                            std::vector<std::vector<int> >& candidates);
+
+#endif
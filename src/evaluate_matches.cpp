@@ -10,8 +10,16 @@
 #include "iterator_reader.hpp"
 #include "matrix_reader.hpp"
 #include "optimal_triangulation.hpp"
+#include "geometry.hpp"
 #include "iterator_writer.hpp"
 #include "default_writer.hpp"
+#include "util/thread-pool.hpp"
+
+DEFINE_int32(num_threads, 4,
+    "Number of worker threads to triangulate with, 0 for none");
+DEFINE_bool(sampson, false,
+    "Use the Sampson approximation of the triangulation residual? It is a "
+    "first-order approximation which is much faster to compute.");
 
 typedef std::vector<Match> MatchList;
 
@@ -61,28 +69,54 @@ int main(int argc, char** argv) {
   CHECK(ok) << "Could not load points";
 
   // Load fundamental matrix.
-  cv::Mat F;
+  cv::Mat F_mat;
   MatrixReader matrix_reader;
-  ok = load(fund_mat_file, F, matrix_reader);
+  ok = load(fund_mat_file, F_mat, matrix_reader);
   CHECK(ok) << "Could not load fundamental matrix";
+  cv::Matx33d F = F_mat;
 
-  // Place where all the scores will go.
   std::vector<double> residuals;
 
-  for (MatchList::const_iterator match = matches.begin();
-       match != matches.end();
-       ++match) {
-    // Extract pair of points.
-    CHECK(match->first < int(points1.size())) << "Out of bounds";
-    CHECK(match->second < int(points2.size())) << "Out of bounds";
-    cv::Point2d point1 = points1[match->first];
-    cv::Point2d point2 = points2[match->second];
+  if (FLAGS_sampson) {
+    // Gather the co-ordinates of the pairs into separate arrays.
+    int num_matches = matches.size();
+    std::vector<double> x1(num_matches);
+    std::vector<double> y1(num_matches);
+    std::vector<double> x2(num_matches);
+    std::vector<double> y2(num_matches);
+    for (int i = 0; i < num_matches; i += 1) {
+      const Match& match = matches[i];
+      CHECK(match.first < int(points1.size())) << "Out of bounds";
+      CHECK(match.second < int(points2.size())) << "Out of bounds";
+      x1[i] = points1[match.first].x;
+      y1[i] = points1[match.first].y;
+      x2[i] = points2[match.second].x;
+      y2[i] = points2[match.second].y;
+    }
 
-    // Perform optimal 2-view triangulation and record residual.
-    double residual = optimalTriangulation(point1, point2, F);
+    residuals.resize(num_matches);
+    if (num_matches > 0) {
+      sampsonErrors(F, &x1.front(), &y1.front(), &x2.front(), &y2.front(),
+          num_matches, &residuals.front());
+    }
+  } else {
+    // Extract pairs of points.
+    std::vector<cv::Point2d> match_points1;
+    std::vector<cv::Point2d> match_points2;
+    match_points1.reserve(matches.size());
+    match_points2.reserve(matches.size());
+    for (MatchList::const_iterator match = matches.begin();
+         match != matches.end();
+         ++match) {
+      CHECK(match->first < int(points1.size())) << "Out of bounds";
+      CHECK(match->second < int(points2.size())) << "Out of bounds";
+      match_points1.push_back(points1[match->first]);
+      match_points2.push_back(points2[match->second]);
+    }
 
-    // Add score to list.
-    residuals.push_back(residual);
+    // Perform optimal 2-view triangulation and record residuals.
+    ThreadPool pool(FLAGS_num_threads);
+    optimalTriangulation(match_points1, match_points2, F, residuals, pool);
   }
 
   DefaultWriter<double> number_writer;
@@ -0,0 +1,442 @@
+#include "exact_matcher.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <utility>
+#include <glog/logging.h>
+#include "half_float.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// 64 x 1024 floats of distances is 256KB, which fits in L2 cache along with
+// the blocks of descriptors.
+const int QUERY_BLOCK_SIZE = 64;
+const int TRAIN_BLOCK_SIZE = 1024;
+
+// Dimensions summed between tests of the partial distance against the
+// radius. Testing more often costs more than the work it saves.
+const int ABANDON_BLOCK_SIZE = 16;
+
+// Squared radii beyond this fraction of the mean squared distance between
+// descriptors abandon too few pairs early to be faster than the product.
+const double MAX_ABANDONING_RADIUS = 0.5;
+
+void computeSquaredNorms(const cv::Mat& rows, std::vector<float>& norms) {
+  norms.resize(rows.rows);
+  for (int i = 0; i < rows.rows; i += 1) {
+    norms[i] = rows.row(i).dot(rows.row(i));
+  }
+}
+
+// Returns rows of any descriptor type as floats. Other types are widened
+// into the buffer, which is re-used if it is large enough.
+cv::Mat toFloatBlock(const cv::Mat& rows, cv::Mat& buffer) {
+  if (rows.type() == cv::DataType<float>::type) {
+    return rows;
+  }
+
+  buffer.create(rows.rows, rows.cols, cv::DataType<float>::type);
+  if (rows.type() == DescriptorMatrix::HALF_TYPE) {
+    for (int i = 0; i < rows.rows; i += 1) {
+      const HalfFloat* in = rows.ptr<HalfFloat>(i);
+      float* out = buffer.ptr<float>(i);
+      for (int j = 0; j < rows.cols; j += 1) {
+        out[j] = in[j];
+      }
+    }
+  } else {
+    rows.convertTo(buffer, cv::DataType<float>::type);
+  }
+  return buffer;
+}
+
+// Calls visitor(i, j, squared_distance) for every query i and train j.
+// The rows may be of any descriptor type.
+template<class Visitor>
+void visitSquaredDistances(const cv::Mat& query,
+                           const float* query_norms,
+                           const cv::Mat& train,
+                           const float* train_norms,
+                           Visitor& visitor) {
+  // Re-used for every pair of blocks.
+  cv::Mat products;
+  cv::Mat query_buffer;
+  cv::Mat train_buffer;
+
+  for (int q0 = 0; q0 < query.rows; q0 += QUERY_BLOCK_SIZE) {
+    int q1 = std::min(q0 + QUERY_BLOCK_SIZE, query.rows);
+    cv::Mat query_block = toFloatBlock(query.rowRange(q0, q1), query_buffer);
+
+    for (int t0 = 0; t0 < train.rows; t0 += TRAIN_BLOCK_SIZE) {
+      int t1 = std::min(t0 + TRAIN_BLOCK_SIZE, train.rows);
+      cv::Mat train_block = toFloatBlock(train.rowRange(t0, t1),
+          train_buffer);
+
+      // -2 a.b for the block.
+      cv::gemm(query_block, train_block, -2., cv::noArray(), 0., products,
+          cv::GEMM_2_T);
+
+      for (int i = q0; i < q1; i += 1) {
+        const float* product = products.ptr<float>(i - q0);
+        float query_norm = query_norms[i];
+
+        for (int j = t0; j < t1; j += 1) {
+          // Rounding can make the distance slightly negative.
+          float distance = std::max(
+              query_norm + train_norms[j] + product[j - t0], 0.f);
+          visitor(i, j, distance);
+        }
+      }
+    }
+  }
+}
+
+// Orders the dimensions of the descriptors by decreasing variance, so that
+// partial distances grow as fast as possible. For descriptors which have
+// been projected by PCA this is the order of the components. Returns the
+// total variance, half the mean squared distance between descriptors.
+double orderByVariance(const DescriptorMatrix& train,
+                       std::vector<int>& order) {
+  int n = train.cols();
+  std::vector<double> sums(n, 0.);
+  std::vector<double> squares(n, 0.);
+
+  cv::Mat buffer;
+  for (int t0 = 0; t0 < train.rows(); t0 += TRAIN_BLOCK_SIZE) {
+    int t1 = std::min(t0 + TRAIN_BLOCK_SIZE, train.rows());
+    cv::Mat block = train.toFloat(t0, t1, buffer);
+    for (int i = 0; i < block.rows; i += 1) {
+      const float* row = block.ptr<float>(i);
+      for (int d = 0; d < n; d += 1) {
+        sums[d] += row[d];
+        squares[d] += double(row[d]) * double(row[d]);
+      }
+    }
+  }
+
+  // Variance is (sum(x^2) - sum(x)^2 / m) / m.
+  int m = std::max(train.rows(), 1);
+  std::vector<std::pair<double, int> > variances(n);
+  double total = 0;
+  for (int d = 0; d < n; d += 1) {
+    double variance = (squares[d] - sums[d] * sums[d] / m) / m;
+    variances[d] = std::make_pair(variance, d);
+    total += variance;
+  }
+  // Stable so that equal variances keep their original order.
+  std::stable_sort(variances.begin(), variances.end(),
+      std::greater<std::pair<double, int> >());
+
+  order.resize(n);
+  for (int d = 0; d < n; d += 1) {
+    order[d] = variances[d].second;
+  }
+  return total;
+}
+
+// Copies the columns of rows of elements T into the given order.
+template<class T>
+void permuteColumns(const cv::Mat& rows,
+                    const std::vector<int>& order,
+                    cv::Mat& permuted) {
+  permuted.create(rows.rows, rows.cols, rows.type());
+  for (int i = 0; i < rows.rows; i += 1) {
+    const T* row = rows.ptr<T>(i);
+    T* output = permuted.ptr<T>(i);
+    for (int d = 0; d < rows.cols; d += 1) {
+      output[d] = row[order[d]];
+    }
+  }
+}
+
+// Permutes rows of any descriptor type, keeping their type.
+void permuteDescriptorColumns(const cv::Mat& rows,
+                              const std::vector<int>& order,
+                              cv::Mat& permuted) {
+  if (rows.type() == cv::DataType<float>::type) {
+    permuteColumns<float>(rows, order, permuted);
+  } else if (rows.type() == DescriptorMatrix::HALF_TYPE) {
+    permuteColumns<HalfFloat>(rows, order, permuted);
+  } else {
+    permuteColumns<uchar>(rows, order, permuted);
+  }
+}
+
+// Computes |x - y|^2, or returns some partial sum greater than the limit as
+// soon as one is found. Blocks of dimensions are summed before each test.
+float abandoningSquaredDistance(const float* x,
+                                const float* y,
+                                int n,
+                                float limit) {
+  float distance = 0;
+  int d = 0;
+
+  for (; d + ABANDON_BLOCK_SIZE <= n; d += ABANDON_BLOCK_SIZE) {
+#ifdef __SSE2__
+    __m128 sums = _mm_setzero_ps();
+    for (int k = 0; k < ABANDON_BLOCK_SIZE; k += 4) {
+      __m128 e = _mm_sub_ps(_mm_loadu_ps(x + d + k), _mm_loadu_ps(y + d + k));
+      sums = _mm_add_ps(sums, _mm_mul_ps(e, e));
+    }
+    float partial[4];
+    _mm_storeu_ps(partial, sums);
+#else
+    float partial[4] = { 0, 0, 0, 0 };
+    for (int k = 0; k < ABANDON_BLOCK_SIZE; k += 4) {
+      for (int j = 0; j < 4; j += 1) {
+        float e = x[d + k + j] - y[d + k + j];
+        partial[j] += e * e;
+      }
+    }
+#endif
+    distance += (partial[0] + partial[1]) + (partial[2] + partial[3]);
+    if (distance > limit) {
+      return distance;
+    }
+  }
+
+  for (; d < n; d += 1) {
+    float e = x[d] - y[d];
+    distance += e * e;
+  }
+  return distance;
+}
+
+// Keeps the k smallest squared distances for each query in sorted arrays.
+class KnnVisitor {
+  public:
+    KnnVisitor(int num_queries, int k)
+        : k_(k),
+          counts_(num_queries, 0),
+          distances_(num_queries * k),
+          indices_(num_queries * k) {}
+
+    void operator()(int i, int j, float distance) {
+      float* distances = &distances_[i * k_];
+      int* indices = &indices_[i * k_];
+      int& count = counts_[i];
+
+      if (count == k_ && distance >= distances[k_ - 1]) {
+        return;
+      }
+
+      // Insertion into the sorted list.
+      int n = std::min(count, k_ - 1);
+      while (n > 0 && distances[n - 1] > distance) {
+        distances[n] = distances[n - 1];
+        indices[n] = indices[n - 1];
+        n -= 1;
+      }
+      distances[n] = distance;
+      indices[n] = j;
+      count = std::min(count + 1, k_);
+    }
+
+    void extract(MatchSink& matches) const {
+      int num_queries = counts_.size();
+      matches.begin(num_queries);
+
+      for (int i = 0; i < num_queries; i += 1) {
+        for (int n = 0; n < counts_[i]; n += 1) {
+          matches.add(i, indices_[i * k_ + n],
+              std::sqrt(distances_[i * k_ + n]));
+        }
+      }
+
+      matches.end();
+    }
+
+  private:
+    int k_;
+    std::vector<int> counts_;
+    std::vector<float> distances_;
+    std::vector<int> indices_;
+};
+
+// Keeps every match within a squared radius in one flat buffer.
+class RadiusVisitor {
+  public:
+    RadiusVisitor(int num_queries, double radius)
+        : num_queries_(num_queries),
+          squared_radius_(radius * radius),
+          matches_() {}
+
+    void operator()(int i, int j, float distance) {
+      if (distance <= squared_radius_) {
+        matches_.push_back(Match(i, distance, j));
+      }
+    }
+
+    void extract(MatchSink& matches) {
+      // Order by query, then distance.
+      std::sort(matches_.begin(), matches_.end());
+
+      matches.begin(num_queries_);
+      std::vector<Match>::const_iterator match;
+      for (match = matches_.begin(); match != matches_.end(); ++match) {
+        matches.add(match->query, match->train, std::sqrt(match->distance));
+      }
+      matches.end();
+    }
+
+  private:
+    struct Match {
+      int query;
+      float distance;
+      int train;
+
+      Match(int query, float distance, int train)
+          : query(query), distance(distance), train(train) {}
+
+      bool operator<(const Match& other) const {
+        if (query != other.query) {
+          return query < other.query;
+        }
+        return distance < other.distance;
+      }
+    };
+
+    int num_queries_;
+    float squared_radius_;
+    std::vector<Match> matches_;
+};
+
+// Visits each distance once for both the rows and the columns.
+template<class Visitor>
+class BothDirectionsVisitor {
+  public:
+    BothDirectionsVisitor(Visitor& forward, Visitor& reverse)
+        : forward_(&forward), reverse_(&reverse) {}
+
+    void operator()(int i, int j, float distance) {
+      (*forward_)(i, j, distance);
+      (*reverse_)(j, i, distance);
+    }
+
+  private:
+    Visitor* forward_;
+    Visitor* reverse_;
+};
+
+}
+
+ExactMatcher::ExactMatcher(const DescriptorMatrix& train)
+    : train_(train), order_(), permuted_(), mean_squared_distance_(0) {
+  if (!train_.hasNorms()) {
+    train_.computeNorms();
+  }
+
+  mean_squared_distance_ = 2 * orderByVariance(train_, order_);
+  permuteDescriptorColumns(train_.mat(), order_, permuted_);
+}
+
+int ExactMatcher::size() const {
+  return train_.rows();
+}
+
+int ExactMatcher::cols() const {
+  return train_.cols();
+}
+
+void ExactMatcher::knnMatch(const cv::Mat& query,
+                            MatchSink& matches,
+                            int k) const {
+  CHECK(query.cols == train_.cols()) << "Descriptors differ in size";
+  CHECK(k > 0);
+
+  CHECK(query.type() == cv::DataType<float>::type);
+  std::vector<float> query_norms;
+  computeSquaredNorms(query, query_norms);
+
+  KnnVisitor visitor(query.rows, std::max(std::min(k, size()), 1));
+  visitSquaredDistances(query,
+      query_norms.empty() ? NULL : &query_norms.front(), train_.mat(),
+      train_.norms(), visitor);
+  visitor.extract(matches);
+}
+
+void ExactMatcher::radiusMatch(const cv::Mat& query,
+                               MatchSink& matches,
+                               double radius) const {
+  CHECK(query.cols == train_.cols()) << "Descriptors differ in size";
+  CHECK(query.type() == cv::DataType<float>::type);
+
+  RadiusVisitor visitor(query.rows, radius);
+
+  if (radius * radius > MAX_ABANDONING_RADIUS * mean_squared_distance_) {
+    std::vector<float> query_norms;
+    computeSquaredNorms(query, query_norms);
+    visitSquaredDistances(query,
+        query_norms.empty() ? NULL : &query_norms.front(), train_.mat(),
+        train_.norms(), visitor);
+    visitor.extract(matches);
+    return;
+  }
+
+  // Both sides in the same order of dimensions, which leaves distances
+  // unchanged.
+  cv::Mat permuted_query;
+  permuteColumns<float>(query, order_, permuted_query);
+
+  // Partial sums of squares never decrease, even when rounded, so one beyond
+  // the radius is never kept.
+  float limit = float(radius * radius);
+  int n = train_.cols();
+
+  // Re-used for every block.
+  cv::Mat buffer;
+
+  for (int t0 = 0; t0 < train_.rows(); t0 += TRAIN_BLOCK_SIZE) {
+    int t1 = std::min(t0 + TRAIN_BLOCK_SIZE, train_.rows());
+    cv::Mat block = toFloatBlock(permuted_.rowRange(t0, t1), buffer);
+
+    for (int i = 0; i < permuted_query.rows; i += 1) {
+      const float* x = permuted_query.ptr<float>(i);
+      for (int j = t0; j < t1; j += 1) {
+        float distance = abandoningSquaredDistance(x,
+            block.ptr<float>(j - t0), n, limit);
+        visitor(i, j, distance);
+      }
+    }
+  }
+
+  visitor.extract(matches);
+}
+
+void ExactMatcher::knnMatchBothDirections(const ExactMatcher& other,
+                                          MatchSink& forward,
+                                          MatchSink& reverse,
+                                          int k) const {
+  CHECK(cols() == other.cols()) << "Descriptors differ in size";
+  CHECK(k > 0);
+
+  KnnVisitor forward_visitor(size(), std::max(std::min(k, other.size()), 1));
+  KnnVisitor reverse_visitor(other.size(), std::max(std::min(k, size()), 1));
+  BothDirectionsVisitor<KnnVisitor> visitor(forward_visitor, reverse_visitor);
+  visitSquaredDistances(train_.mat(), train_.norms(), other.train_.mat(),
+      other.train_.norms(), visitor);
+
+  forward_visitor.extract(forward);
+  reverse_visitor.extract(reverse);
+}
+
+void ExactMatcher::radiusMatchBothDirections(const ExactMatcher& other,
+                                             MatchSink& forward,
+                                             MatchSink& reverse,
+                                             double radius) const {
+  CHECK(cols() == other.cols()) << "Descriptors differ in size";
+
+  RadiusVisitor forward_visitor(size(), radius);
+  RadiusVisitor reverse_visitor(other.size(), radius);
+  BothDirectionsVisitor<RadiusVisitor> visitor(forward_visitor,
+      reverse_visitor);
+  visitSquaredDistances(train_.mat(), train_.norms(), other.train_.mat(),
+      other.train_.norms(), visitor);
+
+  forward_visitor.extract(forward);
+  reverse_visitor.extract(reverse);
+}
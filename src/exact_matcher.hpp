@@ -0,0 +1,66 @@
+#ifndef EXACT_MATCHER_HPP_
+#define EXACT_MATCHER_HPP_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "descriptor_matrix.hpp"
+#include "match_sink.hpp"
+
+// Exact nearest-neighbour search by brute force.
+//
+// Squared distances between blocks of queries and descriptors are computed as
+// |a|^2 + |b|^2 - 2 a.b using a matrix product, which is far faster than
+// comparing one pair of rows at a time. The blocks are sized to stay in
+// cache and only the best matches of each query are kept, so the full
+// distance matrix is never stored.
+//
+// radiusMatch() instead sums the squared differences of each pair directly,
+// in order of decreasing variance of the dimensions, and abandons a pair as
+// soon as the partial sum exceeds the radius. Most pairs are far apart, so
+// for small radii few dimensions are read before they are abandoned. The
+// order is found, and a copy of the descriptors permuted into it, when the
+// matcher is constructed. Radii which are large compared to the typical
+// distance between descriptors abandon few pairs, and use the product.
+//
+// Descriptors may be of any type of DescriptorMatrix, and queries are floats.
+// Blocks of halves and bytes are widened to floats as they are read, so the
+// product is always a gemm, while the stored descriptors keep their size.
+// The norms stored with the descriptors are used if there are any. Distances
+// are Euclidean.
+class ExactMatcher {
+  public:
+    explicit ExactMatcher(const DescriptorMatrix& train);
+
+    int size() const;
+    int cols() const;
+
+    // Finds the k nearest descriptors to each row.
+    void knnMatch(const cv::Mat& query, MatchSink& matches, int k) const;
+    // Finds all descriptors within a radius of each row.
+    void radiusMatch(const cv::Mat& query,
+                     MatchSink& matches,
+                     double radius) const;
+
+    // Matches these descriptors against another set's and the other set's
+    // against these, computing every distance only once.
+    void knnMatchBothDirections(const ExactMatcher& other,
+                                MatchSink& forward,
+                                MatchSink& reverse,
+                                int k) const;
+    void radiusMatchBothDirections(const ExactMatcher& other,
+                                   MatchSink& forward,
+                                   MatchSink& reverse,
+                                   double radius) const;
+
+  private:
+    // Has norms.
+    DescriptorMatrix train_;
+    // Dimensions in order of decreasing variance, and the descriptors with
+    // their columns in that order, of the same type.
+    std::vector<int> order_;
+    cv::Mat permuted_;
+    // Mean over pairs of descriptors.
+    double mean_squared_distance_;
+};
+
+#endif
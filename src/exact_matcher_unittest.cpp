@@ -0,0 +1,142 @@
+#include "exact_matcher.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "descriptor_matrix.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+typedef std::vector<cv::DMatch> RawMatchList;
+
+const int NUM_TRAIN = 300;
+const int NUM_QUERIES = 25;
+// Two blocks of abandoning and a tail.
+const int DIMENSION = 40;
+
+const int NUM_CLUSTERS = 10;
+
+// Rows near the centres of clusters, in integers which fit in bytes. Each
+// dimension has a different spread, so that the order of decreasing variance
+// is not the original order. Pairs in the same cluster are much nearer than
+// the mean distance, as true matches are, so small radii abandon most pairs.
+cv::Mat randomRows(int rows, int seed) {
+  cv::RNG centre_rng(0);
+  cv::Mat centres(NUM_CLUSTERS, DIMENSION, cv::DataType<float>::type);
+  for (int k = 0; k < NUM_CLUSTERS; k += 1) {
+    for (int d = 0; d < DIMENSION; d += 1) {
+      double spread = 4 + (d * 7) % 40;
+      centres.at<float>(k, d) = 128 + centre_rng.uniform(-spread, spread);
+    }
+  }
+
+  cv::Mat x(rows, DIMENSION, cv::DataType<float>::type);
+  cv::RNG rng(seed);
+  for (int i = 0; i < rows; i += 1) {
+    for (int d = 0; d < DIMENSION; d += 1) {
+      x.at<float>(i, d) = std::floor(centres.at<float>(i % NUM_CLUSTERS, d) +
+          rng.uniform(-3., 3.));
+    }
+  }
+  return x;
+}
+
+double distance(const cv::Mat& x, int i, const cv::Mat& y, int j) {
+  double sum = 0;
+  for (int d = 0; d < x.cols; d += 1) {
+    double e = double(x.at<float>(i, d)) - double(y.at<float>(j, d));
+    sum += e * e;
+  }
+  return std::sqrt(sum);
+}
+
+// The distance below which a fraction of all pairs lie.
+double distanceQuantile(const cv::Mat& query, const cv::Mat& train, double q) {
+  std::vector<double> distances;
+  for (int i = 0; i < query.rows; i += 1) {
+    for (int j = 0; j < train.rows; j += 1) {
+      distances.push_back(distance(query, i, train, j));
+    }
+  }
+  std::sort(distances.begin(), distances.end());
+  return distances[int(q * (distances.size() - 1))];
+}
+
+// Expects every pair within the radius, and no other, in order of distance.
+// Pairs within rounding of the radius may be either.
+void expectRadiusMatches(const cv::Mat& query,
+                         const DescriptorMatrix& train,
+                         double radius) {
+  ExactMatcher matcher(train);
+  std::vector<RawMatchList> matches;
+  RawMatchListSink sink(matches);
+  matcher.radiusMatch(query, sink, radius);
+  ASSERT_EQ(query.rows, int(matches.size()));
+
+  cv::Mat train_floats = train.toFloat();
+  const double EPSILON = 1e-3 * radius;
+
+  for (int i = 0; i < query.rows; i += 1) {
+    std::vector<bool> found(train.rows(), false);
+    for (int n = 0; n < int(matches[i].size()); n += 1) {
+      const cv::DMatch& match = matches[i][n];
+      double expected = distance(query, i, train_floats, match.trainIdx);
+      EXPECT_NEAR(expected, match.distance, EPSILON);
+      EXPECT_LE(expected, radius + EPSILON);
+      if (n > 0) {
+        EXPECT_LE(matches[i][n - 1].distance, match.distance);
+      }
+      found[match.trainIdx] = true;
+    }
+
+    for (int j = 0; j < train.rows(); j += 1) {
+      if (distance(query, i, train_floats, j) < radius - EPSILON) {
+        EXPECT_TRUE(found[j]) << "Query " << i << ", train " << j;
+      }
+    }
+  }
+}
+
+// Radii within clusters abandon pairs, larger ones use the product.
+void expectRadiusMatchesForEveryRadius(const DescriptorMatrix& train) {
+  cv::Mat query = randomRows(NUM_QUERIES, 2);
+  cv::Mat train_floats = train.toFloat();
+  double quantiles[] = { 0, 0.01, 0.05, 0.2, 0.6, 1 };
+  for (int k = 0; k < int(sizeof(quantiles) / sizeof(quantiles[0])); k += 1) {
+    double radius = distanceQuantile(query, train_floats, quantiles[k]);
+    SCOPED_TRACE(quantiles[k]);
+    expectRadiusMatches(query, train, radius);
+  }
+}
+
+}
+
+TEST(ExactMatcher, RadiusMatchIsBruteForce) {
+  DescriptorMatrix train;
+  copyToDescriptorMatrix(randomRows(NUM_TRAIN, 1), train, CV_32F);
+  expectRadiusMatchesForEveryRadius(train);
+}
+
+TEST(ExactMatcher, RadiusMatchOfHalvesIsBruteForce) {
+  DescriptorMatrix train;
+  copyToDescriptorMatrix(randomRows(NUM_TRAIN, 1), train,
+      DescriptorMatrix::HALF_TYPE);
+  expectRadiusMatchesForEveryRadius(train);
+}
+
+TEST(ExactMatcher, RadiusMatchOfBytesIsBruteForce) {
+  DescriptorMatrix train;
+  copyToDescriptorMatrix(randomRows(NUM_TRAIN, 1), train, CV_8U);
+  expectRadiusMatchesForEveryRadius(train);
+}
+
+TEST(ExactMatcher, RadiusMatchWithoutTrainFindsNothing) {
+  DescriptorMatrix train(0, DIMENSION);
+  ExactMatcher matcher(train);
+  std::vector<RawMatchList> matches;
+  RawMatchListSink sink(matches);
+  matcher.radiusMatch(randomRows(3, 2), sink, 10);
+  ASSERT_EQ(3u, matches.size());
+  EXPECT_TRUE(matches[0].empty());
+}
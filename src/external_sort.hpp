@@ -0,0 +1,72 @@
+#ifndef EXTERNAL_SORT_HPP_
+#define EXTERNAL_SORT_HPP_
+
+#include <cstdio>
+#include <vector>
+
+// Sorts more records than fit in memory.
+//
+// Records are buffered up to a budget in bytes. Each full buffer is sorted
+// and written to an anonymous temporary file as a run, and the runs are
+// merged as the records are read back in order. If no buffer filled, the
+// records are sorted in memory and nothing is written. Too many runs are
+// merged into one before more are written. Records are copied
+// byte for byte, so they must not own memory.
+template<class T, class Compare>
+class ExternalSorter {
+  public:
+    ExternalSorter(size_t budget, Compare compare);
+    ~ExternalSorter();
+
+    void add(const T& record);
+    // Ends adding. Returns false if a run could not be written.
+    bool finish();
+    // Returns false after the last record, or if a run could not be read.
+    bool next(T& record);
+
+    // Number of records added.
+    size_t size() const;
+    // Number of runs written to disk.
+    int numRuns() const;
+
+  private:
+    struct Run {
+      std::FILE* file;
+      // Records read from the file but not yet merged.
+      std::vector<T> block;
+      size_t position;
+    };
+
+    bool spill();
+    // Merges every run into one, so that fewer files are open.
+    bool mergeRuns();
+    // Reads the first block of every run.
+    void startMerge();
+    bool nextMerged(T& record);
+    // Refills the block of a run. Returns false if the run is exhausted.
+    bool refill(Run& run);
+    // Orders runs so that the top of a heap has the least head.
+    bool laterRun(int lhs, int rhs) const;
+    void pushRun(int run);
+    void popRun();
+
+    size_t capacity_;
+    Compare compare_;
+    std::vector<T> buffer_;
+    size_t size_;
+    bool ok_;
+
+    std::vector<Run> runs_;
+    // Heap of the runs which have records left, by their next record.
+    std::vector<int> heap_;
+    // Position in the buffer when nothing was spilled.
+    size_t position_;
+
+    // Non-copyable.
+    ExternalSorter(const ExternalSorter&);
+    ExternalSorter& operator=(const ExternalSorter&);
+};
+
+#include "external_sort.inl"
+
+#endif
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <glog/logging.h>
+
+// Runs are merged into one when there would be more open files than this.
+const int EXTERNAL_SORT_MAX_RUNS = 256;
+
+template<class T, class Compare>
+ExternalSorter<T, Compare>::ExternalSorter(size_t budget, Compare compare)
+    : capacity_(std::max(budget / sizeof(T), size_t(1))),
+      compare_(compare),
+      buffer_(),
+      size_(0),
+      ok_(true),
+      runs_(),
+      heap_(),
+      position_(0) {}
+
+template<class T, class Compare>
+ExternalSorter<T, Compare>::~ExternalSorter() {
+  typename std::vector<Run>::iterator run;
+  for (run = runs_.begin(); run != runs_.end(); ++run) {
+    std::fclose(run->file);
+  }
+}
+
+template<class T, class Compare>
+void ExternalSorter<T, Compare>::add(const T& record) {
+  if (buffer_.size() == capacity_) {
+    ok_ = spill() && ok_;
+  }
+  buffer_.push_back(record);
+  size_ += 1;
+}
+
+template<class T, class Compare>
+bool ExternalSorter<T, Compare>::spill() {
+  std::sort(buffer_.begin(), buffer_.end(), compare_);
+
+  Run run;
+  run.file = std::tmpfile();
+  run.position = 0;
+  if (run.file == NULL) {
+    LOG(WARNING) << "Could not create a temporary file to sort in";
+    return false;
+  }
+  runs_.push_back(run);
+
+  size_t n = buffer_.size();
+  bool ok = (std::fwrite(&buffer_.front(), sizeof(T), n, run.file) == n);
+  if (!ok) {
+    LOG(WARNING) << "Could not write a sorted run of " << n << " records";
+  }
+  buffer_.clear();
+
+  if (ok && int(runs_.size()) > EXTERNAL_SORT_MAX_RUNS) {
+    ok = mergeRuns();
+  }
+  return ok;
+}
+
+template<class T, class Compare>
+bool ExternalSorter<T, Compare>::finish() {
+  if (runs_.empty()) {
+    std::sort(buffer_.begin(), buffer_.end(), compare_);
+    position_ = 0;
+    return ok_;
+  }
+
+  if (!buffer_.empty()) {
+    ok_ = spill() && ok_;
+  }
+  if (!ok_) {
+    return false;
+  }
+
+  LOG(INFO) << "Merging " << size_ << " records from " << runs_.size() <<
+      " sorted runs";
+  startMerge();
+  return ok_;
+}
+
+template<class T, class Compare>
+void ExternalSorter<T, Compare>::startMerge() {
+  // The runs are read with the memory of the buffer, each an equal share.
+  std::vector<T>().swap(buffer_);
+  size_t block_size = std::max(capacity_ / runs_.size(), size_t(1));
+
+  heap_.clear();
+  for (int i = 0; i < int(runs_.size()); i += 1) {
+    Run& run = runs_[i];
+    std::rewind(run.file);
+    std::vector<T>().swap(run.block);
+    run.block.reserve(block_size);
+    if (refill(run)) {
+      pushRun(i);
+    }
+  }
+}
+
+template<class T, class Compare>
+bool ExternalSorter<T, Compare>::mergeRuns() {
+  std::FILE* file = std::tmpfile();
+  if (file == NULL) {
+    LOG(WARNING) << "Could not create a temporary file to sort in";
+    return false;
+  }
+
+  startMerge();
+  T record;
+  bool ok = true;
+  while (ok && nextMerged(record)) {
+    ok = (std::fwrite(&record, sizeof(T), 1, file) == 1);
+  }
+  ok = ok && ok_;
+  if (!ok) {
+    LOG(WARNING) << "Could not merge sorted runs";
+  }
+
+  typename std::vector<Run>::iterator run;
+  for (run = runs_.begin(); run != runs_.end(); ++run) {
+    std::fclose(run->file);
+  }
+  runs_.assign(1, Run());
+  runs_.front().file = file;
+  runs_.front().position = 0;
+  return ok;
+}
+
+template<class T, class Compare>
+bool ExternalSorter<T, Compare>::refill(Run& run) {
+  run.block.resize(run.block.capacity());
+  size_t n = std::fread(&run.block.front(), sizeof(T), run.block.size(),
+      run.file);
+  if (n < run.block.size() && std::ferror(run.file)) {
+    LOG(WARNING) << "Could not read a sorted run";
+    ok_ = false;
+  }
+  run.block.resize(n);
+  run.position = 0;
+  return n > 0;
+}
+
+template<class T, class Compare>
+bool ExternalSorter<T, Compare>::laterRun(int lhs, int rhs) const {
+  const Run& a = runs_[lhs];
+  const Run& b = runs_[rhs];
+  return compare_(b.block[b.position], a.block[a.position]);
+}
+
+template<class T, class Compare>
+void ExternalSorter<T, Compare>::pushRun(int run) {
+  // std::push_heap() would need a comparator object bound to this.
+  heap_.push_back(run);
+  size_t i = heap_.size() - 1;
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (!laterRun(heap_[parent], heap_[i])) {
+      break;
+    }
+    std::swap(heap_[parent], heap_[i]);
+    i = parent;
+  }
+}
+
+template<class T, class Compare>
+void ExternalSorter<T, Compare>::popRun() {
+  heap_.front() = heap_.back();
+  heap_.pop_back();
+
+  size_t n = heap_.size();
+  size_t i = 0;
+  while (true) {
+    size_t least = i;
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+    if (left < n && laterRun(heap_[least], heap_[left])) {
+      least = left;
+    }
+    if (right < n && laterRun(heap_[least], heap_[right])) {
+      least = right;
+    }
+    if (least == i) {
+      break;
+    }
+    std::swap(heap_[least], heap_[i]);
+    i = least;
+  }
+}
+
+template<class T, class Compare>
+bool ExternalSorter<T, Compare>::next(T& record) {
+  if (runs_.empty()) {
+    if (position_ == buffer_.size()) {
+      return false;
+    }
+    record = buffer_[position_];
+    position_ += 1;
+    return true;
+  }
+
+  return nextMerged(record);
+}
+
+template<class T, class Compare>
+bool ExternalSorter<T, Compare>::nextMerged(T& record) {
+  if (heap_.empty() || !ok_) {
+    return false;
+  }
+
+  int i = heap_.front();
+  Run& run = runs_[i];
+  record = run.block[run.position];
+  run.position += 1;
+
+  popRun();
+  if (run.position < run.block.size() || refill(run)) {
+    pushRun(i);
+  }
+  return ok_;
+}
+
+template<class T, class Compare>
+size_t ExternalSorter<T, Compare>::size() const {
+  return size_;
+}
+
+template<class T, class Compare>
+int ExternalSorter<T, Compare>::numRuns() const {
+  return runs_.size();
+}
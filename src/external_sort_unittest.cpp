@@ -0,0 +1,110 @@
+#include "external_sort.hpp"
+#include <algorithm>
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace {
+
+// A key which may tie, and which record it was.
+struct Record {
+  int key;
+  int id;
+};
+
+bool lessKey(const Record& lhs, const Record& rhs) {
+  return lhs.key < rhs.key;
+}
+
+typedef ExternalSorter<Record, bool (*)(const Record&, const Record&)>
+    RecordSorter;
+
+// Keys in [0, num_keys) in a scrambled order, numbered by id.
+std::vector<Record> makeRecords(int n, int num_keys) {
+  std::vector<Record> records(n);
+  for (int i = 0; i < n; i += 1) {
+    records[i].key = (i * 7919) % num_keys;
+    records[i].id = i;
+  }
+  return records;
+}
+
+// Sorts the records with a buffer of this many, and reads them back.
+std::vector<Record> sortRecords(const std::vector<Record>& records,
+                                int buffer,
+                                int& num_runs) {
+  RecordSorter sorter(buffer * sizeof(Record), lessKey);
+  for (int i = 0; i < int(records.size()); i += 1) {
+    sorter.add(records[i]);
+  }
+  EXPECT_EQ(records.size(), sorter.size());
+  EXPECT_TRUE(sorter.finish());
+  num_runs = sorter.numRuns();
+
+  std::vector<Record> sorted;
+  Record record;
+  while (sorter.next(record)) {
+    sorted.push_back(record);
+  }
+  // Stays at the end.
+  EXPECT_FALSE(sorter.next(record));
+  return sorted;
+}
+
+// Checks that the keys are in order and that every record came back once.
+void expectSorted(const std::vector<Record>& records,
+                  const std::vector<Record>& sorted) {
+  ASSERT_EQ(records.size(), sorted.size());
+  std::vector<bool> seen(records.size(), false);
+  for (int i = 0; i < int(sorted.size()); i += 1) {
+    if (i > 0) {
+      EXPECT_LE(sorted[i - 1].key, sorted[i].key);
+    }
+    int id = sorted[i].id;
+    ASSERT_TRUE(id >= 0 && id < int(records.size()));
+    EXPECT_FALSE(seen[id]);
+    seen[id] = true;
+    EXPECT_EQ(records[id].key, sorted[i].key);
+  }
+}
+
+}
+
+TEST(ExternalSorter, SortsNothing) {
+  int num_runs = -1;
+  std::vector<Record> records;
+  EXPECT_TRUE(sortRecords(records, 4, num_runs).empty());
+  EXPECT_EQ(0, num_runs);
+}
+
+TEST(ExternalSorter, SortsInMemoryWithinBudget) {
+  std::vector<Record> records = makeRecords(100, 1000);
+  int num_runs = -1;
+  expectSorted(records, sortRecords(records, 100, num_runs));
+  EXPECT_EQ(0, num_runs);
+}
+
+TEST(ExternalSorter, MergesRuns) {
+  std::vector<Record> records = makeRecords(1000, 100000);
+  int num_runs = -1;
+  expectSorted(records, sortRecords(records, 64, num_runs));
+  EXPECT_EQ((1000 + 63) / 64, num_runs);
+}
+
+TEST(ExternalSorter, MergesMoreRunsThanFilesOpen) {
+  // One record per run, so the runs are merged into one several times.
+  int n = 3 * EXTERNAL_SORT_MAX_RUNS + 10;
+  std::vector<Record> records = makeRecords(n, 100000);
+  int num_runs = -1;
+  expectSorted(records, sortRecords(records, 1, num_runs));
+  EXPECT_GT(num_runs, 0);
+  EXPECT_LE(num_runs, EXTERNAL_SORT_MAX_RUNS + 1);
+}
+
+TEST(ExternalSorter, KeepsEveryTie) {
+  // Many records of each key, spread over runs.
+  std::vector<Record> records = makeRecords(2000, 7);
+  int num_runs = -1;
+  std::vector<Record> sorted = sortRecords(records, 50, num_runs);
+  EXPECT_GT(num_runs, 1);
+  expectSorted(records, sorted);
+}
@@ -15,6 +15,8 @@
 #include "distorted_epipolar_lines.hpp"
 #include "distortion.hpp"
 #include "extract_sift.hpp"
+#include "camera_rig.hpp"
+#include "util/thread-pool.hpp"
 
 #include "read_lines.hpp"
 #include "read_image.hpp"
@@ -22,6 +24,7 @@
 #include "sift_feature_reader.hpp"
 #include "iterator_reader.hpp"
 #include "camera_properties_reader.hpp"
+#include "camera_reader.hpp"
 #include "matrix_reader.hpp"
 
 #include "iterator_writer.hpp"
@@ -29,6 +32,15 @@
 
 const int NUM_OCTAVE_LAYERS = 3;
 const double SIGMA = 1.6;
+// Greatest distance in pixels between a feature's epipolar line and the line
+// along which examples are extracted.
+const double EPIPOLAR_LINE_OFFSET = 0.5;
+
+DEFINE_string(rig, "",
+    "Cameras of every view, from cameras-to-rig. If given, the fundamental "
+    "matrices and intrinsics are taken from it and their formats ignored");
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads to extract with, 0 to extract serially");
 
 std::string makeImageFilename(const std::string& format,
                               const std::string& view,
@@ -66,14 +78,12 @@ void init(int& argc, char**& argv) {
 
 void extractFeaturesAlongLine(
     const std::vector<cv::Point>& line,
-    const cv::Mat& image,
-    const std::vector<double> scales,
-    const std::vector<double> angles,
+    const SiftExtractor& sift,
+    const std::vector<double>& scales,
+    const std::vector<double>& angles,
     std::deque<std::deque<SiftFeature> >& line_features) {
   line_features.clear();
 
-  SiftExtractor sift(image, NUM_OCTAVE_LAYERS, SIGMA);
-
   // Extract features along the line at different scales and orientations.
   std::vector<cv::Point>::const_iterator point;
   for (point = line.begin(); point != line.end(); ++point) {
@@ -102,50 +112,96 @@ void extractFeaturesAlongLine(
   }
 }
 
-void extractExamplesForView(const TrackList<SiftFeature>& tracks,
-                            const cv::Mat& F,
-                            const CameraProperties& camera1,
-                            const CameraProperties& camera2,
-                            const std::string& image_format,
-                            const std::string& view,
-                            int time,
-                            const std::vector<double>& scales,
-                            const std::vector<double>& angles) {
-  // March along epipolar line.
-  DistortedEpipolarRasterizer rasterizer(camera2, F);
-  rasterizer.init();
-
-  cv::Mat K1(camera1.matrix());
-  cv::Mat K1_inv = K1.inv();
-
+// Finds the undistorted position of every track in the main view.
+void undistortTrackPositions(const TrackList<SiftFeature>& tracks,
+                             const CameraProperties& camera1,
+                             int time,
+                             std::vector<cv::Point2d>& x1) {
+  x1.clear();
   TrackList<SiftFeature>::const_iterator track;
   for (track = tracks.begin(); track != tracks.end(); ++track) {
     Track<SiftFeature>::const_iterator iter = track->find(time);
     CHECK(iter != track->end()) << "Track does not contain the current frame";
 
     const SiftFeature& feature = iter->second;
-    cv::Point2d y1(feature.position.x, feature.position.y);
+    x1.push_back(cv::Point2d(feature.position.x, feature.position.y));
+  }
+  // Undo intrinsics, undistort, and re-apply intrinsics.
+  camera1.calibrateAndUndistort(x1, x1);
+  camera1.uncalibrate(x1, x1);
+}
 
-    // Undo intrinsics, undistort, and re-apply intrinsics.
-    cv::Point2d x1 = affineTransformImagePoint(y1, K1_inv);
-    x1 = undistort(x1, camera1.distort_w);
-    x1 = affineTransformImagePoint(x1, K1);
+// The geometry of one other view, loaded before any extraction begins.
+struct ViewTask {
+  int view;
+  cv::Mat F;
+  CameraProperties camera2;
+};
+
+// Each view's image is loaded and its pyramid built once, then shared by
+// every track.
+void extractExamplesForView(const std::vector<cv::Point2d>& x1,
+                            const ViewTask& task,
+                            const std::string& image_format,
+                            const std::string& view,
+                            int time,
+                            const std::vector<double>& scales,
+                            const std::vector<double>& angles) {
+  // March along epipolar line.
+  DistortedEpipolarLineIndex index(task.camera2, task.F, EPIPOLAR_LINE_OFFSET);
+  EpipolarLineSet lines;
+  index.compute(x1, lines);
+
+  cv::Mat image;
+  std::string image_file = makeImageFilename(image_format, view, time);
+  bool ok = readGrayImage(image_file, image);
+  CHECK(ok) << "Could not load image \"" << image_file << "\"";
+  SiftExtractor sift(image, NUM_OCTAVE_LAYERS, SIGMA);
 
+  int num_tracks = x1.size();
+  for (int i = 0; i < num_tracks; i += 1) {
     // Extract the pixels of the epipolar line.
-    std::vector<cv::Point> line;
-    rasterizer.compute(x1, line);
-
-    // Load first image.
-    cv::Mat image;
-    std::string image_file = makeImageFilename(image_format, view, time);
-    bool ok = readGrayImage(image_file, image);
-    CHECK(ok) << "Could not load image";
+    std::vector<cv::Point> line(lines.begin(i), lines.end(i));
 
     std::deque<std::deque<SiftFeature> > features;
-    extractFeaturesAlongLine(line, image, scales, angles, features);
+    extractFeaturesAlongLine(line, sift, scales, angles, features);
   }
 }
 
+// For use with ThreadPool::parallelFor().
+class ExtractViewFunction {
+  public:
+    ExtractViewFunction(const std::vector<cv::Point2d>& x1,
+                        const std::vector<ViewTask>& tasks,
+                        const std::string& image_format,
+                        const std::vector<std::string>& view_names,
+                        int time,
+                        const std::vector<double>& scales,
+                        const std::vector<double>& angles)
+        : x1_(&x1),
+          tasks_(&tasks),
+          image_format_(&image_format),
+          view_names_(&view_names),
+          time_(time),
+          scales_(&scales),
+          angles_(&angles) {}
+
+    void operator()(int i) const {
+      const ViewTask& task = (*tasks_)[i];
+      extractExamplesForView(*x1_, task, *image_format_,
+          (*view_names_)[task.view], time_, *scales_, *angles_);
+    }
+
+  private:
+    const std::vector<cv::Point2d>* x1_;
+    const std::vector<ViewTask>* tasks_;
+    const std::string* image_format_;
+    const std::vector<std::string>* view_names_;
+    int time_;
+    const std::vector<double>* scales_;
+    const std::vector<double>* angles_;
+};
+
 int main(int argc, char** argv) {
   init(argc, argv);
 
@@ -171,63 +227,92 @@ int main(int argc, char** argv) {
   CHECK(ok) << "Could not load view names";
   int num_views = view_names.size();
 
+  // Load every camera at once if possible.
+  std::vector<Camera> cameras;
+  if (!FLAGS_rig.empty()) {
+    CameraReader rig_reader;
+    ok = loadList(FLAGS_rig, cameras, rig_reader);
+    CHECK(ok) << "Could not load cameras";
+    CHECK(int(cameras.size()) == num_views) <<
+        "Number of cameras does not match number of views";
+  }
+  CameraRig rig(cameras);
+
   // Load intrinsics for main camera.
   CameraProperties camera1;
-  std::string camera_file1 = makeViewFilename(intrinsics_format,
-      view_names[view1]);
   CameraPropertiesReader camera_reader;
-  ok = load(camera_file1, camera1, camera_reader);
-  CHECK(ok) << "Could not load intrinsics for main camera";
+  if (FLAGS_rig.empty()) {
+    std::string camera_file1 = makeViewFilename(intrinsics_format,
+        view_names[view1]);
+    ok = load(camera_file1, camera1, camera_reader);
+    CHECK(ok) << "Could not load intrinsics for main camera";
+  } else {
+    camera1 = rig.camera(view1).intrinsics();
+  }
 
-  // For each view.
+  // Load the geometry of every other view.
+  std::vector<ViewTask> tasks;
   for (int view2 = 0; view2 < num_views; view2 += 1) {
     if (view2 != view1) {
-      // Load fundamental matrix.
-      cv::Mat F;
-      int i = view1;
-      int j = view2;
-      bool swap = false;
-      if (view2 < view1) {
-        std::swap(i, j);
-        swap = true;
-      }
-      std::string fund_mat_file = makeViewPairFilename(fund_mat_format,
-          view_names[i], view_names[j]);
-      MatrixReader matrix_reader;
-      ok = load(fund_mat_file, F, matrix_reader);
-      CHECK(ok) << "Could not load fundamental matrix";
-      if (swap) {
-        F = F.t();
+      ViewTask task;
+      task.view = view2;
+
+      if (FLAGS_rig.empty()) {
+        // Load fundamental matrix.
+        int i = view1;
+        int j = view2;
+        bool swap = false;
+        if (view2 < view1) {
+          std::swap(i, j);
+          swap = true;
+        }
+        std::string fund_mat_file = makeViewPairFilename(fund_mat_format,
+            view_names[i], view_names[j]);
+        MatrixReader matrix_reader;
+        ok = load(fund_mat_file, task.F, matrix_reader);
+        CHECK(ok) << "Could not load fundamental matrix";
+        if (swap) {
+          task.F = task.F.t();
+        }
+
+        // Load camera properties.
+        std::string camera_file2 = makeViewFilename(intrinsics_format,
+            view_names[view2]);
+        ok = load(camera_file2, task.camera2, camera_reader);
+        CHECK(ok) << "Could not load intrinsics for second camera";
+      } else {
+        task.F = cv::Mat(rig.fundamentalMatrix(view1, view2), true);
+        task.camera2 = rig.camera(view2).intrinsics();
       }
 
-      // Load camera properties.
-      CameraProperties camera2;
-      std::string camera_file2 = makeViewFilename(intrinsics_format,
-          view_names[view2]);
-      ok = load(camera_file2, camera2, camera_reader);
-      CHECK(ok) << "Could not load intrinsics for second camera";
-
-      std::vector<double> scales;
-      scales.push_back(4);
-      scales.push_back(8);
-      scales.push_back(16);
-      scales.push_back(32);
-      scales.push_back(64);
-
-      std::vector<double> angles;
-      angles.push_back(0 * M_PI / 4.);
-      angles.push_back(1 * M_PI / 4.);
-      angles.push_back(2 * M_PI / 4.);
-      angles.push_back(3 * M_PI / 4.);
-      angles.push_back(4 * M_PI / 4.);
-      angles.push_back(5 * M_PI / 4.);
-      angles.push_back(6 * M_PI / 4.);
-      angles.push_back(7 * M_PI / 4.);
-
-      extractExamplesForView(features, F, camera1, camera2, image_format,
-          view_names[view2], time, scales, angles);
+      tasks.push_back(task);
     }
   }
 
+  std::vector<double> scales;
+  scales.push_back(4);
+  scales.push_back(8);
+  scales.push_back(16);
+  scales.push_back(32);
+  scales.push_back(64);
+
+  std::vector<double> angles;
+  angles.push_back(0 * M_PI / 4.);
+  angles.push_back(1 * M_PI / 4.);
+  angles.push_back(2 * M_PI / 4.);
+  angles.push_back(3 * M_PI / 4.);
+  angles.push_back(4 * M_PI / 4.);
+  angles.push_back(5 * M_PI / 4.);
+  angles.push_back(6 * M_PI / 4.);
+  angles.push_back(7 * M_PI / 4.);
+
+  // The positions in the main view are the same for every other view.
+  std::vector<cv::Point2d> x1;
+  undistortTrackPositions(features, camera1, time, x1);
+
+  ThreadPool pool(FLAGS_num_threads);
+  pool.parallelFor(0, tasks.size(), ExtractViewFunction(x1, tasks,
+      image_format, view_names, time, scales, angles));
+
   return 0;
 }
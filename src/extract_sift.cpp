@@ -1,9 +1,12 @@
 #include "extract_sift.hpp"
 #include <boost/bind.hpp>
 #include <stdexcept>
+#include "util/thread-pool.hpp"
 
 const int SIFT_FIXPT_SCALE = 48;
 const double SIFT_INIT_SIGMA = 0.5;
+// Maximum number of keypoints extracted by one task.
+const int DESCRIPTOR_BLOCK_SIZE = 256;
 
 namespace {
 
@@ -31,6 +34,74 @@ void extractDescriptorsFromMatrix(const cv::Mat& matrix,
   }
 }
 
+// Orders registered keypoints by octave and then layer.
+class CompareKeypointLevels {
+  public:
+    CompareKeypointLevels(const std::vector<cv::KeyPoint>& keypoints)
+        : keypoints_(&keypoints) {}
+
+    bool operator()(int lhs, int rhs) const {
+      return level((*keypoints_)[lhs]) < level((*keypoints_)[rhs]);
+    }
+
+  private:
+    static int level(const cv::KeyPoint& keypoint) {
+      int octave = keypoint.octave & 255;
+      int layer = (keypoint.octave >> 8) & 255;
+      return (octave << 8) | layer;
+    }
+
+    const std::vector<cv::KeyPoint>* keypoints_;
+};
+
+// Computes the descriptors of one block of keypoints and writes them to their
+// rows of the table. Blocks write disjoint rows.
+// For use with ThreadPool::parallelFor().
+class ExtractDescriptorBlockFunction {
+  public:
+    ExtractDescriptorBlockFunction(const std::vector<cv::Mat>& pyramid,
+                                   int num_octave_layers,
+                                   const std::vector<cv::KeyPoint>& keypoints,
+                                   const std::vector<int>& order,
+                                   const std::vector<int>& blocks,
+                                   cv::Mat& descriptors)
+        : pyramid_(&pyramid),
+          num_octave_layers_(num_octave_layers),
+          keypoints_(&keypoints),
+          order_(&order),
+          blocks_(&blocks),
+          descriptors_(&descriptors) {}
+
+    void operator()(int i) const {
+      int begin = (*blocks_)[i];
+      int end = (*blocks_)[i + 1];
+
+      std::vector<cv::KeyPoint> block;
+      block.reserve(end - begin);
+      for (int j = begin; j < end; j += 1) {
+        block.push_back((*keypoints_)[(*order_)[j]]);
+      }
+
+      // Note: This is not part of the API. Manually exposed by modifying
+      // OpenCV. Tested with OpenCV 2.4.1 only.
+      cv::Mat table = cv::Mat_<float>(end - begin, 128);
+      cv::calcSiftDescriptors(*pyramid_, block, table, num_octave_layers_);
+
+      for (int j = begin; j < end; j += 1) {
+        const float* src = table.ptr<float>(j - begin);
+        std::copy(src, src + 128, descriptors_->ptr<float>((*order_)[j]));
+      }
+    }
+
+  private:
+    const std::vector<cv::Mat>* pyramid_;
+    int num_octave_layers_;
+    const std::vector<cv::KeyPoint>* keypoints_;
+    const std::vector<int>* order_;
+    const std::vector<int>* blocks_;
+    cv::Mat* descriptors_;
+};
+
 }
 
 void makePyramid(const cv::Mat& byte_image,
@@ -66,23 +137,123 @@ SiftExtractor::SiftExtractor(const cv::Mat& image,
   makePyramid(image, pyramid_, num_octave_layers_, sigma_);
 }
 
+SiftExtractor::SiftExtractor(const std::vector<cv::Mat>& pyramid,
+                             int num_octave_layers,
+                             double sigma)
+    : pyramid_(pyramid),
+      num_octave_layers_(num_octave_layers),
+      sigma_(sigma) {}
+
+SiftExtractor::SiftExtractor(const SiftPyramid& pyramid)
+    : pyramid_(pyramid.levels()),
+      num_octave_layers_(pyramid.numOctaveLayers()),
+      sigma_(pyramid.sigma()) {}
+
 void SiftExtractor::extractDescriptors(
     const std::vector<SiftPosition>& features,
     std::vector<Descriptor>& descriptors) const {
-  // Convert each feature to a registered keypoint.
+  extractDescriptors(features, descriptors, NULL);
+}
+
+void SiftExtractor::extractDescriptors(
+    const std::vector<SiftPosition>& features,
+    std::vector<Descriptor>& descriptors,
+    ThreadPool& pool) const {
+  extractDescriptors(features, descriptors, &pool);
+}
+
+void SiftExtractor::extractDescriptors(
+    const std::vector<SiftPosition>& features,
+    DescriptorMatrix& descriptors,
+    int type) const {
+  extractDescriptors(features, descriptors, type, NULL);
+}
+
+void SiftExtractor::extractDescriptors(
+    const std::vector<SiftPosition>& features,
+    DescriptorMatrix& descriptors,
+    ThreadPool& pool,
+    int type) const {
+  extractDescriptors(features, descriptors, type, &pool);
+}
+
+void SiftExtractor::extractDescriptors(
+    const std::vector<SiftPosition>& features,
+    std::vector<Descriptor>& descriptors,
+    ThreadPool* pool) const {
+  cv::Mat descriptor_table = cv::Mat_<float>(features.size(), 128);
+  computeDescriptors(features, descriptor_table, pool);
+
+  // Convert to our format.
+  extractDescriptorsFromMatrix(descriptor_table, descriptors);
+}
+
+void SiftExtractor::extractDescriptors(
+    const std::vector<SiftPosition>& features,
+    DescriptorMatrix& descriptors,
+    int type,
+    ThreadPool* pool) const {
+  cv::Mat descriptor_table;
+  if (type == cv::DataType<float>::type) {
+    // Write straight into the matrix.
+    descriptors.create(features.size(), 128, type);
+    descriptor_table = descriptors.mat();
+  } else {
+    descriptor_table = cv::Mat_<float>(features.size(), 128);
+  }
+
+  computeDescriptors(features, descriptor_table, pool);
+
+  if (type != cv::DataType<float>::type) {
+    copyToDescriptorMatrix(descriptor_table, descriptors, type);
+  } else {
+    descriptors.computeNorms();
+  }
+}
+
+void SiftExtractor::computeDescriptors(
+    const std::vector<SiftPosition>& features,
+    cv::Mat& descriptor_table,
+    ThreadPool* pool) const {
+  int n = features.size();
+  if (n == 0) {
+    return;
+  }
+
   std::vector<cv::KeyPoint> keypoints;
+  keypoints.reserve(n);
   std::transform(features.begin(), features.end(),
       std::back_inserter(keypoints),
       boost::bind(&SiftExtractor::featureToRegisteredKeypoint, *this, _1));
 
-  // Note: This is not part of the API. Manually exposed by modifying OpenCV.
-  // Tested with OpenCV 2.4.1 only.
-  cv::Mat descriptor_table = cv::Mat_<float>(keypoints.size(), 128);
-  cv::calcSiftDescriptors(pyramid_, keypoints, descriptor_table,
-      num_octave_layers_);
-
-  // Convert to our format.
-  extractDescriptorsFromMatrix(descriptor_table, descriptors);
+  // Group the keypoints of each level, so that each task reads one image.
+  std::vector<int> order(n);
+  for (int i = 0; i < n; i += 1) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(),
+      CompareKeypointLevels(keypoints));
+
+  std::vector<int> blocks(1, 0);
+  for (int i = 1; i < n; i += 1) {
+    int level = keypoints[order[i]].octave;
+    int previous = keypoints[order[i - 1]].octave;
+    if (level != previous || i - blocks.back() >= DESCRIPTOR_BLOCK_SIZE) {
+      blocks.push_back(i);
+    }
+  }
+  blocks.push_back(n);
+  int num_blocks = blocks.size() - 1;
+
+  ExtractDescriptorBlockFunction function(pyramid_, num_octave_layers_,
+      keypoints, order, blocks, descriptor_table);
+  if (pool == NULL) {
+    for (int i = 0; i < num_blocks; i += 1) {
+      function(i);
+    }
+  } else {
+    pool->parallelFor(0, num_blocks, function);
+  }
 }
 
 void SiftExtractor::extractDescriptor(const SiftPosition& feature,
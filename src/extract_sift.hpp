@@ -8,15 +8,47 @@
 #include <opencv2/nonfree/nonfree.hpp>
 #include "sift_position.hpp"
 #include "descriptor.hpp"
+#include "descriptor_matrix.hpp"
+#include "sift_pyramid.hpp"
+
+class ThreadPool;
+
+// Builds the Gaussian pyramid from which SIFT descriptors are extracted.
+void makePyramid(const cv::Mat& byte_image,
+                 std::vector<cv::Mat>& pyramid,
+                 int num_octave_layers,
+                 double sigma);
 
 // Extracts SIFT descriptors at arbitrary detections.
 class SiftExtractor {
   public:
     SiftExtractor(const cv::Mat& image, int num_octave_layers, double sigma);
+    // Uses a pyramid which was built by makePyramid() with the same
+    // parameters, for example one from a PlaneCache.
+    SiftExtractor(const std::vector<cv::Mat>& pyramid,
+                  int num_octave_layers,
+                  double sigma);
+    // Shares a pyramid with detection or other extractors.
+    explicit SiftExtractor(const SiftPyramid& pyramid);
 
     // Extracts descriptors for a set of features.
     void extractDescriptors(const std::vector<SiftPosition>& features,
                             std::vector<Descriptor>& descriptors) const;
+    // Extracts the keypoints of each pyramid level in parallel.
+    void extractDescriptors(const std::vector<SiftPosition>& features,
+                            std::vector<Descriptor>& descriptors,
+                            ThreadPool& pool) const;
+
+    // Extracts descriptors for a set of features into the rows of a matrix.
+    // Byte and half descriptors are rounded from the floats which SIFT
+    // computes, see DescriptorMatrix. The norms of the rows are computed.
+    void extractDescriptors(const std::vector<SiftPosition>& features,
+                            DescriptorMatrix& descriptors,
+                            int type = CV_32F) const;
+    void extractDescriptors(const std::vector<SiftPosition>& features,
+                            DescriptorMatrix& descriptors,
+                            ThreadPool& pool,
+                            int type = CV_32F) const;
 
     // Extracts a single descriptor. Less efficient.
     void extractDescriptor(const SiftPosition& feature,
@@ -34,6 +66,19 @@ class SiftExtractor {
     void calculatePyramidPosition(double size, int& octave, int& layer) const;
 
   private:
+    void extractDescriptors(const std::vector<SiftPosition>& features,
+                            std::vector<Descriptor>& descriptors,
+                            ThreadPool* pool) const;
+    void extractDescriptors(const std::vector<SiftPosition>& features,
+                            DescriptorMatrix& descriptors,
+                            int type,
+                            ThreadPool* pool) const;
+    // Writes the float descriptors of the features to the rows of a table
+    // which has been allocated.
+    void computeDescriptors(const std::vector<SiftPosition>& features,
+                            cv::Mat& descriptor_table,
+                            ThreadPool* pool) const;
+
     std::vector<cv::Mat> pyramid_;
     int num_octave_layers_;
     double sigma_;
@@ -21,6 +21,10 @@
 #include "sift_position.hpp"
 #include "descriptor.hpp"
 #include "extract_sift.hpp"
+#include "plane_cache.hpp"
+#include "sift_pyramid.hpp"
+#include "descriptor_matrix.hpp"
+#include "feature_files.hpp"
 
 #include "sift_position_reader.hpp"
 #include "track_list_reader.hpp"
@@ -28,6 +32,31 @@
 #include "sift_position_writer.hpp"
 #include "descriptor_writer.hpp"
 #include "track_list_writer.hpp"
+#include "util/thread-pool.hpp"
+
+DEFINE_string(plane_cache, "",
+    "Directory in which to keep the SIFT pyramid of each image between runs. "
+    "Empty to compute them every time.");
+DEFINE_int32(num_threads, 4,
+    "Number of worker threads to extract descriptors with, 0 for none");
+DEFINE_int32(stride, 1,
+    "Maximum number of frames along a track between extracted descriptors. "
+    "In between, the last descriptor of the track is re-used unless the "
+    "feature has moved beyond a tolerance.");
+DEFINE_double(max_displacement, -1,
+    "Re-use a descriptor while the feature has moved less than this "
+    "fraction of its size. Negative for no limit.");
+DEFINE_double(max_log_scale_change, -1,
+    "Re-use a descriptor while the log of the ratio of sizes is less than "
+    "this. Negative for no limit.");
+DEFINE_double(max_rotation, -1,
+    "Re-use a descriptor while the feature has rotated less than this many "
+    "radians. Negative for no limit.");
+DEFINE_bool(sparse, false,
+    "Only save the observations whose descriptors were extracted, instead "
+    "of every observation with the last descriptor of its track.");
+DEFINE_string(descriptor_type, "float",
+    "Type to round descriptors to (float, half or byte)");
 
 const int NUM_OCTAVE_LAYERS = 3;
 const double SIGMA = 1.6;
@@ -43,19 +72,59 @@ struct Feature {
   Descriptor descriptor;
 };
 
+// Writes descriptors rounded to a type of DescriptorMatrix.
 class FeatureWriter : public Writer<Feature> {
   public:
+    explicit FeatureWriter(int type) : type_(type) {}
     ~FeatureWriter() {}
 
     void write(cv::FileStorage& file, const Feature& feature) {
       SiftPositionWriter position_writer;
       position_writer.write(file, feature.position);
 
-      DescriptorWriter descriptor_writer;
+      DescriptorWriter descriptor_writer(type_);
       descriptor_writer.write(file, feature.descriptor);
     }
+
+  private:
+    int type_;
 };
 
+// Returns true if the feature has changed too much for its descriptor to be
+// re-used, or the descriptor is too old.
+bool needsDescriptor(const SiftPosition& last, int last_t,
+                     const SiftPosition& current, int t) {
+  if (last_t < 0 || t - last_t >= FLAGS_stride) {
+    return true;
+  }
+
+  if (FLAGS_max_displacement >= 0) {
+    double displacement = cv::norm(current.point() - last.point());
+    if (!(displacement < FLAGS_max_displacement * last.size)) {
+      return true;
+    }
+  }
+
+  if (FLAGS_max_log_scale_change >= 0) {
+    double change = std::abs(std::log(current.size / last.size));
+    if (!(change < FLAGS_max_log_scale_change)) {
+      return true;
+    }
+  }
+
+  if (FLAGS_max_rotation >= 0) {
+    // Smallest angle between the orientations.
+    double rotation = std::fmod(std::abs(current.theta - last.theta),
+        2 * CV_PI);
+    rotation = std::min(rotation, 2 * CV_PI - rotation);
+    if (!(rotation < FLAGS_max_rotation)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
   usage << "Extracts SIFT descriptors at every position in a track." <<
@@ -72,6 +141,11 @@ void init(int& argc, char**& argv) {
     google::ShowUsageWithFlags(argv[0]);
     std::exit(1);
   }
+
+  int type;
+  CHECK(parseDescriptorType(FLAGS_descriptor_type, type) &&
+      type != ANY_DESCRIPTOR_TYPE) << "Unknown descriptor type `" <<
+      FLAGS_descriptor_type << "'";
 }
 
 int main(int argc, char** argv) {
@@ -92,6 +166,16 @@ int main(int argc, char** argv) {
   // Where to put the result.
   TrackList<Feature> feature_tracks(num_features);
 
+  PlaneCache cache(FLAGS_plane_cache);
+  ThreadPool pool(FLAGS_num_threads);
+  CHECK(FLAGS_stride > 0) << "Stride must be positive";
+
+  // Where each descriptor was last extracted.
+  std::vector<int> last_times(num_features, -1);
+  std::vector<SiftPosition> last_positions(num_features);
+  int num_extracted = 0;
+  int num_reused = 0;
+
   // Iterate over each frame in the track.
   TrackListTimeIterator<SiftPosition> frame(position_tracks);
   frame.seekToStart();
@@ -106,6 +190,31 @@ int main(int argc, char** argv) {
     std::cout << "frame " << t << ": " << positions.size() << " features" <<
       std::endl;
 
+    // Find which features need a new descriptor.
+    std::vector<int> indices;
+    std::vector<SiftPosition> frame_positions;
+    for (FeatureSet::const_iterator it = positions.begin();
+         it != positions.end();
+         ++it) {
+      int i = it->first;
+      if (needsDescriptor(last_positions[i], last_times[i], it->second, t)) {
+        indices.push_back(i);
+        frame_positions.push_back(it->second);
+      } else {
+        num_reused += 1;
+        if (!FLAGS_sparse) {
+          Feature& feature = (feature_tracks[i][t] = Feature());
+          feature.position = it->second;
+          feature.descriptor = feature_tracks[i][last_times[i]].descriptor;
+        }
+      }
+    }
+
+    if (indices.empty()) {
+      ++frame;
+      continue;
+    }
+
     // Load image.
     std::string image_file = makeFilename(image_format, t);
     cv::Mat integer_image;
@@ -116,24 +225,38 @@ int main(int argc, char** argv) {
       return 1;
     }
 
-    SiftExtractor sift(integer_image, NUM_OCTAVE_LAYERS, SIGMA);
+    // Build or retrieve SIFT pyramid.
+    SiftPyramid pyramid(integer_image, NUM_OCTAVE_LAYERS, SIGMA, cache);
+    SiftExtractor sift(pyramid);
 
-    // Extract descriptor for each and store in track.
-    for (FeatureSet::const_iterator it = positions.begin();
-         it != positions.end();
-         ++it) {
-      int i = it->first;
-      const SiftPosition& position = it->second;
+    // Extract the descriptors of the frame at once.
+    DescriptorMatrix descriptors;
+    sift.extractDescriptors(frame_positions, descriptors, pool);
 
+    // Store each in its track.
+    int num_positions = indices.size();
+    for (int j = 0; j < num_positions; j += 1) {
+      int i = indices[j];
       Feature& feature = (feature_tracks[i][t] = Feature());
-      feature.position = position;
-      sift.extractDescriptor(position, feature.descriptor);
+      feature.position = frame_positions[j];
+
+      const float* row = descriptors.row<float>(j);
+      feature.descriptor.data.assign(row, row + descriptors.cols());
+
+      last_times[i] = t;
+      last_positions[i] = frame_positions[j];
     }
+    num_extracted += num_positions;
 
     ++frame;
   }
 
-  FeatureWriter feature_writer;
+  LOG(INFO) << "Extracted " << num_extracted << " descriptors and re-used " <<
+      num_reused;
+
+  int type;
+  parseDescriptorType(FLAGS_descriptor_type, type);
+  FeatureWriter feature_writer(type);
   ok = saveTrackList(descriptors_file, feature_tracks, feature_writer);
   CHECK(ok) << "Could not save tracks";
 
@@ -0,0 +1,362 @@
+#include "feature_files.hpp"
+#include <algorithm>
+#include <deque>
+#include <glog/logging.h>
+#include "binary_file.hpp"
+#include "descriptor.hpp"
+
+#include "iterator_reader.hpp"
+#include "descriptor_matrix_reader.hpp"
+#include "sift_feature_reader.hpp"
+#include "sift_position_reader.hpp"
+#include "match_result_reader.hpp"
+#include "track_list_reader.hpp"
+#include "multiview_track_list_reader.hpp"
+
+#include "iterator_writer.hpp"
+#include "descriptor_writer.hpp"
+#include "sift_feature_writer.hpp"
+#include "sift_position_writer.hpp"
+#include "match_result_writer.hpp"
+#include "track_list_writer.hpp"
+#include "multiview_track_list_writer.hpp"
+
+namespace {
+
+// Binary records, independent of the layout of the structs in memory.
+struct SiftPositionRecord {
+  double x;
+  double y;
+  double size;
+  double theta;
+};
+
+struct MatchResultRecord {
+  int32_t index1;
+  int32_t index2;
+  double distance;
+};
+
+void toSiftPositionRecord(const SiftPosition& position,
+                          SiftPositionRecord& record) {
+  record.x = position.x;
+  record.y = position.y;
+  record.size = position.size;
+  record.theta = position.theta;
+}
+
+// Writes the norms too, computing them if they are not stored.
+bool writeBinaryDescriptors(const std::string& filename,
+                            BinaryRecordType type,
+                            size_t record_size,
+                            size_t num_records,
+                            const void* records,
+                            const DescriptorMatrix& descriptors) {
+  if (descriptors.empty()) {
+    return writeBinaryFile(filename, type, record_size, num_records, records,
+        cv::Mat());
+  }
+
+  // Shares the rows but not the norms.
+  DescriptorMatrix copy = descriptors;
+  if (!copy.hasNorms()) {
+    copy.computeNorms();
+  }
+  return writeBinaryFile(filename, type, record_size, num_records, records,
+      copy.mat(), copy.norms());
+}
+
+}
+
+bool parseDescriptorType(const std::string& name, int& type) {
+  if (name.empty()) {
+    type = ANY_DESCRIPTOR_TYPE;
+  } else if (name == "float") {
+    type = cv::DataType<float>::type;
+  } else if (name == "half") {
+    type = DescriptorMatrix::HALF_TYPE;
+  } else if (name == "byte") {
+    type = cv::DataType<uchar>::type;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool loadDescriptorMatrix(const std::string& filename,
+                          DescriptorMatrix& descriptors,
+                          int type) {
+  if (!isBinaryFilename(filename)) {
+    if (type == ANY_DESCRIPTOR_TYPE) {
+      type = cv::DataType<float>::type;
+    }
+    DescriptorMatrixReader reader(type);
+    return load(filename, descriptors, reader);
+  }
+
+  BinaryFile file;
+  if (!file.open(filename)) {
+    return false;
+  }
+
+  if (!file.hasDescriptors() || file.header().num_descriptors == 0) {
+    descriptors.release();
+    return true;
+  }
+
+  const BinaryFileHeader& header = file.header();
+  DescriptorMatrix mapped(header.num_descriptors, header.descriptor_cols,
+      header.descriptor_type, file.descriptorData());
+
+  if (mapped.type() == type || type == ANY_DESCRIPTOR_TYPE) {
+    descriptors = mapped;
+    // Files written before the norms were stored need them computed, which
+    // reads every row.
+    if (file.hasNorms()) {
+      descriptors.setNorms(file.normData());
+    } else {
+      descriptors.computeNorms();
+    }
+  } else {
+    copyToDescriptorMatrix(mapped, descriptors, type);
+  }
+
+  return true;
+}
+
+bool saveDescriptorMatrix(const std::string& filename,
+                          const DescriptorMatrix& descriptors) {
+  if (isBinaryFilename(filename)) {
+    return writeBinaryDescriptors(filename, BINARY_NO_RECORDS, 0, 0, NULL,
+        descriptors);
+  }
+
+  std::deque<Descriptor> list(descriptors.rows());
+  cv::Mat matrix;
+  if (!descriptors.empty()) {
+    descriptors.toFloat().convertTo(matrix, cv::DataType<double>::type);
+  }
+  for (int i = 0; i < descriptors.rows(); i += 1) {
+    const double* row = matrix.ptr<double>(i);
+    list[i].data.assign(row, row + matrix.cols);
+  }
+
+  DescriptorWriter writer;
+  return saveList(filename, list, writer);
+}
+
+bool loadSiftFeatures(const std::string& filename,
+                      std::deque<SiftFeature>& features) {
+  if (!isBinaryFilename(filename)) {
+    SiftFeatureReader reader;
+    return loadList(filename, features, reader);
+  }
+
+  std::vector<SiftPosition> positions;
+  DescriptorMatrix descriptors;
+  if (!loadSiftPositions(filename, positions) ||
+      !loadDescriptorMatrix(filename, descriptors, ANY_DESCRIPTOR_TYPE)) {
+    return false;
+  }
+  if (int(positions.size()) != descriptors.rows()) {
+    LOG(WARNING) << "Number of descriptors differs from number of "
+        "positions in `" << filename << "'";
+    return false;
+  }
+
+  features.assign(positions.size(), SiftFeature());
+  // Rows are widened a block at a time.
+  const int BLOCK_SIZE = 1024;
+  cv::Mat buffer;
+  for (int i0 = 0; i0 < descriptors.rows(); i0 += BLOCK_SIZE) {
+    int i1 = std::min(i0 + BLOCK_SIZE, descriptors.rows());
+    cv::Mat block = descriptors.toFloat(i0, i1, buffer);
+    for (int i = i0; i < i1; i += 1) {
+      const float* row = block.ptr<float>(i - i0);
+      features[i].position = positions[i];
+      features[i].descriptor.data.assign(row, row + block.cols);
+    }
+  }
+  return true;
+}
+
+bool saveSiftFeatures(const std::string& filename,
+                      const std::vector<SiftFeature>& features,
+                      int type) {
+  if (!isBinaryFilename(filename)) {
+    SiftFeatureWriter writer(type);
+    return saveList(filename, features, writer);
+  }
+
+  std::vector<SiftPositionRecord> records(features.size());
+  std::deque<Descriptor> list;
+  for (int i = 0; i < int(features.size()); i += 1) {
+    toSiftPositionRecord(features[i].position, records[i]);
+    list.push_back(features[i].descriptor);
+  }
+
+  DescriptorMatrix descriptors;
+  if (!list.empty()) {
+    listToMatrix(list, descriptors, type);
+  }
+  return writeBinaryDescriptors(filename, BINARY_SIFT_POSITIONS,
+      sizeof(SiftPositionRecord), records.size(),
+      records.empty() ? NULL : &records.front(), descriptors);
+}
+
+bool streamSiftPositions(const std::string& filename,
+                         SequenceSink<SiftPosition>& sink) {
+  if (!isBinaryFilename(filename)) {
+    SiftPositionReader reader;
+    return streamSequence(filename, std::vector<std::string>(), reader, sink);
+  }
+
+  BinaryFile file;
+  if (!file.open(filename)) {
+    return false;
+  }
+
+  const SiftPositionRecord* records =
+      file.records<SiftPositionRecord>(BINARY_SIFT_POSITIONS);
+  for (int i = 0; i < file.numRecords(); i += 1) {
+    const SiftPositionRecord& record = records[i];
+    SiftPosition position(record.x, record.y, record.size, record.theta);
+    sink.add(position);
+  }
+
+  return true;
+}
+
+bool loadSiftPositions(const std::string& filename,
+                       std::vector<SiftPosition>& positions) {
+  positions.clear();
+  ContainerSink<SiftPosition, std::vector<SiftPosition> > sink(positions);
+  return streamSiftPositions(filename, sink);
+}
+
+bool saveSiftPositions(const std::string& filename,
+                       const std::vector<SiftPosition>& positions) {
+  if (!isBinaryFilename(filename)) {
+    SiftPositionWriter writer;
+    return saveList(filename, positions, writer);
+  }
+
+  std::vector<SiftPositionRecord> records(positions.size());
+  for (int i = 0; i < int(positions.size()); i += 1) {
+    toSiftPositionRecord(positions[i], records[i]);
+  }
+
+  return writeBinaryFile(filename, BINARY_SIFT_POSITIONS,
+      sizeof(SiftPositionRecord), records.size(),
+      records.empty() ? NULL : &records.front(), cv::Mat());
+}
+
+bool streamMatchResults(const std::string& filename,
+                        SequenceSink<MatchResult>& sink) {
+  if (!isBinaryFilename(filename)) {
+    MatchResultReader reader;
+    return streamSequence(filename, std::vector<std::string>(), reader, sink);
+  }
+
+  BinaryFile file;
+  if (!file.open(filename)) {
+    return false;
+  }
+
+  const MatchResultRecord* records =
+      file.records<MatchResultRecord>(BINARY_MATCH_RESULTS);
+  for (int i = 0; i < file.numRecords(); i += 1) {
+    const MatchResultRecord& record = records[i];
+    MatchResult match(record.index1, record.index2, record.distance);
+    sink.add(match);
+  }
+
+  return true;
+}
+
+bool loadMatchResults(const std::string& filename,
+                      std::vector<MatchResult>& matches) {
+  matches.clear();
+  ContainerSink<MatchResult, std::vector<MatchResult> > sink(matches);
+  return streamMatchResults(filename, sink);
+}
+
+bool saveMatchResults(const std::string& filename,
+                      const std::vector<MatchResult>& matches) {
+  if (!isBinaryFilename(filename)) {
+    MatchResultWriter writer;
+    return saveList(filename, matches, writer);
+  }
+
+  std::vector<MatchResultRecord> records(matches.size());
+  for (int i = 0; i < int(matches.size()); i += 1) {
+    records[i].index1 = matches[i].index1;
+    records[i].index2 = matches[i].index2;
+    records[i].distance = matches[i].distance;
+  }
+
+  return writeBinaryFile(filename, BINARY_MATCH_RESULTS,
+      sizeof(MatchResultRecord), records.size(),
+      records.empty() ? NULL : &records.front(), cv::Mat());
+}
+
+bool loadSiftPositionTracks(const std::string& filename,
+                            TrackListView<SiftPosition>& tracks) {
+  if (!isBinaryFilename(filename)) {
+    TrackList<SiftPosition> list;
+    SiftPositionReader reader;
+    if (!loadTrackList(filename, list, reader)) {
+      return false;
+    }
+    tracks.assign(list);
+    return true;
+  }
+
+  BinaryFile file;
+  if (!file.open(filename)) {
+    return false;
+  }
+  return tracks.map(file, BINARY_SIFT_POSITION_TRACKS);
+}
+
+bool saveSiftPositionTracks(const std::string& filename,
+                            const TrackList<SiftPosition>& tracks) {
+  if (!isBinaryFilename(filename)) {
+    SiftPositionWriter writer;
+    return saveTrackList(filename, tracks, writer);
+  }
+
+  return writeBinaryTrackList(filename, tracks, BINARY_SIFT_POSITION_TRACKS);
+}
+
+bool loadSiftPositionMultiviewTracks(
+    const std::string& filename,
+    MultiviewTrackListView<SiftPosition>& tracks) {
+  if (!isBinaryFilename(filename)) {
+    MultiviewTrackList<SiftPosition> list;
+    SiftPositionReader reader;
+    if (!loadMultiviewTrackList(filename, list, reader)) {
+      return false;
+    }
+    tracks.assign(list);
+    return true;
+  }
+
+  BinaryFile file;
+  if (!file.open(filename)) {
+    return false;
+  }
+  return tracks.map(file, BINARY_SIFT_POSITION_TRACKS);
+}
+
+bool saveSiftPositionMultiviewTracks(
+    const std::string& filename,
+    const MultiviewTrackList<SiftPosition>& tracks) {
+  if (!isBinaryFilename(filename)) {
+    SiftPositionWriter writer;
+    return saveMultiviewTrackList(filename, tracks, writer);
+  }
+
+  return writeBinaryMultiviewTrackList(filename, tracks,
+      BINARY_SIFT_POSITION_TRACKS);
+}
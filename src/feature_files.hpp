@@ -0,0 +1,78 @@
+#ifndef FEATURE_FILES_HPP_
+#define FEATURE_FILES_HPP_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include "descriptor_matrix.hpp"
+#include "sift_feature.hpp"
+#include "sift_position.hpp"
+#include "match_result.hpp"
+#include "sequence_sink.hpp"
+#include "track_list.hpp"
+#include "multiview_track_list.hpp"
+#include "track_list_view.hpp"
+#include "multiview_track_list_view.hpp"
+
+// Loads and saves the files which are read most often.
+//
+// Files whose names end in BINARY_EXTENSION use the binary format of
+// binary_file.hpp, and everything else uses the Reader and Writer of each
+// type. Binary descriptors are mapped rather than read, and are only copied
+// if they must be converted to a different type.
+
+// Keeps the descriptor type of a binary file. Text is read as floats.
+const int ANY_DESCRIPTOR_TYPE = -1;
+
+// Parses float, half or byte, or empty for ANY_DESCRIPTOR_TYPE. Returns
+// false for any other name.
+bool parseDescriptorType(const std::string& name, int& type);
+
+// The norms of the descriptors are mapped if the file has them, and
+// computed otherwise.
+bool loadDescriptorMatrix(const std::string& filename,
+                          DescriptorMatrix& descriptors,
+                          int type = CV_32F);
+// Binary files store the norms of the descriptors.
+bool saveDescriptorMatrix(const std::string& filename,
+                          const DescriptorMatrix& descriptors);
+
+// Binary features are SIFT positions with a block of descriptors of the
+// given type, which loadSiftPositions() and loadDescriptorMatrix() read on
+// their own. Text descriptors are rounded to the type.
+bool loadSiftFeatures(const std::string& filename,
+                      std::deque<SiftFeature>& features);
+bool saveSiftFeatures(const std::string& filename,
+                      const std::vector<SiftFeature>& features,
+                      int type = CV_32F);
+
+bool loadSiftPositions(const std::string& filename,
+                       std::vector<SiftPosition>& positions);
+// Decodes one position at a time into a sink.
+bool streamSiftPositions(const std::string& filename,
+                         SequenceSink<SiftPosition>& sink);
+bool saveSiftPositions(const std::string& filename,
+                       const std::vector<SiftPosition>& positions);
+
+bool loadMatchResults(const std::string& filename,
+                      std::vector<MatchResult>& matches);
+bool streamMatchResults(const std::string& filename,
+                        SequenceSink<MatchResult>& sink);
+bool saveMatchResults(const std::string& filename,
+                      const std::vector<MatchResult>& matches);
+
+// Binary tracks are mapped in place. Text tracks are parsed and then copied
+// into the view.
+bool loadSiftPositionTracks(const std::string& filename,
+                            TrackListView<SiftPosition>& tracks);
+bool saveSiftPositionTracks(const std::string& filename,
+                            const TrackList<SiftPosition>& tracks);
+
+bool loadSiftPositionMultiviewTracks(
+    const std::string& filename,
+    MultiviewTrackListView<SiftPosition>& tracks);
+bool saveSiftPositionMultiviewTracks(
+    const std::string& filename,
+    const MultiviewTrackList<SiftPosition>& tracks);
+
+#endif
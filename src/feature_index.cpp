@@ -1,4 +1,13 @@
 #include "feature_index.hpp"
+#include <glog/logging.h>
+
+namespace {
+
+const int VIEW_BITS = 12;
+const int TIME_BITS = 20;
+const int ID_BITS = 32;
+
+}
 
 FeatureIndex::FeatureIndex() : view(-1), time(-1), id(-1) {}
 
@@ -24,6 +33,29 @@ bool FeatureIndex::operator<(const FeatureIndex& other) const {
   }
 }
 
+bool FeatureIndex::operator==(const FeatureIndex& other) const {
+  return view == other.view && time == other.time && id == other.id;
+}
+
+uint64_t FeatureIndex::key() const {
+  CHECK(view >= 0 && view < (1 << VIEW_BITS)) << "View out of range";
+  CHECK(time >= 0 && time < (1 << TIME_BITS)) << "Time out of range";
+  CHECK(id >= 0) << "Id out of range";
+
+  return (uint64_t(view) << (TIME_BITS + ID_BITS)) |
+      (uint64_t(time) << ID_BITS) | uint64_t(id);
+}
+
+uint64_t hashFeatureKey(uint64_t key) {
+  // Finalizer of MurmurHash3.
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
 std::ostream& operator<<(std::ostream& stream, const FeatureIndex& feature) {
   return stream << "(" << feature.view << ", " << feature.time << ", " <<
       feature.id << ")";
@@ -2,6 +2,7 @@
 #define FEATURE_INDEX_HPP_
 
 #include <ostream>
+#include <stdint.h>
 #include "multiview_track.hpp"
 
 // Identifies a feature in a multiview video.
@@ -17,8 +18,16 @@ struct FeatureIndex {
 
   // Defines an ordering over feature indices.
   bool operator<(const FeatureIndex& other) const;
+  bool operator==(const FeatureIndex& other) const;
+
+  // Packs the index into 64 bits with the same ordering.
+  // View must be less than 2^12, time less than 2^20 and all non-negative.
+  uint64_t key() const;
 };
 
+// Mixes the bits of a packed key.
+uint64_t hashFeatureKey(uint64_t key);
+
 std::ostream& operator<<(std::ostream& stream, const FeatureIndex& feature);
 
 #endif
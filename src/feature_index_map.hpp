@@ -0,0 +1,49 @@
+#ifndef FEATURE_INDEX_MAP_HPP_
+#define FEATURE_INDEX_MAP_HPP_
+
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include "feature_index.hpp"
+
+// Hash table from features to values, such as the vertices of a match graph.
+//
+// Open addressing with linear probing on the packed key of each feature, so a
+// lookup touches one or two cache lines instead of walking a tree. Entries
+// cannot be erased. Inserting may move the values.
+template<class V>
+class FeatureIndexMap {
+  public:
+    FeatureIndexMap();
+
+    // Makes room for n features without rehashing.
+    void reserve(int n);
+
+    // Returns NULL if the feature is absent.
+    V* find(const FeatureIndex& feature);
+    const V* find(const FeatureIndex& feature) const;
+
+    // Inserts the value if the feature is absent.
+    // Returns the stored value and whether it was inserted.
+    std::pair<V*, bool> insert(const FeatureIndex& feature, const V& value);
+
+    int size() const;
+    bool empty() const;
+    void clear();
+    void swap(FeatureIndexMap<V>& other);
+
+  private:
+    // Index of the slot which holds the key, or of the empty slot where it
+    // would go.
+    int slot(uint64_t key) const;
+    void rehash(int capacity);
+
+    // Capacity is zero or a power of two.
+    std::vector<uint64_t> keys_;
+    std::vector<V> values_;
+    int size_;
+};
+
+#include "feature_index_map.inl"
+
+#endif
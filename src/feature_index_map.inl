@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <glog/logging.h>
+
+namespace {
+
+// Not the key of any valid feature.
+const uint64_t EMPTY_FEATURE_KEY = ~uint64_t(0);
+
+// Tables are kept at most half full.
+const int MIN_FEATURE_MAP_CAPACITY = 16;
+
+}
+
+template<class V>
+FeatureIndexMap<V>::FeatureIndexMap() : keys_(), values_(), size_(0) {}
+
+template<class V>
+void FeatureIndexMap<V>::reserve(int n) {
+  int capacity = MIN_FEATURE_MAP_CAPACITY;
+  while (capacity < 2 * n) {
+    capacity *= 2;
+  }
+
+  if (capacity > int(keys_.size())) {
+    rehash(capacity);
+  }
+}
+
+template<class V>
+V* FeatureIndexMap<V>::find(const FeatureIndex& feature) {
+  if (size_ == 0) {
+    return NULL;
+  }
+
+  int i = slot(feature.key());
+  if (keys_[i] == EMPTY_FEATURE_KEY) {
+    return NULL;
+  }
+  return &values_[i];
+}
+
+template<class V>
+const V* FeatureIndexMap<V>::find(const FeatureIndex& feature) const {
+  if (size_ == 0) {
+    return NULL;
+  }
+
+  int i = slot(feature.key());
+  if (keys_[i] == EMPTY_FEATURE_KEY) {
+    return NULL;
+  }
+  return &values_[i];
+}
+
+template<class V>
+std::pair<V*, bool> FeatureIndexMap<V>::insert(const FeatureIndex& feature,
+                                               const V& value) {
+  // Grow before probing so that the slot stays valid.
+  if (2 * (size_ + 1) > int(keys_.size())) {
+    rehash(std::max(2 * int(keys_.size()), MIN_FEATURE_MAP_CAPACITY));
+  }
+
+  uint64_t key = feature.key();
+  int i = slot(key);
+  if (keys_[i] != EMPTY_FEATURE_KEY) {
+    return std::make_pair(&values_[i], false);
+  }
+
+  keys_[i] = key;
+  values_[i] = value;
+  size_ += 1;
+  return std::make_pair(&values_[i], true);
+}
+
+template<class V>
+int FeatureIndexMap<V>::size() const {
+  return size_;
+}
+
+template<class V>
+bool FeatureIndexMap<V>::empty() const {
+  return size_ == 0;
+}
+
+template<class V>
+void FeatureIndexMap<V>::clear() {
+  keys_.clear();
+  values_.clear();
+  size_ = 0;
+}
+
+template<class V>
+void FeatureIndexMap<V>::swap(FeatureIndexMap<V>& other) {
+  keys_.swap(other.keys_);
+  values_.swap(other.values_);
+  std::swap(size_, other.size_);
+}
+
+template<class V>
+int FeatureIndexMap<V>::slot(uint64_t key) const {
+  uint64_t mask = keys_.size() - 1;
+  uint64_t i = hashFeatureKey(key) & mask;
+
+  // Terminates because the table is never full.
+  while (keys_[i] != EMPTY_FEATURE_KEY && keys_[i] != key) {
+    i = (i + 1) & mask;
+  }
+
+  return i;
+}
+
+template<class V>
+void FeatureIndexMap<V>::rehash(int capacity) {
+  CHECK(capacity > 0 && (capacity & (capacity - 1)) == 0);
+
+  std::vector<uint64_t> keys(capacity, EMPTY_FEATURE_KEY);
+  std::vector<V> values(capacity);
+  keys_.swap(keys);
+  values_.swap(values);
+
+  // Re-insert the old entries.
+  for (size_t j = 0; j < keys.size(); j += 1) {
+    if (keys[j] != EMPTY_FEATURE_KEY) {
+      int i = slot(keys[j]);
+      keys_[i] = keys[j];
+      values_[i] = values[j];
+    }
+  }
+}
@@ -0,0 +1,126 @@
+#include "util/feature-scheduler.hpp"
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "gtest/gtest.h"
+
+namespace {
+
+const double DEADLINE = 1;
+const int MIN_ITERATIONS = 5;
+const int MAX_ITERATIONS = 100;
+
+// Times and counts are powers of two, so that the budgets are exact.
+const int ITERATIONS_PER_SECOND = 1024;
+
+std::vector<double> equalPriorities(int n) {
+  return std::vector<double>(n, 0.);
+}
+
+// Runs a frame whose 1024 iterations took the given number of seconds.
+void runFrame(FeatureScheduler& scheduler, double start, double seconds) {
+  scheduler.begin(start, equalPriorities(1));
+  scheduler.end(start + seconds, ITERATIONS_PER_SECOND);
+}
+
+}
+
+TEST(FeatureScheduler, OrdersByDecreasingPriority) {
+  FeatureScheduler scheduler(DEADLINE, MIN_ITERATIONS, MAX_ITERATIONS, 1);
+  std::vector<double> priorities;
+  priorities.push_back(1);
+  priorities.push_back(3);
+  priorities.push_back(2);
+  priorities.push_back(3);
+  scheduler.begin(0, priorities);
+
+  // Equal priorities keep their order.
+  const std::vector<int>& order = scheduler.order();
+  ASSERT_EQ(4u, order.size());
+  EXPECT_EQ(1, order[0]);
+  EXPECT_EQ(3, order[1]);
+  EXPECT_EQ(2, order[2]);
+  EXPECT_EQ(0, order[3]);
+}
+
+TEST(FeatureScheduler, DisabledScheduleKeepsOrderAndLimit) {
+  FeatureScheduler scheduler(0, MIN_ITERATIONS, MAX_ITERATIONS, 3);
+  EXPECT_FALSE(scheduler.enabled());
+  std::vector<double> priorities;
+  priorities.push_back(1);
+  priorities.push_back(2);
+  scheduler.begin(0, priorities);
+  EXPECT_EQ(0, scheduler.order()[0]);
+  EXPECT_EQ(1, scheduler.order()[1]);
+  EXPECT_EQ(MAX_ITERATIONS, scheduler.iterations());
+  EXPECT_FALSE(scheduler.expired(1e9));
+}
+
+TEST(FeatureScheduler, ExpiresAfterDeadline) {
+  FeatureScheduler scheduler(DEADLINE, MIN_ITERATIONS, MAX_ITERATIONS, 1);
+  scheduler.begin(10, equalPriorities(3));
+  EXPECT_FALSE(scheduler.expired(10));
+  EXPECT_FALSE(scheduler.expired(10 + DEADLINE));
+  EXPECT_TRUE(scheduler.expired(10.5 + DEADLINE));
+}
+
+TEST(FeatureScheduler, SizesBudgetToDeadline) {
+  FeatureScheduler scheduler(DEADLINE, MIN_ITERATIONS, MAX_ITERATIONS, 1);
+  // Nothing is known of the cost before the first frame.
+  scheduler.begin(0, equalPriorities(1000));
+  EXPECT_EQ(MAX_ITERATIONS, scheduler.iterations());
+  scheduler.end(1, ITERATIONS_PER_SECOND);
+
+  // 1024 iterations fit in the deadline.
+  scheduler.begin(1, equalPriorities(16));
+  EXPECT_EQ(64, scheduler.iterations());
+  scheduler.begin(1, equalPriorities(8));
+  EXPECT_EQ(MAX_ITERATIONS, scheduler.iterations());
+  scheduler.begin(1, equalPriorities(1024));
+  EXPECT_EQ(MIN_ITERATIONS, scheduler.iterations());
+}
+
+TEST(FeatureScheduler, DividesBudgetBetweenLevels) {
+  FeatureScheduler scheduler(DEADLINE, MIN_ITERATIONS, MAX_ITERATIONS, 2);
+  runFrame(scheduler, 0, 1);
+  scheduler.begin(1, equalPriorities(16));
+  EXPECT_EQ(32, scheduler.iterations());
+}
+
+TEST(FeatureScheduler, SmoothsCostOfIteration) {
+  FeatureScheduler scheduler(DEADLINE, MIN_ITERATIONS, MAX_ITERATIONS, 1);
+  runFrame(scheduler, 0, 1);
+  // Five times slower, of which a quarter is taken.
+  runFrame(scheduler, 1, 5);
+  scheduler.begin(6, equalPriorities(16));
+  EXPECT_EQ(32, scheduler.iterations());
+
+  // Frames without iterations teach nothing.
+  scheduler.end(7, 0);
+  scheduler.begin(7, equalPriorities(16));
+  EXPECT_EQ(32, scheduler.iterations());
+}
+
+TEST(FeaturePriority, RanksSelectedThenDeferredThenValue) {
+  EXPECT_GT(featurePriority(true, 0, 0, 0), featurePriority(false, 5, 1000,
+        1));
+  EXPECT_GT(featurePriority(false, 1, 0, 0), featurePriority(false, 0, 1000,
+        1));
+  EXPECT_GT(featurePriority(false, 0, 20, 0), featurePriority(false, 0, 10,
+        0));
+  EXPECT_GT(featurePriority(false, 0, 0, 0.1), featurePriority(false, 0, 0,
+        0.01));
+}
+
+TEST(PatchTexture, IsMeanSquaredGradient) {
+  cv::Mat ramp(5, 5, cv::DataType<double>::type);
+  for (int i = 0; i < ramp.rows; i += 1) {
+    for (int j = 0; j < ramp.cols; j += 1) {
+      ramp.at<double>(i, j) = 0.1 * j + 0.2 * i;
+    }
+  }
+  EXPECT_NEAR(0.01 + 0.04, patchTexture(ramp), 1e-12);
+
+  cv::Mat flat(5, 5, cv::DataType<double>::type, cv::Scalar(0.5));
+  EXPECT_EQ(0, patchTexture(flat));
+  EXPECT_EQ(0, patchTexture(cv::Mat(1, 1, cv::DataType<double>::type)));
+}
@@ -3,13 +3,19 @@
 
 #include <map>
 #include <vector>
+#include "disjoint_sets.hpp"
 #include "multiview_track.hpp"
 #include "multiview_track_list.hpp"
 #include "feature_index.hpp"
+#include "feature_index_map.hpp"
 
 // Templated because it is essentially a container.
 // The property of a set is accessed by any member in the set.
-// TODO: Provide constant time find().
+//
+// Membership is kept by DisjointSets, so together() and find() take
+// amortized O(alpha(n)) time. The elements of each set are kept in the set
+// itself. Joining merges the smaller set into the larger, and the property
+// of the larger set survives.
 
 template<class T>
 class FeatureSets {
@@ -32,7 +38,10 @@ class FeatureSets {
     // lookup -- A lookup from feature (view, time, id) to vertex index.
     void init(const std::vector<ImageIndex>& vertices,
               const MultiviewTrackList<int>& tracks,
-              const std::map<FeatureIndex, int>& lookup);
+              const FeatureIndexMap<int>& lookup);
+    // Adds a vertex in its own set. Returns its index, which follows the
+    // last.
+    int add(const ImageIndex& vertex);
 
     int count() const;
     void join(int u, int v);
@@ -48,12 +57,16 @@ class FeatureSets {
     const_iterator end() const;
 
   private:
-    Set& get(int v);
-
     typedef std::map<int, Set> SetList;
-    typedef std::vector<int> FeatureList;
 
-    FeatureList features_;
+    Set& get(int v);
+    // Returns the representative vertex of the set containing v.
+    // Shortens the path from v as a side-effect.
+    int root(int v) const;
+
+    mutable DisjointSets forest_;
+    // Where the set of each root is stored. Invalid for other vertices.
+    std::vector<typename SetList::iterator> roots_;
     SetList sets_;
 };
 
@@ -1,30 +1,42 @@
 #include "feature_sets.hpp"
+#include <algorithm>
+#include <utility>
 #include <glog/logging.h>
 
 template<class T>
-FeatureSets<T>::FeatureSets() : features_(), sets_() {}
+FeatureSets<T>::FeatureSets() : forest_(), roots_(), sets_() {}
 
 template<class T>
 void FeatureSets<T>::init(const std::vector<ImageIndex>& vertices) {
-  std::vector<ImageIndex>::const_iterator vertex;
-  int i = 0;
+  int n = vertices.size();
+  forest_.clear();
+  roots_.clear();
+  roots_.reserve(n);
+  sets_.clear();
+
+  for (int i = 0; i < n; i += 1) {
+    add(vertices[i]);
+  }
+}
 
-  for (vertex = vertices.begin(); vertex != vertices.end(); ++vertex) {
-    // Add a new set containing element i.
-    Set& set = sets_[i];
-    set.elements[*vertex] = i;
+template<class T>
+int FeatureSets<T>::add(const ImageIndex& vertex) {
+  int i = forest_.size();
 
-    // Add a pointer back to the set.
-    features_.push_back(i);
+  // Add a new set containing element i.
+  typename SetList::iterator set = sets_.insert(sets_.end(),
+      std::make_pair(i, Set()));
+  set->second.elements[vertex] = i;
 
-    i += 1;
-  }
+  forest_.grow(i + 1);
+  roots_.push_back(set);
+  return i;
 }
 
 template<class T>
 void FeatureSets<T>::init(const std::vector<ImageIndex>& vertices,
                           const MultiviewTrackList<int>& tracks,
-                          const std::map<FeatureIndex, int>& lookup) {
+                          const FeatureIndexMap<int>& lookup) {
   init(vertices);
 
   MultiviewTrackList<int>::const_iterator track;
@@ -40,10 +52,10 @@ void FeatureSets<T>::init(const std::vector<ImageIndex>& vertices,
       FeatureIndex feature(frame.view, frame.time, id);
 
       // Find vertex index in reverse lookup.
-      std::map<FeatureIndex, int>::const_iterator entry = lookup.find(feature);
+      const int* entry = lookup.find(feature);
       // Make sure that the entry exists.
-      CHECK(entry != lookup.end());
-      int vertex = entry->second;
+      CHECK(entry != NULL);
+      int vertex = *entry;
 
       if (first) {
         first_vertex = vertex;
@@ -64,84 +76,47 @@ int FeatureSets<T>::count() const {
 
 template<class T>
 void FeatureSets<T>::join(int u, int v) {
-  if (together(u, v)) {
+  int r = root(u);
+  int q = root(v);
+  if (r == q) {
     return;
   }
 
-  typename SetList::iterator s_iter = sets_.find(features_[u]);
-  typename SetList::iterator t_iter = sets_.find(features_[v]);
-  CHECK(s_iter != sets_.end());
-  CHECK(t_iter != sets_.end());
+  typename SetList::iterator s_iter = roots_[r];
+  typename SetList::iterator t_iter = roots_[q];
 
   // Make sure we're merging the smaller set into the larger one.
   if (s_iter->second.elements.size() < t_iter->second.elements.size()) {
-    std::swap(u, v);
     std::swap(s_iter, t_iter);
   }
 
-  Set& s = s_iter->second;;
-  Set& t = t_iter->second;;
-
   // Merge t into s.
-  s.elements.insert(t.elements.begin(), t.elements.end());
+  s_iter->second.elements.insert(t_iter->second.elements.begin(),
+      t_iter->second.elements.end());
+  sets_.erase(t_iter);
 
-  // Set the elements of t to point at s.
-  std::map<ImageIndex, int>::const_iterator e;
-  for (e = t.elements.begin(); e != t.elements.end(); ++e) {
-    features_[e->second] = s_iter->first;
-  }
+  forest_.join(r, q);
+  roots_[root(r)] = s_iter;
+}
 
-  // Remove set t.
-  sets_.erase(t_iter);
+template<class T>
+int FeatureSets<T>::root(int v) const {
+  return forest_.find(v);
 }
 
 template<class T>
 typename FeatureSets<T>::Set& FeatureSets<T>::get(int v) {
-  typename SetList::iterator set = sets_.find(features_[v]);
-  CHECK(set != sets_.end());
-  return set->second;
+  return roots_[root(v)]->second;
 }
 
 template<class T>
 const typename FeatureSets<T>::Set& FeatureSets<T>::find(int v) const {
-  typename SetList::const_iterator set = sets_.find(features_[v]);
-  CHECK(set != sets_.end());
-  return set->second;
+  return roots_[root(v)]->second;
 }
 
 template<class T>
 bool FeatureSets<T>::together(int u, int v) const {
-  return features_[u] == features_[v];
-}
-
-namespace {
-
-// Adapted from http://www.cplusplus.com/reference/algorithm/set_intersection/
-template <class InputIterator1, class InputIterator2, class Compare>
-bool overlap(InputIterator1 iter1,
-             InputIterator1 last1,
-             InputIterator2 iter2,
-             InputIterator2 last2,
-             Compare comp) {
-  while (iter1 != last1 && iter2 != last2) {
-    if (comp(*iter1, *iter2)) {
-      ++iter1;
-    } else if (comp(*iter2, *iter1)) {
-      ++iter2;
-    } else {
-      // Keys are equal.
-      return true;
-    }
-  }
-
-  return false;
-}
-
-bool compare(const std::map<ImageIndex, int>::value_type& lhs,
-             const std::map<ImageIndex, int>::value_type& rhs) {
-  return lhs.first < rhs.first;
-}
-
+  return root(u) == root(v);
 }
 
 template<class T>
@@ -149,11 +124,22 @@ bool FeatureSets<T>::compatible(int u, int v) const {
   // Assume that u and v are in different sets.
   CHECK(!together(u, v));
 
-  const Set& s = find(u);
-  const Set& t = find(v);
+  const std::map<ImageIndex, int>* s = &find(u).elements;
+  const std::map<ImageIndex, int>* t = &find(v).elements;
+
+  // Look up each frame of the smaller set in the larger.
+  if (s->size() > t->size()) {
+    std::swap(s, t);
+  }
+
+  std::map<ImageIndex, int>::const_iterator e;
+  for (e = s->begin(); e != s->end(); ++e) {
+    if (t->find(e->first) != t->end()) {
+      return false;
+    }
+  }
 
-  return !overlap(s.elements.begin(), s.elements.end(), t.elements.begin(),
-      t.elements.end(), compare);
+  return true;
 }
 
 template<class T>
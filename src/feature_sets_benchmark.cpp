@@ -0,0 +1,49 @@
+#include <utility>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <opencv2/core/core.hpp>
+#include "feature_sets.hpp"
+
+namespace {
+
+// Joins random pairs of n features spread over 8 views and 64 frames, as the
+// agglomerative clustering does. Argument is n.
+void BM_FeatureSetsJoin(benchmark::State& state) {
+  int n = state.range(0);
+
+  cv::RNG rng(0);
+  std::vector<ImageIndex> vertices;
+  for (int i = 0; i < n; i += 1) {
+    vertices.push_back(ImageIndex(rng.uniform(0, 8), rng.uniform(0, 64)));
+  }
+
+  std::vector<std::pair<int, int> > pairs;
+  for (int i = 0; i < n; i += 1) {
+    pairs.push_back(std::make_pair(rng.uniform(0, n), rng.uniform(0, n)));
+  }
+
+  FeatureSets<int> sets;
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    sets.init(vertices);
+    state.ResumeTiming();
+
+    // Only sets without a common frame are joined.
+    std::vector<std::pair<int, int> >::const_iterator pair;
+    for (pair = pairs.begin(); pair != pairs.end(); ++pair) {
+      int u = pair->first;
+      int v = pair->second;
+      if (!sets.together(u, v) && sets.compatible(u, v)) {
+        sets.join(u, v);
+      }
+    }
+    benchmark::DoNotOptimize(sets.count());
+  }
+
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK(BM_FeatureSetsJoin)->RangeMultiplier(8)->Range(1024, 1 << 20)
+    ->Unit(benchmark::kMillisecond);
+
+}
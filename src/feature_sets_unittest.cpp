@@ -1,4 +1,5 @@
 #include "feature_sets.hpp"
+#include "scaling_test.hpp"
 #include "gtest/gtest.h"
 
 template<class Key, class Value>
@@ -76,6 +77,28 @@ TEST(FeatureSets, Join) {
   ASSERT_EQ(sets.find(3).elements, desired);
 }
 
+TEST(FeatureSets, AddAfterJoin) {
+  std::vector<ImageIndex> vertices(2);
+  vertices[0] = ImageIndex(0, 0);
+  vertices[1] = ImageIndex(0, 1);
+
+  FeatureSets<int> sets;
+  sets.init(vertices);
+  sets.join(0, 1);
+  ASSERT_EQ(sets.add(ImageIndex(0, 2)), 2);
+  ASSERT_EQ(sets.count(), 2);
+  ASSERT_TRUE(sets.compatible(0, 2));
+
+  sets.join(2, 1);
+  ASSERT_EQ(sets.count(), 1);
+
+  std::map<ImageIndex, int> desired;
+  desired[ImageIndex(0, 0)] = 0;
+  desired[ImageIndex(0, 1)] = 1;
+  desired[ImageIndex(0, 2)] = 2;
+  ASSERT_EQ(sets.find(2).elements, desired);
+}
+
 TEST(FeatureSets, SeparateJoin) {
   std::vector<ImageIndex> vertices(4);
   vertices[0] = ImageIndex(0, 0);
@@ -193,3 +216,58 @@ TEST(FeatureSets, Compatible) {
   ASSERT_EQ(sets.compatible(1, 2), false);
   ASSERT_EQ(sets.compatible(2, 3), false);
 }
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Joins n features of different frames into one set, either by adding one
+// feature at a time or by joining sets of equal size in rounds.
+class JoinTrial : public ScalingTrial {
+  public:
+    explicit JoinTrial(bool chain) : chain_(chain), sets_(), n_(0) {}
+
+    void setUp(int n) {
+      std::vector<ImageIndex> vertices(n);
+      for (int i = 0; i < n; i += 1) {
+        vertices[i] = ImageIndex(0, i);
+      }
+      sets_.init(vertices);
+      n_ = n;
+    }
+
+    void run() {
+      if (chain_) {
+        // Alternate which side holds the large set.
+        for (int i = 1; i < n_; i += 1) {
+          if (i % 2 == 0) {
+            sets_.join(0, i);
+          } else {
+            sets_.join(i, 0);
+          }
+        }
+      } else {
+        for (int step = 1; step < n_; step *= 2) {
+          for (int i = 0; i + step < n_; i += 2 * step) {
+            sets_.join(i, i + step);
+          }
+        }
+      }
+      EXPECT_EQ(sets_.count(), 1);
+    }
+
+  private:
+    bool chain_;
+    FeatureSets<int> sets_;
+    int n_;
+};
+
+// Merging the smaller set into the larger makes joining n features take
+// O(n log^2 n) map operations. Merging the other way would be quadratic.
+TEST(FeatureSetsScaling, ChainJoin) {
+  JoinTrial trial(true);
+  expectExponentBelow(trial, 1 << 12, 1.5);
+}
+
+TEST(FeatureSetsScaling, BalancedJoin) {
+  JoinTrial trial(false);
+  expectExponentBelow(trial, 1 << 12, 1.5);
+}
@@ -8,6 +8,7 @@
 
 #include "match_result.hpp"
 #include "unique_match_result.hpp"
+#include "match_store.hpp"
 
 #include "iterator_reader.hpp"
 #include "match_result_reader.hpp"
@@ -56,18 +57,11 @@ void selectDistinctiveMatches(const std::vector<UniqueMatchResult>& matches,
 }
 
 void removeUndistinctiveMatches(std::vector<UniqueMatchResult>& matches,
-                                double ratio,
-                                bool forward) {
+                                double ratio) {
   std::vector<UniqueMatchResult> distinctive;
   selectDistinctiveMatches(matches, distinctive, ratio);
-
-  if (forward) {
-    LOG(INFO) << "Kept " << distinctive.size() << " / " << matches.size() <<
-        " distinctive forward matches";
-  } else {
-    LOG(INFO) << "Kept " << distinctive.size() << " / " << matches.size() <<
-        " distinctive reverse matches";
-  }
+  LOG(INFO) << "Kept " << distinctive.size() << " / " << matches.size() <<
+      " distinctive matches";
 
   matches.swap(distinctive);
 }
@@ -86,19 +80,11 @@ void selectGoodMatches(const std::vector<MatchResult>& matches,
       boost::bind(matchIsPoor, _1, threshold));
 }
 
-void removePoorMatches(std::vector<MatchResult>& matches,
-                       double threshold,
-                       bool forward) {
+void removePoorMatches(std::vector<MatchResult>& matches, double threshold) {
   std::vector<MatchResult> good;
   selectGoodMatches(matches, good, threshold);
-
-  if (forward) {
-    LOG(INFO) << "Kept " << good.size() << " / " << matches.size() <<
-        " good forward matches";
-  } else {
-    LOG(INFO) << "Kept " << good.size() << " / " << matches.size() <<
-        " good reverse matches";
-  }
+  LOG(INFO) << "Kept " << good.size() << " / " << matches.size() <<
+      " good matches";
 
   matches.swap(good);
 }
@@ -111,11 +97,64 @@ MatchResult uniqueResultToResult(const UniqueMatchResult& result) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Applies the filters to every pair of a store in one pass over its matches.
+// The matches which pass stay sorted, and keep their second-best distances.
+void filterMatchStore(const std::string& input_file,
+                      const std::string& output_file) {
+  MatchStore store;
+  bool ok = store.open(input_file);
+  CHECK(ok) << "Could not load matches";
+  LOG(INFO) << "Loaded " << store.numMatches() << " matches of " <<
+      store.numPairs() << " pairs";
+
+  bool use_clearance = FLAGS_unique && FLAGS_use_clearance;
+  CHECK(!use_clearance || store.isUnique()) << "Clearance needs second-best "
+      "distances, from a store packed with --type=unique";
+
+  MatchStoreWriter writer;
+  ok = writer.open(output_file, store.isUnique());
+  CHECK(ok) << "Could not open output store";
+
+  std::vector<MatchStoreRecord> kept;
+  int num_kept = 0;
+
+  for (int pair = 0; pair < store.numPairs(); pair += 1) {
+    kept.clear();
+    MatchStore::const_iterator record;
+    for (record = store.begin(pair); record != store.end(pair); ++record) {
+      if (use_clearance && matchIsUndistinctive(toUniqueMatchResult(*record),
+            FLAGS_clearance)) {
+        continue;
+      }
+      if (FLAGS_use_absolute_threshold &&
+          matchIsPoor(toMatchResult(*record), FLAGS_absolute_threshold)) {
+        continue;
+      }
+      kept.push_back(*record);
+    }
+
+    num_kept += kept.size();
+    const MatchStoreRecord* begin = kept.empty() ? NULL : &kept.front();
+    writer.add(store.image1(pair), store.image2(pair), begin,
+        begin + kept.size());
+  }
+
+  ok = writer.close();
+  CHECK(ok) << "Could not save list of matches";
+  LOG(INFO) << "Kept " << num_kept << " / " << store.numMatches() <<
+      " matches";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
   usage << "Computes matches between sets of descriptors." << std::endl;
   usage << std::endl;
   usage << argv[0] << " input-matches output-matches" << std::endl;
+  usage << std::endl;
+  usage << "If the input is a match store (see pack-matches), so is the "
+    "output, and every pair is filtered." << std::endl;
   google::SetUsageMessage(usage.str());
 
   google::InitGoogleLogging(argv[0]);
@@ -133,6 +172,11 @@ int main(int argc, char** argv) {
   std::string input_file = argv[1];
   std::string output_file = argv[2];
 
+  if (isBinaryFilename(input_file)) {
+    filterMatchStore(input_file, output_file);
+    return 0;
+  }
+
   bool ok;
 
   std::vector<MatchResult> matches;
@@ -148,7 +192,7 @@ int main(int argc, char** argv) {
 
     if (FLAGS_use_clearance) {
       // Filter results that are not distinctive.
-      removeUndistinctiveMatches(unique_matches, true, FLAGS_clearance);
+      removeUndistinctiveMatches(unique_matches, FLAGS_clearance);
     }
 
     // Convert to plain old matches (without next-best information).
@@ -163,7 +207,7 @@ int main(int argc, char** argv) {
 
   if (FLAGS_use_absolute_threshold) {
     // Filter matches that are below a threshold.
-    removePoorMatches(matches, FLAGS_absolute_threshold, true);
+    removePoorMatches(matches, FLAGS_absolute_threshold);
   }
 
   MatchResultWriter match_writer;
@@ -0,0 +1,138 @@
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <opencv2/core/core.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include "track_filter.hpp"
+#include "feature_files.hpp"
+
+DEFINE_bool(multiview, false, "Tracks are multiview tracks");
+DEFINE_int32(min_length, 0,
+    "Keep tracks which span at least this many frames (0 to disable)");
+DEFINE_double(min_step, -1,
+    "Keep tracks whose average step is at least this many pixels (negative "
+    "to disable)");
+DEFINE_string(box, "",
+    "Keep tracks which never leave the box x,y,width,height (empty to "
+    "disable)");
+DEFINE_int32(min_views, 0,
+    "Keep multiview tracks present in at least this many views (0 to "
+    "disable)");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Keeps the tracks which satisfy every condition given by the "
+    "flags, in one pass." << std::endl;
+  usage << std::endl;
+  usage << "Sample usage: " << argv[0] << " input-tracks output-tracks";
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+bool parseBox(const std::string& str, cv::Rect_<double>& box) {
+  double x;
+  double y;
+  double width;
+  double height;
+  char end;
+  int n = std::sscanf(str.c_str(), "%lf,%lf,%lf,%lf%c", &x, &y, &width,
+      &height, &end);
+  if (n != 4) {
+    return false;
+  }
+  box = cv::Rect_<double>(x, y, width, height);
+  return true;
+}
+
+void logKept(int num_output, int num_input) {
+  if (num_input == 0) {
+    LOG(INFO) << "No tracks to filter";
+    return;
+  }
+  double fraction = static_cast<double>(num_output) / num_input;
+  LOG(INFO) << "Kept " << num_output << " / " << num_input << " tracks (" <<
+      fraction << ")";
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string input_file = argv[1];
+  std::string output_file = argv[2];
+
+  cv::Rect_<double> box;
+  if (!FLAGS_box.empty()) {
+    bool ok = parseBox(FLAGS_box, box);
+    CHECK(ok) << "Could not parse box \"" << FLAGS_box << "\"";
+  }
+
+  // Single-view conditions, which are applied to every view of a multiview
+  // track.
+  MinLengthPredicate min_length(FLAGS_min_length);
+  MinAverageStepPredicate min_step(FLAGS_min_step);
+  InsideBoxPredicate inside_box(box);
+
+  TrackFilter filter;
+  if (FLAGS_min_length > 0) {
+    filter.add(min_length);
+  }
+  if (!FLAGS_box.empty()) {
+    filter.add(inside_box);
+  }
+
+  if (!FLAGS_multiview) {
+    CHECK(FLAGS_min_views == 0) << "Views are only counted with --multiview";
+    if (FLAGS_min_step >= 0) {
+      filter.add(min_step);
+    }
+
+    // Load tracks from file. Binary tracks are not copied.
+    TrackListView<SiftPosition> input_tracks;
+    bool ok = loadSiftPositionTracks(input_file, input_tracks);
+    CHECK(ok) << "Could not load tracks";
+
+    TrackList<SiftPosition> output_tracks;
+    int num_output = filterTracks(input_tracks, filter, output_tracks);
+    logKept(num_output, input_tracks.size());
+
+    ok = saveSiftPositionTracks(output_file, output_tracks);
+    CHECK(ok) << "Could not save tracks";
+  } else {
+    EachViewPredicate each_view(filter);
+    MultiviewMinAverageStepPredicate multiview_min_step(FLAGS_min_step);
+    MinViewsPredicate min_views(FLAGS_min_views);
+
+    // Cheapest conditions first.
+    MultiviewTrackFilter multiview_filter;
+    if (FLAGS_min_views > 0) {
+      multiview_filter.add(min_views);
+    }
+    multiview_filter.add(each_view);
+    if (FLAGS_min_step >= 0) {
+      multiview_filter.add(multiview_min_step);
+    }
+
+    MultiviewTrackListView<SiftPosition> input_tracks;
+    bool ok = loadSiftPositionMultiviewTracks(input_file, input_tracks);
+    CHECK(ok) << "Could not load tracks";
+
+    MultiviewTrackList<SiftPosition> output_tracks;
+    int num_output = filterMultiviewTracks(input_tracks, multiview_filter,
+        output_tracks);
+    logKept(num_output, input_tracks.numTracks());
+
+    ok = saveSiftPositionMultiviewTracks(output_file, output_tracks);
+    CHECK(ok) << "Could not save tracks";
+  }
+
+  return 0;
+}
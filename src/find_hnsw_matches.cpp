@@ -0,0 +1,87 @@
+#include "find_hnsw_matches.hpp"
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <glog/logging.h>
+#include "util/thread-pool.hpp"
+
+namespace {
+
+// Points searched by one task.
+const int HNSW_BLOCK_SIZE = 256;
+
+// Searches the graph for one block of points.
+// For use with ThreadPool::parallelFor().
+class HnswBlockFunction {
+  public:
+    HnswBlockFunction(const HnswIndex& index,
+                      const cv::Mat& points,
+                      std::deque<QueryResultList>& matches,
+                      int max_num,
+                      bool use_threshold,
+                      double threshold)
+        : index_(&index),
+          points_(&points),
+          matches_(&matches),
+          max_num_(max_num),
+          use_threshold_(use_threshold),
+          threshold_(threshold) {}
+
+    void operator()(int block) const {
+      int begin = block * HNSW_BLOCK_SIZE;
+      int end = std::min(begin + HNSW_BLOCK_SIZE, points_->rows);
+      std::vector<std::pair<float, int> > nearest;
+
+      for (int i = begin; i < end; i += 1) {
+        index_->search(points_->ptr<float>(i), max_num_, nearest);
+
+        QueryResultList& matches = (*matches_)[i];
+        std::vector<std::pair<float, int> >::const_iterator match;
+        for (match = nearest.begin(); match != nearest.end(); ++match) {
+          if (use_threshold_ && match->first > threshold_) {
+            break;
+          }
+          matches.push_back(QueryResult(match->second, match->first));
+        }
+      }
+    }
+
+  private:
+    const HnswIndex* index_;
+    const cv::Mat* points_;
+    std::deque<QueryResultList>* matches_;
+    int max_num_;
+    bool use_threshold_;
+    double threshold_;
+};
+
+}
+
+void findMatchesUsingHnswIndex(const DescriptorMatrix& points1,
+                               const HnswIndex& index2,
+                               std::deque<QueryResultList>& matches,
+                               bool use_max_num,
+                               int max_num,
+                               bool use_threshold,
+                               double threshold,
+                               ThreadPool* pool) {
+  CHECK(use_max_num && max_num > 0) <<
+      "Graph search finds a fixed number of neighbours";
+  CHECK(points1.empty() || points1.cols() == index2.dimension()) <<
+      "Descriptors differ in size";
+
+  // Every block writes to its own elements.
+  matches.assign(points1.rows(), QueryResultList());
+  cv::Mat points = points1.toFloat();
+  int num_blocks = (points.rows + HNSW_BLOCK_SIZE - 1) / HNSW_BLOCK_SIZE;
+  HnswBlockFunction function(index2, points, matches, max_num, use_threshold,
+      threshold);
+
+  if (pool != NULL) {
+    pool->parallelFor(0, num_blocks, function);
+  } else {
+    for (int block = 0; block < num_blocks; block += 1) {
+      function(block);
+    }
+  }
+}
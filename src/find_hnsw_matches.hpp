@@ -0,0 +1,24 @@
+#ifndef FIND_HNSW_MATCHES_HPP_
+#define FIND_HNSW_MATCHES_HPP_
+
+#include <deque>
+#include "descriptor_matrix.hpp"
+#include "find_matches.hpp"
+#include "hnsw_index.hpp"
+
+class ThreadPool;
+
+// Searches a graph index of descriptors, such as those of many captures, for
+// the max_num nearest neighbours of each point. The search is approximate
+// and finds a fixed number of neighbours, so use_max_num must be set.
+// Blocks of points are searched in parallel if given a pool.
+void findMatchesUsingHnswIndex(const DescriptorMatrix& points1,
+                               const HnswIndex& index2,
+                               std::deque<QueryResultList>& matches,
+                               bool use_max_num,
+                               int max_num,
+                               bool use_threshold,
+                               double threshold,
+                               ThreadPool* pool);
+
+#endif
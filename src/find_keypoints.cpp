@@ -8,18 +8,20 @@
 #include <glog/logging.h>
 #include <opencv2/core/core.hpp>
 #include "read_image.hpp"
-#include "detect_sift.hpp"
-
-#include "sift_feature_writer.hpp"
-#include "iterator_writer.hpp"
-
-const int MAX_NUM_FEATURES = 0;
-const int NUM_OCTAVE_LAYERS = 3;
-const double EDGE_THRESHOLD = 10;
-const double SIGMA = 1.6;
+#include "plane_cache.hpp"
+#include "feature_files.hpp"
+#include "stages.hpp"
 
 DEFINE_double(contrast_threshold, 0.04,
     "Constrast threshold for feature detection");
+DEFINE_string(plane_cache, "",
+    "Directory in which to keep the SIFT pyramid of the image, so that "
+    "extract-sift-tracks can reuse it. Features are then detected from that "
+    "pyramid, which starts at the original resolution instead of doubling "
+    "it. Empty to detect with cv::SIFT.");
+DEFINE_string(descriptor_type, "float",
+    "Type to store descriptors as (float, half or byte). Matching keeps "
+    "the stored type, so half and byte take less memory.");
 
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
@@ -37,6 +39,11 @@ void init(int& argc, char**& argv) {
     google::ShowUsageWithFlags(argv[0]);
     std::exit(1);
   }
+
+  int type;
+  CHECK(parseDescriptorType(FLAGS_descriptor_type, type) &&
+      type != ANY_DESCRIPTOR_TYPE) << "Unknown descriptor type `" <<
+      FLAGS_descriptor_type << "'";
 }
 
 int main(int argc, char** argv) {
@@ -51,21 +58,17 @@ int main(int argc, char** argv) {
   bool ok = readImage(image_filename, color_image, image);
   CHECK(ok) << "Could not read image";
 
-  SiftOptions options;
-  options.max_num_features = MAX_NUM_FEATURES;
-  options.num_octave_layers = NUM_OCTAVE_LAYERS;
-  options.contrast_threshold = FLAGS_contrast_threshold;
-  options.edge_threshold = EDGE_THRESHOLD;
-  options.sigma = SIGMA;
-
   std::vector<SiftFeature> features;
-  extractFeatures(image, features, options);
+  PlaneCache cache(FLAGS_plane_cache);
+  findKeypoints(image, findKeypointsOptions(FLAGS_contrast_threshold), cache,
+      features);
 
   LOG(INFO) << "Found " << features.size() << " features";
 
   // Save out to file.
-  SiftFeatureWriter feature_writer;
-  ok = saveList(features_filename, features, feature_writer);
+  int type;
+  parseDescriptorType(FLAGS_descriptor_type, type);
+  ok = saveSiftFeatures(features_filename, features, type);
   CHECK(ok) << "Could not save descriptors";
 
   return 0;
@@ -0,0 +1,186 @@
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/thread/thread.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <opencv2/core/core.hpp>
+
+#include "chunked_archive.hpp"
+#include "detect_sift.hpp"
+#include "feature_files.hpp"
+#include "image_file_sequence.hpp"
+#include "plane_cache.hpp"
+#include "stages.hpp"
+#include "util/bounded-queue.hpp"
+
+#include "iterator_writer.hpp"
+#include "sift_feature_writer.hpp"
+
+DEFINE_double(contrast_threshold, 0.04,
+    "Constrast threshold for feature detection");
+DEFINE_string(plane_cache, "",
+    "Directory in which to keep the SIFT pyramid of each image, so that "
+    "extract-sift-tracks can reuse it. Features are then detected from that "
+    "pyramid, which starts at the original resolution instead of doubling "
+    "it. Empty to detect with cv::SIFT.");
+DEFINE_string(descriptor_type, "float",
+    "Type to round descriptors to (float, half or byte)");
+DEFINE_string(key_format, "%03d.yaml",
+    "Format of the archive key of each frame, which takes the frame number "
+    "starting from 1");
+DEFINE_string(codec, "lz4", "Compression of chunks (none, lz4 or zstd)");
+DEFINE_int32(chunk_size, 1 << 20,
+    "Approximate number of bytes in each chunk before compression");
+DEFINE_int32(num_threads, 4, "Number of frames to find features in at once");
+DEFINE_int32(max_buffered, 8,
+    "Maximum number of frames waiting between each stage");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Finds SIFT keypoints and descriptors in every frame of a sequence "
+    "and stores them in one chunked archive." << std::endl;
+  usage << std::endl;
+  usage << "Sample usage:" << std::endl;
+  usage << argv[0] << " image-format archive" << std::endl;
+  usage << std::endl;
+  usage << "Each entry is the file find-keypoints would write for the frame."
+    << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+std::string makeFilename(const std::string& format, int n) {
+  return boost::str(boost::format(format) % (n + 1));
+}
+
+struct Frame {
+  int t;
+  cv::Mat image;
+};
+
+// Serialized features of one frame.
+struct FrameFeatures {
+  int t;
+  int num_features;
+  std::string data;
+};
+
+// Decoding thread. Reads every frame of the sequence in order.
+void decodeFrames(const ImageFileSequence* video,
+                  BoundedQueue<Frame>* output) {
+  int num_frames = video->length();
+  for (int t = 0; t < num_frames; t += 1) {
+    Frame frame;
+    frame.t = t;
+    bool ok = video->get(t, frame.image);
+    CHECK(ok) << "Could not read frame " << t + 1;
+    output->push(frame);
+  }
+
+  output->close();
+}
+
+// Detection thread. Several take frames from the same queue, so their results
+// arrive out of order.
+void detectFrames(BoundedQueue<Frame>* input,
+                  BoundedQueue<FrameFeatures>* output,
+                  const SiftOptions* options,
+                  const PlaneCache* cache,
+                  int type) {
+  SiftFeatureWriter feature_writer(type);
+  VectorWriter<SiftFeature> writer(feature_writer);
+  Frame frame;
+
+  while (input->pop(frame)) {
+    std::vector<SiftFeature> features;
+    findKeypoints(frame.image, *options, *cache, features);
+
+    FrameFeatures result;
+    result.t = frame.t;
+    result.num_features = features.size();
+    result.data = serializeEntry(features, writer);
+    output->push(result);
+  }
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string image_format = argv[1];
+  std::string archive_file = argv[2];
+
+  ArchiveCodec codec;
+  CHECK(parseArchiveCodec(FLAGS_codec, codec)) << "Unknown codec `" <<
+      FLAGS_codec << "'";
+  CHECK(FLAGS_chunk_size > 0);
+  CHECK(FLAGS_num_threads > 0) << "Need at least one detection thread";
+  int type;
+  CHECK(parseDescriptorType(FLAGS_descriptor_type, type) &&
+      type != ANY_DESCRIPTOR_TYPE) << "Unknown descriptor type `" <<
+      FLAGS_descriptor_type << "'";
+
+  ImageFileSequence video(image_format, true);
+  int num_frames = video.countFrames();
+
+  SiftOptions options = findKeypointsOptions(FLAGS_contrast_threshold);
+
+  PlaneCache cache(FLAGS_plane_cache);
+
+  ChunkedArchiveWriter archive(codec, FLAGS_chunk_size);
+  bool ok = archive.open(archive_file);
+  CHECK(ok) << "Could not open archive";
+
+  // One thread decodes images while the others find features.
+  BoundedQueue<Frame> frames(FLAGS_max_buffered);
+  BoundedQueue<FrameFeatures> results(FLAGS_max_buffered);
+  boost::thread decoder(boost::bind(decodeFrames, &video, &frames));
+  boost::thread_group detectors;
+  for (int i = 0; i < FLAGS_num_threads; i += 1) {
+    detectors.create_thread(boost::bind(detectFrames, &frames, &results,
+          &options, &cache, type));
+  }
+
+  // Write the frames to the archive in order, holding any which finish early.
+  std::map<int, FrameFeatures> finished;
+  int next = 0;
+  for (int i = 0; i < num_frames; i += 1) {
+    FrameFeatures result;
+    ok = results.pop(result);
+    CHECK(ok);
+    finished[result.t].data.swap(result.data);
+    finished[result.t].num_features = result.num_features;
+
+    std::map<int, FrameFeatures>::iterator frame = finished.find(next);
+    while (frame != finished.end()) {
+      ok = archive.add(makeFilename(FLAGS_key_format, next),
+          frame->second.data);
+      CHECK(ok) << "Could not add frame " << next + 1;
+      LOG(INFO) << "Frame " << next + 1 << ": " <<
+          frame->second.num_features << " features";
+
+      finished.erase(frame);
+      next += 1;
+      frame = finished.find(next);
+    }
+  }
+
+  decoder.join();
+  detectors.join_all();
+
+  ok = archive.close();
+  CHECK(ok) << "Could not save archive";
+
+  return 0;
+}
@@ -1,9 +1,12 @@
 #include "find_matches.hpp"
+#include <cmath>
+#include <algorithm>
+#include <utility>
 #include <glog/logging.h>
 #include <boost/bind.hpp>
 #include <opencv2/core/core.hpp>
 #include <opencv2/features2d/features2d.hpp>
-#include "find_matches_util.hpp"
+#include "util/thread-pool.hpp"
 
 QueryResult::QueryResult() : index(-1), distance(-1) {}
 
@@ -39,6 +42,117 @@ void convertQueryResultListsToMatches(
   }
 }
 
+int QueryResultTable::numQueries() const {
+  return offsets.empty() ? 0 : int(offsets.size()) - 1;
+}
+
+std::vector<QueryResult>::const_iterator QueryResultTable::begin(
+    int query) const {
+  return results.begin() + offsets[query];
+}
+
+std::vector<QueryResult>::const_iterator QueryResultTable::end(
+    int query) const {
+  return results.begin() + offsets[query + 1];
+}
+
+void convertQueryResultTableToMatches(const QueryResultTable& table,
+                                      std::vector<MatchResult>& matches,
+                                      bool forward) {
+  matches.clear();
+  matches.reserve(table.results.size());
+
+  for (int i = 0; i < table.numQueries(); i += 1) {
+    std::vector<QueryResult>::const_iterator query;
+
+    for (query = table.begin(i); query != table.end(i); ++query) {
+      int index1 = i;
+      int index2 = query->index;
+
+      if (!forward) {
+        std::swap(index1, index2);
+      }
+
+      matches.push_back(MatchResult(index1, index2, query->distance));
+    }
+  }
+}
+
+void convertQueryResultTableToLists(const QueryResultTable& table,
+                                    std::deque<QueryResultList>& lists) {
+  lists.assign(table.numQueries(), QueryResultList());
+
+  for (int i = 0; i < table.numQueries(); i += 1) {
+    lists[i].assign(table.begin(i), table.end(i));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+QueryResultSink::QueryResultSink(QueryResultTable& table,
+                                 bool use_max_num,
+                                 int max_num,
+                                 bool use_threshold,
+                                 double threshold)
+    : table_(&table),
+      use_max_num_(use_max_num),
+      max_num_(max_num),
+      use_threshold_(use_threshold),
+      threshold_(threshold),
+      num_queries_(0),
+      current_(-1),
+      num_current_(0) {
+  if (use_max_num) {
+    CHECK(max_num > 0);
+  }
+}
+
+void QueryResultSink::begin(int num_queries) {
+  num_queries_ = num_queries;
+  current_ = -1;
+  num_current_ = 0;
+
+  table_->offsets.clear();
+  table_->offsets.reserve(num_queries + 1);
+  table_->offsets.push_back(0);
+  table_->results.clear();
+  if (use_max_num_) {
+    table_->results.reserve(num_queries * max_num_);
+  }
+}
+
+void QueryResultSink::advanceTo(int query) {
+  // Close the current query and any without matches.
+  while (current_ < query) {
+    if (current_ >= 0) {
+      table_->offsets.push_back(table_->results.size());
+    }
+    current_ += 1;
+  }
+}
+
+void QueryResultSink::add(int query, int train, float distance) {
+  if (query != current_) {
+    advanceTo(query);
+    num_current_ = 0;
+  }
+
+  // Matches arrive in order of distance, so the rest can be ignored too.
+  if (use_max_num_ && num_current_ >= max_num_) {
+    return;
+  }
+  if (use_threshold_ && distance > threshold_) {
+    return;
+  }
+
+  table_->results.push_back(QueryResult(train, distance));
+  num_current_ += 1;
+}
+
+void QueryResultSink::end() {
+  advanceTo(num_queries_);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 class CompareQueryResults {
@@ -161,39 +275,134 @@ void findMatchesUsingClassifiers(const std::deque<Classifier>& classifiers,
   }
 }
 
-////////////////////////////////////////////////////////////////////////////////
-
 namespace {
 
-// A list of single matches.
-typedef std::vector<cv::DMatch> RawMatchList;
+// Number of classifiers scored by each matrix product.
+const int CLASSIFIER_BLOCK_SIZE = 64;
+
+// Selects the matches of one classifier from its scores.
+void selectMatchesFromScores(const float* scores,
+                             int num_points,
+                             QueryResultList& matches,
+                             bool use_max_num,
+                             int max_num,
+                             bool use_threshold,
+                             double threshold) {
+  // Distance is exp(-score), so compare scores and only take exp() of those
+  // which are kept. Candidates are (-score, index) to sort by distance.
+  typedef std::pair<float, int> Candidate;
+  std::vector<Candidate> candidates;
+  candidates.reserve(num_points);
+
+  if (!use_threshold) {
+    for (int j = 0; j < num_points; j += 1) {
+      candidates.push_back(Candidate(-scores[j], j));
+    }
+  } else if (threshold > 0) {
+    float max_negative_score = std::log(threshold);
+    for (int j = 0; j < num_points; j += 1) {
+      if (-scores[j] <= max_negative_score) {
+        candidates.push_back(Candidate(-scores[j], j));
+      }
+    }
+  }
 
-// Converts from raw cv::Matches to query results.
-QueryResult convertMatch(const cv::DMatch& match) {
-  return QueryResult(match.trainIdx, match.distance);
-}
+  int num_matches = candidates.size();
+  if (use_max_num) {
+    num_matches = std::min(num_matches, max_num);
+  }
+  std::partial_sort(candidates.begin(), candidates.begin() + num_matches,
+      candidates.end());
 
-void convertMatchList(const RawMatchList& raw, QueryResultList& matches) {
   matches.clear();
-  std::transform(raw.begin(), raw.end(), std::back_inserter(matches),
-      convertMatch);
+  for (int n = 0; n < num_matches; n += 1) {
+    matches.push_back(QueryResult(candidates[n].second,
+          std::exp(candidates[n].first)));
+  }
 }
 
-void convertMatchLists(const std::vector<RawMatchList>& raw,
-                       std::deque<QueryResultList>& directed) {
-  directed.assign(raw.size(), QueryResultList());
+// Scores the points using one block of classifiers.
+// For use with ThreadPool::parallelFor().
+class ClassifierBlockFunction {
+  public:
+    ClassifierBlockFunction(const ClassifierBank& classifiers,
+                            const ClassifierPoints& points,
+                            std::deque<QueryResultList>& matches,
+                            bool use_max_num,
+                            int max_num,
+                            bool use_threshold,
+                            double threshold)
+        : classifiers_(&classifiers),
+          points_(&points),
+          matches_(&matches),
+          use_max_num_(use_max_num),
+          max_num_(max_num),
+          use_threshold_(use_threshold),
+          threshold_(threshold) {}
+
+    void operator()(int block) const {
+      int begin = block * CLASSIFIER_BLOCK_SIZE;
+      int end = std::min(begin + CLASSIFIER_BLOCK_SIZE, classifiers_->size());
+
+      cv::Mat scores;
+      classifiers_->score(*points_, begin, end, scores);
+
+      for (int i = begin; i < end; i += 1) {
+        selectMatchesFromScores(scores.ptr<float>(i - begin), points_->rows(),
+            (*matches_)[i], use_max_num_, max_num_, use_threshold_,
+            threshold_);
+      }
+    }
 
-  std::vector<RawMatchList>::const_iterator raw_matches = raw.begin();
-  std::deque<QueryResultList>::iterator directed_matches = directed.begin();
+  private:
+    const ClassifierBank* classifiers_;
+    const ClassifierPoints* points_;
+    std::deque<QueryResultList>* matches_;
+    bool use_max_num_;
+    int max_num_;
+    bool use_threshold_;
+    double threshold_;
+};
 
-  while (raw_matches != raw.end()) {
-    convertMatchList(*raw_matches, *directed_matches);
+}
 
-    ++raw_matches;
-    ++directed_matches;
+void findMatchesUsingClassifierBank(const ClassifierBank& classifiers,
+                                    const DescriptorMatrix& points,
+                                    std::deque<QueryResultList>& matches,
+                                    bool use_max_num,
+                                    int max_num,
+                                    bool use_threshold,
+                                    double threshold,
+                                    ThreadPool* pool) {
+  if (use_max_num) {
+    CHECK(max_num > 0);
+  }
+
+  // Every block writes to its own elements.
+  matches.assign(classifiers.size(), QueryResultList());
+
+  int num_blocks = (classifiers.size() + CLASSIFIER_BLOCK_SIZE - 1) /
+      CLASSIFIER_BLOCK_SIZE;
+  // Widened and uploaded once for every block of classifiers.
+  ClassifierPoints prepared(classifiers, points.toFloat());
+  ClassifierBlockFunction function(classifiers, prepared, matches,
+      use_max_num, max_num, use_threshold, threshold);
+
+  if (pool != NULL) {
+    pool->parallelFor(0, num_blocks, function);
+  } else {
+    for (int block = 0; block < num_blocks; block += 1) {
+      function(block);
+    }
   }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// A list of single matches.
+typedef std::vector<cv::DMatch> RawMatchList;
 
 // Iteratively finds matches within a relative radius of the best match.
 // Iterative in case of approximate techniques finding better "best" matches.
@@ -255,92 +464,50 @@ void relativeRadiusMatch(const cv::Mat& query,
   }
 }
 
-// Removes matches which are not within the max relative distance.
-void filterMatches(const QueryResultList& matches,
-                   QueryResultList& subset,
-                   double max_relative_distance) {
-  // Matches are ordered by distance.
-  // Find the point at which they exceed the distance.
-  double nearest = matches.front().distance;
-  double radius = nearest / max_relative_distance;
-
-  QueryResultList::const_iterator last = matches.begin();
-  while (last != matches.end() && last->distance <= radius) {
-    ++last;
-  }
-
-  subset.clear();
-  std::copy(matches.begin(), last, std::back_inserter(subset));
-}
-
-void filterMatchLists(const std::deque<QueryResultList>& input,
-                      std::deque<QueryResultList>& output,
-                      double max_relative_distance) {
-  output.assign(input.size(), QueryResultList());
-
-  std::deque<QueryResultList>::const_iterator input_matches = input.begin();
-  std::deque<QueryResultList>::iterator output_matches = output.begin();
-
-  while (input_matches != input.begin()) {
-    filterMatches(*input_matches, *output_matches, max_relative_distance);
-
-    ++input_matches;
-    ++output_matches;
+// Finds the distance from a query to each of its candidates, whose
+// elements are of type T.
+template<class T>
+void matchCandidates(const float* query,
+                     const DescriptorMatrix& train,
+                     const std::vector<int>& candidates,
+                     std::vector<std::pair<float, int> >& distances) {
+  distances.clear();
+  int num_dimensions = train.cols();
+
+  std::vector<int>::const_iterator j;
+  for (j = candidates.begin(); j != candidates.end(); ++j) {
+    const T* row = train.row<T>(*j);
+    float distance = 0;
+    for (int d = 0; d < num_dimensions; d += 1) {
+      float delta = query[d] - float(row[d]);
+      distance += delta * delta;
+    }
+    distances.push_back(std::make_pair(std::sqrt(distance), *j));
   }
 }
 
-// If max_num_matches is greater than zero, the number of matches will be
-// limited. If max_relative_distance is greater than zero, the distance of the
-// matches from the best match will be limited.
+// If use_max_num is set, the k nearest neighbours are retrieved, otherwise
+// all neighbours within the threshold.
 //
 // If both constraints are active, the fixed number will be retrieved and
-// results that are too far away will be removed.
+// results beyond the threshold will be removed.
 void matchMatrixRows(const cv::Mat& query,
-                     const cv::Mat& train,
-                     std::deque<QueryResultList>& matches,
+                     const DescriptorIndex& train,
+                     QueryResultTable& matches,
                      bool use_max_num,
                      int max_num,
                      bool use_threshold,
-                     double threshold,
-                     bool use_flann) {
-  // Construct matching object.
-  cv::Ptr<cv::DescriptorMatcher> matcher;
-  if (use_flann) {
-    matcher = cv::DescriptorMatcher::create("FlannBased");
-  } else {
-    matcher = cv::DescriptorMatcher::create("BruteForce");
-  }
-
-  // Put one element in a singleton list to train the matcher.
-  std::vector<cv::Mat> singleton;
-  singleton.push_back(train);
-  matcher->add(singleton);
+                     double threshold) {
+  QueryResultSink sink(matches, use_max_num, max_num, use_threshold,
+      threshold);
 
   if (use_max_num) {
     // Take top few matches.
-    std::vector<RawMatchList> raw;
-    matcher->knnMatch(query, raw, max_num);
-
-    // Convert from cv::DMatch to our match.
-    convertMatchLists(raw, matches);
-
-    if (use_threshold) {
-      // Remove any results that are too far away.
-      std::deque<QueryResultList> filtered;
-      filterMatchLists(matches, filtered, threshold);
-      matches.swap(filtered);
-    }
+    train.knnMatch(query, sink, max_num);
   } else {
     // No maximum number of matches specified.
     CHECK(use_threshold) << "No limit on number of matches";
-
-    // Retrieve based on relative distance.
-    std::vector<RawMatchList> raw;
-    //relativeRadiusMatch(query, *matcher, raw, max_relative_distance);
-    matcher->radiusMatch(query, raw, threshold);
-
-    // Convert from cv::DMatch to our match.
-    convertMatchLists(raw, matches);
+    train.radiusMatch(query, sink, threshold);
   }
 }
 
@@ -354,15 +521,153 @@ void findMatchesUsingEuclideanDistance(const std::deque<Descriptor>& points1,
                                        bool use_threshold,
                                        double threshold,
                                        bool use_flann) {
-  // Copy descriptors into matrices for cv::DescriptorMatcher.
-  cv::Mat mat1;
-  cv::Mat mat2;
-  listToMatrix(points1, mat1);
-  listToMatrix(points2, mat2);
+  DescriptorIndex index2;
+  index2.build(points2, use_flann);
+
+  findMatchesUsingIndex(points1, index2, matches, use_max_num, max_num,
+      use_threshold, threshold);
+}
+
+void findMatchesUsingIndex(const std::deque<Descriptor>& points1,
+                           const DescriptorIndex& index2,
+                           std::deque<QueryResultList>& matches,
+                           bool use_max_num,
+                           int max_num,
+                           bool use_threshold,
+                           double threshold) {
+  DescriptorMatrix matrix1;
+  listToMatrix(points1, matrix1);
+
+  findMatchesUsingIndex(matrix1, index2, matches, use_max_num, max_num,
+      use_threshold, threshold);
+}
+
+void findMatchesUsingIndex(const DescriptorMatrix& points1,
+                           const DescriptorIndex& index2,
+                           std::deque<QueryResultList>& matches,
+                           bool use_max_num,
+                           int max_num,
+                           bool use_threshold,
+                           double threshold) {
+  QueryResultTable table;
+  findMatchesUsingIndex(points1, index2, table, use_max_num, max_num,
+      use_threshold, threshold);
+  convertQueryResultTableToLists(table, matches);
+}
+
+void findMatchesUsingIndex(const DescriptorMatrix& points1,
+                           const DescriptorIndex& index2,
+                           QueryResultTable& matches,
+                           bool use_max_num,
+                           int max_num,
+                           bool use_threshold,
+                           double threshold) {
+  matchMatrixRows(points1.toFloat(), index2, matches, use_max_num, max_num,
+      use_threshold, threshold);
+}
+
+void findMatchesUsingIndices(const DescriptorIndex& index1,
+                             const DescriptorIndex& index2,
+                             std::deque<QueryResultList>& matches,
+                             bool use_max_num,
+                             int max_num,
+                             bool use_threshold,
+                             double threshold) {
+  QueryResultTable table;
+  findMatchesUsingIndices(index1, index2, table, use_max_num, max_num,
+      use_threshold, threshold);
+  convertQueryResultTableToLists(table, matches);
+}
+
+void findMatchesUsingIndices(const DescriptorIndex& index1,
+                             const DescriptorIndex& index2,
+                             QueryResultTable& matches,
+                             bool use_max_num,
+                             int max_num,
+                             bool use_threshold,
+                             double threshold) {
+  matchMatrixRows(index1.descriptors(), index2, matches, use_max_num, max_num,
+      use_threshold, threshold);
+}
+
+void findMatchesUsingIndices(const DescriptorIndex& index1,
+                             int begin,
+                             int end,
+                             const DescriptorIndex& index2,
+                             QueryResultTable& matches,
+                             bool use_max_num,
+                             int max_num,
+                             bool use_threshold,
+                             double threshold) {
+  matchMatrixRows(index1.descriptors(begin, end), index2, matches,
+      use_max_num, max_num, use_threshold, threshold);
+}
+
+void findMatchesUsingCandidates(
+    const DescriptorMatrix& points1,
+    const DescriptorMatrix& points2,
+    const std::vector<std::vector<int> >& candidates,
+    std::deque<QueryResultList>& matches,
+    bool use_max_num,
+    int max_num,
+    bool use_threshold,
+    double threshold) {
+  QueryResultTable table;
+  findMatchesUsingCandidates(points1, points2, candidates, table, use_max_num,
+      max_num, use_threshold, threshold);
+  convertQueryResultTableToLists(table, matches);
+}
 
-  // Match forwards.
-  matchMatrixRows(mat1, mat2, matches, use_max_num, max_num, use_threshold,
-      threshold, use_flann);
+void findMatchesUsingCandidates(
+    const DescriptorMatrix& points1,
+    const DescriptorMatrix& points2,
+    const std::vector<std::vector<int> >& candidates,
+    QueryResultTable& matches,
+    bool use_max_num,
+    int max_num,
+    bool use_threshold,
+    double threshold) {
+  CHECK(points1.cols() == points2.cols()) << "Descriptors differ in size";
+  CHECK(int(candidates.size()) == points1.rows());
+  if (!use_max_num) {
+    CHECK(use_threshold) << "No limit on number of matches";
+  }
+
+  QueryResultSink sink(matches, use_max_num, max_num, use_threshold,
+      threshold);
+  // Re-used by every query.
+  std::vector<std::pair<float, int> > distances;
+  // The queries are widened once, the candidates are read as stored.
+  cv::Mat query = points1.toFloat();
+  int type = points2.type();
+  CHECK(type == cv::DataType<float>::type ||
+      type == DescriptorMatrix::HALF_TYPE ||
+      type == cv::DataType<uchar>::type) << "Unknown descriptor type";
+
+  sink.begin(points1.rows());
+  for (int i = 0; i < points1.rows(); i += 1) {
+    const float* row = query.ptr<float>(i);
+    if (type == cv::DataType<float>::type) {
+      matchCandidates<float>(row, points2, candidates[i], distances);
+    } else if (type == DescriptorMatrix::HALF_TYPE) {
+      matchCandidates<HalfFloat>(row, points2, candidates[i], distances);
+    } else {
+      matchCandidates<uchar>(row, points2, candidates[i], distances);
+    }
+
+    // Only the matches which the sink keeps need to be sorted.
+    int n = distances.size();
+    if (use_max_num) {
+      n = std::min(n, max_num);
+    }
+    std::partial_sort(distances.begin(), distances.begin() + n,
+        distances.end());
+
+    for (int j = 0; j < n; j += 1) {
+      sink.add(i, distances[j].second, distances[j].first);
+    }
+  }
+  sink.end();
 }
 
 void findMatchesInBothDirectionsUsingEuclideanDistance(
@@ -375,15 +680,52 @@ void findMatchesInBothDirectionsUsingEuclideanDistance(
     bool use_threshold,
     double threshold,
     bool use_flann) {
-  // Copy descriptors into matrices for cv::DescriptorMatcher.
-  cv::Mat mat1;
-  cv::Mat mat2;
-  listToMatrix(points1, mat1);
-  listToMatrix(points2, mat2);
-
-  // Match forwards and backwards.
-  matchMatrixRows(mat1, mat2, forward, use_max_num, max_num, use_threshold,
-      threshold, use_flann);
-  matchMatrixRows(mat2, mat1, reverse, use_max_num, max_num, use_threshold,
-      threshold, use_flann);
+  DescriptorIndex index1;
+  DescriptorIndex index2;
+  index1.build(points1, use_flann);
+  index2.build(points2, use_flann);
+
+  findMatchesInBothDirectionsUsingIndices(index1, index2, forward, reverse,
+      use_max_num, max_num, use_threshold, threshold);
+}
+
+void findMatchesInBothDirectionsUsingIndices(
+    const DescriptorIndex& index1,
+    const DescriptorIndex& index2,
+    std::deque<QueryResultList>& forward,
+    std::deque<QueryResultList>& reverse,
+    bool use_max_num,
+    int max_num,
+    bool use_threshold,
+    double threshold) {
+  QueryResultTable forward_table;
+  QueryResultTable reverse_table;
+  findMatchesInBothDirectionsUsingIndices(index1, index2, forward_table,
+      reverse_table, use_max_num, max_num, use_threshold, threshold);
+  convertQueryResultTableToLists(forward_table, forward);
+  convertQueryResultTableToLists(reverse_table, reverse);
+}
+
+void findMatchesInBothDirectionsUsingIndices(
+    const DescriptorIndex& index1,
+    const DescriptorIndex& index2,
+    QueryResultTable& forward,
+    QueryResultTable& reverse,
+    bool use_max_num,
+    int max_num,
+    bool use_threshold,
+    double threshold) {
+  QueryResultSink forward_sink(forward, use_max_num, max_num, use_threshold,
+      threshold);
+  QueryResultSink reverse_sink(reverse, use_max_num, max_num, use_threshold,
+      threshold);
+
+  // Search both ways at once, which shares the distances if exact.
+  if (use_max_num) {
+    index1.knnMatchBothDirections(index2, forward_sink, reverse_sink, max_num);
+  } else {
+    CHECK(use_threshold) << "No limit on number of matches";
+    index1.radiusMatchBothDirections(index2, forward_sink, reverse_sink,
+        threshold);
+  }
 }
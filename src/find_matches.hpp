@@ -2,9 +2,14 @@
 #include "match.hpp"
 #include "descriptor.hpp"
 #include "classifier.hpp"
+#include "classifier_bank.hpp"
+#include "descriptor_index.hpp"
+#include "match_sink.hpp"
 #include <vector>
 #include <deque>
 
+class ThreadPool;
+
 // Matching in both directions returns directed matches.
 struct QueryResult {
   int index;
@@ -22,6 +27,54 @@ void convertQueryResultListsToMatches(
     std::vector<MatchResult>& undirected,
     bool forward);
 
+// The matches of every query in one flat array.
+// The matches of query i are results[offsets[i]] to results[offsets[i + 1]].
+struct QueryResultTable {
+  std::vector<int> offsets;
+  std::vector<QueryResult> results;
+
+  int numQueries() const;
+  std::vector<QueryResult>::const_iterator begin(int query) const;
+  std::vector<QueryResult>::const_iterator end(int query) const;
+};
+
+void convertQueryResultTableToMatches(const QueryResultTable& directed,
+                                      std::vector<MatchResult>& undirected,
+                                      bool forward);
+
+void convertQueryResultTableToLists(const QueryResultTable& table,
+                                    std::deque<QueryResultList>& lists);
+
+// Writes search results straight into a table.
+// Keeps at most max_num matches per query and drops those beyond the
+// threshold.
+class QueryResultSink : public MatchSink {
+  public:
+    QueryResultSink(QueryResultTable& table,
+                    bool use_max_num,
+                    int max_num,
+                    bool use_threshold,
+                    double threshold);
+
+    void begin(int num_queries);
+    void add(int query, int train, float distance);
+    void end();
+
+  private:
+    // Adds empty entries for queries up to but not including query.
+    void advanceTo(int query);
+
+    QueryResultTable* table_;
+    bool use_max_num_;
+    int max_num_;
+    bool use_threshold_;
+    double threshold_;
+    int num_queries_;
+    // Query whose matches are being added.
+    int current_;
+    int num_current_;
+};
+
 // Finds all matches for each point in the other set.
 // Limited by max_num and threshold.
 // Outputs a list of matched points for each point.
@@ -33,6 +86,17 @@ void findMatchesUsingClassifiers(const std::deque<Classifier>& classifiers,
                                  bool use_threshold,
                                  double threshold);
 
+// Same as above except that all points are scored by a block of classifiers
+// with one matrix product. Blocks are processed in parallel if given a pool.
+void findMatchesUsingClassifierBank(const ClassifierBank& classifiers,
+                                    const DescriptorMatrix& points,
+                                    std::deque<QueryResultList>& matches,
+                                    bool use_max_num,
+                                    int max_num,
+                                    bool use_threshold,
+                                    double threshold,
+                                    ThreadPool* pool);
+
 void findMatchesUsingClassifier(const Classifier& classifier,
                                 const std::deque<Descriptor>& points,
                                 std::vector<QueryResult>& matches,
@@ -54,6 +118,84 @@ void findMatchesUsingEuclideanDistance(
     double threshold,
     bool use_flann);
 
+// Same as above except that the index of the second set is given.
+// Re-use an index to match many sets against one set.
+void findMatchesUsingIndex(const std::deque<Descriptor>& points1,
+                           const DescriptorIndex& index2,
+                           std::deque<QueryResultList>& matches,
+                           bool use_max_num,
+                           int max_num,
+                           bool use_threshold,
+                           double threshold);
+
+// Queries the rows of a matrix without copying.
+void findMatchesUsingIndex(const DescriptorMatrix& points1,
+                           const DescriptorIndex& index2,
+                           std::deque<QueryResultList>& matches,
+                           bool use_max_num,
+                           int max_num,
+                           bool use_threshold,
+                           double threshold);
+
+void findMatchesUsingIndex(const DescriptorMatrix& points1,
+                           const DescriptorIndex& index2,
+                           QueryResultTable& matches,
+                           bool use_max_num,
+                           int max_num,
+                           bool use_threshold,
+                           double threshold);
+
+// Matches the descriptors of the first index against the second.
+void findMatchesUsingIndices(const DescriptorIndex& index1,
+                             const DescriptorIndex& index2,
+                             std::deque<QueryResultList>& matches,
+                             bool use_max_num,
+                             int max_num,
+                             bool use_threshold,
+                             double threshold);
+
+void findMatchesUsingIndices(const DescriptorIndex& index1,
+                             const DescriptorIndex& index2,
+                             QueryResultTable& matches,
+                             bool use_max_num,
+                             int max_num,
+                             bool use_threshold,
+                             double threshold);
+
+// Matches only rows [begin, end) of the first index, e.g. to split a large
+// pair of sets into several tasks. Query i of the table is row begin + i.
+void findMatchesUsingIndices(const DescriptorIndex& index1,
+                             int begin,
+                             int end,
+                             const DescriptorIndex& index2,
+                             QueryResultTable& matches,
+                             bool use_max_num,
+                             int max_num,
+                             bool use_threshold,
+                             double threshold);
+
+// Matches each point only against some candidates in the second set, such as
+// those near its epipolar line. The search is exact.
+void findMatchesUsingCandidates(
+    const DescriptorMatrix& points1,
+    const DescriptorMatrix& points2,
+    const std::vector<std::vector<int> >& candidates,
+    std::deque<QueryResultList>& matches,
+    bool use_max_num,
+    int max_num,
+    bool use_threshold,
+    double threshold);
+
+void findMatchesUsingCandidates(
+    const DescriptorMatrix& points1,
+    const DescriptorMatrix& points2,
+    const std::vector<std::vector<int> >& candidates,
+    QueryResultTable& matches,
+    bool use_max_num,
+    int max_num,
+    bool use_threshold,
+    double threshold);
+
 // Bundle forward and reverse matching together when using Euclidean distance.
 // Saves converting to cv::Mats twice.
 void findMatchesInBothDirectionsUsingEuclideanDistance(
@@ -66,3 +208,24 @@ void findMatchesInBothDirectionsUsingEuclideanDistance(
     bool use_threshold,
     double threshold,
     bool use_flann);
+
+// Same as above except that the index of each set is given.
+void findMatchesInBothDirectionsUsingIndices(
+    const DescriptorIndex& index1,
+    const DescriptorIndex& index2,
+    std::deque<QueryResultList>& forward_matches,
+    std::deque<QueryResultList>& reverse_matches,
+    bool use_max_num,
+    int max_num,
+    bool use_threshold,
+    double threshold);
+
+void findMatchesInBothDirectionsUsingIndices(
+    const DescriptorIndex& index1,
+    const DescriptorIndex& index2,
+    QueryResultTable& forward_matches,
+    QueryResultTable& reverse_matches,
+    bool use_max_num,
+    int max_num,
+    bool use_threshold,
+    double threshold);
@@ -0,0 +1,48 @@
+#include <deque>
+#include <benchmark/benchmark.h>
+#include <opencv2/core/core.hpp>
+#include "descriptor.hpp"
+#include "find_matches.hpp"
+
+namespace {
+
+const int DESCRIPTOR_SIZE = 128;
+const int MAX_NUM_MATCHES = 2;
+
+void makeDescriptors(int n, cv::RNG& rng, std::deque<Descriptor>& points) {
+  points.assign(n, Descriptor(DESCRIPTOR_SIZE));
+
+  std::deque<Descriptor>::iterator point;
+  for (point = points.begin(); point != points.end(); ++point) {
+    rng.fill(point->data, cv::RNG::UNIFORM, 0., 1.);
+  }
+}
+
+// Finds the two nearest neighbours of every point in a set of the same size.
+// Arguments are the number of points and whether to use FLANN.
+void BM_FindMatchesUsingEuclideanDistance(benchmark::State& state) {
+  int n = state.range(0);
+  bool use_flann = state.range(1);
+
+  cv::RNG rng(0);
+  std::deque<Descriptor> points1;
+  std::deque<Descriptor> points2;
+  makeDescriptors(n, rng, points1);
+  makeDescriptors(n, rng, points2);
+
+  std::deque<QueryResultList> matches;
+  while (state.KeepRunning()) {
+    findMatchesUsingEuclideanDistance(points1, points2, matches, true,
+        MAX_NUM_MATCHES, false, 0, use_flann);
+    benchmark::DoNotOptimize(matches.size());
+  }
+
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK(BM_FindMatchesUsingEuclideanDistance)
+    ->ArgsProduct({ benchmark::CreateRange(256, 16384, 4), { 0, 1 } })
+    ->ArgNames({ "n", "flann" })
+    ->Unit(benchmark::kMillisecond);
+
+}
@@ -1,20 +1,21 @@
 #include <iostream>
 #include <string>
 #include <sstream>
-#include <stack>
 #include <map>
 #include <set>
 #include <boost/lexical_cast.hpp>
 #include <boost/format.hpp>
-#include <boost/bind.hpp>
-#include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/undirected_graph.hpp>
-#include <boost/graph/bron_kerbosch_all_cliques.hpp>
 #include <glog/logging.h>
 #include <gflags/gflags.h>
 #include "match.hpp"
 #include "multiview_track.hpp"
 #include "multiview_track_list.hpp"
+#include "feature_index.hpp"
+#include "feature_index_map.hpp"
+#include "match_graph.hpp"
+#include "match_store.hpp"
+#include "max_cliques.hpp"
+#include "util/thread-pool.hpp"
 
 #include "read_lines.hpp"
 #include "iterator_reader.hpp"
@@ -24,65 +25,26 @@
 #include "default_writer.hpp"
 
 DEFINE_bool(discard_inconsistent, false,
-    "Discard any feature which appears twice in one frame.");
+    "Discard any feature which is matched to two features of one frame.");
+DEFINE_int32(min_clique_size, 8, "Smallest clique to print");
+DEFINE_int32(num_threads, 4,
+    "Number of worker threads to search for cliques with, 0 for none");
 
 // More than one feature may be observed in each frame.
 typedef std::vector<int> FeatureSet;
 
-// Identifies a feature in a multiview video.
-// TODO: Need a better name?
-struct FeatureIndex {
-  int view;
-  int time;
-  int id;
-
-  FeatureIndex();
-  FeatureIndex(int view, int time, int id);
-  FeatureIndex(const ImageIndex& frame, int id);
-
-  // Defines an ordering over feature indices.
-  bool operator<(const FeatureIndex& other) const;
-};
-
-FeatureIndex::FeatureIndex() : view(-1), time(-1), id(-1) {}
-
-FeatureIndex::FeatureIndex(int view, int time, int id)
-    : view(view), time(time), id(id) {}
-
-FeatureIndex::FeatureIndex(const ImageIndex& frame, int id)
-    : view(frame.view), time(frame.time), id(id) {}
-
-bool FeatureIndex::operator<(const FeatureIndex& other) const {
-  if (view < other.view) {
-    return true;
-  } else if (other.view < view) {
-    return false;
-  } else {
-    if (time < other.time) {
-      return true;
-    } else if (other.time < time) {
-      return false;
-    } else {
-      return id < other.id;
-    }
-  }
-}
-
-typedef boost::undirected_graph<FeatureIndex> MatchGraph;
-typedef std::map<FeatureIndex, MatchGraph::vertex_descriptor> VertexLookup;
+typedef FeatureIndexMap<int> VertexLookup;
 typedef std::vector<FeatureIndex> FeatureList;
 
-std::ostream& operator<<(std::ostream& stream, const FeatureIndex& feature) {
-  return stream << "(" << feature.view << ", " << feature.time << ", " <<
-      feature.id << ")";
-}
-
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
   usage << "Reduces matches to consistent tracks." << std::endl;
   usage << std::endl;
   usage << argv[0] << " matches-format view-names num-frames tracks" <<
       std::endl;
+  usage << std::endl;
+  usage << "matches-format may instead be a match store of the same pairs "
+    "(see pack-matches)." << std::endl;
   google::SetUsageMessage(usage.str());
 
   google::InitGoogleLogging(argv[0]);
@@ -103,35 +65,43 @@ std::string makeMatchFilename(const std::string& format,
       boost::format(format) % view1 % view2 % (time1 + 1) % (time2 + 1));
 }
 
-MatchGraph::vertex_descriptor findOrInsert(MatchGraph& graph,
-                                           VertexLookup& vertices,
-                                           const FeatureIndex& feature) {
-  MatchGraph::vertex_descriptor vertex;
-
-  // Try to find feature in lookup map.
-  VertexLookup::const_iterator mapping = vertices.find(feature);
-
-  if (mapping != vertices.end()) {
-    // Found the vertex, it already exists.
-    vertex = mapping->second;
-  } else {
-    // Did not find it, create an entry.
-    vertex = boost::add_vertex(feature, graph);
-    vertices[feature] = vertex;
+int findOrInsert(std::vector<FeatureIndex>& features,
+                 VertexLookup& vertices,
+                 const FeatureIndex& feature) {
+  // Reserve an entry in the lookup table, filled in if the feature is new.
+  std::pair<int*, bool> mapping = vertices.insert(feature, 0);
+
+  if (mapping.second) {
+    // Did not find it, create a vertex.
+    features.push_back(feature);
+    *mapping.first = features.size() - 1;
   }
 
-  return vertex;
+  return *mapping.first;
 }
 
 void loadAllMatches(const std::string& matches_format,
                     const std::vector<std::string>& views,
                     int num_frames,
-                    MatchGraph& graph) {
+                    MatchGraph& graph,
+                    ThreadPool& pool) {
   int num_views = views.size();
   int n = num_views * num_frames;
   int num_matches = 0;
 
   VertexLookup vertices;
+  std::vector<FeatureIndex> features;
+  std::vector<MatchGraphEdge> edges;
+
+  if (isBinaryFilename(matches_format)) {
+    // Take the edges of every pair from one mapped store.
+    MatchStore store;
+    bool ok = store.open(matches_format);
+    CHECK(ok) << "Could not load matches";
+    addMatchStoreEdges(store, vertices, features, edges);
+    graph.build(features, edges, pool);
+    return;
+  }
 
   for (int i1 = 0; i1 < n; i1 += 1) {
     // Match all unique pairs.
@@ -166,16 +136,16 @@ void loadAllMatches(const std::string& matches_format,
         FeatureIndex feature2(frame2, match->second);
 
         // Find existing vertex for feature, or insert one.
-        MatchGraph::vertex_descriptor vertex1;
-        MatchGraph::vertex_descriptor vertex2;
-        vertex1 = findOrInsert(graph, vertices, feature1);
-        vertex2 = findOrInsert(graph, vertices, feature2);
+        int vertex1 = findOrInsert(features, vertices, feature1);
+        int vertex2 = findOrInsert(features, vertices, feature2);
 
-        // Add vertex to graph.
-        boost::add_edge(vertex1, vertex2, graph);
+        // Add edge to graph.
+        edges.push_back(MatchGraphEdge(vertex1, vertex2, 1));
       }
     }
   }
+
+  graph.build(features, edges, pool);
 }
 
 bool multitrackToTrack(const MultiviewTrack<FeatureSet>& multiview_multitrack,
@@ -214,26 +184,29 @@ bool multitrackToTrack(const MultiviewTrack<FeatureSet>& multiview_multitrack,
   return true;
 }
 
-// The clique_printer is a visitor that will print the vertices that comprise
-// a clique. Note that the vertices are not given in any specific order.
-template <typename OutputStream>
-struct clique_printer
-{
-    clique_printer(OutputStream& stream)
-        : os(stream)
-    { }
-
-    template <typename Clique, typename Graph>
-    void clique(const Clique& c, const Graph& g)
-    {
-        // Iterate over the clique and print each vertex within it.
-        typename Clique::const_iterator i, end = c.end();
-        for(i = c.begin(); i != end; ++i) {
-            os << g[*i] << " ";
-        }
-        os << std::endl;
+// Prints the features of each clique as the cliques are found.
+class CliquePrinter : public CliqueVisitor {
+  public:
+    CliquePrinter(const MatchGraph& graph, std::ostream& stream)
+        : graph_(&graph), stream_(&stream), num_cliques_(0) {}
+
+    void clique(const std::vector<int>& vertices) {
+      std::vector<int>::const_iterator vertex;
+      for (vertex = vertices.begin(); vertex != vertices.end(); ++vertex) {
+        *stream_ << (*graph_)[*vertex] << " ";
+      }
+      *stream_ << std::endl;
+      num_cliques_ += 1;
+    }
+
+    int numCliques() const {
+      return num_cliques_;
     }
-    OutputStream& os;
+
+  private:
+    const MatchGraph* graph_;
+    std::ostream* stream_;
+    int num_cliques_;
 };
 
 int main(int argc, char** argv) {
@@ -252,19 +225,20 @@ int main(int argc, char** argv) {
   int num_views = views.size();
 
   // Load matches.
+  ThreadPool pool(FLAGS_num_threads);
   MatchGraph graph;
-  loadAllMatches(matches_format, views, num_frames, graph);
-  int num_vertices = boost::num_vertices(graph);
-  int num_edges = boost::num_edges(graph);
+  loadAllMatches(matches_format, views, num_frames, graph, pool);
+  int num_vertices = graph.numVertices();
+  int num_edges = graph.numEdges();
   LOG(INFO) << "Loaded " << num_edges << " matches between " << num_vertices <<
       " features";
 
-  // Instantiate the visitor for printing cliques
-  clique_printer<std::ostream> vis(std::cout);
-
-  // Use the Bron-Kerbosch algorithm to find all cliques, printing them
-  // as they are found.
-  boost::bron_kerbosch_all_cliques(graph, vis, 8);
+  MaxCliqueOptions options;
+  options.min_size = FLAGS_min_clique_size;
+  options.consistent = FLAGS_discard_inconsistent;
+  CliquePrinter printer(graph, std::cout);
+  findMaxCliques(graph, options, printer, pool);
+  LOG(INFO) << "Found " << printer.numCliques() << " maximal cliques";
 
   return 0;
 }
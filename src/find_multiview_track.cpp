@@ -1,5 +1,8 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #include <string>
+#include <utility>
 #include <sstream>
 #include <cstdlib>
 #include <glog/logging.h>
@@ -15,7 +18,8 @@
 #include "distortion.hpp"
 #include "util.hpp"
 #include "quantize_ray.hpp"
-#include "viterbi.hpp"
+#include "ray_track_search.hpp"
+#include "util/thread-pool.hpp"
 
 #include "track_list_reader.hpp"
 #include "image_point_reader.hpp"
@@ -26,6 +30,15 @@
 #include "image_point_writer.hpp"
 
 DEFINE_double(delta, 1, "Minimum resolution (in pixels) per quantization");
+DEFINE_double(coarse_delta, 0,
+    "Resolution (in pixels) of a first, coarse search, 0 to search only at "
+    "--delta");
+DEFINE_int32(band, 2,
+    "Coarse positions either side of the coarse solution within which the "
+    "rays are quantized at --delta");
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads to solve tracks with, 0 to solve serially");
+DEFINE_int32(batch_size, 256, "Number of tracks to solve at once");
 
 std::pair<int, cv::Point2d> calibrateIndexedPoint(
     const std::pair<int, cv::Point2d>& point,
@@ -77,124 +90,54 @@ Track<cv::Point2d> calibrateAndUndistortTrack(
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void findMultiviewTrack(const Track<cv::Point2d>& track,
-                        const std::vector<Camera>& cameras,
-                        int selected,
-                        MultiviewTrack<cv::Point2d>& multiview_track,
-                        double lambda1,
-                        double lambda2) {
-  int num_views = cameras.size();
-
-  multiview_track = MultiviewTrack<cv::Point2d>(num_views);
-
-  LOG(INFO) << "Quantizing 3D ray";
-
-  // For dynamic program, need to find the extent of the 3D ray in each frame.
-  typedef std::map<double, cv::Point3d> Ray;
-  std::vector<Ray> rays;
-  {
-    Track<cv::Point2d>::const_iterator point;
-    for (point = track.begin(); point != track.end(); ++point) {
-      Ray ray;
-      quantizeRay(point->second, cameras, selected, FLAGS_delta, ray);
-      rays.push_back(Ray());
-      rays.back().swap(ray);
-    }
-  }
-
-  LOG(INFO) << "Constructing Viterbi problem";
-
-  // Construct unary costs.
-  std::deque<std::vector<double> > unary_costs;
-  {
-    std::vector<Ray>::const_iterator ray;
-    for (ray = rays.begin(); ray != rays.end(); ++ray) {
-      std::vector<double> costs;
-
-      Ray::const_iterator point;
-      for (point = ray->begin(); point != ray->end(); ++point) {
-        double cost = 0;
-
-        std::vector<Camera>::const_iterator camera;
-        for (camera = cameras.begin(); camera != cameras.end(); ++camera) {
-          // Compute cost.
-          cost += 0;
-        }
-        costs.push_back(cost);
-      }
-
-      unary_costs.push_back(std::vector<double>());
-      unary_costs.back().swap(costs);
-    }
-  }
-
-  // Construct binary costs.
-  std::vector<cv::Mat> binary_costs;
-  if (rays.size() > 1) {
-    std::vector<Ray>::const_iterator ray2 = rays.begin();
-    std::vector<Ray>::const_iterator ray1;
-
-    for (ray1 = ray2++; ray2 != rays.end(); ray1 = ray2++) {
-      int n = ray1->size();
-      int m = ray2->size();
-
-      cv::Mat costs = cv::Mat_<double>(m, n, 0.);
-
-      // Compute cost of moving from each position to another.
-      int index1 = 0;
-      Ray::const_iterator point1;
-      for (point1 = ray1->begin(); point1 != ray1->end(); ++point1) {
-        cv::Point3d x1 = point1->second;
-
-        int index2 = 0;
-        Ray::const_iterator point2;
-        for (point2 = ray2->begin(); point2 != ray2->end(); ++point2) {
-          cv::Point3d x2 = point2->second;
-
-          // Cost of moving from x1 to x2 in 3D.
-          double cost = lambda2 * cv::norm(x1 - x2);
-
-          std::vector<Camera>::const_iterator camera;
-          for (camera = cameras.begin(); camera != cameras.end(); ++camera) {
-            // Compute appearance cost.
-            cost += 0;
-          }
-
-          costs.at<double>(index2, index1) = cost;
-          index2 += 1;
-        }
-        index1 += 1;
-      }
-
-      binary_costs.push_back(costs);
-    }
-  }
-
-  LOG(INFO) << "Solving dynamic program";
-  std::vector<int> solution;
-  solveViterbi(unary_costs, binary_costs, solution);
-}
-
 void findMultiviewTracks(
     const TrackList<cv::Point2d>& tracks,
     const std::vector<Camera>& cameras,
     int selected,
     MultiviewTrackList<cv::Point2d>& multiview_tracks,
-    int lambda1,
-    int lambda2) {
+    int lambda2,
+    ThreadPool& pool) {
   int num_views = cameras.size();
   multiview_tracks = MultiviewTrackList<cv::Point2d>(num_views);
 
-  TrackList<cv::Point2d>::const_iterator track;
-  for (track = tracks.begin(); track != tracks.end(); ++track) {
-    // Find match for this track.
-    MultiviewTrack<cv::Point2d> multiview_track;
-    findMultiviewTrack(*track, cameras, selected, multiview_track, lambda1,
-        lambda2);
-
-    // Swap into end of list.
-    multiview_tracks.push_back(MultiviewTrack<cv::Point2d>());
-    multiview_tracks.back().swap(multiview_track);
+  // The terms of the other cameras are shared by every ray.
+  RayQuantizer quantizer(cameras, selected, FLAGS_delta);
+  // The fine search is only within a band of the coarse one.
+  bool coarse_to_fine = FLAGS_coarse_delta > FLAGS_delta;
+  RayQuantizer coarse_quantizer(cameras, selected,
+      coarse_to_fine ? FLAGS_coarse_delta : FLAGS_delta);
+
+  // The pairwise costs of a track are large, so only one batch is held.
+  int num_tracks = tracks.size();
+  for (int begin = 0; begin < num_tracks; begin += FLAGS_batch_size) {
+    int end = std::min(begin + FLAGS_batch_size, num_tracks);
+    int n = end - begin;
+
+    // For dynamic program, need to find the extent of the 3D ray in each
+    // frame. Quantize the rays of every point in the batch at once.
+    LOG(INFO) << "Quantizing 3D rays for tracks " << begin << " to " << end <<
+        " of " << num_tracks;
+    std::vector<cv::Point2d> projections;
+    // Start of each track's rays, and the number of rays at the end.
+    std::vector<int> offsets(1, 0);
+    for (int i = begin; i < end; i += 1) {
+      Track<cv::Point2d>::const_iterator point;
+      for (point = tracks[i].begin(); point != tracks[i].end(); ++point) {
+        projections.push_back(point->second);
+      }
+      offsets.push_back(projections.size());
+    }
+    QuantizedRaySet rays;
+    std::vector<std::vector<int> > solutions;
+    searchRayTracks(projections, offsets, quantizer,
+        coarse_to_fine ? &coarse_quantizer : NULL, FLAGS_band, lambda2, rays,
+        solutions, pool);
+
+    for (int i = 0; i < n; i += 1) {
+      // Solutions are not yet converted back to points, so each track is
+      // added empty.
+      multiview_tracks.push_back(MultiviewTrack<cv::Point2d>(num_views));
+    }
   }
 }
 
@@ -229,6 +172,8 @@ void init(int& argc, char**& argv) {
     google::ShowUsageWithFlags(argv[0]);
     std::exit(1);
   }
+  CHECK(FLAGS_delta > 0) << "Resolution must be positive";
+  CHECK(FLAGS_band >= 0) << "Band must not be negative";
 }
 
 int main(int argc, char** argv) {
@@ -286,7 +231,9 @@ int main(int argc, char** argv) {
 
   // Find multiview tracks.
   MultiviewTrackList<cv::Point2d> multiview_tracks;
-  findMultiviewTracks(input_tracks, cameras, main_view, multiview_tracks, 1, 1);
+  ThreadPool pool(FLAGS_num_threads);
+  findMultiviewTracks(input_tracks, cameras, main_view, multiview_tracks, 1,
+      pool);
 
   // Save points and tracks out.
   ImagePointWriter<double> point_writer;
@@ -7,7 +7,6 @@
 #include <utility>
 #include <glog/logging.h>
 #include <opencv2/features2d/features2d.hpp>
-#include "find_matches_util.hpp"
 #include "match_result.hpp"
 #include "match.hpp"
 
@@ -52,6 +51,11 @@ void convertUniqueQueryResultsToMatches(
   for (query = queries.begin(); query != queries.end(); ++query) {
     int index1 = index;
     int index2 = query->index;
+    index += 1;
+
+    if (index2 < 0) {
+      continue;
+    }
 
     if (!forward) {
       std::swap(index1, index2);
@@ -60,8 +64,6 @@ void convertUniqueQueryResultsToMatches(
     matches.push_back(
         UniqueMatchResult(index1, index2, query->distance, forward,
           query->next_best));
-
-    index += 1;
   }
 }
 
@@ -96,6 +98,25 @@ void findUniqueMatchesUsingClassifiers(
   }
 }
 
+void findUniqueMatchesUsingClassifierBank(
+    const ClassifierBank& classifiers,
+    const DescriptorMatrix& points,
+    std::vector<UniqueQueryResult>& matches,
+    ThreadPool* pool) {
+  // Find the top two matches for each classifier.
+  std::deque<QueryResultList> directed;
+  findMatchesUsingClassifierBank(classifiers, points, directed, true, 2, false,
+      0, pool);
+
+  matches.clear();
+  std::deque<QueryResultList>::const_iterator pair;
+  for (pair = directed.begin(); pair != directed.end(); ++pair) {
+    CHECK(pair->size() == 2);
+    matches.push_back(UniqueQueryResult((*pair)[0].index, (*pair)[0].distance,
+          (*pair)[1].distance));
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 namespace {
@@ -109,20 +130,11 @@ void convertMatchPairs(const std::vector<RawMatchList>& pairs,
 
 void matchMatrixRows(
     const cv::Mat& query,
-    const cv::Mat& train,
-    std::vector<UniqueQueryResult>& matches,
-    bool use_flann) {
-  // Construct matcher.
-  cv::Ptr<cv::DescriptorMatcher> matcher;
-  if (use_flann) {
-    matcher = cv::DescriptorMatcher::create("FlannBased");
-  } else {
-    matcher = cv::DescriptorMatcher::create("BruteForce");
-  }
-
+    const DescriptorIndex& train,
+    std::vector<UniqueQueryResult>& matches) {
   // Take top two matches.
   std::vector<std::vector<cv::DMatch> > raw;
-  matcher->knnMatch(query, train, raw, 2);
+  train.knnMatch(query, raw, 2);
 
   // Convert from cv::DMatch to UniqueMatchResult.
   convertMatchPairs(raw, matches);
@@ -135,12 +147,68 @@ void findUniqueMatchesUsingEuclideanDistance(
     const std::deque<Descriptor>& points2,
     std::vector<UniqueQueryResult>& matches,
     bool use_flann) {
-  cv::Mat mat1;
-  cv::Mat mat2;
-  listToMatrix(points1, mat1);
-  listToMatrix(points2, mat2);
+  DescriptorIndex index2;
+  index2.build(points2, use_flann);
+
+  findUniqueMatchesUsingIndex(points1, index2, matches);
+}
+
+void findUniqueMatchesUsingIndex(
+    const std::deque<Descriptor>& points1,
+    const DescriptorIndex& index2,
+    std::vector<UniqueQueryResult>& matches) {
+  DescriptorMatrix matrix1;
+  listToMatrix(points1, matrix1);
 
-  matchMatrixRows(mat1, mat2, matches, use_flann);
+  findUniqueMatchesUsingIndex(matrix1, index2, matches);
+}
+
+void findUniqueMatchesUsingIndex(
+    const DescriptorMatrix& points1,
+    const DescriptorIndex& index2,
+    std::vector<UniqueQueryResult>& matches) {
+  matchMatrixRows(points1.toFloat(), index2, matches);
+}
+
+void findUniqueMatchesUsingIndices(
+    const DescriptorIndex& index1,
+    const DescriptorIndex& index2,
+    std::vector<UniqueQueryResult>& matches) {
+  matchMatrixRows(index1.descriptors(), index2, matches);
+}
+
+void findUniqueMatchesUsingIndices(
+    const DescriptorIndex& index1,
+    int begin,
+    int end,
+    const DescriptorIndex& index2,
+    std::vector<UniqueQueryResult>& matches) {
+  matchMatrixRows(index1.descriptors(begin, end), index2, matches);
+}
+
+void findUniqueMatchesUsingCandidates(
+    const DescriptorMatrix& points1,
+    const DescriptorMatrix& points2,
+    const std::vector<std::vector<int> >& candidates,
+    std::vector<UniqueQueryResult>& matches) {
+  // Take the top two matches for each point.
+  std::deque<QueryResultList> directed;
+  findMatchesUsingCandidates(points1, points2, candidates, directed, true, 2,
+      false, 0);
+
+  matches.clear();
+  std::deque<QueryResultList>::const_iterator pair;
+  for (pair = directed.begin(); pair != directed.end(); ++pair) {
+    if (pair->empty()) {
+      matches.push_back(UniqueQueryResult());
+    } else if (pair->size() == 1) {
+      matches.push_back(UniqueQueryResult((*pair)[0].index,
+            (*pair)[0].distance, std::numeric_limits<double>::infinity()));
+    } else {
+      matches.push_back(UniqueQueryResult((*pair)[0].index,
+            (*pair)[0].distance, (*pair)[1].distance));
+    }
+  }
 }
 
 void findUniqueMatchesInBothDirectionsUsingEuclideanDistance(
@@ -149,15 +217,28 @@ void findUniqueMatchesInBothDirectionsUsingEuclideanDistance(
     std::vector<UniqueQueryResult>& forward,
     std::vector<UniqueQueryResult>& reverse,
     bool use_flann) {
-  // Copy descriptors into matrices for cv::DescriptorMatcher.
-  cv::Mat mat1;
-  cv::Mat mat2;
-  listToMatrix(points1, mat1);
-  listToMatrix(points2, mat2);
-
-  // Match forwards and backwards.
-  matchMatrixRows(mat1, mat2, forward, use_flann);
-  matchMatrixRows(mat2, mat1, reverse, use_flann);
+  DescriptorIndex index1;
+  DescriptorIndex index2;
+  index1.build(points1, use_flann);
+  index2.build(points2, use_flann);
+
+  findUniqueMatchesInBothDirectionsUsingIndices(index1, index2, forward,
+      reverse);
+}
+
+void findUniqueMatchesInBothDirectionsUsingIndices(
+    const DescriptorIndex& index1,
+    const DescriptorIndex& index2,
+    std::vector<UniqueQueryResult>& forward,
+    std::vector<UniqueQueryResult>& reverse) {
+  // Take top two matches in each direction.
+  // The distances are shared if the search is exact.
+  std::vector<RawMatchList> raw_forward;
+  std::vector<RawMatchList> raw_reverse;
+  index1.knnMatchBothDirections(index2, raw_forward, raw_reverse, 2);
+
+  convertMatchPairs(raw_forward, forward);
+  convertMatchPairs(raw_reverse, reverse);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1,10 +1,14 @@
 #include "unique_match_result.hpp"
 #include "descriptor.hpp"
 #include "classifier.hpp"
+#include "classifier_bank.hpp"
+#include "descriptor_index.hpp"
 #include <vector>
 #include <map>
 #include <deque>
 
+class ThreadPool;
+
 // The result of a unique match includes the distance to the second-best.
 struct UniqueQueryResult {
   int index;
@@ -15,6 +19,7 @@ struct UniqueQueryResult {
   UniqueQueryResult(int index, double distance, double next_best);
 };
 
+// Skips queries which did not find a match.
 void convertUniqueQueryResultsToMatches(
     const std::vector<UniqueQueryResult>& directed,
     std::vector<UniqueMatchResult>& undirected,
@@ -27,6 +32,14 @@ void findUniqueMatchesUsingClassifiers(
     const std::deque<Descriptor>& points,
     std::vector<UniqueQueryResult>& matches);
 
+// Same as above except that all points are scored by a block of classifiers
+// with one matrix product. Blocks are processed in parallel if given a pool.
+void findUniqueMatchesUsingClassifierBank(
+    const ClassifierBank& classifiers,
+    const DescriptorMatrix& points,
+    std::vector<UniqueQueryResult>& matches,
+    ThreadPool* pool);
+
 // Find the single best match for each point.
 // Returns also the distance to the second-best match.
 void findUniqueMatchesUsingEuclideanDistance(
@@ -35,6 +48,42 @@ void findUniqueMatchesUsingEuclideanDistance(
     std::vector<UniqueQueryResult>& matches,
     bool use_flann);
 
+// Same as above except that the index of the second set is given.
+void findUniqueMatchesUsingIndex(
+    const std::deque<Descriptor>& points1,
+    const DescriptorIndex& index2,
+    std::vector<UniqueQueryResult>& matches);
+
+// Queries the rows of a matrix without copying.
+void findUniqueMatchesUsingIndex(
+    const DescriptorMatrix& points1,
+    const DescriptorIndex& index2,
+    std::vector<UniqueQueryResult>& matches);
+
+// Matches the descriptors of the first index against the second.
+void findUniqueMatchesUsingIndices(
+    const DescriptorIndex& index1,
+    const DescriptorIndex& index2,
+    std::vector<UniqueQueryResult>& matches);
+
+// Matches only rows [begin, end) of the first index. Match i is of row
+// begin + i.
+void findUniqueMatchesUsingIndices(
+    const DescriptorIndex& index1,
+    int begin,
+    int end,
+    const DescriptorIndex& index2,
+    std::vector<UniqueQueryResult>& matches);
+
+// Matches each point only against some candidates in the second set, such as
+// those near its epipolar line. Points without candidates have index -1, and
+// points with one candidate have an infinite next-best distance.
+void findUniqueMatchesUsingCandidates(
+    const DescriptorMatrix& points1,
+    const DescriptorMatrix& points2,
+    const std::vector<std::vector<int> >& candidates,
+    std::vector<UniqueQueryResult>& matches);
+
 // If we're matching in both directions, avoid copying.
 void findUniqueMatchesInBothDirectionsUsingEuclideanDistance(
     const std::deque<Descriptor>& points1,
@@ -42,3 +91,10 @@ void findUniqueMatchesInBothDirectionsUsingEuclideanDistance(
     std::vector<UniqueQueryResult>& forward_matches,
     std::vector<UniqueQueryResult>& reverse_matches,
     bool use_flann);
+
+// Same as above except that the index of each set is given.
+void findUniqueMatchesInBothDirectionsUsingIndices(
+    const DescriptorIndex& index1,
+    const DescriptorIndex& index2,
+    std::vector<UniqueQueryResult>& forward_matches,
+    std::vector<UniqueQueryResult>& reverse_matches);
@@ -0,0 +1,82 @@
+#ifndef FIXED_DESCRIPTOR_HPP_
+#define FIXED_DESCRIPTOR_HPP_
+
+#include "descriptor.hpp"
+
+// Dimension of descriptors which is only known at run time.
+const int DYNAMIC_DIMENSION = 0;
+
+// Number of elements in a descriptor.
+//
+// Kernels take a Dimension<N> so that for fixed N the length of every loop is
+// a constant, which the compiler can unroll and vectorize.
+template<int N>
+class Dimension {
+  public:
+    static const int VALUE = N;
+
+    Dimension();
+    // Checks that n is N.
+    explicit Dimension(int n);
+
+    int size() const;
+};
+
+template<>
+class Dimension<DYNAMIC_DIMENSION> {
+  public:
+    static const int VALUE = DYNAMIC_DIMENSION;
+
+    explicit Dimension(int n);
+
+    int size() const;
+
+  private:
+    int size_;
+};
+
+// Descriptor whose dimension is part of its type, such as
+// FixedDescriptor<128, float> for SIFT. Stored inline.
+template<int N, class Scalar = double>
+struct FixedDescriptor {
+  static const int SIZE = N;
+  typedef Scalar value_type;
+
+  Scalar data[N];
+
+  FixedDescriptor();
+  // The descriptor must have dimension N.
+  explicit FixedDescriptor(const Descriptor& descriptor);
+
+  void copyTo(Descriptor& descriptor) const;
+
+  Scalar* begin();
+  const Scalar* begin() const;
+  Scalar* end();
+  const Scalar* end() const;
+};
+
+// Computes |x - y|^2 in double precision.
+template<int N, class X, class Y>
+double squaredDistance(Dimension<N> dimension, const X* x, const Y* y);
+
+// Computes x . y in double precision.
+template<int N, class X, class Y>
+double dot(Dimension<N> dimension, const X* x, const Y* y);
+
+template<int N, class Scalar>
+double squaredDistance(const FixedDescriptor<N, Scalar>& x,
+                       const FixedDescriptor<N, Scalar>& y);
+
+// Calls f(Dimension<N>()) for the fixed dimension N which equals n, or
+// f(Dimension<DYNAMIC_DIMENSION>(n)) if there is none. Dispatch once, outside
+// the loop over descriptors.
+//
+// The function has a template operator()(Dimension<N>). Fixed dimensions are
+// 128 (SIFT) and 64 and 32 (PCA and sub-vectors).
+template<class Function>
+void dispatchDimension(int n, Function& f);
+
+#include "fixed_descriptor.inl"
+
+#endif
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <glog/logging.h>
+
+template<int N>
+Dimension<N>::Dimension() {}
+
+template<int N>
+Dimension<N>::Dimension(int n) {
+  CHECK(n == N) << "Expected dimension " << N << ", not " << n;
+}
+
+template<int N>
+int Dimension<N>::size() const {
+  return N;
+}
+
+inline Dimension<DYNAMIC_DIMENSION>::Dimension(int n) : size_(n) {
+  CHECK(n >= 0);
+}
+
+inline int Dimension<DYNAMIC_DIMENSION>::size() const {
+  return size_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+template<int N, class Scalar>
+FixedDescriptor<N, Scalar>::FixedDescriptor() {
+  std::fill(begin(), end(), Scalar(0));
+}
+
+template<int N, class Scalar>
+FixedDescriptor<N, Scalar>::FixedDescriptor(const Descriptor& descriptor) {
+  CHECK(int(descriptor.data.size()) == N) << "Expected dimension " << N <<
+      ", not " << descriptor.data.size();
+  std::copy(descriptor.data.begin(), descriptor.data.end(), begin());
+}
+
+template<int N, class Scalar>
+void FixedDescriptor<N, Scalar>::copyTo(Descriptor& descriptor) const {
+  descriptor.data.assign(begin(), end());
+}
+
+template<int N, class Scalar>
+Scalar* FixedDescriptor<N, Scalar>::begin() {
+  return data;
+}
+
+template<int N, class Scalar>
+const Scalar* FixedDescriptor<N, Scalar>::begin() const {
+  return data;
+}
+
+template<int N, class Scalar>
+Scalar* FixedDescriptor<N, Scalar>::end() {
+  return data + N;
+}
+
+template<int N, class Scalar>
+const Scalar* FixedDescriptor<N, Scalar>::end() const {
+  return data + N;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Four independent sums let the additions be pipelined and vectorized, which
+// a single running sum prevents.
+
+template<int N, class X, class Y>
+double squaredDistance(Dimension<N> dimension, const X* x, const Y* y) {
+  int n = dimension.size();
+  double sums[4] = { 0, 0, 0, 0 };
+
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (int j = 0; j < 4; j += 1) {
+      double e = double(x[i + j]) - double(y[i + j]);
+      sums[j] += e * e;
+    }
+  }
+  for (; i < n; i += 1) {
+    double e = double(x[i]) - double(y[i]);
+    sums[0] += e * e;
+  }
+
+  return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+template<int N, class X, class Y>
+double dot(Dimension<N> dimension, const X* x, const Y* y) {
+  int n = dimension.size();
+  double sums[4] = { 0, 0, 0, 0 };
+
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (int j = 0; j < 4; j += 1) {
+      sums[j] += double(x[i + j]) * double(y[i + j]);
+    }
+  }
+  for (; i < n; i += 1) {
+    sums[0] += double(x[i]) * double(y[i]);
+  }
+
+  return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+template<int N, class Scalar>
+double squaredDistance(const FixedDescriptor<N, Scalar>& x,
+                       const FixedDescriptor<N, Scalar>& y) {
+  return squaredDistance(Dimension<N>(), x.data, y.data);
+}
+
+template<class Function>
+void dispatchDimension(int n, Function& f) {
+  if (n == 128) {
+    f(Dimension<128>());
+  } else if (n == 64) {
+    f(Dimension<64>());
+  } else if (n == 32) {
+    f(Dimension<32>());
+  } else {
+    f(Dimension<DYNAMIC_DIMENSION>(n));
+  }
+}
@@ -1,12 +1,88 @@
 #include "flow.hpp"
 #include <stdexcept>
+#include <cmath>
+#include <algorithm>
 #include <numeric>
 #include <glog/logging.h>
 #include <boost/scoped_array.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/static_assert.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <ceres/ceres.h>
 #include "util.hpp"
 #include "warper.hpp"
+#include "translation_warper.hpp"
+#include "similarity_warper.hpp"
+
+namespace {
+
+// Counts the evaluations of a cost function, which it takes ownership of.
+class CountingCost : public ceres::CostFunction {
+  public:
+    CountingCost(ceres::CostFunction* cost, FlowStatistics& statistics)
+        : cost_(cost), statistics_(&statistics) {
+      set_num_residuals(cost->num_residuals());
+      *mutable_parameter_block_sizes() = cost->parameter_block_sizes();
+    }
+
+    bool Evaluate(const double* const* parameters,
+                  double* residuals,
+                  double** jacobians) const {
+      statistics_->num_residual_evaluations += 1;
+      if (jacobians != NULL && jacobians[0] != NULL) {
+        statistics_->num_jacobian_evaluations += 1;
+      }
+      return cost_->Evaluate(parameters, residuals, jacobians);
+    }
+
+  private:
+    boost::scoped_ptr<ceres::CostFunction> cost_;
+    FlowStatistics* statistics_;
+};
+
+}
+
+// Samples the warped image and computes the masked residuals in place.
+// If gradients are required, the derivative images are sampled at the same
+// time (for efficiency and hopefully correct downsampling).
+void computeResiduals(const cv::Mat& M,
+                      const cv::Mat& J,
+                      const cv::Mat& I,
+                      const cv::Mat& dIdx,
+                      const cv::Mat& dIdy,
+                      const cv::Mat& mask,
+                      int interpolation,
+                      double* residuals,
+                      bool gradients,
+                      cv::Mat& ddx_patch,
+                      cv::Mat& ddy_patch) {
+  int diameter = J.rows;
+  bool linear = isLinearInterpolation(interpolation);
+
+  // Sample image for x in regular grid, directly into the residuals.
+  cv::Mat error = cv::Mat_<double>(diameter, diameter, residuals);
+  if (linear && gradients) {
+    samplePatchAndGradientsAffine(I, dIdx, dIdy, error, ddx_patch, ddy_patch,
+        M, diameter);
+  } else if (linear) {
+    samplePatchAffineLinear(I, error, M, diameter);
+  } else {
+    cv::Mat patch;
+    samplePatchAffine(I, patch, M, diameter, false, interpolation);
+    patch.copyTo(error);
+
+    if (gradients) {
+      // Sample whole patches of derivative image.
+      samplePatchAffine(dIdx, ddx_patch, M, diameter, false, interpolation);
+      samplePatchAffine(dIdy, ddy_patch, M, diameter, false, interpolation);
+    }
+  }
+
+  // Compute residuals.
+  cv::subtract(error, J, error);
+  // Weight by the mask.
+  cv::multiply(error, mask, error);
+}
 
 class WarpCost : public ceres::CostFunction {
   public:
@@ -26,6 +102,7 @@ class WarpCost : public ceres::CostFunction {
              const cv::Mat& mask,
              int interpolation,
              bool check_condition,
+             bool condition_from_normal_equations,
              double max_condition);
 
     ~WarpCost() {}
@@ -43,6 +120,7 @@ class WarpCost : public ceres::CostFunction {
     const cv::Mat* mask_;
     int interpolation_;
     bool check_condition_;
+    bool condition_from_normal_equations_;
     double max_condition_;
 };
 
@@ -54,6 +132,7 @@ WarpCost::WarpCost(const Warper& warper,
                    const cv::Mat& mask,
                    int interpolation,
                    bool check_condition,
+                   bool condition_from_normal_equations,
                    double max_condition)
     : warper_(&warper),
       J_(&J),
@@ -63,6 +142,7 @@ WarpCost::WarpCost(const Warper& warper,
       mask_(&mask),
       interpolation_(interpolation),
       check_condition_(check_condition),
+      condition_from_normal_equations_(condition_from_normal_equations),
       max_condition_(max_condition) {
   // Check that we have a square patch.
   CHECK(J.rows == J.cols);
@@ -92,17 +172,15 @@ bool WarpCost::Evaluate(const double* const* params,
 
   // Build matrix representing affine transformation.
   cv::Mat M = warper_->matrix(params[0]);
-  // Sample image for x in regular grid.
-  cv::Mat patch;
-  samplePatchAffine(*I_, patch, M, diameter, false, interpolation_);
+  bool jacobian_required = (jacobians != NULL && jacobians[0] != NULL);
 
-  // Compute residuals.
-  cv::Mat error = cv::Mat_<double>(diameter, diameter, residuals);
-  error = patch - *J_;
-  // Weight by the mask.
-  cv::multiply(error, *mask_, error);
+  // Compute residuals and, if required, sample the derivative images.
+  cv::Mat ddx_patch;
+  cv::Mat ddy_patch;
+  computeResiduals(M, *J_, *I_, *dIdx_, *dIdy_, *mask_, interpolation_,
+      residuals, jacobian_required, ddx_patch, ddy_patch);
 
-  if (jacobians != NULL && jacobians[0] != NULL) {
+  if (jacobian_required) {
     cv::Mat jac = cv::Mat_<double>(num_pixels, num_params, jacobians[0]);
 
     // f(x, p) = I(W(x, p)) - J(x)
@@ -111,13 +189,6 @@ bool WarpCost::Evaluate(const double* const* params,
     // g(x, p) = M(x) f(x, p)
     // dg/dp(x, p) = M(x) df/dp(x, p)
 
-    // Sample whole patches of derivative image.
-    // (for efficiency and hopefully correct downsampling)
-    cv::Mat ddx_patch;
-    cv::Mat ddy_patch;
-    samplePatchAffine(*dIdx_, ddx_patch, M, diameter, false, interpolation_);
-    samplePatchAffine(*dIdy_, ddy_patch, M, diameter, false, interpolation_);
-
     cv::Point2d center(radius, radius);
 
     for (int u = 0; u < diameter; u += 1) {
@@ -145,7 +216,14 @@ bool WarpCost::Evaluate(const double* const* params,
 
     if (check_condition_) {
       // Check that Jacobian is well-conditioned.
-      double condition = cond(jac);
+      double condition;
+      if (condition_from_normal_equations_) {
+        cv::Mat jtj;
+        cv::mulTransposed(jac, jtj, true);
+        condition = condFromNormalMatrix(jtj);
+      } else {
+        condition = cond(jac);
+      }
 
       if (condition > max_condition_) {
         DLOG(INFO) << "Condition number of Jacobian too large (" <<
@@ -160,20 +238,358 @@ bool WarpCost::Evaluate(const double* const* params,
 
 ////////////////////////////////////////////////////////////////////////////////
 
-// Returns false if the optimization did not converge.
-bool trackPatch(Warp& warp,
-                const cv::Mat& reference,
-                const cv::Mat& image,
-                const cv::Mat& ddx_image,
-                const cv::Mat& ddy_image,
-                const cv::Mat& mask,
-                const FlowOptions& options) {
-  CHECK(reference.rows == reference.cols) << "Template must be square";
+// Specialization of WarpCost for a known type of warp.
+//
+// The number of parameters is fixed at compile time and the Jacobian of the
+// warp is evaluated inline from the warp matrix, without allocation or
+// virtual function calls in the per-pixel loop.
+template<class WarperT, int NumParams>
+class WarpCostT : public ceres::SizedCostFunction<ceres::DYNAMIC, NumParams> {
+  public:
+    BOOST_STATIC_ASSERT(NumParams == WarperT::NUM_PARAMS);
+
+    // Parameters are as for WarpCost.
+    WarpCostT(const WarperT& warper,
+              const cv::Mat& J,
+              const cv::Mat& I,
+              const cv::Mat& dIdx,
+              const cv::Mat& dIdy,
+              const cv::Mat& mask,
+              int interpolation,
+              bool check_condition,
+              bool condition_from_normal_equations,
+              double max_condition)
+        : warper_(&warper),
+          J_(&J),
+          I_(&I),
+          dIdx_(&dIdx),
+          dIdy_(&dIdy),
+          mask_(&mask),
+          interpolation_(interpolation),
+          check_condition_(check_condition),
+          condition_from_normal_equations_(condition_from_normal_equations),
+          max_condition_(max_condition) {
+      CHECK(J.rows == J.cols);
+      CHECK(mask.size() == J.size());
+      CHECK(mask.type() == cv::DataType<double>::type);
+
+      this->set_num_residuals(J.total());
+    }
+
+    ~WarpCostT() {}
+
+    bool Evaluate(const double* const* params,
+                  double* residuals,
+                  double** jacobians) const {
+      int diameter = J_->rows;
+      int radius = (diameter - 1) / 2;
+
+      if (!warper_->isValid(params[0], I_->size(), radius)) {
+        return false;
+      }
+
+      cv::Mat M = warper_->matrix(params[0]);
+      bool jacobian_required = (jacobians != NULL && jacobians[0] != NULL);
+
+      cv::Mat ddx_patch;
+      cv::Mat ddy_patch;
+      computeResiduals(M, *J_, *I_, *dIdx_, *dIdy_, *mask_, interpolation_,
+          residuals, jacobian_required, ddx_patch, ddy_patch);
+
+      if (!jacobian_required) {
+        return true;
+      }
+
+      const double* A = M.ptr<double>();
+      double* jac = jacobians[0];
+      double dWdp[2 * NumParams];
+
+      // Accumulate the upper triangle of J^T J if it is needed.
+      bool normal = (check_condition_ && condition_from_normal_equations_);
+      double jtj[NumParams][NumParams] = {};
+
+      for (int v = 0; v < diameter; v += 1) {
+        const double* ddx = ddx_patch.ptr<double>(v);
+        const double* ddy = ddy_patch.ptr<double>(v);
+        const double* mask = mask_->ptr<double>(v);
+
+        for (int u = 0; u < diameter; u += 1) {
+          WarperT::affineJacobian(A, u - radius, v - radius, dWdp);
+
+          // Chain rule, weighted by mask.
+          double dx = mask[u] * ddx[u];
+          double dy = mask[u] * ddy[u];
+          double* row = jac + (v * diameter + u) * NumParams;
+
+          for (int j = 0; j < NumParams; j += 1) {
+            row[j] = dx * dWdp[j] + dy * dWdp[NumParams + j];
+          }
+
+          if (normal) {
+            for (int j = 0; j < NumParams; j += 1) {
+              for (int k = j; k < NumParams; k += 1) {
+                jtj[j][k] += row[j] * row[k];
+              }
+            }
+          }
+        }
+      }
+
+      if (check_condition_) {
+        // Check that Jacobian is well-conditioned.
+        double condition;
+        if (normal) {
+          for (int j = 0; j < NumParams; j += 1) {
+            for (int k = 0; k < j; k += 1) {
+              jtj[j][k] = jtj[k][j];
+            }
+          }
+          condition = condFromNormalMatrix(
+              cv::Mat_<double>(NumParams, NumParams, &jtj[0][0]));
+        } else {
+          condition = cond(
+              cv::Mat_<double>(diameter * diameter, NumParams, jac));
+        }
+
+        if (condition > max_condition_) {
+          DLOG(INFO) << "Condition number of Jacobian too large (" <<
+            condition << " > " << max_condition_ << ")";
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+  private:
+    const WarperT* warper_;
+    const cv::Mat* J_;
+    const cv::Mat* I_;
+    const cv::Mat* dIdx_;
+    const cv::Mat* dIdy_;
+    const cv::Mat* mask_;
+    int interpolation_;
+    bool check_condition_;
+    bool condition_from_normal_equations_;
+    double max_condition_;
+};
+
+// Constructs the cost function for a warper, specialized if possible.
+ceres::CostFunction* newWarpCost(const Warper& warper,
+                                 const cv::Mat& J,
+                                 const cv::Mat& I,
+                                 const cv::Mat& dIdx,
+                                 const cv::Mat& dIdy,
+                                 const cv::Mat& mask,
+                                 const FlowOptions& options) {
+  typedef WarpCostT<TranslationWarper, TranslationWarper::NUM_PARAMS>
+      TranslationWarpCost;
+  typedef WarpCostT<SimilarityWarper, SimilarityWarper::NUM_PARAMS>
+      SimilarityWarpCost;
+
+  const TranslationWarper* translation =
+      dynamic_cast<const TranslationWarper*>(&warper);
+  if (translation != NULL) {
+    return new TranslationWarpCost(*translation, J, I, dIdx, dIdy, mask,
+        options.interpolation, options.check_condition,
+        options.condition_from_normal_equations, options.max_condition);
+  }
+
+  const SimilarityWarper* similarity =
+      dynamic_cast<const SimilarityWarper*>(&warper);
+  if (similarity != NULL) {
+    return new SimilarityWarpCost(*similarity, J, I, dIdx, dIdy, mask,
+        options.interpolation, options.check_condition,
+        options.condition_from_normal_equations, options.max_condition);
+  }
+
+  return new WarpCost(warper, J, I, dIdx, dIdy, mask, options.interpolation,
+      options.check_condition, options.condition_from_normal_equations,
+      options.max_condition);
+}
+
+// Solves for the warp using inverse-compositional Gauss-Newton.
+//
+// The objective is the same as that of WarpCost. The roles of the template
+// and image are swapped in the linearization so that the Jacobian does not
+// depend on the current parameters. The update is applied by composing the
+// current warp with the inverse of the incremental warp.
+bool trackPatchInverseCompositional(Warp& warp,
+                                    const cv::Mat& reference,
+                                    const cv::Mat& image,
+                                    const cv::Mat& mask,
+                                    const FlowOptions& options,
+                                    FlowStatistics* statistics) {
+  const Warper* warper = warp.warper();
+  int num_params = warper->numParams();
+  int diameter = reference.rows;
+  int radius = (diameter - 1) / 2;
+  int num_pixels = diameter * diameter;
+  double* params = warp.params();
+
+  // Differentiate the template.
+  const cv::Mat diff = (cv::Mat_<double>(1, 3) << -0.5, 0, 0.5);
+  const cv::Mat identity = (cv::Mat_<double>(1, 1) << 1);
+  cv::Mat ddx_reference;
+  cv::Mat ddy_reference;
+  cv::sepFilter2D(reference, ddx_reference, -1, diff, identity,
+      cv::Point(-1, -1), 0, cv::BORDER_REPLICATE);
+  cv::sepFilter2D(reference, ddy_reference, -1, identity, diff,
+      cv::Point(-1, -1), 0, cv::BORDER_REPLICATE);
+
+  // Derivative of the warp is evaluated at the identity.
+  std::vector<double> identity_params(num_params);
+  warper->setIdentity(&identity_params.front());
+
+  // Compute the steepest-descent images (the Jacobian), weighted by the mask.
+  cv::Mat jac = cv::Mat_<double>(num_pixels, num_params);
+  std::vector<double> dWdp(2 * num_params);
+  cv::Point2d center(radius, radius);
+
+  for (int u = 0; u < diameter; u += 1) {
+    for (int v = 0; v < diameter; v += 1) {
+      // Get row-major order index.
+      int i = v * diameter + u;
+
+      cv::Point2d position = cv::Point2d(u, v) - center;
+      warper->evaluate(position, &identity_params.front(), &dWdp.front());
+
+      double m = mask.at<double>(v, u);
+      double dx = ddx_reference.at<double>(v, u);
+      double dy = ddy_reference.at<double>(v, u);
+
+      for (int j = 0; j < num_params; j += 1) {
+        jac.at<double>(i, j) = m * (dx * dWdp[j] + dy * dWdp[num_params + j]);
+      }
+    }
+  }
 
+  if (statistics != NULL) {
+    statistics->num_jacobian_evaluations += 1;
+  }
+
+  // Gauss-Newton approximation to the Hessian, constant for all iterations.
+  cv::Mat hessian;
+  cv::mulTransposed(jac, hessian, true);
+
+  if (options.check_condition) {
+    // Check that Jacobian is well-conditioned.
+    double condition;
+    if (options.condition_from_normal_equations) {
+      condition = condFromNormalMatrix(hessian);
+    } else {
+      condition = cond(jac);
+    }
+
+    if (condition > options.max_condition) {
+      DLOG(INFO) << "Condition number of Jacobian too large (" <<
+        condition << " > " << options.max_condition << ")";
+      setTermination(statistics, FLOW_CONDITION_LIMIT);
+      return false;
+    }
+  }
+  cv::Mat inv_hessian;
+  if (cv::invert(hessian, inv_hessian, cv::DECOMP_CHOLESKY) == 0) {
+    DLOG(INFO) << "Hessian is singular";
+    setTermination(statistics, FLOW_NUMERICAL_FAILURE);
+    return false;
+  }
+
+  const ceres::Solver::Options& solver_options = options.solver_options;
+  cv::Mat patch;
+  cv::Mat error;
+  std::vector<double> delta_params(num_params);
+  double previous_cost = 0;
+  bool converged = false;
+
+  for (int iter = 0; iter < solver_options.max_num_iterations; iter += 1) {
+    if (!warper->isValid(params, image.size(), radius)) {
+      setTermination(statistics, FLOW_INVALID_WARP);
+      return false;
+    }
+
+    // Compute residuals at current estimate.
+    cv::Mat M = warper->matrix(params);
+    if (isLinearInterpolation(options.interpolation)) {
+      samplePatchAffineLinear(image, patch, M, diameter);
+    } else {
+      samplePatchAffine(image, patch, M, diameter, false,
+          options.interpolation);
+    }
+    cv::subtract(patch, reference, error);
+    cv::multiply(error, mask, error);
+    if (statistics != NULL) {
+      statistics->num_residual_evaluations += 1;
+    }
+
+    double cost = 0.5 * error.dot(error);
+    if (iter > 0 && std::abs(previous_cost - cost) <=
+        solver_options.function_tolerance * previous_cost) {
+      converged = true;
+      break;
+    }
+    previous_cost = cost;
+
+    // Solve for the incremental warp.
+    cv::Mat delta = inv_hessian * (jac.t() * error.reshape(1, num_pixels));
+    if (!isFinite(cv::norm(delta))) {
+      DLOG(INFO) << "Numerical failure";
+      setTermination(statistics, FLOW_NUMERICAL_FAILURE);
+      return false;
+    }
+
+    // Compose current warp with the inverse of the incremental warp.
+    for (int j = 0; j < num_params; j += 1) {
+      delta_params[j] = identity_params[j] + delta.at<double>(j);
+    }
+    cv::Mat A = cv::Mat::eye(3, 3, cv::DataType<double>::type);
+    M.copyTo(A.rowRange(0, 2));
+    cv::Mat B = cv::Mat::eye(3, 3, cv::DataType<double>::type);
+    warper->matrix(&delta_params.front()).copyTo(B.rowRange(0, 2));
+    cv::Mat C = A * B.inv();
+    warper->paramsFromMatrix(C.rowRange(0, 2), params);
+    if (statistics != NULL) {
+      statistics->num_iterations += 1;
+    }
+
+    // Use the same parameter tolerance as ceres.
+    double norm_params = cv::norm(cv::Mat_<double>(num_params, 1, params));
+    if (cv::norm(delta) <= solver_options.parameter_tolerance *
+        (norm_params + solver_options.parameter_tolerance)) {
+      converged = true;
+      break;
+    }
+  }
+
+  // Iteration limit was reached before any of the convergece criteria?
+  setTermination(statistics,
+      converged ? FLOW_CONVERGED : FLOW_ITERATION_LIMIT);
+  if (options.iteration_limit_is_fatal && !converged) {
+    DLOG(INFO) << "Reached iteration limit";
+    return false;
+  }
+
+  if (!warper->isValid(params, image.size(), radius)) {
+    setTermination(statistics, FLOW_INVALID_WARP);
+    return false;
+  }
+  return true;
+}
+
+bool trackPatchCeres(Warp& warp,
+                     const cv::Mat& reference,
+                     const cv::Mat& image,
+                     const cv::Mat& ddx_image,
+                     const cv::Mat& ddy_image,
+                     const cv::Mat& mask,
+                     const FlowOptions& options,
+                     FlowStatistics* statistics) {
   // Set up non-linear optimization problem.
-  ceres::CostFunction* objective = new WarpCost(*warp.warper(), reference,
-      image, ddx_image, ddy_image, mask, options.interpolation,
-      options.check_condition, options.max_condition);
+  ceres::CostFunction* objective = newWarpCost(*warp.warper(), reference,
+      image, ddx_image, ddy_image, mask, options);
+  if (statistics != NULL) {
+    objective = new CountingCost(objective, *statistics);
+  }
 
   ceres::Problem problem;
   problem.AddResidualBlock(objective, NULL, warp.params());
@@ -185,18 +601,169 @@ bool trackPatch(Warp& warp,
   // Ensure there was no catastrophic failure.
   CHECK(summary.termination_type != ceres::DID_NOT_RUN);
 
+  if (statistics != NULL) {
+    statistics->num_iterations += summary.num_successful_steps +
+      summary.num_unsuccessful_steps;
+  }
+
   // Numerical failure can be caused by e.g. numbers going to infinity.
+  // Evaluations rejected for an ill-conditioned Jacobian or an invalid warp
+  // only shorten the step, unless they occur at the initial estimate.
   if (summary.termination_type == ceres::NUMERICAL_FAILURE) {
     DLOG(INFO) << "Numerical failure";
+    setTermination(statistics, FLOW_NUMERICAL_FAILURE);
     return false;
   }
 
   // Iteration limit was reached before any of the convergece criteria?
-  if (options.iteration_limit_is_fatal &&
-      summary.termination_type == ceres::NO_CONVERGENCE) {
+  bool converged = (summary.termination_type != ceres::NO_CONVERGENCE);
+  setTermination(statistics,
+      converged ? FLOW_CONVERGED : FLOW_ITERATION_LIMIT);
+  if (options.iteration_limit_is_fatal && !converged) {
     DLOG(INFO) << "Reached iteration limit";
     return false;
   }
 
   return true;
 }
+
+// Downsamples a square patch of odd size by a factor of two about its center.
+// Uses the same 5-tap kernel as cv::pyrDown() if smooth is true.
+void downsamplePatch(const cv::Mat& src, cv::Mat& dst, bool smooth) {
+  int src_radius = (src.rows - 1) / 2;
+  int radius = src_radius / 2;
+  int diameter = 2 * radius + 1;
+
+  cv::Mat filtered = src;
+  if (smooth) {
+    const cv::Mat kernel = (cv::Mat_<double>(1, 5) << 1, 4, 6, 4, 1) / 16.;
+    cv::sepFilter2D(src, filtered, -1, kernel, kernel, cv::Point(-1, -1), 0,
+        cv::BORDER_REPLICATE);
+  }
+
+  dst.create(diameter, diameter, cv::DataType<double>::type);
+  for (int v = 0; v < diameter; v += 1) {
+    const double* row = filtered.ptr<double>(src_radius + 2 * (v - radius));
+    double* out = dst.ptr<double>(v);
+    for (int u = 0; u < diameter; u += 1) {
+      out[u] = row[src_radius + 2 * (u - radius)];
+    }
+  }
+}
+
+// Scales the translation of a warp, taking it to a different pyramid level.
+void scaleWarpTranslation(Warp& warp, const Warper& warper, double scale) {
+  cv::Mat M = warp.matrix();
+  M.at<double>(0, 2) *= scale;
+  M.at<double>(1, 2) *= scale;
+  warper.paramsFromMatrix(M, warp.params());
+}
+
+// Returns false if the optimization did not converge.
+bool trackPatch(Warp& warp,
+                const cv::Mat& reference,
+                const cv::Mat& image,
+                const cv::Mat& ddx_image,
+                const cv::Mat& ddy_image,
+                const cv::Mat& mask,
+                const FlowOptions& options,
+                FlowStatistics* statistics) {
+  CHECK(reference.rows == reference.cols) << "Template must be square";
+  int64 start = (statistics != NULL) ? cv::getTickCount() : 0;
+
+  bool tracked;
+  if (options.engine == INVERSE_COMPOSITIONAL_FLOW_ENGINE) {
+    tracked = trackPatchInverseCompositional(warp, reference, image, mask,
+        options, statistics);
+  } else {
+    tracked = trackPatchCeres(warp, reference, image, ddx_image, ddy_image,
+        mask, options, statistics);
+  }
+
+  if (statistics != NULL) {
+    statistics->num_calls += 1;
+    statistics->solver_time += double(cv::getTickCount() - start) /
+        cv::getTickFrequency();
+  }
+  return tracked;
+}
+
+void buildImagePyramid(const cv::Mat& image,
+                       int num_levels,
+                       ImagePyramid& pyramid) {
+  CHECK(num_levels >= 1);
+  CHECK(image.type() == cv::DataType<double>::type);
+  pyramid.resize(num_levels);
+
+  // Central difference. Smoothing is provided by downsampling.
+  const cv::Mat diff = (cv::Mat_<double>(1, 3) << -0.5, 0, 0.5);
+  const cv::Mat identity = (cv::Mat_<double>(1, 1) << 1);
+
+  for (int i = 0; i < num_levels; i += 1) {
+    PyramidLevel& level = pyramid[i];
+    if (i == 0) {
+      level.image = image;
+    } else {
+      cv::pyrDown(pyramid[i - 1].image, level.image);
+    }
+    cv::sepFilter2D(level.image, level.ddx, -1, diff, identity);
+    cv::sepFilter2D(level.image, level.ddy, -1, identity, diff);
+  }
+}
+
+bool trackPatchPyramid(Warp& warp,
+                       const cv::Mat& reference,
+                       const ImagePyramid& pyramid,
+                       const cv::Mat& mask,
+                       const FlowOptions& options,
+                       FlowStatistics* statistics) {
+  CHECK(!pyramid.empty());
+  CHECK(reference.rows == reference.cols) << "Template must be square";
+  int radius = (reference.rows - 1) / 2;
+
+  // Do not use levels at which the patch would vanish.
+  int num_levels = pyramid.size();
+  while (num_levels > 1 && (radius >> (num_levels - 1)) < 1) {
+    num_levels -= 1;
+  }
+
+  // Downsample template and mask for each level.
+  std::vector<cv::Mat> references(num_levels);
+  std::vector<cv::Mat> masks(num_levels);
+  references[0] = reference;
+  masks[0] = mask;
+  for (int i = 1; i < num_levels; i += 1) {
+    downsamplePatch(references[i - 1], references[i], true);
+    downsamplePatch(masks[i - 1], masks[i], false);
+  }
+
+  const Warper* warper = warp.warper();
+  int num_params = warp.numParams();
+  std::vector<double> previous(num_params);
+
+  // Reaching the iteration limit is not fatal at the coarse levels.
+  FlowOptions coarse_options = options;
+  coarse_options.iteration_limit_is_fatal = false;
+
+  // Take warp to the top level.
+  scaleWarpTranslation(warp, *warper, 1. / (1 << (num_levels - 1)));
+
+  for (int i = num_levels - 1; i > 0; i -= 1) {
+    const PyramidLevel& level = pyramid[i];
+    std::copy(warp.params(), warp.params() + num_params, previous.begin());
+
+    bool tracked = trackPatch(warp, references[i], level.image, level.ddx,
+        level.ddy, masks[i], coarse_options, statistics);
+    if (!tracked) {
+      // Continue from the estimate that was propagated to this level.
+      std::copy(previous.begin(), previous.end(), warp.params());
+    }
+
+    // Take warp to the next level down.
+    scaleWarpTranslation(warp, *warper, 2.);
+  }
+
+  const PyramidLevel& level = pyramid[0];
+  return trackPatch(warp, reference, level.image, level.ddx, level.ddy, mask,
+      options, statistics);
+}
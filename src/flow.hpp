@@ -1,23 +1,72 @@
 #ifndef FLOW_HPP_
 #define FLOW_HPP_
 
+#include <vector>
 #include <opencv2/core/core.hpp>
 #include "warp.hpp"
+#include "util/flow-statistics.hpp"
+
+// Method used to solve for the warp parameters.
+enum FlowEngine {
+  // Constructs a non-linear least-squares problem and solves it using ceres.
+  CERES_FLOW_ENGINE,
+  // Inverse-compositional Gauss-Newton (Baker and Matthews).
+  // The Jacobian and Hessian are computed once from the template.
+  INVERSE_COMPOSITIONAL_FLOW_ENGINE
+};
 
 struct FlowOptions {
+  FlowEngine engine;
   int interpolation;
   ceres::Solver::Options solver_options;
   bool iteration_limit_is_fatal;
   bool check_condition;
+  // Compute the condition number from J^T J rather than the SVD of J?
+  // Accepts and rejects the same warps, at a fraction of the cost.
+  bool condition_from_normal_equations;
   double max_condition;
 };
 
+// Statistics are accumulated if not NULL.
 bool trackPatch(Warp& warp,
                 const cv::Mat& reference,
                 const cv::Mat& image,
                 const cv::Mat& ddx_image,
                 const cv::Mat& ddy_image,
                 const cv::Mat& mask,
-                const FlowOptions& options);
+                const FlowOptions& options,
+                FlowStatistics* statistics = NULL);
+
+// Image and its derivatives at one scale.
+struct PyramidLevel {
+  cv::Mat image;
+  cv::Mat ddx;
+  cv::Mat ddy;
+};
+
+// Each level is half the resolution of the one before it.
+// Level 0 is the original image.
+typedef std::vector<PyramidLevel> ImagePyramid;
+
+// Computes the gradients of an image and of num_levels - 1 smaller images.
+// Level 0 shares its data with the image.
+// Re-uses the memory of an existing pyramid.
+void buildImagePyramid(const cv::Mat& image,
+                       int num_levels,
+                       ImagePyramid& pyramid);
+
+// Tracks a patch coarse to fine through an image pyramid.
+// The template and mask are downsampled with the image, the warp is solved at
+// the smallest level first and its translation is propagated down.
+// Coarse levels only provide an initial estimate, the result at level 0
+// determines whether the patch was tracked.
+// With a single level this is equivalent to trackPatch().
+// Statistics are accumulated over all levels if not NULL.
+bool trackPatchPyramid(Warp& warp,
+                       const cv::Mat& reference,
+                       const ImagePyramid& pyramid,
+                       const cv::Mat& mask,
+                       const FlowOptions& options,
+                       FlowStatistics* statistics = NULL);
 
 #endif
@@ -0,0 +1,101 @@
+#include "util/flow-histogram.hpp"
+#include <sstream>
+#include <string>
+#include "gtest/gtest.h"
+
+namespace {
+
+FlowStatistics makeStatistics(int num_iterations,
+                              FlowTermination termination) {
+  FlowStatistics statistics;
+  statistics.num_calls = 1;
+  statistics.num_iterations = num_iterations;
+  statistics.num_residual_evaluations = num_iterations + 1;
+  statistics.num_jacobian_evaluations = num_iterations;
+  statistics.solver_time = 1e-3;
+  statistics.termination = termination;
+  return statistics;
+}
+
+std::string writeLine(const FlowHistogram& histogram) {
+  std::ostringstream stream;
+  histogram.writeLine(stream);
+  return stream.str();
+}
+
+std::string write(const FlowHistogram& histogram) {
+  std::ostringstream stream;
+  histogram.write(stream);
+  return stream.str();
+}
+
+}
+
+TEST(FlowHistogram, NamesEveryTermination) {
+  for (int i = 0; i < NUM_FLOW_TERMINATIONS; i += 1) {
+    std::string name = flowTerminationName(FlowTermination(i));
+    EXPECT_FALSE(name.empty());
+    for (int j = 0; j < i; j += 1) {
+      EXPECT_NE(name, flowTerminationName(FlowTermination(j)));
+    }
+  }
+}
+
+TEST(FlowHistogram, SetTerminationIgnoresNull) {
+  FlowStatistics statistics;
+  setTermination(&statistics, FLOW_INVALID_WARP);
+  EXPECT_EQ(FLOW_INVALID_WARP, statistics.termination);
+  setTermination(NULL, FLOW_INVALID_WARP);
+}
+
+TEST(FlowHistogram, CountsFeaturesAndTerminations) {
+  FlowHistogram histogram;
+  EXPECT_EQ(0, histogram.count());
+
+  histogram.add(makeStatistics(3, FLOW_CONVERGED));
+  histogram.add(makeStatistics(5, FLOW_CONVERGED));
+  histogram.add(makeStatistics(50, FLOW_ITERATION_LIMIT));
+  EXPECT_EQ(3, histogram.count());
+
+  std::string line = writeLine(histogram);
+  EXPECT_EQ(0u, line.find("3 features, "));
+  EXPECT_NE(std::string::npos, line.find("(max 50)"));
+  EXPECT_NE(std::string::npos, line.find("converged 2"));
+  EXPECT_NE(std::string::npos, line.find("iteration limit 1"));
+  // Terminations which did not occur are left out of the line.
+  EXPECT_EQ(std::string::npos, line.find("invalid warp"));
+
+  // But are listed in full.
+  EXPECT_NE(std::string::npos, write(histogram).find("invalid warp: 0"));
+}
+
+TEST(FlowHistogram, MergeEqualsAddingEach) {
+  FlowHistogram a;
+  FlowHistogram b;
+  FlowHistogram all;
+  for (int i = 0; i < 20; i += 1) {
+    FlowStatistics statistics = makeStatistics(i,
+        FlowTermination(i % NUM_FLOW_TERMINATIONS));
+    (i % 3 == 0 ? a : b).add(statistics);
+    all.add(statistics);
+  }
+
+  FlowHistogram merged;
+  merged.add(a);
+  merged.add(b);
+  EXPECT_EQ(all.count(), merged.count());
+  EXPECT_EQ(write(all), write(merged));
+  EXPECT_EQ(writeLine(all), writeLine(merged));
+}
+
+TEST(FlowHistogram, ClearResets) {
+  FlowHistogram histogram;
+  std::string empty = write(histogram);
+
+  histogram.add(makeStatistics(4, FLOW_NUMERICAL_FAILURE));
+  EXPECT_NE(empty, write(histogram));
+
+  histogram.clear();
+  EXPECT_EQ(0, histogram.count());
+  EXPECT_EQ(empty, write(histogram));
+}
@@ -0,0 +1,253 @@
+#include "frame_correlator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <glog/logging.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "util/thread-pool.hpp"
+
+namespace {
+
+// Splits an image into CV_32F channels, each zero-padded to the DFT size.
+void padChannels(const cv::Mat& image,
+                 cv::Size dft_size,
+                 std::vector<cv::Mat>& channels) {
+  cv::Mat converted;
+  image.convertTo(converted, CV_32F);
+  std::vector<cv::Mat> split;
+  cv::split(converted, split);
+
+  channels.clear();
+  for (int c = 0; c < int(split.size()); c += 1) {
+    cv::Mat padded = cv::Mat::zeros(dft_size, CV_32F);
+    cv::Mat roi = padded(cv::Rect(cv::Point(0, 0), image.size()));
+    split[c].copyTo(roi);
+    channels.push_back(padded);
+  }
+}
+
+// Sum over channels of the squared intensity.
+cv::Mat sumOfSquares(const cv::Mat& image) {
+  cv::Mat converted;
+  image.convertTo(converted, CV_64F);
+  std::vector<cv::Mat> channels;
+  cv::split(converted, channels);
+
+  cv::Mat sum = cv::Mat::zeros(image.size(), CV_64F);
+  for (int c = 0; c < int(channels.size()); c += 1) {
+    sum += channels[c].mul(channels[c]);
+  }
+  return sum;
+}
+
+}
+
+FrameCorrelator::FrameCorrelator()
+    : video_(NULL), image_size_(), image_type_(-1), dft_size_(), frames_() {}
+
+bool FrameCorrelator::init(const Video& video,
+                           const PlaneCache& cache,
+                           size_t max_bytes,
+                           ThreadPool& pool) {
+  video_ = &video;
+  frames_.clear();
+  int n = video.length();
+  CHECK(n > 0);
+
+  cv::Mat image;
+  if (!video.get(0, image)) {
+    return false;
+  }
+  image_size_ = image.size();
+  image_type_ = image.type();
+  // Zero-padding to at least the size of the image avoids circular overlap
+  // for any template.
+  dft_size_ = cv::Size(cv::getOptimalDFTSize(image_size_.width),
+                       cv::getOptimalDFTSize(image_size_.height));
+
+  // Spectra of the channels in single precision and the integral in double.
+  size_t frame_bytes = size_t(dft_size_.area()) * image.channels() *
+      sizeof(float) + size_t(image_size_.width + 1) *
+      (image_size_.height + 1) * sizeof(double);
+  int num_transformed = n;
+  if (!cache.enabled()) {
+    num_transformed = std::min(size_t(n), max_bytes / frame_bytes);
+  }
+
+  frames_.resize(n);
+  std::vector<char> ok(n, true);
+  LOG(INFO) << "Transforming " << num_transformed << " of " << n << " frames";
+  pool.parallelFor(0, num_transformed, boost::bind(
+        &FrameCorrelator::transformFrame, this, boost::cref(video),
+        boost::cref(cache), &ok, _1));
+
+  for (int t = 0; t < num_transformed; t += 1) {
+    if (!ok[t]) {
+      frames_.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+int FrameCorrelator::length() const {
+  return frames_.size();
+}
+
+int FrameCorrelator::numTransformed() const {
+  int num_transformed = 0;
+  for (int t = 0; t < length(); t += 1) {
+    if (!frames_[t].planes.empty()) {
+      num_transformed += 1;
+    }
+  }
+  return num_transformed;
+}
+
+void FrameCorrelator::transformFrame(const Video& video,
+                                     const PlaneCache& cache,
+                                     std::vector<char>* ok,
+                                     int t) {
+  Frame& frame = frames_[t];
+
+  cv::Mat image;
+  if (!video.get(t, image)) {
+    (*ok)[t] = false;
+    return;
+  }
+  CHECK(image.size() == image_size_) << "Frames differ in size";
+  CHECK(image.type() == image_type_) << "Frames differ in type";
+
+  // The planes only depend on the image and the size of the transform.
+  std::string key;
+  if (cache.enabled()) {
+    key = planeCacheKey(image, boost::str(boost::format("ccorr-dft %d %d") %
+          dft_size_.width % dft_size_.height));
+    if (cache.map(key, frame.mapping)) {
+      frame.planes = frame.mapping.planes();
+      return;
+    }
+  }
+
+  std::vector<cv::Mat> channels;
+  padChannels(image, dft_size_, channels);
+  for (int c = 0; c < int(channels.size()); c += 1) {
+    cv::Mat spectrum;
+    cv::dft(channels[c], spectrum, 0, image_size_.height);
+    frame.planes.push_back(spectrum);
+  }
+
+  // Only the first integral is kept, which is already of squares.
+  cv::Mat sum;
+  cv::integral(sumOfSquares(image), sum, CV_64F);
+  frame.planes.push_back(sum);
+
+  if (cache.enabled()) {
+    cache.store(key, frame.planes);
+  }
+}
+
+void FrameCorrelator::transformTemplate(const cv::Mat& templ,
+                                        TemplateSpectrum& spectrum) const {
+  CHECK(templ.type() == image_type_) << "Template differs in type from frames";
+  CHECK(templ.rows <= image_size_.height && templ.cols <= image_size_.width)
+      << "Template is larger than frames";
+
+  spectrum.templ = templ;
+  spectrum.size = templ.size();
+  spectrum.norm = std::sqrt(cv::sum(sumOfSquares(templ))[0]);
+
+  std::vector<cv::Mat> channels;
+  padChannels(templ, dft_size_, channels);
+  spectrum.spectra.clear();
+  for (int c = 0; c < int(channels.size()); c += 1) {
+    cv::Mat transform;
+    cv::dft(channels[c], transform, 0, templ.rows);
+    spectrum.spectra.push_back(transform);
+  }
+}
+
+void FrameCorrelator::correlate(int t,
+                                const TemplateSpectrum& spectrum,
+                                cv::Mat& response) const {
+  const Frame& frame = frames_[t];
+  int num_channels = spectrum.spectra.size();
+
+  if (frame.planes.empty()) {
+    cv::Mat image;
+    CHECK(video_->get(t, image)) << "Could not read frame " << t;
+    cv::matchTemplate(image, spectrum.templ, response, cv::TM_CCORR_NORMED);
+    return;
+  }
+
+  // Correlation is linear, so the channels share one inverse transform.
+  cv::Mat product = cv::Mat::zeros(dft_size_, CV_32F);
+  for (int c = 0; c < num_channels; c += 1) {
+    cv::Mat channel;
+    cv::mulSpectrums(frame.planes[c], spectrum.spectra[c], channel, 0, true);
+    product += channel;
+  }
+
+  cv::Size size(image_size_.width - spectrum.size.width + 1,
+                image_size_.height - spectrum.size.height + 1);
+  cv::Mat correlation;
+  cv::idft(product, correlation, cv::DFT_REAL_OUTPUT | cv::DFT_SCALE,
+      size.height);
+
+  // Normalize as cv::matchTemplate() does, including its handling of
+  // windows whose norm is zero or comparable to rounding error.
+  const cv::Mat& sum = frame.planes[num_channels];
+  int h = spectrum.size.height;
+  int w = spectrum.size.width;
+  response.create(size, CV_32F);
+
+  for (int i = 0; i < size.height; i += 1) {
+    const float* row = correlation.ptr<float>(i);
+    const double* top = sum.ptr<double>(i);
+    const double* bottom = sum.ptr<double>(i + h);
+    float* dst = response.ptr<float>(i);
+
+    for (int j = 0; j < size.width; j += 1) {
+      double window = bottom[j + w] - bottom[j] - top[j + w] + top[j];
+      double norm = std::sqrt(std::max(window, 0.)) * spectrum.norm;
+      double x = row[j];
+
+      if (std::abs(x) < norm) {
+        x /= norm;
+      } else if (std::abs(x) < norm * 1.125) {
+        x = x > 0 ? 1 : -1;
+      } else {
+        x = 0;
+      }
+      dst[j] = x;
+    }
+  }
+}
+
+void FrameCorrelator::correlateInto(const TemplateSpectrum* spectrum,
+                                    std::vector<cv::Mat>* responses,
+                                    int t) const {
+  correlate(t, *spectrum, (*responses)[t]);
+}
+
+void FrameCorrelator::correlate(int t,
+                                const cv::Mat& templ,
+                                cv::Mat& response) const {
+  CHECK(t >= 0 && t < length());
+  TemplateSpectrum spectrum;
+  transformTemplate(templ, spectrum);
+  correlate(t, spectrum, response);
+}
+
+void FrameCorrelator::correlate(const cv::Mat& templ,
+                                std::vector<cv::Mat>& responses,
+                                ThreadPool& pool) const {
+  TemplateSpectrum spectrum;
+  transformTemplate(templ, spectrum);
+
+  int n = length();
+  responses.assign(n, cv::Mat());
+  pool.parallelFor(0, n, boost::bind(&FrameCorrelator::correlateInto, this,
+        &spectrum, &responses, _1));
+}
@@ -0,0 +1,90 @@
+#ifndef FRAME_CORRELATOR_HPP_
+#define FRAME_CORRELATOR_HPP_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "plane_cache.hpp"
+#include "video.hpp"
+
+class ThreadPool;
+
+// Matches templates to every frame of a video using the DFT.
+//
+// The spectrum of each frame and the integral of its squared intensity do not
+// depend on the template, so they are computed once for the whole video.
+// Matching a template then costs one inverse DFT per frame. The frames may be
+// kept in a PlaneCache, from which they are mapped without copying.
+//
+// Without a cache, only as many frames as fit in a memory budget are
+// transformed. The rest are read from the video and matched directly.
+//
+// Usage:
+// FrameCorrelator correlator;
+// correlator.init(video, cache, max_bytes, pool);
+// correlator.correlate(templ, responses, pool);
+class FrameCorrelator {
+  public:
+    FrameCorrelator();
+
+    // Transforms the frames in parallel. Returns false if a frame could not
+    // be read. A disabled cache is ignored. Frames mapped from an enabled
+    // cache do not count towards max_bytes. The video must outlive the
+    // correlator.
+    bool init(const Video& video,
+              const PlaneCache& cache,
+              size_t max_bytes,
+              ThreadPool& pool);
+
+    int length() const;
+    // Number of frames whose spectra are held.
+    int numTransformed() const;
+
+    // Same as cv::matchTemplate() with cv::TM_CCORR_NORMED, up to rounding.
+    // The template must have the type of the frames and be no larger.
+    // Responses are CV_32F.
+    void correlate(int t, const cv::Mat& templ, cv::Mat& response) const;
+    // Matches the template to every frame in parallel.
+    void correlate(const cv::Mat& templ,
+                   std::vector<cv::Mat>& responses,
+                   ThreadPool& pool) const;
+
+  private:
+    struct Frame {
+      // Spectrum of each channel then the integral of the sum of squares.
+      // Empty if the frame is matched directly.
+      std::vector<cv::Mat> planes;
+      // Holds the planes if they are mapped from the cache.
+      MappedPlanes mapping;
+    };
+
+    struct TemplateSpectrum {
+      // For frames which were not transformed.
+      cv::Mat templ;
+      cv::Size size;
+      // Conjugated by mulSpectrums().
+      std::vector<cv::Mat> spectra;
+      double norm;
+    };
+
+    // Sets ok[t] to false if the frame could not be read.
+    void transformFrame(const Video& video,
+                        const PlaneCache& cache,
+                        std::vector<char>* ok,
+                        int t);
+    void transformTemplate(const cv::Mat& templ,
+                           TemplateSpectrum& spectrum) const;
+    void correlate(int t,
+                   const TemplateSpectrum& spectrum,
+                   cv::Mat& response) const;
+    void correlateInto(const TemplateSpectrum* spectrum,
+                       std::vector<cv::Mat>* responses,
+                       int t) const;
+
+    const Video* video_;
+    cv::Size image_size_;
+    int image_type_;
+    cv::Size dft_size_;
+    std::vector<Frame> frames_;
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "frame_interval_index.hpp"
+#include <algorithm>
+#include <utility>
+#include <glog/logging.h>
+
+FrameIntervalIndex::FrameIntervalIndex()
+    : num_intervals_(0),
+      first_frame_(0),
+      offsets_(1, 0),
+      containing_(),
+      starts_(),
+      start_frames_() {}
+
+void FrameIntervalIndex::init(const std::vector<int>& first,
+                              const std::vector<int>& last) {
+  CHECK(first.size() == last.size());
+  clear();
+  num_intervals_ = first.size();
+
+  // Order non-empty intervals by first frame.
+  std::vector<std::pair<int, int> > starts;
+  int min_frame = 0;
+  int max_frame = -1;
+  for (int i = 0; i < num_intervals_; i += 1) {
+    if (first[i] > last[i]) {
+      continue;
+    }
+    if (starts.empty()) {
+      min_frame = first[i];
+      max_frame = last[i];
+    } else {
+      min_frame = std::min(min_frame, first[i]);
+      max_frame = std::max(max_frame, last[i]);
+    }
+    starts.push_back(std::make_pair(first[i], i));
+  }
+  std::sort(starts.begin(), starts.end());
+
+  std::vector<std::pair<int, int> >::const_iterator start;
+  for (start = starts.begin(); start != starts.end(); ++start) {
+    start_frames_.push_back(start->first);
+    starts_.push_back(start->second);
+  }
+
+  if (starts.empty()) {
+    return;
+  }
+
+  // Count the intervals which contain each frame.
+  int num_frames = max_frame - min_frame + 1;
+  first_frame_ = min_frame;
+  offsets_.assign(num_frames + 1, 0);
+  for (start = starts.begin(); start != starts.end(); ++start) {
+    int i = start->second;
+    for (int t = first[i]; t <= last[i]; t += 1) {
+      offsets_[t - first_frame_ + 1] += 1;
+    }
+  }
+  for (int t = 0; t < num_frames; t += 1) {
+    offsets_[t + 1] += offsets_[t];
+  }
+
+  // Fill in order of first frame.
+  containing_.resize(offsets_.back());
+  std::vector<int> cursors(offsets_.begin(), offsets_.end() - 1);
+  for (start = starts.begin(); start != starts.end(); ++start) {
+    int i = start->second;
+    for (int t = first[i]; t <= last[i]; t += 1) {
+      containing_[cursors[t - first_frame_]] = i;
+      cursors[t - first_frame_] += 1;
+    }
+  }
+}
+
+void FrameIntervalIndex::find(int t, std::vector<int>& intervals) const {
+  int u = t - first_frame_;
+  if (u < 0 || u + 1 >= int(offsets_.size())) {
+    return;
+  }
+
+  intervals.insert(intervals.end(), containing_.begin() + offsets_[u],
+      containing_.begin() + offsets_[u + 1]);
+}
+
+void FrameIntervalIndex::find(int t0,
+                              int t1,
+                              std::vector<int>& intervals) const {
+  if (t0 > t1) {
+    return;
+  }
+
+  // Intervals which contain t0.
+  find(t0, intervals);
+
+  // Intervals which start in (t0, t1].
+  std::vector<int>::const_iterator begin = std::upper_bound(
+      start_frames_.begin(), start_frames_.end(), t0);
+  std::vector<int>::const_iterator end = std::upper_bound(begin,
+      start_frames_.end(), t1);
+  intervals.insert(intervals.end(),
+      starts_.begin() + (begin - start_frames_.begin()),
+      starts_.begin() + (end - start_frames_.begin()));
+}
+
+int FrameIntervalIndex::size() const {
+  return num_intervals_;
+}
+
+void FrameIntervalIndex::clear() {
+  num_intervals_ = 0;
+  first_frame_ = 0;
+  offsets_.assign(1, 0);
+  containing_.clear();
+  starts_.clear();
+  start_frames_.clear();
+}
+
+void FrameIntervalIndex::swap(FrameIntervalIndex& other) {
+  std::swap(num_intervals_, other.num_intervals_);
+  std::swap(first_frame_, other.first_frame_);
+  offsets_.swap(other.offsets_);
+  containing_.swap(other.containing_);
+  starts_.swap(other.starts_);
+  start_frames_.swap(other.start_frames_);
+}
@@ -0,0 +1,44 @@
+#ifndef FRAME_INTERVAL_INDEX_HPP_
+#define FRAME_INTERVAL_INDEX_HPP_
+
+#include <vector>
+
+// Finds which of a set of frame intervals intersect a window of frames, for
+// example the tracks which are active between t0 and t1.
+//
+// Queries take O(log n + k) time for k results. Every interval which
+// intersects [t0, t1] either contains t0 or starts in (t0, t1], so the index
+// keeps the intervals which contain each frame and a list of intervals in
+// order of their first frame. Uses memory proportional to the total length
+// of the intervals.
+class FrameIntervalIndex {
+  public:
+    FrameIntervalIndex();
+
+    // Interval i is [first[i], last[i]]. Intervals with first > last are
+    // empty and never found.
+    void init(const std::vector<int>& first, const std::vector<int>& last);
+
+    // Appends the index of every interval which contains frame t.
+    void find(int t, std::vector<int>& intervals) const;
+    // Appends the index of every interval which intersects [t0, t1].
+    // Each is found once.
+    void find(int t0, int t1, std::vector<int>& intervals) const;
+
+    int size() const;
+    void clear();
+    void swap(FrameIntervalIndex& other);
+
+  private:
+    int num_intervals_;
+    // Frame corresponding to the first offset.
+    int first_frame_;
+    // Intervals which contain each frame, delimited by offsets.
+    std::vector<int> offsets_;
+    std::vector<int> containing_;
+    // Non-empty intervals in order of first frame, with their first frames.
+    std::vector<int> starts_;
+    std::vector<int> start_frames_;
+};
+
+#endif
@@ -0,0 +1,575 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+#include <boost/format.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "camera.hpp"
+#include "sift_position.hpp"
+#include "image_index.hpp"
+#include "match_result.hpp"
+#include "multiview_track_list.hpp"
+#include "random.hpp"
+#include "feature_files.hpp"
+
+#include "track_writer.hpp"
+#include "camera_writer.hpp"
+#include "camera_properties_writer.hpp"
+#include "camera_pose_writer.hpp"
+#include "multiview_track_list_writer.hpp"
+#include "default_writer.hpp"
+
+// Scene.
+DEFINE_int32(num_views, 4, "Number of cameras");
+DEFINE_int32(num_points, 200, "Number of moving points");
+DEFINE_int32(num_frames, 10, "Number of frames");
+DEFINE_int32(seed, 0, "Seed for the scene, noise and outliers");
+DEFINE_double(scene_radius, 1.,
+    "Points start uniformly inside a cube of this half-width");
+DEFINE_double(speed, 0.02,
+    "Standard deviation of each component of velocity, per frame");
+DEFINE_double(point_radius, 0.04, "Radius of the disc drawn for each point");
+
+// Cameras.
+DEFINE_int32(width, 640, "Image width");
+DEFINE_int32(height, 480, "Image height");
+DEFINE_double(focal, 500., "Focal length in pixels");
+DEFINE_double(distort_w, 0.05,
+    "Parameter of the lens distortion, must be positive (see distortion.hpp)");
+DEFINE_double(camera_distance, 4.,
+    "Distance of the cameras from the center of the scene");
+DEFINE_double(camera_height, 1., "Height of the cameras above the scene");
+DEFINE_double(arc, 0.5,
+    "Fraction of the circle about the scene on which the cameras are spaced");
+
+// Noise.
+DEFINE_double(keypoint_noise, 0.,
+    "Standard deviation in pixels added to saved keypoints");
+DEFINE_double(background_noise, 8.,
+    "Standard deviation of the static background texture");
+
+// Matches.
+DEFINE_string(matches_format, "",
+    "Where to save perfect matches, e.g. matches/%s-%s-%d-%d.yaml");
+DEFINE_string(noisy_matches_format, "",
+    "Where to save matches with missed features and outliers");
+DEFINE_double(miss_fraction, 0.1,
+    "Fraction of true matches left out of the noisy matches");
+DEFINE_double(outlier_fraction, 0.1,
+    "Fraction of noisy matches with a random second feature");
+DEFINE_bool(exhaustive, false,
+    "Save matches between all pairs of images, as agglomerative-cluster reads");
+DEFINE_bool(simultaneous, true,
+    "Save matches between all views in the same frame");
+DEFINE_bool(adjacent, true,
+    "Save matches between adjacent frames of the same view");
+
+DEFINE_string(position_tracks, "",
+    "Where to save the true keypoint positions as multiview tracks");
+
+// Random streams of the seed, so that each image and pair of images can be
+// generated independently of the others.
+enum Stream { POINTS_STREAM, BACKGROUND_STREAM, IMAGE_STREAM, MATCHES_STREAM };
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Generates images of moving textured points seen by calibrated "
+      "cameras, with ground truth." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " view-names image-format keypoints-format "
+      "intrinsics-format extrinsics-format cameras-format tracks" << std::endl;
+  usage << std::endl;
+  usage << "Parameters:" << std::endl;
+  usage << "view-names -- Text file to which view names are written" <<
+      std::endl;
+  usage << "image-format -- e.g. images/%s/%07d.png" << std::endl;
+  usage << "keypoints-format -- e.g. keypoints/%s/%07d.yaml" << std::endl;
+  usage << "intrinsics-format -- e.g. intrinsics/%s.yaml" << std::endl;
+  usage << "extrinsics-format -- e.g. extrinsics/%s.yaml" << std::endl;
+  usage << "cameras-format -- Camera of each frame, e.g. cameras/%s.yaml" <<
+      std::endl;
+  usage << "tracks -- Multiview tracks of keypoint indices, as saved by "
+      "matches-to-multiview-tracks" << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 8) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+std::string makeViewFilename(const std::string& format,
+                             const std::string& view) {
+  return boost::str(boost::format(format) % view);
+}
+
+std::string makeImageFilename(const std::string& format,
+                              const std::string& view,
+                              int time) {
+  return boost::str(boost::format(format) % view % (time + 1));
+}
+
+std::string makeMatchFilename(const std::string& format,
+                              const std::string& view1,
+                              const std::string& view2,
+                              int time1,
+                              int time2) {
+  return boost::str(
+      boost::format(format) % view1 % view2 % (time1 + 1) % (time2 + 1));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// A disc which moves at constant velocity, textured with a sinusoid.
+struct ScenePoint {
+  cv::Point3d position;
+  cv::Point3d velocity;
+  double intensity;
+  double contrast;
+  // Cycles across the radius.
+  double frequency;
+  double orientation;
+  double phase;
+
+  cv::Point3d positionAt(int time) const {
+    return position + time * velocity;
+  }
+};
+
+void generatePoints(int num_points,
+                    std::vector<ScenePoint>& points,
+                    boost::random::mt19937& generator) {
+  boost::random::uniform_real_distribution<double> position(
+      -FLAGS_scene_radius, FLAGS_scene_radius);
+  boost::random::normal_distribution<double> velocity(0., FLAGS_speed);
+  boost::random::uniform_real_distribution<double> intensity(32., 224.);
+  boost::random::uniform_real_distribution<double> contrast(16., 64.);
+  boost::random::uniform_real_distribution<double> frequency(0.5, 2.);
+  boost::random::uniform_real_distribution<double> angle(0., 2. * CV_PI);
+
+  points.clear();
+  for (int i = 0; i < num_points; i += 1) {
+    ScenePoint point;
+    point.position = cv::Point3d(position(generator), position(generator),
+        position(generator));
+    point.velocity = cv::Point3d(velocity(generator), velocity(generator),
+        velocity(generator));
+    point.intensity = intensity(generator);
+    point.contrast = contrast(generator);
+    point.frequency = frequency(generator);
+    point.orientation = angle(generator);
+    point.phase = angle(generator);
+    points.push_back(point);
+  }
+}
+
+// Places a camera on a circle about the scene, looking at its center.
+// Cameras look down their negative z axis with y up (see CameraPose).
+Camera makeCamera(int view, int num_views) {
+  CameraProperties intrinsics;
+  intrinsics.image_size = cv::Size(FLAGS_width, FLAGS_height);
+  intrinsics.focal_x = FLAGS_focal;
+  intrinsics.focal_y = FLAGS_focal;
+  intrinsics.principal_point = cv::Point2d((FLAGS_width - 1) / 2.,
+      (FLAGS_height - 1) / 2.);
+  intrinsics.distort_w = FLAGS_distort_w;
+
+  double theta = 2. * CV_PI * FLAGS_arc * view / num_views;
+  cv::Vec3d center(FLAGS_camera_distance * std::sin(theta), FLAGS_camera_height,
+      FLAGS_camera_distance * std::cos(theta));
+
+  cv::Vec3d forward = -center * (1. / cv::norm(center));
+  cv::Vec3d right = forward.cross(cv::Vec3d(0, 1, 0));
+  right *= 1. / cv::norm(right);
+  cv::Vec3d up = right.cross(forward);
+
+  CameraPose extrinsics;
+  extrinsics.rotation = cv::Matx33d(
+      right[0], right[1], right[2],
+      up[0], up[1], up[2],
+      -forward[0], -forward[1], -forward[2]);
+  extrinsics.center = cv::Point3d(center[0], center[1], center[2]);
+
+  return Camera(intrinsics, extrinsics);
+}
+
+// Where a point appears in one image.
+struct Projection {
+  int point;
+  cv::Point2d position;
+  // Radius in pixels.
+  double radius;
+  double depth;
+
+  bool operator<(const Projection& other) const {
+    // Furthest first.
+    return depth > other.depth;
+  }
+};
+
+// Draws one disc over the image. Pixels covered by more than half are
+// attributed to the point.
+void drawDisc(const ScenePoint& point,
+              const Projection& projection,
+              cv::Mat_<float>& image,
+              cv::Mat_<int>& owner) {
+  const cv::Point2d& x = projection.position;
+  double r = projection.radius;
+  int x_min = std::max(0, int(std::floor(x.x - r - 1)));
+  int x_max = std::min(image.cols - 1, int(std::ceil(x.x + r + 1)));
+  int y_min = std::max(0, int(std::floor(x.y - r - 1)));
+  int y_max = std::min(image.rows - 1, int(std::ceil(x.y + r + 1)));
+
+  double c = std::cos(point.orientation);
+  double s = std::sin(point.orientation);
+
+  for (int i = y_min; i <= y_max; i += 1) {
+    for (int j = x_min; j <= x_max; j += 1) {
+      double dx = j - x.x;
+      double dy = i - x.y;
+      double distance = std::sqrt(dx * dx + dy * dy);
+      // Anti-alias the edge over one pixel.
+      double alpha = std::min(std::max(r - distance + 0.5, 0.), 1.);
+      if (alpha == 0) {
+        continue;
+      }
+
+      double u = (c * dx + s * dy) / r;
+      double value = point.intensity + point.contrast *
+          std::cos(2. * CV_PI * point.frequency * u + point.phase);
+      image(i, j) = alpha * value + (1. - alpha) * image(i, j);
+      if (alpha >= 0.5) {
+        owner(i, j) = projection.point;
+      }
+    }
+  }
+}
+
+// Renders every point in front of the camera, furthest first, and returns
+// those whose center is visible in the image.
+void renderImage(const std::vector<ScenePoint>& points,
+                 int time,
+                 const Camera& camera,
+                 const cv::Mat_<float>& background,
+                 cv::Mat& image,
+                 std::vector<Projection>& visible) {
+  const CameraPose& pose = camera.extrinsics();
+  std::vector<Projection> projections;
+
+  int num_points = points.size();
+  for (int i = 0; i < num_points; i += 1) {
+    cv::Point3d position = points[i].positionAt(time);
+    cv::Vec3d x = pose.rotation * cv::Vec3d(position - pose.center);
+    double depth = -x[2];
+    if (depth <= FLAGS_point_radius) {
+      continue;
+    }
+
+    Projection projection;
+    projection.point = i;
+    projection.position = camera.project(position);
+    projection.radius = FLAGS_focal * FLAGS_point_radius / depth;
+    projection.depth = depth;
+    projections.push_back(projection);
+  }
+  std::sort(projections.begin(), projections.end());
+
+  cv::Mat_<float> canvas = background.clone();
+  cv::Mat_<int> owner(background.size(), -1);
+  std::vector<Projection>::const_iterator projection;
+  for (projection = projections.begin();
+       projection != projections.end();
+       ++projection) {
+    drawDisc(points[projection->point], *projection, canvas, owner);
+  }
+  canvas.convertTo(image, CV_8U);
+
+  // Keep points whose center pixel was not covered by a nearer point.
+  visible.clear();
+  for (projection = projections.begin();
+       projection != projections.end();
+       ++projection) {
+    int j = cvRound(projection->position.x);
+    int i = cvRound(projection->position.y);
+    if (i < 0 || i >= owner.rows || j < 0 || j >= owner.cols) {
+      continue;
+    }
+    if (owner(i, j) == projection->point) {
+      visible.push_back(*projection);
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Index of every point's keypoint in one image, or -1 if it is not visible.
+typedef std::vector<int> KeypointIndex;
+
+int numKeypoints(const KeypointIndex& index) {
+  return index.size() - std::count(index.begin(), index.end(), -1);
+}
+
+void findMatches(const KeypointIndex& image1,
+                 const KeypointIndex& image2,
+                 std::vector<MatchResult>& matches) {
+  matches.clear();
+  int num_points = image1.size();
+  for (int i = 0; i < num_points; i += 1) {
+    if (image1[i] >= 0 && image2[i] >= 0) {
+      matches.push_back(MatchResult(image1[i], image2[i], 0.));
+    }
+  }
+}
+
+// Leaves out some matches and replaces the second feature of others.
+// Distances are made larger for outliers, so that a threshold can recover
+// most of the inliers.
+void corruptMatches(const std::vector<MatchResult>& matches,
+                    int num_features2,
+                    std::vector<MatchResult>& noisy,
+                    boost::random::mt19937& generator) {
+  boost::random::uniform_real_distribution<double> uniform(0., 1.);
+
+  noisy.clear();
+  std::vector<MatchResult>::const_iterator match;
+  for (match = matches.begin(); match != matches.end(); ++match) {
+    if (uniform(generator) < FLAGS_miss_fraction) {
+      continue;
+    }
+
+    MatchResult result = *match;
+    if (uniform(generator) < FLAGS_outlier_fraction) {
+      boost::random::uniform_int_distribution<int> feature(0,
+          num_features2 - 1);
+      result.index2 = feature(generator);
+      result.distance = 0.5 + 0.5 * uniform(generator);
+    } else {
+      result.distance = 0.75 * uniform(generator);
+    }
+    noisy.push_back(result);
+  }
+}
+
+void saveMatches(const std::vector<std::vector<KeypointIndex> >& indices,
+                 const std::vector<std::string>& view_names,
+                 const ImageIndex& image1,
+                 const ImageIndex& image2,
+                 uint32_t seed) {
+  const KeypointIndex& index1 = indices[image1.view][image1.time];
+  const KeypointIndex& index2 = indices[image2.view][image2.time];
+  const std::string& view1 = view_names[image1.view];
+  const std::string& view2 = view_names[image2.view];
+
+  std::vector<MatchResult> matches;
+  findMatches(index1, index2, matches);
+
+  bool ok;
+
+  if (!FLAGS_matches_format.empty()) {
+    std::string file = makeMatchFilename(FLAGS_matches_format, view1, view2,
+        image1.time, image2.time);
+    ok = saveMatchResults(file, matches);
+    CHECK(ok) << "Could not save matches";
+  }
+
+  if (!FLAGS_noisy_matches_format.empty()) {
+    int num_features2 = numKeypoints(index2);
+    std::vector<MatchResult> noisy;
+    if (num_features2 > 0) {
+      // Images ordered by view and then time.
+      int num_frames = indices.front().size();
+      int i1 = image1.view * num_frames + image1.time;
+      int i2 = image2.view * num_frames + image2.time;
+      boost::random::mt19937 generator(streamSeed(streamSeed(seed, i1), i2));
+      corruptMatches(matches, num_features2, noisy, generator);
+    }
+
+    std::string file = makeMatchFilename(FLAGS_noisy_matches_format, view1,
+        view2, image1.time, image2.time);
+    ok = saveMatchResults(file, noisy);
+    CHECK(ok) << "Could not save matches";
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string views_file = argv[1];
+  std::string image_format = argv[2];
+  std::string keypoints_format = argv[3];
+  std::string intrinsics_format = argv[4];
+  std::string extrinsics_format = argv[5];
+  std::string cameras_format = argv[6];
+  std::string tracks_file = argv[7];
+
+  int num_views = FLAGS_num_views;
+  int num_points = FLAGS_num_points;
+  int num_frames = FLAGS_num_frames;
+  CHECK(num_views > 0) << "Number of views must be positive";
+  CHECK(num_points > 0) << "Number of points must be positive";
+  CHECK(num_frames > 0) << "Number of frames must be positive";
+  CHECK(FLAGS_distort_w > 0) << "Distortion parameter must be positive";
+
+  bool ok;
+
+  // Name views.
+  std::vector<std::string> view_names;
+  for (int view = 0; view < num_views; view += 1) {
+    view_names.push_back(boost::str(boost::format("view%02d") % (view + 1)));
+  }
+
+  std::ofstream views_stream(views_file.c_str());
+  CHECK(views_stream.good()) << "Could not open view names";
+  std::vector<std::string>::const_iterator name;
+  for (name = view_names.begin(); name != view_names.end(); ++name) {
+    views_stream << *name << std::endl;
+  }
+  views_stream.close();
+
+  std::vector<ScenePoint> points;
+  boost::random::mt19937 generator(streamSeed(FLAGS_seed, POINTS_STREAM));
+  generatePoints(num_points, points, generator);
+
+  MultiviewTrackList<int> tracks(num_points, num_views);
+  MultiviewTrackList<SiftPosition> position_tracks(num_points, num_views);
+  // Keypoint index of every point in every image.
+  std::vector<std::vector<KeypointIndex> > indices(num_views,
+      std::vector<KeypointIndex>(num_frames, KeypointIndex(num_points, -1)));
+
+  boost::random::normal_distribution<double> keypoint_noise(0.,
+      FLAGS_keypoint_noise);
+
+  for (int view = 0; view < num_views; view += 1) {
+    const std::string& name = view_names[view];
+    Camera camera = makeCamera(view, num_views);
+
+    // Save calibration, static over time.
+    CameraPropertiesWriter intrinsics_writer;
+    ok = save(makeViewFilename(intrinsics_format, name), camera.intrinsics(),
+        intrinsics_writer);
+    CHECK(ok) << "Could not save intrinsics";
+
+    CameraPoseWriter extrinsics_writer;
+    ok = save(makeViewFilename(extrinsics_format, name), camera.extrinsics(),
+        extrinsics_writer);
+    CHECK(ok) << "Could not save extrinsics";
+
+    Track<Camera> cameras;
+    for (int t = 0; t < num_frames; t += 1) {
+      cameras[t] = camera;
+    }
+    CameraWriter camera_writer;
+    TrackWriter<Camera> cameras_writer(camera_writer);
+    ok = save(makeViewFilename(cameras_format, name), cameras, cameras_writer);
+    CHECK(ok) << "Could not save cameras";
+
+    cv::Mat_<float> background(FLAGS_height, FLAGS_width);
+    cv::RNG background_rng(streamSeed(streamSeed(FLAGS_seed,
+            BACKGROUND_STREAM), view));
+    background_rng.fill(background, cv::RNG::NORMAL, 128.,
+        FLAGS_background_noise);
+
+    for (int t = 0; t < num_frames; t += 1) {
+      cv::Mat image;
+      std::vector<Projection> visible;
+      renderImage(points, t, camera, background, image, visible);
+
+      ok = cv::imwrite(makeImageFilename(image_format, name, t), image);
+      CHECK(ok) << "Could not save image";
+
+      boost::random::mt19937 image_generator(streamSeed(streamSeed(
+              streamSeed(FLAGS_seed, IMAGE_STREAM), view), t));
+
+      // Shuffle so that keypoint indices differ between images.
+      randomShuffle(visible.begin(), visible.end(), image_generator);
+
+      std::vector<SiftPosition> keypoints;
+      int num_visible = visible.size();
+      for (int i = 0; i < num_visible; i += 1) {
+        const Projection& projection = visible[i];
+        const ScenePoint& point = points[projection.point];
+        SiftPosition position(projection.position.x, projection.position.y,
+            projection.radius / 2., point.orientation);
+
+        tracks.track(projection.point).view(view)[t] = i;
+        position_tracks.track(projection.point).view(view)[t] = position;
+        indices[view][t][projection.point] = i;
+
+        if (FLAGS_keypoint_noise > 0) {
+          position.x += keypoint_noise(image_generator);
+          position.y += keypoint_noise(image_generator);
+        }
+        keypoints.push_back(position);
+      }
+
+      ok = saveSiftPositions(makeImageFilename(keypoints_format, name, t),
+          keypoints);
+      CHECK(ok) << "Could not save keypoints";
+
+      LOG(INFO) << "(" << name << ", " << t << "): " << num_visible << "/" <<
+          num_points << " points visible";
+    }
+  }
+
+  DefaultWriter<int> feature_writer;
+  ok = saveMultiviewTrackList(tracks_file, tracks, feature_writer);
+  CHECK(ok) << "Could not save tracks";
+
+  if (!FLAGS_position_tracks.empty()) {
+    ok = saveSiftPositionMultiviewTracks(FLAGS_position_tracks,
+        position_tracks);
+    CHECK(ok) << "Could not save position tracks";
+  }
+
+  if (!FLAGS_matches_format.empty() || !FLAGS_noisy_matches_format.empty()) {
+    uint32_t seed = streamSeed(FLAGS_seed, MATCHES_STREAM);
+    if (FLAGS_exhaustive) {
+      // Images ordered by view and then time.
+      int n = num_views * num_frames;
+      for (int i1 = 0; i1 < n; i1 += 1) {
+        for (int i2 = i1 + 1; i2 < n; i2 += 1) {
+          saveMatches(indices, view_names,
+              ImageIndex(i1 / num_frames, i1 % num_frames),
+              ImageIndex(i2 / num_frames, i2 % num_frames), seed);
+        }
+      }
+    } else {
+      for (int t = 0; t < num_frames; t += 1) {
+        if (FLAGS_simultaneous) {
+          for (int p = 0; p < num_views; p += 1) {
+            for (int q = p + 1; q < num_views; q += 1) {
+              saveMatches(indices, view_names, ImageIndex(p, t),
+                  ImageIndex(q, t), seed);
+            }
+          }
+        }
+
+        if (FLAGS_adjacent && t + 1 < num_frames) {
+          for (int v = 0; v < num_views; v += 1) {
+            saveMatches(indices, view_names, ImageIndex(v, t),
+                ImageIndex(v, t + 1), seed);
+          }
+        }
+      }
+    }
+  }
+
+  return 0;
+}
@@ -1,4 +1,7 @@
 #include "geometry.hpp"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 cv::Point2d project(const cv::Mat& P, const cv::Point3d& x) {
   cv::Mat A = P(cv::Range::all(), cv::Range(0, 3));
@@ -54,3 +57,66 @@ cv::Matx33d computeFundMatFromCameras(const cv::Matx34d& P1,
 
   return F;
 }
+
+double sampsonError(const cv::Matx33d& F,
+                    const cv::Point2d& x1,
+                    const cv::Point2d& x2) {
+  double errors;
+  sampsonErrors(F, &x1.x, &x1.y, &x2.x, &x2.y, 1, &errors);
+  return errors;
+}
+
+void sampsonErrors(const cv::Matx33d& F,
+                   const double* x1,
+                   const double* y1,
+                   const double* x2,
+                   const double* y2,
+                   int n,
+                   double* errors) {
+  int i = 0;
+
+#ifdef __SSE2__
+  __m128d f[9];
+  for (int j = 0; j < 9; j += 1) {
+    f[j] = _mm_set1_pd(F.val[j]);
+  }
+
+  for (; i + 2 <= n; i += 2) {
+    __m128d u1 = _mm_loadu_pd(x1 + i);
+    __m128d v1 = _mm_loadu_pd(y1 + i);
+    __m128d u2 = _mm_loadu_pd(x2 + i);
+    __m128d v2 = _mm_loadu_pd(y2 + i);
+
+    // Epipolar line F x1 in the second image.
+    __m128d a = _mm_add_pd(_mm_add_pd(_mm_mul_pd(f[0], u1),
+        _mm_mul_pd(f[1], v1)), f[2]);
+    __m128d b = _mm_add_pd(_mm_add_pd(_mm_mul_pd(f[3], u1),
+        _mm_mul_pd(f[4], v1)), f[5]);
+    __m128d c = _mm_add_pd(_mm_add_pd(_mm_mul_pd(f[6], u1),
+        _mm_mul_pd(f[7], v1)), f[8]);
+    // First two components of F^T x2 in the first image.
+    __m128d p = _mm_add_pd(_mm_add_pd(_mm_mul_pd(f[0], u2),
+        _mm_mul_pd(f[3], v2)), f[6]);
+    __m128d q = _mm_add_pd(_mm_add_pd(_mm_mul_pd(f[1], u2),
+        _mm_mul_pd(f[4], v2)), f[7]);
+
+    __m128d e = _mm_add_pd(_mm_add_pd(_mm_mul_pd(u2, a), _mm_mul_pd(v2, b)),
+        c);
+    __m128d d = _mm_add_pd(_mm_add_pd(_mm_mul_pd(a, a), _mm_mul_pd(b, b)),
+        _mm_add_pd(_mm_mul_pd(p, p), _mm_mul_pd(q, q)));
+    _mm_storeu_pd(errors + i, _mm_div_pd(_mm_mul_pd(e, e), d));
+  }
+#endif
+
+  for (; i < n; i += 1) {
+    double a = F(0, 0) * x1[i] + F(0, 1) * y1[i] + F(0, 2);
+    double b = F(1, 0) * x1[i] + F(1, 1) * y1[i] + F(1, 2);
+    double c = F(2, 0) * x1[i] + F(2, 1) * y1[i] + F(2, 2);
+    double p = F(0, 0) * x2[i] + F(1, 0) * y2[i] + F(2, 0);
+    double q = F(0, 1) * x2[i] + F(1, 1) * y2[i] + F(2, 1);
+
+    double e = x2[i] * a + y2[i] * b + c;
+    double d = (a * a + b * b) + (p * p + q * q);
+    errors[i] = e * e / d;
+  }
+}
@@ -7,4 +7,19 @@ cv::Point2d project(const cv::Mat& P, const cv::Point3d& x);
 cv::Matx33d computeFundMatFromCameras(const cv::Matx34d& P1,
                                       const cv::Matx34d& P2);
 
+// Returns the squared Sampson distance of x1 <-> x2 from x2^T F x1 = 0. This
+// approximates the sum of squared distances which optimal triangulation
+// would move the points.
+double sampsonError(const cv::Matx33d& F,
+                    const cv::Point2d& x1,
+                    const cv::Point2d& x2);
+// The same for n correspondences given as separate arrays of co-ordinates.
+void sampsonErrors(const cv::Matx33d& F,
+                   const double* x1,
+                   const double* y1,
+                   const double* x2,
+                   const double* y2,
+                   int n,
+                   double* errors);
+
 #endif
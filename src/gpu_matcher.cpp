@@ -0,0 +1,247 @@
+#include "gpu_matcher.hpp"
+#include <algorithm>
+#include <vector>
+#include <glog/logging.h>
+
+#ifdef ENABLE_GPU
+
+#include <opencv2/gpu/gpu.hpp>
+
+namespace {
+
+// Queries uploaded together for a k-nearest search.
+const int QUERY_BLOCK_SIZE = 4096;
+// Most results of a radius search held on the device at once. Every query
+// has room for a match to every descriptor, so that none are dropped.
+const int MAX_RADIUS_RESULTS = 1 << 24;
+
+typedef std::vector<std::vector<cv::DMatch> > RawMatchLists;
+
+// Queries of the block are numbered from offset.
+void addBlockResults(RawMatchLists& lists, int offset, MatchSink& matches) {
+  for (int i = 0; i < int(lists.size()); i += 1) {
+    // Sorted by distance.
+    std::sort(lists[i].begin(), lists[i].end());
+
+    std::vector<cv::DMatch>::const_iterator match;
+    for (match = lists[i].begin(); match != lists[i].end(); ++match) {
+      matches.add(offset + i, match->trainIdx, match->distance);
+    }
+  }
+}
+
+}
+
+bool gpuAvailable() {
+  return cv::gpu::getCudaEnabledDeviceCount() > 0;
+}
+
+struct GpuMatcher::Device {
+  cv::gpu::GpuMat train;
+};
+
+GpuMatcher::GpuMatcher(const DescriptorMatrix& train)
+    : device_(new Device), rows_(train.rows()), cols_(train.cols()) {
+  CHECK(gpuAvailable()) << "No CUDA device found";
+  if (!train.empty()) {
+    device_->train.upload(train.toFloat());
+  }
+}
+
+GpuMatcher::~GpuMatcher() {}
+
+int GpuMatcher::size() const {
+  return rows_;
+}
+
+int GpuMatcher::cols() const {
+  return cols_;
+}
+
+void GpuMatcher::knnMatch(const cv::Mat& query,
+                          MatchSink& matches,
+                          int k) const {
+  CHECK(query.rows == 0 || query.cols == cols_) <<
+      "Descriptors differ in size";
+  CHECK(query.type() == cv::DataType<float>::type);
+  CHECK(k > 0);
+
+  matches.begin(query.rows);
+  if (rows_ == 0) {
+    matches.end();
+    return;
+  }
+  k = std::min(k, rows_);
+
+  cv::gpu::BFMatcher_GPU matcher(cv::NORM_L2);
+  // Re-used by every block.
+  cv::gpu::GpuMat block;
+  cv::gpu::GpuMat indices;
+  cv::gpu::GpuMat distances;
+  cv::gpu::GpuMat all_distances;
+  RawMatchLists lists;
+
+  for (int begin = 0; begin < query.rows; begin += QUERY_BLOCK_SIZE) {
+    int end = std::min(begin + QUERY_BLOCK_SIZE, query.rows);
+    block.upload(query.rowRange(begin, end));
+    matcher.knnMatchSingle(block, device_->train, indices, distances,
+        all_distances, k);
+    cv::gpu::BFMatcher_GPU::knnMatchDownload(indices, distances, lists);
+    addBlockResults(lists, begin, matches);
+  }
+  matches.end();
+}
+
+void GpuMatcher::radiusMatch(const cv::Mat& query,
+                             MatchSink& matches,
+                             double radius) const {
+  CHECK(query.rows == 0 || query.cols == cols_) <<
+      "Descriptors differ in size";
+  CHECK(query.type() == cv::DataType<float>::type);
+
+  matches.begin(query.rows);
+  if (rows_ == 0) {
+    matches.end();
+    return;
+  }
+
+  cv::gpu::BFMatcher_GPU matcher(cv::NORM_L2);
+  int block_size = std::max(MAX_RADIUS_RESULTS / rows_, 1);
+  cv::gpu::GpuMat block;
+  cv::gpu::GpuMat indices;
+  cv::gpu::GpuMat distances;
+  cv::gpu::GpuMat num_matches;
+  RawMatchLists lists;
+
+  for (int begin = 0; begin < query.rows; begin += block_size) {
+    int end = std::min(begin + block_size, query.rows);
+    block.upload(query.rowRange(begin, end));
+    // Otherwise the matcher makes room for only a few matches per query.
+    indices.create(end - begin, rows_, cv::DataType<int>::type);
+    distances.create(end - begin, rows_, cv::DataType<float>::type);
+    matcher.radiusMatchSingle(block, device_->train, indices, distances,
+        num_matches, radius);
+    cv::gpu::BFMatcher_GPU::radiusMatchDownload(indices, distances,
+        num_matches, lists);
+    addBlockResults(lists, begin, matches);
+  }
+  matches.end();
+}
+
+struct GpuPoints::Device {
+  cv::gpu::GpuMat points;
+};
+
+GpuPoints::GpuPoints(const cv::Mat& points)
+    : device_(new Device), rows_(points.rows) {
+  CHECK(gpuAvailable()) << "No CUDA device found";
+  CHECK(points.type() == cv::DataType<float>::type);
+  if (!points.empty()) {
+    device_->points.upload(points);
+  }
+}
+
+GpuPoints::~GpuPoints() {}
+
+int GpuPoints::rows() const {
+  return rows_;
+}
+
+struct GpuClassifierScorer::Device {
+  cv::gpu::GpuMat weights;
+  // Added on the host, which is cheap next to the product.
+  cv::Mat biases;
+};
+
+GpuClassifierScorer::GpuClassifierScorer(const cv::Mat& weights,
+                                         const cv::Mat& biases)
+    : device_(new Device) {
+  CHECK(gpuAvailable()) << "No CUDA device found";
+  CHECK(weights.type() == cv::DataType<float>::type);
+  CHECK(biases.rows == weights.rows);
+  device_->weights.upload(weights);
+  biases.copyTo(device_->biases);
+}
+
+GpuClassifierScorer::~GpuClassifierScorer() {}
+
+void GpuClassifierScorer::score(const GpuPoints& points,
+                                int begin,
+                                int end,
+                                cv::Mat& scores) const {
+  CHECK(0 <= begin && begin <= end && end <= device_->weights.rows);
+
+  if (points.rows() == 0 || begin == end) {
+    scores.create(end - begin, points.rows(), cv::DataType<float>::type);
+    return;
+  }
+
+  cv::gpu::GpuMat products;
+  cv::gpu::gemm(device_->weights.rowRange(begin, end),
+      points.device_->points, 1., cv::gpu::GpuMat(), 0., products,
+      cv::GEMM_2_T);
+  products.download(scores);
+
+  for (int i = begin; i < end; i += 1) {
+    scores.row(i - begin) += device_->biases.at<float>(i);
+  }
+}
+
+#else
+
+bool gpuAvailable() {
+  return false;
+}
+
+struct GpuMatcher::Device {};
+
+GpuMatcher::GpuMatcher(const DescriptorMatrix& train)
+    : device_(), rows_(train.rows()), cols_(train.cols()) {
+  LOG(FATAL) << "Built without GPU matching, see WITH_GPU";
+}
+
+GpuMatcher::~GpuMatcher() {}
+
+int GpuMatcher::size() const {
+  return rows_;
+}
+
+int GpuMatcher::cols() const {
+  return cols_;
+}
+
+void GpuMatcher::knnMatch(const cv::Mat&, MatchSink&, int) const {
+  LOG(FATAL) << "Built without GPU matching, see WITH_GPU";
+}
+
+void GpuMatcher::radiusMatch(const cv::Mat&, MatchSink&, double) const {
+  LOG(FATAL) << "Built without GPU matching, see WITH_GPU";
+}
+
+struct GpuPoints::Device {};
+
+GpuPoints::GpuPoints(const cv::Mat& points)
+    : device_(), rows_(points.rows) {
+  LOG(FATAL) << "Built without GPU matching, see WITH_GPU";
+}
+
+GpuPoints::~GpuPoints() {}
+
+int GpuPoints::rows() const {
+  return rows_;
+}
+
+struct GpuClassifierScorer::Device {};
+
+GpuClassifierScorer::GpuClassifierScorer(const cv::Mat&, const cv::Mat&)
+    : device_() {
+  LOG(FATAL) << "Built without GPU matching, see WITH_GPU";
+}
+
+GpuClassifierScorer::~GpuClassifierScorer() {}
+
+void GpuClassifierScorer::score(const GpuPoints&, int, int, cv::Mat&) const {
+  LOG(FATAL) << "Built without GPU matching, see WITH_GPU";
+}
+
+#endif
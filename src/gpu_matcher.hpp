@@ -0,0 +1,98 @@
+#ifndef GPU_MATCHER_HPP_
+#define GPU_MATCHER_HPP_
+
+#include <boost/scoped_ptr.hpp>
+#include <opencv2/core/core.hpp>
+#include "descriptor_matrix.hpp"
+#include "match_sink.hpp"
+
+// Brute-force matching and classifier scoring on a CUDA device, through the
+// gpu module of OpenCV.
+//
+// The work is only compiled in with WITH_GPU, which defines ENABLE_GPU.
+// Otherwise constructing either class is fatal, so that the headers and
+// sources of every target are the same in both builds.
+
+// True if built with ENABLE_GPU and there is a CUDA device.
+bool gpuAvailable();
+
+// Exact nearest-neighbour search by brute force on the device.
+//
+// The descriptors are uploaded once, as floats, and stay on the device for
+// every query. Queries are uploaded in blocks of rows and only the indices
+// and distances of their matches are copied back, so that one set can be
+// matched against the blocks of many others. Distances are Euclidean.
+class GpuMatcher {
+  public:
+    explicit GpuMatcher(const DescriptorMatrix& train);
+    ~GpuMatcher();
+
+    int size() const;
+    int cols() const;
+
+    // Finds the k nearest descriptors to each row of float queries.
+    void knnMatch(const cv::Mat& query, MatchSink& matches, int k) const;
+    // Finds all descriptors within a radius of each row.
+    void radiusMatch(const cv::Mat& query,
+                     MatchSink& matches,
+                     double radius) const;
+
+  private:
+    struct Device;
+
+    boost::scoped_ptr<Device> device_;
+    int rows_;
+    int cols_;
+
+    // Non-copyable.
+    GpuMatcher(const GpuMatcher&);
+    GpuMatcher& operator=(const GpuMatcher&);
+};
+
+// Float points kept on the device, so that every block of classifiers scores
+// them without uploading them again.
+class GpuPoints {
+  public:
+    explicit GpuPoints(const cv::Mat& points);
+    ~GpuPoints();
+
+    int rows() const;
+
+  private:
+    friend class GpuClassifierScorer;
+    struct Device;
+
+    boost::scoped_ptr<Device> device_;
+    int rows_;
+
+    // Non-copyable.
+    GpuPoints(const GpuPoints&);
+    GpuPoints& operator=(const GpuPoints&);
+};
+
+// The weights and biases of a bank of linear classifiers, kept on the
+// device. See ClassifierBank.
+class GpuClassifierScorer {
+  public:
+    // One classifier per row of weights, and one bias per row of biases.
+    GpuClassifierScorer(const cv::Mat& weights, const cv::Mat& biases);
+    ~GpuClassifierScorer();
+
+    // Computes scores(i - begin, j) = w_i . x_j + b_i for classifiers i in
+    // [begin, end) and every point x_j.
+    void score(const GpuPoints& points,
+               int begin,
+               int end,
+               cv::Mat& scores) const;
+
+  private:
+    struct Device;
+
+    boost::scoped_ptr<Device> device_;
+
+    // Non-copyable.
+    GpuClassifierScorer(const GpuClassifierScorer&);
+    GpuClassifierScorer& operator=(const GpuClassifierScorer&);
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef HALF_FLOAT_HPP_
+#define HALF_FLOAT_HPP_
+
+#include <stdint.h>
+
+// IEEE 754 half precision (binary16), for storing descriptors in half the
+// memory of floats. OpenCV 2 has no half type, so matrices of them are
+// CV_16U.
+//
+// Conversion from float rounds to nearest even. Values beyond the range of
+// a half become infinite.
+uint16_t floatToHalf(float x);
+float halfToFloat(uint16_t h);
+
+// Element of a half-precision matrix. Converts to float implicitly, so that
+// the kernels of fixed_descriptor.hpp widen it as they read.
+struct HalfFloat {
+  uint16_t bits;
+
+  HalfFloat();
+  explicit HalfFloat(float x);
+
+  operator float() const;
+};
+
+#include "half_float.inl"
+
+#endif
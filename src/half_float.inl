@@ -0,0 +1,73 @@
+#include <cstring>
+
+inline uint16_t floatToHalf(float x) {
+  uint32_t f;
+  std::memcpy(&f, &x, sizeof(f));
+  uint16_t sign = (f >> 16) & 0x8000;
+  uint32_t magnitude = f & 0x7fffffff;
+
+  if (magnitude >= 0x7f800000) {
+    // Infinity stays infinite and NaN stays NaN.
+    return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+  }
+  if (magnitude >= 0x477ff000) {
+    // Rounds to 65520 or more, beyond the largest half.
+    return sign | 0x7c00;
+  }
+
+  int exponent = magnitude >> 23;
+  uint32_t h;
+  uint32_t remainder;
+  uint32_t halfway;
+  if (exponent >= 113) {
+    // Normal half. Re-bias the exponent and keep the top 10 bits.
+    h = ((exponent - 112) << 10) | ((magnitude >> 13) & 0x3ff);
+    remainder = magnitude & 0x1fff;
+    halfway = 0x1000;
+  } else {
+    // Subnormal half, in units of 2^-24.
+    int shift = 126 - exponent;
+    if (shift > 24) {
+      return sign;
+    }
+    uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+    h = mantissa >> shift;
+    remainder = mantissa & ((1u << shift) - 1);
+    halfway = 1u << (shift - 1);
+  }
+
+  // A carry out of the mantissa correctly increments the exponent.
+  if (remainder > halfway || (remainder == halfway && (h & 1))) {
+    h += 1;
+  }
+  return sign | h;
+}
+
+inline float halfToFloat(uint16_t h) {
+  uint32_t sign = uint32_t(h & 0x8000) << 16;
+  int exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+
+  uint32_t f;
+  if (exponent == 0) {
+    // Zero or subnormal, exactly representable as a float.
+    float x = mantissa * (1.f / 16777216.f);
+    return sign ? -x : x;
+  } else if (exponent == 31) {
+    f = sign | 0x7f800000 | (mantissa << 13);
+  } else {
+    f = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+
+  float x;
+  std::memcpy(&x, &f, sizeof(x));
+  return x;
+}
+
+inline HalfFloat::HalfFloat() : bits(0) {}
+
+inline HalfFloat::HalfFloat(float x) : bits(floatToHalf(x)) {}
+
+inline HalfFloat::operator float() const {
+  return halfToFloat(bits);
+}
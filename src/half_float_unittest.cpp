@@ -0,0 +1,105 @@
+#include "half_float.hpp"
+#include <cmath>
+#include <limits>
+#include "gtest/gtest.h"
+
+namespace {
+
+bool isNegative(float x) {
+  return std::signbit(x);
+}
+
+}
+
+TEST(HalfFloat, RoundTripsEveryHalf) {
+  for (int h = 0; h < 0x10000; h += 1) {
+    int exponent = (h >> 10) & 0x1f;
+    int mantissa = h & 0x3ff;
+    float x = halfToFloat(h);
+    if (exponent == 31 && mantissa != 0) {
+      EXPECT_TRUE(x != x) << h;
+      EXPECT_TRUE(floatToHalf(x) >> 10 == (h >> 10)) << h;
+      EXPECT_NE(0, floatToHalf(x) & 0x3ff) << h;
+    } else {
+      EXPECT_EQ(h, floatToHalf(x)) << h;
+    }
+  }
+}
+
+TEST(HalfFloat, ConvertsExactValues) {
+  EXPECT_EQ(0x3c00, floatToHalf(1));
+  EXPECT_EQ(0xc000, floatToHalf(-2));
+  EXPECT_EQ(0x3800, floatToHalf(0.5));
+  EXPECT_EQ(0x7bff, floatToHalf(65504));
+  // Smallest normal and subnormal.
+  EXPECT_EQ(0x0400, floatToHalf(std::ldexp(1.f, -14)));
+  EXPECT_EQ(0x0001, floatToHalf(std::ldexp(1.f, -24)));
+  EXPECT_EQ(65504.f, halfToFloat(0x7bff));
+  EXPECT_EQ(std::ldexp(1.f, -24), halfToFloat(0x0001));
+}
+
+TEST(HalfFloat, RoundsToNearestEven) {
+  // The halves next to 1 are 1 + 2^-10 apart.
+  float ulp = std::ldexp(1.f, -10);
+  EXPECT_EQ(0x3c00, floatToHalf(1 + 0.49f * ulp));
+  EXPECT_EQ(0x3c01, floatToHalf(1 + 0.51f * ulp));
+  // Ties go to the even mantissa.
+  EXPECT_EQ(0x3c00, floatToHalf(1 + 0.5f * ulp));
+  EXPECT_EQ(0x3c02, floatToHalf(1 + 1.5f * ulp));
+  EXPECT_EQ(0xbc00, floatToHalf(-(1 + 0.5f * ulp)));
+
+  // Rounding up carries into the exponent.
+  EXPECT_EQ(0x4000, floatToHalf(2 - 0.25f * ulp));
+
+  // Subnormal ties, in units of 2^-24.
+  float unit = std::ldexp(1.f, -24);
+  EXPECT_EQ(0x0000, floatToHalf(0.5f * unit));
+  EXPECT_EQ(0x0002, floatToHalf(1.5f * unit));
+  EXPECT_EQ(0x0001, floatToHalf(0.51f * unit));
+  // Rounds up from the largest subnormal to the smallest normal.
+  EXPECT_EQ(0x0400, floatToHalf(1023.5f * unit));
+}
+
+TEST(HalfFloat, OverflowsToInfinity) {
+  // 65520 is halfway between the largest half and the next power of two.
+  EXPECT_EQ(0x7bff, floatToHalf(65519.f));
+  EXPECT_EQ(0x7c00, floatToHalf(65520.f));
+  EXPECT_EQ(0xfc00, floatToHalf(-65520.f));
+  EXPECT_EQ(0x7c00, floatToHalf(1e10f));
+  EXPECT_EQ(0x7c00, floatToHalf(std::numeric_limits<float>::max()));
+}
+
+TEST(HalfFloat, UnderflowsToSignedZero) {
+  EXPECT_EQ(0x0000, floatToHalf(1e-10f));
+  EXPECT_EQ(0x8000, floatToHalf(-1e-10f));
+  EXPECT_EQ(0x0000, floatToHalf(std::numeric_limits<float>::denorm_min()));
+}
+
+TEST(HalfFloat, KeepsSpecialValues) {
+  float inf = std::numeric_limits<float>::infinity();
+  EXPECT_EQ(0x7c00, floatToHalf(inf));
+  EXPECT_EQ(0xfc00, floatToHalf(-inf));
+  EXPECT_EQ(inf, halfToFloat(0x7c00));
+  EXPECT_EQ(-inf, halfToFloat(0xfc00));
+
+  float nan = std::numeric_limits<float>::quiet_NaN();
+  uint16_t h = floatToHalf(nan);
+  EXPECT_EQ(0x7c00, h & 0x7c00);
+  EXPECT_NE(0, h & 0x3ff);
+  float x = halfToFloat(h);
+  EXPECT_TRUE(x != x);
+
+  EXPECT_EQ(0x0000, floatToHalf(0.f));
+  EXPECT_EQ(0x8000, floatToHalf(-0.f));
+  EXPECT_FALSE(isNegative(halfToFloat(0x0000)));
+  EXPECT_TRUE(isNegative(halfToFloat(0x8000)));
+}
+
+TEST(HalfFloat, ConvertsImplicitlyToFloat) {
+  HalfFloat zero;
+  EXPECT_EQ(0.f, float(zero));
+  HalfFloat x(0.1f);
+  // Within half a unit of the eleventh bit.
+  EXPECT_NEAR(0.1f, float(x), 0.1f * std::ldexp(1.f, -11));
+  EXPECT_EQ(floatToHalf(0.1f), x.bits);
+}
@@ -0,0 +1,474 @@
+#include "hnsw_index.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/unordered_set.hpp>
+#include <glog/logging.h>
+#include "random.hpp"
+
+namespace {
+
+const char MAGIC[4] = { 'H', 'N', 'S', 'W' };
+const uint32_t VERSION = 1;
+
+// Writes the length then the values.
+template<class T>
+void writeArray(std::ofstream& file, const std::vector<T>& values) {
+  uint64_t n = values.size();
+  file.write(reinterpret_cast<const char*>(&n), sizeof(n));
+  if (n > 0) {
+    file.write(reinterpret_cast<const char*>(&values.front()),
+        n * sizeof(T));
+  }
+}
+
+template<class T>
+bool readArray(std::ifstream& file, std::vector<T>& values) {
+  uint64_t n;
+  if (!file.read(reinterpret_cast<char*>(&n), sizeof(n))) {
+    return false;
+  }
+  values.resize(n);
+  if (n > 0) {
+    file.read(reinterpret_cast<char*>(&values.front()), n * sizeof(T));
+  }
+  return file.good();
+}
+
+template<class T>
+void writeValue(std::ofstream& file, const T& value) {
+  file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<class T>
+bool readValue(std::ifstream& file, T& value) {
+  return bool(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+// The level of a descriptor depends only on its number, so an index grown
+// over several runs is the same as one built at once.
+int drawLevel(uint32_t seed, int i, int max_neighbors) {
+  boost::random::mt19937 generator(streamSeed(seed, i));
+  // Uniform in (0, 1].
+  double u = (double(generator()) + 1.) / 4294967296.;
+  return int(-std::log(u) / std::log(double(max_neighbors)));
+}
+
+}
+
+HnswOptions::HnswOptions()
+    : max_neighbors(16), construction_ef(200), search_ef(64), seed(0) {}
+
+HnswIndex::HnswIndex()
+    : dimension_(0),
+      options_(),
+      descriptors_(),
+      levels_(),
+      bottom_links_(),
+      upper_links_(),
+      upper_offsets_(1, 0),
+      entry_(-1),
+      max_level_(-1) {}
+
+HnswIndex::HnswIndex(int dimension, const HnswOptions& options)
+    : dimension_(dimension),
+      options_(options),
+      descriptors_(),
+      levels_(),
+      bottom_links_(),
+      upper_links_(),
+      upper_offsets_(1, 0),
+      entry_(-1),
+      max_level_(-1) {
+  CHECK(dimension > 0);
+  CHECK(options.max_neighbors > 1);
+  CHECK(options.construction_ef > 0);
+  CHECK(options.search_ef > 0);
+}
+
+int HnswIndex::size() const {
+  return levels_.size();
+}
+
+int HnswIndex::dimension() const {
+  return dimension_;
+}
+
+const HnswOptions& HnswIndex::options() const {
+  return options_;
+}
+
+void HnswIndex::setSearchEf(int ef) {
+  CHECK(ef > 0);
+  options_.search_ef = ef;
+}
+
+void HnswIndex::add(const DescriptorMatrix& descriptors) {
+  if (descriptors.empty()) {
+    return;
+  }
+  CHECK(descriptors.cols() == dimension_) << "Descriptors differ in size";
+
+  cv::Mat floats = descriptors.toFloat();
+  for (int i = 0; i < floats.rows; i += 1) {
+    add(floats.ptr<float>(i));
+  }
+}
+
+void HnswIndex::add(const float* x) {
+  CHECK(dimension_ > 0) << "Index has no dimension";
+  int i = size();
+  int top = drawLevel(options_.seed, i, options_.max_neighbors);
+
+  descriptors_.insert(descriptors_.end(), x, x + dimension_);
+  levels_.push_back(top);
+  bottom_links_.resize(bottom_links_.size() + capacity(0) + 1, 0);
+  upper_offsets_.push_back(upper_offsets_.back() +
+      uint64_t(top) * (capacity(1) + 1));
+  upper_links_.resize(upper_offsets_.back(), 0);
+
+  if (entry_ < 0) {
+    entry_ = i;
+    max_level_ = top;
+    return;
+  }
+
+  int entry = entry_;
+  for (int level = max_level_; level > top; level -= 1) {
+    entry = searchGreedy(x, entry, level);
+  }
+
+  std::vector<Candidate> entries(1,
+      Candidate(squaredDistance(x, entry), entry));
+  std::vector<Candidate> nearest;
+  for (int level = std::min(top, max_level_); level >= 0; level -= 1) {
+    searchLevel(x, entries, options_.construction_ef, level, nearest);
+
+    std::vector<Candidate> neighbors = nearest;
+    selectNeighbors(neighbors, options_.max_neighbors);
+    int* own = links(i, level);
+    own[0] = neighbors.size();
+    for (int k = 0; k < int(neighbors.size()); k += 1) {
+      own[k + 1] = neighbors[k].second;
+    }
+    for (int k = 0; k < int(neighbors.size()); k += 1) {
+      connect(neighbors[k].second, i, level);
+    }
+
+    entries.swap(nearest);
+  }
+
+  if (top > max_level_) {
+    entry_ = i;
+    max_level_ = top;
+  }
+}
+
+void HnswIndex::search(const float* query,
+                       int k,
+                       std::vector<std::pair<float, int> >& nearest) const {
+  nearest.clear();
+  if (entry_ < 0 || k <= 0) {
+    return;
+  }
+
+  int entry = entry_;
+  for (int level = max_level_; level > 0; level -= 1) {
+    entry = searchGreedy(query, entry, level);
+  }
+
+  std::vector<Candidate> entries(1,
+      Candidate(squaredDistance(query, entry), entry));
+  searchLevel(query, entries, std::max(options_.search_ef, k), 0, nearest);
+
+  nearest.resize(std::min(k, int(nearest.size())));
+  std::vector<Candidate>::iterator candidate;
+  for (candidate = nearest.begin(); candidate != nearest.end(); ++candidate) {
+    candidate->first = std::sqrt(candidate->first);
+  }
+}
+
+void HnswIndex::knnMatch(const cv::Mat& query, MatchSink& matches, int k)
+    const {
+  CHECK(query.rows == 0 || query.cols == dimension_) <<
+      "Descriptors differ in size";
+  CHECK(query.type() == cv::DataType<float>::type);
+  CHECK(k > 0);
+
+  // Re-used by every query.
+  std::vector<Candidate> nearest;
+  matches.begin(query.rows);
+  for (int i = 0; i < query.rows; i += 1) {
+    search(query.ptr<float>(i), k, nearest);
+    std::vector<Candidate>::const_iterator match;
+    for (match = nearest.begin(); match != nearest.end(); ++match) {
+      matches.add(i, match->second, match->first);
+    }
+  }
+  matches.end();
+}
+
+bool HnswIndex::save(const std::string& filename) const {
+  std::ofstream file(filename.c_str(), std::ios::binary);
+  if (!file) {
+    return false;
+  }
+
+  int32_t dimension = dimension_;
+  int32_t max_neighbors = options_.max_neighbors;
+  int32_t construction_ef = options_.construction_ef;
+  int32_t search_ef = options_.search_ef;
+  int32_t entry = entry_;
+  int32_t max_level = max_level_;
+  file.write(MAGIC, sizeof(MAGIC));
+  writeValue(file, VERSION);
+  writeValue(file, dimension);
+  writeValue(file, max_neighbors);
+  writeValue(file, construction_ef);
+  writeValue(file, search_ef);
+  writeValue(file, options_.seed);
+  writeValue(file, entry);
+  writeValue(file, max_level);
+
+  writeArray(file, descriptors_);
+  writeArray(file, levels_);
+  writeArray(file, bottom_links_);
+  writeArray(file, upper_links_);
+  writeArray(file, upper_offsets_);
+
+  return file.good();
+}
+
+bool HnswIndex::load(const std::string& filename) {
+  std::ifstream file(filename.c_str(), std::ios::binary);
+  if (!file) {
+    return false;
+  }
+
+  char magic[sizeof(MAGIC)];
+  uint32_t version;
+  if (!file.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+    LOG(WARNING) << "Not an HNSW index";
+    return false;
+  }
+  if (!readValue(file, version) || version != VERSION) {
+    LOG(WARNING) << "Unsupported version of HNSW index";
+    return false;
+  }
+
+  HnswIndex loaded;
+  int32_t dimension;
+  int32_t max_neighbors;
+  int32_t construction_ef;
+  int32_t search_ef;
+  int32_t entry;
+  int32_t max_level;
+  if (!readValue(file, dimension) ||
+      !readValue(file, max_neighbors) ||
+      !readValue(file, construction_ef) ||
+      !readValue(file, search_ef) ||
+      !readValue(file, loaded.options_.seed) ||
+      !readValue(file, entry) ||
+      !readValue(file, max_level) ||
+      !readArray(file, loaded.descriptors_) ||
+      !readArray(file, loaded.levels_) ||
+      !readArray(file, loaded.bottom_links_) ||
+      !readArray(file, loaded.upper_links_) ||
+      !readArray(file, loaded.upper_offsets_)) {
+    return false;
+  }
+  loaded.dimension_ = dimension;
+  loaded.options_.max_neighbors = max_neighbors;
+  loaded.options_.construction_ef = construction_ef;
+  loaded.options_.search_ef = search_ef;
+  loaded.entry_ = entry;
+  loaded.max_level_ = max_level;
+
+  // The arrays must agree with each other before any link is followed.
+  uint64_t n = loaded.levels_.size();
+  bool ok = dimension > 0 && max_neighbors > 1 && construction_ef > 0 &&
+      search_ef > 0 &&
+      loaded.descriptors_.size() == n * dimension &&
+      loaded.bottom_links_.size() == n * (loaded.capacity(0) + 1) &&
+      loaded.upper_offsets_.size() == n + 1 &&
+      loaded.upper_offsets_.front() == 0 &&
+      loaded.upper_offsets_.back() == loaded.upper_links_.size() &&
+      (n == 0 ? entry == -1 : 0 <= entry && uint64_t(entry) < n);
+  for (uint64_t i = 0; ok && i < n; i += 1) {
+    ok = loaded.levels_[i] >= 0 && loaded.levels_[i] <= max_level &&
+        loaded.upper_offsets_[i + 1] - loaded.upper_offsets_[i] ==
+        uint64_t(loaded.levels_[i]) * (loaded.capacity(1) + 1);
+  }
+  for (uint64_t i = 0; ok && i < n; i += 1) {
+    for (int level = 0; ok && level <= loaded.levels_[i]; level += 1) {
+      const int* list = loaded.links(i, level);
+      ok = 0 <= list[0] && list[0] <= loaded.capacity(level);
+      for (int k = 1; ok && k <= list[0]; k += 1) {
+        ok = 0 <= list[k] && uint64_t(list[k]) < n &&
+            loaded.levels_[list[k]] >= level;
+      }
+    }
+  }
+  if (!ok || (n > 0 && loaded.levels_[entry] != max_level)) {
+    LOG(WARNING) << "Malformed HNSW index";
+    return false;
+  }
+
+  *this = loaded;
+  return true;
+}
+
+const float* HnswIndex::descriptor(int i) const {
+  return &descriptors_[size_t(i) * dimension_];
+}
+
+float HnswIndex::squaredDistance(const float* x, int i) const {
+  const float* y = descriptor(i);
+  float distance = 0;
+  for (int d = 0; d < dimension_; d += 1) {
+    float delta = x[d] - y[d];
+    distance += delta * delta;
+  }
+  return distance;
+}
+
+int HnswIndex::capacity(int level) const {
+  return (level == 0) ? 2 * options_.max_neighbors : options_.max_neighbors;
+}
+
+int* HnswIndex::links(int i, int level) {
+  return const_cast<int*>(static_cast<const HnswIndex*>(this)->links(i,
+        level));
+}
+
+const int* HnswIndex::links(int i, int level) const {
+  if (level == 0) {
+    return &bottom_links_[size_t(i) * (capacity(0) + 1)];
+  }
+  return &upper_links_[upper_offsets_[i] + (level - 1) * (capacity(1) + 1)];
+}
+
+int HnswIndex::searchGreedy(const float* x, int entry, int level) const {
+  float best = squaredDistance(x, entry);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    const int* list = links(entry, level);
+    for (int k = 1; k <= list[0]; k += 1) {
+      float distance = squaredDistance(x, list[k]);
+      if (distance < best) {
+        best = distance;
+        entry = list[k];
+        changed = true;
+      }
+    }
+  }
+  return entry;
+}
+
+void HnswIndex::searchLevel(const float* x,
+                            const std::vector<Candidate>& entries,
+                            int ef,
+                            int level,
+                            std::vector<Candidate>& nearest) const {
+  // Candidates to expand, nearest first, and the best found, furthest first.
+  std::priority_queue<Candidate, std::vector<Candidate>,
+      std::greater<Candidate> > candidates;
+  std::priority_queue<Candidate> found;
+  boost::unordered_set<int> visited;
+  // Roughly the neighbours of the candidates which a search expands.
+  visited.reserve(size_t(ef) * capacity(level));
+
+  std::vector<Candidate>::const_iterator entry;
+  for (entry = entries.begin(); entry != entries.end(); ++entry) {
+    visited.insert(entry->second);
+    candidates.push(*entry);
+    found.push(*entry);
+    if (int(found.size()) > ef) {
+      found.pop();
+    }
+  }
+
+  while (!candidates.empty()) {
+    Candidate candidate = candidates.top();
+    // Every remaining candidate is further than the furthest found.
+    if (int(found.size()) >= ef && candidate.first > found.top().first) {
+      break;
+    }
+    candidates.pop();
+
+    const int* list = links(candidate.second, level);
+    for (int k = 1; k <= list[0]; k += 1) {
+      int j = list[k];
+      if (!visited.insert(j).second) {
+        continue;
+      }
+
+      float distance = squaredDistance(x, j);
+      if (int(found.size()) < ef || distance < found.top().first) {
+        candidates.push(Candidate(distance, j));
+        found.push(Candidate(distance, j));
+        if (int(found.size()) > ef) {
+          found.pop();
+        }
+      }
+    }
+  }
+
+  nearest.clear();
+  while (!found.empty()) {
+    nearest.push_back(found.top());
+    found.pop();
+  }
+  std::reverse(nearest.begin(), nearest.end());
+}
+
+void HnswIndex::selectNeighbors(std::vector<Candidate>& candidates, int n)
+    const {
+  std::sort(candidates.begin(), candidates.end());
+
+  std::vector<Candidate> kept;
+  std::vector<Candidate>::const_iterator candidate;
+  for (candidate = candidates.begin();
+       candidate != candidates.end() && int(kept.size()) < n;
+       ++candidate) {
+    const float* y = descriptor(candidate->second);
+    bool diverse = true;
+    std::vector<Candidate>::const_iterator other;
+    for (other = kept.begin(); other != kept.end() && diverse; ++other) {
+      diverse = squaredDistance(y, other->second) >= candidate->first;
+    }
+    if (diverse) {
+      kept.push_back(*candidate);
+    }
+  }
+  candidates.swap(kept);
+}
+
+void HnswIndex::connect(int i, int j, int level) {
+  int* list = links(i, level);
+  if (list[0] < capacity(level)) {
+    list[list[0] + 1] = j;
+    list[0] += 1;
+    return;
+  }
+
+  const float* x = descriptor(i);
+  std::vector<Candidate> candidates;
+  for (int k = 1; k <= list[0]; k += 1) {
+    candidates.push_back(Candidate(squaredDistance(x, list[k]), list[k]));
+  }
+  candidates.push_back(Candidate(squaredDistance(x, j), j));
+  selectNeighbors(candidates, capacity(level));
+
+  list[0] = candidates.size();
+  for (int k = 0; k < int(candidates.size()); k += 1) {
+    list[k + 1] = candidates[k].second;
+  }
+}
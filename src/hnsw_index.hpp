@@ -0,0 +1,111 @@
+#ifndef HNSW_INDEX_HPP_
+#define HNSW_INDEX_HPP_
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+#include "descriptor_matrix.hpp"
+#include "match_sink.hpp"
+
+struct HnswOptions {
+  // Neighbours of each descriptor in the upper levels, and twice as many in
+  // the bottom level.
+  int max_neighbors;
+  // Candidates explored when adding a descriptor. More give a better graph.
+  int construction_ef;
+  // Candidates explored by a search, at least the number of neighbours
+  // asked for. More give higher recall.
+  int search_ef;
+  // The level of each descriptor is drawn from its own stream.
+  uint32_t seed;
+
+  HnswOptions();
+};
+
+// Approximate nearest-neighbour search over a growing set of descriptors by
+// a hierarchical navigable small world graph (Malkov and Yashunin).
+//
+// Every descriptor is a vertex of the bottom level and, with geometrically
+// decreasing probability, of the sparser levels above it. A search descends
+// greedily from the top level and then explores the search_ef best
+// candidates of the bottom level. Unlike a FLANN index, descriptors can be
+// added at any time without rebuilding, and recall stays high on SIFT at
+// large speed-ups.
+//
+// Descriptors are stored as floats and numbered in the order they were
+// added. Distances are Euclidean. Adding must be serial, whereas searches
+// may run in parallel with each other.
+class HnswIndex {
+  public:
+    HnswIndex();
+    HnswIndex(int dimension, const HnswOptions& options);
+
+    int size() const;
+    int dimension() const;
+    const HnswOptions& options() const;
+    void setSearchEf(int ef);
+
+    // Appends every row, which are numbered from size().
+    void add(const DescriptorMatrix& descriptors);
+    void add(const float* descriptor);
+
+    // Finds the k nearest descriptors to a query, sorted by distance.
+    void search(const float* query,
+                int k,
+                std::vector<std::pair<float, int> >& nearest) const;
+    // Same as above for every row of float queries.
+    void knnMatch(const cv::Mat& query, MatchSink& matches, int k) const;
+
+    // Writes the descriptors and the graph. Values are in the byte order of
+    // the machine which wrote them.
+    bool save(const std::string& filename) const;
+    // Returns false if the file could not be read or is malformed.
+    bool load(const std::string& filename);
+
+  private:
+    typedef std::pair<float, int> Candidate;
+
+    const float* descriptor(int i) const;
+    float squaredDistance(const float* x, int i) const;
+
+    int capacity(int level) const;
+    // The first element is the number of neighbours, which follow.
+    int* links(int i, int level);
+    const int* links(int i, int level) const;
+
+    // Returns the vertex at a level nearest to x, descending greedily from
+    // the entry.
+    int searchGreedy(const float* x, int entry, int level) const;
+    // Finds the ef nearest vertices of a level from the entries, as pairs of
+    // squared distance and vertex, nearest first.
+    void searchLevel(const float* x,
+                     const std::vector<Candidate>& entries,
+                     int ef,
+                     int level,
+                     std::vector<Candidate>& nearest) const;
+    // Keeps up to n of the candidates, nearest first, skipping those which
+    // are closer to a kept candidate than to x, so that the neighbours of a
+    // vertex spread in every direction.
+    void selectNeighbors(std::vector<Candidate>& candidates, int n) const;
+    // Adds j to the neighbours of i, pruning them if there are too many.
+    void connect(int i, int j, int level);
+
+    int dimension_;
+    HnswOptions options_;
+    // One row per descriptor.
+    std::vector<float> descriptors_;
+    std::vector<int32_t> levels_;
+    // capacity(0) + 1 per descriptor.
+    std::vector<int32_t> bottom_links_;
+    // The upper levels of descriptor i are from upper_offsets_[i], with
+    // capacity(1) + 1 for each level above the bottom.
+    std::vector<int32_t> upper_links_;
+    std::vector<uint64_t> upper_offsets_;
+    // Vertex of the top level, or -1 if empty.
+    int entry_;
+    int max_level_;
+};
+
+#endif
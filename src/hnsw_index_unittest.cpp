@@ -0,0 +1,264 @@
+#include "hnsw_index.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+#include <opencv2/core/core.hpp>
+#include "gtest/gtest.h"
+
+namespace {
+
+const int NUM_DESCRIPTORS = 2000;
+const int NUM_QUERIES = 100;
+const int DIMENSION = 16;
+const int K = 10;
+
+typedef std::pair<float, int> Neighbor;
+
+void randomDescriptors(int seed, int n, DescriptorMatrix& descriptors) {
+  descriptors.create(n, DIMENSION, CV_32F);
+  cv::RNG rng(seed);
+  rng.fill(descriptors.mat(), cv::RNG::UNIFORM, 0., 1.);
+}
+
+HnswOptions testOptions() {
+  HnswOptions options;
+  options.max_neighbors = 8;
+  options.construction_ef = 64;
+  options.search_ef = 64;
+  options.seed = 3;
+  return options;
+}
+
+// The k nearest descriptors by brute force, nearest first.
+void bruteForce(const DescriptorMatrix& descriptors,
+                const float* query,
+                int k,
+                std::vector<Neighbor>& nearest) {
+  nearest.clear();
+  for (int i = 0; i < descriptors.rows(); i += 1) {
+    const float* x = descriptors.row<float>(i);
+    float distance = 0;
+    for (int d = 0; d < DIMENSION; d += 1) {
+      distance += (x[d] - query[d]) * (x[d] - query[d]);
+    }
+    nearest.push_back(Neighbor(std::sqrt(distance), i));
+  }
+  k = std::min(k, int(nearest.size()));
+  std::partial_sort(nearest.begin(), nearest.begin() + k, nearest.end());
+  nearest.resize(k);
+}
+
+// Expects every query to find the same neighbours in both indices.
+void expectSameResults(const HnswIndex& expected,
+                       const HnswIndex& actual,
+                       const DescriptorMatrix& queries) {
+  std::vector<Neighbor> a;
+  std::vector<Neighbor> b;
+  for (int i = 0; i < queries.rows(); i += 1) {
+    expected.search(queries.row<float>(i), K, a);
+    actual.search(queries.row<float>(i), K, b);
+    EXPECT_TRUE(a == b) << "Query " << i;
+  }
+}
+
+// Index file in a fresh temporary directory, removed with the fixture.
+class HnswIndexTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      char directory[] = "/tmp/hnsw-index-XXXXXX";
+      ASSERT_TRUE(mkdtemp(directory) != NULL);
+      directory_ = directory;
+      index_file_ = directory_ + "/index.hnsw";
+    }
+
+    virtual void TearDown() {
+      std::remove(index_file_.c_str());
+      rmdir(directory_.c_str());
+    }
+
+    std::string directory_;
+    std::string index_file_;
+};
+
+}
+
+TEST(HnswIndex, EmptyIndexFindsNothing) {
+  HnswIndex index(DIMENSION, testOptions());
+  float query[DIMENSION] = { 0 };
+  std::vector<Neighbor> nearest(1);
+  index.search(query, K, nearest);
+  EXPECT_TRUE(nearest.empty());
+  EXPECT_EQ(0, index.size());
+}
+
+TEST(HnswIndex, FindsEveryDescriptorOfSmallIndex) {
+  DescriptorMatrix descriptors;
+  randomDescriptors(1, 5, descriptors);
+  HnswIndex index(DIMENSION, testOptions());
+  index.add(descriptors);
+
+  std::vector<Neighbor> nearest;
+  std::vector<Neighbor> expected;
+  index.search(descriptors.row<float>(2), K, nearest);
+  bruteForce(descriptors, descriptors.row<float>(2), K, expected);
+  ASSERT_EQ(5u, nearest.size());
+  for (int k = 0; k < 5; k += 1) {
+    EXPECT_EQ(expected[k].second, nearest[k].second);
+    EXPECT_FLOAT_EQ(expected[k].first, nearest[k].first);
+  }
+}
+
+TEST(HnswIndex, RecallsMostNearestNeighbors) {
+  DescriptorMatrix descriptors;
+  randomDescriptors(1, NUM_DESCRIPTORS, descriptors);
+  DescriptorMatrix queries;
+  randomDescriptors(2, NUM_QUERIES, queries);
+
+  HnswIndex index(DIMENSION, testOptions());
+  index.add(descriptors);
+  ASSERT_EQ(NUM_DESCRIPTORS, index.size());
+
+  int num_found = 0;
+  std::vector<Neighbor> nearest;
+  std::vector<Neighbor> expected;
+  for (int i = 0; i < NUM_QUERIES; i += 1) {
+    const float* query = queries.row<float>(i);
+    index.search(query, K, nearest);
+    bruteForce(descriptors, query, K, expected);
+    ASSERT_EQ(K, int(nearest.size()));
+
+    for (int k = 0; k < K; k += 1) {
+      // Sorted by distance.
+      if (k > 0) {
+        EXPECT_LE(nearest[k - 1].first, nearest[k].first);
+      }
+      for (int j = 0; j < int(expected.size()); j += 1) {
+        if (expected[j].second == nearest[k].second) {
+          num_found += 1;
+        }
+      }
+    }
+  }
+
+  // Recall at K against brute force.
+  double recall = double(num_found) / (NUM_QUERIES * K);
+  EXPECT_GT(recall, 0.9);
+}
+
+TEST(HnswIndex, SearchingEveryCandidateIsExact) {
+  DescriptorMatrix descriptors;
+  randomDescriptors(1, NUM_DESCRIPTORS, descriptors);
+  DescriptorMatrix queries;
+  randomDescriptors(2, NUM_QUERIES, queries);
+  HnswIndex index(DIMENSION, testOptions());
+  index.add(descriptors);
+
+  // With every descriptor a candidate, the search is exact.
+  index.setSearchEf(NUM_DESCRIPTORS);
+  std::vector<Neighbor> nearest;
+  std::vector<Neighbor> expected;
+  for (int i = 0; i < NUM_QUERIES; i += 1) {
+    index.search(queries.row<float>(i), K, nearest);
+    bruteForce(descriptors, queries.row<float>(i), K, expected);
+    ASSERT_EQ(expected.size(), nearest.size());
+    for (int k = 0; k < K; k += 1) {
+      EXPECT_EQ(expected[k].second, nearest[k].second);
+    }
+  }
+}
+
+TEST(HnswIndex, GrowsLikeIndexBuiltAtOnce) {
+  DescriptorMatrix descriptors;
+  randomDescriptors(1, NUM_DESCRIPTORS, descriptors);
+  DescriptorMatrix queries;
+  randomDescriptors(2, NUM_QUERIES, queries);
+
+  HnswIndex batch(DIMENSION, testOptions());
+  batch.add(descriptors);
+
+  // One at a time, in several calls.
+  HnswIndex incremental(DIMENSION, testOptions());
+  for (int i = 0; i < NUM_DESCRIPTORS; i += 1) {
+    incremental.add(descriptors.row<float>(i));
+  }
+
+  ASSERT_EQ(batch.size(), incremental.size());
+  expectSameResults(batch, incremental, queries);
+}
+
+TEST_F(HnswIndexTest, SavesAndLoads) {
+  DescriptorMatrix descriptors;
+  randomDescriptors(1, NUM_DESCRIPTORS, descriptors);
+  DescriptorMatrix queries;
+  randomDescriptors(2, NUM_QUERIES, queries);
+
+  HnswIndex index(DIMENSION, testOptions());
+  index.add(descriptors);
+  ASSERT_TRUE(index.save(index_file_));
+
+  HnswIndex loaded;
+  ASSERT_TRUE(loaded.load(index_file_));
+  EXPECT_EQ(index.size(), loaded.size());
+  EXPECT_EQ(index.dimension(), loaded.dimension());
+  EXPECT_EQ(index.options().max_neighbors, loaded.options().max_neighbors);
+  EXPECT_EQ(index.options().construction_ef,
+      loaded.options().construction_ef);
+  EXPECT_EQ(index.options().search_ef, loaded.options().search_ef);
+  EXPECT_EQ(index.options().seed, loaded.options().seed);
+  expectSameResults(index, loaded, queries);
+}
+
+TEST_F(HnswIndexTest, GrowsAcrossSaveAndLoad) {
+  DescriptorMatrix descriptors;
+  randomDescriptors(1, NUM_DESCRIPTORS, descriptors);
+  DescriptorMatrix queries;
+  randomDescriptors(2, NUM_QUERIES, queries);
+
+  HnswIndex batch(DIMENSION, testOptions());
+  batch.add(descriptors);
+
+  // Half in one run and half in the next, as add-to-hnsw-index does.
+  int half = NUM_DESCRIPTORS / 2;
+  HnswIndex first(DIMENSION, testOptions());
+  for (int i = 0; i < half; i += 1) {
+    first.add(descriptors.row<float>(i));
+  }
+  ASSERT_TRUE(first.save(index_file_));
+  HnswIndex second;
+  ASSERT_TRUE(second.load(index_file_));
+  for (int i = half; i < NUM_DESCRIPTORS; i += 1) {
+    second.add(descriptors.row<float>(i));
+  }
+
+  ASSERT_EQ(batch.size(), second.size());
+  expectSameResults(batch, second, queries);
+}
+
+TEST_F(HnswIndexTest, RejectsTruncatedFile) {
+  DescriptorMatrix descriptors;
+  randomDescriptors(1, 100, descriptors);
+  HnswIndex index(DIMENSION, testOptions());
+  index.add(descriptors);
+  ASSERT_TRUE(index.save(index_file_));
+
+  // Cut off in the middle of the graph.
+  std::string contents;
+  {
+    std::ifstream file(index_file_.c_str(), std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(file),
+        std::istreambuf_iterator<char>());
+  }
+  {
+    std::ofstream file(index_file_.c_str(), std::ios::binary);
+    file.write(contents.data(), contents.size() / 2);
+  }
+
+  HnswIndex loaded;
+  EXPECT_FALSE(loaded.load(index_file_));
+  EXPECT_EQ(0, loaded.size());
+}
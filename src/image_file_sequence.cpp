@@ -1,24 +1,21 @@
 #include "image_file_sequence.hpp"
+#include <boost/format.hpp>
 #include <glog/logging.h>
 #include "read_image.hpp"
 #include "util.hpp"
 
-ImageFileSequence::ImageFileSequence(const boost::format& format,
+ImageFileSequence::ImageFileSequence(const std::string& format,
                                      int length,
                                      bool gray)
     : format_(format), length_(length), gray_(gray) {}
 
-ImageFileSequence::ImageFileSequence(const boost::format& format, bool gray)
+ImageFileSequence::ImageFileSequence(const std::string& format, bool gray)
     : format_(format), length_(0), gray_(gray) {}
 
 ImageFileSequence::~ImageFileSequence() {}
 
 int ImageFileSequence::countFrames() {
-  length_ = 0;
-
-  while (fileExists(makeFilename(length_))) {
-    length_ += 1;
-  }
+  length_ = countFrameFiles(format_);
   LOG(INFO) << "Found " << length_ << " frames";
 
   return length_;
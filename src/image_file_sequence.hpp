@@ -2,20 +2,22 @@
 #define IMAGE_FILE_SEQUENCE_HPP_
 
 #include "video.hpp"
-#include <boost/format.hpp>
+#include <string>
 
 // Describes a video saved as a sequence of frame images.
 class ImageFileSequence : public Video {
   public:
-    ImageFileSequence(const boost::format& format, int length, bool gray);
+    // The format takes the frame number, starting from 1.
+    ImageFileSequence(const std::string& format, int length, bool gray);
 
     // This constructor sets the number of frames to zero.
     // Follow it with a call to countFrames().
-    ImageFileSequence(const boost::format& format, bool gray);
+    ImageFileSequence(const std::string& format, bool gray);
 
     ~ImageFileSequence();
 
     // Counts the number of frames based on the existence of image files.
+    // See countFrameFiles().
     int countFrames();
 
     // Accesses the image from time t.
@@ -28,7 +30,7 @@ class ImageFileSequence : public Video {
     // Returns the filename for a frame.
     std::string makeFilename(int t) const;
 
-    boost::format format_;
+    std::string format_;
     int length_;
     bool gray_;
 };
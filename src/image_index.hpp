@@ -1,3 +1,6 @@
+#ifndef IMAGE_INDEX_HPP_
+#define IMAGE_INDEX_HPP_
+
 #include <ostream>
 
 // An image is identified by its view and time instant.
@@ -19,3 +22,5 @@ struct ImageIndex {
 };
 
 std::ostream& operator<<(std::ostream& stream, const ImageIndex& frame);
+
+#endif
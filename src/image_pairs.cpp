@@ -0,0 +1,391 @@
+#include "image_pairs.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <boost/format.hpp>
+#include <glog/logging.h>
+#include "descriptor_matrix.hpp"
+#include "feature_files.hpp"
+
+namespace {
+
+// False for infinity and NaN, which undistortion gives outside the
+// undistortable region.
+bool isFinite(double x) {
+  return x - x == 0;
+}
+
+int imageNumber(const ImageIndex& image, int num_frames) {
+  return image.view * num_frames + image.time;
+}
+
+bool withinTime(const ImagePair& pair, const PairPlannerOptions& options) {
+  int limit = (pair.first.view == pair.second.view) ?
+      options.max_time_offset : options.max_time_offset_between_views;
+  return limit < 0 || std::abs(pair.first.time - pair.second.time) <= limit;
+}
+
+// Frames are numbered from one in filenames.
+std::string makeDescriptorsFilename(const std::string& format,
+                                    const std::string& view,
+                                    int time) {
+  return boost::str(boost::format(format) % view % (time + 1));
+}
+
+// Finds the images which score highest against each image.
+// For use with ThreadPool::parallelFor().
+class ScoreImageFunction {
+  public:
+    ScoreImageFunction(const VocabularyTree& tree,
+                       const std::string& format,
+                       const std::vector<std::string>& views,
+                       int num_frames,
+                       int max_num_similar,
+                       std::vector<std::vector<int> >& similar,
+                       std::vector<char>& loaded)
+        : tree_(&tree),
+          format_(&format),
+          views_(&views),
+          num_frames_(num_frames),
+          max_num_similar_(max_num_similar),
+          similar_(&similar),
+          loaded_(&loaded) {}
+
+    void operator()(int i) const {
+      std::string file = makeDescriptorsFilename(*format_,
+          (*views_)[i / num_frames_], i % num_frames_);
+      DescriptorMatrix descriptors;
+      if (!loadDescriptorMatrix(file, descriptors)) {
+        LOG(WARNING) << "Could not load descriptors \"" << file << "\"";
+        (*loaded_)[i] = false;
+        return;
+      }
+      if (!descriptors.empty() &&
+          descriptors.cols() != tree_->centers().cols) {
+        LOG(WARNING) << "Descriptors \"" << file << "\" differ in size "
+            "from the vocabulary tree";
+        (*loaded_)[i] = false;
+        return;
+      }
+
+      int num_images = views_->size() * num_frames_;
+      findSimilarImages(*tree_, descriptors.mat(), i, num_images,
+          max_num_similar_, (*similar_)[i]);
+    }
+
+  private:
+    const VocabularyTree* tree_;
+    const std::string* format_;
+    const std::vector<std::string>* views_;
+    int num_frames_;
+    int max_num_similar_;
+    std::vector<std::vector<int> >* similar_;
+    std::vector<char>* loaded_;
+};
+
+// Pairs (i, j), i < j, in which either image is similar to the other.
+void findSimilarPairs(const std::vector<std::vector<int> >& similar,
+                      std::set<std::pair<int, int> >& pairs) {
+  for (int i = 0; i < int(similar.size()); i += 1) {
+    std::vector<int>::const_iterator j;
+    for (j = similar[i].begin(); j != similar[i].end(); ++j) {
+      pairs.insert(std::make_pair(std::min(i, *j), std::max(i, *j)));
+    }
+  }
+}
+
+bool overlap(const Camera& camera1,
+             const Camera& camera2,
+             const PairPlannerOptions& options) {
+  return frustumOverlap(camera1, camera2, options.near, options.far,
+        options.grid) >= options.min_overlap ||
+      frustumOverlap(camera2, camera1, options.near, options.far,
+        options.grid) >= options.min_overlap;
+}
+
+}
+
+void appendExhaustiveImagePairs(int num_views,
+                                int num_frames,
+                                std::vector<ImagePair>& pairs) {
+  for (int v = 0; v < num_views; v += 1) {
+    for (int t = 0; t < num_frames; t += 1) {
+      for (int w = v; w < num_views; w += 1) {
+        int first = (v == w) ? t + 1 : 0;
+
+        for (int u = first; u < num_frames; u += 1) {
+          pairs.push_back(ImagePair(ImageIndex(v, t), ImageIndex(w, u)));
+        }
+      }
+    }
+  }
+}
+
+bool loadImagePairList(const std::string& filename,
+                       const std::vector<std::string>& views,
+                       int num_frames,
+                       std::vector<ImagePair>& pairs) {
+  std::ifstream file(filename.c_str());
+  if (!file) {
+    LOG(WARNING) << "Could not open pair list \"" << filename << "\"";
+    return false;
+  }
+
+  std::map<std::string, int> numbers;
+  for (int v = 0; v < int(views.size()); v += 1) {
+    numbers[views[v]] = v;
+  }
+
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    line_number += 1;
+    if (line.empty()) {
+      continue;
+    }
+
+    std::istringstream stream(line);
+    std::string view1;
+    std::string view2;
+    int time1;
+    int time2;
+    std::string rest;
+    if (!(stream >> view1 >> time1 >> view2 >> time2) || stream >> rest) {
+      LOG(WARNING) << filename << ":" << line_number <<
+          ": Expected \"view1 time1 view2 time2\"";
+      return false;
+    }
+
+    std::map<std::string, int>::const_iterator v1 = numbers.find(view1);
+    std::map<std::string, int>::const_iterator v2 = numbers.find(view2);
+    if (v1 == numbers.end() || v2 == numbers.end()) {
+      LOG(WARNING) << filename << ":" << line_number << ": Unknown view";
+      return false;
+    }
+    if (time1 < 1 || time1 > num_frames || time2 < 1 || time2 > num_frames) {
+      LOG(WARNING) << filename << ":" << line_number <<
+          ": Frame out of range";
+      return false;
+    }
+
+    pairs.push_back(ImagePair(ImageIndex(v1->second, time1 - 1),
+          ImageIndex(v2->second, time2 - 1)));
+  }
+
+  return true;
+}
+
+bool saveImagePairList(const std::string& filename,
+                       const std::vector<std::string>& views,
+                       const std::vector<ImagePair>& pairs) {
+  std::ofstream file(filename.c_str());
+  std::vector<ImagePair>::const_iterator pair;
+  for (pair = pairs.begin(); pair != pairs.end(); ++pair) {
+    file << views[pair->first.view] << " " << pair->first.time + 1 << " " <<
+        views[pair->second.view] << " " << pair->second.time + 1 << std::endl;
+  }
+  return file.good();
+}
+
+double frustumOverlap(const Camera& camera1,
+                      const Camera& camera2,
+                      double near,
+                      double far,
+                      int grid) {
+  CHECK(grid > 0);
+  CHECK(0 < near && near < far);
+
+  const CameraProperties& intrinsics1 = camera1.intrinsics();
+  const CameraPose& extrinsics1 = camera1.extrinsics();
+  cv::Size size1 = intrinsics1.image_size;
+
+  std::vector<cv::Point2d> pixels;
+  for (int i = 0; i < grid; i += 1) {
+    for (int j = 0; j < grid; j += 1) {
+      pixels.push_back(cv::Point2d((j + 0.5) * size1.width / grid,
+            (i + 0.5) * size1.height / grid));
+    }
+  }
+  std::vector<cv::Point2d> rays;
+  intrinsics1.calibrateAndUndistort(pixels, rays);
+
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> z;
+  std::vector<cv::Point2d>::const_iterator ray;
+  for (ray = rays.begin(); ray != rays.end(); ++ray) {
+    if (!isFinite(ray->x) || !isFinite(ray->y)) {
+      continue;
+    }
+    cv::Point3d direction = extrinsics1.directionOfRayThrough(*ray);
+    direction *= 1. / cv::norm(direction);
+
+    for (int k = 0; k < grid; k += 1) {
+      double inverse = 1. / near + (k + 0.5) / grid * (1. / far - 1. / near);
+      cv::Point3d point = extrinsics1.center + direction * (1. / inverse);
+      x.push_back(point.x);
+      y.push_back(point.y);
+      z.push_back(point.z);
+    }
+  }
+
+  int n = x.size();
+  if (n == 0) {
+    return 0;
+  }
+
+  std::vector<double> u(n);
+  std::vector<double> v(n);
+  camera2.projectBatch(&x.front(), &y.front(), &z.front(), n, &u.front(),
+      &v.front());
+
+  // Points behind the second camera project too, so check depth as well.
+  const CameraPose& extrinsics2 = camera2.extrinsics();
+  cv::Size size2 = camera2.intrinsics().image_size;
+  int num_seen = 0;
+  for (int i = 0; i < n; i += 1) {
+    cv::Point3d point(x[i], y[i], z[i]);
+    cv::Vec3d local = extrinsics2.rotation *
+        cv::Vec3d(point - extrinsics2.center);
+    if (local[2] < 0 && 0 <= u[i] && u[i] < size2.width && 0 <= v[i] &&
+        v[i] < size2.height) {
+      num_seen += 1;
+    }
+  }
+
+  return double(num_seen) / n;
+}
+
+PairPlannerOptions::PairPlannerOptions()
+    : max_time_offset(-1),
+      max_time_offset_between_views(-1),
+      min_overlap(0),
+      near(1),
+      far(100),
+      grid(8) {}
+
+void planImagePairs(const std::vector<Camera>& cameras,
+                    int num_views,
+                    int num_frames,
+                    const PairPlannerOptions& options,
+                    std::vector<ImagePair>& pairs) {
+  bool use_cameras = (options.min_overlap > 0);
+  bool moving = (int(cameras.size()) != num_views);
+  if (use_cameras) {
+    CHECK(int(cameras.size()) == num_views ||
+        int(cameras.size()) == num_views * num_frames) <<
+        "Need one camera per view or per image";
+  }
+
+  // Static cameras overlap the same at every time, so decide once per pair
+  // of views.
+  std::vector<bool> views_overlap;
+  if (use_cameras && !moving) {
+    views_overlap.assign(num_views * num_views, false);
+    for (int v = 0; v < num_views; v += 1) {
+      for (int w = v; w < num_views; w += 1) {
+        bool b = (v == w) || overlap(cameras[v], cameras[w], options);
+        views_overlap[v * num_views + w] = b;
+        views_overlap[w * num_views + v] = b;
+      }
+    }
+  }
+
+  std::vector<ImagePair> kept;
+  std::vector<ImagePair>::const_iterator pair;
+  for (pair = pairs.begin(); pair != pairs.end(); ++pair) {
+    if (!withinTime(*pair, options)) {
+      continue;
+    }
+
+    if (use_cameras) {
+      bool b;
+      if (moving) {
+        b = overlap(cameras[imageNumber(pair->first, num_frames)],
+            cameras[imageNumber(pair->second, num_frames)], options);
+      } else {
+        b = views_overlap[pair->first.view * num_views + pair->second.view];
+      }
+      if (!b) {
+        continue;
+      }
+    }
+
+    kept.push_back(*pair);
+  }
+  pairs.swap(kept);
+}
+
+bool findSimilarImages(const VocabularyTree& tree,
+                       const std::string& descriptors_format,
+                       const std::vector<std::string>& views,
+                       int num_frames,
+                       int max_num_similar,
+                       ThreadPool& pool,
+                       std::vector<std::vector<int> >& similar) {
+  int num_images = views.size() * num_frames;
+  similar.assign(num_images, std::vector<int>());
+  std::vector<char> loaded(num_images, true);
+  pool.parallelFor(0, num_images,
+      ScoreImageFunction(tree, descriptors_format, views, num_frames,
+        max_num_similar, similar, loaded));
+  return std::find(loaded.begin(), loaded.end(), false) == loaded.end();
+}
+
+void findSimilarImages(const VocabularyTree& tree,
+                       const cv::Mat& descriptors,
+                       int image,
+                       int num_images,
+                       int max_num_similar,
+                       std::vector<int>& similar) {
+  // Ask for one more since the image itself usually scores highest.
+  std::vector<ImageScore> scores;
+  tree.scoreImages(descriptors, max_num_similar + 1, scores);
+
+  similar.clear();
+  std::vector<ImageScore>::const_iterator score;
+  for (score = scores.begin(); score != scores.end(); ++score) {
+    if (int(similar.size()) == max_num_similar) {
+      break;
+    }
+    if (score->image != image && score->image < num_images) {
+      similar.push_back(score->image);
+    }
+  }
+}
+
+void appendSimilarImagePairs(const std::vector<std::vector<int> >& similar,
+                             int num_frames,
+                             std::vector<ImagePair>& pairs) {
+  std::set<std::pair<int, int> > set;
+  findSimilarPairs(similar, set);
+
+  std::set<std::pair<int, int> >::const_iterator pair;
+  for (pair = set.begin(); pair != set.end(); ++pair) {
+    pairs.push_back(ImagePair(
+          ImageIndex(pair->first / num_frames, pair->first % num_frames),
+          ImageIndex(pair->second / num_frames, pair->second % num_frames)));
+  }
+}
+
+void keepSimilarImagePairs(const std::vector<std::vector<int> >& similar,
+                           int num_frames,
+                           std::vector<ImagePair>& pairs) {
+  std::set<std::pair<int, int> > set;
+  findSimilarPairs(similar, set);
+
+  std::vector<ImagePair> kept;
+  std::vector<ImagePair>::const_iterator pair;
+  for (pair = pairs.begin(); pair != pairs.end(); ++pair) {
+    int i = imageNumber(pair->first, num_frames);
+    int j = imageNumber(pair->second, num_frames);
+    if (set.count(std::make_pair(std::min(i, j), std::max(i, j))) > 0) {
+      kept.push_back(*pair);
+    }
+  }
+  pairs.swap(kept);
+}
@@ -0,0 +1,104 @@
+#ifndef IMAGE_PAIRS_HPP_
+#define IMAGE_PAIRS_HPP_
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "camera.hpp"
+#include "image_index.hpp"
+#include "vocabulary_tree.hpp"
+#include "util/thread-pool.hpp"
+
+// Lists of the pairs of images to match, and a planner which removes the
+// pairs which cannot have matches from the cameras, times and appearance of
+// the images.
+
+typedef std::pair<ImageIndex, ImageIndex> ImagePair;
+
+// Same pairs as scripts/generate-unordered-image-pairs.sh.
+// Within a view, each frame is matched to the later frames.
+// Between views, each frame is matched to every frame of the later view.
+void appendExhaustiveImagePairs(int num_views,
+                                int num_frames,
+                                std::vector<ImagePair>& pairs);
+
+// Reads one pair per line, "view1 time1 view2 time2", with view names and
+// frames numbered from one, as written by
+// scripts/generate-unordered-image-pairs.sh. Returns false if a line is
+// malformed or names an image outside the views and frames.
+bool loadImagePairList(const std::string& filename,
+                       const std::vector<std::string>& views,
+                       int num_frames,
+                       std::vector<ImagePair>& pairs);
+bool saveImagePairList(const std::string& filename,
+                       const std::vector<std::string>& views,
+                       const std::vector<ImagePair>& pairs);
+
+// Fraction of the points seen by the first camera between distances near
+// and far from its center which the second camera also sees. Points are
+// sampled on a grid x grid lattice of pixels and at grid distances spaced
+// evenly in inverse distance.
+double frustumOverlap(const Camera& camera1,
+                      const Camera& camera2,
+                      double near,
+                      double far,
+                      int grid);
+
+struct PairPlannerOptions {
+  // Largest difference in time between images of the same view and of
+  // different views. Negative for no limit.
+  int max_time_offset;
+  int max_time_offset_between_views;
+  // Smallest frustum overlap, in either direction, of a pair. Zero or less
+  // to keep pairs regardless of their cameras.
+  double min_overlap;
+  double near;
+  double far;
+  int grid;
+
+  PairPlannerOptions();
+};
+
+// Removes the pairs which are too far apart in time or whose cameras do
+// not look at the same part of the scene. There is either one camera per
+// view, or one per image in view-major order for cameras which move. The
+// remaining pairs keep their order.
+void planImagePairs(const std::vector<Camera>& cameras,
+                    int num_views,
+                    int num_frames,
+                    const PairPlannerOptions& options,
+                    std::vector<ImagePair>& pairs);
+
+// Finds the images which score highest against each image according to
+// the tree, at most max_num_similar each. The descriptors format takes view
+// name and frame, and images are in view-major order. Returns false if any
+// descriptors could not be loaded.
+bool findSimilarImages(const VocabularyTree& tree,
+                       const std::string& descriptors_format,
+                       const std::vector<std::string>& views,
+                       int num_frames,
+                       int max_num_similar,
+                       ThreadPool& pool,
+                       std::vector<std::vector<int> >& similar);
+
+// Finds the images which score highest against the descriptors of one
+// image, other than the image itself, at most max_num_similar. Images
+// beyond num_images, e.g. of a larger tree, are left out.
+void findSimilarImages(const VocabularyTree& tree,
+                       const cv::Mat& descriptors,
+                       int image,
+                       int num_images,
+                       int max_num_similar,
+                       std::vector<int>& similar);
+
+// Appends the pairs in which either image is similar to the other, in the
+// order of appendExhaustiveImagePairs().
+void appendSimilarImagePairs(const std::vector<std::vector<int> >& similar,
+                             int num_frames,
+                             std::vector<ImagePair>& pairs);
+// Keeps the pairs in which either image is similar to the other.
+void keepSimilarImagePairs(const std::vector<std::vector<int> >& similar,
+                           int num_frames,
+                           std::vector<ImagePair>& pairs);
+
+#endif
@@ -0,0 +1,182 @@
+#include "image_pairs.hpp"
+#include <cmath>
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace {
+
+// Pinhole camera at the given center, turned by the given angle about the
+// vertical axis. Cameras look along -z.
+Camera makeCamera(const cv::Point3d& center, double angle) {
+  CameraProperties intrinsics;
+  intrinsics.image_size = cv::Size(64, 48);
+  intrinsics.focal_x = 50;
+  intrinsics.focal_y = 50;
+  intrinsics.principal_point = cv::Point2d(32, 24);
+  // Almost no distortion. Zero is not defined.
+  intrinsics.distort_w = 1e-3;
+
+  CameraPose extrinsics;
+  double c = std::cos(angle);
+  double s = std::sin(angle);
+  extrinsics.rotation = cv::Matx33d(c, 0, -s, 0, 1, 0, s, 0, c);
+  extrinsics.center = center;
+
+  return Camera(intrinsics, extrinsics);
+}
+
+std::vector<ImagePair> exhaustivePairs(int num_views, int num_frames) {
+  std::vector<ImagePair> pairs;
+  appendExhaustiveImagePairs(num_views, num_frames, pairs);
+  return pairs;
+}
+
+bool contains(const std::vector<ImagePair>& pairs,
+              const ImagePair& pair) {
+  for (int i = 0; i < int(pairs.size()); i += 1) {
+    if (pairs[i].first == pair.first && pairs[i].second == pair.second) {
+      return true;
+    }
+  }
+  return false;
+}
+
+ImagePair makePair(int view1, int time1, int view2, int time2) {
+  return ImagePair(ImageIndex(view1, time1), ImageIndex(view2, time2));
+}
+
+}
+
+TEST(FrustumOverlap, SameCameraSeesEverything) {
+  Camera camera = makeCamera(cv::Point3d(0, 0, 0), 0);
+  EXPECT_NEAR(1., frustumOverlap(camera, camera, 1, 100, 8), 1e-9);
+}
+
+TEST(FrustumOverlap, OppositeCameraSeesNothing) {
+  Camera camera1 = makeCamera(cv::Point3d(0, 0, 0), 0);
+  Camera camera2 = makeCamera(cv::Point3d(0, 0, 0), M_PI);
+  // Points behind the second camera also project into its image.
+  EXPECT_EQ(0., frustumOverlap(camera1, camera2, 1, 100, 8));
+}
+
+TEST(FrustumOverlap, DistantCameraSeesNothing) {
+  Camera camera1 = makeCamera(cv::Point3d(0, 0, 0), 0);
+  Camera camera2 = makeCamera(cv::Point3d(1000, 0, 0), 0);
+  EXPECT_EQ(0., frustumOverlap(camera1, camera2, 1, 100, 8));
+}
+
+TEST(FrustumOverlap, TurnedCameraSeesPart) {
+  // Half the field of view is about 33 degrees.
+  Camera camera1 = makeCamera(cv::Point3d(0, 0, 0), 0);
+  Camera camera2 = makeCamera(cv::Point3d(0, 0, 0), 0.5);
+  double overlap = frustumOverlap(camera1, camera2, 1, 100, 8);
+  EXPECT_GT(overlap, 0.1);
+  EXPECT_LT(overlap, 0.9);
+
+  // Turning further sees less.
+  Camera camera3 = makeCamera(cv::Point3d(0, 0, 0), 0.8);
+  EXPECT_LT(frustumOverlap(camera1, camera3, 1, 100, 8), overlap);
+}
+
+TEST(PlanImagePairs, KeepsEverythingByDefault) {
+  std::vector<ImagePair> pairs = exhaustivePairs(2, 4);
+  std::vector<ImagePair> planned = pairs;
+  planImagePairs(std::vector<Camera>(), 2, 4, PairPlannerOptions(), planned);
+  ASSERT_EQ(pairs.size(), planned.size());
+}
+
+TEST(PlanImagePairs, LimitsTimeOffset) {
+  PairPlannerOptions options;
+  options.max_time_offset = 1;
+  options.max_time_offset_between_views = 0;
+
+  std::vector<ImagePair> pairs = exhaustivePairs(2, 4);
+  planImagePairs(std::vector<Camera>(), 2, 4, options, pairs);
+
+  // Consecutive frames within each view, simultaneous frames between them.
+  ASSERT_EQ(2u * 3u + 4u, pairs.size());
+  EXPECT_TRUE(contains(pairs, makePair(0, 0, 0, 1)));
+  EXPECT_FALSE(contains(pairs, makePair(0, 0, 0, 2)));
+  EXPECT_TRUE(contains(pairs, makePair(0, 2, 1, 2)));
+  EXPECT_FALSE(contains(pairs, makePair(0, 2, 1, 3)));
+
+  // Order is kept.
+  std::vector<ImagePair> all = exhaustivePairs(2, 4);
+  int k = 0;
+  for (int i = 0; i < int(all.size()) && k < int(pairs.size()); i += 1) {
+    if (all[i].first == pairs[k].first && all[i].second == pairs[k].second) {
+      k += 1;
+    }
+  }
+  EXPECT_EQ(int(pairs.size()), k);
+}
+
+TEST(PlanImagePairs, RemovesViewsWhichDoNotOverlap) {
+  std::vector<Camera> cameras;
+  cameras.push_back(makeCamera(cv::Point3d(0, 0, 0), 0));
+  cameras.push_back(makeCamera(cv::Point3d(0.2, 0, 0), 0));
+  cameras.push_back(makeCamera(cv::Point3d(0, 0, 0), M_PI));
+
+  PairPlannerOptions options;
+  options.min_overlap = 0.5;
+
+  std::vector<ImagePair> pairs = exhaustivePairs(3, 2);
+  planImagePairs(cameras, 3, 2, options, pairs);
+
+  for (int i = 0; i < int(pairs.size()); i += 1) {
+    // The third view looks the other way.
+    bool third = (pairs[i].first.view == 2 || pairs[i].second.view == 2);
+    bool same = (pairs[i].first.view == pairs[i].second.view);
+    EXPECT_TRUE(!third || same);
+  }
+  EXPECT_TRUE(contains(pairs, makePair(0, 0, 1, 1)));
+  EXPECT_TRUE(contains(pairs, makePair(2, 0, 2, 1)));
+}
+
+TEST(PlanImagePairs, UsesCameraOfEachImageWhenMoving) {
+  // View 0 is still. View 1 turns around after the first frame.
+  std::vector<Camera> cameras;
+  cameras.push_back(makeCamera(cv::Point3d(0, 0, 0), 0));
+  cameras.push_back(makeCamera(cv::Point3d(0, 0, 0), 0));
+  cameras.push_back(makeCamera(cv::Point3d(0.2, 0, 0), 0));
+  cameras.push_back(makeCamera(cv::Point3d(0.2, 0, 0), M_PI));
+
+  PairPlannerOptions options;
+  options.min_overlap = 0.5;
+
+  std::vector<ImagePair> pairs = exhaustivePairs(2, 2);
+  planImagePairs(cameras, 2, 2, options, pairs);
+
+  EXPECT_TRUE(contains(pairs, makePair(0, 0, 1, 0)));
+  EXPECT_TRUE(contains(pairs, makePair(0, 1, 1, 0)));
+  EXPECT_FALSE(contains(pairs, makePair(0, 0, 1, 1)));
+  EXPECT_FALSE(contains(pairs, makePair(1, 0, 1, 1)));
+}
+
+TEST(SimilarImagePairs, ListAndKeepAgree) {
+  // 2 views of 2 frames, in view-major order.
+  std::vector<std::vector<int> > similar(4);
+  similar[0].push_back(3);
+  similar[1].push_back(0);
+  similar[3].push_back(0);
+  similar[3].push_back(2);
+
+  std::vector<ImagePair> listed;
+  appendSimilarImagePairs(similar, 2, listed);
+  ASSERT_EQ(3u, listed.size());
+  // In the order of the exhaustive pairs.
+  EXPECT_TRUE(listed[0].first == ImageIndex(0, 0));
+  EXPECT_TRUE(listed[0].second == ImageIndex(0, 1));
+  EXPECT_TRUE(listed[1].first == ImageIndex(0, 0));
+  EXPECT_TRUE(listed[1].second == ImageIndex(1, 1));
+  EXPECT_TRUE(listed[2].first == ImageIndex(1, 0));
+  EXPECT_TRUE(listed[2].second == ImageIndex(1, 1));
+
+  std::vector<ImagePair> kept = exhaustivePairs(2, 2);
+  keepSimilarImagePairs(similar, 2, kept);
+  ASSERT_EQ(listed.size(), kept.size());
+  for (int i = 0; i < int(kept.size()); i += 1) {
+    EXPECT_TRUE(listed[i].first == kept[i].first);
+    EXPECT_TRUE(listed[i].second == kept[i].second);
+  }
+}
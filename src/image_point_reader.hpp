@@ -9,6 +9,8 @@ class ImagePointReader : public Reader<cv::Point_<T> > {
   public:
     ~ImagePointReader();
     bool read(const cv::FileNode& node, cv::Point_<T>& point);
+    bool fields(std::vector<std::string>& keys) const;
+    bool readFields(const FieldValues& values, cv::Point_<T>& point);
 };
 
 #include "image_point_reader.inl"
@@ -13,3 +13,17 @@ bool ImagePointReader<T>::read(const cv::FileNode& node, cv::Point_<T>& point) {
 
   return true;
 }
+
+template<class T>
+bool ImagePointReader<T>::fields(std::vector<std::string>& keys) const {
+  keys.clear();
+  keys.push_back("x");
+  keys.push_back("y");
+  return true;
+}
+
+template<class T>
+bool ImagePointReader<T>::readFields(const FieldValues& values,
+                                     cv::Point_<T>& point) {
+  return readField<T>(values, 0, point.x) && readField<T>(values, 1, point.y);
+}
@@ -0,0 +1,39 @@
+#include "image_undistorter.hpp"
+#include <vector>
+#include <opencv2/imgproc/imgproc.hpp>
+
+ImageUndistorter::ImageUndistorter(const CameraProperties& camera)
+    : map1_(), map2_() {
+  int width = camera.image_size.width;
+  int height = camera.image_size.height;
+
+  // Construct a list of every pixel in the output image.
+  std::vector<cv::Point2d> points;
+  points.reserve(width * height);
+  for (int i = 0; i < height; i += 1) {
+    for (int j = 0; j < width; j += 1) {
+      points.push_back(cv::Point2d(j, i));
+    }
+  }
+
+  // Apply forward transform to every pixel in the output image.
+  camera.calibrate(points, points);
+  camera.distortAndUncalibrate(points, points);
+
+  cv::Mat_<cv::Vec2f> map(height, width);
+  std::vector<cv::Point2d>::const_iterator point = points.begin();
+  for (int i = 0; i < height; i += 1) {
+    for (int j = 0; j < width; j += 1) {
+      map(i, j) = cv::Vec2f(point->x, point->y);
+      ++point;
+    }
+  }
+
+  cv::convertMaps(map, cv::Mat(), map1_, map2_, CV_16SC2);
+}
+
+void ImageUndistorter::undistort(const cv::Mat& image,
+                                 cv::Mat& undistorted) const {
+  // Sample input image at these locations.
+  cv::remap(image, undistorted, map1_, map2_, cv::INTER_LINEAR);
+}
@@ -0,0 +1,24 @@
+#ifndef IMAGE_UNDISTORTER_HPP_
+#define IMAGE_UNDISTORTER_HPP_
+
+#include <opencv2/core/core.hpp>
+#include "camera_properties.hpp"
+
+// Removes lens distortion from images of one camera.
+//
+// The maps from each undistorted pixel to its distorted position are
+// computed on construction, so that every image costs only cv::remap().
+class ImageUndistorter {
+  public:
+    explicit ImageUndistorter(const CameraProperties& camera);
+
+    // Output image is the size of the camera's images.
+    void undistort(const cv::Mat& image, cv::Mat& undistorted) const;
+
+  private:
+    // In the fixed-point form of cv::convertMaps(), which is faster to remap.
+    cv::Mat map1_;
+    cv::Mat map2_;
+};
+
+#endif
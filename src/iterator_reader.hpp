@@ -2,10 +2,14 @@
 #define ITERATOR_READER_HPP_
 
 #include "reader.hpp"
+#include "sequence_sink.hpp"
+#include "yaml_sequence_stream.hpp"
 #include <vector>
 #include <deque>
 
 // Where the magic happens.
+// Assigns each element to the output. Elements which own memory should be
+// read with a SequenceSink instead, which swaps them out.
 template<class T, class OutputIterator>
 bool readSequence(const cv::FileNode& node,
                   Reader<T>& reader,
@@ -24,8 +28,9 @@ class ContainerReader : public Reader<Container> {
     Reader<T>* reader_;
 };
 
+// Reads the file a few elements at a time and swaps them into the list.
 template<class T, class Container>
-bool loadList(const std::string& file, Reader<T>& reader, Container list);
+bool loadList(const std::string& file, Container& list, Reader<T>& reader);
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -52,13 +52,15 @@ template<class T, class Container>
 bool ContainerReader<T, Container>::read(const cv::FileNode& node,
                                          Container& list) {
   list.clear();
-  return readSequence(node, *reader_, std::back_inserter(list));
+  ContainerSink<T, Container> sink(list);
+  return readSequenceToSink(node, *reader_, sink);
 }
 
 template<class T, class Container>
 bool loadList(const std::string& file, Container& list, Reader<T>& reader) {
-  ContainerReader<T, Container> list_reader(reader);
-  return load(file, list, list_reader);
+  list.clear();
+  ContainerSink<T, Container> sink(list);
+  return streamSequence(file, std::vector<std::string>(), reader, sink);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,295 @@
+#include "keyframe_track_matches.hpp"
+#include <algorithm>
+#include <deque>
+#include "descriptor_index.hpp"
+#include "find_matches.hpp"
+
+bool findFrameRange(const std::vector<FeatureTrackList>& tracks,
+                    int& first_frame,
+                    int& num_frames) {
+  bool found = false;
+  int first = 0;
+  int last = 0;
+  std::vector<FeatureTrackList>::const_iterator view;
+  for (view = tracks.begin(); view != tracks.end(); ++view) {
+    FeatureTrackList::const_iterator track;
+    for (track = view->begin(); track != view->end(); ++track) {
+      if (track->empty()) {
+        continue;
+      }
+      if (!found) {
+        first = track->begin()->first;
+        last = track->rbegin()->first;
+        found = true;
+      }
+      first = std::min(first, track->begin()->first);
+      last = std::max(last, track->rbegin()->first);
+    }
+  }
+
+  first_frame = first;
+  num_frames = found ? last - first + 1 : 0;
+  return found;
+}
+
+void listObservations(const FeatureTrackList& tracks,
+                      int first_frame,
+                      int num_frames,
+                      View& view) {
+  view.frames.assign(num_frames, FrameObservations());
+  view.spans.assign(tracks.size(), Span(0, -1));
+
+  for (int i = 0; i < int(tracks.size()); i += 1) {
+    const Track<SiftFeature>& track = tracks[i];
+    if (track.empty()) {
+      continue;
+    }
+    view.spans[i] = Span(track.begin()->first, track.rbegin()->first);
+
+    Track<SiftFeature>::const_iterator point;
+    for (point = track.begin(); point != track.end(); ++point) {
+      Observation observation;
+      observation.track = i;
+      observation.descriptor = &point->second.descriptor;
+      observation.born = (point == track.begin());
+      view.frames[point->first - first_frame].push_back(observation);
+    }
+  }
+}
+
+namespace {
+
+// The last frames of the tracks which are alive at frame t, sorted.
+void findLastFrames(const std::vector<Span>& spans,
+                    int t,
+                    std::vector<int>& last_frames) {
+  last_frames.clear();
+  std::vector<Span>::const_iterator span;
+  for (span = spans.begin(); span != spans.end(); ++span) {
+    if (span->first <= t && t <= span->second) {
+      last_frames.push_back(span->second);
+    }
+  }
+  std::sort(last_frames.begin(), last_frames.end());
+}
+
+}
+
+void chooseKeyframes(const std::vector<View>& views,
+                     int first_frame,
+                     int num_frames,
+                     double min_survival,
+                     int max_interval,
+                     std::vector<bool>& keyframes) {
+  int num_views = views.size();
+  keyframes.assign(num_frames, false);
+  std::vector<std::vector<int> > last_frames(num_views);
+  int keyframe = 0;
+
+  for (int i = 0; i < num_frames; i += 1) {
+    int t = first_frame + i;
+    bool is_keyframe = (i == 0 || i - keyframe >= max_interval);
+
+    for (int view = 0; view < num_views && !is_keyframe; view += 1) {
+      const std::vector<int>& lasts = last_frames[view];
+      int survivors = lasts.end() -
+          std::lower_bound(lasts.begin(), lasts.end(), t);
+      is_keyframe = (survivors < min_survival * lasts.size());
+    }
+
+    if (is_keyframe) {
+      keyframes[i] = true;
+      keyframe = i;
+      for (int view = 0; view < num_views; view += 1) {
+        findLastFrames(views[view].spans, t, last_frames[view]);
+      }
+    }
+  }
+}
+
+namespace {
+
+void listDescriptors(const FrameObservations& observations,
+                     bool born_only,
+                     std::deque<Descriptor>& descriptors,
+                     std::vector<int>& tracks) {
+  descriptors.clear();
+  tracks.clear();
+  FrameObservations::const_iterator observation;
+  for (observation = observations.begin(); observation != observations.end();
+       ++observation) {
+    if (!born_only || observation->born) {
+      descriptors.push_back(*observation->descriptor);
+      tracks.push_back(observation->track);
+    }
+  }
+}
+
+// Sets the index of the nearest descriptor to each query, or -1 if there is
+// none within the threshold.
+void findNearest(const std::deque<Descriptor>& queries,
+                 const DescriptorIndex& index,
+                 const FrameMatchOptions& options,
+                 std::vector<int>& nearest) {
+  nearest.assign(queries.size(), -1);
+  if (queries.empty() || index.size() == 0) {
+    return;
+  }
+
+  std::deque<QueryResultList> matches;
+  findMatchesUsingIndex(queries, index, matches, true, 1,
+      options.use_threshold, options.threshold);
+  for (int i = 0; i < int(matches.size()); i += 1) {
+    if (!matches[i].empty()) {
+      nearest[i] = matches[i].front().index;
+    }
+  }
+}
+
+// Matches the queries of one view to all descriptors of the other in the
+// frame, keeping a match only if the query is also the nearest to its match.
+// Matches are of track indices, first view first.
+void matchReciprocal(const std::deque<Descriptor>& queries,
+                     const std::vector<int>& query_tracks,
+                     const std::deque<Descriptor>& descriptors,
+                     const std::vector<int>& tracks,
+                     const DescriptorIndex& index,
+                     const DescriptorIndex& other_index,
+                     const std::vector<int>& other_tracks,
+                     const FrameMatchOptions& options,
+                     bool forward,
+                     std::vector<Match>& matches) {
+  std::vector<int> nearest;
+  findNearest(queries, index, options, nearest);
+
+  // Search back from only those descriptors which were matched.
+  std::deque<Descriptor> matched;
+  std::vector<int> queries_of_matched;
+  for (int i = 0; i < int(nearest.size()); i += 1) {
+    if (nearest[i] >= 0) {
+      matched.push_back(descriptors[nearest[i]]);
+      queries_of_matched.push_back(i);
+    }
+  }
+  std::vector<int> reverse;
+  findNearest(matched, other_index, options, reverse);
+
+  for (int k = 0; k < int(matched.size()); k += 1) {
+    int i = queries_of_matched[k];
+    if (reverse[k] < 0 || other_tracks[reverse[k]] != query_tracks[i]) {
+      continue;
+    }
+    int j = tracks[nearest[i]];
+    matches.push_back(forward ? Match(query_tracks[i], j) :
+                                Match(j, query_tracks[i]));
+  }
+}
+
+bool sameMatch(const Match& lhs, const Match& rhs) {
+  return lhs.first == rhs.first && lhs.second == rhs.second;
+}
+
+}
+
+void matchFrame(const FrameObservations& observations1,
+                const FrameObservations& observations2,
+                bool keyframe,
+                const FrameMatchOptions& options,
+                std::vector<Match>& matches) {
+  matches.clear();
+
+  std::deque<Descriptor> descriptors1;
+  std::deque<Descriptor> descriptors2;
+  std::vector<int> tracks1;
+  std::vector<int> tracks2;
+  listDescriptors(observations1, false, descriptors1, tracks1);
+  listDescriptors(observations2, false, descriptors2, tracks2);
+  if (descriptors1.empty() || descriptors2.empty()) {
+    return;
+  }
+
+  std::deque<Descriptor> born1;
+  std::deque<Descriptor> born2;
+  std::vector<int> born_tracks1;
+  std::vector<int> born_tracks2;
+  if (!keyframe) {
+    listDescriptors(observations1, true, born1, born_tracks1);
+    listDescriptors(observations2, true, born2, born_tracks2);
+    if (born1.empty() && born2.empty()) {
+      return;
+    }
+  }
+
+  DescriptorIndex index1;
+  DescriptorIndex index2;
+  index1.build(descriptors1, options.use_flann);
+  index2.build(descriptors2, options.use_flann);
+
+  if (keyframe) {
+    // Matches found from both sides are the same.
+    matchReciprocal(descriptors1, tracks1, descriptors2, tracks2, index2,
+        index1, tracks1, options, true, matches);
+  } else {
+    matchReciprocal(born1, born_tracks1, descriptors2, tracks2, index2,
+        index1, tracks1, options, true, matches);
+    matchReciprocal(born2, born_tracks2, descriptors1, tracks1, index1,
+        index2, tracks2, options, false, matches);
+    std::sort(matches.begin(), matches.end());
+    matches.erase(std::unique(matches.begin(), matches.end(), sameMatch),
+        matches.end());
+  }
+}
+
+namespace {
+
+// Number of frames in which a pair of tracks was matched.
+typedef std::pair<int, Match> Vote;
+
+bool moreVotes(const Vote& lhs, const Vote& rhs) {
+  if (lhs.first != rhs.first) {
+    return lhs.first > rhs.first;
+  }
+  return lhs.second < rhs.second;
+}
+
+}
+
+void selectTrackMatches(const std::vector<std::vector<Match> >& frame_matches,
+                        int num_tracks1,
+                        int num_tracks2,
+                        int min_votes,
+                        std::vector<Match>& matches) {
+  std::vector<Match> all;
+  std::vector<std::vector<Match> >::const_iterator frame;
+  for (frame = frame_matches.begin(); frame != frame_matches.end(); ++frame) {
+    all.insert(all.end(), frame->begin(), frame->end());
+  }
+  std::sort(all.begin(), all.end());
+
+  std::vector<Vote> votes;
+  std::vector<Match>::iterator begin = all.begin();
+  while (begin != all.end()) {
+    std::vector<Match>::iterator end = std::upper_bound(begin, all.end(),
+        *begin);
+    votes.push_back(Vote(end - begin, *begin));
+    begin = end;
+  }
+  std::sort(votes.begin(), votes.end(), moreVotes);
+
+  std::vector<bool> used1(num_tracks1, false);
+  std::vector<bool> used2(num_tracks2, false);
+  matches.clear();
+  std::vector<Vote>::const_iterator vote;
+  for (vote = votes.begin(); vote != votes.end(); ++vote) {
+    if (vote->first < min_votes) {
+      break;
+    }
+    int i = vote->second.first;
+    int j = vote->second.second;
+    if (!used1[i] && !used2[j]) {
+      matches.push_back(vote->second);
+      used1[i] = true;
+      used2[j] = true;
+    }
+  }
+}
@@ -0,0 +1,77 @@
+#ifndef KEYFRAME_TRACK_MATCHES_HPP_
+#define KEYFRAME_TRACK_MATCHES_HPP_
+
+#include <utility>
+#include <vector>
+#include "descriptor.hpp"
+#include "match.hpp"
+#include "sift_feature.hpp"
+#include "track_list.hpp"
+
+typedef TrackList<SiftFeature> FeatureTrackList;
+
+// A descriptor of a track in one frame.
+struct Observation {
+  int track;
+  const Descriptor* descriptor;
+  // First observation of the track.
+  bool born;
+};
+
+typedef std::vector<Observation> FrameObservations;
+
+// The first and last frames of a track.
+typedef std::pair<int, int> Span;
+
+// The observations of every track, by frame from an offset.
+struct View {
+  std::vector<FrameObservations> frames;
+  std::vector<Span> spans;
+};
+
+// Finds the frames spanned by the tracks of every view. Returns false, with
+// no frames from zero, if every track is empty.
+bool findFrameRange(const std::vector<FeatureTrackList>& tracks,
+                    int& first_frame,
+                    int& num_frames);
+
+void listObservations(const FeatureTrackList& tracks,
+                      int first_frame,
+                      int num_frames,
+                      View& view);
+
+// Starts a new keyframe when too many of the tracks of either view at the
+// last keyframe have ended, or after the longest interval. The first frame is
+// always a keyframe. Frames are numbered from first_frame.
+void chooseKeyframes(const std::vector<View>& views,
+                     int first_frame,
+                     int num_frames,
+                     double min_survival,
+                     int max_interval,
+                     std::vector<bool>& keyframes);
+
+struct FrameMatchOptions {
+  bool use_threshold;
+  double threshold;
+  bool use_flann;
+};
+
+// Matches every track at a keyframe and only the newly born tracks between
+// keyframes, against every track of the other view in the same frame.
+// Matches are of track indices, first view first, and are reciprocal.
+void matchFrame(const FrameObservations& observations1,
+                const FrameObservations& observations2,
+                bool keyframe,
+                const FrameMatchOptions& options,
+                std::vector<Match>& matches);
+
+// Assigns each track at most one match, in order of the number of frames in
+// which the pair was matched. The correspondence holds in every frame of the
+// tracks, through which it is propagated between keyframes.
+void selectTrackMatches(const std::vector<std::vector<Match> >& frame_matches,
+                        int num_tracks1,
+                        int num_tracks2,
+                        int min_votes,
+                        std::vector<Match>& matches);
+
+#endif
@@ -0,0 +1,148 @@
+#include "keyframe_track_matches.hpp"
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace {
+
+// Adds a track observed in frames [first, last], whose descriptor is x.
+void addTrack(FeatureTrackList& tracks, int first, int last, double x) {
+  Track<SiftFeature> track;
+  for (int t = first; t <= last; t += 1) {
+    track[t].descriptor = Descriptor(1, x);
+  }
+  tracks.push_back(track);
+}
+
+}
+
+TEST(FindFrameRange, EmptyListsHaveNoFrames) {
+  std::vector<FeatureTrackList> tracks(2);
+  int first_frame = -1;
+  int num_frames = -1;
+  EXPECT_FALSE(findFrameRange(tracks, first_frame, num_frames));
+  EXPECT_EQ(0, first_frame);
+  EXPECT_EQ(0, num_frames);
+
+  // Tracks with no points.
+  tracks[0].push_back(Track<SiftFeature>());
+  tracks[1].push_back(Track<SiftFeature>());
+  EXPECT_FALSE(findFrameRange(tracks, first_frame, num_frames));
+  EXPECT_EQ(0, num_frames);
+}
+
+TEST(FindFrameRange, SpansEveryView) {
+  std::vector<FeatureTrackList> tracks(2);
+  addTrack(tracks[0], 5, 8, 0);
+  tracks[0].push_back(Track<SiftFeature>());
+  addTrack(tracks[1], 3, 4, 0);
+  addTrack(tracks[1], 6, 12, 0);
+
+  int first_frame;
+  int num_frames;
+  ASSERT_TRUE(findFrameRange(tracks, first_frame, num_frames));
+  EXPECT_EQ(3, first_frame);
+  EXPECT_EQ(10, num_frames);
+
+  // Only one view has tracks.
+  tracks[1].clear();
+  ASSERT_TRUE(findFrameRange(tracks, first_frame, num_frames));
+  EXPECT_EQ(5, first_frame);
+  EXPECT_EQ(4, num_frames);
+}
+
+TEST(MatchTracksAtKeyframes, EmptyListsGiveNoMatches) {
+  std::vector<FeatureTrackList> tracks(2);
+  int first_frame;
+  int num_frames;
+  findFrameRange(tracks, first_frame, num_frames);
+
+  std::vector<View> views(2);
+  for (int view = 0; view < 2; view += 1) {
+    listObservations(tracks[view], first_frame, num_frames, views[view]);
+    EXPECT_TRUE(views[view].frames.empty());
+  }
+  std::vector<bool> keyframes;
+  chooseKeyframes(views, first_frame, num_frames, 0.7, 30, keyframes);
+  EXPECT_TRUE(keyframes.empty());
+
+  std::vector<std::vector<Match> > frame_matches(num_frames);
+  std::vector<Match> matches;
+  selectTrackMatches(frame_matches, 0, 0, 1, matches);
+  EXPECT_TRUE(matches.empty());
+}
+
+TEST(ChooseKeyframes, StartsKeyframeWhenTracksEndOrAfterInterval) {
+  std::vector<FeatureTrackList> tracks(2);
+  // Half of the first view's tracks end after frame 3.
+  addTrack(tracks[0], 0, 3, 0);
+  addTrack(tracks[0], 0, 19, 0);
+  addTrack(tracks[1], 0, 19, 0);
+
+  int first_frame;
+  int num_frames;
+  ASSERT_TRUE(findFrameRange(tracks, first_frame, num_frames));
+  std::vector<View> views(2);
+  for (int view = 0; view < 2; view += 1) {
+    listObservations(tracks[view], first_frame, num_frames, views[view]);
+  }
+
+  std::vector<bool> keyframes;
+  chooseKeyframes(views, first_frame, num_frames, 0.7, 8, keyframes);
+  ASSERT_EQ(20u, keyframes.size());
+  for (int t = 0; t < 20; t += 1) {
+    // The first frame, when the track ends, and every 8 frames after.
+    bool expected = (t == 0 || t == 4 || t == 12);
+    EXPECT_EQ(expected, keyframes[t]) << "Frame " << t;
+  }
+}
+
+TEST(MatchFrame, MatchesOnlyBornTracksBetweenKeyframes) {
+  std::vector<FeatureTrackList> tracks(2);
+  addTrack(tracks[0], 0, 1, 0);
+  addTrack(tracks[0], 1, 1, 10);
+  addTrack(tracks[1], 0, 1, 0.1);
+  addTrack(tracks[1], 0, 1, 9.9);
+
+  std::vector<View> views(2);
+  for (int view = 0; view < 2; view += 1) {
+    listObservations(tracks[view], 0, 2, views[view]);
+  }
+  FrameMatchOptions options;
+  options.use_threshold = false;
+  options.threshold = 0;
+  options.use_flann = false;
+
+  std::vector<Match> matches;
+  matchFrame(views[0].frames[0], views[1].frames[0], true, options, matches);
+  // Only the first view is searched from at a keyframe.
+  ASSERT_EQ(1u, matches.size());
+  EXPECT_EQ(0, matches[0].first);
+  EXPECT_EQ(0, matches[0].second);
+
+  matchFrame(views[0].frames[1], views[1].frames[1], false, options, matches);
+  ASSERT_EQ(1u, matches.size());
+  EXPECT_EQ(1, matches[0].first);
+  EXPECT_EQ(1, matches[0].second);
+}
+
+TEST(SelectTrackMatches, AssignsOneToOneByVotes) {
+  std::vector<std::vector<Match> > frame_matches(3);
+  frame_matches[0].push_back(Match(0, 1));
+  frame_matches[1].push_back(Match(0, 1));
+  frame_matches[1].push_back(Match(0, 0));
+  frame_matches[2].push_back(Match(1, 1));
+  frame_matches[2].push_back(Match(2, 2));
+
+  std::vector<Match> matches;
+  selectTrackMatches(frame_matches, 3, 3, 1, matches);
+  // Tracks 0 and 1 of the second view are taken by the pair with most votes.
+  ASSERT_EQ(2u, matches.size());
+  EXPECT_EQ(0, matches[0].first);
+  EXPECT_EQ(1, matches[0].second);
+  EXPECT_EQ(2, matches[1].first);
+  EXPECT_EQ(2, matches[1].second);
+
+  selectTrackMatches(frame_matches, 3, 3, 2, matches);
+  ASSERT_EQ(1u, matches.size());
+  EXPECT_EQ(1, matches[0].second);
+}
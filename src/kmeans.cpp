@@ -1,10 +1,16 @@
 #include "kmeans.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <set>
 #include <boost/random/uniform_int_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
 #include <glog/logging.h>
 #include <opencv2/core/core.hpp>
+#include "fixed_descriptor.hpp"
 #include "util.hpp"
 #include "random.hpp"
+#include "util/thread-pool.hpp"
 
 // "m << n" means "MUCH_LARGER * m < n"
 // Expected number of trials to draw m unique elements from n versus O(n).
@@ -38,40 +44,62 @@ class Result {
 double squaredDistance(const Vector& x,
                        const Vector& y) {
   CHECK(x.size() == y.size());
-
-  cv::Mat e;
-  cv::subtract(x, y, e);
-
-  return e.dot(e);
+  return squaredDistance(Dimension<DYNAMIC_DIMENSION>(x.size()), &x.front(),
+      &y.front());
 }
 
-Result findNearest(const Vector& query,
-                   const std::deque<Vector>& points) {
-  Result min;
-  int num_min = 0;
-
-  std::deque<Vector>::const_iterator point;
-  int i = 0;
-
-  for (point = points.begin(); point != points.end(); ++point) {
-    // Compute distance.
-    double distance = squaredDistance(query, *point);
+// Finds the nearest of a list of points with the dimension of the query.
+class NearestPoint {
+  public:
+    NearestPoint(const Vector& query, const std::deque<Vector>& points)
+        : query_(&query), points_(&points), min_() {}
+
+    template<int N>
+    void operator()(Dimension<N> dimension) {
+      int num_min = 0;
+
+      std::deque<Vector>::const_iterator point;
+      int i = 0;
+
+      for (point = points_->begin(); point != points_->end(); ++point) {
+        CHECK(point->size() == query_->size());
+        // Compute distance.
+        double distance = squaredDistance(dimension, &query_->front(),
+            &point->front());
+
+        if (min_.empty() || distance < min_.value()) {
+          // Replace nearest.
+          min_ = Result(i, distance);
+          num_min = 1;
+        } else if (distance == min_.value()) {
+          // Found an identical minimum.
+          num_min += 1;
+        }
+
+        i += 1;
+      }
+
+      if (num_min > 1) {
+        DLOG(WARNING) << "Exact tie between " << num_min << " clusters";
+      }
+    }
 
-    if (min.empty() || distance < min.value()) {
-      // Replace nearest.
-      min = Result(i, distance);
-      num_min = 1;
-    } else if (distance == min.value()) {
-      // Found an identical minimum.
-      num_min += 1;
+    const Result& result() const {
+      return min_;
     }
 
-    i += 1;
-  }
+  private:
+    const Vector* query_;
+    const std::deque<Vector>* points_;
+    Result min_;
+};
 
-  if (num_min > 1) {
-    DLOG(WARNING) << "Exact tie between " << num_min << " clusters";
-  }
+Result findNearest(const Vector& query,
+                   const std::deque<Vector>& points) {
+  // Choose the kernel once for all points.
+  NearestPoint nearest(query, points);
+  dispatchDimension(query.size(), nearest);
+  Result min = nearest.result();
 
   CHECK(min.index() >= 0);
   CHECK(min.index() < int(points.size()));
@@ -88,6 +116,7 @@ void kMeans(const std::vector<const KMeansPoint*>& points,
   int iter = 0;
 
   assignEachPointToCluster(points, centers, labels);
+  removeEmptyClusters(centers, labels);
 
   while (!converged) {
     updateClusterPositions(points, centers, labels, centers.size());
@@ -282,14 +311,11 @@ void updateClusterPositions(const std::vector<const KMeansPoint*>& points,
   std::vector<int>::const_iterator count = counts.begin();
 
   while (center != centers.end()) {
-    if (*count == 0) {
-      // Remove cluster!
-      centers.erase(center);
-    } else {
-      // Make matrix without copying data.
-      cv::Mat c(*center, false);
-      c /= static_cast<double>(*count);
-    }
+    // Removing a center here would leave the labels pointing past it.
+    CHECK(*count > 0) << "Empty cluster";
+    // Make matrix without copying data.
+    cv::Mat c(*center, false);
+    c /= static_cast<double>(*count);
 
     ++center;
     ++count;
@@ -298,6 +324,915 @@ void updateClusterPositions(const std::vector<const KMeansPoint*>& points,
 
 ////////////////////////////////////////////////////////////////////////////////
 
+namespace {
+
+// Points per task of the bounded k-means passes.
+const int KMEANS_BLOCK_SIZE = 4096;
+
+// State of Hamerly's algorithm. For each point, upper bounds the distance to
+// its center and lower bounds the distance to every other center. A point
+// cannot change cluster while its upper bound is less than its lower bound
+// or half the distance from its center to the nearest other center.
+struct BoundedKMeansState {
+  int dimension;
+  // Read through the points once, instead of a virtual call per distance.
+  std::vector<const double*> points;
+  // One center per row.
+  cv::Mat centers;
+  std::vector<int> labels;
+  std::vector<double> upper;
+  std::vector<double> lower;
+  // Half the distance from each center to the nearest other.
+  std::vector<double> separation;
+  // Distance that each center moved in the last update.
+  std::vector<double> movement;
+  // The center which moved furthest and the distances moved by it and by
+  // the next furthest.
+  int furthest;
+  double max_movement;
+  double second_movement;
+};
+
+int numBlocks(int n) {
+  return (n + KMEANS_BLOCK_SIZE - 1) / KMEANS_BLOCK_SIZE;
+}
+
+// Runs a function of a block of points serially or in a pool.
+template<class Function>
+void forEachBlock(int n, Function& function, ThreadPool* pool) {
+  int num_blocks = numBlocks(n);
+  if (pool == NULL || pool->numThreads() == 0) {
+    for (int block = 0; block < num_blocks; block += 1) {
+      function(block);
+    }
+  } else {
+    pool->parallelFor(0, num_blocks, function);
+  }
+}
+
+// Assigns the points of a block to their nearest center, skipping those
+// whose bounds show they cannot change. Writes the number of points which
+// changed cluster.
+template<int N>
+class AssignBlock {
+  public:
+    AssignBlock(BoundedKMeansState& state,
+                Dimension<N> dimension,
+                bool exhaustive,
+                std::vector<int>& num_changed)
+        : state_(&state),
+          dimension_(dimension),
+          exhaustive_(exhaustive),
+          num_changed_(&num_changed) {}
+
+    void operator()(int block) const {
+      BoundedKMeansState& state = *state_;
+      int n = state.points.size();
+      int k = state.centers.rows;
+      int begin = block * KMEANS_BLOCK_SIZE;
+      int end = std::min(begin + KMEANS_BLOCK_SIZE, n);
+      int num_changed = 0;
+
+      for (int i = begin; i < end; i += 1) {
+        const double* x = state.points[i];
+        int label = state.labels[i];
+
+        if (!exhaustive_) {
+          // The centers have moved since the bounds were computed.
+          state.upper[i] += state.movement[label];
+          state.lower[i] -= (label == state.furthest) ?
+              state.second_movement : state.max_movement;
+
+          // Strict, so that a point never skips an exact tie, which is
+          // broken in favour of the lower index as in kMeans().
+          double bound = std::max(state.separation[label], state.lower[i]);
+          if (state.upper[i] < bound) {
+            continue;
+          }
+          state.upper[i] = std::sqrt(squaredDistance(dimension_, x,
+                state.centers.ptr<double>(label)));
+          if (state.upper[i] < bound) {
+            continue;
+          }
+        }
+
+        // Find the nearest and second nearest centers.
+        int nearest = -1;
+        double first = std::numeric_limits<double>::infinity();
+        double second = std::numeric_limits<double>::infinity();
+        for (int c = 0; c < k; c += 1) {
+          double distance = squaredDistance(dimension_, x,
+              state.centers.ptr<double>(c));
+          if (nearest < 0 || distance < first) {
+            second = first;
+            first = distance;
+            nearest = c;
+          } else if (distance < second) {
+            second = distance;
+          }
+        }
+
+        if (nearest != label) {
+          num_changed += 1;
+        }
+        state.labels[i] = nearest;
+        state.upper[i] = std::sqrt(first);
+        state.lower[i] = std::sqrt(second);
+      }
+
+      (*num_changed_)[block] = num_changed;
+    }
+
+  private:
+    BoundedKMeansState* state_;
+    Dimension<N> dimension_;
+    bool exhaustive_;
+    std::vector<int>* num_changed_;
+};
+
+// Chooses the distance kernel once for the whole pass.
+class AssignPoints {
+  public:
+    AssignPoints(BoundedKMeansState& state, bool exhaustive, ThreadPool* pool)
+        : state_(&state), exhaustive_(exhaustive), pool_(pool),
+          num_changed_(0) {}
+
+    template<int N>
+    void operator()(Dimension<N> dimension) {
+      int n = state_->points.size();
+      std::vector<int> num_changed(numBlocks(n), 0);
+      AssignBlock<N> assign(*state_, dimension, exhaustive_, num_changed);
+      forEachBlock(n, assign, pool_);
+
+      num_changed_ = 0;
+      for (int block = 0; block < int(num_changed.size()); block += 1) {
+        num_changed_ += num_changed[block];
+      }
+    }
+
+    int numChanged() const {
+      return num_changed_;
+    }
+
+  private:
+    BoundedKMeansState* state_;
+    bool exhaustive_;
+    ThreadPool* pool_;
+    int num_changed_;
+};
+
+int assignPoints(BoundedKMeansState& state, bool exhaustive, ThreadPool* pool) {
+  AssignPoints assign(state, exhaustive, pool);
+  dispatchDimension(state.dimension, assign);
+  return assign.numChanged();
+}
+
+// Sums the points of a block in each cluster.
+class SumBlock {
+  public:
+    SumBlock(const BoundedKMeansState& state,
+             std::vector<cv::Mat>& sums,
+             std::vector<std::vector<int> >& counts)
+        : state_(&state), sums_(&sums), counts_(&counts) {}
+
+    void operator()(int block) const {
+      const BoundedKMeansState& state = *state_;
+      int n = state.points.size();
+      int begin = block * KMEANS_BLOCK_SIZE;
+      int end = std::min(begin + KMEANS_BLOCK_SIZE, n);
+
+      cv::Mat& sum = (*sums_)[block];
+      std::vector<int>& count = (*counts_)[block];
+      sum = cv::Mat::zeros(state.centers.size(), CV_64F);
+      count.assign(state.centers.rows, 0);
+
+      for (int i = begin; i < end; i += 1) {
+        int label = state.labels[i];
+        const double* x = state.points[i];
+        double* y = sum.ptr<double>(label);
+        for (int j = 0; j < state.dimension; j += 1) {
+          y[j] += x[j];
+        }
+        count[label] += 1;
+      }
+    }
+
+  private:
+    const BoundedKMeansState* state_;
+    std::vector<cv::Mat>* sums_;
+    std::vector<std::vector<int> >* counts_;
+};
+
+// Moves every center to the mean of its points and records how far they
+// moved. Every cluster must be non-empty.
+void updateCenters(BoundedKMeansState& state, ThreadPool* pool) {
+  int n = state.points.size();
+  int k = state.centers.rows;
+  int num_blocks = numBlocks(n);
+
+  std::vector<cv::Mat> sums(num_blocks);
+  std::vector<std::vector<int> > counts(num_blocks);
+  SumBlock sum(state, sums, counts);
+  forEachBlock(n, sum, pool);
+
+  // Reduce in order of block so that the result does not depend on the pool.
+  cv::Mat centers = cv::Mat::zeros(state.centers.size(), CV_64F);
+  std::vector<int> count(k, 0);
+  for (int block = 0; block < num_blocks; block += 1) {
+    centers += sums[block];
+    for (int c = 0; c < k; c += 1) {
+      count[c] += counts[block][c];
+    }
+  }
+
+  state.movement.assign(k, 0.);
+  state.furthest = -1;
+  state.max_movement = 0;
+  state.second_movement = 0;
+
+  for (int c = 0; c < k; c += 1) {
+    CHECK(count[c] > 0) << "Empty cluster";
+    cv::Mat center = centers.row(c);
+    center /= double(count[c]);
+
+    double movement = cv::norm(center, state.centers.row(c));
+    state.movement[c] = movement;
+    if (state.furthest < 0 || movement > state.max_movement) {
+      state.second_movement = state.max_movement;
+      state.max_movement = movement;
+      state.furthest = c;
+    } else if (movement > state.second_movement) {
+      state.second_movement = movement;
+    }
+  }
+
+  state.centers = centers;
+}
+
+void updateSeparation(BoundedKMeansState& state) {
+  int k = state.centers.rows;
+  Dimension<DYNAMIC_DIMENSION> dimension(state.dimension);
+
+  state.separation.assign(k, std::numeric_limits<double>::infinity());
+  for (int c = 0; c < k; c += 1) {
+    for (int d = c + 1; d < k; d += 1) {
+      double distance = 0.5 * std::sqrt(squaredDistance(dimension,
+            state.centers.ptr<double>(c), state.centers.ptr<double>(d)));
+      state.separation[c] = std::min(state.separation[c], distance);
+      state.separation[d] = std::min(state.separation[d], distance);
+    }
+  }
+}
+
+// Removing a center can only increase the distance to the second nearest, so
+// the bounds remain valid.
+void removeEmptyClusters(BoundedKMeansState& state) {
+  int k = state.centers.rows;
+  std::vector<int> count(k, 0);
+  std::vector<int>::const_iterator label;
+  for (label = state.labels.begin(); label != state.labels.end(); ++label) {
+    count[*label] += 1;
+  }
+
+  std::vector<int> index(k, -1);
+  int num_non_empty = 0;
+  for (int c = 0; c < k; c += 1) {
+    if (count[c] > 0) {
+      index[c] = num_non_empty;
+      num_non_empty += 1;
+    }
+  }
+  if (num_non_empty == k) {
+    return;
+  }
+
+  cv::Mat centers(num_non_empty, state.centers.cols, CV_64F);
+  for (int c = 0; c < k; c += 1) {
+    if (index[c] >= 0) {
+      cv::Mat row = centers.row(index[c]);
+      state.centers.row(c).copyTo(row);
+    }
+  }
+  state.centers = centers;
+
+  std::vector<int>::iterator i;
+  for (i = state.labels.begin(); i != state.labels.end(); ++i) {
+    *i = index[*i];
+  }
+
+  LOG(INFO) << "Empty cluster: decreasing from " << k << " to " <<
+      num_non_empty;
+}
+
+// Runs the bounded k-means in parallel if a pool is given.
+void boundedKMeans(const std::vector<const KMeansPoint*>& points,
+                   std::deque<Vector>& centers,
+                   std::vector<int>& labels,
+                   ThreadPool* pool) {
+  CHECK(!points.empty());
+  CHECK(!centers.empty());
+  int n = points.size();
+  int k = centers.size();
+
+  BoundedKMeansState state;
+  state.dimension = centers.front().size();
+  state.points.resize(n);
+  for (int i = 0; i < n; i += 1) {
+    const Vector& x = points[i]->vector();
+    CHECK(int(x.size()) == state.dimension);
+    state.points[i] = &x.front();
+  }
+
+  state.centers.create(k, state.dimension, CV_64F);
+  for (int c = 0; c < k; c += 1) {
+    CHECK(int(centers[c].size()) == state.dimension);
+    std::copy(centers[c].begin(), centers[c].end(),
+        state.centers.ptr<double>(c));
+  }
+
+  state.labels.assign(n, -1);
+  state.upper.assign(n, 0.);
+  state.lower.assign(n, 0.);
+
+  // The first pass computes every distance to initialize the bounds.
+  assignPoints(state, true, pool);
+  removeEmptyClusters(state);
+
+  bool converged = false;
+  int iter = 0;
+
+  while (!converged) {
+    updateCenters(state, pool);
+    updateSeparation(state);
+
+    int num_changed = assignPoints(state, false, pool);
+    converged = (num_changed == 0);
+
+    DLOG(INFO) << "Iteration " << iter << ": " << num_changed << "/" <<
+        points.size() << " points switched cluster";
+
+    if (!converged) {
+      removeEmptyClusters(state);
+    }
+
+    iter += 1;
+  }
+
+  centers.clear();
+  for (int c = 0; c < state.centers.rows; c += 1) {
+    const double* center = state.centers.ptr<double>(c);
+    centers.push_back(Vector(center, center + state.dimension));
+  }
+  labels.swap(state.labels);
+}
+
+}
+
+void boundedKMeans(const std::vector<const KMeansPoint*>& points,
+                   std::deque<Vector>& centers,
+                   std::vector<int>& labels) {
+  boundedKMeans(points, centers, labels, NULL);
+}
+
+void boundedKMeans(const std::vector<const KMeansPoint*>& points,
+                   std::deque<Vector>& centers,
+                   std::vector<int>& labels,
+                   ThreadPool& pool) {
+  boundedKMeans(points, centers, labels, &pool);
+}
+
+void randomBoundedKMeans(const std::vector<const KMeansPoint*>& points,
+                         int k,
+                         std::deque<Vector>& centers,
+                         std::vector<int>& labels,
+                         boost::random::mt19937& generator) {
+  randomClusterCenters(points, k, centers, generator);
+  boundedKMeans(points, centers, labels, NULL);
+}
+
+void randomBoundedKMeans(const std::vector<const KMeansPoint*>& points,
+                         int k,
+                         std::deque<Vector>& centers,
+                         std::vector<int>& labels,
+                         boost::random::mt19937& generator,
+                         ThreadPool& pool) {
+  randomClusterCenters(points, k, centers, generator);
+  boundedKMeans(points, centers, labels, &pool);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+KMeansOptions::KMeansOptions()
+    : seeding(RANDOM_SEEDING),
+      num_restarts(1),
+      num_rounds(5),
+      oversampling(2) {}
+
+namespace {
+
+// Updates the squared distance from each point of a block to the nearest of
+// a growing list of candidates, given the candidates which were added, and
+// sums the distances of the block.
+template<int N>
+class UpdateNearest {
+  public:
+    UpdateNearest(Dimension<N> dimension,
+                  const std::vector<const double*>& points,
+                  const std::vector<const double*>& candidates,
+                  int first,
+                  std::vector<double>& distances,
+                  std::vector<int>& nearest,
+                  std::vector<double>& sums)
+        : dimension_(dimension),
+          points_(&points),
+          candidates_(&candidates),
+          first_(first),
+          distances_(&distances),
+          nearest_(&nearest),
+          sums_(&sums) {}
+
+    void operator()(int block) const {
+      int n = points_->size();
+      int m = candidates_->size();
+      int begin = block * KMEANS_BLOCK_SIZE;
+      int end = std::min(begin + KMEANS_BLOCK_SIZE, n);
+      double sum = 0;
+
+      for (int i = begin; i < end; i += 1) {
+        double& distance = (*distances_)[i];
+        for (int c = first_; c < m; c += 1) {
+          double d = squaredDistance(dimension_, (*points_)[i],
+              (*candidates_)[c]);
+          if (d < distance) {
+            distance = d;
+            (*nearest_)[i] = c;
+          }
+        }
+        sum += distance;
+      }
+
+      (*sums_)[block] = sum;
+    }
+
+  private:
+    Dimension<N> dimension_;
+    const std::vector<const double*>* points_;
+    const std::vector<const double*>* candidates_;
+    int first_;
+    std::vector<double>* distances_;
+    std::vector<int>* nearest_;
+    std::vector<double>* sums_;
+};
+
+// State of k-means|| for one set of points.
+class ScalableSeeding {
+  public:
+    ScalableSeeding(const std::vector<const double*>& points,
+                    int dimension,
+                    ThreadPool* pool)
+        : points_(&points),
+          dimension_(dimension),
+          pool_(pool),
+          candidates_(),
+          distances_(points.size(), std::numeric_limits<double>::infinity()),
+          nearest_(points.size(), -1),
+          cost_(0) {}
+
+    // Adds point i to the candidates. Call update() after adding some.
+    void add(int i) {
+      candidates_.push_back((*points_)[i]);
+    }
+
+    // Updates distances for the candidates from first onwards.
+    void update(int first) {
+      first_ = first;
+      dispatchDimension(dimension_, *this);
+    }
+
+    template<int N>
+    void operator()(Dimension<N> dimension) {
+      int n = points_->size();
+      std::vector<double> sums(numBlocks(n), 0.);
+      UpdateNearest<N> update(dimension, *points_, candidates_, first_,
+          distances_, nearest_, sums);
+      forEachBlock(n, update, pool_);
+
+      // Sum in order of block so that the result does not depend on the pool.
+      cost_ = 0;
+      for (int block = 0; block < int(sums.size()); block += 1) {
+        cost_ += sums[block];
+      }
+    }
+
+    int numCandidates() const {
+      return candidates_.size();
+    }
+
+    const std::vector<const double*>& candidates() const {
+      return candidates_;
+    }
+
+    const std::vector<double>& distances() const {
+      return distances_;
+    }
+
+    const std::vector<int>& nearest() const {
+      return nearest_;
+    }
+
+    double cost() const {
+      return cost_;
+    }
+
+  private:
+    const std::vector<const double*>* points_;
+    int dimension_;
+    ThreadPool* pool_;
+    std::vector<const double*> candidates_;
+    std::vector<double> distances_;
+    std::vector<int> nearest_;
+    int first_;
+    double cost_;
+};
+
+// Draws an index with probability proportional to its weight. Returns -1 if
+// every weight is zero.
+int sampleWeighted(const std::vector<double>& weights,
+                   boost::random::mt19937& generator) {
+  double total = 0;
+  std::vector<double>::const_iterator weight;
+  for (weight = weights.begin(); weight != weights.end(); ++weight) {
+    total += *weight;
+  }
+  if (!(total > 0)) {
+    return -1;
+  }
+
+  boost::random::uniform_real_distribution<> uniform(0, total);
+  double u = uniform(generator);
+  int last = -1;
+  for (int i = 0; i < int(weights.size()); i += 1) {
+    if (weights[i] > 0) {
+      last = i;
+      u -= weights[i];
+      if (u < 0) {
+        return i;
+      }
+    }
+  }
+  // Rounding.
+  return last;
+}
+
+// Reduces weighted candidates to k centers by k-means++.
+void weightedPlusPlus(const std::vector<const double*>& candidates,
+                      const std::vector<double>& weights,
+                      int k,
+                      int dimension,
+                      std::deque<Vector>& centers,
+                      boost::random::mt19937& generator) {
+  Dimension<DYNAMIC_DIMENSION> size(dimension);
+  int m = candidates.size();
+  std::vector<double> distances(m, std::numeric_limits<double>::infinity());
+  std::vector<double> probabilities(weights);
+
+  centers.clear();
+  while (int(centers.size()) < k) {
+    int c = sampleWeighted(probabilities, generator);
+    if (c < 0) {
+      // Fewer than k distinct candidates.
+      break;
+    }
+    centers.push_back(Vector(candidates[c], candidates[c] + dimension));
+
+    for (int i = 0; i < m; i += 1) {
+      distances[i] = std::min(distances[i], squaredDistance(size,
+            candidates[i], candidates[c]));
+      probabilities[i] = weights[i] * distances[i];
+    }
+  }
+}
+
+// Picks centers by k-means|| in parallel if a pool is given.
+void scalableClusterCenters(const std::vector<const KMeansPoint*>& points,
+                            int k,
+                            const KMeansOptions& options,
+                            std::deque<Vector>& centers,
+                            boost::random::mt19937& generator,
+                            ThreadPool* pool) {
+  CHECK(!points.empty());
+  CHECK(k > 0);
+  int n = points.size();
+  int dimension = points.front()->vector().size();
+
+  std::vector<const double*> data(n);
+  for (int i = 0; i < n; i += 1) {
+    const Vector& x = points[i]->vector();
+    CHECK(int(x.size()) == dimension);
+    data[i] = &x.front();
+  }
+
+  ScalableSeeding seeding(data, dimension, pool);
+  boost::random::uniform_int_distribution<> uniform_index(0, n - 1);
+  seeding.add(uniform_index(generator));
+  seeding.update(0);
+
+  // Each round samples about oversampling * k points in proportion to their
+  // squared distance from the candidates. Sampling is serial so that the
+  // result only depends on the generator.
+  boost::random::uniform_real_distribution<> uniform(0, 1);
+  double expected = options.oversampling * k;
+  for (int round = 0; round < options.num_rounds; round += 1) {
+    double cost = seeding.cost();
+    if (!(cost > 0)) {
+      break;
+    }
+
+    int first = seeding.numCandidates();
+    for (int i = 0; i < n; i += 1) {
+      if (uniform(generator) * cost < expected * seeding.distances()[i]) {
+        seeding.add(i);
+      }
+    }
+    seeding.update(first);
+  }
+
+  // Weight each candidate by the points nearest to it.
+  std::vector<double> weights(seeding.numCandidates(), 0.);
+  std::vector<int>::const_iterator nearest;
+  for (nearest = seeding.nearest().begin(); nearest != seeding.nearest().end();
+       ++nearest) {
+    weights[*nearest] += 1;
+  }
+
+  weightedPlusPlus(seeding.candidates(), weights, k, dimension, centers,
+      generator);
+  DLOG(INFO) << "Chose " << centers.size() << " centers from " <<
+      seeding.numCandidates() << " candidates";
+}
+
+double sumOfSquaredErrors(const std::vector<const KMeansPoint*>& points,
+                          const std::deque<Vector>& centers,
+                          const std::vector<int>& labels) {
+  double sum = 0;
+  for (int i = 0; i < int(points.size()); i += 1) {
+    sum += squaredDistance(points[i]->vector(), centers[labels[i]]);
+  }
+  return sum;
+}
+
+// Seeds and runs bounded k-means once.
+double seededKMeansOnce(const std::vector<const KMeansPoint*>& points,
+                        int k,
+                        const KMeansOptions& options,
+                        std::deque<Vector>& centers,
+                        std::vector<int>& labels,
+                        boost::random::mt19937& generator,
+                        ThreadPool* pool) {
+  if (options.seeding == KMeansOptions::SCALABLE_PLUS_PLUS_SEEDING) {
+    scalableClusterCenters(points, k, options, centers, generator, pool);
+  } else {
+    randomClusterCenters(points, k, centers, generator);
+  }
+  boundedKMeans(points, centers, labels, pool);
+  return sumOfSquaredErrors(points, centers, labels);
+}
+
+// Runs one restart with its own generator.
+class RestartKMeans {
+  public:
+    RestartKMeans(const std::vector<const KMeansPoint*>& points,
+                  int k,
+                  const KMeansOptions& options,
+                  const std::vector<uint32_t>& seeds,
+                  std::vector<std::deque<Vector> >& centers,
+                  std::vector<std::vector<int> >& labels,
+                  std::vector<double>& errors)
+        : points_(&points),
+          k_(k),
+          options_(&options),
+          seeds_(&seeds),
+          centers_(&centers),
+          labels_(&labels),
+          errors_(&errors) {}
+
+    void operator()(int r) const {
+      boost::random::mt19937 generator((*seeds_)[r]);
+      (*errors_)[r] = seededKMeansOnce(*points_, k_, *options_,
+          (*centers_)[r], (*labels_)[r], generator, NULL);
+    }
+
+  private:
+    const std::vector<const KMeansPoint*>* points_;
+    int k_;
+    const KMeansOptions* options_;
+    const std::vector<uint32_t>* seeds_;
+    std::vector<std::deque<Vector> >* centers_;
+    std::vector<std::vector<int> >* labels_;
+    std::vector<double>* errors_;
+};
+
+// Runs the restarts concurrently if a pool is given.
+double seededKMeans(const std::vector<const KMeansPoint*>& points,
+                    int k,
+                    const KMeansOptions& options,
+                    std::deque<Vector>& centers,
+                    std::vector<int>& labels,
+                    boost::random::mt19937& generator,
+                    ThreadPool* pool) {
+  CHECK(options.num_restarts > 0);
+  int num_restarts = options.num_restarts;
+
+  if (num_restarts == 1) {
+    // Parallelize within the run instead.
+    return seededKMeansOnce(points, k, options, centers, labels, generator,
+        pool);
+  }
+
+  // Each restart has its own stream, so the result does not depend on the
+  // order in which they run, and restart r is the same for any number of
+  // restarts.
+  uint32_t seed = generator();
+  std::vector<uint32_t> seeds(num_restarts);
+  for (int r = 0; r < num_restarts; r += 1) {
+    seeds[r] = streamSeed(seed, r);
+  }
+
+  std::vector<std::deque<Vector> > restart_centers(num_restarts);
+  std::vector<std::vector<int> > restart_labels(num_restarts);
+  std::vector<double> errors(num_restarts, 0.);
+  RestartKMeans restart(points, k, options, seeds, restart_centers,
+      restart_labels, errors);
+  if (pool == NULL || pool->numThreads() == 0) {
+    for (int r = 0; r < num_restarts; r += 1) {
+      restart(r);
+    }
+  } else {
+    pool->parallelFor(0, num_restarts, restart);
+  }
+
+  int best = std::min_element(errors.begin(), errors.end()) - errors.begin();
+  DLOG(INFO) << "Best of " << num_restarts << " restarts has error " <<
+      errors[best];
+  centers.swap(restart_centers[best]);
+  labels.swap(restart_labels[best]);
+  return errors[best];
+}
+
+}
+
+void scalableClusterCenters(const std::vector<const KMeansPoint*>& points,
+                            int k,
+                            const KMeansOptions& options,
+                            std::deque<Vector>& centers,
+                            boost::random::mt19937& generator) {
+  scalableClusterCenters(points, k, options, centers, generator, NULL);
+}
+
+void scalableClusterCenters(const std::vector<const KMeansPoint*>& points,
+                            int k,
+                            const KMeansOptions& options,
+                            std::deque<Vector>& centers,
+                            boost::random::mt19937& generator,
+                            ThreadPool& pool) {
+  scalableClusterCenters(points, k, options, centers, generator, &pool);
+}
+
+double seededKMeans(const std::vector<const KMeansPoint*>& points,
+                    int k,
+                    const KMeansOptions& options,
+                    std::deque<Vector>& centers,
+                    std::vector<int>& labels,
+                    boost::random::mt19937& generator) {
+  return seededKMeans(points, k, options, centers, labels, generator, NULL);
+}
+
+double seededKMeans(const std::vector<const KMeansPoint*>& points,
+                    int k,
+                    const KMeansOptions& options,
+                    std::deque<Vector>& centers,
+                    std::vector<int>& labels,
+                    boost::random::mt19937& generator,
+                    ThreadPool& pool) {
+  return seededKMeans(points, k, options, centers, labels, generator, &pool);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Finds the nearest row of a matrix to each of a list of vectors.
+class NearestRows {
+  public:
+    NearestRows(const std::vector<const double*>& points,
+                const cv::Mat& rows,
+                std::vector<int>& nearest)
+        : points_(&points), rows_(&rows), nearest_(&nearest) {}
+
+    template<int N>
+    void operator()(Dimension<N> dimension) {
+      int n = points_->size();
+      nearest_->assign(n, -1);
+
+      for (int i = 0; i < n; i += 1) {
+        double min = 0;
+        for (int r = 0; r < rows_->rows; r += 1) {
+          double distance = squaredDistance(dimension, (*points_)[i],
+              rows_->ptr<double>(r));
+          if (r == 0 || distance < min) {
+            min = distance;
+            (*nearest_)[i] = r;
+          }
+        }
+      }
+    }
+
+  private:
+    const std::vector<const double*>* points_;
+    const cv::Mat* rows_;
+    std::vector<int>* nearest_;
+};
+
+}
+
+MiniBatchKMeans::MiniBatchKMeans() : centers_(), counts_() {}
+
+void MiniBatchKMeans::init(const std::deque<Vector>& centers) {
+  CHECK(!centers.empty());
+  int k = centers.size();
+  int dimension = centers.front().size();
+  CHECK(dimension > 0);
+
+  centers_.create(k, dimension, CV_64F);
+  for (int c = 0; c < k; c += 1) {
+    CHECK(int(centers[c].size()) == dimension);
+    std::copy(centers[c].begin(), centers[c].end(), centers_.ptr<double>(c));
+  }
+  counts_.assign(k, 0);
+}
+
+bool MiniBatchKMeans::empty() const {
+  return centers_.empty();
+}
+
+int MiniBatchKMeans::numCenters() const {
+  return centers_.rows;
+}
+
+const std::vector<int>& MiniBatchKMeans::counts() const {
+  return counts_;
+}
+
+void MiniBatchKMeans::centers(std::deque<Vector>& centers) const {
+  centers.clear();
+  for (int c = 0; c < centers_.rows; c += 1) {
+    const double* center = centers_.ptr<double>(c);
+    centers.push_back(Vector(center, center + centers_.cols));
+  }
+}
+
+void MiniBatchKMeans::update(const std::vector<const KMeansPoint*>& batch) {
+  CHECK(!empty());
+  int n = batch.size();
+  int dimension = centers_.cols;
+
+  std::vector<const double*> points(n);
+  for (int i = 0; i < n; i += 1) {
+    const Vector& x = batch[i]->vector();
+    CHECK(int(x.size()) == dimension);
+    points[i] = &x.front();
+  }
+
+  // Assign the whole batch before any center moves.
+  std::vector<int> labels;
+  NearestRows nearest(points, centers_, labels);
+  dispatchDimension(dimension, nearest);
+
+  for (int i = 0; i < n; i += 1) {
+    int c = labels[i];
+    counts_[c] += 1;
+    double rate = 1. / counts_[c];
+
+    double* center = centers_.ptr<double>(c);
+    for (int j = 0; j < dimension; j += 1) {
+      center[j] += rate * (points[i][j] - center[j]);
+    }
+  }
+}
+
+int MiniBatchKMeans::nearest(const Vector& x) const {
+  CHECK(!empty());
+  CHECK(int(x.size()) == centers_.cols);
+
+  std::vector<const double*> points(1, &x.front());
+  std::vector<int> labels;
+  NearestRows nearest(points, centers_, labels);
+  dispatchDimension(centers_.cols, nearest);
+  return labels.front();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 // Generates m unique random numbers in [0, n) by trial and error.
 // Only use for m << n.
 void uniqueRandomNumbersByTrialAndError(int m,
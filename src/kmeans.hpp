@@ -4,6 +4,9 @@
 #include <vector>
 #include <deque>
 #include <boost/random/mersenne_twister.hpp>
+#include <opencv2/core/core.hpp>
+
+class ThreadPool;
 
 // A k-means points must be able to expose a vector representation.
 class KMeansPoint {
@@ -34,6 +37,129 @@ void randomKMeans(const std::vector<const KMeansPoint*>& points,
                   std::vector<int>& labels,
                   boost::random::mt19937& generator);
 
+// Runs k-means like kMeans(), using Hamerly's bounds on the distance from
+// each point to its nearest and second nearest center to skip most distance
+// computations once clusters settle. Centers are kept in one contiguous
+// matrix. The result is the same as kMeans() up to rounding.
+void boundedKMeans(const std::vector<const KMeansPoint*>& points,
+                   std::deque<std::vector<double> >& centers,
+                   std::vector<int>& labels);
+// Assigns points and sums clusters in parallel.
+void boundedKMeans(const std::vector<const KMeansPoint*>& points,
+                   std::deque<std::vector<double> >& centers,
+                   std::vector<int>& labels,
+                   ThreadPool& pool);
+
+// Runs bounded k-means with randomized cluster centers.
+void randomBoundedKMeans(const std::vector<const KMeansPoint*>& points,
+                         int k,
+                         std::deque<std::vector<double> >& centers,
+                         std::vector<int>& labels,
+                         boost::random::mt19937& generator);
+void randomBoundedKMeans(const std::vector<const KMeansPoint*>& points,
+                         int k,
+                         std::deque<std::vector<double> >& centers,
+                         std::vector<int>& labels,
+                         boost::random::mt19937& generator,
+                         ThreadPool& pool);
+
+struct KMeansOptions {
+  // How the initial centers are chosen.
+  enum Seeding {
+    // Distinct points chosen uniformly at random.
+    RANDOM_SEEDING,
+    // k-means|| (scalable k-means++) of Bahmani et al.
+    SCALABLE_PLUS_PLUS_SEEDING
+  };
+
+  Seeding seeding;
+  // Runs of k-means from different seeds. The one with the least sum of
+  // squared errors is kept.
+  int num_restarts;
+  // Rounds of k-means|| sampling, each of which samples about
+  // oversampling * k candidates.
+  int num_rounds;
+  double oversampling;
+
+  // Random seeding without restarts, as randomKMeans().
+  KMeansOptions();
+};
+
+// Picks cluster centers by k-means||. Each round samples points in
+// proportion to their squared distance from the candidates so far. The
+// candidates are then weighted by the number of points nearest to them and
+// reduced to k by k-means++. There may be fewer than k centers if there are
+// fewer distinct points.
+void scalableClusterCenters(const std::vector<const KMeansPoint*>& points,
+                            int k,
+                            const KMeansOptions& options,
+                            std::deque<std::vector<double> >& centers,
+                            boost::random::mt19937& generator);
+// Computes distances in parallel.
+void scalableClusterCenters(const std::vector<const KMeansPoint*>& points,
+                            int k,
+                            const KMeansOptions& options,
+                            std::deque<std::vector<double> >& centers,
+                            boost::random::mt19937& generator,
+                            ThreadPool& pool);
+
+// Runs bounded k-means from the seeding of the options, options.num_restarts
+// times, and keeps the result with the least sum of squared errors, which is
+// returned. Each restart draws from a generator seeded by the one given, so
+// the result does not depend on the number of threads.
+double seededKMeans(const std::vector<const KMeansPoint*>& points,
+                    int k,
+                    const KMeansOptions& options,
+                    std::deque<std::vector<double> >& centers,
+                    std::vector<int>& labels,
+                    boost::random::mt19937& generator);
+// Runs restarts concurrently, or parallelizes a single run.
+double seededKMeans(const std::vector<const KMeansPoint*>& points,
+                    int k,
+                    const KMeansOptions& options,
+                    std::deque<std::vector<double> >& centers,
+                    std::vector<int>& labels,
+                    boost::random::mt19937& generator,
+                    ThreadPool& pool);
+
+// Mini-batch k-means, for points which do not fit in memory at once.
+//
+// Each update assigns a batch to the nearest centers and then moves every
+// center towards each of its points with a learning rate of one over the
+// number of points it has been assigned in all batches so far. Only the
+// centers and their counts are kept between batches.
+//
+// Usage:
+// MiniBatchKMeans kmeans;
+// randomClusterCenters(FIRST_BATCH, k, centers, generator);
+// kmeans.init(centers);
+// while (READ(batch)) {
+//   kmeans.update(batch);
+// }
+class MiniBatchKMeans {
+  public:
+    MiniBatchKMeans();
+
+    // Starts from initial cluster centers of the same (non-zero) dimension.
+    void init(const std::deque<std::vector<double> >& centers);
+    bool empty() const;
+
+    int numCenters() const;
+    // Number of points assigned to each center in all batches.
+    const std::vector<int>& counts() const;
+    void centers(std::deque<std::vector<double> >& centers) const;
+
+    // Points must have the dimension of the centers.
+    void update(const std::vector<const KMeansPoint*>& batch);
+    // Returns the index of the nearest center.
+    int nearest(const std::vector<double>& x) const;
+
+  private:
+    // One center per row.
+    cv::Mat centers_;
+    std::vector<int> counts_;
+};
+
 // Finds the nearest cluster center for each point. Parameters as above.
 //
 // Returns the number of points whose labels were modified.
@@ -45,6 +171,8 @@ int assignEachPointToCluster(const std::vector<const KMeansPoint*>& points,
 void removeEmptyClusters(std::deque<std::vector<double> >& centers,
                          std::vector<int>& labels);
 
+// Moves each center to the mean of its points. Every cluster must have at
+// least one point; call removeEmptyClusters() first.
 void updateClusterPositions(const std::vector<const KMeansPoint*>& points,
                             std::deque<std::vector<double> >& centers,
                             const std::vector<int>& labels,
@@ -0,0 +1,73 @@
+#include <deque>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <boost/random/mersenne_twister.hpp>
+#include <opencv2/core/core.hpp>
+#include "kmeans.hpp"
+
+namespace {
+
+const int DIMENSION = 64;
+
+class Point : public KMeansPoint {
+  public:
+    std::vector<double> x;
+
+    Point() : x(DIMENSION) {}
+
+    const std::vector<double>& vector() const {
+      return x;
+    }
+};
+
+void makePoints(int n, std::vector<Point>& points) {
+  cv::RNG rng(0);
+  points.assign(n, Point());
+
+  std::vector<Point>::iterator point;
+  for (point = points.begin(); point != points.end(); ++point) {
+    rng.fill(point->x, cv::RNG::NORMAL, 0., 1.);
+  }
+}
+
+// Clusters n points into k clusters from the same random start each time.
+// Arguments are n and k.
+template<void (*Cluster)(const std::vector<const KMeansPoint*>&,
+                         int,
+                         std::deque<std::vector<double> >&,
+                         std::vector<int>&,
+                         boost::random::mt19937&)>
+void runKMeans(benchmark::State& state) {
+  int n = state.range(0);
+  int k = state.range(1);
+
+  std::vector<Point> points;
+  makePoints(n, points);
+  std::vector<const KMeansPoint*> pointers;
+  for (int i = 0; i < n; i += 1) {
+    pointers.push_back(&points[i]);
+  }
+
+  std::deque<std::vector<double> > centers;
+  std::vector<int> labels;
+  while (state.KeepRunning()) {
+    boost::random::mt19937 generator(0);
+    Cluster(pointers, k, centers, labels, generator);
+    benchmark::DoNotOptimize(labels.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+void kMeansArguments(benchmark::internal::Benchmark* b) {
+  b->ArgsProduct({ benchmark::CreateRange(1024, 65536, 8), { 16, 256 } });
+  b->ArgNames({ "n", "k" });
+  b->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK_TEMPLATE(runKMeans, randomKMeans)->Name("BM_KMeans")
+    ->Apply(kMeansArguments);
+BENCHMARK_TEMPLATE(runKMeans, randomBoundedKMeans)->Name("BM_BoundedKMeans")
+    ->Apply(kMeansArguments);
+
+}
@@ -0,0 +1,331 @@
+#include "kmeans.hpp"
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include "util/thread-pool.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+typedef std::vector<double> Vector;
+typedef std::deque<Vector> CenterList;
+
+class VectorPoint : public KMeansPoint {
+  public:
+    explicit VectorPoint(const Vector& x) : x_(x) {}
+    const Vector& vector() const { return x_; }
+
+  private:
+    Vector x_;
+};
+
+// Owns the points and the list of pointers which k-means takes.
+class PointSet {
+  public:
+    PointSet() : storage_(), points_() {}
+
+    void add(const Vector& x) {
+      storage_.push_back(VectorPoint(x));
+      points_.clear();
+    }
+
+    const std::vector<const KMeansPoint*>& points() {
+      if (points_.empty()) {
+        for (int i = 0; i < int(storage_.size()); i += 1) {
+          points_.push_back(&storage_[i]);
+        }
+      }
+      return points_;
+    }
+
+  private:
+    std::deque<VectorPoint> storage_;
+    std::vector<const KMeansPoint*> points_;
+};
+
+// Points around a few random centers which overlap, so that k-means takes
+// several iterations to settle.
+void makeBlobs(int n, int dimension, int num_blobs, int seed,
+               PointSet& points) {
+  boost::random::mt19937 generator(seed);
+  boost::random::uniform_real_distribution<double> uniform(-10, 10);
+  boost::random::normal_distribution<double> noise(0, 4);
+
+  std::vector<Vector> blobs(num_blobs, Vector(dimension));
+  for (int b = 0; b < num_blobs; b += 1) {
+    for (int d = 0; d < dimension; d += 1) {
+      blobs[b][d] = uniform(generator);
+    }
+  }
+
+  for (int i = 0; i < n; i += 1) {
+    Vector x(dimension);
+    for (int d = 0; d < dimension; d += 1) {
+      x[d] = blobs[i % num_blobs][d] + noise(generator);
+    }
+    points.add(x);
+  }
+}
+
+void makePoints1D(const double* values, int n, PointSet& points) {
+  for (int i = 0; i < n; i += 1) {
+    points.add(Vector(1, values[i]));
+  }
+}
+
+void expectSameCenters(const CenterList& expected, const CenterList& actual) {
+  ASSERT_EQ(expected.size(), actual.size());
+  for (int c = 0; c < int(expected.size()); c += 1) {
+    ASSERT_EQ(expected[c].size(), actual[c].size());
+    for (int d = 0; d < int(expected[c].size()); d += 1) {
+      EXPECT_NEAR(expected[c][d], actual[c][d], 1e-9) << "Center " << c;
+    }
+  }
+}
+
+// Runs both from the same centers and expects the same clusters.
+void expectBoundedIsKMeans(const std::vector<const KMeansPoint*>& points,
+                           const CenterList& initial) {
+  CenterList expected_centers = initial;
+  std::vector<int> expected_labels;
+  kMeans(points, expected_centers, expected_labels);
+
+  CenterList centers = initial;
+  std::vector<int> labels;
+  boundedKMeans(points, centers, labels);
+
+  EXPECT_EQ(expected_labels, labels);
+  expectSameCenters(expected_centers, centers);
+}
+
+}
+
+TEST(BoundedKMeans, IsKMeansInEveryDimension) {
+  int dimensions[] = { 1, 2, 3, 16, 128 };
+  for (int i = 0; i < int(sizeof(dimensions) / sizeof(dimensions[0])); i += 1) {
+    SCOPED_TRACE(dimensions[i]);
+    PointSet points;
+    makeBlobs(600, dimensions[i], 6, i, points);
+
+    boost::random::mt19937 generator(i);
+    CenterList initial;
+    randomClusterCenters(points.points(), 8, initial, generator);
+    expectBoundedIsKMeans(points.points(), initial);
+  }
+}
+
+TEST(BoundedKMeans, RandomIsRandomKMeans) {
+  PointSet points;
+  makeBlobs(500, 5, 4, 11, points);
+
+  boost::random::mt19937 expected_generator(5);
+  CenterList expected_centers;
+  std::vector<int> expected_labels;
+  randomKMeans(points.points(), 6, expected_centers, expected_labels,
+      expected_generator);
+
+  boost::random::mt19937 generator(5);
+  CenterList centers;
+  std::vector<int> labels;
+  randomBoundedKMeans(points.points(), 6, centers, labels, generator);
+
+  EXPECT_EQ(expected_labels, labels);
+  expectSameCenters(expected_centers, centers);
+}
+
+TEST(BoundedKMeans, SingleClusterIsMean) {
+  PointSet points;
+  makeBlobs(300, 4, 3, 2, points);
+  const std::vector<const KMeansPoint*>& x = points.points();
+
+  Vector mean(4, 0.);
+  for (int i = 0; i < int(x.size()); i += 1) {
+    for (int d = 0; d < 4; d += 1) {
+      mean[d] += x[i]->vector()[d] / x.size();
+    }
+  }
+
+  CenterList centers(1, x[17]->vector());
+  std::vector<int> labels;
+  boundedKMeans(x, centers, labels);
+
+  EXPECT_EQ(std::vector<int>(x.size(), 0), labels);
+  expectSameCenters(CenterList(1, mean), centers);
+  expectBoundedIsKMeans(x, CenterList(1, x[17]->vector()));
+}
+
+// The middle cluster loses both its points to its neighbours after the
+// first update.
+TEST(BoundedKMeans, ClusterEmptiedByUpdate) {
+  const double VALUES[] = { 2, 3.4, 6.6, 8 };
+  PointSet points;
+  makePoints1D(VALUES, 4, points);
+
+  CenterList initial;
+  initial.push_back(Vector(1, 0.));
+  initial.push_back(Vector(1, 5.));
+  initial.push_back(Vector(1, 10.));
+
+  CenterList centers = initial;
+  std::vector<int> labels;
+  boundedKMeans(points.points(), centers, labels);
+
+  ASSERT_EQ(2u, centers.size());
+  EXPECT_NEAR(2.7, centers[0][0], 1e-12);
+  EXPECT_NEAR(7.3, centers[1][0], 1e-12);
+  int expected_labels[] = { 0, 0, 1, 1 };
+  EXPECT_EQ(std::vector<int>(expected_labels, expected_labels + 4), labels);
+
+  expectBoundedIsKMeans(points.points(), initial);
+}
+
+// A repeated center gets no points, since ties go to the first.
+TEST(BoundedKMeans, ClusterEmptyFromStart) {
+  PointSet points;
+  makeBlobs(200, 3, 3, 4, points);
+  const std::vector<const KMeansPoint*>& x = points.points();
+
+  CenterList initial;
+  initial.push_back(x[0]->vector());
+  initial.push_back(x[1]->vector());
+  initial.push_back(x[0]->vector());
+  initial.push_back(x[2]->vector());
+
+  CenterList centers = initial;
+  std::vector<int> labels;
+  boundedKMeans(x, centers, labels);
+  EXPECT_EQ(3u, centers.size());
+
+  expectBoundedIsKMeans(x, initial);
+}
+
+// Enough points for several blocks, whose sums must be reduced in the same
+// order by every pool.
+TEST(BoundedKMeans, SameForAnyNumberOfThreads) {
+  PointSet points;
+  makeBlobs(10000, 8, 10, 3, points);
+
+  boost::random::mt19937 generator(1);
+  CenterList initial;
+  randomClusterCenters(points.points(), 12, initial, generator);
+
+  CenterList serial_centers = initial;
+  std::vector<int> serial_labels;
+  boundedKMeans(points.points(), serial_centers, serial_labels);
+
+  for (int num_threads = 0; num_threads <= 4; num_threads += 2) {
+    SCOPED_TRACE(num_threads);
+    ThreadPool pool(num_threads);
+    CenterList centers = initial;
+    std::vector<int> labels;
+    boundedKMeans(points.points(), centers, labels, pool);
+
+    EXPECT_EQ(serial_labels, labels);
+    EXPECT_TRUE(serial_centers == centers);
+  }
+
+  boost::random::mt19937 serial_generator(9);
+  CenterList random_serial_centers;
+  randomBoundedKMeans(points.points(), 12, random_serial_centers,
+      serial_labels, serial_generator);
+
+  ThreadPool pool(3);
+  boost::random::mt19937 parallel_generator(9);
+  CenterList random_centers;
+  std::vector<int> labels;
+  randomBoundedKMeans(points.points(), 12, random_centers, labels,
+      parallel_generator, pool);
+  EXPECT_EQ(serial_labels, labels);
+  EXPECT_TRUE(random_serial_centers == random_centers);
+}
+
+// The first point a center gets replaces it, and each later one moves it by
+// one over the count, so one batch of every point gives the mean of the
+// points nearest each initial center.
+TEST(MiniBatchKMeans, SingleBatchGivesRunningMeans) {
+  PointSet points;
+  makeBlobs(400, 3, 4, 6, points);
+  const std::vector<const KMeansPoint*>& x = points.points();
+
+  CenterList initial;
+  initial.push_back(x[0]->vector());
+  initial.push_back(x[1]->vector());
+  initial.push_back(x[2]->vector());
+  // Too far away to get any point.
+  initial.push_back(Vector(3, 1e6));
+
+  std::vector<int> labels;
+  assignEachPointToCluster(x, initial, labels);
+  CenterList means(4, Vector(3, 0.));
+  std::vector<int> counts(4, 0);
+  for (int i = 0; i < int(x.size()); i += 1) {
+    counts[labels[i]] += 1;
+    for (int d = 0; d < 3; d += 1) {
+      means[labels[i]][d] += x[i]->vector()[d];
+    }
+  }
+  for (int c = 0; c < 3; c += 1) {
+    for (int d = 0; d < 3; d += 1) {
+      means[c][d] /= counts[c];
+    }
+  }
+  means[3] = initial[3];
+
+  MiniBatchKMeans kmeans;
+  EXPECT_TRUE(kmeans.empty());
+  kmeans.init(initial);
+  EXPECT_EQ(4, kmeans.numCenters());
+  kmeans.update(x);
+
+  EXPECT_EQ(counts, kmeans.counts());
+  CenterList centers;
+  kmeans.centers(centers);
+  expectSameCenters(means, centers);
+}
+
+// Every batch is assigned to the cluster of its blob, so the centers are the
+// means of all points seen, which repeated passes do not change.
+TEST(MiniBatchKMeans, BatchesConvergeToKMeans) {
+  const int NUM_BLOBS = 5;
+  PointSet points;
+  boost::random::mt19937 generator(8);
+  boost::random::normal_distribution<double> noise;
+  for (int i = 0; i < 1000; i += 1) {
+    Vector x(4);
+    for (int d = 0; d < 4; d += 1) {
+      x[d] = 100 * ((i % NUM_BLOBS) == d) + noise(generator);
+    }
+    points.add(x);
+  }
+  const std::vector<const KMeansPoint*>& x = points.points();
+
+  CenterList initial;
+  for (int c = 0; c < NUM_BLOBS; c += 1) {
+    initial.push_back(x[c]->vector());
+  }
+  CenterList expected_centers = initial;
+  std::vector<int> expected_labels;
+  kMeans(x, expected_centers, expected_labels);
+
+  MiniBatchKMeans kmeans;
+  kmeans.init(initial);
+  const int BATCH_SIZE = 64;
+  for (int pass = 0; pass < 3; pass += 1) {
+    for (int begin = 0; begin < int(x.size()); begin += BATCH_SIZE) {
+      int end = std::min(begin + BATCH_SIZE, int(x.size()));
+      std::vector<const KMeansPoint*> batch(x.begin() + begin,
+          x.begin() + end);
+      kmeans.update(batch);
+    }
+  }
+
+  CenterList centers;
+  kmeans.centers(centers);
+  expectSameCenters(expected_centers, centers);
+  for (int i = 0; i < int(x.size()); i += 1) {
+    EXPECT_EQ(expected_labels[i], kmeans.nearest(x[i]->vector()));
+  }
+}
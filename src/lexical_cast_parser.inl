@@ -1,4 +1,5 @@
 #include <boost/lexical_cast.hpp>
+#include "parse_number.hpp"
 
 template<class T>
 LexicalCastParser<T>::~LexicalCastParser() {}
@@ -13,3 +14,22 @@ bool LexicalCastParser<T>::parse(const std::string& text, T& x) {
 
   return true;
 }
+
+// Numbers skip the stream which lexical_cast constructs for every value.
+// Others, such as "nan", "inf" and "infinity", are still read by lexical_cast.
+template<>
+inline bool LexicalCastParser<double>::parse(const std::string& text,
+                                             double& x) {
+  const char* end = text.c_str();
+  if (parseNumber(end, x) && *end == '\0') {
+    return true;
+  }
+
+  try {
+    x = boost::lexical_cast<double>(text);
+  } catch (boost::bad_lexical_cast& ex) {
+    return false;
+  }
+
+  return true;
+}
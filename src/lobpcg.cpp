@@ -0,0 +1,267 @@
+#include "lobpcg.hpp"
+#include <algorithm>
+#include <cmath>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <glog/logging.h>
+#include <opencv2/core/core.hpp>
+#include "csr_mat.hpp"
+
+// Seed of the random vectors in the initial block, for repeatable cuts.
+const int LOBPCG_SEED = 0;
+// A column is dependent on those before if orthogonalization removes all but
+// this fraction of its norm.
+const double LOBPCG_DEPENDENT_FRACTION = 1e-10;
+
+namespace {
+
+typedef std::vector<double> Vector;
+typedef std::vector<Vector> Block;
+
+double dot(const Vector& x, const Vector& y) {
+  double sum = 0;
+  int n = x.size();
+  for (int i = 0; i < n; i += 1) {
+    sum += x[i] * y[i];
+  }
+  return sum;
+}
+
+// y += a x
+void addScaled(double a, const Vector& x, Vector& y) {
+  int n = x.size();
+  for (int i = 0; i < n; i += 1) {
+    y[i] += a * x[i];
+  }
+}
+
+void scale(double a, Vector& x) {
+  int n = x.size();
+  for (int i = 0; i < n; i += 1) {
+    x[i] *= a;
+  }
+}
+
+void multiply(const CsrMat& A, const Vector& x, Vector& y, ThreadPool* pool) {
+  y.assign(A.rows(), 0.);
+  if (y.empty()) {
+    return;
+  }
+
+  if (pool == NULL) {
+    A.multiply(&x.front(), &y.front());
+  } else {
+    A.multiply(&x.front(), &y.front(), *pool);
+  }
+}
+
+// Removes the components of s along the orthonormal columns of Q, and those
+// of as along their images AQ.
+void project(const Block& Q, const Block& AQ, Vector& s, Vector& as) {
+  int num_columns = Q.size();
+  for (int j = 0; j < num_columns; j += 1) {
+    double c = dot(Q[j], s);
+    addScaled(-c, Q[j], s);
+    addScaled(-c, AQ[j], as);
+  }
+}
+
+// Orthonormalizes the columns of S against the constraints, the basis and
+// each other, and appends them to the basis. Applies the same operations to
+// their images under the matrix, so that these need not be multiplied again.
+// Drops columns which depend on those before. Takes the contents of S and AS.
+void orthonormalize(const Block& constraints,
+                    const Block& constraint_images,
+                    Block& basis,
+                    Block& images,
+                    Block& S,
+                    Block& AS) {
+  int num_columns = S.size();
+
+  for (int i = 0; i < num_columns; i += 1) {
+    Vector s;
+    Vector as;
+    s.swap(S[i]);
+    as.swap(AS[i]);
+
+    double original = std::sqrt(dot(s, s));
+    // Twice is enough to be orthogonal in floating point.
+    for (int pass = 0; pass < 2; pass += 1) {
+      project(constraints, constraint_images, s, as);
+      project(basis, images, s, as);
+    }
+
+    double r = std::sqrt(dot(s, s));
+    if (r <= LOBPCG_DEPENDENT_FRACTION * original) {
+      continue;
+    }
+    scale(1. / r, s);
+    scale(1. / r, as);
+
+    basis.push_back(Vector());
+    basis.back().swap(s);
+    images.push_back(Vector());
+    images.back().swap(as);
+  }
+
+  S.clear();
+  AS.clear();
+}
+
+// Sets y to the sum of the columns [first, last) of S weighted by the
+// coefficients in a row of C.
+void combine(const Block& S,
+             const cv::Mat& C,
+             int row,
+             int first,
+             int last,
+             Vector& y) {
+  y.assign(S.front().size(), 0.);
+  for (int r = first; r < last; r += 1) {
+    addScaled(C.at<double>(row, r), S[r], y);
+  }
+}
+
+}
+
+bool lobpcg(const CsrMat& A,
+            const std::vector<std::vector<double> >& constraints,
+            int block_size,
+            int max_iter,
+            double tolerance,
+            std::vector<double>& x,
+            double* lambda,
+            ThreadPool* pool) {
+  CHECK(A.rows() == A.cols());
+  int n = A.rows();
+  int m = std::min(block_size, n - int(constraints.size()));
+  if (m <= 0) {
+    return false;
+  }
+
+  // Start from the guess, and fill the rest of the block at random. The
+  // guess may lie in the span of the constraints, so there is one random
+  // vector too many.
+  Block X;
+  if (int(x.size()) == n) {
+    X.push_back(x);
+  }
+  boost::random::mt19937 generator(LOBPCG_SEED);
+  boost::random::uniform_real_distribution<double> uniform(-1., 1.);
+  for (int j = 0; j < m; j += 1) {
+    X.push_back(Vector(n));
+    for (int i = 0; i < n; i += 1) {
+      X.back()[i] = uniform(generator);
+    }
+  }
+
+  int num_constraints = constraints.size();
+  Block constraint_images(num_constraints);
+  for (int j = 0; j < num_constraints; j += 1) {
+    multiply(A, constraints[j], constraint_images[j], pool);
+  }
+
+  int num_candidates = X.size();
+  Block AX(num_candidates);
+  for (int i = 0; i < num_candidates; i += 1) {
+    multiply(A, X[i], AX[i], pool);
+  }
+  {
+    Block basis;
+    Block images;
+    orthonormalize(constraints, constraint_images, basis, images, X, AX);
+    X.swap(basis);
+    AX.swap(images);
+  }
+  m = std::min(m, int(X.size()));
+  if (m == 0) {
+    return false;
+  }
+  X.resize(m);
+  AX.resize(m);
+
+  // Previous search directions.
+  Block P;
+  Block AP;
+  double theta = 0;
+
+  for (int iter = 0; iter < max_iter; iter += 1) {
+    // Residuals of the Rayleigh quotients.
+    Block W(m);
+    Block AW(m);
+    double residual = 0;
+    for (int i = 0; i < m; i += 1) {
+      double rayleigh = dot(X[i], AX[i]);
+      W[i] = AX[i];
+      addScaled(-rayleigh, X[i], W[i]);
+
+      if (i == 0) {
+        theta = rayleigh;
+        residual = std::sqrt(dot(W[i], W[i]));
+      }
+    }
+
+    if (residual <= tolerance) {
+      DLOG(INFO) << "LOBPCG converged after " << iter << " iterations";
+      x.swap(X.front());
+      if (lambda != NULL) {
+        *lambda = theta;
+      }
+      return true;
+    }
+
+    for (int i = 0; i < m; i += 1) {
+      multiply(A, W[i], AW[i], pool);
+    }
+
+    // Subspace of the block, the residuals and the previous directions.
+    // Rounding errors along the constraints are removed from the block too,
+    // lest the smaller eigenvalues amplify them.
+    Block S;
+    Block AS;
+    orthonormalize(constraints, constraint_images, S, AS, X, AX);
+    if (int(S.size()) < m) {
+      return false;
+    }
+    W.insert(W.end(), P.begin(), P.end());
+    AW.insert(AW.end(), AP.begin(), AP.end());
+    orthonormalize(constraints, constraint_images, S, AS, W, AW);
+    int dim = S.size();
+
+    // Rayleigh-Ritz. Eigenvalues are in descending order.
+    cv::Mat G(dim, dim, cv::DataType<double>::type);
+    for (int r = 0; r < dim; r += 1) {
+      for (int c = r; c < dim; c += 1) {
+        double g = 0.5 * (dot(S[r], AS[c]) + dot(S[c], AS[r]));
+        G.at<double>(r, c) = g;
+        G.at<double>(c, r) = g;
+      }
+    }
+    cv::Mat values;
+    cv::Mat vectors;
+    cv::eigen(G, values, vectors);
+
+    X.assign(m, Vector());
+    AX.assign(m, Vector());
+    P.assign(m, Vector());
+    AP.assign(m, Vector());
+    // Keep the smallest Ritz vectors, and their parts outside the block as
+    // the next directions.
+    for (int i = 0; i < m; i += 1) {
+      int row = dim - 1 - i;
+      combine(S, vectors, row, m, dim, P[i]);
+      combine(AS, vectors, row, m, dim, AP[i]);
+
+      combine(S, vectors, row, 0, m, X[i]);
+      addScaled(1., P[i], X[i]);
+      combine(AS, vectors, row, 0, m, AX[i]);
+      addScaled(1., AP[i], AX[i]);
+    }
+  }
+
+  x.swap(X.front());
+  if (lambda != NULL) {
+    *lambda = theta;
+  }
+  return false;
+}
@@ -0,0 +1,29 @@
+#ifndef LOBPCG_HPP_
+#define LOBPCG_HPP_
+
+#include <vector>
+
+class CsrMat;
+class ThreadPool;
+
+// Finds the smallest eigenvalue of a symmetric matrix, and its eigenvector,
+// amongst the vectors orthogonal to some known eigenvectors. Uses locally
+// optimal block conjugate gradients (LOBPCG) without a preconditioner.
+//
+// The constraints must be orthonormal. If x has one value per row on entry,
+// it is the initial guess, and the rest of the block is filled at random.
+// On return x is the unit eigenvector.
+//
+// Stops when the residual norm is at most tolerance. Returns false if this
+// was not reached within max_iter iterations. Multiplies by the matrix using
+// the threads of the pool if it is not NULL.
+bool lobpcg(const CsrMat& A,
+            const std::vector<std::vector<double> >& constraints,
+            int block_size,
+            int max_iter,
+            double tolerance,
+            std::vector<double>& x,
+            double* lambda,
+            ThreadPool* pool);
+
+#endif
@@ -0,0 +1,347 @@
+#include "logistic_regression.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <numeric>
+#include <glog/logging.h>
+#include "util/thread-pool.hpp"
+
+namespace {
+
+// Conjugate gradient iterations to find each Newton step.
+const int MAX_CG_ITERATIONS = 50;
+// Relative residual at which the Newton step is accurate enough.
+const double CG_TOLERANCE = 0.1;
+// Halvings of the step before giving up.
+const int MAX_LINE_SEARCH_STEPS = 20;
+// Fraction of the predicted decrease which a step must achieve.
+const double SUFFICIENT_DECREASE = 1e-4;
+
+double dot(const std::vector<double>& x, const std::vector<double>& y) {
+  return std::inner_product(x.begin(), x.end(), y.begin(), 0.);
+}
+
+// log(1 + exp(-z)) without overflow.
+double logisticLoss(double z) {
+  if (z >= 0) {
+    return std::log(1. + std::exp(-z));
+  } else {
+    return -z + std::log(1. + std::exp(z));
+  }
+}
+
+// The objective 1/2 |w|^2 + sum_i C_i log(1 + exp(-y_i w^T x_i)), where each
+// example is a row of the matrix followed by a 1 for the bias.
+class LogisticObjective {
+  public:
+    LogisticObjective(const DescriptorMatrix& examples,
+                      const std::vector<int>& positives,
+                      const LogisticRegressionOptions& options)
+        : examples_(&examples), labels_(examples.rows(), -1), costs_() {
+      std::vector<int>::const_iterator positive;
+      for (positive = positives.begin(); positive != positives.end();
+          ++positive) {
+        CHECK(*positive >= 0 && *positive < examples.rows()) <<
+            "Positive example out of range";
+        labels_[*positive] = 1;
+      }
+
+      costs_[0] = options.negative_cost;
+      costs_[1] = options.positive_cost;
+    }
+
+    int dimension() const {
+      return examples_->cols() + 1;
+    }
+
+    // Returns the objective and outputs the margins y_i w^T x_i.
+    double evaluate(const std::vector<double>& w,
+                    std::vector<double>& margins) const {
+      int n = examples_->rows();
+      margins.resize(n);
+      double f = 0.5 * dot(w, w);
+
+      for (int i = 0; i < n; i += 1) {
+        margins[i] = labels_[i] * product(*examples_, i, w);
+        f += cost(i) * logisticLoss(margins[i]);
+      }
+      return f;
+    }
+
+    // Outputs the gradient and the diagonal of the Hessian of the loss.
+    void gradient(const std::vector<double>& w,
+                  const std::vector<double>& margins,
+                  std::vector<double>& g,
+                  std::vector<double>& curvatures) const {
+      int n = examples_->rows();
+      int d = examples_->cols();
+      g = w;
+      curvatures.resize(n);
+
+      for (int i = 0; i < n; i += 1) {
+        double sigma = 1. / (1. + std::exp(-margins[i]));
+        curvatures[i] = cost(i) * sigma * (1. - sigma);
+
+        double a = cost(i) * (sigma - 1.) * labels_[i];
+        const float* x = examples_->row<float>(i);
+        for (int j = 0; j < d; j += 1) {
+          g[j] += a * x[j];
+        }
+        g[d] += a;
+      }
+    }
+
+    // Multiplies a vector by the Hessian I + X^T D X.
+    void hessianProduct(const std::vector<double>& curvatures,
+                        const std::vector<double>& v,
+                        std::vector<double>& Hv) const {
+      int n = examples_->rows();
+      int d = examples_->cols();
+      Hv = v;
+
+      for (int i = 0; i < n; i += 1) {
+        double a = curvatures[i] * product(*examples_, i, v);
+        const float* x = examples_->row<float>(i);
+        for (int j = 0; j < d; j += 1) {
+          Hv[j] += a * x[j];
+        }
+        Hv[d] += a;
+      }
+    }
+
+  private:
+    double cost(int i) const {
+      return costs_[labels_[i] > 0 ? 1 : 0];
+    }
+
+    // Inner product of an example with weights whose last element is the
+    // bias.
+    static double product(const DescriptorMatrix& examples,
+                          int i,
+                          const std::vector<double>& w) {
+      int d = examples.cols();
+      const float* x = examples.row<float>(i);
+      double y = w[d];
+      for (int j = 0; j < d; j += 1) {
+        y += w[j] * x[j];
+      }
+      return y;
+    }
+
+    const DescriptorMatrix* examples_;
+    std::vector<int> labels_;
+    double costs_[2];
+};
+
+// Approximately solves H s = -g using conjugate gradients.
+void newtonStep(const LogisticObjective& objective,
+                const std::vector<double>& curvatures,
+                const std::vector<double>& g,
+                std::vector<double>& s) {
+  int m = g.size();
+  s.assign(m, 0.);
+  std::vector<double> r(m);
+  std::transform(g.begin(), g.end(), r.begin(), std::negate<double>());
+  std::vector<double> p = r;
+  std::vector<double> Hp;
+
+  double rr = dot(r, r);
+  double tolerance = CG_TOLERANCE * std::sqrt(rr);
+
+  for (int k = 0; k < MAX_CG_ITERATIONS; k += 1) {
+    if (std::sqrt(rr) <= tolerance) {
+      break;
+    }
+
+    objective.hessianProduct(curvatures, p, Hp);
+    double alpha = rr / dot(p, Hp);
+    for (int j = 0; j < m; j += 1) {
+      s[j] += alpha * p[j];
+      r[j] -= alpha * Hp[j];
+    }
+
+    double rr_next = dot(r, r);
+    double beta = rr_next / rr;
+    for (int j = 0; j < m; j += 1) {
+      p[j] = r[j] + beta * p[j];
+    }
+    rr = rr_next;
+  }
+}
+
+// Outputs the n weights and the bias of the classifier as one vector.
+void weightsFromClassifier(const Classifier& classifier,
+                           int n,
+                           std::vector<double>& w) {
+  if (int(classifier.w.size()) == n) {
+    w = classifier.w;
+    w.push_back(classifier.b);
+  } else {
+    w.assign(n + 1, 0.);
+  }
+}
+
+}
+
+LogisticRegressionOptions::LogisticRegressionOptions()
+    : positive_cost(1),
+      negative_cost(1),
+      tolerance(1e-6),
+      max_iterations(100) {}
+
+void trainLogisticRegression(const DescriptorMatrix& examples,
+                             const std::vector<int>& positives,
+                             const LogisticRegressionOptions& options,
+                             Classifier& classifier) {
+  CHECK(examples.type() == cv::DataType<float>::type);
+  CHECK(!examples.empty()) << "No examples";
+
+  LogisticObjective objective(examples, positives, options);
+  int m = objective.dimension();
+
+  // Measure convergence relative to the gradient at zero, not at the start.
+  std::vector<double> w(m, 0.);
+  std::vector<double> margins;
+  std::vector<double> g;
+  std::vector<double> curvatures;
+  objective.evaluate(w, margins);
+  objective.gradient(w, margins, g, curvatures);
+  double min_norm = options.tolerance * std::sqrt(dot(g, g));
+
+  weightsFromClassifier(classifier, m - 1, w);
+  double f = objective.evaluate(w, margins);
+  objective.gradient(w, margins, g, curvatures);
+
+  std::vector<double> s;
+  std::vector<double> w_next(m);
+  std::vector<double> margins_next;
+  int iteration = 0;
+
+  while (iteration < options.max_iterations &&
+      std::sqrt(dot(g, g)) > min_norm) {
+    newtonStep(objective, curvatures, g, s);
+
+    // Backtrack until the objective decreases enough.
+    double decrease = dot(g, s);
+    double t = 1;
+    double f_next = f;
+    bool found = false;
+
+    for (int k = 0; k < MAX_LINE_SEARCH_STEPS && !found; k += 1) {
+      for (int j = 0; j < m; j += 1) {
+        w_next[j] = w[j] + t * s[j];
+      }
+      f_next = objective.evaluate(w_next, margins_next);
+      if (f_next <= f + SUFFICIENT_DECREASE * t * decrease) {
+        found = true;
+      } else {
+        t *= 0.5;
+      }
+    }
+
+    if (!found) {
+      break;
+    }
+
+    w.swap(w_next);
+    margins.swap(margins_next);
+    f = f_next;
+    objective.gradient(w, margins, g, curvatures);
+    iteration += 1;
+  }
+  DLOG(INFO) << "Converged after " << iteration << " iterations";
+
+  classifier.b = w.back();
+  w.pop_back();
+  classifier.w.swap(w);
+}
+
+namespace {
+
+// For use with ThreadPool::parallelFor().
+class TrainFunction {
+  public:
+    TrainFunction(const DescriptorMatrix& examples,
+                  const std::vector<std::vector<int> >& positives,
+                  const LogisticRegressionOptions& options,
+                  std::vector<Classifier>& classifiers)
+        : examples_(&examples),
+          positives_(&positives),
+          options_(&options),
+          classifiers_(&classifiers) {}
+
+    void operator()(int i) const {
+      trainLogisticRegression(*examples_, (*positives_)[i], *options_,
+          (*classifiers_)[i]);
+    }
+
+  private:
+    const DescriptorMatrix* examples_;
+    const std::vector<std::vector<int> >* positives_;
+    const LogisticRegressionOptions* options_;
+    std::vector<Classifier>* classifiers_;
+};
+
+void trainLogisticRegressions(
+    const DescriptorMatrix& examples,
+    const std::vector<std::vector<int> >& positives,
+    const LogisticRegressionOptions& options,
+    std::vector<Classifier>& classifiers,
+    ThreadPool* pool) {
+  int n = positives.size();
+  // Classifiers beyond those given start from zero.
+  classifiers.resize(n);
+
+  TrainFunction function(examples, positives, options, classifiers);
+  if (pool == NULL) {
+    for (int i = 0; i < n; i += 1) {
+      function(i);
+    }
+  } else {
+    pool->parallelFor(0, n, function);
+  }
+}
+
+}
+
+void trainLogisticRegressions(
+    const DescriptorMatrix& examples,
+    const std::vector<std::vector<int> >& positives,
+    const LogisticRegressionOptions& options,
+    std::vector<Classifier>& classifiers) {
+  trainLogisticRegressions(examples, positives, options, classifiers, NULL);
+}
+
+void trainLogisticRegressions(
+    const DescriptorMatrix& examples,
+    const std::vector<std::vector<int> >& positives,
+    const LogisticRegressionOptions& options,
+    std::vector<Classifier>& classifiers,
+    ThreadPool& pool) {
+  trainLogisticRegressions(examples, positives, options, classifiers, &pool);
+}
+
+void matchClassifiersById(const std::vector<Classifier>& initial,
+                          const std::vector<int>& initial_ids,
+                          const std::vector<int>& ids,
+                          std::vector<Classifier>& classifiers) {
+  CHECK(initial.size() == initial_ids.size()) <<
+      "Number of classifiers and ids differ";
+
+  typedef std::map<int, int> IndexMap;
+  IndexMap indices;
+  for (int i = 0; i < int(initial_ids.size()); i += 1) {
+    bool inserted = indices.insert(std::make_pair(initial_ids[i], i)).second;
+    CHECK(inserted) << "Classifier id " << initial_ids[i] << " is repeated";
+  }
+
+  int n = ids.size();
+  classifiers.assign(n, Classifier());
+  for (int i = 0; i < n; i += 1) {
+    IndexMap::const_iterator index = indices.find(ids[i]);
+    if (index != indices.end()) {
+      classifiers[i] = initial[index->second];
+    }
+  }
+}
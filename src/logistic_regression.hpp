@@ -0,0 +1,58 @@
+#ifndef LOGISTIC_REGRESSION_HPP_
+#define LOGISTIC_REGRESSION_HPP_
+
+#include <vector>
+#include "classifier.hpp"
+#include "descriptor_matrix.hpp"
+
+class ThreadPool;
+
+struct LogisticRegressionOptions {
+  // Weights of the loss of positive and negative examples.
+  double positive_cost;
+  double negative_cost;
+  // Stops when the gradient is this fraction of its norm at zero.
+  double tolerance;
+  int max_iterations;
+
+  LogisticRegressionOptions();
+};
+
+// Trains an L2-regularized logistic regression classifier, as liblinear's
+// L2R_LR solver does, which separates the positive rows of examples from all
+// other rows. The bias is regularized like any other weight.
+//
+// The examples are a CV_32F matrix, which is read but never copied, so that
+// many classifiers can share one set of negatives. Positives are row indices.
+//
+// If the classifier already has the dimension of the examples, it is used
+// as the starting point, which is much faster when it was trained on similar
+// examples.
+void trainLogisticRegression(const DescriptorMatrix& examples,
+                             const std::vector<int>& positives,
+                             const LogisticRegressionOptions& options,
+                             Classifier& classifier);
+
+// Trains one classifier for each set of positives.
+void trainLogisticRegressions(
+    const DescriptorMatrix& examples,
+    const std::vector<std::vector<int> >& positives,
+    const LogisticRegressionOptions& options,
+    std::vector<Classifier>& classifiers);
+// Trains the classifiers in the threads of the pool.
+void trainLogisticRegressions(
+    const DescriptorMatrix& examples,
+    const std::vector<std::vector<int> >& positives,
+    const LogisticRegressionOptions& options,
+    std::vector<Classifier>& classifiers,
+    ThreadPool& pool);
+
+// Orders previously trained classifiers as the starting points of new ones.
+// The new classifier i starts from the one whose id is ids[i], and from zero
+// if there is none. Ids must be unique.
+void matchClassifiersById(const std::vector<Classifier>& initial,
+                          const std::vector<int>& initial_ids,
+                          const std::vector<int>& ids,
+                          std::vector<Classifier>& classifiers);
+
+#endif
@@ -0,0 +1,180 @@
+#include "logistic_regression.hpp"
+#include <cmath>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "util/thread-pool.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+const int NUM_EXAMPLES = 100;
+const int DIMENSION = 8;
+
+void randomExamples(int seed, DescriptorMatrix& examples) {
+  examples.create(NUM_EXAMPLES, DIMENSION, CV_32F);
+  cv::RNG rng(seed);
+  rng.fill(examples.mat(), cv::RNG::NORMAL, 0., 1.);
+}
+
+// Gradient of 1/2 |w|^2 + sum_i C_i log(1 + exp(-y_i (w^T x_i + b))) with
+// respect to w and b, computed independently of the solver.
+std::vector<double> gradient(const DescriptorMatrix& examples,
+                             const std::vector<int>& positives,
+                             const LogisticRegressionOptions& options,
+                             const Classifier& classifier) {
+  int n = examples.rows();
+  int d = examples.cols();
+  std::vector<int> labels(n, -1);
+  for (int i = 0; i < int(positives.size()); i += 1) {
+    labels[positives[i]] = 1;
+  }
+
+  std::vector<double> w(classifier.w);
+  w.push_back(classifier.b);
+  std::vector<double> g(w);
+  for (int i = 0; i < n; i += 1) {
+    const float* x = examples.row<float>(i);
+    double z = classifier.score(x, x + d);
+    double cost = labels[i] > 0 ? options.positive_cost :
+        options.negative_cost;
+    double a = -cost * labels[i] / (1. + std::exp(labels[i] * z));
+    for (int j = 0; j < d; j += 1) {
+      g[j] += a * x[j];
+    }
+    g[d] += a;
+  }
+  return g;
+}
+
+double norm(const std::vector<double>& x) {
+  double y = 0;
+  for (int i = 0; i < int(x.size()); i += 1) {
+    y += x[i] * x[i];
+  }
+  return std::sqrt(y);
+}
+
+Classifier zeroClassifier() {
+  Classifier classifier;
+  classifier.w.assign(DIMENSION, 0.);
+  classifier.b = 0;
+  return classifier;
+}
+
+void expectNear(const Classifier& expected,
+                const Classifier& actual,
+                double tolerance) {
+  ASSERT_EQ(expected.w.size(), actual.w.size());
+  for (int j = 0; j < int(expected.w.size()); j += 1) {
+    EXPECT_NEAR(expected.w[j], actual.w[j], tolerance);
+  }
+  EXPECT_NEAR(expected.b, actual.b, tolerance);
+}
+
+TEST(LogisticRegression, GradientVanishesAtSolution) {
+  DescriptorMatrix examples;
+  randomExamples(1, examples);
+  std::vector<int> positives;
+  positives.push_back(3);
+  positives.push_back(17);
+
+  LogisticRegressionOptions options;
+  options.positive_cost = 0.5;
+  options.negative_cost = 0.01;
+  options.tolerance = 1e-8;
+
+  Classifier classifier;
+  trainLogisticRegression(examples, positives, options, classifier);
+  ASSERT_EQ(DIMENSION, int(classifier.w.size()));
+
+  double initial = norm(gradient(examples, positives, options,
+        zeroClassifier()));
+  double residual = norm(gradient(examples, positives, options, classifier));
+  EXPECT_LT(residual, 1e-6 * initial);
+}
+
+TEST(LogisticRegression, SeparatesPositive) {
+  DescriptorMatrix examples;
+  randomExamples(2, examples);
+  std::vector<int> positives(1, 5);
+
+  // Heavily weight the single positive.
+  LogisticRegressionOptions options;
+  options.positive_cost = 100;
+  options.negative_cost = 1;
+
+  Classifier classifier;
+  trainLogisticRegression(examples, positives, options, classifier);
+
+  const float* x = examples.row<float>(5);
+  EXPECT_GT(classifier.score(x, x + DIMENSION), 0);
+}
+
+TEST(LogisticRegression, WarmStartReachesSameSolution) {
+  DescriptorMatrix examples;
+  randomExamples(3, examples);
+  std::vector<int> positives(1, 0);
+
+  LogisticRegressionOptions options;
+  options.tolerance = 1e-10;
+
+  Classifier cold;
+  trainLogisticRegression(examples, positives, options, cold);
+
+  // Start from a perturbed solution.
+  Classifier warm = cold;
+  for (int j = 0; j < DIMENSION; j += 1) {
+    warm.w[j] += 0.1 * (j % 3 - 1);
+  }
+  warm.b -= 0.2;
+  trainLogisticRegression(examples, positives, options, warm);
+
+  expectNear(cold, warm, 1e-6);
+}
+
+TEST(LogisticRegression, PoolMatchesSerial) {
+  DescriptorMatrix examples;
+  randomExamples(4, examples);
+  std::vector<std::vector<int> > positives(NUM_EXAMPLES);
+  for (int i = 0; i < NUM_EXAMPLES; i += 1) {
+    positives[i].push_back(i);
+  }
+  LogisticRegressionOptions options;
+
+  std::vector<Classifier> serial;
+  trainLogisticRegressions(examples, positives, options, serial);
+
+  ThreadPool pool(4);
+  std::vector<Classifier> parallel;
+  trainLogisticRegressions(examples, positives, options, parallel, pool);
+
+  ASSERT_EQ(serial.size(), parallel.size());
+  for (int i = 0; i < NUM_EXAMPLES; i += 1) {
+    EXPECT_EQ(serial[i].w, parallel[i].w);
+    EXPECT_EQ(serial[i].b, parallel[i].b);
+  }
+}
+
+TEST(MatchClassifiersById, FollowsIdsNotPositions) {
+  std::vector<Classifier> initial(3, zeroClassifier());
+  std::vector<int> initial_ids;
+  for (int i = 0; i < 3; i += 1) {
+    initial[i].b = i;
+    initial_ids.push_back(10 * i);
+  }
+
+  // Track 10 was removed, and track 5 was added before the others.
+  std::vector<int> ids;
+  ids.push_back(5);
+  ids.push_back(0);
+  ids.push_back(20);
+
+  std::vector<Classifier> classifiers;
+  matchClassifiersById(initial, initial_ids, ids, classifiers);
+  ASSERT_EQ(3, int(classifiers.size()));
+  EXPECT_TRUE(classifiers[0].w.empty());
+  EXPECT_EQ(0, classifiers[1].b);
+  EXPECT_EQ(2, classifiers[2].b);
+}
+
+}
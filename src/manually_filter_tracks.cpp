@@ -15,6 +15,9 @@
 #include "scale_space_position.hpp"
 #include "scale_space_feature_drawer.hpp"
 #include "random_color.hpp"
+#include "image_file_sequence.hpp"
+#include "cached_video.hpp"
+#include "frame_interval_index.hpp"
 
 #include "track_list_reader.hpp"
 #include "default_reader.hpp"
@@ -28,12 +31,65 @@
 
 DEFINE_int32(radius, 5, "Base feature radius");
 DEFINE_int32(line_thickness, 2, "Line thickness for drawing");
+DEFINE_int32(cache_megabytes, 256, "Memory to keep decoded frames in");
+DEFINE_int32(read_ahead, 8,
+    "Number of frames to decode ahead in the direction of playback");
+DEFINE_bool(show_others, false,
+    "Also draw the other tracks which are present in the current frame?");
 
 const double SATURATION = 0.99;
 const double BRIGHTNESS = 0.99;
+const cv::Scalar OTHER_COLOR(128, 128, 128);
+const int OTHER_LINE_THICKNESS = 1;
+
+typedef std::list<Track<ScaleSpacePosition> > TrackSet;
+typedef std::vector<const Track<ScaleSpacePosition>*> TrackPointers;
+
+// Finds the frames spanned by every track, so that the tracks in the current
+// frame can be drawn without visiting all of them. Must be rebuilt after the
+// tracks are edited.
+void indexTracks(const TrackSet& tracks,
+                 TrackPointers& pointers,
+                 FrameIntervalIndex& index) {
+  pointers.clear();
+  std::vector<int> first;
+  std::vector<int> last;
+
+  TrackSet::const_iterator track;
+  for (track = tracks.begin(); track != tracks.end(); ++track) {
+    pointers.push_back(&*track);
+    first.push_back(track->begin()->first);
+    last.push_back(track->rbegin()->first);
+  }
+
+  index.init(first, last);
+}
+
+// Draws the other tracks which have a point in frame t.
+void drawOtherTracks(cv::Mat& image,
+                     const TrackPointers& pointers,
+                     const FrameIntervalIndex& index,
+                     const Track<ScaleSpacePosition>& selected,
+                     int t) {
+  std::vector<int> present;
+  index.find(t, present);
+
+  std::vector<int>::const_iterator i;
+  for (i = present.begin(); i != present.end(); ++i) {
+    const Track<ScaleSpacePosition>& track = *pointers[*i];
+    if (&track == &selected) {
+      continue;
+    }
+
+    // Tracks may have gaps within their interval.
+    Track<ScaleSpacePosition>::const_iterator point = track.find(t);
+    if (point == track.end()) {
+      continue;
+    }
 
-std::string makeImageFilename(const std::string& format, int time) {
-  return boost::str(boost::format(format) % (time + 1));
+    ScaleSpaceFeatureDrawer drawer(point->second, FLAGS_radius);
+    drawer.draw(image, OTHER_COLOR, OTHER_LINE_THICKNESS);
+  }
 }
 
 void init(int& argc, char**& argv) {
@@ -58,6 +114,7 @@ int main(int argc, char** argv) {
 
   std::string tracks_file = argv[1];
   std::string image_format = argv[2];
+  int num_frames = boost::lexical_cast<int>(argv[3]);
   std::string output_file = argv[4];
   std::string indices_file = argv[5];
 
@@ -70,7 +127,7 @@ int main(int argc, char** argv) {
   ok = loadTrackList(tracks_file, track_list, feature_reader);
   CHECK(ok) << "Could not load tracks";
 
-  std::list<Track<ScaleSpacePosition> > tracks;
+  TrackSet tracks;
   std::copy(track_list.begin(), track_list.end(), std::back_inserter(tracks));
 
   int num_tracks = tracks.size();
@@ -82,6 +139,14 @@ int main(int argc, char** argv) {
     colors.push_back(randomColor(BRIGHTNESS, SATURATION));
   }
 
+  // Frames are decoded on demand, and the next few ahead of time.
+  ImageFileSequence files(image_format, num_frames, false);
+  CachedVideo video(files, size_t(FLAGS_cache_megabytes) << 20,
+      FLAGS_read_ahead);
+
+  TrackPointers pointers;
+  FrameIntervalIndex index;
+
   cv::namedWindow("Tracks");
 
   cv::Mat image;
@@ -89,10 +154,13 @@ int main(int argc, char** argv) {
   bool exit = false;
   bool paused = true;
 
-  std::list<Track<ScaleSpacePosition> >::iterator track = tracks.begin();
+  TrackSet::iterator track = tracks.begin();
   std::vector<cv::Scalar>::iterator color = colors.begin();
   Track<ScaleSpacePosition>::iterator element = track->begin();
   bool changed = true;
+  // The overlay only needs to be drawn again when something changes.
+  bool redraw = true;
+  bool reindex = FLAGS_show_others;
 
   bool marker_set = false;
   Track<ScaleSpacePosition>::iterator marker_element;
@@ -104,20 +172,34 @@ int main(int argc, char** argv) {
 
     // Load image if required.
     if (changed) {
-      std::string file = makeImageFilename(image_format, t);
-      ok = readColorImage(file, image);
+      ok = video.get(t, image);
       CHECK(ok) << "Could not load image";
       changed = false;
+      redraw = true;
+    }
+
+    if (reindex) {
+      indexTracks(tracks, pointers, index);
+      reindex = false;
+      redraw = true;
     }
 
-    // Clone image.
-    display = image.clone();
+    if (redraw) {
+      // Clone image.
+      display = image.clone();
 
-    // Draw feature.
-    ScaleSpaceFeatureDrawer drawer(position, FLAGS_radius);
-    drawer.draw(display, *color, FLAGS_line_thickness);
+      if (FLAGS_show_others) {
+        drawOtherTracks(display, pointers, index, *track, t);
+      }
+
+      // Draw feature.
+      ScaleSpaceFeatureDrawer drawer(position, FLAGS_radius);
+      drawer.draw(display, *color, FLAGS_line_thickness);
+
+      cv::imshow("Tracks", display);
+      redraw = false;
+    }
 
-    cv::imshow("Tracks", display);
     char c = cv::waitKey(30);
 
     if (c == 27) {
@@ -186,6 +268,7 @@ int main(int argc, char** argv) {
 
           marker_set = false;
           changed = true;
+          reindex = FLAGS_show_others;
         } else if (c == 'x') {
           // Delete current frame.
           track->erase(element++);
@@ -208,6 +291,7 @@ int main(int argc, char** argv) {
 
           marker_set = false;
           changed = true;
+          reindex = FLAGS_show_others;
         } else if (c == 'v') {
           if (marker_set) {
             marker_set = false;
@@ -244,6 +328,7 @@ int main(int argc, char** argv) {
 
             marker_set = false;
             changed = true;
+            reindex = FLAGS_show_others;
           } else {
             LOG(INFO) << "No marker set";
           }
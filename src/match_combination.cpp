@@ -0,0 +1,155 @@
+#include "match_combination.hpp"
+#include <algorithm>
+#include <iterator>
+#include <glog/logging.h>
+
+namespace {
+
+bool compareSecond(const Match& x, const Match& y) {
+  return Match(x.second, x.first) < Match(y.second, y.first);
+}
+
+bool compareFirst(const Match& x, const Match& y) {
+  return x.first < y.first;
+}
+
+bool compareIndices(const MatchResult& x, const MatchResult& y) {
+  return Match(x.index1, x.index2) < Match(y.index1, y.index2);
+}
+
+bool sameIndices(const MatchResult& x, const MatchResult& y) {
+  return x.index1 == y.index1 && x.index2 == y.index2;
+}
+
+void forwardConsistentMatches(std::vector<Match>& forward,
+                              std::vector<Match>& reverse,
+                              std::vector<Match>& matches) {
+  // Take the forward matches whose feature in the second image is unique.
+  std::sort(forward.begin(), forward.end(), compareSecond);
+  std::vector<Match> unique;
+
+  std::vector<Match>::const_iterator match = forward.begin();
+  while (match != forward.end()) {
+    std::vector<Match>::const_iterator next = match + 1;
+    while (next != forward.end() && next->second == match->second) {
+      ++next;
+    }
+    if (next - match == 1) {
+      unique.push_back(*match);
+    }
+    match = next;
+  }
+
+  // Of several for one feature in the first image, keep the last.
+  std::sort(unique.begin(), unique.end());
+  // Of several reverse matches, keep the first in the file.
+  std::stable_sort(reverse.begin(), reverse.end(), compareFirst);
+
+  matches.clear();
+  std::vector<Match>::const_iterator x = unique.begin();
+  std::vector<Match>::const_iterator y = reverse.begin();
+
+  while (x != unique.end() || y != reverse.end()) {
+    if (y == reverse.end() || (x != unique.end() && x->first <= y->first)) {
+      int first = x->first;
+      while (x + 1 != unique.end() && (x + 1)->first == first) {
+        ++x;
+      }
+      matches.push_back(*x);
+      ++x;
+
+      // Forward matches replace reverse matches.
+      while (y != reverse.end() && y->first == first) {
+        ++y;
+      }
+    } else {
+      int first = y->first;
+      matches.push_back(*y);
+      while (y != reverse.end() && y->first == first) {
+        ++y;
+      }
+    }
+  }
+}
+
+Match flipMatch(const Match& match) {
+  return match.flip();
+}
+
+MatchResult flipResult(const MatchResult& result) {
+  return MatchResult(result.index2, result.index1, result.distance);
+}
+
+// Sorts and removes all but the first of several matches between the same
+// features.
+void makeSet(std::vector<MatchResult>& matches) {
+  std::stable_sort(matches.begin(), matches.end(), compareIndices);
+  matches.erase(std::unique(matches.begin(), matches.end(), sameIndices),
+      matches.end());
+}
+
+}
+
+void flipMatches(std::vector<Match>& matches) {
+  std::transform(matches.begin(), matches.end(), matches.begin(), flipMatch);
+}
+
+void flipMatches(std::vector<MatchResult>& matches) {
+  std::transform(matches.begin(), matches.end(), matches.begin(), flipResult);
+}
+
+void combineMatches(std::vector<Match>& forward,
+                    std::vector<Match>& reverse,
+                    MatchCombination combination,
+                    std::vector<Match>& matches) {
+  if (combination == MATCH_FORWARD_CONSISTENT) {
+    forwardConsistentMatches(forward, reverse, matches);
+    return;
+  }
+
+  std::sort(forward.begin(), forward.end());
+  std::sort(reverse.begin(), reverse.end());
+
+  matches.clear();
+  if (combination == MATCH_RECIPROCAL) {
+    std::set_intersection(forward.begin(), forward.end(), reverse.begin(),
+        reverse.end(), std::back_inserter(matches));
+  } else {
+    std::set_union(forward.begin(), forward.end(), reverse.begin(),
+        reverse.end(), std::back_inserter(matches));
+  }
+}
+
+void combineMatchResults(std::vector<MatchResult>& forward,
+                         std::vector<MatchResult>& reverse,
+                         MatchCombination combination,
+                         std::vector<MatchResult>& matches) {
+  CHECK(combination != MATCH_FORWARD_CONSISTENT) <<
+      "Forward consistency is not supported with distances";
+
+  makeSet(forward);
+  makeSet(reverse);
+
+  matches.clear();
+  std::vector<MatchResult>::const_iterator x = forward.begin();
+  std::vector<MatchResult>::const_iterator y = reverse.begin();
+
+  while (x != forward.end() || y != reverse.end()) {
+    if (y == reverse.end() || (x != forward.end() && compareIndices(*x, *y))) {
+      if (combination == MATCH_UNION) {
+        matches.push_back(*x);
+      }
+      ++x;
+    } else if (x == forward.end() || compareIndices(*y, *x)) {
+      if (combination == MATCH_UNION) {
+        matches.push_back(*y);
+      }
+      ++y;
+    } else {
+      CHECK(x->distance == y->distance) << "Values did not match";
+      matches.push_back(*x);
+      ++x;
+      ++y;
+    }
+  }
+}
@@ -0,0 +1,43 @@
+#ifndef MATCH_COMBINATION_HPP_
+#define MATCH_COMBINATION_HPP_
+
+#include <vector>
+#include "match.hpp"
+#include "match_result.hpp"
+
+// Combines the matches from image 1 to image 2 with the matches from image 2
+// to image 1, which must already be flipped so that their first index is in
+// image 1.
+//
+// Each combination sorts the two lists in place once and then makes one
+// pass over them.
+enum MatchCombination {
+  // Every match in either direction.
+  MATCH_UNION,
+  // Matches found in both directions.
+  MATCH_RECIPROCAL,
+  // Forward matches whose feature in image 2 is not matched to any other
+  // feature, plus reverse matches for the remaining features of image 1.
+  // Each feature in image 1 is matched at most once.
+  MATCH_FORWARD_CONSISTENT
+};
+
+// Swaps the images of every match, to bring the reverse matches into the
+// order of the forward matches.
+void flipMatches(std::vector<Match>& matches);
+void flipMatches(std::vector<MatchResult>& matches);
+
+void combineMatches(std::vector<Match>& forward,
+                    std::vector<Match>& reverse,
+                    MatchCombination combination,
+                    std::vector<Match>& matches);
+
+// Only the first of several matches between the same features is kept. The
+// distance of a match found in both directions must be the same in each.
+// Forward consistency is not supported.
+void combineMatchResults(std::vector<MatchResult>& forward,
+                         std::vector<MatchResult>& reverse,
+                         MatchCombination combination,
+                         std::vector<MatchResult>& matches);
+
+#endif
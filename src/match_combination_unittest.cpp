@@ -0,0 +1,207 @@
+#include "match_combination.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <map>
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace {
+
+const int NUM_TRIALS = 200;
+// Few features, so that matches collide and repeat.
+const int NUM_FEATURES = 8;
+const int MAX_MATCHES = 20;
+
+// The combinations as combine-matches computed them with maps before they
+// became sorted passes.
+
+void referenceForwardConsistent(const std::vector<Match>& forward,
+                                const std::vector<Match>& reverse,
+                                std::vector<Match>& matches) {
+  std::multimap<int, int> inverted;
+  for (int i = 0; i < int(forward.size()); i += 1) {
+    inverted.insert(std::make_pair(forward[i].second, forward[i].first));
+  }
+
+  // Forward matches whose feature in the second image is unique.
+  std::map<int, int> matches_set;
+  std::multimap<int, int>::const_iterator pair = inverted.begin();
+  while (pair != inverted.end()) {
+    if (inverted.count(pair->first) == 1) {
+      matches_set[pair->second] = pair->first;
+    }
+    pair = inverted.upper_bound(pair->first);
+  }
+
+  // Reverse matches of the remaining features, the first of several.
+  std::map<int, int> reverse_set;
+  for (int i = 0; i < int(reverse.size()); i += 1) {
+    reverse_set.insert(std::make_pair(reverse[i].first, reverse[i].second));
+  }
+  std::map<int, int>::const_iterator match;
+  for (match = reverse_set.begin(); match != reverse_set.end(); ++match) {
+    matches_set.insert(*match);
+  }
+
+  matches.clear();
+  for (match = matches_set.begin(); match != matches_set.end(); ++match) {
+    matches.push_back(Match(match->first, match->second));
+  }
+}
+
+void referenceMatchResults(const std::vector<MatchResult>& forward,
+                           const std::vector<MatchResult>& reverse,
+                           MatchCombination combination,
+                           std::vector<MatchResult>& matches) {
+  // Maps keep the first of several matches.
+  std::map<Match, double> forward_set;
+  std::map<Match, double> reverse_set;
+  for (int i = 0; i < int(forward.size()); i += 1) {
+    forward_set.insert(std::make_pair(Match(forward[i].index1,
+            forward[i].index2), forward[i].distance));
+  }
+  for (int i = 0; i < int(reverse.size()); i += 1) {
+    reverse_set.insert(std::make_pair(Match(reverse[i].index1,
+            reverse[i].index2), reverse[i].distance));
+  }
+
+  std::map<Match, double> match_set;
+  std::map<Match, double>::const_iterator match;
+  for (match = forward_set.begin(); match != forward_set.end(); ++match) {
+    if (combination == MATCH_UNION || reverse_set.count(match->first) > 0) {
+      match_set.insert(*match);
+    }
+  }
+  if (combination == MATCH_UNION) {
+    match_set.insert(reverse_set.begin(), reverse_set.end());
+  }
+
+  matches.clear();
+  for (match = match_set.begin(); match != match_set.end(); ++match) {
+    matches.push_back(MatchResult(match->first, match->second));
+  }
+}
+
+void randomMatches(std::vector<Match>& matches) {
+  matches.clear();
+  int n = std::rand() % MAX_MATCHES;
+  for (int i = 0; i < n; i += 1) {
+    matches.push_back(Match(std::rand() % NUM_FEATURES,
+          std::rand() % NUM_FEATURES));
+  }
+}
+
+// Matches between the same features have the same distance in both
+// directions.
+void randomMatchResults(std::vector<MatchResult>& matches) {
+  std::vector<Match> indices;
+  randomMatches(indices);
+  matches.clear();
+  for (int i = 0; i < int(indices.size()); i += 1) {
+    double distance = indices[i].first * NUM_FEATURES + indices[i].second;
+    matches.push_back(MatchResult(indices[i], distance));
+  }
+}
+
+bool equal(const std::vector<Match>& x, const std::vector<Match>& y) {
+  if (x.size() != y.size()) {
+    return false;
+  }
+  for (int i = 0; i < int(x.size()); i += 1) {
+    if (x[i].pair() != y[i].pair()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+TEST(CombineMatches, UnionAndIntersectionAreSetOperations) {
+  std::srand(1);
+  for (int trial = 0; trial < NUM_TRIALS; trial += 1) {
+    std::vector<Match> forward;
+    std::vector<Match> reverse;
+    randomMatches(forward);
+    randomMatches(reverse);
+
+    std::vector<Match> forward_set(forward);
+    std::vector<Match> reverse_set(reverse);
+    std::sort(forward_set.begin(), forward_set.end());
+    std::sort(reverse_set.begin(), reverse_set.end());
+    std::vector<Match> expected_union;
+    std::set_union(forward_set.begin(), forward_set.end(),
+        reverse_set.begin(), reverse_set.end(),
+        std::back_inserter(expected_union));
+    std::vector<Match> expected_intersection;
+    std::set_intersection(forward_set.begin(), forward_set.end(),
+        reverse_set.begin(), reverse_set.end(),
+        std::back_inserter(expected_intersection));
+
+    std::vector<Match> matches;
+    std::vector<Match> x(forward);
+    std::vector<Match> y(reverse);
+    combineMatches(x, y, MATCH_UNION, matches);
+    EXPECT_TRUE(equal(expected_union, matches));
+
+    x = forward;
+    y = reverse;
+    combineMatches(x, y, MATCH_RECIPROCAL, matches);
+    EXPECT_TRUE(equal(expected_intersection, matches));
+  }
+}
+
+TEST(CombineMatches, ForwardConsistentMatchesReference) {
+  std::srand(2);
+  for (int trial = 0; trial < NUM_TRIALS; trial += 1) {
+    std::vector<Match> forward;
+    std::vector<Match> reverse;
+    randomMatches(forward);
+    randomMatches(reverse);
+
+    std::vector<Match> expected;
+    referenceForwardConsistent(forward, reverse, expected);
+
+    std::vector<Match> matches;
+    combineMatches(forward, reverse, MATCH_FORWARD_CONSISTENT, matches);
+    EXPECT_TRUE(equal(expected, matches)) << "Trial " << trial;
+  }
+}
+
+TEST(CombineMatchResults, MatchesReference) {
+  std::srand(3);
+  for (int trial = 0; trial < NUM_TRIALS; trial += 1) {
+    std::vector<MatchResult> forward;
+    std::vector<MatchResult> reverse;
+    randomMatchResults(forward);
+    randomMatchResults(reverse);
+
+    MatchCombination combinations[] = { MATCH_UNION, MATCH_RECIPROCAL };
+    for (int i = 0; i < 2; i += 1) {
+      std::vector<MatchResult> expected;
+      referenceMatchResults(forward, reverse, combinations[i], expected);
+
+      std::vector<MatchResult> x(forward);
+      std::vector<MatchResult> y(reverse);
+      std::vector<MatchResult> matches;
+      combineMatchResults(x, y, combinations[i], matches);
+      EXPECT_TRUE(matches == expected) << "Trial " << trial;
+    }
+  }
+}
+
+TEST(FlipMatches, SwapsImages) {
+  std::vector<Match> matches;
+  matches.push_back(Match(1, 2));
+  flipMatches(matches);
+  EXPECT_EQ(2, matches[0].first);
+  EXPECT_EQ(1, matches[0].second);
+
+  std::vector<MatchResult> results;
+  results.push_back(MatchResult(3, 4, 0.5));
+  flipMatches(results);
+  EXPECT_EQ(4, results[0].index1);
+  EXPECT_EQ(3, results[0].index2);
+  EXPECT_EQ(0.5, results[0].distance);
+}
+
+}
@@ -11,13 +11,21 @@
 #include "unique_match_result.hpp"
 #include "find_matches.hpp"
 #include "find_unique_matches.hpp"
+#include "descriptor_index.hpp"
+#include "descriptor_matrix.hpp"
+#include "epipolar_candidates.hpp"
+#include "sift_position.hpp"
+#include "camera_properties.hpp"
+#include "pca_projection.hpp"
 
-#include "descriptor_reader.hpp"
-#include "iterator_reader.hpp"
+#include "feature_files.hpp"
+#include "camera_properties_reader.hpp"
+#include "matrix_reader.hpp"
+#include "pca_projection_reader.hpp"
 
 #include "iterator_writer.hpp"
-#include "match_result_writer.hpp"
 #include "unique_match_result_writer.hpp"
+#include "util/trace.hpp"
 
 DEFINE_bool(unique, false, "Only take best match");
 
@@ -30,6 +38,30 @@ DEFINE_double(absolute_threshold, 1,
 
 DEFINE_bool(use_flann, true,
     "Use FLANN (fast but approximate) to find nearest neighbours.");
+DEFINE_bool(use_gpu, false,
+    "Find exact nearest neighbours on a CUDA device rather than with FLANN, "
+    "if built with WITH_GPU");
+DEFINE_string(pca, "",
+    "Project both sets of descriptors with this PCA model before matching. "
+    "Distances are then between the projected descriptors.");
+DEFINE_bool(cache_index, false,
+    "Save the FLANN index beside the second descriptors file and re-use it?");
+DEFINE_string(reverse_matches, "",
+    "Also save matches from the second set to the first to this file. "
+    "Equivalent to swapping the inputs, but a brute-force search computes "
+    "each distance only once.");
+
+DEFINE_string(fund_mat, "",
+    "Only compare descriptors whose keypoints are near the epipolar line of "
+    "this fundamental matrix. Requires keypoints and intrinsics.");
+DEFINE_string(keypoints1, "", "Keypoints of the first descriptors");
+DEFINE_string(keypoints2, "", "Keypoints of the second descriptors");
+DEFINE_string(intrinsics1, "", "Intrinsics of the first camera");
+DEFINE_string(intrinsics2, "", "Intrinsics of the second camera");
+DEFINE_double(epipolar_band, 4.,
+    "Maximum distance in pixels from the epipolar line");
+DEFINE_string(trace, "",
+    "File to write a trace of each stage to, if built with tracing");
 
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
@@ -52,8 +84,96 @@ void init(int& argc, char**& argv) {
   }
 }
 
+void loadKeypointPositions(const std::string& file,
+                           std::vector<cv::Point2d>& points) {
+  std::vector<SiftPosition> keypoints;
+  bool ok = loadSiftPositions(file, keypoints);
+  CHECK(ok) << "Could not load keypoints";
+
+  points.clear();
+  std::vector<SiftPosition>::const_iterator keypoint;
+  for (keypoint = keypoints.begin(); keypoint != keypoints.end(); ++keypoint) {
+    points.push_back(cv::Point2d(keypoint->x, keypoint->y));
+  }
+}
+
+// Finds the features in the second image near each epipolar line.
+void loadEpipolarCandidates(int num_points1,
+                            int num_points2,
+                            std::vector<std::vector<int> >& candidates) {
+  cv::Mat F;
+  MatrixReader matrix_reader;
+  bool ok = load(FLAGS_fund_mat, F, matrix_reader);
+  CHECK(ok) << "Could not load fundamental matrix";
+
+  CameraProperties camera1;
+  CameraProperties camera2;
+  CameraPropertiesReader camera_reader;
+  ok = load(FLAGS_intrinsics1, camera1, camera_reader);
+  CHECK(ok) << "Could not load intrinsics for first camera";
+  ok = load(FLAGS_intrinsics2, camera2, camera_reader);
+  CHECK(ok) << "Could not load intrinsics for second camera";
+
+  std::vector<cv::Point2d> points1;
+  std::vector<cv::Point2d> points2;
+  loadKeypointPositions(FLAGS_keypoints1, points1);
+  loadKeypointPositions(FLAGS_keypoints2, points2);
+  CHECK(int(points1.size()) == num_points1) <<
+      "Number of keypoints and descriptors differ";
+  CHECK(int(points2.size()) == num_points2) <<
+      "Number of keypoints and descriptors differ";
+
+  EpipolarCandidateFinder finder(camera1, camera2, F, points2,
+      FLAGS_epipolar_band);
+  findEpipolarCandidates(finder, points1, candidates);
+
+  int num_candidates = 0;
+  for (int i = 0; i < num_points1; i += 1) {
+    num_candidates += candidates[i].size();
+  }
+  LOG(INFO) << "Comparing " << num_candidates << " of " <<
+      num_points1 * num_points2 << " pairs near epipolar lines";
+}
+
+void buildIndex(const DescriptorMatrix& descriptors, DescriptorIndex& index) {
+  if (FLAGS_use_gpu) {
+    index.buildOnGpu(descriptors);
+  } else {
+    index.build(descriptors, FLAGS_use_flann);
+  }
+}
+
+void saveUniqueMatches(const std::string& file,
+                       const std::vector<UniqueQueryResult>& query_results) {
+  TRACE_SCOPE("save");
+  // Convert from query to match representation.
+  std::vector<UniqueMatchResult> matches;
+  convertUniqueQueryResultsToMatches(query_results, matches, true);
+  LOG(INFO) << "Found " << matches.size() << " matches";
+  TRACE_COUNT("matches", matches.size());
+
+  UniqueMatchResultWriter writer;
+  bool ok = saveList(file, matches, writer);
+  CHECK(ok) << "Could not save list of matches";
+}
+
+void saveMatches(const std::string& file,
+                 const QueryResultTable& query_results) {
+  TRACE_SCOPE("save");
+  // Flatten out lists of query results to match results.
+  std::vector<MatchResult> matches;
+  convertQueryResultTableToMatches(query_results, matches, true);
+  LOG(INFO) << "Found " << matches.size() << " matches";
+  TRACE_COUNT("matches", matches.size());
+
+  bool ok = saveMatchResults(file, matches);
+  CHECK(ok) << "Could not save list of matches";
+}
+
 int main(int argc, char** argv) {
   init(argc, argv);
+  TRACE_INIT(FLAGS_trace);
+  TRACE_STAGES(stages);
 
   std::string descriptors_file1 = argv[1];
   std::string descriptors_file2 = argv[2];
@@ -62,47 +182,115 @@ int main(int argc, char** argv) {
   bool ok;
 
   // Load descriptors.
-  DescriptorReader descriptor_reader;
-  std::deque<Descriptor> descriptors1;
-  ok = loadList(descriptors_file1, descriptors1, descriptor_reader);
+  TRACE_NEXT_STAGE(stages, "load");
+  DescriptorMatrix descriptors1;
+  ok = loadDescriptorMatrix(descriptors_file1, descriptors1,
+      ANY_DESCRIPTOR_TYPE);
   CHECK(ok) << "Could not load first descriptors file";
-  LOG(INFO) << "Loaded " << descriptors1.size() << " descriptors";
+  LOG(INFO) << "Loaded " << descriptors1.rows() << " descriptors";
 
-  std::deque<Descriptor> descriptors2;
-  ok = loadList(descriptors_file2, descriptors2, descriptor_reader);
+  DescriptorMatrix descriptors2;
+  ok = loadDescriptorMatrix(descriptors_file2, descriptors2,
+      ANY_DESCRIPTOR_TYPE);
   CHECK(ok) << "Could not load second descriptors file";
-  LOG(INFO) << "Loaded " << descriptors2.size() << " descriptors";
+  LOG(INFO) << "Loaded " << descriptors2.rows() << " descriptors";
+
+  // The index of projected descriptors is cached under a different name.
+  std::string index_file2 = descriptors_file2;
+
+  if (!FLAGS_pca.empty()) {
+    PcaProjection projection;
+    PcaProjectionReader projection_reader;
+    ok = load(FLAGS_pca, projection, projection_reader);
+    CHECK(ok) << "Could not load PCA model";
+
+    DescriptorMatrix projected1;
+    DescriptorMatrix projected2;
+    projection.project(descriptors1, projected1);
+    projection.project(descriptors2, projected2);
+    descriptors1 = projected1;
+    descriptors2 = projected2;
+    index_file2 = makeProjectedDescriptorsFilename(descriptors_file2);
+    LOG(INFO) << "Projected descriptors to " << projection.numComponents() <<
+        " dimensions";
+  }
+
+  if (!FLAGS_fund_mat.empty()) {
+    CHECK(FLAGS_reverse_matches.empty()) <<
+        "Epipolar constraint only supports one direction";
+
+    std::vector<std::vector<int> > candidates;
+    loadEpipolarCandidates(descriptors1.rows(), descriptors2.rows(),
+        candidates);
+    TRACE_NEXT_STAGE(stages, "match");
+
+    if (FLAGS_unique) {
+      std::vector<UniqueQueryResult> matches;
+      findUniqueMatchesUsingCandidates(descriptors1, descriptors2, candidates,
+          matches);
+      saveUniqueMatches(matches_file, matches);
+    } else {
+      QueryResultTable matches;
+      findMatchesUsingCandidates(descriptors1, descriptors2, candidates,
+          matches, FLAGS_use_max_num, FLAGS_max_num,
+          FLAGS_use_absolute_threshold, FLAGS_absolute_threshold);
+      saveMatches(matches_file, matches);
+    }
+
+    return 0;
+  }
+
+  // Index the descriptors which are searched.
+  // When matching many files against one, the index is built only once.
+  TRACE_NEXT_STAGE(stages, "index");
+  DescriptorIndex index2;
+  if (FLAGS_use_flann && FLAGS_cache_index && !FLAGS_use_gpu) {
+    loadOrBuildDescriptorIndex(descriptors2, index_file2, index2);
+  } else {
+    buildIndex(descriptors2, index2);
+  }
+
+  bool both_directions = !FLAGS_reverse_matches.empty();
+  TRACE_NEXT_STAGE(stages, "match");
 
   if (FLAGS_unique) {
-    // Find one match in each direction.
     std::vector<UniqueQueryResult> forward_matches;
-    findUniqueMatchesUsingEuclideanDistance(descriptors1, descriptors2,
-        forward_matches, FLAGS_use_flann);
+    std::vector<UniqueQueryResult> reverse_matches;
 
-    // Convert from query to match representation.
-    std::vector<UniqueMatchResult> matches;
-    convertUniqueQueryResultsToMatches(forward_matches, matches, true);
-    LOG(INFO) << "Found " << matches.size() << " matches";
+    if (!both_directions) {
+      findUniqueMatchesUsingIndex(descriptors1, index2, forward_matches);
+    } else {
+      DescriptorIndex index1;
+      buildIndex(descriptors1, index1);
+      findUniqueMatchesInBothDirectionsUsingIndices(index1, index2,
+          forward_matches, reverse_matches);
+    }
 
-    UniqueMatchResultWriter writer;
-    ok = saveList(matches_file, matches, writer);
-    CHECK(ok) << "Could not save list of matches";
+    saveUniqueMatches(matches_file, forward_matches);
+    if (both_directions) {
+      saveUniqueMatches(FLAGS_reverse_matches, reverse_matches);
+    }
   } else {
-    // Find several matches in each direction.
-    std::deque<QueryResultList> forward_matches;
-    findMatchesUsingEuclideanDistance(descriptors1, descriptors2,
-        forward_matches, FLAGS_use_max_num, FLAGS_max_num,
-        FLAGS_use_absolute_threshold, FLAGS_absolute_threshold,
-        FLAGS_use_flann);
-
-    // Flatten out lists of query results to match results.
-    std::vector<MatchResult> matches;
-    convertQueryResultListsToMatches(forward_matches, matches, true);
-    LOG(INFO) << "Found " << matches.size() << " matches";
-
-    MatchResultWriter writer;
-    ok = saveList(matches_file, matches, writer);
-    CHECK(ok) << "Could not save list of matches";
+    // Find several matches for each descriptor.
+    QueryResultTable forward_matches;
+    QueryResultTable reverse_matches;
+
+    if (!both_directions) {
+      findMatchesUsingIndex(descriptors1, index2, forward_matches,
+          FLAGS_use_max_num, FLAGS_max_num, FLAGS_use_absolute_threshold,
+          FLAGS_absolute_threshold);
+    } else {
+      DescriptorIndex index1;
+      buildIndex(descriptors1, index1);
+      findMatchesInBothDirectionsUsingIndices(index1, index2, forward_matches,
+          reverse_matches, FLAGS_use_max_num, FLAGS_max_num,
+          FLAGS_use_absolute_threshold, FLAGS_absolute_threshold);
+    }
+
+    saveMatches(matches_file, forward_matches);
+    if (both_directions) {
+      saveMatches(FLAGS_reverse_matches, reverse_matches);
+    }
   }
 
   return 0;
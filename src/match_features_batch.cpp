@@ -0,0 +1,988 @@
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <map>
+#include <set>
+#include <utility>
+#include <algorithm>
+#include <cstdlib>
+#include <stdint.h>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "descriptor_index.hpp"
+#include "descriptor_matrix.hpp"
+#include "image_index.hpp"
+#include "image_pairs.hpp"
+#include "match_result.hpp"
+#include "unique_match_result.hpp"
+#include "find_matches.hpp"
+#include "find_unique_matches.hpp"
+#include "vocabulary_tree.hpp"
+
+#include "read_lines.hpp"
+#include "binary_file.hpp"
+#include "feature_files.hpp"
+#include "vocabulary_tree_reader.hpp"
+
+#include "iterator_writer.hpp"
+#include "unique_match_result_writer.hpp"
+#include "util/metrics.hpp"
+#include "util/numa.hpp"
+#include "util/thread-pool.hpp"
+#include "util/trace.hpp"
+
+DEFINE_bool(unique, false, "Only take best match");
+
+DEFINE_bool(use_max_num, false, "Limit number of matches");
+DEFINE_int32(max_num, 1, "Maximum number of matches");
+
+DEFINE_bool(use_absolute_threshold, false, "Use absolute distance threshold");
+DEFINE_double(absolute_threshold, 1,
+    "Maximum appearance distance between features");
+
+DEFINE_bool(use_flann, true,
+    "Use FLANN (fast but approximate) to find nearest neighbours.");
+DEFINE_bool(use_gpu, false,
+    "Keep the descriptors of each loaded image on a CUDA device and find "
+    "exact nearest neighbours there, if built with WITH_GPU");
+
+DEFINE_string(vocabulary_tree, "",
+    "Only match each image to its most similar images according to this "
+    "tree, as saved by cluster-descriptors");
+DEFINE_int32(max_num_similar, 10,
+    "Number of similar images to match each image to");
+DEFINE_string(pairs, "",
+    "Only match the pairs in this list, as written by plan-image-pairs");
+
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads to match with, 0 to match serially");
+DEFINE_bool(numa, false,
+    "Split the workers, images and pairs between the NUMA nodes, so that "
+    "most pairs are matched next to the descriptors of both images");
+DEFINE_string(trace, "",
+    "File to write a trace of each stage to, if built with tracing");
+DEFINE_int32(metrics_port, 0,
+    "Port on which to serve metrics at /metrics while matching, 0 for none");
+
+DEFINE_int32(block_rows, 2048,
+    "Split pairs into tasks of this many descriptors of the first image, "
+    "0 for one task per pair");
+DEFINE_string(ledger, "",
+    "File to write the descriptors, time and matches of every pair to");
+DEFINE_string(schedule_ledger, "",
+    "Ledger of an earlier run, to start the pairs which took longest first");
+
+DEFINE_int32(num_shards, 1,
+    "Number of parts to split the pairs into, e.g. one per machine");
+DEFINE_int32(shard, 0, "Which part of the pairs to match, from zero");
+DEFINE_int32(shard_tile, 64,
+    "Pairs are assigned to shards in tiles of this many by this many images");
+DEFINE_string(match_list, "",
+    "File to list the match files of this shard in, one per line");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Computes matches between all pairs of images." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " view-names num-frames descriptors-format "
+      "matches-format" << std::endl;
+  usage << std::endl;
+  usage << "view-names -- Input. One view name per line." << std::endl;
+  usage << "descriptors-format -- Input. Takes view name and frame." <<
+      std::endl;
+  usage << "matches-format -- Output. Takes two view names and two frames." <<
+      std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 5) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+// Frames are numbered from one in filenames.
+std::string makeDescriptorsFilename(const std::string& format,
+                                    const std::string& view,
+                                    int time) {
+  return boost::str(boost::format(format) % view % (time + 1));
+}
+
+std::string makeMatchFilename(const std::string& format,
+                              const std::string& view1,
+                              const std::string& view2,
+                              int time1,
+                              int time2) {
+  return boost::str(
+      boost::format(format) % view1 % view2 % (time1 + 1) % (time2 + 1));
+}
+
+double currentTime() {
+  return double(cv::getTickCount()) / cv::getTickFrequency();
+}
+
+// Counts one finished task of a stage, if metrics are enabled.
+void recordTask(Metrics* metrics,
+                const std::string& stage,
+                const std::string& counter,
+                double start) {
+  if (metrics == NULL) {
+    return;
+  }
+  metrics->add(counter, 1);
+  metrics->change("queue_depth{stage=\"" + stage + "\"}", -1);
+  metrics->observe("stage_seconds{stage=\"" + stage + "\"}",
+      currentTime() - start);
+}
+
+// One index per image, in view-major order.
+typedef std::vector<boost::shared_ptr<DescriptorIndex> > IndexList;
+
+int imageNumber(const ImageIndex& image, int num_frames) {
+  return image.view * num_frames + image.time;
+}
+
+// Interleaves the bits of two numbers.
+uint64_t zOrder(uint32_t x, uint32_t y) {
+  uint64_t z = 0;
+  for (int b = 0; b < 32; b += 1) {
+    z |= uint64_t((x >> b) & 1) << (2 * b);
+    z |= uint64_t((y >> b) & 1) << (2 * b + 1);
+  }
+  return z;
+}
+
+// Splits the space of pairs of images into parts which each need the
+// descriptors of a fraction of the images.
+//
+// Pairs (i, j) of image numbers are grouped into tiles of tile x tile
+// images. Tiles are ordered along a Z-order curve, which visits squares of
+// tiles one after another, and runs of consecutive tiles go to each part,
+// balanced by number of pairs. Every pair goes to exactly one part, the same
+// for any order of the pairs.
+void assignTiles(const std::vector<ImagePair>& pairs,
+                 int num_parts,
+                 int tile,
+                 int num_frames,
+                 std::vector<int>& parts) {
+  std::vector<uint64_t> tiles;
+  std::map<uint64_t, int> sizes;
+  std::vector<ImagePair>::const_iterator pair;
+  for (pair = pairs.begin(); pair != pairs.end(); ++pair) {
+    int i = imageNumber(pair->first, num_frames);
+    int j = imageNumber(pair->second, num_frames);
+    uint64_t key = zOrder(std::min(i, j) / tile, std::max(i, j) / tile);
+    tiles.push_back(key);
+    sizes[key] += 1;
+  }
+
+  // Assign each tile by the middle of its range of pairs.
+  double total = pairs.size();
+  double before = 0;
+  std::map<uint64_t, int> tile_parts;
+  std::map<uint64_t, int>::const_iterator size;
+  for (size = sizes.begin(); size != sizes.end(); ++size) {
+    int part = int((before + 0.5 * size->second) / total * num_parts);
+    tile_parts[size->first] = std::min(part, num_parts - 1);
+    before += size->second;
+  }
+
+  parts.clear();
+  for (int k = 0; k < int(pairs.size()); k += 1) {
+    parts.push_back(tile_parts[tiles[k]]);
+  }
+}
+
+// Keeps the pairs of one shard, so that several machines can share a batch.
+// The pairs of a shard keep their order.
+void selectShard(int shard,
+                 int num_shards,
+                 int tile,
+                 int num_frames,
+                 std::vector<ImagePair>& pairs) {
+  std::vector<int> shards;
+  assignTiles(pairs, num_shards, tile, num_frames, shards);
+
+  std::vector<ImagePair> selected;
+  for (int k = 0; k < int(pairs.size()); k += 1) {
+    if (shards[k] == shard) {
+      selected.push_back(pairs[k]);
+    }
+  }
+  pairs.swap(selected);
+}
+
+// Numbers of the images in any pair.
+void listImagesOfPairs(const std::vector<ImagePair>& pairs,
+                       int num_frames,
+                       std::vector<int>& images) {
+  std::set<int> set;
+  std::vector<ImagePair>::const_iterator pair;
+  for (pair = pairs.begin(); pair != pairs.end(); ++pair) {
+    set.insert(imageNumber(pair->first, num_frames));
+    set.insert(imageNumber(pair->second, num_frames));
+  }
+  images.assign(set.begin(), set.end());
+}
+
+// Loads the descriptors of one image and indexes them.
+// For use with ThreadPool::parallelFor().
+class LoadIndexFunction {
+  public:
+    LoadIndexFunction(const std::string& format,
+                      const std::vector<std::string>& views,
+                      int num_frames,
+                      const std::vector<int>& images,
+                      IndexList& indices,
+                      bool copy_mapped,
+                      Metrics* metrics)
+        : format_(&format),
+          views_(&views),
+          num_frames_(num_frames),
+          images_(&images),
+          indices_(&indices),
+          copy_mapped_(copy_mapped),
+          metrics_(metrics) {}
+
+    void operator()(int k) const {
+      TRACE_SCOPE("load image");
+      double start = currentTime();
+      int i = (*images_)[k];
+      int view = i / num_frames_;
+      int time = i % num_frames_;
+      std::string file = makeDescriptorsFilename(*format_, (*views_)[view],
+          time);
+
+      DescriptorMatrix descriptors;
+      // Kept in their stored type, which the index widens as it reads.
+      bool ok = loadDescriptorMatrix(file, descriptors, ANY_DESCRIPTOR_TYPE);
+      CHECK(ok) << "Could not load descriptors \"" << file << "\"";
+      // Rows mapped from a binary file are in the page cache, which may be
+      // on another node.
+      if (copy_mapped_ && isBinaryFilename(file)) {
+        descriptors = descriptors.clone();
+      }
+
+      (*indices_)[i].reset(new DescriptorIndex);
+      if (FLAGS_use_gpu) {
+        (*indices_)[i]->buildOnGpu(descriptors);
+      } else {
+        (*indices_)[i]->build(descriptors, FLAGS_use_flann);
+      }
+
+      recordTask(metrics_, "load", "images_loaded_total", start);
+    }
+
+  private:
+    const std::string* format_;
+    const std::vector<std::string>* views_;
+    int num_frames_;
+    const std::vector<int>* images_;
+    IndexList* indices_;
+    bool copy_mapped_;
+    Metrics* metrics_;
+};
+
+// What matching one pair of images took, to find the pairs which set the
+// running time of a batch and to schedule later batches.
+struct PairLedger {
+  int num_descriptors1;
+  int num_descriptors2;
+  // Pairs of descriptors which could match.
+  double num_candidates;
+  int num_blocks;
+  // Summed over blocks, including saving.
+  double seconds;
+  int num_matches;
+
+  PairLedger();
+};
+
+PairLedger::PairLedger()
+    : num_descriptors1(0),
+      num_descriptors2(0),
+      num_candidates(0),
+      num_blocks(0),
+      seconds(0),
+      num_matches(0) {}
+
+// Rows [begin, end) of the first image of a pair. One task.
+struct MatchBlock {
+  int pair;
+  // Number of the block within the pair.
+  int index;
+  int begin;
+  int end;
+  // Expected time, in any unit.
+  double cost;
+
+  MatchBlock(int pair, int index, int begin, int end);
+};
+
+MatchBlock::MatchBlock(int pair, int index, int begin, int end)
+    : pair(pair), index(index), begin(begin), end(end), cost(0) {}
+
+// Orders by decreasing cost, then as the pairs were given.
+bool isLongerBlock(const MatchBlock& lhs, const MatchBlock& rhs) {
+  if (lhs.cost != rhs.cost) {
+    return lhs.cost > rhs.cost;
+  }
+  if (lhs.pair != rhs.pair) {
+    return lhs.pair < rhs.pair;
+  }
+  return lhs.begin < rhs.begin;
+}
+
+// Splits a pair into blocks of at most block_rows rows, 0 for one block.
+void appendBlocks(int pair,
+                  int num_rows,
+                  int block_rows,
+                  std::vector<MatchBlock>& blocks) {
+  if (block_rows <= 0 || num_rows <= block_rows) {
+    blocks.push_back(MatchBlock(pair, 0, 0, num_rows));
+    return;
+  }
+  for (int begin = 0; begin < num_rows; begin += block_rows) {
+    blocks.push_back(MatchBlock(pair, begin / block_rows, begin,
+          std::min(begin + block_rows, num_rows)));
+  }
+}
+
+std::string ledgerKey(const std::string& view1,
+                      int time1,
+                      const std::string& view2,
+                      int time2) {
+  return boost::str(boost::format("%s %d %s %d") % view1 % (time1 + 1) %
+      view2 % (time2 + 1));
+}
+
+// One line per pair, frames numbered from one as in filenames.
+bool saveLedger(const std::string& filename,
+                const std::vector<std::string>& views,
+                const std::vector<ImagePair>& pairs,
+                const std::vector<PairLedger>& ledger) {
+  std::ofstream stream(filename.c_str());
+  if (!stream.good()) {
+    return false;
+  }
+
+  stream << "# view1 frame1 view2 frame2 descriptors1 descriptors2 "
+      "candidates blocks seconds matches" << std::endl;
+  for (int i = 0; i < int(pairs.size()); i += 1) {
+    const ImageIndex& image1 = pairs[i].first;
+    const ImageIndex& image2 = pairs[i].second;
+    const PairLedger& entry = ledger[i];
+    stream << ledgerKey(views[image1.view], image1.time, views[image2.view],
+        image2.time) << " " << entry.num_descriptors1 << " " <<
+        entry.num_descriptors2 << " " << entry.num_candidates << " " <<
+        entry.num_blocks << " " << entry.seconds << " " <<
+        entry.num_matches << std::endl;
+  }
+  return stream.good();
+}
+
+// Reads the time of every pair and the time per candidate overall.
+bool loadLedgerTimes(const std::string& filename,
+                     std::map<std::string, double>& times,
+                     double& seconds_per_candidate) {
+  std::ifstream stream(filename.c_str());
+  if (!stream.good()) {
+    return false;
+  }
+
+  double total_seconds = 0;
+  double total_candidates = 0;
+  std::string line;
+  while (std::getline(stream, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    std::istringstream fields(line);
+    std::string view1;
+    std::string view2;
+    int frame1;
+    int frame2;
+    int num_descriptors1;
+    int num_descriptors2;
+    double num_candidates;
+    int num_blocks;
+    double seconds;
+    fields >> view1 >> frame1 >> view2 >> frame2 >> num_descriptors1 >>
+        num_descriptors2 >> num_candidates >> num_blocks >> seconds;
+    if (fields.fail()) {
+      return false;
+    }
+
+    times[ledgerKey(view1, frame1 - 1, view2, frame2 - 1)] = seconds;
+    total_seconds += seconds;
+    total_candidates += num_candidates;
+  }
+
+  seconds_per_candidate = (total_candidates > 0) ?
+      total_seconds / total_candidates : 0;
+  return true;
+}
+
+// Logs how unevenly the time is spread over pairs, and how long the batch
+// could have taken on the given number of workers.
+void reportSkew(const std::vector<std::string>& views,
+                const std::vector<ImagePair>& pairs,
+                const std::vector<PairLedger>& ledger,
+                int num_workers,
+                double makespan) {
+  int n = ledger.size();
+  if (n == 0) {
+    return;
+  }
+
+  std::vector<std::pair<double, int> > times;
+  double total = 0;
+  for (int i = 0; i < n; i += 1) {
+    times.push_back(std::make_pair(ledger[i].seconds, i));
+    total += ledger[i].seconds;
+  }
+  std::sort(times.begin(), times.end());
+
+  double median = times[n / 2].first;
+  double slowest = times.back().first;
+  LOG(INFO) << boost::format("Pair times: median %.4f s, 90%% %.4f s, "
+      "99%% %.4f s, max %.4f s (%.1f times the median)") % median %
+      times[int(0.9 * (n - 1))].first % times[int(0.99 * (n - 1))].first %
+      slowest % (median > 0 ? slowest / median : 0.);
+  LOG(INFO) << boost::format("Matched in %.2f s on %d workers, at least "
+      "%.2f s with perfect balance") % makespan % num_workers %
+      (total / num_workers);
+
+  const int NUM_SLOWEST = 5;
+  for (int k = 0; k < NUM_SLOWEST && k < n; k += 1) {
+    int i = times[n - 1 - k].second;
+    const ImageIndex& image1 = pairs[i].first;
+    const ImageIndex& image2 = pairs[i].second;
+    const PairLedger& entry = ledger[i];
+    LOG(INFO) << boost::format("Slow pair %s: %.4f s, %d x %d descriptors, "
+        "%d blocks, %d matches") % ledgerKey(views[image1.view],
+          image1.time, views[image2.view], image2.time) % entry.seconds %
+        entry.num_descriptors1 % entry.num_descriptors2 % entry.num_blocks %
+        entry.num_matches;
+  }
+}
+
+// Matches of every block of a pair, until the last block is done.
+struct PairResults {
+  std::vector<QueryResultTable> tables;
+  std::vector<std::vector<UniqueQueryResult> > unique;
+  int num_remaining;
+
+  PairResults();
+};
+
+PairResults::PairResults() : tables(), unique(), num_remaining(0) {}
+
+// Appends the queries of a table to another.
+void appendTable(const QueryResultTable& block, QueryResultTable& table) {
+  if (table.offsets.empty()) {
+    table.offsets.push_back(0);
+  }
+  int offset = table.results.size();
+  for (int i = 0; i < block.numQueries(); i += 1) {
+    table.offsets.push_back(offset + block.offsets[i + 1]);
+  }
+  table.results.insert(table.results.end(), block.results.begin(),
+      block.results.end());
+}
+
+// Matches one block of a pair of images, and saves the result of the pair
+// once all of its blocks are done.
+// For use with ThreadPool::parallelFor().
+class MatchBlockFunction {
+  public:
+    MatchBlockFunction(const std::string& format,
+                       const std::vector<std::string>& views,
+                       int num_frames,
+                       const std::vector<ImagePair>& pairs,
+                       const IndexList& indices,
+                       const std::vector<MatchBlock>& blocks,
+                       std::vector<PairResults>& results,
+                       std::vector<PairLedger>& ledger,
+                       boost::mutex& mutex,
+                       Metrics* metrics)
+        : format_(&format),
+          views_(&views),
+          num_frames_(num_frames),
+          pairs_(&pairs),
+          indices_(&indices),
+          blocks_(&blocks),
+          results_(&results),
+          ledger_(&ledger),
+          mutex_(&mutex),
+          metrics_(metrics) {}
+
+    void operator()(int i) const {
+      const MatchBlock& block = (*blocks_)[i];
+      double start = currentTime();
+      const ImageIndex& image1 = (*pairs_)[block.pair].first;
+      const ImageIndex& image2 = (*pairs_)[block.pair].second;
+      const DescriptorIndex& index1 =
+          *(*indices_)[imageNumber(image1, num_frames_)];
+      const DescriptorIndex& index2 =
+          *(*indices_)[imageNumber(image2, num_frames_)];
+      PairResults& results = (*results_)[block.pair];
+      int b = block.index;
+
+      {
+        TRACE_SCOPE("match block");
+        if (FLAGS_unique) {
+          findUniqueMatchesUsingIndices(index1, block.begin, block.end,
+              index2, results.unique[b]);
+        } else {
+          findMatchesUsingIndices(index1, block.begin, block.end, index2,
+              results.tables[b], FLAGS_use_max_num, FLAGS_max_num,
+              FLAGS_use_absolute_threshold, FLAGS_absolute_threshold);
+        }
+      }
+      recordTask(metrics_, "match", "blocks_matched_total", start);
+
+      bool last;
+      {
+        boost::mutex::scoped_lock lock(*mutex_);
+        (*ledger_)[block.pair].seconds += currentTime() - start;
+        results.num_remaining -= 1;
+        last = (results.num_remaining == 0);
+      }
+      if (last) {
+        save(block.pair);
+      }
+    }
+
+  private:
+    // Joins the blocks of a pair and saves them.
+    void save(int pair) const {
+      TRACE_SCOPE("save pair");
+      double start = currentTime();
+      const ImageIndex& image1 = (*pairs_)[pair].first;
+      const ImageIndex& image2 = (*pairs_)[pair].second;
+      PairResults& results = (*results_)[pair];
+      std::string file = makeMatchFilename(*format_,
+          (*views_)[image1.view], (*views_)[image2.view], image1.time,
+          image2.time);
+
+      bool ok;
+      int num_matches;
+      if (FLAGS_unique) {
+        std::vector<UniqueQueryResult> forward_matches;
+        for (int b = 0; b < int(results.unique.size()); b += 1) {
+          forward_matches.insert(forward_matches.end(),
+              results.unique[b].begin(), results.unique[b].end());
+        }
+
+        std::vector<UniqueMatchResult> matches;
+        convertUniqueQueryResultsToMatches(forward_matches, matches, true);
+
+        TRACE_COUNT("matches", matches.size());
+        num_matches = matches.size();
+        UniqueMatchResultWriter writer;
+        ok = saveList(file, matches, writer);
+      } else {
+        QueryResultTable forward_matches;
+        for (int b = 0; b < int(results.tables.size()); b += 1) {
+          appendTable(results.tables[b], forward_matches);
+        }
+
+        std::vector<MatchResult> matches;
+        convertQueryResultTableToMatches(forward_matches, matches, true);
+
+        TRACE_COUNT("matches", matches.size());
+        num_matches = matches.size();
+        ok = saveMatchResults(file, matches);
+      }
+      CHECK(ok) << "Could not save matches \"" << file << "\"";
+
+      // Free the blocks.
+      std::vector<QueryResultTable>().swap(results.tables);
+      std::vector<std::vector<UniqueQueryResult> >().swap(results.unique);
+
+      {
+        boost::mutex::scoped_lock lock(*mutex_);
+        PairLedger& entry = (*ledger_)[pair];
+        entry.seconds += currentTime() - start;
+        entry.num_matches = num_matches;
+      }
+
+      if (metrics_ != NULL) {
+        metrics_->add("pairs_matched_total", 1);
+        metrics_->add("matches_total", num_matches);
+      }
+    }
+
+    const std::string* format_;
+    const std::vector<std::string>* views_;
+    int num_frames_;
+    const std::vector<ImagePair>* pairs_;
+    const IndexList* indices_;
+    const std::vector<MatchBlock>* blocks_;
+    std::vector<PairResults>* results_;
+    std::vector<PairLedger>* ledger_;
+    boost::mutex* mutex_;
+    Metrics* metrics_;
+};
+
+// The workers of one NUMA node, and the images and blocks assigned to it.
+struct NodeWork {
+  NumaNode node;
+  boost::shared_ptr<ThreadPool> pool;
+  std::vector<int> images;
+  std::vector<MatchBlock> blocks;
+};
+
+// Splits the workers evenly between the nodes, and pins each share to its
+// node. With a negative number, every CPU of every node works. The thread
+// which runs the loop of each node also works, so with fewer threads than
+// nodes only as many nodes as threads are used.
+void startNodePools(const std::vector<NumaNode>& nodes,
+                    int num_threads,
+                    std::vector<NodeWork>& work) {
+  int num_nodes = nodes.size();
+  int total = num_threads + 1;
+  if (num_threads >= 0) {
+    num_nodes = std::min(num_nodes, total);
+  }
+  work.assign(num_nodes, NodeWork());
+
+  for (int n = 0; n < num_nodes; n += 1) {
+    work[n].node = nodes[n];
+    int num_workers = -1;
+    if (num_threads >= 0) {
+      int share = total / num_nodes + (n < total % num_nodes ? 1 : 0);
+      num_workers = std::max(share - 1, 0);
+    }
+    work[n].pool.reset(new ThreadPool(num_workers, nodes[n].cpus));
+  }
+}
+
+// Assigns each image to the node whose pairs use it most, so that it is
+// loaded there.
+void assignImageNodes(const std::vector<ImagePair>& pairs,
+                      const std::vector<int>& pair_nodes,
+                      int num_frames,
+                      std::vector<NodeWork>& work) {
+  std::map<int, std::vector<int> > uses;
+  for (int k = 0; k < int(pairs.size()); k += 1) {
+    int images[2] = { imageNumber(pairs[k].first, num_frames),
+                      imageNumber(pairs[k].second, num_frames) };
+    for (int i = 0; i < 2; i += 1) {
+      std::vector<int>& counts = uses[images[i]];
+      counts.resize(work.size(), 0);
+      counts[pair_nodes[k]] += 1;
+    }
+  }
+
+  std::map<int, std::vector<int> >::const_iterator image;
+  for (image = uses.begin(); image != uses.end(); ++image) {
+    const std::vector<int>& counts = image->second;
+    int node = std::max_element(counts.begin(), counts.end()) -
+        counts.begin();
+    work[node].images.push_back(image->first);
+  }
+}
+
+// Pins the calling thread to the CPUs of a node and runs a loop on the pool
+// of the node, which the thread joins as one more worker.
+void runOnNode(const NodeWork* work,
+               int size,
+               const ThreadPool::IndexFunction* function) {
+  bindThreadToCpus(work->node.cpus);
+  work->pool->parallelFor(0, size, *function);
+}
+
+// Runs a loop on every node at once, and waits for all of them.
+void runOnNodes(const std::vector<NodeWork>& work,
+                const std::vector<int>& sizes,
+                const std::vector<ThreadPool::IndexFunction>& functions) {
+  boost::thread_group threads;
+  for (int n = 0; n < int(work.size()); n += 1) {
+    threads.create_thread(boost::bind(runOnNode, &work[n], sizes[n],
+          &functions[n]));
+  }
+  threads.join_all();
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+  TRACE_INIT(FLAGS_trace);
+  TRACE_STAGES(stages);
+
+  std::string view_names_file = argv[1];
+  int num_frames = boost::lexical_cast<int>(argv[2]);
+  std::string descriptors_format = argv[3];
+  std::string matches_format = argv[4];
+
+  bool ok;
+
+  std::vector<std::string> views;
+  ok = readLines(view_names_file, views);
+  CHECK(ok) << "Could not load view names";
+  int num_views = views.size();
+
+  // With NUMA, the pools of the nodes do all of the work.
+  std::vector<NodeWork> node_work;
+  if (FLAGS_numa) {
+    std::vector<NumaNode> nodes;
+    listNumaNodes(nodes);
+    if (nodes.empty()) {
+      LOG(WARNING) << "No NUMA nodes found, matching without";
+    } else {
+      startNodePools(nodes, FLAGS_num_threads, node_work);
+      LOG(INFO) << "Matching on " << node_work.size() << " of " <<
+          nodes.size() << " NUMA nodes";
+    }
+  }
+  bool use_numa = !node_work.empty();
+  int num_nodes = node_work.size();
+  ThreadPool pool(use_numa ? 0 : FLAGS_num_threads);
+
+  Metrics metrics;
+  MetricsServer server(metrics);
+  Metrics* served = NULL;
+  if (FLAGS_metrics_port > 0) {
+    ok = server.start(FLAGS_metrics_port);
+    CHECK(ok) << "Could not serve metrics on port " << FLAGS_metrics_port;
+    served = &metrics;
+  }
+
+  CHECK(FLAGS_num_shards > 0);
+  CHECK(FLAGS_shard >= 0 && FLAGS_shard < FLAGS_num_shards) <<
+      "Shard must be less than the number of shards";
+  CHECK(FLAGS_shard_tile > 0);
+  CHECK(FLAGS_pairs.empty() || FLAGS_vocabulary_tree.empty()) <<
+      "Give either a list of pairs or a vocabulary tree, plan-image-pairs "
+      "can combine them";
+
+  // Parse and index every image once, rather than once per pair.
+  IndexList indices(num_views * num_frames);
+  std::vector<int> images;
+  std::vector<ImagePair> pairs;
+  // Node of each pair, with NUMA.
+  std::vector<int> pair_nodes;
+
+  if (FLAGS_vocabulary_tree.empty()) {
+    TRACE_NEXT_STAGE(stages, "select pairs");
+    if (FLAGS_pairs.empty()) {
+      appendExhaustiveImagePairs(num_views, num_frames, pairs);
+    } else {
+      ok = loadImagePairList(FLAGS_pairs, views, num_frames, pairs);
+      CHECK(ok) << "Could not load pairs \"" << FLAGS_pairs << "\"";
+    }
+    selectShard(FLAGS_shard, FLAGS_num_shards, FLAGS_shard_tile, num_frames,
+        pairs);
+
+    // Only the images of this shard.
+    TRACE_NEXT_STAGE(stages, "load");
+    listImagesOfPairs(pairs, num_frames, images);
+    metrics.set("queue_depth{stage=\"load\"}", images.size());
+    if (!use_numa) {
+      pool.parallelFor(0, images.size(),
+          LoadIndexFunction(descriptors_format, views, num_frames, images,
+            indices, false, served));
+    } else {
+      // Tiles of pairs of nearby images go to the same node, where the
+      // images they use most are loaded.
+      assignTiles(pairs, num_nodes, FLAGS_shard_tile, num_frames,
+          pair_nodes);
+      assignImageNodes(pairs, pair_nodes, num_frames, node_work);
+    }
+  } else {
+    // Every image is scored against every other.
+    TRACE_NEXT_STAGE(stages, "load");
+    for (int i = 0; i < int(indices.size()); i += 1) {
+      images.push_back(i);
+    }
+    metrics.set("queue_depth{stage=\"load\"}", images.size());
+    if (!use_numa) {
+      pool.parallelFor(0, images.size(),
+          LoadIndexFunction(descriptors_format, views, num_frames, images,
+            indices, false, served));
+    } else {
+      // The pairs are not known until the images are loaded. Ranges of
+      // images go to each node.
+      for (int i = 0; i < int(images.size()); i += 1) {
+        int node = int(int64_t(i) * num_nodes / images.size());
+        node_work[node].images.push_back(images[i]);
+      }
+    }
+  }
+
+  // First touch by the workers of a node places the descriptors and index
+  // of each of its images in the memory of that node. Mapped descriptors are
+  // copied for this.
+  if (use_numa) {
+    std::vector<int> sizes;
+    std::vector<ThreadPool::IndexFunction> functions;
+    for (int n = 0; n < num_nodes; n += 1) {
+      sizes.push_back(node_work[n].images.size());
+      functions.push_back(LoadIndexFunction(descriptors_format, views,
+            num_frames, node_work[n].images, indices, true, served));
+    }
+    runOnNodes(node_work, sizes, functions);
+  }
+
+  if (!FLAGS_vocabulary_tree.empty()) {
+    TRACE_NEXT_STAGE(stages, "select pairs");
+    VocabularyTree tree;
+    VocabularyTreeReader tree_reader;
+    ok = load(FLAGS_vocabulary_tree, tree, tree_reader);
+    CHECK(ok) << "Could not load vocabulary tree";
+
+    int num_images = indices.size();
+    std::vector<std::vector<int> > similar(num_images);
+    for (int i = 0; i < num_images; i += 1) {
+      findSimilarImages(tree, indices[i]->descriptors(), i, num_images,
+          FLAGS_max_num_similar, similar[i]);
+    }
+    appendSimilarImagePairs(similar, num_frames, pairs);
+    selectShard(FLAGS_shard, FLAGS_num_shards, FLAGS_shard_tile, num_frames,
+        pairs);
+
+    if (use_numa) {
+      // Every query of a pair searches all of the second image, which is
+      // then read most.
+      std::vector<int> image_nodes(indices.size(), 0);
+      for (int n = 0; n < num_nodes; n += 1) {
+        std::vector<int>::const_iterator image;
+        for (image = node_work[n].images.begin();
+             image != node_work[n].images.end(); ++image) {
+          image_nodes[*image] = n;
+        }
+      }
+      std::vector<ImagePair>::const_iterator pair;
+      for (pair = pairs.begin(); pair != pairs.end(); ++pair) {
+        pair_nodes.push_back(
+            image_nodes[imageNumber(pair->second, num_frames)]);
+      }
+    }
+  }
+  LOG(INFO) << "Loaded descriptors for " << images.size() << " images";
+  LOG(INFO) << "Matching " << pairs.size() << " pairs of images";
+
+  TRACE_NEXT_STAGE(stages, "schedule");
+  std::map<std::string, double> previous_times;
+  double seconds_per_candidate = 0;
+  if (!FLAGS_schedule_ledger.empty()) {
+    ok = loadLedgerTimes(FLAGS_schedule_ledger, previous_times,
+        seconds_per_candidate);
+    CHECK(ok) << "Could not load ledger \"" << FLAGS_schedule_ledger << "\"";
+  }
+
+  int num_pairs = pairs.size();
+  std::vector<PairLedger> ledger(num_pairs);
+  std::vector<PairResults> results(num_pairs);
+  std::vector<MatchBlock> blocks;
+  for (int i = 0; i < num_pairs; i += 1) {
+    const ImageIndex& image1 = pairs[i].first;
+    const ImageIndex& image2 = pairs[i].second;
+    PairLedger& entry = ledger[i];
+    entry.num_descriptors1 = indices[imageNumber(image1, num_frames)]->size();
+    entry.num_descriptors2 = indices[imageNumber(image2, num_frames)]->size();
+    entry.num_candidates = double(entry.num_descriptors1) *
+        entry.num_descriptors2;
+
+    int first = blocks.size();
+    appendBlocks(i, entry.num_descriptors1, FLAGS_block_rows, blocks);
+    entry.num_blocks = blocks.size() - first;
+    results[i].num_remaining = entry.num_blocks;
+    if (FLAGS_unique) {
+      results[i].unique.resize(entry.num_blocks);
+    } else {
+      results[i].tables.resize(entry.num_blocks);
+    }
+
+    // Expect the time of the earlier run if there was one, otherwise a time
+    // proportional to the number of candidates.
+    double cost = entry.num_candidates;
+    std::map<std::string, double>::const_iterator previous =
+        previous_times.find(ledgerKey(views[image1.view], image1.time,
+              views[image2.view], image2.time));
+    if (previous != previous_times.end() && seconds_per_candidate > 0) {
+      cost = previous->second / seconds_per_candidate;
+    }
+    for (int b = first; b < int(blocks.size()); b += 1) {
+      if (entry.num_descriptors1 > 0) {
+        blocks[b].cost = cost * (blocks[b].end - blocks[b].begin) /
+            entry.num_descriptors1;
+      }
+    }
+  }
+
+  // Start the longest blocks first so that none is left to run alone at the
+  // end.
+  std::sort(blocks.begin(), blocks.end(), isLongerBlock);
+  LOG(INFO) << "Split " << num_pairs << " pairs into " << blocks.size() <<
+      " blocks";
+
+  TRACE_NEXT_STAGE(stages, "match");
+  metrics.set("queue_depth{stage=\"match\"}", blocks.size());
+  boost::mutex mutex;
+  double start = currentTime();
+  int num_workers;
+  if (!use_numa) {
+    pool.parallelFor(0, blocks.size(),
+        MatchBlockFunction(matches_format, views, num_frames, pairs, indices,
+          blocks, results, ledger, mutex, served));
+    // The calling thread also works.
+    num_workers = pool.numThreads() + 1;
+  } else {
+    // Each node keeps the longest first order of its own blocks.
+    std::vector<MatchBlock>::const_iterator block;
+    for (block = blocks.begin(); block != blocks.end(); ++block) {
+      node_work[pair_nodes[block->pair]].blocks.push_back(*block);
+    }
+
+    std::vector<int> sizes;
+    std::vector<ThreadPool::IndexFunction> functions;
+    num_workers = 0;
+    for (int n = 0; n < num_nodes; n += 1) {
+      sizes.push_back(node_work[n].blocks.size());
+      functions.push_back(MatchBlockFunction(matches_format, views,
+            num_frames, pairs, indices, node_work[n].blocks, results, ledger,
+            mutex, served));
+      num_workers += node_work[n].pool->numThreads() + 1;
+      LOG(INFO) << "Node " << node_work[n].node.id << ": " <<
+          node_work[n].images.size() << " images, " <<
+          node_work[n].blocks.size() << " blocks";
+    }
+    runOnNodes(node_work, sizes, functions);
+  }
+  double makespan = currentTime() - start;
+
+  reportSkew(views, pairs, ledger, num_workers, makespan);
+
+  if (!FLAGS_ledger.empty()) {
+    ok = saveLedger(FLAGS_ledger, views, pairs, ledger);
+    CHECK(ok) << "Could not save ledger \"" << FLAGS_ledger << "\"";
+  }
+
+  if (!FLAGS_match_list.empty()) {
+    std::ofstream stream(FLAGS_match_list.c_str());
+    std::vector<ImagePair>::const_iterator pair;
+    for (pair = pairs.begin(); pair != pairs.end(); ++pair) {
+      stream << makeMatchFilename(matches_format, views[pair->first.view],
+          views[pair->second.view], pair->first.time, pair->second.time) <<
+          std::endl;
+    }
+    CHECK(stream.good()) << "Could not save match list \"" <<
+        FLAGS_match_list << "\"";
+  }
+
+  return 0;
+}
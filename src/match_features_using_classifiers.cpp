@@ -4,18 +4,22 @@
 #include <glog/logging.h>
 #include <gflags/gflags.h>
 
-#include "descriptor.hpp"
+#include "descriptor_matrix.hpp"
 #include "classifier.hpp"
+#include "classifier_bank.hpp"
+#include "classifier_candidates.hpp"
 #include "find_matches.hpp"
 #include "find_unique_matches.hpp"
+#include "pca_projection.hpp"
 
 #include "iterator_reader.hpp"
-#include "descriptor_reader.hpp"
+#include "feature_files.hpp"
 #include "classifier_reader.hpp"
+#include "pca_projection_reader.hpp"
 
 #include "iterator_writer.hpp"
-#include "match_result_writer.hpp"
 #include "unique_match_result_writer.hpp"
+#include "util/thread-pool.hpp"
 
 DEFINE_bool(unique, false, "Only take best match");
 
@@ -26,6 +30,18 @@ DEFINE_bool(use_absolute_threshold, false, "Use absolute distance threshold");
 DEFINE_double(absolute_threshold, 1,
     "Maximum appearance distance between features");
 
+DEFINE_string(pca, "",
+    "Rank the descriptors for each classifier in the subspace of this PCA "
+    "projection of the descriptors, and only score the best exactly.");
+DEFINE_int32(num_candidates, 32,
+    "Number of descriptors each classifier scores exactly when ranking with "
+    "a projection");
+
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads to score classifiers with, 0 to score serially");
+DEFINE_bool(use_gpu, false,
+    "Score every descriptor on a CUDA device, if built with WITH_GPU");
+
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
   usage << "Computes matches between sets of descriptors." << std::endl;
@@ -44,6 +60,13 @@ void init(int& argc, char**& argv) {
     google::ShowUsageWithFlags(argv[0]);
     std::exit(1);
   }
+
+  if (!FLAGS_pca.empty()) {
+    CHECK(FLAGS_num_candidates > 0) << "--num_candidates must be positive";
+    // The second best candidate gives the distance ratio.
+    CHECK(!FLAGS_unique || FLAGS_num_candidates >= 2) <<
+        "--unique needs --num_candidates of at least 2";
+  }
 }
 
 int main(int argc, char** argv) {
@@ -63,16 +86,67 @@ int main(int argc, char** argv) {
   LOG(INFO) << "Loaded " << classifiers.size() << " classifiers";
 
   // Load descriptors.
-  DescriptorReader descriptor_reader;
-  std::deque<Descriptor> descriptors;
-  ok = loadList(descriptors_file, descriptors, descriptor_reader);
+  DescriptorMatrix descriptors;
+  ok = loadDescriptorMatrix(descriptors_file, descriptors);
   CHECK(ok) << "Could not load first descriptors file";
-  LOG(INFO) << "Loaded " << descriptors.size() << " descriptors";
+  LOG(INFO) << "Loaded " << descriptors.rows() << " descriptors";
+  CHECK(!FLAGS_unique || descriptors.rows() >= 2) <<
+      "--unique needs at least two descriptors";
+
+  // Score every descriptor with a block of classifiers at once.
+  ClassifierBank bank(classifiers);
+  if (FLAGS_use_gpu) {
+    bank.upload();
+  }
+  ThreadPool pool(FLAGS_num_threads);
 
-  if (FLAGS_unique) {
+  PcaProjection projection;
+  if (!FLAGS_pca.empty()) {
+    PcaProjectionReader projection_reader;
+    ok = load(FLAGS_pca, projection, projection_reader);
+    CHECK(ok) << "Could not load PCA model";
+  }
+
+  if (!projection.empty()) {
+    // The best two of the candidates.
+    int max_num = FLAGS_unique ? 2 : FLAGS_max_num;
+    bool use_max_num = FLAGS_unique || FLAGS_use_max_num;
+    bool use_threshold = !FLAGS_unique && FLAGS_use_absolute_threshold;
+
+    std::deque<QueryResultList> results;
+    findMatchesUsingClassifierCandidates(bank, projection, descriptors,
+        FLAGS_num_candidates, results, use_max_num, max_num, use_threshold,
+        FLAGS_absolute_threshold, &pool);
+
+    if (FLAGS_unique) {
+      std::vector<UniqueQueryResult> unique_results;
+      std::deque<QueryResultList>::const_iterator pair;
+      for (pair = results.begin(); pair != results.end(); ++pair) {
+        // Guaranteed by the checks of --num_candidates and the descriptors.
+        CHECK(pair->size() == 2);
+        unique_results.push_back(UniqueQueryResult((*pair)[0].index,
+              (*pair)[0].distance, (*pair)[1].distance));
+      }
+
+      std::vector<UniqueMatchResult> matches;
+      convertUniqueQueryResultsToMatches(unique_results, matches, true);
+      LOG(INFO) << "Found " << matches.size() << " matches";
+
+      UniqueMatchResultWriter match_writer;
+      ok = saveList(matches_file, matches, match_writer);
+      CHECK(ok) << "Could not save list of matches";
+    } else {
+      std::vector<MatchResult> matches;
+      convertQueryResultListsToMatches(results, matches, true);
+      LOG(INFO) << "Found " << matches.size() << " matches";
+
+      ok = saveMatchResults(matches_file, matches);
+      CHECK(ok) << "Could not save list of matches";
+    }
+  } else if (FLAGS_unique) {
     // Find best match for every feature in the other image.
     std::vector<UniqueQueryResult> results;
-    findUniqueMatchesUsingClassifiers(classifiers, descriptors, results);
+    findUniqueMatchesUsingClassifierBank(bank, descriptors, results, &pool);
 
     std::vector<UniqueMatchResult> matches;
     convertUniqueQueryResultsToMatches(results, matches, true);
@@ -87,16 +161,15 @@ int main(int argc, char** argv) {
     }
 
     std::deque<QueryResultList> results;
-    findMatchesUsingClassifiers(classifiers, descriptors, results,
+    findMatchesUsingClassifierBank(bank, descriptors, results,
         FLAGS_use_max_num, FLAGS_max_num, FLAGS_use_absolute_threshold,
-        FLAGS_absolute_threshold);
+        FLAGS_absolute_threshold, &pool);
 
     std::vector<MatchResult> matches;
     convertQueryResultListsToMatches(results, matches, true);
     LOG(INFO) << "Found " << matches.size() << " matches";
 
-    MatchResultWriter match_writer;
-    ok = saveList(matches_file, matches, match_writer);
+    ok = saveMatchResults(matches_file, matches);
     CHECK(ok) << "Could not save list of matches";
   }
 
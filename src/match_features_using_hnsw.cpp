@@ -0,0 +1,81 @@
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdlib>
+#include <sstream>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "descriptor_matrix.hpp"
+#include "hnsw_index.hpp"
+#include "find_hnsw_matches.hpp"
+#include "feature_files.hpp"
+#include "util/thread-pool.hpp"
+
+DEFINE_int32(max_num, 1, "Number of nearest neighbours to find");
+DEFINE_bool(use_absolute_threshold, false, "Use absolute distance threshold");
+DEFINE_double(absolute_threshold, 1,
+    "Maximum appearance distance between features");
+DEFINE_int32(search_ef, 0,
+    "Candidates explored by each search, 0 to keep those of the index");
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads to search with, 0 to search serially");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Finds the approximate nearest neighbours of descriptors in a "
+      "graph index." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " descriptors index matches" << std::endl;
+  usage << std::endl;
+  usage << "descriptors -- Input. Descriptors to match." << std::endl;
+  usage << "index -- Input. Output of add-to-hnsw-index." << std::endl;
+  usage << "matches -- Output. Pairwise association of indices, of the "
+      "descriptors and of the index." << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 4) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string descriptors_file = argv[1];
+  std::string index_file = argv[2];
+  std::string matches_file = argv[3];
+
+  bool ok;
+
+  DescriptorMatrix descriptors;
+  ok = loadDescriptorMatrix(descriptors_file, descriptors);
+  CHECK(ok) << "Could not load descriptors";
+  LOG(INFO) << "Loaded " << descriptors.rows() << " descriptors";
+
+  HnswIndex index;
+  ok = index.load(index_file);
+  CHECK(ok) << "Could not load index";
+  LOG(INFO) << "Loaded index of " << index.size() << " descriptors";
+  if (FLAGS_search_ef > 0) {
+    index.setSearchEf(FLAGS_search_ef);
+  }
+
+  ThreadPool pool(FLAGS_num_threads);
+  std::deque<QueryResultList> results;
+  findMatchesUsingHnswIndex(descriptors, index, results, true, FLAGS_max_num,
+      FLAGS_use_absolute_threshold, FLAGS_absolute_threshold, &pool);
+
+  std::vector<MatchResult> matches;
+  convertQueryResultListsToMatches(results, matches, true);
+  LOG(INFO) << "Found " << matches.size() << " matches";
+
+  ok = saveMatchResults(matches_file, matches);
+  CHECK(ok) << "Could not save list of matches";
+
+  return 0;
+}
@@ -0,0 +1,89 @@
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <sstream>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "descriptor_matrix.hpp"
+#include "product_quantizer.hpp"
+#include "find_matches.hpp"
+
+#include "feature_files.hpp"
+#include "product_quantizer_reader.hpp"
+#include "matrix_reader.hpp"
+
+DEFINE_bool(use_max_num, false, "Limit number of matches");
+DEFINE_int32(max_num, 1, "Maximum number of matches");
+
+DEFINE_bool(use_absolute_threshold, false, "Use absolute distance threshold");
+DEFINE_double(absolute_threshold, 1,
+    "Maximum appearance distance between features");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Computes approximate matches between descriptors and the codes "
+      "of another set." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " quantizer descriptors1 codes2 matches" << std::endl;
+  usage << std::endl;
+  usage << "quantizer -- Input. Used to encode the codes." << std::endl;
+  usage << "descriptors1 -- Input" << std::endl;
+  usage << "codes2 -- Input. Output of encode-descriptors." << std::endl;
+  usage << "matches -- Output. Pairwise association of indices" << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 5) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string quantizer_file = argv[1];
+  std::string descriptors_file = argv[2];
+  std::string codes_file = argv[3];
+  std::string matches_file = argv[4];
+
+  bool ok;
+
+  ProductQuantizer quantizer;
+  ProductQuantizerReader quantizer_reader;
+  ok = load(quantizer_file, quantizer, quantizer_reader);
+  CHECK(ok) << "Could not load quantizer";
+
+  DescriptorMatrix descriptors;
+  ok = loadDescriptorMatrix(descriptors_file, descriptors);
+  CHECK(ok) << "Could not load descriptors file";
+  LOG(INFO) << "Loaded " << descriptors.rows() << " descriptors";
+
+  cv::Mat code_matrix;
+  MatrixReader code_reader;
+  ok = load(codes_file, code_matrix, code_reader);
+  CHECK(ok) << "Could not load codes file";
+  DescriptorMatrix codes;
+  if (!code_matrix.empty()) {
+    copyToDescriptorMatrix(code_matrix, codes, cv::DataType<uchar>::type);
+  }
+  LOG(INFO) << "Loaded " << codes.rows() << " codes";
+
+  ProductCodeIndex index(quantizer, codes);
+  QueryResultTable results;
+  findMatchesUsingProductCodes(descriptors, index, results,
+      FLAGS_use_max_num, FLAGS_max_num, FLAGS_use_absolute_threshold,
+      FLAGS_absolute_threshold);
+
+  std::vector<MatchResult> matches;
+  convertQueryResultTableToMatches(results, matches, true);
+  LOG(INFO) << "Found " << matches.size() << " matches";
+
+  ok = saveMatchResults(matches_file, matches);
+  CHECK(ok) << "Could not save list of matches";
+
+  return 0;
+}
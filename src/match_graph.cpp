@@ -0,0 +1,207 @@
+#include "match_graph.hpp"
+#include <algorithm>
+#include <glog/logging.h>
+#include "util/thread-pool.hpp"
+
+MatchGraphEdge::MatchGraphEdge() : source(-1), target(-1), weight(0) {}
+
+MatchGraphEdge::MatchGraphEdge(int source, int target, double weight)
+    : source(source), target(target), weight(weight) {}
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+typedef std::vector<std::vector<size_t> > BlockCursors;
+
+size_t blockBegin(size_t num_edges, int num_blocks, int block) {
+  return num_edges * block / num_blocks;
+}
+
+// Counts the edges at each vertex within one block of edges.
+// For use with ThreadPool::parallelFor().
+class CountDegreesFunction {
+  public:
+    CountDegreesFunction(const std::vector<MatchGraphEdge>& edges,
+                         BlockCursors& counts)
+        : edges_(&edges), counts_(&counts) {}
+
+    void operator()(int block) const {
+      int num_blocks = counts_->size();
+      size_t begin = blockBegin(edges_->size(), num_blocks, block);
+      size_t end = blockBegin(edges_->size(), num_blocks, block + 1);
+      std::vector<size_t>& counts = (*counts_)[block];
+      int n = counts.size();
+
+      for (size_t i = begin; i < end; i += 1) {
+        const MatchGraphEdge& edge = (*edges_)[i];
+        CHECK(0 <= edge.source && edge.source < n);
+        CHECK(0 <= edge.target && edge.target < n);
+        counts[edge.source] += 1;
+        counts[edge.target] += 1;
+      }
+    }
+
+  private:
+    const std::vector<MatchGraphEdge>* edges_;
+    BlockCursors* counts_;
+};
+
+// Writes the edges of one block of edges at the cursors of that block.
+// Every block has its own range within the list of each vertex.
+class FillNeighborsFunction {
+  public:
+    FillNeighborsFunction(const std::vector<MatchGraphEdge>& edges,
+                          BlockCursors& cursors,
+                          std::vector<int>& neighbors,
+                          std::vector<double>& weights)
+        : edges_(&edges),
+          cursors_(&cursors),
+          neighbors_(&neighbors),
+          weights_(&weights) {}
+
+    void operator()(int block) const {
+      int num_blocks = cursors_->size();
+      size_t begin = blockBegin(edges_->size(), num_blocks, block);
+      size_t end = blockBegin(edges_->size(), num_blocks, block + 1);
+      std::vector<size_t>& cursors = (*cursors_)[block];
+
+      for (size_t i = begin; i < end; i += 1) {
+        const MatchGraphEdge& edge = (*edges_)[i];
+
+        size_t j = cursors[edge.source];
+        (*neighbors_)[j] = edge.target;
+        (*weights_)[j] = edge.weight;
+        cursors[edge.source] += 1;
+
+        j = cursors[edge.target];
+        (*neighbors_)[j] = edge.source;
+        (*weights_)[j] = edge.weight;
+        cursors[edge.target] += 1;
+      }
+    }
+
+  private:
+    const std::vector<MatchGraphEdge>* edges_;
+    BlockCursors* cursors_;
+    std::vector<int>* neighbors_;
+    std::vector<double>* weights_;
+};
+
+}
+
+MatchGraph::MatchGraph()
+    : features_(), offsets_(1, 0), neighbors_(), weights_() {}
+
+void MatchGraph::build(std::vector<FeatureIndex>& features,
+                       const std::vector<MatchGraphEdge>& edges,
+                       ThreadPool& pool) {
+  int n = features.size();
+
+  // One block per thread, including the caller. Each needs a count per
+  // vertex, so there are no more blocks than that.
+  int num_blocks = std::max(1, pool.numThreads() + 1);
+  num_blocks = std::min<size_t>(num_blocks, std::max<size_t>(edges.size(), 1));
+  BlockCursors cursors(num_blocks, std::vector<size_t>(n, 0));
+
+  pool.parallelFor(0, num_blocks, CountDegreesFunction(edges, cursors));
+
+  // Turn the counts into offsets. Within the list of each vertex, the edges
+  // of earlier blocks come first, so the result is independent of threads.
+  offsets_.assign(n + 1, 0);
+  size_t offset = 0;
+  for (int v = 0; v < n; v += 1) {
+    offsets_[v] = offset;
+    for (int b = 0; b < num_blocks; b += 1) {
+      size_t count = cursors[b][v];
+      cursors[b][v] = offset;
+      offset += count;
+    }
+  }
+  offsets_[n] = offset;
+
+  neighbors_.resize(offset);
+  weights_.resize(offset);
+  pool.parallelFor(0, num_blocks,
+      FillNeighborsFunction(edges, cursors, neighbors_, weights_));
+
+  features_.swap(features);
+  features.clear();
+}
+
+int MatchGraph::numVertices() const {
+  return features_.size();
+}
+
+size_t MatchGraph::numEdges() const {
+  return neighbors_.size() / 2;
+}
+
+const FeatureIndex& MatchGraph::operator[](int vertex) const {
+  return features_[vertex];
+}
+
+int MatchGraph::degree(int vertex) const {
+  return offsets_[vertex + 1] - offsets_[vertex];
+}
+
+const int* MatchGraph::neighbors(int vertex) const {
+  return neighbors_.empty() ? NULL : &neighbors_[offsets_[vertex]];
+}
+
+const double* MatchGraph::weights(int vertex) const {
+  return weights_.empty() ? NULL : &weights_[offsets_[vertex]];
+}
+
+void MatchGraph::clear() {
+  features_.clear();
+  offsets_.assign(1, 0);
+  neighbors_.clear();
+  weights_.clear();
+}
+
+void MatchGraph::swap(MatchGraph& other) {
+  features_.swap(other.features_);
+  offsets_.swap(other.offsets_);
+  neighbors_.swap(other.neighbors_);
+  weights_.swap(other.weights_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int findConnectedComponents(const MatchGraph& graph, std::vector<int>& labels) {
+  int n = graph.numVertices();
+  labels.assign(n, -1);
+
+  int num_components = 0;
+  std::vector<int> stack;
+
+  for (int root = 0; root < n; root += 1) {
+    if (labels[root] >= 0) {
+      continue;
+    }
+
+    // Depth-first search from the first unlabelled vertex.
+    labels[root] = num_components;
+    stack.push_back(root);
+
+    while (!stack.empty()) {
+      int vertex = stack.back();
+      stack.pop_back();
+
+      const int* neighbors = graph.neighbors(vertex);
+      int degree = graph.degree(vertex);
+      for (int i = 0; i < degree; i += 1) {
+        int neighbor = neighbors[i];
+        if (labels[neighbor] < 0) {
+          labels[neighbor] = num_components;
+          stack.push_back(neighbor);
+        }
+      }
+    }
+
+    num_components += 1;
+  }
+
+  return num_components;
+}
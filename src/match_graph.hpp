@@ -1,17 +1,64 @@
 #ifndef MATCH_GRAPH_HPP_
 #define MATCH_GRAPH_HPP_
 
-#include <boost/graph/adjacency_list.hpp>
+#include <cstddef>
+#include <vector>
 #include "feature_index.hpp"
 
-typedef boost::property<boost::edge_weight_t, double>
-        MatchGraphEdgeProperty;
+class ThreadPool;
 
-typedef boost::adjacency_list<boost::vecS,
-                              boost::vecS,
-                              boost::undirectedS,
-                              FeatureIndex,
-                              MatchGraphEdgeProperty>
-        MatchGraph;
+// A match between two vertices of a MatchGraph.
+struct MatchGraphEdge {
+  int source;
+  int target;
+  double weight;
+
+  MatchGraphEdge();
+  MatchGraphEdge(int source, int target, double weight);
+};
+
+// Undirected graph whose vertices are features and whose edges are matches.
+//
+// Read-only once built. Stored in compressed sparse row form: the neighbours
+// of every vertex are contiguous in one array, and the edge weights are kept
+// in a parallel array. Each edge appears in the lists of both its ends.
+class MatchGraph {
+  public:
+    MatchGraph();
+
+    // Builds the graph from a list of edges, each given once.
+    // Takes the contents of features, which are the vertices.
+    // Degrees are counted and neighbour lists filled by the threads of the
+    // pool, each over a block of edges.
+    void build(std::vector<FeatureIndex>& features,
+               const std::vector<MatchGraphEdge>& edges,
+               ThreadPool& pool);
+
+    int numVertices() const;
+    // Number of undirected edges.
+    size_t numEdges() const;
+
+    const FeatureIndex& operator[](int vertex) const;
+
+    int degree(int vertex) const;
+    // Arrays of length degree(vertex).
+    const int* neighbors(int vertex) const;
+    const double* weights(int vertex) const;
+
+    void clear();
+    void swap(MatchGraph& other);
+
+  private:
+    std::vector<FeatureIndex> features_;
+    // Start of the neighbours of each vertex, and the total at the end.
+    std::vector<size_t> offsets_;
+    std::vector<int> neighbors_;
+    std::vector<double> weights_;
+};
+
+// Labels every vertex with the index of its connected component.
+// Components are numbered in order of their first vertex.
+// Returns the number of components.
+int findConnectedComponents(const MatchGraph& graph, std::vector<int>& labels);
 
 #endif
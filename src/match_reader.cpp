@@ -13,3 +13,15 @@ bool MatchReader::read(const cv::FileNode& node, Match& match) {
 
   return true;
 }
+
+bool MatchReader::fields(std::vector<std::string>& keys) const {
+  keys.clear();
+  keys.push_back("index1");
+  keys.push_back("index2");
+  return true;
+}
+
+bool MatchReader::readFields(const FieldValues& values, Match& match) {
+  return readField<int>(values, 0, match.first) &&
+         readField<int>(values, 1, match.second);
+}
@@ -8,6 +8,8 @@ class MatchReader : public Reader<Match> {
   public:
     ~MatchReader();
     bool read(const cv::FileNode& node, Match& match);
+    bool fields(std::vector<std::string>& keys) const;
+    bool readFields(const FieldValues& values, Match& match);
 };
 
 #endif
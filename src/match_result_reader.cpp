@@ -20,3 +20,18 @@ bool MatchResultReader::read(const cv::FileNode& node, MatchResult& result) {
 
   return true;
 }
+
+bool MatchResultReader::fields(std::vector<std::string>& keys) const {
+  keys.clear();
+  keys.push_back("index1");
+  keys.push_back("index2");
+  keys.push_back("dist");
+  return true;
+}
+
+bool MatchResultReader::readFields(const FieldValues& values,
+                                   MatchResult& result) {
+  return readField<int>(values, 0, result.index1) &&
+         readField<int>(values, 1, result.index2) &&
+         readField<double>(values, 2, result.distance);
+}
@@ -8,6 +8,8 @@ class MatchResultReader : public Reader<MatchResult> {
   public:
     ~MatchResultReader();
     bool read(const cv::FileNode& node, MatchResult& result);
+    bool fields(std::vector<std::string>& keys) const;
+    bool readFields(const FieldValues& values, MatchResult& result);
 };
 
 #endif
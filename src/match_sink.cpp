@@ -0,0 +1,16 @@
+#include "match_sink.hpp"
+
+RawMatchListSink::RawMatchListSink(std::vector<RawMatchList>& matches)
+    : matches_(&matches) {}
+
+RawMatchListSink::~RawMatchListSink() {}
+
+void RawMatchListSink::begin(int num_queries) {
+  matches_->assign(num_queries, RawMatchList());
+}
+
+void RawMatchListSink::add(int query, int train, float distance) {
+  (*matches_)[query].push_back(cv::DMatch(query, train, 0, distance));
+}
+
+void RawMatchListSink::end() {}
@@ -0,0 +1,39 @@
+#ifndef MATCH_SINK_HPP_
+#define MATCH_SINK_HPP_
+
+#include <vector>
+#include <opencv2/features2d/features2d.hpp>
+
+// Receives the results of a nearest-neighbour search as they are found, so
+// that they can be filtered and stored without intermediate lists.
+//
+// Queries arrive in order. The matches of a query arrive together, in order
+// of increasing distance.
+class MatchSink {
+  public:
+    virtual ~MatchSink() {}
+
+    // Called before any matches.
+    virtual void begin(int num_queries) = 0;
+    virtual void add(int query, int train, float distance) = 0;
+    // Called after all matches.
+    virtual void end() = 0;
+};
+
+// Collects the matches of each query into a list.
+class RawMatchListSink : public MatchSink {
+  public:
+    typedef std::vector<cv::DMatch> RawMatchList;
+
+    explicit RawMatchListSink(std::vector<RawMatchList>& matches);
+    ~RawMatchListSink();
+
+    void begin(int num_queries);
+    void add(int query, int train, float distance);
+    void end();
+
+  private:
+    std::vector<RawMatchList>* matches_;
+};
+
+#endif
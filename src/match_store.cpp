@@ -0,0 +1,350 @@
+#include "match_store.hpp"
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <glog/logging.h>
+
+namespace {
+
+// The key of each group is the view and time of both images.
+const int PAIR_KEY_SIZE = 4;
+
+// Record flag of a store of unique match results.
+const uint32_t UNIQUE_MATCH_RESULTS = 1;
+
+// Compares pairs of images in the order of a store.
+bool pairBefore(const ImageIndex& a1,
+                const ImageIndex& a2,
+                const ImageIndex& b1,
+                const ImageIndex& b2) {
+  if (a1 != b1) {
+    return a1 < b1;
+  } else {
+    return a2 < b2;
+  }
+}
+
+// Second-best distances which are not finite in single precision are
+// infinite.
+float toNextBest(double next_best) {
+  if (next_best >= std::numeric_limits<float>::max()) {
+    return std::numeric_limits<float>::infinity();
+  }
+  return next_best;
+}
+
+double fromNextBest(float next_best) {
+  if (next_best == std::numeric_limits<float>::infinity()) {
+    return std::numeric_limits<double>::max();
+  }
+  return next_best;
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+MatchStore::MatchStore() : file_(), records_(NULL) {}
+
+bool MatchStore::open(const std::string& filename) {
+  records_ = NULL;
+  if (!file_.open(filename)) {
+    return false;
+  }
+
+  const BinaryFileHeader& header = file_.header();
+  if (header.record_type != uint32_t(BINARY_MATCH_STORE) ||
+      header.record_size != sizeof(MatchStoreRecord)) {
+    LOG(WARNING) << "`" << filename << "' is not a match store";
+    return false;
+  }
+  if (header.num_groups > 0 &&
+      (header.group_size != 1 || file_.groupKeySize() != PAIR_KEY_SIZE)) {
+    LOG(WARNING) << "`" << filename << "' has no index of pairs";
+    return false;
+  }
+
+  records_ = file_.records<MatchStoreRecord>(BINARY_MATCH_STORE);
+  return true;
+}
+
+bool MatchStore::isUnique() const {
+  return (file_.header().record_flags & UNIQUE_MATCH_RESULTS) != 0;
+}
+
+int MatchStore::numPairs() const {
+  return file_.numGroups();
+}
+
+int MatchStore::numMatches() const {
+  return file_.numRecords();
+}
+
+ImageIndex MatchStore::image1(int pair) const {
+  const int32_t* key = file_.groupKeys() + pair * PAIR_KEY_SIZE;
+  return ImageIndex(key[0], key[1]);
+}
+
+ImageIndex MatchStore::image2(int pair) const {
+  const int32_t* key = file_.groupKeys() + pair * PAIR_KEY_SIZE;
+  return ImageIndex(key[2], key[3]);
+}
+
+int MatchStore::find(const ImageIndex& image1,
+                     const ImageIndex& image2) const {
+  // First pair which is not before the given pair.
+  int lower = 0;
+  int upper = numPairs();
+  while (lower < upper) {
+    int middle = lower + (upper - lower) / 2;
+    if (pairBefore(this->image1(middle), this->image2(middle), image1,
+          image2)) {
+      lower = middle + 1;
+    } else {
+      upper = middle;
+    }
+  }
+
+  if (lower < numPairs() && this->image1(lower) == image1 &&
+      this->image2(lower) == image2) {
+    return lower;
+  }
+  return -1;
+}
+
+MatchStore::const_iterator MatchStore::begin(int pair) const {
+  return records_ + file_.groups()[pair];
+}
+
+MatchStore::const_iterator MatchStore::end(int pair) const {
+  return records_ + file_.groups()[pair + 1];
+}
+
+int MatchStore::numMatches(int pair) const {
+  return end(pair) - begin(pair);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+MatchStoreWriter::MatchStoreWriter()
+    : writer_(), unique_(false), num_pairs_(0), last1_(), last2_() {}
+
+bool MatchStoreWriter::open(const std::string& filename, bool unique) {
+  unique_ = unique;
+  num_pairs_ = 0;
+  if (!writer_.open(filename, BINARY_MATCH_STORE, sizeof(MatchStoreRecord),
+        PAIR_KEY_SIZE)) {
+    return false;
+  }
+  writer_.setRecordFlags(unique ? UNIQUE_MATCH_RESULTS : 0);
+  return true;
+}
+
+void MatchStoreWriter::add(const ImageIndex& image1,
+                           const ImageIndex& image2,
+                           const std::vector<Match>& matches) {
+  CHECK(!unique_) << "Plain matches have no second-best distances";
+  std::vector<MatchStoreRecord> records;
+  records.reserve(matches.size());
+  std::vector<Match>::const_iterator match;
+  for (match = matches.begin(); match != matches.end(); ++match) {
+    records.push_back(toMatchStoreRecord(*match));
+  }
+  add(image1, image2, records);
+}
+
+void MatchStoreWriter::add(const ImageIndex& image1,
+                           const ImageIndex& image2,
+                           const std::vector<MatchResult>& matches) {
+  CHECK(!unique_) << "Match results have no second-best distances";
+  std::vector<MatchStoreRecord> records;
+  records.reserve(matches.size());
+  std::vector<MatchResult>::const_iterator match;
+  for (match = matches.begin(); match != matches.end(); ++match) {
+    records.push_back(toMatchStoreRecord(*match));
+  }
+  add(image1, image2, records);
+}
+
+void MatchStoreWriter::add(const ImageIndex& image1,
+                           const ImageIndex& image2,
+                           const std::vector<UniqueMatchResult>& matches) {
+  std::vector<MatchStoreRecord> records;
+  records.reserve(matches.size());
+  std::vector<UniqueMatchResult>::const_iterator match;
+  for (match = matches.begin(); match != matches.end(); ++match) {
+    records.push_back(toMatchStoreRecord(*match));
+  }
+  add(image1, image2, records);
+}
+
+void MatchStoreWriter::add(const ImageIndex& image1,
+                           const ImageIndex& image2,
+                           std::vector<MatchStoreRecord>& records) {
+  // Stable, so that the first of several matches between two features
+  // stays first.
+  std::stable_sort(records.begin(), records.end(), recordBefore);
+  beginPair(image1, image2);
+  if (!records.empty()) {
+    writer_.write(&records.front(), records.size());
+  }
+}
+
+void MatchStoreWriter::add(const ImageIndex& image1,
+                           const ImageIndex& image2,
+                           const MatchStoreRecord* begin,
+                           const MatchStoreRecord* end) {
+  for (const MatchStoreRecord* record = begin; record + 1 < end; ++record) {
+    CHECK(!recordBefore(*(record + 1), *record)) << "Matches are not sorted";
+  }
+  beginPair(image1, image2);
+  writer_.write(begin, end - begin);
+}
+
+void MatchStoreWriter::beginPair(const ImageIndex& image1,
+                                 const ImageIndex& image2) {
+  CHECK(num_pairs_ == 0 || pairBefore(last1_, last2_, image1, image2)) <<
+      "Pairs must be added in increasing order";
+  num_pairs_ += 1;
+  last1_ = image1;
+  last2_ = image2;
+
+  int32_t key[] = { image1.view, image1.time, image2.view, image2.time };
+  writer_.beginGroup(key);
+}
+
+bool MatchStoreWriter::close() {
+  return writer_.close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+MatchStoreRecord toMatchStoreRecord(const Match& match) {
+  MatchStoreRecord record;
+  record.index1 = match.first;
+  record.index2 = match.second;
+  record.distance = 0;
+  record.next_best = std::numeric_limits<float>::infinity();
+  return record;
+}
+
+MatchStoreRecord toMatchStoreRecord(const MatchResult& match) {
+  MatchStoreRecord record;
+  record.index1 = match.index1;
+  record.index2 = match.index2;
+  record.distance = match.distance;
+  record.next_best = std::numeric_limits<float>::infinity();
+  return record;
+}
+
+MatchStoreRecord toMatchStoreRecord(const UniqueMatchResult& match) {
+  MatchStoreRecord record;
+  record.index1 = match.index1;
+  record.index2 = match.index2;
+  record.distance = match.distance;
+  record.next_best = toNextBest(match.minNextBest());
+  return record;
+}
+
+Match toMatch(const MatchStoreRecord& record) {
+  return Match(record.index1, record.index2);
+}
+
+MatchResult toMatchResult(const MatchStoreRecord& record) {
+  return MatchResult(record.index1, record.index2, record.distance);
+}
+
+UniqueMatchResult toUniqueMatchResult(const MatchStoreRecord& record) {
+  double next_best = fromNextBest(record.next_best);
+  return UniqueMatchResult(record.index1, record.index2, record.distance,
+      next_best, next_best);
+}
+
+bool recordBefore(const MatchStoreRecord& lhs, const MatchStoreRecord& rhs) {
+  if (lhs.index1 != rhs.index1) {
+    return lhs.index1 < rhs.index1;
+  } else {
+    return lhs.index2 < rhs.index2;
+  }
+}
+
+void addMatchStoreEdges(const MatchStore& store,
+                        FeatureIndexMap<int>& vertices,
+                        std::vector<FeatureIndex>& features,
+                        std::vector<MatchGraphEdge>& edges) {
+  edges.reserve(edges.size() + store.numMatches());
+
+  for (int pair = 0; pair < store.numPairs(); pair += 1) {
+    ImageIndex image1 = store.image1(pair);
+    ImageIndex image2 = store.image2(pair);
+
+    MatchStore::const_iterator record;
+    for (record = store.begin(pair); record != store.end(pair); ++record) {
+      FeatureIndex feature[] = {
+        FeatureIndex(image1, record->index1),
+        FeatureIndex(image2, record->index2) };
+      int vertex[2];
+
+      for (int i = 0; i < 2; i += 1) {
+        // Reserve an entry in the lookup table, filled in if the feature is
+        // new.
+        std::pair<int*, bool> mapping = vertices.insert(feature[i], 0);
+        if (mapping.second) {
+          features.push_back(feature[i]);
+          *mapping.first = features.size() - 1;
+        }
+        vertex[i] = *mapping.first;
+      }
+
+      edges.push_back(MatchGraphEdge(vertex[0], vertex[1], 1));
+    }
+  }
+}
+
+int combineMatchStores(const MatchStore& forward_store,
+                       const MatchStore& reverse_store,
+                       MatchCombination combination,
+                       bool keep_distance,
+                       MatchStoreWriter& writer) {
+  int num_matches = 0;
+
+  for (int pair = 0; pair < forward_store.numPairs(); pair += 1) {
+    ImageIndex image1 = forward_store.image1(pair);
+    ImageIndex image2 = forward_store.image2(pair);
+    int reverse_pair = reverse_store.find(image2, image1);
+    CHECK(reverse_pair >= 0) << "No reverse matches for (" << image1 <<
+        ", " << image2 << ")";
+
+    if (keep_distance) {
+      std::vector<MatchResult> forward;
+      std::vector<MatchResult> reverse;
+      std::transform(forward_store.begin(pair), forward_store.end(pair),
+          std::back_inserter(forward), toMatchResult);
+      std::transform(reverse_store.begin(reverse_pair),
+          reverse_store.end(reverse_pair), std::back_inserter(reverse),
+          toMatchResult);
+      flipMatches(reverse);
+
+      std::vector<MatchResult> matches;
+      combineMatchResults(forward, reverse, combination, matches);
+      writer.add(image1, image2, matches);
+      num_matches += matches.size();
+    } else {
+      std::vector<Match> forward;
+      std::vector<Match> reverse;
+      std::transform(forward_store.begin(pair), forward_store.end(pair),
+          std::back_inserter(forward), toMatch);
+      std::transform(reverse_store.begin(reverse_pair),
+          reverse_store.end(reverse_pair), std::back_inserter(reverse),
+          toMatch);
+      flipMatches(reverse);
+
+      std::vector<Match> matches;
+      combineMatches(forward, reverse, combination, matches);
+      writer.add(image1, image2, matches);
+      num_matches += matches.size();
+    }
+  }
+
+  return num_matches;
+}
@@ -0,0 +1,150 @@
+#ifndef MATCH_STORE_HPP_
+#define MATCH_STORE_HPP_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "binary_file.hpp"
+#include "image_index.hpp"
+#include "feature_index.hpp"
+#include "feature_index_map.hpp"
+#include "match.hpp"
+#include "match_combination.hpp"
+#include "match_result.hpp"
+#include "unique_match_result.hpp"
+#include "match_graph.hpp"
+
+// The matches between many pairs of images in one binary file (see
+// binary_file.hpp), in place of a text file for each pair. Tools which read
+// every pair map the store instead of parsing a file per pair.
+//
+// The matches of each pair are a group of 16-byte records, sorted by their
+// index in the first image and then in the second, so that the lists of two
+// pairs can be combined in one pass. The key of each group is its pair of
+// images. Pairs are in increasing order, so that they can be found by binary
+// search. Distances are kept as single precision.
+//
+// Only a store of unique match results has second-best distances. The header
+// records whether it has, and tools which filter by the ratio of the best to
+// the second-best distance must check it, since the second-best distances of
+// other stores are all infinite.
+
+// One match of a store.
+struct MatchStoreRecord {
+  int32_t index1;
+  int32_t index2;
+  float distance;
+  // The smaller of the second-best distances of a unique match. Infinite if
+  // there is none, as for plain matches and match results.
+  float next_best;
+};
+
+// A store mapped into memory. Copies share the mapping.
+class MatchStore {
+  public:
+    typedef const MatchStoreRecord* const_iterator;
+
+    MatchStore();
+
+    // Returns false if the file could not be mapped or is not a store.
+    bool open(const std::string& filename);
+
+    // True if the store was written from unique match results, with their
+    // second-best distances.
+    bool isUnique() const;
+
+    int numPairs() const;
+    // Over all pairs.
+    int numMatches() const;
+
+    ImageIndex image1(int pair) const;
+    ImageIndex image2(int pair) const;
+    // Returns -1 if the store has no entry for the pair.
+    int find(const ImageIndex& image1, const ImageIndex& image2) const;
+
+    // Matches of a pair, sorted.
+    const_iterator begin(int pair) const;
+    const_iterator end(int pair) const;
+    int numMatches(int pair) const;
+
+  private:
+    BinaryFile file_;
+    const MatchStoreRecord* records_;
+};
+
+// Writes a store a pair at a time, in increasing order of images. The
+// matches of each pair are sorted as they are written.
+class MatchStoreWriter {
+  public:
+    MatchStoreWriter();
+
+    // Plain matches and match results may only be added if the store is not
+    // unique.
+    bool open(const std::string& filename, bool unique);
+
+    // Plain matches have zero distance.
+    void add(const ImageIndex& image1,
+             const ImageIndex& image2,
+             const std::vector<Match>& matches);
+    void add(const ImageIndex& image1,
+             const ImageIndex& image2,
+             const std::vector<MatchResult>& matches);
+    void add(const ImageIndex& image1,
+             const ImageIndex& image2,
+             const std::vector<UniqueMatchResult>& matches);
+    // Sorts the records in place.
+    void add(const ImageIndex& image1,
+             const ImageIndex& image2,
+             std::vector<MatchStoreRecord>& records);
+    // Records must already be sorted, e.g. those of a pair of another store
+    // which passed a filter.
+    void add(const ImageIndex& image1,
+             const ImageIndex& image2,
+             const MatchStoreRecord* begin,
+             const MatchStoreRecord* end);
+
+    // Returns false if the store could not be written.
+    bool close();
+
+  private:
+    void beginPair(const ImageIndex& image1, const ImageIndex& image2);
+
+    BinaryGroupWriter writer_;
+    bool unique_;
+    int num_pairs_;
+    ImageIndex last1_;
+    ImageIndex last2_;
+};
+
+MatchStoreRecord toMatchStoreRecord(const Match& match);
+MatchStoreRecord toMatchStoreRecord(const MatchResult& match);
+MatchStoreRecord toMatchStoreRecord(const UniqueMatchResult& match);
+
+Match toMatch(const MatchStoreRecord& record);
+MatchResult toMatchResult(const MatchStoreRecord& record);
+// Both second-best distances are the smaller of the two.
+UniqueMatchResult toUniqueMatchResult(const MatchStoreRecord& record);
+
+// Orders records by index1 and then index2.
+bool recordBefore(const MatchStoreRecord& lhs, const MatchStoreRecord& rhs);
+
+// Appends the matches of every pair to the edges of a match graph, with unit
+// weight. Features which are not yet vertices are appended to the features
+// in order of first appearance.
+void addMatchStoreEdges(const MatchStore& store,
+                        FeatureIndexMap<int>& vertices,
+                        std::vector<FeatureIndex>& features,
+                        std::vector<MatchGraphEdge>& edges);
+
+// Combines each pair of the forward store with the reverse pair of the
+// reverse store, which may be the same store, and writes a pair for each
+// pair of the forward store. Forward matches are read sorted from the store,
+// and only the flipped reverse matches need sorting. Distances are kept if
+// asked, as for combineMatchResults(). Returns the number of matches written.
+int combineMatchStores(const MatchStore& forward_store,
+                       const MatchStore& reverse_store,
+                       MatchCombination combination,
+                       bool keep_distance,
+                       MatchStoreWriter& writer);
+
+#endif
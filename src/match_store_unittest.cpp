@@ -0,0 +1,261 @@
+#include "match_store.hpp"
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "gtest/gtest.h"
+
+namespace {
+
+MatchStoreRecord makeRecord(int index1,
+                            int index2,
+                            float distance,
+                            float next_best) {
+  MatchStoreRecord record;
+  record.index1 = index1;
+  record.index2 = index2;
+  record.distance = distance;
+  record.next_best = next_best;
+  return record;
+}
+
+// Stores in a fresh temporary directory, removed with the fixture.
+class MatchStoreTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      char directory[] = "/tmp/match-store-XXXXXX";
+      ASSERT_TRUE(mkdtemp(directory) != NULL);
+      directory_ = directory;
+    }
+
+    virtual void TearDown() {
+      for (int i = 0; i < int(files_.size()); i += 1) {
+        std::remove(files_[i].c_str());
+      }
+      rmdir(directory_.c_str());
+    }
+
+    std::string filename(const std::string& name) {
+      files_.push_back(directory_ + "/" + name + ".bin");
+      return files_.back();
+    }
+
+    std::string directory_;
+    std::vector<std::string> files_;
+};
+
+}
+
+TEST_F(MatchStoreTest, RoundTripsPairsInSortedOrder) {
+  std::string file = filename("store");
+  ImageIndex a(0, 1);
+  ImageIndex b(0, 5);
+  ImageIndex c(1, 0);
+  {
+    MatchStoreWriter writer;
+    ASSERT_TRUE(writer.open(file, false));
+
+    // Out of order within the pair, with a repeated index1.
+    std::vector<MatchStoreRecord> records;
+    records.push_back(makeRecord(7, 2, 0.5, 0.75));
+    records.push_back(makeRecord(3, 9, 0.25, 1));
+    records.push_back(makeRecord(7, 1, 1.5,
+          std::numeric_limits<float>::infinity()));
+    writer.add(a, b, records);
+    // A pair with no matches.
+    writer.add(a, c, std::vector<Match>());
+    std::vector<Match> matches;
+    matches.push_back(Match(4, 0));
+    matches.push_back(Match(0, 4));
+    writer.add(b, a, matches);
+    ASSERT_TRUE(writer.close());
+  }
+
+  MatchStore store;
+  ASSERT_TRUE(store.open(file));
+  EXPECT_FALSE(store.isUnique());
+  ASSERT_EQ(3, store.numPairs());
+  EXPECT_EQ(5, store.numMatches());
+
+  EXPECT_EQ(a, store.image1(0));
+  EXPECT_EQ(b, store.image2(0));
+  ASSERT_EQ(3, store.numMatches(0));
+  const MatchStoreRecord* records = store.begin(0);
+  EXPECT_EQ(3, records[0].index1);
+  EXPECT_EQ(9, records[0].index2);
+  EXPECT_EQ(0.25, records[0].distance);
+  EXPECT_EQ(1, records[0].next_best);
+  EXPECT_EQ(7, records[1].index1);
+  EXPECT_EQ(1, records[1].index2);
+  EXPECT_EQ(std::numeric_limits<float>::infinity(), records[1].next_best);
+  EXPECT_EQ(2, records[2].index2);
+  EXPECT_EQ(0.75, records[2].next_best);
+
+  EXPECT_EQ(0, store.numMatches(1));
+  EXPECT_EQ(store.begin(1), store.end(1));
+
+  // Plain matches have zero distance and no second-best.
+  ASSERT_EQ(2, store.numMatches(2));
+  EXPECT_EQ(0, store.begin(2)->index1);
+  EXPECT_EQ(0, store.begin(2)->distance);
+  EXPECT_EQ(std::numeric_limits<float>::infinity(),
+      store.begin(2)->next_best);
+}
+
+TEST_F(MatchStoreTest, FindsPairsByBinarySearch) {
+  std::string file = filename("store");
+  std::vector<std::pair<ImageIndex, ImageIndex> > pairs;
+  for (int view = 0; view < 3; view += 1) {
+    for (int time = 0; time < 20; time += 3) {
+      pairs.push_back(std::make_pair(ImageIndex(view, time),
+            ImageIndex(view + 1, time)));
+    }
+  }
+  {
+    MatchStoreWriter writer;
+    ASSERT_TRUE(writer.open(file, false));
+    for (int i = 0; i < int(pairs.size()); i += 1) {
+      writer.add(pairs[i].first, pairs[i].second,
+          std::vector<Match>(1, Match(i, i)));
+    }
+    ASSERT_TRUE(writer.close());
+  }
+
+  MatchStore store;
+  ASSERT_TRUE(store.open(file));
+  ASSERT_EQ(int(pairs.size()), store.numPairs());
+  for (int i = 0; i < int(pairs.size()); i += 1) {
+    int pair = store.find(pairs[i].first, pairs[i].second);
+    ASSERT_EQ(i, pair);
+    EXPECT_EQ(i, store.begin(pair)->index1);
+  }
+
+  // Before the first, between two and after the last.
+  EXPECT_EQ(-1, store.find(ImageIndex(0, 0), ImageIndex(0, 0)));
+  EXPECT_EQ(-1, store.find(ImageIndex(1, 4), ImageIndex(2, 4)));
+  EXPECT_EQ(-1, store.find(ImageIndex(0, 3), ImageIndex(1, 4)));
+  EXPECT_EQ(-1, store.find(ImageIndex(9, 0), ImageIndex(9, 1)));
+}
+
+TEST_F(MatchStoreTest, StoreWithoutPairsIsEmpty) {
+  std::string file = filename("empty");
+  {
+    MatchStoreWriter writer;
+    ASSERT_TRUE(writer.open(file, false));
+    ASSERT_TRUE(writer.close());
+  }
+
+  MatchStore store;
+  ASSERT_TRUE(store.open(file));
+  EXPECT_EQ(0, store.numPairs());
+  EXPECT_EQ(0, store.numMatches());
+  EXPECT_EQ(-1, store.find(ImageIndex(0, 0), ImageIndex(1, 0)));
+}
+
+TEST_F(MatchStoreTest, RecordsWhetherStoreIsUnique) {
+  std::string file = filename("unique");
+  {
+    MatchStoreWriter writer;
+    ASSERT_TRUE(writer.open(file, true));
+    writer.add(ImageIndex(0, 0), ImageIndex(0, 1),
+        std::vector<UniqueMatchResult>(1,
+          UniqueMatchResult(1, 2, 0.5, 0.9, 0.7)));
+    ASSERT_TRUE(writer.close());
+  }
+
+  MatchStore store;
+  ASSERT_TRUE(store.open(file));
+  EXPECT_TRUE(store.isUnique());
+  ASSERT_EQ(1, store.numMatches(0));
+  EXPECT_FLOAT_EQ(0.7, store.begin(0)->next_best);
+}
+
+TEST(MatchStoreRecord, ConvertsUniqueMatches) {
+  UniqueMatchResult match(1, 2, 0.5, 0.9, 0.7);
+  MatchStoreRecord record = toMatchStoreRecord(match);
+  EXPECT_FLOAT_EQ(0.7, record.next_best);
+  UniqueMatchResult converted = toUniqueMatchResult(record);
+  EXPECT_EQ(1, converted.index1);
+  EXPECT_EQ(2, converted.index2);
+  EXPECT_FLOAT_EQ(0.7, converted.minNextBest());
+
+  // No second-best is the largest distance.
+  match = UniqueMatchResult(1, 2, 0.5, std::numeric_limits<double>::max(),
+      std::numeric_limits<double>::max());
+  record = toMatchStoreRecord(match);
+  EXPECT_EQ(std::numeric_limits<float>::infinity(), record.next_best);
+  EXPECT_EQ(std::numeric_limits<double>::max(),
+      toUniqueMatchResult(record).minNextBest());
+}
+
+TEST_F(MatchStoreTest, CombinesEachPairWithItsReverse) {
+  std::string forward_file = filename("forward");
+  std::string reverse_file = filename("reverse");
+  ImageIndex a(0, 0);
+  ImageIndex b(1, 0);
+  {
+    MatchStoreWriter writer;
+    ASSERT_TRUE(writer.open(forward_file, false));
+    std::vector<MatchResult> matches;
+    matches.push_back(MatchResult(0, 1, 0.5));
+    matches.push_back(MatchResult(2, 3, 0.25));
+    writer.add(a, b, matches);
+    ASSERT_TRUE(writer.close());
+  }
+  {
+    // The reverse store has other pairs around the one which is used.
+    MatchStoreWriter writer;
+    ASSERT_TRUE(writer.open(reverse_file, false));
+    writer.add(ImageIndex(0, 5), a, std::vector<Match>(1, Match(9, 9)));
+    std::vector<MatchResult> matches;
+    matches.push_back(MatchResult(1, 0, 0.5));
+    matches.push_back(MatchResult(4, 5, 0.125));
+    writer.add(b, a, matches);
+    writer.add(ImageIndex(2, 0), a, std::vector<Match>(1, Match(8, 8)));
+    ASSERT_TRUE(writer.close());
+  }
+
+  MatchStore forward;
+  ASSERT_TRUE(forward.open(forward_file));
+  MatchStore reverse;
+  ASSERT_TRUE(reverse.open(reverse_file));
+
+  std::string reciprocal_file = filename("reciprocal");
+  {
+    MatchStoreWriter writer;
+    ASSERT_TRUE(writer.open(reciprocal_file, false));
+    EXPECT_EQ(1, combineMatchStores(forward, reverse, MATCH_RECIPROCAL,
+          false, writer));
+    ASSERT_TRUE(writer.close());
+  }
+  MatchStore reciprocal;
+  ASSERT_TRUE(reciprocal.open(reciprocal_file));
+  ASSERT_EQ(1, reciprocal.numPairs());
+  EXPECT_EQ(a, reciprocal.image1(0));
+  EXPECT_EQ(b, reciprocal.image2(0));
+  ASSERT_EQ(1, reciprocal.numMatches(0));
+  EXPECT_EQ(0, reciprocal.begin(0)->index1);
+  EXPECT_EQ(1, reciprocal.begin(0)->index2);
+
+  std::string union_file = filename("union");
+  {
+    MatchStoreWriter writer;
+    ASSERT_TRUE(writer.open(union_file, false));
+    EXPECT_EQ(3, combineMatchStores(forward, reverse, MATCH_UNION, true,
+          writer));
+    ASSERT_TRUE(writer.close());
+  }
+  MatchStore combined;
+  ASSERT_TRUE(combined.open(union_file));
+  ASSERT_EQ(3, combined.numMatches(0));
+  // Sorted, with the flipped reverse match and the distances.
+  const MatchStoreRecord* records = combined.begin(0);
+  EXPECT_EQ(0, records[0].index1);
+  EXPECT_EQ(0.5, records[0].distance);
+  EXPECT_EQ(2, records[1].index1);
+  EXPECT_EQ(0.25, records[1].distance);
+  EXPECT_EQ(5, records[2].index1);
+  EXPECT_EQ(4, records[2].index2);
+  EXPECT_EQ(0.125, records[2].distance);
+}
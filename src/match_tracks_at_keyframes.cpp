@@ -0,0 +1,136 @@
+#include <string>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstdlib>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "keyframe_track_matches.hpp"
+#include "match.hpp"
+#include "sift_feature.hpp"
+#include "track_list.hpp"
+
+#include "iterator_writer.hpp"
+#include "match_writer.hpp"
+#include "sift_feature_reader.hpp"
+#include "track_list_reader.hpp"
+#include "util/thread-pool.hpp"
+
+DEFINE_double(min_survival, 0.7,
+    "A frame is a keyframe when fewer than this fraction of the tracks of "
+    "either view at the last keyframe are still alive");
+DEFINE_int32(max_interval, 30, "Most frames from one keyframe to the next");
+DEFINE_bool(use_absolute_threshold, false, "Use absolute distance threshold");
+DEFINE_double(absolute_threshold, 1,
+    "Maximum distance of a match, if use_absolute_threshold");
+DEFINE_bool(use_flann, false,
+    "Index the descriptors of each frame with FLANN. Building the index "
+    "costs as much as a search between keyframes");
+DEFINE_int32(min_votes, 1,
+    "Fewest frames in which a pair of tracks must be matched");
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads over frames, 0 to match serially");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Matches the tracks of two views at keyframes and at the births "
+      "of tracks, for track-matches-to-multiview-tracks." << std::endl;
+  usage << std::endl;
+  usage << "Sample usage:" << std::endl;
+  usage << argv[0] << " descriptors-1 descriptors-2 matches" << std::endl;
+  usage << std::endl;
+  usage << "The descriptors are tracks of features from extract-sift-tracks "
+      "and the matches are of track indices." << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 4) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+// For use with ThreadPool::parallelFor().
+class MatchFunction {
+  public:
+    MatchFunction(const std::vector<View>& views,
+                  const std::vector<bool>& keyframes,
+                  const FrameMatchOptions& options,
+                  std::vector<std::vector<Match> >& matches)
+        : views_(&views),
+          keyframes_(&keyframes),
+          options_(&options),
+          matches_(&matches) {}
+
+    void operator()(int i) const {
+      // Each thread writes to a different element.
+      matchFrame((*views_)[0].frames[i], (*views_)[1].frames[i],
+          (*keyframes_)[i], *options_, (*matches_)[i]);
+    }
+
+  private:
+    const std::vector<View>* views_;
+    const std::vector<bool>* keyframes_;
+    const FrameMatchOptions* options_;
+    std::vector<std::vector<Match> >* matches_;
+};
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+  std::string descriptors_file1 = argv[1];
+  std::string descriptors_file2 = argv[2];
+  std::string matches_file = argv[3];
+
+  bool ok;
+
+  std::vector<FeatureTrackList> tracks(2);
+  SiftFeatureReader feature_reader;
+  ok = loadTrackList(descriptors_file1, tracks[0], feature_reader);
+  CHECK(ok) << "Could not load tracks \"" << descriptors_file1 << "\"";
+  ok = loadTrackList(descriptors_file2, tracks[1], feature_reader);
+  CHECK(ok) << "Could not load tracks \"" << descriptors_file2 << "\"";
+  LOG(INFO) << "Loaded " << tracks[0].size() << " and " << tracks[1].size() <<
+      " tracks";
+
+  int first_frame;
+  int num_frames;
+  if (!findFrameRange(tracks, first_frame, num_frames)) {
+    LOG(WARNING) << "Every track is empty";
+  }
+
+  std::vector<View> views(2);
+  for (int view = 0; view < 2; view += 1) {
+    listObservations(tracks[view], first_frame, num_frames, views[view]);
+  }
+
+  std::vector<bool> keyframes;
+  chooseKeyframes(views, first_frame, num_frames, FLAGS_min_survival,
+      FLAGS_max_interval, keyframes);
+  LOG(INFO) << "Chose " << std::count(keyframes.begin(), keyframes.end(),
+      true) << " keyframes of " << num_frames << " frames";
+
+  FrameMatchOptions options;
+  options.use_threshold = FLAGS_use_absolute_threshold;
+  options.threshold = FLAGS_absolute_threshold;
+  options.use_flann = FLAGS_use_flann;
+
+  ThreadPool pool(FLAGS_num_threads);
+  std::vector<std::vector<Match> > frame_matches(num_frames);
+  pool.parallelFor(0, num_frames,
+      MatchFunction(views, keyframes, options, frame_matches));
+
+  std::vector<Match> matches;
+  selectTrackMatches(frame_matches, tracks[0].size(), tracks[1].size(),
+      FLAGS_min_votes, matches);
+  LOG(INFO) << "Matched " << matches.size() << " pairs of tracks";
+
+  MatchWriter writer;
+  ok = saveList(matches_file, matches, writer);
+  CHECK(ok) << "Could not save matches \"" << matches_file << "\"";
+
+  return 0;
+}
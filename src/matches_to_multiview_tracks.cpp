@@ -4,19 +4,26 @@
 #include <map>
 #include <set>
 #include <utility>
+#include <algorithm>
 #include <boost/lexical_cast.hpp>
 #include <boost/format.hpp>
 #include <boost/bind.hpp>
-#include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/connected_components.hpp>
 #include <glog/logging.h>
 #include <gflags/gflags.h>
 
 #include "match.hpp"
 #include "feature_index.hpp"
+#include "image_pairs.hpp"
+#include "stages.hpp"
+#include "feature_index_map.hpp"
 #include "match_graph.hpp"
+#include "disjoint_sets.hpp"
 #include "multiview_track.hpp"
 #include "multiview_track_list.hpp"
+#include "parallel_load.hpp"
+#include "util/memory.hpp"
+#include "util/thread-pool.hpp"
+#include "util/trace.hpp"
 
 #include "read_lines.hpp"
 #include "iterator_reader.hpp"
@@ -36,11 +43,27 @@ DEFINE_bool(adjacent, false,
     "Match image to all views in the same frame and its own view in adjacent "
     "frames");
 DEFINE_bool(one_to_all, false, "Match one image to all others");
+DEFINE_string(pairs, "",
+    "Match the pairs in this list, as written by plan-image-pairs");
 DEFINE_int32(view, -1, "View of image");
 DEFINE_int32(time, -1, "Time of image");
 DEFINE_bool(directed, false, "Matches are directed");
 DEFINE_bool(duplicate, false,
     "Duplicate features that would otherwise be inconsistent");
+DEFINE_int32(num_threads, 4,
+    "Number of worker threads to load files with, 0 to load serially");
+DEFINE_int32(max_files_in_flight, 64,
+    "Maximum number of files which are loaded at once");
+DEFINE_bool(streaming, false,
+    "Join the features of each match as it is loaded, instead of building "
+    "the match graph");
+DEFINE_int32(window, 0,
+    "Find tracks in windows of this many frames, one after another, and "
+    "stitch them, 0 to take every frame at once");
+DEFINE_int32(window_overlap, 1,
+    "Number of frames shared by consecutive windows");
+DEFINE_string(trace, "",
+    "File to write a trace of memory use to, if built with tracing");
 
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
@@ -59,10 +82,6 @@ void init(int& argc, char**& argv) {
   }
 }
 
-// For when more than one feature may be observed in each frame.
-typedef std::vector<int> FeatureSet;
-
-typedef std::map<FeatureIndex, MatchGraph::vertex_descriptor> VertexLookup;
 typedef std::vector<FeatureIndex> FeatureList;
 
 std::string makeMatchFilename(const std::string& format,
@@ -74,28 +93,6 @@ std::string makeMatchFilename(const std::string& format,
       boost::format(format) % view1 % view2 % (time1 + 1) % (time2 + 1));
 }
 
-MatchGraph::vertex_descriptor findOrInsert(MatchGraph& graph,
-                                           VertexLookup& vertices,
-                                           const FeatureIndex& feature) {
-  MatchGraph::vertex_descriptor vertex;
-
-  // Try to find feature in lookup map.
-  VertexLookup::const_iterator mapping = vertices.find(feature);
-
-  if (mapping != vertices.end()) {
-    // Found the vertex, it already exists.
-    vertex = mapping->second;
-  } else {
-    // Did not find it, create an entry.
-    vertex = boost::add_vertex(feature, graph);
-    vertices[feature] = vertex;
-  }
-
-  return vertex;
-}
-
-typedef std::pair<ImageIndex, ImageIndex> ImagePair;
-
 void appendSimultaneousImagePairs(int num_views,
                                   int num_frames,
                                   std::set<ImagePair>& pairs) {
@@ -196,155 +193,131 @@ void loadImagePairMatches(ImageIndex image1,
   }
 }
 
-bool multitrackToTrack(const MultiviewTrack<FeatureSet>& multiview_multitrack,
-                       MultiviewTrack<int>& multiview_track) {
-  int num_views = multiview_multitrack.numViews();
-  multiview_track = MultiviewTrack<int>(num_views);
-
-  MultiviewTrack<FeatureSet>::const_iterator multitrack;
-  MultiviewTrack<int>::iterator track;
-
-  multitrack = multiview_multitrack.begin();
-  track = multiview_track.begin();
-
-  while (multitrack != multiview_multitrack.end()) {
-    TrackIterator<FeatureSet> point(*multitrack);
-
-    while (!point.end()) {
-      // There should never be an entry with zero features.
-      CHECK(point.get().size() > 0);
-
-      if (point.get().size() > 1) {
-        // Multiple features in this frame. Inconsistent track!
-        return false;
-      } else {
-        // Add the single element in the vector to the track.
-        (*track)[point.time()] = point.get().front();
-      }
-
-      point.next();
+// Loads the matches of one pair of images per index.
+class ImagePairMatchLoader : public IndexedLoader<std::vector<Match> > {
+  public:
+    ImagePairMatchLoader(const std::vector<ImagePair>& pairs,
+                         bool directed,
+                         const std::string& format,
+                         const std::vector<std::string>& views)
+        : pairs_(&pairs), directed_(directed), format_(&format),
+          views_(&views) {}
+
+    bool load(int index, std::vector<Match>& matches) const {
+      const ImagePair& pair = (*pairs_)[index];
+      loadImagePairMatches(pair.first, pair.second, matches, directed_,
+          *format_, *views_);
+      return true;
     }
 
-    ++multitrack;
-    ++track;
-  }
-
-  return true;
-}
-
-int numFeaturesInMultitrack(const MultiviewTrack<FeatureSet>& track) {
-  MultiviewTrack<FeatureSet>::ConstFeatureIterator iter(track);
-  int n = 0;
-
-  for (iter.begin(); !iter.end(); iter.next()) {
-    n += iter.get().second->size();
-  }
-
-  return n;
-}
-
-int addNumFeaturesInMultitrack(int n, const MultiviewTrack<FeatureSet>& track) {
-  return n + numFeaturesInMultitrack(track);
-}
-
-int numFeaturesInMultitrackList(const MultiviewTrackList<FeatureSet>& tracks) {
-  return std::accumulate(tracks.begin(), tracks.end(), 0,
-      addNumFeaturesInMultitrack);
-}
-
-void loadOneToAllImagePair(const ImageIndex& image,
-                           const ImageIndex& other,
-                           MatchGraph& graph,
-                           VertexLookup& vertices,
-                           bool directed,
-                           const std::string& format,
-                           const std::vector<std::string>& views) {
-  // Load matches.
-  std::vector<Match> matches;
-  loadImagePairMatches(image, other, matches, directed, format, views);
-
-  // Now create a new vertex for every feature in the other image.
-  std::vector<Match>::const_iterator match;
-  for (match = matches.begin(); match != matches.end(); ++match) {
-    FeatureIndex feature1(image, match->first);
-    FeatureIndex feature2(other, match->second);
-
-    // Find the first feature in the graph.
-    MatchGraph::vertex_descriptor vertex1 =
-        findOrInsert(graph, vertices, feature1);
-    // Create a new vertex for the second feature.
-    MatchGraph::vertex_descriptor vertex2 = boost::add_vertex(feature2, graph);
-
-    // Connect these vertices.
-    boost::add_edge(vertex1, vertex2, graph);
-  }
+  private:
+    const std::vector<ImagePair>* pairs_;
+    bool directed_;
+    const std::string* format_;
+    const std::vector<std::string>* views_;
+};
+
+// Loads the matches of every pair, and passes them to the sink as edges
+// between the features. Files are read in parallel, and their matches are
+// added in order from the calling thread.
+void loadImagePairs(const std::vector<ImagePair>& pairs,
+                    std::vector<FeatureIndex>& features,
+                    SequenceSink<MatchGraphEdge>& edges,
+                    bool directed,
+                    bool duplicate,
+                    const std::string& format,
+                    const std::vector<std::string>& views,
+                    ThreadPool& pool) {
+  ImagePairMatchLoader loader(pairs, directed, format, views);
+  MatchEdgeSink sink(pairs, duplicate, features, edges);
+  bool ok = loadInParallel(pool, pairs.size(), loader, sink,
+      FLAGS_max_files_in_flight);
+  CHECK(ok) << "Could not load matches";
 }
 
 void loadOneToAllMatches(const ImageIndex& image,
-                         MatchGraph& graph,
+                         std::vector<FeatureIndex>& features,
+                         SequenceSink<MatchGraphEdge>& edges,
                          bool directed,
                          const std::string& format,
                          const std::vector<std::string>& views,
-                         int num_frames) {
-  VertexLookup vertices;
+                         int num_frames,
+                         ThreadPool& pool) {
   int num_views = views.size();
 
   // Iterate through all images.
+  std::vector<ImagePair> pairs;
   for (int t = 0; t < num_frames; t += 1) {
     for (int v = 0; v < num_views; v += 1) {
       ImageIndex other(v, t);
       if (image != other) {
-        loadOneToAllImagePair(image, other, graph, vertices, directed, format,
-            views);
+        pairs.push_back(ImagePair(image, other));
       }
     }
   }
-}
 
-void loadImagePair(const ImageIndex& image1,
-                   const ImageIndex& image2,
-                   MatchGraph& graph,
-                   VertexLookup& vertices,
-                   bool directed,
-                   const std::string& format,
-                   const std::vector<std::string>& views) {
-  std::vector<Match> matches;
-  loadImagePairMatches(image1, image2, matches, directed, format, views);
-
-  std::vector<Match>::const_iterator match;
-  for (match = matches.begin(); match != matches.end(); ++match) {
-    FeatureIndex feature1(image1, match->first);
-    FeatureIndex feature2(image2, match->second);
-
-    // Find existing vertex for feature, or insert one.
-    MatchGraph::vertex_descriptor vertex1;
-    MatchGraph::vertex_descriptor vertex2;
-    vertex1 = findOrInsert(graph, vertices, feature1);
-    vertex2 = findOrInsert(graph, vertices, feature2);
-
-    // Add vertex to graph.
-    boost::add_edge(vertex1, vertex2, graph);
-  }
+  loadImagePairs(pairs, features, edges, directed, true, format, views, pool);
 }
 
-void loadImagePairs(const std::set<ImagePair>& pairs,
-                    MatchGraph& graph,
+// Lists the pairs of images chosen by the flags, without duplicates.
+// Returns whether the matches of the pairs are directed.
+bool listImagePairs(const std::vector<std::string>& views,
+                    int num_frames,
+                    const std::string& pairs_file,
+                    bool exhaustive,
+                    bool simultaneous,
+                    bool adjacent,
+                    bool one_to_all,
+                    int view,
+                    int time,
                     bool directed,
-                    const std::string& format,
-                    const std::vector<std::string>& views) {
-  VertexLookup vertices;
+                    std::vector<ImagePair>& pair_list) {
+  int num_views = views.size();
 
-  std::set<ImagePair>::const_iterator pair;
-  for (pair = pairs.begin(); pair != pairs.end(); ++pair) {
-    loadImagePair(pair->first, pair->second, graph, vertices, directed, format,
-        views);
+  // Generate a list of image pairs.
+  std::set<ImagePair> pairs;
+
+  if (!pairs_file.empty()) {
+    std::vector<ImagePair> list;
+    bool ok = loadImagePairList(pairs_file, views, num_frames, list);
+    CHECK(ok) << "Could not load pairs \"" << pairs_file << "\"";
+    pairs.insert(list.begin(), list.end());
+    directed = false;
+  } else if (exhaustive) {
+    // Append all pairs!
+    appendAllImagePairs(num_views, num_frames, pairs);
+    directed = false;
+  } else if (simultaneous || adjacent) {
+    // These flags can be combined.
+    if (simultaneous) {
+      appendSimultaneousImagePairs(num_views, num_frames, pairs);
+    }
+    if (adjacent) {
+      appendAllImagePairs(num_views, num_frames, pairs);
+    }
+    directed = false;
+  } else if (one_to_all) {
+    // Check that view and time parameters were supplied.
+    CHECK(0 <= view && view < num_views);
+    CHECK(0 <= time && time < num_frames);
+    // Append pairs containing this image.
+    ImageIndex image(view, time);
+    appendImagePairsContaining(image, num_views, num_frames, pairs, directed);
+  } else {
+    LOG(WARNING) << "No image pairs specified";
+    directed = false;
   }
+
+  pair_list.assign(pairs.begin(), pairs.end());
+  return directed;
 }
 
-void loadMatches(MatchGraph& graph,
+void loadMatches(std::vector<FeatureIndex>& features,
+                 SequenceSink<MatchGraphEdge>& edges,
                  const std::string& format,
                  const std::vector<std::string>& views,
                  int num_frames,
+                 const std::string& pairs_file,
                  bool exhaustive,
                  bool simultaneous,
                  bool adjacent,
@@ -352,7 +325,8 @@ void loadMatches(MatchGraph& graph,
                  int view,
                  int time,
                  bool directed,
-                 bool duplicate) {
+                 bool duplicate,
+                 ThreadPool& pool) {
   int num_views = views.size();
 
   if (one_to_all && duplicate) {
@@ -362,42 +336,88 @@ void loadMatches(MatchGraph& graph,
     CHECK(0 <= time && time < num_frames);
     // Append pairs containing this image.
     ImageIndex image(view, time);
-    loadOneToAllMatches(image, graph, directed, format, views, num_frames);
+    loadOneToAllMatches(image, features, edges, directed, format, views,
+        num_frames, pool);
   } else {
-    // Generate a list of image pairs.
-    std::set<ImagePair> pairs;
+    std::vector<ImagePair> pair_list;
+    directed = listImagePairs(views, num_frames, pairs_file, exhaustive,
+        simultaneous, adjacent, one_to_all, view, time, directed, pair_list);
+    loadImagePairs(pair_list, features, edges, directed, false, format, views,
+        pool);
+  }
+}
 
-    if (exhaustive) {
-      // Append all pairs!
-      appendAllImagePairs(num_views, num_frames, pairs);
-      directed = false;
-    } else if (simultaneous || adjacent) {
-      // These flags can be combined.
-      if (simultaneous) {
-        appendSimultaneousImagePairs(num_views, num_frames, pairs);
-      }
-      if (adjacent) {
-        appendAllImagePairs(num_views, num_frames, pairs);
-      }
-      directed = false;
-    } else if (one_to_all) {
-      // Check that view and time parameters were supplied.
-      CHECK(0 <= view && view < num_views);
-      CHECK(0 <= time && time < num_frames);
-      // Append pairs containing this image.
-      ImageIndex image(view, time);
-      appendImagePairsContaining(image, num_views, num_frames, pairs, directed);
+// Finds the tracks of one window of frames after another, from the matches
+// of the pairs within each, and stitches them together. Only the features of
+// one window are held at once. Each pair is loaded in the first window which
+// contains it, and pairs which no window contains are skipped.
+void findWindowedTracks(const std::vector<ImagePair>& pairs,
+                        bool directed,
+                        const std::string& format,
+                        const std::vector<std::string>& views,
+                        int num_frames,
+                        int window,
+                        int overlap,
+                        ThreadPool& pool,
+                        MultiviewTrackList<IndexSet>& multitracks) {
+  CHECK(0 < overlap && overlap < window) <<
+      "Windows must overlap by at least one frame and less than a window";
+  int num_views = views.size();
+  int step = window - overlap;
+
+  // The last window reaches the last frame.
+  int num_windows = 1;
+  if (num_frames > window) {
+    num_windows += (num_frames - window + step - 1) / step;
+  }
+
+  std::vector<std::vector<ImagePair> > window_pairs(num_windows);
+  int num_skipped = 0;
+  std::vector<ImagePair>::const_iterator pair;
+  for (pair = pairs.begin(); pair != pairs.end(); ++pair) {
+    int k = firstWindowOfPair(*pair, window, step);
+    if (k < 0) {
+      num_skipped += 1;
     } else {
-      LOG(WARNING) << "No image pairs specified";
-      directed = false;
+      CHECK(k < num_windows);
+      window_pairs[k].push_back(*pair);
     }
+  }
+  if (num_skipped > 0) {
+    LOG(WARNING) << "Skipped " << num_skipped << " of " << pairs.size() <<
+        " pairs which are further apart than a window";
+  }
 
-    loadImagePairs(pairs, graph, directed, format, views);
+  TrackStitcher stitcher(num_views);
+
+  for (int k = 0; k < num_windows; k += 1) {
+    std::vector<FeatureIndex> features;
+    DisjointSets sets;
+    DisjointSetsSink sink(sets);
+    loadImagePairs(window_pairs[k], features, sink, directed, false, format,
+        views, pool);
+    std::vector<ImagePair>().swap(window_pairs[k]);
+    sets.grow(features.size());
+
+    std::vector<int> labels;
+    int num_components = sets.label(labels);
+    MultiviewTrackList<IndexSet> tracks;
+    labelsToMultitracks(features, labels, num_components, num_views, tracks);
+    LOG(INFO) << "Found " << num_components << " tracks in frames " <<
+        k * step + 1 << " to " << std::min(k * step + window, num_frames);
+
+    stitcher.add(tracks, (k + 1) * step);
   }
+
+  stitcher.stitch(multitracks);
+  LOG(INFO) << "Stitched windows into " << multitracks.numTracks() <<
+      " tracks";
 }
 
 int main(int argc, char** argv) {
   init(argc, argv);
+  TRACE_INIT(FLAGS_trace);
+  MEMORY_STAGES(stages);
 
   std::string matches_format = argv[1];
   std::string view_names_file = argv[2];
@@ -411,68 +431,78 @@ int main(int argc, char** argv) {
   CHECK(ok) << "Could not load view names";
   int num_views = views.size();
 
-  MatchGraph graph;
-  loadMatches(graph, matches_format, views, num_frames, FLAGS_exhaustive,
-      FLAGS_simultaneous, FLAGS_adjacent, FLAGS_one_to_all, FLAGS_view,
-      FLAGS_time, FLAGS_directed, FLAGS_duplicate);
-
-  int num_vertices = boost::num_vertices(graph);
-  int num_edges = boost::num_edges(graph);
-  LOG(INFO) << "Loaded " << num_edges << " matches between " << num_vertices <<
-      " features";
-
-  // Find connected components of graph.
-  std::vector<int> labels(num_vertices);
-  int num_components = boost::connected_components(graph, &labels.front());
-  LOG(INFO) << "Found " << num_components << " connected components";
-
-  // boost::connected_components assigns a label to each node.
-  // Now assign features with the same label to one track.
-
-  // "Multitracks" can have more than one feature per frame.
-  std::vector<MultiviewTrack<FeatureSet> > multitrack_list(num_components,
-      MultiviewTrack<FeatureSet>(num_views));
-
-  for (int i = 0; i < num_vertices; i += 1) {
-    const FeatureIndex& vertex = graph[i];
-    ImageIndex frame(vertex.view, vertex.time);
-
-    MultiviewTrack<FeatureSet>& multitrack = multitrack_list[labels[i]];
-
-    FeatureSet* set = multitrack.point(frame);
-
-    // If there is no entry for this frame, create a blank one.
-    if (set == NULL) {
-      multitrack.view(vertex.view)[vertex.time] = FeatureSet();
-      set = multitrack.point(frame);
-      CHECK(set != NULL);
+  ThreadPool pool(FLAGS_num_threads);
+  MultiviewTrackList<IndexSet> multitracks;
+
+  if (FLAGS_window > 0) {
+    CHECK(!FLAGS_duplicate) << "Cannot duplicate features in windows";
+    MEMORY_NEXT_STAGE(stages, "find tracks in windows");
+    std::vector<ImagePair> pairs;
+    bool directed = listImagePairs(views, num_frames, FLAGS_pairs,
+        FLAGS_exhaustive, FLAGS_simultaneous, FLAGS_adjacent,
+        FLAGS_one_to_all, FLAGS_view, FLAGS_time, FLAGS_directed, pairs);
+    findWindowedTracks(pairs, directed, matches_format, views, num_frames,
+        FLAGS_window, FLAGS_window_overlap, pool, multitracks);
+  } else {
+    std::vector<FeatureIndex> features;
+    std::vector<int> labels;
+    int num_components;
+
+    if (FLAGS_streaming) {
+      MEMORY_NEXT_STAGE(stages, "load matches into DisjointSets");
+      DisjointSets sets;
+      DisjointSetsSink sink(sets);
+      loadMatches(features, sink, matches_format, views, num_frames,
+          FLAGS_pairs, FLAGS_exhaustive, FLAGS_simultaneous, FLAGS_adjacent,
+          FLAGS_one_to_all, FLAGS_view, FLAGS_time, FLAGS_directed,
+          FLAGS_duplicate, pool);
+      sets.grow(features.size());
+      LOG(INFO) << "Loaded matches between " << features.size() <<
+          " features";
+
+      num_components = sets.label(labels);
+    } else {
+      MEMORY_NEXT_STAGE(stages, "load list of edges");
+      std::vector<MatchGraphEdge> edges;
+      ContainerSink<MatchGraphEdge, std::vector<MatchGraphEdge> > sink(edges);
+      loadMatches(features, sink, matches_format, views, num_frames,
+          FLAGS_pairs, FLAGS_exhaustive, FLAGS_simultaneous, FLAGS_adjacent,
+          FLAGS_one_to_all, FLAGS_view, FLAGS_time, FLAGS_directed,
+          FLAGS_duplicate, pool);
+
+      MEMORY_NEXT_STAGE(stages, "build MatchGraph");
+      MatchGraph graph;
+      graph.build(features, edges, pool);
+      edges.clear();
+
+      int num_vertices = graph.numVertices();
+      int num_edges = graph.numEdges();
+      LOG(INFO) << "Loaded " << num_edges << " matches between " <<
+          num_vertices << " features";
+
+      // Find connected components of graph.
+      MEMORY_NEXT_STAGE(stages, "find connected components");
+      num_components = findConnectedComponents(graph, labels);
+
+      // Keep only the features.
+      for (int i = 0; i < num_vertices; i += 1) {
+        features.push_back(graph[i]);
+      }
     }
+    LOG(INFO) << "Found " << num_components << " connected components";
 
-    // Add this feature.
-    set->push_back(vertex.id);
-  }
-
-  MultiviewTrackList<FeatureSet> multitracks(num_views);
-  for (int i = 0; i < num_components; i += 1) {
-    multitracks.push_back(MultiviewTrack<FeatureSet>());
-    multitracks.back().swap(multitrack_list[i]);
+    // Each component has a label. Now assign features with the same label to
+    // one track.
+    MEMORY_NEXT_STAGE(stages, "build track list");
+    labelsToMultitracks(features, labels, num_components, num_views,
+        multitracks);
   }
 
+  MEMORY_NEXT_STAGE(stages, "save tracks");
   if (FLAGS_consistent) {
     // Build actual tracks from "multitracks", which have a set per frame.
-    MultiviewTrackList<int> tracks(num_views);
-
-    for (int i = 0; i < num_components; i += 1) {
-      // Do not keep "multi-tracks" which were observed twice in one frame.
-      MultiviewTrack<int> track;
-      bool consistent = multitrackToTrack(multitracks.track(i), track);
-
-      if (consistent) {
-        // Add to the list.
-        tracks.push_back(MultiviewTrack<int>());
-        tracks.back().swap(track);
-      }
-    }
+    MultiviewTrackList<int> tracks;
+    keepConsistentTracks(multitracks, tracks);
 
     int num_tracks_discarded = multitracks.numTracks() - tracks.numTracks();
     LOG(INFO) << "Discarded " << num_tracks_discarded <<
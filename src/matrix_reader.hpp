@@ -4,6 +4,9 @@
 #include <opencv2/core/core.hpp>
 #include "reader.hpp"
 
+// Reads a matrix from a node. Returns false if the node is empty.
+bool readMatrix(const cv::FileNode& node, cv::Mat& A);
+
 class MatrixReader : public Reader<cv::Mat> {
   public:
     ~MatrixReader();
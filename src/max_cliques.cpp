@@ -0,0 +1,540 @@
+#include "max_cliques.hpp"
+#include <algorithm>
+#include <iterator>
+#include <glog/logging.h>
+#include "match_graph.hpp"
+#include "util/thread-pool.hpp"
+
+MaxCliqueOptions::MaxCliqueOptions() : min_size(1), consistent(false) {}
+
+namespace {
+
+typedef std::vector<int> VertexSet;
+typedef std::vector<VertexSet> CliqueList;
+
+// A connected component, with its vertices numbered by their rank in
+// degeneracy order. Neighbour lists are sorted by rank.
+struct CliqueComponent {
+  // Vertex of the graph at each rank.
+  std::vector<int> vertices;
+  std::vector<size_t> offsets;
+  std::vector<int> neighbors;
+
+  int size() const {
+    return vertices.size();
+  }
+
+  VertexSet::const_iterator begin(int v) const {
+    return neighbors.begin() + offsets[v];
+  }
+
+  VertexSet::const_iterator end(int v) const {
+    return neighbors.begin() + offsets[v + 1];
+  }
+
+  void swap(CliqueComponent& other) {
+    vertices.swap(other.vertices);
+    offsets.swap(other.offsets);
+    neighbors.swap(other.neighbors);
+  }
+};
+
+// Maximum number of branches whose cliques are held before they are passed
+// to the visitor, unless one component has more.
+const int MAX_BATCH_BRANCHES = 1 << 14;
+
+// Whether a vertex is matched to two or more features of one frame.
+bool isAmbiguous(const MatchGraph& graph, int vertex) {
+  const int* neighbors = graph.neighbors(vertex);
+  VertexSet distinct(neighbors, neighbors + graph.degree(vertex));
+  std::sort(distinct.begin(), distinct.end());
+  distinct.erase(std::unique(distinct.begin(), distinct.end()),
+      distinct.end());
+
+  std::vector<std::pair<int, int> > frames;
+  VertexSet::const_iterator u;
+  for (u = distinct.begin(); u != distinct.end(); ++u) {
+    frames.push_back(std::make_pair(graph[*u].view, graph[*u].time));
+  }
+  std::sort(frames.begin(), frames.end());
+  return std::adjacent_find(frames.begin(), frames.end()) != frames.end();
+}
+
+bool largerComponent(const VertexSet& lhs, const VertexSet& rhs) {
+  return lhs.size() > rhs.size();
+}
+
+// Orders the vertices by repeatedly removing one of least degree, and finds
+// the core number of each (Batagelj and Zaversnik). Degrees are taken from
+// sorted, unique neighbour lists in local terms.
+void degeneracyOrder(const std::vector<VertexSet>& adjacency,
+                     std::vector<int>& order,
+                     std::vector<int>& cores) {
+  int n = adjacency.size();
+  std::vector<int> degrees(n);
+  int max_degree = 0;
+  for (int v = 0; v < n; v += 1) {
+    degrees[v] = adjacency[v].size();
+    max_degree = std::max(max_degree, degrees[v]);
+  }
+
+  // Sort the vertices by degree into bins.
+  std::vector<int> bins(max_degree + 1, 0);
+  for (int v = 0; v < n; v += 1) {
+    bins[degrees[v]] += 1;
+  }
+  int start = 0;
+  for (int d = 0; d <= max_degree; d += 1) {
+    int count = bins[d];
+    bins[d] = start;
+    start += count;
+  }
+  order.assign(n, 0);
+  std::vector<int> positions(n);
+  for (int v = 0; v < n; v += 1) {
+    positions[v] = bins[degrees[v]];
+    order[positions[v]] = v;
+    bins[degrees[v]] += 1;
+  }
+  for (int d = max_degree; d > 0; d -= 1) {
+    bins[d] = bins[d - 1];
+  }
+  bins[0] = 0;
+
+  // Remove vertices in order. Each neighbour still present moves to the
+  // front of its bin, then into the bin below.
+  for (int i = 0; i < n; i += 1) {
+    int v = order[i];
+    VertexSet::const_iterator u;
+    for (u = adjacency[v].begin(); u != adjacency[v].end(); ++u) {
+      if (degrees[*u] > degrees[v]) {
+        int d = degrees[*u];
+        int first = order[bins[d]];
+        if (first != *u) {
+          std::swap(order[positions[*u]], order[bins[d]]);
+          std::swap(positions[*u], positions[first]);
+        }
+        bins[d] += 1;
+        degrees[*u] -= 1;
+      }
+    }
+  }
+
+  cores.swap(degrees);
+}
+
+// Builds a component from its vertices. Vertices whose core number is too
+// small to be in a large enough clique are left out, and so are ambiguous
+// vertices if required.
+void buildComponent(const MatchGraph& graph,
+                    const VertexSet& vertices,
+                    const MaxCliqueOptions& options,
+                    CliqueComponent& component) {
+  int n = vertices.size();
+
+  std::vector<char> kept(n, 1);
+  if (options.consistent) {
+    for (int i = 0; i < n; i += 1) {
+      kept[i] = !isAmbiguous(graph, vertices[i]);
+    }
+  }
+
+  // Neighbours in local terms. Parallel matches are one edge.
+  std::vector<VertexSet> adjacency(n);
+  for (int i = 0; i < n; i += 1) {
+    if (!kept[i]) {
+      continue;
+    }
+    int vertex = vertices[i];
+    const int* neighbors = graph.neighbors(vertex);
+    int degree = graph.degree(vertex);
+    for (int k = 0; k < degree; k += 1) {
+      if (neighbors[k] == vertex) {
+        continue;
+      }
+      VertexSet::const_iterator j = std::lower_bound(vertices.begin(),
+          vertices.end(), neighbors[k]);
+      CHECK(j != vertices.end() && *j == neighbors[k]);
+      if (kept[j - vertices.begin()]) {
+        adjacency[i].push_back(j - vertices.begin());
+      }
+    }
+    std::sort(adjacency[i].begin(), adjacency[i].end());
+    adjacency[i].erase(std::unique(adjacency[i].begin(), adjacency[i].end()),
+        adjacency[i].end());
+  }
+
+  std::vector<int> order;
+  std::vector<int> cores;
+  degeneracyOrder(adjacency, order, cores);
+
+  // Number the remaining vertices by rank.
+  std::vector<int> ranks(n, -1);
+  component.vertices.clear();
+  for (int i = 0; i < n; i += 1) {
+    int v = order[i];
+    if (kept[v] && cores[v] + 1 >= options.min_size) {
+      ranks[v] = component.vertices.size();
+      component.vertices.push_back(vertices[v]);
+    }
+  }
+
+  int m = component.vertices.size();
+  component.offsets.assign(1, 0);
+  component.neighbors.clear();
+  for (int i = 0; i < n; i += 1) {
+    int v = order[i];
+    if (ranks[v] < 0) {
+      continue;
+    }
+
+    size_t begin = component.neighbors.size();
+    VertexSet::const_iterator u;
+    for (u = adjacency[v].begin(); u != adjacency[v].end(); ++u) {
+      if (ranks[*u] >= 0) {
+        component.neighbors.push_back(ranks[*u]);
+      }
+    }
+    std::sort(component.neighbors.begin() + begin, component.neighbors.end());
+    component.offsets.push_back(component.neighbors.size());
+  }
+  CHECK(int(component.offsets.size()) == m + 1);
+}
+
+// Builds the component of each index. For use with ThreadPool::parallelFor().
+class BuildComponentFunction {
+  public:
+    BuildComponentFunction(const MatchGraph& graph,
+                           const std::vector<VertexSet>& vertices,
+                           const MaxCliqueOptions& options,
+                           std::vector<CliqueComponent>& components)
+        : graph_(&graph),
+          vertices_(&vertices),
+          options_(&options),
+          components_(&components) {}
+
+    void operator()(int i) const {
+      buildComponent(*graph_, (*vertices_)[i], *options_, (*components_)[i]);
+    }
+
+  private:
+    const MatchGraph* graph_;
+    const std::vector<VertexSet>* vertices_;
+    const MaxCliqueOptions* options_;
+    std::vector<CliqueComponent>* components_;
+};
+
+// Bron-Kerbosch with Tomita pivoting within one component.
+class CliqueSearch {
+  public:
+    CliqueSearch(const CliqueComponent& component,
+                 const MaxCliqueOptions& options,
+                 CliqueList& cliques)
+        : component_(&component), options_(&options), cliques_(&cliques) {}
+
+    // Finds the maximal cliques whose earliest vertex in degeneracy order is
+    // the root.
+    void searchFrom(int root) {
+      VertexSet candidates;
+      VertexSet excluded;
+      VertexSet::const_iterator u;
+      for (u = component_->begin(root); u != component_->end(root); ++u) {
+        if (*u > root) {
+          candidates.push_back(*u);
+        } else {
+          excluded.push_back(*u);
+        }
+      }
+
+      VertexSet clique(1, root);
+      expand(clique, candidates, excluded);
+    }
+
+  private:
+    // Vertices of a set which are adjacent to v.
+    void restrict(const VertexSet& set, int v, VertexSet& result) const {
+      result.clear();
+      VertexSet::const_iterator a = set.begin();
+      VertexSet::const_iterator b = component_->begin(v);
+      VertexSet::const_iterator b_end = component_->end(v);
+
+      while (a != set.end() && b != b_end) {
+        if (*a < *b) {
+          ++a;
+        } else if (*b < *a) {
+          ++b;
+        } else {
+          result.push_back(*a);
+          ++a;
+          ++b;
+        }
+      }
+    }
+
+    int numAdjacent(const VertexSet& set, int v) const {
+      int count = 0;
+      VertexSet::const_iterator a = set.begin();
+      VertexSet::const_iterator b = component_->begin(v);
+      VertexSet::const_iterator b_end = component_->end(v);
+
+      while (a != set.end() && b != b_end) {
+        if (*a < *b) {
+          ++a;
+        } else if (*b < *a) {
+          ++b;
+        } else {
+          count += 1;
+          ++a;
+          ++b;
+        }
+      }
+      return count;
+    }
+
+    // Chooses the vertex of either set with the most neighbours amongst the
+    // candidates.
+    int choosePivot(const VertexSet& candidates,
+                    const VertexSet& excluded) const {
+      int pivot = -1;
+      int max_adjacent = -1;
+      const VertexSet* sets[] = { &candidates, &excluded };
+      for (int i = 0; i < 2; i += 1) {
+        VertexSet::const_iterator u;
+        for (u = sets[i]->begin(); u != sets[i]->end(); ++u) {
+          int adjacent = numAdjacent(candidates, *u);
+          if (adjacent > max_adjacent) {
+            pivot = *u;
+            max_adjacent = adjacent;
+          }
+        }
+      }
+      return pivot;
+    }
+
+    void expand(VertexSet& clique,
+                const VertexSet& candidates,
+                const VertexSet& excluded) {
+      if (candidates.empty()) {
+        if (excluded.empty() && int(clique.size()) >= options_->min_size) {
+          report(clique);
+        }
+        return;
+      }
+      if (int(clique.size() + candidates.size()) < options_->min_size) {
+        // Cannot grow large enough.
+        return;
+      }
+
+      // Every maximal clique contains the pivot or one of its non-neighbours.
+      int pivot = choosePivot(candidates, excluded);
+      VertexSet branches;
+      std::set_difference(candidates.begin(), candidates.end(),
+          component_->begin(pivot), component_->end(pivot),
+          std::back_inserter(branches));
+
+      VertexSet remaining(candidates);
+      VertexSet visited(excluded);
+      VertexSet next_candidates;
+      VertexSet next_excluded;
+      VertexSet::const_iterator v;
+      for (v = branches.begin(); v != branches.end(); ++v) {
+        restrict(remaining, *v, next_candidates);
+        restrict(visited, *v, next_excluded);
+
+        clique.push_back(*v);
+        expand(clique, next_candidates, next_excluded);
+        clique.pop_back();
+
+        // Cliques with v have been found.
+        remaining.erase(std::lower_bound(remaining.begin(), remaining.end(),
+              *v));
+        visited.insert(std::lower_bound(visited.begin(), visited.end(), *v),
+            *v);
+      }
+    }
+
+    void report(const VertexSet& clique) {
+      cliques_->push_back(VertexSet());
+      VertexSet& vertices = cliques_->back();
+      VertexSet::const_iterator v;
+      for (v = clique.begin(); v != clique.end(); ++v) {
+        vertices.push_back(component_->vertices[*v]);
+      }
+      std::sort(vertices.begin(), vertices.end());
+    }
+
+    const CliqueComponent* component_;
+    const MaxCliqueOptions* options_;
+    CliqueList* cliques_;
+};
+
+// A branch of the search: a component and the root vertex of the branch.
+typedef std::pair<int, int> CliqueBranch;
+
+// Searches one branch per index. For use with ThreadPool::parallelFor().
+class SearchBranchFunction {
+  public:
+    SearchBranchFunction(const std::vector<CliqueComponent>& components,
+                         const std::vector<CliqueBranch>& branches,
+                         const MaxCliqueOptions& options,
+                         std::vector<CliqueList>& cliques)
+        : components_(&components),
+          branches_(&branches),
+          options_(&options),
+          cliques_(&cliques) {}
+
+    void operator()(int i) const {
+      const CliqueBranch& branch = (*branches_)[i];
+      CliqueSearch search((*components_)[branch.first], *options_,
+          (*cliques_)[i]);
+      search.searchFrom(branch.second);
+    }
+
+  private:
+    const std::vector<CliqueComponent>* components_;
+    const std::vector<CliqueBranch>* branches_;
+    const MaxCliqueOptions* options_;
+    std::vector<CliqueList>* cliques_;
+};
+
+void findMaxCliques(const MatchGraph& graph,
+                    const MaxCliqueOptions& options,
+                    CliqueVisitor& visitor,
+                    ThreadPool* pool) {
+  CHECK(options.min_size >= 1);
+  int n = graph.numVertices();
+
+  // Group the vertices of each component, in order.
+  std::vector<int> labels;
+  int num_components = findConnectedComponents(graph, labels);
+  std::vector<VertexSet> members(num_components);
+  for (int v = 0; v < n; v += 1) {
+    members[labels[v]].push_back(v);
+  }
+
+  // Components too small for a clique need not be searched. The largest
+  // come first, since they take the longest.
+  std::vector<VertexSet> vertices;
+  std::vector<VertexSet>::iterator group;
+  for (group = members.begin(); group != members.end(); ++group) {
+    if (int(group->size()) >= options.min_size) {
+      vertices.push_back(VertexSet());
+      vertices.back().swap(*group);
+    }
+  }
+  std::stable_sort(vertices.begin(), vertices.end(), largerComponent);
+
+  int num_searched = vertices.size();
+  std::vector<CliqueComponent> components(num_searched);
+  BuildComponentFunction build(graph, vertices, options, components);
+  if (pool == NULL) {
+    for (int i = 0; i < num_searched; i += 1) {
+      build(i);
+    }
+  } else {
+    pool->parallelFor(0, num_searched, build);
+  }
+  LOG(INFO) << "Searching " << num_searched << " of " << num_components <<
+      " components";
+
+  // Search whole components in batches, so that the cliques of one batch are
+  // passed on before the next is searched.
+  int begin = 0;
+  while (begin < num_searched) {
+    std::vector<CliqueBranch> branches;
+    int end = begin;
+    while (end < num_searched &&
+        (branches.empty() || int(branches.size()) + components[end].size() <=
+            MAX_BATCH_BRANCHES)) {
+      for (int v = 0; v < components[end].size(); v += 1) {
+        branches.push_back(CliqueBranch(end, v));
+      }
+      end += 1;
+    }
+
+    int num_branches = branches.size();
+    std::vector<CliqueList> found(num_branches);
+    SearchBranchFunction search(components, branches, options, found);
+    if (pool == NULL) {
+      for (int i = 0; i < num_branches; i += 1) {
+        search(i);
+      }
+    } else {
+      pool->parallelFor(0, num_branches, search);
+    }
+
+    CliqueList cliques;
+    std::vector<CliqueList>::iterator list;
+    for (list = found.begin(); list != found.end(); ++list) {
+      CliqueList::iterator clique;
+      for (clique = list->begin(); clique != list->end(); ++clique) {
+        cliques.push_back(VertexSet());
+        cliques.back().swap(*clique);
+      }
+      CliqueList().swap(*list);
+    }
+    std::sort(cliques.begin(), cliques.end());
+
+    CliqueList::const_iterator clique;
+    for (clique = cliques.begin(); clique != cliques.end(); ++clique) {
+      visitor.clique(*clique);
+    }
+
+    // Free the components which have been searched.
+    for (int i = begin; i < end; i += 1) {
+      CliqueComponent().swap(components[i]);
+    }
+    begin = end;
+  }
+}
+
+// Appends every clique to a list.
+class CliqueCollector : public CliqueVisitor {
+  public:
+    explicit CliqueCollector(CliqueList& cliques) : cliques_(&cliques) {}
+
+    void clique(const std::vector<int>& vertices) {
+      cliques_->push_back(vertices);
+    }
+
+  private:
+    CliqueList* cliques_;
+};
+
+void findMaxCliques(const MatchGraph& graph,
+                    const MaxCliqueOptions& options,
+                    CliqueList& cliques,
+                    ThreadPool* pool) {
+  cliques.clear();
+  CliqueCollector collector(cliques);
+  findMaxCliques(graph, options, collector, pool);
+  std::sort(cliques.begin(), cliques.end());
+}
+
+}
+
+void findMaxCliques(const MatchGraph& graph,
+                    const MaxCliqueOptions& options,
+                    CliqueVisitor& visitor) {
+  findMaxCliques(graph, options, visitor, NULL);
+}
+
+void findMaxCliques(const MatchGraph& graph,
+                    const MaxCliqueOptions& options,
+                    CliqueVisitor& visitor,
+                    ThreadPool& pool) {
+  findMaxCliques(graph, options, visitor, &pool);
+}
+
+void findMaxCliques(const MatchGraph& graph,
+                    const MaxCliqueOptions& options,
+                    std::vector<std::vector<int> >& cliques) {
+  findMaxCliques(graph, options, cliques, NULL);
+}
+
+void findMaxCliques(const MatchGraph& graph,
+                    const MaxCliqueOptions& options,
+                    std::vector<std::vector<int> >& cliques,
+                    ThreadPool& pool) {
+  findMaxCliques(graph, options, cliques, &pool);
+}
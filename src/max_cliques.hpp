@@ -0,0 +1,56 @@
+#ifndef MAX_CLIQUES_HPP_
+#define MAX_CLIQUES_HPP_
+
+#include <vector>
+
+class MatchGraph;
+class ThreadPool;
+
+struct MaxCliqueOptions {
+  // Smallest clique to report.
+  int min_size;
+  // Leaves out features which are matched to two or more features of one
+  // frame, since a track could contain at most one of them. Features of one
+  // frame are never matched to each other, so every clique has at most one
+  // feature per frame either way.
+  bool consistent;
+
+  MaxCliqueOptions();
+};
+
+// Receives the cliques as they are found.
+class CliqueVisitor {
+  public:
+    virtual ~CliqueVisitor() {}
+    // The vertices are sorted.
+    virtual void clique(const std::vector<int>& vertices) = 0;
+};
+
+// Finds every maximal clique with at least min_size vertices.
+//
+// Each connected component is searched separately, from every vertex in
+// degeneracy order, by Bron-Kerbosch with Tomita pivoting. The vertices of
+// each clique are sorted, and the cliques are in lexicographic order.
+//
+// The visitor overloads search the components in batches, largest first, and
+// pass the cliques of each batch to the visitor in lexicographic order before
+// searching the next. Only the cliques of one batch are held at once.
+void findMaxCliques(const MatchGraph& graph,
+                    const MaxCliqueOptions& options,
+                    CliqueVisitor& visitor);
+// Searches the components and the branches from their vertices in parallel.
+void findMaxCliques(const MatchGraph& graph,
+                    const MaxCliqueOptions& options,
+                    CliqueVisitor& visitor,
+                    ThreadPool& pool);
+
+void findMaxCliques(const MatchGraph& graph,
+                    const MaxCliqueOptions& options,
+                    std::vector<std::vector<int> >& cliques);
+// Searches the components and the branches from their vertices in parallel.
+void findMaxCliques(const MatchGraph& graph,
+                    const MaxCliqueOptions& options,
+                    std::vector<std::vector<int> >& cliques,
+                    ThreadPool& pool);
+
+#endif
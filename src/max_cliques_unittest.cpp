@@ -0,0 +1,182 @@
+#include "max_cliques.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include "match_graph.hpp"
+#include "util/thread-pool.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+typedef std::vector<int> VertexSet;
+typedef std::vector<VertexSet> CliqueList;
+
+// Every maximal clique of at least min_size vertices, by trying every subset.
+void bruteForceCliques(const std::vector<std::vector<char> >& adjacent,
+                       int min_size,
+                       CliqueList& cliques) {
+  int n = adjacent.size();
+  cliques.clear();
+
+  for (int subset = 1; subset < (1 << n); subset += 1) {
+    VertexSet clique;
+    for (int v = 0; v < n; v += 1) {
+      if (subset & (1 << v)) {
+        clique.push_back(v);
+      }
+    }
+
+    bool is_clique = true;
+    for (int i = 0; i < int(clique.size()) && is_clique; i += 1) {
+      for (int j = i + 1; j < int(clique.size()) && is_clique; j += 1) {
+        is_clique = adjacent[clique[i]][clique[j]];
+      }
+    }
+    if (!is_clique || int(clique.size()) < min_size) {
+      continue;
+    }
+
+    bool maximal = true;
+    for (int u = 0; u < n && maximal; u += 1) {
+      if (subset & (1 << u)) {
+        continue;
+      }
+      bool extends = true;
+      for (int i = 0; i < int(clique.size()) && extends; i += 1) {
+        extends = adjacent[u][clique[i]];
+      }
+      maximal = !extends;
+    }
+    if (maximal) {
+      cliques.push_back(clique);
+    }
+  }
+
+  std::sort(cliques.begin(), cliques.end());
+}
+
+// Random matches between features of different frames, as in a match graph.
+void randomGraph(int n,
+                 int num_frames,
+                 double density,
+                 unsigned int seed,
+                 MatchGraph& graph,
+                 std::vector<std::vector<char> >& adjacent) {
+  std::srand(seed);
+  std::vector<FeatureIndex> features;
+  for (int v = 0; v < n; v += 1) {
+    features.push_back(FeatureIndex(0, v % num_frames, v));
+  }
+
+  adjacent.assign(n, std::vector<char>(n, 0));
+  std::vector<MatchGraphEdge> edges;
+  for (int u = 0; u < n; u += 1) {
+    for (int v = u + 1; v < n; v += 1) {
+      if (u % num_frames == v % num_frames) {
+        continue;
+      }
+      if (std::rand() < density * RAND_MAX) {
+        edges.push_back(MatchGraphEdge(u, v, 1));
+        adjacent[u][v] = 1;
+        adjacent[v][u] = 1;
+      }
+    }
+  }
+
+  ThreadPool pool(0);
+  graph.build(features, edges, pool);
+}
+
+VertexSet makeSet(int a, int b, int c = -1) {
+  VertexSet set;
+  set.push_back(a);
+  set.push_back(b);
+  if (c >= 0) {
+    set.push_back(c);
+  }
+  return set;
+}
+
+// Records the cliques in the order in which they are visited.
+class CliqueRecorder : public CliqueVisitor {
+  public:
+    void clique(const std::vector<int>& vertices) {
+      cliques.push_back(vertices);
+    }
+
+    CliqueList cliques;
+};
+
+}
+
+TEST(FindMaxCliques, VersusBruteForce) {
+  for (int seed = 0; seed < 20; seed += 1) {
+    MatchGraph graph;
+    std::vector<std::vector<char> > adjacent;
+    randomGraph(14, 5, 0.6, seed, graph, adjacent);
+
+    for (int min_size = 1; min_size <= 4; min_size += 1) {
+      CliqueList expected;
+      bruteForceCliques(adjacent, min_size, expected);
+
+      MaxCliqueOptions options;
+      options.min_size = min_size;
+      CliqueList cliques;
+      findMaxCliques(graph, options, cliques);
+      EXPECT_EQ(expected, cliques) << "seed " << seed << ", min_size " <<
+          min_size;
+
+      ThreadPool pool(3);
+      CliqueList parallel;
+      findMaxCliques(graph, options, parallel, pool);
+      EXPECT_EQ(expected, parallel);
+
+      // The visitor receives the same cliques, each once.
+      CliqueRecorder recorder;
+      findMaxCliques(graph, options, recorder, pool);
+      std::sort(recorder.cliques.begin(), recorder.cliques.end());
+      EXPECT_EQ(expected, recorder.cliques);
+    }
+  }
+}
+
+// Features matched to two features of one frame are left out.
+TEST(FindMaxCliques, Consistent) {
+  // a in frame 0, b1 and b2 in frame 1, c in frame 2, d in frame 3.
+  std::vector<FeatureIndex> features;
+  features.push_back(FeatureIndex(0, 0, 0));
+  features.push_back(FeatureIndex(0, 1, 0));
+  features.push_back(FeatureIndex(0, 1, 1));
+  features.push_back(FeatureIndex(0, 2, 0));
+  features.push_back(FeatureIndex(0, 3, 0));
+  const int a = 0, b1 = 1, b2 = 2, c = 3, d = 4;
+
+  std::vector<MatchGraphEdge> edges;
+  edges.push_back(MatchGraphEdge(a, b1, 1));
+  edges.push_back(MatchGraphEdge(a, b2, 1));
+  edges.push_back(MatchGraphEdge(a, c, 1));
+  edges.push_back(MatchGraphEdge(b1, c, 1));
+  edges.push_back(MatchGraphEdge(b2, c, 1));
+  edges.push_back(MatchGraphEdge(b1, d, 1));
+  // A parallel match is not a second feature.
+  edges.push_back(MatchGraphEdge(d, b1, 1));
+
+  ThreadPool pool(0);
+  MatchGraph graph;
+  graph.build(features, edges, pool);
+
+  MaxCliqueOptions options;
+  options.min_size = 2;
+  CliqueList cliques;
+  findMaxCliques(graph, options, cliques);
+  ASSERT_EQ(3u, cliques.size());
+  EXPECT_EQ(makeSet(a, b1, c), cliques[0]);
+  EXPECT_EQ(makeSet(a, b2, c), cliques[1]);
+  EXPECT_EQ(makeSet(b1, d), cliques[2]);
+
+  // a and c are each matched to b1 and b2.
+  options.consistent = true;
+  findMaxCliques(graph, options, cliques);
+  ASSERT_EQ(1u, cliques.size());
+  EXPECT_EQ(makeSet(b1, d), cliques[0]);
+}
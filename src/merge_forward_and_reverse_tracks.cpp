@@ -13,6 +13,12 @@
 #include "track_list_writer.hpp"
 #include "scale_space_position_reader.hpp"
 #include "scale_space_position_writer.hpp"
+#include "track_reader.hpp"
+#include "sequence_sink.hpp"
+#include "yaml_sequence_stream.hpp"
+
+typedef Track<ScaleSpacePosition> ScaleSpaceTrack;
+typedef TrackList<ScaleSpacePosition> ScaleSpaceTrackList;
 
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
@@ -31,6 +37,87 @@ void init(int& argc, char**& argv) {
   }
 }
 
+// Appends each forward track with its frames shifted by the offset.
+class ForwardSink : public SequenceSink<ScaleSpaceTrack> {
+  public:
+    ForwardSink(int offset, ScaleSpaceTrackList& tracks)
+        : offset_(offset), tracks_(&tracks) {}
+
+    void add(ScaleSpaceTrack& forward_track) {
+      tracks_->push_back(ScaleSpaceTrack());
+      ScaleSpaceTrack& track = tracks_->back();
+
+      // Frames are in order, so each point goes at the end.
+      ScaleSpaceTrack::const_iterator elem;
+      for (elem = forward_track.begin(); elem != forward_track.end(); ++elem) {
+        track.insert(track.end(),
+            std::make_pair(offset_ + elem->first, elem->second));
+      }
+    }
+
+  private:
+    int offset_;
+    ScaleSpaceTrackList* tracks_;
+};
+
+// Joins each reverse track to the forward track with the same seed, which
+// is the one at the same position in the list.
+class ReverseSink : public SequenceSink<ScaleSpaceTrack> {
+  public:
+    ReverseSink(int offset, ScaleSpaceTrackList& tracks)
+        : offset_(offset), tracks_(&tracks), index_(0), merged_() {}
+
+    void add(ScaleSpaceTrack& reverse_track) {
+      CHECK(index_ < tracks_->size()) << "More reverse than forward tracks";
+      ScaleSpaceTrack& forward_track = (*tracks_)[index_];
+      merged_.clear();
+
+      // Both are in order of frame once the reverse track is read backwards.
+      // Where they meet, the reverse point replaces the forward point.
+      ScaleSpaceTrack::const_iterator forward = forward_track.begin();
+      ScaleSpaceTrack::const_reverse_iterator reverse =
+          reverse_track.rbegin();
+
+      while (forward != forward_track.end() ||
+          reverse != reverse_track.rend()) {
+        bool take_reverse;
+        if (reverse == reverse_track.rend()) {
+          take_reverse = false;
+        } else if (forward == forward_track.end()) {
+          take_reverse = true;
+        } else {
+          take_reverse = (offset_ - reverse->first <= forward->first);
+        }
+
+        if (take_reverse) {
+          int frame = offset_ - reverse->first;
+          if (forward != forward_track.end() && forward->first == frame) {
+            ++forward;
+          }
+          merged_.insert(merged_.end(), std::make_pair(frame, reverse->second));
+          ++reverse;
+        } else {
+          merged_.insert(merged_.end(), *forward);
+          ++forward;
+        }
+      }
+
+      forward_track.swap(merged_);
+      index_ += 1;
+    }
+
+    int size() const {
+      return index_;
+    }
+
+  private:
+    int offset_;
+    ScaleSpaceTrackList* tracks_;
+    int index_;
+    // Re-used for every track, its nodes are returned to the pool.
+    ScaleSpaceTrack merged_;
+};
+
 int main(int argc, char** argv) {
   init(argc, argv);
 
@@ -41,58 +128,24 @@ int main(int argc, char** argv) {
 
   bool ok;
 
-  // Load tracks.
-  TrackList<ScaleSpacePosition> forward_tracks;
-  TrackList<ScaleSpacePosition> reverse_tracks;
   ScaleSpacePositionReader feature_reader;
-  ok = loadTrackList(forward_file, forward_tracks, feature_reader);
+  TrackReader<ScaleSpacePosition> track_reader(feature_reader);
+
+  // Read the forward tracks into the output, then join each reverse track to
+  // its forward track as it is read. Only the output is resident.
+  ScaleSpaceTrackList tracks;
+  ForwardSink forward_sink(offset, tracks);
+  ok = streamSequence(forward_file, std::vector<std::string>(), track_reader,
+      forward_sink);
   CHECK(ok) << "Could not load forward tracks";
-  LOG(INFO) << "Loaded " << forward_tracks.size() << " forward tracks";
-  ok = loadTrackList(reverse_file, reverse_tracks, feature_reader);
-  CHECK(ok) << "Could not load reverse tracks";
-  LOG(INFO) << "Loaded " << reverse_tracks.size() << " reverse tracks";
-
-  int num_tracks = forward_tracks.size();
-  CHECK(forward_tracks.size() == reverse_tracks.size());
-
-  // Merge tracks.
-  TrackList<ScaleSpacePosition> tracks(num_tracks);
-
-  {
-    TrackList<ScaleSpacePosition>::const_iterator forward_track;
-    TrackList<ScaleSpacePosition>::iterator track = tracks.begin();
-
-    for (forward_track = forward_tracks.begin();
-         forward_track != forward_tracks.end();
-         ++forward_track) {
-      Track<ScaleSpacePosition>::const_iterator elem;
-      for (elem = forward_track->begin();
-           elem != forward_track->end();
-           ++elem) {
-        (*track)[offset + elem->first] = elem->second;
-      }
-
-      ++track;
-    }
-  }
+  LOG(INFO) << "Loaded " << tracks.size() << " forward tracks";
 
-  {
-    TrackList<ScaleSpacePosition>::const_iterator reverse_track;
-    TrackList<ScaleSpacePosition>::iterator track = tracks.begin();
-
-    for (reverse_track = reverse_tracks.begin();
-         reverse_track != reverse_tracks.end();
-         ++reverse_track) {
-      Track<ScaleSpacePosition>::const_iterator elem;
-      for (elem = reverse_track->begin();
-           elem != reverse_track->end();
-           ++elem) {
-        (*track)[offset - elem->first] = elem->second;
-      }
-
-      ++track;
-    }
-  }
+  ReverseSink reverse_sink(offset, tracks);
+  ok = streamSequence(reverse_file, std::vector<std::string>(), track_reader,
+      reverse_sink);
+  CHECK(ok) << "Could not load reverse tracks";
+  LOG(INFO) << "Loaded " << reverse_sink.size() << " reverse tracks";
+  CHECK(reverse_sink.size() == tracks.size());
 
   ScaleSpacePositionWriter feature_writer;
   ok = saveTrackList(tracks_file, tracks, feature_writer);
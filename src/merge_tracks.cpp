@@ -20,9 +20,11 @@
 #include "sift_position_writer.hpp"
 #include "track_list_reader.hpp"
 #include "track_list_writer.hpp"
+#include "track_reader.hpp"
+#include "sequence_sink.hpp"
+#include "yaml_sequence_stream.hpp"
 
 typedef TrackList<SiftPosition> SimilarityTrackList;
-typedef std::vector<SimilarityTrackList> TrackListList;
 
 std::string makeFilename(const std::string& format, int n) {
   return boost::str(boost::format(format) % (n + 1));
@@ -32,43 +34,35 @@ bool fileExists(const std::string& filename) {
   return std::ifstream(filename.c_str()).good();
 }
 
+// Appends the tracks of every frame to one list as each file is read. Tracks
+// are swapped out of the reader, so only the output is resident.
 bool loadAllTracks(const std::string& tracks_format,
-                   TrackListList& track_lists) {
-  bool ok = true;
-  bool have_frame = true;
-  int t = 0;
-
-  while (have_frame && ok) {
+                   SimilarityTrackList& merged,
+                   int& num_files) {
+  SiftPositionReader feature_reader;
+  TrackReader<SiftPosition> track_reader(feature_reader);
+  ContainerSink<Track<SiftPosition>, SimilarityTrackList> sink(merged);
+  num_files = 0;
+
+  while (true) {
     // Check if file exists.
-    std::string tracks_file = makeFilename(tracks_format, t);
-    have_frame = fileExists(tracks_file);
-    if (!have_frame) {
+    std::string tracks_file = makeFilename(tracks_format, num_files);
+    if (!fileExists(tracks_file)) {
       // End of movie.
-      continue;
+      return true;
     }
 
-    // Add an empty track list.
-    SimilarityTrackList track_list;
-
-    // Attempt to load tracks.
-    SiftPositionReader feature_reader;
-    ok = loadTrackList(tracks_file, track_list, feature_reader);
+    int num_before = merged.size();
+    bool ok = streamSequence(tracks_file, std::vector<std::string>(),
+        track_reader, sink);
     if (!ok) {
-      // Failed.
-      continue;
+      return false;
     }
 
-    LOG(INFO) << "Read " << track_list.size() << " tracks from `" <<
+    LOG(INFO) << "Read " << merged.size() - num_before << " tracks from `" <<
         tracks_file << "'";
-
-    // Put into list.
-    track_lists.push_back(SimilarityTrackList());
-    track_lists.back().swap(track_list);
-
-    t += 1;
+    num_files += 1;
   }
-
-  return ok;
 }
 
 void init(int& argc, char**& argv) {
@@ -96,24 +90,11 @@ int main(int argc, char** argv) {
   bool ok;
 
   // Load tracks from every frame.
-  TrackListList track_lists;
-  ok = loadAllTracks(tracks_format, track_lists);
-  CHECK(ok) << "Could not load all tracks";
-  LOG(INFO) << "Loaded " << track_lists.size() << " lists of tracks";
-
-  // Now combine all tracks.
   SimilarityTrackList merged;
-
-  for (TrackListList::const_iterator tracks = track_lists.begin();
-       tracks != track_lists.end();
-       ++tracks) {
-    // Add each track to the full list.
-    for (SimilarityTrackList::const_iterator track = tracks->begin();
-         track != tracks->end();
-         ++track) {
-      merged.push_back(*track);
-    }
-  }
+  int num_files;
+  ok = loadAllTracks(tracks_format, merged, num_files);
+  CHECK(ok) << "Could not load all tracks";
+  LOG(INFO) << "Loaded " << num_files << " lists of tracks";
 
   SiftPositionWriter feature_writer;
   ok = saveTrackList(merged_file, merged, feature_writer);
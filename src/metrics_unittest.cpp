@@ -0,0 +1,151 @@
+#include "util/metrics.hpp"
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <boost/bind.hpp>
+#include "util/thread-pool.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+std::string write(const Metrics& metrics) {
+  std::ostringstream stream;
+  metrics.write(stream);
+  return stream.str();
+}
+
+bool contains(const std::string& text, const std::string& line) {
+  return text.find(line + "\n") != std::string::npos;
+}
+
+void addOne(Metrics* metrics, int) {
+  metrics->add("tasks_total", 1);
+}
+
+// Sends a request to the local port and returns the whole response.
+std::string request(int port, const std::string& text) {
+  int connection = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  if (connect(connection, reinterpret_cast<sockaddr*>(&address),
+        sizeof(address)) != 0) {
+    close(connection);
+    return std::string();
+  }
+  send(connection, text.c_str(), text.size(), 0);
+
+  std::string response;
+  char buffer[1024];
+  ssize_t n;
+  while ((n = recv(connection, buffer, sizeof(buffer), 0)) > 0) {
+    response.append(buffer, n);
+  }
+  close(connection);
+  return response;
+}
+
+}
+
+TEST(Metrics, WritesCountersAndGauges) {
+  Metrics metrics;
+  metrics.add("frames_total", 2);
+  metrics.add("frames_total", 3);
+  metrics.add("dropped_total{reason=\"invalid warp\"}", 1);
+  metrics.set("queue_depth{stage=\"capture\"}", 4);
+  metrics.set("queue_depth{stage=\"capture\"}", 1);
+  metrics.change("queue_depth{stage=\"track\"}", 3);
+  metrics.change("queue_depth{stage=\"track\"}", -1);
+
+  std::string text = write(metrics);
+  EXPECT_TRUE(contains(text, "# TYPE frames_total counter"));
+  EXPECT_TRUE(contains(text, "frames_total 5"));
+  EXPECT_TRUE(contains(text, "dropped_total{reason=\"invalid warp\"} 1"));
+  EXPECT_TRUE(contains(text, "queue_depth{stage=\"capture\"} 1"));
+  EXPECT_TRUE(contains(text, "queue_depth{stage=\"track\"} 2"));
+
+  // One TYPE line per name, whatever its labels.
+  std::string type = "# TYPE queue_depth gauge\n";
+  std::string::size_type first = text.find(type);
+  ASSERT_NE(std::string::npos, first);
+  EXPECT_EQ(std::string::npos, text.find(type, first + 1));
+
+  EXPECT_TRUE(contains(text, "# TYPE process_resident_memory_bytes gauge"));
+}
+
+TEST(Metrics, CountersKeepTheirDigits) {
+  Metrics metrics;
+  metrics.add("matches_total", 123456789);
+  EXPECT_TRUE(contains(write(metrics), "matches_total 123456789"));
+}
+
+TEST(Metrics, SummaryGivesQuantilesOfLatestObservations) {
+  Metrics metrics;
+  for (int i = 1; i <= 101; i += 1) {
+    metrics.observe("stage_seconds{stage=\"match\"}", i);
+  }
+
+  std::string text = write(metrics);
+  EXPECT_TRUE(contains(text, "# TYPE stage_seconds summary"));
+  EXPECT_TRUE(contains(text,
+        "stage_seconds{stage=\"match\",quantile=\"0.5\"} 51"));
+  EXPECT_TRUE(contains(text,
+        "stage_seconds{stage=\"match\",quantile=\"0.9\"} 91"));
+  EXPECT_TRUE(contains(text,
+        "stage_seconds{stage=\"match\",quantile=\"0.99\"} 100"));
+  EXPECT_TRUE(contains(text, "stage_seconds_sum{stage=\"match\"} 5151"));
+  EXPECT_TRUE(contains(text, "stage_seconds_count{stage=\"match\"} 101"));
+}
+
+TEST(Metrics, SummaryForgetsOldObservations) {
+  Metrics metrics;
+  // The window holds the latest 1024.
+  for (int i = 0; i < 1024; i += 1) {
+    metrics.observe("latency_seconds", 100);
+  }
+  for (int i = 0; i < 1024; i += 1) {
+    metrics.observe("latency_seconds", 1);
+  }
+
+  std::string text = write(metrics);
+  EXPECT_TRUE(contains(text, "latency_seconds{quantile=\"0.99\"} 1"));
+  // Totals are of every observation.
+  EXPECT_TRUE(contains(text, "latency_seconds_count 2048"));
+  EXPECT_TRUE(contains(text, "latency_seconds_sum 103424"));
+}
+
+TEST(Metrics, AddsFromManyThreads) {
+  Metrics metrics;
+  ThreadPool pool(4);
+  pool.parallelFor(0, 10000, boost::bind(addOne, &metrics, _1));
+  EXPECT_TRUE(contains(write(metrics), "tasks_total 10000"));
+}
+
+TEST(MetricsServer, ServesMetrics) {
+  Metrics metrics;
+  metrics.add("frames_total", 7);
+
+  MetricsServer server(metrics);
+  // Any free port will do.
+  int port = 0;
+  for (int candidate = 19090; candidate < 19190; candidate += 1) {
+    if (server.start(candidate)) {
+      port = candidate;
+      break;
+    }
+  }
+  ASSERT_NE(0, port);
+
+  std::string response = request(port, "GET /metrics HTTP/1.0\r\n\r\n");
+  EXPECT_EQ(0u, response.find("HTTP/1.0 200 OK\r\n"));
+  EXPECT_NE(std::string::npos, response.find("\nframes_total 7\n"));
+
+  response = request(port, "GET /other HTTP/1.0\r\n\r\n");
+  EXPECT_EQ(0u, response.find("HTTP/1.0 404 Not Found\r\n"));
+}
@@ -1,16 +1,22 @@
 #include <string>
 #include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
 #include <cstdlib>
+#include <stdint.h>
 #include <glog/logging.h>
 #include <gflags/gflags.h>
 #include <boost/lexical_cast.hpp>
 #include <boost/format.hpp>
 
 #include "multiview_track_list.hpp"
+#include "columnar_multiview_track_list.hpp"
 #include "track_list.hpp"
 #include "sift_position.hpp"
 
 #include "read_lines.hpp"
+#include "feature_files.hpp"
 #include "multiview_track_list_reader.hpp"
 #include "iterator_reader.hpp"
 #include "default_reader.hpp"
@@ -19,10 +25,18 @@
 #include "multiview_track_list_writer.hpp"
 #include "iterator_writer.hpp"
 #include "sift_position_writer.hpp"
+#include "util/thread-pool.hpp"
+#include "util/hash.hpp"
 
 DEFINE_bool(input_multitracks, false,
     "Input tracks or multi-tracks of indices?");
 DEFINE_bool(input_keypoints, true, "Build output from keypoints or tracks?");
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads to gather keypoints with, 0 to gather serially");
+DEFINE_string(previous_index_tracks, "",
+    "Index tracks of an earlier run. Tracks which have not changed since are "
+    "copied from previous_feature_tracks instead of being gathered again");
+DEFINE_string(previous_feature_tracks, "", "Output of the earlier run");
 
 typedef std::vector<int> IndexSet;
 typedef std::vector<SiftPosition> FeatureSet;
@@ -57,254 +71,318 @@ void init(int& argc, char**& argv) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Makes a set containing only one point.
 template<class T>
-void trackToMultitrack(const Track<T>& track,
-                       Track<std::vector<T> >& multitrack) {
-  typedef std::vector<T> Set;
-
-  // Clear output.
-  multitrack.clear();
-
-  typename Track<T>::const_iterator point;
-
-  for (point = track.begin(); point != track.end(); ++point) {
-    // Create a size-one set.
-    Set set;
-    set.push_back(point->second);
-    // Add it to the track.
-    multitrack[point->first] = set;
+struct MakeSingleton {
+  std::vector<T> operator()(const T& x) const {
+    return std::vector<T>(1, x);
   }
-}
+};
 
+// True for sets with at least one element.
 template<class T>
-void multiviewTrackToMultitrack(const MultiviewTrack<T>& track,
-                                MultiviewTrack<std::vector<T> >& multitrack) {
-  typedef std::vector<T> Set;
-
-  // Clear output structure.
-  int num_views = track.numViews();
-  multitrack = MultiviewTrack<Set>(num_views);
-
-  // Add point from each view.
-  typename MultiviewTrack<T>::const_iterator view_track;
-  typename MultiviewTrack<Set>::iterator view_multitrack;
-
-  view_track = track.begin();
-  view_multitrack = multitrack.begin();
-
-  for (int i = 0; i < num_views; i += 1) {
-    trackToMultitrack(*view_track, *view_multitrack);
-
-    ++view_track;
-    ++view_multitrack;
+struct NonEmpty {
+  bool operator()(const std::vector<T>& set) const {
+    return !set.empty();
   }
-}
+};
 
+// Extracts the point from a set which must have exactly one element.
 template<class T>
-void tracksToMultitracks(const MultiviewTrackList<T>& tracks,
-                         MultiviewTrackList<std::vector<T> >& multitracks) {
-  typedef std::vector<T> Set;
-
-  int num_tracks = tracks.numTracks();
-  int num_views = tracks.numViews();
-
-  multitracks = MultiviewTrackList<Set>(num_tracks, num_views);
-
-  for (int i = 0; i < num_tracks; i += 1) {
-    // Create multitrack from track.
-    MultiviewTrack<Set> multitrack(num_views);
-    multiviewTrackToMultitrack(tracks.track(i), multitracks.track(i));
+struct SingleElement {
+  T operator()(const std::vector<T>& set) const {
+    CHECK(set.size() == 1);
+    return set.front();
   }
-}
+};
 
 ////////////////////////////////////////////////////////////////////////////////
 
-template<class T>
-void multitrackToTrack(const Track<std::vector<T> >& multitrack,
-                       Track<T>& track) {
-  typedef std::vector<T> Set;
-
-  track.clear();
+// The points of one view and time, which are contiguous.
+struct FrameRange {
+  int view;
+  int time;
+  int begin;
+  int end;
 
-  typename Track<Set>::const_iterator it;
+  FrameRange(int view, int time, int begin, int end)
+      : view(view), time(time), begin(begin), end(end) {}
+};
 
-  for (it = multitrack.begin(); it != multitrack.end(); ++it) {
-    int time = it->first;
-    const Set& set = it->second;
-    // Assert that the set has exactly one element.
-    CHECK(set.size() == 1);
-    // Add it to the track.
-    track[time] = set.front();
+template<class T>
+void findFrameRanges(const ColumnarMultiviewTrackList<T>& tracks,
+                     std::vector<FrameRange>& frames) {
+  frames.clear();
+
+  for (int view = 0; view < tracks.numViews(); view += 1) {
+    int end = tracks.viewEnd(view);
+    int begin = tracks.viewBegin(view);
+
+    while (begin != end) {
+      int time = tracks.time(begin);
+      int frame_end = tracks.frameEnd(view, time);
+      frames.push_back(FrameRange(view, time, begin, frame_end));
+      begin = frame_end;
+    }
   }
 }
 
-template<class T>
-void multiviewMultitrackToTrack(
-    const MultiviewTrack<std::vector<T> >& multitrack,
-    MultiviewTrack<T>& track) {
-  typedef std::vector<T> Set;
-
-  int num_views = multitrack.numViews();
-  track = MultiviewTrack<T>(num_views);
-
-  // Add point from each view.
-  typename MultiviewTrack<Set>::const_iterator view_multitrack;
-  typename MultiviewTrack<T>::iterator view_track;
-
-  view_multitrack = multitrack.begin();
-  view_track = track.begin();
+// For use with ThreadPool::parallelFor().
+// Each frame writes to a different range of points.
+class GatherKeypointsFunction {
+  public:
+    GatherKeypointsFunction(
+        const ColumnarMultiviewTrackList<IndexSet>& index_tracks,
+        const std::string& features_format,
+        const std::vector<std::string>& views,
+        const std::vector<FrameRange>& frames,
+        ColumnarMultiviewTrackList<FeatureSet>& tracks,
+        std::vector<char>& ok)
+        : index_tracks_(&index_tracks),
+          features_format_(&features_format),
+          views_(&views),
+          frames_(&frames),
+          tracks_(&tracks),
+          ok_(&ok) {}
+
+    void operator()(int n) const {
+      const FrameRange& frame = (*frames_)[n];
+      std::vector<SiftPosition> keypoints;
+
+      // Load features in this frame. Binary files are mapped.
+      std::string file = makeFrameFilename(*features_format_,
+          (*views_)[frame.view], frame.time);
+      if (!loadSiftPositions(file, keypoints)) {
+        LOG(WARNING) << "Could not load keypoints \"" << file << "\"";
+        return;
+      }
+      LOG(INFO) << "Loaded " << keypoints.size() << " features for (" <<
+          frame.view << ", " << frame.time << ")";
+
+      // Copy into track.
+      for (int i = frame.begin; i < frame.end; i += 1) {
+        const IndexSet& indices = index_tracks_->value(i);
+        FeatureSet& set = tracks_->value(i);
+
+        IndexSet::const_iterator index;
+        for (index = indices.begin(); index != indices.end(); ++index) {
+          // Add feature to set.
+          CHECK(*index < int(keypoints.size()));
+          set.push_back(keypoints[*index]);
+        }
+      }
 
-  for (int i = 0; i < num_views; i += 1) {
-    multitrackToTrack(*view_multitrack, *view_track);
+      (*ok_)[n] = 1;
+    }
 
-    ++view_multitrack;
-    ++view_track;
+  private:
+    const ColumnarMultiviewTrackList<IndexSet>* index_tracks_;
+    const std::string* features_format_;
+    const std::vector<std::string>* views_;
+    const std::vector<FrameRange>* frames_;
+    ColumnarMultiviewTrackList<FeatureSet>* tracks_;
+    std::vector<char>* ok_;
+};
+
+// Each (view, time) is loaded once, in parallel.
+bool loadKeypoints(const ColumnarMultiviewTrackList<IndexSet>& index_tracks,
+                   const std::string& features_format,
+                   const std::vector<std::string>& views,
+                   ColumnarMultiviewTrackList<FeatureSet>& tracks,
+                   ThreadPool& pool) {
+  int num_views = views.size();
+  CHECK(index_tracks.numViews() == num_views);
+  // Same points, with empty sets.
+  tracks.assignKeys(index_tracks);
+
+  std::vector<FrameRange> frames;
+  findFrameRanges(index_tracks, frames);
+  std::vector<char> ok(frames.size(), 0);
+  pool.parallelFor(0, frames.size(), GatherKeypointsFunction(index_tracks,
+        features_format, views, frames, tracks, ok));
+  if (std::count(ok.begin(), ok.end(), 0) != 0) {
+    return false;
   }
-}
 
-template<class T>
-void multitracksToTracks(const MultiviewTrackList<std::vector<T> >& multitracks,
-                         MultiviewTrackList<T>& tracks) {
-  typedef std::vector<T> Set;
+  // Sets of no indices do not produce a point.
+  tracks.filter(NonEmpty<SiftPosition>());
 
-  int num_tracks = multitracks.numTracks();
-  int num_views = multitracks.numViews();
-
-  tracks = MultiviewTrackList<T>(num_tracks, num_views);
-
-  for (int i = 0; i < num_tracks; i += 1) {
-    // Create multitrack from track.
-    MultiviewTrack<T> track;
-    multiviewMultitrackToTrack(multitracks.track(i), tracks.track(i));
-  }
+  return true;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-
-bool loadKeypoints(const MultiviewTrackList<IndexSet>& index_tracks,
-                   const std::string& features_format,
-                   const std::vector<std::string>& views,
-                   MultiviewTrackList<FeatureSet>& tracks) {
+bool loadTracks(const ColumnarMultiviewTrackList<IndexSet>& index_tracks,
+                const std::string& features_format,
+                const std::vector<std::string>& views,
+                MultiviewTrackList<FeatureSet>& tracks) {
   // Initialize list of empty tracks.
   int num_features = index_tracks.numTracks();
   int num_views = views.size();
+  CHECK(index_tracks.numViews() == num_views);
   tracks = MultiviewTrackList<FeatureSet>(num_features, num_views);
 
-  // Iterate through time (to avoid loading all features at once).
-  MultiViewTimeIterator<IndexSet> iterator(index_tracks);
-
-  while (!iterator.end()) {
-    int time = iterator.time();
+  for (int view = 0; view < num_views; view += 1) {
+    int end = index_tracks.viewEnd(view);
+    int begin = index_tracks.viewBegin(view);
 
-    for (int view = 0; view < num_views; view += 1) {
-      // Get feature indices matched in this frame.
-      std::map<int, IndexSet> subset;
-      iterator.getView(view, subset);
+    while (begin != end) {
+      int time = index_tracks.time(begin);
+      int frame_end = index_tracks.frameEnd(view, time);
 
-      // Only load tracks if there were some features.
-      if (!subset.empty()) {
-        std::vector<SiftPosition> keypoints;
+      TrackList<SiftPosition> features;
 
-        // Load features in this frame.
-        std::string file;
-        file = makeFrameFilename(features_format, views[view], time);
-        SiftPositionReader reader;
-        bool ok = loadList(file, keypoints, reader);
-        if (!ok) {
-          return false;
-        }
-        LOG(INFO) << "Loaded " << keypoints.size() << " features for (" <<
-            view << ", " << time << ")";
-
-        // Copy into track.
-        std::map<int, IndexSet>::const_iterator it;
-        for (it = subset.begin(); it != subset.end(); ++it) {
-          int track = it->first;
-          const IndexSet& indices = it->second;
-
-          CHECK(track < num_features);
-
-          IndexSet::const_iterator index;
-          for (index = indices.begin(); index != indices.end(); ++index) {
-            // Instantiates a set if it doesn't already exist.
-            FeatureSet& set = tracks.track(track).view(view)[time];
-
-            // Add feature to set.
-            CHECK(*index < int(keypoints.size()));
-            set.push_back(keypoints[*index]);
+      // Load features in this frame.
+      std::string file;
+      file = makeFrameFilename(features_format, views[view], time);
+      SiftPositionReader reader;
+      bool ok = loadTrackList(file, features, reader);
+      if (!ok) {
+        return false;
+      }
+      LOG(INFO) << "Loaded " << features.size() << " tracks for (" << view <<
+          ", " << time << ")";
+
+      // Iterate through features in this frame.
+      for (int i = begin; i < frame_end; i += 1) {
+        int id = index_tracks.track(i);
+        const IndexSet& indices = index_tracks.value(i);
+
+        IndexSet::const_iterator index;
+        for (index = indices.begin(); index != indices.end(); ++index) {
+          // Copy every point in the track.
+          CHECK(*index < int(features.size()));
+          const Track<SiftPosition>& track = features[*index];
+
+          Track<SiftPosition>::const_iterator point;
+          for (point = track.begin(); point != track.end(); ++point) {
+            int t = point->first;
+            const SiftPosition& x = point->second;
+
+            tracks.track(id).view(view)[t].push_back(x);
           }
         }
       }
-    }
 
-    iterator.next();
+      begin = frame_end;
+    }
   }
 
   return true;
 }
 
-bool loadTracks(const MultiviewTrackList<IndexSet>& index_tracks,
-                const std::string& features_format,
-                const std::vector<std::string>& views,
-                MultiviewTrackList<FeatureSet>& tracks) {
-  // Initialize list of empty tracks.
-  int num_features = index_tracks.numTracks();
-  int num_views = views.size();
-  tracks = MultiviewTrackList<FeatureSet>(num_features, num_views);
-
-  // Iterate through time (to avoid loading all features at once).
-  MultiViewTimeIterator<IndexSet> iterator(index_tracks);
+////////////////////////////////////////////////////////////////////////////////
 
-  while (!iterator.end()) {
-    int time = iterator.time();
+// Hash of every (view, time, index) of a track.
+uint64_t hashIndexTrack(const MultiviewTrack<int>& track) {
+  Hash hash;
+  for (int view = 0; view < track.numViews(); view += 1) {
+    Track<int>::const_iterator point;
+    for (point = track.view(view).begin(); point != track.view(view).end();
+        ++point) {
+      hash.add(int32_t(view));
+      hash.add(int32_t(point->first));
+      hash.add(int32_t(point->second));
+    }
+  }
+  return hash.value();
+}
 
-    for (int view = 0; view < num_views; view += 1) {
-      // Get feature indices matched in this frame.
-      std::map<int, IndexSet> subset;
-      iterator.getView(view, subset);
+bool equalIndexTracks(const MultiviewTrack<int>& lhs,
+                      const MultiviewTrack<int>& rhs) {
+  if (lhs.numViews() != rhs.numViews()) {
+    return false;
+  }
+  for (int view = 0; view < lhs.numViews(); view += 1) {
+    const Track<int>& x = lhs.view(view);
+    const Track<int>& y = rhs.view(view);
+    if (x.size() != y.size() || !std::equal(x.begin(), x.end(), y.begin())) {
+      return false;
+    }
+  }
+  return true;
+}
 
-      // Only load tracks if there were some features.
-      if (!subset.empty()) {
-        TrackList<SiftPosition> features;
+// Finds, for every track, an identical track in the previous list, or -1.
+void findUnchangedTracks(const MultiviewTrackList<int>& tracks,
+                         const MultiviewTrackList<int>& previous,
+                         std::vector<int>& unchanged) {
+  typedef std::multimap<uint64_t, int> HashIndex;
+  HashIndex index;
+  for (int j = 0; j < previous.numTracks(); j += 1) {
+    index.insert(std::make_pair(hashIndexTrack(previous.track(j)), j));
+  }
 
-        // Load features in this frame.
-        std::string file;
-        file = makeFrameFilename(features_format, views[view], time);
-        SiftPositionReader reader;
-        bool ok = loadTrackList(file, features, reader);
-        if (!ok) {
-          return false;
-        }
-        LOG(INFO) << "Loaded " << features.size() << " tracks for (" << view <<
-            ", " << time << ")";
-
-        // Iterate through features in this frame.
-        std::map<int, IndexSet>::const_iterator it;
-        for (it = subset.begin(); it != subset.end(); ++it) {
-          int id = it->first;
-          const IndexSet& indices = it->second;
-          CHECK(id < num_features);
-
-          IndexSet::const_iterator index;
-          for (index = indices.begin(); index != indices.end(); ++index) {
-            // Copy every point in the track.
-            CHECK(*index < int(features.size()));
-            const Track<SiftPosition>& track = features[*index];
-
-            Track<SiftPosition>::const_iterator point;
-            for (point = track.begin(); point != track.end(); ++point) {
-              int t = point->first;
-              const SiftPosition& x = point->second;
-
-              tracks.track(id).view(view)[t].push_back(x);
-            }
-          }
-        }
+  unchanged.assign(tracks.numTracks(), -1);
+  for (int i = 0; i < tracks.numTracks(); i += 1) {
+    const MultiviewTrack<int>& track = tracks.track(i);
+    std::pair<HashIndex::const_iterator, HashIndex::const_iterator> range =
+        index.equal_range(hashIndexTrack(track));
+
+    HashIndex::const_iterator match;
+    for (match = range.first; match != range.second; ++match) {
+      // Rule out collisions.
+      if (equalIndexTracks(track, previous.track(match->second))) {
+        unchanged[i] = match->second;
+        break;
       }
     }
+  }
+}
 
-    iterator.next();
+// Builds tracks of keypoints from tracks of indices, copying those which are
+// unchanged from a previous run. Only the frames of changed tracks are read.
+bool loadKeypointTracksIncremental(
+    const MultiviewTrackList<int>& index_tracks,
+    const MultiviewTrackList<int>& previous_index_tracks,
+    const MultiviewTrackList<SiftPosition>& previous_tracks,
+    const std::string& features_format,
+    const std::vector<std::string>& views,
+    MultiviewTrackList<SiftPosition>& tracks,
+    ThreadPool& pool) {
+  CHECK(previous_tracks.numTracks() == previous_index_tracks.numTracks()) <<
+      "Previous feature tracks do not match previous index tracks";
+
+  std::vector<int> unchanged;
+  findUnchangedTracks(index_tracks, previous_index_tracks, unchanged);
+
+  // Gather the changed tracks as a smaller list.
+  int num_views = index_tracks.numViews();
+  MultiviewTrackList<int> changed(num_views);
+  for (int i = 0; i < index_tracks.numTracks(); i += 1) {
+    if (unchanged[i] < 0) {
+      changed.push_back(index_tracks.track(i));
+    }
   }
+  int num_changed = changed.numTracks();
+  LOG(INFO) << "Reusing " << index_tracks.numTracks() - num_changed << " / " <<
+      index_tracks.numTracks() << " tracks";
+
+  ColumnarMultiviewTrackList<IndexSet> index_multitracks;
+  ColumnarMultiviewTrackList<int> columns(changed);
+  columns.transform(MakeSingleton<int>(), index_multitracks);
+
+  ColumnarMultiviewTrackList<FeatureSet> multitracks;
+  if (!loadKeypoints(index_multitracks, features_format, views, multitracks,
+        pool)) {
+    return false;
+  }
+
+  ColumnarMultiviewTrackList<SiftPosition> feature_columns;
+  multitracks.transform(SingleElement<SiftPosition>(), feature_columns);
+  MultiviewTrackList<SiftPosition> gathered;
+  feature_columns.copyTo(gathered);
+
+  // Interleave the reused and gathered tracks in their original order.
+  tracks = MultiviewTrackList<SiftPosition>(num_views);
+  int next = 0;
+  for (int i = 0; i < index_tracks.numTracks(); i += 1) {
+    if (unchanged[i] >= 0) {
+      tracks.push_back(previous_tracks.track(unchanged[i]));
+    } else {
+      tracks.push_back(gathered.track(next));
+      next += 1;
+    }
+  }
+  CHECK(next == gathered.numTracks());
 
   return true;
 }
@@ -321,15 +399,53 @@ int main(int argc, char** argv) {
   // Load names of views.
   std::vector<std::string> views;
   bool ok = readLines(views_file, views);
+  CHECK(ok) << "Could not load view names";
 
-  MultiviewTrackList<IndexSet> index_multitracks;
+  ThreadPool pool(FLAGS_num_threads);
+
+  if (!FLAGS_previous_index_tracks.empty()) {
+    CHECK(!FLAGS_previous_feature_tracks.empty()) <<
+        "Need the previous feature tracks too";
+    CHECK(!FLAGS_input_multitracks && FLAGS_input_keypoints) <<
+        "Only tracks of keypoints can be built incrementally";
+
+    MultiviewTrackList<int> index_tracks;
+    MultiviewTrackList<int> previous_index_tracks;
+    DefaultReader<int> index_reader;
+    ok = loadMultiviewTrackList(index_tracks_file, index_tracks, index_reader);
+    CHECK(ok) << "Could not load tracks";
+    ok = loadMultiviewTrackList(FLAGS_previous_index_tracks,
+        previous_index_tracks, index_reader);
+    CHECK(ok) << "Could not load previous tracks";
+
+    MultiviewTrackList<SiftPosition> previous_tracks;
+    SiftPositionReader feature_reader;
+    ok = loadMultiviewTrackList(FLAGS_previous_feature_tracks,
+        previous_tracks, feature_reader);
+    CHECK(ok) << "Could not load previous feature tracks";
+
+    MultiviewTrackList<SiftPosition> tracks;
+    ok = loadKeypointTracksIncremental(index_tracks, previous_index_tracks,
+        previous_tracks, features_format, views, tracks, pool);
+    CHECK(ok) << "Could not load keypoints";
+
+    SiftPositionWriter writer;
+    ok = saveMultiviewTrackList(feature_tracks_file, tracks, writer);
+    CHECK(ok) << "Could not save tracks";
+    return 0;
+  }
+
+  ColumnarMultiviewTrackList<IndexSet> index_multitracks;
 
   if (FLAGS_input_multitracks) {
     // Load multi-tracks from file.
+    MultiviewTrackList<IndexSet> multitracks;
     DefaultReader<int> index_reader;
     VectorReader<int> reader(index_reader);
-    ok = loadMultiviewTrackList(index_tracks_file, index_multitracks, reader);
+    ok = loadMultiviewTrackList(index_tracks_file, multitracks, reader);
     CHECK(ok) << "Could not load multi-tracks";
+
+    index_multitracks.assign(multitracks);
   } else {
     // Load tracks from file.
     MultiviewTrackList<int> tracks;
@@ -338,29 +454,41 @@ int main(int argc, char** argv) {
     CHECK(ok) << "Could not load tracks";
 
     // Convert to multitracks.
-    tracksToMultitracks(tracks, index_multitracks);
+    ColumnarMultiviewTrackList<int> columns(tracks);
+    columns.transform(MakeSingleton<int>(), index_multitracks);
   }
 
-  MultiviewTrackList<FeatureSet> multitracks;
-
   // Convert to multitracks of features for reconstructing/visualizing.
   if (FLAGS_input_keypoints) {
-    ok = loadKeypoints(index_multitracks, features_format, views, multitracks);
+    ColumnarMultiviewTrackList<FeatureSet> multitracks;
+    ok = loadKeypoints(index_multitracks, features_format, views, multitracks,
+        pool);
     CHECK(ok) << "Could not load keypoints";
+
+    if (!FLAGS_input_multitracks) {
+      // If we input valid tracks and used keypoints not tracks,
+      // then we can write out valid tracks.
+      ColumnarMultiviewTrackList<SiftPosition> columns;
+      multitracks.transform(SingleElement<SiftPosition>(), columns);
+      MultiviewTrackList<SiftPosition> tracks;
+      columns.copyTo(tracks);
+
+      SiftPositionWriter writer;
+      saveMultiviewTrackList(feature_tracks_file, tracks, writer);
+    } else {
+      // Save multitracks.
+      MultiviewTrackList<FeatureSet> tracks;
+      multitracks.copyTo(tracks);
+
+      SiftPositionWriter feature_writer;
+      VectorWriter<SiftPosition> writer(feature_writer);
+      saveMultiviewTrackList(feature_tracks_file, tracks, writer);
+    }
   } else {
+    MultiviewTrackList<FeatureSet> multitracks;
     ok = loadTracks(index_multitracks, features_format, views, multitracks);
     CHECK(ok) << "Could not load feature tracks";
-  }
-
-  if (!FLAGS_input_multitracks && FLAGS_input_keypoints) {
-    // If we input valid tracks and used keypoints not tracks,
-    // then we can write out valid tracks.
-    MultiviewTrackList<SiftPosition> tracks;
-    multitracksToTracks(multitracks, tracks);
 
-    SiftPositionWriter writer;
-    saveMultiviewTrackList(feature_tracks_file, tracks, writer);
-  } else {
     // Save multitracks.
     SiftPositionWriter feature_writer;
     VectorWriter<SiftPosition> writer(feature_writer);
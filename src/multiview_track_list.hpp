@@ -3,6 +3,7 @@
 
 #include "track.hpp"
 #include "multiview_track.hpp"
+#include "frame_interval_index.hpp"
 #include <vector>
 #include <deque>
 
@@ -57,12 +58,64 @@ class MultiviewTrackList {
 template<class T>
 void swap(MultiviewTrackList<T>& lhs, MultiviewTrackList<T>& rhs);
 
+// Indexes each multiview track by the interval from its first to last frame
+// in any view. See indexTrackIntervals() for a single view.
+template<class T>
+void indexTrackIntervals(const MultiviewTrackList<T>& tracks,
+                         FrameIntervalIndex& index);
+
+// One point of a track, as listed by a MultiviewTimeIndex.
+template<class T>
+struct TimeIndexEntry {
+  int id;
+  const T* point;
+};
+
+// Lists the points of every track by view and time, so that the points in a
+// frame are found in time proportional to their number rather than to the
+// number of tracks. Refers to the points of the track list, which must not be
+// modified or destroyed while the index is in use.
+template<class T>
+class MultiviewTimeIndex {
+  public:
+    typedef const TimeIndexEntry<T>* const_iterator;
+
+    MultiviewTimeIndex();
+    explicit MultiviewTimeIndex(const MultiviewTrackList<T>& tracks);
+
+    int numViews() const;
+    // One after the last frame which has a point in the view.
+    int numFrames(int view) const;
+
+    // Points in one view at one time, in order of track.
+    // Empty for times outside the range.
+    const_iterator begin(int view, int time) const;
+    const_iterator end(int view, int time) const;
+    int size(int view, int time) const;
+
+  private:
+    typedef std::vector<TimeIndexEntry<T> > EntryList;
+
+    // Entries of each view in order of time and then track.
+    std::vector<EntryList> entries_;
+    // Entries of view v at time t are [offsets_[v][t], offsets_[v][t + 1]).
+    std::vector<std::vector<int> > offsets_;
+};
+
 // Iterates over all tracks in one view of a MultiviewTrackList in time order.
+//
+// Constructed from the track list, it advances a cursor in every track at
+// each frame. Constructed from a MultiviewTimeIndex, each frame costs only
+// as much as the points in it.
 template<class T>
 class SingleViewTimeIterator {
   public:
+    typedef typename MultiviewTimeIndex<T>::const_iterator PointIterator;
+
     SingleViewTimeIterator();
     SingleViewTimeIterator(const MultiviewTrackList<T>& tracks, int view);
+    // Does not take ownership of the index.
+    SingleViewTimeIterator(const MultiviewTimeIndex<T>& index, int view);
 
     // Advance to next time instant.
     void next();
@@ -73,6 +126,11 @@ class SingleViewTimeIterator {
     // Copies out the subset of points observed in the current frame.
     void get(std::map<int, T>& points) const;
 
+    // Points observed in the current frame, without copying.
+    // Only available when constructed from an index.
+    PointIterator pointsBegin() const;
+    PointIterator pointsEnd() const;
+
   private:
     typedef TrackIterator<T> Cursor;
     typedef std::vector<Cursor> CursorList;
@@ -80,6 +138,7 @@ class SingleViewTimeIterator {
     int view_;
     int time_;
     CursorList cursors_;
+    const MultiviewTimeIndex<T>* index_;
 };
 
 // Iterates over all tracks in a MultiviewTrackList in time order.
@@ -88,6 +147,8 @@ class MultiViewTimeIterator {
   public:
     MultiViewTimeIterator();
     MultiViewTimeIterator(const MultiviewTrackList<T>& tracks);
+    // Does not take ownership of the index.
+    MultiViewTimeIterator(const MultiviewTimeIndex<T>& index);
 
     // Advance to next time instant.
     void next();
@@ -68,6 +68,40 @@ void swap(MultiviewTrackList<T>& lhs, MultiviewTrackList<T>& rhs) {
   lhs.swap(rhs);
 }
 
+template<class T>
+void indexTrackIntervals(const MultiviewTrackList<T>& tracks,
+                         FrameIntervalIndex& index) {
+  std::vector<int> first;
+  std::vector<int> last;
+
+  typename MultiviewTrackList<T>::const_iterator track;
+  for (track = tracks.begin(); track != tracks.end(); ++track) {
+    // Starts empty.
+    int track_first = 0;
+    int track_last = -1;
+
+    for (int view = 0; view < track->numViews(); view += 1) {
+      const Track<T>& points = track->view(view);
+      if (points.empty()) {
+        continue;
+      }
+
+      if (track_first > track_last) {
+        track_first = points.begin()->first;
+        track_last = points.rbegin()->first;
+      } else {
+        track_first = std::min(track_first, points.begin()->first);
+        track_last = std::max(track_last, points.rbegin()->first);
+      }
+    }
+
+    first.push_back(track_first);
+    last.push_back(track_last);
+  }
+
+  index.init(first, last);
+}
+
 template<class T>
 void MultiviewTrackList<T>::clear() {
   tracks_.clear();
@@ -128,15 +162,116 @@ int MultiviewTrackList<T>::numImageFeatures() const {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+template<class T>
+MultiviewTimeIndex<T>::MultiviewTimeIndex() : entries_(), offsets_() {}
+
+template<class T>
+MultiviewTimeIndex<T>::MultiviewTimeIndex(const MultiviewTrackList<T>& tracks)
+    : entries_(tracks.numViews()), offsets_(tracks.numViews()) {
+  int num_views = tracks.numViews();
+  typename MultiviewTrackList<T>::const_iterator track;
+
+  // Count the points at each time.
+  for (int view = 0; view < num_views; view += 1) {
+    std::vector<int>& offsets = offsets_[view];
+
+    for (track = tracks.begin(); track != tracks.end(); ++track) {
+      const Track<T>& points = track->view(view);
+      if (points.empty()) {
+        continue;
+      }
+      CHECK(points.begin()->first >= 0) << "Negative time in track";
+      int last = points.rbegin()->first;
+      if (int(offsets.size()) < last + 2) {
+        offsets.resize(last + 2, 0);
+      }
+
+      typename Track<T>::const_iterator point;
+      for (point = points.begin(); point != points.end(); ++point) {
+        offsets[point->first + 1] += 1;
+      }
+    }
+
+    if (offsets.empty()) {
+      offsets.push_back(0);
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+  }
+
+  // Fill in the points in order of track.
+  for (int view = 0; view < num_views; view += 1) {
+    EntryList& entries = entries_[view];
+    entries.resize(offsets_[view].back());
+    std::vector<int> next(offsets_[view].begin(), offsets_[view].end() - 1);
+
+    int id = 0;
+    for (track = tracks.begin(); track != tracks.end(); ++track) {
+      const Track<T>& points = track->view(view);
+
+      typename Track<T>::const_iterator point;
+      for (point = points.begin(); point != points.end(); ++point) {
+        TimeIndexEntry<T>& entry = entries[next[point->first]++];
+        entry.id = id;
+        entry.point = &point->second;
+      }
+
+      id += 1;
+    }
+  }
+}
+
+template<class T>
+int MultiviewTimeIndex<T>::numViews() const {
+  return offsets_.size();
+}
+
+template<class T>
+int MultiviewTimeIndex<T>::numFrames(int view) const {
+  return int(offsets_[view].size()) - 1;
+}
+
+template<class T>
+typename MultiviewTimeIndex<T>::const_iterator MultiviewTimeIndex<T>::begin(
+    int view,
+    int time) const {
+  if (time < 0 || time >= numFrames(view)) {
+    return NULL;
+  }
+  return &entries_[view].front() + offsets_[view][time];
+}
+
+template<class T>
+typename MultiviewTimeIndex<T>::const_iterator MultiviewTimeIndex<T>::end(
+    int view,
+    int time) const {
+  if (time < 0 || time >= numFrames(view)) {
+    return NULL;
+  }
+  return &entries_[view].front() + offsets_[view][time + 1];
+}
+
+template<class T>
+int MultiviewTimeIndex<T>::size(int view, int time) const {
+  return end(view, time) - begin(view, time);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 template<class T>
 SingleViewTimeIterator<T>::SingleViewTimeIterator()
-    : view_(-1), time_(0), cursors_() {}
+    : view_(-1), time_(0), cursors_(), index_(NULL) {}
+
+template<class T>
+SingleViewTimeIterator<T>::SingleViewTimeIterator(
+    const MultiviewTimeIndex<T>& index,
+    int view)
+    : view_(view), time_(0), cursors_(), index_(&index) {}
 
 template<class T>
 SingleViewTimeIterator<T>::SingleViewTimeIterator(
     const MultiviewTrackList<T>& tracks,
     int view)
-    : view_(view), time_(0), cursors_() {
+    : view_(view), time_(0), cursors_(), index_(NULL) {
   // Populate cursor list.
   typename MultiviewTrackList<T>::const_iterator multiview_track;
 
@@ -150,6 +285,11 @@ SingleViewTimeIterator<T>::SingleViewTimeIterator(
 
 template<class T>
 void SingleViewTimeIterator<T>::next() {
+  if (index_ != NULL) {
+    time_ += 1;
+    return;
+  }
+
   // Iterate through features.
   typename CursorList::iterator cursor;
 
@@ -170,6 +310,10 @@ void SingleViewTimeIterator<T>::next() {
 
 template<class T>
 bool SingleViewTimeIterator<T>::end() const {
+  if (index_ != NULL) {
+    return time_ >= index_->numFrames(view_);
+  }
+
   // Iterate through features.
   typename CursorList::const_iterator cursor;
   
@@ -193,6 +337,15 @@ template<class T>
 void SingleViewTimeIterator<T>::get(std::map<int, T>& points) const {
   points.clear();
 
+  if (index_ != NULL) {
+    // Points are in order, so each is inserted at the end.
+    PointIterator point;
+    for (point = pointsBegin(); point != pointsEnd(); ++point) {
+      points.insert(points.end(), std::make_pair(point->id, *point->point));
+    }
+    return;
+  }
+
   // Iterate through features.
   typename CursorList::const_iterator cursor = cursors_.begin();
   int index = 0;
@@ -213,12 +366,35 @@ void SingleViewTimeIterator<T>::get(std::map<int, T>& points) const {
   }
 }
 
+template<class T>
+typename SingleViewTimeIterator<T>::PointIterator
+SingleViewTimeIterator<T>::pointsBegin() const {
+  CHECK(index_ != NULL) << "Iterator was not constructed from an index";
+  return index_->begin(view_, time_);
+}
+
+template<class T>
+typename SingleViewTimeIterator<T>::PointIterator
+SingleViewTimeIterator<T>::pointsEnd() const {
+  CHECK(index_ != NULL) << "Iterator was not constructed from an index";
+  return index_->end(view_, time_);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 template<class T>
 MultiViewTimeIterator<T>::MultiViewTimeIterator()
     : views_(), time_(0) {}
 
+template<class T>
+MultiViewTimeIterator<T>::MultiViewTimeIterator(
+    const MultiviewTimeIndex<T>& index)
+    : views_(), time_(0) {
+  for (int view = 0; view < index.numViews(); view += 1) {
+    views_.push_back(SingleViewTimeIterator<T>(index, view));
+  }
+}
+
 template<class T>
 MultiViewTimeIterator<T>::MultiViewTimeIterator(
     const MultiviewTrackList<T>& tracks)
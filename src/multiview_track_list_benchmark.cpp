@@ -0,0 +1,70 @@
+#include <map>
+#include <benchmark/benchmark.h>
+#include <opencv2/core/core.hpp>
+#include "multiview_track_list.hpp"
+
+namespace {
+
+const int NUM_FRAMES = 1000;
+const int TRACK_LENGTH = 20;
+
+// n tracks in one view, each TRACK_LENGTH frames long and starting at a
+// random frame.
+void makeTracks(int n, MultiviewTrackList<int>& tracks) {
+  cv::RNG rng(0);
+  tracks = MultiviewTrackList<int>(n, 1);
+  for (int i = 0; i < n; i += 1) {
+    int start = rng.uniform(0, NUM_FRAMES - TRACK_LENGTH);
+    Track<int>& track = tracks.track(i).view(0);
+    for (int t = start; t < start + TRACK_LENGTH; t += 1) {
+      track[t] = i;
+    }
+  }
+}
+
+// Copies out the points of every frame, advancing a cursor in every track.
+// Argument is the number of tracks.
+void BM_SingleViewTimeIteratorCursors(benchmark::State& state) {
+  int n = state.range(0);
+  MultiviewTrackList<int> tracks;
+  makeTracks(n, tracks);
+
+  std::map<int, int> points;
+  while (state.KeepRunning()) {
+    SingleViewTimeIterator<int> iterator(tracks, 0);
+    while (!iterator.end()) {
+      iterator.get(points);
+      iterator.next();
+    }
+    benchmark::DoNotOptimize(points.size());
+  }
+
+  state.SetItemsProcessed(state.iterations() * n * TRACK_LENGTH);
+}
+
+// Same, with a MultiviewTimeIndex built on every iteration.
+void BM_SingleViewTimeIteratorIndex(benchmark::State& state) {
+  int n = state.range(0);
+  MultiviewTrackList<int> tracks;
+  makeTracks(n, tracks);
+
+  std::map<int, int> points;
+  while (state.KeepRunning()) {
+    MultiviewTimeIndex<int> index(tracks);
+    SingleViewTimeIterator<int> iterator(index, 0);
+    while (!iterator.end()) {
+      iterator.get(points);
+      iterator.next();
+    }
+    benchmark::DoNotOptimize(points.size());
+  }
+
+  state.SetItemsProcessed(state.iterations() * n * TRACK_LENGTH);
+}
+
+BENCHMARK(BM_SingleViewTimeIteratorCursors)->RangeMultiplier(10)
+    ->Range(1000, 100000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SingleViewTimeIteratorIndex)->RangeMultiplier(10)
+    ->Range(1000, 100000)->Unit(benchmark::kMillisecond);
+
+}
@@ -1,6 +1,8 @@
 #include "iterator_reader.hpp"
 #include "multiview_track_reader.hpp"
 #include "track_reader.hpp"
+#include "sequence_sink.hpp"
+#include "yaml_sequence_stream.hpp"
 
 template<class T>
 MultiviewTrackListReader<T>::MultiviewTrackListReader(Reader<T>& reader)
@@ -36,7 +38,8 @@ bool MultiviewTrackListReader<T>::read(const cv::FileNode& node,
 
   // Read tracks into vector.
   MultiviewTrackReader<T> track_reader(*reader_, num_views);
-  if (!readSequence(node["tracks"], track_reader, std::back_inserter(tracks))) {
+  ContainerSink<MultiviewTrack<T>, MultiviewTrackList<T> > sink(tracks);
+  if (!readSequenceToSink(node["tracks"], track_reader, sink)) {
     return false;
   }
 
@@ -48,5 +51,23 @@ bool loadMultiviewTrackList(const std::string& filename,
                             MultiviewTrackList<T>& tracks,
                             Reader<T>& reader) {
   MultiviewTrackListReader<T> list_reader(reader);
-  return load(filename, tracks, list_reader);
+
+  // Read a few tracks at a time rather than parsing the whole file.
+  YamlSequenceStream stream;
+  if (!stream.open(filename, std::vector<std::string>(1, "tracks"))) {
+    return load(filename, tracks, list_reader);
+  }
+
+  int num_views;
+  cv::FileStorage header(stream.header(),
+      cv::FileStorage::READ + cv::FileStorage::MEMORY);
+  if (!header.isOpened() || !::read<int>(header["num_views"], num_views)) {
+    // The number of views did not precede the tracks.
+    return load(filename, tracks, list_reader);
+  }
+
+  tracks = MultiviewTrackList<T>(num_views);
+  MultiviewTrackReader<T> track_reader(reader, num_views);
+  ContainerSink<MultiviewTrack<T>, MultiviewTrackList<T> > sink(tracks);
+  return streamSequence(stream, track_reader, sink);
 }
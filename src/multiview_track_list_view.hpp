@@ -0,0 +1,117 @@
+#ifndef MULTIVIEW_TRACK_LIST_VIEW_HPP_
+#define MULTIVIEW_TRACK_LIST_VIEW_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include "multiview_track.hpp"
+#include "multiview_track_list.hpp"
+#include "track_list_view.hpp"
+#include "binary_file.hpp"
+
+// Read-only multiview track. The track of each view is a TrackView.
+// Does not own its points.
+template<class T>
+class MultiviewTrackView {
+  public:
+    MultiviewTrackView();
+    // Takes num_views + 1 offsets into the points.
+    MultiviewTrackView(const TrackViewPoint<T>* points,
+                       const uint64_t* offsets,
+                       int num_views);
+
+    const T* point(const ImageIndex& frame) const;
+    TrackView<T> view(int view) const;
+
+    int numViews() const;
+    bool empty() const;
+
+    // Returns the index of the first and last frame.
+    int firstFrameNumber() const;
+    int lastFrameNumber() const;
+
+    // Returns the number of image features in all views.
+    int numImageFeatures() const;
+    // Returns the number of views in which the feature was present.
+    int numViewsPresent() const;
+
+    // Replaces the contents of a multiview track.
+    void copyTo(MultiviewTrack<T>& track) const;
+
+    // Iterates through points in time order.
+    // Mirrors MultiviewTrack<T>::TimeIterator.
+    class TimeIterator {
+      public:
+        TimeIterator();
+        TimeIterator(const MultiviewTrackView<T>& track);
+        TimeIterator(const MultiviewTrackView<T>& track, int time);
+
+        // Advance to next time instant.
+        void next();
+        // Reached the end of the tracks?
+        bool end() const;
+        // Current time index.
+        int time() const;
+        // Populates a map of view -> point.
+        void get(std::map<int, T>& points) const;
+
+      private:
+        typedef TrackViewIterator<T> Cursor;
+        typedef std::vector<Cursor> CursorList;
+
+        CursorList cursors_;
+        int time_;
+    };
+
+  private:
+    const TrackViewPoint<T>* points_;
+    const uint64_t* offsets_;
+    int num_views_;
+};
+
+// Read-only list of multiview tracks. The points of view v of track i are
+// group i * numViews() + v of a binary file.
+template<class T>
+class MultiviewTrackListView {
+  public:
+    MultiviewTrackListView();
+
+    // Uses the records of a binary file in place.
+    // Returns false if the file does not contain tracks of the given type.
+    bool map(const BinaryFile& file, BinaryRecordType type);
+    // Copies the tracks into a buffer owned by the view.
+    void assign(const MultiviewTrackList<T>& tracks);
+
+    int numTracks() const;
+    int numViews() const;
+    int numImageFeatures() const;
+    MultiviewTrackView<T> track(int id) const;
+
+  private:
+    struct Buffer {
+      std::vector<TrackViewPoint<T> > points;
+      std::vector<uint64_t> offsets;
+    };
+
+    void reset();
+
+    BinaryFile file_;
+    boost::shared_ptr<const Buffer> buffer_;
+    const TrackViewPoint<T>* points_;
+    const uint64_t* offsets_;
+    int num_tracks_;
+    int num_views_;
+};
+
+// Saves tracks in the binary format which can be mapped by
+// MultiviewTrackListView.
+template<class T>
+bool writeBinaryMultiviewTrackList(const std::string& filename,
+                                   const MultiviewTrackList<T>& tracks,
+                                   BinaryRecordType type);
+
+#include "multiview_track_list_view.inl"
+
+#endif
@@ -0,0 +1,296 @@
+#include <glog/logging.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// MultiviewTrackView
+
+template<class T>
+MultiviewTrackView<T>::MultiviewTrackView()
+    : points_(NULL), offsets_(NULL), num_views_(0) {}
+
+template<class T>
+MultiviewTrackView<T>::MultiviewTrackView(const TrackViewPoint<T>* points,
+                                          const uint64_t* offsets,
+                                          int num_views)
+    : points_(points), offsets_(offsets), num_views_(num_views) {}
+
+template<class T>
+const T* MultiviewTrackView<T>::point(const ImageIndex& frame) const {
+  TrackView<T> track = view(frame.view);
+  typename TrackView<T>::const_iterator result = track.find(frame.time);
+
+  if (result == track.end()) {
+    return NULL;
+  } else {
+    return &result->second;
+  }
+}
+
+template<class T>
+TrackView<T> MultiviewTrackView<T>::view(int view) const {
+  CHECK(view >= 0 && view < num_views_);
+  return TrackView<T>(points_ + offsets_[view], points_ + offsets_[view + 1]);
+}
+
+template<class T>
+int MultiviewTrackView<T>::numViews() const {
+  return num_views_;
+}
+
+template<class T>
+bool MultiviewTrackView<T>::empty() const {
+  return num_views_ == 0 || offsets_[0] == offsets_[num_views_];
+}
+
+template<class T>
+int MultiviewTrackView<T>::firstFrameNumber() const {
+  bool valid = false;
+  int t = -1;
+
+  for (int i = 0; i < num_views_; i += 1) {
+    TrackView<T> track = view(i);
+    if (!track.empty()) {
+      int u = track.begin()->first;
+      if (!valid || u < t) {
+        t = u;
+        valid = true;
+      }
+    }
+  }
+
+  return t;
+}
+
+template<class T>
+int MultiviewTrackView<T>::lastFrameNumber() const {
+  bool valid = false;
+  int t = -1;
+
+  for (int i = 0; i < num_views_; i += 1) {
+    TrackView<T> track = view(i);
+    if (!track.empty()) {
+      int u = track.rbegin()->first;
+      if (!valid || u > t) {
+        t = u;
+        valid = true;
+      }
+    }
+  }
+
+  return t;
+}
+
+template<class T>
+int MultiviewTrackView<T>::numImageFeatures() const {
+  return num_views_ == 0 ? 0 : offsets_[num_views_] - offsets_[0];
+}
+
+template<class T>
+int MultiviewTrackView<T>::numViewsPresent() const {
+  int count = 0;
+  for (int i = 0; i < num_views_; i += 1) {
+    if (offsets_[i] != offsets_[i + 1]) {
+      count += 1;
+    }
+  }
+  return count;
+}
+
+template<class T>
+void MultiviewTrackView<T>::copyTo(MultiviewTrack<T>& track) const {
+  MultiviewTrack<T> copy(num_views_);
+  for (int i = 0; i < num_views_; i += 1) {
+    view(i).copyTo(copy.view(i));
+  }
+  track.swap(copy);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// MultiviewTrackView::TimeIterator
+
+template<class T>
+MultiviewTrackView<T>::TimeIterator::TimeIterator()
+    : cursors_(), time_(-1) {}
+
+template<class T>
+MultiviewTrackView<T>::TimeIterator::TimeIterator(
+    const MultiviewTrackView<T>& track) : cursors_(), time_(0) {
+  // Start at the earliest frame in all views.
+  int first = track.firstFrameNumber();
+  if (first >= 0) {
+    time_ = first;
+  }
+
+  for (int i = 0; i < track.numViews(); i += 1) {
+    cursors_.push_back(Cursor(track.view(i)));
+  }
+}
+
+template<class T>
+MultiviewTrackView<T>::TimeIterator::TimeIterator(
+    const MultiviewTrackView<T>& track,
+    int time)
+    : cursors_(), time_(time) {
+  for (int i = 0; i < track.numViews(); i += 1) {
+    cursors_.push_back(Cursor(track.view(i), time_));
+  }
+}
+
+template<class T>
+void MultiviewTrackView<T>::TimeIterator::next() {
+  typename CursorList::iterator cursor;
+  for (cursor = cursors_.begin(); cursor != cursors_.end(); ++cursor) {
+    // Advance cursor if it points to the current frame.
+    if (!cursor->end() && cursor->time() == time_) {
+      cursor->next();
+    }
+  }
+
+  time_ += 1;
+}
+
+template<class T>
+bool MultiviewTrackView<T>::TimeIterator::end() const {
+  typename CursorList::const_iterator cursor;
+  for (cursor = cursors_.begin(); cursor != cursors_.end(); ++cursor) {
+    // If at least one view has not ended, the multiview track has not ended.
+    if (!cursor->end()) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+template<class T>
+int MultiviewTrackView<T>::TimeIterator::time() const {
+  return time_;
+}
+
+template<class T>
+void MultiviewTrackView<T>::TimeIterator::get(
+    std::map<int, T>& points) const {
+  points.clear();
+
+  int i = 0;
+  typename CursorList::const_iterator cursor;
+  for (cursor = cursors_.begin(); cursor != cursors_.end(); ++cursor) {
+    if (!cursor->end() && cursor->time() == time_) {
+      points[i] = cursor->get();
+    }
+    i += 1;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// MultiviewTrackListView
+
+template<class T>
+MultiviewTrackListView<T>::MultiviewTrackListView()
+    : file_(),
+      buffer_(),
+      points_(NULL),
+      offsets_(NULL),
+      num_tracks_(0),
+      num_views_(0) {}
+
+template<class T>
+void MultiviewTrackListView<T>::reset() {
+  file_ = BinaryFile();
+  buffer_.reset();
+  points_ = NULL;
+  offsets_ = NULL;
+  num_tracks_ = 0;
+  num_views_ = 0;
+}
+
+template<class T>
+bool MultiviewTrackListView<T>::map(const BinaryFile& file,
+                                    BinaryRecordType type) {
+  reset();
+
+  const BinaryFileHeader& header = file.header();
+  if (header.record_type != uint32_t(type) ||
+      header.record_size != sizeof(TrackViewPoint<T>)) {
+    LOG(WARNING) << "File does not contain tracks of the expected type";
+    return false;
+  }
+
+  if (file.numGroups() == 0) {
+    if (file.numRecords() != 0) {
+      LOG(WARNING) << "Points are not grouped into tracks";
+      return false;
+    }
+    // No tracks.
+    file_ = file;
+    num_views_ = file.groupSize();
+    return true;
+  }
+
+  file_ = file;
+  points_ = file.records<TrackViewPoint<T> >(type);
+  offsets_ = file.groups();
+  num_views_ = file.groupSize();
+  num_tracks_ = file.numGroups() / num_views_;
+  return true;
+}
+
+template<class T>
+void MultiviewTrackListView<T>::assign(const MultiviewTrackList<T>& tracks) {
+  reset();
+
+  boost::shared_ptr<Buffer> buffer(new Buffer());
+  buffer->offsets.push_back(0);
+  typename MultiviewTrackList<T>::const_iterator track;
+  for (track = tracks.begin(); track != tracks.end(); ++track) {
+    CHECK(track->numViews() == tracks.numViews());
+    flattenTracks(track->begin(), track->end(), buffer->points,
+        buffer->offsets);
+  }
+
+  buffer_ = buffer;
+  points_ = buffer->points.empty() ? NULL : &buffer->points.front();
+  offsets_ = &buffer->offsets.front();
+  num_tracks_ = tracks.numTracks();
+  num_views_ = tracks.numViews();
+}
+
+template<class T>
+int MultiviewTrackListView<T>::numTracks() const {
+  return num_tracks_;
+}
+
+template<class T>
+int MultiviewTrackListView<T>::numViews() const {
+  return num_views_;
+}
+
+template<class T>
+int MultiviewTrackListView<T>::numImageFeatures() const {
+  return num_tracks_ == 0 ? 0 : offsets_[num_tracks_ * num_views_];
+}
+
+template<class T>
+MultiviewTrackView<T> MultiviewTrackListView<T>::track(int id) const {
+  CHECK(id >= 0 && id < num_tracks_);
+  return MultiviewTrackView<T>(points_, offsets_ + id * num_views_,
+      num_views_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+template<class T>
+bool writeBinaryMultiviewTrackList(const std::string& filename,
+                                   const MultiviewTrackList<T>& tracks,
+                                   BinaryRecordType type) {
+  std::vector<TrackViewPoint<T> > points;
+  std::vector<uint64_t> offsets(1, 0);
+  typename MultiviewTrackList<T>::const_iterator track;
+  for (track = tracks.begin(); track != tracks.end(); ++track) {
+    CHECK(track->numViews() == tracks.numViews());
+    flattenTracks(track->begin(), track->end(), points, offsets);
+  }
+
+  return writeBinaryFile(filename, type, sizeof(TrackViewPoint<T>),
+      points.size(), points.empty() ? NULL : &points.front(), offsets,
+      tracks.numViews());
+}
@@ -1,5 +1,7 @@
 #include "track_reader.hpp"
 #include "iterator_reader.hpp"
+#include "sequence_sink.hpp"
+#include "yaml_sequence_stream.hpp"
 
 template<class T>
 MultiviewTrackReader<T>::MultiviewTrackReader(Reader<T>& reader, int num_views)
@@ -13,6 +15,9 @@ bool MultiviewTrackReader<T>::read(const cv::FileNode& node,
                                    MultiviewTrack<T>& multiview_track) {
   TrackReader<T> track_reader(*reader_);
 
-  multiview_track = MultiviewTrack<T>(num_views_);
-  return readSequence(node, track_reader, multiview_track.begin());
+  MultiviewTrack<T>(num_views_).swap(multiview_track);
+  // Swap each view in rather than copying it.
+  RangeSink<Track<T>, typename MultiviewTrack<T>::iterator> sink(
+      multiview_track.begin(), multiview_track.end());
+  return readSequenceToSink(node, track_reader, sink);
 }
@@ -1,36 +1,62 @@
 #include "normalized_cut.hpp"
-#include <opencv2/core/core.hpp>
+#include <cmath>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <boost/thread/mutex.hpp>
 #include <glog/logging.h>
-#include "sparse_mat.hpp"
+#include "csr_mat.hpp"
+#include "lobpcg.hpp"
+#ifdef ENABLE_ARPACK
 #include "arssym.h"
+#endif
+
+#ifdef ENABLE_ARPACK
+const NormalizedCutSolver DEFAULT_SOLVER = ARPACK_SOLVER;
+#else
+const NormalizedCutSolver DEFAULT_SOLVER = LOBPCG_SOLVER;
+#endif
+
+NormalizedCutOptions::NormalizedCutOptions()
+    : solver(DEFAULT_SOLVER), max_iter(1000), tolerance(1e-6), block_size(2) {}
+
+#ifdef ENABLE_ARPACK
 
 namespace {
 
-class OpencvArpackMatrix {
+// ARPACK keeps the state of its iterations in static variables, so only one
+// problem may be solved at a time.
+boost::mutex arpack_mutex;
+
+class CsrArpackMatrix {
   public:
-    OpencvArpackMatrix(const cv::SparseMat& mat) : mat_(&mat) {}
+    CsrArpackMatrix(const CsrMat& mat, ThreadPool* pool)
+        : mat_(&mat), pool_(pool) {}
 
     int nrows() const {
-      return mat_->size(0);
+      return mat_->rows();
     }
 
     int ncols() const {
-      return mat_->size(1);
+      return mat_->cols();
     }
 
     void MultMv(double* v, double* w) {
-      cv::Mat x(ncols(), 1, cv::DataType<double>::type, v, false);
-      cv::Mat y(nrows(), 1, cv::DataType<double>::type, w, false);
-
-      multiply(*mat_, x, y);
+      if (pool_ == NULL) {
+        mat_->multiply(v, w);
+      } else {
+        mat_->multiply(v, w, *pool_);
+      }
     }
 
   private:
-    const cv::SparseMat* mat_;
+    const CsrMat* mat_;
+    ThreadPool* pool_;
 };
 
 std::string eigenvalueList(
-    ARSymStdEig<double, OpencvArpackMatrix>& problem,
+    ARSymStdEig<double, CsrArpackMatrix>& problem,
     int nconv) {
   std::ostringstream ss;
 
@@ -46,16 +72,18 @@ std::string eigenvalueList(
 
 }
 
-bool smallestEigenvector(const cv::SparseMat& A,
+bool smallestEigenvector(const CsrMat& A,
                          int k,
                          std::vector<double>* x,
                          double* lambda,
-                         int max_iter) {
-  int n = A.size(0);
-  OpencvArpackMatrix matrix(A);
+                         int max_iter,
+                         ThreadPool* pool) {
+  int n = A.rows();
+  CsrArpackMatrix matrix(A, pool);
+  boost::mutex::scoped_lock lock(arpack_mutex);
 
-  ARSymStdEig<double, OpencvArpackMatrix> problem(matrix.ncols(), k + 1,
-      &matrix, &OpencvArpackMatrix::MultMv, "SM");
+  ARSymStdEig<double, CsrArpackMatrix> problem(matrix.ncols(), k + 1,
+      &matrix, &CsrArpackMatrix::MultMv, "SM");
   problem.ChangeMaxit(max_iter);
 
   int nconv = problem.FindEigenvectors();
@@ -78,3 +106,274 @@ bool smallestEigenvector(const cv::SparseMat& A,
 
   return true;
 }
+
+#else
+
+bool smallestEigenvector(const CsrMat&,
+                         int,
+                         std::vector<double>*,
+                         double*,
+                         int,
+                         ThreadPool*) {
+  LOG(FATAL) << "Built without ARPACK, use the LOBPCG solver";
+  return false;
+}
+
+#endif
+
+bool fiedlerVector(const CsrMat& L,
+                   const std::vector<double>& degrees,
+                   const NormalizedCutOptions& options,
+                   std::vector<double>& x,
+                   double* lambda,
+                   ThreadPool* pool) {
+  if (options.solver == ARPACK_SOLVER) {
+    return smallestEigenvector(L, 1, &x, lambda, options.max_iter, pool);
+  }
+
+  // The smallest eigenvector is D^{0.5} 1 for a connected graph. Search
+  // amongst the vectors orthogonal to it instead of finding it again.
+  int n = degrees.size();
+  std::vector<std::vector<double> > constraints(1, std::vector<double>(n));
+  double volume = std::accumulate(degrees.begin(), degrees.end(), 0.);
+  if (volume == 0) {
+    return false;
+  }
+  for (int i = 0; i < n; i += 1) {
+    constraints[0][i] = std::sqrt(degrees[i] / volume);
+  }
+
+  return lobpcg(L, constraints, options.block_size, options.max_iter,
+      options.tolerance, x, lambda, pool);
+}
+
+namespace {
+
+double quantizeUpToPositiveScale(const std::multimap<double, int>& map,
+                                 std::vector<int>& labels,
+                                 const CsrMat& W,
+                                 const std::vector<double>& degrees) {
+  int n = W.rows();
+  double volume = std::accumulate(degrees.begin(), degrees.end(), 0.);
+
+  labels.clear();
+  double min_ncut = 0;
+
+  // Tentative labels. Initially every point in set A.
+  std::vector<int> y(n, 0);
+
+  // Incrementally update volumes and cut.
+  double volume_A = volume;
+  double volume_B = 0;
+  double cut = 0;
+
+  std::multimap<double, int>::const_iterator iter = map.begin();;
+
+  while (iter != map.end()) {
+    // Get value of current element.
+    double value = iter->first;
+
+    // Add all non-positive elements in the first iteration.
+    // Add all elements which have identical value.
+    while (iter != map.end() && (iter->first <= 0 || iter->first == value)) {
+      int u = iter->second;
+
+      // Iterate through adjacent vertices.
+      for (size_t k = W.rowBegin(u); k < W.rowBegin(u + 1); k += 1) {
+        // Edge is to vertex v with weight w.
+        int v = W.columns()[k];
+        double w = W.values()[k];
+
+        if (y[v] == 0) {
+          // Neighbor remains in old set. Edge is cut.
+          cut += w;
+        } else {
+          // Neighbor is in new set. Edge is restored.
+          cut -= w;
+        }
+      }
+
+      // Remove from set A.
+      volume_A -= degrees[u];
+      // Add to set B.
+      volume_B += degrees[u];
+
+      // Move this vertex to B.
+      y[u] = 1;
+
+      ++iter;
+    }
+
+    if (iter != map.end()) {
+      double ncut = (1. / volume_A + 1. / volume_B) * cut;
+
+      // If this is the best so far...
+      if (labels.empty() || ncut < min_ncut) {
+        labels = y;
+        min_ncut = ncut;
+      }
+    }
+  }
+
+  CHECK_EQ(volume_A, 0);
+  CHECK_EQ(volume_B, volume);
+
+  return min_ncut;
+}
+
+// Returns a discrete solution given the solution to the continuous relaxation.
+//
+// The continuous solution is only up to scale.
+// Searches the scale parameter for the optimal solution w.r.t. objective.
+void quantizeUpToScale(const std::vector<double>& x,
+                       std::vector<int>& labels,
+                       const CsrMat& W,
+                       const std::vector<double>& degrees) {
+  int n = x.size();
+
+  std::vector<int> positive_labels;
+  double positive_cut;
+  {
+    // Construct a value to index map.
+    std::multimap<double, int> map;
+    for (int i = 0; i < n; i += 1) {
+      map.insert(std::make_pair(x[i], i));
+    }
+
+    positive_cut = quantizeUpToPositiveScale(map, positive_labels, W,
+        degrees);
+  }
+
+  std::vector<int> negative_labels;
+  double negative_cut;
+  {
+    // Construct a value to index map.
+    std::multimap<double, int> map;
+    for (int i = 0; i < n; i += 1) {
+      map.insert(std::make_pair(x[i], i));
+    }
+
+    negative_cut = quantizeUpToPositiveScale(map, negative_labels, W,
+        degrees);
+  }
+
+  if (positive_cut <= negative_cut) {
+    labels.swap(positive_labels);
+  } else {
+    labels.swap(negative_labels);
+  }
+}
+
+}
+
+bool normalizedCut(const CsrMat& W,
+                   std::vector<int>& labels,
+                   const NormalizedCutOptions& options,
+                   std::vector<double>* relaxed,
+                   ThreadPool* pool) {
+  int n = W.rows();
+
+  // L = D^{-0.5} (D - W) D^{-0.5}.
+  CsrMat L;
+  std::vector<double> degrees;
+  normalizedLaplacian(W, L, degrees);
+
+  // The relaxed solution is D^{-0.5} x.
+  std::vector<double> x;
+  if (relaxed != NULL && int(relaxed->size()) == n) {
+    x.resize(n);
+    for (int i = 0; i < n; i += 1) {
+      x[i] = std::sqrt(degrees[i]) * (*relaxed)[i];
+    }
+  }
+
+  LOG(INFO) << "Solving " << n << "x" << n << " eigensystem";
+  double lambda;
+  bool ok = fiedlerVector(L, degrees, options, x, &lambda, pool);
+
+  if (!ok) {
+    LOG(WARNING) << "Reached iteration limit";
+    return false;
+  }
+
+  if (relaxed != NULL) {
+    relaxed->assign(n, 0.);
+    for (int i = 0; i < n; i += 1) {
+      if (degrees[i] != 0) {
+        (*relaxed)[i] = x[i] / std::sqrt(degrees[i]);
+      }
+    }
+  }
+
+  quantizeUpToScale(x, labels, W, degrees);
+
+  int n1 = 0;
+  int n2 = 0;
+
+  // Split solutions using sign.
+  for (int i = 0; i < n; i += 1) {
+    if (labels[i] == 0) {
+      n1 += 1;
+    } else {
+      n2 += 1;
+    }
+  }
+  LOG(INFO) << n << " => {" << n1 << ", " << n2 << "}";
+
+  return true;
+}
+
+bool normalizedCut(const CsrMat& W,
+                   std::vector<int>& labels,
+                   const NormalizedCutOptions& options,
+                   std::vector<double>* relaxed) {
+  return normalizedCut(W, labels, options, relaxed, NULL);
+}
+
+bool normalizedCut(const CsrMat& W,
+                   std::vector<int>& labels,
+                   const NormalizedCutOptions& options,
+                   std::vector<double>* relaxed,
+                   ThreadPool& pool) {
+  return normalizedCut(W, labels, options, relaxed, &pool);
+}
+
+int findSideComponents(const CsrMat& W,
+                       const std::vector<int>& labels,
+                       std::vector<int>& components) {
+  int n = W.rows();
+  components.assign(n, -1);
+
+  int num_components = 0;
+  std::vector<int> stack;
+
+  for (int side = 0; side < 2; side += 1) {
+    for (int root = 0; root < n; root += 1) {
+      if (labels[root] != side || components[root] >= 0) {
+        continue;
+      }
+
+      // Depth-first search within the side from the first unlabelled vertex.
+      components[root] = num_components;
+      stack.push_back(root);
+
+      while (!stack.empty()) {
+        int vertex = stack.back();
+        stack.pop_back();
+
+        for (size_t k = W.rowBegin(vertex); k < W.rowBegin(vertex + 1);
+             k += 1) {
+          int neighbor = W.columns()[k];
+          if (labels[neighbor] == side && components[neighbor] < 0) {
+            components[neighbor] = num_components;
+            stack.push_back(neighbor);
+          }
+        }
+      }
+
+      num_components += 1;
+    }
+  }
+
+  return num_components;
+}
@@ -3,6 +3,29 @@
 
 #include <vector>
 
+class CsrMat;
+class ThreadPool;
+
+// Solvers for the eigenvector of the continuous relaxation.
+enum NormalizedCutSolver {
+  // Implicitly restarted Lanczos. Solves one problem at a time. Only if
+  // built with ARPACK (ENABLE_ARPACK), otherwise fatal.
+  ARPACK_SOLVER,
+  // Block conjugate gradients, which can start from a guess.
+  LOBPCG_SOLVER
+};
+
+struct NormalizedCutOptions {
+  NormalizedCutSolver solver;
+  int max_iter;
+  // Residual norm at which LOBPCG stops.
+  double tolerance;
+  // Number of vectors which LOBPCG iterates together.
+  int block_size;
+
+  NormalizedCutOptions();
+};
+
 // Finds the minimum normalized cut.
 //
 // Graph must satisfy VertexListGraph, EdgeListGraph and IncidenceGraph.
@@ -10,6 +33,48 @@ template<class Graph>
 bool normalizedCut(const Graph& graph,
                    std::vector<int>& labels,
                    int max_iter);
+// Multiplies by the Laplacian in parallel.
+template<class Graph>
+bool normalizedCut(const Graph& graph,
+                   std::vector<int>& labels,
+                   int max_iter,
+                   ThreadPool& pool);
+
+// If relaxed is not NULL, it holds the solution of the continuous relaxation
+// on return, with one value per vertex. If it has one value per vertex on
+// entry, LOBPCG starts from it. The solution of a graph restricted to a
+// subgraph is a good start for the subgraph.
+template<class Graph>
+bool normalizedCut(const Graph& graph,
+                   std::vector<int>& labels,
+                   const NormalizedCutOptions& options,
+                   std::vector<double>* relaxed);
+template<class Graph>
+bool normalizedCut(const Graph& graph,
+                   std::vector<int>& labels,
+                   const NormalizedCutOptions& options,
+                   std::vector<double>* relaxed,
+                   ThreadPool& pool);
+
+// Cuts the graph of an affinity matrix, e.g. a block of the matrix of a
+// parent graph, without building a graph.
+bool normalizedCut(const CsrMat& W,
+                   std::vector<int>& labels,
+                   const NormalizedCutOptions& options,
+                   std::vector<double>* relaxed);
+bool normalizedCut(const CsrMat& W,
+                   std::vector<int>& labels,
+                   const NormalizedCutOptions& options,
+                   std::vector<double>* relaxed,
+                   ThreadPool& pool);
+
+// Labels each vertex of a cut graph with a connected component of its side,
+// in the graph of its affinity matrix. The components of the first side are
+// numbered first, each side in order of first vertex. Returns the number of
+// components.
+int findSideComponents(const CsrMat& W,
+                       const std::vector<int>& labels,
+                       std::vector<int>& components);
 
 #include "normalized_cut.inl"
 
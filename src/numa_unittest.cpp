@@ -0,0 +1,64 @@
+#include "util/numa.hpp"
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace {
+
+std::vector<int> parse(const std::string& text) {
+  std::vector<int> cpus;
+  EXPECT_TRUE(parseCpuList(text, cpus)) << text;
+  return cpus;
+}
+
+bool parses(const std::string& text) {
+  std::vector<int> cpus;
+  return parseCpuList(text, cpus);
+}
+
+}
+
+TEST(ParseCpuList, ParsesRangesAndSingleCpus) {
+  std::vector<int> cpus = parse("0-3,8-9,12");
+  int expected[] = { 0, 1, 2, 3, 8, 9, 12 };
+  ASSERT_EQ(7u, cpus.size());
+  for (int i = 0; i < 7; i += 1) {
+    EXPECT_EQ(expected[i], cpus[i]);
+  }
+
+  cpus = parse("5");
+  ASSERT_EQ(1u, cpus.size());
+  EXPECT_EQ(5, cpus[0]);
+  cpus = parse("2-2");
+  ASSERT_EQ(1u, cpus.size());
+  EXPECT_EQ(2, cpus[0]);
+}
+
+TEST(ParseCpuList, AcceptsLineOfFile) {
+  std::vector<int> cpus = parse("0-1,4\n");
+  ASSERT_EQ(3u, cpus.size());
+  EXPECT_EQ(4, cpus[2]);
+}
+
+TEST(ParseCpuList, EmptyListHasNoCpus) {
+  // A node of memory alone.
+  EXPECT_TRUE(parse("").empty());
+  EXPECT_TRUE(parse("\n").empty());
+}
+
+TEST(ParseCpuList, RejectsMalformedRanges) {
+  EXPECT_FALSE(parses("3-1"));
+  EXPECT_FALSE(parses("-1"));
+  EXPECT_FALSE(parses("0-"));
+  EXPECT_FALSE(parses("a"));
+  EXPECT_FALSE(parses("1x"));
+  EXPECT_FALSE(parses("0-3,x"));
+  EXPECT_FALSE(parses("1-2-3"));
+}
+
+TEST(ParseCpuList, ClearsPreviousCpus) {
+  std::vector<int> cpus(3, 7);
+  ASSERT_TRUE(parseCpuList("1", cpus));
+  ASSERT_EQ(1u, cpus.size());
+  EXPECT_EQ(1, cpus[0]);
+}
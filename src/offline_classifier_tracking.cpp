@@ -14,10 +14,16 @@
 #include "track_list.hpp"
 #include "track.hpp"
 #include "image_file_sequence.hpp"
+#include "cached_video.hpp"
 #include "dynamic_program_tracker.hpp"
 #include "dynamic_program_occlusion_tracker.hpp"
+#include "frame_correlator.hpp"
+#include "plane_cache.hpp"
+#include "util/thread-pool.hpp"
 
+#include "track_list_reader.hpp"
 #include "track_list_writer.hpp"
+#include "image_point_reader.hpp"
 #include "image_point_writer.hpp"
 
 DEFINE_int32(radius, 5, "Radius of patch");
@@ -25,12 +31,39 @@ DEFINE_double(lambda, 1., "Temporal regularization");
 DEFINE_double(rho, 1., "ADMM parameter");
 DEFINE_double(penalty, 0.5, "The cost of occlusion");
 DEFINE_bool(fix_seed, true, "Constrain track to go through initial point?");
+DEFINE_bool(checkpoint, false,
+    "Recompute the dynamic program to use memory proportional to the square "
+    "root of the number of frames?");
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads for the distance transforms and, with --batch, "
+    "the seeds, 0 for none");
+DEFINE_int32(concurrent_seeds, 1,
+    "Number of seeds to track at once with --batch, each in one thread. "
+    "Unless --checkpoint, each holds the responses of every frame.");
+DEFINE_int32(cache_megabytes, 512, "Memory to keep decoded frames in");
+DEFINE_int32(read_ahead, 8,
+    "Number of frames to decode ahead in the direction of playback");
+DEFINE_bool(transform_frames, false,
+    "Compute the DFT of the frames at startup so that each new track only "
+    "needs an inverse DFT per frame?");
+DEFINE_int32(transform_megabytes, 1024,
+    "Memory to keep the DFT of frames in, unless --spectrum_cache is set. "
+    "Frames beyond it are matched without the DFT.");
+DEFINE_string(spectrum_cache, "",
+    "Directory in which to keep the DFT of each frame between runs. Empty to "
+    "compute them every time.");
+DEFINE_bool(batch, false,
+    "Read the seeds from the points file, as saved by a previous run, and "
+    "track them all in parallel without opening a window?");
 
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
   usage << "Linear time offline tracking" << std::endl;
   usage << std::endl;
   usage << argv[0] << " image-format num-frames points tracks" << std::endl;
+  usage << std::endl;
+  usage << "Seeds are chosen by clicking on the video and saved to the points "
+      "file, or read from it with --batch." << std::endl;
   google::SetUsageMessage(usage.str());
 
   google::InitGoogleLogging(argv[0]);
@@ -40,6 +73,7 @@ void init(int& argc, char**& argv) {
     google::ShowUsageWithFlags(argv[0]);
     std::exit(1);
   }
+  CHECK(FLAGS_concurrent_seeds > 0) << "Must track at least one seed at once";
 }
 
 struct State {
@@ -164,17 +198,61 @@ int main(int argc, char** argv) {
   int radius = FLAGS_radius;
 
   // Set up video stream.
-  ImageFileSequence video(boost::format(image_format), num_frames, true);
+  ImageFileSequence files(image_format, num_frames, true);
+  CachedVideo video(files, size_t(FLAGS_cache_megabytes) << 20,
+      FLAGS_read_ahead);
+
+  ThreadPool pool(FLAGS_num_threads);
+
+  // Match templates against the spectra of the frames.
+  FrameCorrelator correlator;
+  const FrameCorrelator* frames = NULL;
+  if (FLAGS_transform_frames) {
+    PlaneCache cache(FLAGS_spectrum_cache);
+    bool ok = correlator.init(video, cache,
+        size_t(FLAGS_transform_megabytes) << 20, pool);
+    CHECK(ok) << "Could not transform frames";
+    frames = &correlator;
+  }
 
   // Set up tracker.
   DynamicProgramTracker simple_tracker(FLAGS_lambda, FLAGS_radius,
-      FLAGS_fix_seed);
+      FLAGS_fix_seed, FLAGS_checkpoint, pool, frames);
   DynamicProgramOcclusionTracker occlusion_tracker(FLAGS_lambda, FLAGS_penalty,
-      FLAGS_radius, FLAGS_fix_seed);
+      FLAGS_radius, FLAGS_fix_seed, FLAGS_checkpoint, pool, frames);
 
   OfflineTracker* tracker = &occlusion_tracker;
   tracker->init(video);
 
+  bool ok;
+
+  if (FLAGS_batch) {
+    TrackList<cv::Point> seeds;
+    ImagePointReader<int> pixel_reader;
+    ok = loadTrackList(points_file, seeds, pixel_reader);
+    CHECK(ok) << "Could not load points";
+
+    // Every point of every track is a seed.
+    std::vector<SpaceTimeImagePoint> points;
+    TrackList<cv::Point>::const_iterator seed;
+    for (seed = seeds.begin(); seed != seeds.end(); ++seed) {
+      Track<cv::Point>::const_iterator point;
+      for (point = seed->begin(); point != seed->end(); ++point) {
+        points.push_back(SpaceTimeImagePoint(point->second, point->first));
+      }
+    }
+
+    LOG(INFO) << "Tracking " << points.size() << " seeds";
+    TrackList<cv::Point2d> tracks;
+    tracker->trackMany(points, FLAGS_concurrent_seeds, tracks, pool);
+
+    ImagePointWriter<double> point_writer;
+    ok = saveTrackList(tracks_file, tracks, point_writer);
+    CHECK(ok) << "Could not save tracks";
+
+    return 0;
+  }
+
   bool exit = false;
   int time = 0;
   bool paused = true;
@@ -242,8 +320,6 @@ int main(int argc, char** argv) {
     }
   }
 
-  bool ok;
-
   // Save points and tracks out.
   ImagePointWriter<int> pixel_writer;
   ok = saveTrackList(points_file, seeds, pixel_writer);
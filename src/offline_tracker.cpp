@@ -0,0 +1,91 @@
+#include "offline_tracker.hpp"
+#include <algorithm>
+#include <glog/logging.h>
+#include <boost/thread/mutex.hpp>
+#include "util/thread-pool.hpp"
+
+namespace {
+
+// Tracks the next point which no other task has taken, until none remain,
+// without threads of its own. For use with ThreadPool::parallelFor(), one
+// index per point tracked at once.
+class TrackNextFunction {
+  public:
+    TrackNextFunction(const OfflineTracker& tracker,
+                      const std::vector<SpaceTimeImagePoint>& points,
+                      TrackList<cv::Point2d>& tracks,
+                      std::vector<char>& ok,
+                      int& next,
+                      boost::mutex& mutex)
+        : tracker_(&tracker),
+          points_(&points),
+          tracks_(&tracks),
+          ok_(&ok),
+          next_(&next),
+          mutex_(&mutex) {}
+
+    void operator()(int) const {
+      ThreadPool serial(0);
+      int n = points_->size();
+
+      while (true) {
+        int i;
+        {
+          boost::mutex::scoped_lock lock(*mutex_);
+          i = *next_;
+          *next_ += 1;
+        }
+        if (i >= n) {
+          return;
+        }
+
+        Track<cv::Point2d>& track = (*tracks_)[i];
+        (*ok_)[i] = tracker_->track((*points_)[i], track, serial);
+        if (!(*ok_)[i]) {
+          track.clear();
+        }
+      }
+    }
+
+  private:
+    const OfflineTracker* tracker_;
+    const std::vector<SpaceTimeImagePoint>* points_;
+    TrackList<cv::Point2d>* tracks_;
+    std::vector<char>* ok_;
+    int* next_;
+    boost::mutex* mutex_;
+};
+
+}
+
+int OfflineTracker::trackMany(const std::vector<SpaceTimeImagePoint>& points,
+                              int num_concurrent,
+                              TrackList<cv::Point2d>& tracks,
+                              ThreadPool& pool) const {
+  CHECK(num_concurrent > 0);
+  int n = points.size();
+  // Every track is constructed before the tasks write to them.
+  tracks = TrackList<cv::Point2d>(n);
+  std::vector<char> ok(n, 0);
+
+  if (num_concurrent == 1) {
+    for (int i = 0; i < n; i += 1) {
+      ok[i] = track(points[i], tracks[i], pool);
+      if (!ok[i]) {
+        tracks[i].clear();
+      }
+    }
+  } else {
+    int next = 0;
+    boost::mutex mutex;
+    pool.parallelFor(0, std::min(num_concurrent, n),
+        TrackNextFunction(*this, points, tracks, ok, next, mutex));
+  }
+
+  int num_tracked = std::count(ok.begin(), ok.end(), 1);
+  if (num_tracked < n) {
+    LOG(WARNING) << "Could not track " << n - num_tracked << " of " << n <<
+        " points";
+  }
+  return num_tracked;
+}
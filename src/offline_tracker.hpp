@@ -1,18 +1,43 @@
 #ifndef OFFLINE_TRACKER_HPP_
 #define OFFLINE_TRACKER_HPP_
 
+#include <vector>
 #include <opencv2/core/core.hpp>
 #include "video.hpp"
 #include "space_time_image_point.hpp"
 #include "track.hpp"
+#include "track_list.hpp"
+
+class ThreadPool;
 
 // Tracks points through a video sequence.
 class OfflineTracker {
   public:
     virtual ~OfflineTracker() {}
     virtual void init(const Video& video) = 0;
+    // Returns false if the point is too close to the border of its frame for
+    // a template, or could not be tracked.
     virtual bool track(const SpaceTimeImagePoint& point,
                        Track<cv::Point2d>& track) const = 0;
+    // Same as above, using the threads of another pool than the tracker's.
+    virtual bool track(const SpaceTimeImagePoint& point,
+                       Track<cv::Point2d>& track,
+                       ThreadPool& pool) const = 0;
+
+    // Tracks many points, up to num_concurrent at once. Whatever init()
+    // computes for the video, such as the spectra of the frames, is shared by
+    // every point. Track i is empty if point i could not be tracked. Returns
+    // the number of points which were tracked.
+    //
+    // Unless the tracker checkpoints, each point being tracked holds the
+    // responses of every frame, so num_concurrent bounds the memory. With
+    // one, each point in turn uses every thread of the pool. With more, each
+    // point is tracked by one thread, so that the pool is never used by
+    // nested loops.
+    virtual int trackMany(const std::vector<SpaceTimeImagePoint>& points,
+                          int num_concurrent,
+                          TrackList<cv::Point2d>& tracks,
+                          ThreadPool& pool) const;
 };
 
 #endif
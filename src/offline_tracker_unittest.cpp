@@ -0,0 +1,211 @@
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "dynamic_program_tracker.hpp"
+#include "dynamic_program_occlusion_tracker.hpp"
+#include "frame_correlator.hpp"
+#include "plane_cache.hpp"
+#include "util/thread-pool.hpp"
+
+namespace {
+
+// Frames held in memory.
+class MemoryVideo : public Video {
+  public:
+    explicit MemoryVideo(const std::vector<cv::Mat>& frames)
+        : frames_(frames) {}
+
+    bool get(int t, cv::Mat& image) const {
+      if (t < 0 || t >= int(frames_.size())) {
+        return false;
+      }
+      image = frames_[t];
+      return true;
+    }
+
+    int length() const {
+      return frames_.size();
+    }
+
+  private:
+    std::vector<cv::Mat> frames_;
+};
+
+// Bright square which moves one pixel right per frame over a textured
+// background.
+void makeVideo(int n, std::vector<cv::Mat>& frames) {
+  cv::RNG rng(1);
+  cv::Mat background(48, 64, cv::DataType<uchar>::type);
+  rng.fill(background, cv::RNG::UNIFORM, 0, 64);
+
+  frames.clear();
+  for (int t = 0; t < n; t += 1) {
+    cv::Mat frame = background.clone();
+    cv::Mat square = frame(cv::Rect(16 + t, 20, 6, 6));
+    rng.fill(square, cv::RNG::UNIFORM, 192, 256);
+    frames.push_back(frame);
+  }
+}
+
+void expectEqual(const Track<cv::Point2d>& expected,
+                 const Track<cv::Point2d>& actual) {
+  ASSERT_EQ(expected.size(), actual.size());
+  Track<cv::Point2d>::const_iterator a = expected.begin();
+  Track<cv::Point2d>::const_iterator b = actual.begin();
+  for (; a != expected.end(); ++a, ++b) {
+    EXPECT_EQ(a->first, b->first);
+    EXPECT_EQ(a->second, b->second);
+  }
+}
+
+}
+
+// Frames beyond the memory budget are matched directly, with the same result.
+TEST(FrameCorrelator, BoundedMemory) {
+  std::vector<cv::Mat> frames;
+  makeVideo(8, frames);
+  MemoryVideo video(frames);
+  ThreadPool pool(2);
+
+  // Spectrum of a 64 x 48 frame and the integral of its squares.
+  size_t frame_bytes = 64 * 48 * sizeof(float) + 65 * 49 * sizeof(double);
+  FrameCorrelator correlator;
+  ASSERT_TRUE(correlator.init(video, PlaneCache(""), 3 * frame_bytes + 1,
+        pool));
+  EXPECT_EQ(8, correlator.length());
+  EXPECT_EQ(3, correlator.numTransformed());
+
+  cv::Mat templ = frames[2](cv::Rect(17, 19, 7, 7)).clone();
+  std::vector<cv::Mat> responses;
+  correlator.correlate(templ, responses, pool);
+  ASSERT_EQ(8, int(responses.size()));
+
+  for (int t = 0; t < 8; t += 1) {
+    cv::Mat expected;
+    cv::matchTemplate(frames[t], templ, expected, cv::TM_CCORR_NORMED);
+    ASSERT_EQ(expected.size(), responses[t].size());
+    EXPECT_LT(cv::norm(expected, responses[t], cv::NORM_INF), 1e-4) << t;
+  }
+}
+
+// Computing the responses on demand must not change the track.
+TEST(DynamicProgramTracker, CheckpointVersusFull) {
+  std::vector<cv::Mat> frames;
+  makeVideo(12, frames);
+  MemoryVideo video(frames);
+  ThreadPool pool(2);
+  SpaceTimeImagePoint seed(cv::Point2d(24, 23), 5);
+
+  DynamicProgramTracker full(1., 3, true, false, pool);
+  full.init(video);
+  Track<cv::Point2d> expected;
+  ASSERT_TRUE(full.track(seed, expected));
+  EXPECT_EQ(12, int(expected.size()));
+  EXPECT_EQ(cv::Point2d(21, 23), expected[0]);
+
+  DynamicProgramTracker checkpointed(1., 3, true, true, pool);
+  checkpointed.init(video);
+  Track<cv::Point2d> actual;
+  ASSERT_TRUE(checkpointed.track(seed, actual));
+  expectEqual(expected, actual);
+}
+
+TEST(DynamicProgramTracker, CheckpointVersusFullWithCorrelator) {
+  std::vector<cv::Mat> frames;
+  makeVideo(12, frames);
+  MemoryVideo video(frames);
+  ThreadPool pool(2);
+  SpaceTimeImagePoint seed(cv::Point2d(24, 23), 5);
+
+  FrameCorrelator correlator;
+  ASSERT_TRUE(correlator.init(video, PlaneCache(""), size_t(1) << 30, pool));
+
+  DynamicProgramTracker full(1., 3, true, false, pool, &correlator);
+  full.init(video);
+  Track<cv::Point2d> expected;
+  ASSERT_TRUE(full.track(seed, expected));
+
+  DynamicProgramTracker checkpointed(1., 3, true, true, pool, &correlator);
+  checkpointed.init(video);
+  Track<cv::Point2d> actual;
+  ASSERT_TRUE(checkpointed.track(seed, actual));
+  expectEqual(expected, actual);
+}
+
+TEST(DynamicProgramOcclusionTracker, CheckpointVersusFull) {
+  std::vector<cv::Mat> frames;
+  makeVideo(12, frames);
+  MemoryVideo video(frames);
+  ThreadPool pool(2);
+  SpaceTimeImagePoint seed(cv::Point2d(24, 23), 5);
+
+  DynamicProgramOcclusionTracker full(1., 0.5, 3, true, false, pool);
+  full.init(video);
+  Track<cv::Point2d> expected;
+  ASSERT_TRUE(full.track(seed, expected));
+  EXPECT_TRUE(expected.find(5) != expected.end());
+
+  DynamicProgramOcclusionTracker checkpointed(1., 0.5, 3, true, true, pool);
+  checkpointed.init(video);
+  Track<cv::Point2d> actual;
+  ASSERT_TRUE(checkpointed.track(seed, actual));
+  expectEqual(expected, actual);
+}
+
+// Seeds too close to the border for a template are skipped.
+TEST(DynamicProgramTracker, RejectsSeedNearBorder) {
+  std::vector<cv::Mat> frames;
+  makeVideo(6, frames);
+  MemoryVideo video(frames);
+  ThreadPool pool(0);
+
+  DynamicProgramTracker tracker(1., 3, true, false, pool);
+  tracker.init(video);
+  Track<cv::Point2d> track;
+  EXPECT_FALSE(tracker.track(SpaceTimeImagePoint(cv::Point2d(1, 20), 2),
+        track));
+  EXPECT_FALSE(tracker.track(SpaceTimeImagePoint(cv::Point2d(30, 46), 2),
+        track));
+  EXPECT_TRUE(tracker.track(SpaceTimeImagePoint(cv::Point2d(3, 3), 2),
+        track));
+}
+
+// Tracking many seeds at once gives the tracks of one at a time.
+TEST(OfflineTracker, TrackManyVersusOneAtATime) {
+  std::vector<cv::Mat> frames;
+  makeVideo(8, frames);
+  MemoryVideo video(frames);
+  ThreadPool pool(2);
+
+  std::vector<SpaceTimeImagePoint> seeds;
+  seeds.push_back(SpaceTimeImagePoint(cv::Point2d(24, 23), 5));
+  seeds.push_back(SpaceTimeImagePoint(cv::Point2d(30, 10), 2));
+  // Too close to the border.
+  seeds.push_back(SpaceTimeImagePoint(cv::Point2d(1, 1), 0));
+  seeds.push_back(SpaceTimeImagePoint(cv::Point2d(40, 30), 7));
+  seeds.push_back(SpaceTimeImagePoint(cv::Point2d(62, 30), 3));
+
+  DynamicProgramOcclusionTracker tracker(1., 0.5, 3, true, false, pool);
+  tracker.init(video);
+
+  TrackList<cv::Point2d> expected(seeds.size());
+  for (int i = 0; i < int(seeds.size()); i += 1) {
+    bool ok = tracker.track(seeds[i], expected[i]);
+    EXPECT_EQ(i != 2 && i != 4, ok) << i;
+  }
+
+  for (int num_concurrent = 1; num_concurrent <= 4; num_concurrent += 3) {
+    TrackList<cv::Point2d> tracks;
+    EXPECT_EQ(3, tracker.trackMany(seeds, num_concurrent, tracks, pool));
+    ASSERT_EQ(int(seeds.size()), tracks.size());
+    for (int i = 0; i < int(seeds.size()); i += 1) {
+      if (i == 2 || i == 4) {
+        EXPECT_TRUE(tracks[i].empty());
+      } else {
+        expectEqual(expected[i], tracks[i]);
+      }
+    }
+  }
+}
@@ -1,25 +1,17 @@
-#include <vector>
-#include <complex>
+#include "optimal_triangulation.hpp"
+#include <cmath>
 #include <glog/logging.h>
 #include "roots.hpp"
 #include "util.hpp"
+#include "util/thread-pool.hpp"
 
-cv::Mat imageTranslationMatrix(const cv::Point2d& p) {
-  cv::Mat T = cv::Mat_<double>::eye(3, 3);
+// Correspondences given to each thread at a time.
+const int TRIANGULATION_GRAIN = 256;
 
-  T.at<double>(0, 2) = p.x;
-  T.at<double>(1, 2) = p.y;
+namespace {
 
-  return T;
-}
-
-// x2^T F x1 = 0
-void computeEpipoles(const cv::Mat& F, cv::Mat& e1, cv::Mat& e2) {
-  cv::SVD svd(F);
-  //LOG(INFO) << "Singular values of F: " << svd.w;
-  e1 = svd.vt.row(2).t();
-  e2 = svd.u.col(2);
-}
+// Degree of the polynomial whose roots are the stationary points.
+const int TRIANGULATION_DEGREE = 6;
 
 struct FundMatParams {
   double f1;
@@ -30,22 +22,28 @@ struct FundMatParams {
   double d;
 };
 
-cv::Mat buildFundMatFromParams(const FundMatParams& params) {
-  // Maybe this function should go inside FundMatParams purely to avoid this?
-  // Although it's not clear where functions using both parametrizations go.
-  const double& f1 = params.f1;
-  const double& f2 = params.f2;
-  const double& a = params.a;
-  const double& b = params.b;
-  const double& c = params.c;
-  const double& d = params.d;
+// x2^T F x1 = 0
+void computeEpipoles(const cv::Matx33d& F, cv::Vec3d& e1, cv::Vec3d& e2) {
+  cv::Mat G(F, true);
+  cv::SVD svd(G);
+  for (int i = 0; i < 3; i += 1) {
+    e1[i] = svd.vt.at<double>(2, i);
+    e2[i] = svd.u.at<double>(i, 2);
+  }
+}
 
-  cv::Mat F = (cv::Mat_<double>(3, 3) <<
-      f1 * f2 * d, -f2 * c, -f2 * d,
-          -f1 * b,       a,       b,
-          -f1 * d,       c,       d);
+// Epipole after moving a point to the origin.
+cv::Vec3d translateEpipole(const cv::Vec3d& e, const cv::Point2d& x) {
+  cv::Vec3d f(e[0] - x.x * e[2], e[1] - x.y * e[2], e[2]);
+  return f * (1. / std::sqrt(sqr(f[0]) + sqr(f[1])));
+}
 
-  return F;
+// Rotation which takes the normalized epipole e to (1, 0, e[2]).
+cv::Matx33d epipoleRotation(const cv::Vec3d& e) {
+  return cv::Matx33d(
+       e[0], e[1], 0,
+      -e[1], e[0], 0,
+          0,    0, 1);
 }
 
 double triangulationObjective(double t, const FundMatParams& fund_params) {
@@ -62,8 +60,18 @@ double triangulationObjective(double t, const FundMatParams& fund_params) {
   return s;
 }
 
+// Limit of the objective as t goes to infinity.
+double asymptoticObjective(const FundMatParams& fund_params) {
+  const double& f1 = fund_params.f1;
+  const double& f2 = fund_params.f2;
+  const double& a = fund_params.a;
+  const double& c = fund_params.c;
+
+  return 1. / sqr(f1) + sqr(c) / (sqr(a) + sqr(f2 * c));
+}
+
 void triangulationPolynomial(const FundMatParams& params,
-                             std::vector<double>& p) {
+                             double p[TRIANGULATION_DEGREE + 1]) {
   const double& f1 = params.f1;
   const double& f2 = params.f2;
   const double& a = params.a;
@@ -78,9 +86,6 @@ void triangulationPolynomial(const FundMatParams& params,
   // >> h = coeffs(g, t);
   // >> ccode(h)
 
-  const int DEGREE = 6;
-  p.assign(DEGREE, 0);
-
   p[0] = -b*d*(a*d-b*c);
   p[1] = sqr(b*b+(d*d)*(f2*f2))-a*d*(a*d-b*c)-b*c*(a*d-b*c);
   p[2] = (b*b+(d*d)*(f2*f2))*(a*b*2.0+c*d*(f2*f2)*2.0)*2.0-a*c*(a*d-b*c)-b*d*(f1*f1)*(a*d-b*c)*2.0;
@@ -92,138 +97,189 @@ void triangulationPolynomial(const FundMatParams& params,
 
 // Returns the transforms to take F to the canonical form for triangulation.
 // A2^T F A1
-void transformToCanonicalForm(cv::Mat& F,
-                              FundMatParams& p,
+//
+// The epipoles of F are given, since they need only be found once for many
+// correspondences.
+void transformToCanonicalForm(const cv::Matx33d& F,
+                              const cv::Vec3d& e1,
+                              const cv::Vec3d& e2,
                               const cv::Point2d& x1,
                               const cv::Point2d& x2,
-                              cv::Mat& A1,
-                              cv::Mat& A2) {
+                              FundMatParams& p,
+                              cv::Matx33d& A1,
+                              cv::Matx33d& A2) {
   // Shift points to the origin.
-  cv::Mat T1_inv = imageTranslationMatrix(x1);
-  cv::Mat T2_inv = imageTranslationMatrix(x2);
-
-  // Transform the fundamental matrix in this way.
-  F = T2_inv.t() * F * T1_inv;
-
-  // Find epipoles.
-  cv::Mat e1;
-  cv::Mat e2;
-  computeEpipoles(F, e1, e2);
+  cv::Matx33d T1_inv(1, 0, x1.x, 0, 1, x1.y, 0, 0, 1);
+  cv::Matx33d T2_inv(1, 0, x2.x, 0, 1, x2.y, 0, 0, 1);
 
-  // Normalize.
-  e1 /= std::sqrt(sqr(e1.at<double>(0)) + sqr(e1.at<double>(1)));
-  e2 /= std::sqrt(sqr(e2.at<double>(0)) + sqr(e2.at<double>(1)));
+  // Epipoles of the shifted fundamental matrix, normalized.
+  cv::Vec3d f1 = translateEpipole(e1, x1);
+  cv::Vec3d f2 = translateEpipole(e2, x2);
 
   // Form rotation matrices to bring to canonical form.
-  cv::Mat R1 = (cv::Mat_<double>(3, 3) <<
-       e1.at<double>(0), e1.at<double>(1), 0,
-      -e1.at<double>(1), e1.at<double>(0), 0,
-                      0,                0, 1);
-  cv::Mat R2 = (cv::Mat_<double>(3, 3) <<
-       e2.at<double>(0), e2.at<double>(1), 0,
-      -e2.at<double>(1), e2.at<double>(0), 0,
-                      0,                0, 1);
-  F = R2 * F * R1.t();
+  cv::Matx33d R1 = epipoleRotation(f1);
+  cv::Matx33d R2 = epipoleRotation(f2);
+  cv::Matx33d G = R2 * T2_inv.t() * F * T1_inv * R1.t();
 
   // Output overall transforms.
   A1 = T1_inv * R1.t();
   A2 = T2_inv * R2.t();
 
   // Extract parametrization.
-  p.f1 = e1.at<double>(2);
-  p.f2 = e2.at<double>(2);
-  p.a = F.at<double>(1, 1);
-  p.b = F.at<double>(1, 2);
-  p.c = F.at<double>(2, 1);
-  p.d = F.at<double>(2, 2);
+  p.f1 = f1[2];
+  p.f2 = f2[2];
+  p.a = G(1, 1);
+  p.b = G(1, 2);
+  p.c = G(2, 1);
+  p.d = G(2, 2);
 }
 
-// Constructs the 2D projections (x1(t), x2(t)) in homogeneous coords.
-void buildParametrizedProjections(double t,
-                                  cv::Mat& X1,
-                                  cv::Mat& X2,
-                                  const FundMatParams& p) {
-  // Parametrized lines.
-  double lambda1[3] = { t * p.f1, 1, -t };
-  double lambda2[3] = { -p.f2 * (p.c * t + p.d), p.a * t + p.b, p.c * t + p.d };
-
-  X1 = (cv::Mat_<double>(3, 1) <<
-      -lambda1[0] * lambda1[2],
-      -lambda1[1] * lambda1[2],
-      (sqr(lambda1[0]) + sqr(lambda1[1])));
-  X2 = (cv::Mat_<double>(3, 1) <<
-      -lambda2[0] * lambda2[2],
-      -lambda2[1] * lambda2[2],
-      (sqr(lambda2[0]) + sqr(lambda2[1])));
+// Point on a line closest to the origin, in homogeneous coords.
+cv::Vec3d closestPointToOrigin(const cv::Vec3d& lambda) {
+  return cv::Vec3d(-lambda[0] * lambda[2], -lambda[1] * lambda[2],
+      sqr(lambda[0]) + sqr(lambda[1]));
 }
 
-double findMinimumRealSolution(
-    const std::vector<std::complex<double> >& solutions,
-    const FundMatParams& fund_params) {
-  int n = solutions.size();
-  double min = 0;
-  int arg = 0;
-
-  for (int i = 0; i < n; i += 1) {
-    // Only consider real part (since all solutions are minima or maxima).
-    double t = solutions[i].real();
-    double s = triangulationObjective(t, fund_params);
-
-    if (i == 0 || s < min) {
-      min = s;
-      arg = i;
+// Finds the parameter which minimizes the objective. Returns false if the
+// minimum is at infinity.
+bool findMinimum(const FundMatParams& fund_params, double& t, double& s) {
+  double coeffs[TRIANGULATION_DEGREE + 1];
+  triangulationPolynomial(fund_params, coeffs);
+  double roots[TRIANGULATION_DEGREE];
+  int num_roots = findRealRoots(coeffs, TRIANGULATION_DEGREE, roots);
+
+  // With no stationary points, fall back to the origin.
+  t = 0;
+  s = triangulationObjective(t, fund_params);
+  for (int i = 0; i < num_roots; i += 1) {
+    double s_i = triangulationObjective(roots[i], fund_params);
+    if (s_i < s) {
+      t = roots[i];
+      s = s_i;
     }
   }
 
-  if (solutions[arg].imag() != 0) {
-    LOG(WARNING) << "Taking real part of complex solution: " << solutions[arg];
+  // The polynomial omits the point at infinity.
+  if (fund_params.f1 != 0) {
+    double s_inf = asymptoticObjective(fund_params);
+    if (s_inf < s) {
+      s = s_inf;
+      return false;
+    }
   }
 
-  return solutions[arg].real();
+  return true;
 }
 
-// Returns the sum of the two residuals.
-// Hartley and Sturm, "Triangulation", CVIU 1997.
-// Hartley and Zisserman, 2nd ed. p318.
-//
-// Convention used is x2^T F x1 = 0.
-// "First" image co-ordinates multiplied on the right.
-double optimalTriangulation(cv::Point2d& x1,
-                            cv::Point2d& x2,
-                            const cv::Matx33d& F) {
+// Triangulates one correspondence given the epipoles of F.
+double triangulate(cv::Point2d& x1,
+                   cv::Point2d& x2,
+                   const cv::Matx33d& F,
+                   const cv::Vec3d& e1,
+                   const cv::Vec3d& e2) {
   // Transform fundamental matrix to canonical form.
-  cv::Mat G(F, true);
-  FundMatParams fund_params;
-  cv::Mat A1;
-  cv::Mat A2;
-  transformToCanonicalForm(G, fund_params, x1, x2, A1, A2);
+  FundMatParams p;
+  cv::Matx33d A1;
+  cv::Matx33d A2;
+  transformToCanonicalForm(F, e1, e2, x1, x2, p, A1, A2);
+
+  double t;
+  double s;
+  cv::Vec3d lambda1;
+  cv::Vec3d lambda2;
+  if (findMinimum(p, t, s)) {
+    // Parametrized lines.
+    lambda1 = cv::Vec3d(t * p.f1, 1, -t);
+    lambda2 = cv::Vec3d(-p.f2 * (p.c * t + p.d), p.a * t + p.b, p.c * t + p.d);
+  } else {
+    // Lines in the limit, up to scale.
+    lambda1 = cv::Vec3d(p.f1, 0, -1);
+    lambda2 = cv::Vec3d(-p.f2 * p.c, p.a, p.c);
+  }
 
-  // Set up polynomial problem to solve for parametrization of points.
-  std::vector<double> coeffs;
-  triangulationPolynomial(fund_params, coeffs);
+  // Undo canonicalization.
+  cv::Vec3d X1 = A1 * closestPointToOrigin(lambda1);
+  cv::Vec3d X2 = A2 * closestPointToOrigin(lambda2);
 
-  // Solve for all roots of polynomial.
-  std::vector<std::complex<double> > solutions;
-  PolynomialSolver solver;
-  solver.init(coeffs.size() - 1);
-  solver.solve(coeffs, solutions);
+  // Return from homogeneous coordinates.
+  x1 = cv::Point2d(X1[0] / X1[2], X1[1] / X1[2]);
+  x2 = cv::Point2d(X2[0] / X2[2], X2[1] / X2[2]);
 
-  // Find minimum real solution.
-  double t = findMinimumRealSolution(solutions, fund_params);
-  double s = triangulationObjective(t, fund_params);
+  return s;
+}
 
-  // Construct projections from the parameter t.
-  cv::Mat X1;
-  cv::Mat X2;
-  buildParametrizedProjections(t, X1, X2, fund_params);
+// Triangulates the correspondences with one fundamental matrix.
+// For use with ThreadPool::parallelFor().
+class TriangulateFunction {
+  public:
+    TriangulateFunction(std::vector<cv::Point2d>& x1,
+                        std::vector<cv::Point2d>& x2,
+                        const cv::Matx33d& F,
+                        const cv::Vec3d& e1,
+                        const cv::Vec3d& e2,
+                        std::vector<double>& residuals)
+        : x1_(&x1), x2_(&x2), F_(F), e1_(e1), e2_(e2),
+          residuals_(&residuals) {}
+
+    void operator()(int i) const {
+      (*residuals_)[i] = triangulate((*x1_)[i], (*x2_)[i], F_, e1_, e2_);
+    }
 
-  // Undo canonicalization.
-  X1 = A1 * X1;
-  X2 = A2 * X2;
+  private:
+    std::vector<cv::Point2d>* x1_;
+    std::vector<cv::Point2d>* x2_;
+    cv::Matx33d F_;
+    cv::Vec3d e1_;
+    cv::Vec3d e2_;
+    std::vector<double>* residuals_;
+};
 
-  // Return from homogeneous coordinates.
-  x1 = imagePointFromHomogeneous(X1);
-  x2 = imagePointFromHomogeneous(X2);
+void optimalTriangulation(std::vector<cv::Point2d>& x1,
+                          std::vector<cv::Point2d>& x2,
+                          const cv::Matx33d& F,
+                          std::vector<double>& residuals,
+                          ThreadPool* pool) {
+  CHECK(x1.size() == x2.size()) << "Different number of points in each image";
+  int n = x1.size();
 
-  return s;
+  cv::Vec3d e1;
+  cv::Vec3d e2;
+  computeEpipoles(F, e1, e2);
+
+  residuals.resize(n);
+  TriangulateFunction function(x1, x2, F, e1, e2, residuals);
+  if (pool == NULL) {
+    for (int i = 0; i < n; i += 1) {
+      function(i);
+    }
+  } else {
+    pool->parallelFor(0, n, function, TRIANGULATION_GRAIN);
+  }
+}
+
+}
+
+double optimalTriangulation(cv::Point2d& x1,
+                            cv::Point2d& x2,
+                            const cv::Matx33d& F) {
+  cv::Vec3d e1;
+  cv::Vec3d e2;
+  computeEpipoles(F, e1, e2);
+
+  return triangulate(x1, x2, F, e1, e2);
+}
+
+void optimalTriangulation(std::vector<cv::Point2d>& x1,
+                          std::vector<cv::Point2d>& x2,
+                          const cv::Matx33d& F,
+                          std::vector<double>& residuals) {
+  optimalTriangulation(x1, x2, F, residuals, NULL);
+}
+
+void optimalTriangulation(std::vector<cv::Point2d>& x1,
+                          std::vector<cv::Point2d>& x2,
+                          const cv::Matx33d& F,
+                          std::vector<double>& residuals,
+                          ThreadPool& pool) {
+  optimalTriangulation(x1, x2, F, residuals, &pool);
 }
@@ -1,5 +1,11 @@
+#ifndef OPTIMAL_TRIANGULATION_HPP_
+#define OPTIMAL_TRIANGULATION_HPP_
+
+#include <vector>
 #include <opencv2/core/core.hpp>
 
+class ThreadPool;
+
 // Returns the sum of the two residuals.
 // Hartley and Sturm, "Triangulation", CVIU 1997.
 // Hartley and Zisserman, 2nd ed. p318.
@@ -9,3 +15,19 @@
 double optimalTriangulation(cv::Point2d& x1,
                             cv::Point2d& x2,
                             const cv::Matx33d& F);
+
+// Triangulates many correspondences with the same fundamental matrix, whose
+// epipoles are found once. Corrects x1[i] and x2[i] in place and outputs the
+// sum of their residuals in residuals[i].
+void optimalTriangulation(std::vector<cv::Point2d>& x1,
+                          std::vector<cv::Point2d>& x2,
+                          const cv::Matx33d& F,
+                          std::vector<double>& residuals);
+// Divides the correspondences amongst the threads of the pool.
+void optimalTriangulation(std::vector<cv::Point2d>& x1,
+                          std::vector<cv::Point2d>& x2,
+                          const cv::Matx33d& F,
+                          std::vector<double>& residuals,
+                          ThreadPool& pool);
+
+#endif
@@ -0,0 +1,87 @@
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <opencv2/core/core.hpp>
+#include "optimal_triangulation.hpp"
+#include "util/thread-pool.hpp"
+
+namespace {
+
+// Fundamental matrix of two cameras separated by a translation, with noisy
+// correspondences.
+cv::Matx33d makeProblem(int n,
+                        std::vector<cv::Point2d>& x1,
+                        std::vector<cv::Point2d>& x2) {
+  // F = [t]_x for K = I, R = I and t = (1, 0.2, 0).
+  cv::Matx33d F(0, 0, 0.2,
+                0, 0, -1,
+                -0.2, 1, 0);
+
+  cv::RNG rng(0);
+  x1.clear();
+  x2.clear();
+  for (int i = 0; i < n; i += 1) {
+    cv::Point2d x(rng.uniform(-1., 1.), rng.uniform(-1., 1.));
+    double depth = rng.uniform(2., 10.);
+    cv::Point2d y = x + cv::Point2d(1., 0.2) * (1. / depth);
+    x1.push_back(x + cv::Point2d(rng.gaussian(1e-3), rng.gaussian(1e-3)));
+    x2.push_back(y + cv::Point2d(rng.gaussian(1e-3), rng.gaussian(1e-3)));
+  }
+
+  return F;
+}
+
+// Corrects n correspondences one at a time.
+void BM_OptimalTriangulation(benchmark::State& state) {
+  int n = state.range(0);
+  std::vector<cv::Point2d> x1;
+  std::vector<cv::Point2d> x2;
+  cv::Matx33d F = makeProblem(n, x1, x2);
+
+  while (state.KeepRunning()) {
+    double total = 0;
+    for (int i = 0; i < n; i += 1) {
+      cv::Point2d y1 = x1[i];
+      cv::Point2d y2 = x2[i];
+      total += optimalTriangulation(y1, y2, F);
+    }
+    benchmark::DoNotOptimize(total);
+  }
+
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK(BM_OptimalTriangulation)->RangeMultiplier(8)->Range(64, 262144);
+
+// Corrects n correspondences as a batch, with threads if the second argument
+// is non-zero.
+void BM_OptimalTriangulationBatch(benchmark::State& state) {
+  int n = state.range(0);
+  ThreadPool pool(state.range(1));
+  std::vector<cv::Point2d> x1;
+  std::vector<cv::Point2d> x2;
+  cv::Matx33d F = makeProblem(n, x1, x2);
+
+  std::vector<double> residuals;
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    std::vector<cv::Point2d> y1 = x1;
+    std::vector<cv::Point2d> y2 = x2;
+    state.ResumeTiming();
+
+    if (state.range(1) > 0) {
+      optimalTriangulation(y1, y2, F, residuals, pool);
+    } else {
+      optimalTriangulation(y1, y2, F, residuals);
+    }
+    benchmark::DoNotOptimize(residuals.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK(BM_OptimalTriangulationBatch)
+    ->ArgsProduct({ benchmark::CreateRange(4096, 262144, 8), { 0, 4 } })
+    ->ArgNames({ "n", "threads" })
+    ->UseRealTime();
+
+}
@@ -0,0 +1,126 @@
+#include "optimal_triangulation.hpp"
+#include <cmath>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "util/thread-pool.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+// More than one grain of correspondences for each thread.
+const int NUM_POINTS = 1000;
+
+// Correspondences of two views of random points with noise, and their
+// fundamental matrix.
+void noisyMatches(double noise,
+                  cv::Matx33d& F,
+                  std::vector<cv::Point2d>& x1,
+                  std::vector<cv::Point2d>& x2) {
+  cv::Matx33d K(500, 0, 320, 0, 500, 240, 0, 0, 1);
+  // Rotation about the vertical axis and a sideways translation.
+  double theta = 0.1;
+  cv::Matx33d R(std::cos(theta), 0, std::sin(theta),
+                0, 1, 0,
+                -std::sin(theta), 0, std::cos(theta));
+  cv::Vec3d t(-1, 0.1, 0.05);
+  cv::Matx33d T(0, -t[2], t[1], t[2], 0, -t[0], -t[1], t[0], 0);
+  F = K.inv().t() * T * R * K.inv();
+
+  cv::RNG rng(3);
+  x1.clear();
+  x2.clear();
+
+  for (int i = 0; i < NUM_POINTS; i += 1) {
+    cv::Vec3d X(rng.uniform(-2., 2.), rng.uniform(-1.5, 1.5),
+        rng.uniform(4., 8.));
+    cv::Vec3d y1 = K * X;
+    cv::Vec3d y2 = K * (R * X + t);
+    x1.push_back(cv::Point2d(y1[0] / y1[2] + rng.gaussian(noise),
+          y1[1] / y1[2] + rng.gaussian(noise)));
+    x2.push_back(cv::Point2d(y2[0] / y2[2] + rng.gaussian(noise),
+          y2[1] / y2[2] + rng.gaussian(noise)));
+  }
+}
+
+double epipolarError(const cv::Matx33d& F,
+                     const cv::Point2d& x1,
+                     const cv::Point2d& x2) {
+  cv::Vec3d y1(x1.x, x1.y, 1);
+  cv::Vec3d y2(x2.x, x2.y, 1);
+  return (y2.t() * F * y1)(0, 0);
+}
+
+double squaredDistance(const cv::Point2d& x, const cv::Point2d& y) {
+  return (x.x - y.x) * (x.x - y.x) + (x.y - y.y) * (x.y - y.y);
+}
+
+}
+
+TEST(OptimalTriangulation, CorrectsOntoEpipolarLines) {
+  cv::Matx33d F;
+  std::vector<cv::Point2d> x1;
+  std::vector<cv::Point2d> x2;
+  noisyMatches(1, F, x1, x2);
+
+  for (int i = 0; i < NUM_POINTS; i += 1) {
+    cv::Point2d y1 = x1[i];
+    cv::Point2d y2 = x2[i];
+    double residual = optimalTriangulation(y1, y2, F);
+
+    // F is in pixels, whose epipolar error is of order 1e-3 per pixel.
+    EXPECT_NEAR(0, epipolarError(F, y1, y2), 1e-9);
+    // The points move only as far as the residual says.
+    double moved = squaredDistance(x1[i], y1) + squaredDistance(x2[i], y2);
+    EXPECT_NEAR(moved, residual, 1e-6 * std::max(1., residual));
+  }
+}
+
+TEST(OptimalTriangulation, ExactMatchesDoNotMove) {
+  cv::Matx33d F;
+  std::vector<cv::Point2d> x1;
+  std::vector<cv::Point2d> x2;
+  noisyMatches(0, F, x1, x2);
+
+  for (int i = 0; i < NUM_POINTS; i += 1) {
+    cv::Point2d y1 = x1[i];
+    cv::Point2d y2 = x2[i];
+    EXPECT_NEAR(0, optimalTriangulation(y1, y2, F), 1e-12);
+    EXPECT_NEAR(0, squaredDistance(x1[i], y1), 1e-12);
+    EXPECT_NEAR(0, squaredDistance(x2[i], y2), 1e-12);
+  }
+}
+
+TEST(OptimalTriangulation, BatchIsSinglePoint) {
+  cv::Matx33d F;
+  std::vector<cv::Point2d> x1;
+  std::vector<cv::Point2d> x2;
+  noisyMatches(1, F, x1, x2);
+
+  std::vector<cv::Point2d> expected_x1 = x1;
+  std::vector<cv::Point2d> expected_x2 = x2;
+  std::vector<double> expected_residuals(NUM_POINTS);
+  for (int i = 0; i < NUM_POINTS; i += 1) {
+    expected_residuals[i] = optimalTriangulation(expected_x1[i],
+        expected_x2[i], F);
+  }
+
+  std::vector<cv::Point2d> y1 = x1;
+  std::vector<cv::Point2d> y2 = x2;
+  std::vector<double> residuals;
+  optimalTriangulation(y1, y2, F, residuals);
+  EXPECT_EQ(expected_residuals, residuals);
+
+  ThreadPool pool(3);
+  std::vector<cv::Point2d> z1 = x1;
+  std::vector<cv::Point2d> z2 = x2;
+  std::vector<double> parallel_residuals;
+  optimalTriangulation(z1, z2, F, parallel_residuals, pool);
+  EXPECT_EQ(expected_residuals, parallel_residuals);
+
+  for (int i = 0; i < NUM_POINTS; i += 1) {
+    EXPECT_EQ(expected_x1[i], y1[i]);
+    EXPECT_EQ(expected_x2[i], y2[i]);
+    EXPECT_EQ(expected_x1[i], z1[i]);
+    EXPECT_EQ(expected_x2[i], z2[i]);
+  }
+}
@@ -0,0 +1,82 @@
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "chunked_archive.hpp"
+#include "read_lines.hpp"
+
+DEFINE_string(codec, "lz4", "Compression of chunks (none, lz4 or zstd)");
+DEFINE_int32(chunk_size, 1 << 20,
+    "Approximate number of bytes in each chunk before compression");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Packs many small files into one chunked archive." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " file-list archive" << std::endl;
+  usage << std::endl;
+  usage << "file-list -- Text file with one filename per line. Each file is"
+    " stored under its name as given." << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+bool readFile(const std::string& filename, std::string& data) {
+  std::ifstream file(filename.c_str(), std::ios_base::in |
+      std::ios_base::binary);
+  if (!file) {
+    return false;
+  }
+
+  data.assign(std::istreambuf_iterator<char>(file),
+      std::istreambuf_iterator<char>());
+  return !file.bad();
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string list_file = argv[1];
+  std::string archive_file = argv[2];
+
+  ArchiveCodec codec;
+  CHECK(parseArchiveCodec(FLAGS_codec, codec)) << "Unknown codec `" <<
+      FLAGS_codec << "'";
+  CHECK(FLAGS_chunk_size > 0);
+
+  std::vector<std::string> filenames;
+  bool ok = readLines(list_file, filenames);
+  CHECK(ok) << "Could not load list of files";
+
+  ChunkedArchiveWriter archive(codec, FLAGS_chunk_size);
+  ok = archive.open(archive_file);
+  CHECK(ok) << "Could not open archive";
+
+  std::vector<std::string>::const_iterator filename;
+  for (filename = filenames.begin(); filename != filenames.end(); ++filename) {
+    std::string data;
+    ok = readFile(*filename, data);
+    CHECK(ok) << "Could not read `" << *filename << "'";
+
+    ok = archive.add(*filename, data);
+    CHECK(ok) << "Could not add `" << *filename << "'";
+  }
+
+  ok = archive.close();
+  CHECK(ok) << "Could not save archive";
+  LOG(INFO) << "Packed " << filenames.size() << " files";
+
+  return 0;
+}
@@ -0,0 +1,146 @@
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <sstream>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "match.hpp"
+#include "match_result.hpp"
+#include "unique_match_result.hpp"
+#include "match_store.hpp"
+
+#include "read_lines.hpp"
+#include "iterator_reader.hpp"
+#include "match_reader.hpp"
+#include "match_result_reader.hpp"
+#include "unique_match_result_reader.hpp"
+
+DEFINE_string(type, "results",
+    "What each file holds: matches, results or unique (results with "
+    "second-best distances)");
+DEFINE_bool(ordered_pairs, false,
+    "Pack both orders of every pair of images, e.g. forward and reverse "
+    "matches, rather than only the pairs whose first image comes first");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Packs the match files of every pair of images into one store." <<
+      std::endl;
+  usage << std::endl;
+  usage << argv[0] << " matches-format view-names num-frames store" <<
+      std::endl;
+  usage << std::endl;
+  usage << "matches-format -- Format of match files, taking view, view, "
+    "time, time." << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 5) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+std::string makeMatchFilename(const std::string& format,
+                              const std::string& view1,
+                              const std::string& view2,
+                              int time1,
+                              int time2) {
+  return boost::str(
+      boost::format(format) % view1 % view2 % (time1 + 1) % (time2 + 1));
+}
+
+// Returns the number of matches.
+int packPair(const std::string& matches_file,
+             const ImageIndex& image1,
+             const ImageIndex& image2,
+             MatchStoreWriter& writer) {
+  bool ok;
+  int num_matches;
+
+  if (FLAGS_type == "matches") {
+    std::vector<Match> matches;
+    MatchReader reader;
+    ok = loadList(matches_file, matches, reader);
+    CHECK(ok) << "Could not load matches";
+    writer.add(image1, image2, matches);
+    num_matches = matches.size();
+  } else if (FLAGS_type == "results") {
+    std::vector<MatchResult> matches;
+    MatchResultReader reader;
+    ok = loadList(matches_file, matches, reader);
+    CHECK(ok) << "Could not load matches";
+    writer.add(image1, image2, matches);
+    num_matches = matches.size();
+  } else if (FLAGS_type == "unique") {
+    std::vector<UniqueMatchResult> matches;
+    UniqueMatchResultReader reader;
+    ok = loadList(matches_file, matches, reader);
+    CHECK(ok) << "Could not load matches";
+    writer.add(image1, image2, matches);
+    num_matches = matches.size();
+  } else {
+    LOG(FATAL) << "Unknown type `" << FLAGS_type << "'";
+    num_matches = 0;
+  }
+
+  return num_matches;
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string matches_format = argv[1];
+  std::string view_names_file = argv[2];
+  int num_frames = boost::lexical_cast<int>(argv[3]);
+  std::string store_file = argv[4];
+
+  bool ok;
+
+  std::vector<std::string> views;
+  ok = readLines(view_names_file, views);
+  CHECK(ok) << "Could not load view names";
+  int num_views = views.size();
+
+  MatchStoreWriter writer;
+  ok = writer.open(store_file, FLAGS_type == "unique");
+  CHECK(ok) << "Could not open store";
+
+  // Images are numbered in the order of the store's pairs.
+  int n = num_views * num_frames;
+  int num_pairs = 0;
+  int num_matches = 0;
+
+  for (int i1 = 0; i1 < n; i1 += 1) {
+    int i2 = FLAGS_ordered_pairs ? 0 : i1 + 1;
+    for (; i2 < n; i2 += 1) {
+      if (i2 == i1) {
+        continue;
+      }
+
+      // Extract view and time indices.
+      int t1 = i1 % num_frames;
+      int t2 = i2 % num_frames;
+      int v1 = i1 / num_frames;
+      int v2 = i2 / num_frames;
+
+      std::string matches_file = makeMatchFilename(matches_format, views[v1],
+          views[v2], t1, t2);
+      num_matches += packPair(matches_file, ImageIndex(v1, t1),
+          ImageIndex(v2, t2), writer);
+      num_pairs += 1;
+    }
+  }
+
+  ok = writer.close();
+  CHECK(ok) << "Could not save store";
+  LOG(INFO) << "Packed " << num_matches << " matches of " << num_pairs <<
+      " pairs";
+
+  return 0;
+}
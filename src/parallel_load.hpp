@@ -0,0 +1,32 @@
+#ifndef PARALLEL_LOAD_HPP_
+#define PARALLEL_LOAD_HPP_
+
+#include "sequence_sink.hpp"
+#include "util/thread-pool.hpp"
+
+// Loads the item with some index, for example the file of one (view, time).
+template<class T>
+class IndexedLoader {
+  public:
+    virtual ~IndexedLoader() {}
+    // Called from several threads at once.
+    virtual bool load(int index, T& x) const = 0;
+};
+
+// Loads items [0, n) using the threads of a pool, and adds them to the sink
+// in order of index from the calling thread.
+//
+// Items are loaded in windows of at most max_in_flight, so that no more than
+// that are held in memory before the sink takes them. Returns false if any
+// item could not be loaded, in which case the sink has received every item
+// before the window which failed.
+template<class T>
+bool loadInParallel(ThreadPool& pool,
+                    int n,
+                    const IndexedLoader<T>& loader,
+                    SequenceSink<T>& sink,
+                    int max_in_flight);
+
+#include "parallel_load.inl"
+
+#endif
@@ -0,0 +1,55 @@
+#include <algorithm>
+#include <vector>
+#include <glog/logging.h>
+
+// For use with ThreadPool::parallelFor().
+template<class T>
+class LoadWindowFunction {
+  public:
+    LoadWindowFunction(const IndexedLoader<T>& loader,
+                       int offset,
+                       std::vector<T>& items,
+                       std::vector<char>& ok)
+        : loader_(&loader), offset_(offset), items_(&items), ok_(&ok) {}
+
+    void operator()(int i) const {
+      // Each thread writes to a different element.
+      (*ok_)[i] = loader_->load(offset_ + i, (*items_)[i]);
+    }
+
+  private:
+    const IndexedLoader<T>* loader_;
+    int offset_;
+    std::vector<T>* items_;
+    std::vector<char>* ok_;
+};
+
+template<class T>
+bool loadInParallel(ThreadPool& pool,
+                    int n,
+                    const IndexedLoader<T>& loader,
+                    SequenceSink<T>& sink,
+                    int max_in_flight) {
+  CHECK(max_in_flight > 0);
+
+  for (int offset = 0; offset < n; offset += max_in_flight) {
+    int size = std::min(max_in_flight, n - offset);
+    std::vector<T> items(size);
+    std::vector<char> ok(size, 0);
+
+    pool.parallelFor(0, size, LoadWindowFunction<T>(loader, offset, items, ok));
+
+    for (int i = 0; i < size; i += 1) {
+      if (!ok[i]) {
+        LOG(WARNING) << "Could not load item " << offset + i;
+        return false;
+      }
+    }
+
+    for (int i = 0; i < size; i += 1) {
+      sink.add(items[i]);
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,131 @@
+#ifndef PARSE_NUMBER_HPP_
+#define PARSE_NUMBER_HPP_
+
+#include <cstdlib>
+#include <limits>
+#include <stdint.h>
+
+// Parses a number at the start of NUL-terminated text as written by
+// cv::FileStorage, such as "12", "-3.5", "1.2345678901234567e+02" or ".Nan".
+// On success, advances the text to the first character after the number.
+//
+// Numbers of up to 15 significant digits with small exponents are converted
+// exactly by a single multiplication or division, like std::from_chars.
+// Others, such as the 17 digits of a double, are left to strtod() so that
+// every number is correctly rounded.
+inline bool parseNumber(const char*& text, double& x) {
+  static const double POWERS[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  static const int MAX_POWER = 22;
+  static const int MAX_DIGITS = 15;
+
+  const char* p = text;
+  bool negative = false;
+  if (*p == '-' || *p == '+') {
+    negative = (*p == '-');
+    p += 1;
+  }
+
+  // Special values.
+  if (p[0] == '.' && (p[1] == 'N' || p[1] == 'n' ||
+                      p[1] == 'I' || p[1] == 'i')) {
+    const char* name = p + 1;
+    if ((name[0] | 0x20) == 'n' && (name[1] | 0x20) == 'a' &&
+        (name[2] | 0x20) == 'n') {
+      x = std::numeric_limits<double>::quiet_NaN();
+    } else if ((name[0] | 0x20) == 'i' && (name[1] | 0x20) == 'n' &&
+               (name[2] | 0x20) == 'f') {
+      x = negative ? -std::numeric_limits<double>::infinity() :
+                      std::numeric_limits<double>::infinity();
+    } else {
+      return false;
+    }
+    text = name + 3;
+    return true;
+  }
+
+  // The digits without leading or trailing zeros, their number, and the
+  // power of ten they are scaled by.
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int zeros = 0;
+  int exponent = 0;
+  bool any = false;
+  bool fraction = false;
+
+  for (;; p += 1) {
+    if (*p == '.' && !fraction) {
+      fraction = true;
+      continue;
+    }
+    if (!('0' <= *p && *p <= '9')) {
+      break;
+    }
+    any = true;
+    if (fraction) {
+      exponent -= 1;
+    }
+
+    if (*p == '0') {
+      zeros += (digits > 0);
+    } else {
+      digits += zeros + 1;
+      if (digits <= MAX_DIGITS) {
+        for (; zeros > 0; zeros -= 1) {
+          mantissa *= 10;
+        }
+        mantissa = 10 * mantissa + (*p - '0');
+      }
+      zeros = 0;
+    }
+  }
+  if (!any) {
+    return false;
+  }
+  exponent += zeros;
+
+  if (*p == 'e' || *p == 'E') {
+    const char* q = p + 1;
+    bool negative_exponent = false;
+    if (*q == '-' || *q == '+') {
+      negative_exponent = (*q == '-');
+      q += 1;
+    }
+    if (!('0' <= *q && *q <= '9')) {
+      return false;
+    }
+    int value = 0;
+    for (; '0' <= *q && *q <= '9'; q += 1) {
+      if (value < 10000) {
+        value = 10 * value + (*q - '0');
+      }
+    }
+    exponent += negative_exponent ? -value : value;
+    p = q;
+  }
+
+  if (digits > MAX_DIGITS || exponent < -MAX_POWER || exponent > MAX_POWER) {
+    // Both the mantissa and the power of ten are not exact as doubles.
+    char* end;
+    x = std::strtod(text, &end);
+    if (end != p) {
+      return false;
+    }
+  } else {
+    x = double(mantissa);
+    if (exponent < 0) {
+      x /= POWERS[-exponent];
+    } else {
+      x *= POWERS[exponent];
+    }
+    if (negative) {
+      x = -x;
+    }
+  }
+
+  text = p;
+  return true;
+}
+
+#endif
@@ -0,0 +1,158 @@
+#include "parse_number.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include "lexical_cast_parser.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+// Parses the whole of the text, or returns NaN.
+double parse(const char* text) {
+  const char* end = text;
+  double x;
+  if (!parseNumber(end, x) || *end != '\0') {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  return x;
+}
+
+bool parses(const char* text) {
+  const char* end = text;
+  double x;
+  return parseNumber(end, x);
+}
+
+// Expects the same double as strtod(), to the bit.
+void expectSameAsStrtod(const char* text) {
+  double expected = std::strtod(text, NULL);
+  double actual = parse(text);
+  EXPECT_EQ(0, std::memcmp(&expected, &actual, sizeof(double)))
+      << text << ": " << expected << " != " << actual;
+}
+
+bool isNegative(double x) {
+  return std::signbit(x);
+}
+
+}
+
+TEST(ParseNumber, ParsesIntegersAndDecimals) {
+  EXPECT_EQ(12, parse("12"));
+  EXPECT_EQ(-3.5, parse("-3.5"));
+  EXPECT_EQ(2, parse("+2"));
+  EXPECT_EQ(0.1, parse("0.1"));
+  EXPECT_EQ(1, parse("1."));
+  EXPECT_EQ(0.5, parse(".5"));
+  EXPECT_EQ(-0.5, parse("-.5"));
+  EXPECT_EQ(1500, parse("1.5e3"));
+  EXPECT_EQ(0.25, parse("2.5000000000000000e-01"));
+}
+
+TEST(ParseNumber, KeepsSignOfZero) {
+  EXPECT_EQ(0, parse("-0"));
+  EXPECT_TRUE(isNegative(parse("-0")));
+  EXPECT_TRUE(isNegative(parse("-0.0e+00")));
+  EXPECT_FALSE(isNegative(parse("0")));
+}
+
+TEST(ParseNumber, RoundsLikeStrtod) {
+  // Past the exact powers of ten.
+  expectSameAsStrtod("1e23");
+  expectSameAsStrtod("1e-23");
+  expectSameAsStrtod("8.5e-300");
+  expectSameAsStrtod("1.7976931348623157e+308");
+  expectSameAsStrtod("4.9406564584124654e-324");
+  // 17 and more significant digits.
+  expectSameAsStrtod("1.2345678901234567e+02");
+  expectSameAsStrtod("12345678901234567890");
+  expectSameAsStrtod("0.30000000000000004");
+  expectSameAsStrtod("9007199254740993");
+  // 15 digits and trailing zeros take the exact path.
+  expectSameAsStrtod("123456789012345");
+  expectSameAsStrtod("1.2345678901234500000e-05");
+}
+
+TEST(ParseNumber, RoundsRandomNumbersLikeStrtod) {
+  const char* formats[] = { "%.17g", "%.16e", "%.6g", "%.15g", "%g" };
+  int num_formats = sizeof(formats) / sizeof(formats[0]);
+  unsigned int state = 12345;
+
+  for (int i = 0; i < 10000; i += 1) {
+    state = state * 1103515245 + 12345;
+    double mantissa = double(state >> 8) / (1 << 24);
+    state = state * 1103515245 + 12345;
+    int exponent = int(state >> 16) % 80 - 40;
+    double x = (mantissa - 0.5) * std::pow(10., exponent);
+
+    for (int j = 0; j < num_formats; j += 1) {
+      char text[64];
+      std::snprintf(text, sizeof(text), formats[j], x);
+      expectSameAsStrtod(text);
+    }
+  }
+}
+
+TEST(ParseNumber, ParsesSpecialValues) {
+  double inf = std::numeric_limits<double>::infinity();
+  EXPECT_EQ(inf, parse(".Inf"));
+  EXPECT_EQ(inf, parse(".inf"));
+  EXPECT_EQ(-inf, parse("-.Inf"));
+  double nan = parse(".Nan");
+  EXPECT_TRUE(nan != nan);
+  nan = parse(".nan");
+  EXPECT_TRUE(nan != nan);
+  EXPECT_FALSE(parses(".Nope"));
+}
+
+TEST(ParseNumber, StopsAfterNumber) {
+  const char* text = "3.5, 4";
+  double x;
+  ASSERT_TRUE(parseNumber(text, x));
+  EXPECT_EQ(3.5, x);
+  EXPECT_EQ(',', *text);
+
+  text = ".Inf]";
+  ASSERT_TRUE(parseNumber(text, x));
+  EXPECT_EQ(']', *text);
+}
+
+TEST(ParseNumber, RejectsNonNumbers) {
+  EXPECT_FALSE(parses(""));
+  EXPECT_FALSE(parses("-"));
+  EXPECT_FALSE(parses("."));
+  EXPECT_FALSE(parses("e5"));
+  EXPECT_FALSE(parses("1e"));
+  EXPECT_FALSE(parses("1e+"));
+  EXPECT_FALSE(parses("abc"));
+}
+
+TEST(LexicalCastParser, ParsesDoubles) {
+  LexicalCastParser<double> parser;
+  double x;
+  ASSERT_TRUE(parser.parse("1.5", x));
+  EXPECT_EQ(1.5, x);
+  ASSERT_TRUE(parser.parse("1e23", x));
+  EXPECT_EQ(1e23, x);
+  EXPECT_FALSE(parser.parse("1.5x", x));
+  EXPECT_FALSE(parser.parse("", x));
+}
+
+TEST(LexicalCastParser, ParsesNamedSpecialValues) {
+  LexicalCastParser<double> parser;
+  double inf = std::numeric_limits<double>::infinity();
+  double x;
+  ASSERT_TRUE(parser.parse("nan", x));
+  EXPECT_TRUE(x != x);
+  ASSERT_TRUE(parser.parse("inf", x));
+  EXPECT_EQ(inf, x);
+  ASSERT_TRUE(parser.parse("-infinity", x));
+  EXPECT_EQ(-inf, x);
+  ASSERT_TRUE(parser.parse("INF", x));
+  EXPECT_EQ(inf, x);
+  ASSERT_TRUE(parser.parse(".Inf", x));
+  EXPECT_EQ(inf, x);
+}
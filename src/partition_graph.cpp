@@ -1,7 +1,6 @@
 #include <iostream>
 #include <string>
 #include <sstream>
-#include <stack>
 #include <map>
 #include <set>
 #include <glog/logging.h>
@@ -23,6 +22,10 @@
 #include "multiview_track.hpp"
 #include "multiview_track_list.hpp"
 #include "feature_index.hpp"
+#include "feature_index_map.hpp"
+#include "clustering_checkpoint.hpp"
+#include "recursive_cut.hpp"
+#include "util/thread-pool.hpp"
 
 #include "read_lines.hpp"
 #include "iterator_reader.hpp"
@@ -50,7 +53,16 @@ typedef boost::subgraph<
                                 EdgeProperty> >
         Graph;
 
-typedef std::map<FeatureIndex, Graph::vertex_descriptor> VertexLookup;
+typedef FeatureIndexMap<Graph::vertex_descriptor> VertexLookup;
+
+DEFINE_int32(num_threads, 4,
+    "Number of worker threads to cut subgraphs with, 0 for none");
+DEFINE_string(checkpoint, "",
+    "Periodically save the subgraphs which remain to be cut to this file");
+DEFINE_int32(checkpoint_interval, 600,
+    "Minimum number of seconds between checkpoints");
+DEFINE_bool(resume, false,
+    "Resume partitioning from the checkpoint file, if it exists");
 
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
@@ -67,6 +79,8 @@ void init(int& argc, char**& argv) {
     google::ShowUsageWithFlags(argv[0]);
     std::exit(1);
   }
+  CHECK(!FLAGS_resume || !FLAGS_checkpoint.empty()) <<
+      "Resuming requires a checkpoint file";
 }
 
 std::string makeMatchFilename(const std::string& format,
@@ -81,23 +95,18 @@ std::string makeMatchFilename(const std::string& format,
 Graph::vertex_descriptor findOrInsert(Graph& graph,
                                       VertexLookup& vertices,
                                       const FeatureIndex& feature) {
-  Graph::vertex_descriptor vertex;
-
-  // Try to find feature in lookup map.
-  VertexLookup::const_iterator mapping = vertices.find(feature);
+  // Reserve an entry in the lookup table, filled in if the feature is new.
+  std::pair<Graph::vertex_descriptor*, bool> mapping =
+      vertices.insert(feature, Graph::vertex_descriptor());
 
-  if (mapping != vertices.end()) {
-    // Found the vertex, it already exists.
-    vertex = mapping->second;
-  } else {
-    // Did not find it, create an entry.
-    vertex = boost::add_vertex(graph);
+  if (mapping.second) {
+    // Did not find it, create a vertex.
+    Graph::vertex_descriptor vertex = boost::add_vertex(graph);
     graph[vertex] = feature;
-    // Create an entry in the lookup table too.
-    vertices[feature] = vertex;
+    *mapping.first = vertex;
   }
 
-  return vertex;
+  return *mapping.first;
 }
 
 void loadAllMatches(const std::string& matches_format,
@@ -202,83 +211,84 @@ bool isConsistent(const Graph& graph) {
   return true;
 }
 
-int cut(Graph& parent, Graph*& child1, Graph*& child2) {
-  int num_vertices = boost::num_vertices(parent);
+// Labels each vertex with 1 or 0. Returns the number of edges cut.
+int minCut(const Graph& graph, std::vector<int>& labels) {
+  int num_vertices = boost::num_vertices(graph);
 
-  // Label each vertex with 1 or 0.
   BOOST_AUTO(parities,
       boost::make_one_bit_color_map(num_vertices,
-        boost::get(boost::vertex_index, parent)));
+        boost::get(boost::vertex_index, graph)));
 
-  int n = boost::stoer_wagner_min_cut(parent,
-      boost::get(boost::edge_weight, parent),
+  int n = boost::stoer_wagner_min_cut(graph,
+      boost::get(boost::edge_weight, graph),
       boost::parity_map(parities));
 
-  child1 = &parent.root().create_subgraph();
-  child2 = &parent.root().create_subgraph();
-
+  labels.clear();
   for (int j = 0; j < num_vertices; j += 1) {
-    if (boost::get(parities, j)) {
-      boost::add_vertex(parent.local_to_global(j), *child1);
-    } else {
-      boost::add_vertex(parent.local_to_global(j), *child2);
-    }
+    labels.push_back(boost::get(parities, j) ? 1 : 0);
   }
 
   return n;
 }
 
-void recursiveCut(std::vector<Graph*>& subgraphs) {
-  // Copy into stack.
-  std::deque<Graph*> deque(subgraphs.begin(), subgraphs.end());
-  std::stack<Graph*> pending(deque);
-  // Replace with output.
-  subgraphs.clear();
-
-  while (!pending.empty()) {
-    Graph* subgraph = pending.top();
-    pending.pop();
-
-    int num_vertices = boost::num_vertices(*subgraph);
+// Divides subgraphs in two by their minimum cut until they are consistent.
+class MinCutDivider : public SubgraphDivider<Graph> {
+  public:
+    Decision examine(const Graph& subgraph, std::vector<int>& labels) const {
+      int num_vertices = boost::num_vertices(subgraph);
+
+      if (num_vertices > MAX_GRAPH_SIZE) {
+        // Too big for the cut algorithm to handle.
+        LOG(WARNING) << "Skipping subgraph with too many vertices (" <<
+            num_vertices << " > " << MAX_GRAPH_SIZE << ")";
+        return DISCARD_SUBGRAPH;
+      }
 
-    if (num_vertices > MAX_GRAPH_SIZE) {
-      // Too big for the cut algorithm to handle.
-      LOG(WARNING) << "Skipping subgraph with too many vertices (" <<
-          num_vertices << " > " << MAX_GRAPH_SIZE << ")";
-      continue;
-    }
+      if (num_vertices < MIN_GRAPH_SIZE) {
+        // Not enough observations, forget about it.
+        DLOG(INFO) << "Skipping subgraph with too few vertices (" <<
+            num_vertices << " < " << MIN_GRAPH_SIZE << ")";
+        return DISCARD_SUBGRAPH;
+      }
 
-    if (num_vertices < MIN_GRAPH_SIZE) {
-      // Not enough observations, forget about it.
-      DLOG(INFO) << "Skipping subgraph with too few vertices (" <<
-          num_vertices << " < " << MIN_GRAPH_SIZE << ")";
-      continue;
-    }
+      if (isConsistent(subgraph)) {
+        DLOG(INFO) << "Found consistent subgraph with " << num_vertices <<
+            " vertices";
+        return ACCEPT_SUBGRAPH;
+      }
 
-    if (isConsistent(*subgraph)) {
-      // Move to list of valid subgraphs.
-      subgraphs.push_back(subgraph);
-      DLOG(INFO) << "Found consistent subgraph with " << num_vertices <<
-          " vertices";
-      continue;
+      // Cut the subgraph in two.
+      int n = minCut(subgraph, labels);
+      DLOG(INFO) << "Cut " << n << " edges";
+      return DIVIDE_SUBGRAPH;
     }
 
-    // Cut the subgraph in two.
-    Graph* subgraph1;
-    Graph* subgraph2;
-    int n = cut(*subgraph, subgraph1, subgraph2);
+    void divide(Graph& subgraph,
+                const std::vector<int>& labels,
+                std::vector<Graph*>& children) const {
+      int num_vertices = boost::num_vertices(subgraph);
+      Graph* child1 = &subgraph.root().create_subgraph();
+      Graph* child2 = &subgraph.root().create_subgraph();
+
+      for (int j = 0; j < num_vertices; j += 1) {
+        if (labels[j]) {
+          boost::add_vertex(subgraph.local_to_global(j), *child1);
+        } else {
+          boost::add_vertex(subgraph.local_to_global(j), *child2);
+        }
+      }
 
-    // Can't actually delete subgraph, but we can at least empty it.
-    *subgraph = Graph();
-    // Add both children.
-    pending.push(subgraph1);
-    pending.push(subgraph2);
+      // Can't actually delete subgraph, but we can at least empty it.
+      subgraph = Graph();
+      // Add both children.
+      children.push_back(child1);
+      children.push_back(child2);
 
-    int n1 = boost::num_vertices(*subgraph1);
-    int n2 = boost::num_vertices(*subgraph2);
-    DLOG(INFO) << "Cut " << n << " edges, split (" << n1 << ", " << n2 << ")";
-  }
-}
+      int n1 = boost::num_vertices(*child1);
+      int n2 = boost::num_vertices(*child2);
+      DLOG(INFO) << "Split (" << n1 << ", " << n2 << ")";
+    }
+};
 
 void subgraphToTrack(const Graph& subgraph,
                      MultiviewTrack<int>& track,
@@ -346,13 +356,31 @@ int main(int argc, char** argv) {
   LOG(INFO) << "Loaded " << num_edges << " matches between " << num_vertices <<
       " features";
 
-  std::vector<Graph*> subgraphs;
-  splitIntoComponents(graph, subgraphs);
-  int num_components = subgraphs.size();
-  LOG(INFO) << "Found " << num_components << " connected components";
+  ThreadPool pool(FLAGS_num_threads);
+  MinCutDivider divider;
+  ParallelRecursiveCut<Graph> cutter(graph, divider, PARTITION_GRAPH);
+  cutter.setCheckpoint(FLAGS_checkpoint, FLAGS_checkpoint_interval);
+
+  ClusteringCheckpoint checkpoint;
+  if (FLAGS_resume && loadClusteringCheckpoint(FLAGS_checkpoint, checkpoint)) {
+    ok = cutter.resume(checkpoint);
+    CHECK(ok) << "Could not resume from checkpoint";
+    LOG(INFO) << "Resumed after " << cutter.numCuts() << " cuts with " <<
+        cutter.numPending() << " subgraphs pending";
+  } else {
+    std::vector<Graph*> components;
+    splitIntoComponents(graph, components);
+    int num_components = components.size();
+    LOG(INFO) << "Found " << num_components << " connected components";
+    cutter.init(components);
+  }
 
   // Recursively partition using min-cut.
-  recursiveCut(subgraphs);
+  ok = cutter.run(pool);
+  if (!ok) {
+    LOG(WARNING) << "Some checkpoints could not be saved";
+  }
+  const std::vector<Graph*>& subgraphs = cutter.subgraphs();
   LOG(INFO) << "Found " << subgraphs.size() << " valid tracks";
 
   // Convert each consistent subgraph to a multi-view track of indices.
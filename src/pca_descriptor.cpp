@@ -14,6 +14,7 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include "descriptor.hpp"
+#include "descriptor_matrix.hpp"
 #include "random_color.hpp"
 #include "track_list.hpp"
 
@@ -67,7 +68,7 @@ int main(int argc, char** argv) {
   int num_descriptors = descriptor_tracks.countPoints();
 
   // Put all descriptors into one big matrix.
-  cv::Mat descriptors = cv::Mat_<double>(num_descriptors, 128);
+  DescriptorMatrix descriptors(num_descriptors, 128);
   {
     // Maintain overall descriptor index.
     int i = 0;
@@ -84,7 +85,7 @@ int main(int argc, char** argv) {
         // Copy each descriptor into the matrix.
         const Descriptor& descriptor = pair->second;
         std::copy(descriptor.data.begin(), descriptor.data.end(),
-            descriptors.row(i).begin<double>());
+            descriptors.row<float>(i));
 
         i += 1;
       }
@@ -92,11 +93,12 @@ int main(int argc, char** argv) {
   }
 
   // Perform PCA.
-  cv::PCA pca(descriptors, cv::Mat(), CV_PCA_DATA_AS_ROW, NUM_DIMENSIONS);
+  cv::PCA pca(descriptors.mat(), cv::Mat(), CV_PCA_DATA_AS_ROW,
+      NUM_DIMENSIONS);
 
   // Project each descriptor down on to the basis.
   cv::Mat alpha;
-  pca.project(descriptors, alpha);
+  pca.project(descriptors.mat(), alpha);
 
   // Write out points in gnuplot format.
   {
@@ -120,7 +122,7 @@ int main(int argc, char** argv) {
            descriptor != track->end();
            ++descriptor) {
         for (int j = 0; j < NUM_DIMENSIONS; j += 1) {
-          std::cout << alpha.at<double>(i, j);
+          std::cout << alpha.at<float>(i, j);
           std::cout << "\t";
         }
         std::cout << color;
@@ -0,0 +1,188 @@
+#include "pca_projection.hpp"
+#include <glog/logging.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+float dotProduct(const float* x, const float* y, int n) {
+  int d = 0;
+  float sum = 0;
+
+#ifdef __SSE2__
+  __m128 sums = _mm_setzero_ps();
+  for (; d + 4 <= n; d += 4) {
+    sums = _mm_add_ps(sums, _mm_mul_ps(_mm_loadu_ps(x + d),
+                                       _mm_loadu_ps(y + d)));
+  }
+  float partial[4];
+  _mm_storeu_ps(partial, sums);
+  sum = (partial[0] + partial[1]) + (partial[2] + partial[3]);
+#endif
+
+  for (; d < n; d += 1) {
+    sum += x[d] * y[d];
+  }
+  return sum;
+}
+
+}
+
+DescriptorCovariance::DescriptorCovariance()
+    : shift_(), sum_(), products_(), count_(0) {}
+
+void DescriptorCovariance::add(const DescriptorMatrix& points) {
+  if (points.empty()) {
+    return;
+  }
+
+  cv::Mat X;
+  points.toFloat().convertTo(X, cv::DataType<double>::type);
+
+  if (shift_.empty()) {
+    cv::reduce(X, shift_, 0, CV_REDUCE_AVG);
+    sum_ = cv::Mat::zeros(1, X.cols, cv::DataType<double>::type);
+    products_ = cv::Mat::zeros(X.cols, X.cols, cv::DataType<double>::type);
+  }
+  CHECK(X.cols == shift_.cols) << "Descriptors differ in size";
+
+  for (int i = 0; i < X.rows; i += 1) {
+    X.row(i) -= shift_;
+  }
+
+  cv::Mat sum;
+  cv::reduce(X, sum, 0, CV_REDUCE_SUM);
+  sum_ += sum;
+
+  // Sum of outer products.
+  cv::Mat products;
+  cv::mulTransposed(X, products, true);
+  products_ += products;
+
+  count_ += X.rows;
+}
+
+int DescriptorCovariance::count() const {
+  return count_;
+}
+
+int DescriptorCovariance::dimension() const {
+  return shift_.cols;
+}
+
+void DescriptorCovariance::compute(cv::Mat& mean, cv::Mat& covariance) const {
+  CHECK(count_ > 0) << "No descriptors";
+
+  cv::Mat shifted_mean = sum_ / count_;
+  mean = shift_ + shifted_mean;
+  covariance = products_ / count_ - shifted_mean.t() * shifted_mean;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+PcaProjection::PcaProjection() : mean_(), basis_(), offset_() {}
+
+void PcaProjection::train(const DescriptorCovariance& covariance,
+                          int num_components) {
+  CHECK(num_components > 0) << "Need at least one component";
+  CHECK(num_components <= covariance.dimension()) <<
+      "More components than dimensions";
+
+  cv::Mat mean;
+  cv::Mat C;
+  covariance.compute(mean, C);
+
+  // Eigenvectors are rows in order of decreasing eigenvalue.
+  cv::Mat eigenvalues;
+  cv::Mat eigenvectors;
+  cv::eigen(C, eigenvalues, eigenvectors);
+
+  double total = cv::sum(eigenvalues)[0];
+  double kept = cv::sum(eigenvalues.rowRange(0, num_components))[0];
+  LOG(INFO) << "Kept " << kept / total << " of the variance in " <<
+      num_components << " components";
+
+  cv::Mat basis;
+  eigenvectors.rowRange(0, num_components).convertTo(basis,
+      cv::DataType<float>::type);
+  mean.convertTo(mean, cv::DataType<float>::type);
+  bool ok = setBasis(mean, basis);
+  CHECK(ok);
+}
+
+bool PcaProjection::empty() const {
+  return basis_.empty();
+}
+
+int PcaProjection::dimension() const {
+  return basis_.cols;
+}
+
+int PcaProjection::numComponents() const {
+  return basis_.rows;
+}
+
+void PcaProjection::project(const DescriptorMatrix& points,
+                            DescriptorMatrix& projected) const {
+  CHECK(!empty()) << "Projection has not been trained";
+  CHECK(points.empty() || points.cols() == dimension()) <<
+      "Descriptors differ in size";
+
+  DescriptorMatrix floats = points;
+  if (!points.empty() && points.type() != cv::DataType<float>::type) {
+    copyToDescriptorMatrix(points, floats);
+  }
+
+  int num_components = numComponents();
+  int num_dimensions = dimension();
+  projected.create(points.rows(), num_components, cv::DataType<float>::type);
+  const float* offset = offset_.ptr<float>(0);
+
+  for (int i = 0; i < floats.rows(); i += 1) {
+    const float* x = floats.row<float>(i);
+    float* y = projected.row<float>(i);
+
+    for (int c = 0; c < num_components; c += 1) {
+      y[c] = dotProduct(basis_.ptr<float>(c), x, num_dimensions) - offset[c];
+    }
+  }
+}
+
+const cv::Mat& PcaProjection::mean() const {
+  return mean_;
+}
+
+const cv::Mat& PcaProjection::basis() const {
+  return basis_;
+}
+
+bool PcaProjection::setBasis(const cv::Mat& mean, const cv::Mat& basis) {
+  if (mean.rows != 1 || basis.empty() || mean.cols != basis.cols) {
+    return false;
+  }
+  if (basis.rows > basis.cols) {
+    return false;
+  }
+
+  mean.convertTo(mean_, cv::DataType<float>::type);
+  basis.convertTo(basis_, cv::DataType<float>::type);
+
+  cv::Mat offset = basis_ * mean_.t();
+  offset_ = offset.t();
+  return true;
+}
+
+std::string makeProjectedDescriptorsFilename(
+    const std::string& descriptors_file) {
+  // Keep the extension, which determines the format.
+  size_t slash = descriptors_file.find_last_of('/');
+  size_t dot = descriptors_file.find_last_of('.');
+  if (dot == std::string::npos ||
+      (slash != std::string::npos && dot < slash)) {
+    return descriptors_file + ".pca";
+  }
+  return descriptors_file.substr(0, dot) + ".pca" +
+      descriptors_file.substr(dot);
+}
@@ -0,0 +1,31 @@
+#include "pca_projection_reader.hpp"
+#include <glog/logging.h>
+#include "matrix_reader.hpp"
+
+PcaProjectionReader::~PcaProjectionReader() {}
+
+bool PcaProjectionReader::read(const cv::FileNode& node,
+                               PcaProjection& projection) {
+  if (node.type() != cv::FileNode::MAP) {
+    return false;
+  }
+
+  cv::Mat mean;
+  bool ok = readMatrix(node["mean"], mean);
+  if (!ok) {
+    return false;
+  }
+
+  cv::Mat basis;
+  ok = readMatrix(node["basis"], basis);
+  if (!ok) {
+    return false;
+  }
+
+  if (!projection.setBasis(mean, basis)) {
+    LOG(WARNING) << "Mean and basis have inconsistent dimensions";
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,13 @@
+#ifndef PCA_PROJECTION_READER_HPP_
+#define PCA_PROJECTION_READER_HPP_
+
+#include "pca_projection.hpp"
+#include "reader.hpp"
+
+class PcaProjectionReader : public Reader<PcaProjection> {
+  public:
+    ~PcaProjectionReader();
+    bool read(const cv::FileNode& node, PcaProjection& projection);
+};
+
+#endif
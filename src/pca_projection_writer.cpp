@@ -0,0 +1,9 @@
+#include "pca_projection_writer.hpp"
+
+PcaProjectionWriter::~PcaProjectionWriter() {}
+
+void PcaProjectionWriter::write(cv::FileStorage& file,
+                                const PcaProjection& projection) {
+  file << "mean" << projection.mean();
+  file << "basis" << projection.basis();
+}
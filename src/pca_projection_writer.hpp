@@ -0,0 +1,13 @@
+#ifndef PCA_PROJECTION_WRITER_HPP_
+#define PCA_PROJECTION_WRITER_HPP_
+
+#include "pca_projection.hpp"
+#include "writer.hpp"
+
+class PcaProjectionWriter : public Writer<PcaProjection> {
+  public:
+    ~PcaProjectionWriter();
+    void write(cv::FileStorage& file, const PcaProjection& projection);
+};
+
+#endif
@@ -0,0 +1,815 @@
+#include "pipeline.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <glog/logging.h>
+#include "read_lines.hpp"
+#include "util/hash.hpp"
+#include "util/thread-pool.hpp"
+
+PipelineTask::PipelineTask()
+    : stage(),
+      item(),
+      command(),
+      inputs(),
+      outputs(),
+      cpus(1),
+      memory_mb(0),
+      dependencies() {}
+
+PipelineOptions::PipelineOptions()
+    : cpus(1),
+      memory_mb(0),
+      keep_going(false),
+      dry_run(false),
+      skip_if_unchanged(false) {}
+
+namespace {
+
+typedef std::map<std::string, std::string> Variables;
+
+// Stage as declared, before it is expanded into tasks.
+struct Stage {
+  std::string name;
+  std::string items;
+  std::vector<std::string> inputs;
+  std::vector<std::string> outputs;
+  std::string command;
+  int cpus;
+  int memory_mb;
+
+  Stage();
+};
+
+Stage::Stage()
+    : name(), items("once"), inputs(), outputs(), command(), cpus(1),
+      memory_mb(0) {}
+
+std::string trim(const std::string& s) {
+  std::string::size_type begin = s.find_first_not_of(" \t\r");
+  if (begin == std::string::npos) {
+    return std::string();
+  }
+  std::string::size_type end = s.find_last_not_of(" \t\r");
+  return s.substr(begin, end - begin + 1);
+}
+
+bool parseInt(const std::string& s, int& x) {
+  std::istringstream stream(s);
+  stream >> x;
+  return !stream.fail() && stream.eof();
+}
+
+bool isNameCharacter(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Replaces {name} and {name:0w} with the value of a variable, the latter
+// padded with zeros to w characters. Braces after a $ are left for the
+// shell. Returns false if a variable is not defined.
+bool substitute(const std::string& pattern,
+                const Variables& variables,
+                std::string& result) {
+  result.clear();
+  std::string::size_type i = 0;
+  while (i < pattern.size()) {
+    std::string::size_type close = pattern.find('}', i);
+    if (pattern[i] != '{' || (i > 0 && pattern[i - 1] == '$') ||
+        close == std::string::npos) {
+      result += pattern[i];
+      i += 1;
+      continue;
+    }
+
+    std::string field = pattern.substr(i + 1, close - i - 1);
+    std::string name = field.substr(0, field.find(':'));
+    int width = 0;
+    if (name.size() < field.size()) {
+      if (!parseInt(field.substr(name.size() + 1), width)) {
+        LOG(WARNING) << "Invalid width in \"{" << field << "}\"";
+        return false;
+      }
+    }
+
+    bool valid = !name.empty();
+    for (std::string::size_type j = 0; j < name.size(); j += 1) {
+      valid = valid && isNameCharacter(name[j]);
+    }
+    if (!valid) {
+      // Not a variable, e.g. a brace of the shell.
+      result += pattern[i];
+      i += 1;
+      continue;
+    }
+
+    Variables::const_iterator variable = variables.find(name);
+    if (variable == variables.end()) {
+      LOG(WARNING) << "Undefined variable \"" << name << "\" in \"" <<
+          pattern << "\"";
+      return false;
+    }
+    std::string value = variable->second;
+    if (int(value.size()) < width) {
+      value = std::string(width - value.size(), '0') + value;
+    }
+    result += value;
+    i = close + 1;
+  }
+  return true;
+}
+
+std::string frameNumber(int time) {
+  return boost::str(boost::format("%d") % (time + 1));
+}
+
+// Variables of every item of a stage.
+bool listItems(const std::string& items,
+               const std::vector<std::string>& views,
+               int num_frames,
+               std::vector<Variables>& list) {
+  int num_views = views.size();
+  list.clear();
+
+  if (items == "once") {
+    list.push_back(Variables());
+  } else if (items == "views") {
+    for (int v = 0; v < num_views; v += 1) {
+      Variables variables;
+      variables["view"] = views[v];
+      list.push_back(variables);
+    }
+  } else if (items == "frames") {
+    for (int t = 0; t < num_frames; t += 1) {
+      Variables variables;
+      variables["time"] = frameNumber(t);
+      list.push_back(variables);
+    }
+  } else if (items == "images") {
+    for (int v = 0; v < num_views; v += 1) {
+      for (int t = 0; t < num_frames; t += 1) {
+        Variables variables;
+        variables["view"] = views[v];
+        variables["time"] = frameNumber(t);
+        list.push_back(variables);
+      }
+    }
+  } else if (items == "pairs" || items == "simultaneous" ||
+      items == "adjacent") {
+    // Same order as match-features-batch.
+    for (int v = 0; v < num_views; v += 1) {
+      for (int t = 0; t < num_frames; t += 1) {
+        for (int w = v; w < num_views; w += 1) {
+          int first = (v == w) ? t + 1 : 0;
+
+          for (int u = first; u < num_frames; u += 1) {
+            if (items == "simultaneous" && (v == w || t != u)) {
+              continue;
+            }
+            if (items == "adjacent" && (v != w || u != t + 1)) {
+              continue;
+            }
+
+            Variables variables;
+            variables["view1"] = views[v];
+            variables["time1"] = frameNumber(t);
+            variables["view2"] = views[w];
+            variables["time2"] = frameNumber(u);
+            list.push_back(variables);
+          }
+        }
+      }
+    }
+  } else {
+    LOG(WARNING) << "Unknown items \"" << items << "\"";
+    return false;
+  }
+  return true;
+}
+
+// Lists of files as {name} and {nameN}, from one.
+void addFiles(const std::string& name,
+              const std::vector<std::string>& files,
+              Variables& variables) {
+  std::string all;
+  for (int i = 0; i < int(files.size()); i += 1) {
+    all += (i == 0 ? "" : " ") + files[i];
+    variables[boost::str(boost::format("%s%d") % name % (i + 1))] = files[i];
+  }
+  variables[name] = all;
+}
+
+bool expandStage(const Stage& stage,
+                 const Variables& globals,
+                 const std::vector<std::string>& views,
+                 int num_frames,
+                 std::vector<PipelineTask>& tasks) {
+  std::vector<Variables> items;
+  if (!listItems(stage.items, views, num_frames, items)) {
+    return false;
+  }
+
+  std::vector<Variables>::iterator item;
+  for (item = items.begin(); item != items.end(); ++item) {
+    Variables& variables = *item;
+    variables.insert(globals.begin(), globals.end());
+
+    PipelineTask task;
+    task.stage = stage.name;
+    task.cpus = stage.cpus;
+    task.memory_mb = stage.memory_mb;
+
+    // The item as view and frame names.
+    const char* NAMES[] = { "view", "view1", "time1", "view2", "time2",
+      "time" };
+    const int NUM_NAMES = sizeof(NAMES) / sizeof(NAMES[0]);
+    for (int i = 0; i < NUM_NAMES; i += 1) {
+      Variables::const_iterator name = variables.find(NAMES[i]);
+      if (name != variables.end()) {
+        task.item += (task.item.empty() ? "" : " ") + name->second;
+      }
+    }
+
+    task.inputs.resize(stage.inputs.size());
+    for (int i = 0; i < int(stage.inputs.size()); i += 1) {
+      if (!substitute(stage.inputs[i], variables, task.inputs[i])) {
+        return false;
+      }
+    }
+    task.outputs.resize(stage.outputs.size());
+    for (int i = 0; i < int(stage.outputs.size()); i += 1) {
+      if (!substitute(stage.outputs[i], variables, task.outputs[i])) {
+        return false;
+      }
+    }
+
+    addFiles("input", task.inputs, variables);
+    addFiles("output", task.outputs, variables);
+    if (!substitute(stage.command, variables, task.command)) {
+      return false;
+    }
+
+    tasks.push_back(task);
+  }
+  return true;
+}
+
+// Links each task to those which write its inputs.
+bool findDependencies(std::vector<PipelineTask>& tasks) {
+  std::map<std::string, int> writers;
+  for (int i = 0; i < int(tasks.size()); i += 1) {
+    const std::vector<std::string>& outputs = tasks[i].outputs;
+    for (int j = 0; j < int(outputs.size()); j += 1) {
+      if (!writers.insert(std::make_pair(outputs[j], i)).second) {
+        LOG(WARNING) << "Two tasks write \"" << outputs[j] << "\"";
+        return false;
+      }
+    }
+  }
+
+  for (int i = 0; i < int(tasks.size()); i += 1) {
+    PipelineTask& task = tasks[i];
+    for (int j = 0; j < int(task.inputs.size()); j += 1) {
+      std::map<std::string, int>::const_iterator writer =
+          writers.find(task.inputs[j]);
+      if (writer != writers.end()) {
+        if (writer->second == i) {
+          LOG(WARNING) << "Task reads its own output \"" << task.inputs[j] <<
+              "\"";
+          return false;
+        }
+        task.dependencies.push_back(writer->second);
+      }
+    }
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// In nanoseconds, since a task may take less than a second.
+bool modificationTime(const std::string& file, long long& time) {
+  struct stat status;
+  if (stat(file.c_str(), &status) != 0) {
+    return false;
+  }
+  time = status.st_mtim.tv_sec * 1000000000LL + status.st_mtim.tv_nsec;
+  return true;
+}
+
+// True if every output exists and is no older than every input.
+bool isUpToDate(const PipelineTask& task) {
+  if (task.outputs.empty()) {
+    return false;
+  }
+
+  long long oldest_output = 0;
+  for (int i = 0; i < int(task.outputs.size()); i += 1) {
+    long long time;
+    if (!modificationTime(task.outputs[i], time)) {
+      return false;
+    }
+    if (i == 0 || time < oldest_output) {
+      oldest_output = time;
+    }
+  }
+
+  for (int i = 0; i < int(task.inputs.size()); i += 1) {
+    long long time;
+    if (!modificationTime(task.inputs[i], time) || time > oldest_output) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool hashFile(const std::string& file, uint64_t& value) {
+  std::ifstream stream(file.c_str(), std::ios::binary);
+  if (!stream.is_open()) {
+    return false;
+  }
+
+  Hash hash;
+  char buffer[1 << 16];
+  while (stream.read(buffer, sizeof(buffer)) || stream.gcount() > 0) {
+    hash.add(buffer, stream.gcount());
+  }
+  value = hash.value();
+  return true;
+}
+
+std::string hexadecimal(uint64_t value) {
+  return boost::str(boost::format("%016x") % value);
+}
+
+// Records what an output was made from, next to it.
+std::string manifestFilename(const std::string& output) {
+  return output + ".manifest";
+}
+
+// Reads the hash of the task which wrote an output.
+bool loadManifestHash(const std::string& output, std::string& hash) {
+  std::ifstream stream(manifestFilename(output).c_str());
+  std::string key;
+  stream >> key >> hash;
+  return !stream.fail() && key == "hash";
+}
+
+// Creates the directory of a file and its parents, like mkdir -p.
+bool makeParentDirectories(const std::string& file) {
+  std::string::size_type slash = file.find('/', 1);
+  while (slash != std::string::npos) {
+    std::string directory = file.substr(0, slash);
+    if (mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST) {
+      return false;
+    }
+    slash = file.find('/', slash + 1);
+  }
+  return true;
+}
+
+// Runs a command with /bin/sh and returns its exit status.
+// Unlike std::system(), this may be called from several threads at once.
+int runCommand(const std::string& command) {
+  pid_t pid = fork();
+  if (pid < 0) {
+    return -1;
+  }
+  if (pid == 0) {
+    execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char*>(NULL));
+    _exit(127);
+  }
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      return -1;
+    }
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+class PipelineRunner {
+  public:
+    PipelineRunner(const std::vector<PipelineTask>& tasks,
+                   const PipelineOptions& options);
+
+    bool run();
+
+  private:
+    enum State { WAITING, RUNNING, DONE, UP_TO_DATE, FAILED, BLOCKED };
+
+    // Runs the command of a task on a worker of the pool.
+    void execute(int i);
+    // Checks the inputs, runs the command and checks the outputs.
+    bool runTask(const PipelineTask& task);
+    bool fits(const PipelineTask& task) const;
+    // True if a dependency ran, so that in a dry run the outputs of a task
+    // will be out of date.
+    bool dependencyRan(const PipelineTask& task) const;
+    // True if every output has a manifest of the same command and inputs.
+    // Outputs without manifests which are newer than the inputs are
+    // adopted. Called with the mutex held.
+    bool isUnchanged(int i);
+    // Hash of the command and the contents of the inputs.
+    bool taskHash(const PipelineTask& task, uint64_t& value);
+    void saveManifests(int i) const;
+    // Makes the dependents of a task ready. Called with the mutex held.
+    void finish(int i, State state);
+    void block(int i);
+
+    const std::vector<PipelineTask>* tasks_;
+    PipelineOptions options_;
+    std::vector<State> states_;
+    std::vector<std::vector<int> > dependents_;
+    // Number of dependencies of each task which are not done.
+    std::vector<int> num_remaining_;
+    // Tasks whose dependencies are done, in the order they were declared.
+    std::deque<int> ready_;
+    // Of each task and input file, if skipping unchanged tasks.
+    std::vector<uint64_t> task_hashes_;
+    std::map<std::string, uint64_t> file_hashes_;
+    int num_running_;
+    int cpus_used_;
+    int memory_used_;
+    bool failed_;
+
+    boost::mutex mutex_;
+    boost::condition_variable task_finished_;
+    // One worker per CPU of the budget, which is enough for every task that
+    // fits in it.
+    ThreadPool pool_;
+};
+
+PipelineRunner::PipelineRunner(const std::vector<PipelineTask>& tasks,
+                               const PipelineOptions& options)
+    : tasks_(&tasks),
+      options_(options),
+      states_(tasks.size(), WAITING),
+      dependents_(tasks.size()),
+      num_remaining_(tasks.size(), 0),
+      ready_(),
+      task_hashes_(tasks.size(), 0),
+      file_hashes_(),
+      num_running_(0),
+      cpus_used_(0),
+      memory_used_(0),
+      failed_(false),
+      mutex_(),
+      task_finished_(),
+      pool_(std::max(options.cpus, 1)) {
+  for (int i = 0; i < int(tasks.size()); i += 1) {
+    const std::vector<int>& dependencies = tasks[i].dependencies;
+    for (int j = 0; j < int(dependencies.size()); j += 1) {
+      dependents_[dependencies[j]].push_back(i);
+    }
+    num_remaining_[i] = dependencies.size();
+    if (dependencies.empty()) {
+      ready_.push_back(i);
+    }
+  }
+}
+
+bool PipelineRunner::fits(const PipelineTask& task) const {
+  if (num_running_ == 0) {
+    return true;
+  }
+  if (cpus_used_ + task.cpus > options_.cpus) {
+    return false;
+  }
+  if (options_.memory_mb > 0 &&
+      memory_used_ + task.memory_mb > options_.memory_mb) {
+    return false;
+  }
+  return true;
+}
+
+bool PipelineRunner::dependencyRan(const PipelineTask& task) const {
+  for (int i = 0; i < int(task.dependencies.size()); i += 1) {
+    if (states_[task.dependencies[i]] == DONE) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PipelineRunner::taskHash(const PipelineTask& task, uint64_t& value) {
+  Hash hash;
+  hash.add(task.command);
+  for (int i = 0; i < int(task.inputs.size()); i += 1) {
+    const std::string& input = task.inputs[i];
+    std::map<std::string, uint64_t>::const_iterator cached =
+        file_hashes_.find(input);
+    if (cached == file_hashes_.end()) {
+      uint64_t file_hash;
+      if (!hashFile(input, file_hash)) {
+        return false;
+      }
+      cached = file_hashes_.insert(std::make_pair(input, file_hash)).first;
+    }
+
+    hash.add(input);
+    hash.add(&cached->second, sizeof(cached->second));
+  }
+  value = hash.value();
+  return true;
+}
+
+bool PipelineRunner::isUnchanged(int i) {
+  const PipelineTask& task = (*tasks_)[i];
+  if (!taskHash(task, task_hashes_[i]) || task.outputs.empty()) {
+    return false;
+  }
+  std::string expected = hexadecimal(task_hashes_[i]);
+
+  int num_recorded = 0;
+  for (int j = 0; j < int(task.outputs.size()); j += 1) {
+    std::string hash;
+    if (loadManifestHash(task.outputs[j], hash)) {
+      if (hash != expected) {
+        return false;
+      }
+      num_recorded += 1;
+    }
+  }
+
+  if (num_recorded == int(task.outputs.size())) {
+    return access(task.outputs[0].c_str(), F_OK) == 0;
+  }
+  if (num_recorded == 0 && isUpToDate(task)) {
+    // A dry run does not write anything.
+    if (!options_.dry_run) {
+      saveManifests(i);
+    }
+    return true;
+  }
+  return false;
+}
+
+void PipelineRunner::saveManifests(int i) const {
+  const PipelineTask& task = (*tasks_)[i];
+  for (int j = 0; j < int(task.outputs.size()); j += 1) {
+    std::ofstream stream(manifestFilename(task.outputs[j]).c_str());
+    stream << "hash " << hexadecimal(task_hashes_[i]) << std::endl;
+    stream << "command " << task.command << std::endl;
+    for (int k = 0; k < int(task.inputs.size()); k += 1) {
+      stream << "input " << task.inputs[k] << std::endl;
+    }
+  }
+}
+
+void PipelineRunner::finish(int i, State state) {
+  states_[i] = state;
+  if (state == FAILED) {
+    failed_ = true;
+    block(i);
+    return;
+  }
+
+  const std::vector<int>& dependents = dependents_[i];
+  for (int j = 0; j < int(dependents.size()); j += 1) {
+    int k = dependents[j];
+    num_remaining_[k] -= 1;
+    if (num_remaining_[k] == 0 && states_[k] == WAITING) {
+      ready_.push_back(k);
+    }
+  }
+}
+
+// Marks everything which depends on a failed task.
+void PipelineRunner::block(int i) {
+  std::vector<int> stack(1, i);
+  while (!stack.empty()) {
+    int j = stack.back();
+    stack.pop_back();
+
+    const std::vector<int>& dependents = dependents_[j];
+    for (int d = 0; d < int(dependents.size()); d += 1) {
+      int k = dependents[d];
+      if (states_[k] == WAITING) {
+        states_[k] = BLOCKED;
+        stack.push_back(k);
+      }
+    }
+  }
+}
+
+bool PipelineRunner::runTask(const PipelineTask& task) {
+  for (int i = 0; i < int(task.inputs.size()); i += 1) {
+    if (access(task.inputs[i].c_str(), F_OK) != 0) {
+      LOG(ERROR) << task.stage << " " << task.item << ": missing input \"" <<
+          task.inputs[i] << "\"";
+      return false;
+    }
+  }
+  for (int i = 0; i < int(task.outputs.size()); i += 1) {
+    if (!makeParentDirectories(task.outputs[i])) {
+      LOG(ERROR) << task.stage << " " << task.item << ": could not create " <<
+          "directory of \"" << task.outputs[i] << "\"";
+      return false;
+    }
+  }
+
+  int status = runCommand(task.command);
+  if (status != 0) {
+    LOG(ERROR) << task.stage << " " << task.item << ": exit status " <<
+        status << " of \"" << task.command << "\"";
+    return false;
+  }
+
+  for (int i = 0; i < int(task.outputs.size()); i += 1) {
+    if (access(task.outputs[i].c_str(), F_OK) != 0) {
+      LOG(ERROR) << task.stage << " " << task.item << ": did not write \"" <<
+          task.outputs[i] << "\"";
+      return false;
+    }
+  }
+  return true;
+}
+
+void PipelineRunner::execute(int i) {
+  const PipelineTask& task = (*tasks_)[i];
+  bool ok = runTask(task);
+  if (!ok) {
+    // Partial outputs would look finished to the next run.
+    for (int j = 0; j < int(task.outputs.size()); j += 1) {
+      std::remove(task.outputs[j].c_str());
+      std::remove(manifestFilename(task.outputs[j]).c_str());
+    }
+  } else if (options_.skip_if_unchanged) {
+    saveManifests(i);
+  }
+
+  boost::mutex::scoped_lock lock(mutex_);
+  for (int j = 0; j < int(task.outputs.size()); j += 1) {
+    file_hashes_.erase(task.outputs[j]);
+  }
+  num_running_ -= 1;
+  cpus_used_ -= task.cpus;
+  memory_used_ -= task.memory_mb;
+  finish(i, ok ? DONE : FAILED);
+  task_finished_.notify_all();
+}
+
+bool PipelineRunner::run() {
+  const std::vector<PipelineTask>& tasks = *tasks_;
+  boost::mutex::scoped_lock lock(mutex_);
+
+  while (true) {
+    // Start ready tasks in order while they fit in the budget.
+    while (!ready_.empty() && (options_.keep_going || !failed_)) {
+      int i = ready_.front();
+      const PipelineTask& task = tasks[i];
+
+      bool up_to_date;
+      if (options_.dry_run && dependencyRan(task)) {
+        up_to_date = false;
+      } else if (options_.skip_if_unchanged) {
+        up_to_date = isUnchanged(i);
+      } else {
+        up_to_date = isUpToDate(task);
+      }
+      if (up_to_date) {
+        ready_.pop_front();
+        finish(i, UP_TO_DATE);
+        continue;
+      }
+      if (options_.dry_run) {
+        ready_.pop_front();
+        std::cout << task.command << std::endl;
+        finish(i, DONE);
+        continue;
+      }
+      if (!fits(task)) {
+        break;
+      }
+
+      ready_.pop_front();
+      LOG(INFO) << task.stage << " " << task.item;
+      states_[i] = RUNNING;
+      num_running_ += 1;
+      cpus_used_ += task.cpus;
+      memory_used_ += task.memory_mb;
+      pool_.schedule(boost::bind(&PipelineRunner::execute, this, i));
+    }
+
+    if (num_running_ == 0) {
+      break;
+    }
+    task_finished_.wait(lock);
+  }
+  lock.unlock();
+  pool_.wait();
+
+  int counts[BLOCKED + 1] = { 0 };
+  for (int i = 0; i < int(states_.size()); i += 1) {
+    counts[states_[i]] += 1;
+  }
+  LOG(INFO) << counts[DONE] << " tasks ran, " << counts[UP_TO_DATE] <<
+      " were up to date, " << counts[FAILED] << " failed, " <<
+      counts[BLOCKED] << " depend on failed tasks and " << counts[WAITING] <<
+      " did not start";
+  return counts[DONE] + counts[UP_TO_DATE] == int(states_.size());
+}
+
+}
+
+bool loadPipeline(const std::string& filename,
+                  std::vector<PipelineTask>& tasks) {
+  std::vector<std::string> lines;
+  if (!readLines(filename, lines)) {
+    return false;
+  }
+
+  std::string views_file;
+  int num_frames = 0;
+  std::vector<Stage> stages;
+
+  for (int i = 0; i < int(lines.size()); i += 1) {
+    std::string line = trim(lines[i]);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    std::string::size_type space = line.find_first_of(" \t");
+    std::string key = line.substr(0, space);
+    std::string value = (space == std::string::npos) ? std::string() :
+        trim(line.substr(space));
+    bool ok = true;
+
+    if (key == "stage") {
+      stages.push_back(Stage());
+      stages.back().name = value;
+    } else if (key == "views") {
+      views_file = value;
+    } else if (key == "frames") {
+      ok = parseInt(value, num_frames);
+    } else if (stages.empty()) {
+      ok = false;
+    } else if (key == "for") {
+      stages.back().items = value;
+    } else if (key == "input") {
+      stages.back().inputs.push_back(value);
+    } else if (key == "output") {
+      stages.back().outputs.push_back(value);
+    } else if (key == "command") {
+      stages.back().command = value;
+    } else if (key == "cpus") {
+      ok = parseInt(value, stages.back().cpus);
+    } else if (key == "memory") {
+      ok = parseInt(value, stages.back().memory_mb);
+    } else {
+      ok = false;
+    }
+
+    if (!ok || value.empty()) {
+      LOG(WARNING) << filename << ":" << i + 1 << ": invalid line \"" <<
+          line << "\"";
+      return false;
+    }
+  }
+
+  std::vector<std::string> views;
+  if (!views_file.empty() && !readLines(views_file, views)) {
+    LOG(WARNING) << "Could not load view names \"" << views_file << "\"";
+    return false;
+  }
+
+  Variables globals;
+  globals["views"] = views_file;
+  globals["frames"] = boost::str(boost::format("%d") % num_frames);
+
+  tasks.clear();
+  std::vector<Stage>::const_iterator stage;
+  for (stage = stages.begin(); stage != stages.end(); ++stage) {
+    if (stage->command.empty()) {
+      LOG(WARNING) << "Stage \"" << stage->name << "\" has no command";
+      return false;
+    }
+    if (!expandStage(*stage, globals, views, num_frames, tasks)) {
+      LOG(WARNING) << "Could not expand stage \"" << stage->name << "\"";
+      return false;
+    }
+  }
+
+  return findDependencies(tasks);
+}
+
+bool runPipeline(const std::vector<PipelineTask>& tasks,
+                 const PipelineOptions& options) {
+  PipelineRunner runner(tasks, options);
+  return runner.run();
+}
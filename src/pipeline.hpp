@@ -0,0 +1,87 @@
+#ifndef PIPELINE_HPP_
+#define PIPELINE_HPP_
+
+#include <string>
+#include <vector>
+
+// A pipeline of stages, each of which runs one command per view, frame,
+// image or pair of images. Tasks depend on the tasks which write their
+// inputs, and are skipped if their outputs are newer than their inputs, so
+// that a pipeline can be run again after a failure to finish it.
+//
+// Pipelines are declared in a text file, e.g.
+//
+//   views views.txt
+//   frames 300
+//
+//   stage descriptors
+//   for images
+//   input images/{view}/{time:07}.png
+//   output descriptors/{view}/{time:07}.yaml
+//   command ./extract-sift {input} {output}
+//   memory 200
+//
+//   stage matches
+//   for pairs
+//   input descriptors/{view1}/{time1:07}.yaml
+//   input descriptors/{view2}/{time2:07}.yaml
+//   output matches/{view1}-{view2}-{time1}-{time2}.yaml
+//   command ./match-features {input1} {input2} {output}
+//
+// Stages are "for" once, views, frames, images (every view and frame),
+// pairs (the same pairs as scripts/match-features-exhaustive.sh),
+// simultaneous (pairs of views at each frame) or adjacent (consecutive
+// frames of each view). Frames are numbered from one, and {time:07} pads
+// with zeros to seven digits. Commands may also refer to {input},
+// {output} (all of them), {inputN}, {outputN}, {views} and {frames}.
+// Each task of a stage takes "cpus" (default 1) and "memory" in MB
+// (default 0) of the budget.
+
+struct PipelineTask {
+  std::string stage;
+  // The item of the stage, e.g. "view01 3".
+  std::string item;
+  std::string command;
+  std::vector<std::string> inputs;
+  std::vector<std::string> outputs;
+  int cpus;
+  int memory_mb;
+  // Tasks which write inputs of this one.
+  std::vector<int> dependencies;
+
+  PipelineTask();
+};
+
+struct PipelineOptions {
+  // Budget of the tasks which run at once. A task which exceeds the whole
+  // budget runs alone.
+  int cpus;
+  int memory_mb;
+  // Keep running tasks which do not depend on a failed task.
+  bool keep_going;
+  // Print the commands which would run instead.
+  bool dry_run;
+  // Skip tasks whose command and input contents are the same as when they
+  // last ran, rather than those whose outputs are newer than their inputs.
+  // Each output has a manifest next to it, e.g. matches.yaml.manifest,
+  // with the hash of the command and inputs which made it. A task which
+  // rewrites its outputs unchanged then does not cause its dependents to
+  // run again.
+  bool skip_if_unchanged;
+
+  PipelineOptions();
+};
+
+// Reads a pipeline file and expands its stages into tasks.
+// Returns false if the file is malformed, or if two tasks write the same
+// output.
+bool loadPipeline(const std::string& filename,
+                  std::vector<PipelineTask>& tasks);
+
+// Runs every task which is not up to date once its dependencies are done.
+// Returns false if any task failed or could not run. The outputs of failed
+// tasks are removed, so that they are not mistaken for finished ones.
+bool runPipeline(const std::vector<PipelineTask>& tasks,
+                 const PipelineOptions& options);
+
+#endif
@@ -0,0 +1,260 @@
+#include "pipeline.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "gtest/gtest.h"
+
+namespace {
+
+// Pipeline and views files in a fresh temporary directory, removed with the
+// fixture.
+class PipelineTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      char directory[] = "/tmp/pipeline-XXXXXX";
+      ASSERT_TRUE(mkdtemp(directory) != NULL);
+      directory_ = directory;
+      pipeline_file_ = directory_ + "/pipeline.txt";
+
+      std::ofstream views((directory_ + "/views.txt").c_str());
+      views << "a" << std::endl << "b" << std::endl;
+    }
+
+    virtual void TearDown() {
+      std::string command = "rm -rf " + directory_;
+      ASSERT_EQ(0, std::system(command.c_str()));
+    }
+
+    // Writes the header and the given stages, and loads them.
+    bool load(const std::string& stages, std::vector<PipelineTask>& tasks) {
+      std::ofstream file(pipeline_file_.c_str());
+      file << "views " << directory_ << "/views.txt" << std::endl;
+      file << "frames 2" << std::endl;
+      file << std::endl;
+      file << stages;
+      file.close();
+      return loadPipeline(pipeline_file_, tasks);
+    }
+
+    bool exists(const std::string& file) const {
+      return access((directory_ + "/" + file).c_str(), F_OK) == 0;
+    }
+
+    std::string directory_;
+    std::string pipeline_file_;
+};
+
+int countStage(const std::vector<PipelineTask>& tasks,
+               const std::string& stage) {
+  int n = 0;
+  for (int i = 0; i < int(tasks.size()); i += 1) {
+    n += (tasks[i].stage == stage) ? 1 : 0;
+  }
+  return n;
+}
+
+}
+
+TEST_F(PipelineTest, ExpandsStagesIntoTasks) {
+  std::vector<PipelineTask> tasks;
+  ASSERT_TRUE(load(
+        "stage once\n"
+        "command echo {views} {frames}\n"
+        "stage views\n"
+        "for views\n"
+        "command echo {view}\n"
+        "stage frames\n"
+        "for frames\n"
+        "command echo {time}\n"
+        "stage images\n"
+        "for images\n"
+        "output {view}/{time:03}.txt\n"
+        "command echo {view} {time} > {output}\n"
+        "cpus 2\n"
+        "memory 100\n"
+        "stage pairs\n"
+        "for pairs\n"
+        "command echo {view1} {time1} {view2} {time2}\n"
+        "stage simultaneous\n"
+        "for simultaneous\n"
+        "command echo\n"
+        "stage adjacent\n"
+        "for adjacent\n"
+        "command echo\n",
+        tasks));
+
+  EXPECT_EQ(1, countStage(tasks, "once"));
+  EXPECT_EQ(2, countStage(tasks, "views"));
+  EXPECT_EQ(2, countStage(tasks, "frames"));
+  EXPECT_EQ(4, countStage(tasks, "images"));
+  // Every pair of the 4 images.
+  EXPECT_EQ(6, countStage(tasks, "pairs"));
+  // Views a and b at each of 2 frames.
+  EXPECT_EQ(2, countStage(tasks, "simultaneous"));
+  // Frames 1 and 2 of each of 2 views.
+  EXPECT_EQ(2, countStage(tasks, "adjacent"));
+
+  const PipelineTask& once = tasks[0];
+  EXPECT_EQ(directory_ + "/views.txt 2", once.command.substr(5));
+
+  // Frames are numbered from one and padded.
+  const PipelineTask& image = tasks[5];
+  EXPECT_EQ("images", image.stage);
+  EXPECT_EQ("a 1", image.item);
+  ASSERT_EQ(1u, image.outputs.size());
+  EXPECT_EQ("a/001.txt", image.outputs[0]);
+  EXPECT_EQ("echo a 1 > a/001.txt", image.command);
+  EXPECT_EQ(2, image.cpus);
+  EXPECT_EQ(100, image.memory_mb);
+
+  const PipelineTask& pair = tasks[9];
+  EXPECT_EQ("pairs", pair.stage);
+  EXPECT_EQ("a 1 a 2", pair.item);
+  EXPECT_EQ(1, pair.cpus);
+  EXPECT_EQ(0, pair.memory_mb);
+}
+
+TEST_F(PipelineTest, LinksTasksToWritersOfTheirInputs) {
+  std::vector<PipelineTask> tasks;
+  ASSERT_TRUE(load(
+        "stage images\n"
+        "for images\n"
+        "output {view}-{time}.txt\n"
+        "command touch {output}\n"
+        "stage pairs\n"
+        "for simultaneous\n"
+        "input {view1}-{time1}.txt\n"
+        "input {view2}-{time2}.txt\n"
+        "input external.txt\n"
+        "output {view1}-{view2}-{time1}.txt\n"
+        "command cat {input1} {input2} > {output1}\n",
+        tasks));
+
+  ASSERT_EQ(6u, tasks.size());
+  // Images are ordered by view, then frame: a-1, a-2, b-1, b-2.
+  const PipelineTask& pair = tasks[4];
+  EXPECT_EQ("a-b-1.txt", pair.outputs[0]);
+  EXPECT_EQ("cat a-1.txt b-1.txt > a-b-1.txt", pair.command);
+  ASSERT_EQ(2u, pair.dependencies.size());
+  EXPECT_EQ(0, pair.dependencies[0]);
+  EXPECT_EQ(2, pair.dependencies[1]);
+  EXPECT_TRUE(tasks[0].dependencies.empty());
+}
+
+TEST_F(PipelineTest, LeavesShellBracesAlone) {
+  std::vector<PipelineTask> tasks;
+  ASSERT_TRUE(load(
+        "stage shell\n"
+        "output out.txt\n"
+        "command echo ${HOME} {a,b} > {output}\n",
+        tasks));
+  ASSERT_EQ(1u, tasks.size());
+  EXPECT_EQ("echo ${HOME} {a,b} > out.txt", tasks[0].command);
+}
+
+TEST_F(PipelineTest, RejectsInvalidPipelines) {
+  std::vector<PipelineTask> tasks;
+  // Two tasks write the same file.
+  EXPECT_FALSE(load("stage x\nfor views\noutput same.txt\ncommand true\n",
+        tasks));
+  // A task reads its own output.
+  EXPECT_FALSE(load("stage x\ninput a.txt\noutput a.txt\ncommand true\n",
+        tasks));
+  EXPECT_FALSE(load("stage x\ncommand echo {undefined}\n", tasks));
+  EXPECT_FALSE(load("stage x\nfor everything\ncommand true\n", tasks));
+  EXPECT_FALSE(load("stage x\nfor views\noutput {view:x}\ncommand true\n",
+        tasks));
+  EXPECT_FALSE(load("stage x\nfor views\n", tasks));
+  EXPECT_FALSE(load("command true\n", tasks));
+  EXPECT_FALSE(load("stage x\ncommand true\ncpus many\n", tasks));
+  EXPECT_FALSE(load("stage x\ncommand true\nunknown key\n", tasks));
+  EXPECT_FALSE(loadPipeline(directory_ + "/missing.txt", tasks));
+}
+
+TEST_F(PipelineTest, RunsTasksOnceDependenciesAreDone) {
+  std::string d = directory_;
+  std::vector<PipelineTask> tasks;
+  ASSERT_TRUE(load(
+        "stage images\n"
+        "for images\n"
+        "output " + d + "/images/{view}-{time}.txt\n"
+        "command echo {view} {time} > {output}\n"
+        "stage pairs\n"
+        "for pairs\n"
+        "input " + d + "/images/{view1}-{time1}.txt\n"
+        "input " + d + "/images/{view2}-{time2}.txt\n"
+        "output " + d + "/pairs/{view1}{time1}-{view2}{time2}.txt\n"
+        "command cat {input} > {output}\n",
+        tasks));
+
+  PipelineOptions options;
+  options.cpus = 3;
+  ASSERT_TRUE(runPipeline(tasks, options));
+  EXPECT_TRUE(exists("images/b-2.txt"));
+  EXPECT_TRUE(exists("pairs/a1-b2.txt"));
+
+  std::ifstream pair((d + "/pairs/a1-b2.txt").c_str());
+  std::string line1;
+  std::string line2;
+  std::getline(pair, line1);
+  std::getline(pair, line2);
+  EXPECT_EQ("a 1", line1);
+  EXPECT_EQ("b 2", line2);
+
+  // A second run remakes the missing output.
+  std::remove((d + "/pairs/a1-b2.txt").c_str());
+  ASSERT_TRUE(runPipeline(tasks, options));
+  EXPECT_TRUE(exists("pairs/a1-b2.txt"));
+}
+
+TEST_F(PipelineTest, BlocksDependentsOfFailedTasks) {
+  std::string d = directory_;
+  std::vector<PipelineTask> tasks;
+  ASSERT_TRUE(load(
+        "stage first\n"
+        "for views\n"
+        "output " + d + "/{view}.txt\n"
+        "command echo partial > {output}; test {view} = a\n"
+        "stage second\n"
+        "for views\n"
+        "input " + d + "/{view}.txt\n"
+        "output " + d + "/{view}-second.txt\n"
+        "command cp {input} {output}\n",
+        tasks));
+
+  PipelineOptions options;
+  options.cpus = 2;
+  options.keep_going = true;
+  EXPECT_FALSE(runPipeline(tasks, options));
+  EXPECT_TRUE(exists("a-second.txt"));
+  // The outputs of the failed task are removed.
+  EXPECT_FALSE(exists("b.txt"));
+  EXPECT_FALSE(exists("b-second.txt"));
+}
+
+TEST_F(PipelineTest, DryRunWritesNoManifests) {
+  std::string d = directory_;
+  std::vector<PipelineTask> tasks;
+  ASSERT_TRUE(load(
+        "stage copy\n"
+        "input " + d + "/views.txt\n"
+        "output " + d + "/copy.txt\n"
+        "command cp {input} {output}\n",
+        tasks));
+
+  PipelineOptions options;
+  ASSERT_TRUE(runPipeline(tasks, options));
+  ASSERT_TRUE(exists("copy.txt"));
+
+  // The output is newer than its input but has no manifest yet.
+  options.skip_if_unchanged = true;
+  options.dry_run = true;
+  ASSERT_TRUE(runPipeline(tasks, options));
+  EXPECT_FALSE(exists("copy.txt.manifest"));
+
+  options.dry_run = false;
+  ASSERT_TRUE(runPipeline(tasks, options));
+  EXPECT_TRUE(exists("copy.txt.manifest"));
+}
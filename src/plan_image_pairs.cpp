@@ -0,0 +1,142 @@
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cstdlib>
+#include <boost/lexical_cast.hpp>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "camera.hpp"
+#include "image_pairs.hpp"
+#include "vocabulary_tree.hpp"
+#include "util/thread-pool.hpp"
+
+#include "read_lines.hpp"
+#include "iterator_reader.hpp"
+#include "camera_reader.hpp"
+#include "vocabulary_tree_reader.hpp"
+
+DEFINE_string(pairs, "",
+    "Pairs to choose from, as written by this program, rather than all pairs");
+
+DEFINE_int32(max_time_offset, -1,
+    "Largest difference in frames within a view, negative for no limit");
+DEFINE_int32(max_time_offset_between_views, -1,
+    "Largest difference in frames between views, negative for no limit");
+
+DEFINE_string(rig, "",
+    "Cameras of every view, from cameras-to-rig, or of every image in "
+    "view-major order. If given, pairs whose frustums do not overlap are "
+    "removed");
+DEFINE_double(min_overlap, 0.05,
+    "Smallest fraction of either frustum which the other camera must see");
+DEFINE_double(near, 1, "Nearest distance of the scene from a camera");
+DEFINE_double(far, 100, "Farthest distance of the scene from a camera");
+DEFINE_int32(overlap_grid, 8,
+    "Frustums are sampled at this many pixels across and down and this many "
+    "distances");
+
+DEFINE_string(vocabulary_tree, "",
+    "Only keep pairs in which one image is among the most similar to the "
+    "other according to this tree, as saved by cluster-descriptors");
+DEFINE_string(descriptors_format, "",
+    "Descriptors to score with the vocabulary tree. Takes view name and frame");
+DEFINE_int32(max_num_similar, 10,
+    "Number of similar images to keep for each image");
+
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads to score images with, 0 to score serially");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Lists the pairs of images worth matching, from their times, "
+      "cameras and appearance." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " view-names num-frames pairs" << std::endl;
+  usage << std::endl;
+  usage << "view-names -- Input. One view name per line." << std::endl;
+  usage << "pairs -- Output. One pair per line, \"view1 time1 view2 time2\"."
+      << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 4) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string view_names_file = argv[1];
+  int num_frames = boost::lexical_cast<int>(argv[2]);
+  std::string pairs_file = argv[3];
+
+  bool ok;
+
+  std::vector<std::string> views;
+  ok = readLines(view_names_file, views);
+  CHECK(ok) << "Could not load view names";
+  int num_views = views.size();
+
+  std::vector<ImagePair> pairs;
+  if (FLAGS_pairs.empty()) {
+    appendExhaustiveImagePairs(num_views, num_frames, pairs);
+  } else {
+    ok = loadImagePairList(FLAGS_pairs, views, num_frames, pairs);
+    CHECK(ok) << "Could not load pairs \"" << FLAGS_pairs << "\"";
+  }
+  int num_candidates = pairs.size();
+
+  PairPlannerOptions options;
+  options.max_time_offset = FLAGS_max_time_offset;
+  options.max_time_offset_between_views = FLAGS_max_time_offset_between_views;
+
+  std::vector<Camera> cameras;
+  if (!FLAGS_rig.empty()) {
+    CameraReader camera_reader;
+    ok = loadList(FLAGS_rig, cameras, camera_reader);
+    CHECK(ok) << "Could not load cameras";
+    CHECK(int(cameras.size()) == num_views ||
+        int(cameras.size()) == num_views * num_frames) <<
+        "Number of cameras does not match number of views or images";
+
+    options.min_overlap = FLAGS_min_overlap;
+    options.near = FLAGS_near;
+    options.far = FLAGS_far;
+    options.grid = FLAGS_overlap_grid;
+  }
+
+  planImagePairs(cameras, num_views, num_frames, options, pairs);
+  LOG(INFO) << "Kept " << pairs.size() << " of " << num_candidates <<
+      " pairs by time and cameras";
+
+  if (!FLAGS_vocabulary_tree.empty()) {
+    CHECK(!FLAGS_descriptors_format.empty()) <<
+        "Need descriptors to score with the vocabulary tree";
+
+    VocabularyTree tree;
+    VocabularyTreeReader tree_reader;
+    ok = load(FLAGS_vocabulary_tree, tree, tree_reader);
+    CHECK(ok) << "Could not load vocabulary tree";
+
+    std::vector<std::vector<int> > similar;
+    ThreadPool pool(FLAGS_num_threads);
+    ok = findSimilarImages(tree, FLAGS_descriptors_format, views, num_frames,
+        FLAGS_max_num_similar, pool, similar);
+    CHECK(ok) << "Could not score images";
+
+    int num_planned = pairs.size();
+    keepSimilarImagePairs(similar, num_frames, pairs);
+    LOG(INFO) << "Kept " << pairs.size() << " of " << num_planned <<
+        " pairs by appearance";
+  }
+
+  ok = saveImagePairList(pairs_file, views, pairs);
+  CHECK(ok) << "Could not save pairs \"" << pairs_file << "\"";
+
+  return 0;
+}
@@ -0,0 +1,194 @@
+#include "plane_cache.hpp"
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+#include <boost/format.hpp>
+#include <glog/logging.h>
+#include "binary_file.hpp"
+#include "util/hash.hpp"
+
+namespace {
+
+// Describes one plane in the descriptor block of the file.
+struct PlaneRecord {
+  int32_t rows;
+  int32_t cols;
+  int32_t type;
+  int32_t padding;
+  // Bytes from the start of the block.
+  uint64_t offset;
+};
+
+const int ALIGNMENT = BinaryFileHeader::ALIGNMENT;
+
+uint64_t alignOffset(uint64_t offset) {
+  return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+size_t rowBytes(const cv::Mat& plane) {
+  return plane.cols * plane.elemSize();
+}
+
+}
+
+std::string planeCacheKey(const cv::Mat& image, const std::string& parameters) {
+  Hash hash;
+  hash.add(int32_t(image.rows));
+  hash.add(int32_t(image.cols));
+  hash.add(int32_t(image.type()));
+  for (int i = 0; i < image.rows; i += 1) {
+    hash.add(image.ptr(i), rowBytes(image));
+  }
+  hash.add(parameters.data(), parameters.size());
+
+  return boost::str(boost::format("%016x") % hash.value());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+MappedPlanes::MappedPlanes() : data_(), planes_() {}
+
+const std::vector<cv::Mat>& MappedPlanes::planes() const {
+  return planes_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+PlaneCache::PlaneCache(const std::string& directory)
+    : directory_(directory) {}
+
+bool PlaneCache::enabled() const {
+  return !directory_.empty();
+}
+
+std::string PlaneCache::filename(const std::string& key) const {
+  return directory_ + "/" + key + BINARY_EXTENSION;
+}
+
+bool PlaneCache::map(const std::string& key, MappedPlanes& planes) const {
+  planes.data_.reset();
+  planes.planes_.clear();
+
+  if (!enabled()) {
+    return false;
+  }
+
+  // A missing entry is not worth a warning.
+  std::string file = filename(key);
+  if (access(file.c_str(), R_OK) != 0) {
+    return false;
+  }
+
+  BinaryFile binary;
+  if (!binary.open(file)) {
+    return false;
+  }
+  const BinaryFileHeader& header = binary.header();
+  if (header.record_type != BINARY_IMAGE_PLANES ||
+      header.record_size != sizeof(PlaneRecord)) {
+    LOG(WARNING) << "`" << file << "' does not contain image planes";
+    return false;
+  }
+
+  int num_planes = binary.numRecords();
+  if (num_planes == 0) {
+    return true;
+  }
+  if (!binary.hasDescriptors() || header.descriptor_type != CV_8U) {
+    LOG(WARNING) << "`" << file << "' has no plane data";
+    return false;
+  }
+
+  const PlaneRecord* records =
+      binary.records<PlaneRecord>(BINARY_IMAGE_PLANES);
+  uint64_t size = header.num_descriptors * header.descriptor_cols;
+  boost::shared_ptr<void> data = binary.descriptorData();
+
+  std::vector<cv::Mat> mapped;
+  for (int i = 0; i < num_planes; i += 1) {
+    const PlaneRecord& record = records[i];
+    uint64_t plane_size = uint64_t(record.rows) * record.cols *
+        CV_ELEM_SIZE(record.type);
+    if (record.rows < 0 || record.cols < 0 ||
+        record.offset + plane_size > size) {
+      LOG(WARNING) << "Plane " << i << " of `" << file << "' is truncated";
+      return false;
+    }
+    mapped.push_back(cv::Mat(record.rows, record.cols, record.type,
+        static_cast<char*>(data.get()) + record.offset));
+  }
+
+  planes.data_ = data;
+  planes.planes_.swap(mapped);
+  return true;
+}
+
+bool PlaneCache::load(const std::string& key,
+                      std::vector<cv::Mat>& planes) const {
+  MappedPlanes mapped;
+  if (!map(key, mapped)) {
+    return false;
+  }
+
+  planes.clear();
+  std::vector<cv::Mat>::const_iterator plane;
+  for (plane = mapped.planes().begin(); plane != mapped.planes().end();
+       ++plane) {
+    planes.push_back(plane->clone());
+  }
+  return true;
+}
+
+bool PlaneCache::store(const std::string& key,
+                       const std::vector<cv::Mat>& planes) const {
+  if (!enabled()) {
+    return false;
+  }
+
+  // Each plane starts on an aligned offset of the block.
+  std::vector<PlaneRecord> records;
+  uint64_t size = 0;
+  std::vector<cv::Mat>::const_iterator plane;
+  for (plane = planes.begin(); plane != planes.end(); ++plane) {
+    PlaneRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.rows = plane->rows;
+    record.cols = plane->cols;
+    record.type = plane->type();
+    record.offset = size;
+    records.push_back(record);
+
+    size = alignOffset(size + plane->rows * rowBytes(*plane));
+  }
+
+  // The block is rows of ALIGNMENT bytes.
+  cv::Mat block = cv::Mat::zeros(size / ALIGNMENT, ALIGNMENT, CV_8U);
+  for (size_t i = 0; i < planes.size(); i += 1) {
+    const cv::Mat& plane = planes[i];
+    char* dst = reinterpret_cast<char*>(block.data) + records[i].offset;
+    for (int r = 0; r < plane.rows; r += 1) {
+      std::memcpy(dst + r * rowBytes(plane), plane.ptr(r), rowBytes(plane));
+    }
+  }
+
+  std::string file = filename(key);
+  std::string temporary = boost::str(boost::format("%s.%d.tmp") % file %
+      getpid());
+  bool ok = writeBinaryFile(temporary, BINARY_IMAGE_PLANES,
+      sizeof(PlaneRecord), records.size(),
+      records.empty() ? NULL : &records.front(), block);
+  if (!ok) {
+    std::remove(temporary.c_str());
+    return false;
+  }
+
+  if (std::rename(temporary.c_str(), file.c_str()) != 0) {
+    LOG(WARNING) << "Could not rename `" << temporary << "' to `" << file <<
+        "'";
+    std::remove(temporary.c_str());
+    return false;
+  }
+
+  return true;
+}
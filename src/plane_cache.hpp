@@ -0,0 +1,65 @@
+#ifndef PLANE_CACHE_HPP_
+#define PLANE_CACHE_HPP_
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <opencv2/core/core.hpp>
+
+// Identifies the planes derived from an image by a hash of its pixels and a
+// description of the computation, for example "sift-pyramid 3 1.6". The
+// description must change whenever the result would.
+std::string planeCacheKey(const cv::Mat& image, const std::string& parameters);
+
+// Planes which are mapped from a cache file without copying.
+// The matrices point into the mapping, which is released with this object.
+class MappedPlanes {
+  public:
+    MappedPlanes();
+
+    const std::vector<cv::Mat>& planes() const;
+
+  private:
+    boost::shared_ptr<void> data_;
+    std::vector<cv::Mat> planes_;
+
+    friend class PlaneCache;
+};
+
+// Stores images derived from a frame, such as gradients or pyramids, on disk
+// so that repeated runs over the same frames do not compute them again.
+//
+// Each entry is a binary file (see binary_file.hpp) in the directory, named by
+// its key. Entries are written to a temporary file and renamed, so several
+// processes may share a directory. Nothing is ever removed.
+//
+// Usage:
+// PlaneCache cache(DIRECTORY);
+// std::string key = planeCacheKey(image, PARAMETERS);
+// if (!cache.load(key, planes)) {
+//   COMPUTE(image, planes);
+//   cache.store(key, planes);
+// }
+class PlaneCache {
+  public:
+    // An empty directory disables the cache.
+    explicit PlaneCache(const std::string& directory);
+
+    bool enabled() const;
+
+    // Returns false if the entry does not exist or is malformed.
+    bool map(const std::string& key, MappedPlanes& planes) const;
+    // Copies the planes out of the file.
+    bool load(const std::string& key, std::vector<cv::Mat>& planes) const;
+
+    // Returns false if the entry could not be written.
+    bool store(const std::string& key,
+               const std::vector<cv::Mat>& planes) const;
+
+  private:
+    std::string filename(const std::string& key) const;
+
+    std::string directory_;
+};
+
+#endif
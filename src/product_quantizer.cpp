@@ -0,0 +1,282 @@
+#include "product_quantizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <glog/logging.h>
+#include "kmeans.hpp"
+
+namespace {
+
+// One subspace of a descriptor for k-means.
+class SubvectorPoint : public KMeansPoint {
+  public:
+    SubvectorPoint(const float* begin, const float* end) : data_(begin, end) {}
+
+    const std::vector<double>& vector() const {
+      return data_;
+    }
+
+  private:
+    std::vector<double> data_;
+};
+
+typedef std::pair<float, int> Candidate;
+
+}
+
+ProductQuantizer::ProductQuantizer() : centers_(), num_subspaces_(0) {}
+
+void ProductQuantizer::train(const DescriptorMatrix& points,
+                             int num_subspaces,
+                             int num_centers,
+                             boost::random::mt19937& generator) {
+  CHECK(points.type() == cv::DataType<float>::type);
+  CHECK(num_subspaces > 0);
+  CHECK(points.cols() % num_subspaces == 0) <<
+      "Dimension is not divisible by number of subspaces";
+  CHECK(num_centers > 0 && num_centers <= MAX_NUM_CENTERS);
+  CHECK(points.rows() >= num_centers) << "Not enough training descriptors";
+
+  int num_dimensions = points.cols() / num_subspaces;
+  centers_.create(num_subspaces * num_centers, num_dimensions,
+      cv::DataType<float>::type);
+  num_subspaces_ = num_subspaces;
+
+  for (int s = 0; s < num_subspaces; s += 1) {
+    int offset = s * num_dimensions;
+
+    std::vector<SubvectorPoint> subvectors;
+    subvectors.reserve(points.rows());
+    for (int i = 0; i < points.rows(); i += 1) {
+      const float* row = points.row<float>(i) + offset;
+      subvectors.push_back(SubvectorPoint(row, row + num_dimensions));
+    }
+
+    std::vector<const KMeansPoint*> subspace;
+    subspace.reserve(subvectors.size());
+    for (int i = 0; i < int(subvectors.size()); i += 1) {
+      subspace.push_back(&subvectors[i]);
+    }
+
+    std::deque<std::vector<double> > centers;
+    std::vector<int> labels;
+    randomKMeans(subspace, num_centers, centers, labels, generator);
+    LOG(INFO) << "Quantized subspace " << s << " to " << centers.size() <<
+        " centers";
+
+    // Empty clusters are removed by k-means. Fill their codes with repeats of
+    // the first center, which are never nearest since ties take the first.
+    for (int k = 0; k < num_centers; k += 1) {
+      const std::vector<double>& center =
+          centers[k < int(centers.size()) ? k : 0];
+      float* dst = centers_.ptr<float>(s * num_centers + k);
+      std::copy(center.begin(), center.end(), dst);
+    }
+  }
+}
+
+bool ProductQuantizer::empty() const {
+  return num_subspaces_ == 0;
+}
+
+int ProductQuantizer::dimension() const {
+  return num_subspaces_ * centers_.cols;
+}
+
+int ProductQuantizer::numSubspaces() const {
+  return num_subspaces_;
+}
+
+int ProductQuantizer::numCenters() const {
+  return empty() ? 0 : centers_.rows / num_subspaces_;
+}
+
+void ProductQuantizer::encode(const DescriptorMatrix& points,
+                              DescriptorMatrix& codes) const {
+  CHECK(!empty()) << "Quantizer has not been trained";
+  CHECK(points.type() == cv::DataType<float>::type);
+  CHECK(points.cols() == dimension()) << "Descriptors differ in size";
+
+  codes.create(points.rows(), num_subspaces_, cv::DataType<uchar>::type);
+  cv::Mat table;
+
+  for (int i = 0; i < points.rows(); i += 1) {
+    distanceTable(points.row<float>(i), table);
+    uchar* code = codes.row<uchar>(i);
+
+    for (int s = 0; s < num_subspaces_; s += 1) {
+      const float* row = table.ptr<float>(s);
+      code[s] = std::min_element(row, row + table.cols) - row;
+    }
+  }
+}
+
+void ProductQuantizer::distanceTable(const float* query,
+                                     cv::Mat& table) const {
+  int num_centers = numCenters();
+  int num_dimensions = centers_.cols;
+  table.create(num_subspaces_, num_centers, cv::DataType<float>::type);
+
+  for (int s = 0; s < num_subspaces_; s += 1) {
+    const float* x = query + s * num_dimensions;
+    float* distances = table.ptr<float>(s);
+
+    for (int k = 0; k < num_centers; k += 1) {
+      const float* center = centers_.ptr<float>(s * num_centers + k);
+      float distance = 0;
+      for (int d = 0; d < num_dimensions; d += 1) {
+        float delta = x[d] - center[d];
+        distance += delta * delta;
+      }
+      distances[k] = distance;
+    }
+  }
+}
+
+const cv::Mat& ProductQuantizer::centers() const {
+  return centers_;
+}
+
+bool ProductQuantizer::setCenters(const cv::Mat& centers, int num_subspaces) {
+  if (num_subspaces <= 0 || centers.rows % num_subspaces != 0) {
+    return false;
+  }
+  if (centers.rows / num_subspaces > MAX_NUM_CENTERS) {
+    return false;
+  }
+
+  centers.convertTo(centers_, cv::DataType<float>::type);
+  num_subspaces_ = num_subspaces;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+ProductCodeIndex::ProductCodeIndex(const ProductQuantizer& quantizer,
+                                   const DescriptorMatrix& codes)
+    : quantizer_(&quantizer), codes_(&codes) {
+  CHECK(codes.empty() || codes.type() == cv::DataType<uchar>::type);
+  CHECK(codes.empty() || codes.cols() == quantizer.numSubspaces()) <<
+      "Codes do not match quantizer";
+}
+
+int ProductCodeIndex::size() const {
+  return codes_->rows();
+}
+
+void ProductCodeIndex::distances(const cv::Mat& table,
+                                 std::vector<float>& distances) const {
+  int n = size();
+  int num_subspaces = table.rows;
+  distances.resize(n);
+
+  for (int j = 0; j < n; j += 1) {
+    const uchar* code = codes_->row<uchar>(j);
+    float distance = 0;
+    for (int s = 0; s < num_subspaces; s += 1) {
+      distance += table.ptr<float>(s)[code[s]];
+    }
+    distances[j] = distance;
+  }
+}
+
+void ProductCodeIndex::knnMatch(const DescriptorMatrix& query,
+                                MatchSink& matches,
+                                int k) const {
+  CHECK(query.type() == cv::DataType<float>::type);
+  CHECK(query.cols() == quantizer_->dimension()) <<
+      "Descriptors differ in size";
+  k = std::max(std::min(k, size()), 0);
+
+  // Re-used by every query.
+  cv::Mat table;
+  std::vector<float> squared;
+  std::vector<Candidate> candidates;
+
+  matches.begin(query.rows());
+  for (int i = 0; i < query.rows(); i += 1) {
+    quantizer_->distanceTable(query.row<float>(i), table);
+    distances(table, squared);
+
+    candidates.clear();
+    for (int j = 0; j < int(squared.size()); j += 1) {
+      candidates.push_back(Candidate(squared[j], j));
+    }
+    std::partial_sort(candidates.begin(), candidates.begin() + k,
+        candidates.end());
+
+    for (int j = 0; j < k; j += 1) {
+      matches.add(i, candidates[j].second, std::sqrt(candidates[j].first));
+    }
+  }
+  matches.end();
+}
+
+void ProductCodeIndex::radiusMatch(const DescriptorMatrix& query,
+                                   MatchSink& matches,
+                                   double radius) const {
+  CHECK(query.type() == cv::DataType<float>::type);
+  CHECK(query.cols() == quantizer_->dimension()) <<
+      "Descriptors differ in size";
+  float max_squared = radius * radius;
+
+  cv::Mat table;
+  std::vector<float> squared;
+  std::vector<Candidate> candidates;
+
+  matches.begin(query.rows());
+  for (int i = 0; i < query.rows(); i += 1) {
+    quantizer_->distanceTable(query.row<float>(i), table);
+    distances(table, squared);
+
+    candidates.clear();
+    for (int j = 0; j < int(squared.size()); j += 1) {
+      if (squared[j] <= max_squared) {
+        candidates.push_back(Candidate(squared[j], j));
+      }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    for (int j = 0; j < int(candidates.size()); j += 1) {
+      matches.add(i, candidates[j].second, std::sqrt(candidates[j].first));
+    }
+  }
+  matches.end();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void findMatchesUsingProductCodes(const DescriptorMatrix& points1,
+                                  const ProductCodeIndex& index2,
+                                  QueryResultTable& matches,
+                                  bool use_max_num,
+                                  int max_num,
+                                  bool use_threshold,
+                                  double threshold) {
+  QueryResultSink sink(matches, use_max_num, max_num, use_threshold,
+      threshold);
+
+  if (use_max_num) {
+    index2.knnMatch(points1, sink, max_num);
+  } else {
+    CHECK(use_threshold) << "No limit on number of matches";
+    index2.radiusMatch(points1, sink, threshold);
+  }
+}
+
+void findMatchesUsingProductCodes(const DescriptorMatrix& points1,
+                                  const ProductCodeIndex& index2,
+                                  std::deque<QueryResultList>& matches,
+                                  bool use_max_num,
+                                  int max_num,
+                                  bool use_threshold,
+                                  double threshold) {
+  QueryResultTable table;
+  findMatchesUsingProductCodes(points1, index2, table, use_max_num, max_num,
+      use_threshold, threshold);
+  convertQueryResultTableToLists(table, matches);
+}
+
+std::string makeProductCodesFilename(const std::string& descriptors_file) {
+  return descriptors_file + ".codes";
+}
@@ -0,0 +1,99 @@
+#ifndef PRODUCT_QUANTIZER_HPP_
+#define PRODUCT_QUANTIZER_HPP_
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <boost/random/mersenne_twister.hpp>
+#include <opencv2/core/core.hpp>
+#include "descriptor_matrix.hpp"
+#include "match_sink.hpp"
+#include "find_matches.hpp"
+
+// Compresses descriptors to one byte per subspace.
+//
+// The dimensions are divided into contiguous subspaces of equal size, and
+// each subspace is quantized to the nearest of (at most 256) centers. A
+// 128-dimensional descriptor split into 16 subspaces becomes 16 bytes.
+class ProductQuantizer {
+  public:
+    static const int MAX_NUM_CENTERS = 256;
+
+    ProductQuantizer();
+
+    // Runs k-means on each subspace of the training descriptors.
+    void train(const DescriptorMatrix& points,
+               int num_subspaces,
+               int num_centers,
+               boost::random::mt19937& generator);
+
+    bool empty() const;
+    int dimension() const;
+    int numSubspaces() const;
+    int numCenters() const;
+
+    // Codes are a CV_8U matrix with one row per descriptor.
+    void encode(const DescriptorMatrix& points, DescriptorMatrix& codes) const;
+
+    // Computes the squared distance from each subspace of the query to each
+    // center. The table has one row per subspace.
+    void distanceTable(const float* query, cv::Mat& table) const;
+
+    // Centers of all subspaces. Subspace s occupies rows
+    // [s * numCenters(), (s + 1) * numCenters()).
+    const cv::Mat& centers() const;
+    // Checks the dimensions of the centers.
+    bool setCenters(const cv::Mat& centers, int num_subspaces);
+
+  private:
+    cv::Mat centers_;
+    int num_subspaces_;
+};
+
+// Searches codes using the distance from each query to the quantized
+// descriptors, so that queries are never quantized themselves.
+class ProductCodeIndex {
+  public:
+    // Neither is copied.
+    ProductCodeIndex(const ProductQuantizer& quantizer,
+                     const DescriptorMatrix& codes);
+
+    int size() const;
+
+    void knnMatch(const DescriptorMatrix& query,
+                  MatchSink& matches,
+                  int k) const;
+    void radiusMatch(const DescriptorMatrix& query,
+                     MatchSink& matches,
+                     double radius) const;
+
+  private:
+    // Computes the approximate squared distance to every code.
+    void distances(const cv::Mat& table, std::vector<float>& distances) const;
+
+    const ProductQuantizer* quantizer_;
+    const DescriptorMatrix* codes_;
+};
+
+// Finds the approximate matches of each descriptor among the codes.
+// Limited by max_num and threshold as for findMatchesUsingIndex().
+void findMatchesUsingProductCodes(const DescriptorMatrix& points1,
+                                  const ProductCodeIndex& index2,
+                                  QueryResultTable& matches,
+                                  bool use_max_num,
+                                  int max_num,
+                                  bool use_threshold,
+                                  double threshold);
+
+void findMatchesUsingProductCodes(const DescriptorMatrix& points1,
+                                  const ProductCodeIndex& index2,
+                                  std::deque<QueryResultList>& matches,
+                                  bool use_max_num,
+                                  int max_num,
+                                  bool use_threshold,
+                                  double threshold);
+
+// Codes are stored beside the descriptors they encode.
+std::string makeProductCodesFilename(const std::string& descriptors_file);
+
+#endif
@@ -0,0 +1,32 @@
+#include "product_quantizer_reader.hpp"
+#include <glog/logging.h>
+#include "matrix_reader.hpp"
+
+ProductQuantizerReader::~ProductQuantizerReader() {}
+
+bool ProductQuantizerReader::read(const cv::FileNode& node,
+                                  ProductQuantizer& quantizer) {
+  if (node.type() != cv::FileNode::MAP) {
+    return false;
+  }
+
+  int num_subspaces;
+  bool ok = ::read<int>(node["num_subspaces"], num_subspaces);
+  if (!ok) {
+    return false;
+  }
+
+  cv::Mat centers;
+  ok = readMatrix(node["centers"], centers);
+  if (!ok) {
+    return false;
+  }
+
+  if (!quantizer.setCenters(centers, num_subspaces)) {
+    LOG(WARNING) << "Centers do not divide into " << num_subspaces <<
+        " subspaces";
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,13 @@
+#ifndef PRODUCT_QUANTIZER_READER_HPP_
+#define PRODUCT_QUANTIZER_READER_HPP_
+
+#include "product_quantizer.hpp"
+#include "reader.hpp"
+
+class ProductQuantizerReader : public Reader<ProductQuantizer> {
+  public:
+    ~ProductQuantizerReader();
+    bool read(const cv::FileNode& node, ProductQuantizer& quantizer);
+};
+
+#endif
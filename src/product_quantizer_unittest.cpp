@@ -0,0 +1,194 @@
+#include "product_quantizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include <boost/random/mersenne_twister.hpp>
+#include <opencv2/core/core.hpp>
+#include "descriptor_matrix.hpp"
+#include "match_sink.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+typedef std::vector<cv::DMatch> RawMatchList;
+
+const int DIMENSION = 16;
+const int NUM_SUBSPACES = 4;
+const int NUM_CENTERS = 8;
+const int NUM_TRAIN = 400;
+const int NUM_QUERIES = 20;
+
+const int NUM_DIMENSIONS = DIMENSION / NUM_SUBSPACES;
+
+cv::Mat randomRows(int rows, int seed) {
+  cv::Mat x(rows, DIMENSION, cv::DataType<float>::type);
+  cv::RNG rng(seed);
+  for (int i = 0; i < rows; i += 1) {
+    for (int d = 0; d < DIMENSION; d += 1) {
+      x.at<float>(i, d) = rng.uniform(0., 10.);
+    }
+  }
+  return x;
+}
+
+void trainQuantizer(ProductQuantizer& quantizer) {
+  DescriptorMatrix train;
+  copyToDescriptorMatrix(randomRows(NUM_TRAIN, 1), train, CV_32F);
+  boost::random::mt19937 generator(2);
+  quantizer.train(train, NUM_SUBSPACES, NUM_CENTERS, generator);
+}
+
+// Squared distance from a subspace of x to a center of that subspace.
+double subspaceDistance(const ProductQuantizer& quantizer,
+                        const float* x,
+                        int s,
+                        int k) {
+  const float* center = quantizer.centers().ptr<float>(s * NUM_CENTERS + k);
+  double sum = 0;
+  for (int d = 0; d < NUM_DIMENSIONS; d += 1) {
+    double e = double(x[s * NUM_DIMENSIONS + d]) - double(center[d]);
+    sum += e * e;
+  }
+  return sum;
+}
+
+// Concatenates the center of each subspace.
+std::vector<float> decode(const ProductQuantizer& quantizer,
+                          const uchar* code) {
+  std::vector<float> x;
+  for (int s = 0; s < NUM_SUBSPACES; s += 1) {
+    const float* center = quantizer.centers().ptr<float>(
+        s * NUM_CENTERS + code[s]);
+    x.insert(x.end(), center, center + NUM_DIMENSIONS);
+  }
+  return x;
+}
+
+double squaredDistance(const float* x, const std::vector<float>& y) {
+  double sum = 0;
+  for (int d = 0; d < DIMENSION; d += 1) {
+    double e = double(x[d]) - double(y[d]);
+    sum += e * e;
+  }
+  return sum;
+}
+
+}
+
+TEST(ProductQuantizer, TrainsEverySubspace) {
+  ProductQuantizer quantizer;
+  EXPECT_TRUE(quantizer.empty());
+  trainQuantizer(quantizer);
+
+  EXPECT_FALSE(quantizer.empty());
+  EXPECT_EQ(DIMENSION, quantizer.dimension());
+  EXPECT_EQ(NUM_SUBSPACES, quantizer.numSubspaces());
+  EXPECT_EQ(NUM_CENTERS, quantizer.numCenters());
+  EXPECT_EQ(NUM_SUBSPACES * NUM_CENTERS, quantizer.centers().rows);
+  EXPECT_EQ(NUM_DIMENSIONS, quantizer.centers().cols);
+}
+
+TEST(ProductQuantizer, EncodesToNearestCenter) {
+  ProductQuantizer quantizer;
+  trainQuantizer(quantizer);
+
+  DescriptorMatrix points;
+  copyToDescriptorMatrix(randomRows(NUM_QUERIES, 3), points, CV_32F);
+  DescriptorMatrix codes;
+  quantizer.encode(points, codes);
+  ASSERT_EQ(NUM_QUERIES, codes.rows());
+  ASSERT_EQ(NUM_SUBSPACES, codes.cols());
+  EXPECT_EQ(cv::DataType<uchar>::type, codes.type());
+
+  for (int i = 0; i < NUM_QUERIES; i += 1) {
+    const float* x = points.row<float>(i);
+    for (int s = 0; s < NUM_SUBSPACES; s += 1) {
+      int code = codes.row<uchar>(i)[s];
+      ASSERT_LT(code, NUM_CENTERS);
+      double nearest = subspaceDistance(quantizer, x, s, code);
+      for (int k = 0; k < NUM_CENTERS; k += 1) {
+        EXPECT_LE(nearest, subspaceDistance(quantizer, x, s, k) + 1e-4) <<
+            "Point " << i << ", subspace " << s << ", center " << k;
+      }
+    }
+  }
+}
+
+TEST(ProductQuantizer, DistanceTableSumsToDistanceToDecoded) {
+  ProductQuantizer quantizer;
+  trainQuantizer(quantizer);
+
+  DescriptorMatrix points;
+  copyToDescriptorMatrix(randomRows(NUM_TRAIN, 4), points, CV_32F);
+  DescriptorMatrix codes;
+  quantizer.encode(points, codes);
+
+  cv::Mat query = randomRows(NUM_QUERIES, 5);
+  cv::Mat table;
+  for (int i = 0; i < NUM_QUERIES; i += 1) {
+    const float* q = query.ptr<float>(i);
+    quantizer.distanceTable(q, table);
+    ASSERT_EQ(NUM_SUBSPACES, table.rows);
+    ASSERT_EQ(NUM_CENTERS, table.cols);
+
+    for (int j = 0; j < NUM_TRAIN; j += 1) {
+      const uchar* code = codes.row<uchar>(j);
+      double sum = 0;
+      for (int s = 0; s < NUM_SUBSPACES; s += 1) {
+        sum += table.at<float>(s, code[s]);
+      }
+      double expected = squaredDistance(q, decode(quantizer, code));
+      EXPECT_NEAR(expected, sum, 1e-4 * expected);
+    }
+  }
+}
+
+TEST(ProductCodeIndex, KnnMatchIsBruteForceOnDecoded) {
+  ProductQuantizer quantizer;
+  trainQuantizer(quantizer);
+
+  DescriptorMatrix points;
+  copyToDescriptorMatrix(randomRows(NUM_TRAIN, 6), points, CV_32F);
+  DescriptorMatrix codes;
+  quantizer.encode(points, codes);
+  ProductCodeIndex index(quantizer, codes);
+  EXPECT_EQ(NUM_TRAIN, index.size());
+
+  DescriptorMatrix query;
+  copyToDescriptorMatrix(randomRows(NUM_QUERIES, 7), query, CV_32F);
+  const int K = 5;
+  std::vector<RawMatchList> matches;
+  RawMatchListSink sink(matches);
+  index.knnMatch(query, sink, K);
+  ASSERT_EQ(NUM_QUERIES, int(matches.size()));
+
+  for (int i = 0; i < NUM_QUERIES; i += 1) {
+    const float* q = query.row<float>(i);
+    std::vector<std::pair<double, int> > expected;
+    for (int j = 0; j < NUM_TRAIN; j += 1) {
+      double distance = std::sqrt(squaredDistance(q,
+            decode(quantizer, codes.row<uchar>(j))));
+      expected.push_back(std::make_pair(distance, j));
+    }
+    std::sort(expected.begin(), expected.end());
+
+    // Codes are often repeated, so compare distances rather than indices.
+    ASSERT_EQ(K, int(matches[i].size()));
+    for (int n = 0; n < K; n += 1) {
+      const cv::DMatch& match = matches[i][n];
+      EXPECT_EQ(i, match.queryIdx);
+      EXPECT_NEAR(expected[n].first, match.distance, 1e-4 * expected[n].first);
+      double distance = std::sqrt(squaredDistance(q,
+            decode(quantizer, codes.row<uchar>(match.trainIdx))));
+      EXPECT_NEAR(distance, match.distance, 1e-4 * distance);
+    }
+  }
+
+  // Asking for more than there are gives every code.
+  std::vector<RawMatchList> all;
+  RawMatchListSink all_sink(all);
+  index.knnMatch(query, all_sink, NUM_TRAIN + 10);
+  ASSERT_EQ(NUM_QUERIES, int(all.size()));
+  EXPECT_EQ(NUM_TRAIN, int(all[0].size()));
+}
@@ -0,0 +1,9 @@
+#include "product_quantizer_writer.hpp"
+
+ProductQuantizerWriter::~ProductQuantizerWriter() {}
+
+void ProductQuantizerWriter::write(cv::FileStorage& file,
+                                   const ProductQuantizer& quantizer) {
+  file << "num_subspaces" << quantizer.numSubspaces();
+  file << "centers" << quantizer.centers();
+}
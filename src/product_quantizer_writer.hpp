@@ -0,0 +1,13 @@
+#ifndef PRODUCT_QUANTIZER_WRITER_HPP_
+#define PRODUCT_QUANTIZER_WRITER_HPP_
+
+#include "product_quantizer.hpp"
+#include "writer.hpp"
+
+class ProductQuantizerWriter : public Writer<ProductQuantizer> {
+  public:
+    ~ProductQuantizerWriter();
+    void write(cv::FileStorage& file, const ProductQuantizer& quantizer);
+};
+
+#endif
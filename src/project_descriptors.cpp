@@ -0,0 +1,74 @@
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <sstream>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "descriptor_matrix.hpp"
+#include "pca_projection.hpp"
+
+#include "read_lines.hpp"
+#include "feature_files.hpp"
+#include "pca_projection_reader.hpp"
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Reduces the dimension of descriptors using a PCA projection." <<
+      std::endl;
+  usage << std::endl;
+  usage << argv[0] << " projection descriptors-files" << std::endl;
+  usage << std::endl;
+  usage << "projection -- Input." << std::endl;
+  usage << "descriptors-files -- Input. One descriptors file per line." <<
+      std::endl;
+  usage << std::endl;
+  usage << "The projected descriptors of each file are saved beside it, with"
+      " .pca before the extension." << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string projection_file = argv[1];
+  std::string descriptors_files_file = argv[2];
+
+  bool ok;
+
+  PcaProjection projection;
+  PcaProjectionReader projection_reader;
+  ok = load(projection_file, projection, projection_reader);
+  CHECK(ok) << "Could not load projection";
+
+  std::vector<std::string> descriptors_files;
+  ok = readLines(descriptors_files_file, descriptors_files);
+  CHECK(ok) << "Could not load list of descriptors files";
+
+  std::vector<std::string>::const_iterator file;
+  for (file = descriptors_files.begin();
+       file != descriptors_files.end();
+       ++file) {
+    DescriptorMatrix descriptors;
+    ok = loadDescriptorMatrix(*file, descriptors);
+    CHECK(ok) << "Could not load descriptors \"" << *file << "\"";
+
+    DescriptorMatrix projected;
+    projection.project(descriptors, projected);
+
+    std::string projected_file = makeProjectedDescriptorsFilename(*file);
+    ok = saveDescriptorMatrix(projected_file, projected);
+    CHECK(ok) << "Could not save descriptors \"" << projected_file << "\"";
+    DLOG(INFO) << "Projected " << descriptors.rows() << " descriptors";
+  }
+
+  return 0;
+}
@@ -1,91 +1,91 @@
 #include "quantize_ray.hpp"
-#include <set>
-#include <numeric>
+#include <algorithm>
+#include <limits>
 #include <glog/logging.h>
-#include <boost/bind.hpp>
 #include <boost/math/tools/roots.hpp>
 #include "distortion.hpp"
-#include "util.hpp"
+#include "util/thread-pool.hpp"
 
 double EPSILON = 1e-6;
 
-double errorInDistanceFromPoint(cv::Point2d y,
-                                double lambda,
-                                const cv::Mat A,
-                                const cv::Mat B,
-                                double delta,
-                                const CameraProperties& intrinsics) {
-  cv::Mat X = A + lambda * B;
-  cv::Point2d x = imagePointFromHomogeneous(X);
-  x = intrinsics.distortAndUncalibrate(x);
-  return cv::norm(x - y) - delta;
-}
-
-struct ProjectiveLine {
-  cv::Mat A;
-  cv::Mat B;
-};
+namespace {
 
 // Everything you need to quantize a 3D ray in one view.
 struct Quantizer {
-  // Index for establishing uniqueness and order in a set.
-  int index;
-  // Parameters of 2D line (calibrated and undistorted).
-  ProjectiveLine line;
+  const RayQuantizerView* view;
+  // Parameters of 2D line (calibrated and undistorted), A + lambda B.
+  cv::Vec3d A;
+  cv::Vec3d B;
   // Interval of ray which is in front of camera.
   double lambda_min;
   double lambda_max;
   // Position of current lambda.
-  // TODO: This should be a map not a set!
-  mutable cv::Point2d x;
+  cv::Point2d x;
+};
 
-  CameraProperties intrinsics;
+// Distorts and uncalibrates a calibrated point in homogeneous co-ordinates.
+cv::Point2d projectToImage(const RayQuantizerView& view, const cv::Vec3d& X) {
+  cv::Point2d x(X[0] / X[2], X[1] / X[2]);
+  x = distort(x, view.distort_w);
+  cv::Vec3d Y = view.K * cv::Vec3d(x.x, x.y, 1);
+  return cv::Point2d(Y[0] / Y[2], Y[1] / Y[2]);
+}
 
-  bool operator<(const Quantizer& other) const {
-    return index < other.index;
-  }
-};
+// Distorts and uncalibrates a calibrated point at infinity.
+cv::Point2d projectPointAtInfinityToImage(const RayQuantizerView& view,
+                                          const cv::Vec3d& X) {
+  cv::Point2d x(X[0], X[1]);
+  x = distortPointAtInfinity(x, view.distort_w);
+  cv::Vec3d Y = view.K * cv::Vec3d(x.x, x.y, 1);
+  return cv::Point2d(Y[0] / Y[2], Y[1] / Y[2]);
+}
 
-double maximumErrorInDistanceFromPoint(const std::set<Quantizer>& views,
-                                       double lambda,
-                                       double delta) {
-  double max = -std::numeric_limits<double>::infinity();
+double errorInDistanceFromPoint(const cv::Point2d& y,
+                                double lambda,
+                                const Quantizer& quantizer,
+                                double delta) {
+  cv::Point2d x = projectToImage(*quantizer.view,
+      quantizer.A + quantizer.B * lambda);
+  return cv::norm(x - y) - delta;
+}
 
-  std::set<Quantizer>::const_iterator view;
-  for (view = views.begin(); view != views.end(); ++view) {
-    CHECK(view->lambda_min <= lambda);
-    CHECK(lambda <= view->lambda_max);
+// Greatest error in distance from the previous position over all views.
+// For use with boost::math::tools::bisect(), which copies it.
+class MaximumErrorFunction {
+  public:
+    MaximumErrorFunction(const std::vector<Quantizer>& views, double delta)
+        : views_(&views), delta_(delta) {}
 
-    // Compute position on line.
-    cv::Mat X = view->line.A + lambda * view->line.B;
-    cv::Point2d x = imagePointFromHomogeneous(X);
-    x = view->intrinsics.distortAndUncalibrate(x);
+    double operator()(double lambda) const {
+      double max = -std::numeric_limits<double>::infinity();
 
-    // Compute error in distance from previous position.
-    double e = cv::norm(x - view->x) - delta;
+      std::vector<Quantizer>::const_iterator view;
+      for (view = views_->begin(); view != views_->end(); ++view) {
+        CHECK(view->lambda_min <= lambda);
+        CHECK(lambda <= view->lambda_max);
 
-    if (e > max) {
-      max = e;
-    }
-  }
+        // Compute error in distance from previous position.
+        double e = errorInDistanceFromPoint(view->x, lambda, *view, delta_);
 
-  return max;
-}
+        if (e > max) {
+          max = e;
+        }
+      }
 
-double maxLambdaMin(double lambda_min, const Quantizer& quantizer) {
-  return std::max(lambda_min, quantizer.lambda_min);
-}
+      return max;
+    }
 
-bool lambdaMinGreaterThan(const Quantizer& quantizer, double lambda) {
-  return quantizer.lambda_min > lambda;
-}
+  private:
+    const std::vector<Quantizer>* views_;
+    double delta_;
+};
 
-double computeLambdaMax(const cv::Mat& A,
-                        const cv::Mat& B,
-                        const CameraProperties& intrinsics,
+double computeLambdaMax(const cv::Vec3d& A,
+                        const cv::Vec3d& B,
+                        const RayQuantizerView& view,
                         cv::Point2d& x) {
-  double a3 = A.at<double>(2, 0);
-  double b3 = B.at<double>(2, 0);
+  double a3 = A[2];
+  double b3 = B[2];
 
   double lambda_max;
 
@@ -97,8 +97,7 @@ double computeLambdaMax(const cv::Mat& A,
     lambda_max = std::numeric_limits<double>::infinity();
 
     // Compute vanishing point.
-    x = imagePointFromHomogeneous(B);
-    x = intrinsics.distortAndUncalibrate(x);
+    x = projectToImage(view, B);
   } else {
     // Ray goes to infinity behind camera, crossing image plane. There is no
     // vanishing point. However, under distortion, a 2D point at infinity
@@ -108,10 +107,7 @@ double computeLambdaMax(const cv::Mat& A,
     CHECK(lambda_max > 0);
 
     // Find position of point at infinity after distortion.
-    cv::Mat X = A + lambda_max * B;
-    x = cv::Point2d(X.at<double>(0, 0), X.at<double>(1, 0));
-    x = distortPointAtInfinity(x, intrinsics.distort_w);
-    x = intrinsics.uncalibrate(x);
+    x = projectPointAtInfinityToImage(view, A + B * lambda_max);
 
     // Shrink by some epsilon to allow non-strict inequality.
     lambda_max *= (1. - EPSILON);
@@ -120,12 +116,9 @@ double computeLambdaMax(const cv::Mat& A,
   return lambda_max;
 }
 
-double computeLambdaMin(const cv::Mat& A,
-                        const cv::Mat& B,
-                        const CameraProperties& intrinsics,
-                        cv::Point2d& x) {
-  double a3 = A.at<double>(2, 0);
-  double b3 = B.at<double>(2, 0);
+double computeLambdaMin(const cv::Vec3d& A, const cv::Vec3d& B) {
+  double a3 = A[2];
+  double b3 = B[2];
 
   double lambda_min;
 
@@ -134,22 +127,12 @@ double computeLambdaMin(const cv::Mat& A,
     // Ray starts in front of camera. 2D line starts at a finite coordinate.
     DLOG(INFO) << "Ray starts in front of camera";
     lambda_min = 0;
-
-    // Compute epipole.
-    x = imagePointFromHomogeneous(A);
-    x = intrinsics.distortAndUncalibrate(x);
   } else {
     // Ray starts behind camera. 2D line starts at infinity.
     DLOG(INFO) << "Ray starts behind camera";
     lambda_min = -a3 / b3;
     CHECK(lambda_min > 0);
 
-    // Find position of point at infinity after distortion.
-    cv::Mat X = A + lambda_min * B;
-    x = cv::Point2d(X.at<double>(0, 0), X.at<double>(1, 0));
-    x = distortPointAtInfinity(x, intrinsics.distort_w);
-    x = intrinsics.uncalibrate(x);
-
     // Grow by some epsilon to allow non-strict inequality.
     lambda_min *= (1. + EPSILON);
   }
@@ -157,75 +140,150 @@ double computeLambdaMin(const cv::Mat& A,
   return lambda_min;
 }
 
-void quantizeRay(const cv::Point2d& projection,
-                 const std::vector<Camera>& cameras,
-                 int selected,
-                 double delta,
-                 std::map<double, cv::Point3d>& points) {
+// Quantizes the rays of a list of projections.
+// For use with ThreadPool::parallelFor().
+class QuantizeRayFunction {
+  public:
+    // The whole of every ray is quantized if bounds is NULL.
+    QuantizeRayFunction(
+        const RayQuantizer& quantizer,
+        const std::vector<cv::Point2d>& projections,
+        const std::vector<std::pair<double, double> >* bounds,
+        std::vector<std::vector<RayPoint> >& rays)
+        : quantizer_(&quantizer),
+          projections_(&projections),
+          bounds_(bounds),
+          rays_(&rays) {}
+
+    void operator()(int i) const {
+      if (bounds_ == NULL) {
+        quantizer_->quantize((*projections_)[i], (*rays_)[i]);
+      } else {
+        quantizer_->quantize((*projections_)[i], (*bounds_)[i].first,
+            (*bounds_)[i].second, (*rays_)[i]);
+      }
+    }
+
+  private:
+    const RayQuantizer* quantizer_;
+    const std::vector<cv::Point2d>* projections_;
+    const std::vector<std::pair<double, double> >* bounds_;
+    std::vector<std::vector<RayPoint> >* rays_;
+};
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+RayPoint::RayPoint() : lambda(0), point() {}
+
+RayPoint::RayPoint(double lambda, const cv::Point3d& point)
+    : lambda(lambda), point(point) {}
+
+////////////////////////////////////////////////////////////////////////////////
+
+QuantizedRaySet::QuantizedRaySet() : points_(), offsets_(1, 0) {}
+
+int QuantizedRaySet::size() const {
+  return offsets_.size() - 1;
+}
+
+const RayPoint* QuantizedRaySet::begin(int i) const {
+  return points_.empty() ? NULL : &points_.front() + offsets_[i];
+}
+
+const RayPoint* QuantizedRaySet::end(int i) const {
+  return points_.empty() ? NULL : &points_.front() + offsets_[i + 1];
+}
+
+int QuantizedRaySet::length(int i) const {
+  return offsets_[i + 1] - offsets_[i];
+}
+
+void QuantizedRaySet::add(const std::vector<RayPoint>& ray) {
+  points_.insert(points_.end(), ray.begin(), ray.end());
+  offsets_.push_back(points_.size());
+}
+
+void QuantizedRaySet::clear() {
+  points_.clear();
+  offsets_.assign(1, 0);
+}
+
+void QuantizedRaySet::swap(QuantizedRaySet& other) {
+  points_.swap(other.points_);
+  offsets_.swap(other.offsets_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+RayQuantizer::RayQuantizer(const std::vector<Camera>& cameras,
+                           int selected,
+                           double delta)
+    : camera_(), views_(), delta_(delta) {
+  CHECK(0 <= selected && selected < int(cameras.size()));
+  camera_ = cameras[selected];
+
+  int num_cameras = cameras.size();
+  for (int index = 0; index < num_cameras; index += 1) {
+    if (index != selected) {
+      RayQuantizerView view;
+      view.index = index;
+      view.extrinsics = cameras[index].extrinsics().matrix();
+      view.K = cameras[index].intrinsics().matrix();
+      view.distort_w = cameras[index].intrinsics().distort_w;
+      views_.push_back(view);
+    }
+  }
+}
+
+void RayQuantizer::quantize(const cv::Point2d& projection,
+                            std::vector<RayPoint>& points) const {
+  quantize(projection, 0, std::numeric_limits<double>::infinity(), points);
+}
+
+void RayQuantizer::quantize(const cv::Point2d& projection,
+                            double lambda_lower,
+                            double lambda_upper,
+                            std::vector<RayPoint>& points) const {
+  CHECK(lambda_lower <= lambda_upper);
   points.clear();
 
   // Solutions parametrized by 3D line c + lambda v, lambda >= 0.
-  const Camera& camera = cameras[selected];
-  cv::Point3d c = camera.extrinsics().center;
-  cv::Point2d w = camera.intrinsics().calibrateAndUndistort(projection);
-  cv::Point3d v = camera.extrinsics().directionOfRayThrough(w);
+  cv::Point3d c = camera_.extrinsics().center;
+  cv::Point2d w = camera_.intrinsics().calibrateAndUndistort(projection);
+  cv::Point3d v = camera_.extrinsics().directionOfRayThrough(w);
 
-  cv::Mat C = worldPointToHomogeneous(c);
-  cv::Mat V = worldPointToHomogeneous(v, 0);
+  cv::Vec4d C(c.x, c.y, c.z, 1);
+  cv::Vec4d V(v.x, v.y, v.z, 0);
 
   // Initialize Quantizer for each view.
-  std::set<Quantizer> pending;
-
-  {
-    std::vector<Camera>::const_iterator other;
-    int index = 0;
-
-    for (other = cameras.begin(); other != cameras.end(); ++other) {
-      if (index != selected) {
-        // Find 2D projective line.
-        cv::Mat P(other->extrinsics().matrix());
-        ProjectiveLine line;
-        line.A = P * C;
-        line.B = P * V;
-
-        // Check whether each point is in front of or behind the camera.
-        double a3 = line.A.at<double>(2, 0);
-        double b3 = line.B.at<double>(2, 0);
-
-        if (a3 > 0 && b3 > 0) {
-          // Entire ray is behind camera.
-          DLOG(INFO) << "Ray is not observed";
-        } else {
-          double lambda_min;
-          double lambda_max;
-          cv::Point2d x;
-
-          lambda_max = computeLambdaMax(line.A, line.B, other->intrinsics(), x);
-          cv::Point2d y;
-          lambda_min = computeLambdaMin(line.A, line.B, other->intrinsics(), y);
-
-          Quantizer view;
-          view.index = index;
-          view.line = line;
-          view.lambda_min = lambda_min;
-          view.lambda_max = lambda_max;
-          view.x = x;
-          view.intrinsics = other->intrinsics();
-
-          pending.insert(view);
-        }
-      }
-
-      index += 1;
+  std::vector<Quantizer> pending;
+
+  std::vector<RayQuantizerView>::const_iterator other;
+  for (other = views_.begin(); other != views_.end(); ++other) {
+    // Find 2D projective line.
+    Quantizer view;
+    view.view = &*other;
+    view.A = other->extrinsics * C;
+    view.B = other->extrinsics * V;
+
+    // Check whether each point is in front of or behind the camera.
+    if (view.A[2] > 0 && view.B[2] > 0) {
+      // Entire ray is behind camera.
+      DLOG(INFO) << "Ray is not observed";
+    } else {
+      view.lambda_max = computeLambdaMax(view.A, view.B, *other, view.x);
+      view.lambda_min = computeLambdaMin(view.A, view.B);
+      pending.push_back(view);
     }
   }
 
   // Find initial lambda.
   double lambda = 0;
 
-  for (std::set<Quantizer>::const_iterator view = pending.begin();
-       view != pending.end();
-       ++view) {
+  std::vector<Quantizer>::const_iterator view;
+  for (view = pending.begin(); view != pending.end(); ++view) {
     if (view->lambda_max < std::numeric_limits<double>::infinity()) {
       // lambda_max is finite.
       lambda = std::max(lambda, view->lambda_max);
@@ -238,8 +296,8 @@ void quantizeRay(const cv::Point2d& projection,
       lambda = std::max(lambda, view->lambda_min);
 
       while (!big_enough) {
-        double error = errorInDistanceFromPoint(view->x, lambda, view->line.A,
-            view->line.B, delta, view->intrinsics);
+        double error = errorInDistanceFromPoint(view->x, lambda, *view,
+            delta_);
 
         if (error < 0) {
           big_enough = true;
@@ -254,62 +312,56 @@ void quantizeRay(const cv::Point2d& projection,
     }
   }
 
+  // Start no further along the ray than lambda_upper.
+  lambda = std::min(lambda, lambda_upper);
+
   bool converged = false;
   int t = 0;
 
-  std::set<Quantizer> active;
+  std::vector<Quantizer> active;
+  std::vector<Quantizer> remaining;
 
   while (!converged) {
     // Move points from pending to active set for which lambda <= lambda_max.
-    {
-      std::set<Quantizer>::iterator view = pending.begin();
-      while (view != pending.end()) {
-        // Is the domain of the function within the bisection range?
-        if (lambda <= view->lambda_max) {
-          active.insert(*view);
-          pending.erase(view++);
-        } else {
-          ++view;
-        }
+    remaining.clear();
+    for (view = pending.begin(); view != pending.end(); ++view) {
+      // Is the domain of the function within the bisection range?
+      if (lambda <= view->lambda_max) {
+        active.push_back(*view);
+      } else {
+        remaining.push_back(*view);
       }
     }
+    pending.swap(remaining);
 
     // Remove points from active set for which lambda < lambda_min.
-    {
-      std::set<Quantizer> valid;
-      std::remove_copy_if(active.begin(), active.end(),
-          std::inserter(valid, valid.begin()),
-          boost::bind(lambdaMinGreaterThan, _1, lambda));
-      active.swap(valid);
+    remaining.clear();
+    for (view = active.begin(); view != active.end(); ++view) {
+      if (!(view->lambda_min > lambda)) {
+        remaining.push_back(*view);
+      }
     }
+    active.swap(remaining);
 
     CHECK(!(active.empty() && !pending.empty()));
 
-    // Update positions.
-    std::set<Quantizer>::iterator view;
+    // Update positions and remove points which do not have a solution in
+    // (lambda_min(i), lambda).
+    remaining.clear();
     for (view = active.begin(); view != active.end(); ++view) {
-      cv::Mat X = view->line.A + lambda * view->line.B;
-      cv::Point2d x = imagePointFromHomogeneous(X);
-      x = view->intrinsics.distortAndUncalibrate(x);
-      view->x = x;
-    }
-
-    // Remove points which do not have a solution in (lambda_min(i), lambda).
-    {
-      std::set<Quantizer>::iterator view = active.begin();
-      while (view != active.end()) {
-        // Is there a sign change across the interval?
-        double f_max = errorInDistanceFromPoint(view->x, view->lambda_min,
-            view->line.A, view->line.B, delta, view->intrinsics);
-
-        // We know that f(lambda_max) < 0, so f(lower) should be > 0.
-        if (f_max < 0) {
-          active.erase(view++);
-        } else {
-          ++view;
-        }
+      // Update position.
+      Quantizer updated = *view;
+      updated.x = projectToImage(*view->view, view->A + view->B * lambda);
+
+      // Is there a sign change across the interval?
+      // We know that f(lambda_max) < 0, so f(lower) should be > 0.
+      double f_max = errorInDistanceFromPoint(updated.x, updated.lambda_min,
+          updated, delta_);
+      if (f_max >= 0) {
+        remaining.push_back(updated);
       }
     }
+    active.swap(remaining);
 
     if (active.empty() && pending.empty()) {
       converged = true;
@@ -318,13 +370,15 @@ void quantizeRay(const cv::Point2d& projection,
 
       // Update lower bound to be maximum lambda_min over active set.
       double lower = 0;
-      lower = std::accumulate(active.begin(), active.end(), lower, maxLambdaMin);
+      for (view = active.begin(); view != active.end(); ++view) {
+        lower = std::max(lower, view->lambda_min);
+      }
 
       // Find lambda which gives point at most delta pixels away from x.
       double old_lambda = lambda;
       std::pair<double, double> interval = boost::math::tools::bisect(
-          boost::bind(maximumErrorInDistanceFromPoint, active, _1, delta),
-          lower, lambda, boost::math::tools::eps_tolerance<double>(16));
+          MaximumErrorFunction(active, delta_), lower, lambda,
+          boost::math::tools::eps_tolerance<double>(16));
       lambda = interval.second;
 
       // Guard against limit cycles.
@@ -333,10 +387,77 @@ void quantizeRay(const cv::Point2d& projection,
       }
 
       // Add points to tracks.
-      points[lambda] = c + lambda * v;
+      points.push_back(RayPoint(lambda, c + lambda * v));
       t += 1;
+
+      if (lambda < lambda_lower) {
+        converged = true;
+      }
     }
   }
 
+  // Lambda decreases with every step.
+  std::reverse(points.begin(), points.end());
+
   DLOG(INFO) << "Quantized ray into " << points.size() << " positions";
 }
+
+void RayQuantizer::quantize(
+    const std::vector<cv::Point2d>& projections,
+    const std::vector<std::pair<double, double> >* bounds,
+    QuantizedRaySet& rays,
+    ThreadPool* pool) const {
+  int n = projections.size();
+  if (bounds != NULL) {
+    CHECK(int(bounds->size()) == n);
+  }
+  std::vector<std::vector<RayPoint> > points(n);
+  QuantizeRayFunction function(*this, projections, bounds, points);
+  if (pool == NULL) {
+    for (int i = 0; i < n; i += 1) {
+      function(i);
+    }
+  } else {
+    pool->parallelFor(0, n, function);
+  }
+
+  rays.clear();
+  for (int i = 0; i < n; i += 1) {
+    rays.add(points[i]);
+  }
+}
+
+void RayQuantizer::quantize(const std::vector<cv::Point2d>& projections,
+                            QuantizedRaySet& rays) const {
+  quantize(projections, NULL, rays, NULL);
+}
+
+void RayQuantizer::quantize(const std::vector<cv::Point2d>& projections,
+                            QuantizedRaySet& rays,
+                            ThreadPool& pool) const {
+  quantize(projections, NULL, rays, &pool);
+}
+
+void RayQuantizer::quantize(
+    const std::vector<cv::Point2d>& projections,
+    const std::vector<std::pair<double, double> >& bounds,
+    QuantizedRaySet& rays,
+    ThreadPool& pool) const {
+  quantize(projections, &bounds, rays, &pool);
+}
+
+void quantizeRay(const cv::Point2d& projection,
+                 const std::vector<Camera>& cameras,
+                 int selected,
+                 double delta,
+                 QuantizedRay& points) {
+  RayQuantizer quantizer(cameras, selected, delta);
+  std::vector<RayPoint> ray;
+  quantizer.quantize(projection, ray);
+
+  points.clear();
+  std::vector<RayPoint>::const_iterator point;
+  for (point = ray.begin(); point != ray.end(); ++point) {
+    points.insert(points.end(), std::make_pair(point->lambda, point->point));
+  }
+}
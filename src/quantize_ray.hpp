@@ -1,9 +1,111 @@
+#ifndef QUANTIZE_RAY_HPP_
+#define QUANTIZE_RAY_HPP_
+
 #include <opencv2/core/core.hpp>
+#include <functional>
+#include <map>
+#include <utility>
 #include <vector>
+#include <boost/pool/pool_alloc.hpp>
 #include "camera.hpp"
 
+class ThreadPool;
+
+// Points on a ray by their distance along it.
+// Rays are built for every frame, so their nodes come from a pool.
+typedef std::map<double, cv::Point3d, std::less<double>,
+                 boost::fast_pool_allocator<std::pair<const double,
+                                                      cv::Point3d> > >
+        QuantizedRay;
+
 void quantizeRay(const cv::Point2d& projection,
                  const std::vector<Camera>& cameras,
                  int selected,
                  double delta,
-                 std::map<double, cv::Point3d>& points);
+                 QuantizedRay& points);
+
+// A point on a ray at distance lambda along it.
+struct RayPoint {
+  double lambda;
+  cv::Point3d point;
+
+  RayPoint();
+  RayPoint(double lambda, const cv::Point3d& point);
+};
+
+// Many quantized rays, stored contiguously. Each is in ascending lambda.
+class QuantizedRaySet {
+  public:
+    QuantizedRaySet();
+
+    // Number of rays.
+    int size() const;
+    // Points of ray i are [begin(i), end(i)).
+    const RayPoint* begin(int i) const;
+    const RayPoint* end(int i) const;
+    int length(int i) const;
+
+    void add(const std::vector<RayPoint>& ray);
+
+    void clear();
+    void swap(QuantizedRaySet& other);
+
+  private:
+    std::vector<RayPoint> points_;
+    // Start of each ray, and the number of points at the end.
+    std::vector<int> offsets_;
+};
+
+// Terms of one of the other cameras, for projecting points on a ray.
+struct RayQuantizerView {
+  int index;
+  cv::Matx34d extrinsics;
+  cv::Matx33d K;
+  double distort_w;
+};
+
+// Quantizes the rays through many points in one view, the same as
+// quantizeRay(). Consecutive points are at most delta pixels apart in the
+// other views. The terms of each camera are computed once for all rays.
+class RayQuantizer {
+  public:
+    RayQuantizer(const std::vector<Camera>& cameras,
+                 int selected,
+                 double delta);
+
+    // Outputs points in ascending lambda.
+    void quantize(const cv::Point2d& projection,
+                  std::vector<RayPoint>& points) const;
+    // Quantizes only the part of the ray within [lambda_lower, lambda_upper],
+    // such as a band around the solution of a coarser search. The points
+    // step as those of the whole ray do, from the first below lambda_upper to
+    // the first below lambda_lower, if the ray goes that far.
+    void quantize(const cv::Point2d& projection,
+                  double lambda_lower,
+                  double lambda_upper,
+                  std::vector<RayPoint>& points) const;
+    // Ray i is through projections[i].
+    void quantize(const std::vector<cv::Point2d>& projections,
+                  QuantizedRaySet& rays) const;
+    // Divides the rays amongst the threads of the pool.
+    void quantize(const std::vector<cv::Point2d>& projections,
+                  QuantizedRaySet& rays,
+                  ThreadPool& pool) const;
+    // Ray i is within the interval bounds[i] of lambda.
+    void quantize(const std::vector<cv::Point2d>& projections,
+                  const std::vector<std::pair<double, double> >& bounds,
+                  QuantizedRaySet& rays,
+                  ThreadPool& pool) const;
+
+  private:
+    void quantize(const std::vector<cv::Point2d>& projections,
+                  const std::vector<std::pair<double, double> >* bounds,
+                  QuantizedRaySet& rays,
+                  ThreadPool* pool) const;
+
+    Camera camera_;
+    std::vector<RayQuantizerView> views_;
+    double delta_;
+};
+
+#endif
@@ -8,3 +8,12 @@ int GenerateFunction::operator()(int n) {
   boost::random::uniform_int_distribution<> dist(0, n - 1);
   return dist(*generator_);
 }
+
+uint32_t streamSeed(uint32_t seed, uint32_t stream) {
+  // Finalizer of SplitMix64, which maps nearby keys to unrelated values.
+  uint64_t z = (uint64_t(seed) << 32 | stream) + 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z = z ^ (z >> 31);
+  return uint32_t(z >> 32);
+}
@@ -1,8 +1,15 @@
 #ifndef RANDOM_HPP_
 #define RANDOM_HPP_
 
+#include <stdint.h>
 #include <boost/random/mersenne_twister.hpp>
 
+// Seed of an independent stream of random numbers for one task of a
+// computation, e.g. one restart, view or image. Each task then draws the
+// same numbers regardless of how many threads run the tasks and in which
+// order. Streams may be nested, e.g. streamSeed(streamSeed(seed, view), t).
+uint32_t streamSeed(uint32_t seed, uint32_t stream);
+
 template<class RandomAccessIterator>
 void randomShuffle(RandomAccessIterator first,
                    RandomAccessIterator last,
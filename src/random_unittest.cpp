@@ -0,0 +1,120 @@
+#include "random.hpp"
+#include <set>
+#include <vector>
+#include <boost/random/normal_distribution.hpp>
+#include "kmeans.hpp"
+#include "util/thread-pool.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+class VectorPoint : public KMeansPoint {
+  public:
+    explicit VectorPoint(const std::vector<double>& x) : x_(x) {}
+    const std::vector<double>& vector() const { return x_; }
+
+  private:
+    std::vector<double> x_;
+};
+
+// Points scattered around a few centers.
+void makePoints(int n, int dimension, std::vector<VectorPoint>& points) {
+  boost::random::mt19937 generator(7);
+  boost::random::normal_distribution<double> noise;
+  for (int i = 0; i < n; i += 1) {
+    std::vector<double> x(dimension);
+    for (int d = 0; d < dimension; d += 1) {
+      x[d] = 10 * (i % 5) + noise(generator);
+    }
+    points.push_back(VectorPoint(x));
+  }
+}
+
+}
+
+TEST(StreamSeed, IsDeterministic) {
+  EXPECT_EQ(streamSeed(42, 3), streamSeed(42, 3));
+  EXPECT_EQ(streamSeed(streamSeed(42, 3), 5),
+            streamSeed(streamSeed(42, 3), 5));
+}
+
+TEST(StreamSeed, NearbyKeysGiveDistinctSeeds) {
+  std::set<uint32_t> seeds;
+  int n = 0;
+  for (uint32_t seed = 0; seed < 32; seed += 1) {
+    for (uint32_t stream = 0; stream < 32; stream += 1) {
+      seeds.insert(streamSeed(seed, stream));
+      n += 1;
+    }
+  }
+  EXPECT_EQ(n, int(seeds.size()));
+
+  // Swapping the seed and stream gives another stream.
+  EXPECT_NE(streamSeed(1, 2), streamSeed(2, 1));
+  // Nesting is not the same as either level.
+  EXPECT_NE(streamSeed(streamSeed(1, 2), 3), streamSeed(1, 3));
+  EXPECT_NE(streamSeed(streamSeed(1, 2), 3), streamSeed(1, 2));
+}
+
+TEST(StreamSeed, StreamsDoNotOverlap) {
+  // The first draws of adjacent streams should not repeat each other.
+  boost::random::mt19937 a(streamSeed(1, 0));
+  boost::random::mt19937 b(streamSeed(1, 1));
+  std::set<uint32_t> draws;
+  for (int i = 0; i < 1000; i += 1) {
+    draws.insert(a());
+    draws.insert(b());
+  }
+  EXPECT_EQ(2000u, draws.size());
+}
+
+TEST(RandomShuffle, SameSeedGivesSamePermutation) {
+  std::vector<int> x(100);
+  for (int i = 0; i < 100; i += 1) {
+    x[i] = i;
+  }
+  std::vector<int> y = x;
+
+  boost::random::mt19937 a(streamSeed(9, 1));
+  boost::random::mt19937 b(streamSeed(9, 1));
+  randomShuffle(x.begin(), x.end(), a);
+  randomShuffle(y.begin(), y.end(), b);
+  EXPECT_EQ(x, y);
+
+  std::multiset<int> elements(x.begin(), x.end());
+  EXPECT_EQ(100u, elements.size());
+  EXPECT_EQ(0, *elements.begin());
+  EXPECT_EQ(99, *elements.rbegin());
+}
+
+TEST(SeededKMeans, SameForAnyNumberOfThreads) {
+  std::vector<VectorPoint> storage;
+  makePoints(500, 4, storage);
+  std::vector<const KMeansPoint*> points;
+  for (int i = 0; i < int(storage.size()); i += 1) {
+    points.push_back(&storage[i]);
+  }
+
+  KMeansOptions options;
+  options.seeding = KMeansOptions::SCALABLE_PLUS_PLUS_SEEDING;
+  options.num_restarts = 6;
+
+  std::deque<std::vector<double> > serial_centers;
+  std::vector<int> serial_labels;
+  boost::random::mt19937 serial_generator(3);
+  double serial_error = seededKMeans(points, 5, options, serial_centers,
+      serial_labels, serial_generator);
+
+  for (int num_threads = 1; num_threads <= 4; num_threads *= 2) {
+    ThreadPool pool(num_threads);
+    std::deque<std::vector<double> > centers;
+    std::vector<int> labels;
+    boost::random::mt19937 generator(3);
+    double error = seededKMeans(points, 5, options, centers, labels,
+        generator, pool);
+
+    EXPECT_EQ(serial_error, error);
+    EXPECT_EQ(serial_labels, labels);
+    EXPECT_TRUE(serial_centers == centers);
+  }
+}
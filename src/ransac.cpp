@@ -0,0 +1,492 @@
+#include "ransac.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <glog/logging.h>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include "geometry.hpp"
+#include "util/thread-pool.hpp"
+
+RansacOptions::RansacOptions()
+    : model(FUNDAMENTAL_MATRIX_MODEL),
+      threshold(2.),
+      confidence(0.999),
+      max_iterations(100000),
+      batch_size(64),
+      sprt_delta(0.01),
+      sprt_model_cost(200.),
+      seed(0) {}
+
+namespace {
+
+// Number of iterations over which PROSAC grows the sampled set to all
+// correspondences.
+const int PROSAC_GROWTH_ITERATIONS = 200000;
+// Number of fixed point iterations to find the SPRT decision threshold.
+const int SPRT_THRESHOLD_ITERATIONS = 10;
+// Assumed least fraction of inliers before a good model has been found.
+const double MIN_INLIER_FRACTION = 0.1;
+
+int sampleSize(RansacModel model) {
+  return (model == FUNDAMENTAL_MATRIX_MODEL) ? 8 : 4;
+}
+
+// Finds a similarity which moves the centroid of the points to the origin and
+// their mean distance from it to sqrt(2).
+// Hartley and Zisserman, 2nd ed. p109.
+cv::Matx33d normalizingTransform(const std::vector<cv::Point2d>& x,
+                                 const std::vector<int>& indices) {
+  int n = indices.size();
+
+  cv::Point2d mean(0, 0);
+  for (int i = 0; i < n; i += 1) {
+    mean += x[indices[i]];
+  }
+  mean *= 1. / n;
+
+  double distance = 0;
+  for (int i = 0; i < n; i += 1) {
+    distance += cv::norm(x[indices[i]] - mean);
+  }
+  distance /= n;
+
+  double s = (distance > 0) ? std::sqrt(2.) / distance : 1.;
+  return cv::Matx33d(s, 0, -s * mean.x,
+                     0, s, -s * mean.y,
+                     0, 0, 1);
+}
+
+cv::Vec3d transform(const cv::Matx33d& T, const cv::Point2d& x) {
+  return T * cv::Vec3d(x.x, x.y, 1);
+}
+
+// Normalized eight-point algorithm using at least eight correspondences.
+// Hartley and Zisserman, 2nd ed. p282.
+bool fitFundamentalMatrix(const std::vector<cv::Point2d>& x1,
+                          const std::vector<cv::Point2d>& x2,
+                          const std::vector<int>& indices,
+                          cv::Matx33d& F) {
+  int n = indices.size();
+  cv::Matx33d T1 = normalizingTransform(x1, indices);
+  cv::Matx33d T2 = normalizingTransform(x2, indices);
+
+  // Each correspondence gives one row of A f = 0.
+  cv::Mat A(n, 9, cv::DataType<double>::type);
+  for (int i = 0; i < n; i += 1) {
+    cv::Vec3d y1 = transform(T1, x1[indices[i]]);
+    cv::Vec3d y2 = transform(T2, x2[indices[i]]);
+    double* row = A.ptr<double>(i);
+    for (int j = 0; j < 3; j += 1) {
+      for (int k = 0; k < 3; k += 1) {
+        row[3 * j + k] = y2[j] * y1[k];
+      }
+    }
+  }
+
+  cv::Mat f;
+  cv::SVD::solveZ(A, f);
+  cv::Matx33d G(f.ptr<double>());
+
+  // Enforce rank two.
+  cv::Mat G_mat(G, false);
+  cv::SVD svd(G_mat);
+  cv::Mat w = svd.w.clone();
+  w.at<double>(2) = 0;
+  cv::Mat R = svd.u * cv::Mat::diag(w) * svd.vt;
+  G = cv::Matx33d(R.ptr<double>());
+
+  F = T2.t() * G * T1;
+  return cv::checkRange(cv::Mat(F, false));
+}
+
+// Normalized direct linear transform using at least four correspondences.
+// Hartley and Zisserman, 2nd ed. p109.
+bool fitHomography(const std::vector<cv::Point2d>& x1,
+                   const std::vector<cv::Point2d>& x2,
+                   const std::vector<int>& indices,
+                   cv::Matx33d& H) {
+  int n = indices.size();
+  cv::Matx33d T1 = normalizingTransform(x1, indices);
+  cv::Matx33d T2 = normalizingTransform(x2, indices);
+
+  // Each correspondence gives two rows of A h = 0.
+  cv::Mat A = cv::Mat_<double>(2 * n, 9, 0.);
+  for (int i = 0; i < n; i += 1) {
+    cv::Vec3d y1 = transform(T1, x1[indices[i]]);
+    cv::Vec3d y2 = transform(T2, x2[indices[i]]);
+    double* u = A.ptr<double>(2 * i);
+    double* v = A.ptr<double>(2 * i + 1);
+    for (int k = 0; k < 3; k += 1) {
+      u[3 + k] = -y2[2] * y1[k];
+      u[6 + k] = y2[1] * y1[k];
+      v[k] = y2[2] * y1[k];
+      v[6 + k] = -y2[0] * y1[k];
+    }
+  }
+
+  cv::Mat h;
+  cv::SVD::solveZ(A, h);
+  cv::Matx33d G(h.ptr<double>());
+
+  H = T2.inv() * G * T1;
+  return cv::checkRange(cv::Mat(H, false));
+}
+
+bool fitModel(RansacModel model,
+              const std::vector<cv::Point2d>& x1,
+              const std::vector<cv::Point2d>& x2,
+              const std::vector<int>& indices,
+              cv::Matx33d& M) {
+  if (model == FUNDAMENTAL_MATRIX_MODEL) {
+    return fitFundamentalMatrix(x1, x2, indices, M);
+  } else {
+    return fitHomography(x1, x2, indices, M);
+  }
+}
+
+// Returns the squared distance from x2 to the mapping of x1.
+double transferError(const cv::Matx33d& H,
+                     const cv::Point2d& x1,
+                     const cv::Point2d& x2) {
+  cv::Vec3d y = H * cv::Vec3d(x1.x, x1.y, 1);
+  double dx = y[0] / y[2] - x2.x;
+  double dy = y[1] / y[2] - x2.y;
+  return dx * dx + dy * dy;
+}
+
+double modelError(RansacModel model,
+                  const cv::Matx33d& M,
+                  const cv::Point2d& x1,
+                  const cv::Point2d& x2) {
+  if (model == FUNDAMENTAL_MATRIX_MODEL) {
+    return sampsonError(M, x1, x2);
+  } else {
+    return transferError(M, x1, x2);
+  }
+}
+
+// Sequential probability ratio test that a model is bad.
+struct Sprt {
+  // Likelihood ratio multipliers for consistent and inconsistent points.
+  double consistent;
+  double inconsistent;
+  // Decision threshold, infinite if the test is disabled.
+  double threshold;
+
+  // epsilon is the probability that a point is consistent with a good model.
+  Sprt(double epsilon, double delta, double model_cost);
+};
+
+Sprt::Sprt(double epsilon, double delta, double model_cost)
+    : consistent(delta / epsilon),
+      inconsistent((1. - delta) / (1. - epsilon)),
+      threshold(std::numeric_limits<double>::infinity()) {
+  if (!(delta < epsilon && epsilon < 1)) {
+    // The test cannot tell good and bad models apart.
+    return;
+  }
+
+  // Information per point, Matas and Chum eq. (4).
+  double C = (1. - delta) * std::log((1. - delta) / (1. - epsilon)) +
+      delta * std::log(delta / epsilon);
+
+  // Optimal threshold is the fixed point of A = t_M C + 1 + log(A).
+  double A = model_cost * C + 1.;
+  for (int i = 0; i < SPRT_THRESHOLD_ITERATIONS; i += 1) {
+    A = model_cost * C + 1. + std::log(A);
+  }
+  threshold = A;
+}
+
+// A sample and the model fit to it.
+struct Hypothesis {
+  std::vector<int> sample;
+  cv::Matx33d model;
+  // False if the model could not be fit or was rejected by the SPRT.
+  bool valid;
+  int num_inliers;
+};
+
+// Fits and scores each hypothesis of a batch.
+// For use with ThreadPool::parallelFor().
+class ScoreHypothesisFunction {
+  public:
+    ScoreHypothesisFunction(const std::vector<cv::Point2d>& x1,
+                            const std::vector<cv::Point2d>& x2,
+                            RansacModel model,
+                            double threshold,
+                            const Sprt& sprt,
+                            std::vector<Hypothesis>& hypotheses)
+        : x1_(&x1),
+          x2_(&x2),
+          model_(model),
+          threshold2_(threshold * threshold),
+          sprt_(sprt),
+          hypotheses_(&hypotheses) {}
+
+    void operator()(int i) const {
+      Hypothesis& hypothesis = (*hypotheses_)[i];
+      hypothesis.num_inliers = 0;
+      hypothesis.valid = fitModel(model_, *x1_, *x2_, hypothesis.sample,
+          hypothesis.model);
+      if (!hypothesis.valid) {
+        return;
+      }
+
+      double lambda = 1;
+      int n = x1_->size();
+      for (int j = 0; j < n; j += 1) {
+        double e = modelError(model_, hypothesis.model, (*x1_)[j], (*x2_)[j]);
+        if (e <= threshold2_) {
+          hypothesis.num_inliers += 1;
+          lambda *= sprt_.consistent;
+        } else {
+          lambda *= sprt_.inconsistent;
+        }
+
+        if (lambda > sprt_.threshold) {
+          hypothesis.valid = false;
+          return;
+        }
+      }
+    }
+
+  private:
+    const std::vector<cv::Point2d>* x1_;
+    const std::vector<cv::Point2d>* x2_;
+    RansacModel model_;
+    double threshold2_;
+    Sprt sprt_;
+    std::vector<Hypothesis>* hypotheses_;
+};
+
+// Draws samples from progressively larger sets of the best correspondences.
+// Chum and Matas, "Matching with PROSAC", CVPR 2005.
+class ProsacSampler {
+  public:
+    ProsacSampler(int num_points, int sample_size, unsigned int seed);
+
+    void sample(std::vector<int>& indices);
+
+  private:
+    // Draws k distinct indices from [0, n) into indices.
+    void drawDistinct(int k, int n, std::vector<int>& indices);
+
+    int num_points_;
+    int sample_size_;
+    boost::random::mt19937 generator_;
+    // Number of samples drawn.
+    int t_;
+    // Size of the set from which samples are drawn.
+    int n_;
+    // T_n and T'_n of the paper.
+    double T_n_;
+    double T_n_prime_;
+};
+
+ProsacSampler::ProsacSampler(int num_points, int sample_size,
+                             unsigned int seed)
+    : num_points_(num_points),
+      sample_size_(sample_size),
+      generator_(seed),
+      t_(0),
+      n_(sample_size),
+      T_n_(PROSAC_GROWTH_ITERATIONS),
+      T_n_prime_(1) {
+  // Expected number of samples from the first m points, of T_N samples.
+  for (int i = 0; i < sample_size_; i += 1) {
+    T_n_ *= double(n_ - i) / (num_points_ - i);
+  }
+}
+
+void ProsacSampler::sample(std::vector<int>& indices) {
+  t_ += 1;
+
+  // Grow the sampled set.
+  if (t_ > T_n_prime_ && n_ < num_points_) {
+    double T_n_next = T_n_ * (n_ + 1) / (n_ + 1 - sample_size_);
+    T_n_prime_ += std::ceil(T_n_next - T_n_);
+    T_n_ = T_n_next;
+    n_ += 1;
+  }
+
+  indices.clear();
+  if (T_n_prime_ < t_) {
+    // Draw the whole sample from the first n points.
+    drawDistinct(sample_size_, n_, indices);
+  } else {
+    // Always include the nth point.
+    drawDistinct(sample_size_ - 1, n_ - 1, indices);
+    indices.push_back(n_ - 1);
+  }
+}
+
+void ProsacSampler::drawDistinct(int k, int n, std::vector<int>& indices) {
+  boost::random::uniform_int_distribution<> dist(0, n - 1);
+  int begin = indices.size();
+
+  while (int(indices.size()) - begin < k) {
+    int i = dist(generator_);
+    if (std::find(indices.begin() + begin, indices.end(), i) ==
+        indices.end()) {
+      indices.push_back(i);
+    }
+  }
+}
+
+// Number of iterations to draw an all-inlier sample with given confidence.
+double requiredIterations(double inlier_fraction,
+                          int sample_size,
+                          double confidence,
+                          double sprt_threshold) {
+  // Probability that a sample is all inliers and passes the test.
+  double p = std::pow(inlier_fraction, sample_size) *
+      (1. - 1. / sprt_threshold);
+  if (!(p > 0)) {
+    return std::numeric_limits<double>::infinity();
+  }
+  if (p >= 1) {
+    return 1;
+  }
+  return std::log(1. - confidence) / std::log(1. - p);
+}
+
+// Finds which correspondences are inliers of a model.
+int findInliers(const std::vector<cv::Point2d>& x1,
+                const std::vector<cv::Point2d>& x2,
+                RansacModel model,
+                const cv::Matx33d& M,
+                double threshold,
+                std::vector<bool>& inliers) {
+  int n = x1.size();
+  double threshold2 = threshold * threshold;
+  int num_inliers = 0;
+
+  inliers.assign(n, false);
+  for (int i = 0; i < n; i += 1) {
+    if (modelError(model, M, x1[i], x2[i]) <= threshold2) {
+      inliers[i] = true;
+      num_inliers += 1;
+    }
+  }
+
+  return num_inliers;
+}
+
+bool ransac(const std::vector<cv::Point2d>& x1,
+            const std::vector<cv::Point2d>& x2,
+            const RansacOptions& options,
+            cv::Matx33d& model,
+            std::vector<bool>& inliers,
+            ThreadPool* pool) {
+  CHECK(x1.size() == x2.size());
+  int n = x1.size();
+  int m = sampleSize(options.model);
+
+  inliers.assign(n, false);
+  if (n < m) {
+    return false;
+  }
+
+  ProsacSampler sampler(n, m, options.seed);
+  std::vector<Hypothesis> hypotheses(options.batch_size);
+
+  bool found = false;
+  cv::Matx33d best_model;
+  int best_num_inliers = 0;
+  int iterations = 0;
+  double required = std::numeric_limits<double>::infinity();
+
+  while (iterations < options.max_iterations && iterations < required) {
+    // Draw samples sequentially, since PROSAC depends on their order.
+    int batch_size = std::min(options.batch_size,
+        options.max_iterations - iterations);
+    for (int i = 0; i < batch_size; i += 1) {
+      sampler.sample(hypotheses[i].sample);
+    }
+
+    // The test needs the fraction of inliers to a good model.
+    double epsilon = std::max(double(best_num_inliers) / n,
+        MIN_INLIER_FRACTION);
+    Sprt sprt(epsilon, options.sprt_delta, options.sprt_model_cost);
+
+    ScoreHypothesisFunction function(x1, x2, options.model, options.threshold,
+        sprt, hypotheses);
+    if (pool == NULL) {
+      for (int i = 0; i < batch_size; i += 1) {
+        function(i);
+      }
+    } else {
+      pool->parallelFor(0, batch_size, function);
+    }
+
+    // Take the first of the best, so that the result does not depend on the
+    // number of threads.
+    for (int i = 0; i < batch_size; i += 1) {
+      const Hypothesis& hypothesis = hypotheses[i];
+      if (hypothesis.valid && hypothesis.num_inliers > best_num_inliers) {
+        found = true;
+        best_model = hypothesis.model;
+        best_num_inliers = hypothesis.num_inliers;
+      }
+    }
+
+    iterations += batch_size;
+    if (found) {
+      required = requiredIterations(double(best_num_inliers) / n, m,
+          options.confidence, sprt.threshold);
+    }
+  }
+
+  DLOG(INFO) << "Drew " << iterations << " samples, best model has " <<
+      best_num_inliers << " / " << n << " inliers";
+
+  if (!found) {
+    return false;
+  }
+
+  // Fit the model to all of its inliers.
+  findInliers(x1, x2, options.model, best_model, options.threshold, inliers);
+  std::vector<int> indices;
+  for (int i = 0; i < n; i += 1) {
+    if (inliers[i]) {
+      indices.push_back(i);
+    }
+  }
+
+  cv::Matx33d refined;
+  std::vector<bool> refined_inliers;
+  if (fitModel(options.model, x1, x2, indices, refined)) {
+    int num_refined = findInliers(x1, x2, options.model, refined,
+        options.threshold, refined_inliers);
+
+    // Least squares is not robust, keep whichever is better.
+    if (num_refined >= best_num_inliers) {
+      best_model = refined;
+      inliers.swap(refined_inliers);
+    }
+  }
+
+  model = best_model;
+  return true;
+}
+
+}
+
+bool ransac(const std::vector<cv::Point2d>& x1,
+            const std::vector<cv::Point2d>& x2,
+            const RansacOptions& options,
+            cv::Matx33d& model,
+            std::vector<bool>& inliers) {
+  return ransac(x1, x2, options, model, inliers, NULL);
+}
+
+bool ransac(const std::vector<cv::Point2d>& x1,
+            const std::vector<cv::Point2d>& x2,
+            const RansacOptions& options,
+            cv::Matx33d& model,
+            std::vector<bool>& inliers,
+            ThreadPool& pool) {
+  return ransac(x1, x2, options, model, inliers, &pool);
+}
@@ -0,0 +1,59 @@
+#ifndef RANSAC_HPP_
+#define RANSAC_HPP_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+class ThreadPool;
+
+enum RansacModel {
+  // Convention is x2^T F x1 = 0.
+  FUNDAMENTAL_MATRIX_MODEL,
+  // Convention is x2 ~ H x1.
+  HOMOGRAPHY_MODEL
+};
+
+struct RansacOptions {
+  RansacModel model;
+  // Greatest error of an inlier in pixels. This is the Sampson distance for
+  // a fundamental matrix and the transfer distance for a homography.
+  double threshold;
+  // Probability of having drawn an all-inlier sample when stopping.
+  double confidence;
+  int max_iterations;
+  // Number of hypotheses which are drawn and then scored in parallel.
+  int batch_size;
+  // Probability that a point is consistent with a bad model, used by the
+  // sequential probability ratio test to stop scoring bad models early.
+  double sprt_delta;
+  // Time to fit one model in units of the time to score one point.
+  double sprt_model_cost;
+  unsigned int seed;
+
+  RansacOptions();
+};
+
+// Robustly fits a model to correspondences x1[i] <-> x2[i].
+//
+// Samples are drawn using PROSAC, so the correspondences must be ordered from
+// most to least likely to be correct, e.g. by descriptor distance. Each model
+// is scored using the sequential probability ratio test of Matas and Chum,
+// "Randomized RANSAC with Sequential Probability Ratio Test", ICCV 2005.
+//
+// Outputs the model fit to all inliers of the best hypothesis and whether
+// each correspondence is an inlier of it. Returns false if there are too few
+// correspondences or no model was found.
+bool ransac(const std::vector<cv::Point2d>& x1,
+            const std::vector<cv::Point2d>& x2,
+            const RansacOptions& options,
+            cv::Matx33d& model,
+            std::vector<bool>& inliers);
+// Scores each batch of hypotheses using the threads of the pool.
+bool ransac(const std::vector<cv::Point2d>& x1,
+            const std::vector<cv::Point2d>& x2,
+            const RansacOptions& options,
+            cv::Matx33d& model,
+            std::vector<bool>& inliers,
+            ThreadPool& pool);
+
+#endif
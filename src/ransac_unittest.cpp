@@ -0,0 +1,163 @@
+#include "ransac.hpp"
+#include <cmath>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "geometry.hpp"
+#include "util/thread-pool.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+const int NUM_INLIERS = 200;
+const int NUM_OUTLIERS = 100;
+// Least distance of an outlier from the true model, in pixels.
+const double MIN_OUTLIER_DISTANCE = 10;
+
+cv::Point2d apply(const cv::Matx33d& H, const cv::Point2d& x) {
+  cv::Vec3d y = H * cv::Vec3d(x.x, x.y, 1);
+  return cv::Point2d(y[0] / y[2], y[1] / y[2]);
+}
+
+// Correspondences of a homography with small noise, mixed with outliers which
+// are far from it. Outliers are marked false.
+void homographyMatches(const cv::Matx33d& H,
+                       std::vector<cv::Point2d>& x1,
+                       std::vector<cv::Point2d>& x2,
+                       std::vector<bool>& is_inlier) {
+  cv::RNG rng(1);
+  x1.clear();
+  x2.clear();
+  is_inlier.clear();
+
+  for (int i = 0; i < NUM_INLIERS + NUM_OUTLIERS; i += 1) {
+    cv::Point2d a(rng.uniform(0., 640.), rng.uniform(0., 480.));
+    cv::Point2d b = apply(H, a);
+    bool inlier = (i % 3 != 2 || i >= 3 * NUM_OUTLIERS);
+    if (inlier) {
+      b += cv::Point2d(rng.gaussian(0.1), rng.gaussian(0.1));
+    } else {
+      double angle = rng.uniform(0., 2 * M_PI);
+      double distance = rng.uniform(MIN_OUTLIER_DISTANCE, 100.);
+      b += distance * cv::Point2d(std::cos(angle), std::sin(angle));
+    }
+    x1.push_back(a);
+    x2.push_back(b);
+    is_inlier.push_back(inlier);
+  }
+}
+
+// Correspondences of two views of random points with small noise, mixed with
+// outliers which are far from their epipolar lines.
+void fundamentalMatches(cv::Matx33d& F,
+                        std::vector<cv::Point2d>& x1,
+                        std::vector<cv::Point2d>& x2,
+                        std::vector<bool>& is_inlier) {
+  cv::Matx33d K(500, 0, 320, 0, 500, 240, 0, 0, 1);
+  // Rotation about the vertical axis and a sideways translation.
+  double theta = 0.1;
+  cv::Matx33d R(std::cos(theta), 0, std::sin(theta),
+                0, 1, 0,
+                -std::sin(theta), 0, std::cos(theta));
+  cv::Vec3d t(-1, 0.1, 0.05);
+  cv::Matx33d T(0, -t[2], t[1], t[2], 0, -t[0], -t[1], t[0], 0);
+  F = K.inv().t() * T * R * K.inv();
+
+  cv::RNG rng(2);
+  x1.clear();
+  x2.clear();
+  is_inlier.clear();
+
+  for (int i = 0; i < NUM_INLIERS + NUM_OUTLIERS; i += 1) {
+    cv::Vec3d X(rng.uniform(-2., 2.), rng.uniform(-1.5, 1.5),
+        rng.uniform(4., 8.));
+    cv::Vec3d y1 = K * X;
+    cv::Vec3d y2 = K * (R * X + t);
+    cv::Point2d a(y1[0] / y1[2], y1[1] / y1[2]);
+    cv::Point2d b(y2[0] / y2[2], y2[1] / y2[2]);
+
+    bool inlier = (i % 3 != 2 || i >= 3 * NUM_OUTLIERS);
+    if (inlier) {
+      b += cv::Point2d(rng.gaussian(0.1), rng.gaussian(0.1));
+    } else {
+      // Resample until far from the epipolar line.
+      do {
+        b = cv::Point2d(rng.uniform(0., 640.), rng.uniform(0., 480.));
+      } while (sampsonError(F, a, b) <
+          MIN_OUTLIER_DISTANCE * MIN_OUTLIER_DISTANCE);
+    }
+    x1.push_back(a);
+    x2.push_back(b);
+    is_inlier.push_back(inlier);
+  }
+}
+
+}
+
+TEST(Ransac, Homography) {
+  cv::Matx33d H(1.1, 0.05, 10,
+                -0.03, 0.95, -5,
+                1e-4, 0, 1);
+  std::vector<cv::Point2d> x1;
+  std::vector<cv::Point2d> x2;
+  std::vector<bool> expected;
+  homographyMatches(H, x1, x2, expected);
+
+  RansacOptions options;
+  options.model = HOMOGRAPHY_MODEL;
+  cv::Matx33d M;
+  std::vector<bool> inliers;
+  ASSERT_TRUE(ransac(x1, x2, options, M, inliers));
+  EXPECT_EQ(expected, inliers);
+
+  // Same model up to the noise.
+  for (int i = 0; i < int(x1.size()); i += 1) {
+    EXPECT_LT(cv::norm(apply(M, x1[i]) - apply(H, x1[i])), 0.5);
+  }
+
+  // The result does not depend on the number of threads.
+  ThreadPool pool(3);
+  cv::Matx33d M_parallel;
+  std::vector<bool> parallel_inliers;
+  ASSERT_TRUE(ransac(x1, x2, options, M_parallel, parallel_inliers, pool));
+  EXPECT_EQ(inliers, parallel_inliers);
+  EXPECT_EQ(0., cv::norm(cv::Mat(M), cv::Mat(M_parallel), cv::NORM_INF));
+}
+
+TEST(Ransac, FundamentalMatrix) {
+  cv::Matx33d F;
+  std::vector<cv::Point2d> x1;
+  std::vector<cv::Point2d> x2;
+  std::vector<bool> expected;
+  fundamentalMatches(F, x1, x2, expected);
+
+  RansacOptions options;
+  options.model = FUNDAMENTAL_MATRIX_MODEL;
+  cv::Matx33d M;
+  std::vector<bool> inliers;
+  ASSERT_TRUE(ransac(x1, x2, options, M, inliers));
+  EXPECT_EQ(expected, inliers);
+
+  // The true correspondences satisfy the estimate.
+  for (int i = 0; i < int(x1.size()); i += 1) {
+    if (expected[i]) {
+      EXPECT_LT(sampsonError(M, x1[i], x2[i]), 1.);
+    }
+  }
+
+  ThreadPool pool(3);
+  cv::Matx33d M_parallel;
+  std::vector<bool> parallel_inliers;
+  ASSERT_TRUE(ransac(x1, x2, options, M_parallel, parallel_inliers, pool));
+  EXPECT_EQ(inliers, parallel_inliers);
+  EXPECT_EQ(0., cv::norm(cv::Mat(M), cv::Mat(M_parallel), cv::NORM_INF));
+}
+
+TEST(Ransac, TooFewCorrespondences) {
+  std::vector<cv::Point2d> x1(3, cv::Point2d(0, 0));
+  std::vector<cv::Point2d> x2(3, cv::Point2d(1, 1));
+  RansacOptions options;
+  options.model = HOMOGRAPHY_MODEL;
+  cv::Matx33d M;
+  std::vector<bool> inliers;
+  EXPECT_FALSE(ransac(x1, x2, options, M, inliers));
+}
@@ -0,0 +1,244 @@
+#include "ray_track_search.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <glog/logging.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "viterbi.hpp"
+#include "util/thread-pool.hpp"
+
+namespace {
+
+// The points of many quantized rays, one array per coordinate, so that the
+// distances from a point to every point of a ray can be computed together.
+// Ray i is [offsets[i], offsets[i + 1]) of each array.
+struct PackedRaySet {
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> z;
+  std::vector<int> offsets;
+
+  explicit PackedRaySet(const QuantizedRaySet& rays);
+};
+
+PackedRaySet::PackedRaySet(const QuantizedRaySet& rays)
+    : x(), y(), z(), offsets(1, 0) {
+  for (int i = 0; i < rays.size(); i += 1) {
+    const RayPoint* point;
+    for (point = rays.begin(i); point != rays.end(i); ++point) {
+      x.push_back(point->point.x);
+      y.push_back(point->point.y);
+      z.push_back(point->point.z);
+    }
+    offsets.push_back(x.size());
+  }
+}
+
+// Computes costs[i] = lambda * |p - q_i| for the n points q_i.
+void fillDistanceCosts(double px,
+                       double py,
+                       double pz,
+                       const double* x,
+                       const double* y,
+                       const double* z,
+                       int n,
+                       double lambda,
+                       double* costs) {
+  int i = 0;
+
+#ifdef __SSE2__
+  __m128d u = _mm_set1_pd(px);
+  __m128d v = _mm_set1_pd(py);
+  __m128d w = _mm_set1_pd(pz);
+  __m128d scale = _mm_set1_pd(lambda);
+
+  for (; i + 2 <= n; i += 2) {
+    __m128d dx = _mm_sub_pd(_mm_loadu_pd(x + i), u);
+    __m128d dy = _mm_sub_pd(_mm_loadu_pd(y + i), v);
+    __m128d dz = _mm_sub_pd(_mm_loadu_pd(z + i), w);
+    __m128d d = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)),
+        _mm_mul_pd(dz, dz));
+    _mm_storeu_pd(costs + i, _mm_mul_pd(scale, _mm_sqrt_pd(d)));
+  }
+#endif
+
+  for (; i < n; i += 1) {
+    double dx = x[i] - px;
+    double dy = y[i] - py;
+    double dz = z[i] - pz;
+    costs[i] = lambda * std::sqrt(dx * dx + dy * dy + dz * dz);
+  }
+}
+
+// Constructs the cost of moving from each position on ray t - 1 to each on
+// ray t, which is proportional to the distance in 3D. Row j is for point j
+// of ray t.
+void constructBinaryCosts(const PackedRaySet& rays,
+                          int t,
+                          double lambda2,
+                          cv::Mat& costs) {
+  int begin1 = rays.offsets[t - 1];
+  int n = rays.offsets[t] - begin1;
+  int begin2 = rays.offsets[t];
+  int m = rays.offsets[t + 1] - begin2;
+
+  costs.create(m, n, cv::DataType<double>::type);
+  for (int j = 0; j < m; j += 1) {
+    fillDistanceCosts(rays.x[begin2 + j], rays.y[begin2 + j],
+        rays.z[begin2 + j], &rays.x[begin1], &rays.y[begin1],
+        &rays.z[begin1], n, lambda2, costs.ptr<double>(j));
+  }
+}
+
+// Constructs the binary costs of one step of one track of a batch.
+// Step k is from ray steps[k] - 1 to ray steps[k], of track tracks[k].
+// For use with ThreadPool::parallelFor().
+class ConstructBinaryCostsFunction {
+  public:
+    ConstructBinaryCostsFunction(const PackedRaySet& rays,
+                                 const std::vector<int>& offsets,
+                                 const std::vector<int>& tracks,
+                                 const std::vector<int>& steps,
+                                 double lambda2,
+                                 std::vector<std::vector<cv::Mat> >& costs)
+        : rays_(&rays),
+          offsets_(&offsets),
+          tracks_(&tracks),
+          steps_(&steps),
+          lambda2_(lambda2),
+          costs_(&costs) {}
+
+    void operator()(int k) const {
+      int i = (*tracks_)[k];
+      int t = (*steps_)[k];
+      int first = (*offsets_)[i];
+      constructBinaryCosts(*rays_, t, lambda2_, (*costs_)[i][t - first - 1]);
+    }
+
+  private:
+    const PackedRaySet* rays_;
+    const std::vector<int>* offsets_;
+    const std::vector<int>* tracks_;
+    const std::vector<int>* steps_;
+    double lambda2_;
+    std::vector<std::vector<cv::Mat> >* costs_;
+};
+
+// Constructs the dynamic programs which find each track in the other views.
+// The quantized rays of track i are rays [offsets[i], offsets[i + 1]). The
+// binary costs of every step of every track are constructed in parallel.
+//
+// There is no appearance term yet, so every position costs nothing. When one
+// is added, the projections of every ray point into every camera should be
+// computed once here for all steps.
+void constructViterbiProblems(
+    const QuantizedRaySet& rays,
+    const std::vector<int>& offsets,
+    double lambda2,
+    std::vector<std::deque<std::vector<double> > >& unary_costs,
+    std::vector<std::vector<cv::Mat> >& binary_costs,
+    ThreadPool& pool) {
+  int n = offsets.size() - 1;
+  PackedRaySet packed(rays);
+
+  unary_costs.assign(n, std::deque<std::vector<double> >());
+  binary_costs.assign(n, std::vector<cv::Mat>());
+  std::vector<int> tracks;
+  std::vector<int> steps;
+  for (int i = 0; i < n; i += 1) {
+    int first = offsets[i];
+    int count = offsets[i + 1] - first;
+
+    for (int t = first; t < first + count; t += 1) {
+      unary_costs[i].push_back(std::vector<double>(rays.length(t), 0.));
+    }
+
+    binary_costs[i].resize(std::max(count - 1, 0));
+    for (int t = first + 1; t < first + count; t += 1) {
+      tracks.push_back(i);
+      steps.push_back(t);
+    }
+  }
+
+  pool.parallelFor(0, steps.size(), ConstructBinaryCostsFunction(packed,
+        offsets, tracks, steps, lambda2, binary_costs));
+}
+
+}
+
+void solveViterbiProblems(const QuantizedRaySet& rays,
+                          const std::vector<int>& offsets,
+                          double lambda2,
+                          std::vector<std::vector<int> >& solutions,
+                          ThreadPool& pool) {
+  int n = offsets.size() - 1;
+
+  std::vector<std::deque<std::vector<double> > > unary_costs;
+  std::vector<std::vector<cv::Mat> > binary_costs;
+  constructViterbiProblems(rays, offsets, lambda2, unary_costs,
+      binary_costs, pool);
+
+  std::vector<ViterbiProblem> problems;
+  for (int i = 0; i < n; i += 1) {
+    problems.push_back(ViterbiProblem(unary_costs[i], binary_costs[i]));
+  }
+  std::vector<double> values;
+  solveViterbiBatch(problems, solutions, values, pool);
+}
+
+void findSolutionBands(const QuantizedRaySet& rays,
+                       const std::vector<int>& offsets,
+                       const std::vector<std::vector<int> >& solutions,
+                       int band,
+                       std::vector<std::pair<double, double> >& bounds) {
+  CHECK(band >= 0) << "Band must not be negative";
+  int n = offsets.size() - 1;
+  bounds.assign(rays.size(),
+      std::make_pair(0., std::numeric_limits<double>::infinity()));
+
+  for (int i = 0; i < n; i += 1) {
+    for (int t = offsets[i]; t < offsets[i + 1]; t += 1) {
+      int length = rays.length(t);
+      if (length == 0) {
+        continue;
+      }
+      int k = solutions[i][t - offsets[i]];
+      const RayPoint* points = rays.begin(t);
+
+      if (k - band > 0) {
+        bounds[t].first = points[k - band].lambda;
+      }
+      if (k + band < length - 1) {
+        bounds[t].second = points[k + band].lambda;
+      }
+    }
+  }
+}
+
+void searchRayTracks(const std::vector<cv::Point2d>& projections,
+                     const std::vector<int>& offsets,
+                     const RayQuantizer& quantizer,
+                     const RayQuantizer* coarse_quantizer,
+                     int band,
+                     double lambda2,
+                     QuantizedRaySet& rays,
+                     std::vector<std::vector<int> >& solutions,
+                     ThreadPool& pool) {
+  if (coarse_quantizer != NULL) {
+    coarse_quantizer->quantize(projections, rays, pool);
+    LOG(INFO) << "Solving coarse dynamic programs";
+    solveViterbiProblems(rays, offsets, lambda2, solutions, pool);
+
+    std::vector<std::pair<double, double> > bounds;
+    findSolutionBands(rays, offsets, solutions, band, bounds);
+    LOG(INFO) << "Quantizing 3D rays within coarse solutions";
+    quantizer.quantize(projections, bounds, rays, pool);
+  } else {
+    quantizer.quantize(projections, rays, pool);
+  }
+
+  LOG(INFO) << "Solving dynamic programs";
+  solveViterbiProblems(rays, offsets, lambda2, solutions, pool);
+}
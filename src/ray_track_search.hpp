@@ -0,0 +1,44 @@
+#ifndef RAY_TRACK_SEARCH_HPP_
+#define RAY_TRACK_SEARCH_HPP_
+
+#include <utility>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "quantize_ray.hpp"
+
+class ThreadPool;
+
+// Finds the best position on every ray of each track. The rays of track i
+// are [offsets[i], offsets[i + 1]). Moving between consecutive rays costs
+// lambda2 times the distance in 3D.
+void solveViterbiProblems(const QuantizedRaySet& rays,
+                          const std::vector<int>& offsets,
+                          double lambda2,
+                          std::vector<std::vector<int> >& solutions,
+                          ThreadPool& pool);
+
+// Finds the interval of lambda within band positions either side of the
+// solution on each ray. The interval is unbounded where the band reaches an
+// end of the ray, so that the fine search can go further than the coarse
+// one did. The band must not be negative.
+void findSolutionBands(const QuantizedRaySet& rays,
+                       const std::vector<int>& offsets,
+                       const std::vector<std::vector<int> >& solutions,
+                       int band,
+                       std::vector<std::pair<double, double> >& bounds);
+
+// Quantizes the ray through each projection and solves for the tracks.
+// If there is a coarse quantizer, the tracks are first found on the coarse
+// rays, and then only the fine points within the band of each coarse
+// solution are searched. Outputs the fine rays and the solutions on them.
+void searchRayTracks(const std::vector<cv::Point2d>& projections,
+                     const std::vector<int>& offsets,
+                     const RayQuantizer& quantizer,
+                     const RayQuantizer* coarse_quantizer,
+                     int band,
+                     double lambda2,
+                     QuantizedRaySet& rays,
+                     std::vector<std::vector<int> >& solutions,
+                     ThreadPool& pool);
+
+#endif
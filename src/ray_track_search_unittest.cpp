@@ -0,0 +1,165 @@
+#include "ray_track_search.hpp"
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "util/thread-pool.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+const double DELTA = 1;
+const double COARSE_DELTA = 4;
+const double LAMBDA2 = 1;
+
+// Pinhole camera at the given center, looking along -z.
+Camera makeCamera(const cv::Point3d& center) {
+  CameraProperties intrinsics;
+  intrinsics.image_size = cv::Size(64, 48);
+  intrinsics.focal_x = 50;
+  intrinsics.focal_y = 50;
+  intrinsics.principal_point = cv::Point2d(32, 24);
+  // Almost no distortion. Zero is not defined.
+  intrinsics.distort_w = 1e-3;
+
+  CameraPose extrinsics;
+  extrinsics.rotation = cv::Matx33d::eye();
+  extrinsics.center = center;
+
+  return Camera(intrinsics, extrinsics);
+}
+
+std::vector<Camera> makeCameras() {
+  std::vector<Camera> cameras;
+  cameras.push_back(makeCamera(cv::Point3d(0, 0, 0)));
+  cameras.push_back(makeCamera(cv::Point3d(0.5, 0, 1)));
+  return cameras;
+}
+
+// Two tracks in view 0, of three frames and of two.
+void makeTracks(std::vector<cv::Point2d>& projections,
+                std::vector<int>& offsets) {
+  projections.clear();
+  projections.push_back(cv::Point2d(30, 20));
+  projections.push_back(cv::Point2d(32, 22));
+  projections.push_back(cv::Point2d(34, 24));
+  projections.push_back(cv::Point2d(10, 10));
+  projections.push_back(cv::Point2d(12, 11));
+
+  offsets.clear();
+  offsets.push_back(0);
+  offsets.push_back(3);
+  offsets.push_back(5);
+}
+
+// A ray of the given lambdas.
+void addRay(const std::vector<double>& lambdas, QuantizedRaySet& rays) {
+  std::vector<RayPoint> ray;
+  for (int i = 0; i < int(lambdas.size()); i += 1) {
+    ray.push_back(RayPoint(lambdas[i], cv::Point3d(0, 0, -lambdas[i])));
+  }
+  rays.add(ray);
+}
+
+}
+
+TEST(FindSolutionBands, ExtendsBandToEndsOfRay) {
+  std::vector<double> lambdas;
+  for (int i = 0; i < 10; i += 1) {
+    lambdas.push_back(i + 1);
+  }
+  // One track of three rays.
+  QuantizedRaySet rays;
+  addRay(lambdas, rays);
+  addRay(lambdas, rays);
+  addRay(lambdas, rays);
+  std::vector<int> offsets;
+  offsets.push_back(0);
+  offsets.push_back(3);
+  std::vector<std::vector<int> > solutions(1);
+  solutions[0].push_back(5);
+  solutions[0].push_back(1);
+  solutions[0].push_back(8);
+
+  double inf = std::numeric_limits<double>::infinity();
+  std::vector<std::pair<double, double> > bounds;
+  findSolutionBands(rays, offsets, solutions, 2, bounds);
+  ASSERT_EQ(3u, bounds.size());
+  EXPECT_EQ(std::make_pair(4., 8.), bounds[0]);
+  EXPECT_EQ(std::make_pair(0., 4.), bounds[1]);
+  EXPECT_EQ(std::make_pair(7., inf), bounds[2]);
+
+  // A band of zero is just the solution, except at the ends.
+  findSolutionBands(rays, offsets, solutions, 0, bounds);
+  EXPECT_EQ(std::make_pair(6., 6.), bounds[0]);
+  EXPECT_EQ(std::make_pair(2., 2.), bounds[1]);
+  EXPECT_EQ(std::make_pair(9., 9.), bounds[2]);
+}
+
+TEST(SearchRayTracks, WideBandSearchesWholeRay) {
+  std::vector<Camera> cameras = makeCameras();
+  RayQuantizer quantizer(cameras, 0, DELTA);
+  RayQuantizer coarse_quantizer(cameras, 0, COARSE_DELTA);
+  std::vector<cv::Point2d> projections;
+  std::vector<int> offsets;
+  makeTracks(projections, offsets);
+  ThreadPool pool(0);
+
+  QuantizedRaySet fine_rays;
+  std::vector<std::vector<int> > fine_solutions;
+  searchRayTracks(projections, offsets, quantizer, NULL, 0, LAMBDA2,
+      fine_rays, fine_solutions, pool);
+
+  // The band reaches both ends of every coarse ray.
+  QuantizedRaySet rays;
+  std::vector<std::vector<int> > solutions;
+  searchRayTracks(projections, offsets, quantizer, &coarse_quantizer, 1000,
+      LAMBDA2, rays, solutions, pool);
+
+  ASSERT_EQ(fine_rays.size(), rays.size());
+  for (int t = 0; t < rays.size(); t += 1) {
+    ASSERT_EQ(fine_rays.length(t), rays.length(t));
+    for (int k = 0; k < rays.length(t); k += 1) {
+      EXPECT_EQ(fine_rays.begin(t)[k].lambda, rays.begin(t)[k].lambda);
+    }
+  }
+  EXPECT_TRUE(fine_solutions == solutions);
+}
+
+TEST(SearchRayTracks, CoarseToFineFindsFineSolution) {
+  std::vector<Camera> cameras = makeCameras();
+  RayQuantizer quantizer(cameras, 0, DELTA);
+  RayQuantizer coarse_quantizer(cameras, 0, COARSE_DELTA);
+  std::vector<cv::Point2d> projections;
+  std::vector<int> offsets;
+  makeTracks(projections, offsets);
+  ThreadPool pool(0);
+
+  QuantizedRaySet fine_rays;
+  std::vector<std::vector<int> > fine_solutions;
+  searchRayTracks(projections, offsets, quantizer, NULL, 0, LAMBDA2,
+      fine_rays, fine_solutions, pool);
+
+  QuantizedRaySet rays;
+  std::vector<std::vector<int> > solutions;
+  searchRayTracks(projections, offsets, quantizer, &coarse_quantizer, 2,
+      LAMBDA2, rays, solutions, pool);
+
+  // The fine points within a band start from the coarse point at its end,
+  // so they are not those of the whole ray. The solutions agree to within
+  // the coarse resolution in the other view.
+  int n = offsets.size() - 1;
+  ASSERT_EQ(n, int(solutions.size()));
+  ASSERT_EQ(n, int(fine_solutions.size()));
+  for (int i = 0; i < n; i += 1) {
+    ASSERT_EQ(fine_solutions[i].size(), solutions[i].size());
+    for (int t = offsets[i]; t < offsets[i + 1]; t += 1) {
+      ASSERT_GT(rays.length(t), 0);
+      cv::Point3d expected = fine_rays.begin(t)[
+          fine_solutions[i][t - offsets[i]]].point;
+      cv::Point3d actual = rays.begin(t)[solutions[i][t - offsets[i]]].point;
+      double error = cv::norm(cameras[1].project(actual) -
+          cameras[1].project(expected));
+      EXPECT_LE(error, COARSE_DELTA) << "Track " << i << ", ray " << t;
+    }
+  }
+}
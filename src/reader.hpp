@@ -1,14 +1,35 @@
 #ifndef READER_HPP_
 #define READER_HPP_
 
+#include <string>
+#include <vector>
 #include <opencv2/core/core.hpp>
 
+// The values of the fields of a map of numbers, parsed from text. Each field
+// holds a number or a sequence of them.
+struct FieldValues {
+  std::vector<double> values;
+  // Field i has values [first[i], last[i]).
+  std::vector<int> first;
+  std::vector<int> last;
+
+  int size(int field) const;
+  const double* begin(int field) const;
+};
+
 // Describes a way of deserializing T.
 template<class T>
 class Reader {
   public:
     virtual ~Reader() {}
     virtual bool read(const cv::FileNode& node, T& x) = 0;
+
+    // Readers of elements which are maps of numbers can list their keys, so
+    // that a sequence of them is parsed from text without a node tree. See
+    // streamSequence(). Returns false if the reader does not.
+    virtual bool fields(std::vector<std::string>& keys) const;
+    // Reads an element from the values of the keys listed by fields().
+    virtual bool readFields(const FieldValues& values, T& x);
 };
 
 // Parses a variable of type T and assigns it to a variable of type X.
@@ -16,6 +37,11 @@ class Reader {
 template<class T, class X>
 bool read(const cv::FileNode& node, X& x);
 
+// Same as above for a field which holds one number. Returns false if it holds
+// a sequence.
+template<class T, class X>
+bool readField(const FieldValues& values, int field, X& x);
+
 // Loads anything which has an appropriate Reader.
 template<class T>
 bool load(const std::string& filename, T& x, Reader<T>& reader);
@@ -1,5 +1,23 @@
 #include <glog/logging.h>
 
+inline int FieldValues::size(int field) const {
+  return last[field] - first[field];
+}
+
+inline const double* FieldValues::begin(int field) const {
+  return values.empty() ? NULL : &values.front() + first[field];
+}
+
+template<class T>
+bool Reader<T>::fields(std::vector<std::string>&) const {
+  return false;
+}
+
+template<class T>
+bool Reader<T>::readFields(const FieldValues&, T&) {
+  return false;
+}
+
 template<class T, class X>
 bool read(const cv::FileNode& node, X& x) {
   if (node.type() == cv::FileNode::NONE) {
@@ -11,6 +29,17 @@ bool read(const cv::FileNode& node, X& x) {
   return true;
 }
 
+template<class T, class X>
+bool readField(const FieldValues& values, int field, X& x) {
+  if (values.size(field) != 1) {
+    return false;
+  }
+
+  x = static_cast<T>(*values.begin(field));
+
+  return true;
+}
+
 template<class T>
 bool load(const std::string& filename, T& x, Reader<T>& reader) {
   // Try to open file.
@@ -0,0 +1,106 @@
+#ifndef RECURSIVE_CUT_HPP_
+#define RECURSIVE_CUT_HPP_
+
+#include <ctime>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "clustering_checkpoint.hpp"
+#include "util/thread-pool.hpp"
+
+// Decides what to do with each subgraph of a recursive cut.
+//
+// Graph is a boost::subgraph, or a type with the same members and free
+// functions, found by argument-dependent lookup, such as VertexSubgraph.
+template<class Graph>
+class SubgraphDivider {
+  public:
+    enum Decision {
+      DISCARD_SUBGRAPH,
+      ACCEPT_SUBGRAPH,
+      DIVIDE_SUBGRAPH
+    };
+
+    virtual ~SubgraphDivider() {}
+
+    // Labels the vertices of a subgraph which should be divided.
+    // Called by several threads at once, so must not modify the graph.
+    virtual Decision examine(const Graph& subgraph,
+                             std::vector<int>& labels) const = 0;
+
+    // Creates the subgraphs which replace a subgraph, given its labels.
+    // Called by one thread at a time.
+    virtual void divide(Graph& subgraph,
+                        const std::vector<int>& labels,
+                        std::vector<Graph*>& children) const = 0;
+};
+
+// Divides subgraphs concurrently until each is accepted or discarded.
+//
+// Any thread takes the largest subgraph which remains, since large cuts are
+// the slowest. Subgraphs are only created while holding a lock, since they
+// modify their parents. If a file is given, the subgraphs which remain are
+// saved periodically in the background.
+template<class Graph>
+class ParallelRecursiveCut {
+  public:
+    ParallelRecursiveCut(Graph& graph,
+                         const SubgraphDivider<Graph>& divider,
+                         ClusteringProgram program);
+
+    // An empty filename disables checkpoints. Interval is in seconds.
+    void setCheckpoint(const std::string& filename, int interval);
+
+    // Starts from subgraphs of the graph.
+    void init(const std::vector<Graph*>& subgraphs);
+    // Starts from a checkpoint. Returns false if it is not of this graph.
+    bool resume(const ClusteringCheckpoint& checkpoint);
+
+    // Returns false if a checkpoint could not be saved.
+    bool run(ThreadPool& pool);
+
+    // Accepted subgraphs, in order of their first vertex.
+    const std::vector<Graph*>& subgraphs() const;
+    int numPending() const;
+    int numCuts() const;
+
+  private:
+    // Progress counters of a checkpoint.
+    enum Counter {
+      NUM_CUTS = 0,
+      NUM_COUNTERS = 1
+    };
+
+    typedef std::multimap<int, Graph*> PendingList;
+
+    void push(Graph* subgraph);
+    void work(int worker);
+    // Caller must hold the lock.
+    void checkpointIfDue();
+
+    Graph* graph_;
+    const SubgraphDivider<Graph>* divider_;
+    ClusteringProgram program_;
+    std::string checkpoint_file_;
+    int checkpoint_interval_;
+
+    // Subgraphs by number of vertices.
+    PendingList pending_;
+    // Subgraphs which are being examined.
+    std::set<Graph*> active_;
+    std::vector<Graph*> subgraphs_;
+    int num_cuts_;
+
+    boost::mutex mutex_;
+    // Signalled when a subgraph is finished.
+    boost::condition_variable finished_;
+    CheckpointWriter* writer_;
+    std::time_t last_checkpoint_;
+};
+
+#include "recursive_cut.inl"
+
+#endif
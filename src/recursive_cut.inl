@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <glog/logging.h>
+
+// Orders disjoint subgraphs by their first vertex in the root graph.
+template<class Graph>
+bool firstVertexBefore(const Graph* lhs, const Graph* rhs) {
+  return lhs->local_to_global(0) < rhs->local_to_global(0);
+}
+
+// Appends the vertices of a subgraph in the root graph, in local order.
+template<class Graph>
+void addSubgraphVertices(const Graph& subgraph, VertexGroups& groups) {
+  int n = num_vertices(subgraph);
+  for (int v = 0; v < n; v += 1) {
+    groups.vertices.push_back(subgraph.local_to_global(v));
+  }
+  groups.close();
+}
+
+// Creates a subgraph of the root for each group, with the same local order.
+// Returns false if a vertex is not in the graph.
+template<class Graph>
+bool restoreSubgraphs(Graph& graph,
+                      const VertexGroups& groups,
+                      std::vector<Graph*>& subgraphs) {
+  int n = num_vertices(graph);
+  subgraphs.clear();
+
+  for (int i = 0; i < groups.numGroups(); i += 1) {
+    Graph* subgraph = &graph.create_subgraph();
+    for (uint64_t j = groups.offsets[i]; j < groups.offsets[i + 1]; j += 1) {
+      int vertex = groups.vertices[j];
+      if (vertex < 0 || vertex >= n) {
+        LOG(WARNING) << "Checkpoint contains vertex " << vertex << " of " <<
+            n;
+        return false;
+      }
+      add_vertex(vertex, *subgraph);
+    }
+    subgraphs.push_back(subgraph);
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Graph>
+ParallelRecursiveCut<Graph>::ParallelRecursiveCut(
+    Graph& graph,
+    const SubgraphDivider<Graph>& divider,
+    ClusteringProgram program)
+    : graph_(&graph),
+      divider_(&divider),
+      program_(program),
+      checkpoint_file_(),
+      checkpoint_interval_(0),
+      pending_(),
+      active_(),
+      subgraphs_(),
+      num_cuts_(0),
+      mutex_(),
+      finished_(),
+      writer_(NULL),
+      last_checkpoint_(0) {}
+
+template<class Graph>
+void ParallelRecursiveCut<Graph>::setCheckpoint(const std::string& filename,
+                                                int interval) {
+  checkpoint_file_ = filename;
+  checkpoint_interval_ = interval;
+}
+
+template<class Graph>
+void ParallelRecursiveCut<Graph>::init(const std::vector<Graph*>& subgraphs) {
+  pending_.clear();
+  subgraphs_.clear();
+  num_cuts_ = 0;
+
+  typename std::vector<Graph*>::const_iterator subgraph;
+  for (subgraph = subgraphs.begin(); subgraph != subgraphs.end(); ++subgraph) {
+    push(*subgraph);
+  }
+}
+
+template<class Graph>
+bool ParallelRecursiveCut<Graph>::resume(
+    const ClusteringCheckpoint& checkpoint) {
+  if (checkpoint.program != uint32_t(program_) ||
+      checkpoint.num_vertices != num_vertices(*graph_) ||
+      checkpoint.num_edges != num_edges(*graph_)) {
+    LOG(WARNING) << "Checkpoint is not of this graph";
+    return false;
+  }
+  if (checkpoint.groups.size() != 2 ||
+      checkpoint.counters.size() != NUM_COUNTERS) {
+    LOG(WARNING) << "Malformed checkpoint";
+    return false;
+  }
+
+  std::vector<Graph*> pending;
+  std::vector<Graph*> subgraphs;
+  if (!restoreSubgraphs(*graph_, checkpoint.groups[0], pending) ||
+      !restoreSubgraphs(*graph_, checkpoint.groups[1], subgraphs)) {
+    return false;
+  }
+
+  init(pending);
+  subgraphs_.swap(subgraphs);
+  num_cuts_ = checkpoint.counters[NUM_CUTS];
+  return true;
+}
+
+template<class Graph>
+bool ParallelRecursiveCut<Graph>::run(ThreadPool& pool) {
+  boost::scoped_ptr<CheckpointWriter> writer;
+  if (!checkpoint_file_.empty()) {
+    writer.reset(new CheckpointWriter(checkpoint_file_));
+  }
+  writer_ = writer.get();
+  last_checkpoint_ = std::time(NULL);
+
+  // Every worker takes subgraphs until none remain. The calling thread is
+  // one of them.
+  int num_workers = pool.numThreads() + 1;
+  pool.parallelFor(0, num_workers,
+      boost::bind(&ParallelRecursiveCut<Graph>::work, this, _1));
+  CHECK(pending_.empty() && active_.empty());
+
+  // The order of completion depends on the threads.
+  std::sort(subgraphs_.begin(), subgraphs_.end(), firstVertexBefore<Graph>);
+
+  writer_ = NULL;
+  return !writer || writer->wait();
+}
+
+template<class Graph>
+const std::vector<Graph*>& ParallelRecursiveCut<Graph>::subgraphs() const {
+  return subgraphs_;
+}
+
+template<class Graph>
+int ParallelRecursiveCut<Graph>::numPending() const {
+  return pending_.size();
+}
+
+template<class Graph>
+int ParallelRecursiveCut<Graph>::numCuts() const {
+  return num_cuts_;
+}
+
+template<class Graph>
+void ParallelRecursiveCut<Graph>::push(Graph* subgraph) {
+  pending_.insert(std::make_pair(int(num_vertices(*subgraph)), subgraph));
+}
+
+template<class Graph>
+void ParallelRecursiveCut<Graph>::work(int) {
+  boost::mutex::scoped_lock lock(mutex_);
+
+  while (true) {
+    checkpointIfDue();
+
+    // Other workers may yet divide a subgraph.
+    while (pending_.empty() && !active_.empty()) {
+      finished_.wait(lock);
+    }
+    if (pending_.empty()) {
+      break;
+    }
+
+    // Take the largest.
+    typename PendingList::iterator last = pending_.end();
+    --last;
+    Graph* subgraph = last->second;
+    pending_.erase(last);
+    active_.insert(subgraph);
+
+    lock.unlock();
+    std::vector<int> labels;
+    typename SubgraphDivider<Graph>::Decision decision =
+        divider_->examine(*subgraph, labels);
+    lock.lock();
+
+    if (decision == SubgraphDivider<Graph>::ACCEPT_SUBGRAPH) {
+      subgraphs_.push_back(subgraph);
+    } else if (decision == SubgraphDivider<Graph>::DIVIDE_SUBGRAPH) {
+      std::vector<Graph*> children;
+      divider_->divide(*subgraph, labels, children);
+      num_cuts_ += 1;
+
+      typename std::vector<Graph*>::const_iterator child;
+      for (child = children.begin(); child != children.end(); ++child) {
+        push(*child);
+      }
+    }
+
+    active_.erase(subgraph);
+    finished_.notify_all();
+  }
+}
+
+template<class Graph>
+void ParallelRecursiveCut<Graph>::checkpointIfDue() {
+  if (writer_ == NULL ||
+      std::difftime(std::time(NULL), last_checkpoint_) <
+      checkpoint_interval_) {
+    return;
+  }
+
+  ClusteringCheckpoint checkpoint;
+  checkpoint.program = program_;
+  checkpoint.num_vertices = num_vertices(*graph_);
+  checkpoint.num_edges = num_edges(*graph_);
+  checkpoint.counters.assign(NUM_COUNTERS, 0);
+  checkpoint.counters[NUM_CUTS] = num_cuts_;
+
+  // Subgraphs which are being examined are saved as pending.
+  checkpoint.groups.resize(2);
+  VertexGroups& pending = checkpoint.groups[0];
+  typename PendingList::const_iterator entry;
+  for (entry = pending_.begin(); entry != pending_.end(); ++entry) {
+    addSubgraphVertices(*entry->second, pending);
+  }
+  typename std::set<Graph*>::const_iterator active;
+  for (active = active_.begin(); active != active_.end(); ++active) {
+    addSubgraphVertices(**active, pending);
+  }
+
+  typename std::vector<Graph*>::const_iterator subgraph;
+  for (subgraph = subgraphs_.begin(); subgraph != subgraphs_.end();
+       ++subgraph) {
+    addSubgraphVertices(**subgraph, checkpoint.groups[1]);
+  }
+
+  LOG(INFO) << "Checkpoint after " << num_cuts_ << " cuts, " <<
+      pending.numGroups() << " subgraphs pending";
+  writer_->write(checkpoint);
+  last_checkpoint_ = std::time(NULL);
+}
@@ -0,0 +1,137 @@
+#include "tracking/region-of-interest.hpp"
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "gtest/gtest.h"
+
+using tracking::RegionOfInterest;
+
+namespace {
+
+const int TILE_SIZE = 8;
+
+// Expects no two regions to overlap.
+void expectDisjoint(const std::vector<cv::Rect>& regions) {
+  for (int i = 0; i < int(regions.size()); i += 1) {
+    for (int j = i + 1; j < int(regions.size()); j += 1) {
+      EXPECT_EQ(0, (regions[i] & regions[j]).area()) << i << ", " << j;
+    }
+  }
+}
+
+// Expects every non-zero pixel of the mask to be in some region.
+void expectCoversMask(const RegionOfInterest& roi) {
+  const cv::Mat& mask = roi.mask();
+  cv::Mat covered = cv::Mat::zeros(mask.size(), cv::DataType<uchar>::type);
+  for (int i = 0; i < int(roi.regions().size()); i += 1) {
+    covered(roi.regions()[i]).setTo(1);
+  }
+  for (int y = 0; y < mask.rows; y += 1) {
+    for (int x = 0; x < mask.cols; x += 1) {
+      if (mask.at<uchar>(y, x)) {
+        ASSERT_TRUE(covered.at<uchar>(y, x)) << x << ", " << y;
+      }
+    }
+  }
+}
+
+}
+
+TEST(RegionOfInterest, EmptyMaskIsWholeFrame) {
+  RegionOfInterest roi;
+  EXPECT_TRUE(roi.all());
+  EXPECT_EQ(1, roi.coverage());
+  EXPECT_TRUE(roi.contains(cv::Point(1000, 1000)));
+  EXPECT_TRUE(roi.intersects(cv::Rect(0, 0, 1, 1)));
+  EXPECT_FALSE(roi.intersects(cv::Rect(0, 0, 0, 1)));
+
+  RegionOfInterest empty(cv::Mat(), TILE_SIZE, 0);
+  EXPECT_TRUE(empty.all());
+}
+
+TEST(RegionOfInterest, KeepsTilesOfMaskWithoutMargin) {
+  // Frame of 5 x 4 tiles whose last column is partial.
+  cv::Mat mask = cv::Mat::zeros(32, 36, cv::DataType<uchar>::type);
+  mask.at<uchar>(9, 10) = 1;
+  mask.at<uchar>(9, 35) = 1;
+
+  RegionOfInterest roi(mask, TILE_SIZE, 0);
+  EXPECT_FALSE(roi.all());
+  ASSERT_EQ(2u, roi.regions().size());
+  EXPECT_EQ(cv::Rect(8, 8, 8, 8), roi.regions()[0]);
+  // Clipped to the frame.
+  EXPECT_EQ(cv::Rect(32, 8, 4, 8), roi.regions()[1]);
+  EXPECT_DOUBLE_EQ((64. + 32.) / (32 * 36), roi.coverage());
+
+  EXPECT_TRUE(roi.contains(cv::Point(10, 9)));
+  EXPECT_FALSE(roi.contains(cv::Point(11, 9)));
+  EXPECT_TRUE(roi.intersects(cv::Rect(0, 0, 11, 10)));
+  EXPECT_FALSE(roi.intersects(cv::Rect(0, 0, 10, 10)));
+  // Clipped to the frame.
+  EXPECT_TRUE(roi.intersects(cv::Rect(30, 5, 100, 100)));
+  EXPECT_FALSE(roi.intersects(cv::Rect(-10, -10, 5, 5)));
+}
+
+TEST(RegionOfInterest, MarginGrowsByWholeTilesAndMergesRows) {
+  cv::Mat mask = cv::Mat::zeros(64, 64, cv::DataType<uchar>::type);
+  mask.at<uchar>(27, 27) = 1;
+
+  // A margin of one pixel is rounded up to one tile on every side.
+  RegionOfInterest roi(mask, TILE_SIZE, 1);
+  ASSERT_EQ(3u, roi.regions().size());
+  for (int i = 0; i < 3; i += 1) {
+    EXPECT_EQ(cv::Rect(16, 16 + i * TILE_SIZE, 3 * TILE_SIZE, TILE_SIZE),
+        roi.regions()[i]);
+  }
+  expectDisjoint(roi.regions());
+  expectCoversMask(roi);
+
+  // Two tiles of margin.
+  RegionOfInterest wide(mask, TILE_SIZE, TILE_SIZE + 1);
+  ASSERT_EQ(5u, wide.regions().size());
+  EXPECT_EQ(cv::Rect(8, 8, 5 * TILE_SIZE, TILE_SIZE), wide.regions()[0]);
+  EXPECT_DOUBLE_EQ(25. * TILE_SIZE * TILE_SIZE / (64 * 64), wide.coverage());
+}
+
+TEST(RegionOfInterest, RegionsOfIrregularMaskAreDisjoint) {
+  cv::Mat mask = cv::Mat::zeros(100, 120, cv::DataType<uchar>::type);
+  cv::RNG rng(3);
+  for (int i = 0; i < 30; i += 1) {
+    mask.at<uchar>(rng.uniform(0, mask.rows), rng.uniform(0, mask.cols)) = 1;
+  }
+
+  for (int margin = 0; margin <= 20; margin += 5) {
+    RegionOfInterest roi(mask, TILE_SIZE, margin);
+    SCOPED_TRACE(margin);
+    expectDisjoint(roi.regions());
+    expectCoversMask(roi);
+    EXPECT_GT(roi.coverage(), 0);
+    EXPECT_LE(roi.coverage(), 1);
+  }
+}
+
+TEST(ConvertRegions, ConvertsOnlyWithinRegions) {
+  cv::Mat image(32, 40, cv::DataType<uchar>::type);
+  cv::RNG rng(1);
+  rng.fill(image, cv::RNG::UNIFORM, 1, 256);
+  cv::Mat mask = cv::Mat::zeros(image.size(), cv::DataType<uchar>::type);
+  mask.at<uchar>(20, 3) = 1;
+  RegionOfInterest roi(mask, TILE_SIZE, 0);
+
+  cv::Mat converted;
+  tracking::convertRegions(image, converted, cv::DataType<float>::type, 0.5,
+      roi);
+  ASSERT_EQ(cv::DataType<float>::type, converted.type());
+  ASSERT_EQ(image.size(), converted.size());
+  for (int y = 0; y < image.rows; y += 1) {
+    for (int x = 0; x < image.cols; x += 1) {
+      bool inside = x < TILE_SIZE && y >= 16 && y < 24;
+      float expected = inside ? 0.5f * image.at<uchar>(y, x) : 0.f;
+      ASSERT_EQ(expected, converted.at<float>(y, x)) << x << ", " << y;
+    }
+  }
+
+  // The whole frame.
+  tracking::convertRegions(image, converted, cv::DataType<float>::type, 0.5,
+      RegionOfInterest());
+  EXPECT_EQ(0.5f * image.at<uchar>(0, 0), converted.at<float>(0, 0));
+}
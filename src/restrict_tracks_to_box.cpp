@@ -100,6 +100,11 @@ int main(int argc, char** argv) {
   int num_tracks = tracks.size();
   LOG(INFO) << "Loaded " << num_tracks << " tracks";
 
+  // Find the tracks in each frame without visiting all of them.
+  // Erasing points does not invalidate the index.
+  FrameIntervalIndex index;
+  indexTrackIntervals(tracks, index);
+
   // Generate a color for each track.
   std::vector<cv::Scalar> colors;
   for (int i = 0; i < num_tracks; i += 1) {
@@ -129,9 +134,17 @@ int main(int argc, char** argv) {
     display = image.clone();
 
     // Get features for this frame.
+    std::vector<int> active;
+    index.find(t, active);
+
     std::map<int, ScaleSpacePosition> features;
-    TrackListTimeIterator<ScaleSpacePosition> frame(tracks, t);
-    frame.getPoints(features);
+    std::vector<int>::const_iterator id;
+    for (id = active.begin(); id != active.end(); ++id) {
+      Track<ScaleSpacePosition>::const_iterator point = tracks[*id].find(t);
+      if (point != tracks[*id].end()) {
+        features[*id] = point->second;
+      }
+    }
 
     // Draw rectangle.
     if (state.rect || state.corner) {
@@ -183,8 +196,12 @@ int main(int argc, char** argv) {
       if (state.paused) {
         // If a rectangle is selected, remove all the features outside it.
         if (state.rect) {
-          TrackList<ScaleSpacePosition>::iterator track;
-          for (track = tracks.begin(); track != tracks.end(); ++track) {
+          std::vector<int> active;
+          index.find(t, active);
+
+          std::vector<int>::const_iterator id;
+          for (id = active.begin(); id != active.end(); ++id) {
+            Track<ScaleSpacePosition>* track = &tracks[*id];
             Track<ScaleSpacePosition>::iterator elem = track->find(t);
             if (elem != track->end()) {
               cv::Point2d point = elem->second.point();
@@ -1,4 +1,12 @@
 #include "roots.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <glog/logging.h>
+
+// Steps before giving up on the interval shrinking further. Bisection alone
+// reaches machine precision within about 100 steps from the widest bounds.
+const int MAX_ROOT_ITERATIONS = 200;
 
 PolynomialSolver::PolynomialSolver() : n_(0), workspace_(NULL) {}
 
@@ -28,3 +36,132 @@ void PolynomialSolver::solve(const std::vector<double>& a,
     x.push_back(std::complex<double>(z[2 * i], z[2 * i + 1]));
   }
 }
+
+namespace {
+
+double evaluatePolynomial(const double* a, int n, double x) {
+  double y = a[n];
+  for (int i = n - 1; i >= 0; i -= 1) {
+    y = y * x + a[i];
+  }
+  return y;
+}
+
+// Finds the root of a polynomial in an interval on which it is monotonic and
+// changes sign. d is its derivative.
+double refineRoot(const double* a,
+                  const double* d,
+                  int n,
+                  double lo,
+                  double hi,
+                  double f_lo) {
+  const double EPSILON = std::numeric_limits<double>::epsilon();
+  double x = 0.5 * (lo + hi);
+  double last_step = hi - lo;
+
+  for (int i = 0; i < MAX_ROOT_ITERATIONS; i += 1) {
+    double f = evaluatePolynomial(a, n, x);
+    if (f == 0) {
+      break;
+    }
+
+    // Keep the root within the interval.
+    if ((f < 0) == (f_lo < 0)) {
+      lo = x;
+    } else {
+      hi = x;
+    }
+    if (hi - lo <= 2 * EPSILON * std::max(1., std::abs(x))) {
+      break;
+    }
+
+    // Bisect if Newton's method would leave the interval, or would not at
+    // least halve the previous step. Far from the root, the steps of
+    // Newton's method may shrink slowly.
+    double slope = evaluatePolynomial(d, n - 1, x);
+    double next = 0.5 * (lo + hi);
+    if (slope != 0) {
+      double step = x - f / slope;
+      if (lo < step && step < hi &&
+          std::abs(step - x) < 0.5 * last_step) {
+        next = step;
+      }
+    }
+
+    if (next == x) {
+      break;
+    }
+    last_step = std::abs(next - x);
+    x = next;
+  }
+
+  return x;
+}
+
+}
+
+int findRealRoots(const double* a, int n, double* roots) {
+  CHECK(n <= MAX_REAL_ROOTS_DEGREE);
+
+  // Ignore vanishing leading coefficients.
+  while (n > 0 && a[n] == 0) {
+    n -= 1;
+  }
+  if (n == 0) {
+    return 0;
+  }
+  if (n == 1) {
+    roots[0] = -a[0] / a[1];
+    return 1;
+  }
+
+  // Every root lies within the Cauchy bound.
+  double bound = 0;
+  for (int i = 0; i < n; i += 1) {
+    bound = std::max(bound, std::abs(a[i] / a[n]));
+  }
+  bound += 1;
+
+  // Roots of the derivative separate those of the polynomial.
+  double d[MAX_REAL_ROOTS_DEGREE];
+  for (int i = 0; i < n; i += 1) {
+    d[i] = (i + 1) * a[i + 1];
+  }
+  double critical[MAX_REAL_ROOTS_DEGREE];
+  int num_critical = findRealRoots(d, n - 1, critical);
+
+  double ends[MAX_REAL_ROOTS_DEGREE + 1];
+  int num_ends = 0;
+  ends[num_ends] = -bound;
+  num_ends += 1;
+  for (int i = 0; i < num_critical; i += 1) {
+    if (-bound < critical[i] && critical[i] < bound) {
+      ends[num_ends] = critical[i];
+      num_ends += 1;
+    }
+  }
+  ends[num_ends] = bound;
+  num_ends += 1;
+
+  int num_roots = 0;
+  double lo = ends[0];
+  double f_lo = evaluatePolynomial(a, n, lo);
+  for (int i = 1; i < num_ends; i += 1) {
+    double hi = ends[i];
+    double f_hi = evaluatePolynomial(a, n, hi);
+
+    if (f_lo == 0) {
+      // A root at a critical point.
+      roots[num_roots] = lo;
+      num_roots += 1;
+    } else if (f_hi != 0 && (f_lo < 0) != (f_hi < 0)) {
+      roots[num_roots] = refineRoot(a, d, n, lo, hi, f_lo);
+      num_roots += 1;
+    }
+
+    lo = hi;
+    f_lo = f_hi;
+  }
+
+  return num_roots;
+}
@@ -20,4 +20,17 @@ class PolynomialSolver {
     gsl_poly_complex_workspace* workspace_;
 };
 
+// Greatest degree of the polynomials which findRealRoots() solves.
+const int MAX_REAL_ROOTS_DEGREE = 8;
+
+// Finds the real roots of the polynomial a[0] + a[1] x + ... + a[n] x^n in
+// ascending order, without allocating. Roots holds at least n values.
+//
+// The roots of the derivative divide the line into intervals on which the
+// polynomial is monotonic. Each root within an interval is refined by
+// Newton's method, safeguarded by bisection. Roots of even multiplicity are
+// found only where the polynomial is exactly zero. Returns the number of
+// roots.
+int findRealRoots(const double* a, int n, double* roots);
+
 #endif
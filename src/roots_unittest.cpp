@@ -0,0 +1,178 @@
+#include "roots.hpp"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include "gtest/gtest.h"
+
+namespace {
+
+typedef std::vector<double> Polynomial;
+
+// Roots which PolynomialSolver finds within a tolerance of the real line,
+// in ascending order.
+std::vector<double> solverRealRoots(const Polynomial& a) {
+  int n = a.size() - 1;
+  while (a[n] == 0) {
+    n -= 1;
+  }
+  Polynomial b(a.begin(), a.begin() + n + 1);
+
+  PolynomialSolver solver;
+  solver.init(n);
+  std::vector<std::complex<double> > x;
+  solver.solve(b, x);
+
+  std::vector<double> roots;
+  for (int i = 0; i < int(x.size()); i += 1) {
+    if (std::abs(x[i].imag()) <= 1e-9 * std::max(1., std::abs(x[i]))) {
+      roots.push_back(x[i].real());
+    }
+  }
+  std::sort(roots.begin(), roots.end());
+  return roots;
+}
+
+std::vector<double> realRoots(const Polynomial& a) {
+  std::vector<double> roots(MAX_REAL_ROOTS_DEGREE);
+  int n = findRealRoots(&a.front(), a.size() - 1, &roots.front());
+  roots.resize(n);
+  return roots;
+}
+
+void expectRoots(const std::vector<double>& expected,
+                 const std::vector<double>& roots) {
+  ASSERT_EQ(expected.size(), roots.size());
+  for (int i = 0; i < int(roots.size()); i += 1) {
+    EXPECT_NEAR(expected[i], roots[i],
+        1e-9 * std::max(1., std::abs(expected[i])));
+    if (i > 0) {
+      EXPECT_LT(roots[i - 1], roots[i]);
+    }
+  }
+}
+
+// Multiplies a polynomial by (x^2 + b x + c).
+Polynomial multiplyQuadratic(const Polynomial& a, double b, double c) {
+  Polynomial p(a.size() + 2, 0.);
+  for (int i = 0; i < int(a.size()); i += 1) {
+    p[i] += c * a[i];
+    p[i + 1] += b * a[i];
+    p[i + 2] += a[i];
+  }
+  return p;
+}
+
+// Multiplies a polynomial by (x - r).
+Polynomial multiplyRoot(const Polynomial& a, double r) {
+  Polynomial p(a.size() + 1, 0.);
+  for (int i = 0; i < int(a.size()); i += 1) {
+    p[i] -= r * a[i];
+    p[i + 1] += a[i];
+  }
+  return p;
+}
+
+Polynomial makePolynomial(const double* coeffs, int n) {
+  return Polynomial(coeffs, coeffs + n + 1);
+}
+
+}
+
+// Products of well separated real roots and quadratics without real roots,
+// so that the solver's real roots are unambiguous.
+TEST(FindRealRoots, AgreesWithPolynomialSolver) {
+  boost::random::mt19937 generator(1);
+  boost::random::uniform_real_distribution<double> uniform(-1, 1);
+
+  for (int degree = 1; degree <= MAX_REAL_ROOTS_DEGREE; degree += 1) {
+    for (int num_real = degree % 2; num_real <= degree; num_real += 2) {
+      SCOPED_TRACE(testing::Message() << "Degree " << degree << ", " <<
+          num_real << " real roots");
+
+      Polynomial a(1, 0.5 + uniform(generator) * uniform(generator));
+      for (int i = 0; i < num_real; i += 1) {
+        a = multiplyRoot(a, 2 * i - num_real + 0.5 * uniform(generator));
+      }
+      for (int i = num_real; i < degree; i += 2) {
+        double b = 4 * uniform(generator);
+        double c = 0.3 + 0.3 * b * b + std::abs(uniform(generator));
+        a = multiplyQuadratic(a, b, c);
+      }
+
+      std::vector<double> expected = solverRealRoots(a);
+      ASSERT_EQ(num_real, int(expected.size()));
+      expectRoots(expected, realRoots(a));
+    }
+  }
+}
+
+TEST(FindRealRoots, IgnoresVanishingLeadingCoefficients) {
+  // (x - 1) (x + 2) (x - 3) with two zeros above.
+  const double COEFFS[] = { 6, -5, -2, 1, 0, 0 };
+  Polynomial a = makePolynomial(COEFFS, 5);
+  std::vector<double> expected = solverRealRoots(a);
+  ASSERT_EQ(3u, expected.size());
+  expectRoots(expected, realRoots(a));
+
+  // Only a constant remains.
+  const double CONSTANT[] = { 2, 0, 0 };
+  EXPECT_TRUE(realRoots(makePolynomial(CONSTANT, 2)).empty());
+  const double ZERO[] = { 0, 0, 0 };
+  EXPECT_TRUE(realRoots(makePolynomial(ZERO, 2)).empty());
+}
+
+TEST(FindRealRoots, LinearAndQuadratic) {
+  const double LINEAR[] = { -3, 2 };
+  std::vector<double> roots = realRoots(makePolynomial(LINEAR, 1));
+  ASSERT_EQ(1u, roots.size());
+  EXPECT_EQ(1.5, roots[0]);
+
+  // (x - 2) (x - 3)
+  const double QUADRATIC[] = { 6, -5, 1 };
+  Polynomial a = makePolynomial(QUADRATIC, 2);
+  expectRoots(solverRealRoots(a), realRoots(a));
+  ASSERT_EQ(2u, realRoots(a).size());
+
+  // x^2 + 1
+  const double NO_ROOTS[] = { 1, 0, 1 };
+  EXPECT_TRUE(realRoots(makePolynomial(NO_ROOTS, 2)).empty());
+  EXPECT_TRUE(solverRealRoots(makePolynomial(NO_ROOTS, 2)).empty());
+}
+
+TEST(FindRealRoots, RootAtCriticalPoint) {
+  // x^2 (x - 3), whose derivative vanishes at 0 and 2.
+  const double COEFFS[] = { 0, 0, -3, 1 };
+  std::vector<double> roots = realRoots(makePolynomial(COEFFS, 3));
+  ASSERT_EQ(2u, roots.size());
+  EXPECT_EQ(0, roots[0]);
+  EXPECT_NEAR(3, roots[1], 1e-12);
+
+  // x^3 crosses zero at its only critical point.
+  const double CUBE[] = { 0, 0, 0, 1 };
+  roots = realRoots(makePolynomial(CUBE, 3));
+  ASSERT_EQ(1u, roots.size());
+  EXPECT_EQ(0, roots[0]);
+}
+
+TEST(FindRealRoots, DoubleRoot) {
+  // (x - 1)^2 (x + 2), whose double root is found once.
+  const double COEFFS[] = { 1, -2, 1 };
+  Polynomial a = multiplyRoot(makePolynomial(COEFFS, 2), -2);
+  std::vector<double> roots = realRoots(a);
+  ASSERT_EQ(2u, roots.size());
+  EXPECT_NEAR(-2, roots[0], 1e-12);
+  EXPECT_NEAR(1, roots[1], 1e-12);
+
+  // The solver finds it twice, up to the square root of rounding.
+  std::vector<double> solver_roots = solverRealRoots(makePolynomial(COEFFS,
+        2));
+  for (int i = 0; i < int(solver_roots.size()); i += 1) {
+    EXPECT_NEAR(1, solver_roots[i], 1e-6);
+  }
+  roots = realRoots(makePolynomial(COEFFS, 2));
+  ASSERT_EQ(1u, roots.size());
+  EXPECT_EQ(1, roots[0]);
+}
@@ -0,0 +1,67 @@
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+#include "pipeline.hpp"
+
+DEFINE_int32(cpus, 0, "CPUs to run tasks on at once, 0 for all of them");
+DEFINE_int32(memory, 0, "Memory in MB for tasks at once, 0 for no limit");
+DEFINE_bool(keep_going, false,
+    "Keep running the tasks which do not depend on a failed one");
+DEFINE_bool(dry_run, false,
+    "Print the commands of the tasks which are not up to date");
+DEFINE_bool(skip_if_unchanged, false,
+    "Skip tasks whose command and inputs have the same contents as when they "
+    "last ran, rather than tasks whose outputs are newer than their inputs");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Runs the tasks of a pipeline which are not up to date, in "
+      "parallel." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " pipeline" << std::endl;
+  usage << std::endl;
+  usage << "pipeline -- Input. Stages of the pipeline, see pipeline.hpp." <<
+      std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 2) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string pipeline_file = argv[1];
+
+  std::vector<PipelineTask> tasks;
+  bool ok = loadPipeline(pipeline_file, tasks);
+  CHECK(ok) << "Could not load pipeline";
+  LOG(INFO) << "Pipeline has " << tasks.size() << " tasks";
+
+  PipelineOptions options;
+  options.cpus = FLAGS_cpus;
+  if (options.cpus <= 0) {
+    options.cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  options.memory_mb = FLAGS_memory;
+  options.keep_going = FLAGS_keep_going;
+  options.dry_run = FLAGS_dry_run;
+  options.skip_if_unchanged = FLAGS_skip_if_unchanged;
+
+  ok = runPipeline(tasks, options);
+  if (!ok) {
+    LOG(ERROR) << "Pipeline did not finish, run again to resume";
+    return 1;
+  }
+
+  return 0;
+}
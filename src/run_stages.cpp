@@ -0,0 +1,224 @@
+#include <string>
+#include <vector>
+#include <deque>
+#include <sstream>
+#include <cstdlib>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "descriptor.hpp"
+#include "descriptor_index.hpp"
+#include "image_pairs.hpp"
+#include "stages.hpp"
+#include "util/thread-pool.hpp"
+
+#include "read_image.hpp"
+#include "read_lines.hpp"
+#include "multiview_track_list_writer.hpp"
+#include "default_writer.hpp"
+#include "sift_position_writer.hpp"
+
+DEFINE_double(contrast_threshold, 0.04,
+    "Constrast threshold for feature detection");
+
+DEFINE_string(pairs, "",
+    "Only match the pairs in this list, as written by plan-image-pairs, "
+    "rather than all pairs");
+DEFINE_bool(use_max_num, false, "Limit number of matches");
+DEFINE_int32(max_num, 1, "Maximum number of matches");
+DEFINE_bool(use_absolute_threshold, false, "Use absolute distance threshold");
+DEFINE_double(absolute_threshold, 1,
+    "Maximum appearance distance between features");
+DEFINE_bool(use_flann, true,
+    "Use FLANN (fast but approximate) to find nearest neighbours.");
+DEFINE_bool(reciprocal, false, "Require matches to be reciprocal?");
+
+DEFINE_string(index_tracks, "",
+    "Also save the tracks of feature indices to this file");
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads to run the stages with, 0 to run serially");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Finds multiview feature tracks in images, running the stages "
+      "find-keypoints, match-features, combine-matches, "
+      "matches-to-multiview-tracks --consistent and "
+      "multiview-index-tracks-to-features in memory." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " view-names num-frames image-format feature-tracks" <<
+      std::endl;
+  usage << std::endl;
+  usage << "view-names -- Input. One view name per line." << std::endl;
+  usage << "image-format -- Input. Takes view name and frame." << std::endl;
+  usage << "feature-tracks -- Output. Multiview tracks of keypoints." <<
+      std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 5) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+// Frames are numbered from one in filenames.
+std::string makeImageFilename(const std::string& format,
+                              const std::string& view,
+                              int time) {
+  return boost::str(boost::format(format) % view % (time + 1));
+}
+
+typedef std::vector<boost::shared_ptr<DescriptorIndex> > IndexList;
+
+// Finds the features of one image and indexes their descriptors.
+// For use with ThreadPool::parallelFor().
+class FindKeypointsFunction {
+  public:
+    FindKeypointsFunction(const std::string& format,
+                          const std::vector<std::string>& views,
+                          int num_frames,
+                          std::vector<std::vector<SiftFeature> >& features,
+                          IndexList& indices)
+        : format_(&format),
+          views_(&views),
+          num_frames_(num_frames),
+          features_(&features),
+          indices_(&indices) {}
+
+    void operator()(int i) const {
+      std::string file = makeImageFilename(*format_,
+          (*views_)[i / num_frames_], i % num_frames_);
+      cv::Mat color;
+      cv::Mat gray;
+      bool ok = readImage(file, color, gray);
+      CHECK(ok) << "Could not read image \"" << file << "\"";
+
+      std::vector<SiftFeature>& features = (*features_)[i];
+      findKeypoints(gray, FLAGS_contrast_threshold, features);
+
+      std::deque<Descriptor> descriptors;
+      std::vector<SiftFeature>::const_iterator feature;
+      for (feature = features.begin(); feature != features.end(); ++feature) {
+        descriptors.push_back(feature->descriptor);
+      }
+      (*indices_)[i].reset(new DescriptorIndex);
+      (*indices_)[i]->build(descriptors, FLAGS_use_flann);
+    }
+
+  private:
+    const std::string* format_;
+    const std::vector<std::string>* views_;
+    int num_frames_;
+    std::vector<std::vector<SiftFeature> >* features_;
+    IndexList* indices_;
+};
+
+// Matches the features of one pair of images in both directions.
+// For use with ThreadPool::parallelFor().
+class MatchPairFunction {
+  public:
+    MatchPairFunction(const std::vector<ImagePair>& pairs,
+                      int num_frames,
+                      const IndexList& indices,
+                      const MatchOptions& options,
+                      std::vector<std::vector<Match> >& matches)
+        : pairs_(&pairs),
+          num_frames_(num_frames),
+          indices_(&indices),
+          options_(&options),
+          matches_(&matches) {}
+
+    void operator()(int k) const {
+      const ImagePair& pair = (*pairs_)[k];
+      int i = pair.first.view * num_frames_ + pair.first.time;
+      int j = pair.second.view * num_frames_ + pair.second.time;
+      matchFeatures(*(*indices_)[i], *(*indices_)[j], *options_,
+          (*matches_)[k]);
+    }
+
+  private:
+    const std::vector<ImagePair>* pairs_;
+    int num_frames_;
+    const IndexList* indices_;
+    const MatchOptions* options_;
+    std::vector<std::vector<Match> >* matches_;
+};
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string view_names_file = argv[1];
+  int num_frames = boost::lexical_cast<int>(argv[2]);
+  std::string image_format = argv[3];
+  std::string feature_tracks_file = argv[4];
+
+  bool ok;
+
+  std::vector<std::string> views;
+  ok = readLines(view_names_file, views);
+  CHECK(ok) << "Could not load view names";
+  int num_views = views.size();
+  int num_images = num_views * num_frames;
+
+  ThreadPool pool(FLAGS_num_threads);
+
+  // find-keypoints.
+  std::vector<std::vector<SiftFeature> > features(num_images);
+  IndexList indices(num_images);
+  pool.parallelFor(0, num_images,
+      FindKeypointsFunction(image_format, views, num_frames, features,
+        indices));
+  LOG(INFO) << "Found features in " << num_images << " images";
+
+  // match-features and combine-matches.
+  std::vector<ImagePair> pairs;
+  if (FLAGS_pairs.empty()) {
+    appendExhaustiveImagePairs(num_views, num_frames, pairs);
+  } else {
+    ok = loadImagePairList(FLAGS_pairs, views, num_frames, pairs);
+    CHECK(ok) << "Could not load pairs \"" << FLAGS_pairs << "\"";
+  }
+
+  MatchOptions options;
+  options.use_max_num = FLAGS_use_max_num;
+  options.max_num = FLAGS_max_num;
+  options.use_absolute_threshold = FLAGS_use_absolute_threshold;
+  options.absolute_threshold = FLAGS_absolute_threshold;
+  options.reciprocal = FLAGS_reciprocal;
+
+  std::vector<std::vector<Match> > matches(pairs.size());
+  pool.parallelFor(0, pairs.size(),
+      MatchPairFunction(pairs, num_frames, indices, options, matches));
+  indices.clear();
+  LOG(INFO) << "Matched " << pairs.size() << " pairs of images";
+
+  // matches-to-multiview-tracks --consistent.
+  MultiviewTrackList<IndexSet> multitracks;
+  matchesToMultiviewTracks(pairs, matches, num_views, multitracks);
+  MultiviewTrackList<int> index_tracks;
+  keepConsistentTracks(multitracks, index_tracks);
+  LOG(INFO) << "Kept " << index_tracks.numTracks() << " of " <<
+      multitracks.numTracks() << " tracks which are consistent";
+
+  if (!FLAGS_index_tracks.empty()) {
+    DefaultWriter<int> index_writer;
+    ok = saveMultiviewTrackList(FLAGS_index_tracks, index_tracks,
+        index_writer);
+    CHECK(ok) << "Could not save index tracks";
+  }
+
+  // multiview-index-tracks-to-features.
+  MultiviewTrackList<SiftPosition> tracks;
+  indexTracksToFeatureTracks(index_tracks, features, num_frames, tracks);
+
+  SiftPositionWriter writer;
+  ok = saveMultiviewTrackList(feature_tracks_file, tracks, writer);
+  CHECK(ok) << "Could not save tracks";
+
+  return 0;
+}
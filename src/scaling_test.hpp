@@ -0,0 +1,20 @@
+#ifndef SCALING_TEST_HPP_
+#define SCALING_TEST_HPP_
+
+#include <sstream>
+#include "util/scaling.hpp"
+#include "gtest/gtest.h"
+
+// Fails the current test if the running time of the trial grows faster than
+// size^max_exponent over five sizes doubling from first. The message gives
+// the time of each size.
+inline void expectExponentBelow(ScalingTrial& trial,
+                                int first,
+                                double max_exponent) {
+  ScalingResult result = measureScaling(trial, first, 2, 5);
+  std::ostringstream message;
+  result.write(message);
+  EXPECT_LT(result.exponent, max_exponent) << message.str();
+}
+
+#endif
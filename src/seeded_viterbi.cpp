@@ -0,0 +1,164 @@
+#include "seeded_viterbi.hpp"
+#include <algorithm>
+#include <limits>
+#include <glog/logging.h>
+#include "viterbi.hpp"
+#include "util.hpp"
+
+SeededViterbiQuadratic2D::SeededViterbiQuadratic2D(
+    const std::vector<cv::Mat>& g)
+    : g_(&g),
+      forward_args_(),
+      backward_args_(),
+      last_(),
+      seeds_(),
+      segments_() {
+  CHECK(!g.empty());
+  int n = g.size();
+  forward_args_.resize(n - 1);
+  backward_args_.resize(n - 1);
+
+  // Forward pass.
+  cv::Mat f = g[0];
+  for (int t = 0; t < n - 1; t += 1) {
+    cv::Mat d;
+    quadraticDistanceTransform2D(f, d, forward_args_[t]);
+    f = d + g[t + 1];
+  }
+
+  double f_star;
+  cv::Point point;
+  cv::minMaxLoc(f, &f_star, NULL, &point, NULL);
+  // Convert from (x, y) back to (i, j).
+  last_ = cv::Vec2i(point.y, point.x);
+
+  // Backward pass.
+  cv::Mat b = g[n - 1];
+  for (int t = n - 2; t >= 0; t -= 1) {
+    cv::Mat d;
+    quadraticDistanceTransform2D(b, d, backward_args_[t]);
+    b = d + g[t];
+  }
+}
+
+int SeededViterbiQuadratic2D::length() const {
+  return g_->size();
+}
+
+void SeededViterbiQuadratic2D::setSeed(int t, const cv::Vec2i& x) {
+  CHECK(t >= 0 && t < length());
+  seeds_[t] = x;
+}
+
+void SeededViterbiQuadratic2D::removeSeed(int t) {
+  seeds_.erase(t);
+}
+
+void SeededViterbiQuadratic2D::clearSeeds() {
+  seeds_.clear();
+}
+
+double SeededViterbiQuadratic2D::solve(std::vector<cv::Vec2i>& x) {
+  int n = length();
+  x.assign(n, cv::Vec2i::all(-1));
+
+  // From the first seed, or the best final position, trace backwards.
+  int first = n - 1;
+  if (seeds_.empty()) {
+    x[n - 1] = last_;
+  } else {
+    first = seeds_.begin()->first;
+    x[first] = seeds_.begin()->second;
+  }
+  for (int t = first; t > 0; t -= 1) {
+    x[t - 1] = forward_args_[t - 1].at<cv::Vec2i>(x[t]);
+  }
+
+  if (seeds_.empty()) {
+    return evaluate(x);
+  }
+
+  // From the last seed, trace forwards.
+  int last = seeds_.rbegin()->first;
+  x[last] = seeds_.rbegin()->second;
+  for (int t = last; t < n - 1; t += 1) {
+    x[t + 1] = backward_args_[t].at<cv::Vec2i>(x[t]);
+  }
+
+  // Re-use the segments between seeds which have not changed.
+  std::map<int, Segment> segments;
+  std::map<int, cv::Vec2i>::const_iterator begin = seeds_.begin();
+  std::map<int, cv::Vec2i>::const_iterator end = begin;
+
+  for (++end; end != seeds_.end(); ++begin, ++end) {
+    Segment& segment = segments[begin->first];
+
+    std::map<int, Segment>::iterator previous =
+        segments_.find(begin->first);
+    if (previous != segments_.end() &&
+        previous->second.end == end->first &&
+        previous->second.first == begin->second &&
+        previous->second.last == end->second) {
+      segment.end = previous->second.end;
+      segment.first = previous->second.first;
+      segment.last = previous->second.last;
+      segment.x.swap(previous->second.x);
+    } else {
+      solveSegment(begin->first, begin->second, end->first, end->second,
+          segment);
+    }
+
+    std::copy(segment.x.begin(), segment.x.end(), x.begin() + begin->first);
+  }
+
+  // Forget segments which no longer join consecutive seeds.
+  segments_.swap(segments);
+
+  return evaluate(x);
+}
+
+void SeededViterbiQuadratic2D::solveSegment(int begin,
+                                            const cv::Vec2i& first,
+                                            int end,
+                                            const cv::Vec2i& last,
+                                            Segment& segment) const {
+  const std::vector<cv::Mat>& g = *g_;
+
+  // Every other position is impossible at the first seed.
+  cv::Mat f = cv::Mat_<double>(g[begin].size(),
+      std::numeric_limits<double>::infinity());
+  f.at<double>(first[0], first[1]) = g[begin].at<double>(first[0], first[1]);
+
+  std::vector<cv::Mat> args(end - begin);
+  for (int t = begin; t < end; t += 1) {
+    cv::Mat d;
+    quadraticDistanceTransform2D(f, d, args[t - begin]);
+    f = d + g[t + 1];
+  }
+
+  segment.end = end;
+  segment.first = first;
+  segment.last = last;
+  segment.x.assign(end - begin + 1, cv::Vec2i::all(-1));
+  segment.x[end - begin] = last;
+  for (int t = end; t > begin; t -= 1) {
+    segment.x[t - 1 - begin] =
+        args[t - 1 - begin].at<cv::Vec2i>(segment.x[t - begin]);
+  }
+}
+
+double SeededViterbiQuadratic2D::evaluate(
+    const std::vector<cv::Vec2i>& x) const {
+  const std::vector<cv::Mat>& g = *g_;
+  int n = x.size();
+  double value = 0;
+
+  for (int t = 0; t < n; t += 1) {
+    value += g[t].at<double>(x[t][0], x[t][1]);
+    if (t > 0) {
+      value += sqr(x[t][0] - x[t - 1][0]) + sqr(x[t][1] - x[t - 1][1]);
+    }
+  }
+
+  return value;
+}
@@ -0,0 +1,71 @@
+#ifndef SEEDED_VITERBI_HPP_
+#define SEEDED_VITERBI_HPP_
+
+#include <map>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+// Solves the problem of solveViterbiQuadratic2D() subject to x[t] being
+// fixed for some t, and solves it again quickly when these seeds change.
+//
+// The minimizers of a forward and backward pass are computed once. The track
+// before the first seed and after the last seed is then traced out of them
+// without any distance transforms. Only the segments between seeds whose
+// ends have changed are solved again.
+//
+// Requires argmin tables for each frame in both directions, 2n H x W tables
+// of cv::Vec2i in total.
+//
+// Usage:
+// SeededViterbiQuadratic2D solver(unary_costs);
+// solver.setSeed(t, x_t);
+// solver.solve(x);
+// solver.setSeed(t, x_t_corrected);
+// solver.solve(x);
+class SeededViterbiQuadratic2D {
+  public:
+    // Does not copy the unary terms, which must outlive the solver.
+    explicit SeededViterbiQuadratic2D(const std::vector<cv::Mat>& g);
+
+    int length() const;
+
+    // Replaces the seed at time t if there is one.
+    void setSeed(int t, const cv::Vec2i& x);
+    void removeSeed(int t);
+    void clearSeeds();
+
+    // Returns the value of the minimizer. Without seeds, this solves the
+    // unconstrained problem.
+    double solve(std::vector<cv::Vec2i>& x);
+
+  private:
+    // Solution between two consecutive seeds.
+    struct Segment {
+      int end;
+      cv::Vec2i first;
+      cv::Vec2i last;
+      // Positions at times [begin, end].
+      std::vector<cv::Vec2i> x;
+    };
+
+    void solveSegment(int begin,
+                      const cv::Vec2i& first,
+                      int end,
+                      const cv::Vec2i& last,
+                      Segment& segment) const;
+    double evaluate(const std::vector<cv::Vec2i>& x) const;
+
+    const std::vector<cv::Mat>* g_;
+    // forward_args_[t] gives the best x[t] for each x[t + 1].
+    std::vector<cv::Mat> forward_args_;
+    // backward_args_[t] gives the best x[t + 1] for each x[t].
+    std::vector<cv::Mat> backward_args_;
+    // Minimizer of the final variable without seeds.
+    cv::Vec2i last_;
+
+    std::map<int, cv::Vec2i> seeds_;
+    // Indexed by the time of the seed at which they begin.
+    std::map<int, Segment> segments_;
+};
+
+#endif
@@ -9,16 +9,14 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include "multiview_track_list.hpp"
+#include "multiview_track_list_view.hpp"
 #include "sift_position.hpp"
-#include "sift_position_reader.hpp"
-#include "multiview_track_list_reader.hpp"
-#include "sift_position_writer.hpp"
-#include "multiview_track_list_writer.hpp"
+#include "feature_files.hpp"
 
 DEFINE_bool(top_n, false, "Select best n tracks (versus a threshold)");
 DEFINE_bool(fraction, false, "When top_n is enabled, selects top fraction");
 
-void pathLength(const Track<SiftPosition>& track,
+void pathLength(const TrackView<SiftPosition>& track,
                 double& distance,
                 int& duration) {
   distance = 0;
@@ -26,7 +24,7 @@ void pathLength(const Track<SiftPosition>& track,
 
   int previous_time = 0;
   cv::Point2d previous_position;
-  TrackIterator<SiftPosition> iterator(track);
+  TrackViewIterator<SiftPosition> iterator(track);
 
   while (!iterator.end()) {
     int time = iterator.time();
@@ -45,7 +43,7 @@ void pathLength(const Track<SiftPosition>& track,
   }
 }
 
-double measureAverageStep(const MultiviewTrack<SiftPosition>& track) {
+double measureAverageStep(const MultiviewTrackView<SiftPosition>& track) {
   double total_distance = 0;
   int total_duration = 0;
 
@@ -90,10 +88,9 @@ int main(int argc, char** argv) {
   std::string output_file = argv[2];
   const char* threshold = argv[3];
 
-  // Load tracks from file.
-  MultiviewTrackList<SiftPosition> input_tracks;
-  SiftPositionReader feature_reader;
-  bool ok = loadMultiviewTrackList(input_file, input_tracks, feature_reader);
+  // Load tracks from file. Binary tracks are not copied.
+  MultiviewTrackListView<SiftPosition> input_tracks;
+  bool ok = loadSiftPositionMultiviewTracks(input_file, input_tracks);
   CHECK(ok) << "Could not load tracks";
 
   int num_tracks = input_tracks.numTracks();
@@ -101,8 +98,9 @@ int main(int argc, char** argv) {
 
   // Measure how much each point moved.
   std::vector<double> distances;
-  std::transform(input_tracks.begin(), input_tracks.end(),
-      std::back_inserter(distances), measureAverageStep);
+  for (int i = 0; i < num_tracks; i += 1) {
+    distances.push_back(measureAverageStep(input_tracks.track(i)));
+  }
 
   // Take tracks as long as the n-th value or x-th percentile.
   // (To avoid non-deterministic behaviour.)
@@ -135,7 +133,9 @@ int main(int argc, char** argv) {
   // Filter out distances which are too small.
   for (int i = 0; i < num_tracks; i += 1) {
     if (distances[i] >= min_distance_per_frame) {
-      output_tracks.push_back(input_tracks.track(i));
+      MultiviewTrack<SiftPosition> track;
+      input_tracks.track(i).copyTo(track);
+      output_tracks.push_back(track);
     }
   }
 
@@ -146,8 +146,7 @@ int main(int argc, char** argv) {
       fraction << ")";
 
   // Write out tracks.
-  SiftPositionWriter feature_writer;
-  ok = saveMultiviewTrackList(output_file, output_tracks, feature_writer);
+  ok = saveSiftPositionMultiviewTracks(output_file, output_tracks);
   CHECK(ok) << "Could not save tracks";
 
   return 0;
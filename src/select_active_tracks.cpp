@@ -9,22 +9,20 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include "track_list.hpp"
+#include "track_list_view.hpp"
 #include "sift_position.hpp"
-#include "sift_position_reader.hpp"
-#include "track_list_reader.hpp"
-#include "sift_position_writer.hpp"
-#include "track_list_writer.hpp"
+#include "feature_files.hpp"
 
 DEFINE_bool(top_n, false, "Select best n tracks (versus a threshold)");
 DEFINE_bool(fraction, false, "When top_n is enabled, selects top fraction");
 
 // Considers only (x, y) movement not rotation or scale.
-double measureAverageStep(const Track<SiftPosition>& track) {
+double measureAverageStep(const TrackView<SiftPosition>& track) {
   double distance = 0;
   int n = 0;
   cv::Point2d previous;
 
-  Track<SiftPosition>::const_iterator point;
+  TrackView<SiftPosition>::const_iterator point;
   for (point = track.begin(); point != track.end(); ++point) {
     // Get current position.
     const SiftPosition& feature = point->second;
@@ -70,10 +68,9 @@ int main(int argc, char** argv) {
   std::string output_file = argv[2];
   const char* threshold = argv[3];
 
-  // Load tracks from file.
-  TrackList<SiftPosition> input_tracks;
-  SiftPositionReader feature_reader;
-  bool ok = loadTrackList(input_file, input_tracks, feature_reader);
+  // Load tracks from file. Binary tracks are not copied.
+  TrackListView<SiftPosition> input_tracks;
+  bool ok = loadSiftPositionTracks(input_file, input_tracks);
   CHECK(ok) << "Could not load tracks";
 
   int num_tracks = input_tracks.size();
@@ -81,8 +78,9 @@ int main(int argc, char** argv) {
 
   // Measure how much each point moved.
   std::vector<double> distances;
-  std::transform(input_tracks.begin(), input_tracks.end(),
-      std::back_inserter(distances), measureAverageStep);
+  for (int i = 0; i < num_tracks; i += 1) {
+    distances.push_back(measureAverageStep(input_tracks[i]));
+  }
 
   // Take tracks as long as the n-th value or x-th percentile.
   // (To avoid non-deterministic behaviour.)
@@ -114,7 +112,8 @@ int main(int argc, char** argv) {
   // Filter out distances which are too small.
   for (int i = 0; i < num_tracks; i += 1) {
     if (distances[i] >= min_distance_per_frame) {
-      output_tracks.push_back(input_tracks[i]);
+      output_tracks.push_back(Track<SiftPosition>());
+      input_tracks[i].copyTo(output_tracks.back());
     }
   }
 
@@ -125,8 +124,7 @@ int main(int argc, char** argv) {
       fraction << ")";
 
   // Write out tracks.
-  SiftPositionWriter feature_writer;
-  ok = saveTrackList(output_file, output_tracks, feature_writer);
+  ok = saveSiftPositionTracks(output_file, output_tracks);
   CHECK(ok) << "Could not save tracks";
 
   return 0;
@@ -6,6 +6,7 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include "unique_match_result.hpp"
+#include "match_store.hpp"
 #include "iterator_reader.hpp"
 #include "unique_match_result_reader.hpp"
 #include "iterator_writer.hpp"
@@ -13,6 +14,58 @@
 
 typedef std::vector<UniqueMatchResult> MatchList;
 
+bool isDistinctive(const UniqueMatchResult& match,
+                   double max_relative_distance) {
+  // Calculate distinctiveness.
+  double nearest = match.minNextBest();
+  double relative_distance = match.distance / nearest;
+
+  // Only keep if below threshold.
+  return relative_distance < max_relative_distance;
+}
+
+// Selects the distinctive matches of every pair of a store, in one pass.
+void selectDistinctiveStoredMatches(const std::string& input_file,
+                                    const std::string& output_file,
+                                    double max_relative_distance) {
+  MatchStore store;
+  bool ok = store.open(input_file);
+  CHECK(ok) << "Could not load matches";
+  CHECK(store.isUnique()) << "Matches have no second-best distances, pack "
+      "them with --type=unique";
+
+  MatchStoreWriter writer;
+  ok = writer.open(output_file, true);
+  CHECK(ok) << "Could not open output store";
+
+  std::vector<MatchStoreRecord> distinctive;
+  int num_output = 0;
+
+  for (int pair = 0; pair < store.numPairs(); pair += 1) {
+    distinctive.clear();
+    MatchStore::const_iterator record;
+    for (record = store.begin(pair); record != store.end(pair); ++record) {
+      if (isDistinctive(toUniqueMatchResult(*record), max_relative_distance)) {
+        distinctive.push_back(*record);
+      }
+    }
+
+    num_output += distinctive.size();
+    const MatchStoreRecord* begin =
+        distinctive.empty() ? NULL : &distinctive.front();
+    writer.add(store.image1(pair), store.image2(pair), begin,
+        begin + distinctive.size());
+  }
+
+  ok = writer.close();
+  CHECK(ok) << "Could not save matches";
+
+  int num_input = store.numMatches();
+  double fraction = static_cast<double>(num_output) / num_input;
+  LOG(INFO) << "Kept " << num_output << " / " << num_input << " matches (" <<
+      fraction << ") of " << store.numPairs() << " pairs";
+}
+
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
   usage << "Selects all matches that are sufficiently distinctive." <<
@@ -21,7 +74,10 @@ void init(int& argc, char**& argv) {
   usage << "Sample usage: " << argv[0] << " input-matches output-matches"
       " second-best-ratio" << std::endl;
   usage << std::endl;
-  usage << "Ratio is between 0 and 1. 1 allows all, 0 excludes all.";
+  usage << "Ratio is between 0 and 1. 1 allows all, 0 excludes all." <<
+      std::endl;
+  usage << "If the input is a match store (see pack-matches), so is the "
+    "output, and every pair is filtered.";
   google::SetUsageMessage(usage.str());
 
   google::InitGoogleLogging(argv[0]);
@@ -40,6 +96,12 @@ int main(int argc, char** argv) {
   std::string output_file = argv[2];
   double max_relative_distance = boost::lexical_cast<double>(argv[3]);
 
+  if (isBinaryFilename(input_file)) {
+    selectDistinctiveStoredMatches(input_file, output_file,
+        max_relative_distance);
+    return 0;
+  }
+
   // Load matches from file.
   MatchList matches;
   UniqueMatchResultReader match_reader;
@@ -51,12 +113,7 @@ int main(int argc, char** argv) {
 
   MatchList::const_iterator match;
   for (match = matches.begin(); match != matches.end(); ++match) {
-    // Calculate distinctiveness.
-    double nearest = match->minNextBest();
-    double relative_distance = match->distance / nearest;
-
-    // Only keep if below threshold.
-    if (relative_distance < max_relative_distance) {
+    if (isDistinctive(*match, max_relative_distance)) {
       distinctive.push_back(*match);
     }
   }
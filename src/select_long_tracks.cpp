@@ -8,12 +8,9 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include "track_list.hpp"
+#include "track_list_view.hpp"
 #include "sift_position.hpp"
-
-#include "sift_position_reader.hpp"
-#include "sift_position_writer.hpp"
-#include "track_list_reader.hpp"
-#include "track_list_writer.hpp"
+#include "feature_files.hpp"
 
 DEFINE_bool(top_n, false, "Select best n tracks (versus a threshold)");
 DEFINE_bool(fraction, false, "When top_n is enabled, selects top fraction");
@@ -51,10 +48,9 @@ int main(int argc, char** argv) {
   std::string input_file = argv[1];
   std::string output_file = argv[2];
 
-  // Load tracks from file.
-  TrackList<SiftPosition> input_tracks;
-  SiftPositionReader feature_reader;
-  bool ok = loadTrackList(input_file, input_tracks, feature_reader);
+  // Load tracks from file. Binary tracks are not copied.
+  TrackListView<SiftPosition> input_tracks;
+  bool ok = loadSiftPositionTracks(input_file, input_tracks);
   CHECK(ok) << "Could not load tracks";
 
   int num_tracks = input_tracks.size();
@@ -66,7 +62,7 @@ int main(int argc, char** argv) {
     // Sort tracks by their length.
     std::vector<ScoredIndex> scored;
     for (int i = 0; i < int(input_tracks.size()); i += 1) {
-      const Track<SiftPosition>& track = input_tracks[i];
+      TrackView<SiftPosition> track = input_tracks[i];
       int length = track.rbegin()->first - track.begin()->first + 1;
       scored.push_back(ScoredIndex(i, length));
     }
@@ -92,14 +88,15 @@ int main(int argc, char** argv) {
 
   TrackList<SiftPosition> output_tracks;
 
-  TrackList<SiftPosition>::const_iterator track;
-  for (track = input_tracks.begin(); track != input_tracks.end(); ++track) {
+  for (int i = 0; i < num_tracks; i += 1) {
+    TrackView<SiftPosition> track = input_tracks[i];
     // Measure track length.
-    int length = track->rbegin()->first - track->begin()->first + 1;
+    int length = track.rbegin()->first - track.begin()->first + 1;
 
     // Only keep if above threshold.
     if (length >= min_track_length) {
-      output_tracks.push_back(*track);
+      output_tracks.push_back(Track<SiftPosition>());
+      track.copyTo(output_tracks.back());
     }
   }
 
@@ -110,8 +107,7 @@ int main(int argc, char** argv) {
       fraction << ")";
 
   // Write out tracks.
-  SiftPositionWriter feature_writer;
-  ok = saveTrackList(output_file, output_tracks, feature_writer);
+  ok = saveSiftPositionTracks(output_file, output_tracks);
   CHECK(ok) << "Could not save tracks";
 
   return 0;
@@ -1,12 +1,17 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #include <string>
 #include <sstream>
 #include <opencv2/core/core.hpp>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <boost/format.hpp>
 
 #include "match_result.hpp"
 #include "optimal_triangulation.hpp"
+#include "ransac.hpp"
+#include "util.hpp"
 
 #include "match_result_reader.hpp"
 #include "image_point_reader.hpp"
@@ -14,9 +19,26 @@
 #include "matrix_reader.hpp"
 #include "iterator_writer.hpp"
 #include "match_result_writer.hpp"
+#include "matrix_writer.hpp"
+#include "util/thread-pool.hpp"
 
 DEFINE_double(max_residual, 2.,
-    "Maximum deviation from epipolar line in pixels");
+    "Maximum residual of a match in pixels squared: the sum of the squared "
+    "distances which optimal triangulation moves its points. RANSAC compares "
+    "the squared Sampson or transfer error with the same value.");
+DEFINE_int32(num_threads, 4,
+    "Number of worker threads to triangulate and score models with, 0 for "
+    "none");
+DEFINE_string(estimate, "",
+    "Estimate the model from the matches using RANSAC instead of loading "
+    "it? Either \"fundamental\" or \"homography\". The estimated model is "
+    "saved to the fund-mat file.");
+DEFINE_double(confidence, 0.999,
+    "Probability of having found an all-inlier sample when RANSAC stops");
+DEFINE_int32(max_iterations, 100000, "Maximum number of RANSAC samples");
+DEFINE_bool(all_frames, false,
+    "Select the matches of every frame of a sequence? Arguments are then "
+    "formats for each frame, except for a loaded fundamental matrix.");
 
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
@@ -24,6 +46,8 @@ void init(int& argc, char**& argv) {
   usage << std::endl;
   usage << argv[0] << " matches keypoints1 keypoints2 fund-mat rigid-matches" <<
       std::endl;
+  usage << argv[0] << " -all_frames matches-format keypoints1-format"
+      " keypoints2-format fund-mat rigid-matches-format" << std::endl;
 
   google::SetUsageMessage(usage.str());
   google::ParseCommandLineFlags(&argc, &argv, true);
@@ -35,40 +59,75 @@ void init(int& argc, char**& argv) {
   }
 }
 
-struct MatchIsOutlier {
-  const std::vector<cv::Point2d>* points1;
-  const std::vector<cv::Point2d>* points2;
-  const cv::Mat* F;
-  double max_residual;
+std::string makeFilename(const std::string& format, int n) {
+  return boost::str(boost::format(format) % (n + 1));
+}
+
+// Orders matches from most to least distinctive.
+class CompareMatchDistances {
+  public:
+    CompareMatchDistances(const std::vector<MatchResult>& matches)
+        : matches_(&matches) {}
+
+    bool operator()(int lhs, int rhs) const {
+      return (*matches_)[lhs].distance < (*matches_)[rhs].distance;
+    }
 
-  bool operator()(const MatchResult& match) const {
-    cv::Point2d point1 = (*points1)[match.index1];
-    cv::Point2d point2 = (*points2)[match.index2];
+  private:
+    const std::vector<MatchResult>* matches_;
+};
 
-    double residual = optimalTriangulation(point1, point2, *F);
+// Estimates a model from the matches and finds its inliers.
+// Returns false if there were too few matches.
+bool estimateModel(const std::vector<MatchResult>& matches,
+                   const std::vector<cv::Point2d>& match_points1,
+                   const std::vector<cv::Point2d>& match_points2,
+                   RansacModel model,
+                   cv::Matx33d& M,
+                   std::vector<bool>& inliers,
+                   ThreadPool& pool) {
+  int num_matches = matches.size();
 
-    return (residual > max_residual);
+  // PROSAC draws from the most distinctive matches first.
+  std::vector<int> order(num_matches);
+  for (int i = 0; i < num_matches; i += 1) {
+    order[i] = i;
   }
+  std::stable_sort(order.begin(), order.end(), CompareMatchDistances(matches));
 
-  MatchIsOutlier(const std::vector<cv::Point2d>& points1,
-                 const std::vector<cv::Point2d>& points2,
-                 const cv::Mat& F,
-                 double max_residual)
-      : points1(&points1),
-        points2(&points2),
-        F(&F),
-        max_residual(max_residual) {}
-};
+  std::vector<cv::Point2d> x1(num_matches);
+  std::vector<cv::Point2d> x2(num_matches);
+  for (int i = 0; i < num_matches; i += 1) {
+    x1[i] = match_points1[order[i]];
+    x2[i] = match_points2[order[i]];
+  }
 
-int main(int argc, char** argv) {
-  init(argc, argv);
+  RansacOptions options;
+  options.model = model;
+  // The options take a distance, and the flag is a squared distance.
+  options.threshold = std::sqrt(FLAGS_max_residual);
+  options.confidence = FLAGS_confidence;
+  options.max_iterations = FLAGS_max_iterations;
 
-  std::string matches_file = argv[1];
-  std::string keypoints_file1 = argv[2];
-  std::string keypoints_file2 = argv[3];
-  std::string fund_mat_file = argv[4];
-  std::string inliers_file = argv[5];
+  std::vector<bool> sorted_inliers;
+  if (!ransac(x1, x2, options, M, sorted_inliers, pool)) {
+    return false;
+  }
 
+  inliers.assign(num_matches, false);
+  for (int i = 0; i < num_matches; i += 1) {
+    inliers[order[i]] = sorted_inliers[i];
+  }
+
+  return true;
+}
+
+void selectRigidMatches(const std::string& matches_file,
+                        const std::string& keypoints_file1,
+                        const std::string& keypoints_file2,
+                        const std::string& fund_mat_file,
+                        const std::string& inliers_file,
+                        ThreadPool& pool) {
   bool ok;
 
   // Load matches.
@@ -86,18 +145,75 @@ int main(int argc, char** argv) {
   ok = loadList(keypoints_file2, points2, point_reader);
   CHECK(ok) << "Could not load points";
 
-  // Load fundamental matrix.
-  cv::Mat F;
-  MatrixReader matrix_reader;
-  ok = load(fund_mat_file, F, matrix_reader);
-  CHECK(ok) << "Could not load fundamental matrix";
+  std::vector<cv::Point2d> match_points1;
+  std::vector<cv::Point2d> match_points2;
+  match_points1.reserve(matches.size());
+  match_points2.reserve(matches.size());
+  std::vector<MatchResult>::const_iterator match;
+  for (match = matches.begin(); match != matches.end(); ++match) {
+    match_points1.push_back(points1[match->index1]);
+    match_points2.push_back(points2[match->index2]);
+  }
+
+  int num_matches = matches.size();
+  std::vector<bool> is_inlier(num_matches, false);
+
+  if (FLAGS_estimate == "homography") {
+    cv::Matx33d H;
+    if (estimateModel(matches, match_points1, match_points2, HOMOGRAPHY_MODEL,
+          H, is_inlier, pool)) {
+      MatrixWriter matrix_writer;
+      ok = save(fund_mat_file, cv::Mat(H), matrix_writer);
+      CHECK(ok) << "Could not save homography";
+    } else {
+      LOG(WARNING) << "Could not estimate homography";
+    }
+  } else {
+    cv::Matx33d F;
+    bool found = true;
+
+    if (FLAGS_estimate.empty()) {
+      // Load fundamental matrix.
+      cv::Mat F_mat;
+      MatrixReader matrix_reader;
+      ok = load(fund_mat_file, F_mat, matrix_reader);
+      CHECK(ok) << "Could not load fundamental matrix";
+      F = F_mat;
+    } else {
+      CHECK(FLAGS_estimate == "fundamental") << "Unknown model \"" <<
+          FLAGS_estimate << "\"";
+      std::vector<bool> sampson_inliers;
+      found = estimateModel(matches, match_points1, match_points2,
+          FUNDAMENTAL_MATRIX_MODEL, F, sampson_inliers, pool);
+
+      if (found) {
+        MatrixWriter matrix_writer;
+        ok = save(fund_mat_file, cv::Mat(F), matrix_writer);
+        CHECK(ok) << "Could not save fundamental matrix";
+      } else {
+        LOG(WARNING) << "Could not estimate fundamental matrix";
+      }
+    }
+
+    if (found) {
+      // Triangulate all matches at once, using the estimated matrix to
+      // measure the same residual as for a loaded one.
+      std::vector<double> residuals;
+      optimalTriangulation(match_points1, match_points2, F, residuals, pool);
+
+      for (int i = 0; i < num_matches; i += 1) {
+        is_inlier[i] = !(residuals[i] > FLAGS_max_residual);
+      }
+    }
+  }
 
-  std::vector<MatchResult> inliers;
-  // Construct test.
-  MatchIsOutlier match_is_outlier(points1, points2, F, FLAGS_max_residual);
   // Remove outliers.
-  std::remove_copy_if(matches.begin(), matches.end(),
-      std::back_inserter(inliers), match_is_outlier);
+  std::vector<MatchResult> inliers;
+  for (int i = 0; i < num_matches; i += 1) {
+    if (is_inlier[i]) {
+      inliers.push_back(matches[i]);
+    }
+  }
 
   int num_input = matches.size();
   int num_output = inliers.size();
@@ -108,6 +224,38 @@ int main(int argc, char** argv) {
   MatchResultWriter match_writer;
   ok = saveList(inliers_file, inliers, match_writer);
   CHECK(ok) << "Could not save rigid matches to file";
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string matches_file = argv[1];
+  std::string keypoints_file1 = argv[2];
+  std::string keypoints_file2 = argv[3];
+  std::string fund_mat_file = argv[4];
+  std::string inliers_file = argv[5];
+
+  ThreadPool pool(FLAGS_num_threads);
+
+  if (FLAGS_all_frames) {
+    int num_frames = countFrameFiles(matches_file);
+    LOG(INFO) << "Selecting rigid matches of " << num_frames << " frames";
+
+    for (int t = 0; t < num_frames; t += 1) {
+      // An estimated model is saved for each frame.
+      std::string frame_fund_mat_file = fund_mat_file;
+      if (!FLAGS_estimate.empty()) {
+        frame_fund_mat_file = makeFilename(fund_mat_file, t);
+      }
+
+      selectRigidMatches(makeFilename(matches_file, t),
+          makeFilename(keypoints_file1, t), makeFilename(keypoints_file2, t),
+          frame_fund_mat_file, makeFilename(inliers_file, t), pool);
+    }
+  } else {
+    selectRigidMatches(matches_file, keypoints_file1, keypoints_file2,
+        fund_mat_file, inliers_file, pool);
+  }
 
   return 0;
 }
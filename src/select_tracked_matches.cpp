@@ -1,6 +1,7 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <cstdlib>
 #include <opencv2/core/core.hpp>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
@@ -9,6 +10,7 @@
 #include "match_result.hpp"
 #include "sift_position.hpp"
 #include "track_list.hpp"
+#include "batch_jobs.hpp"
 
 #include "iterator_reader.hpp"
 #include "match_result_reader.hpp"
@@ -17,8 +19,15 @@
 #include "matrix_reader.hpp"
 #include "iterator_writer.hpp"
 #include "match_result_writer.hpp"
+#include "util/thread-pool.hpp"
 
 DEFINE_double(max_error, 2., "Maximum deviation from track (pixels)");
+DEFINE_bool(batch, false,
+    "The only argument is a file with one \"matches tracks1 tracks2 "
+    "frame-number verified-matches\" per line, which are verified in "
+    "parallel");
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads in batch mode, 0 to verify serially");
 
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
@@ -26,104 +35,121 @@ void init(int& argc, char**& argv) {
   usage << std::endl;
   usage << argv[0] << " matches tracks1 tracks2 frame-number "
       << "verified-matches" << std::endl;
+  usage << argv[0] << " --batch jobs" << std::endl;
 
   google::SetUsageMessage(usage.str());
   google::ParseCommandLineFlags(&argc, &argv, true);
   google::InitGoogleLogging(argv[0]);
 
-  if (argc != 6) {
+  if (argc != (FLAGS_batch ? 2 : 6)) {
     google::ShowUsageWithFlags(argv[0]);
     std::exit(1);
   }
 }
 
-bool matchVerified(const Track<SiftPosition>& track1,
-                   const Track<SiftPosition>& track2,
-                   int t,
-                   double max_error) {
-  Track<SiftPosition>::const_iterator point1;
-  Track<SiftPosition>::const_iterator point2;
-
-  // Find current position in each track.
-  point1 = track1.find(t);
-  point2 = track2.find(t + 1);
-  // These points MUST exist in the track.
-  CHECK(point1 != track1.end());
-  CHECK(point2 != track2.end());
-
-  cv::Point2d start1(point1->second.x, point1->second.y);
-  cv::Point2d start2(point2->second.x, point2->second.y);
-
-  // Find next and previous position, respectively.
-  point1 = track1.find(t + 1);
-  point2 = track2.find(t);
-  // If the track didn't contain this point, then the match is not verified.
-  if (point1 == track1.end() || point2 == track2.end()) {
-    return false;
-  }
-
-  cv::Point2d end1(point1->second.x, point1->second.y);
-  cv::Point2d end2(point2->second.x, point2->second.y);
-
-  cv::Point2d d1 = end1 - start2;
-  cv::Point2d d2 = end2 - start1;
-
-  // Check that differences were below threshold.
-  return (cv::norm(d1) <= max_error && cv::norm(d2) <= max_error);
-}
-
-struct MatchNotVerified {
-  const TrackList<SiftPosition>* tracks1;
-  const TrackList<SiftPosition>* tracks2;
-  int t;
-  double max_error;
+// Position of every track in one frame, indexed by track.
+struct FramePositions {
+  std::vector<cv::Point2d> points;
+  std::vector<bool> present;
+};
 
-  bool operator()(const MatchResult& match) const {
-    return !matchVerified((*tracks1)[match.index1], (*tracks2)[match.index2], t,
-        max_error);
+void findFramePositions(const TrackList<SiftPosition>& tracks,
+                        int t,
+                        FramePositions& positions) {
+  int n = tracks.size();
+  positions.points.assign(n, cv::Point2d());
+  positions.present.assign(n, false);
+
+  for (int i = 0; i < n; i += 1) {
+    Track<SiftPosition>::const_iterator point = tracks[i].find(t);
+    if (point != tracks[i].end()) {
+      positions.points[i] = cv::Point2d(point->second.x, point->second.y);
+      positions.present[i] = true;
+    }
   }
+}
 
-  MatchNotVerified(const TrackList<SiftPosition>& tracks1,
-                   const TrackList<SiftPosition>& tracks2,
-                   int t,
-                   double max_error)
-      : tracks1(&tracks1), tracks2(&tracks2), t(t), max_error(max_error) {}
+// Looks up each match in the positions of both tracks in frames t and t + 1,
+// which are found once per track rather than once per match.
+class MatchVerifier {
+  public:
+    MatchVerifier(const TrackList<SiftPosition>& tracks1,
+                  const TrackList<SiftPosition>& tracks2,
+                  int t,
+                  double max_error)
+        : max_error_(max_error) {
+      findFramePositions(tracks1, t, start1_);
+      findFramePositions(tracks1, t + 1, end1_);
+      findFramePositions(tracks2, t + 1, start2_);
+      findFramePositions(tracks2, t, end2_);
+    }
+
+    bool verified(const MatchResult& match) const {
+      int i = match.index1;
+      int j = match.index2;
+      CHECK(i >= 0 && i < int(start1_.present.size()));
+      CHECK(j >= 0 && j < int(start2_.present.size()));
+      // These points MUST exist in the track.
+      CHECK(start1_.present[i]);
+      CHECK(start2_.present[j]);
+
+      // If the track didn't contain this point, then the match is not
+      // verified.
+      if (!end1_.present[i] || !end2_.present[j]) {
+        return false;
+      }
+
+      cv::Point2d d1 = end1_.points[i] - start2_.points[j];
+      cv::Point2d d2 = end2_.points[j] - start1_.points[i];
+
+      // Check that differences were below threshold.
+      return (cv::norm(d1) <= max_error_ && cv::norm(d2) <= max_error_);
+    }
+
+  private:
+    double max_error_;
+    FramePositions start1_;
+    FramePositions end1_;
+    FramePositions start2_;
+    FramePositions end2_;
 };
 
-int main(int argc, char** argv) {
-  init(argc, argv);
-
-  std::string matches_file = argv[1];
-  std::string tracks_file1 = argv[2];
-  std::string tracks_file2 = argv[3];
-  int frame_number = boost::lexical_cast<int>(argv[4]);
-  std::string verified_file = argv[5];
-
-  bool ok;
-
+bool selectTrackedMatches(const std::string& matches_file,
+                          const std::string& tracks_file1,
+                          const std::string& tracks_file2,
+                          int frame_number,
+                          const std::string& verified_file) {
   // Load matches.
   std::vector<MatchResult> matches;
   MatchResultReader match_reader;
-  ok = loadList(matches_file, matches, match_reader);
-  CHECK(ok) << "Could not load matches";
+  if (!loadList(matches_file, matches, match_reader)) {
+    LOG(WARNING) << "Could not load matches \"" << matches_file << "\"";
+    return false;
+  }
 
   SiftPositionReader point_reader;
 
   // Load tracks.
   TrackList<SiftPosition> tracks1;
   TrackList<SiftPosition> tracks2;
-  ok = loadTrackList(tracks_file1, tracks1, point_reader);
-  CHECK(ok) << "Could not load tracks";
-  ok = loadTrackList(tracks_file2, tracks2, point_reader);
-  CHECK(ok) << "Could not load tracks";
+  if (!loadTrackList(tracks_file1, tracks1, point_reader)) {
+    LOG(WARNING) << "Could not load tracks \"" << tracks_file1 << "\"";
+    return false;
+  }
+  if (!loadTrackList(tracks_file2, tracks2, point_reader)) {
+    LOG(WARNING) << "Could not load tracks \"" << tracks_file2 << "\"";
+    return false;
+  }
 
-  std::vector<MatchResult> verified;
-  // Construct test.
-  MatchNotVerified match_verified(tracks1, tracks2, frame_number,
-      FLAGS_max_error);
   // Remove outliers.
-  std::remove_copy_if(matches.begin(), matches.end(),
-      std::back_inserter(verified), match_verified);
+  MatchVerifier verifier(tracks1, tracks2, frame_number, FLAGS_max_error);
+  std::vector<MatchResult> verified;
+  std::vector<MatchResult>::const_iterator match;
+  for (match = matches.begin(); match != matches.end(); ++match) {
+    if (verifier.verified(*match)) {
+      verified.push_back(*match);
+    }
+  }
 
   int num_input = matches.size();
   int num_output = verified.size();
@@ -132,8 +158,59 @@ int main(int argc, char** argv) {
       fraction << ")";
 
   MatchResultWriter match_writer;
-  ok = saveList(verified_file, verified, match_writer);
-  CHECK(ok) << "Could not save rigid matches to file";
+  if (!saveList(verified_file, verified, match_writer)) {
+    LOG(WARNING) << "Could not save verified matches \"" << verified_file <<
+        "\"";
+    return false;
+  }
+
+  return true;
+}
+
+// Runs a line "matches tracks1 tracks2 frame-number verified-matches" of the
+// batch file. For use with runBatchJobs().
+class SelectFunction {
+  public:
+    explicit SelectFunction(const std::vector<BatchJob>& jobs)
+        : jobs_(&jobs) {}
+
+    bool operator()(int i) const {
+      const BatchJob& job = (*jobs_)[i];
+      int frame_number;
+      std::istringstream stream(job[3]);
+      if (!(stream >> frame_number)) {
+        LOG(WARNING) << "Could not parse frame number \"" << job[3] << "\"";
+        return false;
+      }
+      return selectTrackedMatches(job[0], job[1], job[2], frame_number,
+          job[4]);
+    }
+
+  private:
+    const std::vector<BatchJob>* jobs_;
+};
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  bool ok;
+
+  if (!FLAGS_batch) {
+    int frame_number = boost::lexical_cast<int>(argv[4]);
+    ok = selectTrackedMatches(argv[1], argv[2], argv[3], frame_number,
+        argv[5]);
+    CHECK(ok) << "Could not select tracked matches";
+    return 0;
+  }
+
+  std::vector<BatchJob> jobs;
+  ok = readBatchJobs(argv[1], 5, jobs);
+  CHECK(ok) << "Could not load jobs";
+
+  ThreadPool pool(FLAGS_num_threads);
+  int num_failed = runBatchJobs(jobs.size(), SelectFunction(jobs), pool);
+  CHECK(num_failed == 0) << "Could not verify " << num_failed << " of " <<
+      jobs.size() << " lists of matches";
 
   return 0;
 }
@@ -0,0 +1,43 @@
+#ifndef SEQUENCE_SINK_HPP_
+#define SEQUENCE_SINK_HPP_
+
+// Receives the elements of a sequence one at a time as they are read.
+template<class T>
+class SequenceSink {
+  public:
+    virtual ~SequenceSink() {}
+    // May take the contents of x, which is not used again.
+    virtual void add(T& x) = 0;
+};
+
+// Appends elements to a container by swapping rather than copying.
+// Container must provide push_back() and back().
+template<class T, class Container>
+class ContainerSink : public SequenceSink<T> {
+  public:
+    explicit ContainerSink(Container& list);
+    ~ContainerSink();
+    void add(T& x);
+
+  private:
+    Container* list_;
+};
+
+// Swaps elements into successive positions of a range which already exists,
+// for example the views of a MultiviewTrack.
+template<class T, class Iterator>
+class RangeSink : public SequenceSink<T> {
+  public:
+    RangeSink(Iterator begin, Iterator end);
+    ~RangeSink();
+    // The sequence must not be longer than the range.
+    void add(T& x);
+
+  private:
+    Iterator position_;
+    Iterator end_;
+};
+
+#include "sequence_sink.inl"
+
+#endif
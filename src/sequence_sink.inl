@@ -0,0 +1,31 @@
+#include <algorithm>
+#include <glog/logging.h>
+
+template<class T, class Container>
+ContainerSink<T, Container>::ContainerSink(Container& list) : list_(&list) {}
+
+template<class T, class Container>
+ContainerSink<T, Container>::~ContainerSink() {}
+
+template<class T, class Container>
+void ContainerSink<T, Container>::add(T& x) {
+  list_->push_back(T());
+  // Finds swap() beside T if there is one.
+  using std::swap;
+  swap(list_->back(), x);
+}
+
+template<class T, class Iterator>
+RangeSink<T, Iterator>::RangeSink(Iterator begin, Iterator end)
+    : position_(begin), end_(end) {}
+
+template<class T, class Iterator>
+RangeSink<T, Iterator>::~RangeSink() {}
+
+template<class T, class Iterator>
+void RangeSink<T, Iterator>::add(T& x) {
+  CHECK(position_ != end_) << "Sequence is longer than range";
+  using std::swap;
+  swap(*position_, x);
+  ++position_;
+}
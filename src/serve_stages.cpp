@@ -0,0 +1,662 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "camera.hpp"
+#include "descriptor_index.hpp"
+#include "descriptor_matrix.hpp"
+#include "image_pairs.hpp"
+#include "pca_projection.hpp"
+#include "stage_job.hpp"
+#include "stages.hpp"
+#include "vocabulary_tree.hpp"
+#include "util/thread-pool.hpp"
+
+#include "read_image.hpp"
+#include "read_lines.hpp"
+#include "feature_files.hpp"
+#include "iterator_reader.hpp"
+#include "iterator_writer.hpp"
+#include "camera_reader.hpp"
+#include "pca_projection_reader.hpp"
+#include "vocabulary_tree_reader.hpp"
+#include "match_writer.hpp"
+
+DEFINE_string(socket, "/tmp/nrt-stages.sock",
+    "Path of the local socket to accept jobs on");
+DEFINE_int32(num_threads, 4,
+    "Number of worker threads which run jobs and share their work, 0 to "
+    "run one job at a time");
+
+const int POLL_TIMEOUT_MS = 200;
+const int MAX_REQUEST_SIZE = 4096;
+// A client which does not send its request in this time is dropped.
+const int RECEIVE_TIMEOUT_S = 10;
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Runs the stages as jobs sent over a local socket, keeping the "
+      "models which they load between jobs." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << std::endl;
+  usage << std::endl;
+  usage << "Each connection sends one job as a line of words," << std::endl;
+  usage << "  stage argument... [name=value]..." << std::endl;
+  usage << "and receives one line, \"ok seconds\" or \"error message\", e.g."
+      << std::endl;
+  usage << "  echo find-keypoints 1.png 1.yaml | nc -U /tmp/nrt-stages.sock"
+      << std::endl;
+  usage << std::endl;
+  usage << "  find-keypoints image keypoints [contrast_threshold] "
+      "[descriptor_type]" << std::endl;
+  usage << "  match-features descriptors1 descriptors2 matches [pca] "
+      "[use_max_num] [max_num] [use_absolute_threshold] "
+      "[absolute_threshold] [use_flann] [reciprocal]" << std::endl;
+  usage << "  project-descriptors pca descriptors" << std::endl;
+  usage << "  plan-image-pairs view-names num-frames pairs [rig] "
+      "[max_time_offset] [max_time_offset_between_views] [min_overlap] "
+      "[near] [far] [overlap_grid] [vocabulary_tree] [descriptors_format] "
+      "[max_num_similar]" << std::endl;
+  usage << "  shutdown -- Stops once the running jobs finish." << std::endl;
+  usage << std::endl;
+  usage << "Options take the defaults of the programs of the same name. "
+      "match-features writes the matches of both directions combined, as "
+      "combine-matches does." << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 1) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool loadPcaProjection(const std::string& file, PcaProjection& projection) {
+  PcaProjectionReader reader;
+  return load(file, projection, reader);
+}
+
+bool loadVocabularyTree(const std::string& file, VocabularyTree& tree) {
+  VocabularyTreeReader reader;
+  return load(file, tree, reader);
+}
+
+bool loadCameras(const std::string& file, std::vector<Camera>& cameras) {
+  CameraReader reader;
+  return loadList(file, cameras, reader);
+}
+
+// Set by the job which shuts the service down, and read by the loop which
+// accepts connections.
+class StopFlag {
+  public:
+    StopFlag() : mutex_(), stop_(false) {}
+
+    void set() {
+      boost::mutex::scoped_lock lock(mutex_);
+      stop_ = true;
+    }
+
+    bool isSet() const {
+      boost::mutex::scoped_lock lock(mutex_);
+      return stop_;
+    }
+
+  private:
+    mutable boost::mutex mutex_;
+    bool stop_;
+
+    // Non-copyable.
+    StopFlag(const StopFlag&);
+    StopFlag& operator=(const StopFlag&);
+};
+
+// Models which jobs share, loaded by the first job which asks for each and
+// kept until the service stops. Jobs only read them.
+class ModelCache {
+  public:
+    ModelCache() : mutex_(), projections_(), trees_(), rigs_() {}
+
+    // Each returns NULL if the model could not be loaded.
+    boost::shared_ptr<const PcaProjection> projection(
+        const std::string& file) {
+      return find(file, projections_, loadPcaProjection);
+    }
+
+    boost::shared_ptr<const VocabularyTree> tree(const std::string& file) {
+      return find(file, trees_, loadVocabularyTree);
+    }
+
+    boost::shared_ptr<const std::vector<Camera> > rig(
+        const std::string& file) {
+      return find(file, rigs_, loadCameras);
+    }
+
+  private:
+    // A model is loaded while holding the lock, so that it is loaded once.
+    template<class T>
+    boost::shared_ptr<const T> find(
+        const std::string& file,
+        std::map<std::string, boost::shared_ptr<const T> >& models,
+        bool (*loader)(const std::string&, T&)) {
+      boost::mutex::scoped_lock lock(mutex_);
+      typename std::map<std::string, boost::shared_ptr<const T> >::iterator
+          model = models.find(file);
+      if (model != models.end()) {
+        return model->second;
+      }
+
+      boost::shared_ptr<T> loaded(new T);
+      if (!loader(file, *loaded)) {
+        return boost::shared_ptr<const T>();
+      }
+      LOG(INFO) << "Loaded model \"" << file << "\"";
+      models[file] = loaded;
+      return loaded;
+    }
+
+    boost::mutex mutex_;
+    std::map<std::string, boost::shared_ptr<const PcaProjection> >
+        projections_;
+    std::map<std::string, boost::shared_ptr<const VocabularyTree> > trees_;
+    std::map<std::string, boost::shared_ptr<const std::vector<Camera> > >
+        rigs_;
+
+    // Non-copyable.
+    ModelCache(const ModelCache&);
+    ModelCache& operator=(const ModelCache&);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool checkNumArguments(const Job& job, int n, std::string& error) {
+  if (int(job.arguments().size()) != n) {
+    std::ostringstream message;
+    message << job.stage() << " takes " << n << " arguments";
+    error = message.str();
+    return false;
+  }
+  return true;
+}
+
+// The stages CHECK their options. A job must not stop the service, so they
+// are checked here first.
+bool checkMatchOptions(const MatchOptions& options, std::string& error) {
+  if (options.use_max_num && options.max_num <= 0) {
+    error = "max_num must be positive";
+    return false;
+  }
+  if (!options.use_max_num && !options.use_absolute_threshold) {
+    error = "Need use_max_num or use_absolute_threshold";
+    return false;
+  }
+  return true;
+}
+
+bool checkProjection(const PcaProjection& projection,
+                     const DescriptorMatrix& descriptors,
+                     std::string& error) {
+  if (projection.empty()) {
+    error = "PCA model has not been trained";
+    return false;
+  }
+  if (!descriptors.empty() && descriptors.cols() != projection.dimension()) {
+    error = "Descriptors differ in size from the PCA model";
+    return false;
+  }
+  return true;
+}
+
+bool checkPairPlannerOptions(const PairPlannerOptions& options,
+                             std::string& error) {
+  if (options.grid <= 0) {
+    error = "overlap_grid must be positive";
+    return false;
+  }
+  if (!(0 < options.near && options.near < options.far)) {
+    error = "Need 0 < near < far";
+    return false;
+  }
+  return true;
+}
+
+bool findKeypointsJob(Job& job, std::string& error) {
+  double contrast_threshold = 0.04;
+  std::string descriptor_type = "float";
+  if (!job.option("contrast_threshold", contrast_threshold, error) ||
+      !job.option("descriptor_type", descriptor_type, error) ||
+      !job.checkOptions(error) || !checkNumArguments(job, 2, error)) {
+    return false;
+  }
+  int type;
+  if (!parseDescriptorType(descriptor_type, type) ||
+      type == ANY_DESCRIPTOR_TYPE) {
+    error = "Unknown descriptor type " + descriptor_type;
+    return false;
+  }
+  const std::string& image_file = job.arguments()[0];
+  const std::string& keypoints_file = job.arguments()[1];
+
+  cv::Mat color;
+  cv::Mat gray;
+  if (!readImage(image_file, color, gray)) {
+    error = "Could not read image " + image_file;
+    return false;
+  }
+
+  std::vector<SiftFeature> features;
+  findKeypoints(gray, contrast_threshold, features);
+
+  if (!saveSiftFeatures(keypoints_file, features, type)) {
+    error = "Could not save keypoints " + keypoints_file;
+    return false;
+  }
+  return true;
+}
+
+bool matchFeaturesJob(Job& job, ModelCache& models, std::string& error) {
+  MatchOptions options;
+  std::string pca_file;
+  bool use_flann = true;
+  if (!job.option("use_max_num", options.use_max_num, error) ||
+      !job.option("max_num", options.max_num, error) ||
+      !job.option("use_absolute_threshold", options.use_absolute_threshold,
+        error) ||
+      !job.option("absolute_threshold", options.absolute_threshold, error) ||
+      !job.option("reciprocal", options.reciprocal, error) ||
+      !job.option("use_flann", use_flann, error) ||
+      !job.option("pca", pca_file, error) ||
+      !job.checkOptions(error) || !checkNumArguments(job, 3, error) ||
+      !checkMatchOptions(options, error)) {
+    return false;
+  }
+  const std::string& descriptors_file1 = job.arguments()[0];
+  const std::string& descriptors_file2 = job.arguments()[1];
+  const std::string& matches_file = job.arguments()[2];
+
+  DescriptorMatrix descriptors1;
+  DescriptorMatrix descriptors2;
+  if (!loadDescriptorMatrix(descriptors_file1, descriptors1,
+          ANY_DESCRIPTOR_TYPE) ||
+      !loadDescriptorMatrix(descriptors_file2, descriptors2,
+          ANY_DESCRIPTOR_TYPE)) {
+    error = "Could not load descriptors";
+    return false;
+  }
+  if (!descriptors1.empty() && !descriptors2.empty() &&
+      descriptors1.cols() != descriptors2.cols()) {
+    error = "Descriptors differ in size";
+    return false;
+  }
+
+  if (!pca_file.empty()) {
+    boost::shared_ptr<const PcaProjection> projection =
+        models.projection(pca_file);
+    if (!projection) {
+      error = "Could not load PCA model " + pca_file;
+      return false;
+    }
+    if (!checkProjection(*projection, descriptors1, error) ||
+        !checkProjection(*projection, descriptors2, error)) {
+      return false;
+    }
+
+    DescriptorMatrix projected1;
+    DescriptorMatrix projected2;
+    projection->project(descriptors1, projected1);
+    projection->project(descriptors2, projected2);
+    descriptors1 = projected1;
+    descriptors2 = projected2;
+  }
+
+  DescriptorIndex index1;
+  DescriptorIndex index2;
+  index1.build(descriptors1, use_flann);
+  index2.build(descriptors2, use_flann);
+
+  std::vector<Match> matches;
+  matchFeatures(index1, index2, options, matches);
+
+  MatchWriter writer;
+  if (!saveList(matches_file, matches, writer)) {
+    error = "Could not save matches " + matches_file;
+    return false;
+  }
+  return true;
+}
+
+bool projectDescriptorsJob(Job& job, ModelCache& models, std::string& error) {
+  if (!job.checkOptions(error) || !checkNumArguments(job, 2, error)) {
+    return false;
+  }
+  const std::string& pca_file = job.arguments()[0];
+  const std::string& descriptors_file = job.arguments()[1];
+
+  boost::shared_ptr<const PcaProjection> projection =
+      models.projection(pca_file);
+  if (!projection) {
+    error = "Could not load PCA model " + pca_file;
+    return false;
+  }
+
+  DescriptorMatrix descriptors;
+  if (!loadDescriptorMatrix(descriptors_file, descriptors)) {
+    error = "Could not load descriptors " + descriptors_file;
+    return false;
+  }
+  if (!checkProjection(*projection, descriptors, error)) {
+    return false;
+  }
+
+  DescriptorMatrix projected;
+  projection->project(descriptors, projected);
+
+  std::string projected_file =
+      makeProjectedDescriptorsFilename(descriptors_file);
+  if (!saveDescriptorMatrix(projected_file, projected)) {
+    error = "Could not save descriptors " + projected_file;
+    return false;
+  }
+  return true;
+}
+
+bool planImagePairsJob(Job& job,
+                       ModelCache& models,
+                       ThreadPool& pool,
+                       std::string& error) {
+  PairPlannerOptions options;
+  std::string rig_file;
+  double min_overlap = 0.05;
+  std::string tree_file;
+  std::string descriptors_format;
+  int max_num_similar = 10;
+  if (!job.option("max_time_offset", options.max_time_offset, error) ||
+      !job.option("max_time_offset_between_views",
+        options.max_time_offset_between_views, error) ||
+      !job.option("rig", rig_file, error) ||
+      !job.option("min_overlap", min_overlap, error) ||
+      !job.option("near", options.near, error) ||
+      !job.option("far", options.far, error) ||
+      !job.option("overlap_grid", options.grid, error) ||
+      !job.option("vocabulary_tree", tree_file, error) ||
+      !job.option("descriptors_format", descriptors_format, error) ||
+      !job.option("max_num_similar", max_num_similar, error) ||
+      !job.checkOptions(error) || !checkNumArguments(job, 3, error)) {
+    return false;
+  }
+  if (!rig_file.empty() && !checkPairPlannerOptions(options, error)) {
+    return false;
+  }
+  if (max_num_similar <= 0) {
+    error = "max_num_similar must be positive";
+    return false;
+  }
+  const std::string& view_names_file = job.arguments()[0];
+  const std::string& pairs_file = job.arguments()[2];
+  std::istringstream frames(job.arguments()[1]);
+  int num_frames;
+  if (!(frames >> num_frames) || num_frames <= 0) {
+    error = "Could not parse number of frames " + job.arguments()[1];
+    return false;
+  }
+
+  std::vector<std::string> views;
+  if (!readLines(view_names_file, views)) {
+    error = "Could not load view names " + view_names_file;
+    return false;
+  }
+  int num_views = views.size();
+
+  std::vector<ImagePair> pairs;
+  appendExhaustiveImagePairs(num_views, num_frames, pairs);
+
+  boost::shared_ptr<const std::vector<Camera> > cameras(
+      new std::vector<Camera>());
+  if (!rig_file.empty()) {
+    cameras = models.rig(rig_file);
+    if (!cameras) {
+      error = "Could not load cameras " + rig_file;
+      return false;
+    }
+    if (int(cameras->size()) != num_views &&
+        int(cameras->size()) != num_views * num_frames) {
+      error = "Number of cameras does not match number of views or images";
+      return false;
+    }
+    options.min_overlap = min_overlap;
+  }
+  planImagePairs(*cameras, num_views, num_frames, options, pairs);
+
+  if (!tree_file.empty()) {
+    if (descriptors_format.empty()) {
+      error = "Need descriptors_format to score with the vocabulary tree";
+      return false;
+    }
+    boost::shared_ptr<const VocabularyTree> tree = models.tree(tree_file);
+    if (!tree) {
+      error = "Could not load vocabulary tree " + tree_file;
+      return false;
+    }
+
+    std::vector<std::vector<int> > similar;
+    if (!findSimilarImages(*tree, descriptors_format, views, num_frames,
+          max_num_similar, pool, similar)) {
+      error = "Could not score images";
+      return false;
+    }
+    keepSimilarImagePairs(similar, num_frames, pairs);
+  }
+
+  if (!saveImagePairList(pairs_file, views, pairs)) {
+    error = "Could not save pairs " + pairs_file;
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool sendAll(int connection, const std::string& data) {
+  const char* begin = data.c_str();
+  const char* end = begin + data.size();
+  while (begin < end) {
+    ssize_t n = send(connection, begin, end - begin, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    begin += n;
+  }
+  return true;
+}
+
+// Reads up to the end of the first line.
+bool receiveLine(int connection, std::string& line) {
+  line.clear();
+  char buffer[256];
+  while (int(line.size()) < MAX_REQUEST_SIZE) {
+    ssize_t n = recv(connection, buffer, sizeof(buffer), 0);
+    if (n < 0) {
+      return false;
+    }
+    line.append(buffer, n);
+
+    std::string::size_type newline = line.find('\n');
+    if (newline != std::string::npos) {
+      line.erase(newline);
+      return true;
+    }
+    if (n == 0) {
+      return !line.empty();
+    }
+  }
+  return false;
+}
+
+double secondsSince(const timespec& start) {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start.tv_sec) + 1e-9 * (now.tv_nsec - start.tv_nsec);
+}
+
+// Runs the job of one connection and answers it. For use with
+// TaskGroup::run().
+class ServeConnection {
+  public:
+    ServeConnection(int connection,
+                    ModelCache& models,
+                    ThreadPool& pool,
+                    StopFlag& stop)
+        : connection_(connection), models_(&models), pool_(&pool),
+          stop_(&stop) {}
+
+    void operator()() const {
+      timespec start;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+
+      std::string request;
+      std::string error;
+      Job job;
+      bool ok;
+      if (!receiveLine(connection_, request)) {
+        ok = false;
+        error = "Could not read request";
+      } else {
+        ok = job.parse(request, error) && run(job, error);
+      }
+
+      std::ostringstream response;
+      if (ok) {
+        response << "ok " << secondsSince(start) << "\n";
+        LOG(INFO) << job.stage() << " took " << secondsSince(start) << " s";
+      } else {
+        response << "error " << error << "\n";
+        LOG(WARNING) << "Job \"" << request << "\" failed: " << error;
+      }
+      sendAll(connection_, response.str());
+      close(connection_);
+    }
+
+  private:
+    bool run(Job& job, std::string& error) const {
+      const std::string& stage = job.stage();
+      if (stage == "find-keypoints") {
+        return findKeypointsJob(job, error);
+      } else if (stage == "match-features") {
+        return matchFeaturesJob(job, *models_, error);
+      } else if (stage == "project-descriptors") {
+        return projectDescriptorsJob(job, *models_, error);
+      } else if (stage == "plan-image-pairs") {
+        return planImagePairsJob(job, *models_, *pool_, error);
+      } else if (stage == "shutdown") {
+        stop_->set();
+        return true;
+      } else {
+        error = "Unknown stage " + stage;
+        return false;
+      }
+    }
+
+    int connection_;
+    ModelCache* models_;
+    ThreadPool* pool_;
+    StopFlag* stop_;
+};
+
+// Returns a listening socket at the path, or -1.
+int listenAt(const std::string& path) {
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  if (path.size() >= sizeof(address.sun_path)) {
+    LOG(WARNING) << "Socket path is too long";
+    return -1;
+  }
+  address.sun_family = AF_UNIX;
+  std::strcpy(address.sun_path, path.c_str());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  // A socket left by a service which did not stop cleanly. Anything else at
+  // the path is not ours to remove.
+  struct stat status;
+  if (lstat(path.c_str(), &status) == 0) {
+    if (!S_ISSOCK(status.st_mode)) {
+      LOG(WARNING) << "\"" << path << "\" exists and is not a socket";
+      close(fd);
+      return -1;
+    }
+    unlink(path.c_str());
+  }
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(fd, 64) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  int fd = listenAt(FLAGS_socket);
+  CHECK(fd >= 0) << "Could not listen at \"" << FLAGS_socket << "\"";
+  LOG(INFO) << "Accepting jobs at \"" << FLAGS_socket << "\"";
+
+  ThreadPool pool(FLAGS_num_threads);
+  ModelCache models;
+  StopFlag stop;
+
+  {
+    // Jobs may call parallelFor() on the same pool.
+    TaskGroup jobs(pool);
+    while (!stop.isSet()) {
+      pollfd ready;
+      ready.fd = fd;
+      ready.events = POLLIN;
+      ready.revents = 0;
+      if (poll(&ready, 1, POLL_TIMEOUT_MS) <= 0) {
+        continue;
+      }
+
+      int connection = accept(fd, NULL, NULL);
+      if (connection < 0) {
+        continue;
+      }
+      // A client which never sends would hold a worker forever.
+      timeval timeout;
+      timeout.tv_sec = RECEIVE_TIMEOUT_S;
+      timeout.tv_usec = 0;
+      setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+          sizeof(timeout));
+      jobs.run(ServeConnection(connection, models, pool, stop));
+    }
+
+    LOG(INFO) << "Waiting for running jobs to finish";
+    jobs.wait();
+  }
+
+  close(fd);
+  unlink(FLAGS_socket.c_str());
+  return 0;
+}
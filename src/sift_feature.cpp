@@ -10,3 +10,7 @@ void SiftFeature::swap(SiftFeature& other) {
   std::swap(position, other.position);
   descriptor.swap(other.descriptor);
 }
+
+void swap(SiftFeature& lhs, SiftFeature& rhs) {
+  lhs.swap(rhs);
+}
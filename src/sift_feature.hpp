@@ -14,4 +14,6 @@ struct SiftFeature {
   void swap(SiftFeature& other);
 };
 
+void swap(SiftFeature& lhs, SiftFeature& rhs);
+
 #endif
@@ -17,3 +17,23 @@ bool SiftFeatureReader::read(const cv::FileNode& node, SiftFeature& feature) {
 
   return true;
 }
+
+bool SiftFeatureReader::fields(std::vector<std::string>& keys) const {
+  SiftPositionReader position_reader;
+  position_reader.fields(keys);
+  keys.push_back("list");
+  return true;
+}
+
+bool SiftFeatureReader::readFields(const FieldValues& values,
+                                   SiftFeature& feature) {
+  SiftPositionReader position_reader;
+  if (!position_reader.readFields(values, feature.position)) {
+    return false;
+  }
+
+  // The descriptor follows the four fields of the position.
+  const double* begin = values.begin(4);
+  feature.descriptor.data.assign(begin, begin + values.size(4));
+  return true;
+}
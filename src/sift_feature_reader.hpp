@@ -8,6 +8,8 @@ class SiftFeatureReader : public Reader<SiftFeature> {
   public:
     ~SiftFeatureReader();
     bool read(const cv::FileNode& node, SiftFeature& feature);
+    bool fields(std::vector<std::string>& keys) const;
+    bool readFields(const FieldValues& values, SiftFeature& feature);
 };
 
 #endif
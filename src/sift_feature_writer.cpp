@@ -2,6 +2,8 @@
 #include "sift_position_writer.hpp"
 #include "descriptor_writer.hpp"
 
+SiftFeatureWriter::SiftFeatureWriter(int type) : type_(type) {}
+
 SiftFeatureWriter::~SiftFeatureWriter() {}
 
 void SiftFeatureWriter::write(cv::FileStorage& file,
@@ -9,6 +11,6 @@ void SiftFeatureWriter::write(cv::FileStorage& file,
   SiftPositionWriter position_writer;
   position_writer.write(file, feature.position);
 
-  DescriptorWriter descriptor_writer;
+  DescriptorWriter descriptor_writer(type_);
   descriptor_writer.write(file, feature.descriptor);
 }
@@ -1,13 +1,19 @@
 #ifndef SIFT_FEATURE_WRITER_HPP_
 #define SIFT_FEATURE_WRITER_HPP_
 
+#include <opencv2/core/core.hpp>
 #include "writer.hpp"
 #include "sift_feature.hpp"
 
+// Writes descriptors rounded to a type of DescriptorMatrix.
 class SiftFeatureWriter : public Writer<SiftFeature> {
   public:
+    explicit SiftFeatureWriter(int type = CV_32F);
     ~SiftFeatureWriter();
     void write(cv::FileStorage& file, const SiftFeature& feature);
+
+  private:
+    int type_;
 };
 
 #endif
@@ -37,3 +37,20 @@ bool SiftPositionReader::read(const cv::FileNode& node, SiftPosition& feature) {
 
   return true;
 }
+
+bool SiftPositionReader::fields(std::vector<std::string>& keys) const {
+  keys.clear();
+  keys.push_back("x");
+  keys.push_back("y");
+  keys.push_back("size");
+  keys.push_back("angle");
+  return true;
+}
+
+bool SiftPositionReader::readFields(const FieldValues& values,
+                                    SiftPosition& feature) {
+  return readField<double>(values, 0, feature.x) &&
+         readField<double>(values, 1, feature.y) &&
+         readField<double>(values, 2, feature.size) &&
+         readField<double>(values, 3, feature.theta);
+}
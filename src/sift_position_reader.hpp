@@ -8,6 +8,8 @@ class SiftPositionReader : public Reader<SiftPosition> {
   public:
     ~SiftPositionReader();
     bool read(const cv::FileNode& node, SiftPosition& feature);
+    bool fields(std::vector<std::string>& keys) const;
+    bool readFields(const FieldValues& values, SiftPosition& feature);
 };
 
 #endif
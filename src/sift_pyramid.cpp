@@ -0,0 +1,59 @@
+#include "sift_pyramid.hpp"
+#include <algorithm>
+#include <boost/format.hpp>
+#include "extract_sift.hpp"
+
+SiftPyramid::SiftPyramid() : levels_(), num_octave_layers_(0), sigma_(0) {}
+
+SiftPyramid::SiftPyramid(const cv::Mat& byte_image,
+                         int num_octave_layers,
+                         double sigma)
+    : levels_(), num_octave_layers_(num_octave_layers), sigma_(sigma) {
+  makePyramid(byte_image, levels_, num_octave_layers_, sigma_);
+}
+
+SiftPyramid::SiftPyramid(const cv::Mat& byte_image,
+                         int num_octave_layers,
+                         double sigma,
+                         const PlaneCache& cache)
+    : levels_(), num_octave_layers_(num_octave_layers), sigma_(sigma) {
+  std::string key = cacheKey(byte_image, num_octave_layers_, sigma_);
+  if (!cache.load(key, levels_)) {
+    makePyramid(byte_image, levels_, num_octave_layers_, sigma_);
+    cache.store(key, levels_);
+  }
+}
+
+const std::vector<cv::Mat>& SiftPyramid::levels() const {
+  return levels_;
+}
+
+bool SiftPyramid::empty() const {
+  return levels_.empty();
+}
+
+int SiftPyramid::numOctaves() const {
+  // Each octave has three more Gaussian levels than it has layers.
+  return levels_.size() / (num_octave_layers_ + 3);
+}
+
+int SiftPyramid::numOctaveLayers() const {
+  return num_octave_layers_;
+}
+
+double SiftPyramid::sigma() const {
+  return sigma_;
+}
+
+void SiftPyramid::swap(SiftPyramid& other) {
+  levels_.swap(other.levels_);
+  std::swap(num_octave_layers_, other.num_octave_layers_);
+  std::swap(sigma_, other.sigma_);
+}
+
+std::string SiftPyramid::cacheKey(const cv::Mat& byte_image,
+                                  int num_octave_layers,
+                                  double sigma) {
+  return planeCacheKey(byte_image, boost::str(
+      boost::format("sift-pyramid %d %g") % num_octave_layers % sigma));
+}
@@ -0,0 +1,44 @@
+#ifndef SIFT_PYRAMID_HPP_
+#define SIFT_PYRAMID_HPP_
+
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "plane_cache.hpp"
+
+// The Gaussian scale space of an image, from which SIFT features are detected
+// and descriptors are extracted. Build one per image and share it, rather
+// than letting each stage build its own.
+//
+// Levels are as built by makePyramid(), starting from the original resolution.
+class SiftPyramid {
+  public:
+    SiftPyramid();
+    SiftPyramid(const cv::Mat& byte_image, int num_octave_layers, double sigma);
+    // Retrieves the pyramid of the image from the cache, or builds and stores
+    // it if it is not there.
+    SiftPyramid(const cv::Mat& byte_image,
+                int num_octave_layers,
+                double sigma,
+                const PlaneCache& cache);
+
+    const std::vector<cv::Mat>& levels() const;
+    bool empty() const;
+    int numOctaves() const;
+    int numOctaveLayers() const;
+    double sigma() const;
+
+    void swap(SiftPyramid& other);
+
+    // Identifies the pyramid of an image in a PlaneCache.
+    static std::string cacheKey(const cv::Mat& byte_image,
+                                int num_octave_layers,
+                                double sigma);
+
+  private:
+    std::vector<cv::Mat> levels_;
+    int num_octave_layers_;
+    double sigma_;
+};
+
+#endif
@@ -75,3 +75,22 @@ bool SimilarityWarper::isValid(const double* params,
 
   return true;
 }
+
+void SimilarityWarper::setIdentity(double* params) const {
+  params[0] = 0;
+  params[1] = 0;
+  params[2] = 0;
+  params[3] = 0;
+}
+
+void SimilarityWarper::paramsFromMatrix(const cv::Mat& M,
+                                        double* params) const {
+  // M = [s R, t] where R is a rotation.
+  double a = M.at<double>(0, 0);
+  double b = M.at<double>(1, 0);
+
+  params[0] = M.at<double>(0, 2);
+  params[1] = M.at<double>(1, 2);
+  params[2] = std::log(std::sqrt(a * a + b * b));
+  params[3] = std::atan2(b, a);
+}
@@ -41,6 +41,31 @@ class SimilarityWarper : public Warper {
                  const cv::Size& image_size,
                  int patch_radius) const;
 
+    void setIdentity(double* params) const;
+    void paramsFromMatrix(const cv::Mat& M, double* params) const;
+
+    // Evaluates the Jacobian of the warp with respect to the parameters
+    // given the 2x3 row-major matrix representation of the warp.
+    // Inline for use in the inner loop of WarpCostT.
+    static inline void affineJacobian(const double* M,
+                                      double x,
+                                      double y,
+                                      double* jacobian) {
+      // A = scale * R(theta)
+      // dq/d(log scale) = A x
+      // dq/d(theta) = R(pi / 2) A x
+      double ax = M[0] * x + M[1] * y;
+      double ay = M[3] * x + M[4] * y;
+      jacobian[0] = 1;
+      jacobian[1] = 0;
+      jacobian[2] = ax;
+      jacobian[3] = -ay;
+      jacobian[4] = 0;
+      jacobian[5] = 1;
+      jacobian[6] = ay;
+      jacobian[7] = ax;
+    }
+
   private:
     // Cost function.
     const CostFunction* function_;
@@ -0,0 +1,85 @@
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <opencv2/core/core.hpp>
+#include "sparse_mat.hpp"
+#include "csr_mat.hpp"
+#include "util/thread-pool.hpp"
+
+namespace {
+
+// Random n x n matrix with about k entries per row.
+void makeEntries(int n, int k, std::vector<CsrEntry>& entries) {
+  cv::RNG rng(0);
+  entries.clear();
+  for (int i = 0; i < n; i += 1) {
+    for (int j = 0; j < k; j += 1) {
+      entries.push_back(CsrEntry(i, rng.uniform(0, n), rng.uniform(-1., 1.)));
+    }
+  }
+}
+
+// Multiplies a cv::SparseMat by a dense n x 8 matrix, as in the spectral
+// partitioning. Arguments are n and the number of entries per row.
+void BM_SparseTimesDense(benchmark::State& state) {
+  int n = state.range(0);
+  int k = state.range(1);
+
+  std::vector<CsrEntry> entries;
+  makeEntries(n, k, entries);
+  const int ndims = 2;
+  int dims[ndims] = { n, n };
+  cv::SparseMat A(ndims, dims, cv::DataType<double>::type);
+  std::vector<CsrEntry>::const_iterator entry;
+  for (entry = entries.begin(); entry != entries.end(); ++entry) {
+    A.ref<double>(entry->row, entry->col) = entry->value;
+  }
+
+  cv::Mat B(n, 8, cv::DataType<double>::type);
+  cv::randn(B, 0, 1);
+  cv::Mat C;
+  while (state.KeepRunning()) {
+    multiply(A, B, C);
+    benchmark::DoNotOptimize(C.data);
+  }
+
+  state.SetItemsProcessed(state.iterations() * A.nzcount());
+}
+
+// The same product with one column, in compressed sparse row form.
+// A third argument gives the number of threads, zero for none.
+void BM_CsrTimesVector(benchmark::State& state) {
+  int n = state.range(0);
+  int k = state.range(1);
+  int num_threads = state.range(2);
+  ThreadPool pool(num_threads);
+
+  std::vector<CsrEntry> entries;
+  makeEntries(n, k, entries);
+  CsrMat A;
+  A.build(n, n, entries);
+
+  std::vector<double> x(n);
+  cv::randn(x, 0, 1);
+  std::vector<double> y(n);
+  while (state.KeepRunning()) {
+    if (num_threads > 0) {
+      A.multiply(x.data(), y.data(), pool);
+    } else {
+      A.multiply(x.data(), y.data());
+    }
+    benchmark::DoNotOptimize(y.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * A.numNonZeros());
+}
+
+BENCHMARK(BM_SparseTimesDense)
+    ->ArgsProduct({ benchmark::CreateRange(1024, 65536, 8), { 4, 32 } })
+    ->ArgNames({ "n", "k" });
+BENCHMARK(BM_CsrTimesVector)
+    ->ArgsProduct({ benchmark::CreateRange(1024, 1 << 20, 8), { 4, 32 },
+        { 0, 4 } })
+    ->ArgNames({ "n", "k", "threads" })
+    ->UseRealTime();
+
+}
@@ -1,4 +1,12 @@
 #include "sparse_mat.hpp"
+#include <cmath>
+#include "csr_mat.hpp"
+#include "lobpcg.hpp"
+#include "match_graph.hpp"
+#include "normalized_cut.hpp"
+#include "scaling_test.hpp"
+#include "util/thread-pool.hpp"
+#include "vertex_subgraph.hpp"
 #include "gtest/gtest.h"
 
 TEST(SparseTimesDense, Basic) {
@@ -72,3 +80,461 @@ TEST(SparsePlusSparse, Basic) {
   double e = E.dot(E);
   ASSERT_EQ(e, 0.);
 }
+
+TEST(CsrTimesVector, Basic) {
+  std::vector<CsrEntry> entries;
+  entries.push_back(CsrEntry(1, 1, 5));
+  entries.push_back(CsrEntry(0, 3, -3));
+  entries.push_back(CsrEntry(1, 0, 1));
+  entries.push_back(CsrEntry(2, 4, -1));
+  // Replaces the earlier entry.
+  entries.push_back(CsrEntry(1, 1, 2));
+
+  CsrMat A;
+  A.build(3, 5, entries);
+  ASSERT_EQ(A.numNonZeros(), 4u);
+
+  double x[] = { 1, 2, 3, 4, 5 };
+  double y[3];
+  A.multiply(x, y);
+
+  ASSERT_EQ(y[0], -12.);
+  ASSERT_EQ(y[1], 5.);
+  ASSERT_EQ(y[2], -5.);
+}
+
+TEST(CsrTimesVector, Parallel) {
+  // Enough entries to be divided amongst the threads, with uneven rows.
+  const int n = 1000;
+  std::vector<CsrEntry> entries;
+  for (int i = 0; i < n; i += 1) {
+    for (int j = 0; j < n; j += 1 + i % 7) {
+      entries.push_back(CsrEntry(i, j, (i + 2 * j) % 11 - 5));
+    }
+  }
+
+  CsrMat A;
+  A.build(n, n, entries);
+
+  std::vector<double> x(n);
+  for (int j = 0; j < n; j += 1) {
+    x[j] = j % 13 - 6;
+  }
+
+  std::vector<double> y(n);
+  A.multiply(&x.front(), &y.front());
+
+  ThreadPool pool(3);
+  std::vector<double> parallel_y(n);
+  A.multiply(&x.front(), &parallel_y.front(), pool);
+
+  // Each row is summed in the same order by either.
+  for (int i = 0; i < n; i += 1) {
+    ASSERT_EQ(parallel_y[i], y[i]);
+  }
+}
+
+TEST(CsrPlusCsr, Basic) {
+  const int ndims = 2;
+  int dims[ndims] = { 4, 5 };
+
+  cv::SparseMat A(ndims, dims, cv::DataType<double>::type);
+  A.ref<double>(0, 3) = -3;
+  A.ref<double>(1, 0) = 1;
+  A.ref<double>(1, 1) = 2;
+  A.ref<double>(3, 4) = -1;
+
+  cv::SparseMat B(ndims, dims, cv::DataType<double>::type);
+  B.ref<double>(0, 0) = 1;
+  B.ref<double>(1, 1) = -4;
+  B.ref<double>(2, 1) = -3;
+  B.ref<double>(3, 3) = 2;
+  B.ref<double>(3, 4) = 1;
+
+  CsrMat csr_A;
+  CsrMat csr_B;
+  csr_A.build(A);
+  csr_B.build(B);
+  CsrMat csr_C;
+  add(csr_A, csr_B, csr_C);
+
+  cv::SparseMat C;
+  csr_C.toSparseMat(C);
+  cv::Mat dense_C;
+  C.copyTo(dense_C);
+
+  // Do dense addition for reference.
+  cv::Mat dense_A;
+  cv::Mat dense_B;
+  A.copyTo(dense_A);
+  B.copyTo(dense_B);
+  cv::Mat ref_C;
+  ref_C = dense_A + dense_B;
+
+  cv::Mat E = dense_C - ref_C;
+  double e = E.dot(E);
+  ASSERT_EQ(e, 0.);
+}
+
+TEST(CsrNormalizedLaplacian, MatchGraph) {
+  std::vector<FeatureIndex> features;
+  for (int i = 0; i < 5; i += 1) {
+    features.push_back(FeatureIndex(0, i, 0));
+  }
+
+  // Two matches between 0 and 1 are summed. Vertex 3 is isolated within the
+  // subset, and 4 is outside it.
+  std::vector<MatchGraphEdge> edges;
+  edges.push_back(MatchGraphEdge(0, 1, 1));
+  edges.push_back(MatchGraphEdge(1, 0, 2));
+  edges.push_back(MatchGraphEdge(1, 2, 4));
+  edges.push_back(MatchGraphEdge(3, 4, 1));
+
+  ThreadPool pool(0);
+  MatchGraph graph;
+  graph.build(features, edges, pool);
+
+  std::vector<int> vertices;
+  vertices.push_back(0);
+  vertices.push_back(1);
+  vertices.push_back(2);
+  vertices.push_back(3);
+
+  CsrMat L;
+  std::vector<double> degrees;
+  normalizedLaplacian(graph, vertices, L, degrees);
+
+  double ref_degrees[] = { 3, 7, 4, 0 };
+  ASSERT_EQ(degrees.size(), 4u);
+  for (int i = 0; i < 4; i += 1) {
+    ASSERT_EQ(degrees[i], ref_degrees[i]);
+  }
+
+  // Reference D^{-1/2} (D - W) D^{-1/2}, with the isolated row left empty.
+  cv::Mat W = (cv::Mat_<double>(4, 4) <<
+      0, 3, 0, 0,
+      3, 0, 4, 0,
+      0, 4, 0, 0,
+      0, 0, 0, 0);
+  cv::Mat ref_L = cv::Mat::zeros(4, 4, cv::DataType<double>::type);
+  for (int i = 0; i < 3; i += 1) {
+    for (int j = 0; j < 3; j += 1) {
+      double d = (i == j) ? ref_degrees[i] : 0;
+      ref_L.at<double>(i, j) = (d - W.at<double>(i, j)) /
+          std::sqrt(ref_degrees[i] * ref_degrees[j]);
+    }
+  }
+
+  cv::SparseMat sparse_L;
+  L.toSparseMat(sparse_L);
+  cv::Mat dense_L;
+  sparse_L.copyTo(dense_L);
+
+  cv::Mat E = dense_L - ref_L;
+  double e = E.dot(E);
+  ASSERT_LT(e, 1e-20);
+  ASSERT_EQ(L.rowBegin(4), L.rowBegin(3));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const int SCALING_ENTRIES_PER_ROW = 8;
+
+// Random entries of a square matrix with a few in each row.
+void randomEntries(int n, int seed, std::vector<CsrEntry>& entries) {
+  cv::RNG rng(seed);
+  entries.clear();
+  for (int i = 0; i < n * SCALING_ENTRIES_PER_ROW; i += 1) {
+    entries.push_back(CsrEntry(rng.uniform(0, n), rng.uniform(0, n),
+          rng.uniform(-1., 1.)));
+  }
+}
+
+}
+
+class CsrBuildTrial : public ScalingTrial {
+  public:
+    CsrBuildTrial() : n_(0), entries_(), A_() {}
+
+    void setUp(int n) {
+      n_ = n;
+      randomEntries(n, 0, entries_);
+    }
+
+    void run() {
+      A_.build(n_, n_, entries_);
+    }
+
+  private:
+    int n_;
+    std::vector<CsrEntry> entries_;
+    CsrMat A_;
+};
+
+// Sorting the entries is O(n log n).
+TEST(CsrMatScaling, Build) {
+  CsrBuildTrial trial;
+  expectExponentBelow(trial, 1 << 13, 1.4);
+}
+
+class CsrMultiplyTrial : public ScalingTrial {
+  public:
+    CsrMultiplyTrial() : A_(), x_(), y_() {}
+
+    void setUp(int n) {
+      std::vector<CsrEntry> entries;
+      randomEntries(n, 0, entries);
+      A_.build(n, n, entries);
+      x_.assign(n, 1.);
+      y_.assign(n, 0.);
+    }
+
+    void run() {
+      // Long enough to time.
+      for (int i = 0; i < 8; i += 1) {
+        A_.multiply(&x_.front(), &y_.front());
+      }
+    }
+
+  private:
+    CsrMat A_;
+    std::vector<double> x_;
+    std::vector<double> y_;
+};
+
+TEST(CsrMatScaling, Multiply) {
+  CsrMultiplyTrial trial;
+  expectExponentBelow(trial, 1 << 13, 1.3);
+}
+
+class CsrAddTrial : public ScalingTrial {
+  public:
+    CsrAddTrial() : A_(), B_(), C_() {}
+
+    void setUp(int n) {
+      std::vector<CsrEntry> entries;
+      randomEntries(n, 0, entries);
+      A_.build(n, n, entries);
+      randomEntries(n, 1, entries);
+      B_.build(n, n, entries);
+    }
+
+    void run() {
+      add(A_, B_, C_);
+    }
+
+  private:
+    CsrMat A_;
+    CsrMat B_;
+    CsrMat C_;
+};
+
+// Merging sorted rows is linear in the number of entries.
+TEST(CsrMatScaling, Add) {
+  CsrAddTrial trial;
+  expectExponentBelow(trial, 1 << 13, 1.4);
+}
+
+// Laplacian of a path of n vertices, whose eigenvalues are 2 - 2 cos(pi k / n)
+// with eigenvectors cos(pi k (i + 1/2) / n).
+TEST(Lobpcg, PathLaplacian) {
+  const int n = 50;
+  std::vector<CsrEntry> entries;
+  for (int i = 0; i < n; i += 1) {
+    int degree = (i > 0) + (i < n - 1);
+    entries.push_back(CsrEntry(i, i, degree));
+    if (i > 0) {
+      entries.push_back(CsrEntry(i, i - 1, -1));
+    }
+    if (i < n - 1) {
+      entries.push_back(CsrEntry(i, i + 1, -1));
+    }
+  }
+  CsrMat L;
+  L.build(n, n, entries);
+
+  // Exclude the constant eigenvector of eigenvalue zero.
+  std::vector<std::vector<double> > constraints(1,
+      std::vector<double>(n, 1. / std::sqrt(double(n))));
+
+  std::vector<double> expected(n);
+  double norm = 0;
+  for (int i = 0; i < n; i += 1) {
+    expected[i] = std::cos(M_PI * (i + 0.5) / n);
+    norm += expected[i] * expected[i];
+  }
+
+  for (int threads = 0; threads < 2; threads += 1) {
+    ThreadPool pool(2);
+    std::vector<double> x;
+    double lambda = 0;
+    ASSERT_TRUE(lobpcg(L, constraints, 2, 2000, 1e-8, x, &lambda,
+          threads == 0 ? NULL : &pool));
+    EXPECT_NEAR(2 - 2 * std::cos(M_PI / n), lambda, 1e-8);
+
+    ASSERT_EQ(n, int(x.size()));
+    double dot = 0;
+    for (int i = 0; i < n; i += 1) {
+      dot += x[i] * expected[i];
+    }
+    EXPECT_NEAR(1, std::abs(dot) / std::sqrt(norm), 1e-6);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Symmetric affinities of a graph of 6 vertices: a path 0-1-2, an edge 3-4,
+// and vertex 5 alone, with an edge 2-3 between them.
+void buildAffinity(CsrMat& W) {
+  std::vector<CsrEntry> entries;
+  int edges[][2] = { { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 4 } };
+  for (int k = 0; k < 4; k += 1) {
+    double weight = k + 1;
+    entries.push_back(CsrEntry(edges[k][0], edges[k][1], weight));
+    entries.push_back(CsrEntry(edges[k][1], edges[k][0], weight));
+  }
+  W.build(6, 6, entries);
+}
+
+cv::Mat toDense(const CsrMat& A) {
+  cv::SparseMat sparse;
+  A.toSparseMat(sparse);
+  cv::Mat dense;
+  sparse.copyTo(dense);
+  return dense;
+}
+
+}
+
+TEST(CsrDiagonalBlocks, KeepsEntriesWithinEachPart) {
+  CsrMat W;
+  buildAffinity(W);
+  int parts[] = { 1, 0, 1, 1, 2, 0 };
+  std::vector<int> labels(parts, parts + 6);
+
+  std::vector<CsrMat> blocks;
+  W.diagonalBlocks(labels, 3, blocks);
+  ASSERT_EQ(3u, blocks.size());
+
+  // Part 0 is vertices 1 and 5, which share no edge.
+  ASSERT_EQ(2, blocks[0].rows());
+  ASSERT_EQ(2, blocks[0].cols());
+  EXPECT_EQ(0u, blocks[0].numNonZeros());
+
+  // Part 1 is vertices 0, 2 and 3, in order, which keeps the edge 2-3.
+  ASSERT_EQ(3, blocks[1].rows());
+  cv::Mat expected = (cv::Mat_<double>(3, 3) <<
+      0, 0, 0,
+      0, 0, 3,
+      0, 3, 0);
+  cv::Mat E = toDense(blocks[1]) - expected;
+  EXPECT_EQ(0, E.dot(E));
+
+  // Part 2 is vertex 4 alone, whose edge was cut.
+  ASSERT_EQ(1, blocks[2].rows());
+  EXPECT_EQ(0u, blocks[2].numNonZeros());
+  EXPECT_EQ(blocks[2].rowBegin(0), blocks[2].rowBegin(1));
+}
+
+TEST(CsrDiagonalBlocks, OnePartIsWholeMatrix) {
+  CsrMat W;
+  buildAffinity(W);
+  std::vector<CsrMat> blocks;
+  W.diagonalBlocks(std::vector<int>(6, 0), 1, blocks);
+  ASSERT_EQ(1u, blocks.size());
+  cv::Mat E = toDense(blocks[0]) - toDense(W);
+  EXPECT_EQ(0, E.dot(E));
+  EXPECT_EQ(W.numNonZeros(), blocks[0].numNonZeros());
+}
+
+TEST(FindSideComponents, SplitsEachSideIntoComponents) {
+  CsrMat W;
+  buildAffinity(W);
+  // The cut separates 0-1 from 2-3-4, and 5 is alone on the first side.
+  int sides[] = { 0, 0, 1, 1, 1, 0 };
+  std::vector<int> labels(sides, sides + 6);
+
+  std::vector<int> components;
+  ASSERT_EQ(3, findSideComponents(W, labels, components));
+  // First side first, each in order of first vertex.
+  int expected[] = { 0, 0, 2, 2, 2, 1 };
+  ASSERT_EQ(6u, components.size());
+  for (int i = 0; i < 6; i += 1) {
+    EXPECT_EQ(expected[i], components[i]) << "Vertex " << i;
+  }
+
+  // A cut through the path leaves 1 apart from 0 and 2.
+  int path_sides[] = { 0, 1, 0, 0, 0, 0 };
+  labels.assign(path_sides, path_sides + 6);
+  ASSERT_EQ(4, findSideComponents(W, labels, components));
+  int path_expected[] = { 0, 3, 1, 1, 1, 2 };
+  for (int i = 0; i < 6; i += 1) {
+    EXPECT_EQ(path_expected[i], components[i]) << "Vertex " << i;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Graph of 5 features with edges 0-1, 1-2 and 3-4.
+void buildMatchGraph(MatchGraph& graph) {
+  std::vector<FeatureIndex> features;
+  for (int i = 0; i < 5; i += 1) {
+    features.push_back(FeatureIndex(0, i, 0));
+  }
+  std::vector<MatchGraphEdge> edges;
+  edges.push_back(MatchGraphEdge(0, 1, 1));
+  edges.push_back(MatchGraphEdge(1, 2, 1));
+  edges.push_back(MatchGraphEdge(3, 4, 1));
+  ThreadPool pool(0);
+  graph.build(features, edges, pool);
+}
+
+}
+
+TEST(VertexSubgraph, RootHasEveryVertex) {
+  MatchGraph graph;
+  buildMatchGraph(graph);
+  VertexSubgraph root(graph);
+  EXPECT_EQ(5u, num_vertices(root));
+  EXPECT_EQ(3u, num_edges(root));
+  EXPECT_EQ(&root, &root.root());
+  for (int v = 0; v < 5; v += 1) {
+    EXPECT_EQ(v, root.local_to_global(v));
+    EXPECT_EQ(v, root.global_to_local(v));
+  }
+}
+
+TEST(VertexSubgraph, SubgraphKeepsVerticesSortedAndUnique) {
+  MatchGraph graph;
+  buildMatchGraph(graph);
+  VertexSubgraph root(graph);
+  VertexSubgraph& subgraph = root.create_subgraph();
+  EXPECT_EQ(0u, num_vertices(subgraph));
+  EXPECT_EQ(&root, &subgraph.root());
+
+  add_vertex(4, subgraph);
+  add_vertex(1, subgraph);
+  add_vertex(2, subgraph);
+  add_vertex(1, subgraph);
+  ASSERT_EQ(3u, num_vertices(subgraph));
+  EXPECT_EQ(1, subgraph.local_to_global(0));
+  EXPECT_EQ(2, subgraph.local_to_global(1));
+  EXPECT_EQ(4, subgraph.local_to_global(2));
+  EXPECT_EQ(2, subgraph.global_to_local(4));
+
+  // Only the edge 1-2 is between vertices of the subgraph.
+  EXPECT_EQ(1u, num_edges(subgraph));
+
+  // Subgraphs of subgraphs are owned by the root.
+  VertexSubgraph& grandchild = subgraph.create_subgraph();
+  EXPECT_EQ(&root, &grandchild.root());
+  add_vertex(3, grandchild);
+  add_vertex(4, grandchild);
+  EXPECT_EQ(1u, num_edges(grandchild));
+}
@@ -1,28 +1,30 @@
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <sstream>
-#include <stack>
 #include <map>
 #include <set>
 #include <glog/logging.h>
 #include <gflags/gflags.h>
 #include <boost/lexical_cast.hpp>
 #include <boost/format.hpp>
-#include <boost/bind.hpp>
-#include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/connected_components.hpp>
-#include <boost/graph/subgraph.hpp>
-#include <boost/graph/copy.hpp>
-#include <boost/graph/graph_traits.hpp>
-#include <boost/property_map/property_map.hpp>
-#include <boost/typeof/typeof.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "match.hpp"
 #include "multiview_track.hpp"
 #include "multiview_track_list.hpp"
 #include "feature_index.hpp"
+#include "feature_index_map.hpp"
+#include "clustering_checkpoint.hpp"
+#include "csr_mat.hpp"
+#include "match_graph.hpp"
+#include "match_store.hpp"
+#include "recursive_cut.hpp"
+#include "vertex_subgraph.hpp"
+#include "util/memory.hpp"
+#include "util/thread-pool.hpp"
+#include "util/trace.hpp"
 #include "normalized_cut.hpp"
-#include "sparse_mat.hpp"
 
 #include "read_lines.hpp"
 #include "iterator_reader.hpp"
@@ -35,23 +37,28 @@ const int MIN_GRAPH_SIZE = 2;
 const int MAX_GRAPH_SIZE = 10000;
 
 DEFINE_int32(max_iter, 1000, "Maximum number of iterations");
-
-// boost::subgraph requires vertex_index_t and edge_index_t.
-typedef boost::property<boost::vertex_index_t, int,
-                        FeatureIndex>
-        VertexProperty;
-typedef boost::property<boost::edge_index_t, int,
-        boost::property<boost::edge_weight_t, int> >
-        EdgeProperty;
-typedef boost::subgraph<
-          boost::adjacency_list<boost::vecS,
-                                boost::vecS,
-                                boost::undirectedS,
-                                VertexProperty,
-                                EdgeProperty> >
-        Graph;
-
-typedef std::map<FeatureIndex, Graph::vertex_descriptor> VertexLookup;
+DEFINE_string(eigen_solver, "",
+    "Eigensolver for the normalized cut, arpack or lobpcg. Empty for arpack "
+    "if built with it, otherwise lobpcg");
+DEFINE_double(lobpcg_tolerance, 1e-6,
+    "Residual norm at which LOBPCG stops");
+DEFINE_int32(lobpcg_block_size, 2,
+    "Number of vectors which LOBPCG iterates together");
+DEFINE_bool(warm_start, true,
+    "Start LOBPCG from the relaxed cut of the parent graph");
+
+typedef FeatureIndexMap<int> VertexLookup;
+
+DEFINE_int32(num_threads, 4,
+    "Number of worker threads to cut subgraphs with, 0 for none");
+DEFINE_string(checkpoint, "",
+    "Periodically save the subgraphs which remain to be cut to this file");
+DEFINE_int32(checkpoint_interval, 600,
+    "Minimum number of seconds between checkpoints");
+DEFINE_bool(resume, false,
+    "Resume partitioning from the checkpoint file, if it exists");
+DEFINE_string(trace, "",
+    "File to write a trace of memory use to, if built with tracing");
 
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
@@ -59,6 +66,9 @@ void init(int& argc, char**& argv) {
   usage << std::endl;
   usage << argv[0] << " matches-format view-names num-frames tracks" <<
       std::endl;
+  usage << std::endl;
+  usage << "matches-format may instead be a match store of the same pairs "
+    "(see pack-matches)." << std::endl;
   google::SetUsageMessage(usage.str());
 
   google::InitGoogleLogging(argv[0]);
@@ -68,6 +78,8 @@ void init(int& argc, char**& argv) {
     google::ShowUsageWithFlags(argv[0]);
     std::exit(1);
   }
+  CHECK(!FLAGS_resume || !FLAGS_checkpoint.empty()) <<
+      "Resuming requires a checkpoint file";
 }
 
 std::string makeMatchFilename(const std::string& format,
@@ -79,37 +91,43 @@ std::string makeMatchFilename(const std::string& format,
       boost::format(format) % view1 % view2 % (time1 + 1) % (time2 + 1));
 }
 
-Graph::vertex_descriptor findOrInsert(Graph& graph,
-                                      VertexLookup& vertices,
-                                      const FeatureIndex& feature) {
-  Graph::vertex_descriptor vertex;
-
-  // Try to find feature in lookup map.
-  VertexLookup::const_iterator mapping = vertices.find(feature);
+int findOrInsert(std::vector<FeatureIndex>& features,
+                 VertexLookup& vertices,
+                 const FeatureIndex& feature) {
+  // Reserve an entry in the lookup table, filled in if the feature is new.
+  std::pair<int*, bool> mapping = vertices.insert(feature, 0);
 
-  if (mapping != vertices.end()) {
-    // Found the vertex, it already exists.
-    vertex = mapping->second;
-  } else {
-    // Did not find it, create an entry.
-    vertex = boost::add_vertex(graph);
-    graph[vertex] = feature;
-    // Create an entry in the lookup table too.
-    vertices[feature] = vertex;
+  if (mapping.second) {
+    // Did not find it, create a vertex.
+    features.push_back(feature);
+    *mapping.first = features.size() - 1;
   }
 
-  return vertex;
+  return *mapping.first;
 }
 
 void loadAllMatches(const std::string& matches_format,
                     const std::vector<std::string>& views,
                     int num_frames,
-                    Graph& graph) {
+                    MatchGraph& graph,
+                    ThreadPool& pool) {
   int num_views = views.size();
   int n = num_views * num_frames;
   int num_matches = 0;
 
   VertexLookup vertices;
+  std::vector<FeatureIndex> features;
+  std::vector<MatchGraphEdge> edges;
+
+  if (isBinaryFilename(matches_format)) {
+    // Take the edges of every pair from one mapped store.
+    MatchStore store;
+    bool ok = store.open(matches_format);
+    CHECK(ok) << "Could not load matches";
+    addMatchStoreEdges(store, vertices, features, edges);
+    graph.build(features, edges, pool);
+    return;
+  }
 
   for (int i1 = 0; i1 < n; i1 += 1) {
     // Match all unique pairs.
@@ -144,25 +162,23 @@ void loadAllMatches(const std::string& matches_format,
         FeatureIndex feature2(frame2, match->second);
 
         // Find existing vertex for feature, or insert one.
-        Graph::vertex_descriptor vertex1;
-        Graph::vertex_descriptor vertex2;
-        vertex1 = findOrInsert(graph, vertices, feature1);
-        vertex2 = findOrInsert(graph, vertices, feature2);
-
-        // Add vertex to graph. Set edge weight to 1.
-        EdgeProperty edge(0, 1);
-        boost::add_edge(vertex1, vertex2, edge, graph);
+        int vertex1 = findOrInsert(features, vertices, feature1);
+        int vertex2 = findOrInsert(features, vertices, feature2);
+
+        // Add edge to graph. Set edge weight to 1.
+        edges.push_back(MatchGraphEdge(vertex1, vertex2, 1));
       }
     }
   }
-}
 
-void splitIntoComponents(Graph& graph, std::vector<Graph*>& subgraphs) {
-  int num_vertices = boost::num_vertices(graph);
+  graph.build(features, edges, pool);
+}
 
+void splitIntoComponents(VertexSubgraph& graph,
+                         std::vector<VertexSubgraph*>& subgraphs) {
   // Extract connected components.
-  std::vector<int> labels(num_vertices);
-  int num_components = boost::connected_components(graph, &labels.front());
+  std::vector<int> labels;
+  int num_components = findConnectedComponents(graph.graph(), labels);
 
   subgraphs.clear();
   for (int i = 0; i < num_components; i += 1) {
@@ -170,23 +186,22 @@ void splitIntoComponents(Graph& graph, std::vector<Graph*>& subgraphs) {
     subgraphs.push_back(&graph.create_subgraph());
   }
 
-  // Add each vertex to one subgraph.
+  // Add each vertex to one subgraph, in order.
+  int num_vertices = labels.size();
   for (int v = 0; v < num_vertices; v += 1) {
-    boost::add_vertex(graph.local_to_global(v), *subgraphs[labels[v]]);
+    add_vertex(v, *subgraphs[labels[v]]);
   }
 }
 
 // Returns false iff a feature appears twice in the same image.
-bool isConsistent(const Graph& graph) {
+bool isConsistent(const VertexSubgraph& subgraph) {
+  const MatchGraph& graph = subgraph.graph();
   std::set<ImageIndex> visible;
 
-  // Get (begin, end) pair of vertex iterators.
-  std::pair<Graph::vertex_iterator, Graph::vertex_iterator> vertices;
-  vertices = boost::vertices(graph);
-
   // Iterate through all vertices.
-  Graph::vertex_iterator vertex;
-  for (vertex = vertices.first; vertex != vertices.second; ++vertex) {
+  const std::vector<int>& vertices = subgraph.vertices();
+  std::vector<int>::const_iterator vertex;
+  for (vertex = vertices.begin(); vertex != vertices.end(); ++vertex) {
     const FeatureIndex& feature = graph[*vertex];
     ImageIndex frame(feature.view, feature.time);
 
@@ -203,113 +218,231 @@ bool isConsistent(const Graph& graph) {
   return true;
 }
 
-void cut(Graph& parent, Graph*& child1, Graph*& child2) {
-  int num_vertices = boost::num_vertices(parent);
+NormalizedCutOptions normalizedCutOptions() {
+  NormalizedCutOptions options;
+  options.max_iter = FLAGS_max_iter;
+  options.tolerance = FLAGS_lobpcg_tolerance;
+  options.block_size = FLAGS_lobpcg_block_size;
+
+  if (FLAGS_eigen_solver.empty()) {
+    // The default of the build.
+  } else if (FLAGS_eigen_solver == "arpack") {
+    options.solver = ARPACK_SOLVER;
+  } else if (FLAGS_eigen_solver == "lobpcg") {
+    options.solver = LOBPCG_SOLVER;
+  } else {
+    LOG(FATAL) << "Unknown eigensolver \"" << FLAGS_eigen_solver << "\"";
+  }
 
-  child1 = &parent.create_subgraph();
-  child2 = &parent.create_subgraph();
+  return options;
+}
 
-  // Spectral clustering.
-  std::vector<int> labels;
-  bool ok = normalizedCut(parent, labels, FLAGS_max_iter);
-
-  if (ok) {
-    for (int j = 0; j < num_vertices; j += 1) {
-      if (labels[j] == 0) {
-        boost::add_vertex(parent.local_to_global(j), *child1);
-      } else {
-        boost::add_vertex(parent.local_to_global(j), *child2);
+// Divides subgraphs by their normalized cut, then into connected components,
+// until they are consistent.
+//
+// The affinity matrix of a subgraph is kept from its cut, and divided into
+// the blocks of its children, so that no child is built from the graph again.
+// Each child's degrees are those of its rows in the parent, less the edges
+// which were cut. Only the components of the whole graph, and subgraphs
+// restored from a checkpoint, are built from the graph.
+//
+// ARPACK serializes the cuts, so each product by the Laplacian is divided
+// amongst the pool in turn. LOBPCG may start each child from the relaxed
+// solution of its parent, restricted to its vertices.
+class NormalizedCutDivider : public SubgraphDivider<VertexSubgraph> {
+  public:
+    NormalizedCutDivider(const NormalizedCutOptions& options,
+                         bool warm_start,
+                         ThreadPool& pool)
+        : options_(options),
+          warm_start_(warm_start && options.solver == LOBPCG_SOLVER),
+          pool_(&pool),
+          affinities_(),
+          relaxed_(),
+          mutex_() {}
+
+    Decision examine(const VertexSubgraph& subgraph,
+                     std::vector<int>& labels) const {
+      int num_vertices = subgraph.numVertices();
+
+      if (num_vertices > MAX_GRAPH_SIZE) {
+        // Too big for the cut algorithm to handle.
+        LOG(WARNING) << "Skipping subgraph with too many vertices (" <<
+            num_vertices << " > " << MAX_GRAPH_SIZE << ")";
+        forget(subgraph);
+        return DISCARD_SUBGRAPH;
       }
-    }
-  }
-}
 
-void recursiveCut(std::vector<Graph*>& subgraphs) {
-  // Copy into stack.
-  std::deque<Graph*> deque(subgraphs.begin(), subgraphs.end());
-  std::stack<Graph*> pending(deque);
-  // Replace with output.
-  subgraphs.clear();
+      if (num_vertices < MIN_GRAPH_SIZE) {
+        // Not enough observations, forget about it.
+        DLOG(INFO) << "Skipping subgraph with too few vertices (" <<
+            num_vertices << " < " << MIN_GRAPH_SIZE << ")";
+        forget(subgraph);
+        return DISCARD_SUBGRAPH;
+      }
 
-  while (!pending.empty()) {
-    Graph* subgraph = pending.top();
-    pending.pop();
+      if (isConsistent(subgraph)) {
+        DLOG(INFO) << "Found consistent subgraph with " << num_vertices <<
+            " vertices";
+        forget(subgraph);
+        return ACCEPT_SUBGRAPH;
+      }
 
-    int num_vertices = boost::num_vertices(*subgraph);
+      // Spectral clustering.
+      CsrMat W;
+      takeAffinity(subgraph, W);
+      std::vector<double> relaxed;
+      takeRelaxed(subgraph, &relaxed);
+      bool ok = normalizedCut(W, labels, options_, &relaxed, *pool_);
+      if (!ok) {
+        return DISCARD_SUBGRAPH;
+      }
 
-    if (num_vertices > MAX_GRAPH_SIZE) {
-      // Too big for the cut algorithm to handle.
-      LOG(WARNING) << "Skipping subgraph with too many vertices (" <<
-          num_vertices << " > " << MAX_GRAPH_SIZE << ")";
-      continue;
+      // Kept for divide().
+      boost::mutex::scoped_lock lock(mutex_);
+      affinities_[&subgraph].swap(W);
+      if (warm_start_) {
+        relaxed_[&subgraph].swap(relaxed);
+      }
+      return DIVIDE_SUBGRAPH;
     }
 
-    if (num_vertices < MIN_GRAPH_SIZE) {
-      // Not enough observations, forget about it.
-      DLOG(INFO) << "Skipping subgraph with too few vertices (" <<
-          num_vertices << " < " << MIN_GRAPH_SIZE << ")";
-      continue;
-    }
+    void divide(VertexSubgraph& subgraph,
+                const std::vector<int>& labels,
+                std::vector<VertexSubgraph*>& children) const {
+      int num_vertices = subgraph.numVertices();
+      int n1 = std::count(labels.begin(), labels.end(), 0);
+      int n2 = num_vertices - n1;
+
+      // Split both sides into their components, and the affinities into the
+      // blocks of the components.
+      std::vector<int> components;
+      std::vector<CsrMat> blocks;
+      {
+        CsrMat W;
+        takeAffinity(subgraph, W);
+        int num_components = findSideComponents(W, labels, components);
+        W.diagonalBlocks(components, num_components, blocks);
+      }
 
-    if (isConsistent(*subgraph)) {
-      // Move to list of valid subgraphs.
-      subgraphs.push_back(subgraph);
+      int first = children.size();
+      for (size_t i = 0; i < blocks.size(); i += 1) {
+        children.push_back(&subgraph.create_subgraph());
+      }
+      for (int v = 0; v < num_vertices; v += 1) {
+        add_vertex(subgraph.local_to_global(v),
+            *children[first + components[v]]);
+      }
+
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        for (size_t i = 0; i < blocks.size(); i += 1) {
+          affinities_[children[first + i]].swap(blocks[i]);
+        }
+      }
+
+      if (warm_start_) {
+        std::vector<VertexSubgraph*> added(children.begin() + first,
+            children.end());
+        restrictRelaxed(subgraph, components, added);
+      }
 
-      DLOG(INFO) << "Found consistent subgraph with " << num_vertices <<
-          " vertices";
-      continue;
+      DLOG(INFO) << num_vertices << " => {" << n1 << ", " << n2 << "}";
     }
 
-    // Cut the subgraph in two.
-    Graph* subgraph1;
-    Graph* subgraph2;
-    cut(*subgraph, subgraph1, subgraph2);
+  private:
+    // Removes the affinity matrix saved for a subgraph, or builds it from the
+    // graph if there is none.
+    void takeAffinity(const VertexSubgraph& subgraph, CsrMat& W) const {
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        AffinityMap::iterator entry = affinities_.find(&subgraph);
+        if (entry != affinities_.end()) {
+          W.swap(entry->second);
+          affinities_.erase(entry);
+          return;
+        }
+      }
+
+      affinityMatrix(subgraph.graph(), subgraph.vertices(), W);
+    }
 
-    int n1 = boost::num_vertices(*subgraph1);
-    int n2 = boost::num_vertices(*subgraph2);
+    // Removes everything saved for a subgraph which will not be divided.
+    void forget(const VertexSubgraph& subgraph) const {
+      boost::mutex::scoped_lock lock(mutex_);
+      affinities_.erase(&subgraph);
+      relaxed_.erase(&subgraph);
+    }
 
-    // Add both children.
-    if (n1 > 0) {
-      // Split into components.
-      std::vector<Graph*> children;
-      splitIntoComponents(*subgraph1, children);
+    // Removes the relaxed solution saved for a subgraph, if any.
+    void takeRelaxed(const VertexSubgraph& subgraph,
+                     std::vector<double>* relaxed) const {
+      if (!warm_start_) {
+        return;
+      }
 
-      std::vector<Graph*>::const_iterator child;
-      for (child = children.begin(); child != children.end(); ++child) {
-        pending.push(*child);
+      boost::mutex::scoped_lock lock(mutex_);
+      RelaxedMap::iterator entry = relaxed_.find(&subgraph);
+      if (entry != relaxed_.end()) {
+        if (relaxed != NULL) {
+          relaxed->swap(entry->second);
+        }
+        relaxed_.erase(entry);
       }
     }
 
-    if (n2 > 0) {
-      // Split into components.
-      std::vector<Graph*> children;
-      splitIntoComponents(*subgraph2, children);
+    // Saves the relaxed solution of the parent for each child, given the
+    // child of each vertex of the parent.
+    void restrictRelaxed(const VertexSubgraph& parent,
+                         const std::vector<int>& components,
+                         const std::vector<VertexSubgraph*>& children) const {
+      std::vector<double> relaxed;
+      takeRelaxed(parent, &relaxed);
+      if (relaxed.empty()) {
+        return;
+      }
+
+      // Vertices keep their order in each child.
+      std::vector<std::vector<double> > restricted(children.size());
+      int num_vertices = components.size();
+      for (int v = 0; v < num_vertices; v += 1) {
+        restricted[components[v]].push_back(relaxed[v]);
+      }
 
-      std::vector<Graph*>::const_iterator child;
-      for (child = children.begin(); child != children.end(); ++child) {
-        pending.push(*child);
+      boost::mutex::scoped_lock lock(mutex_);
+      for (size_t i = 0; i < children.size(); i += 1) {
+        relaxed_[children[i]].swap(restricted[i]);
       }
     }
 
-    DLOG(INFO) << num_vertices << " => {" << n1 << ", " << n2 << "}";
-  }
-}
-
-void subgraphToTrack(const Graph& subgraph,
+    typedef std::map<const VertexSubgraph*, CsrMat> AffinityMap;
+    typedef std::map<const VertexSubgraph*, std::vector<double> > RelaxedMap;
+
+    NormalizedCutOptions options_;
+    bool warm_start_;
+    ThreadPool* pool_;
+    // Affinity matrices of subgraphs which were cut by examine(), and of the
+    // children created by divide(). Cuts run concurrently.
+    mutable AffinityMap affinities_;
+    // Relaxed solutions to start subgraphs from.
+    mutable RelaxedMap relaxed_;
+    mutable boost::mutex mutex_;
+};
+
+void subgraphToTrack(const VertexSubgraph& subgraph,
                      MultiviewTrack<int>& track,
                      int num_views) {
+  const MatchGraph& graph = subgraph.graph();
+
   // Clear track.
   track = MultiviewTrack<int>(num_views);
 
   // Iterate over vertices.
-  Graph::vertex_iterator begin;
-  Graph::vertex_iterator end;
-  boost::tie(begin, end) = boost::vertices(subgraph);
-
-  Graph::vertex_iterator vertex;
-  for (vertex = begin; vertex != end; ++vertex) {
+  const std::vector<int>& vertices = subgraph.vertices();
+  std::vector<int>::const_iterator vertex;
+  for (vertex = vertices.begin(); vertex != vertices.end(); ++vertex) {
     // Access feature.
-    const FeatureIndex& feature = subgraph[*vertex];
+    const FeatureIndex& feature = graph[*vertex];
 
     // Check it doesn't already exist.
     Track<int>& view_track = track.view(feature.view);
@@ -321,12 +454,12 @@ void subgraphToTrack(const Graph& subgraph,
   }
 }
 
-void subgraphsToTracks(const std::vector<Graph*>& subgraphs,
+void subgraphsToTracks(const std::vector<VertexSubgraph*>& subgraphs,
                        MultiviewTrackList<int>& tracks,
                        int num_views) {
   tracks = MultiviewTrackList<int>(num_views);
 
-  std::vector<Graph*>::const_iterator subgraph;
+  std::vector<VertexSubgraph*>::const_iterator subgraph;
   for (subgraph = subgraphs.begin(); subgraph != subgraphs.end(); ++subgraph) {
     // Create track.
     MultiviewTrack<int> track;
@@ -340,6 +473,8 @@ void subgraphsToTracks(const std::vector<Graph*>& subgraphs,
 
 int main(int argc, char** argv) {
   init(argc, argv);
+  TRACE_INIT(FLAGS_trace);
+  MEMORY_STAGES(stages);
 
   std::string matches_format = argv[1];
   std::string view_names_file = argv[2];
@@ -353,24 +488,48 @@ int main(int argc, char** argv) {
   int num_views = views.size();
   CHECK(ok) << "Could not load view names";
 
+  ThreadPool pool(FLAGS_num_threads);
+
   // Load matches.
-  Graph graph;
-  loadAllMatches(matches_format, views, num_frames, graph);
-  int num_vertices = boost::num_vertices(graph);
-  int num_edges = boost::num_edges(graph);
-  LOG(INFO) << "Loaded " << num_edges << " matches between " << num_vertices <<
-      " features";
-
-  std::vector<Graph*> subgraphs;
-  splitIntoComponents(graph, subgraphs);
-  int num_components = subgraphs.size();
-  LOG(INFO) << "Found " << num_components << " connected components";
+  MEMORY_NEXT_STAGE(stages, "load matches into graph");
+  MatchGraph graph;
+  loadAllMatches(matches_format, views, num_frames, graph, pool);
+  LOG(INFO) << "Loaded " << graph.numEdges() << " matches between " <<
+      graph.numVertices() << " features";
+
+  VertexSubgraph root(graph);
+  NormalizedCutDivider divider(normalizedCutOptions(), FLAGS_warm_start,
+      pool);
+  ParallelRecursiveCut<VertexSubgraph> cutter(root, divider,
+      SPECTRAL_PARTITION_GRAPH);
+  cutter.setCheckpoint(FLAGS_checkpoint, FLAGS_checkpoint_interval);
+
+  MEMORY_NEXT_STAGE(stages, "split into components");
+  ClusteringCheckpoint checkpoint;
+  if (FLAGS_resume && loadClusteringCheckpoint(FLAGS_checkpoint, checkpoint)) {
+    ok = cutter.resume(checkpoint);
+    CHECK(ok) << "Could not resume from checkpoint";
+    LOG(INFO) << "Resumed after " << cutter.numCuts() << " cuts with " <<
+        cutter.numPending() << " subgraphs pending";
+  } else {
+    std::vector<VertexSubgraph*> components;
+    splitIntoComponents(root, components);
+    int num_components = components.size();
+    LOG(INFO) << "Found " << num_components << " connected components";
+    cutter.init(components);
+  }
 
   // Recursively partition.
-  recursiveCut(subgraphs);
+  MEMORY_NEXT_STAGE(stages, "partition");
+  ok = cutter.run(pool);
+  if (!ok) {
+    LOG(WARNING) << "Some checkpoints could not be saved";
+  }
+  const std::vector<VertexSubgraph*>& subgraphs = cutter.subgraphs();
   LOG(INFO) << "Found " << subgraphs.size() << " valid tracks";
 
   // Convert each consistent subgraph to a multi-view track of indices.
+  MEMORY_NEXT_STAGE(stages, "convert to track list");
   MultiviewTrackList<int> tracks;
   subgraphsToTracks(subgraphs, tracks, num_views);
 
@@ -0,0 +1,62 @@
+#include "stage_job.hpp"
+
+bool Job::parse(const std::string& request, std::string& error) {
+  std::istringstream stream(request);
+  std::string word;
+  while (stream >> word) {
+    std::string::size_type equals = word.find('=');
+    if (stage_.empty()) {
+      stage_ = word;
+    } else if (equals == std::string::npos) {
+      arguments_.push_back(word);
+    } else {
+      std::string name = word.substr(0, equals);
+      if (options_.count(name) > 0) {
+        error = "Option " + name + " given twice";
+        return false;
+      }
+      options_[name] = word.substr(equals + 1);
+    }
+  }
+
+  if (stage_.empty()) {
+    error = "Empty request";
+    return false;
+  }
+  return true;
+}
+
+const std::string& Job::stage() const {
+  return stage_;
+}
+
+const std::vector<std::string>& Job::arguments() const {
+  return arguments_;
+}
+
+bool Job::option(const std::string& name, bool& value, std::string& error) {
+  std::string text;
+  if (!option(name, text, error)) {
+    return false;
+  }
+  if (text == "true" || text == "1") {
+    value = true;
+  } else if (text == "false" || text == "0") {
+    value = false;
+  } else if (!text.empty()) {
+    error = "Could not parse option " + name + "=" + text;
+    return false;
+  }
+  return true;
+}
+
+bool Job::checkOptions(std::string& error) const {
+  std::map<std::string, std::string>::const_iterator entry;
+  for (entry = options_.begin(); entry != options_.end(); ++entry) {
+    if (used_.count(entry->first) == 0) {
+      error = "Unknown option " + entry->first + " for " + stage_;
+      return false;
+    }
+  }
+  return true;
+}
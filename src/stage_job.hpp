@@ -0,0 +1,37 @@
+#ifndef STAGE_JOB_HPP_
+#define STAGE_JOB_HPP_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// One request to serve-stages, "stage argument... name=value...".
+class Job {
+  public:
+    // Returns false if the request is empty or repeats an option.
+    bool parse(const std::string& request, std::string& error);
+
+    const std::string& stage() const;
+    const std::vector<std::string>& arguments() const;
+
+    // Leaves the value as it is if the option was not given. Returns false
+    // if the option does not parse.
+    template<class T>
+    bool option(const std::string& name, T& value, std::string& error);
+    // Takes true, false, 1 or 0.
+    bool option(const std::string& name, bool& value, std::string& error);
+
+    // Returns false if an option was given which the stage does not take.
+    bool checkOptions(std::string& error) const;
+
+  private:
+    std::string stage_;
+    std::vector<std::string> arguments_;
+    std::map<std::string, std::string> options_;
+    std::set<std::string> used_;
+};
+
+#include "stage_job.inl"
+
+#endif
@@ -0,0 +1,19 @@
+#include <sstream>
+
+template<class T>
+bool Job::option(const std::string& name, T& value, std::string& error) {
+  used_.insert(name);
+  std::map<std::string, std::string>::const_iterator entry =
+      options_.find(name);
+  if (entry == options_.end()) {
+    return true;
+  }
+
+  std::istringstream stream(entry->second);
+  std::string rest;
+  if (!(stream >> value) || stream >> rest) {
+    error = "Could not parse option " + name + "=" + entry->second;
+    return false;
+  }
+  return true;
+}
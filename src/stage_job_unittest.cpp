@@ -0,0 +1,80 @@
+#include "stage_job.hpp"
+#include <string>
+#include "gtest/gtest.h"
+
+TEST(Job, ParsesStageArgumentsAndOptions) {
+  Job job;
+  std::string error;
+  ASSERT_TRUE(job.parse("match-features a.bin  b.bin max_num=3 m.yaml\n",
+      error));
+  EXPECT_EQ("match-features", job.stage());
+  ASSERT_EQ(3, int(job.arguments().size()));
+  EXPECT_EQ("a.bin", job.arguments()[0]);
+  EXPECT_EQ("b.bin", job.arguments()[1]);
+  EXPECT_EQ("m.yaml", job.arguments()[2]);
+
+  int max_num = 1;
+  EXPECT_TRUE(job.option("max_num", max_num, error));
+  EXPECT_EQ(3, max_num);
+  EXPECT_TRUE(job.checkOptions(error));
+}
+
+TEST(Job, RejectsEmptyRequest) {
+  Job job;
+  std::string error;
+  EXPECT_FALSE(job.parse(" \t\n", error));
+  EXPECT_FALSE(error.empty());
+}
+
+TEST(Job, RejectsRepeatedOption) {
+  Job job;
+  std::string error;
+  EXPECT_FALSE(job.parse("find-keypoints a b x=1 x=2", error));
+  EXPECT_NE(std::string::npos, error.find("x"));
+}
+
+TEST(Job, KeepsDefaultOfMissingOption) {
+  Job job;
+  std::string error;
+  ASSERT_TRUE(job.parse("find-keypoints a b", error));
+  double threshold = 0.04;
+  EXPECT_TRUE(job.option("contrast_threshold", threshold, error));
+  EXPECT_EQ(0.04, threshold);
+}
+
+TEST(Job, RejectsOptionWhichDoesNotParse) {
+  Job job;
+  std::string error;
+  ASSERT_TRUE(job.parse("match-features max_num=3x near=", error));
+  int max_num = 1;
+  EXPECT_FALSE(job.option("max_num", max_num, error));
+  double near = 1;
+  EXPECT_FALSE(job.option("near", near, error));
+}
+
+TEST(Job, ParsesBooleans) {
+  Job job;
+  std::string error;
+  ASSERT_TRUE(job.parse("s a=true b=0 c=yes", error));
+  bool a = false;
+  bool b = true;
+  bool c = false;
+  bool d = true;
+  EXPECT_TRUE(job.option("a", a, error));
+  EXPECT_TRUE(a);
+  EXPECT_TRUE(job.option("b", b, error));
+  EXPECT_FALSE(b);
+  EXPECT_FALSE(job.option("c", c, error));
+  EXPECT_TRUE(job.option("d", d, error));
+  EXPECT_TRUE(d);
+}
+
+TEST(Job, RejectsUnknownOption) {
+  Job job;
+  std::string error;
+  ASSERT_TRUE(job.parse("find-keypoints a b typo=1", error));
+  double threshold = 0.04;
+  EXPECT_TRUE(job.option("contrast_threshold", threshold, error));
+  EXPECT_FALSE(job.checkOptions(error));
+  EXPECT_NE(std::string::npos, error.find("typo"));
+}
@@ -0,0 +1,407 @@
+#include "stages.hpp"
+#include <algorithm>
+#include <numeric>
+#include <glog/logging.h>
+#include "find_matches.hpp"
+#include "match_combination.hpp"
+#include "match_result.hpp"
+#include "sift_pyramid.hpp"
+
+// Detector settings of find-keypoints, other than the threshold.
+const int MAX_NUM_FEATURES = 0;
+const int NUM_OCTAVE_LAYERS = 3;
+const double EDGE_THRESHOLD = 10;
+const double SIGMA = 1.6;
+
+SiftOptions findKeypointsOptions(double contrast_threshold) {
+  SiftOptions options;
+  options.max_num_features = MAX_NUM_FEATURES;
+  options.num_octave_layers = NUM_OCTAVE_LAYERS;
+  options.contrast_threshold = contrast_threshold;
+  options.edge_threshold = EDGE_THRESHOLD;
+  options.sigma = SIGMA;
+  return options;
+}
+
+void findKeypoints(const cv::Mat& image,
+                   double contrast_threshold,
+                   std::vector<SiftFeature>& features) {
+  extractFeatures(image, features, findKeypointsOptions(contrast_threshold));
+}
+
+void findKeypoints(const cv::Mat& image,
+                   const SiftOptions& options,
+                   const PlaneCache& cache,
+                   std::vector<SiftFeature>& features) {
+  if (cache.enabled()) {
+    SiftPyramid pyramid(image, options.num_octave_layers, options.sigma,
+        cache);
+    extractFeatures(pyramid, features, options);
+  } else {
+    extractFeatures(image, features, options);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+MatchOptions::MatchOptions()
+    : use_max_num(false),
+      max_num(1),
+      use_absolute_threshold(false),
+      absolute_threshold(1),
+      reciprocal(false) {}
+
+void matchFeatures(const DescriptorIndex& index1,
+                   const DescriptorIndex& index2,
+                   const MatchOptions& options,
+                   std::vector<Match>& matches) {
+  QueryResultTable forward_table;
+  QueryResultTable reverse_table;
+  findMatchesInBothDirectionsUsingIndices(index1, index2, forward_table,
+      reverse_table, options.use_max_num, options.max_num,
+      options.use_absolute_threshold, options.absolute_threshold);
+
+  // Reverse matches are flipped so that their first index is in image 1.
+  std::vector<MatchResult> forward;
+  std::vector<MatchResult> reverse;
+  convertQueryResultTableToMatches(forward_table, forward, true);
+  convertQueryResultTableToMatches(reverse_table, reverse, false);
+
+  std::vector<MatchResult> combined;
+  combineMatchResults(forward, reverse,
+      options.reciprocal ? MATCH_RECIPROCAL : MATCH_UNION, combined);
+
+  matches.clear();
+  matches.reserve(combined.size());
+  std::vector<MatchResult>::const_iterator match;
+  for (match = combined.begin(); match != combined.end(); ++match) {
+    matches.push_back(Match(match->index1, match->index2));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+MatchEdgeSink::MatchEdgeSink(const std::vector<ImagePair>& pairs,
+                             bool duplicate,
+                             std::vector<FeatureIndex>& features,
+                             SequenceSink<MatchGraphEdge>& edges)
+    : pairs_(&pairs), duplicate_(duplicate), index_(0),
+      features_(&features), edges_(&edges), vertices_() {}
+
+void MatchEdgeSink::add(std::vector<Match>& matches) {
+  const ImagePair& pair = (*pairs_)[index_];
+  index_ += 1;
+
+  std::vector<Match>::const_iterator match;
+  for (match = matches.begin(); match != matches.end(); ++match) {
+    FeatureIndex feature1(pair.first, match->first);
+    FeatureIndex feature2(pair.second, match->second);
+
+    // Find existing vertex for feature, or insert one.
+    int vertex1 = findOrInsert(feature1);
+    int vertex2;
+    if (duplicate_) {
+      vertex2 = addVertex(feature2);
+    } else {
+      vertex2 = findOrInsert(feature2);
+    }
+
+    // Add edge to graph.
+    MatchGraphEdge edge(vertex1, vertex2, 0);
+    edges_->add(edge);
+  }
+}
+
+int MatchEdgeSink::addVertex(const FeatureIndex& feature) {
+  features_->push_back(feature);
+  return features_->size() - 1;
+}
+
+int MatchEdgeSink::findOrInsert(const FeatureIndex& feature) {
+  // Reserve an entry in the lookup table, filled in if the feature is new.
+  std::pair<int*, bool> mapping = vertices_.insert(feature, 0);
+
+  if (mapping.second) {
+    // Did not find it, create a vertex.
+    *mapping.first = addVertex(feature);
+  }
+
+  return *mapping.first;
+}
+
+DisjointSetsSink::DisjointSetsSink(DisjointSets& sets) : sets_(&sets) {}
+
+void DisjointSetsSink::add(MatchGraphEdge& edge) {
+  sets_->grow(std::max(edge.source, edge.target) + 1);
+  sets_->join(edge.source, edge.target);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void labelsToMultitracks(const std::vector<FeatureIndex>& features,
+                         const std::vector<int>& labels,
+                         int num_components,
+                         int num_views,
+                         MultiviewTrackList<IndexSet>& multitracks) {
+  // "Multitracks" can have more than one feature per frame.
+  std::vector<MultiviewTrack<IndexSet> > multitrack_list(num_components,
+      MultiviewTrack<IndexSet>(num_views));
+
+  int num_vertices = features.size();
+  for (int i = 0; i < num_vertices; i += 1) {
+    const FeatureIndex& vertex = features[i];
+    ImageIndex frame(vertex.view, vertex.time);
+
+    MultiviewTrack<IndexSet>& multitrack = multitrack_list[labels[i]];
+
+    IndexSet* set = multitrack.point(frame);
+
+    // If there is no entry for this frame, create a blank one.
+    if (set == NULL) {
+      multitrack.view(vertex.view)[vertex.time] = IndexSet();
+      set = multitrack.point(frame);
+      CHECK(set != NULL);
+    }
+
+    // Add this feature.
+    set->push_back(vertex.id);
+  }
+
+  multitracks = MultiviewTrackList<IndexSet>(num_views);
+  for (int i = 0; i < num_components; i += 1) {
+    multitracks.push_back(MultiviewTrack<IndexSet>());
+    multitracks.back().swap(multitrack_list[i]);
+  }
+}
+
+bool multitrackToTrack(const MultiviewTrack<IndexSet>& multiview_multitrack,
+                       MultiviewTrack<int>& multiview_track) {
+  int num_views = multiview_multitrack.numViews();
+  multiview_track = MultiviewTrack<int>(num_views);
+
+  MultiviewTrack<IndexSet>::const_iterator multitrack;
+  MultiviewTrack<int>::iterator track;
+
+  multitrack = multiview_multitrack.begin();
+  track = multiview_track.begin();
+
+  while (multitrack != multiview_multitrack.end()) {
+    TrackIterator<IndexSet> point(*multitrack);
+
+    while (!point.end()) {
+      // There should never be an entry with zero features.
+      CHECK(point.get().size() > 0);
+
+      if (point.get().size() > 1) {
+        // Multiple features in this frame. Inconsistent track!
+        return false;
+      } else {
+        // Add the single element in the vector to the track.
+        (*track)[point.time()] = point.get().front();
+      }
+
+      point.next();
+    }
+
+    ++multitrack;
+    ++track;
+  }
+
+  return true;
+}
+
+void keepConsistentTracks(const MultiviewTrackList<IndexSet>& multitracks,
+                          MultiviewTrackList<int>& tracks) {
+  tracks = MultiviewTrackList<int>(multitracks.numViews());
+
+  for (int i = 0; i < multitracks.numTracks(); i += 1) {
+    // Do not keep "multi-tracks" which were observed twice in one frame.
+    MultiviewTrack<int> track;
+    bool consistent = multitrackToTrack(multitracks.track(i), track);
+
+    if (consistent) {
+      // Add to the list.
+      tracks.push_back(MultiviewTrack<int>());
+      tracks.back().swap(track);
+    }
+  }
+}
+
+namespace {
+
+int numFeaturesInMultitrack(const MultiviewTrack<IndexSet>& track) {
+  MultiviewTrack<IndexSet>::ConstFeatureIterator iter(track);
+  int n = 0;
+
+  for (iter.begin(); !iter.end(); iter.next()) {
+    n += iter.get().second->size();
+  }
+
+  return n;
+}
+
+int addNumFeaturesInMultitrack(int n, const MultiviewTrack<IndexSet>& track) {
+  return n + numFeaturesInMultitrack(track);
+}
+
+}
+
+int numFeaturesInMultitrackList(const MultiviewTrackList<IndexSet>& tracks) {
+  return std::accumulate(tracks.begin(), tracks.end(), 0,
+      addNumFeaturesInMultitrack);
+}
+
+void matchesToMultiviewTracks(const std::vector<ImagePair>& pairs,
+                              std::vector<std::vector<Match> >& matches,
+                              int num_views,
+                              MultiviewTrackList<IndexSet>& multitracks) {
+  CHECK(pairs.size() == matches.size());
+
+  std::vector<FeatureIndex> features;
+  DisjointSets sets;
+  DisjointSetsSink sets_sink(sets);
+  MatchEdgeSink sink(pairs, false, features, sets_sink);
+  for (int i = 0; i < int(pairs.size()); i += 1) {
+    sink.add(matches[i]);
+    std::vector<Match>().swap(matches[i]);
+  }
+  sets.grow(features.size());
+
+  std::vector<int> labels;
+  int num_components = sets.label(labels);
+  labelsToMultitracks(features, labels, num_components, num_views,
+      multitracks);
+}
+
+int firstWindowOfPair(const ImagePair& pair, int window, int step) {
+  int first = std::min(pair.first.time, pair.second.time);
+  int last = std::max(pair.first.time, pair.second.time);
+
+  // The first window which reaches the later image.
+  int k = 0;
+  if (last >= window) {
+    k = (last - window) / step + 1;
+  }
+  if (k * step > first) {
+    return -1;
+  }
+  return k;
+}
+
+TrackStitcher::TrackStitcher(int num_views)
+    : num_views_(num_views), pieces_(), joined_(), carried_() {}
+
+void TrackStitcher::add(MultiviewTrackList<IndexSet>& tracks,
+                        int next_begin) {
+  FeatureIndexMap<int> previous;
+  previous.reserve(carried_.size());
+  std::vector<std::pair<FeatureIndex, int> > carried;
+  std::vector<std::pair<FeatureIndex, int> >::const_iterator entry;
+  for (entry = carried_.begin(); entry != carried_.end(); ++entry) {
+    previous.insert(entry->first, entry->second);
+    if (entry->first.time >= next_begin) {
+      carried.push_back(*entry);
+    }
+  }
+
+  int base = pieces_.size();
+  joined_.grow(base + tracks.numTracks());
+
+  for (int i = 0; i < tracks.numTracks(); i += 1) {
+    int piece = base + i;
+    MultiviewTrack<IndexSet>::ConstFeatureIterator point(tracks.track(i));
+
+    for (point.begin(); !point.end(); point.next()) {
+      const ImageIndex& image = point.get().first;
+      const IndexSet& set = *point.get().second;
+
+      IndexSet::const_iterator id;
+      for (id = set.begin(); id != set.end(); ++id) {
+        FeatureIndex feature(image, *id);
+        const int* other = previous.find(feature);
+        if (other != NULL) {
+          joined_.join(piece, *other);
+        } else if (feature.time >= next_begin) {
+          carried.push_back(std::make_pair(feature, piece));
+        }
+      }
+    }
+
+    pieces_.push_back(MultiviewTrack<IndexSet>());
+    pieces_.back().swap(tracks.track(i));
+  }
+
+  carried_.swap(carried);
+  tracks.clear();
+}
+
+void TrackStitcher::stitch(MultiviewTrackList<IndexSet>& tracks) {
+  std::vector<int> labels;
+  int num_tracks = joined_.label(labels);
+  std::vector<MultiviewTrack<IndexSet> > merged(num_tracks,
+      MultiviewTrack<IndexSet>(num_views_));
+
+  for (int i = 0; i < int(pieces_.size()); i += 1) {
+    MultiviewTrack<IndexSet>& track = merged[labels[i]];
+
+    for (int view = 0; view < num_views_; view += 1) {
+      const Track<IndexSet>& piece = pieces_[i].view(view);
+      Track<IndexSet>::const_iterator point;
+      for (point = piece.begin(); point != piece.end(); ++point) {
+        IndexSet& set = track.view(view)[point->first];
+        set.insert(set.end(), point->second.begin(), point->second.end());
+      }
+    }
+    MultiviewTrack<IndexSet>().swap(pieces_[i]);
+  }
+
+  // Features in the overlap of two windows were added by both.
+  tracks = MultiviewTrackList<IndexSet>(num_views_);
+  for (int i = 0; i < num_tracks; i += 1) {
+    for (int view = 0; view < num_views_; view += 1) {
+      Track<IndexSet>& frames = merged[i].view(view);
+      Track<IndexSet>::iterator frame;
+      for (frame = frames.begin(); frame != frames.end(); ++frame) {
+        IndexSet& set = frame->second;
+        std::sort(set.begin(), set.end());
+        set.erase(std::unique(set.begin(), set.end()), set.end());
+      }
+    }
+
+    tracks.push_back(MultiviewTrack<IndexSet>());
+    tracks.back().swap(merged[i]);
+  }
+
+  pieces_.clear();
+  joined_.clear();
+  carried_.clear();
+}
+
+void indexTracksToFeatureTracks(
+    const MultiviewTrackList<int>& index_tracks,
+    const std::vector<std::vector<SiftFeature> >& features,
+    int num_frames,
+    MultiviewTrackList<SiftPosition>& tracks) {
+  int num_views = index_tracks.numViews();
+  tracks = MultiviewTrackList<SiftPosition>(index_tracks.numTracks(),
+      num_views);
+
+  for (int i = 0; i < index_tracks.numTracks(); i += 1) {
+    const MultiviewTrack<int>& index_track = index_tracks.track(i);
+    MultiviewTrack<SiftPosition>& track = tracks.track(i);
+
+    for (int view = 0; view < num_views; view += 1) {
+      const Track<int>& indices = index_track.view(view);
+      Track<SiftPosition>& positions = track.view(view);
+
+      Track<int>::const_iterator index;
+      for (index = indices.begin(); index != indices.end(); ++index) {
+        int time = index->first;
+        const std::vector<SiftFeature>& image =
+            features[view * num_frames + time];
+        CHECK(0 <= index->second && index->second < int(image.size()));
+        positions[time] = image[index->second].position;
+      }
+    }
+  }
+}
@@ -0,0 +1,166 @@
+#ifndef STAGES_HPP_
+#define STAGES_HPP_
+
+#include <utility>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "descriptor_index.hpp"
+#include "detect_sift.hpp"
+#include "disjoint_sets.hpp"
+#include "feature_index.hpp"
+#include "feature_index_map.hpp"
+#include "image_pairs.hpp"
+#include "match.hpp"
+#include "match_graph.hpp"
+#include "multiview_track_list.hpp"
+#include "plane_cache.hpp"
+#include "sequence_sink.hpp"
+#include "sift_feature.hpp"
+#include "sift_position.hpp"
+
+// The work of the stages which take images to multiview feature tracks,
+//
+//   find-keypoints -> match-features -> combine-matches ->
+//   matches-to-multiview-tracks -> multiview-index-tracks-to-features
+//
+// over in-memory types rather than files. The executables of the stages
+// load and save files around these, and run-stages runs them end to end,
+// saving only the tracks. Built into the nrt_core library.
+
+// Features observed in one frame of a multitrack.
+typedef std::vector<int> IndexSet;
+
+// find-keypoints. Options of the detector with the given threshold.
+SiftOptions findKeypointsOptions(double contrast_threshold);
+
+// find-keypoints. Detects SIFT features with cv::SIFT.
+void findKeypoints(const cv::Mat& image,
+                   double contrast_threshold,
+                   std::vector<SiftFeature>& features);
+// Detects from the pyramid of the plane cache if it is enabled.
+void findKeypoints(const cv::Mat& image,
+                   const SiftOptions& options,
+                   const PlaneCache& cache,
+                   std::vector<SiftFeature>& features);
+
+struct MatchOptions {
+  bool use_max_num;
+  int max_num;
+  bool use_absolute_threshold;
+  double absolute_threshold;
+  // Keep the matches found in both directions, otherwise in either.
+  bool reciprocal;
+
+  MatchOptions();
+};
+
+// match-features --reverse_matches, then combine-matches.
+// Indices of the matches are of features 1 and 2.
+void matchFeatures(const DescriptorIndex& index1,
+                   const DescriptorIndex& index2,
+                   const MatchOptions& options,
+                   std::vector<Match>& matches);
+
+// Assigns a vertex to every feature and passes the matches of each pair on
+// as edges, in order.
+class MatchEdgeSink : public SequenceSink<std::vector<Match> > {
+  public:
+    // If duplicate is true, every feature in the second image of each pair
+    // gets a new vertex.
+    MatchEdgeSink(const std::vector<ImagePair>& pairs,
+                  bool duplicate,
+                  std::vector<FeatureIndex>& features,
+                  SequenceSink<MatchGraphEdge>& edges);
+
+    void add(std::vector<Match>& matches);
+
+  private:
+    int addVertex(const FeatureIndex& feature);
+    int findOrInsert(const FeatureIndex& feature);
+
+    const std::vector<ImagePair>* pairs_;
+    bool duplicate_;
+    int index_;
+    std::vector<FeatureIndex>* features_;
+    SequenceSink<MatchGraphEdge>* edges_;
+    FeatureIndexMap<int> vertices_;
+};
+
+// Joins the ends of every edge, so that no edge need be kept.
+class DisjointSetsSink : public SequenceSink<MatchGraphEdge> {
+  public:
+    explicit DisjointSetsSink(DisjointSets& sets);
+
+    void add(MatchGraphEdge& edge);
+
+  private:
+    DisjointSets* sets_;
+};
+
+// Groups the features with the same label into one multitrack each.
+void labelsToMultitracks(const std::vector<FeatureIndex>& features,
+                         const std::vector<int>& labels,
+                         int num_components,
+                         int num_views,
+                         MultiviewTrackList<IndexSet>& multitracks);
+
+// Returns false if the multitrack has more than one feature in any frame.
+bool multitrackToTrack(const MultiviewTrack<IndexSet>& multitrack,
+                       MultiviewTrack<int>& track);
+
+// Keeps the multitracks which have one feature per frame, as tracks.
+void keepConsistentTracks(const MultiviewTrackList<IndexSet>& multitracks,
+                          MultiviewTrackList<int>& tracks);
+
+int numFeaturesInMultitrackList(const MultiviewTrackList<IndexSet>& tracks);
+
+// matches-to-multiview-tracks --streaming, given the matches of each pair.
+// Clears the matches as they are joined.
+void matchesToMultiviewTracks(const std::vector<ImagePair>& pairs,
+                              std::vector<std::vector<Match> >& matches,
+                              int num_views,
+                              MultiviewTrackList<IndexSet>& multitracks);
+
+// The first of the windows of frames [k * step, k * step + window) which
+// contains both images of the pair, or -1 if none does.
+int firstWindowOfPair(const ImagePair& pair, int window, int step);
+
+// Joins the multitracks of overlapping windows of frames, found one window
+// after another, into multitracks of the whole capture. Tracks which share
+// a feature are joined, as are the tracks which share a feature with
+// those. If the matches of each pair were joined in exactly one window, the
+// result is the same as for every frame at once.
+class TrackStitcher {
+  public:
+    explicit TrackStitcher(int num_views);
+
+    // Takes the tracks of the next window. Features before next_begin,
+    // the first frame of the window after, cannot be shared again and are
+    // forgotten.
+    void add(MultiviewTrackList<IndexSet>& tracks, int next_begin);
+    // Joins the tracks of every window. The features of each frame are in
+    // increasing order.
+    void stitch(MultiviewTrackList<IndexSet>& tracks);
+
+  private:
+    int num_views_;
+    // The tracks of every window.
+    std::vector<MultiviewTrack<IndexSet> > pieces_;
+    DisjointSets joined_;
+    // The piece of each feature which a later window may share.
+    std::vector<std::pair<FeatureIndex, int> > carried_;
+
+    // Non-copyable.
+    TrackStitcher(const TrackStitcher&);
+    TrackStitcher& operator=(const TrackStitcher&);
+};
+
+// multiview-index-tracks-to-features, given the features of every image in
+// view-major order.
+void indexTracksToFeatureTracks(
+    const MultiviewTrackList<int>& index_tracks,
+    const std::vector<std::vector<SiftFeature> >& features,
+    int num_frames,
+    MultiviewTrackList<SiftPosition>& tracks);
+
+#endif
@@ -0,0 +1,301 @@
+#include "stages.hpp"
+#include <algorithm>
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace {
+
+typedef std::vector<FeatureIndex> FeatureList;
+
+// The features of a multitrack, in order.
+FeatureList featuresOf(const MultiviewTrack<IndexSet>& track) {
+  FeatureList features;
+  MultiviewTrack<IndexSet>::ConstFeatureIterator point(track);
+  for (point.begin(); !point.end(); point.next()) {
+    const ImageIndex& image = point.get().first;
+    const IndexSet& set = *point.get().second;
+    for (int i = 0; i < int(set.size()); i += 1) {
+      features.push_back(FeatureIndex(image, set[i]));
+    }
+  }
+  std::sort(features.begin(), features.end());
+  return features;
+}
+
+// The multitracks as sets of features, independent of the order of the
+// tracks and of the features within a frame.
+std::vector<FeatureList> canonical(
+    const MultiviewTrackList<IndexSet>& tracks) {
+  std::vector<FeatureList> sets;
+  for (int i = 0; i < tracks.numTracks(); i += 1) {
+    sets.push_back(featuresOf(tracks.track(i)));
+  }
+  std::sort(sets.begin(), sets.end());
+  return sets;
+}
+
+// Every frame matched to the next in the same view and to the same frame in
+// the next view, and to two frames later. A few of the features are matched
+// in each pair, so that tracks merge, split and skip frames.
+void makeMatches(int num_views,
+                 int num_frames,
+                 std::vector<ImagePair>& pairs,
+                 std::vector<std::vector<Match> >& matches) {
+  pairs.clear();
+  for (int view = 0; view < num_views; view += 1) {
+    for (int time = 0; time < num_frames; time += 1) {
+      ImageIndex image(view, time);
+      if (time + 1 < num_frames) {
+        pairs.push_back(ImagePair(image, ImageIndex(view, time + 1)));
+      }
+      if (time + 2 < num_frames) {
+        pairs.push_back(ImagePair(image, ImageIndex(view, time + 2)));
+      }
+      if (view + 1 < num_views) {
+        pairs.push_back(ImagePair(image, ImageIndex(view + 1, time)));
+      }
+    }
+  }
+
+  matches.assign(pairs.size(), std::vector<Match>());
+  for (int i = 0; i < int(pairs.size()); i += 1) {
+    int shift = (pairs[i].first.time + 3 * pairs[i].second.view + i) % 7;
+    for (int id = 0; id < 3; id += 1) {
+      matches[i].push_back(Match((id * 5 + shift) % 20, (id * 7 + i) % 20));
+    }
+  }
+}
+
+// matches-to-multiview-tracks --window, without files.
+void windowedTracks(const std::vector<ImagePair>& pairs,
+                    const std::vector<std::vector<Match> >& matches,
+                    int num_views,
+                    int num_frames,
+                    int window,
+                    int overlap,
+                    MultiviewTrackList<IndexSet>& multitracks) {
+  int step = window - overlap;
+  int num_windows = 1;
+  if (num_frames > window) {
+    num_windows += (num_frames - window + step - 1) / step;
+  }
+
+  std::vector<std::vector<ImagePair> > window_pairs(num_windows);
+  std::vector<std::vector<std::vector<Match> > > window_matches(num_windows);
+  for (int i = 0; i < int(pairs.size()); i += 1) {
+    int k = firstWindowOfPair(pairs[i], window, step);
+    ASSERT_LE(0, k);
+    ASSERT_LT(k, num_windows);
+    window_pairs[k].push_back(pairs[i]);
+    window_matches[k].push_back(matches[i]);
+  }
+
+  TrackStitcher stitcher(num_views);
+  for (int k = 0; k < num_windows; k += 1) {
+    MultiviewTrackList<IndexSet> tracks;
+    matchesToMultiviewTracks(window_pairs[k], window_matches[k], num_views,
+        tracks);
+    stitcher.add(tracks, (k + 1) * step);
+  }
+  stitcher.stitch(multitracks);
+}
+
+}
+
+TEST(MatchEdgeSink, FindsOrAddsVertices) {
+  std::vector<ImagePair> pairs;
+  pairs.push_back(ImagePair(ImageIndex(0, 0), ImageIndex(0, 1)));
+  pairs.push_back(ImagePair(ImageIndex(0, 1), ImageIndex(1, 1)));
+
+  std::vector<Match> first;
+  first.push_back(Match(0, 1));
+  first.push_back(Match(2, 1));
+  std::vector<Match> second;
+  second.push_back(Match(1, 0));
+
+  std::vector<FeatureIndex> features;
+  std::vector<MatchGraphEdge> edges;
+  ContainerSink<MatchGraphEdge, std::vector<MatchGraphEdge> > edge_sink(
+      edges);
+  MatchEdgeSink sink(pairs, false, features, edge_sink);
+  sink.add(first);
+  sink.add(second);
+
+  ASSERT_EQ(4, int(features.size()));
+  EXPECT_TRUE(features[0] == FeatureIndex(0, 0, 0));
+  EXPECT_TRUE(features[1] == FeatureIndex(0, 1, 1));
+  EXPECT_TRUE(features[2] == FeatureIndex(0, 0, 2));
+  EXPECT_TRUE(features[3] == FeatureIndex(1, 1, 0));
+
+  ASSERT_EQ(3, int(edges.size()));
+  EXPECT_EQ(0, edges[0].source);
+  EXPECT_EQ(1, edges[0].target);
+  EXPECT_EQ(2, edges[1].source);
+  EXPECT_EQ(1, edges[1].target);
+  EXPECT_EQ(1, edges[2].source);
+  EXPECT_EQ(3, edges[2].target);
+}
+
+TEST(MatchEdgeSink, DuplicatesSecondFeature) {
+  std::vector<ImagePair> pairs;
+  pairs.push_back(ImagePair(ImageIndex(0, 0), ImageIndex(0, 1)));
+
+  std::vector<Match> matches;
+  matches.push_back(Match(0, 1));
+  matches.push_back(Match(2, 1));
+
+  std::vector<FeatureIndex> features;
+  std::vector<MatchGraphEdge> edges;
+  ContainerSink<MatchGraphEdge, std::vector<MatchGraphEdge> > edge_sink(
+      edges);
+  MatchEdgeSink sink(pairs, true, features, edge_sink);
+  sink.add(matches);
+
+  // Feature 1 of the second image has a vertex for each match.
+  ASSERT_EQ(4, int(features.size()));
+  EXPECT_TRUE(features[1] == FeatureIndex(0, 1, 1));
+  EXPECT_TRUE(features[3] == FeatureIndex(0, 1, 1));
+  ASSERT_EQ(2, int(edges.size()));
+  EXPECT_EQ(3, edges[1].target);
+}
+
+TEST(DisjointSetsSink, JoinsEnds) {
+  DisjointSets sets;
+  DisjointSetsSink sink(sets);
+  MatchGraphEdge a(0, 3, 0);
+  MatchGraphEdge b(3, 1, 0);
+  sink.add(a);
+  sink.add(b);
+  sets.grow(5);
+
+  EXPECT_EQ(sets.find(0), sets.find(1));
+  EXPECT_EQ(sets.find(0), sets.find(3));
+  EXPECT_NE(sets.find(0), sets.find(2));
+  EXPECT_EQ(3, sets.numSets());
+}
+
+TEST(LabelsToMultitracks, GroupsByLabel) {
+  std::vector<FeatureIndex> features;
+  features.push_back(FeatureIndex(0, 0, 4));
+  features.push_back(FeatureIndex(1, 2, 7));
+  features.push_back(FeatureIndex(0, 0, 5));
+  features.push_back(FeatureIndex(1, 3, 1));
+  std::vector<int> labels;
+  labels.push_back(0);
+  labels.push_back(1);
+  labels.push_back(0);
+  labels.push_back(1);
+
+  MultiviewTrackList<IndexSet> multitracks;
+  labelsToMultitracks(features, labels, 2, 2, multitracks);
+
+  ASSERT_EQ(2, multitracks.numTracks());
+  EXPECT_EQ(2, multitracks.numViews());
+
+  const IndexSet* set = multitracks.track(0).point(ImageIndex(0, 0));
+  ASSERT_TRUE(set != NULL);
+  ASSERT_EQ(2, int(set->size()));
+  EXPECT_EQ(4, (*set)[0]);
+  EXPECT_EQ(5, (*set)[1]);
+  EXPECT_TRUE(multitracks.track(0).view(1).empty());
+
+  EXPECT_EQ(2, multitracks.track(1).view(1).size());
+  EXPECT_EQ(4, numFeaturesInMultitrackList(multitracks));
+}
+
+TEST(KeepConsistentTracks, DropsTracksWithTwoFeaturesInAFrame) {
+  MultiviewTrackList<IndexSet> multitracks(2);
+
+  MultiviewTrack<IndexSet> consistent(2);
+  consistent.view(0)[0] = IndexSet(1, 3);
+  consistent.view(1)[2] = IndexSet(1, 8);
+  multitracks.push_back(consistent);
+
+  MultiviewTrack<IndexSet> inconsistent(2);
+  inconsistent.view(0)[0] = IndexSet(1, 1);
+  inconsistent.view(1)[1] = IndexSet(2, 2);
+  multitracks.push_back(inconsistent);
+
+  MultiviewTrack<int> track;
+  EXPECT_TRUE(multitrackToTrack(consistent, track));
+  EXPECT_FALSE(multitrackToTrack(inconsistent, track));
+
+  MultiviewTrackList<int> tracks;
+  keepConsistentTracks(multitracks, tracks);
+  ASSERT_EQ(1, tracks.numTracks());
+  ASSERT_TRUE(tracks.track(0).point(ImageIndex(0, 0)) != NULL);
+  EXPECT_EQ(3, *tracks.track(0).point(ImageIndex(0, 0)));
+  ASSERT_TRUE(tracks.track(0).point(ImageIndex(1, 2)) != NULL);
+  EXPECT_EQ(8, *tracks.track(0).point(ImageIndex(1, 2)));
+}
+
+TEST(FirstWindowOfPair, FindsFirstWindowContainingBoth) {
+  // Windows of 4 frames every 2: [0, 4), [2, 6), [4, 8), ...
+  int window = 4;
+  int step = 2;
+  EXPECT_EQ(0, firstWindowOfPair(
+      ImagePair(ImageIndex(0, 0), ImageIndex(1, 0)), window, step));
+  EXPECT_EQ(0, firstWindowOfPair(
+      ImagePair(ImageIndex(0, 3), ImageIndex(0, 0)), window, step));
+  EXPECT_EQ(1, firstWindowOfPair(
+      ImagePair(ImageIndex(0, 2), ImageIndex(0, 5)), window, step));
+  EXPECT_EQ(2, firstWindowOfPair(
+      ImagePair(ImageIndex(0, 5), ImageIndex(0, 6)), window, step));
+  // Frames 1 and 4 are never in the same window.
+  EXPECT_EQ(-1, firstWindowOfPair(
+      ImagePair(ImageIndex(0, 1), ImageIndex(0, 4)), window, step));
+}
+
+TEST(TrackStitcher, WindowsGiveSameTracksAsAllFrames) {
+  int num_views = 2;
+  int num_frames = 11;
+  std::vector<ImagePair> pairs;
+  std::vector<std::vector<Match> > matches;
+  makeMatches(num_views, num_frames, pairs, matches);
+
+  MultiviewTrackList<IndexSet> windowed;
+  windowedTracks(pairs, matches, num_views, num_frames, 4, 2, windowed);
+  MultiviewTrackList<IndexSet> windowed_wide;
+  windowedTracks(pairs, matches, num_views, num_frames, 5, 3,
+      windowed_wide);
+
+  std::vector<std::vector<Match> > all_matches(matches);
+  MultiviewTrackList<IndexSet> expected;
+  matchesToMultiviewTracks(pairs, all_matches, num_views, expected);
+
+  EXPECT_LT(1, expected.numTracks());
+  EXPECT_TRUE(canonical(expected) == canonical(windowed));
+  EXPECT_TRUE(canonical(expected) == canonical(windowed_wide));
+}
+
+TEST(IndexTracksToFeatureTracks, LooksUpPositions) {
+  int num_views = 2;
+  int num_frames = 3;
+  std::vector<std::vector<SiftFeature> > features(num_views * num_frames);
+  for (int image = 0; image < int(features.size()); image += 1) {
+    for (int id = 0; id < 2; id += 1) {
+      SiftFeature feature;
+      feature.position = SiftPosition(10 * image + id, -id, 1, 0);
+      features[image].push_back(feature);
+    }
+  }
+
+  MultiviewTrackList<int> index_tracks(num_views);
+  MultiviewTrack<int> index_track(num_views);
+  index_track.view(0)[2] = 1;
+  index_track.view(1)[0] = 0;
+  index_tracks.push_back(index_track);
+
+  MultiviewTrackList<SiftPosition> tracks;
+  indexTracksToFeatureTracks(index_tracks, features, num_frames, tracks);
+
+  ASSERT_EQ(1, tracks.numTracks());
+  const SiftPosition* a = tracks.track(0).point(ImageIndex(0, 2));
+  ASSERT_TRUE(a != NULL);
+  EXPECT_EQ(21, a->x);
+  EXPECT_EQ(-1, a->y);
+  const SiftPosition* b = tracks.track(0).point(ImageIndex(1, 0));
+  ASSERT_TRUE(b != NULL);
+  EXPECT_EQ(30, b->x);
+  EXPECT_EQ(2, tracks.track(0).numImageFeatures());
+}
@@ -1,6 +1,10 @@
 #include "stats.hpp"
 #include <numeric>
 #include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <utility>
+#include <glog/logging.h>
 
 double computeMean(const std::vector<double>& x) {
   return std::accumulate(x.begin(), x.end(), 0.) / x.size();
@@ -11,10 +15,10 @@ double computeMedian(const std::vector<double>& x) {
     return 0. / 0.;
   }
 
-  std::vector<double> y;
-  std::copy(x.begin(), x.end(), std::back_inserter(y));
-  std::sort(y.begin(), y.end());
-  return y[x.size() / 2];
+  // Only the middle element needs to be in its sorted place.
+  std::vector<double> y(x);
+  std::nth_element(y.begin(), y.begin() + y.size() / 2, y.end());
+  return y[y.size() / 2];
 }
 
 int countLessThanEqualTo(const std::vector<double>& x, double a) {
@@ -29,3 +33,145 @@ int countLessThanEqualTo(const std::vector<double>& x, double a) {
 
   return n;
 }
+
+namespace {
+
+// Values and their weights, ordered by value.
+typedef std::vector<std::pair<double, int64_t> > WeightedValues;
+
+}
+
+QuantileSketch::QuantileSketch(int k)
+    : k_(k), count_(0), levels_(1), state_(2463534242u) {
+  CHECK(k >= 2);
+}
+
+void QuantileSketch::add(double x) {
+  levels_.front().push_back(x);
+  count_ += 1;
+  compress();
+}
+
+void QuantileSketch::merge(const QuantileSketch& other) {
+  if (other.levels_.size() > levels_.size()) {
+    levels_.resize(other.levels_.size());
+  }
+  for (int h = 0; h < int(other.levels_.size()); h += 1) {
+    levels_[h].insert(levels_[h].end(), other.levels_[h].begin(),
+        other.levels_[h].end());
+  }
+  count_ += other.count_;
+  compress();
+}
+
+int64_t QuantileSketch::count() const {
+  return count_;
+}
+
+bool QuantileSketch::empty() const {
+  return count_ == 0;
+}
+
+int QuantileSketch::size() const {
+  int n = 0;
+  std::vector<std::vector<double> >::const_iterator level;
+  for (level = levels_.begin(); level != levels_.end(); ++level) {
+    n += level->size();
+  }
+  return n;
+}
+
+int QuantileSketch::capacity(int level) const {
+  // The top level holds k values and each level below two thirds as many.
+  int depth = levels_.size() - 1 - level;
+  return std::max(2, int(std::ceil(k_ * std::pow(2. / 3., depth))));
+}
+
+void QuantileSketch::compress() {
+  // A merge may overfill several levels.
+  for (int h = 0; h < int(levels_.size()); h += 1) {
+    if (int(levels_[h].size()) >= capacity(h)) {
+      compact(h);
+    }
+  }
+}
+
+void QuantileSketch::compact(int level) {
+  if (level + 1 == int(levels_.size())) {
+    levels_.push_back(std::vector<double>());
+  }
+  std::vector<double>& values = levels_[level];
+  std::vector<double>& above = levels_[level + 1];
+  std::sort(values.begin(), values.end());
+
+  // An odd value out stays, so that the total weight is unchanged.
+  int n = values.size();
+  int begin = n % 2;
+  for (int i = begin + (randomBit() ? 1 : 0); i < n; i += 2) {
+    above.push_back(values[i]);
+  }
+  values.resize(begin);
+}
+
+bool QuantileSketch::randomBit() {
+  // Xorshift, so that a sketch of the same values is always the same.
+  state_ ^= state_ << 13;
+  state_ ^= state_ >> 17;
+  state_ ^= state_ << 5;
+  return (state_ & 1) != 0;
+}
+
+double QuantileSketch::quantile(double q) const {
+  if (empty()) {
+    return 0. / 0.;
+  }
+  q = std::min(std::max(q, 0.), 1.);
+
+  WeightedValues values;
+  values.reserve(size());
+  for (int h = 0; h < int(levels_.size()); h += 1) {
+    std::vector<double>::const_iterator x;
+    for (x = levels_[h].begin(); x != levels_[h].end(); ++x) {
+      values.push_back(std::make_pair(*x, int64_t(1) << h));
+    }
+  }
+  std::sort(values.begin(), values.end());
+
+  // The first value whose rank reaches q of the total.
+  double rank = q * count_;
+  int64_t total = 0;
+  WeightedValues::const_iterator value;
+  for (value = values.begin(); value != values.end(); ++value) {
+    total += value->second;
+    if (total > rank) {
+      return value->first;
+    }
+  }
+  return values.back().first;
+}
+
+double QuantileSketch::cdf(double x) const {
+  if (empty()) {
+    return 0. / 0.;
+  }
+
+  int64_t total = 0;
+  for (int h = 0; h < int(levels_.size()); h += 1) {
+    std::vector<double>::const_iterator value;
+    for (value = levels_[h].begin(); value != levels_[h].end(); ++value) {
+      if (*value <= x) {
+        total += int64_t(1) << h;
+      }
+    }
+  }
+  return double(total) / count_;
+}
+
+void writeQuantiles(std::ostream& os, const QuantileSketch& sketch, int n) {
+  for (int i = 1; i <= n; i += 1) {
+    if (i > 1) {
+      os << "\t";
+    }
+    os << sketch.quantile(double(i) / n);
+  }
+}
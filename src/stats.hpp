@@ -1,11 +1,61 @@
 #ifndef STATS_HPP_
 #define STATS_HPP_
 
+#include <iosfwd>
 #include <vector>
+#include <stdint.h>
 
 double computeMean(const std::vector<double>& x);
 double computeMedian(const std::vector<double>& x);
 
 int countLessThanEqualTo(const std::vector<double>& x, double a);
 
+// Summarizes a stream of values in small memory, from which any quantile or
+// the CDF can be estimated (the KLL sketch of Karnin, Lang and Liberty).
+//
+// Values are kept in levels, where each value of level h stands for 2^h
+// values. When a level is full it is sorted and every other value is moved up
+// a level, starting from the first or second at random. Memory grows only
+// with the logarithm of the number of values. For the default k, 2M values
+// keep about 240, and the error in rank is usually near 1% and below 2% of
+// the number of values.
+//
+// Sketches of parts of a stream, e.g. one per thread, can be merged. The
+// result then depends on the order in which they are merged, within the
+// error in rank.
+class QuantileSketch {
+  public:
+    // Larger k keeps more values and is more accurate.
+    explicit QuantileSketch(int k = 200);
+
+    void add(double x);
+    void merge(const QuantileSketch& other);
+
+    // Number of values added.
+    int64_t count() const;
+    bool empty() const;
+    // Number of values kept.
+    int size() const;
+
+    // Returns the value at a quantile in [0, 1], or NaN if empty.
+    double quantile(double q) const;
+    // Returns the fraction of values which are at most x, or NaN if empty.
+    double cdf(double x) const;
+
+  private:
+    // Values a level may hold before it is compacted.
+    int capacity(int level) const;
+    void compress();
+    void compact(int level);
+    bool randomBit();
+
+    int k_;
+    int64_t count_;
+    std::vector<std::vector<double> > levels_;
+    uint32_t state_;
+};
+
+// Writes the values at quantiles 1 / n, ..., 1, separated by tabs.
+void writeQuantiles(std::ostream& os, const QuantileSketch& sketch, int n);
+
 #endif
@@ -0,0 +1,107 @@
+#include "stats.hpp"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace {
+
+const int NUM_VALUES = 2000000;
+
+// The integers [0, n) in a scrambled order, where n has no factor 7919.
+double scrambled(int i, int n) {
+  return (int64_t(i) * 7919) % n;
+}
+
+// Greatest error in rank over the percentiles, as a fraction of the count.
+// The values are [0, n), so value x has rank x + 1.
+double maxRankError(const QuantileSketch& sketch, int n) {
+  double max = 0;
+  for (int i = 1; i < 100; i += 1) {
+    double q = i / 100.;
+    double rank = (sketch.quantile(q) + 1) / n;
+    max = std::max(max, std::abs(rank - q));
+  }
+  return max;
+}
+
+}
+
+TEST(QuantileSketch, EmptySketchHasNoQuantiles) {
+  QuantileSketch sketch;
+  EXPECT_TRUE(sketch.empty());
+  EXPECT_EQ(0, sketch.count());
+  double q = sketch.quantile(0.5);
+  EXPECT_TRUE(q != q);
+  double p = sketch.cdf(0);
+  EXPECT_TRUE(p != p);
+}
+
+TEST(QuantileSketch, KeepsEveryValueOfShortStream) {
+  QuantileSketch sketch;
+  for (int i = 0; i < 100; i += 1) {
+    sketch.add(scrambled(i, 100));
+  }
+  EXPECT_EQ(100, sketch.count());
+  EXPECT_EQ(100, sketch.size());
+  EXPECT_EQ(0, sketch.quantile(0));
+  EXPECT_EQ(50, sketch.quantile(0.5));
+  EXPECT_EQ(99, sketch.quantile(1));
+  EXPECT_DOUBLE_EQ(0.5, sketch.cdf(49));
+  EXPECT_DOUBLE_EQ(1, sketch.cdf(1000));
+  EXPECT_DOUBLE_EQ(0, sketch.cdf(-1));
+}
+
+TEST(QuantileSketch, LongStreamIsSmallAndAccurate) {
+  QuantileSketch sketch;
+  for (int i = 0; i < NUM_VALUES; i += 1) {
+    sketch.add(scrambled(i, NUM_VALUES));
+  }
+  EXPECT_EQ(NUM_VALUES, sketch.count());
+  // About 240 values.
+  EXPECT_GT(sketch.size(), 200);
+  EXPECT_LT(sketch.size(), 280);
+  // Near 1% of the count.
+  EXPECT_LT(maxRankError(sketch, NUM_VALUES), 0.015);
+
+  double error = std::abs(sketch.cdf(NUM_VALUES / 4) - 0.25);
+  EXPECT_LT(error, 0.015);
+}
+
+TEST(QuantileSketch, MergedSketchesAreAccurate) {
+  // Every eighth value in each, as the threads of a pool might see them.
+  QuantileSketch merged;
+  for (int j = 0; j < 8; j += 1) {
+    QuantileSketch part;
+    for (int i = j; i < NUM_VALUES; i += 8) {
+      part.add(scrambled(i, NUM_VALUES));
+    }
+    merged.merge(part);
+  }
+  EXPECT_EQ(NUM_VALUES, merged.count());
+  EXPECT_LT(merged.size(), 280);
+  EXPECT_LT(maxRankError(merged, NUM_VALUES), 0.015);
+}
+
+TEST(WriteQuantiles, WritesEveryQuantileUpToOne) {
+  QuantileSketch sketch;
+  for (int i = 0; i < 100; i += 1) {
+    sketch.add(scrambled(i, 100));
+  }
+  std::ostringstream os;
+  writeQuantiles(os, sketch, 4);
+  EXPECT_EQ("25\t50\t75\t99", os.str());
+}
+
+TEST(ComputeMedian, FindsMiddleValue) {
+  std::vector<double> x;
+  x.push_back(5);
+  x.push_back(1);
+  x.push_back(3);
+  EXPECT_EQ(3, computeMedian(x));
+  EXPECT_EQ(3, computeMean(x));
+  EXPECT_EQ(2, countLessThanEqualTo(x, 3));
+  double median = computeMedian(std::vector<double>());
+  EXPECT_TRUE(median != median);
+}
@@ -0,0 +1,392 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <opencv2/core/core.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "descriptor_index.hpp"
+#include "descriptor_matrix.hpp"
+#include "find_matches.hpp"
+#include "optimal_triangulation.hpp"
+#include "read_lines.hpp"
+#include "sift_position.hpp"
+#include "stats.hpp"
+#include "util.hpp"
+#include "util/thread-pool.hpp"
+
+#include "feature_files.hpp"
+#include "matrix_reader.hpp"
+
+DEFINE_double(max_residual, 1.,
+    "Maximum sum-of-squares pixel error to be an inlier.");
+DEFINE_bool(use_flann, true,
+    "Use FLANN to find approximate nearest neighbours instead of exact ones");
+DEFINE_int32(num_threads, 4,
+    "Number of worker threads to triangulate and evaluate with, 0 for none");
+DEFINE_string(cdf, "",
+    "Also write the distribution of the residuals of each setting over every "
+    "frame to this file, as the residual at --num_quantiles evenly spaced "
+    "quantiles");
+DEFINE_int32(num_quantiles, 20, "Number of quantiles to write to --cdf");
+
+// A setting of the parameters of match-features and filter-matches.
+struct MatchingParameters {
+  // Matches kept for each feature.
+  int max_num;
+  // Maximum distance of a match. Infinite for none.
+  double absolute_threshold;
+  // Maximum ratio of the distance of a match to the next-best one, which is
+  // the first that max_num does not keep. 1 for none.
+  double ratio;
+  // Require each match to also be kept in the reverse direction.
+  bool reciprocal;
+};
+
+// Means over frames of one setting.
+struct Stats {
+  double num_matches;
+  double num_correct;
+  double mean_residual;
+  double median_residual;
+  // Every residual of every frame.
+  QuantileSketch residuals;
+
+  Stats()
+      : num_matches(0),
+        num_correct(0),
+        mean_residual(0),
+        median_residual(0),
+        residuals() {}
+};
+
+void writeStats(std::ostream& os, const Stats& stats) {
+  os << stats.num_matches << "\t";
+  os << stats.num_correct << "\t";
+  os << stats.mean_residual << "\t";
+  os << stats.median_residual;
+}
+
+std::string makeFilename(const std::string& format, int n) {
+  return boost::str(boost::format(format) % (n + 1));
+}
+
+bool readValues(const std::string& filename, std::vector<double>& values) {
+  std::vector<std::string> lines;
+  if (!readLines(filename, lines)) {
+    return false;
+  }
+
+  values.clear();
+  std::vector<std::string>::const_iterator line;
+  for (line = lines.begin(); line != lines.end(); ++line) {
+    values.push_back(boost::lexical_cast<double>(*line));
+  }
+  return !values.empty();
+}
+
+// Returns the number of the sorted results of a query which a setting keeps.
+// Each test keeps a prefix of the results, since they are sorted by distance.
+int numKept(const QueryResultTable& table,
+            int query,
+            const MatchingParameters& parameters) {
+  int num_results = table.end(query) - table.begin(query);
+  std::vector<QueryResult>::const_iterator results = table.begin(query);
+
+  int n = std::min(parameters.max_num, num_results);
+  double max_distance = parameters.absolute_threshold;
+  if (n < num_results) {
+    max_distance = std::min(max_distance,
+        parameters.ratio * results[n].distance);
+  }
+
+  int num_kept = 0;
+  while (num_kept < n && results[num_kept].distance <= max_distance) {
+    num_kept += 1;
+  }
+  return num_kept;
+}
+
+// Top matches of one pair of frames in both directions, and the residual of
+// every forward match, from which any setting can be evaluated.
+class FrameMatches {
+  public:
+    FrameMatches() : forward_(), reverse_(), reverse_ranks_(), residuals_() {}
+
+    void compute(const DescriptorMatrix& descriptors1,
+                 const DescriptorMatrix& descriptors2,
+                 const std::vector<SiftPosition>& keypoints1,
+                 const std::vector<SiftPosition>& keypoints2,
+                 const cv::Matx33d& F,
+                 int max_num,
+                 ThreadPool& pool);
+
+    void evaluate(const MatchingParameters& parameters,
+                  double max_residual,
+                  Stats& stats) const;
+
+  private:
+    QueryResultTable forward_;
+    QueryResultTable reverse_;
+    // Position of the first feature in the reverse results of the second, or
+    // the number of results if it is not there, for each forward match.
+    std::vector<int> reverse_ranks_;
+    std::vector<double> residuals_;
+};
+
+void FrameMatches::compute(const DescriptorMatrix& descriptors1,
+                           const DescriptorMatrix& descriptors2,
+                           const std::vector<SiftPosition>& keypoints1,
+                           const std::vector<SiftPosition>& keypoints2,
+                           const cv::Matx33d& F,
+                           int max_num,
+                           ThreadPool& pool) {
+  // One more than the most kept to find the next-best distance.
+  DescriptorIndex index1;
+  DescriptorIndex index2;
+  index1.build(descriptors1, FLAGS_use_flann);
+  index2.build(descriptors2, FLAGS_use_flann);
+  findMatchesInBothDirectionsUsingIndices(index1, index2, forward_, reverse_,
+      true, max_num + 1, false, 0);
+
+  int num_queries = forward_.numQueries();
+  std::vector<cv::Point2d> x1;
+  std::vector<cv::Point2d> x2;
+  reverse_ranks_.clear();
+
+  for (int i = 0; i < num_queries; i += 1) {
+    std::vector<QueryResult>::const_iterator result;
+    for (result = forward_.begin(i); result != forward_.end(i); ++result) {
+      int j = result->index;
+      CHECK(i < int(keypoints1.size())) << "Out of bounds";
+      CHECK(j < int(keypoints2.size())) << "Out of bounds";
+      x1.push_back(cv::Point2d(keypoints1[i].x, keypoints1[i].y));
+      x2.push_back(cv::Point2d(keypoints2[j].x, keypoints2[j].y));
+
+      int rank = 0;
+      std::vector<QueryResult>::const_iterator reverse;
+      for (reverse = reverse_.begin(j); reverse != reverse_.end(j);
+          ++reverse) {
+        if (reverse->index == i) {
+          break;
+        }
+        rank += 1;
+      }
+      reverse_ranks_.push_back(rank);
+    }
+  }
+
+  optimalTriangulation(x1, x2, F, residuals_, pool);
+}
+
+void FrameMatches::evaluate(const MatchingParameters& parameters,
+                            double max_residual,
+                            Stats& stats) const {
+  std::vector<double> residuals;
+
+  int num_queries = forward_.numQueries();
+  for (int i = 0; i < num_queries; i += 1) {
+    int offset = forward_.offsets[i];
+    int num_kept = numKept(forward_, i, parameters);
+
+    for (int k = 0; k < num_kept; k += 1) {
+      if (parameters.reciprocal) {
+        int j = forward_.begin(i)[k].index;
+        if (!(reverse_ranks_[offset + k] < numKept(reverse_, j, parameters))) {
+          continue;
+        }
+      }
+      residuals.push_back(residuals_[offset + k]);
+    }
+  }
+
+  stats.num_matches += residuals.size();
+  stats.num_correct += countLessThanEqualTo(residuals, max_residual);
+  if (!residuals.empty()) {
+    stats.mean_residual += computeMean(residuals);
+    stats.median_residual += computeMedian(residuals);
+  }
+
+  std::vector<double>::const_iterator residual;
+  for (residual = residuals.begin(); residual != residuals.end();
+      ++residual) {
+    stats.residuals.add(*residual);
+  }
+}
+
+// Evaluates every setting on one frame. For use with
+// ThreadPool::parallelFor().
+class EvaluateSettingFunction {
+  public:
+    EvaluateSettingFunction(const FrameMatches& matches,
+                            const std::vector<MatchingParameters>& settings,
+                            double max_residual,
+                            std::vector<Stats>& stats)
+        : matches_(&matches),
+          settings_(&settings),
+          max_residual_(max_residual),
+          stats_(&stats) {}
+
+    void operator()(int i) const {
+      matches_->evaluate((*settings_)[i], max_residual_, (*stats_)[i]);
+    }
+
+  private:
+    const FrameMatches* matches_;
+    const std::vector<MatchingParameters>* settings_;
+    double max_residual_;
+    std::vector<Stats>* stats_;
+};
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Evaluates every combination of matching parameters over a "
+      "sequence, searching each pair of frames only once." << std::endl;
+  usage << std::endl;
+  usage << "Sample usage:" << std::endl;
+  usage << argv[0] << " descriptors1-format descriptors2-format"
+      " keypoints1-format keypoints2-format fund-mat max-nums"
+      " absolute-thresholds ratios output" << std::endl;
+  usage << std::endl;
+  usage << "Parameters:" << std::endl;
+  usage << "max-nums, absolute-thresholds, ratios -- Files containing a value"
+      " per line. Use inf and 1 to disable the threshold and the ratio test."
+      << std::endl;
+  usage << "output -- Table with a line per setting: max_num,"
+      " absolute_threshold, ratio, reciprocal, then the mean number of"
+      " matches, number correct, mean and median residual over frames." <<
+      std::endl;
+
+  google::SetUsageMessage(usage.str());
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  if (argc != 10) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string descriptors_format1 = argv[1];
+  std::string descriptors_format2 = argv[2];
+  std::string keypoints_format1 = argv[3];
+  std::string keypoints_format2 = argv[4];
+  std::string fund_mat_file = argv[5];
+  std::string max_nums_file = argv[6];
+  std::string absolute_thresholds_file = argv[7];
+  std::string ratios_file = argv[8];
+  std::string output_file = argv[9];
+
+  bool ok;
+
+  std::vector<double> max_nums;
+  std::vector<double> absolute_thresholds;
+  std::vector<double> ratios;
+  ok = readValues(max_nums_file, max_nums);
+  CHECK(ok) << "Could not read values of max_num";
+  ok = readValues(absolute_thresholds_file, absolute_thresholds);
+  CHECK(ok) << "Could not read absolute thresholds";
+  ok = readValues(ratios_file, ratios);
+  CHECK(ok) << "Could not read ratios";
+
+  // Enumerate every setting.
+  std::vector<MatchingParameters> settings;
+  int max_max_num = 0;
+  for (int a = 0; a < int(max_nums.size()); a += 1) {
+    for (int b = 0; b < int(absolute_thresholds.size()); b += 1) {
+      for (int c = 0; c < int(ratios.size()); c += 1) {
+        for (int d = 0; d < 2; d += 1) {
+          MatchingParameters parameters;
+          parameters.max_num = max_nums[a];
+          parameters.absolute_threshold = absolute_thresholds[b];
+          parameters.ratio = ratios[c];
+          parameters.reciprocal = (d == 1);
+          CHECK(parameters.max_num > 0) << "max_num must be positive";
+          max_max_num = std::max(max_max_num, parameters.max_num);
+          settings.push_back(parameters);
+        }
+      }
+    }
+  }
+  int num_settings = settings.size();
+
+  cv::Mat F_mat;
+  MatrixReader matrix_reader;
+  ok = load(fund_mat_file, F_mat, matrix_reader);
+  CHECK(ok) << "Could not load fundamental matrix";
+  cv::Matx33d F = F_mat;
+
+  ThreadPool pool(FLAGS_num_threads);
+
+  int num_frames = countFrameFiles(descriptors_format1);
+  CHECK(num_frames > 0) << "No frames";
+  std::vector<Stats> stats(num_settings);
+
+  for (int t = 0; t < num_frames; t += 1) {
+    DescriptorMatrix descriptors1;
+    DescriptorMatrix descriptors2;
+    ok = loadDescriptorMatrix(makeFilename(descriptors_format1, t),
+        descriptors1);
+    CHECK(ok) << "Could not load first descriptors file";
+    ok = loadDescriptorMatrix(makeFilename(descriptors_format2, t),
+        descriptors2);
+    CHECK(ok) << "Could not load second descriptors file";
+
+    std::vector<SiftPosition> keypoints1;
+    std::vector<SiftPosition> keypoints2;
+    ok = loadSiftPositions(makeFilename(keypoints_format1, t), keypoints1);
+    CHECK(ok) << "Could not load first keypoints file";
+    ok = loadSiftPositions(makeFilename(keypoints_format2, t), keypoints2);
+    CHECK(ok) << "Could not load second keypoints file";
+
+    // Search once for the most matches of any setting.
+    FrameMatches matches;
+    matches.compute(descriptors1, descriptors2, keypoints1, keypoints2, F,
+        max_max_num, pool);
+
+    // Each setting has its own statistics.
+    pool.parallelFor(0, num_settings, EvaluateSettingFunction(matches,
+          settings, FLAGS_max_residual, stats));
+    LOG(INFO) << "Evaluated frame " << t + 1 << " / " << num_frames;
+  }
+
+  std::ofstream ofs(output_file.c_str());
+  CHECK(ofs.is_open()) << "Could not write to data file";
+  for (int i = 0; i < num_settings; i += 1) {
+    Stats mean;
+    mean.num_matches = stats[i].num_matches / num_frames;
+    mean.num_correct = stats[i].num_correct / num_frames;
+    mean.mean_residual = stats[i].mean_residual / num_frames;
+    mean.median_residual = stats[i].median_residual / num_frames;
+
+    ofs << settings[i].max_num << "\t";
+    ofs << settings[i].absolute_threshold << "\t";
+    ofs << settings[i].ratio << "\t";
+    ofs << settings[i].reciprocal << "\t";
+    writeStats(ofs, mean);
+    ofs << std::endl;
+  }
+
+  if (!FLAGS_cdf.empty()) {
+    std::ofstream cdf(FLAGS_cdf.c_str());
+    CHECK(cdf.is_open()) << "Could not write to CDF file";
+    for (int i = 0; i < num_settings; i += 1) {
+      cdf << settings[i].max_num << "\t";
+      cdf << settings[i].absolute_threshold << "\t";
+      cdf << settings[i].ratio << "\t";
+      cdf << settings[i].reciprocal << "\t";
+      writeQuantiles(cdf, stats[i].residuals, FLAGS_num_quantiles);
+      cdf << std::endl;
+    }
+  }
+
+  return 0;
+}
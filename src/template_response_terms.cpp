@@ -0,0 +1,98 @@
+#include "template_response_terms.hpp"
+#include <cmath>
+#include <limits>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "frame_correlator.hpp"
+
+TemplateResponseTerms::TemplateResponseTerms(const Video& video,
+                                             const FrameCorrelator* correlator,
+                                             const cv::Mat& templ,
+                                             cv::Size size,
+                                             double lambda,
+                                             int radius,
+                                             const SpaceTimeImagePoint* seed)
+    : video_(&video),
+      correlator_(correlator),
+      templ_(templ),
+      interior_(size.width - templ.cols + 1, size.height - templ.rows + 1),
+      lambda_(lambda),
+      radius_(radius),
+      fix_seed_(seed != NULL),
+      failed_(false) {
+  if (seed != NULL) {
+    seed_ = *seed;
+  }
+}
+
+int TemplateResponseTerms::length() const {
+  return video_->length();
+}
+
+void TemplateResponseTerms::get(int t, cv::Mat& g) const {
+  if (fix_seed_ && t == seed_.t) {
+    seedCost(g);
+    return;
+  }
+
+  cv::Mat response;
+  if (correlator_ != NULL) {
+    correlator_->correlate(t, templ_, response);
+  } else {
+    cv::Mat image;
+    if (!video_->get(t, image)) {
+      failed_ = true;
+      g = cv::Mat_<double>::zeros(interior_);
+      return;
+    }
+    // Evaluate response to template.
+    cv::matchTemplate(image, templ_, response, cv::TM_CCORR_NORMED);
+  }
+  toCost(response, g);
+}
+
+bool TemplateResponseTerms::getAll(std::vector<cv::Mat>& g,
+                                   ThreadPool& pool) const {
+  int n = length();
+  g.assign(n, cv::Mat());
+
+  if (correlator_ == NULL) {
+    for (int t = 0; t < n; t += 1) {
+      get(t, g[t]);
+    }
+    return !failed_;
+  }
+
+  // Every frame at once since they have been transformed.
+  std::vector<cv::Mat> responses;
+  correlator_->correlate(templ_, responses, pool);
+  for (int t = 0; t < n; t += 1) {
+    if (fix_seed_ && t == seed_.t) {
+      seedCost(g[t]);
+    } else {
+      toCost(responses[t], g[t]);
+    }
+    // Release each response once it has been converted.
+    responses[t] = cv::Mat();
+  }
+  return true;
+}
+
+bool TemplateResponseTerms::failed() const {
+  return failed_;
+}
+
+void TemplateResponseTerms::seedCost(cv::Mat& g) const {
+  // Set all other positions to +inf.
+  g = cv::Mat_<double>(interior_, std::numeric_limits<double>::infinity());
+  cv::Point center = cv::Point(std::floor(seed_.x() + 0.5),
+                               std::floor(seed_.y() + 0.5));
+  cv::Point corner = center - cv::Point(radius_, radius_);
+  g.at<double>(corner) = 0; // any finite constant
+}
+
+void TemplateResponseTerms::toCost(const cv::Mat& response, cv::Mat& g) const {
+  // Convert to 64-bit.
+  g = cv::Mat_<double>(response);
+  // Negate (minimizing not maximizing) and normalize.
+  g = -1. / lambda_ * g;
+}
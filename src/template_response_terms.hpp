@@ -0,0 +1,62 @@
+#ifndef TEMPLATE_RESPONSE_TERMS_HPP_
+#define TEMPLATE_RESPONSE_TERMS_HPP_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "viterbi.hpp"
+#include "video.hpp"
+#include "space_time_image_point.hpp"
+
+class FrameCorrelator;
+class ThreadPool;
+
+// Appearance cost of every position of a template in every frame of a video,
+// the normalized cross-correlation negated and divided by lambda. Position
+// (i, j) is the template centered at (j + radius, i + radius).
+//
+// Frames are matched when they are requested, so that a checkpointed dynamic
+// program holds the response of only one frame at a time. If a frame could
+// not be read, its cost is zero and failed() becomes true.
+class TemplateResponseTerms : public UnaryTerms2D {
+  public:
+    // Parameters:
+    // video -- Frames in which to match the template.
+    // correlator -- Matches templates to the transformed frames of the video,
+    //   or NULL to call cv::matchTemplate() on every frame.
+    // templ -- Square template of size (2 * radius + 1).
+    // size -- Size of the frames of the video.
+    // seed -- If not NULL, the cost in frame seed->t is infinite except at
+    //   the seed.
+    TemplateResponseTerms(const Video& video,
+                          const FrameCorrelator* correlator,
+                          const cv::Mat& templ,
+                          cv::Size size,
+                          double lambda,
+                          int radius,
+                          const SpaceTimeImagePoint* seed);
+
+    int length() const;
+    void get(int t, cv::Mat& g) const;
+
+    // Computes the cost of every frame at once, in parallel if there is a
+    // correlator. Returns false if a frame could not be read.
+    bool getAll(std::vector<cv::Mat>& g, ThreadPool& pool) const;
+
+    bool failed() const;
+
+  private:
+    void seedCost(cv::Mat& g) const;
+    void toCost(const cv::Mat& response, cv::Mat& g) const;
+
+    const Video* video_;
+    const FrameCorrelator* correlator_;
+    cv::Mat templ_;
+    cv::Size interior_;
+    double lambda_;
+    int radius_;
+    bool fix_seed_;
+    SpaceTimeImagePoint seed_;
+    mutable bool failed_;
+};
+
+#endif
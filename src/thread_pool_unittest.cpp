@@ -0,0 +1,165 @@
+#include "util/thread-pool.hpp"
+#include <algorithm>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include "gtest/gtest.h"
+
+namespace {
+
+boost::mutex solver_mutex;
+
+// Holds a lock across a nested parallelFor(), as the normalized cut does
+// around ARPACK.
+class LockedSolveFunction {
+  public:
+    LockedSolveFunction(ThreadPool& pool, std::vector<int>& counts)
+        : pool_(&pool), counts_(&counts) {}
+
+    void operator()(int i) const {
+      boost::mutex::scoped_lock lock(solver_mutex);
+      pool_->parallelFor(0, 100, boost::bind(increment, counts_, i, _1));
+    }
+
+  private:
+    static void increment(std::vector<int>* counts, int i, int j) {
+      // Distinct elements per (i, j), so no synchronization is needed.
+      (*counts)[100 * i + j] += 1;
+    }
+
+    ThreadPool* pool_;
+    std::vector<int>* counts_;
+};
+
+void addIndex(std::vector<int>* counts, int i) {
+  (*counts)[i] += 1;
+}
+
+void setValue(int* x, int value) {
+  *x = value;
+}
+
+void recordThread(boost::thread::id* id) {
+  *id = boost::this_thread::get_id();
+}
+
+// Sums [begin, end) by splitting it in half with a TaskGroup, so that every
+// level of the recursion waits for tasks of the same pool.
+void sumRange(ThreadPool* pool, int begin, int end, long* sum) {
+  if (end - begin <= 4) {
+    *sum = 0;
+    for (int i = begin; i < end; i += 1) {
+      *sum += i;
+    }
+    return;
+  }
+
+  int middle = (begin + end) / 2;
+  long left = 0;
+  long right = 0;
+  TaskGroup group(*pool);
+  group.run(boost::bind(sumRange, pool, begin, middle, &left));
+  group.run(boost::bind(sumRange, pool, middle, end, &right));
+  group.wait();
+  *sum = left + right;
+}
+
+void addToLocal(PerThread<long>* sums, int i) {
+  sums->local() += i;
+}
+
+}
+
+// The thread which holds the lock must not pick up another outer index
+// while it waits for its nested loop, which would deadlock.
+TEST(ThreadPool, NestedParallelForWithLockHeld) {
+  ThreadPool pool(4);
+  int n = 64;
+  std::vector<int> counts(100 * n, 0);
+  pool.parallelFor(0, n, LockedSolveFunction(pool, counts));
+
+  for (int i = 0; i < 100 * n; i += 1) {
+    EXPECT_EQ(1, counts[i]);
+  }
+}
+
+TEST(ThreadPool, NegativeCountUsesEveryCoreButOne) {
+  int num_cores = boost::thread::hardware_concurrency();
+  ThreadPool pool(-1);
+  EXPECT_EQ(std::max(num_cores - 1, 0), pool.numThreads());
+
+  std::vector<int> cpus;
+  cpus.push_back(0);
+  cpus.push_back(1);
+  cpus.push_back(2);
+  ThreadPool pinned(-1, cpus);
+  EXPECT_EQ(2, pinned.numThreads());
+
+  ThreadPool single(-1, std::vector<int>(1, 0));
+  EXPECT_EQ(0, single.numThreads());
+}
+
+TEST(ThreadPool, NoThreadsRunsInCaller) {
+  ThreadPool pool(0);
+  EXPECT_EQ(0, pool.numThreads());
+
+  boost::thread::id id;
+  pool.schedule(boost::bind(recordThread, &id));
+  EXPECT_TRUE(id == boost::this_thread::get_id());
+}
+
+TEST(ThreadPool, ParallelForVisitsEachIndexOnce) {
+  ThreadPool pool(3);
+  for (int grain = 1; grain <= 16; grain *= 4) {
+    std::vector<int> counts(1000, 0);
+    pool.parallelFor(0, 1000, boost::bind(addIndex, &counts, _1), grain);
+    EXPECT_EQ(1000, std::count(counts.begin(), counts.end(), 1));
+  }
+}
+
+TEST(TaskGroup, WaitsForItsTasks) {
+  ThreadPool pool(2);
+  std::vector<int> values(50, 0);
+  {
+    TaskGroup group(pool);
+    for (int i = 0; i < 50; i += 1) {
+      group.run(boost::bind(setValue, &values[i], i + 1));
+    }
+    group.wait();
+    for (int i = 0; i < 50; i += 1) {
+      EXPECT_EQ(i + 1, values[i]);
+    }
+
+    // The destructor waits too.
+    group.run(boost::bind(setValue, &values[0], -1));
+  }
+  EXPECT_EQ(-1, values[0]);
+}
+
+// Every worker may be waiting for a group, so waiting must run queued tasks.
+TEST(TaskGroup, NestedGroupsDoNotDeadlock) {
+  for (int num_threads = 0; num_threads <= 2; num_threads += 1) {
+    ThreadPool pool(num_threads);
+    long sum = 0;
+    sumRange(&pool, 0, 1000, &sum);
+    EXPECT_EQ(999L * 1000 / 2, sum);
+  }
+}
+
+TEST(PerThread, KeepsOneValuePerThread) {
+  ThreadPool pool(3);
+  PerThread<long> sums;
+  pool.parallelFor(0, 10000, boost::bind(addToLocal, &sums, _1));
+
+  // The workers and the calling thread.
+  PerThread<long>::Values& values = sums.values();
+  EXPECT_GE(4u, values.size());
+  EXPECT_LE(1u, values.size());
+
+  long total = 0;
+  PerThread<long>::Values::const_iterator value;
+  for (value = values.begin(); value != values.end(); ++value) {
+    total += value->second;
+  }
+  EXPECT_EQ(9999L * 10000 / 2, total);
+}
@@ -0,0 +1,74 @@
+#include <sstream>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include "tools/using.hpp"
+#include "videoseg/label-runs.hpp"
+#include "videoseg/segmentation-stream.hpp"
+#include "chunked_archive.hpp"
+
+using videoseg::LabelRun;
+using videoseg::VideoSegmentation;
+using videoseg::VideoSegmentationStreamReader;
+
+DEFINE_string(codec, "zstd", "Compression of chunks (none, lz4 or zstd)");
+DEFINE_int32(chunk_size, 1 << 20,
+    "Approximate number of bytes in each chunk before compression");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Converts a flat segmentation into runs of labels, one archive "
+      "entry per frame." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " segmentation label-runs" << std::endl;
+  usage << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  string segmentation_file = argv[1];
+  string label_runs_file = argv[2];
+
+  bool ok;
+
+  ArchiveCodec codec;
+  CHECK(parseArchiveCodec(FLAGS_codec, codec)) << "Unknown codec `" <<
+      FLAGS_codec << "'";
+
+  VideoSegmentationStreamReader segmentation;
+  ok = segmentation.open(segmentation_file);
+  CHECK(ok) << "Could not open segmentation file";
+
+  ChunkedArchiveWriter archive(codec, FLAGS_chunk_size);
+  ok = archive.open(label_runs_file);
+  CHECK(ok) << "Could not open output";
+
+  // Only one frame is in memory at a time.
+  VideoSegmentation::Frame frame;
+  vector<LabelRun> runs;
+  string data;
+  int t = 0;
+
+  while (segmentation.read(frame)) {
+    videoseg::frameToLabelRuns(frame, runs);
+    videoseg::encodeLabelRuns(runs, data);
+    ok = archive.add(videoseg::makeLabelRunsKey(t), data);
+    CHECK(ok) << "Could not add frame " << t;
+    t += 1;
+  }
+
+  ok = archive.close();
+  CHECK(ok) << "Could not save output";
+  LOG(INFO) << "Packed " << t << " frames";
+
+  return 0;
+}
@@ -6,17 +6,34 @@
 #include "tools/using.hpp"
 #include "videoseg/segmentation.hpp"
 #include "videoseg/region.hpp"
+#include "videoseg/label-runs.hpp"
+#include "videoseg/segmentation-stream.hpp"
+#include "chunked_archive.hpp"
 #include "util/random-color.hpp"
 #include "tracking/track-list.hpp"
+#include "tracking/track-list-stream.hpp"
+#include <google/protobuf/arena.h>
 #include <google/protobuf/repeated_field.h>
 
+using google::protobuf::Arena;
 using google::protobuf::RepeatedPtrField;
 using tracking::TrackList;
+using tracking::TrackListStreamReader;
+using tracking::TrackListStreamWriter;
 using videoseg::VideoSegmentation;
 using videoseg::Rasterization;
+using videoseg::LabelRun;
+using videoseg::VideoSegmentationStreamReader;
 
 DEFINE_double(min_fraction, 1.,
     "The fraction of frames that need to be inside the foreground region");
+DEFINE_bool(label_runs, false,
+    "The foreground is an archive of label runs from pack-label-runs");
+DEFINE_bool(stream, false,
+    "Read the tracks and the foreground together one frame at a time, in two "
+    "passes, instead of loading either whole");
+DEFINE_bool(packed, false,
+    "Write the packed format of tracks, which is smaller and quicker to read");
 
 const int FOREGROUND_LABEL = 0;
 const int BACKGROUND_LABEL = 1;
@@ -53,7 +70,6 @@ struct Tally {
 void updateStatistics(const RepeatedPtrField<TrackList::Point>& points,
                       const Rasterization& foreground,
                       map<int, Tally>& stats) {
-
   PointList::const_iterator point;
   for (point = points.begin(); point != points.end(); ++point) {
     // Get existing element, or insert one.
@@ -99,6 +115,45 @@ void computeStatistics(const TrackList& tracks,
   }
 }
 
+void updateStatistics(const RepeatedPtrField<TrackList::Point>& points,
+                      const vector<LabelRun>& runs,
+                      map<int, Tally>& stats) {
+  PointList::const_iterator point;
+  for (point = points.begin(); point != points.end(); ++point) {
+    // Get existing element, or insert one.
+    Tally& tally = stats[point->id()];
+    tally.total += 1;
+
+    // Round to nearest integer coordinates.
+    cv::Point pos(std::floor(point->x() + 0.5), std::floor(point->y() + 0.5));
+
+    if (videoseg::findLabel(runs, pos) == FOREGROUND_LABEL) {
+      tally.num_inside += 1;
+    }
+  }
+}
+
+void computeStatistics(const TrackList& tracks,
+                       ChunkedArchiveReader& segmentation,
+                       map<int, Tally>& stats) {
+  const TrackFrameList& track_frames = tracks.frames();
+  int num_frames = segmentation.size();
+
+  // Segmentation does not include first or last frame.
+  CHECK_EQ(track_frames.size(), num_frames + 2);
+
+  string data;
+  vector<LabelRun> runs;
+
+  for (int t = 0; t < num_frames; t += 1) {
+    bool ok = segmentation.read(videoseg::makeLabelRunsKey(t), data) &&
+        videoseg::decodeLabelRuns(data, runs);
+    CHECK(ok) << "Could not read label runs of frame " << t;
+
+    updateStatistics(track_frames.Get(t + 1).points(), runs, stats);
+  }
+}
+
 void findSubset(const map<int, Tally>& stats,
                 set<int>& ids,
                 double min_fraction) {
@@ -118,6 +173,39 @@ void findSubset(const map<int, Tally>& stats,
   }
 }
 
+// Copies the points of the tracks in the set, numbered by their position in
+// the set.
+void selectFrameSubset(const TrackList::Frame& frame,
+                       const set<int>& ids,
+                       TrackList::Frame& new_frame) {
+  const PointList& points = frame.points();
+
+  // Points in the frame and indices in the set are ordered.
+  set<int>::const_iterator id = ids.begin();
+  int new_id = 0;
+  PointList::const_iterator point = points.begin();
+
+  while (id != ids.end() && point != points.end()) {
+    if (*id < point->id()) {
+      ++id;
+      new_id += 1;
+    } else if (point->id() < *id) {
+      ++point;
+    } else {
+      // Have a match. Adjust the ID and copy the point.
+      TrackList::Point* new_point = new_frame.add_points();
+      *new_point = *point;
+      new_point->set_id(new_id);
+
+      // Next point in the set.
+      ++id;
+      new_id += 1;
+      // Next point in the frame.
+      ++point;
+    }
+  }
+}
+
 void selectSubset(const TrackList& tracks,
                   const set<int>& ids,
                   TrackList& subset) {
@@ -125,57 +213,185 @@ void selectSubset(const TrackList& tracks,
 
   TrackFrameList::const_iterator frame;
   for (frame = frames.begin(); frame != frames.end(); ++frame) {
-    const PointList& points = frame->points();
-    TrackList::Frame new_frame;
-
-    // Points in the frame and indices in the set are ordered.
-    set<int>::const_iterator id = ids.begin();
-    int new_id = 0;
-    PointList::const_iterator point = points.begin();
-
-    while (id != ids.end() && point != points.end()) {
-      if (*id < point->id()) {
-        ++id;
-        new_id += 1;
-      } else if (point->id() < *id) {
-        ++point;
-      } else {
-        // Have a match. Adjust the ID and copy the point.
-        TrackList::Point new_point(*point);
-        new_point.set_id(new_id);
-        new_frame.mutable_points()->Add()->Swap(&new_point);
-
-        // Next point in the set.
-        ++id;
-        new_id += 1;
-        // Next point in the frame.
-        ++point;
-      }
-    }
-
-    // Add frame to the track list.
-    subset.mutable_frames()->Add()->Swap(&new_frame);
+    // Constructed in place, on the arena of the subset if it has one.
+    selectFrameSubset(*frame, ids, *subset.add_frames());
   }
 }
 
+// Print number of tracks.
+void printSubsetSize(const set<int>& ids, const map<int, Tally>& stats) {
+  int kept = std::floor(100. * ids.size() / stats.size() + 0.5);
+  std::cout << "Keeping " << ids.size() << " / " << stats.size() <<
+      " tracks (" << kept << "%)" << std::endl;
+}
+
 void selectForegroundTracks(const TrackList& tracks,
-                            const VideoSegmentation& segmentation,
+                            const map<int, Tally>& stats,
                             TrackList& foreground_tracks,
                             double min_fraction) {
-  map<int, Tally> stats;
-  computeStatistics(tracks, segmentation, stats);
-
   set<int> foreground_ids;
   findSubset(stats, foreground_ids, min_fraction);
-
-  // Print number of tracks.
-  int kept = std::floor(100. * foreground_ids.size() / stats.size() + 0.5);
-  std::cout << "Keeping " << foreground_ids.size() << " / " << stats.size() <<
-      " tracks (" << kept << "%)" << std::endl;
+  printSubsetSize(foreground_ids, stats);
 
   selectSubset(tracks, foreground_ids, foreground_tracks);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Streaming
+
+// Reads the foreground of each frame in turn as a mask, from either a flat
+// segmentation or an archive of label runs.
+class ForegroundMaskReader {
+  public:
+    ForegroundMaskReader() : label_runs_(false), t_(0) {}
+
+    bool open(const string& filename, bool label_runs) {
+      label_runs_ = label_runs;
+      t_ = 0;
+      if (label_runs_) {
+        return archive_.open(filename);
+      } else {
+        return segmentation_.open(filename);
+      }
+    }
+
+    // Returns false after the last frame.
+    bool read(cv::Mat_<uchar>& mask) {
+      runs_.clear();
+
+      if (label_runs_) {
+        if (t_ >= archive_.size()) {
+          return false;
+        }
+        bool ok = archive_.read(videoseg::makeLabelRunsKey(t_), data_) &&
+            videoseg::decodeLabelRuns(data_, runs_);
+        CHECK(ok) << "Could not read label runs of frame " << t_;
+      } else {
+        if (!segmentation_.read(frame_)) {
+          return false;
+        }
+        videoseg::frameToLabelRuns(frame_, runs_);
+      }
+
+      drawMask(runs_, mask);
+      t_ += 1;
+      return true;
+    }
+
+  private:
+    // Sets the foreground pixels of a mask which is large enough to hold them.
+    static void drawMask(const vector<LabelRun>& runs, cv::Mat_<uchar>& mask) {
+      int rows = 0;
+      int cols = 0;
+      vector<LabelRun>::const_iterator run;
+      for (run = runs.begin(); run != runs.end(); ++run) {
+        rows = std::max(rows, run->y + 1);
+        cols = std::max(cols, run->right + 1);
+      }
+
+      // Re-uses the memory of the previous frame.
+      mask.create(rows, cols);
+      mask = 0;
+
+      for (run = runs.begin(); run != runs.end(); ++run) {
+        if (run->label == FOREGROUND_LABEL) {
+          uchar* row = mask[run->y];
+          std::fill(row + run->left, row + run->right + 1, 1);
+        }
+      }
+    }
+
+    bool label_runs_;
+    VideoSegmentationStreamReader segmentation_;
+    ChunkedArchiveReader archive_;
+    int t_;
+
+    // Memory that is re-used every frame.
+    VideoSegmentation::Frame frame_;
+    string data_;
+    vector<LabelRun> runs_;
+};
+
+void updateStatistics(const PointList& points,
+                      const cv::Mat_<uchar>& mask,
+                      map<int, Tally>& stats) {
+  PointList::const_iterator point;
+  for (point = points.begin(); point != points.end(); ++point) {
+    // Get existing element, or insert one.
+    Tally& tally = stats[point->id()];
+    tally.total += 1;
+
+    // Round to nearest integer coordinates.
+    int x = std::floor(point->x() + 0.5);
+    int y = std::floor(point->y() + 0.5);
+
+    if (y >= 0 && y < mask.rows && x >= 0 && x < mask.cols && mask(y, x)) {
+      tally.num_inside += 1;
+    }
+  }
+}
+
+// First pass, frame by frame.
+void computeStatisticsStreaming(const string& tracks_file,
+                                const string& foreground_file,
+                                bool label_runs,
+                                map<int, Tally>& stats) {
+  TrackListStreamReader tracks;
+  bool ok = tracks.open(tracks_file);
+  CHECK(ok) << "Could not open tracks file";
+
+  ForegroundMaskReader foreground;
+  ok = foreground.open(foreground_file, label_runs);
+  CHECK(ok) << "Could not open foreground file";
+
+  // Segmentation does not include first or last frame.
+  TrackList::Frame track_frame;
+  ok = tracks.read(track_frame);
+  CHECK(ok) << "Tracks have no frames";
+
+  cv::Mat_<uchar> mask;
+  int num_frames = 0;
+
+  while (foreground.read(mask)) {
+    track_frame.Clear();
+    ok = tracks.read(track_frame);
+    CHECK(ok) << "Tracks end before the foreground";
+
+    updateStatistics(track_frame.points(), mask, stats);
+    num_frames += 1;
+  }
+
+  // Expect exactly one more frame.
+  ok = tracks.read(track_frame) && !tracks.read(track_frame);
+  CHECK(ok) << "Tracks do not have two more frames than the foreground";
+
+  LOG(INFO) << "Tested points in " << num_frames << " frames";
+}
+
+// Second pass, frame by frame.
+void selectSubsetStreaming(const string& tracks_file,
+                           const set<int>& ids,
+                           const string& subset_file) {
+  TrackListStreamReader tracks;
+  bool ok = tracks.open(tracks_file);
+  CHECK(ok) << "Could not open tracks file";
+
+  TrackListStreamWriter subset(FLAGS_packed);
+  ok = subset.open(subset_file);
+  CHECK(ok) << "Could not open output";
+
+  TrackList::Frame frame;
+  TrackList::Frame new_frame;
+
+  while (tracks.read(frame)) {
+    new_frame.Clear();
+    selectFrameSubset(frame, ids, new_frame);
+    ok = subset.write(new_frame);
+    CHECK(ok) << "Could not save output";
+    frame.Clear();
+  }
+}
+
 int main(int argc, char** argv) {
   init(argc, argv);
 
@@ -185,36 +401,71 @@ int main(int argc, char** argv) {
 
   bool ok;
 
+  if (FLAGS_stream) {
+    map<int, Tally> stats;
+    computeStatisticsStreaming(input_tracks_file, foreground_file,
+        FLAGS_label_runs, stats);
+
+    set<int> foreground_ids;
+    findSubset(stats, foreground_ids, FLAGS_min_fraction);
+    printSubsetSize(foreground_ids, stats);
+
+    selectSubsetStreaming(input_tracks_file, foreground_ids, out_tracks_file);
+    return 0;
+  }
+
+  // All messages are allocated on one arena and freed together.
+  Arena arena;
+
   // Load tracks from file.
-  TrackList input_tracks;
+  TrackList& input_tracks = *Arena::CreateMessage<TrackList>(&arena);
   {
     std::ifstream ifs(input_tracks_file.c_str(), std::ios::binary);
     if (!ifs) {
       LOG(FATAL) << "Could not open tracks file";
     }
-    ok = input_tracks.ParseFromIstream(&ifs);
+    ok = input_tracks.ParseFromIstream(&ifs) &&
+        tracking::unpackTrackList(input_tracks);
     if (!ok) {
       LOG(FATAL) << "Could not parse tracks from file";
     }
   }
 
-  // Load segmentation from file.
-  VideoSegmentation segmentation;
-  {
-    std::ifstream ifs(foreground_file.c_str(), std::ios::binary);
-    if (!ifs) {
-      LOG(FATAL) << "Could not open segmentation file";
-    }
-    ok = segmentation.ParseFromIstream(&ifs);
+  map<int, Tally> stats;
+
+  if (FLAGS_label_runs) {
+    // Frames are decoded one at a time.
+    ChunkedArchiveReader segmentation;
+    ok = segmentation.open(foreground_file);
     if (!ok) {
-      LOG(FATAL) << "Could not parse segmentation from file";
+      LOG(FATAL) << "Could not open label runs file";
+    }
+    computeStatistics(input_tracks, segmentation, stats);
+  } else {
+    // Load segmentation from file.
+    VideoSegmentation& segmentation =
+        *Arena::CreateMessage<VideoSegmentation>(&arena);
+    {
+      std::ifstream ifs(foreground_file.c_str(), std::ios::binary);
+      if (!ifs) {
+        LOG(FATAL) << "Could not open segmentation file";
+      }
+      ok = segmentation.ParseFromIstream(&ifs);
+      if (!ok) {
+        LOG(FATAL) << "Could not parse segmentation from file";
+      }
     }
+    computeStatistics(input_tracks, segmentation, stats);
   }
 
-  TrackList output_tracks;
-  selectForegroundTracks(input_tracks, segmentation, output_tracks,
+  TrackList& output_tracks = *Arena::CreateMessage<TrackList>(&arena);
+  selectForegroundTracks(input_tracks, stats, output_tracks,
       FLAGS_min_fraction);
 
+  if (FLAGS_packed) {
+    tracking::packTrackList(output_tracks);
+  }
+
   std::ofstream ofs(out_tracks_file.c_str(),
       std::ios::trunc | std::ios::binary);
   ok = output_tracks.SerializeToOstream(&ofs);
@@ -1,13 +1,21 @@
 #ifndef TRACK_HPP_
 #define TRACK_HPP_
 
-#include <opencv2/core/core.hpp>
+#include <functional>
 #include <map>
+#include <utility>
+#include <memory>
+#include <opencv2/core/core.hpp>
 
-template<class T>
+// Points are allocated with the standard allocator unless another is given.
+// With boost::fast_pool_allocator<std::pair<const int, T> >, they come from
+// a pool shared by every track of the same type, which makes filling and
+// destroying millions of small nodes much cheaper. The pool holds its memory
+// until exit.
+template<class T, class Allocator = std::allocator<std::pair<const int, T> > >
 class Track {
   private:
-    typedef std::map<int, T> Map;
+    typedef std::map<int, T, std::less<int>, Allocator> Map;
 
   public:
     typedef typename Map::iterator iterator;
@@ -42,7 +50,7 @@ class Track {
     int size() const;
     bool empty() const;
     void clear();
-    void swap(Track<T>& other);
+    void swap(Track<T, Allocator>& other);
 
     iterator begin();
     const_iterator begin() const;
@@ -58,22 +66,25 @@ class Track {
     Map map_;
 };
 
-template<class T>
-void swap(Track<T>& lhs, Track<T>& rhs);
+template<class T, class Allocator>
+void swap(Track<T, Allocator>& lhs, Track<T, Allocator>& rhs);
 
+// Only for the default allocator, so that addTrackSize<T> names a function.
 template<class T>
 int addTrackSize(int x, const Track<T>& track);
 
 ////////////////////////////////////////////////////////////////////////////////
 
 // Iterates through a track.
-template<class T>
+// Works for any track type with the interface of Track<T>, such as a track
+// with another allocator.
+template<class T, class TrackType = Track<T> >
 class TrackIterator {
   public:
     TrackIterator();
-    explicit TrackIterator(const Track<T>& track);
-    TrackIterator(const Track<T>& track, int time);
-    TrackIterator(const TrackIterator<T>& other);
+    explicit TrackIterator(const TrackType& track);
+    TrackIterator(const TrackType& track, int time);
+    TrackIterator(const TrackIterator<T, TrackType>& other);
 
     void next();
     void previous();
@@ -85,9 +96,9 @@ class TrackIterator {
     int time() const;
 
   private:
-    typedef typename Track<T>::const_iterator Position;
+    typedef typename TrackType::const_iterator Position;
 
-    const Track<T>* track_;
+    const TrackType* track_;
     Position position_;
 };
 
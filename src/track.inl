@@ -3,131 +3,136 @@
 ////////////////////////////////////////////////////////////////////////////////
 // Track
 
-template<class T>
-Track<T>::Track() : map_() {}
+template<class T, class Allocator>
+Track<T, Allocator>::Track() : map_() {}
 
-template<class T>
-void Track<T>::resetRange(int first, int last) {
+template<class T, class Allocator>
+void Track<T, Allocator>::resetRange(int first, int last) {
   for (int t = first; t <= last; t += 1) {
     map_[t];
   }
 }
 
-template<class T>
-T& Track<T>::operator[](int x) {
+template<class T, class Allocator>
+T& Track<T, Allocator>::operator[](int x) {
   return map_[x];
 }
 
-template<class T>
-std::pair<typename Track<T>::iterator, bool>
-Track<T>::insert(const value_type& x) {
+template<class T, class Allocator>
+std::pair<typename Track<T, Allocator>::iterator, bool>
+Track<T, Allocator>::insert(const value_type& x) {
   return map_.insert(x);
 }
 
-template<class T>
-typename Track<T>::iterator
-Track<T>::insert(iterator position, const value_type& x) {
+template<class T, class Allocator>
+typename Track<T, Allocator>::iterator
+Track<T, Allocator>::insert(iterator position, const value_type& x) {
   return map_.insert(position, x);
 }
 
-template<class T>
+template<class T, class Allocator>
 template<class InputIterator>
-void Track<T>::insert(InputIterator first, InputIterator last) {
+void Track<T, Allocator>::insert(InputIterator first, InputIterator last) {
   map_.insert(first, last);
 }
 
-template<class T>
-typename Track<T>::iterator Track<T>::find(int x) {
+template<class T, class Allocator>
+typename Track<T, Allocator>::iterator Track<T, Allocator>::find(int x) {
   return map_.find(x);
 }
 
-template<class T>
-typename Track<T>::const_iterator Track<T>::find(int x) const {
+template<class T, class Allocator>
+typename Track<T, Allocator>::const_iterator
+Track<T, Allocator>::find(int x) const {
   return map_.find(x);
 }
 
-template<class T>
-void Track<T>::erase(iterator position) {
+template<class T, class Allocator>
+void Track<T, Allocator>::erase(iterator position) {
   map_.erase(position);
 }
 
-template<class T>
-void Track<T>::erase(iterator first, iterator last) {
+template<class T, class Allocator>
+void Track<T, Allocator>::erase(iterator first, iterator last) {
   map_.erase(first, last);
 }
 
-template<class T>
-typename Track<T>::iterator Track<T>::lower_bound(int x) {
+template<class T, class Allocator>
+typename Track<T, Allocator>::iterator Track<T, Allocator>::lower_bound(int x) {
   return map_.lower_bound(x);
 }
 
-template<class T>
-typename Track<T>::const_iterator Track<T>::lower_bound(int x) const {
+template<class T, class Allocator>
+typename Track<T, Allocator>::const_iterator
+Track<T, Allocator>::lower_bound(int x) const {
   return map_.lower_bound(x);
 }
 
-template<class T>
-int Track<T>::size() const {
+template<class T, class Allocator>
+int Track<T, Allocator>::size() const {
   return map_.size();
 }
 
-template<class T>
-bool Track<T>::empty() const {
+template<class T, class Allocator>
+bool Track<T, Allocator>::empty() const {
   return map_.empty();
 }
 
-template<class T>
-void Track<T>::clear() {
+template<class T, class Allocator>
+void Track<T, Allocator>::clear() {
   map_.clear();
 }
 
-template<class T>
-void Track<T>::swap(Track<T>& other) {
+template<class T, class Allocator>
+void Track<T, Allocator>::swap(Track<T, Allocator>& other) {
   map_.swap(other.map_);
 }
 
-template<class T>
-void swap(Track<T>& lhs, Track<T>& rhs) {
+template<class T, class Allocator>
+void swap(Track<T, Allocator>& lhs, Track<T, Allocator>& rhs) {
   lhs.swap(rhs);
 }
 
-template<class T>
-typename Track<T>::iterator Track<T>::begin() {
+template<class T, class Allocator>
+typename Track<T, Allocator>::iterator Track<T, Allocator>::begin() {
   return map_.begin();
 }
 
-template<class T>
-typename Track<T>::const_iterator Track<T>::begin() const {
+template<class T, class Allocator>
+typename Track<T, Allocator>::const_iterator
+Track<T, Allocator>::begin() const {
   return map_.begin();
 }
 
-template<class T>
-typename Track<T>::iterator Track<T>::end() {
+template<class T, class Allocator>
+typename Track<T, Allocator>::iterator Track<T, Allocator>::end() {
   return map_.end();
 }
 
-template<class T>
-typename Track<T>::const_iterator Track<T>::end() const {
+template<class T, class Allocator>
+typename Track<T, Allocator>::const_iterator Track<T, Allocator>::end() const {
   return map_.end();
 }
 
-template<class T>
-typename Track<T>::reverse_iterator Track<T>::rbegin() {
+template<class T, class Allocator>
+typename Track<T, Allocator>::reverse_iterator Track<T, Allocator>::rbegin() {
   return map_.rbegin();
 }
 
-template<class T>
-typename Track<T>::const_reverse_iterator Track<T>::rbegin() const {
+template<class T, class Allocator>
+typename Track<T, Allocator>::const_reverse_iterator
+Track<T, Allocator>::rbegin() const {
   return map_.rbegin();
 }
 
-template<class T>
-typename Track<T>::reverse_iterator Track<T>::rend() {
+template<class T, class Allocator>
+typename Track<T, Allocator>::reverse_iterator Track<T, Allocator>::rend() {
   return map_.rend();
 }
 
-template<class T>
-typename Track<T>::const_reverse_iterator Track<T>::rend() const {
+template<class T, class Allocator>
+typename Track<T, Allocator>::const_reverse_iterator
+Track<T, Allocator>::rend() const {
   return map_.rend();
 }
 
@@ -139,56 +144,57 @@ int addTrackSize(int x, const Track<T>& track) {
 ////////////////////////////////////////////////////////////////////////////////
 // TrackIterator
 
-template<class T>
-TrackIterator<T>::TrackIterator() : track_(NULL), position_() {}
+template<class T, class TrackType>
+TrackIterator<T, TrackType>::TrackIterator() : track_(NULL), position_() {}
 
-template<class T>
-TrackIterator<T>::TrackIterator(const Track<T>& track)
+template<class T, class TrackType>
+TrackIterator<T, TrackType>::TrackIterator(const TrackType& track)
     : track_(&track), position_(track.begin()) {}
 
-template<class T>
-TrackIterator<T>::TrackIterator(const Track<T>& track, int time)
+template<class T, class TrackType>
+TrackIterator<T, TrackType>::TrackIterator(const TrackType& track, int time)
     : track_(&track), position_() {
   // Find the last component whose key is less than or equal to time.
   position_ = track_->lower_bound(time);
 }
 
-template<class T>
-TrackIterator<T>::TrackIterator(const TrackIterator<T>& other)
+template<class T, class TrackType>
+TrackIterator<T, TrackType>::TrackIterator(
+    const TrackIterator<T, TrackType>& other)
     : track_(other.track_), position_(other.position_) {}
 
-template<class T>
-void TrackIterator<T>::next() {
+template<class T, class TrackType>
+void TrackIterator<T, TrackType>::next() {
   CHECK_NOTNULL(track_);
   ++position_;
 }
 
-template<class T>
-void TrackIterator<T>::previous() {
+template<class T, class TrackType>
+void TrackIterator<T, TrackType>::previous() {
   CHECK_NOTNULL(track_);
   --position_;
 }
 
-template<class T>
-bool TrackIterator<T>::end() const {
+template<class T, class TrackType>
+bool TrackIterator<T, TrackType>::end() const {
   CHECK_NOTNULL(track_);
   return (position_ == track_->end());
 }
 
-template<class T>
-bool TrackIterator<T>::begin() const {
+template<class T, class TrackType>
+bool TrackIterator<T, TrackType>::begin() const {
   CHECK_NOTNULL(track_);
   return (position_ == track_->begin());
 }
 
-template<class T>
-const T& TrackIterator<T>::get() const {
+template<class T, class TrackType>
+const T& TrackIterator<T, TrackType>::get() const {
   CHECK_NOTNULL(track_);
   return position_->second;
 }
 
-template<class T>
-int TrackIterator<T>::time() const {
+template<class T, class TrackType>
+int TrackIterator<T, TrackType>::time() const {
   CHECK_NOTNULL(track_);
   return position_->first;
 }
@@ -6,6 +6,8 @@
 #include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/pool/pool_alloc.hpp>
+#include <boost/thread/mutex.hpp>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <opencv2/core/core.hpp>
@@ -19,6 +21,7 @@
 #include "similarity_warp.hpp"
 #include "sift_position.hpp"
 #include "flow.hpp"
+#include "util/flow-histogram.hpp"
 #include "track_list.hpp"
 #include "random_color.hpp"
 
@@ -26,7 +29,9 @@
 #include "sift_position_reader.hpp"
 #include "sift_position_writer.hpp"
 #include "track_list_writer.hpp"
+#include "plane_cache.hpp"
 #include "util.hpp"
+#include "util/thread-pool.hpp"
 
 DEFINE_int32(max_frames, -1,
     "Maximum number of frames to track in either direction. "
@@ -35,6 +40,19 @@ DEFINE_double(min_scale, 1., "Scale below which feature will be dropped");
 
 DEFINE_int32(radius, 8, "Half of [patch size - 1]");
 
+DEFINE_bool(all_frames, false,
+    "Track from every frame which has a keypoints file? "
+    "Arguments are then image-format keypoints-format tracks-format. "
+    "Frames are streamed once in each direction for all starting frames, "
+    "so only one is held in memory at a time.");
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads to track features with, 0 to track serially");
+DEFINE_string(plane_cache, "",
+    "Directory in which to keep the gradients of each image between runs. "
+    "Empty to compute them every time.");
+DEFINE_bool(solver_statistics, false,
+    "Log histograms of the solver statistics of every frame and in total");
+
 // Scale of Gaussian mask.
 // Patch size should be about 2 * (2 or 3 sigma).
 const double MASK_SIGMA = 4.;
@@ -55,6 +73,9 @@ const bool UPDATE_TEMPLATE = true;
 // (A value of 1 means anything is permitted.)
 const double MAX_RESIDUAL = 0.05;
 
+// Number of keypoints tracked in one direction by a single task.
+const int KEYPOINTS_PER_TASK = 32;
+
 std::string makeFilename(const std::string& format, int n) {
   return boost::str(boost::format(format) % (n + 1));
 }
@@ -113,6 +134,8 @@ void init(int& argc, char**& argv) {
   usage << std::endl;
   usage << argv[0] << " image-format frame-number keypoints-file tracks-file" <<
       std::endl;
+  usage << argv[0] << " --all_frames image-format keypoints-format "
+      "tracks-format" << std::endl;
   usage << std::endl;
   usage << "Parameters:" << std::endl;
   usage << "frame-number -- Frame to start tracking from (zero-indexed)." <<
@@ -122,7 +145,7 @@ void init(int& argc, char**& argv) {
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
 
-  if (argc != 5) {
+  if (argc != (FLAGS_all_frames ? 4 : 5)) {
     google::ShowUsageWithFlags(argv[0]);
     std::exit(1);
   }
@@ -157,234 +180,458 @@ double patchResidual(const cv::Mat& A, const cv::Mat& B, const cv::Mat& W) {
   return num / denom;
 }
 
-// Tracks a collection of warps through a sequence.
-void trackFeatures(const std::vector<SimilarityWarp>& warps,
-                   TrackList<SiftPosition>& tracks,
-                   int width,
-                   const cv::Mat& mask,
-                   const std::string& image_format,
-                   int time,
-                   const FlowOptions& options,
-                   int max_duration,
-                   bool reverse) {
-  int num_keypoints = warps.size();
-  tracks = TrackList<SiftPosition>(num_keypoints);
-
-  int duration = 0;
-  bool ok = true;
+// An image and its gradients.
+// Computed once per frame and shared read-only between tasks.
+struct Frame {
+  cv::Mat image;
+  cv::Mat ddx;
+  cv::Mat ddy;
+};
+
+bool loadFrame(const std::string& image_format,
+               int time,
+               const PlaneCache& cache,
+               Frame& frame) {
   cv::Mat color_image;
   cv::Mat integer_image;
-  cv::Mat image;
+  bool ok = readImage(makeFilename(image_format, time), color_image,
+      integer_image);
+  if (!ok) {
+    return false;
+  }
+
+  std::string key = planeCacheKey(integer_image, "central-difference double");
+  std::vector<cv::Mat> planes;
+  if (cache.load(key, planes) && planes.size() == 3) {
+    frame.image = planes[0];
+    frame.ddx = planes[1];
+    frame.ddy = planes[2];
+    return true;
+  }
+
+  // Convert to floating point.
+  integer_image.convertTo(frame.image, cv::DataType<double>::type, 1. / 255.);
+
+  // Compute gradients.
+  cv::Mat diff = (cv::Mat_<double>(1, 3) << -0.5, 0, 0.5);
+  cv::Mat identity = (cv::Mat_<double>(1, 1) << 1);
+  cv::sepFilter2D(frame.image, frame.ddx, -1, diff, identity);
+  cv::sepFilter2D(frame.image, frame.ddy, -1, identity, diff);
+
+  if (cache.enabled()) {
+    planes.clear();
+    planes.push_back(frame.image);
+    planes.push_back(frame.ddx);
+    planes.push_back(frame.ddy);
+    cache.store(key, planes);
+  }
+
+  return true;
+}
+
+// Keypoints to track from one frame, and their tracks in either direction.
+struct Seed {
+  int time;
+  std::string tracks_file;
+  std::vector<SimilarityWarp> warps;
+  TrackList<SiftPosition> forward_tracks;
+  TrackList<SiftPosition> reverse_tracks;
+};
+
+// Loads keypoints and converts each to a tracking feature.
+void loadSeed(const std::string& keypoints_file,
+              const SimilarityWarper& warper,
+              Seed& seed) {
+  // Load initial keypoints (x, y, size, theta).
+  std::vector<SiftPosition> keypoints;
+  SiftPositionReader feature_reader;
+  bool ok = loadList(keypoints_file, keypoints, feature_reader);
+  CHECK(ok) << "Could not load keypoints";
+
+  int num_features = keypoints.size();
+  LOG(INFO) << "Loaded " << num_features << " keypoints for frame " <<
+      seed.time;
+
+  std::vector<SiftPosition>::const_iterator keypoint;
+  for (keypoint = keypoints.begin(); keypoint != keypoints.end(); ++keypoint) {
+    // Convert to a warp.
+    SimilarityWarp warp = constructWarpFromSiftPosition(*keypoint, warper);
+    seed.warps.push_back(warp);
+  }
 
-  // Set of features currently being tracked.
-  typedef std::map<int, TrackedFeature> TrackedFeatureSet;
+  seed.forward_tracks = TrackList<SiftPosition>(num_features);
+  seed.reverse_tracks = TrackList<SiftPosition>(num_features);
+}
+
+// Warns if any features are initialized as invalid.
+void checkSeed(const Seed& seed, const cv::Size& size, int radius) {
+  int num_features = seed.warps.size();
+  int num_invalid = 0;
+  for (int i = 0; i < num_features; i += 1) {
+    if (!seed.warps[i].isValid(size, radius)) {
+      num_invalid += 1;
+    }
+  }
+
+  if (num_invalid > 0) {
+    LOG(WARNING) << "Some features were invalid to track (" << num_invalid <<
+        " / " << num_features << ")";
+  }
+}
+
+// Set of features currently being tracked.
+// Features enter and leave every frame, so nodes come from a pool.
+typedef std::map<int, TrackedFeature, std::less<int>,
+                 boost::fast_pool_allocator<std::pair<const int,
+                                                      TrackedFeature> > >
+        TrackedFeatureSet;
+
+// Keypoints [begin, end) of a seed, tracked in one direction.
+// Writes only to those tracks, so that legs can advance in parallel.
+struct Leg {
+  Seed* seed;
+  int begin;
+  int end;
+  TrackList<SiftPosition>* tracks;
   TrackedFeatureSet active;
+};
 
-  while (ok && (max_duration < 0 || duration < max_duration)) {
-    // Load image.
-    std::string file = makeFilename(image_format, time);
-    ok = readImage(file, color_image, integer_image);
-    if (!ok) {
-      // Assume that this function only fails at the end of the sequence.
-      continue;
+// Solver statistics of each frame, merged from every leg tracking into it.
+struct FrameHistograms {
+  boost::mutex mutex;
+  std::vector<FlowHistogram> frames;
+};
+
+// Extracts a patch for each keypoint of a leg in its seed frame.
+void startLeg(Leg& leg,
+              const Frame& frame,
+              int width,
+              const FlowOptions& options) {
+  const std::vector<SimilarityWarp>& warps = leg.seed->warps;
+
+  for (int i = leg.begin; i < leg.end; i += 1) {
+    // Extract patch.
+    cv::Mat patch;
+    samplePatch(warps[i], frame.image, patch, width, false,
+        options.interpolation);
+
+    // Insert into active set.
+    TrackedFeature& feature = (leg.active[i] = TrackedFeature());
+
+    // Copy warp parameters.
+    feature.warp = warps[i];
+    // Copy into previous patch.
+    feature.previous_patch = patch.clone();
+    // Transfer ownership to set initial patch (using shared pointer).
+    std::swap(feature.initial_patch, patch);
+  }
+}
+
+// Tracks the active features of a leg into the next frame.
+// Solver statistics are collected if histogram is not NULL.
+void advanceLeg(Leg& leg,
+                const Frame& frame,
+                int width,
+                const cv::Mat& mask,
+                const FlowOptions& options,
+                FlowHistogram* histogram) {
+  const cv::Mat& image = frame.image;
+
+  TrackedFeatureSet::iterator it = leg.active.begin();
+  while (it != leg.active.end()) {
+    TrackedFeature& feature = it->second;
+
+    const cv::Mat* reference;
+    if (UPDATE_TEMPLATE) {
+      reference = &feature.previous_patch;
+    } else {
+      reference = &feature.initial_patch;
     }
 
-    // Convert to floating point.
-    integer_image.convertTo(image, cv::DataType<double>::type, 1. / 255.);
-
-    if (duration == 0) {
-      // First frame. Extract a patch for each feature.
-      for (int i = 0; i < num_keypoints; i += 1) {
-        // Extract patch.
-        cv::Mat patch;
-        samplePatch(warps[i], image, patch, width, false,
-            options.interpolation);
-
-        // Insert into active set.
-        TrackedFeature& feature = (active[i] = TrackedFeature());
-
-        // Copy warp parameters.
-        feature.warp = warps[i];
-        // Copy into previous patch.
-        feature.previous_patch = patch.clone();
-        // Transfer ownership to set initial patch (using shared pointer).
-        std::swap(feature.initial_patch, patch);
+    // Track the patch.
+    FlowStatistics statistics;
+    bool tracked = trackPatch(feature.warp, *reference, image, frame.ddx,
+        frame.ddy, mask, options, (histogram != NULL) ? &statistics : NULL);
+
+    if (tracked) {
+      // Sample patch for appearance check and/or template update.
+      cv::Mat patch;
+      samplePatch(feature.warp, image, patch, width, false,
+          options.interpolation);
+
+      // Do appearance check.
+      double residual = patchResidual(patch, feature.initial_patch, mask);
+      if (residual > MAX_RESIDUAL) {
+        DLOG(INFO) << "Appearance residual too large (" << residual <<
+            " > " << MAX_RESIDUAL << ")";
+        tracked = false;
+        statistics.termination = FLOW_APPEARANCE_REJECTED;
       }
-    } else {
-      // Not first frame. Track!
-
-      // Compute gradients.
-      cv::Mat ddx;
-      cv::Mat ddy;
-      cv::Mat diff = (cv::Mat_<double>(1, 3) << -0.5, 0, 0.5);
-      cv::Mat identity = (cv::Mat_<double>(1, 1) << 1);
-      cv::sepFilter2D(image, ddx, -1, diff, identity);
-      cv::sepFilter2D(image, ddy, -1, identity, diff);
-
-      // Try to track each active feature.
-      TrackedFeatureSet::iterator it = active.begin();
-      while (it != active.end()) {
-        TrackedFeature& feature = it->second;
-
-        const cv::Mat* reference;
-        if (UPDATE_TEMPLATE) {
-          reference = &feature.previous_patch;
-        } else {
-          reference = &feature.initial_patch;
-        }
 
-        // Track the patch.
-        bool tracked = trackPatch(feature.warp, *reference, image, ddx, ddy,
-            mask, options);
-
-        if (tracked) {
-          // Sample patch for appearance check and/or template update.
-          cv::Mat patch;
-          samplePatch(feature.warp, image, patch, width, false,
-              options.interpolation);
-
-          // Do appearance check.
-          double residual = patchResidual(patch, feature.initial_patch, mask);
-          if (residual > MAX_RESIDUAL) {
-            DLOG(INFO) << "Appearance residual too large (" << residual <<
-                " > " << MAX_RESIDUAL << ")";
-            tracked = false;
-          }
-
-          // Update appearance.
-          std::swap(feature.previous_patch, patch);
-        }
+      // Update appearance.
+      std::swap(feature.previous_patch, patch);
+    }
+
+    if (histogram != NULL) {
+      histogram->add(statistics);
+    }
+
+    if (!tracked) {
+      // Remove.
+      leg.active.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
 
-        if (!tracked) {
-          // Remove.
-          active.erase(it++);
-        } else {
-          // Update previous appearance.
-          ++it;
+// Starts or advances each of a set of legs in one frame, then adds their
+// features to the tracks. For use with ThreadPool::parallelFor().
+class StepLegFunction {
+  public:
+    StepLegFunction(const std::vector<Leg*>& legs,
+                    const Frame& frame,
+                    int time,
+                    int width,
+                    const cv::Mat& mask,
+                    const FlowOptions& options,
+                    FrameHistograms* histograms)
+        : legs_(&legs),
+          frame_(&frame),
+          time_(time),
+          width_(width),
+          mask_(&mask),
+          options_(&options),
+          histograms_(histograms) {}
+
+    void operator()(int i) const {
+      Leg& leg = *(*legs_)[i];
+
+      if (leg.seed->time == time_) {
+        startLeg(leg, *frame_, width_, *options_);
+      } else {
+        FlowHistogram histogram;
+        advanceLeg(leg, *frame_, width_, *mask_, *options_,
+            (histograms_ != NULL) ? &histogram : NULL);
+
+        if (histograms_ != NULL) {
+          boost::mutex::scoped_lock lock(histograms_->mutex);
+          histograms_->frames[time_].add(histogram);
         }
       }
 
-      LOG(INFO) << "Tracked " << active.size() << " features into frame " <<
-        (duration + 1);
+      // Add each feature to the list of tracks.
+      TrackedFeatureSet::const_iterator it;
+      for (it = leg.active.begin(); it != leg.active.end(); ++it) {
+        (*leg.tracks)[it->first][time_] =
+            extractSiftPositionFromWarp(it->second.warp);
+      }
     }
 
-    // Add each feature to the list of tracks.
-    TrackedFeatureSet::const_iterator it;
-    for (it = active.begin(); it != active.end(); ++it) {
-      int id = it->first;
-      const TrackedFeature& feature = it->second;
+  private:
+    const std::vector<Leg*>* legs_;
+    const Frame* frame_;
+    int time_;
+    int width_;
+    const cv::Mat* mask_;
+    const FlowOptions* options_;
+    FrameHistograms* histograms_;
+};
+
+// Does the leg have work to do in this frame?
+bool legIsLive(const Leg& leg, int time, bool reverse, int max_duration) {
+  int duration = reverse ? leg.seed->time - time : time - leg.seed->time;
+  if (duration < 0) {
+    // Not yet started.
+    return false;
+  }
+  if (max_duration >= 0 && duration >= max_duration) {
+    return false;
+  }
+  return duration == 0 || !leg.active.empty();
+}
 
-      tracks[id][time] = extractSiftPositionFromWarp(feature.warp);
+// Tracks every seed through the sequence in one direction.
+// Frames are visited in order and only one is held in memory at a time,
+// so that memory does not grow with the length of the sequence.
+void sweep(std::vector<Seed>& seeds,
+           bool reverse,
+           const std::string& image_format,
+           const PlaneCache& cache,
+           int num_frames,
+           int radius,
+           const cv::Mat& mask,
+           const FlowOptions& options,
+           int max_duration,
+           FrameHistograms* histograms,
+           ThreadPool& pool) {
+  int width = 2 * radius + 1;
+
+  // Split the keypoints of every seed into legs.
+  std::list<Leg> legs;
+  std::vector<Seed>::iterator seed;
+  for (seed = seeds.begin(); seed != seeds.end(); ++seed) {
+    int num_features = seed->warps.size();
+    for (int begin = 0; begin < num_features; begin += KEYPOINTS_PER_TASK) {
+      legs.push_back(Leg());
+      Leg& leg = legs.back();
+      leg.seed = &*seed;
+      leg.begin = begin;
+      leg.end = std::min(begin + KEYPOINTS_PER_TASK, num_features);
+      leg.tracks = reverse ? &seed->reverse_tracks : &seed->forward_tracks;
     }
+  }
 
-    if (reverse) {
-      time -= 1;
-    } else {
-      time += 1;
+  int num_loaded = 0;
+  for (int i = 0; i < num_frames; i += 1) {
+    int time = reverse ? num_frames - 1 - i : i;
+
+    std::vector<Leg*> live;
+    std::list<Leg>::iterator leg = legs.begin();
+    while (leg != legs.end()) {
+      bool started = reverse ? leg->seed->time >= time :
+          leg->seed->time <= time;
+      if (legIsLive(*leg, time, reverse, max_duration)) {
+        live.push_back(&*leg);
+        ++leg;
+      } else if (started) {
+        // Finished, release its patches.
+        legs.erase(leg++);
+      } else {
+        ++leg;
+      }
+    }
+    if (live.empty()) {
+      continue;
+    }
+
+    Frame frame;
+    bool ok = loadFrame(image_format, time, cache, frame);
+    CHECK(ok) << "Could not load frame " << time;
+    num_loaded += 1;
+
+    if (!reverse) {
+      for (seed = seeds.begin(); seed != seeds.end(); ++seed) {
+        if (seed->time == time) {
+          checkSeed(*seed, frame.image.size(), radius);
+        }
+      }
     }
-    duration += 1;
+
+    pool.parallelFor(0, live.size(), StepLegFunction(live, frame, time,
+          width, mask, options, histograms));
   }
+
+  LOG(INFO) << "Tracked " << (reverse ? "backwards" : "forwards") <<
+      " through " << num_loaded << " frames";
+}
+
+// Merges the tracks in either direction and saves them.
+void saveSeed(const Seed& seed) {
+  int num_features = seed.warps.size();
+
+  TrackList<SiftPosition> tracks(num_features);
+  for (int i = 0; i < num_features; i += 1) {
+    Track<SiftPosition> track;
+    track.insert(seed.forward_tracks[i].begin(), seed.forward_tracks[i].end());
+    track.insert(seed.reverse_tracks[i].begin(), seed.reverse_tracks[i].end());
+    tracks[i].swap(track);
+  }
+
+  SiftPositionWriter feature_writer;
+  bool ok = saveTrackList(seed.tracks_file, tracks, feature_writer);
+  CHECK(ok) << "Could not save tracks";
 }
 
 int main(int argc, char** argv) {
   init(argc, argv);
 
   std::string image_format = argv[1];
-  int frame_number = boost::lexical_cast<int>(argv[2]);
-  std::string keypoints_file = argv[3];
-  std::string tracks_file = argv[4];
-
   const int DIAMETER = FLAGS_radius * 2 + 1;
 
-  // Load initial keypoints (x, y, size, theta).
-  std::vector<SiftPosition> keypoints;
-  SiftPositionReader feature_reader;
-  bool ok = loadList(keypoints_file, keypoints, feature_reader);
-  CHECK(ok) << "Could not load keypoints";
-
-  int num_features = keypoints.size();
-  LOG(INFO) << "Loaded " << num_features << " keypoints";
-
-  // Convert each SIFT feature to a tracking feature.
-  typedef std::vector<SimilarityWarp> WarpList;
-  WarpList warps;
-
   // Construct similarity warp cost function.
   SimilarityWarper::CostFunction cost_function(new SimilarityWarpFunction());
   SimilarityWarper warper(cost_function, FLAGS_min_scale);
 
-  std::vector<SiftPosition>::const_iterator keypoint;
-  for (keypoint = keypoints.begin(); keypoint != keypoints.end(); ++keypoint) {
-    // Convert to a warp.
-    SimilarityWarp warp = constructWarpFromSiftPosition(*keypoint, warper);
-    warps.push_back(warp);
+  int num_frames = countFrameFiles(image_format);
+  CHECK(num_frames > 0) << "Could not find first frame";
+
+  // Find the frames to track from.
+  std::vector<Seed> seeds;
+  if (FLAGS_all_frames) {
+    std::string keypoints_format = argv[2];
+    std::string tracks_format = argv[3];
+
+    for (int t = 0; t < num_frames; t += 1) {
+      std::string keypoints_file = makeFilename(keypoints_format, t);
+      if (fileExists(keypoints_file)) {
+        seeds.push_back(Seed());
+        seeds.back().time = t;
+        seeds.back().tracks_file = makeFilename(tracks_format, t);
+        loadSeed(keypoints_file, warper, seeds.back());
+      }
+    }
+  } else {
+    seeds.push_back(Seed());
+    seeds.back().time = boost::lexical_cast<int>(argv[2]);
+    seeds.back().tracks_file = argv[4];
+    loadSeed(argv[3], warper, seeds.back());
   }
 
-  // Read one image to get size.
-  cv::Size size;
-  {
-    std::string file = makeFilename(image_format, 0);
-    cv::Mat color_image;
-    cv::Mat gray_image;
-    ok = readImage(file, color_image, gray_image);
-    CHECK(ok) << "Could not determine image size from first frame";
-    size = color_image.size();
+  ThreadPool pool(FLAGS_num_threads);
+  std::vector<Seed>::iterator seed;
+  for (seed = seeds.begin(); seed != seeds.end(); ++seed) {
+    CHECK(seed->time >= 0 && seed->time < num_frames) <<
+      "Frame " << seed->time << " is not in the sequence";
   }
+  PlaneCache cache(FLAGS_plane_cache);
 
   // Linear solver options.
   FlowOptions options;
+  options.engine = CERES_FLOW_ENGINE;
   options.solver_options.linear_solver_type = ceres::DENSE_QR;
   options.solver_options.max_num_iterations = MAX_NUM_ITERATIONS;
   options.solver_options.function_tolerance = FUNCTION_TOLERANCE;
   options.solver_options.gradient_tolerance = GRADIENT_TOLERANCE;
   options.solver_options.parameter_tolerance = PARAMETER_TOLERANCE;
   options.check_condition = CHECK_CONDITION;
+  options.condition_from_normal_equations = true;
   options.max_condition = MAX_CONDITION;
   options.iteration_limit_is_fatal = ITERATION_LIMIT_IS_FATAL;
   options.interpolation = cv::INTER_AREA;
   // Construct mask.
   cv::Mat mask = makeGaussian(MASK_SIGMA, DIAMETER);
 
-  // Check whether any of the features are initialized as invalid.
-  // This warrants a warning.
-  WarpList valid;
-  for (int i = 0; i < num_features; i += 1) {
-    if (warps[i].isValid(size, FLAGS_radius)) {
-      valid.push_back(warps[i]);
+  // Track forwards and backwards from every seed.
+  FrameHistograms histograms;
+  histograms.frames.resize(num_frames);
+  FrameHistograms* histograms_ptr =
+      FLAGS_solver_statistics ? &histograms : NULL;
+  sweep(seeds, false, image_format, cache, num_frames, FLAGS_radius, mask,
+      options, FLAGS_max_frames, histograms_ptr, pool);
+  sweep(seeds, true, image_format, cache, num_frames, FLAGS_radius, mask,
+      options, FLAGS_max_frames, histograms_ptr, pool);
+
+  if (FLAGS_solver_statistics) {
+    FlowHistogram total;
+    for (int t = 0; t < num_frames; t += 1) {
+      const FlowHistogram& histogram = histograms.frames[t];
+      if (histogram.count() > 0) {
+        std::ostringstream line;
+        histogram.writeLine(line);
+        LOG(INFO) << "Frame " << t << ": " << line.str();
+      }
+      total.add(histogram);
     }
-  }
 
-  int num_valid = valid.size();
-  int num_invalid = num_features - num_valid;
-  if (num_invalid > 0) {
-    LOG(WARNING) << "Some features were invalid to track (" << num_invalid <<
-        " / " << num_features << ")";
+    std::ostringstream summary;
+    total.write(summary);
+    LOG(INFO) << "Solver statistics:" << std::endl << summary.str();
   }
-  //warp_params.swap(valid);
-  //num_features = num_valid;
-
-  // Track forwards.
-  TrackList<SiftPosition> forward_tracks;
-  trackFeatures(warps, forward_tracks, DIAMETER, mask, image_format,
-      frame_number, options, FLAGS_max_frames, false);
-
-  // Track backwards.
-  TrackList<SiftPosition> reverse_tracks;
-  trackFeatures(warps, reverse_tracks, DIAMETER, mask, image_format,
-      frame_number, options, FLAGS_max_frames, true);
 
-  // Merge tracks.
-  TrackList<SiftPosition> tracks(num_features);
-  for (int i = 0; i < num_features; i += 1) {
-    Track<SiftPosition> track;
-    track.insert(forward_tracks[i].begin(), forward_tracks[i].end());
-    track.insert(reverse_tracks[i].begin(), reverse_tracks[i].end());
-    tracks[i].swap(track);
+  for (seed = seeds.begin(); seed != seeds.end(); ++seed) {
+    saveSeed(*seed);
   }
 
-  SiftPositionWriter feature_writer;
-  ok = saveTrackList(tracks_file, tracks, feature_writer);
-  CHECK(ok) << "Could not save tracks";
-
   return 0;
 }
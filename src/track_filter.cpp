@@ -0,0 +1,183 @@
+#include "track_filter.hpp"
+
+namespace {
+
+// Sums the (x, y) distance and the number of frames between consecutive
+// points.
+void pathLength(const TrackView<SiftPosition>& track,
+                double& distance,
+                int& duration) {
+  distance = 0;
+  duration = 0;
+
+  TrackView<SiftPosition>::const_iterator point;
+  for (point = track.begin(); point != track.end(); ++point) {
+    // If this is the first point, we have no previous measurement.
+    if (point != track.begin()) {
+      TrackView<SiftPosition>::const_iterator previous = point - 1;
+      cv::Point2d step(point->second.x - previous->second.x,
+                       point->second.y - previous->second.y);
+      distance += cv::norm(step);
+      duration += point->first - previous->first;
+    }
+  }
+}
+
+}
+
+MinLengthPredicate::MinLengthPredicate(int min_length)
+    : min_length_(min_length) {}
+
+bool MinLengthPredicate::accept(const TrackView<SiftPosition>& track) const {
+  if (track.empty()) {
+    return false;
+  }
+  int length = track.rbegin()->first - track.begin()->first + 1;
+  return length >= min_length_;
+}
+
+MinAverageStepPredicate::MinAverageStepPredicate(double min_step)
+    : min_step_(min_step) {}
+
+bool MinAverageStepPredicate::accept(
+    const TrackView<SiftPosition>& track) const {
+  if (track.size() < 2) {
+    return false;
+  }
+
+  double distance;
+  int duration;
+  pathLength(track, distance, duration);
+  // Steps are counted between points, not frames.
+  return distance / (track.size() - 1) >= min_step_;
+}
+
+InsideBoxPredicate::InsideBoxPredicate(const cv::Rect_<double>& box)
+    : box_(box) {}
+
+bool InsideBoxPredicate::accept(const TrackView<SiftPosition>& track) const {
+  TrackView<SiftPosition>::const_iterator point;
+  for (point = track.begin(); point != track.end(); ++point) {
+    if (!box_.contains(cv::Point2d(point->second.x, point->second.y))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+MinViewsPredicate::MinViewsPredicate(int min_views) : min_views_(min_views) {}
+
+bool MinViewsPredicate::accept(
+    const MultiviewTrackView<SiftPosition>& track) const {
+  return track.numViewsPresent() >= min_views_;
+}
+
+MultiviewMinAverageStepPredicate::MultiviewMinAverageStepPredicate(
+    double min_step)
+    : min_step_(min_step) {}
+
+bool MultiviewMinAverageStepPredicate::accept(
+    const MultiviewTrackView<SiftPosition>& track) const {
+  double total_distance = 0;
+  int total_duration = 0;
+
+  for (int view = 0; view < track.numViews(); view += 1) {
+    double distance;
+    int duration;
+    pathLength(track.view(view), distance, duration);
+
+    total_distance += distance;
+    total_duration += duration;
+  }
+
+  if (total_duration == 0) {
+    return false;
+  }
+  return total_distance / total_duration >= min_step_;
+}
+
+EachViewPredicate::EachViewPredicate(const TrackPredicate& predicate)
+    : predicate_(&predicate) {}
+
+bool EachViewPredicate::accept(
+    const MultiviewTrackView<SiftPosition>& track) const {
+  for (int view = 0; view < track.numViews(); view += 1) {
+    TrackView<SiftPosition> points = track.view(view);
+    if (!points.empty() && !predicate_->accept(points)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+TrackFilter::TrackFilter() : predicates_() {}
+
+void TrackFilter::add(const TrackPredicate& predicate) {
+  predicates_.push_back(&predicate);
+}
+
+bool TrackFilter::accept(const TrackView<SiftPosition>& track) const {
+  std::vector<const TrackPredicate*>::const_iterator predicate;
+  for (predicate = predicates_.begin(); predicate != predicates_.end();
+      ++predicate) {
+    if (!(*predicate)->accept(track)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+MultiviewTrackFilter::MultiviewTrackFilter() : predicates_() {}
+
+void MultiviewTrackFilter::add(const MultiviewTrackPredicate& predicate) {
+  predicates_.push_back(&predicate);
+}
+
+bool MultiviewTrackFilter::accept(
+    const MultiviewTrackView<SiftPosition>& track) const {
+  std::vector<const MultiviewTrackPredicate*>::const_iterator predicate;
+  for (predicate = predicates_.begin(); predicate != predicates_.end();
+      ++predicate) {
+    if (!(*predicate)->accept(track)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int filterTracks(const TrackListView<SiftPosition>& input,
+                 const TrackFilter& filter,
+                 TrackList<SiftPosition>& output) {
+  output.clear();
+
+  for (int i = 0; i < input.size(); i += 1) {
+    TrackView<SiftPosition> track = input[i];
+    if (filter.accept(track)) {
+      output.push_back(Track<SiftPosition>());
+      track.copyTo(output.back());
+    }
+  }
+
+  return output.size();
+}
+
+int filterMultiviewTracks(const MultiviewTrackListView<SiftPosition>& input,
+                          const MultiviewTrackFilter& filter,
+                          MultiviewTrackList<SiftPosition>& output) {
+  output = MultiviewTrackList<SiftPosition>(input.numViews());
+
+  for (int i = 0; i < input.numTracks(); i += 1) {
+    MultiviewTrackView<SiftPosition> track = input.track(i);
+    if (filter.accept(track)) {
+      MultiviewTrack<SiftPosition> copy;
+      track.copyTo(copy);
+      output.push_back(copy);
+    }
+  }
+
+  return output.numTracks();
+}
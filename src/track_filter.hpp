@@ -0,0 +1,126 @@
+#ifndef TRACK_FILTER_HPP_
+#define TRACK_FILTER_HPP_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "sift_position.hpp"
+#include "track_list.hpp"
+#include "track_list_view.hpp"
+#include "multiview_track_list.hpp"
+#include "multiview_track_list_view.hpp"
+
+// Decides whether to keep a track.
+class TrackPredicate {
+  public:
+    virtual ~TrackPredicate() {}
+    virtual bool accept(const TrackView<SiftPosition>& track) const = 0;
+};
+
+// Decides whether to keep a multiview track.
+class MultiviewTrackPredicate {
+  public:
+    virtual ~MultiviewTrackPredicate() {}
+    virtual bool accept(const MultiviewTrackView<SiftPosition>& track) const = 0;
+};
+
+// Keeps tracks which span at least a number of frames, as select-long-tracks
+// does with a threshold.
+class MinLengthPredicate : public TrackPredicate {
+  public:
+    explicit MinLengthPredicate(int min_length);
+    bool accept(const TrackView<SiftPosition>& track) const;
+
+  private:
+    int min_length_;
+};
+
+// Keeps tracks whose average (x, y) step between points is at least a
+// distance, as select-active-tracks does with a threshold. Tracks with fewer
+// than two points are rejected.
+class MinAverageStepPredicate : public TrackPredicate {
+  public:
+    explicit MinAverageStepPredicate(double min_step);
+    bool accept(const TrackView<SiftPosition>& track) const;
+
+  private:
+    double min_step_;
+};
+
+// Keeps tracks which never leave a box.
+class InsideBoxPredicate : public TrackPredicate {
+  public:
+    explicit InsideBoxPredicate(const cv::Rect_<double>& box);
+    bool accept(const TrackView<SiftPosition>& track) const;
+
+  private:
+    cv::Rect_<double> box_;
+};
+
+// Keeps multiview tracks which are present in at least a number of views.
+class MinViewsPredicate : public MultiviewTrackPredicate {
+  public:
+    explicit MinViewsPredicate(int min_views);
+    bool accept(const MultiviewTrackView<SiftPosition>& track) const;
+
+  private:
+    int min_views_;
+};
+
+// Keeps multiview tracks whose average step over all views is at least a
+// distance, as select-active-multiview-tracks does with a threshold.
+class MultiviewMinAverageStepPredicate : public MultiviewTrackPredicate {
+  public:
+    explicit MultiviewMinAverageStepPredicate(double min_step);
+    bool accept(const MultiviewTrackView<SiftPosition>& track) const;
+
+  private:
+    double min_step_;
+};
+
+// Applies a single-view predicate to every view in which a multiview track is
+// present. Does not own the predicate.
+class EachViewPredicate : public MultiviewTrackPredicate {
+  public:
+    explicit EachViewPredicate(const TrackPredicate& predicate);
+    bool accept(const MultiviewTrackView<SiftPosition>& track) const;
+
+  private:
+    const TrackPredicate* predicate_;
+};
+
+// Keeps the tracks which every predicate accepts, testing them in the order
+// they were added. Filters are themselves predicates, so they can be nested.
+// Does not own the predicates.
+class TrackFilter : public TrackPredicate {
+  public:
+    TrackFilter();
+
+    void add(const TrackPredicate& predicate);
+    bool accept(const TrackView<SiftPosition>& track) const;
+
+  private:
+    std::vector<const TrackPredicate*> predicates_;
+};
+
+class MultiviewTrackFilter : public MultiviewTrackPredicate {
+  public:
+    MultiviewTrackFilter();
+
+    void add(const MultiviewTrackPredicate& predicate);
+    bool accept(const MultiviewTrackView<SiftPosition>& track) const;
+
+  private:
+    std::vector<const MultiviewTrackPredicate*> predicates_;
+};
+
+// Copies the accepted tracks in one pass over the input, which may be mapped
+// from a binary file. Returns the number of tracks kept.
+int filterTracks(const TrackListView<SiftPosition>& input,
+                 const TrackFilter& filter,
+                 TrackList<SiftPosition>& output);
+
+int filterMultiviewTracks(const MultiviewTrackListView<SiftPosition>& input,
+                          const MultiviewTrackFilter& filter,
+                          MultiviewTrackList<SiftPosition>& output);
+
+#endif
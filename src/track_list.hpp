@@ -3,6 +3,7 @@
 
 #include <deque>
 #include "track.hpp"
+#include "frame_interval_index.hpp"
 #include <map>
 
 // List of features which each has some value at a small subset of frames.
@@ -62,6 +63,13 @@ class TrackList {
 template<class T>
 void swap(TrackList<T>& lhs, TrackList<T>& rhs);
 
+// Indexes each track by the interval from its first to last frame, to find
+// the tracks which are active at a frame or in a window.
+// Removing points from the tracks afterwards only shrinks the intervals, so
+// the index still finds a superset of the active tracks.
+template<class T>
+void indexTrackIntervals(const TrackList<T>& tracks, FrameIntervalIndex& index);
+
 ////////////////////////////////////////////////////////////////////////////////
 
 // Iterates through a list of tracks one frame at a time.
@@ -129,6 +129,26 @@ typename TrackList<T>::const_iterator TrackList<T>::end() const {
   return list_.end();
 }
 
+template<class T>
+void indexTrackIntervals(const TrackList<T>& tracks, FrameIntervalIndex& index) {
+  std::vector<int> first;
+  std::vector<int> last;
+
+  typename TrackList<T>::const_iterator track;
+  for (track = tracks.begin(); track != tracks.end(); ++track) {
+    if (track->empty()) {
+      // Empty interval.
+      first.push_back(0);
+      last.push_back(-1);
+    } else {
+      first.push_back(track->begin()->first);
+      last.push_back(track->rbegin()->first);
+    }
+  }
+
+  index.init(first, last);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // TrackListTimeIterator
 
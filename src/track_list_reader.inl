@@ -1,5 +1,7 @@
 #include "track_reader.hpp"
 #include "iterator_reader.hpp"
+#include "sequence_sink.hpp"
+#include "yaml_sequence_stream.hpp"
 
 template<class T>
 TrackListReader<T>::TrackListReader(Reader<T>& reader)
@@ -10,15 +12,20 @@ TrackListReader<T>::~TrackListReader() {}
 
 template<class T>
 bool TrackListReader<T>::read(const cv::FileNode& node, TrackList<T>& tracks) {
-  tracks = TrackList<T>();
+  tracks.clear();
   TrackReader<T> track_reader(*reader_);
-  return readSequence(node, track_reader, std::back_inserter(tracks));
+  ContainerSink<Track<T>, TrackList<T> > sink(tracks);
+  return readSequenceToSink(node, track_reader, sink);
 }
 
 template<class T>
 bool loadTrackList(const std::string& filename,
                    TrackList<T>& tracks,
                    Reader<T>& reader) {
-  TrackListReader<T> list_reader(reader);
-  return load(filename, tracks, list_reader);
+  // Read a few tracks at a time rather than parsing the whole file.
+  tracks.clear();
+  TrackReader<T> track_reader(reader);
+  ContainerSink<Track<T>, TrackList<T> > sink(tracks);
+  return streamSequence(filename, std::vector<std::string>(), track_reader,
+      sink);
 }
@@ -0,0 +1,301 @@
+#include "tracking/track-list-stream.hpp"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "gtest/gtest.h"
+
+using tracking::TrackList;
+
+namespace {
+
+void addPoint(TrackList::Frame& frame, int id, double x, double y) {
+  TrackList::Point* point = frame.add_points();
+  point->set_id(id);
+  point->set_x(x);
+  point->set_y(y);
+}
+
+void addPoint(TrackList::Frame& frame,
+              int id,
+              double x,
+              double y,
+              double scale,
+              double angle) {
+  addPoint(frame, id, x, y);
+  TrackList::Point* point = frame.mutable_points(frame.points_size() - 1);
+  point->set_scale(scale);
+  point->set_angle(angle);
+}
+
+// Frame with every field set, whose IDs go down as well as up.
+TrackList::Frame makeFrame(int seed) {
+  TrackList::Frame frame;
+  addPoint(frame, seed + 3, 1280.25, 0.1, 2.5, -3.1);
+  addPoint(frame, seed + 100000, 0, 719.875, 1, 0);
+  addPoint(frame, seed, -1.5, 1e-3, 0.3, 1.7);
+  return frame;
+}
+
+// Expects the same points to within single precision.
+void expectNearFrame(const TrackList::Frame& expected,
+                     const TrackList::Frame& actual) {
+  ASSERT_EQ(expected.points_size(), actual.points_size());
+  for (int i = 0; i < expected.points_size(); i += 1) {
+    const TrackList::Point& a = expected.points(i);
+    const TrackList::Point& b = actual.points(i);
+    EXPECT_EQ(a.id(), b.id());
+    EXPECT_EQ(float(a.x()), b.x());
+    EXPECT_EQ(float(a.y()), b.y());
+    EXPECT_EQ(a.has_scale(), b.has_scale());
+    EXPECT_EQ(float(a.scale()), float(b.scale()));
+    EXPECT_EQ(a.has_angle(), b.has_angle());
+    EXPECT_EQ(float(a.angle()), float(b.angle()));
+  }
+}
+
+// Track list file in a fresh temporary directory, removed with the fixture.
+class TrackListStreamTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      char directory[] = "/tmp/track-list-stream-XXXXXX";
+      ASSERT_TRUE(mkdtemp(directory) != NULL);
+      directory_ = directory;
+      filename_ = directory_ + "/tracks.pb";
+    }
+
+    virtual void TearDown() {
+      std::remove(filename_.c_str());
+      rmdir(directory_.c_str());
+    }
+
+    // Writes the frames one at a time.
+    void writeFrames(const std::vector<TrackList::Frame>& frames,
+                     bool packed) {
+      tracking::TrackListStreamWriter writer(packed);
+      ASSERT_TRUE(writer.open(filename_));
+      for (int t = 0; t < int(frames.size()); t += 1) {
+        ASSERT_TRUE(writer.write(frames[t]));
+      }
+      writer.close();
+    }
+
+    // Reads every frame of the file.
+    void readFrames(std::vector<TrackList::Frame>& frames) {
+      frames.clear();
+      tracking::TrackListStreamReader reader;
+      ASSERT_TRUE(reader.open(filename_));
+      TrackList::Frame frame;
+      while (reader.read(frame)) {
+        frames.push_back(frame);
+      }
+      reader.close();
+    }
+
+    std::string directory_;
+    std::string filename_;
+};
+
+}
+
+TEST(PackFrame, RoundTripsEveryField) {
+  TrackList::Frame frame = makeFrame(7);
+  TrackList::PackedFrame packed;
+  tracking::packFrame(frame, packed);
+  EXPECT_EQ(3, packed.id_deltas_size());
+  EXPECT_EQ(3, packed.scale_size());
+  EXPECT_EQ(3, packed.angle_size());
+  // Deltas from the previous ID, and of the first from zero.
+  EXPECT_EQ(10, packed.id_deltas(0));
+  EXPECT_EQ(100000 - 3, packed.id_deltas(1));
+  EXPECT_EQ(-100000, packed.id_deltas(2));
+
+  TrackList::Frame unpacked;
+  ASSERT_TRUE(tracking::unpackFrame(packed, unpacked));
+  expectNearFrame(frame, unpacked);
+}
+
+TEST(PackFrame, DropsScalesAndAnglesUnlessEveryPointHasThem) {
+  TrackList::Frame frame;
+  addPoint(frame, 1, 10, 20, 2, 0.5);
+  addPoint(frame, 2, 30, 40);
+  TrackList::PackedFrame packed;
+  tracking::packFrame(frame, packed);
+  EXPECT_EQ(0, packed.scale_size());
+  EXPECT_EQ(0, packed.angle_size());
+
+  TrackList::Frame unpacked;
+  ASSERT_TRUE(tracking::unpackFrame(packed, unpacked));
+  ASSERT_EQ(2, unpacked.points_size());
+  EXPECT_FALSE(unpacked.points(0).has_scale());
+  EXPECT_FALSE(unpacked.points(0).has_angle());
+  EXPECT_EQ(30, unpacked.points(1).x());
+}
+
+TEST(PackFrame, RoundTripsEmptyFrame) {
+  TrackList::Frame frame;
+  TrackList::PackedFrame packed;
+  tracking::packFrame(frame, packed);
+  TrackList::Frame unpacked;
+  ASSERT_TRUE(tracking::unpackFrame(packed, unpacked));
+  EXPECT_EQ(0, unpacked.points_size());
+}
+
+TEST(PackFrame, RejectsArraysOfDifferentLengths) {
+  TrackList::PackedFrame packed;
+  tracking::packFrame(makeFrame(0), packed);
+  packed.mutable_y()->RemoveLast();
+  TrackList::Frame frame;
+  EXPECT_FALSE(tracking::unpackFrame(packed, frame));
+
+  tracking::packFrame(makeFrame(0), packed);
+  packed.add_angle(0);
+  EXPECT_FALSE(tracking::unpackFrame(packed, frame));
+}
+
+TEST(PackTrackList, RoundTripsWholeList) {
+  TrackList tracks;
+  for (int t = 0; t < 4; t += 1) {
+    *tracks.add_frames() = makeFrame(t);
+  }
+  tracks.add_frames();
+  TrackList expected = tracks;
+
+  tracking::packTrackList(tracks);
+  EXPECT_EQ(0, tracks.frames_size());
+  EXPECT_EQ(5, tracks.packed_frames_size());
+
+  ASSERT_TRUE(tracking::unpackTrackList(tracks));
+  EXPECT_EQ(0, tracks.packed_frames_size());
+  ASSERT_EQ(expected.frames_size(), tracks.frames_size());
+  for (int t = 0; t < tracks.frames_size(); t += 1) {
+    expectNearFrame(expected.frames(t), tracks.frames(t));
+  }
+}
+
+TEST_F(TrackListStreamTest, ReadsWhatWasWritten) {
+  std::vector<TrackList::Frame> frames;
+  for (int t = 0; t < 3; t += 1) {
+    frames.push_back(makeFrame(t));
+  }
+  frames.push_back(TrackList::Frame());
+
+  for (int packed = 0; packed < 2; packed += 1) {
+    writeFrames(frames, packed);
+    std::vector<TrackList::Frame> read;
+    readFrames(read);
+    ASSERT_EQ(frames.size(), read.size()) << "Packed " << packed;
+    for (int t = 0; t < int(frames.size()); t += 1) {
+      expectNearFrame(frames[t], read[t]);
+    }
+  }
+}
+
+TEST_F(TrackListStreamTest, StreamIsSerializedTrackList) {
+  std::vector<TrackList::Frame> frames;
+  frames.push_back(makeFrame(0));
+  frames.push_back(makeFrame(1));
+
+  for (int packed = 0; packed < 2; packed += 1) {
+    writeFrames(frames, packed);
+    TrackList tracks;
+    {
+      std::ifstream file(filename_.c_str(), std::ios::binary);
+      ASSERT_TRUE(tracks.ParseFromIstream(&file));
+    }
+    EXPECT_EQ(packed ? 0 : 2, tracks.frames_size());
+    EXPECT_EQ(packed ? 2 : 0, tracks.packed_frames_size());
+    ASSERT_TRUE(tracking::unpackTrackList(tracks));
+    ASSERT_EQ(2, tracks.frames_size());
+    expectNearFrame(frames[0], tracks.frames(0));
+    expectNearFrame(frames[1], tracks.frames(1));
+  }
+}
+
+TEST_F(TrackListStreamTest, ReadsWholeSerializedList) {
+  TrackList tracks;
+  *tracks.add_frames() = makeFrame(0);
+  *tracks.add_frames() = makeFrame(1);
+  {
+    std::ofstream file(filename_.c_str(), std::ios::binary);
+    ASSERT_TRUE(tracks.SerializeToOstream(&file));
+  }
+
+  std::vector<TrackList::Frame> read;
+  readFrames(read);
+  ASSERT_EQ(2u, read.size());
+  EXPECT_EQ(tracks.frames(0).SerializeAsString(), read[0].SerializeAsString());
+  EXPECT_EQ(tracks.frames(1).SerializeAsString(), read[1].SerializeAsString());
+}
+
+TEST_F(TrackListStreamTest, AsyncWriterWritesFramesInOrder) {
+  // More frames than buffers, so that each buffer is filled several times.
+  std::vector<TrackList::Frame> frames;
+  for (int t = 0; t < 20; t += 1) {
+    frames.push_back(makeFrame(t));
+    if (t % 3 == 0) {
+      addPoint(frames.back(), 200000 + t, t, -t);
+    }
+  }
+
+  for (int packed = 0; packed < 2; packed += 1) {
+    for (int depth = 1; depth <= 4; depth += 3) {
+      {
+        tracking::AsyncTrackListWriter writer(packed, depth);
+        ASSERT_TRUE(writer.open(filename_));
+        for (int t = 0; t < int(frames.size()); t += 1) {
+          TrackList::Frame* frame = writer.newFrame();
+          ASSERT_EQ(0, frame->points_size());
+          *frame = frames[t];
+          writer.write();
+        }
+        EXPECT_TRUE(writer.close());
+      }
+
+      std::vector<TrackList::Frame> read;
+      readFrames(read);
+      ASSERT_EQ(frames.size(), read.size()) << "Packed " << packed <<
+          ", depth " << depth;
+      for (int t = 0; t < int(frames.size()); t += 1) {
+        expectNearFrame(frames[t], read[t]);
+      }
+    }
+  }
+}
+
+TEST_F(TrackListStreamTest, AsyncWriterDropsUnfinishedFrame) {
+  {
+    tracking::AsyncTrackListWriter writer(false, 2);
+    ASSERT_TRUE(writer.open(filename_));
+    *writer.newFrame() = makeFrame(0);
+    writer.write();
+    *writer.newFrame() = makeFrame(1);
+    writer.write();
+    // Not written when the writer is destroyed.
+    *writer.newFrame() = makeFrame(2);
+  }
+
+  std::vector<TrackList::Frame> read;
+  readFrames(read);
+  ASSERT_EQ(2u, read.size());
+  expectNearFrame(makeFrame(0), read[0]);
+  expectNearFrame(makeFrame(1), read[1]);
+}
+
+TEST_F(TrackListStreamTest, AsyncWriterReportsErrors) {
+  tracking::AsyncTrackListWriter missing(false, 2);
+  EXPECT_FALSE(missing.open(directory_ + "/missing/tracks.pb"));
+
+  // Every write to this device fails.
+  if (!std::ifstream("/dev/full")) {
+    return;
+  }
+  tracking::AsyncTrackListWriter writer(false, 2);
+  ASSERT_TRUE(writer.open("/dev/full"));
+  for (int t = 0; t < 5; t += 1) {
+    *writer.newFrame() = makeFrame(t);
+    writer.write();
+  }
+  EXPECT_FALSE(writer.close());
+}
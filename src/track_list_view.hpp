@@ -0,0 +1,137 @@
+#ifndef TRACK_LIST_VIEW_HPP_
+#define TRACK_LIST_VIEW_HPP_
+
+#include <iterator>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include "track.hpp"
+#include "track_list.hpp"
+#include "binary_file.hpp"
+
+// One point of a track as it is stored in a binary file.
+// Members are named as in std::pair so that a pointer to a point can be used
+// like an iterator of Track<T>. The point is stored as it is laid out in
+// memory, so T must be plain data such as SiftPosition.
+template<class T>
+struct TrackViewPoint {
+  int32_t first;
+  int32_t padding;
+  T second;
+};
+
+// Read-only track whose points are contiguous and in order of frame.
+// Does not own its points.
+template<class T>
+class TrackView {
+  public:
+    typedef TrackViewPoint<T> value_type;
+    typedef const TrackViewPoint<T>* const_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    TrackView();
+    TrackView(const_iterator begin, const_iterator end);
+
+    // Binary search.
+    const_iterator find(int x) const;
+    const_iterator lower_bound(int x) const;
+
+    int size() const;
+    bool empty() const;
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_reverse_iterator rbegin() const;
+    const_reverse_iterator rend() const;
+
+    // Replaces the contents of a track.
+    void copyTo(Track<T>& track) const;
+
+  private:
+    const_iterator begin_;
+    const_iterator end_;
+};
+
+// Iterates through a track view. Mirrors TrackIterator.
+template<class T>
+class TrackViewIterator {
+  public:
+    TrackViewIterator();
+    explicit TrackViewIterator(const TrackView<T>& track);
+    TrackViewIterator(const TrackView<T>& track, int time);
+
+    void next();
+    void previous();
+
+    bool end() const;
+    bool begin() const;
+
+    const T& get() const;
+    int time() const;
+
+  private:
+    typedef typename TrackView<T>::const_iterator Position;
+
+    TrackView<T> track_;
+    Position position_;
+};
+
+// Read-only list of tracks, stored as one array of points and a table of
+// where each track starts.
+//
+// The points can be mapped from a binary file without being copied, which
+// is much faster than building a TrackList for large files. Copies share the
+// points.
+template<class T>
+class TrackListView {
+  public:
+    TrackListView();
+
+    // Uses the records of a binary file in place.
+    // Returns false if the file does not contain tracks of the given type.
+    bool map(const BinaryFile& file, BinaryRecordType type);
+    // Copies the tracks into a buffer owned by the view.
+    void assign(const TrackList<T>& tracks);
+
+    int size() const;
+    bool empty() const;
+    TrackView<T> operator[](int n) const;
+
+    // Returns the first frame in any track.
+    int findFirstFrame() const;
+    // Returns the number of points in all tracks.
+    int countPoints() const;
+
+  private:
+    struct Buffer {
+      std::vector<TrackViewPoint<T> > points;
+      std::vector<uint64_t> offsets;
+    };
+
+    void reset();
+
+    BinaryFile file_;
+    boost::shared_ptr<const Buffer> buffer_;
+    const TrackViewPoint<T>* points_;
+    const uint64_t* offsets_;
+    int num_tracks_;
+};
+
+// Concatenates the points of several tracks and appends the index of the end
+// of each to the offsets. The offsets should initially contain the start.
+template<class T, class InputIterator>
+void flattenTracks(InputIterator first,
+                   InputIterator last,
+                   std::vector<TrackViewPoint<T> >& points,
+                   std::vector<uint64_t>& offsets);
+
+// Saves tracks in the binary format which can be mapped by TrackListView.
+template<class T>
+bool writeBinaryTrackList(const std::string& filename,
+                          const TrackList<T>& tracks,
+                          BinaryRecordType type);
+
+#include "track_list_view.inl"
+
+#endif
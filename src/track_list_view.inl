@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <limits>
+#include <glog/logging.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// TrackView
+
+template<class T>
+TrackView<T>::TrackView() : begin_(NULL), end_(NULL) {}
+
+template<class T>
+TrackView<T>::TrackView(const_iterator begin, const_iterator end)
+    : begin_(begin), end_(end) {}
+
+template<class T>
+bool pointPrecedesFrame(const TrackViewPoint<T>& point, int x) {
+  return point.first < x;
+}
+
+template<class T>
+typename TrackView<T>::const_iterator TrackView<T>::lower_bound(int x) const {
+  return std::lower_bound(begin_, end_, x, pointPrecedesFrame<T>);
+}
+
+template<class T>
+typename TrackView<T>::const_iterator TrackView<T>::find(int x) const {
+  const_iterator position = lower_bound(x);
+  if (position != end_ && position->first == x) {
+    return position;
+  }
+  return end_;
+}
+
+template<class T>
+int TrackView<T>::size() const {
+  return end_ - begin_;
+}
+
+template<class T>
+bool TrackView<T>::empty() const {
+  return begin_ == end_;
+}
+
+template<class T>
+typename TrackView<T>::const_iterator TrackView<T>::begin() const {
+  return begin_;
+}
+
+template<class T>
+typename TrackView<T>::const_iterator TrackView<T>::end() const {
+  return end_;
+}
+
+template<class T>
+typename TrackView<T>::const_reverse_iterator TrackView<T>::rbegin() const {
+  return const_reverse_iterator(end_);
+}
+
+template<class T>
+typename TrackView<T>::const_reverse_iterator TrackView<T>::rend() const {
+  return const_reverse_iterator(begin_);
+}
+
+template<class T>
+void TrackView<T>::copyTo(Track<T>& track) const {
+  track.clear();
+  typename Track<T>::iterator hint = track.end();
+  for (const_iterator point = begin_; point != end_; ++point) {
+    // Points are in order, so each is inserted at the end.
+    hint = track.insert(hint, std::make_pair(int(point->first), point->second));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// TrackViewIterator
+
+template<class T>
+TrackViewIterator<T>::TrackViewIterator() : track_(), position_(NULL) {}
+
+template<class T>
+TrackViewIterator<T>::TrackViewIterator(const TrackView<T>& track)
+    : track_(track), position_(track.begin()) {}
+
+template<class T>
+TrackViewIterator<T>::TrackViewIterator(const TrackView<T>& track, int time)
+    : track_(track), position_(track.lower_bound(time)) {}
+
+template<class T>
+void TrackViewIterator<T>::next() {
+  ++position_;
+}
+
+template<class T>
+void TrackViewIterator<T>::previous() {
+  --position_;
+}
+
+template<class T>
+bool TrackViewIterator<T>::end() const {
+  return position_ == track_.end();
+}
+
+template<class T>
+bool TrackViewIterator<T>::begin() const {
+  return position_ == track_.begin();
+}
+
+template<class T>
+const T& TrackViewIterator<T>::get() const {
+  return position_->second;
+}
+
+template<class T>
+int TrackViewIterator<T>::time() const {
+  return position_->first;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// TrackListView
+
+template<class T>
+TrackListView<T>::TrackListView()
+    : file_(), buffer_(), points_(NULL), offsets_(NULL), num_tracks_(0) {}
+
+template<class T>
+void TrackListView<T>::reset() {
+  file_ = BinaryFile();
+  buffer_.reset();
+  points_ = NULL;
+  offsets_ = NULL;
+  num_tracks_ = 0;
+}
+
+template<class T>
+bool TrackListView<T>::map(const BinaryFile& file, BinaryRecordType type) {
+  reset();
+
+  const BinaryFileHeader& header = file.header();
+  if (header.record_type != uint32_t(type) ||
+      header.record_size != sizeof(TrackViewPoint<T>)) {
+    LOG(WARNING) << "File does not contain tracks of the expected type";
+    return false;
+  }
+  if (file.numGroups() == 0) {
+    if (file.numRecords() != 0) {
+      LOG(WARNING) << "Points are not grouped into tracks";
+      return false;
+    }
+    // No tracks.
+    file_ = file;
+    return true;
+  }
+  if (file.groupSize() != 1) {
+    LOG(WARNING) << "File contains multiview tracks";
+    return false;
+  }
+
+  file_ = file;
+  points_ = file.records<TrackViewPoint<T> >(type);
+  offsets_ = file.groups();
+  num_tracks_ = file.numGroups();
+  return true;
+}
+
+template<class T>
+void TrackListView<T>::assign(const TrackList<T>& tracks) {
+  reset();
+
+  boost::shared_ptr<Buffer> buffer(new Buffer());
+  buffer->offsets.push_back(0);
+  flattenTracks(tracks.begin(), tracks.end(), buffer->points, buffer->offsets);
+
+  buffer_ = buffer;
+  points_ = buffer->points.empty() ? NULL : &buffer->points.front();
+  offsets_ = &buffer->offsets.front();
+  num_tracks_ = tracks.size();
+}
+
+template<class T>
+int TrackListView<T>::size() const {
+  return num_tracks_;
+}
+
+template<class T>
+bool TrackListView<T>::empty() const {
+  return num_tracks_ == 0;
+}
+
+template<class T>
+TrackView<T> TrackListView<T>::operator[](int n) const {
+  CHECK(n >= 0 && n < num_tracks_);
+  return TrackView<T>(points_ + offsets_[n], points_ + offsets_[n + 1]);
+}
+
+template<class T>
+int TrackListView<T>::findFirstFrame() const {
+  int first = std::numeric_limits<int>::max();
+  for (int i = 0; i < num_tracks_; i += 1) {
+    if (offsets_[i] != offsets_[i + 1]) {
+      first = std::min(first, int(points_[offsets_[i]].first));
+    }
+  }
+  return first;
+}
+
+template<class T>
+int TrackListView<T>::countPoints() const {
+  return num_tracks_ == 0 ? 0 : offsets_[num_tracks_];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+template<class T, class InputIterator>
+void flattenTracks(InputIterator first,
+                   InputIterator last,
+                   std::vector<TrackViewPoint<T> >& points,
+                   std::vector<uint64_t>& offsets) {
+  for (InputIterator track = first; track != last; ++track) {
+    typename Track<T>::const_iterator point;
+    for (point = track->begin(); point != track->end(); ++point) {
+      TrackViewPoint<T> record;
+      record.first = point->first;
+      record.padding = 0;
+      record.second = point->second;
+      points.push_back(record);
+    }
+    offsets.push_back(points.size());
+  }
+}
+
+template<class T>
+bool writeBinaryTrackList(const std::string& filename,
+                          const TrackList<T>& tracks,
+                          BinaryRecordType type) {
+  std::vector<TrackViewPoint<T> > points;
+  std::vector<uint64_t> offsets(1, 0);
+  flattenTracks(tracks.begin(), tracks.end(), points, offsets);
+
+  return writeBinaryFile(filename, type, sizeof(TrackViewPoint<T>),
+      points.size(), points.empty() ? NULL : &points.front(), offsets, 1);
+}
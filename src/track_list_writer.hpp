@@ -1,6 +1,7 @@
 #ifndef TRACK_LIST_WRITER_HPP_
 #define TRACK_LIST_WRITER_HPP_
 
+#include <string>
 #include "track_list.hpp"
 #include "writer.hpp"
 
@@ -20,6 +21,30 @@ bool saveTrackList(const std::string& filename,
                    const TrackList<T>& tracks,
                    Writer<T>& writer);
 
+// Writes tracks one at a time in the format of saveTrackList(), so that a
+// list can be saved without all of its tracks being in memory.
+template<class T>
+class TrackListStreamWriter {
+  public:
+    // Does not own the writer.
+    explicit TrackListStreamWriter(Writer<T>& writer);
+    // Closes the file if it is open.
+    ~TrackListStreamWriter();
+
+    bool open(const std::string& filename);
+    // Ends the list. Nothing can be written afterwards.
+    void close();
+
+    void write(const Track<T>& track);
+    // Number of tracks written.
+    int size() const;
+
+  private:
+    Writer<T>* writer_;
+    cv::FileStorage file_;
+    int size_;
+};
+
 #include "track_list_writer.inl"
 
 #endif
@@ -1,3 +1,4 @@
+#include <glog/logging.h>
 #include "track_writer.hpp"
 
 template<class T>
@@ -30,3 +31,52 @@ bool saveTrackList(const std::string& filename,
   TrackListWriter<T> list_writer(track_writer);
   return save(filename, tracks, list_writer);
 }
+
+template<class T>
+TrackListStreamWriter<T>::TrackListStreamWriter(Writer<T>& writer)
+    : writer_(&writer), file_(), size_(0) {}
+
+template<class T>
+TrackListStreamWriter<T>::~TrackListStreamWriter() {
+  close();
+}
+
+template<class T>
+bool TrackListStreamWriter<T>::open(const std::string& filename) {
+  close();
+  size_ = 0;
+
+  file_.open(filename, cv::FileStorage::WRITE);
+  if (!file_.isOpened()) {
+    LOG(WARNING) << "Could not open `" << filename << "' for writing";
+    return false;
+  }
+
+  file_ << "list";
+  file_ << "[";
+  return true;
+}
+
+template<class T>
+void TrackListStreamWriter<T>::close() {
+  if (file_.isOpened()) {
+    file_ << "]";
+    file_.release();
+  }
+}
+
+template<class T>
+void TrackListStreamWriter<T>::write(const Track<T>& track) {
+  CHECK(file_.isOpened()) << "Stream is not open";
+
+  TrackWriter<T> track_writer(*writer_);
+  file_ << "{";
+  track_writer.write(file_, track);
+  file_ << "}";
+  size_ += 1;
+}
+
+template<class T>
+int TrackListStreamWriter<T>::size() const {
+  return size_;
+}
@@ -1,9 +1,13 @@
+#include <cmath>
 #include <string>
 #include <vector>
 #include <list>
 #include <iterator>
 #include <algorithm>
 #include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <opencv2/core/core.hpp>
@@ -18,6 +22,7 @@
 #include "similarity_warp.hpp"
 #include "sift_position.hpp"
 #include "flow.hpp"
+#include "util/flow-histogram.hpp"
 #include "track_list.hpp"
 #include "random_color.hpp"
 
@@ -26,11 +31,33 @@
 #include "sift_position_writer.hpp"
 #include "track_list_writer.hpp"
 #include "util.hpp"
+#include "util/latest-value.hpp"
+#include "util/metrics.hpp"
+#include "util/feature-scheduler.hpp"
 
 DEFINE_int32(max_image_size, 512, "Maximum average dimension of image");
 DEFINE_int32(radius, 8, "Half of [patch size - 1]");
 DEFINE_double(mask_sigma, 4., "Sigma to use in mask");
 DEFINE_double(min_scale, 1., "Minimum warp scale");
+DEFINE_int32(pyramid_levels, 1,
+    "Number of pyramid levels to track through, 1 for full resolution only");
+DEFINE_bool(low_latency, true,
+    "Capture and display in their own threads, dropping frames which "
+    "tracking cannot keep up with?");
+DEFINE_bool(solver_statistics, false,
+    "Log histograms of the solver statistics of every frame and at exit");
+DEFINE_int32(metrics_port, 0,
+    "Port on which to serve metrics at /metrics, 0 for none");
+DEFINE_double(deadline, 0,
+    "Milliseconds in which to track the features of each frame, 0 for no "
+    "limit. Features which are not started in time stay where they were and "
+    "are tracked first in the next frame.");
+DEFINE_int32(min_iter, 5,
+    "Fewest iterations per feature and pyramid level when the deadline "
+    "reduces them");
+DEFINE_int32(max_deferred, 3,
+    "Number of consecutive frames a feature may stay without tracking before "
+    "it is dropped");
 
 // Optical flow settings (frame to frame).
 const int MAX_NUM_ITERATIONS = 100;
@@ -41,11 +68,22 @@ const bool ITERATION_LIMIT_IS_FATAL = true;
 const bool CHECK_CONDITION = true;
 const double MAX_CONDITION = 1e3;
 
+// Period of display refresh.
+const int DISPLAY_DELAY_MS = 1000 / 30;
+
 struct TrackedFeature {
   boost::shared_ptr<Warp> warp;
   cv::Mat appearance;
+  // Number of frames the feature has been in.
+  int age;
+  // Number of consecutive frames it was not tracked in.
+  int num_deferred;
+
+  TrackedFeature() : warp(), appearance(), age(0), num_deferred(0) {}
 };
 
+typedef std::list<TrackedFeature> FeatureList;
+
 ////////////////////////////////////////////////////////////////////////////////
 
 // enum
@@ -86,63 +124,372 @@ void init(int& argc, char**& argv) {
   google::ParseCommandLineFlags(&argc, &argv, true);
 }
 
+// A point where the user asked for a new feature.
+struct Click {
+  int x;
+  int y;
+  bool similarity;
+};
+
+// Clicks are recorded by the UI and consumed by tracking, which may be in
+// another thread.
 struct State {
-  const TranslationWarper* translation_warper;
-  const SimilarityWarper* similarity_warper;
-  std::list<TrackedFeature>* features;
-  const cv::Mat* image;
-  int radius;
-  const FlowOptions* options;
+  boost::mutex mutex;
+  std::vector<Click> clicks;
 };
 
 void onMouse(int event, int x, int y, int, void* tag) {
   State& state = *static_cast<State*>(tag);
 
   if (event == CV_EVENT_LBUTTONDOWN || event == CV_EVENT_RBUTTONDOWN) {
-    // Clicked! Add a feature.
+    // Clicked! Left for translation, right for similarity.
+    Click click;
+    click.x = x;
+    click.y = y;
+    click.similarity = (event == CV_EVENT_RBUTTONDOWN);
+
+    boost::mutex::scoped_lock lock(state.mutex);
+    state.clicks.push_back(click);
+  }
+}
+
+// Everything needed to track a frame which does not change between frames.
+struct Tracking {
+  const TranslationWarper* translation_warper;
+  const SimilarityWarper* similarity_warper;
+  const cv::Mat* mask;
+  const FlowOptions* options;
+  int radius;
+  // Solver statistics of the whole run, collected if not NULL.
+  FlowHistogram* histogram;
+  // Served to monitoring, updated if not NULL.
+  Metrics* metrics;
+  // Orders the features of each frame and bounds their iterations.
+  FeatureScheduler* scheduler;
+};
+
+double currentTime() {
+  return double(cv::getTickCount()) / cv::getTickFrequency();
+}
+
+// Tracks features into a new frame and draws them.
+// Features which were clicked since the last frame are added first.
+void trackFrame(const cv::Mat& color_image,
+                FeatureList& features,
+                State& state,
+                const Tracking& tracking,
+                cv::Mat& display) {
+  const FlowOptions& options = *tracking.options;
+  int diameter = 2 * tracking.radius + 1;
+
+  cv::Mat small_image = color_image;
+  int max_pixels = FLAGS_max_image_size * FLAGS_max_image_size;
+  while (small_image.total() > max_pixels) {
+    cv::pyrDown(small_image, small_image);
+  }
+
+  // Convert color to intensity.
+  cv::Mat integer_gray_image;
+  cv::cvtColor(small_image, integer_gray_image, CV_BGR2GRAY);
+  // Convert to floating point in [0, 1].
+  cv::Mat image;
+  integer_gray_image.convertTo(image, cv::DataType<double>::type, 1. / 255.);
+
+  // Compute pyramid and gradients using central difference.
+  // Don't worry about smoothing, this will be done by downsampling.
+  ImagePyramid pyramid;
+  buildImagePyramid(image, FLAGS_pyramid_levels, pyramid);
+
+  // Track features from the previous image, in order of priority until the
+  // deadline.
+  {
+    double start = currentTime();
+    FeatureScheduler& scheduler = *tracking.scheduler;
+    // The scheduler learns the cost of an iteration from the statistics.
+    bool collect = (tracking.histogram != NULL || tracking.metrics != NULL ||
+        scheduler.enabled());
+
+    std::vector<FeatureList::iterator> list;
+    std::vector<double> priorities;
+    FeatureList::iterator it;
+    for (it = features.begin(); it != features.end(); ++it) {
+      list.push_back(it);
+      // Every feature was clicked.
+      priorities.push_back(scheduler.enabled() ? featurePriority(true,
+            it->num_deferred, it->age, patchTexture(it->appearance)) : 0.);
+    }
+    scheduler.begin(start, priorities);
+
+    // Stopping short of the usual limit is no failure.
+    FlowOptions frame_options = options;
+    frame_options.solver_options.max_num_iterations = scheduler.iterations();
+    frame_options.iteration_limit_is_fatal = options.iteration_limit_is_fatal &&
+        scheduler.iterations() >= options.solver_options.max_num_iterations;
+
+    FlowHistogram histogram;
+    int num_iterations = 0;
+    int num_deferred = 0;
+    const std::vector<int>& order = scheduler.order();
+    std::vector<int>::const_iterator index;
+    for (index = order.begin(); index != order.end(); ++index) {
+      FeatureList::iterator feature = list[*index];
+
+      if (scheduler.expired(currentTime())) {
+        if (feature->num_deferred < FLAGS_max_deferred) {
+          // Stays where it was until the next frame.
+          feature->num_deferred += 1;
+          feature->age += 1;
+          num_deferred += 1;
+        } else {
+          if (tracking.metrics != NULL) {
+            tracking.metrics->add(
+                "features_dropped_total{reason=\"deadline\"}", 1);
+          }
+          features.erase(feature);
+        }
+        continue;
+      }
+
+      FlowStatistics statistics;
+      bool tracked = trackPatchPyramid(*feature->warp, feature->appearance,
+          pyramid, *tracking.mask, frame_options,
+          collect ? &statistics : NULL);
+      num_iterations += statistics.num_iterations;
+      if (tracking.histogram != NULL) {
+        histogram.add(statistics);
+      }
+
+      if (!tracked) {
+        if (tracking.metrics != NULL) {
+          tracking.metrics->add(
+              std::string("features_dropped_total{reason=\"") +
+              flowTerminationName(statistics.termination) + "\"}", 1);
+        }
+        // Failed to track. Erase feature and move on.
+        features.erase(feature);
+      } else {
+        feature->num_deferred = 0;
+        feature->age += 1;
+      }
+    }
+    scheduler.end(currentTime(), num_iterations);
+
+    if (tracking.histogram != NULL) {
+      tracking.histogram->add(histogram);
+      std::ostringstream line;
+      histogram.writeLine(line);
+      LOG(INFO) << line.str();
+    }
+
+    if (tracking.metrics != NULL) {
+      tracking.metrics->observe("stage_seconds{stage=\"track\"}",
+          currentTime() - start);
+      tracking.metrics->add("features_tracked_total",
+          features.size() - num_deferred);
+      tracking.metrics->add("features_deferred_total", num_deferred);
+    }
+  }
+
+  // Add features which were clicked.
+  std::vector<Click> clicks;
+  {
+    boost::mutex::scoped_lock lock(state.mutex);
+    clicks.swap(state.clicks);
+  }
+  std::vector<Click>::const_iterator click;
+  for (click = clicks.begin(); click != clicks.end(); ++click) {
     TrackedFeature feature;
 
-    if (event == CV_EVENT_LBUTTONDOWN) {
-      // Left-clicked. Add a translation feature.
-      feature.warp.reset(
-          new TranslationWarp(x, y, *state.translation_warper));
+    if (!click->similarity) {
+      feature.warp.reset(new TranslationWarp(click->x, click->y,
+            *tracking.translation_warper));
     } else {
-      // Right-clicked. Add a similarity feature.
-      feature.warp.reset(
-          new SimilarityWarp(x, y, std::log(2.), 0., *state.similarity_warper));
+      feature.warp.reset(new SimilarityWarp(click->x, click->y,
+            std::log(2.), 0., *tracking.similarity_warper));
     }
 
     // Extract initial appearance.
-    int diameter = 2 * state.radius + 1;
-    samplePatch(*feature.warp, *state.image, feature.appearance, diameter,
-        false, state.options->interpolation);
+    samplePatch(*feature.warp, image, feature.appearance, diameter, false,
+        options.interpolation);
+
+    features.push_back(feature);
+  }
+
+  // Convert grayscale back to color for displaying.
+  cv::cvtColor(integer_gray_image, display, CV_GRAY2BGR);
+
+  if (tracking.metrics != NULL) {
+    tracking.metrics->add("frames_total", 1);
+    tracking.metrics->set("features", features.size());
+  }
+
+  // Draw features.
+  LOG(INFO) << features.size() << " features";
+  {
+    FeatureList::const_iterator feature;
+    for (feature = features.begin(); feature != features.end(); ++feature) {
+      cv::Scalar color(200, 0, 0);
+      feature->warp->draw(display, tracking.radius, color, 1);
+    }
+  }
+}
 
-    state.features->push_back(feature);
+// A frame and the time at which it left the camera.
+struct TimedFrame {
+  cv::Mat image;
+  double time;
+};
+
+// Reads frames as fast as the camera delivers them. A frame which tracking
+// has not started on by the time the next one arrives is dropped.
+void captureFrames(cv::VideoCapture* capture,
+                   LatestValue<TimedFrame>* frames) {
+  while (true) {
+    TimedFrame frame;
+    if (!capture->read(frame.image)) {
+      break;
+    }
+    frame.time = currentTime();
+
+    if (!frames->put(frame)) {
+      // Closed by the consumer.
+      break;
+    }
+  }
+
+  frames->close();
+}
+
+// Tracks the newest captured frame whenever tracking is free, and passes the
+// drawing on to the UI with the frame's capture time.
+void trackFrames(LatestValue<TimedFrame>* captured,
+                 LatestValue<TimedFrame>* drawn,
+                 State* state,
+                 const Tracking* tracking) {
+  FeatureList features;
+  TimedFrame frame;
+
+  while (captured->take(frame)) {
+    TimedFrame display;
+    trackFrame(frame.image, features, *state, *tracking, display.image);
+    display.time = frame.time;
+
+    if (!drawn->put(display)) {
+      break;
+    }
   }
+
+  drawn->close();
+}
+
+// Captures, tracks and displays in one thread. Latency builds up if tracking
+// is slower than the camera.
+void trackLive(cv::VideoCapture& capture,
+               State& state,
+               const Tracking& tracking) {
+  FeatureList features;
+  bool exit = false;
+
+  while (!exit) {
+    cv::Mat color_image;
+    if (!capture.read(color_image)) {
+      break;
+    }
+
+    cv::Mat display;
+    trackFrame(color_image, features, state, tracking, display);
+
+    // Display image.
+    cv::imshow("video", display);
+    char keypress = cv::waitKey(DISPLAY_DELAY_MS);
+
+    if (keypress == 27) {
+      exit = true;
+    }
+  }
+}
+
+// Captures and tracks in their own threads. The UI refreshes at its own
+// rate, showing the newest tracked frame and reporting the time from capture
+// to display.
+void trackLiveLowLatency(cv::VideoCapture& capture,
+                         State& state,
+                         const Tracking& tracking) {
+  LatestValue<TimedFrame> captured;
+  LatestValue<TimedFrame> drawn;
+  boost::thread capturer(boost::bind(captureFrames, &capture, &captured));
+  boost::thread tracker(boost::bind(trackFrames, &captured, &drawn, &state,
+        &tracking));
+
+  bool exit = false;
+  int num_dropped = 0;
+
+  while (!exit) {
+    if (tracking.metrics != NULL) {
+      // Each stage holds at most one frame.
+      tracking.metrics->set("queue_depth{stage=\"capture\"}", captured.full());
+      tracking.metrics->set("queue_depth{stage=\"display\"}", drawn.full());
+    }
+
+    TimedFrame display;
+    if (drawn.tryTake(display)) {
+      cv::imshow("video", display.image);
+
+      double latency = currentTime() - display.time;
+      LOG(INFO) << "Capture to display " << latency * 1e3 << " ms, " <<
+          captured.numDropped() << " frames dropped";
+
+      if (tracking.metrics != NULL) {
+        tracking.metrics->observe("capture_to_display_seconds", latency);
+        int total_dropped = captured.numDropped();
+        tracking.metrics->add("frames_dropped_total",
+            total_dropped - num_dropped);
+        num_dropped = total_dropped;
+      }
+    } else if (drawn.closed()) {
+      // Camera stopped.
+      break;
+    }
+
+    // HighGUI must be used from this thread.
+    char keypress = cv::waitKey(DISPLAY_DELAY_MS);
+
+    if (keypress == 27) {
+      exit = true;
+    }
+  }
+
+  // Stop the other threads, the tracker first so that it does not wait for a
+  // frame which will never come.
+  captured.close();
+  drawn.close();
+  tracker.join();
+  capturer.join();
 }
 
 int main(int argc, char** argv) {
   init(argc, argv);
 
-  int diameter = FLAGS_radius * 2 + 1;
-
   // Open camera.
   cv::VideoCapture capture(0);
   CHECK(capture.isOpened()) << "Unable to open default camera";
 
   // Linear solver options.
   FlowOptions options;
+  options.engine = CERES_FLOW_ENGINE;
   options.solver_options.linear_solver_type = ceres::DENSE_QR;
   options.solver_options.max_num_iterations = MAX_NUM_ITERATIONS;
   options.solver_options.function_tolerance = FUNCTION_TOLERANCE;
   options.solver_options.gradient_tolerance = GRADIENT_TOLERANCE;
   options.solver_options.parameter_tolerance = PARAMETER_TOLERANCE;
   options.check_condition = CHECK_CONDITION;
+  options.condition_from_normal_equations = true;
   options.max_condition = MAX_CONDITION;
   options.iteration_limit_is_fatal = ITERATION_LIMIT_IS_FATAL;
   options.interpolation = cv::INTER_AREA;
 
   // Construct mask.
+  int diameter = FLAGS_radius * 2 + 1;
   cv::Mat mask = makeGaussian(FLAGS_mask_sigma, diameter);
 
   // Set up different warps.
@@ -153,86 +500,42 @@ int main(int argc, char** argv) {
   SimilarityWarper::CostFunction similarity_cost(new SimilarityWarpFunction());
   SimilarityWarper similarity_warper(similarity_cost, FLAGS_min_scale);
 
-  bool exit = false;
-  char keypress = 0;
-
-  typedef std::list<TrackedFeature> FeatureList;
-  FeatureList features;
-
-  cv::Mat image;
+  Tracking tracking;
+  tracking.translation_warper = &translation_warper;
+  tracking.similarity_warper = &similarity_warper;
+  tracking.mask = &mask;
+  tracking.options = &options;
+  tracking.radius = FLAGS_radius;
+  FlowHistogram histogram;
+  tracking.histogram = FLAGS_solver_statistics ? &histogram : NULL;
+  FeatureScheduler scheduler(FLAGS_deadline * 1e-3, FLAGS_min_iter,
+      MAX_NUM_ITERATIONS, FLAGS_pyramid_levels);
+  tracking.scheduler = &scheduler;
+
+  Metrics metrics;
+  MetricsServer server(metrics);
+  tracking.metrics = NULL;
+  if (FLAGS_metrics_port > 0) {
+    bool ok = server.start(FLAGS_metrics_port);
+    CHECK(ok) << "Could not serve metrics on port " << FLAGS_metrics_port;
+    tracking.metrics = &metrics;
+  }
 
   State state;
-  state.translation_warper = &translation_warper;
-  state.similarity_warper = &similarity_warper;
-  state.features = &features;
-  state.image = &image;
-  state.radius = FLAGS_radius;
-  state.options = &options;
 
   cv::namedWindow("video");
   cv::setMouseCallback("video", onMouse, &state);
 
-  while (!exit) {
-    cv::Mat color_image;
-    capture >> color_image;
-    int max_pixels = FLAGS_max_image_size * FLAGS_max_image_size;
-    while (color_image.total() > max_pixels) {
-      cv::pyrDown(color_image, color_image);
-    }
-
-    // Convert color to intensity.
-    cv::Mat integer_gray_image;
-    cv::cvtColor(color_image, integer_gray_image, CV_BGR2GRAY);
-    // Convert to floating point in [0, 1].
-    integer_gray_image.convertTo(image, cv::DataType<double>::type, 1. / 255.);
-
-    // Compute gradients using central difference.
-    // Don't worry about smoothing, this will be done by downsampling.
-    cv::Mat ddx;
-    cv::Mat ddy;
-    cv::Mat diff = (cv::Mat_<double>(1, 3) << -0.5, 0, 0.5);
-    cv::Mat identity = (cv::Mat_<double>(1, 1) << 1);
-    cv::sepFilter2D(image, ddx, -1, diff, identity);
-    cv::sepFilter2D(image, ddy, -1, identity, diff);
-
-    // Track features from the previous image.
-    {
-      FeatureList::iterator feature = features.begin();
-      while (feature != features.end()) {
-        bool tracked = trackPatch(*feature->warp, feature->appearance, image,
-            ddx, ddy, mask, options);
-
-        if (!tracked) {
-          // Failed to track. Erase feature and move on.
-          features.erase(feature++);
-        } else {
-          // Move to next.
-          ++feature;
-        }
-      }
-    }
-
-    // Convert grayscale back to color for displaying.
-    cv::Mat display;
-    cv::cvtColor(integer_gray_image, display, CV_GRAY2BGR);
-
-    // Draw features.
-    LOG(INFO) << features.size() << " features";
-    {
-      FeatureList::const_iterator feature;
-      for (feature = features.begin(); feature != features.end(); ++feature) {
-        cv::Scalar color(200, 0, 0);
-        feature->warp->draw(display, FLAGS_radius, color, 1);
-      }
-    }
-
-    // Display image.
-    cv::imshow("video", display);
-    keypress = cv::waitKey(1000 / 30);
+  if (FLAGS_low_latency) {
+    trackLiveLowLatency(capture, state, tracking);
+  } else {
+    trackLive(capture, state, tracking);
+  }
 
-    if (keypress == 27) {
-      exit = true;
-    }
+  if (FLAGS_solver_statistics) {
+    std::ostringstream summary;
+    histogram.write(summary);
+    LOG(INFO) << "Solver statistics:" << std::endl << summary.str();
   }
 
   return 0;
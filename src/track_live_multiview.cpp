@@ -0,0 +1,569 @@
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <map>
+#include <sstream>
+#include <cmath>
+#include <cstdlib>
+#include <boost/shared_ptr.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/format.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <ceres/ceres.h>
+
+#include "warp.hpp"
+#include "translation_warp.hpp"
+#include "flow.hpp"
+#include "camera.hpp"
+#include "multiview_track_list.hpp"
+#include "read_lines.hpp"
+#include "util.hpp"
+#include "util/bounded-queue.hpp"
+
+#include "camera_reader.hpp"
+#include "multiview_track_list_writer.hpp"
+#include "image_point_writer.hpp"
+
+DEFINE_int32(radius, 8, "Half of [patch size - 1]");
+DEFINE_double(mask_sigma, 4., "Sigma to use in mask");
+DEFINE_int32(pyramid_levels, 1,
+    "Number of pyramid levels to track through, 1 for full resolution only");
+DEFINE_int32(max_features, 200, "Maximum number of features per view");
+DEFINE_double(quality, 0.01,
+    "Minimum cornerness relative to the strongest corner");
+DEFINE_double(min_clearance, 8., "Minimum distance between features");
+DEFINE_double(sync_tolerance, 0.010,
+    "Maximum difference in seconds between the frames of a synchronized set");
+DEFINE_int32(max_buffered, 4, "Maximum number of frames buffered per view");
+DEFINE_int32(num_frames, 0,
+    "Stop after this many synchronized frames, 0 to run until a camera stops");
+DEFINE_bool(display, true, "Show tracking in a window per view");
+
+// Optical flow settings (frame to frame).
+const int MAX_NUM_ITERATIONS = 100;
+const double FUNCTION_TOLERANCE = 1e-6;
+const double GRADIENT_TOLERANCE = 1e-6;
+const double PARAMETER_TOLERANCE = 1e-6;
+const bool ITERATION_LIMIT_IS_FATAL = true;
+const bool CHECK_CONDITION = true;
+const double MAX_CONDITION = 1e3;
+
+cv::Mat makeGaussian(double sigma, int width) {
+  cv::Mat gaussian = cv::Mat_<double>(width, width);
+  int radius = (width - 1) / 2;
+  double sigma2 = sigma * sigma;
+
+  for (int i = 0; i < width; i += 1) {
+    double u = i - radius;
+    for (int j = 0; j < width; j += 1) {
+      double v = j - radius;
+      double d2 = u * u + v * v;
+      gaussian.at<double>(i, j) = std::exp(-d2 / (2. * sigma2));
+    }
+  }
+
+  cv::Mat mask = cv::Mat_<double>::zeros(width, width);
+  cv::Point center(radius, radius);
+  cv::circle(mask, center, radius, 1., -1);
+  cv::multiply(gaussian, mask, gaussian);
+
+  return gaussian;
+}
+
+std::string makeViewFilename(const std::string& format,
+                             const std::string& view) {
+  return boost::str(boost::format(format) % view);
+}
+
+double currentTime() {
+  return double(cv::getTickCount()) / cv::getTickFrequency();
+}
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Tracks points live in several synchronized cameras." << std::endl;
+  usage << std::endl;
+  usage << "views is a file with the name of each view and its device (a "
+    "camera index or a URL) per line." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " views camera-format tracks" << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 4) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// A frame and the time at which it left the camera.
+struct TimedFrame {
+  cv::Mat image;
+  double time;
+};
+
+// Buffers the latest frames of every camera and releases sets of frames,
+// one per camera, whose timestamps agree to within a tolerance.
+class FrameSynchronizer {
+  public:
+    FrameSynchronizer(int num_views, double tolerance, int max_buffered)
+        : buffers_(num_views),
+          mutex_(),
+          added_(),
+          tolerance_(tolerance),
+          max_buffered_(std::max(max_buffered, 1)),
+          num_dropped_(0),
+          closed_(false) {}
+
+    // Called by the capture thread of each view.
+    // Drops the oldest frame of the view if its buffer is full.
+    void add(int view, const TimedFrame& frame) {
+      boost::mutex::scoped_lock lock(mutex_);
+      std::deque<TimedFrame>& buffer = buffers_[view];
+      buffer.push_back(frame);
+      if (int(buffer.size()) > max_buffered_) {
+        buffer.pop_front();
+        num_dropped_ += 1;
+      }
+      added_.notify_one();
+    }
+
+    // Signals that a camera has stopped, after which no more sets are
+    // released.
+    void close() {
+      boost::mutex::scoped_lock lock(mutex_);
+      closed_ = true;
+      added_.notify_all();
+    }
+
+    bool closed() {
+      boost::mutex::scoped_lock lock(mutex_);
+      return closed_;
+    }
+
+    // Blocks until there is a synchronized set. Returns false if closed.
+    bool next(std::vector<TimedFrame>& frames) {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (!closed_) {
+        if (findSet(frames)) {
+          return true;
+        }
+        added_.wait(lock);
+      }
+      return false;
+    }
+
+    // Number of frames discarded without being part of a set.
+    int numDropped() {
+      boost::mutex::scoped_lock lock(mutex_);
+      return num_dropped_;
+    }
+
+  private:
+    // Must be called with the lock held.
+    bool findSet(std::vector<TimedFrame>& frames) {
+      int num_views = buffers_.size();
+      std::vector<int> nearest(num_views);
+
+      while (true) {
+        for (int view = 0; view < num_views; view += 1) {
+          if (buffers_[view].empty()) {
+            return false;
+          }
+        }
+
+        // Newest frame of the view which is furthest behind.
+        double reference = buffers_[0].back().time;
+        for (int view = 1; view < num_views; view += 1) {
+          reference = std::min(reference, buffers_[view].back().time);
+        }
+
+        // Find the frame of every view which is nearest to the reference.
+        bool found = true;
+        int oldest_view = 0;
+        for (int view = 0; view < num_views; view += 1) {
+          const std::deque<TimedFrame>& buffer = buffers_[view];
+          int best = 0;
+          for (int i = 1; i < int(buffer.size()); i += 1) {
+            if (std::abs(buffer[i].time - reference) <
+                std::abs(buffer[best].time - reference)) {
+              best = i;
+            }
+          }
+          nearest[view] = best;
+
+          if (std::abs(buffer[best].time - reference) > tolerance_) {
+            found = false;
+          }
+          if (buffer.front().time < buffers_[oldest_view].front().time) {
+            oldest_view = view;
+          }
+        }
+
+        if (found) {
+          // Release the set and everything older.
+          frames.resize(num_views);
+          for (int view = 0; view < num_views; view += 1) {
+            std::deque<TimedFrame>& buffer = buffers_[view];
+            frames[view] = buffer[nearest[view]];
+            num_dropped_ += nearest[view];
+            buffer.erase(buffer.begin(), buffer.begin() + nearest[view] + 1);
+          }
+          return true;
+        }
+
+        // The oldest frame cannot be matched, discard it and try again.
+        buffers_[oldest_view].pop_front();
+        num_dropped_ += 1;
+      }
+    }
+
+    std::vector<std::deque<TimedFrame> > buffers_;
+    boost::mutex mutex_;
+    boost::condition_variable added_;
+    double tolerance_;
+    int max_buffered_;
+    int num_dropped_;
+    bool closed_;
+};
+
+// Reads frames as fast as a camera delivers them.
+void captureFrames(cv::VideoCapture* capture,
+                   int view,
+                   FrameSynchronizer* synchronizer) {
+  while (!synchronizer->closed()) {
+    TimedFrame frame;
+    if (!capture->read(frame.image)) {
+      LOG(WARNING) << "Camera " << view << " stopped";
+      break;
+    }
+    frame.time = currentTime();
+    synchronizer->add(view, frame);
+  }
+
+  synchronizer->close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct TrackedFeature {
+  boost::shared_ptr<Warp> warp;
+  cv::Mat appearance;
+  // Identifies the feature within its view.
+  int id;
+};
+
+// Points observed in one view in one frame, by feature ID within the view.
+struct ViewPoints {
+  std::map<int, cv::Point2d> points;
+  cv::Mat display;
+};
+
+// Everything needed to track a view which does not change between frames.
+struct Tracking {
+  const TranslationWarper* warper;
+  const cv::Mat* mask;
+  const FlowOptions* options;
+  int radius;
+  bool display;
+};
+
+// Tracks features in one view and tops them up with new corners.
+void trackView(const cv::Mat& color_image,
+               std::list<TrackedFeature>& features,
+               int& next_id,
+               const Tracking& tracking,
+               ViewPoints& output) {
+  const FlowOptions& options = *tracking.options;
+  int diameter = 2 * tracking.radius + 1;
+
+  cv::Mat integer_image;
+  cv::cvtColor(color_image, integer_image, CV_BGR2GRAY);
+  cv::Mat image;
+  integer_image.convertTo(image, cv::DataType<double>::type, 1. / 255.);
+
+  ImagePyramid pyramid;
+  buildImagePyramid(image, FLAGS_pyramid_levels, pyramid);
+
+  // Track features from the previous frame.
+  std::list<TrackedFeature>::iterator feature = features.begin();
+  while (feature != features.end()) {
+    bool tracked = trackPatchPyramid(*feature->warp, feature->appearance,
+        pyramid, *tracking.mask, options);
+    if (!tracked) {
+      features.erase(feature++);
+    } else {
+      ++feature;
+    }
+  }
+
+  // Detect new corners away from existing features.
+  int num_wanted = FLAGS_max_features - int(features.size());
+  if (num_wanted > 0) {
+    // Only allow corners whose patch lies within the image.
+    cv::Mat allowed(image.size(), CV_8UC1, cv::Scalar(0));
+    cv::Rect valid(tracking.radius, tracking.radius,
+        image.cols - 2 * tracking.radius, image.rows - 2 * tracking.radius);
+    allowed(valid).setTo(cv::Scalar(255));
+
+    for (feature = features.begin(); feature != features.end(); ++feature) {
+      cv::Point2d x = feature->warp->evaluate(cv::Point2d(0, 0), NULL);
+      cv::circle(allowed, x, FLAGS_min_clearance, cv::Scalar(0), -1);
+    }
+
+    cv::Mat float_image;
+    integer_image.convertTo(float_image, cv::DataType<float>::type,
+        1. / 255.);
+    std::vector<cv::Point2f> corners;
+    cv::goodFeaturesToTrack(float_image, corners, num_wanted, FLAGS_quality,
+        FLAGS_min_clearance, allowed);
+
+    std::vector<cv::Point2f>::const_iterator corner;
+    for (corner = corners.begin(); corner != corners.end(); ++corner) {
+      TrackedFeature added;
+      added.warp.reset(new TranslationWarp(corner->x, corner->y,
+            *tracking.warper));
+      samplePatch(*added.warp, image, added.appearance, diameter, false,
+          options.interpolation);
+      added.id = next_id;
+      next_id += 1;
+      features.push_back(added);
+    }
+  }
+
+  output.points.clear();
+  for (feature = features.begin(); feature != features.end(); ++feature) {
+    output.points[feature->id] = feature->warp->evaluate(cv::Point2d(0, 0),
+        NULL);
+  }
+
+  if (tracking.display) {
+    cv::cvtColor(integer_image, output.display, CV_GRAY2BGR);
+    for (feature = features.begin(); feature != features.end(); ++feature) {
+      feature->warp->draw(output.display, tracking.radius,
+          cv::Scalar(200, 0, 0), 1);
+    }
+  }
+}
+
+// Tracking thread of one view. Takes synchronized frames and returns the
+// positions of its features in the same order.
+void trackFrames(BoundedQueue<TimedFrame>* input,
+                 BoundedQueue<ViewPoints>* output,
+                 const Tracking* tracking) {
+  std::list<TrackedFeature> features;
+  int next_id = 0;
+  TimedFrame frame;
+
+  while (input->pop(frame)) {
+    ViewPoints points;
+    trackView(frame.image, features, next_id, *tracking, points);
+    output->push(points);
+  }
+
+  output->close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// A view and the device it is captured from.
+struct View {
+  std::string name;
+  std::string device;
+};
+
+bool readViews(const std::string& filename, std::vector<View>& views) {
+  std::vector<std::string> lines;
+  if (!readLines(filename, lines)) {
+    return false;
+  }
+
+  views.clear();
+  std::vector<std::string>::const_iterator line;
+  for (line = lines.begin(); line != lines.end(); ++line) {
+    std::istringstream stream(*line);
+    View view;
+    if (!(stream >> view.name)) {
+      continue;
+    }
+    if (!(stream >> view.device)) {
+      LOG(WARNING) << "No device for view \"" << view.name << "\"";
+      return false;
+    }
+    views.push_back(view);
+  }
+
+  return true;
+}
+
+bool openDevice(const std::string& device, cv::VideoCapture& capture) {
+  try {
+    return capture.open(boost::lexical_cast<int>(device));
+  } catch (boost::bad_lexical_cast&) {
+    return capture.open(device);
+  }
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string views_file = argv[1];
+  std::string camera_format = argv[2];
+  std::string tracks_file = argv[3];
+
+  bool ok;
+
+  std::vector<View> views;
+  ok = readViews(views_file, views);
+  CHECK(ok) << "Could not read views";
+  CHECK(!views.empty()) << "No views";
+  int num_views = views.size();
+
+  // Load calibration and open cameras.
+  std::vector<boost::shared_ptr<cv::VideoCapture> > captures;
+  std::vector<Camera> cameras(num_views);
+  CameraReader camera_reader;
+
+  for (int view = 0; view < num_views; view += 1) {
+    std::string camera_file = makeViewFilename(camera_format,
+        views[view].name);
+    ok = load(camera_file, cameras[view], camera_reader);
+    CHECK(ok) << "Could not load camera for view " << views[view].name;
+
+    captures.push_back(boost::shared_ptr<cv::VideoCapture>(
+        new cv::VideoCapture()));
+    ok = openDevice(views[view].device, *captures.back());
+    CHECK(ok) << "Could not open device " << views[view].device;
+  }
+
+  FlowOptions options;
+  options.engine = CERES_FLOW_ENGINE;
+  options.solver_options.linear_solver_type = ceres::DENSE_QR;
+  options.solver_options.max_num_iterations = MAX_NUM_ITERATIONS;
+  options.solver_options.function_tolerance = FUNCTION_TOLERANCE;
+  options.solver_options.gradient_tolerance = GRADIENT_TOLERANCE;
+  options.solver_options.parameter_tolerance = PARAMETER_TOLERANCE;
+  options.solver_options.logging_type = ceres::SILENT;
+  options.check_condition = CHECK_CONDITION;
+  options.condition_from_normal_equations = true;
+  options.max_condition = MAX_CONDITION;
+  options.iteration_limit_is_fatal = ITERATION_LIMIT_IS_FATAL;
+  options.interpolation = cv::INTER_LINEAR;
+
+  int diameter = FLAGS_radius * 2 + 1;
+  cv::Mat mask = makeGaussian(FLAGS_mask_sigma, diameter);
+
+  TranslationWarper::CostFunction translation_cost(
+      new TranslationWarpFunction());
+  TranslationWarper translation_warper(translation_cost);
+
+  Tracking tracking;
+  tracking.warper = &translation_warper;
+  tracking.mask = &mask;
+  tracking.options = &options;
+  tracking.radius = FLAGS_radius;
+  tracking.display = FLAGS_display;
+
+  // One capture thread and one tracking thread per camera.
+  FrameSynchronizer synchronizer(num_views, FLAGS_sync_tolerance,
+      FLAGS_max_buffered);
+  std::vector<boost::shared_ptr<BoundedQueue<TimedFrame> > > inputs;
+  std::vector<boost::shared_ptr<BoundedQueue<ViewPoints> > > outputs;
+  boost::thread_group capturers;
+  boost::thread_group trackers;
+
+  for (int view = 0; view < num_views; view += 1) {
+    inputs.push_back(boost::shared_ptr<BoundedQueue<TimedFrame> >(
+          new BoundedQueue<TimedFrame>(1)));
+    outputs.push_back(boost::shared_ptr<BoundedQueue<ViewPoints> >(
+          new BoundedQueue<ViewPoints>(1)));
+    capturers.create_thread(boost::bind(captureFrames, captures[view].get(),
+          view, &synchronizer));
+    trackers.create_thread(boost::bind(trackFrames, inputs[view].get(),
+          outputs[view].get(), &tracking));
+  }
+
+  // Each feature of each view is a multiview track observed in that view.
+  MultiviewTrackList<cv::Point2d> tracks(num_views);
+  std::vector<std::map<int, int> > track_indices(num_views);
+
+  int time = 0;
+  std::vector<TimedFrame> frames;
+  bool exit = false;
+
+  while (!exit && synchronizer.next(frames)) {
+    double spread = 0;
+    for (int view = 0; view < num_views; view += 1) {
+      const cv::Size& size = cameras[view].intrinsics().image_size;
+      if (frames[view].image.size() != size) {
+        LOG(WARNING) << "View " << views[view].name << " is not the size it "
+          "was calibrated at";
+      }
+      spread = std::max(spread, std::abs(frames[view].time - frames[0].time));
+      inputs[view]->push(frames[view]);
+    }
+
+    // Merge the points of every view into the multiview tracks.
+    for (int view = 0; view < num_views; view += 1) {
+      ViewPoints points;
+      ok = outputs[view]->pop(points);
+      CHECK(ok);
+
+      std::map<int, cv::Point2d>::const_iterator point;
+      for (point = points.points.begin(); point != points.points.end();
+          ++point) {
+        std::map<int, int>::iterator index =
+          track_indices[view].find(point->first);
+        if (index == track_indices[view].end()) {
+          tracks.push_back(MultiviewTrack<cv::Point2d>(num_views));
+          index = track_indices[view].insert(std::make_pair(point->first,
+                tracks.numTracks() - 1)).first;
+        }
+        tracks.track(index->second).view(view)[time] = point->second;
+      }
+
+      if (FLAGS_display) {
+        cv::imshow(views[view].name, points.display);
+      }
+    }
+
+    LOG(INFO) << "Frame " << time << ": views " << spread * 1e3 <<
+        " ms apart, " << synchronizer.numDropped() << " frames dropped";
+
+    if (FLAGS_display && cv::waitKey(1) == 27) {
+      exit = true;
+    }
+
+    time += 1;
+    if (FLAGS_num_frames > 0 && time >= FLAGS_num_frames) {
+      exit = true;
+    }
+  }
+
+  // Stop all threads.
+  synchronizer.close();
+  for (int view = 0; view < num_views; view += 1) {
+    inputs[view]->close();
+  }
+  trackers.join_all();
+  capturers.join_all();
+
+  ImagePointWriter<double> point_writer;
+  ok = saveMultiviewTrackList(tracks_file, tracks, point_writer);
+  CHECK(ok) << "Could not save tracks";
+
+  return 0;
+}
@@ -1,6 +1,7 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include <cstdlib>
 #include <glog/logging.h>
 #include <gflags/gflags.h>
 
@@ -8,6 +9,7 @@
 #include "track_list.hpp"
 #include "scale_space_position.hpp"
 #include "multiview_track_list.hpp"
+#include "batch_jobs.hpp"
 
 #include "iterator_reader.hpp"
 #include "match_reader.hpp"
@@ -15,6 +17,13 @@
 #include "scale_space_position_reader.hpp"
 #include "multiview_track_list_writer.hpp"
 #include "scale_space_position_writer.hpp"
+#include "util/thread-pool.hpp"
+
+DEFINE_bool(batch, false,
+    "The only argument is a file with one \"matches tracks-1 tracks-2 "
+    "multiview-tracks\" per line, which are converted in parallel");
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads in batch mode, 0 to convert serially");
 
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
@@ -22,119 +31,172 @@ void init(int& argc, char**& argv) {
   usage << std::endl;
   usage << "Sample usage:" << std::endl;
   usage << argv[0] << " matches tracks-1 tracks-2 multiview-tracks" << std::endl;
+  usage << argv[0] << " --batch jobs" << std::endl;
   google::SetUsageMessage(usage.str());
 
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
 
-  if (argc != 5) {
+  if (argc != (FLAGS_batch ? 2 : 5)) {
     google::ShowUsageWithFlags(argv[0]);
     std::exit(1);
   }
 }
 
-int main(int argc, char** argv) {
-  init(argc, argv);
-  std::string matches_file = argv[1];
-  std::string tracks_file1 = argv[2];
-  std::string tracks_file2 = argv[3];
-  std::string multiview_tracks_file = argv[4];
-
-  bool ok;
-  std::vector<Match> matches;
-  TrackList<ScaleSpacePosition> track_list1;
-  TrackList<ScaleSpacePosition> track_list2;
-
-  // Load matches.
-  MatchReader match_reader;
-  ok = loadList(matches_file, matches, match_reader);
-  CHECK(ok) << "Could not load matches";
+typedef Track<ScaleSpacePosition> ScaleSpaceTrack;
+typedef TrackList<ScaleSpacePosition> ScaleSpaceTrackList;
 
-  // Load tracks.
-  ScaleSpacePositionReader feature_reader;
-  ok = loadTrackList(tracks_file1, track_list1, feature_reader);
-  CHECK(ok) << "Could not load tracks";
-  ok = loadTrackList(tracks_file2, track_list2, feature_reader);
-  CHECK(ok) << "Could not load tracks";
+// Adds a track to one view of a new multiview track, taking its contents.
+void addSingleViewTrack(ScaleSpaceTrack& single_view,
+                        int view,
+                        MultiviewTrackList<ScaleSpacePosition>& tracks) {
+  MultiviewTrack<ScaleSpacePosition> track(2);
+  track.view(view).swap(single_view);
 
-  // Move tracks into maps.
-  std::map<int, Track<ScaleSpacePosition> > tracks1;
-  std::map<int, Track<ScaleSpacePosition> > tracks2;
-
-  int n1 = track_list1.size();
-  for (int i = 0; i < n1; i += 1) {
-    tracks1[i].swap(track_list1[i]);
-  }
-  int n2 = track_list2.size();
-  for (int i = 0; i < n2; i += 1) {
-    tracks2[i].swap(track_list2[i]);
-  }
+  tracks.push_back(MultiviewTrack<ScaleSpacePosition>());
+  tracks.back().swap(track);
+}
 
-  // Create multi-view track.
-  int num_views = 2;
-  MultiviewTrackList<ScaleSpacePosition> multiview_tracks(num_views);
+// Joins the tracks of two views by a list of matches of their indices, and
+// adds every unmatched track on its own. Tracks are taken from the lists.
+//
+// Tracks are looked up directly by index, and a flag for each track records
+// whether it has been used.
+bool joinTracks(const std::vector<Match>& matches,
+                ScaleSpaceTrackList& tracks1,
+                ScaleSpaceTrackList& tracks2,
+                MultiviewTrackList<ScaleSpacePosition>& multiview_tracks) {
+  int n1 = tracks1.size();
+  int n2 = tracks2.size();
+  std::vector<bool> used1(n1, false);
+  std::vector<bool> used2(n2, false);
+
+  multiview_tracks = MultiviewTrackList<ScaleSpacePosition>(2);
 
   // Add multiview track for each match.
-  int num_matches = matches.size();
-  for (int i = 0; i < num_matches; i += 1) {
-    // Move tracks into multiview structure.
-    std::map<int, Track<ScaleSpacePosition> >::iterator track1 =
-        tracks1.find(matches[i].first);
-    CHECK(track1 != tracks1.end()) << "Track already used";
-    std::map<int, Track<ScaleSpacePosition> >::iterator track2 =
-        tracks2.find(matches[i].first);
-    CHECK(track2 != tracks2.end()) << "Track already used";
+  std::vector<Match>::const_iterator match;
+  for (match = matches.begin(); match != matches.end(); ++match) {
+    int i = match->first;
+    int j = match->second;
+    if (i < 0 || i >= n1 || j < 0 || j >= n2) {
+      LOG(WARNING) << "Match " << *match << " is out of range";
+      return false;
+    }
+    if (used1[i] || used2[j]) {
+      LOG(WARNING) << "Track already used by match " << *match;
+      return false;
+    }
 
+    // Move tracks into multiview structure.
     MultiviewTrack<ScaleSpacePosition> track(2);
-    track.view(0).swap(track1->second);
-    track.view(1).swap(track2->second);
+    track.view(0).swap(tracks1[i]);
+    track.view(1).swap(tracks2[j]);
 
     multiview_tracks.push_back(MultiviewTrack<ScaleSpacePosition>());
     multiview_tracks.back().swap(track);
 
-    // Remove entry in map.
-    tracks1.erase(track1);
-    tracks2.erase(track2);
+    used1[i] = true;
+    used2[j] = true;
   }
 
-  LOG(INFO) << "Multi-view: " << multiview_tracks.numTracks();
-  LOG(INFO) << "First view only: " << tracks1.size();
-  LOG(INFO) << "Second view only: " << tracks2.size();
+  int num_matched = multiview_tracks.numTracks();
+  LOG(INFO) << "Multi-view: " << num_matched;
+  LOG(INFO) << "First view only: " << n1 - num_matched;
+  LOG(INFO) << "Second view only: " << n2 - num_matched;
 
   // Add all remaining tracks as their own multiview track.
-  while (!tracks1.empty()) {
-    std::map<int, Track<ScaleSpacePosition> >::iterator track1 =
-        tracks1.begin();
+  for (int i = 0; i < n1; i += 1) {
+    if (!used1[i]) {
+      addSingleViewTrack(tracks1[i], 0, multiview_tracks);
+    }
+  }
+  for (int j = 0; j < n2; j += 1) {
+    if (!used2[j]) {
+      addSingleViewTrack(tracks2[j], 1, multiview_tracks);
+    }
+  }
 
-    MultiviewTrack<ScaleSpacePosition> track(2);
-    track.view(0).swap(track1->second);
+  LOG(INFO) << "Total: " << multiview_tracks.numTracks();
+  return true;
+}
 
-    multiview_tracks.push_back(MultiviewTrack<ScaleSpacePosition>());
-    multiview_tracks.back().swap(track);
+bool convertMatches(const std::string& matches_file,
+                    const std::string& tracks_file1,
+                    const std::string& tracks_file2,
+                    const std::string& multiview_tracks_file) {
+  // Load matches.
+  std::vector<Match> matches;
+  MatchReader match_reader;
+  if (!loadList(matches_file, matches, match_reader)) {
+    LOG(WARNING) << "Could not load matches \"" << matches_file << "\"";
+    return false;
+  }
 
-    tracks1.erase(track1);
+  // Load tracks.
+  ScaleSpaceTrackList tracks1;
+  ScaleSpaceTrackList tracks2;
+  ScaleSpacePositionReader feature_reader;
+  if (!loadTrackList(tracks_file1, tracks1, feature_reader)) {
+    LOG(WARNING) << "Could not load tracks \"" << tracks_file1 << "\"";
+    return false;
+  }
+  if (!loadTrackList(tracks_file2, tracks2, feature_reader)) {
+    LOG(WARNING) << "Could not load tracks \"" << tracks_file2 << "\"";
+    return false;
   }
 
-  // Add all remaining tracks as their own multiview track.
-  while (!tracks2.empty()) {
-    std::map<int, Track<ScaleSpacePosition> >::iterator track2 =
-        tracks2.begin();
+  MultiviewTrackList<ScaleSpacePosition> multiview_tracks;
+  if (!joinTracks(matches, tracks1, tracks2, multiview_tracks)) {
+    return false;
+  }
 
-    MultiviewTrack<ScaleSpacePosition> track(2);
-    track.view(1).swap(track2->second);
+  // Save track list.
+  ScaleSpacePositionWriter writer;
+  if (!saveMultiviewTrackList(multiview_tracks_file, multiview_tracks,
+        writer)) {
+    LOG(WARNING) << "Could not save multi-view tracks \"" <<
+        multiview_tracks_file << "\"";
+    return false;
+  }
 
-    multiview_tracks.push_back(MultiviewTrack<ScaleSpacePosition>());
-    multiview_tracks.back().swap(track);
+  return true;
+}
+
+// Runs a line "matches tracks-1 tracks-2 multiview-tracks" of the batch
+// file. For use with runBatchJobs().
+class ConvertFunction {
+  public:
+    explicit ConvertFunction(const std::vector<BatchJob>& jobs)
+        : jobs_(&jobs) {}
+
+    bool operator()(int i) const {
+      const BatchJob& files = (*jobs_)[i];
+      return convertMatches(files[0], files[1], files[2], files[3]);
+    }
 
-    tracks2.erase(track2);
+  private:
+    const std::vector<BatchJob>* jobs_;
+};
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  bool ok;
+
+  if (!FLAGS_batch) {
+    ok = convertMatches(argv[1], argv[2], argv[3], argv[4]);
+    CHECK(ok) << "Could not convert matches";
+    return 0;
   }
 
-  LOG(INFO) << "Total: " << multiview_tracks.numTracks();
+  std::vector<BatchJob> jobs;
+  ok = readBatchJobs(argv[1], 4, jobs);
+  CHECK(ok) << "Could not load jobs";
 
-  // Save track list.
-  ScaleSpacePositionWriter writer;
-  ok = saveMultiviewTrackList(multiview_tracks_file, multiview_tracks, writer);
-  CHECK(ok) << "Could not save multi-view tracks";
+  ThreadPool pool(FLAGS_num_threads);
+  int num_failed = runBatchJobs(jobs.size(), ConvertFunction(jobs), pool);
+  CHECK(num_failed == 0) << "Could not convert " << num_failed << " of " <<
+      jobs.size() << " lists of matches";
 
   return 0;
 }
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <utility>
+
 namespace {
 
 template<class T>
@@ -52,7 +55,12 @@ bool TrackReader<T>::read(const cv::FileNode& node, Track<T>& track) {
       return false;
     }
 
-    track[pair.first] = pair.second;
+    // Points are usually in order, so insert at the end. Swap rather than
+    // copying the point, which may own a descriptor.
+    typename Track<T>::iterator point = track.insert(track.end(),
+        std::make_pair(pair.first, T()));
+    using std::swap;
+    swap(point->second, pair.second);
   }
 
   return true;
@@ -0,0 +1,126 @@
+#include "tracking/benchmark.hpp"
+#include <fstream>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <opencv2/core/core.hpp>
+
+namespace tracking {
+
+namespace {
+
+const char* const STAGE_NAMES[NUM_BENCHMARK_STAGES] = {
+  "decode",
+  "gradients",
+  "tracking",
+  "appearance",
+  "detection",
+  "serialization"
+};
+
+const int NUM_PERCENTILES = 4;
+const double PERCENTILES[NUM_PERCENTILES] = { 50, 90, 99, 100 };
+
+// Nearest-rank percentile of a sorted list.
+double percentile(const vector<double>& sorted, double p) {
+  int n = sorted.size();
+  int rank = std::ceil(p / 100. * n);
+  rank = std::max(rank, 1);
+  return sorted[rank - 1];
+}
+
+// Writes "name": {"count": ..., "mean": ..., "p50": ..., ...}.
+void writeSummary(std::ostream& stream,
+                  const string& indent,
+                  const string& name,
+                  const vector<double>& values) {
+  vector<double> sorted(values);
+  std::sort(sorted.begin(), sorted.end());
+
+  stream << indent << "\"" << name << "\": {\"count\": " << sorted.size();
+  if (!sorted.empty()) {
+    double sum = std::accumulate(sorted.begin(), sorted.end(), 0.);
+    stream << ", \"mean\": " << sum / sorted.size();
+    for (int i = 0; i < NUM_PERCENTILES; i += 1) {
+      stream << ", \"p" << PERCENTILES[i] << "\": " <<
+          percentile(sorted, PERCENTILES[i]);
+    }
+  }
+  stream << "}";
+}
+
+}
+
+double wallTime() {
+  return double(cv::getTickCount()) / cv::getTickFrequency();
+}
+
+FrameTiming::FrameTiming() : total(0) {
+  std::fill(stages, stages + NUM_BENCHMARK_STAGES, 0.);
+}
+
+Benchmark::Benchmark()
+    : totals_(),
+      iterations_(),
+      residual_evaluations_(),
+      jacobian_evaluations_(),
+      solver_times_() {
+  std::fill(terminations_, terminations_ + NUM_FLOW_TERMINATIONS, 0);
+}
+
+void Benchmark::addFrame(const FrameTiming& timing) {
+  for (int i = 0; i < NUM_BENCHMARK_STAGES; i += 1) {
+    stages_[i].push_back(timing.stages[i]);
+  }
+  totals_.push_back(timing.total);
+}
+
+void Benchmark::addFeature(const FlowStatistics& statistics) {
+  iterations_.push_back(statistics.num_iterations);
+  residual_evaluations_.push_back(statistics.num_residual_evaluations);
+  jacobian_evaluations_.push_back(statistics.num_jacobian_evaluations);
+  solver_times_.push_back(statistics.solver_time);
+  terminations_[statistics.termination] += 1;
+}
+
+void Benchmark::write(std::ostream& stream) const {
+  stream << "{" << std::endl;
+  stream << "  \"frame_seconds\": {" << std::endl;
+  for (int i = 0; i < NUM_BENCHMARK_STAGES; i += 1) {
+    writeSummary(stream, "    ", STAGE_NAMES[i], stages_[i]);
+    stream << "," << std::endl;
+  }
+  writeSummary(stream, "    ", "total", totals_);
+  stream << std::endl << "  }," << std::endl;
+
+  stream << "  \"feature\": {" << std::endl;
+  writeSummary(stream, "    ", "iterations", iterations_);
+  stream << "," << std::endl;
+  writeSummary(stream, "    ", "residual_evaluations", residual_evaluations_);
+  stream << "," << std::endl;
+  writeSummary(stream, "    ", "jacobian_evaluations", jacobian_evaluations_);
+  stream << "," << std::endl;
+  writeSummary(stream, "    ", "solver_seconds", solver_times_);
+  stream << std::endl << "  }," << std::endl;
+
+  // Number of features which ended with each termination.
+  stream << "  \"termination\": {" << std::endl;
+  for (int i = 0; i < NUM_FLOW_TERMINATIONS; i += 1) {
+    stream << "    \"" << flowTerminationName(FlowTermination(i)) <<
+        "\": " << terminations_[i];
+    stream << ((i + 1 < NUM_FLOW_TERMINATIONS) ? "," : "") << std::endl;
+  }
+  stream << "  }" << std::endl;
+  stream << "}" << std::endl;
+}
+
+bool Benchmark::write(const string& filename) const {
+  std::ofstream stream(filename.c_str());
+  if (!stream) {
+    return false;
+  }
+  write(stream);
+  return stream.good();
+}
+
+} // namespace tracking
@@ -0,0 +1,58 @@
+#ifndef TRACKING_BENCHMARK_HPP_
+#define TRACKING_BENCHMARK_HPP_
+
+#include <ostream>
+#include "tracking/using.hpp"
+#include "tracking/flow.hpp"
+
+namespace tracking {
+
+// Wall-clock time in seconds since an arbitrary origin.
+double wallTime();
+
+// Stages of processing a frame.
+enum BenchmarkStage {
+  DECODE_STAGE,
+  GRADIENTS_STAGE,
+  TRACKING_STAGE,
+  APPEARANCE_STAGE,
+  DETECTION_STAGE,
+  SERIALIZATION_STAGE,
+  NUM_BENCHMARK_STAGES
+};
+
+// Time spent in each stage of one frame, in seconds.
+struct FrameTiming {
+  double stages[NUM_BENCHMARK_STAGES];
+  // Time between successive frames leaving the tracker.
+  double total;
+
+  FrameTiming();
+};
+
+// Collects the timing of each frame and the solver statistics of each
+// tracked feature, and summarizes them as percentiles.
+class Benchmark {
+  public:
+    Benchmark();
+
+    void addFrame(const FrameTiming& timing);
+    void addFeature(const FlowStatistics& statistics);
+
+    // Writes the summary as a JSON object.
+    void write(std::ostream& stream) const;
+    bool write(const string& filename) const;
+
+  private:
+    vector<double> stages_[NUM_BENCHMARK_STAGES];
+    vector<double> totals_;
+    vector<double> iterations_;
+    vector<double> residual_evaluations_;
+    vector<double> jacobian_evaluations_;
+    vector<double> solver_times_;
+    int terminations_[NUM_FLOW_TERMINATIONS];
+};
+
+} // namespace tracking
+
+#endif
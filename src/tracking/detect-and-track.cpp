@@ -1,35 +1,67 @@
 #include "tracking/using.hpp"
 #include <sstream>
 #include <fstream>
+#include <cstdio>
 #include <algorithm>
-#include <numeric>
+#include <cmath>
+#include <stdint.h>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <glog/logging.h>
 #include <gflags/gflags.h>
 #include "tracking/track-list.hpp"
+#include "tracking/track-list-stream.hpp"
 #include "tracking/warp.hpp"
 #include "tracking/flow.hpp"
+#include "tracking/patch-mask.hpp"
+#include "tracking/benchmark.hpp"
 #include "tracking/similarity-warp.hpp"
 #include "tracking/translation-warp.hpp"
+#include "tracking/region-of-interest.hpp"
+#include "videoseg/segmentation-stream.hpp"
 #include "util/sqr.hpp"
 #include "util/random-color.hpp"
+#include "util/thread-pool.hpp"
+#include "util/bounded-queue.hpp"
+#include "util/trace.hpp"
+#include "util/flow-histogram.hpp"
+#include "util/feature-scheduler.hpp"
 #include <boost/format.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
 
 using namespace tracking;
 
 DEFINE_bool(display, true, "Show tracking in window");
 DEFINE_string(save, "", "Directory to save frames to, ignored if empty");
+DEFINE_string(benchmark, "",
+    "File to write per-stage timing and solver statistics to as JSON, "
+    "ignored if empty. Disables display and saving.");
 
 DEFINE_int32(radius, 8, "Half of [patch size - 1]");
 DEFINE_double(threshold, 1e-3, "Cornerness threshold");
 DEFINE_double(min_clearance, 8., "Minimum clearance before re-detecting");
+DEFINE_bool(detect_similarity, false,
+    "Detect features at multiple scales and track them in scale and "
+    "rotation?");
+DEFINE_int32(detect_levels, 3,
+    "Number of octaves to detect similarity features in");
+DEFINE_int32(detect_interval, 1,
+    "Maximum number of frames between detections while coverage is above "
+    "target, 1 to detect every frame");
+DEFINE_double(target_coverage, 0.5,
+    "Fraction of occupancy cells containing a feature above which detection "
+    "may be skipped");
 DEFINE_double(mask_sigma, 4., "Sigma to use in mask");
 DEFINE_double(max_residual, 0.05,
     "Maximum relative average intensity difference");
 
 DEFINE_bool(check_condition, true,
     "Check condition of Jacobian during tracking?");
+DEFINE_bool(condition_from_normal_equations, true,
+    "Compute condition from J^T J instead of the SVD of J?");
 DEFINE_double(max_condition, 1e3,
     "Maximum condition of Jacobian during tracking");
 DEFINE_int32(max_iter, 100,
@@ -37,11 +69,65 @@ DEFINE_int32(max_iter, 100,
 DEFINE_bool(fatal_max_iter, true,
     "Does reaching the iteration limit without converging terminate the "
     "track?");
+DEFINE_bool(inverse_compositional, false,
+    "Use inverse-compositional Gauss-Newton instead of ceres?");
+DEFINE_bool(single_precision, false,
+    "Track in single-precision images? Patches are double precision.");
+DEFINE_int32(pyramid_levels, 1,
+    "Number of pyramid levels to track through, 1 for full resolution only");
+DEFINE_bool(predict_motion, false,
+    "Initialize each warp by extrapolating its motion in the last frame?");
+DEFINE_double(deadline, 0,
+    "Milliseconds in which to track the features of each frame, 0 for no "
+    "limit. Features which are not started in time are carried forward on "
+    "their predicted motion, left out of the frame's tracks, and tracked "
+    "first in the next frame.");
+DEFINE_int32(min_iter, 5,
+    "Fewest iterations per feature and pyramid level when the deadline "
+    "reduces them");
+DEFINE_int32(max_deferred, 3,
+    "Number of consecutive frames a feature may be carried forward without "
+    "tracking before it is dropped");
+DEFINE_bool(solver_statistics, false,
+    "Log histograms of the solver statistics of every frame and video");
+DEFINE_int32(pipeline_depth, 2,
+    "Number of frames buffered between decoding, tracking, and writing tracks "
+    "and images");
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads to track features with, 0 to track serially");
+DEFINE_string(manifest, "",
+    "File listing a video and a tracks file per line. If not empty, tracks "
+    "every video in it instead of the command-line arguments.");
+DEFINE_string(trace, "",
+    "File to write a trace of each stage to, if built with tracing");
+DEFINE_bool(packed, false,
+    "Write the packed format of tracks, which is smaller and quicker to read");
+DEFINE_int32(num_streams, 2,
+    "Number of videos from the manifest to track at once, sharing the worker "
+    "threads");
+DEFINE_string(roi, "",
+    "Rectangle x,y,width,height outside of which features are neither "
+    "detected nor tracked. Empty for the whole frame.");
+DEFINE_string(roi_mask, "",
+    "Image whose non-zero pixels are of interest, or a format of one image "
+    "per frame such as mask/%08d.png. Empty for the whole frame.");
+DEFINE_string(roi_foreground, "",
+    "Foreground segmentation of the video, as labelled by segment-foreground, "
+    "whose foreground in each frame is of interest. Empty for none.");
+DEFINE_int32(roi_margin, -1,
+    "Pixels around the region of interest which are differentiated, so that "
+    "features near its edge can still be tracked. Negative for one patch "
+    "radius at the coarsest level of the pyramid.");
 
 const double FUNCTION_TOLERANCE = 1e-6;
 const double GRADIENT_TOLERANCE = 1e-6;
 const double PARAMETER_TOLERANCE = 1e-6;
 
+// Side of the tiles which cover a region of interest.
+const int ROI_TILE_SIZE = 32;
+// Label of the foreground regions written by segment-foreground.
+const int FOREGROUND_LABEL = 0;
+
 // Visualization parameters.
 const double SATURATION = 0.99;
 const double BRIGHTNESS = 0.99;
@@ -51,156 +137,256 @@ string makeFilename(const string& format, int n) {
   return boost::str(boost::format(format) % n);
 }
 
-// Describes a feature which is currently being tracked.
-class TrackedFeature {
+// Stores the features which are currently being tracked as a structure of
+// arrays.
+//
+// Each feature occupies a slot. Warps, colors and velocities are kept in
+// contiguous arrays, appearances as fixed-stride patches within one large
+// buffer. The slots of lost features go on a free list and are reused, so
+// that once the list has grown to its working size nothing is allocated per
+// feature. IDs are never reused since they identify tracks in the output.
+//
+// Features in different slots may be modified concurrently, but not while
+// features are being added.
+class TrackedFeatureList {
   public:
-    TrackedFeature() : similarity_(), translation_(), appearance_(), color_() {}
-
-    TrackedFeature(const TranslationWarp& warp, const cv::Vec3b& color)
-      : similarity_(),
-        translation_(new TranslationWarp(warp)),
-        appearance_(),
-        color_(color) {}
-
-    TrackedFeature(const SimilarityWarp& warp, const cv::Vec3b& color)
-      : similarity_(new SimilarityWarp(warp)),
-        translation_(),
-        appearance_(),
-        color_(color) {}
-
-    TrackedFeature(const TrackedFeature& other)
-        : similarity_(),
-          translation_(),
-          appearance_(other.appearance_.clone()),
-          color_(other.color_) {
-      if (other.similarity_) {
-        similarity_.reset(new SimilarityWarp(*other.similarity_));
-      }
-      if (other.translation_) {
-        translation_.reset(new TranslationWarp(*other.translation_));
-      }
+    // Largest number of warp parameters of any feature.
+    static const int MAX_NUM_PARAMS = SimilarityWarper::NUM_PARAMS;
+
+    explicit TrackedFeatureList(int diameter)
+        : diameter_(diameter),
+          capacity_(0),
+          next_id_(0),
+          live_(),
+          free_(),
+          ids_(),
+          similarity_(),
+          translations_(),
+          similarities_(),
+          colors_(),
+          velocities_(),
+          has_velocity_(),
+          ages_(),
+          deferred_(),
+          phase_(),
+          appearances_() {}
+
+    // Returns the number of features.
+    inline int size() const { return live_.size(); }
+
+    // Returns the slots of all features in order of ID.
+    inline const vector<int>& slots() const { return live_; }
+
+    // Adds a feature and returns its slot.
+    // The appearance of the feature must then be set.
+    int add(const TranslationWarp& warp, const cv::Vec3b& color) {
+      int slot = allocate(color);
+      similarity_[slot] = false;
+      translations_[slot] = warp;
+      return slot;
     }
 
-    TrackedFeature& operator=(const TrackedFeature& other) {
-      similarity_.reset();
-      if (other.similarity_) {
-        similarity_.reset(new SimilarityWarp(*other.similarity_));
-      }
+    int add(const SimilarityWarp& warp, const cv::Vec3b& color) {
+      int slot = allocate(color);
+      similarity_[slot] = true;
+      similarities_[slot] = warp;
+      return slot;
+    }
 
-      translation_.reset();
-      if (other.translation_) {
-        translation_.reset(new TranslationWarp(*other.translation_));
+    // Removes the features at positions i in slots() for which keep[i] is
+    // false. Returns the number of features removed.
+    int removeIf(const vector<char>& keep) {
+      CHECK(keep.size() == live_.size());
+      int n = live_.size();
+      int num_kept = 0;
+
+      for (int i = 0; i < n; i += 1) {
+        if (keep[i]) {
+          live_[num_kept] = live_[i];
+          num_kept += 1;
+        } else {
+          free_.push_back(live_[i]);
+        }
       }
+      live_.resize(num_kept);
 
-      appearance_ = other.appearance_.clone();
-      color_ = other.color_;
-
-      return *this;
+      return n - num_kept;
     }
 
-    inline const cv::Mat& appearance() const { return appearance_; }
-    inline cv::Mat& appearance() { return appearance_; }
-    inline cv::Vec3b color() const { return color_; }
-
-    inline bool isSimilarity() const {
-      return static_cast<bool>(similarity_);
-    }
+    inline int id(int slot) const { return ids_[slot]; }
+    inline cv::Vec3b color(int slot) const { return colors_[slot]; }
 
-    inline bool isTranslation() const {
-      return static_cast<bool>(translation_);
-    }
+    inline bool isSimilarity(int slot) const { return similarity_[slot]; }
+    inline bool isTranslation(int slot) const { return !similarity_[slot]; }
 
-    inline const Warp& warp() const {
-      if (isSimilarity()) {
-        return *similarity_;
+    inline const Warp& warp(int slot) const {
+      if (isSimilarity(slot)) {
+        return similarities_[slot];
       } else {
-        return *translation_;
+        return translations_[slot];
       }
     }
 
-    inline Warp& warp() {
-      if (isSimilarity()) {
-        return *similarity_;
+    inline Warp& warp(int slot) {
+      if (isSimilarity(slot)) {
+        return similarities_[slot];
       } else {
-        return *translation_;
+        return translations_[slot];
       }
     }
 
-    inline const SimilarityWarp& similarity() const {
-      return *similarity_;
+    inline const TranslationWarp& translation(int slot) const {
+      return translations_[slot];
     }
 
-    inline SimilarityWarp& similarity() {
-      return *similarity_;
+    inline const SimilarityWarp& similarity(int slot) const {
+      return similarities_[slot];
     }
 
-    inline const TranslationWarp& translation() const {
-      return *translation_;
+    // Returns a header for the appearance of a feature, within the buffer.
+    inline cv::Mat appearance(int slot) const {
+      return patch(slot, phase_[slot]);
     }
 
-    inline TranslationWarp& translation() {
-      return *translation_;
+    // Returns a header for the spare patch of a feature, within the buffer.
+    // For sampling the new appearance while the old one is still needed.
+    inline cv::Mat spareAppearance(int slot) const {
+      return patch(slot, 1 - phase_[slot]);
     }
 
-    void swap(TrackedFeature& other) {
-      similarity_.swap(other.similarity_);
-      translation_.swap(other.translation_);
-      std::swap(appearance_, other.appearance_);
-      std::swap(color_, other.color_);
+    // Makes the spare patch the appearance.
+    inline void swapAppearance(int slot) {
+      phase_[slot] = 1 - phase_[slot];
     }
 
-  private:
-    // Only one of these is non-null.
-    scoped_ptr<SimilarityWarp> similarity_;
-    scoped_ptr<TranslationWarp> translation_;
+    // Change in warp parameters over the last frame.
+    // Null until the feature has been tracked once.
+    inline const double* velocity(int slot) const {
+      if (!has_velocity_[slot]) {
+        return NULL;
+      }
+      return &velocities_[slot * MAX_NUM_PARAMS];
+    }
 
-    cv::Mat appearance_;
-    cv::Vec3b color_;
-};
+    // Moves the warp by its velocity (constant-velocity prediction).
+    void predict(int slot) {
+      const double* velocity = this->velocity(slot);
+      if (velocity == NULL) {
+        return;
+      }
 
-// Describes a list of features currently being tracked.
-class TrackedFeatureList {
-  public:
-    TrackedFeatureList() : features_(), count_(0) {}
+      Warp& warp = this->warp(slot);
+      double* params = warp.params();
+      int n = warp.numParams();
+      for (int i = 0; i < n; i += 1) {
+        params[i] += velocity[i];
+      }
+    }
 
-    typedef map<int, TrackedFeature>::const_iterator const_iterator;
-    typedef map<int, TrackedFeature>::iterator iterator;
+    // Number of frames the feature has been in.
+    inline int age(int slot) const { return ages_[slot]; }
+    // Number of consecutive frames the feature was carried forward without
+    // being tracked.
+    inline int numDeferred(int slot) const { return deferred_[slot]; }
 
-    inline const_iterator begin() const {
-      return features_.begin();
+    // Records that the feature was tracked into a frame.
+    void markTracked(int slot) {
+      ages_[slot] += 1;
+      deferred_[slot] = 0;
     }
 
-    inline const_iterator end() const {
-      return features_.end();
+    // Records that the feature was carried into a frame on its prediction.
+    void markDeferred(int slot) {
+      ages_[slot] += 1;
+      deferred_[slot] += 1;
     }
 
-    inline iterator begin() {
-      return features_.begin();
+    // Sets the velocity from the parameters in the previous frame.
+    void updateVelocity(int slot, const double* previous) {
+      const Warp& warp = this->warp(slot);
+      const double* params = warp.params();
+      double* velocity = &velocities_[slot * MAX_NUM_PARAMS];
+      int n = warp.numParams();
+      for (int i = 0; i < n; i += 1) {
+        velocity[i] = params[i] - previous[i];
+      }
+      has_velocity_[slot] = true;
     }
 
-    inline iterator end() {
-      return features_.end();
-    }
+  private:
+    int allocate(const cv::Vec3b& color) {
+      if (free_.empty()) {
+        grow(std::max(2 * capacity_, 64));
+      }
 
-    int size() const {
-      return features_.size();
-    }
+      int slot = free_.back();
+      free_.pop_back();
+      live_.push_back(slot);
 
-    TrackedFeature& add() {
-      return (features_[count_++] = TrackedFeature());
+      ids_[slot] = next_id_;
+      next_id_ += 1;
+      colors_[slot] = color;
+      has_velocity_[slot] = false;
+      ages_[slot] = 0;
+      deferred_[slot] = 0;
+      phase_[slot] = 0;
+
+      return slot;
     }
 
-    void erase(iterator position) {
-      features_.erase(position);
+    // Increases the number of slots, preserving the contents of existing ones.
+    void grow(int capacity) {
+      ids_.resize(capacity);
+      similarity_.resize(capacity);
+      translations_.resize(capacity);
+      similarities_.resize(capacity);
+      colors_.resize(capacity);
+      velocities_.resize(capacity * MAX_NUM_PARAMS);
+      has_velocity_.resize(capacity);
+      ages_.resize(capacity);
+      deferred_.resize(capacity);
+      phase_.resize(capacity);
+
+      // Two patches per slot, one row of the buffer each.
+      int num_pixels = diameter_ * diameter_;
+      cv::Mat appearances = cv::Mat_<double>(2 * capacity, num_pixels);
+      if (capacity_ > 0) {
+        appearances_.copyTo(appearances.rowRange(0, 2 * capacity_));
+      }
+      appearances_ = appearances;
+
+      // Use lower slots first.
+      for (int slot = capacity - 1; slot >= capacity_; slot -= 1) {
+        free_.push_back(slot);
+      }
+      capacity_ = capacity;
     }
 
-    int erase(int id) {
-      return features_.erase(id);
+    inline cv::Mat patch(int slot, int phase) const {
+      return cv::Mat_<double>(diameter_, diameter_,
+          const_cast<double*>(appearances_.ptr<double>(2 * slot + phase)));
     }
 
-  private:
-    map<int, TrackedFeature> features_;
-    int count_;
+    int diameter_;
+    int capacity_;
+    int next_id_;
+
+    // Slots in use, ordered by ID, and unused slots.
+    vector<int> live_;
+    vector<int> free_;
+
+    // Indexed by slot.
+    vector<int> ids_;
+    vector<char> similarity_;
+    vector<TranslationWarp> translations_;
+    vector<SimilarityWarp> similarities_;
+    vector<cv::Vec3b> colors_;
+    vector<double> velocities_;
+    vector<char> has_velocity_;
+    vector<int> ages_;
+    vector<int> deferred_;
+    vector<char> phase_;
+    cv::Mat appearances_;
 };
 
 cv::Mat makeGaussian(double sigma, int width) {
@@ -225,16 +411,23 @@ cv::Mat makeGaussian(double sigma, int width) {
   return gaussian;
 }
 
-// Computes the average pixel residual, weighted by W.
-double patchResidual(const cv::Mat& A, const cv::Mat& B, const cv::Mat& W) {
-  // D = abs(A - B) .* W
-  cv::Mat D = cv::abs(A - B);
-  cv::multiply(D, W, D);
-
-  double num = std::accumulate(D.begin<double>(), D.end<double>(), 0.);
-  double denom = std::accumulate(W.begin<double>(), W.end<double>(), 0.);
+// Computes the average pixel residual, weighted by the mask.
+double patchResidual(const cv::Mat& A, const cv::Mat& B, const PatchMask& W) {
+  CHECK(A.isContinuous());
+  CHECK(B.isContinuous());
+  const double* a = A.ptr<double>();
+  const double* b = B.ptr<double>();
+  const vector<int>& indices = W.indices();
+  const vector<double>& weights = W.weights();
+
+  // sum(abs(A - B) .* W)
+  double num = 0;
+  int n = W.size();
+  for (int k = 0; k < n; k += 1) {
+    num += weights[k] * std::abs(a[indices[k]] - b[indices[k]]);
+  }
 
-  return num / denom;
+  return num / W.totalWeight();
 }
 
 void init(int& argc, char**& argv) {
@@ -242,397 +435,1477 @@ void init(int& argc, char**& argv) {
   usage << "Automatically detects and tracks featuers." << std::endl;
   usage << std::endl;
   usage << argv[0] << " video tracks" << std::endl;
+  usage << argv[0] << " --manifest=file" << std::endl;
   usage << std::endl;
   google::SetUsageMessage(usage.str());
 
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
 
-  if (argc != 3) {
+  if (argc != (FLAGS_manifest.empty() ? 3 : 1)) {
     google::ShowUsageWithFlags(argv[0]);
     std::exit(1);
   }
 }
 
-class OccupancyMap {
+// Coarse occupancy grid of square cells whose side is the minimum clearance.
+// Any feature within clearance of a point must then lie in the 3x3 block of
+// cells around it, so a query only visits a handful of points instead of
+// rasterising a disc into a full-size image per feature.
+//
+// The point lists of the cells are kept between frames to avoid
+// re-allocating.
+class OccupancyGrid {
   public:
-    OccupancyMap(cv::Size size, double radius)
-        : occupied_(size, false), radius_(radius) {}
+    OccupancyGrid()
+        : cells_(),
+          rows_(0),
+          cols_(0),
+          cell_size_(1),
+          clearance_(0),
+          num_occupied_(0) {}
+
+    // Empties the grid and sizes it for an image.
+    void reset(cv::Size size, double clearance) {
+      clearance_ = clearance;
+      cell_size_ = std::max(clearance, 1.);
+      int rows = std::ceil(size.height / cell_size_);
+      int cols = std::ceil(size.width / cell_size_);
+
+      if (rows != rows_ || cols != cols_) {
+        rows_ = rows;
+        cols_ = cols;
+        cells_.assign(rows_ * cols_, vector<cv::Point2d>());
+      } else {
+        vector<vector<cv::Point2d> >::iterator cell;
+        for (cell = cells_.begin(); cell != cells_.end(); ++cell) {
+          cell->clear();
+        }
+      }
 
-    inline bool occupied(cv::Point pos) const {
-      return occupied_(pos);
+      num_occupied_ = 0;
     }
 
-    void add(cv::Point pos) {
-      // Set region to occupied.
-      int min_y = std::floor(pos.y - radius_ + 0.5);
-      int max_y = std::floor(pos.y + radius_ + 0.5);
-      // Clip to bounds of image.
-      min_y = std::max(min_y, 0);
-      max_y = std::min(max_y, occupied_.rows - 1);
-
-      for (int y = min_y; y <= max_y; y += 1) {
-        double delta = std::sqrt(sqr(radius_) - sqr(y - pos.y));
-        // Set region to occupied.
-        int min_x = std::floor(pos.x - delta + 0.5);
-        int max_x = std::floor(pos.x + delta + 0.5);
-        // Clip to bounds of image.
-        min_x = std::max(min_x, 0);
-        max_x = std::min(max_x, occupied_.cols - 1);
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    double cellSize() const { return cell_size_; }
+
+    // Cell containing a coordinate, clamped to the grid.
+    int cellRow(double y) const { return clampCell(y, rows_); }
+    int cellCol(double x) const { return clampCell(x, cols_); }
 
-        for (int x = min_x; x <= max_x; x += 1) {
-          occupied_(cv::Point(x, y)) = true;
+    // Does the cell contain no features?
+    bool empty(int row, int col) const {
+      return cells_[row * cols_ + col].empty();
+    }
+
+    void add(const cv::Point2d& pos) {
+      vector<cv::Point2d>& cell = cells_[cellRow(pos.y) * cols_ +
+        cellCol(pos.x)];
+      if (cell.empty()) {
+        num_occupied_ += 1;
+      }
+      cell.push_back(pos);
+    }
+
+    // Is there a feature within the clearance of this point?
+    bool occupied(const cv::Point2d& pos) const {
+      int row = cellRow(pos.y);
+      int col = cellCol(pos.x);
+      double max_distance = sqr(clearance_);
+
+      for (int i = std::max(row - 1, 0); i <= std::min(row + 1, rows_ - 1);
+          i += 1) {
+        for (int j = std::max(col - 1, 0); j <= std::min(col + 1, cols_ - 1);
+            j += 1) {
+          const vector<cv::Point2d>& cell = cells_[i * cols_ + j];
+          vector<cv::Point2d>::const_iterator point;
+          for (point = cell.begin(); point != cell.end(); ++point) {
+            if (sqr(point->x - pos.x) + sqr(point->y - pos.y) <=
+                max_distance) {
+              return true;
+            }
+          }
         }
       }
+
+      return false;
+    }
+
+    // Fraction of cells which contain at least one feature.
+    double coverage() const {
+      if (cells_.empty()) {
+        return 0;
+      }
+      return double(num_occupied_) / cells_.size();
     }
 
   private:
-    cv::Mat_<bool> occupied_;
-    double radius_;
+    int clampCell(double x, int n) const {
+      int i = std::floor(x / cell_size_);
+      return std::min(std::max(i, 0), n - 1);
+    }
+
+    vector<vector<cv::Point2d> > cells_;
+    int rows_;
+    int cols_;
+    double cell_size_;
+    double clearance_;
+    int num_occupied_;
 };
 
-//class ScaleSpaceOccupancyMap {
-//  public:
-//    ScaleSpaceOccupancyMap(int width,
-//                           int height,
-//                           double radius,
-//                           double step,
-//                           double sigma)
-//        : width_(width),
-//          height_(height),
-//          radius_(radius),
-//          log_step_(std::log(step)),
-//          sigma_(sigma) {
-//      int num_levels = std::log(std::min(width_, height_)) / log_step_;
-//
-//      for (int level = 0; level < num_levels; level += 1) {
-//        double scale = std::exp(level * log_step_);
-//        int w = std::ceil(width / scale);
-//        int h = std::ceil(height / scale);
-//        occupied_.push_back(cv::Mat_<bool>(h, w, false));
-//      }
-//    }
-//
-//    inline bool occupied(double x, double y, double scale) const {
-//      // Determine nearest level.
-//      int level = std::floor(std::log(scale) / log_step_ + 0.5);
-//      // Clamp to valid range.
-//      level = std::max(level, 0);
-//      level = std::min(level, int(occupied_.size()) - 1);
-//      // Divide x and y by scale of the nearest level.
-//      double level_scale = std::exp(level * log_step_);
-//      x = x / level_scale;
-//      y = y / level_scale;
-//
-//      int i = std::floor(y + 0.5);
-//      int j = std::floor(x + 0.5);
-//
-//      return occupied_[level](i, j);
-//    }
-//
-//    void add(double x, double y, double scale) {
-//    }
+// Binary image packed into 64-bit words, row by row.
+class BitGrid {
+  public:
+    BitGrid() : words_(), width_(0), height_(0), words_per_row_(0) {}
+
+    BitGrid(int width, int height)
+        : words_(),
+          width_(width),
+          height_(height),
+          words_per_row_((width + WORD_BITS - 1) / WORD_BITS) {
+      words_.assign(height_ * words_per_row_, 0);
+    }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    void clear() {
+      std::fill(words_.begin(), words_.end(), 0);
+    }
+
+    inline bool get(int x, int y) const {
+      uint64_t word = words_[y * words_per_row_ + x / WORD_BITS];
+      return (word >> (x % WORD_BITS)) & 1;
+    }
+
+    // Sets pixels min_x to max_x inclusive in row y.
+    void setSpan(int y, int min_x, int max_x) {
+      uint64_t* row = &words_[y * words_per_row_];
+      int first = min_x / WORD_BITS;
+      int last = max_x / WORD_BITS;
+      uint64_t first_mask = ~uint64_t(0) << (min_x % WORD_BITS);
+      uint64_t last_mask = ~uint64_t(0) >> (WORD_BITS - 1 - max_x % WORD_BITS);
+
+      if (first == last) {
+        row[first] |= first_mask & last_mask;
+      } else {
+        row[first] |= first_mask;
+        std::fill(row + first + 1, row + last, ~uint64_t(0));
+        row[last] |= last_mask;
+      }
+    }
+
+  private:
+    static const int WORD_BITS = 64;
+
+    vector<uint64_t> words_;
+    int width_;
+    int height_;
+    int words_per_row_;
+};
+
+// Occupancy of features in position and scale.
 //
-//  private:
-//    double width_;
-//    double height_;
-//    double radius_;
-//    double log_step_;
-//    double sigma_;
-//    vector<cv::Mat_<bool> > occupied_;
-//};
+// Scale is quantized into levels which are a constant ratio apart, each with
+// its own bit-packed grid at that level's resolution. A feature marks a disc
+// of the clearance radius, in units of the level's pixels, in the level
+// nearest its scale and in scale_radius levels either side. Features of
+// similar scale therefore keep apart, while a large feature does not stop
+// small features being found within it.
+class ScaleSpaceOccupancyMap {
+  public:
+    ScaleSpaceOccupancyMap()
+        : levels_(),
+          size_(),
+          radius_(0),
+          log_step_(1),
+          scale_radius_(0) {}
+
+    // Empties the map, re-allocating only if its shape changed.
+    void reset(cv::Size size, double radius, double step, int scale_radius) {
+      CHECK(step > 1) << "Levels must increase in scale";
+      double log_step = std::log(step);
+
+      if (size != size_ || log_step != log_step_ || levels_.empty()) {
+        size_ = size;
+        log_step_ = log_step;
+        levels_.clear();
+
+        int num_levels = std::log(double(std::min(size.width, size.height))) /
+          log_step_;
+        num_levels = std::max(num_levels, 1);
+
+        for (int level = 0; level < num_levels; level += 1) {
+          double scale = levelScale(level);
+          int w = std::ceil(size.width / scale);
+          int h = std::ceil(size.height / scale);
+          levels_.push_back(BitGrid(w, h));
+        }
+      } else {
+        vector<BitGrid>::iterator level;
+        for (level = levels_.begin(); level != levels_.end(); ++level) {
+          level->clear();
+        }
+      }
+
+      radius_ = radius;
+      scale_radius_ = scale_radius;
+    }
+
+    int numLevels() const {
+      return levels_.size();
+    }
+
+    inline double levelScale(int level) const {
+      return std::exp(level * log_step_);
+    }
+
+    // Nearest level to a scale, clamped to the valid range.
+    inline int level(double scale) const {
+      int level = std::floor(std::log(scale) / log_step_ + 0.5);
+      level = std::max(level, 0);
+      level = std::min(level, int(levels_.size()) - 1);
+      return level;
+    }
+
+    inline bool occupied(double x, double y, double scale) const {
+      int level = this->level(scale);
+      const BitGrid& grid = levels_[level];
+      double level_scale = levelScale(level);
+
+      int i = std::floor(y / level_scale + 0.5);
+      int j = std::floor(x / level_scale + 0.5);
+      if (i < 0 || i >= grid.height() || j < 0 || j >= grid.width()) {
+        return false;
+      }
+
+      return grid.get(j, i);
+    }
+
+    void add(double x, double y, double scale) {
+      int nearest = level(scale);
+      int min_level = std::max(nearest - scale_radius_, 0);
+      int max_level = std::min(nearest + scale_radius_, numLevels() - 1);
+
+      for (int level = min_level; level <= max_level; level += 1) {
+        double level_scale = levelScale(level);
+        addDisc(levels_[level], x / level_scale, y / level_scale);
+      }
+    }
+
+  private:
+    void addDisc(BitGrid& grid, double x, double y) {
+      int min_y = std::floor(y - radius_ + 0.5);
+      int max_y = std::floor(y + radius_ + 0.5);
+      // Clip to bounds of grid.
+      min_y = std::max(min_y, 0);
+      max_y = std::min(max_y, grid.height() - 1);
+
+      for (int i = min_y; i <= max_y; i += 1) {
+        double delta = std::sqrt(std::max(sqr(radius_) - sqr(i - y), 0.));
+        int min_x = std::floor(x - delta + 0.5);
+        int max_x = std::floor(x + delta + 0.5);
+        // Clip to bounds of grid.
+        min_x = std::max(min_x, 0);
+        max_x = std::min(max_x, grid.width() - 1);
+
+        if (min_x <= max_x) {
+          grid.setSpan(i, min_x, max_x);
+        }
+      }
+    }
+
+    vector<BitGrid> levels_;
+    cv::Size size_;
+    double radius_;
+    double log_step_;
+    int scale_radius_;
+};
 
 struct ScoredPixel {
   cv::Point pos;
   double score;
+  // Pyramid level at which the pixel was found.
+  int level;
 
   bool operator<(const ScoredPixel& other) const {
     return score < other.score;
   }
 
-  ScoredPixel(cv::Point pos, double score) : pos(pos), score(score) {}
+  ScoredPixel(cv::Point pos, double score, int level = 0)
+      : pos(pos), score(score), level(level) {}
 };
 
-// This is an object to avoid re-allocating cornerness map.
+// Is cornerness above threshold and no less than that of its 4 neighbours?
+inline bool isLocalMaximum(const cv::Mat& cornerness,
+                           cv::Point pos,
+                           double threshold) {
+  double score = cornerness.at<float>(pos);
+  if (score < threshold) {
+    return false;
+  }
+
+  double right = cornerness.at<float>(pos + cv::Point( 1,  0));
+  double left  = cornerness.at<float>(pos + cv::Point(-1,  0));
+  double above = cornerness.at<float>(pos + cv::Point( 0, -1));
+  double below = cornerness.at<float>(pos + cv::Point( 0,  1));
+
+  return score >= right && score >= left && score >= above && score >= below;
+}
+
+// Ratio of scales between octaves of similarity feature detection.
+const double DETECTION_SCALE_STEP = 2.;
+// Number of neighbouring scale levels in which a similarity feature prevents
+// detection.
+const int SCALE_CLEARANCE_LEVELS = 1;
+
+// Number of occupancy cells along each side of a detection block.
+const int DETECTION_BLOCK_CELLS = 4;
+
+// This is an object to avoid re-allocating the cornerness map, occupancy grid
+// and candidate list.
+//
+// Detection is bucketed into blocks of occupancy cells. Cornerness is only
+// evaluated in blocks which contain an empty cell, and candidates are only
+// taken from empty cells, so the parts of the image which are already full of
+// features cost nothing.
+//
+// This differs from testing clearance at every pixel in one respect: a cell
+// is skipped as soon as it contains a feature, even where parts of the cell
+// are further than the clearance from it. Among the candidates, occupancy is
+// as before: a candidate is rejected if any earlier candidate, accepted or
+// not, or any existing feature lies within the clearance.
 class FeatureDetector {
   public:
-    FeatureDetector() : cornerness_() {}
-    FeatureDetector(cv::Size size) : cornerness_(cv::Mat_<float>(size)) {}
+    FeatureDetector()
+        : occupancy_(),
+          scale_space_(),
+          cornerness_(),
+          pyramid_(),
+          pyramid_cornerness_(),
+          pixels_() {}
+    FeatureDetector(cv::Size size)
+        : occupancy_(),
+          scale_space_(),
+          cornerness_(cv::Mat_<float>(size)),
+          pyramid_(),
+          pyramid_cornerness_(),
+          pixels_() {}
 
     void reserve(cv::Size size) {
       cornerness_.create(size, cv::DataType<float>::type);
     }
 
+    // Rebuilds the occupancy grid from the positions of the surviving
+    // features. This is linear in the number of features and must precede
+    // detect().
+    void updateOccupancy(cv::Size size,
+                         const TrackedFeatureList& features,
+                         double min_clearance) {
+      occupancy_.reset(size, min_clearance);
+
+      const vector<int>& slots = features.slots();
+      vector<int>::const_iterator slot;
+      for (slot = slots.begin(); slot != slots.end(); ++slot) {
+        if (features.isTranslation(*slot)) {
+          const TranslationWarp& warp = features.translation(*slot);
+          occupancy_.add(cv::Point2d(warp.x(), warp.y()));
+        } else {
+          const SimilarityWarp& warp = features.similarity(*slot);
+          occupancy_.add(cv::Point2d(warp.x(), warp.y()));
+        }
+      }
+    }
+
+    // Fraction of occupancy cells which contain a feature.
+    double coverage() const {
+      return occupancy_.coverage();
+    }
+
+    // Only blocks which meet the region of interest are scanned, and only
+    // pixels within it are candidates.
     void detect(const cv::Mat& image,
                 const cv::Mat& float_image,
                 TrackedFeatureList& features,
+                const RegionOfInterest& roi,
                 int block_size,
                 int k_size,
-                double min_clearance,
                 double threshold,
                 int diameter,
                 int interpolation) {
-      // Calculate cornerness at every pixel.
-      cv::cornerMinEigenVal(float_image, cornerness_, block_size, k_size);
-
-      // Populate occupancy map with location of existing translation features.
       const cv::Size size = cornerness_.size();
-      OccupancyMap occupancy(size, min_clearance);
-
-      TrackedFeatureList::const_iterator it;
-      for (it = features.begin(); it != features.end(); ++it) {
-        const TrackedFeature& feature = it->second;
-
-        if (feature.isTranslation()) {
-          const TranslationWarp& warp = feature.translation();
-          occupancy.add(cv::Point2d(warp.x(), warp.y()));
-        }
-      }
+      CHECK(size == float_image.size());
+      CHECK(occupancy_.rows() > 0) << "Occupancy has not been updated";
 
-      // Build list of local maxima.
-      typedef vector<ScoredPixel> PixelList;
-      PixelList pixels;
+      // Extent of pixels at which features can be detected.
       int radius = (diameter - 1) / 2;
-
-      for (int x = radius; x < size.width - radius - 1; x += 1) {
-        for (int y = radius; y < size.height - radius - 1; y += 1) {
-          cv::Point pos(x, y);
-          double score = cornerness_.at<float>(pos);
-          bool use;
-
-          double right = cornerness_.at<float>(pos + cv::Point( 1,  0));
-          double left  = cornerness_.at<float>(pos + cv::Point(-1,  0));
-          double above = cornerness_.at<float>(pos + cv::Point( 0, -1));
-          double below = cornerness_.at<float>(pos + cv::Point( 0,  1));
-
-          if (score < threshold) {
-            use = false;
-          } else {
-            if (score >= right && score >= left &&
-                score >= above && score >= below) {
-              use = true;
-            } else {
-              use = false;
-            }
+      cv::Rect valid(radius, radius, size.width - 2 * radius - 1,
+          size.height - 2 * radius - 1);
+      // Border around a block within which cornerness differs from that of
+      // the whole image, plus one pixel for the local maximum test.
+      int margin = block_size / 2 + k_size / 2 + 2;
+      cv::Rect bounds(cv::Point(0, 0), size);
+
+      pixels_.clear();
+
+      for (int i = 0; i < occupancy_.rows(); i += DETECTION_BLOCK_CELLS) {
+        for (int j = 0; j < occupancy_.cols(); j += DETECTION_BLOCK_CELLS) {
+          int max_i = std::min(i + DETECTION_BLOCK_CELLS, occupancy_.rows());
+          int max_j = std::min(j + DETECTION_BLOCK_CELLS, occupancy_.cols());
+
+          if (!hasEmptyCell(i, j, max_i, max_j)) {
+            continue;
           }
 
-          if (use) {
-            pixels.push_back(ScoredPixel(pos, score));
+          // Pixels whose cells lie in this block.
+          double cell_size = occupancy_.cellSize();
+          int min_x = std::ceil(j * cell_size);
+          int min_y = std::ceil(i * cell_size);
+          int max_x = std::ceil(max_j * cell_size);
+          int max_y = std::ceil(max_i * cell_size);
+          cv::Rect block = cv::Rect(min_x, min_y, max_x - min_x,
+              max_y - min_y) & valid;
+          if (block.area() == 0 || !roi.intersects(block)) {
+            continue;
           }
+
+          // Calculate cornerness over the block and its margin, in place
+          // within the full-size map.
+          cv::Rect region = cv::Rect(block.x - margin, block.y - margin,
+              block.width + 2 * margin, block.height + 2 * margin) & bounds;
+          cv::Mat cornerness = cornerness_(region);
+          cv::cornerMinEigenVal(float_image(region), cornerness, block_size,
+              k_size);
+          DCHECK(cornerness.data == cornerness_(region).data);
+
+          findLocalMaxima(block, roi, threshold);
         }
       }
 
-      std::make_heap(pixels.begin(), pixels.end());
+      std::make_heap(pixels_.begin(), pixels_.end());
       int num_added = 0;
 
-      while (!pixels.empty()) {
+      while (!pixels_.empty()) {
         // Take next best pixel.
-        const ScoredPixel& pixel = pixels.front();
-        std::pop_heap(pixels.begin(), pixels.end());
-        pixels.pop_back();
+        ScoredPixel pixel = pixels_.front();
+        std::pop_heap(pixels_.begin(), pixels_.end());
+        pixels_.pop_back();
 
         // Add to list if not occupied.
-        if (!occupancy.occupied(pixel.pos)) {
+        if (!occupancy_.occupied(pixel.pos)) {
           TranslationWarp warp(pixel.pos.x, pixel.pos.y);
-          // Sample patch appearance.
-          cv::Mat patch;
-          samplePatch(warp, image, patch, diameter, false, interpolation);
+          int slot = features.add(warp, randomColor(SATURATION, BRIGHTNESS));
 
-          TrackedFeature feature(warp, randomColor(SATURATION, BRIGHTNESS));
-          std::swap(feature.appearance(), patch);
+          // Sample patch appearance, directly into the list.
+          cv::Mat patch = features.appearance(slot);
+          samplePatch(warp, image, patch, diameter, false, interpolation);
+          DCHECK(patch.data == features.appearance(slot).data);
 
-          features.add().swap(feature);
           num_added += 1;
         }
 
-        // Add to occupancy map.
-        occupancy.add(pixel.pos);
+        // Add to occupancy map. Rejected candidates also suppress weaker
+        // ones around them.
+        occupancy_.add(pixel.pos);
       }
 
       LOG(INFO) << "Added " << num_added << " features";
     }
 
+    // Detects similarity features in num_levels octaves of the image.
+    // Candidates at all scales compete by cornerness, and are kept apart in
+    // position and scale by a ScaleSpaceOccupancyMap. Cornerness is only
+    // computed within the regions of interest.
+    void detectSimilarity(const cv::Mat& image,
+                          const cv::Mat& float_image,
+                          TrackedFeatureList& features,
+                          const RegionOfInterest& roi,
+                          int block_size,
+                          int k_size,
+                          double min_clearance,
+                          double threshold,
+                          int diameter,
+                          int num_levels,
+                          int interpolation) {
+      CHECK(num_levels > 0);
+      cv::buildPyramid(float_image, pyramid_, num_levels - 1);
+      pyramid_cornerness_.resize(num_levels);
+      scale_space_.reset(float_image.size(), min_clearance,
+          DETECTION_SCALE_STEP, SCALE_CLEARANCE_LEVELS);
+
+      // Populate occupancy with existing features at their scales.
+      const vector<int>& slots = features.slots();
+      vector<int>::const_iterator slot;
+      for (slot = slots.begin(); slot != slots.end(); ++slot) {
+        if (features.isSimilarity(*slot)) {
+          const SimilarityWarp& warp = features.similarity(*slot);
+          scale_space_.add(warp.x(), warp.y(), std::exp(warp.logScale()));
+        } else {
+          const TranslationWarp& warp = features.translation(*slot);
+          scale_space_.add(warp.x(), warp.y(), 1);
+        }
+      }
+
+      // Build list of local maxima at every level.
+      pixels_.clear();
+      for (int level = 0; level < num_levels; level += 1) {
+        cv::Mat& cornerness = pyramid_cornerness_[level];
+        computeCornerness(pyramid_[level], roi, level, block_size, k_size,
+            cornerness);
+
+        int scale = 1 << level;
+        for (int x = 1; x < cornerness.cols - 1; x += 1) {
+          for (int y = 1; y < cornerness.rows - 1; y += 1) {
+            cv::Point pos(x, y);
+            if (!roi.contains(cv::Point(std::min(x * scale, image.cols - 1),
+                    std::min(y * scale, image.rows - 1)))) {
+              continue;
+            }
+            if (isLocalMaximum(cornerness, pos, threshold)) {
+              pixels_.push_back(ScoredPixel(pos, cornerness.at<float>(pos),
+                    level));
+            }
+          }
+        }
+      }
+
+      std::make_heap(pixels_.begin(), pixels_.end());
+      int radius = (diameter - 1) / 2;
+      int num_added = 0;
+
+      while (!pixels_.empty()) {
+        // Take next best pixel.
+        ScoredPixel pixel = pixels_.front();
+        std::pop_heap(pixels_.begin(), pixels_.end());
+        pixels_.pop_back();
+
+        // Each level of cv::buildPyramid() halves the resolution.
+        double scale = 1 << pixel.level;
+        double x = pixel.pos.x * scale;
+        double y = pixel.pos.y * scale;
+
+        if (scale_space_.occupied(x, y, scale)) {
+          continue;
+        }
+
+        SimilarityWarp warp(x, y, std::log(scale), 0);
+        if (!warp.isValid(image.size(), radius)) {
+          continue;
+        }
+        int slot = features.add(warp, randomColor(SATURATION, BRIGHTNESS));
+
+        // Sample patch appearance, directly into the list.
+        cv::Mat patch = features.appearance(slot);
+        samplePatch(warp, image, patch, diameter, false, interpolation);
+        DCHECK(patch.data == features.appearance(slot).data);
+
+        scale_space_.add(x, y, scale);
+        num_added += 1;
+      }
+
+      LOG(INFO) << "Added " << num_added << " similarity features";
+    }
+
   private:
+    // Computes the cornerness of a level of the pyramid within the regions of
+    // interest, scaled down to the level, and zero elsewhere.
+    static void computeCornerness(const cv::Mat& image,
+                                  const RegionOfInterest& roi,
+                                  int level,
+                                  int block_size,
+                                  int k_size,
+                                  cv::Mat& cornerness) {
+      if (roi.all()) {
+        cv::cornerMinEigenVal(image, cornerness, block_size, k_size);
+        return;
+      }
+
+      cornerness.create(image.size(), cv::DataType<float>::type);
+      cornerness.setTo(0);
+      int scale = 1 << level;
+      cv::Rect bounds(cv::Point(0, 0), image.size());
+
+      const vector<cv::Rect>& regions = roi.regions();
+      vector<cv::Rect>::const_iterator region;
+      for (region = regions.begin(); region != regions.end(); ++region) {
+        int min_x = region->x / scale;
+        int min_y = region->y / scale;
+        int max_x = (region->x + region->width + scale - 1) / scale;
+        int max_y = (region->y + region->height + scale - 1) / scale;
+        cv::Rect rect = cv::Rect(min_x, min_y, max_x - min_x,
+            max_y - min_y) & bounds;
+        if (rect.area() == 0) {
+          continue;
+        }
+        cv::Mat part = cornerness(rect);
+        cv::cornerMinEigenVal(image(rect), part, block_size, k_size);
+        DCHECK(part.data == cornerness(rect).data);
+      }
+    }
+
+    bool hasEmptyCell(int min_i, int min_j, int max_i, int max_j) const {
+      for (int i = min_i; i < max_i; i += 1) {
+        for (int j = min_j; j < max_j; j += 1) {
+          if (occupancy_.empty(i, j)) {
+            return true;
+          }
+        }
+      }
+      return false;
+    }
+
+    // Adds the local maxima of cornerness in empty cells of the block to the
+    // candidate list.
+    void findLocalMaxima(const cv::Rect& block,
+                         const RegionOfInterest& roi,
+                         double threshold) {
+      for (int x = block.x; x < block.x + block.width; x += 1) {
+        int col = occupancy_.cellCol(x);
+
+        for (int y = block.y; y < block.y + block.height; y += 1) {
+          if (!occupancy_.empty(occupancy_.cellRow(y), col)) {
+            continue;
+          }
+
+          cv::Point pos(x, y);
+          if (!roi.contains(pos)) {
+            continue;
+          }
+          if (isLocalMaximum(cornerness_, pos, threshold)) {
+            pixels_.push_back(ScoredPixel(pos, cornerness_.at<float>(pos)));
+          }
+        }
+      }
+    }
+
+    OccupancyGrid occupancy_;
+    ScaleSpaceOccupancyMap scale_space_;
     cv::Mat cornerness_;
+    vector<cv::Mat> pyramid_;
+    vector<cv::Mat> pyramid_cornerness_;
+    vector<ScoredPixel> pixels_;
 };
 
+// Features which were deferred are left out, since their positions are
+// only predictions.
 void addFeaturesToFrame(const TrackedFeatureList& features,
                         TrackList::Frame& frame) {
-  TrackedFeatureList::const_iterator it;
+  const vector<int>& slots = features.slots();
+  vector<int>::const_iterator slot;
 
-  for (it = features.begin(); it != features.end(); ++it) {
-    int id = it->first;
-    const TrackedFeature& feature = it->second;
-
-    if (!feature.isTranslation()) {
+  for (slot = slots.begin(); slot != slots.end(); ++slot) {
+    if (features.numDeferred(*slot) > 0) {
       continue;
     }
 
-    const TranslationWarp& warp = feature.translation();
+    // Only the position of similarity features is recorded.
+    // Constructed in place, on the arena of the frame if it has one.
+    TrackList::Point* point = frame.add_points();
+    point->set_id(features.id(*slot));
+    if (features.isTranslation(*slot)) {
+      const TranslationWarp& warp = features.translation(*slot);
+      point->set_x(warp.x());
+      point->set_y(warp.y());
+    } else {
+      const SimilarityWarp& warp = features.similarity(*slot);
+      point->set_x(warp.x());
+      point->set_y(warp.y());
+    }
+  }
+}
 
-    TrackList::Point point;
-    point.set_id(id);
-    point.set_x(warp.x());
-    point.set_y(warp.y());
+// Copy of what is needed to draw a feature once tracking has moved on.
+struct DrawnFeature {
+  boost::shared_ptr<Warp> warp;
+  cv::Vec3b color;
+};
 
-    frame.mutable_points()->Add()->Swap(&point);
+void listDrawnFeatures(const TrackedFeatureList& features,
+                       vector<DrawnFeature>& drawn) {
+  drawn.clear();
+  drawn.reserve(features.size());
+
+  const vector<int>& slots = features.slots();
+  vector<int>::const_iterator slot;
+  for (slot = slots.begin(); slot != slots.end(); ++slot) {
+    DrawnFeature copy;
+    if (features.isSimilarity(*slot)) {
+      copy.warp.reset(new SimilarityWarp(features.similarity(*slot)));
+    } else {
+      copy.warp.reset(new TranslationWarp(features.translation(*slot)));
+    }
+    copy.color = features.color(*slot);
+    drawn.push_back(copy);
   }
 }
 
-void drawFeatures(const TrackedFeatureList& features,
+void drawFeatures(const vector<DrawnFeature>& features,
+                  const cv::Mat& integer_image,
                   cv::Mat& image,
                   int radius) {
+  // Convert grayscale back to color for displaying.
+  cv::cvtColor(integer_image, image, CV_GRAY2BGR);
+
   // Draw features.
-  TrackedFeatureList::const_iterator it;
+  vector<DrawnFeature>::const_iterator it;
   for (it = features.begin(); it != features.end(); ++it) {
-    const TrackedFeature& feature = it->second;
-    cv::Vec3b color = feature.color();
-    cv::Scalar scalar(color[0], color[1], color[2]);
-    feature.warp().draw(image, radius, scalar, LINE_THICKNESS);
+    cv::Scalar scalar(it->color[0], it->color[1], it->color[2]);
+    it->warp->draw(image, radius, scalar, LINE_THICKNESS);
+  }
+}
+
+// Produces the mask of interest of each frame in turn, from a rectangle, a
+// mask image or a format of them, or a foreground segmentation.
+class RoiSource {
+  public:
+    RoiSource()
+        : has_rect_(false), rect_(), mask_(), format_(), foreground_(),
+          frame_(), n_(0), static_roi_(), has_static_roi_(false) {}
+
+    // Returns false if the rectangle could not be parsed or a file could not
+    // be opened. At most one of the arguments may be given.
+    bool open(const string& rect,
+              const string& mask,
+              const string& foreground) {
+      int num_given = !rect.empty() + !mask.empty() + !foreground.empty();
+      CHECK(num_given <= 1) << "More than one region of interest";
+
+      if (!rect.empty()) {
+        char end;
+        int n = std::sscanf(rect.c_str(), "%d,%d,%d,%d%c", &rect_.x, &rect_.y,
+            &rect_.width, &rect_.height, &end);
+        has_rect_ = true;
+        return n == 4;
+      }
+
+      if (!mask.empty()) {
+        if (mask.find('%') != string::npos) {
+          format_ = mask;
+          return true;
+        }
+        mask_ = cv::imread(mask, CV_LOAD_IMAGE_GRAYSCALE);
+        return !mask_.empty();
+      }
+
+      if (!foreground.empty()) {
+        foreground_.reset(new videoseg::VideoSegmentationStreamReader);
+        return foreground_->open(foreground);
+      }
+
+      return true;
+    }
+
+    bool enabled() const {
+      return has_rect_ || !mask_.empty() || !format_.empty() || foreground_;
+    }
+
+    // Finds the region of interest of the next frame. A rectangle or a
+    // single mask is the same in every frame, so its tiles are found once.
+    bool next(cv::Size size, int margin, RegionOfInterest& roi) {
+      bool is_static = has_rect_ || !mask_.empty();
+      if (is_static && has_static_roi_ &&
+          static_roi_.mask().size() == size) {
+        n_ += 1;
+        roi = static_roi_;
+        return true;
+      }
+
+      cv::Mat mask;
+      if (!next(size, mask)) {
+        return false;
+      }
+      roi = RegionOfInterest(mask, ROI_TILE_SIZE, margin);
+      if (is_static) {
+        static_roi_ = roi;
+        has_static_roi_ = true;
+      }
+      return true;
+    }
+
+    // Finds the mask of the next frame, of the size of the frame. Returns
+    // false if it could not be read.
+    bool next(cv::Size size, cv::Mat& mask) {
+      int n = n_;
+      n_ += 1;
+
+      if (has_rect_) {
+        mask = cv::Mat::zeros(size, cv::DataType<uchar>::type);
+        mask(rect_ & cv::Rect(cv::Point(0, 0), size)).setTo(1);
+        return true;
+      }
+
+      if (!format_.empty()) {
+        mask = cv::imread(makeFilename(format_, n), CV_LOAD_IMAGE_GRAYSCALE);
+        return !mask.empty() && mask.size() == size;
+      }
+
+      if (foreground_) {
+        if (!foreground_->read(frame_)) {
+          return false;
+        }
+        rasterizeForeground(frame_, size, mask);
+        return true;
+      }
+
+      mask = mask_;
+      return mask.size() == size;
+    }
+
+  private:
+    typedef videoseg::VideoSegmentation::Frame SegmentationFrame;
+
+    static void rasterizeForeground(const SegmentationFrame& frame,
+                                    cv::Size size,
+                                    cv::Mat& mask) {
+      typedef SegmentationFrame::Region Region;
+      typedef RepeatedPtrField<videoseg::ScanInterval> IntervalList;
+
+      mask = cv::Mat::zeros(size, cv::DataType<uchar>::type);
+      RepeatedPtrField<Region>::const_iterator region;
+      for (region = frame.regions().begin(); region != frame.regions().end();
+           ++region) {
+        if (region->id() != FOREGROUND_LABEL) {
+          continue;
+        }
+
+        const IntervalList& intervals = region->raster().scan_inter();
+        IntervalList::const_iterator interval;
+        for (interval = intervals.begin(); interval != intervals.end();
+             ++interval) {
+          int y = interval->y();
+          int left = std::max(interval->left_x(), 0);
+          int right = std::min(interval->right_x(), size.width - 1);
+          if (y < 0 || y >= size.height || left > right) {
+            continue;
+          }
+          uchar* row = mask.ptr<uchar>(y);
+          std::fill(row + left, row + right + 1, uchar(1));
+        }
+      }
+    }
+
+    bool has_rect_;
+    cv::Rect rect_;
+    cv::Mat mask_;
+    string format_;
+    scoped_ptr<videoseg::VideoSegmentationStreamReader> foreground_;
+    SegmentationFrame frame_;
+    int n_;
+    RegionOfInterest static_roi_;
+    bool has_static_roi_;
+};
+
+// A frame which has been decoded and differentiated, ready to be tracked.
+struct InputFrame {
+  cv::Mat integer_image;
+  cv::Mat float_image;
+  cv::Mat image;
+  ImagePyramid pyramid;
+  // Pixels outside it are zero in the images and gradients.
+  RegionOfInterest roi;
+  // Time taken to decode and convert the frame, and to compute its pyramid.
+  double decode_time;
+  double gradients_time;
+};
+
+// A frame which has been tracked, to be rendered and saved.
+struct OutputFrame {
+  int n;
+  cv::Mat integer_image;
+  vector<DrawnFeature> features;
+};
+
+// First stage of the pipeline: decodes frames and computes their pyramids.
+// Every frame has its own buffers, since it is queued.
+void decodeFrames(cv::VideoCapture* capture,
+                  int pyramid_levels,
+                  bool single_precision,
+                  RoiSource* roi_source,
+                  int roi_margin,
+                  BoundedQueue<InputFrame>* queue) {
+  while (true) {
+    TRACE_SCOPE("decode frame");
+    double start = wallTime();
+    cv::Mat color_image;
+    bool ok = capture->read(color_image);
+    if (!ok) {
+      // Reached end.
+      break;
+    }
+
+    InputFrame frame;
+    // Convert color to intensity.
+    cv::cvtColor(color_image, frame.integer_image, CV_BGR2GRAY);
+
+    if (roi_source->enabled()) {
+      bool ok = roi_source->next(frame.integer_image.size(), roi_margin,
+          frame.roi);
+      CHECK(ok) << "Could not find region of interest of frame";
+    }
+
+    // Convert to floating point in [0, 1], only within the region of
+    // interest. OpenCV corner detection requires single precision.
+    convertRegions(frame.integer_image, frame.float_image,
+        cv::DataType<float>::type, 1. / 255, frame.roi);
+    if (single_precision) {
+      frame.image = frame.float_image;
+    } else {
+      convertRegions(frame.integer_image, frame.image,
+          cv::DataType<double>::type, 1. / 255, frame.roi);
+    }
+    double decoded = wallTime();
+    // Compute pyramid and gradient images once.
+    if (frame.roi.all()) {
+      buildImagePyramid(frame.image, pyramid_levels, frame.pyramid);
+    } else {
+      buildImagePyramid(frame.image, pyramid_levels, frame.roi.regions(),
+          frame.pyramid);
+    }
+    frame.decode_time = decoded - start;
+    frame.gradients_time = wallTime() - decoded;
+
+    queue->push(frame);
+  }
+
+  queue->close();
+}
+
+// Last stage of the pipeline: renders and saves frames.
+void saveFrames(BoundedQueue<OutputFrame>* queue,
+                int radius,
+                const string* format) {
+  OutputFrame frame;
+  cv::Mat visualization;
+
+  while (queue->pop(frame)) {
+    TRACE_SCOPE("save frame");
+    drawFeatures(frame.features, frame.integer_image, visualization, radius);
+    string file = makeFilename(*format, frame.n);
+    cv::imwrite(file, visualization);
+  }
+}
+
+// Cost of tracking one feature, recorded when benchmarking.
+struct FeatureStatistics {
+  double track_time;
+  double appearance_time;
+  FlowStatistics flow;
+
+  FeatureStatistics() : track_time(0), appearance_time(0), flow() {}
+};
+
+// Tracks a feature into the next image and updates its appearance.
+// Returns false if the feature was lost.
+// Statistics are recorded if not NULL.
+bool trackFeature(TrackedFeatureList& features,
+                  int slot,
+                  const ImagePyramid& pyramid,
+                  const PatchMask& mask,
+                  double max_residual,
+                  bool predict_motion,
+                  const FlowOptions& options,
+                  FeatureStatistics* statistics) {
+  double start = (statistics != NULL) ? wallTime() : 0;
+  FlowStatistics* flow_statistics = (statistics != NULL) ?
+      &statistics->flow : NULL;
+  const cv::Mat appearance = features.appearance(slot);
+  // The solver samples the new appearance for the appearance check and
+  // template update.
+  cv::Mat patch = features.spareAppearance(slot);
+  Warp& warp = features.warp(slot);
+  int num_params = warp.numParams();
+  double previous[TrackedFeatureList::MAX_NUM_PARAMS];
+  std::copy(warp.params(), warp.params() + num_params, previous);
+
+  bool predicted = (predict_motion && features.velocity(slot) != NULL);
+  if (predicted) {
+    features.predict(slot);
+  }
+
+  bool tracked = trackPatchPyramid(warp, appearance, pyramid, mask, options,
+      flow_statistics, &patch);
+  if (!tracked && predicted) {
+    // Prediction may have been wrong, e.g. if the feature stopped.
+    std::copy(previous, previous + num_params, warp.params());
+    tracked = trackPatchPyramid(warp, appearance, pyramid, mask, options,
+        flow_statistics, &patch);
+  }
+
+  double solved = (statistics != NULL) ? wallTime() : 0;
+  if (statistics != NULL) {
+    statistics->track_time = solved - start;
+  }
+  if (!tracked) {
+    return false;
+  }
+  features.updateVelocity(slot, previous);
+
+  DCHECK(patch.data == features.spareAppearance(slot).data);
+
+  // Do appearance check.
+  double residual = patchResidual(patch, appearance, mask);
+  if (residual > max_residual) {
+    DLOG(INFO) << "Appearance residual too large (" << residual <<
+        " > " << max_residual << ")";
+    tracked = false;
+    if (flow_statistics != NULL) {
+      flow_statistics->termination = FLOW_APPEARANCE_REJECTED;
+    }
+  }
+
+  // Update appearance.
+  features.swapAppearance(slot);
+
+  if (statistics != NULL) {
+    statistics->appearance_time = wallTime() - solved;
+  }
+
+  return tracked;
+}
+
+// Tracks the k-th feature of a list in the order of the scheduler, or
+// defers it if the deadline has passed. For use with
+// ThreadPool::parallelFor(). Each call writes to a different slot and
+// element of the output.
+class TrackFeatureFunction {
+  public:
+    TrackFeatureFunction(TrackedFeatureList& features,
+                         const FeatureScheduler& scheduler,
+                         vector<char>& tracked,
+                         vector<char>& deferred,
+                         const ImagePyramid& pyramid,
+                         const PatchMask& mask,
+                         double max_residual,
+                         bool predict_motion,
+                         const FlowOptions& options,
+                         vector<FeatureStatistics>* statistics)
+        : features_(&features),
+          scheduler_(&scheduler),
+          tracked_(&tracked),
+          deferred_(&deferred),
+          pyramid_(&pyramid),
+          mask_(&mask),
+          max_residual_(max_residual),
+          predict_motion_(predict_motion),
+          options_(&options),
+          statistics_(statistics) {}
+
+    void operator()(int k) const {
+      int i = scheduler_->order()[k];
+      if (scheduler_->expired(wallTime())) {
+        (*deferred_)[i] = true;
+        return;
+      }
+
+      int slot = features_->slots()[i];
+      FeatureStatistics* statistics = (statistics_ != NULL) ?
+          &(*statistics_)[i] : NULL;
+      (*tracked_)[i] = trackFeature(*features_, slot, *pyramid_, *mask_,
+          max_residual_, predict_motion_, *options_, statistics);
+    }
+
+  private:
+    TrackedFeatureList* features_;
+    const FeatureScheduler* scheduler_;
+    vector<char>* tracked_;
+    vector<char>* deferred_;
+    const ImagePyramid* pyramid_;
+    const PatchMask* mask_;
+    double max_residual_;
+    bool predict_motion_;
+    const FlowOptions* options_;
+    vector<FeatureStatistics>* statistics_;
+};
+
+// Ranks the features of a list for the scheduler.
+void listFeaturePriorities(const TrackedFeatureList& features,
+                           vector<double>& priorities) {
+  const vector<int>& slots = features.slots();
+  priorities.resize(slots.size());
+  for (int i = 0; i < int(slots.size()); i += 1) {
+    int slot = slots[i];
+    priorities[i] = featurePriority(false, features.numDeferred(slot),
+        features.age(slot), patchTexture(features.appearance(slot)));
   }
 }
 
 void detectAndTrack(cv::VideoCapture& capture,
-                    TrackList& tracks,
+                    RoiSource& roi,
+                    int roi_margin,
+                    AsyncTrackListWriter& tracks,
                     int radius,
                     double threshold,
                     double min_clearance,
+                    int detect_interval,
+                    double target_coverage,
+                    bool detect_similarity,
+                    int detect_levels,
                     double mask_sigma,
                     double max_residual,
                     const FlowOptions& options,
+                    int pyramid_levels,
+                    bool single_precision,
+                    bool predict_motion,
+                    double deadline,
+                    int min_iterations,
+                    int max_deferred,
+                    int pipeline_depth,
+                    ThreadPool& pool,
                     bool display,
-                    const std::string& save) {
-  // Construct mask.
+                    const std::string& save,
+                    bool solver_statistics,
+                    Benchmark* benchmark) {
+  // Construct mask and list its non-zero pixels once.
   int diameter = radius * 2 + 1;
-  cv::Mat mask = makeGaussian(mask_sigma, diameter);
-  // Draw tracks?
-  bool render = (display || !save.empty());
+  PatchMask mask(makeGaussian(mask_sigma, diameter));
+
+  // Decoding and saving run in their own threads, either side of tracking.
+  BoundedQueue<InputFrame> input(pipeline_depth);
+  BoundedQueue<OutputFrame> output(pipeline_depth);
+  boost::thread decoder(boost::bind(decodeFrames, &capture, pyramid_levels,
+        single_precision, &roi, roi_margin, &input));
+  scoped_ptr<boost::thread> saver;
+  if (!save.empty()) {
+    saver.reset(new boost::thread(boost::bind(saveFrames, &output, radius,
+          &save)));
+  }
 
   // Loop state.
-  bool end = false;
   int n = 0;
+  int frames_since_detection = 0;
 
   // Features currently being tracked.
-  TrackedFeatureList features;
+  TrackedFeatureList features(diameter);
 
   // Memory that is re-used every loop.
-  cv::Mat image;
-  cv::Mat color_image;
-  cv::Mat integer_image;
-  cv::Mat float_image;
-  cv::Mat ddx;
-  cv::Mat ddy;
+  InputFrame input_frame;
+  vector<char> tracked;
+  vector<FeatureStatistics> statistics;
+  vector<DrawnFeature> drawn;
   cv::Mat visualization;
 
-  const cv::Mat diff = (cv::Mat_<double>(1, 3) << -0.5, 0, 0.5);
-  const cv::Mat identity = (cv::Mat_<double>(1, 1) << 1);
+  vector<char> deferred;
+  vector<double> priorities;
 
   FeatureDetector detector;
+  double previous_end = wallTime();
+
+  FeatureScheduler scheduler(deadline, min_iterations,
+      options.solver_options.max_num_iterations, pyramid_levels);
+  FlowOptions frame_options = options;
+
+  // Solver statistics are collected for any of these, the scheduler to
+  // learn the cost of an iteration.
+  bool collect_statistics = (benchmark != NULL || solver_statistics ||
+      scheduler.enabled());
+  FlowHistogram frame_histogram;
+  FlowHistogram run_histogram;
 
   // Read frames of video.
-  while (!end) {
-    // Read next frame.
-    bool ok = capture.read(color_image);
-    if (!ok) {
-      // Reached end.
-      end = true;
-      continue;
-    }
+  while (input.pop(input_frame)) {
+    const cv::Mat& image = input_frame.image;
+    const ImagePyramid& pyramid = input_frame.pyramid;
 
     LOG(INFO) << "Tracking " << features.size() << " features";
+    TRACE_STAGES(stages);
+    TRACE_NEXT_STAGE(stages, "track");
+    TRACE_COUNT("features tracked", features.size());
+
+    // Track features from the previous image, in parallel, in order of
+    // priority until the deadline.
+    double start = wallTime();
+    if (scheduler.enabled()) {
+      listFeaturePriorities(features, priorities);
+    } else {
+      priorities.assign(features.size(), 0.);
+    }
+    scheduler.begin(start, priorities);
+    // Stopping short of the usual limit is no failure.
+    frame_options.solver_options.max_num_iterations = scheduler.iterations();
+    frame_options.iteration_limit_is_fatal = options.iteration_limit_is_fatal &&
+        scheduler.iterations() >= options.solver_options.max_num_iterations;
+
+    tracked.assign(features.size(), false);
+    deferred.assign(features.size(), false);
+    if (collect_statistics) {
+      statistics.assign(features.size(), FeatureStatistics());
+    }
+    TrackFeatureFunction track(features, scheduler, tracked, deferred,
+        pyramid, mask, max_residual, predict_motion, frame_options,
+        collect_statistics ? &statistics : NULL);
+    pool.parallelFor(0, features.size(), track);
+    double tracking_end = wallTime();
+
+    if (scheduler.enabled()) {
+      int num_iterations = 0;
+      vector<FeatureStatistics>::const_iterator feature;
+      for (feature = statistics.begin(); feature != statistics.end();
+          ++feature) {
+        num_iterations += feature->flow.num_iterations;
+      }
+      scheduler.end(tracking_end, num_iterations);
+    }
 
-    // Convert color to intensity.
-    cv::cvtColor(color_image, integer_image, CV_BGR2GRAY);
-    // Convert to floating point in [0, 1].
-    integer_image.convertTo(image, cv::DataType<double>::type, 1. / 255);
-    // Purely for OpenCV corner detection.
-    integer_image.convertTo(float_image, cv::DataType<float>::type, 1. / 255);
-    // Compute gradient images once.
-    cv::sepFilter2D(image, ddx, -1, diff, identity);
-    cv::sepFilter2D(image, ddy, -1, identity, diff);
-
-    int num_removed = 0;
-
-    TrackedFeatureList::iterator it = features.begin();
-    while (it != features.end()) {
-      TrackedFeature& feature = it->second;
-
-      // Track features from the previous image.
-      bool tracked = trackPatch(feature.warp(), feature.appearance(), image,
-          ddx, ddy, mask, options);
-
-      if (tracked) {
-        // Sample patch for appearance check and template update.
-        cv::Mat patch;
-        samplePatch(feature.warp(), image, patch, diameter, false,
-            options.interpolation);
-
-        // Do appearance check.
-        double residual = patchResidual(patch, feature.appearance(), mask);
-        if (residual > max_residual) {
-          DLOG(INFO) << "Appearance residual too large (" << residual <<
-              " > " << max_residual << ")";
-          tracked = false;
-        }
+    // Carry deferred features forward on their prediction, unless they have
+    // waited too long.
+    int num_deferred = 0;
+    for (int i = 0; i < features.size(); i += 1) {
+      int slot = features.slots()[i];
+      if (!deferred[i]) {
+        features.markTracked(slot);
+      } else if (features.numDeferred(slot) < max_deferred) {
+        features.predict(slot);
+        features.markDeferred(slot);
+        tracked[i] = true;
+        num_deferred += 1;
+      }
+    }
+
+    // Erase features which failed to track.
+    int num_removed = features.removeIf(tracked);
+
+    LOG(INFO) << "Removed " << num_removed << " features";
+    if (scheduler.enabled()) {
+      LOG(INFO) << "Deferred " << num_deferred << " features, " <<
+          scheduler.iterations() << " iterations each";
+    }
 
-        // Update appearance.
-        std::swap(feature.appearance(), patch);
+    if (solver_statistics) {
+      frame_histogram.clear();
+      vector<FeatureStatistics>::const_iterator feature;
+      for (feature = statistics.begin(); feature != statistics.end();
+          ++feature) {
+        // Deferred features were not solved.
+        if (feature->flow.num_calls > 0) {
+          frame_histogram.add(feature->flow);
+        }
       }
+      run_histogram.add(frame_histogram);
 
-      // Erase feature if failed to track. Move to next feature.
-      if (!tracked) {
-        features.erase(it++);
-        num_removed += 1;
+      std::ostringstream line;
+      frame_histogram.writeLine(line);
+      LOG(INFO) << "Frame " << n << ": " << line.str();
+    }
+    TRACE_COUNT("features removed", num_removed);
+    TRACE_NEXT_STAGE(stages, "detect");
+
+    // Detect new features, unless the image is well covered and the last
+    // detection was recent.
+    detector.updateOccupancy(image.size(), features, min_clearance);
+    frames_since_detection += 1;
+
+    // Only the region of interest can be covered.
+    const RegionOfInterest& frame_roi = input_frame.roi;
+    if (frames_since_detection >= detect_interval ||
+        detector.coverage() < target_coverage * frame_roi.coverage()) {
+      if (detect_similarity) {
+        detector.detectSimilarity(image, input_frame.float_image, features,
+            frame_roi, radius, 3, min_clearance, threshold, diameter,
+            detect_levels, options.interpolation);
       } else {
-        ++it;
+        detector.reserve(image.size());
+        detector.detect(image, input_frame.float_image, features, frame_roi,
+            radius, 3, threshold, diameter, options.interpolation);
       }
+      frames_since_detection = 0;
+    } else {
+      LOG(INFO) << "Skipped detection at coverage " << detector.coverage();
     }
+    double detection_end = wallTime();
+    TRACE_NEXT_STAGE(stages, "serialize");
+
+    // Add all features to structure and queue it to be written.
+    // Only waits if the writer is behind by the depth of the pipeline.
+    TrackList::Frame* frame = tracks.newFrame();
+    addFeaturesToFrame(features, *frame);
+    tracks.write();
+    double serialization_end = wallTime();
+
+    if (benchmark != NULL) {
+      FrameTiming timing;
+      timing.stages[DECODE_STAGE] = input_frame.decode_time;
+      timing.stages[GRADIENTS_STAGE] = input_frame.gradients_time;
+
+      // Features are tracked in parallel, so split the wall time of the
+      // tracking loop in proportion to the time each feature spent solving
+      // and checking appearance.
+      double track_time = 0;
+      double appearance_time = 0;
+      vector<FeatureStatistics>::const_iterator feature;
+      for (feature = statistics.begin(); feature != statistics.end();
+          ++feature) {
+        track_time += feature->track_time;
+        appearance_time += feature->appearance_time;
+        if (feature->flow.num_calls > 0) {
+          benchmark->addFeature(feature->flow);
+        }
+      }
+      double loop_time = tracking_end - start;
+      double feature_time = track_time + appearance_time;
+      if (feature_time > 0) {
+        timing.stages[TRACKING_STAGE] = loop_time * track_time / feature_time;
+        timing.stages[APPEARANCE_STAGE] = loop_time * appearance_time /
+          feature_time;
+      } else {
+        timing.stages[TRACKING_STAGE] = loop_time;
+      }
 
-    LOG(INFO) << "Removed " << num_removed << " features";
-
-    // Detect new features.
-    detector.reserve(color_image.size());
-    detector.detect(image, float_image, features, radius, 3, min_clearance,
-        threshold, diameter, options.interpolation);
+      timing.stages[DETECTION_STAGE] = detection_end - tracking_end;
+      timing.stages[SERIALIZATION_STAGE] = serialization_end - detection_end;
+      timing.total = serialization_end - previous_end;
+      benchmark->addFrame(timing);
+    }
+    previous_end = serialization_end;
+    TRACE_NEXT_STAGE(stages, "display");
 
-    // Add all features to structure.
-    TrackList::Frame frame;
-    addFeaturesToFrame(features, frame);
-    tracks.mutable_frames()->Add()->Swap(&frame);
+    if (display || !save.empty()) {
+      listDrawnFeatures(features, drawn);
+    }
 
-    if (render) {
-      // Convert grayscale back to color for displaying.
-      cv::cvtColor(integer_image, visualization, CV_GRAY2BGR);
-      drawFeatures(features, visualization, radius);
+    if (display) {
+      // HighGUI must be used from this thread.
+      drawFeatures(drawn, input_frame.integer_image, visualization, radius);
+      cv::imshow("Tracks", visualization);
+      cv::waitKey(1000. / 30);
+    }
 
-      if (display) {
-        cv::imshow("Tracks", visualization);
-        cv::waitKey(1000. / 30);
-      }
-      if (!save.empty()) {
-        string file = makeFilename(save, n);
-        cv::imwrite(file, visualization);
-      }
+    if (!save.empty()) {
+      OutputFrame output_frame;
+      output_frame.n = n;
+      output_frame.integer_image = input_frame.integer_image;
+      output_frame.features.swap(drawn);
+      output.push(output_frame);
     }
 
     n += 1;
   }
-}
 
-int main(int argc, char** argv) {
-  init(argc, argv);
+  output.close();
+  decoder.join();
+  if (saver) {
+    saver->join();
+  }
 
-  string video_file = argv[1];
-  string tracks_file = argv[2];
+  if (solver_statistics) {
+    std::ostringstream summary;
+    run_histogram.write(summary);
+    LOG(INFO) << "Solver statistics of " << n << " frames:" << std::endl <<
+        summary.str();
+  }
+}
 
+// Tracks one video to a file of tracks.
+void trackVideo(const string& video_file,
+                const string& tracks_file,
+                const FlowOptions& options,
+                ThreadPool& pool,
+                bool display,
+                const string& save,
+                Benchmark* benchmark) {
   bool ok;
 
   // Open video stream.
   cv::VideoCapture capture;
   ok = capture.open(video_file);
-  CHECK(ok) << "Could not open video stream";
+  CHECK(ok) << "Could not open video stream " << video_file;
+
+  RoiSource roi;
+  ok = roi.open(FLAGS_roi, FLAGS_roi_mask, FLAGS_roi_foreground);
+  CHECK(ok) << "Could not open region of interest";
+
+  // Frames are written as they are completed, in a thread of their own.
+  AsyncTrackListWriter tracks(FLAGS_packed, FLAGS_pipeline_depth);
+  ok = tracks.open(tracks_file);
+  CHECK(ok) << "Could not open output file " << tracks_file;
+
+  // Features move up to about one patch radius at the coarsest level.
+  int roi_margin = FLAGS_roi_margin;
+  if (roi_margin < 0) {
+    roi_margin = (FLAGS_radius << (FLAGS_pyramid_levels - 1)) + 1;
+  }
+
+  detectAndTrack(capture, roi, roi_margin, tracks, FLAGS_radius,
+      FLAGS_threshold, FLAGS_min_clearance, FLAGS_detect_interval,
+      FLAGS_target_coverage, FLAGS_detect_similarity, FLAGS_detect_levels,
+      FLAGS_mask_sigma, FLAGS_max_residual, options, FLAGS_pyramid_levels,
+      FLAGS_single_precision, FLAGS_predict_motion, FLAGS_deadline * 1e-3,
+      FLAGS_min_iter, FLAGS_max_deferred, FLAGS_pipeline_depth, pool, display,
+      save, FLAGS_solver_statistics, benchmark);
+  ok = tracks.close();
+  CHECK(ok) << "Could not write tracks to " << tracks_file;
+}
+
+// A video and the file to write its tracks to.
+struct VideoJob {
+  string video_file;
+  string tracks_file;
+};
+
+// Reads a manifest with one whitespace-separated video and tracks file per
+// line. Blank lines are ignored.
+bool readManifest(const string& filename, vector<VideoJob>& jobs) {
+  std::ifstream file(filename.c_str());
+  if (!file) {
+    return false;
+  }
+
+  jobs.clear();
+  string line;
+  while (std::getline(file, line)) {
+    std::istringstream stream(line);
+    VideoJob job;
+    if (!(stream >> job.video_file)) {
+      continue;
+    }
+    if (!(stream >> job.tracks_file)) {
+      LOG(WARNING) << "No tracks file for \"" << job.video_file << "\"";
+      return false;
+    }
+    jobs.push_back(job);
+  }
+
+  return true;
+}
+
+// Takes videos from a shared list until none remain.
+// Several of these run at once, sharing one pool for tracking.
+void trackVideos(const vector<VideoJob>* jobs,
+                 int* next,
+                 boost::mutex* mutex,
+                 const FlowOptions* options,
+                 ThreadPool* pool) {
+  while (true) {
+    int i;
+    {
+      boost::mutex::scoped_lock lock(*mutex);
+      if (*next >= int(jobs->size())) {
+        return;
+      }
+      i = *next;
+      *next += 1;
+    }
+
+    const VideoJob& job = (*jobs)[i];
+    LOG(INFO) << "Tracking \"" << job.video_file << "\" to \"" <<
+        job.tracks_file << "\"";
+    trackVideo(job.video_file, job.tracks_file, *options, *pool, false, "",
+        NULL);
+  }
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+  TRACE_INIT(FLAGS_trace);
+
+  bool ok;
 
   FlowOptions options;
+  if (FLAGS_inverse_compositional) {
+    options.engine = INVERSE_COMPOSITIONAL_FLOW_ENGINE;
+  } else {
+    options.engine = CERES_FLOW_ENGINE;
+  }
   options.solver_options.linear_solver_type = ceres::DENSE_QR;
   options.solver_options.max_num_iterations = FLAGS_max_iter;
   options.solver_options.function_tolerance = FUNCTION_TOLERANCE;
@@ -640,20 +1913,61 @@ int main(int argc, char** argv) {
   options.solver_options.parameter_tolerance = PARAMETER_TOLERANCE;
   options.solver_options.logging_type = ceres::SILENT;
   options.check_condition = FLAGS_check_condition;
+  options.condition_from_normal_equations =
+    FLAGS_condition_from_normal_equations;
   options.max_condition = FLAGS_max_condition;
   options.iteration_limit_is_fatal = FLAGS_fatal_max_iter;
   options.interpolation = cv::INTER_LINEAR;
 
-  TrackList tracks;
-  detectAndTrack(capture, tracks, FLAGS_radius, FLAGS_threshold,
-      FLAGS_min_clearance, FLAGS_mask_sigma, FLAGS_max_residual, options,
-      FLAGS_display, FLAGS_save);
+  ThreadPool pool(FLAGS_num_threads);
+
+  if (!FLAGS_manifest.empty()) {
+    // Batch mode. Streams are interleaved frame by frame in the pool, so the
+    // last long video still gets every worker.
+    CHECK(FLAGS_benchmark.empty()) << "Cannot benchmark with a manifest";
+    CHECK(FLAGS_roi_foreground.empty()) <<
+        "A foreground segmentation is of only one video";
+    if (FLAGS_display || !FLAGS_save.empty()) {
+      LOG(WARNING) << "Display and saving are disabled with a manifest";
+    }
+
+    vector<VideoJob> jobs;
+    ok = readManifest(FLAGS_manifest, jobs);
+    CHECK(ok) << "Could not read manifest";
+
+    int next = 0;
+    boost::mutex mutex;
+    boost::thread_group streams;
+    int num_streams = std::min(std::max(FLAGS_num_streams, 1),
+        int(jobs.size()));
+    for (int i = 0; i < num_streams; i += 1) {
+      streams.create_thread(boost::bind(trackVideos, &jobs, &next, &mutex,
+            &options, &pool));
+    }
+    streams.join_all();
+
+    return 0;
+  }
+
+  string video_file = argv[1];
+  string tracks_file = argv[2];
+
+  // Benchmarking measures tracking alone.
+  bool display = FLAGS_display;
+  string save = FLAGS_save;
+  scoped_ptr<Benchmark> benchmark;
+  if (!FLAGS_benchmark.empty()) {
+    display = false;
+    save.clear();
+    benchmark.reset(new Benchmark());
+  }
+
+  trackVideo(video_file, tracks_file, options, pool, display, save,
+      benchmark.get());
 
-  LOG(INFO) << "Saving tracks...";
-  std::ofstream ofs(tracks_file.c_str(), std::ios::trunc | std::ios::binary);
-  ok = tracks.SerializeToOstream(&ofs);
-  if (!ok) {
-    LOG(FATAL) << "Could not save output";
+  if (benchmark) {
+    ok = benchmark->write(FLAGS_benchmark);
+    CHECK(ok) << "Could not write benchmark to " << FLAGS_benchmark;
   }
 
   return 0;
@@ -0,0 +1,124 @@
+#include <cmath>
+#include <benchmark/benchmark.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "tracking/flow.hpp"
+#include "tracking/warp.hpp"
+#include "tracking/patch-mask.hpp"
+#include "tracking/translation-warp.hpp"
+#include "tracking/similarity-warp.hpp"
+
+using namespace tracking;
+
+namespace {
+
+const int IMAGE_SIZE = 256;
+const double MASK_SIGMA = 4;
+
+// Smooth random texture, so that the solver has a basin to converge in.
+cv::Mat makeTexture(int size) {
+  cv::RNG rng(0);
+  cv::Mat image(size, size, cv::DataType<double>::type);
+  rng.fill(image, cv::RNG::UNIFORM, 0., 1.);
+  cv::GaussianBlur(image, image, cv::Size(0, 0), 2.);
+  return image;
+}
+
+cv::Mat makeGaussian(double sigma, int width) {
+  cv::Mat g = cv::getGaussianKernel(width, sigma, CV_64F);
+  cv::Mat mask = g * g.t();
+  return mask / mask.at<double>((width - 1) / 2, (width - 1) / 2);
+}
+
+FlowOptions makeOptions(FlowEngine engine) {
+  FlowOptions options;
+  options.engine = engine;
+  options.interpolation = cv::INTER_LINEAR;
+  options.solver_options.linear_solver_type = ceres::DENSE_QR;
+  options.solver_options.max_num_iterations = 100;
+  options.solver_options.logging_type = ceres::SILENT;
+  options.iteration_limit_is_fatal = false;
+  options.check_condition = false;
+  options.condition_from_normal_equations = true;
+  options.max_condition = 100;
+  return options;
+}
+
+// Tracks a patch between two frames related by one pixel of motion.
+// Arguments are the radius of the patch and the engine.
+template<class WarpType>
+void runTrackPatch(benchmark::State& state, const WarpType& initial) {
+  int radius = state.range(0);
+  int diameter = 2 * radius + 1;
+  FlowOptions options = makeOptions(FlowEngine(state.range(1)));
+
+  ImagePyramid pyramid;
+  buildImagePyramid(makeTexture(IMAGE_SIZE), 1, pyramid);
+  const PyramidLevel& level = pyramid.front();
+  PatchMask mask(makeGaussian(MASK_SIGMA, diameter));
+
+  cv::Mat reference;
+  samplePatch(initial, level.image, reference, diameter, false,
+      options.interpolation);
+
+  int num_tracked = 0;
+  while (state.KeepRunning()) {
+    WarpType warp = initial;
+    warp.params()[0] += 1.;
+    warp.params()[1] -= 1.;
+    bool ok = trackPatch(warp, reference, level.image, level.ddx, level.ddy,
+        mask, options);
+    num_tracked += ok ? 1 : 0;
+    benchmark::DoNotOptimize(warp.params());
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.counters["tracked"] = double(num_tracked) / state.iterations();
+}
+
+void BM_TrackPatchTranslation(benchmark::State& state) {
+  double c = IMAGE_SIZE / 2;
+  runTrackPatch(state, TranslationWarp(c, c));
+}
+
+void BM_TrackPatchSimilarity(benchmark::State& state) {
+  double c = IMAGE_SIZE / 2;
+  runTrackPatch(state, SimilarityWarp(c, c, 0., 0.));
+}
+
+void trackPatchArguments(benchmark::internal::Benchmark* b) {
+  int engines[] = { CERES_FLOW_ENGINE, INVERSE_COMPOSITIONAL_FLOW_ENGINE };
+  for (int i = 0; i < 2; i += 1) {
+    for (int radius = 4; radius <= 32; radius *= 2) {
+      b->Args({ radius, engines[i] });
+    }
+  }
+  b->ArgNames({ "radius", "engine" });
+}
+
+BENCHMARK(BM_TrackPatchTranslation)->Apply(trackPatchArguments);
+BENCHMARK(BM_TrackPatchSimilarity)->Apply(trackPatchArguments);
+
+// Samples a rotated and scaled patch. Argument is the patch width.
+void BM_SamplePatchAffine(benchmark::State& state) {
+  int width = state.range(0);
+  cv::Mat image = makeTexture(IMAGE_SIZE);
+
+  double theta = 0.3;
+  double scale = 1.2;
+  double c = IMAGE_SIZE / 2;
+  cv::Mat M = (cv::Mat_<double>(2, 3) <<
+      scale * std::cos(theta), -scale * std::sin(theta), c,
+      scale * std::sin(theta), scale * std::cos(theta), c);
+
+  cv::Mat patch;
+  while (state.KeepRunning()) {
+    samplePatchAffine(image, patch, M, width, false, cv::INTER_LINEAR);
+    benchmark::DoNotOptimize(patch.data);
+  }
+
+  state.SetItemsProcessed(state.iterations() * width * width);
+}
+
+BENCHMARK(BM_SamplePatchAffine)->Arg(9)->Arg(17)->Arg(33)->Arg(65)->Arg(129);
+
+}
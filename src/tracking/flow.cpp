@@ -1,15 +1,111 @@
 #include "tracking/flow.hpp"
+#include <cmath>
+#include <limits>
+#include <algorithm>
 #include <numeric>
 #include <glog/logging.h>
+#include <boost/static_assert.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <ceres/ceres.h>
 #include "util/cond.hpp"
+#include "util/is-finite.hpp"
 #include "tracking/warper.hpp"
+#include "tracking/patch-mask.hpp"
+#include "tracking/translation-warper.hpp"
+#include "tracking/similarity-warper.hpp"
 
 namespace tracking {
 
 namespace {
 
+// Samples the warped image at the pixels of the mask and computes the
+// weighted residuals in place. If ddx and ddy are not null, the derivative
+// images are sampled at the same time (for efficiency and hopefully correct
+// downsampling). If values is not null, the samples are kept there.
+void computeResiduals(const cv::Mat& M,
+                      const cv::Mat& J,
+                      const cv::Mat& I,
+                      const cv::Mat& dIdx,
+                      const cv::Mat& dIdy,
+                      const PatchMask& mask,
+                      int interpolation,
+                      double* residuals,
+                      double* ddx,
+                      double* ddy,
+                      double* values = NULL) {
+  int diameter = J.rows;
+  bool gradients = (ddx != NULL && ddy != NULL);
+  const vector<cv::Point>& points = mask.offsets();
+  double* samples = (values != NULL) ? values : residuals;
+
+  // Sample image at each pixel of the mask, directly into the residuals
+  // unless the samples are kept.
+  if (isLinearInterpolation(interpolation)) {
+    if (gradients) {
+      samplePointsAndGradientsAffine(I, dIdx, dIdy, points, samples, ddx,
+          ddy, M);
+    } else {
+      samplePointsAffineLinear(I, points, samples, M);
+    }
+  } else {
+    cv::Mat patch;
+    samplePatchAffine(I, patch, M, diameter, false, interpolation);
+    mask.gather(patch, samples);
+
+    if (gradients) {
+      // Sample whole patches of derivative image.
+      samplePatchAffine(dIdx, patch, M, diameter, false, interpolation);
+      mask.gather(patch, ddx);
+      samplePatchAffine(dIdy, patch, M, diameter, false, interpolation);
+      mask.gather(patch, ddy);
+    }
+  }
+
+  // Compute residuals and weight by the mask.
+  const double* reference = J.ptr<double>();
+  const vector<int>& indices = mask.indices();
+  const vector<double>& weights = mask.weights();
+  int num_pixels = mask.size();
+
+  for (int k = 0; k < num_pixels; k += 1) {
+    residuals[k] = weights[k] * (samples[k] - reference[indices[k]]);
+  }
+}
+
+// Samples the warped image into a whole patch. The first mask.size() values
+// are the samples at the pixels of the mask if sampled is true, otherwise
+// they are found here. There must be room for one value per pixel.
+void sampleFinalPatch(const cv::Mat& M,
+                      const cv::Mat& I,
+                      const PatchMask& mask,
+                      int interpolation,
+                      bool sampled,
+                      double* values,
+                      cv::Mat& patch) {
+  int diameter = mask.diameter();
+  if (!isLinearInterpolation(interpolation)) {
+    samplePatchAffine(I, patch, M, diameter, false, interpolation);
+    return;
+  }
+
+  patch.create(diameter, diameter, cv::DataType<double>::type);
+  if (!sampled) {
+    samplePointsAffineLinear(I, mask.offsets(), values, M);
+  }
+  mask.scatter(values, patch);
+
+  // Pixels outside the mask do not enter the residuals, but the template
+  // is differentiated and downsampled across them.
+  double* rest = values + mask.size();
+  samplePointsAffineLinear(I, mask.zeroOffsets(), rest, M);
+  double* data = patch.ptr<double>();
+  const vector<int>& indices = mask.zeroIndices();
+  int n = indices.size();
+  for (int k = 0; k < n; k += 1) {
+    data[indices[k]] = rest[k];
+  }
+}
+
 class WarpCost : public ceres::CostFunction {
   public:
     // Constructs a warp cost function.
@@ -18,16 +114,18 @@ class WarpCost : public ceres::CostFunction {
     // J -- Template patch, must be square.
     // I -- Image within which to find the template patch.
     // dIdx, dIdy -- The x and y derivative of the image.
-    // mask -- Weighting mask, same size as template.
+    // mask -- Non-zero pixels of the weighting mask, same size as template.
     //   Should be rotationally symmetric and circular.
+    //   There is one residual per pixel of the mask.
     WarpCost(const Warper& warper,
              const cv::Mat& J,
              const cv::Mat& I,
              const cv::Mat& dIdx,
              const cv::Mat& dIdy,
-             const cv::Mat& mask,
+             const PatchMask& mask,
              int interpolation,
              bool check_condition,
+             bool condition_from_normal_equations,
              double max_condition);
 
     ~WarpCost() {}
@@ -42,9 +140,10 @@ class WarpCost : public ceres::CostFunction {
     const cv::Mat* I_;
     const cv::Mat* dIdx_;
     const cv::Mat* dIdy_;
-    const cv::Mat* mask_;
+    const PatchMask* mask_;
     int interpolation_;
     bool check_condition_;
+    bool condition_from_normal_equations_;
     double max_condition_;
 };
 
@@ -53,9 +152,10 @@ WarpCost::WarpCost(const Warper& warper,
                    const cv::Mat& I,
                    const cv::Mat& dIdx,
                    const cv::Mat& dIdy,
-                   const cv::Mat& mask,
+                   const PatchMask& mask,
                    int interpolation,
                    bool check_condition,
+                   bool condition_from_normal_equations,
                    double max_condition)
     : warper_(&warper),
       J_(&J),
@@ -65,17 +165,20 @@ WarpCost::WarpCost(const Warper& warper,
       mask_(&mask),
       interpolation_(interpolation),
       check_condition_(check_condition),
+      condition_from_normal_equations_(condition_from_normal_equations),
       max_condition_(max_condition) {
   // Check that we have a square patch.
   CHECK(J.rows == J.cols);
+  CHECK(J.isContinuous());
   // Check that mask is correct size.
-  CHECK(mask.size() == J.size());
+  CHECK(mask.diameter() == J.rows);
+  CHECK(mask.size() > 0);
 
   // Set the number of inputs (configure as a single block).
   mutable_parameter_block_sizes()->push_back(warper_->numParams());
 
   // Set the number of outputs.
-  set_num_residuals(J.total());
+  set_num_residuals(mask.size());
 }
 
 bool WarpCost::Evaluate(const double* const* params,
@@ -90,21 +193,24 @@ bool WarpCost::Evaluate(const double* const* params,
     return false;
   }
 
-  int num_pixels = diameter * diameter;
+  int num_pixels = mask_->size();
 
   // Build matrix representing affine transformation.
   cv::Mat M = warper_->matrix(params[0]);
-  // Sample image for x in regular grid.
-  cv::Mat patch;
-  samplePatchAffine(*I_, patch, M, diameter, false, interpolation_);
-
-  // Compute residuals.
-  cv::Mat error = cv::Mat_<double>(diameter, diameter, residuals);
-  error = patch - *J_;
-  // Weight by the mask.
-  cv::multiply(error, *mask_, error);
+  bool jacobian_required = (jacobians != NULL && jacobians[0] != NULL);
+
+  // Compute residuals and, if required, sample the derivative images.
+  vector<double> ddx;
+  vector<double> ddy;
+  if (jacobian_required) {
+    ddx.resize(num_pixels);
+    ddy.resize(num_pixels);
+  }
+  computeResiduals(M, *J_, *I_, *dIdx_, *dIdy_, *mask_, interpolation_,
+      residuals, jacobian_required ? &ddx.front() : NULL,
+      jacobian_required ? &ddy.front() : NULL);
 
-  if (jacobians != NULL && jacobians[0] != NULL) {
+  if (jacobian_required) {
     cv::Mat jac = cv::Mat_<double>(num_pixels, num_params, jacobians[0]);
 
     // f(x, p) = I(W(x, p)) - J(x)
@@ -113,41 +219,35 @@ bool WarpCost::Evaluate(const double* const* params,
     // g(x, p) = M(x) f(x, p)
     // dg/dp(x, p) = M(x) df/dp(x, p)
 
-    // Sample whole patches of derivative image.
-    // (for efficiency and hopefully correct downsampling)
-    cv::Mat ddx_patch;
-    cv::Mat ddy_patch;
-    samplePatchAffine(*dIdx_, ddx_patch, M, diameter, false, interpolation_);
-    samplePatchAffine(*dIdy_, ddy_patch, M, diameter, false, interpolation_);
-
-    cv::Point2d center(radius, radius);
+    const vector<cv::Point>& offsets = mask_->offsets();
+    const vector<double>& weights = mask_->weights();
 
-    for (int u = 0; u < diameter; u += 1) {
-      for (int v = 0; v < diameter; v += 1) {
-        // Get row-major order index.
-        int i = v * diameter + u;
+    for (int i = 0; i < num_pixels; i += 1) {
+      // Get image derivative at each warped point.
+      cv::Mat dIdx = (cv::Mat_<double>(1, 2) << ddx[i], ddy[i]);
 
-        // Get image derivative at each warped point.
-        cv::Mat dIdx = (cv::Mat_<double>(1, 2) <<
-            ddx_patch.at<double>(v, u), ddy_patch.at<double>(v, u));
+      // Get derivative of warp function.
+      double dWdp_data[2 * num_params];
+      cv::Point2d position(offsets[i].x, offsets[i].y);
+      warper_->evaluate(position, params[0], dWdp_data);
 
-        // Get derivative of warp function.
-        double dWdp_data[2 * num_params];
-        cv::Point2d position = cv::Point2d(u, v) - center;
-        warper_->evaluate(position, params[0], dWdp_data);
+      // Use chain rule.
+      cv::Mat dWdp(2, num_params, cv::DataType<double>::type, dWdp_data);
 
-        // Use chain rule.
-        cv::Mat dWdp(2, num_params, cv::DataType<double>::type, dWdp_data);
-
-        // Compute partial Jacobian.
-        double m = mask_->at<double>(v, u);
-        jac.row(i) = m * dIdx * dWdp;
-      }
+      // Compute partial Jacobian.
+      jac.row(i) = weights[i] * dIdx * dWdp;
     }
 
     if (check_condition_) {
       // Check that Jacobian is well-conditioned.
-      double condition = cond(jac);
+      double condition;
+      if (condition_from_normal_equations_) {
+        cv::Mat jtj;
+        cv::mulTransposed(jac, jtj, true);
+        condition = condFromNormalMatrix(jtj);
+      } else {
+        condition = cond(jac);
+      }
 
       if (condition > max_condition_) {
         DLOG(INFO) << "Condition number of Jacobian too large (" <<
@@ -160,25 +260,397 @@ bool WarpCost::Evaluate(const double* const* params,
   return true;
 }
 
-} // namespace
+// Specialization of WarpCost for a known type of warp.
+//
+// The number of parameters is fixed at compile time and the Jacobian of the
+// warp is evaluated inline from the warp matrix, without allocation or
+// virtual function calls in the per-pixel loop.
+template<class WarperT, int NumParams>
+class WarpCostT : public ceres::SizedCostFunction<ceres::DYNAMIC, NumParams> {
+  public:
+    BOOST_STATIC_ASSERT(NumParams == WarperT::NUM_PARAMS);
+
+    // Parameters are as for WarpCost.
+    WarpCostT(const WarperT& warper,
+              const cv::Mat& J,
+              const cv::Mat& I,
+              const cv::Mat& dIdx,
+              const cv::Mat& dIdy,
+              const PatchMask& mask,
+              int interpolation,
+              bool check_condition,
+              bool condition_from_normal_equations,
+              double max_condition)
+        : warper_(&warper),
+          J_(&J),
+          I_(&I),
+          dIdx_(&dIdx),
+          dIdy_(&dIdy),
+          mask_(&mask),
+          interpolation_(interpolation),
+          check_condition_(check_condition),
+          condition_from_normal_equations_(condition_from_normal_equations),
+          max_condition_(max_condition) {
+      CHECK(J.rows == J.cols);
+      CHECK(J.isContinuous());
+      CHECK(mask.diameter() == J.rows);
+      CHECK(mask.size() > 0);
+
+      this->set_num_residuals(mask.size());
+    }
 
-////////////////////////////////////////////////////////////////////////////////
+    ~WarpCostT() {}
 
-// Returns false if the optimization did not converge.
-bool trackPatch(Warp& warp,
-                const cv::Mat& reference,
-                const cv::Mat& image,
-                const cv::Mat& ddx_image,
-                const cv::Mat& ddy_image,
-                const cv::Mat& mask,
-                const FlowOptions& options) {
-  CHECK(reference.rows == reference.cols) << "Template must be square";
+    bool Evaluate(const double* const* params,
+                  double* residuals,
+                  double** jacobians) const {
+      int diameter = J_->rows;
+      int radius = (diameter - 1) / 2;
+
+      if (!warper_->isValid(params[0], I_->size(), radius)) {
+        return false;
+      }
+
+      cv::Mat M = warper_->matrix(params[0]);
+      bool jacobian_required = (jacobians != NULL && jacobians[0] != NULL);
+
+      if (!jacobian_required) {
+        computeResiduals(M, *J_, *I_, *dIdx_, *dIdy_, *mask_, interpolation_,
+            residuals, NULL, NULL);
+        return true;
+      }
+
+      int num_pixels = mask_->size();
+      vector<double> ddx(num_pixels);
+      vector<double> ddy(num_pixels);
+      computeResiduals(M, *J_, *I_, *dIdx_, *dIdy_, *mask_, interpolation_,
+          residuals, &ddx.front(), &ddy.front());
+
+      const double* A = M.ptr<double>();
+      double* jac = jacobians[0];
+      double dWdp[2 * NumParams];
+
+      // Accumulate the upper triangle of J^T J if it is needed.
+      bool normal = (check_condition_ && condition_from_normal_equations_);
+      double jtj[NumParams][NumParams] = {};
+
+      const vector<cv::Point>& offsets = mask_->offsets();
+      const vector<double>& weights = mask_->weights();
+
+      for (int i = 0; i < num_pixels; i += 1) {
+        WarperT::affineJacobian(A, offsets[i].x, offsets[i].y, dWdp);
+
+        // Chain rule, weighted by mask.
+        double dx = weights[i] * ddx[i];
+        double dy = weights[i] * ddy[i];
+        double* row = jac + i * NumParams;
+
+        for (int j = 0; j < NumParams; j += 1) {
+          row[j] = dx * dWdp[j] + dy * dWdp[NumParams + j];
+        }
+
+        if (normal) {
+          for (int j = 0; j < NumParams; j += 1) {
+            for (int k = j; k < NumParams; k += 1) {
+              jtj[j][k] += row[j] * row[k];
+            }
+          }
+        }
+      }
+
+      if (check_condition_) {
+        // Check that Jacobian is well-conditioned.
+        double condition;
+        if (normal) {
+          for (int j = 0; j < NumParams; j += 1) {
+            for (int k = 0; k < j; k += 1) {
+              jtj[j][k] = jtj[k][j];
+            }
+          }
+          condition = condFromNormalMatrix(
+              cv::Mat_<double>(NumParams, NumParams, &jtj[0][0]));
+        } else {
+          condition = cond(cv::Mat_<double>(num_pixels, NumParams, jac));
+        }
+
+        if (condition > max_condition_) {
+          DLOG(INFO) << "Condition number of Jacobian too large (" <<
+            condition << " > " << max_condition_ << ")";
+          return false;
+        }
+      }
 
+      return true;
+    }
+
+  private:
+    const WarperT* warper_;
+    const cv::Mat* J_;
+    const cv::Mat* I_;
+    const cv::Mat* dIdx_;
+    const cv::Mat* dIdy_;
+    const PatchMask* mask_;
+    int interpolation_;
+    bool check_condition_;
+    bool condition_from_normal_equations_;
+    double max_condition_;
+};
+
+// Constructs the cost function for a warper, specialized if possible.
+ceres::CostFunction* newWarpCost(const Warper& warper,
+                                 const cv::Mat& J,
+                                 const cv::Mat& I,
+                                 const cv::Mat& dIdx,
+                                 const cv::Mat& dIdy,
+                                 const PatchMask& mask,
+                                 const FlowOptions& options) {
+  typedef WarpCostT<TranslationWarper, TranslationWarper::NUM_PARAMS>
+      TranslationWarpCost;
+  typedef WarpCostT<SimilarityWarper, SimilarityWarper::NUM_PARAMS>
+      SimilarityWarpCost;
+
+  const TranslationWarper* translation =
+      dynamic_cast<const TranslationWarper*>(&warper);
+  if (translation != NULL) {
+    return new TranslationWarpCost(*translation, J, I, dIdx, dIdy, mask,
+        options.interpolation, options.check_condition,
+        options.condition_from_normal_equations, options.max_condition);
+  }
+
+  const SimilarityWarper* similarity =
+      dynamic_cast<const SimilarityWarper*>(&warper);
+  if (similarity != NULL) {
+    return new SimilarityWarpCost(*similarity, J, I, dIdx, dIdy, mask,
+        options.interpolation, options.check_condition,
+        options.condition_from_normal_equations, options.max_condition);
+  }
+
+  return new WarpCost(warper, J, I, dIdx, dIdy, mask, options.interpolation,
+      options.check_condition, options.condition_from_normal_equations,
+      options.max_condition);
+}
+
+// Solves for the warp using inverse-compositional Gauss-Newton.
+//
+// The objective is the same as that of WarpCost. The roles of the template
+// and image are swapped in the linearization so that the Jacobian does not
+// depend on the current parameters. The update is applied by composing the
+// current warp with the inverse of the incremental warp.
+//
+// The patch, if not null, is completed from the samples of the last residual
+// evaluation when that was at the final warp.
+bool trackPatchInverseCompositional(Warp& warp,
+                                    const cv::Mat& reference,
+                                    const cv::Mat& image,
+                                    const PatchMask& mask,
+                                    const FlowOptions& options,
+                                    FlowStatistics* statistics,
+                                    cv::Mat* patch) {
+  scoped_ptr<Warper> warper(warp.newWarper());
+  int num_params = warper->numParams();
+  int diameter = reference.rows;
+  int radius = (diameter - 1) / 2;
+  int num_pixels = mask.size();
+  double* params = warp.params();
+
+  CHECK(reference.isContinuous());
+  CHECK(mask.diameter() == diameter);
+  CHECK(num_pixels > 0);
+
+  // Differentiate the template.
+  const cv::Mat diff = (cv::Mat_<double>(1, 3) << -0.5, 0, 0.5);
+  const cv::Mat identity = (cv::Mat_<double>(1, 1) << 1);
+  cv::Mat ddx_reference;
+  cv::Mat ddy_reference;
+  cv::sepFilter2D(reference, ddx_reference, -1, diff, identity,
+      cv::Point(-1, -1), 0, cv::BORDER_REPLICATE);
+  cv::sepFilter2D(reference, ddy_reference, -1, identity, diff,
+      cv::Point(-1, -1), 0, cv::BORDER_REPLICATE);
+  vector<double> ddx(num_pixels);
+  vector<double> ddy(num_pixels);
+  mask.gather(ddx_reference, &ddx.front());
+  mask.gather(ddy_reference, &ddy.front());
+
+  // Derivative of the warp is evaluated at the identity.
+  vector<double> identity_params(num_params);
+  warper->setIdentity(&identity_params.front());
+
+  // Compute the steepest-descent images (the Jacobian), weighted by the mask.
+  cv::Mat jac = cv::Mat_<double>(num_pixels, num_params);
+  vector<double> dWdp(2 * num_params);
+  const vector<cv::Point>& offsets = mask.offsets();
+  const vector<double>& weights = mask.weights();
+
+  for (int i = 0; i < num_pixels; i += 1) {
+    cv::Point2d position(offsets[i].x, offsets[i].y);
+    warper->evaluate(position, &identity_params.front(), &dWdp.front());
+
+    double dx = weights[i] * ddx[i];
+    double dy = weights[i] * ddy[i];
+
+    for (int j = 0; j < num_params; j += 1) {
+      jac.at<double>(i, j) = dx * dWdp[j] + dy * dWdp[num_params + j];
+    }
+  }
+
+  if (statistics != NULL) {
+    statistics->num_jacobian_evaluations += 1;
+  }
+
+  // Gauss-Newton approximation to the Hessian, constant for all iterations.
+  cv::Mat hessian;
+  cv::mulTransposed(jac, hessian, true);
+
+  if (options.check_condition) {
+    // Check that Jacobian is well-conditioned.
+    double condition;
+    if (options.condition_from_normal_equations) {
+      condition = condFromNormalMatrix(hessian);
+    } else {
+      condition = cond(jac);
+    }
+
+    if (condition > options.max_condition) {
+      DLOG(INFO) << "Condition number of Jacobian too large (" <<
+        condition << " > " << options.max_condition << ")";
+      setTermination(statistics, FLOW_CONDITION_LIMIT);
+      return false;
+    }
+  }
+  cv::Mat inv_hessian;
+  if (cv::invert(hessian, inv_hessian, cv::DECOMP_CHOLESKY) == 0) {
+    DLOG(INFO) << "Hessian is singular";
+    setTermination(statistics, FLOW_NUMERICAL_FAILURE);
+    return false;
+  }
+
+  const ceres::Solver::Options& solver_options = options.solver_options;
+  cv::Mat error = cv::Mat_<double>(num_pixels, 1);
+  vector<double> samples;
+  if (patch != NULL) {
+    samples.resize(diameter * diameter);
+  }
+  double* values = (patch != NULL) ? &samples.front() : NULL;
+  // Were the samples taken at the current parameters?
+  bool sampled = false;
+  vector<double> delta_params(num_params);
+  double previous_cost = 0;
+  bool converged = false;
+
+  for (int iter = 0; iter < solver_options.max_num_iterations; iter += 1) {
+    if (!warper->isValid(params, image.size(), radius)) {
+      setTermination(statistics, FLOW_INVALID_WARP);
+      return false;
+    }
+
+    // Compute residuals at current estimate.
+    cv::Mat M = warper->matrix(params);
+    computeResiduals(M, reference, image, image, image, mask,
+        options.interpolation, error.ptr<double>(), NULL, NULL, values);
+    sampled = true;
+    if (statistics != NULL) {
+      statistics->num_residual_evaluations += 1;
+    }
+
+    double cost = 0.5 * error.dot(error);
+    if (iter > 0 && std::abs(previous_cost - cost) <=
+        solver_options.function_tolerance * previous_cost) {
+      converged = true;
+      break;
+    }
+    previous_cost = cost;
+
+    // Solve for the incremental warp.
+    cv::Mat delta = inv_hessian * (jac.t() * error);
+    if (!isFinite(cv::norm(delta))) {
+      DLOG(INFO) << "Numerical failure";
+      setTermination(statistics, FLOW_NUMERICAL_FAILURE);
+      return false;
+    }
+
+    // Compose current warp with the inverse of the incremental warp.
+    for (int j = 0; j < num_params; j += 1) {
+      delta_params[j] = identity_params[j] + delta.at<double>(j);
+    }
+    cv::Mat A = cv::Mat::eye(3, 3, cv::DataType<double>::type);
+    M.copyTo(A.rowRange(0, 2));
+    cv::Mat B = cv::Mat::eye(3, 3, cv::DataType<double>::type);
+    warper->matrix(&delta_params.front()).copyTo(B.rowRange(0, 2));
+    cv::Mat C = A * B.inv();
+    warper->paramsFromMatrix(C.rowRange(0, 2), params);
+    sampled = false;
+    if (statistics != NULL) {
+      statistics->num_iterations += 1;
+    }
+
+    // Use the same parameter tolerance as ceres.
+    double norm_params = cv::norm(cv::Mat_<double>(num_params, 1, params));
+    if (cv::norm(delta) <= solver_options.parameter_tolerance *
+        (norm_params + solver_options.parameter_tolerance)) {
+      converged = true;
+      break;
+    }
+  }
+
+  // Iteration limit was reached before any of the convergece criteria?
+  setTermination(statistics,
+      converged ? FLOW_CONVERGED : FLOW_ITERATION_LIMIT);
+  if (options.iteration_limit_is_fatal && !converged) {
+    DLOG(INFO) << "Reached iteration limit";
+    return false;
+  }
+
+  if (!warper->isValid(params, image.size(), radius)) {
+    setTermination(statistics, FLOW_INVALID_WARP);
+    return false;
+  }
+
+  if (patch != NULL) {
+    sampleFinalPatch(warper->matrix(params), image, mask,
+        options.interpolation, sampled, values, *patch);
+  }
+  return true;
+}
+
+// Counts the evaluations of a cost function, which it takes ownership of.
+class CountingCost : public ceres::CostFunction {
+  public:
+    CountingCost(ceres::CostFunction* cost, FlowStatistics& statistics)
+        : cost_(cost), statistics_(&statistics) {
+      set_num_residuals(cost->num_residuals());
+      *mutable_parameter_block_sizes() = cost->parameter_block_sizes();
+    }
+
+    bool Evaluate(const double* const* parameters,
+                  double* residuals,
+                  double** jacobians) const {
+      statistics_->num_residual_evaluations += 1;
+      if (jacobians != NULL && jacobians[0] != NULL) {
+        statistics_->num_jacobian_evaluations += 1;
+      }
+      return cost_->Evaluate(parameters, residuals, jacobians);
+    }
+
+  private:
+    scoped_ptr<ceres::CostFunction> cost_;
+    FlowStatistics* statistics_;
+};
+
+bool trackPatchCeres(Warp& warp,
+                     const cv::Mat& reference,
+                     const cv::Mat& image,
+                     const cv::Mat& ddx_image,
+                     const cv::Mat& ddy_image,
+                     const PatchMask& mask,
+                     const FlowOptions& options,
+                     FlowStatistics* statistics) {
   // Set up non-linear optimization problem.
   scoped_ptr<Warper> warper(warp.newWarper());
-  ceres::CostFunction* objective = new WarpCost(*warper, reference, image,
-      ddx_image, ddy_image, mask, options.interpolation,
-      options.check_condition, options.max_condition);
+  ceres::CostFunction* objective = newWarpCost(*warper, reference, image,
+      ddx_image, ddy_image, mask, options);
+  if (statistics != NULL) {
+    objective = new CountingCost(objective, *statistics);
+  }
 
   ceres::Problem problem;
   problem.AddResidualBlock(objective, NULL, warp.params());
@@ -190,15 +662,25 @@ bool trackPatch(Warp& warp,
   // Ensure there was no catastrophic failure.
   CHECK(summary.termination_type != ceres::DID_NOT_RUN);
 
+  if (statistics != NULL) {
+    statistics->num_iterations += summary.num_successful_steps +
+      summary.num_unsuccessful_steps;
+  }
+
   // Numerical failure can be caused by e.g. numbers going to infinity.
+  // Evaluations rejected for an ill-conditioned Jacobian or an invalid warp
+  // only shorten the step, unless they occur at the initial estimate.
   if (summary.termination_type == ceres::NUMERICAL_FAILURE) {
     DLOG(INFO) << "Numerical failure";
+    setTermination(statistics, FLOW_NUMERICAL_FAILURE);
     return false;
   }
 
   // Iteration limit was reached before any of the convergece criteria?
-  if (options.iteration_limit_is_fatal &&
-      summary.termination_type == ceres::NO_CONVERGENCE) {
+  bool converged = (summary.termination_type != ceres::NO_CONVERGENCE);
+  setTermination(statistics,
+      converged ? FLOW_CONVERGED : FLOW_ITERATION_LIMIT);
+  if (options.iteration_limit_is_fatal && !converged) {
     DLOG(INFO) << "Reached iteration limit";
     return false;
   }
@@ -206,4 +688,224 @@ bool trackPatch(Warp& warp,
   return true;
 }
 
+// Downsamples a square patch of odd size by a factor of two about its center.
+// Uses the same 5-tap kernel as cv::pyrDown() if smooth is true.
+void downsamplePatch(const cv::Mat& src, cv::Mat& dst, bool smooth) {
+  int src_radius = (src.rows - 1) / 2;
+  int radius = src_radius / 2;
+  int diameter = 2 * radius + 1;
+
+  cv::Mat filtered = src;
+  if (smooth) {
+    const cv::Mat kernel = (cv::Mat_<double>(1, 5) << 1, 4, 6, 4, 1) / 16.;
+    cv::sepFilter2D(src, filtered, -1, kernel, kernel, cv::Point(-1, -1), 0,
+        cv::BORDER_REPLICATE);
+  }
+
+  dst.create(diameter, diameter, cv::DataType<double>::type);
+  for (int v = 0; v < diameter; v += 1) {
+    const double* row = filtered.ptr<double>(src_radius + 2 * (v - radius));
+    double* out = dst.ptr<double>(v);
+    for (int u = 0; u < diameter; u += 1) {
+      out[u] = row[src_radius + 2 * (u - radius)];
+    }
+  }
+}
+
+// Scales the translation of a warp, taking it to a different pyramid level.
+void scaleWarpTranslation(Warp& warp, const Warper& warper, double scale) {
+  cv::Mat M = warp.matrix();
+  M.at<double>(0, 2) *= scale;
+  M.at<double>(1, 2) *= scale;
+  warper.paramsFromMatrix(M, warp.params());
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Returns false if the optimization did not converge.
+bool trackPatch(Warp& warp,
+                const cv::Mat& reference,
+                const cv::Mat& image,
+                const cv::Mat& ddx_image,
+                const cv::Mat& ddy_image,
+                const PatchMask& mask,
+                const FlowOptions& options,
+                FlowStatistics* statistics,
+                cv::Mat* patch) {
+  CHECK(reference.rows == reference.cols) << "Template must be square";
+  int64 start = (statistics != NULL) ? cv::getTickCount() : 0;
+
+  bool tracked;
+  if (options.engine == INVERSE_COMPOSITIONAL_FLOW_ENGINE) {
+    tracked = trackPatchInverseCompositional(warp, reference, image, mask,
+        options, statistics, patch);
+  } else {
+    tracked = trackPatchCeres(warp, reference, image, ddx_image, ddy_image,
+        mask, options, statistics);
+    if (tracked && patch != NULL) {
+      // The residuals are evaluated inside ceres, so sample once more.
+      vector<double> values(reference.total());
+      sampleFinalPatch(warp.matrix(), image, mask, options.interpolation,
+          false, &values.front(), *patch);
+    }
+  }
+
+  if (statistics != NULL) {
+    statistics->num_calls += 1;
+    statistics->solver_time += double(cv::getTickCount() - start) /
+        cv::getTickFrequency();
+  }
+  return tracked;
+}
+
+bool trackPatch(Warp& warp,
+                const cv::Mat& reference,
+                const cv::Mat& image,
+                const cv::Mat& ddx_image,
+                const cv::Mat& ddy_image,
+                const cv::Mat& mask,
+                const FlowOptions& options) {
+  return trackPatch(warp, reference, image, ddx_image, ddy_image,
+      PatchMask(mask), options);
+}
+
+
+void buildImagePyramid(const cv::Mat& image,
+                       int num_levels,
+                       ImagePyramid& pyramid) {
+  CHECK(num_levels >= 1);
+  CHECK(image.type() == cv::DataType<double>::type ||
+        image.type() == cv::DataType<float>::type);
+  pyramid.resize(num_levels);
+
+  // Central difference. Smoothing is provided by downsampling.
+  const cv::Mat diff = (cv::Mat_<double>(1, 3) << -0.5, 0, 0.5);
+  const cv::Mat identity = (cv::Mat_<double>(1, 1) << 1);
+
+  for (int i = 0; i < num_levels; i += 1) {
+    PyramidLevel& level = pyramid[i];
+    if (i == 0) {
+      level.image = image;
+    } else {
+      cv::pyrDown(pyramid[i - 1].image, level.image);
+    }
+    cv::sepFilter2D(level.image, level.ddx, -1, diff, identity);
+    cv::sepFilter2D(level.image, level.ddy, -1, identity, diff);
+  }
+}
+
+void buildImagePyramid(const cv::Mat& image,
+                       int num_levels,
+                       const vector<cv::Rect>& regions,
+                       ImagePyramid& pyramid) {
+  CHECK(num_levels >= 1);
+  CHECK(image.type() == cv::DataType<double>::type ||
+        image.type() == cv::DataType<float>::type);
+  pyramid.resize(num_levels);
+
+  const cv::Mat diff = (cv::Mat_<double>(1, 3) << -0.5, 0, 0.5);
+  const cv::Mat identity = (cv::Mat_<double>(1, 1) << 1);
+
+  for (int i = 0; i < num_levels; i += 1) {
+    PyramidLevel& level = pyramid[i];
+    if (i == 0) {
+      level.image = image;
+    } else {
+      cv::pyrDown(pyramid[i - 1].image, level.image);
+    }
+    level.ddx.create(level.image.size(), level.image.type());
+    level.ddy.create(level.image.size(), level.image.type());
+    level.ddx.setTo(0);
+    level.ddy.setTo(0);
+
+    int scale = 1 << i;
+    cv::Rect bounds(cv::Point(0, 0), level.image.size());
+    vector<cv::Rect>::const_iterator region;
+    for (region = regions.begin(); region != regions.end(); ++region) {
+      // Round outwards at coarse levels.
+      int min_x = region->x / scale;
+      int min_y = region->y / scale;
+      int max_x = (region->x + region->width + scale - 1) / scale;
+      int max_y = (region->y + region->height + scale - 1) / scale;
+      cv::Rect rect = cv::Rect(min_x, min_y, max_x - min_x, max_y - min_y) &
+          bounds;
+      if (rect.area() == 0) {
+        continue;
+      }
+
+      // Differentiated in place within the full-size gradients, using the
+      // pixels of the image around the region.
+      cv::Mat ddx = level.ddx(rect);
+      cv::Mat ddy = level.ddy(rect);
+      cv::sepFilter2D(level.image(rect), ddx, -1, diff, identity);
+      cv::sepFilter2D(level.image(rect), ddy, -1, identity, diff);
+      DCHECK(ddx.data == level.ddx(rect).data);
+      DCHECK(ddy.data == level.ddy(rect).data);
+    }
+  }
+}
+
+bool trackPatchPyramid(Warp& warp,
+                       const cv::Mat& reference,
+                       const ImagePyramid& pyramid,
+                       const PatchMask& mask,
+                       const FlowOptions& options,
+                       FlowStatistics* statistics,
+                       cv::Mat* patch) {
+  CHECK(!pyramid.empty());
+  CHECK(reference.rows == reference.cols) << "Template must be square";
+  int radius = (reference.rows - 1) / 2;
+
+  // Do not use levels at which the patch would vanish.
+  int num_levels = pyramid.size();
+  while (num_levels > 1 && (radius >> (num_levels - 1)) < 1) {
+    num_levels -= 1;
+  }
+
+  // Downsample template and mask for each level.
+  vector<cv::Mat> references(num_levels);
+  vector<PatchMask> masks(num_levels);
+  references[0] = reference;
+  cv::Mat level_mask = mask.mask();
+  for (int i = 1; i < num_levels; i += 1) {
+    downsamplePatch(references[i - 1], references[i], true);
+    cv::Mat next_mask;
+    downsamplePatch(level_mask, next_mask, false);
+    masks[i] = PatchMask(next_mask);
+    level_mask = next_mask;
+  }
+
+  scoped_ptr<Warper> warper(warp.newWarper());
+  int num_params = warp.numParams();
+  vector<double> previous(num_params);
+
+  // Reaching the iteration limit is not fatal at the coarse levels.
+  FlowOptions coarse_options = options;
+  coarse_options.iteration_limit_is_fatal = false;
+
+  // Take warp to the top level.
+  scaleWarpTranslation(warp, *warper, 1. / (1 << (num_levels - 1)));
+
+  for (int i = num_levels - 1; i > 0; i -= 1) {
+    const PyramidLevel& level = pyramid[i];
+    std::copy(warp.params(), warp.params() + num_params, previous.begin());
+
+    bool tracked = trackPatch(warp, references[i], level.image, level.ddx,
+        level.ddy, masks[i], coarse_options, statistics);
+    if (!tracked) {
+      // Continue from the estimate that was propagated to this level.
+      std::copy(previous.begin(), previous.end(), warp.params());
+    }
+
+    // Take warp to the next level down.
+    scaleWarpTranslation(warp, *warper, 2.);
+  }
+
+  const PyramidLevel& level = pyramid[0];
+  return trackPatch(warp, reference, level.image, level.ddx, level.ddy, mask,
+      options, statistics, patch);
+}
+
 }
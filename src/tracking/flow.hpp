@@ -3,17 +3,52 @@
 
 #include "tracking/using.hpp"
 #include "tracking/warp.hpp"
+#include "tracking/patch-mask.hpp"
+#include "util/flow-statistics.hpp"
 
 namespace tracking {
 
+using ::FlowTermination;
+using ::FlowStatistics;
+using ::flowTerminationName;
+
+// Method used to solve for the warp parameters.
+enum FlowEngine {
+  // Constructs a non-linear least-squares problem and solves it using ceres.
+  CERES_FLOW_ENGINE,
+  // Inverse-compositional Gauss-Newton (Baker and Matthews).
+  // The Jacobian and Hessian are computed once from the template.
+  INVERSE_COMPOSITIONAL_FLOW_ENGINE
+};
+
 struct FlowOptions {
+  FlowEngine engine;
   int interpolation;
   ceres::Solver::Options solver_options;
   bool iteration_limit_is_fatal;
   bool check_condition;
+  // Compute the condition number from J^T J rather than the SVD of J?
+  // Accepts and rejects the same warps, at a fraction of the cost.
+  bool condition_from_normal_equations;
   double max_condition;
 };
 
+// Statistics are accumulated if not NULL.
+// If patch is not NULL and the patch was tracked, the image is sampled into
+// it at the final warp, as for the residuals. Its memory is re-used if it
+// has the size of the template. The inverse compositional engine re-uses
+// the samples of its last residual evaluation.
+bool trackPatch(Warp& warp,
+                const cv::Mat& reference,
+                const cv::Mat& image,
+                const cv::Mat& ddx_image,
+                const cv::Mat& ddy_image,
+                const PatchMask& mask,
+                const FlowOptions& options,
+                FlowStatistics* statistics = NULL,
+                cv::Mat* patch = NULL);
+
+// Convenience version which lists the non-zero pixels of the mask each call.
 bool trackPatch(Warp& warp,
                 const cv::Mat& reference,
                 const cv::Mat& image,
@@ -22,6 +57,48 @@ bool trackPatch(Warp& warp,
                 const cv::Mat& mask,
                 const FlowOptions& options);
 
+// Image and its derivatives at one scale.
+struct PyramidLevel {
+  cv::Mat image;
+  cv::Mat ddx;
+  cv::Mat ddy;
+};
+
+// Each level is half the resolution of the one before it.
+// Level 0 is the original image.
+typedef vector<PyramidLevel> ImagePyramid;
+
+// Computes the gradients of an image and of num_levels - 1 smaller images.
+// The image may be single or double precision.
+// Level 0 shares its data with the image.
+// Re-uses the memory of an existing pyramid.
+void buildImagePyramid(const cv::Mat& image,
+                       int num_levels,
+                       ImagePyramid& pyramid);
+// Same as above, but only differentiates within regions of level 0, which
+// are scaled down to the other levels. Gradients are zero elsewhere, so that
+// the cost is proportional to the area of the regions.
+void buildImagePyramid(const cv::Mat& image,
+                       int num_levels,
+                       const vector<cv::Rect>& regions,
+                       ImagePyramid& pyramid);
+
+// Tracks a patch coarse to fine through an image pyramid.
+// The template and mask are downsampled with the image, the warp is solved at
+// the smallest level first and its translation is propagated down.
+// Coarse levels only provide an initial estimate, the result at level 0
+// determines whether the patch was tracked.
+// With a single level this is equivalent to trackPatch().
+// Statistics are accumulated over all levels if not NULL.
+// The patch, if not NULL, is sampled from level 0 as by trackPatch().
+bool trackPatchPyramid(Warp& warp,
+                       const cv::Mat& reference,
+                       const ImagePyramid& pyramid,
+                       const PatchMask& mask,
+                       const FlowOptions& options,
+                       FlowStatistics* statistics = NULL,
+                       cv::Mat* patch = NULL);
+
 }
 
 #endif
@@ -0,0 +1,121 @@
+#include "tracking/gpu-tracker.hpp"
+#include <cmath>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <glog/logging.h>
+
+namespace tracking {
+
+GpuTracker::GpuTracker(int max_features,
+                       int min_features,
+                       double quality,
+                       double min_distance,
+                       int window_radius,
+                       int num_levels,
+                       int max_iterations)
+    : detector_(max_features, quality, min_distance),
+      flow_(),
+      min_features_(min_features),
+      min_distance_(min_distance),
+      tracks_(),
+      num_frames_(0) {
+  int diameter = 2 * window_radius + 1;
+  flow_.winSize = cv::Size(diameter, diameter);
+  flow_.maxLevel = num_levels - 1;
+  flow_.iters = max_iterations;
+}
+
+GpuTracker::~GpuTracker() {}
+
+void GpuTracker::feed(const cv::Mat& image) {
+  // This is the only image which is copied to the device.
+  if (image.channels() == 1) {
+    current_.upload(image);
+  } else {
+    color_.upload(image);
+    cv::gpu::cvtColor(color_, current_, CV_BGR2GRAY);
+  }
+  cv::Rect bounds(cv::Point(0, 0), image.size());
+
+  if (!positions_.empty()) {
+    flow_.sparse(previous_, current_, points_, next_points_, status_);
+
+    // Only positions and status come back.
+    next_points_.download(host_points_);
+    status_.download(host_status_);
+    const cv::Point2f* next = host_points_.ptr<cv::Point2f>();
+    const uchar* status = host_status_.ptr<uchar>();
+
+    // Keep points which were tracked and are still in the image.
+    int n = positions_.size();
+    int num_kept = 0;
+    for (int i = 0; i < n; i += 1) {
+      if (!status[i] || !bounds.contains(next[i])) {
+        continue;
+      }
+      int index = indices_[i];
+      tracks_[index][num_frames_] = cv::Point2d(next[i].x, next[i].y);
+      positions_[num_kept] = next[i];
+      indices_[num_kept] = index;
+      num_kept += 1;
+    }
+    positions_.resize(num_kept);
+    indices_.resize(num_kept);
+
+    DLOG(INFO) << "Lost " << n - num_kept << " of " << n << " features";
+  }
+
+  if (int(positions_.size()) < min_features_) {
+    detect();
+  }
+
+  // Upload the surviving points for the next frame.
+  if (!positions_.empty()) {
+    points_.upload(cv::Mat(1, positions_.size(), CV_32FC2,
+          &positions_.front()));
+  }
+
+  // Current frame stays on the device to be tracked from.
+  previous_.swap(current_);
+  num_frames_ += 1;
+}
+
+void GpuTracker::detect() {
+  // Exclude the neighbourhood of existing points.
+  host_mask_.create(current_.size(), CV_8UC1);
+  host_mask_.setTo(255);
+  int radius = std::ceil(min_distance_);
+  vector<cv::Point2f>::const_iterator position;
+  for (position = positions_.begin(); position != positions_.end();
+      ++position) {
+    cv::circle(host_mask_, *position, radius, cv::Scalar(0), -1);
+  }
+  mask_.upload(host_mask_);
+
+  detector_(current_, corners_, mask_);
+  if (corners_.empty()) {
+    return;
+  }
+
+  corners_.download(host_points_);
+  const cv::Point2f* corners = host_points_.ptr<cv::Point2f>();
+  int n = host_points_.cols;
+
+  for (int i = 0; i < n; i += 1) {
+    indices_.push_back(tracks_.size());
+    positions_.push_back(corners[i]);
+    tracks_.push_back(::Track<cv::Point2d>());
+    tracks_.back()[num_frames_] = cv::Point2d(corners[i].x, corners[i].y);
+  }
+
+  DLOG(INFO) << "Detected " << n << " features";
+}
+
+int GpuTracker::numFrames() const {
+  return num_frames_;
+}
+
+const ::TrackList<cv::Point2d>& GpuTracker::tracks() const {
+  return tracks_;
+}
+
+} // namespace tracking
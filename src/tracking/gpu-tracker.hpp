@@ -0,0 +1,64 @@
+#ifndef TRACKING_GPU_TRACKER_HPP_
+#define TRACKING_GPU_TRACKER_HPP_
+
+#include <opencv2/gpu/gpu.hpp>
+#include "tracking/using.hpp"
+#include "tracking/tracker.hpp"
+
+namespace tracking {
+
+// Tracks corners with pyramidal Lucas-Kanade on the GPU.
+//
+// Frames are uploaded once and stay on the device for detection and
+// tracking the next frame. Gradients, cornerness and the independent
+// patch solves all run on the device. Only the positions and status of the
+// tracked points are copied back each frame.
+class GpuTracker : public Tracker {
+  public:
+    // Features are re-detected whenever fewer than min_features remain.
+    GpuTracker(int max_features,
+               int min_features,
+               double quality,
+               double min_distance,
+               int window_radius,
+               int num_levels,
+               int max_iterations);
+    ~GpuTracker();
+
+    void feed(const cv::Mat& image);
+    int numFrames() const;
+    const ::TrackList<cv::Point2d>& tracks() const;
+
+  private:
+    // Adds corners which are at least min_distance from existing points.
+    void detect();
+
+    cv::gpu::GoodFeaturesToTrackDetector_GPU detector_;
+    cv::gpu::PyrLKOpticalFlow flow_;
+    int min_features_;
+    double min_distance_;
+
+    // Device memory, re-used every frame.
+    cv::gpu::GpuMat color_;
+    cv::gpu::GpuMat previous_;
+    cv::gpu::GpuMat current_;
+    cv::gpu::GpuMat points_;
+    cv::gpu::GpuMat next_points_;
+    cv::gpu::GpuMat status_;
+    cv::gpu::GpuMat corners_;
+    cv::gpu::GpuMat mask_;
+
+    // Host copies of the points being tracked and their tracks' indices.
+    vector<cv::Point2f> positions_;
+    vector<int> indices_;
+    cv::Mat host_points_;
+    cv::Mat host_status_;
+    cv::Mat host_mask_;
+
+    ::TrackList<cv::Point2d> tracks_;
+    int num_frames_;
+};
+
+} // namespace tracking
+
+#endif
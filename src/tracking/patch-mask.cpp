@@ -0,0 +1,60 @@
+#include "tracking/patch-mask.hpp"
+#include <glog/logging.h>
+
+namespace tracking {
+
+PatchMask::PatchMask()
+    : mask_(), offsets_(), indices_(), weights_(), total_weight_(0),
+      zero_offsets_(), zero_indices_() {}
+
+PatchMask::PatchMask(const cv::Mat& mask)
+    : mask_(mask.clone()), offsets_(), indices_(), weights_(),
+      total_weight_(0), zero_offsets_(), zero_indices_() {
+  CHECK(mask.rows == mask.cols) << "Mask must be square";
+  CHECK(mask.rows % 2 == 1) << "Mask must have odd size";
+  CHECK(mask.type() == cv::DataType<double>::type);
+
+  int diameter = mask.rows;
+  int radius = (diameter - 1) / 2;
+
+  for (int v = 0; v < diameter; v += 1) {
+    const double* row = mask_.ptr<double>(v);
+    for (int u = 0; u < diameter; u += 1) {
+      if (row[u] == 0) {
+        zero_offsets_.push_back(cv::Point(u - radius, v - radius));
+        zero_indices_.push_back(v * diameter + u);
+        continue;
+      }
+      offsets_.push_back(cv::Point(u - radius, v - radius));
+      indices_.push_back(v * diameter + u);
+      weights_.push_back(row[u]);
+      total_weight_ += row[u];
+    }
+  }
+}
+
+void PatchMask::gather(const cv::Mat& patch, double* values) const {
+  CHECK(patch.size() == mask_.size());
+  CHECK(patch.type() == cv::DataType<double>::type);
+  CHECK(patch.isContinuous());
+
+  const double* data = patch.ptr<double>();
+  int n = indices_.size();
+  for (int k = 0; k < n; k += 1) {
+    values[k] = data[indices_[k]];
+  }
+}
+
+void PatchMask::scatter(const double* values, cv::Mat& patch) const {
+  CHECK(patch.size() == mask_.size());
+  CHECK(patch.type() == cv::DataType<double>::type);
+  CHECK(patch.isContinuous());
+
+  double* data = patch.ptr<double>();
+  int n = indices_.size();
+  for (int k = 0; k < n; k += 1) {
+    data[indices_[k]] = values[k];
+  }
+}
+
+} // namespace tracking
@@ -0,0 +1,59 @@
+#ifndef TRACKING_PATCH_MASK_HPP_
+#define TRACKING_PATCH_MASK_HPP_
+
+#include "tracking/using.hpp"
+
+namespace tracking {
+
+// Lists the pixels of a square weighting mask which are non-zero.
+//
+// A circular mask leaves about a fifth of a square patch at zero.
+// Residuals, sampling and appearance checks only visit the listed pixels.
+class PatchMask {
+  public:
+    PatchMask();
+    // The mask must be square, of odd size and double precision.
+    explicit PatchMask(const cv::Mat& mask);
+
+    // Returns the dense mask.
+    inline const cv::Mat& mask() const { return mask_; }
+
+    inline int diameter() const { return mask_.rows; }
+    inline int radius() const { return (mask_.rows - 1) / 2; }
+
+    // Returns the number of non-zero pixels.
+    inline int size() const { return weights_.size(); }
+
+    // Position of the k-th pixel relative to the center of the patch.
+    inline const vector<cv::Point>& offsets() const { return offsets_; }
+    // Row-major index of the k-th pixel within the patch.
+    inline const vector<int>& indices() const { return indices_; }
+    // Weight of the k-th pixel.
+    inline const vector<double>& weights() const { return weights_; }
+
+    inline double totalWeight() const { return total_weight_; }
+
+    // Pixels of the patch which are zero, in the same form.
+    inline const vector<cv::Point>& zeroOffsets() const {
+      return zero_offsets_;
+    }
+    inline const vector<int>& zeroIndices() const { return zero_indices_; }
+
+    // Copies the listed pixels of a double-precision patch.
+    void gather(const cv::Mat& patch, double* values) const;
+    // Inverse of gather(). The patch must already be allocated.
+    void scatter(const double* values, cv::Mat& patch) const;
+
+  private:
+    cv::Mat mask_;
+    vector<cv::Point> offsets_;
+    vector<int> indices_;
+    vector<double> weights_;
+    double total_weight_;
+    vector<cv::Point> zero_offsets_;
+    vector<int> zero_indices_;
+};
+
+} // namespace tracking
+
+#endif
@@ -0,0 +1,104 @@
+#include "tracking/region-of-interest.hpp"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <glog/logging.h>
+
+namespace tracking {
+
+RegionOfInterest::RegionOfInterest() : mask_(), regions_() {}
+
+RegionOfInterest::RegionOfInterest(const cv::Mat& mask,
+                                   int tile_size,
+                                   int margin)
+    : mask_(mask), regions_() {
+  if (mask.empty()) {
+    return;
+  }
+  CHECK(mask.type() == cv::DataType<uchar>::type) << "Mask must be 8-bit";
+  CHECK(tile_size > 0);
+  CHECK(margin >= 0);
+
+  int rows = (mask.rows + tile_size - 1) / tile_size;
+  int cols = (mask.cols + tile_size - 1) / tile_size;
+  cv::Rect bounds(cv::Point(0, 0), mask.size());
+
+  // Tiles which contain part of the mask.
+  cv::Mat_<uchar> tiles(rows, cols, uchar(0));
+  for (int i = 0; i < rows; i += 1) {
+    for (int j = 0; j < cols; j += 1) {
+      cv::Rect tile(j * tile_size, i * tile_size, tile_size, tile_size);
+      tiles(i, j) = (cv::countNonZero(mask(tile & bounds)) > 0);
+    }
+  }
+
+  // Grow them by the margin, rounded up to whole tiles.
+  int grow = (margin + tile_size - 1) / tile_size;
+  if (grow > 0) {
+    cv::Mat element = cv::Mat::ones(2 * grow + 1, 2 * grow + 1, CV_8U);
+    cv::dilate(tiles, tiles, element);
+  }
+
+  // Merge runs of tiles along each row.
+  for (int i = 0; i < rows; i += 1) {
+    int j = 0;
+    while (j < cols) {
+      if (!tiles(i, j)) {
+        j += 1;
+        continue;
+      }
+      int first = j;
+      while (j < cols && tiles(i, j)) {
+        j += 1;
+      }
+      cv::Rect run(first * tile_size, i * tile_size, (j - first) * tile_size,
+          tile_size);
+      regions_.push_back(run & bounds);
+    }
+  }
+}
+
+bool RegionOfInterest::intersects(const cv::Rect& rect) const {
+  if (mask_.empty()) {
+    return rect.area() > 0;
+  }
+  cv::Rect clipped = rect & cv::Rect(cv::Point(0, 0), mask_.size());
+  return clipped.area() > 0 && cv::countNonZero(mask_(clipped)) > 0;
+}
+
+double RegionOfInterest::coverage() const {
+  if (mask_.empty()) {
+    return 1;
+  }
+
+  double area = 0;
+  vector<cv::Rect>::const_iterator region;
+  for (region = regions_.begin(); region != regions_.end(); ++region) {
+    area += region->area();
+  }
+  return area / mask_.total();
+}
+
+void convertRegions(const cv::Mat& src,
+                    cv::Mat& dst,
+                    int type,
+                    double scale,
+                    const RegionOfInterest& roi) {
+  if (roi.all()) {
+    src.convertTo(dst, type, scale);
+    return;
+  }
+
+  CHECK(src.size() == roi.mask().size());
+  dst.create(src.size(), type);
+  dst.setTo(0);
+
+  const vector<cv::Rect>& regions = roi.regions();
+  vector<cv::Rect>::const_iterator region;
+  for (region = regions.begin(); region != regions.end(); ++region) {
+    // Converted in place within the full-size image.
+    cv::Mat part = dst(*region);
+    src(*region).convertTo(part, type, scale);
+    DCHECK(part.data == dst(*region).data);
+  }
+}
+
+} // namespace tracking
@@ -0,0 +1,55 @@
+#ifndef TRACKING_REGION_OF_INTEREST_HPP_
+#define TRACKING_REGION_OF_INTEREST_HPP_
+
+#include "tracking/using.hpp"
+
+namespace tracking {
+
+// The part of a frame in which features are detected and tracked, as
+// rectangles which cover a mask of interest.
+//
+// The frame is divided into square tiles. A tile is kept if any pixel of the
+// mask within it, or within a margin of it, is non-zero, so that features near
+// the edge of the mask still have gradients under their patches. Kept tiles
+// which are next to each other in a row of tiles are merged into one region,
+// so that regions never overlap and work done per region is proportional to
+// their total area.
+class RegionOfInterest {
+  public:
+    // The whole frame is of interest.
+    RegionOfInterest();
+    // The mask must be 8-bit. An empty mask selects the whole frame.
+    RegionOfInterest(const cv::Mat& mask, int tile_size, int margin);
+
+    // True if the whole frame is of interest.
+    inline bool all() const { return mask_.empty(); }
+
+    inline const cv::Mat& mask() const { return mask_; }
+    inline const vector<cv::Rect>& regions() const { return regions_; }
+
+    // Tests whether a pixel is in the mask.
+    inline bool contains(const cv::Point& point) const {
+      return mask_.empty() || mask_.at<uchar>(point) != 0;
+    }
+    // Tests whether any pixel of a rectangle is in the mask.
+    bool intersects(const cv::Rect& rect) const;
+
+    // Fraction of the frame which is covered by the regions.
+    double coverage() const;
+
+  private:
+    cv::Mat mask_;
+    vector<cv::Rect> regions_;
+};
+
+// Converts an image within the regions of interest as cv::Mat::convertTo()
+// does, and sets it to zero elsewhere.
+void convertRegions(const cv::Mat& src,
+                    cv::Mat& dst,
+                    int type,
+                    double scale,
+                    const RegionOfInterest& roi);
+
+} // namespace tracking
+
+#endif
@@ -0,0 +1,68 @@
+#include "tracking/using.hpp"
+#include <sstream>
+#include <cstdlib>
+#include <opencv2/highgui/highgui.hpp>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+#include "tracking/gpu-tracker.hpp"
+#include "track_list_writer.hpp"
+#include "image_point_writer.hpp"
+
+using namespace tracking;
+
+DEFINE_int32(max_features, 2000, "Maximum number of features to detect");
+DEFINE_int32(min_features, 1000,
+    "Detect new features when fewer than this many remain");
+DEFINE_double(quality, 0.01,
+    "Minimum cornerness relative to the strongest corner");
+DEFINE_double(min_clearance, 8., "Minimum distance between features");
+DEFINE_int32(radius, 8, "Half of [window size - 1]");
+DEFINE_int32(pyramid_levels, 3, "Number of pyramid levels to track through");
+DEFINE_int32(max_iter, 30, "Maximum number of iterations per level");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Detects and tracks corners on the GPU." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " video tracks" << std::endl;
+  usage << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  string video_file = argv[1];
+  string tracks_file = argv[2];
+
+  bool ok;
+
+  CHECK(cv::gpu::getCudaEnabledDeviceCount() > 0) << "No CUDA device found";
+
+  cv::VideoCapture capture;
+  ok = capture.open(video_file);
+  CHECK(ok) << "Could not open video stream";
+
+  GpuTracker tracker(FLAGS_max_features, FLAGS_min_features, FLAGS_quality,
+      FLAGS_min_clearance, FLAGS_radius, FLAGS_pyramid_levels, FLAGS_max_iter);
+
+  cv::Mat image;
+  while (capture.read(image)) {
+    tracker.feed(image);
+    LOG(INFO) << "Tracked frame " << tracker.numFrames() - 1;
+  }
+
+  ImagePointWriter<double> point_writer;
+  ok = saveTrackList(tracks_file, tracker.tracks(), point_writer);
+  CHECK(ok) << "Could not save tracks";
+
+  return 0;
+}
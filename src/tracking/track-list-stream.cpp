@@ -0,0 +1,287 @@
+#include "tracking/track-list-stream.hpp"
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <glog/logging.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/repeated_field.h>
+#include <google/protobuf/wire_format_lite.h>
+
+using google::protobuf::MessageLite;
+using google::protobuf::RepeatedPtrField;
+using google::protobuf::uint32;
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::IstreamInputStream;
+using google::protobuf::io::StringOutputStream;
+using google::protobuf::internal::WireFormatLite;
+
+namespace tracking {
+
+namespace {
+
+// Tag of each element of TrackList::frames.
+const uint32 FRAME_TAG = WireFormatLite::MakeTag(
+    TrackList::kFramesFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+// Tag of each element of TrackList::packed_frames.
+const uint32 PACKED_FRAME_TAG = WireFormatLite::MakeTag(
+    TrackList::kPackedFramesFieldNumber,
+    WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+
+typedef RepeatedPtrField<TrackList::Frame> FrameList;
+typedef RepeatedPtrField<TrackList::PackedFrame> PackedFrameList;
+typedef RepeatedPtrField<TrackList::Point> PointList;
+
+}
+
+void packFrame(const TrackList::Frame& frame, TrackList::PackedFrame& packed) {
+  packed.Clear();
+  const PointList& points = frame.points();
+  int n = points.size();
+  packed.mutable_id_deltas()->Reserve(n);
+  packed.mutable_x()->Reserve(n);
+  packed.mutable_y()->Reserve(n);
+
+  bool scales = n > 0;
+  bool angles = n > 0;
+  int previous = 0;
+  PointList::const_iterator point;
+  for (point = points.begin(); point != points.end(); ++point) {
+    packed.add_id_deltas(point->id() - previous);
+    previous = point->id();
+    packed.add_x(point->x());
+    packed.add_y(point->y());
+    scales = scales && point->has_scale();
+    angles = angles && point->has_angle();
+  }
+
+  if (scales) {
+    for (point = points.begin(); point != points.end(); ++point) {
+      packed.add_scale(point->scale());
+    }
+  }
+  if (angles) {
+    for (point = points.begin(); point != points.end(); ++point) {
+      packed.add_angle(point->angle());
+    }
+  }
+}
+
+bool unpackFrame(const TrackList::PackedFrame& packed,
+                 TrackList::Frame& frame) {
+  int n = packed.id_deltas_size();
+  bool scales = packed.scale_size() > 0;
+  bool angles = packed.angle_size() > 0;
+  if (packed.x_size() != n || packed.y_size() != n ||
+      (scales && packed.scale_size() != n) ||
+      (angles && packed.angle_size() != n)) {
+    LOG(WARNING) << "Arrays of packed frame differ in length";
+    return false;
+  }
+
+  frame.mutable_points()->Reserve(frame.points_size() + n);
+  int id = 0;
+  for (int i = 0; i < n; i += 1) {
+    id += packed.id_deltas(i);
+    TrackList::Point* point = frame.add_points();
+    point->set_id(id);
+    point->set_x(packed.x(i));
+    point->set_y(packed.y(i));
+    if (scales) {
+      point->set_scale(packed.scale(i));
+    }
+    if (angles) {
+      point->set_angle(packed.angle(i));
+    }
+  }
+
+  return true;
+}
+
+void packTrackList(TrackList& tracks) {
+  const FrameList& frames = tracks.frames();
+  FrameList::const_iterator frame;
+  for (frame = frames.begin(); frame != frames.end(); ++frame) {
+    packFrame(*frame, *tracks.add_packed_frames());
+  }
+  tracks.clear_frames();
+}
+
+bool unpackTrackList(TrackList& tracks) {
+  const PackedFrameList& packed = tracks.packed_frames();
+  PackedFrameList::const_iterator frame;
+  for (frame = packed.begin(); frame != packed.end(); ++frame) {
+    if (!unpackFrame(*frame, *tracks.add_frames())) {
+      return false;
+    }
+  }
+  tracks.clear_packed_frames();
+  return true;
+}
+
+TrackListStreamWriter::TrackListStreamWriter(bool packed)
+    : packed_(packed), stream_(), buffer_(), packed_frame_() {}
+
+bool TrackListStreamWriter::open(const string& filename) {
+  stream_.open(filename.c_str(), std::ios::trunc | std::ios::binary);
+  return stream_.good();
+}
+
+void TrackListStreamWriter::close() {
+  stream_.close();
+}
+
+bool TrackListStreamWriter::write(const TrackList::Frame& frame) {
+  const MessageLite* message = &frame;
+  uint32 tag = FRAME_TAG;
+  if (packed_) {
+    packFrame(frame, packed_frame_);
+    message = &packed_frame_;
+    tag = PACKED_FRAME_TAG;
+  }
+
+  buffer_.clear();
+  {
+    StringOutputStream output(&buffer_);
+    CodedOutputStream coded(&output);
+    coded.WriteTag(tag);
+    coded.WriteVarint32(message->ByteSize());
+    message->SerializeWithCachedSizes(&coded);
+    if (coded.HadError()) {
+      return false;
+    }
+  }
+
+  stream_.write(buffer_.data(), buffer_.size());
+  stream_.flush();
+  return stream_.good();
+}
+
+AsyncTrackListWriter::AsyncTrackListWriter(bool packed, int depth)
+    : writer_(packed),
+      // One being filled and the others queued or being written.
+      num_buffers_(std::max(depth, 1) + 1),
+      buffers_(new Buffer[num_buffers_]),
+      free_(num_buffers_),
+      queued_(num_buffers_),
+      current_(NULL),
+      thread_(),
+      ok_(true) {
+  for (int i = 0; i < num_buffers_; i += 1) {
+    buffers_[i].frame = NULL;
+    free_.push(&buffers_[i]);
+  }
+}
+
+AsyncTrackListWriter::~AsyncTrackListWriter() {
+  if (thread_) {
+    // A frame which was not finished is dropped.
+    current_ = NULL;
+    close();
+  }
+}
+
+bool AsyncTrackListWriter::open(const string& filename) {
+  CHECK(!thread_) << "Writer is already open";
+  if (!writer_.open(filename)) {
+    return false;
+  }
+  thread_.reset(new boost::thread(
+        boost::bind(&AsyncTrackListWriter::run, this)));
+  return true;
+}
+
+bool AsyncTrackListWriter::close() {
+  CHECK(thread_) << "Writer is not open";
+  CHECK(current_ == NULL) << "Frame was not written";
+  queued_.close();
+  thread_->join();
+  thread_.reset();
+  writer_.close();
+  return ok_;
+}
+
+TrackList::Frame* AsyncTrackListWriter::newFrame() {
+  CHECK(current_ == NULL) << "Previous frame was not written";
+  // Blocks while every other buffer is waiting to be written.
+  free_.pop(current_);
+  // Releases the points of the frame it last held.
+  current_->arena.Reset();
+  current_->frame = Arena::CreateMessage<TrackList::Frame>(&current_->arena);
+  return current_->frame;
+}
+
+void AsyncTrackListWriter::write() {
+  CHECK(current_ != NULL) << "No frame to write";
+  queued_.push(current_);
+  current_ = NULL;
+}
+
+void AsyncTrackListWriter::run() {
+  Buffer* buffer;
+  while (queued_.pop(buffer)) {
+    if (ok_ && !writer_.write(*buffer->frame)) {
+      LOG(WARNING) << "Could not write frame";
+      ok_ = false;
+    }
+    free_.push(buffer);
+  }
+}
+
+TrackListStreamReader::TrackListStreamReader()
+    : stream_(), input_(), packed_frame_() {}
+
+bool TrackListStreamReader::open(const string& filename) {
+  stream_.open(filename.c_str(), std::ios::binary);
+  if (!stream_) {
+    return false;
+  }
+  input_.reset(new IstreamInputStream(&stream_));
+  return true;
+}
+
+void TrackListStreamReader::close() {
+  input_.reset();
+  stream_.close();
+}
+
+bool TrackListStreamReader::read(TrackList::Frame& frame) {
+  CHECK(input_) << "Stream is not open";
+
+  // A new coded stream per frame avoids its limit on the total size.
+  CodedInputStream coded(input_.get());
+
+  uint32 tag = coded.ReadTag();
+  if (tag == 0) {
+    // Reached end.
+    return false;
+  }
+  bool packed = (tag == PACKED_FRAME_TAG);
+  if (tag != FRAME_TAG && !packed) {
+    LOG(WARNING) << "Unexpected field in track list (tag " << tag << ")";
+    return false;
+  }
+
+  uint32 size;
+  if (!coded.ReadVarint32(&size)) {
+    return false;
+  }
+
+  CodedInputStream::Limit limit = coded.PushLimit(size);
+  bool ok;
+  if (packed) {
+    ok = packed_frame_.ParseFromCodedStream(&coded) &&
+         coded.ConsumedEntireMessage();
+  } else {
+    ok = frame.ParseFromCodedStream(&coded) &&
+         coded.ConsumedEntireMessage();
+  }
+  coded.PopLimit(limit);
+
+  if (ok && packed) {
+    frame.Clear();
+    ok = unpackFrame(packed_frame_, frame);
+  }
+  return ok;
+}
+
+} // namespace tracking
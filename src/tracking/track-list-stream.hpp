@@ -0,0 +1,127 @@
+#ifndef TRACKING_TRACK_LIST_STREAM_HPP_
+#define TRACKING_TRACK_LIST_STREAM_HPP_
+
+#include <fstream>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/thread.hpp>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include "tracking/using.hpp"
+#include "tracking/track-list.hpp"
+#include "util/bounded-queue.hpp"
+
+namespace tracking {
+
+// Converts a frame to the packed format. The scales or angles are kept if
+// every point has one.
+void packFrame(const TrackList::Frame& frame, TrackList::PackedFrame& packed);
+// Appends the points of a packed frame. Returns false if its arrays differ in
+// length.
+bool unpackFrame(const TrackList::PackedFrame& packed,
+                 TrackList::Frame& frame);
+
+// Replaces the frames of a whole list with packed frames, or the reverse.
+void packTrackList(TrackList& tracks);
+bool unpackTrackList(TrackList& tracks);
+
+// Writes the frames of a track list one at a time, as they are completed.
+//
+// Each frame is written as the encoding of one element of TrackList::frames,
+// which is a length-delimited Frame message preceded by its field tag.
+// The file is therefore also a valid serialized TrackList at every frame
+// boundary. If packed, each frame is instead written as an element of
+// TrackList::packed_frames.
+class TrackListStreamWriter {
+  public:
+    explicit TrackListStreamWriter(bool packed = false);
+
+    bool open(const string& filename);
+    void close();
+
+    // Appends a frame and flushes it to the file.
+    bool write(const TrackList::Frame& frame);
+
+  private:
+    bool packed_;
+    std::ofstream stream_;
+    string buffer_;
+    TrackList::PackedFrame packed_frame_;
+};
+
+// Writes frames with a TrackListStreamWriter in a thread of its own, so that
+// the tracker does not wait for serialization or the disk.
+//
+// Frames are built in place, each on an arena of its own which is re-used
+// once the frame has been written. At most depth frames wait to be written,
+// after which newFrame() blocks until the writer catches up. Usage:
+//   AsyncTrackListWriter writer(packed, depth);
+//   writer.open(filename);
+//   for each frame:
+//     TrackList::Frame* frame = writer.newFrame();
+//     ... add the points of the frame ...
+//     writer.write();
+//   bool ok = writer.close();
+class AsyncTrackListWriter {
+  public:
+    AsyncTrackListWriter(bool packed, int depth);
+    // Closes the file if it is open, dropping a frame which was not written.
+    ~AsyncTrackListWriter();
+
+    // Starts the writing thread. Only one file may be written.
+    bool open(const string& filename);
+    // Waits for every frame to be written. Returns false if any could not be.
+    bool close();
+
+    // Returns an empty frame to be filled before calling write().
+    TrackList::Frame* newFrame();
+    // Queues the frame returned by newFrame(), which must not be changed
+    // once queued.
+    void write();
+
+  private:
+    struct Buffer {
+      Arena arena;
+      TrackList::Frame* frame;
+    };
+
+    // Body of the writing thread.
+    void run();
+
+    TrackListStreamWriter writer_;
+    int num_buffers_;
+    boost::scoped_array<Buffer> buffers_;
+    // Buffers which may be filled, and buffers waiting to be written.
+    BoundedQueue<Buffer*> free_;
+    BoundedQueue<Buffer*> queued_;
+    // Being filled by the caller, or NULL.
+    Buffer* current_;
+    scoped_ptr<boost::thread> thread_;
+    // Written only by the thread until it is joined.
+    bool ok_;
+
+    // Non-copyable.
+    AsyncTrackListWriter(const AsyncTrackListWriter&);
+    AsyncTrackListWriter& operator=(const AsyncTrackListWriter&);
+};
+
+// Reads the frames of a track list one at a time.
+// Works for files written by TrackListStreamWriter or by serializing a whole
+// TrackList, in either format. Packed frames are unpacked.
+class TrackListStreamReader {
+  public:
+    TrackListStreamReader();
+
+    bool open(const string& filename);
+    void close();
+
+    // Returns false at the end of the file or if a frame could not be parsed.
+    bool read(TrackList::Frame& frame);
+
+  private:
+    std::ifstream stream_;
+    scoped_ptr<google::protobuf::io::IstreamInputStream> input_;
+    TrackList::PackedFrame packed_frame_;
+};
+
+} // namespace tracking
+
+#endif
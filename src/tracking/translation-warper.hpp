@@ -42,6 +42,22 @@ class TranslationWarper : public Warper {
                  const cv::Size& image_size,
                  int radius) const;
 
+    void setIdentity(double* params) const;
+    void paramsFromMatrix(const cv::Mat& M, double* params) const;
+
+    // Evaluates the Jacobian of the warp with respect to the parameters
+    // given the 2x3 row-major matrix representation of the warp.
+    // Inline for use in the inner loop of WarpCostT.
+    static inline void affineJacobian(const double* M,
+                                      double x,
+                                      double y,
+                                      double* jacobian) {
+      jacobian[0] = 1;
+      jacobian[1] = 0;
+      jacobian[2] = 0;
+      jacobian[3] = 1;
+    }
+
   private:
     CostFunction function_;
 };
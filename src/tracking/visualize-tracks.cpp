@@ -6,14 +6,29 @@
 #include <glog/logging.h>
 #include <gflags/gflags.h>
 #include "tracking/track-list.hpp"
+#include "tracking/track-list-stream.hpp"
 #include "tracking/translation-warp.hpp"
 #include "util/random-color.hpp"
+#include "util/thread-pool.hpp"
+#include "util/frame-writer.hpp"
+#include "util/render-queue.hpp"
 #include <boost/format.hpp>
+#include <boost/bind.hpp>
 
 using namespace tracking;
 
 DEFINE_bool(display, true, "Show tracking in window");
 DEFINE_string(save, "", "Directory to save frames to, ignored if empty");
+DEFINE_string(video, "", "Video file to encode frames into, ignored if empty");
+DEFINE_string(fourcc, "XVID", "Codec of --video");
+DEFINE_double(fps, 30, "Frame rate of --video");
+DEFINE_string(encoder, "",
+    "Command to pipe raw BGR frames to, with %1% and %2% for the width and "
+    "height, ignored if empty");
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads to draw with, 0 to draw serially");
+DEFINE_int32(max_buffered, 8,
+    "Maximum number of frames drawn ahead of being written");
 
 DEFINE_int32(radius, 8, "Half of [patch size - 1]");
 
@@ -22,10 +37,6 @@ const double SATURATION = 0.99;
 const double BRIGHTNESS = 0.99;
 const int LINE_THICKNESS = 1;
 
-string makeFilename(const string& format, int n) {
-  return boost::str(boost::format(format) % n);
-}
-
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
   usage << argv[0] << " tracks video";
@@ -40,33 +51,55 @@ void init(int& argc, char**& argv) {
   }
 }
 
-void visualizeTracks(const TrackList& tracks,
+// A feature to draw in one frame.
+struct DrawnPoint {
+  double x;
+  double y;
+  cv::Scalar color;
+};
+
+// Converts a frame to intensity and draws its features. Called by
+// RenderQueue.
+void renderFrame(const cv::Mat& color_image,
+                 const vector<DrawnPoint>& points,
+                 int radius,
+                 cv::Mat& visualization) {
+  // Convert color to intensity and back again.
+  cv::Mat image;
+  cv::cvtColor(color_image, image, CV_BGR2GRAY);
+  cv::cvtColor(image, visualization, CV_GRAY2BGR);
+
+  vector<DrawnPoint>::const_iterator point;
+  for (point = points.begin(); point != points.end(); ++point) {
+    TranslationWarp warp(point->x, point->y);
+    warp.draw(visualization, radius, point->color, LINE_THICKNESS);
+  }
+}
+
+void visualizeTracks(TrackListStreamReader& tracks,
                      cv::VideoCapture& capture,
                      int radius,
-                     bool display,
-                     const string& save) {
+                     ThreadPool& pool,
+                     FrameWriter& writer,
+                     bool render) {
   typedef map<int, cv::Vec3b> ColorMap;
   ColorMap colors;
 
-  // Draw tracks?
-  bool render = (display || !save.empty());
+  // Frames are drawn in parallel and written in order.
+  RenderQueue queue(pool, writer, FLAGS_max_buffered);
 
   // Loop state.
   bool end = false;
   int n = 0;
 
-  typedef RepeatedPtrField<TrackList::Frame> FrameList;
-  const FrameList& frames = tracks.frames();
-  FrameList::const_iterator frame = frames.begin();
-
   // Memory that is re-used every loop.
-  cv::Mat color_image;
-  cv::Mat image;
-  cv::Mat visualization;
+  // Each frame is parsed onto the arena, which is reset for the next.
+  Arena arena;
 
   // Read frames of video.
   while (!end) {
-    // Read next frame.
+    // Read next frame. Each is a new image since it may still be drawn.
+    cv::Mat color_image;
     bool ok = capture.read(color_image);
     if (!ok) {
       // Reached end.
@@ -74,16 +107,14 @@ void visualizeTracks(const TrackList& tracks,
       continue;
     }
 
-    CHECK(frame != frames.end());
-
-    if (render) {
-      // Convert color to intensity and back again.
-      cv::cvtColor(color_image, image, CV_BGR2GRAY);
-      cv::cvtColor(image, visualization, CV_GRAY2BGR);
-    }
+    arena.Reset();
+    TrackList::Frame* frame = Arena::CreateMessage<TrackList::Frame>(&arena);
+    ok = tracks.read(*frame);
+    CHECK(ok) << "Could not read tracks for frame " << n;
 
     typedef RepeatedPtrField<TrackList::Point> PointList;
     const PointList& features = frame->points();
+    vector<DrawnPoint> points;
 
     PointList::const_iterator feature;
     for (feature = features.begin(); feature != features.end(); ++feature) {
@@ -98,27 +129,24 @@ void visualizeTracks(const TrackList& tracks,
       }
 
       if (render) {
-        // Draw.
-        TranslationWarp warp(feature->x(), feature->y());
-        cv::Scalar scalar((*color)[0], (*color)[1], (*color)[2]);
-        warp.draw(visualization, radius, scalar, LINE_THICKNESS);
+        DrawnPoint point;
+        point.x = feature->x();
+        point.y = feature->y();
+        point.color = cv::Scalar((*color)[0], (*color)[1], (*color)[2]);
+        points.push_back(point);
       }
     }
 
-    if (display) {
-      cv::imshow("Tracks", visualization);
-      cv::waitKey(1000. / 30);
-    }
-
-    if (!save.empty()) {
-      string file = makeFilename(save, n);
-      cv::imwrite(file, visualization);
+    if (render) {
+      queue.push(boost::bind(renderFrame, color_image, points, radius, _1));
     }
 
-    ++frame;
     n += 1;
   }
 
+  bool ok = queue.finish();
+  CHECK(ok) << "Could not write frames";
+
   std::cout << "Read " << colors.size() << " tracks" << std::endl;
 }
 
@@ -130,17 +158,11 @@ int main(int argc, char** argv) {
 
   bool ok;
 
-  // Load tracks from file.
-  TrackList tracks;
-  {
-    std::ifstream ifs(tracks_file.c_str(), std::ios::binary);
-    if (!ifs) {
-      LOG(FATAL) << "Could not open tracks file";
-    }
-    ok = tracks.ParseFromIstream(&ifs);
-    if (!ok) {
-      LOG(FATAL) << "Could not parse tracks from file";
-    }
+  // Tracks are read from file one frame at a time.
+  TrackListStreamReader tracks;
+  ok = tracks.open(tracks_file);
+  if (!ok) {
+    LOG(FATAL) << "Could not open tracks file";
   }
 
   // Open video stream.
@@ -150,7 +172,30 @@ int main(int argc, char** argv) {
     LOG(FATAL) << "Could not open video stream";
   }
 
-  visualizeTracks(tracks, capture, FLAGS_radius, FLAGS_display, FLAGS_save);
+  // Outputs, which receive the frames in order.
+  ImageSequenceWriter image_writer(boost::format(FLAGS_save), 0);
+  VideoFileWriter video_writer(FLAGS_video, FLAGS_fourcc, FLAGS_fps);
+  EncoderPipeWriter encoder_writer(FLAGS_encoder);
+  WindowWriter window_writer("Tracks", 1000. / 30);
+
+  FrameWriterList writers;
+  if (!FLAGS_save.empty()) {
+    writers.add(image_writer);
+  }
+  if (!FLAGS_video.empty()) {
+    writers.add(video_writer);
+  }
+  if (!FLAGS_encoder.empty()) {
+    writers.add(encoder_writer);
+  }
+  if (FLAGS_display) {
+    writers.add(window_writer);
+  }
+
+  ThreadPool pool(FLAGS_num_threads);
+  // Draw tracks?
+  bool render = !writers.empty();
+  visualizeTracks(tracks, capture, FLAGS_radius, pool, writers, render);
 
   return 0;
 }
@@ -1,5 +1,10 @@
 #include "tracking/warp.hpp"
+#include <cmath>
 #include <opencv2/imgproc/imgproc.hpp>
+#include <glog/logging.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace tracking {
 
@@ -43,11 +48,260 @@ void samplePatchAffine(const cv::Mat& src,
   int flags = interpolation | invert_flags;
 
   // Invert the warp. OpenCV doesn't seem to be doing what it says.
-  cv::warpAffine(src, dst, Q, size, flags, cv::BORDER_CONSTANT,
-      cv::Scalar::all(0.));
+  if (src.type() == cv::DataType<double>::type) {
+    cv::warpAffine(src, dst, Q, size, flags, cv::BORDER_CONSTANT,
+        cv::Scalar::all(0.));
+  } else {
+    // Patches are always double precision.
+    cv::Mat patch;
+    cv::warpAffine(src, patch, Q, size, flags, cv::BORDER_CONSTANT,
+        cv::Scalar::all(0.));
+    patch.convertTo(dst, cv::DataType<double>::type);
+  }
   //warpAffine(src, dst, Q, size);
 }
 
+namespace {
+
+// Bilinearly interpolates an image at (j + a, i + b), 0 <= a, b < 1,
+// where all four neighbours are known to lie within the image.
+template<class T>
+inline double interpolateInterior(const cv::Mat& image,
+                                  int i,
+                                  int j,
+                                  double a,
+                                  double b) {
+  const T* row0 = image.ptr<T>(i) + j;
+  const T* row1 = image.ptr<T>(i + 1) + j;
+
+  return (1. - b) * ((1. - a) * row0[0] + a * row0[1]) +
+                b * ((1. - a) * row1[0] + a * row1[1]);
+}
+
+#ifdef __SSE2__
+template<>
+inline double interpolateInterior<double>(const cv::Mat& image,
+                                          int i,
+                                          int j,
+                                          double a,
+                                          double b) {
+  const double* row0 = image.ptr<double>(i) + j;
+  const double* row1 = image.ptr<double>(i + 1) + j;
+
+  // The horizontal neighbours are adjacent in memory.
+  __m128d wx = _mm_set_pd(a, 1. - a);
+  __m128d top = _mm_mul_pd(_mm_loadu_pd(row0), _mm_set1_pd(1. - b));
+  __m128d bottom = _mm_mul_pd(_mm_loadu_pd(row1), _mm_set1_pd(b));
+  __m128d t = _mm_mul_pd(_mm_add_pd(top, bottom), wx);
+  return _mm_cvtsd_f64(_mm_add_sd(t, _mm_unpackhi_pd(t, t)));
+}
+
+template<>
+inline double interpolateInterior<float>(const cv::Mat& image,
+                                         int i,
+                                         int j,
+                                         double a,
+                                         double b) {
+  const float* row0 = image.ptr<float>(i) + j;
+  const float* row1 = image.ptr<float>(i + 1) + j;
+
+  // All four neighbours fit in one register.
+  __m128 p = _mm_loadl_pi(_mm_setzero_ps(),
+      reinterpret_cast<const __m64*>(row0));
+  p = _mm_loadh_pi(p, reinterpret_cast<const __m64*>(row1));
+  __m128 w = _mm_setr_ps((1. - a) * (1. - b), a * (1. - b),
+      (1. - a) * b, a * b);
+  __m128 t = _mm_mul_ps(p, w);
+  t = _mm_add_ps(t, _mm_movehl_ps(t, t));
+  t = _mm_add_ss(t, _mm_shuffle_ps(t, t, 1));
+  return _mm_cvtss_f32(t);
+}
+#endif
+
+// Returns the pixel value, or zero outside the image.
+template<class T>
+inline double pixelOrZero(const cv::Mat& image, int i, int j) {
+  if (i < 0 || i >= image.rows || j < 0 || j >= image.cols) {
+    return 0.;
+  }
+  return image.at<T>(i, j);
+}
+
+// Bilinearly interpolates an image near its boundary.
+template<class T>
+inline double interpolateBoundary(const cv::Mat& image,
+                                  int i,
+                                  int j,
+                                  double a,
+                                  double b) {
+  return (1. - b) * ((1. - a) * pixelOrZero<T>(image, i, j) +
+                           a  * pixelOrZero<T>(image, i, j + 1)) +
+                b * ((1. - a) * pixelOrZero<T>(image, i + 1, j) +
+                           a  * pixelOrZero<T>(image, i + 1, j + 1));
+}
+
+// Samples a set of images at (x, y) and writes the values to element index
+// of each output.
+template<class T>
+inline void sampleLinear(const cv::Mat* const* src,
+                         double* const* dst,
+                         int num_images,
+                         const cv::Size& size,
+                         double x,
+                         double y,
+                         int index) {
+  int j = std::floor(x);
+  int i = std::floor(y);
+  double a = x - j;
+  double b = y - i;
+
+  bool interior = (i >= 0 && i + 1 < size.height &&
+                   j >= 0 && j + 1 < size.width);
+
+  for (int k = 0; k < num_images; k += 1) {
+    if (interior) {
+      dst[k][index] = interpolateInterior<T>(*src[k], i, j, a, b);
+    } else {
+      dst[k][index] = interpolateBoundary<T>(*src[k], i, j, a, b);
+    }
+  }
+}
+
+// Samples a set of images of pixel type T at the same warped positions.
+// If points is NULL, samples a width x width grid about the center.
+// The outputs are always double precision.
+template<class T>
+void sampleAffineLinear(const cv::Mat* const* src,
+                        double* const* dst,
+                        int num_images,
+                        const cv::Mat& M,
+                        int width,
+                        const vector<cv::Point>* points) {
+  const cv::Size size = src[0]->size();
+  for (int k = 0; k < num_images; k += 1) {
+    CHECK(src[k]->type() == cv::DataType<T>::type);
+    CHECK(src[k]->size() == size);
+  }
+
+  double m00 = M.at<double>(0, 0);
+  double m01 = M.at<double>(0, 1);
+  double m02 = M.at<double>(0, 2);
+  double m10 = M.at<double>(1, 0);
+  double m11 = M.at<double>(1, 1);
+  double m12 = M.at<double>(1, 2);
+
+  if (points != NULL) {
+    int n = points->size();
+    for (int index = 0; index < n; index += 1) {
+      const cv::Point& p = (*points)[index];
+      // Source position is computed once for all images.
+      double x = m00 * p.x + m01 * p.y + m02;
+      double y = m10 * p.x + m11 * p.y + m12;
+      sampleLinear<T>(src, dst, num_images, size, x, y, index);
+    }
+    return;
+  }
+
+  double offset = (width - 1) / 2.;
+
+  for (int v = 0; v < width; v += 1) {
+    double dv = v - offset;
+
+    for (int u = 0; u < width; u += 1) {
+      double du = u - offset;
+
+      // Source position is computed once for all images.
+      double x = m00 * du + m01 * dv + m02;
+      double y = m10 * du + m11 * dv + m12;
+      sampleLinear<T>(src, dst, num_images, size, x, y, v * width + u);
+    }
+  }
+}
+
+// Dispatches on the pixel type of the source images.
+void sampleAffineLinear(const cv::Mat* const* src,
+                        double* const* dst,
+                        int num_images,
+                        const cv::Mat& M,
+                        int width,
+                        const vector<cv::Point>* points) {
+  if (src[0]->type() == cv::DataType<float>::type) {
+    sampleAffineLinear<float>(src, dst, num_images, M, width, points);
+  } else {
+    sampleAffineLinear<double>(src, dst, num_images, M, width, points);
+  }
+}
+
+// Allocates continuous square patches and returns their data.
+void createPatches(cv::Mat* const* patches,
+                   double** data,
+                   int num_patches,
+                   int width) {
+  for (int k = 0; k < num_patches; k += 1) {
+    cv::Mat& patch = *patches[k];
+    if (!patch.isContinuous()) {
+      patch.release();
+    }
+    patch.create(width, width, cv::DataType<double>::type);
+    data[k] = patch.ptr<double>();
+  }
+}
+
+}
+
+void samplePatchAndGradientsAffine(const cv::Mat& src,
+                                   const cv::Mat& ddx_src,
+                                   const cv::Mat& ddy_src,
+                                   cv::Mat& dst,
+                                   cv::Mat& ddx_dst,
+                                   cv::Mat& ddy_dst,
+                                   const cv::Mat& M,
+                                   int width) {
+  const cv::Mat* srcs[3] = { &src, &ddx_src, &ddy_src };
+  cv::Mat* dsts[3] = { &dst, &ddx_dst, &ddy_dst };
+  double* data[3];
+  createPatches(dsts, data, 3, width);
+  sampleAffineLinear(srcs, data, 3, M, width, NULL);
+}
+
+void samplePatchAffineLinear(const cv::Mat& src,
+                             cv::Mat& dst,
+                             const cv::Mat& M,
+                             int width) {
+  const cv::Mat* srcs[1] = { &src };
+  cv::Mat* dsts[1] = { &dst };
+  double* data[1];
+  createPatches(dsts, data, 1, width);
+  sampleAffineLinear(srcs, data, 1, M, width, NULL);
+}
+
+void samplePointsAndGradientsAffine(const cv::Mat& src,
+                                    const cv::Mat& ddx_src,
+                                    const cv::Mat& ddy_src,
+                                    const vector<cv::Point>& points,
+                                    double* dst,
+                                    double* ddx_dst,
+                                    double* ddy_dst,
+                                    const cv::Mat& M) {
+  const cv::Mat* srcs[3] = { &src, &ddx_src, &ddy_src };
+  double* data[3] = { dst, ddx_dst, ddy_dst };
+  sampleAffineLinear(srcs, data, 3, M, 0, &points);
+}
+
+void samplePointsAffineLinear(const cv::Mat& src,
+                              const vector<cv::Point>& points,
+                              double* dst,
+                              const cv::Mat& M) {
+  const cv::Mat* srcs[1] = { &src };
+  double* data[1] = { dst };
+  sampleAffineLinear(srcs, data, 1, M, 0, &points);
+}
+
+bool isLinearInterpolation(int interpolation) {
+  return (interpolation == cv::INTER_LINEAR ||
+          interpolation == cv::INTER_AREA);
+}
+
 #if 0
 // Unused. Implemented as a sanity check.
 // This is what the OpenCV documentation says it is doing, but I could only
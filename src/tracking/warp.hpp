@@ -46,6 +46,7 @@ class Warp {
 };
 
 // Extracts a square patch of an image after applying a warp.
+// The image may be single or double precision, the patch is always double.
 void samplePatch(const Warp& warp,
                  const cv::Mat& image,
                  cv::Mat& patch,
@@ -61,6 +62,50 @@ void samplePatchAffine(const cv::Mat& src,
                        bool invert,
                        int interpolation);
 
+// Extracts square patches of an image and its two derivatives after applying
+// an affine warp, using bilinear interpolation and a zero border.
+// Equivalent to calling samplePatchAffine() on each image with the same
+// matrix (invert = false), but each source position is computed only once.
+// All images must have the same size and the same type, either single or
+// double precision. The patches are always double precision.
+// Outputs which already have the correct size are written in place.
+void samplePatchAndGradientsAffine(const cv::Mat& src,
+                                   const cv::Mat& ddx_src,
+                                   const cv::Mat& ddy_src,
+                                   cv::Mat& dst,
+                                   cv::Mat& ddx_dst,
+                                   cv::Mat& ddy_dst,
+                                   const cv::Mat& M,
+                                   int width);
+
+// Single-image version of samplePatchAndGradientsAffine().
+void samplePatchAffineLinear(const cv::Mat& src,
+                             cv::Mat& dst,
+                             const cv::Mat& M,
+                             int width);
+
+// Samples an image and its two derivatives at the warped positions of a list
+// of points relative to the center of a patch, using bilinear interpolation
+// and a zero border. The outputs must have room for one value per point.
+void samplePointsAndGradientsAffine(const cv::Mat& src,
+                                    const cv::Mat& ddx_src,
+                                    const cv::Mat& ddy_src,
+                                    const vector<cv::Point>& points,
+                                    double* dst,
+                                    double* ddx_dst,
+                                    double* ddy_dst,
+                                    const cv::Mat& M);
+
+// Single-image version of samplePointsAndGradientsAffine().
+void samplePointsAffineLinear(const cv::Mat& src,
+                              const vector<cv::Point>& points,
+                              double* dst,
+                              const cv::Mat& M);
+
+// Returns whether the bilinear sampling functions implement an interpolation
+// method. (OpenCV treats INTER_AREA as INTER_LINEAR for affine warps.)
+bool isLinearInterpolation(int interpolation);
+
 } // namespace tracking
 
 #endif
@@ -1,18 +1,38 @@
+#include <algorithm>
 #include <sstream>
 #include <cstdlib>
 #include <numeric>
 #include <glog/logging.h>
 #include <gflags/gflags.h>
-#include <boost/scoped_ptr.hpp>
-#include <linear.h>
 
 #include "classifier.hpp"
 #include "descriptor.hpp"
+#include "descriptor_matrix.hpp"
+#include "logistic_regression.hpp"
+#include "read_lines.hpp"
+#include "lexical_cast_parser.hpp"
+#include "util/thread-pool.hpp"
+
 #include "descriptor_reader.hpp"
+#include "classifier_reader.hpp"
 #include "iterator_reader.hpp"
 #include "iterator_writer.hpp"
 #include "classifier_writer.hpp"
 
+DEFINE_double(positive_cost, 0.5, "Weight of the loss of the positive example");
+DEFINE_double(negative_cost, 0.01, "Weight of the loss of each negative");
+DEFINE_int32(num_threads, 4,
+    "Number of worker threads to train classifiers with, 0 for none");
+DEFINE_string(initial_classifiers, "",
+    "Start from the classifiers in this file, such as those trained on a "
+    "previous set of descriptors. Requires --ids and --initial_ids.");
+DEFINE_string(ids, "",
+    "File with the id of each descriptor, one per line, such as its track");
+DEFINE_string(initial_ids, "",
+    "File with the id of each initial classifier, one per line. A "
+    "descriptor starts from the classifier with the same id, or from zero if "
+    "there is none.");
+
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
   usage << "Trains a classifier for every feature in the image." << std::endl;
@@ -29,144 +49,6 @@ void init(int& argc, char**& argv) {
   }
 }
 
-typedef std::vector<feature_node> Example;
-
-void descriptorToExample(const Descriptor& descriptor, Example& example) {
-  example.clear();
-
-  // Feature indices start at 1 not 0.
-  int index = 1;
-
-  // Copy non-zero elements.
-  const Descriptor::Data& data = descriptor.data;
-  Descriptor::Data::const_iterator x;
-  for (x = data.begin(); x != data.end(); ++x) {
-    if (*x != 0) {
-      feature_node node;
-      node.index = index;
-      node.value = *x;
-
-      example.push_back(node);
-    }
-
-    index += 1;
-  }
-
-  // Append bias term.
-  feature_node one;
-  one.index = index;
-  one.value = 1;
-  example.push_back(one);
-
-  // Append terminator.
-  feature_node end;
-  end.index = -1;
-  end.value = 0;
-  example.push_back(end);
-}
-
-void descriptorsToExamples(const std::deque<Descriptor>& descriptors,
-                           std::deque<Example>& examples) {
-  examples.clear();
-
-  std::deque<Descriptor>::const_iterator desc;
-  for (desc = descriptors.begin(); desc != descriptors.end(); ++desc) {
-    Example example;
-    descriptorToExample(*desc, example);
-
-    examples.push_back(Example());
-    examples.back().swap(example);
-  }
-}
-
-void nop(const char*) {}
-
-double negate(double x) {
-  return -x;
-}
-
-// n -- Dimensionality of vectors (not including the bias term).
-void trainClassifier(const std::vector<const feature_node*>& examples,
-                     const std::vector<double>& labels,
-                     double C1,
-                     double C2,
-                     int n,
-                     Classifier& classifier) {
-  // Set up problem.
-  problem prob;
-  prob.l = examples.size();
-  prob.n = n + 1;
-  prob.y = const_cast<double*>(&labels.front());
-  prob.x = const_cast<feature_node**>(&examples.front());
-  prob.bias = 1;
-
-  int weight_label[2] = { 1, 2 };
-  double weight[2] = { C1, C2 };
-
-  parameter param;
-  param.solver_type = L2R_LR;
-  param.eps = 1e-6;
-  param.C = 1;
-  param.nr_weight = 2;
-  param.weight_label = weight_label;
-  param.weight = weight;
-
-  CHECK(check_parameter(&prob, &param) == NULL) <<
-      "Invalid SVM problem definition";
-
-  model* mod = train(&prob, &param);
-
-  classifier.w.clear();
-  // Copy first n elements into weight vector.
-  std::copy(&mod->w[0], &mod->w[n], std::back_inserter(classifier.w));
-  // Set bias to last element.
-  classifier.b = mod->w[n];
-
-  if (labels[0] == 1) {
-    // First example was not in positive class. Negate w and b.
-    // Not sure why this is necessary.
-    std::transform(classifier.w.begin(), classifier.w.end(),
-        classifier.w.begin(), negate);
-    classifier.b = -classifier.b;
-  }
-
-  free_and_destroy_model(&mod);
-}
-
-void trainClassifiers(const std::deque<Descriptor>& descriptors,
-                      std::deque<Classifier>& classifiers,
-                      double C_pos,
-                      double C_neg) {
-  // Convert descriptors to liblinear examples.
-  std::deque<Example> examples;
-  descriptorsToExamples(descriptors, examples);
-
-  // Obtain a list of pointers to the examples' data.
-  std::vector<const feature_node*> data;
-  std::deque<Example>::const_iterator example;
-  for (example = examples.begin(); example != examples.end(); ++example) {
-    data.push_back(&example->front());
-  }
-
-  size_t num_examples = descriptors.size();
-  CHECK(!descriptors.empty());
-  size_t num_dims = descriptors.front().data.size();
-  std::vector<double> labels(num_examples, 1);
-  classifiers.clear();
-
-  for (size_t i = 0; i < num_examples; i += 1) {
-    labels[i] = 2;
-
-    Classifier classifier;
-    trainClassifier(data, labels, C_neg, C_pos, num_dims, classifier);
-
-    classifiers.push_back(Classifier());
-    classifiers.back().swap(classifier);
-
-    labels[i] = 1;
-  }
-}
-
 void classify(const Classifier& classifier,
               const std::deque<Descriptor>& descriptors,
               std::vector<bool>& labels) {
@@ -286,14 +168,14 @@ ClassifierResult evaluateClassifier(const Classifier& classifier,
   return result;
 }
 
-void evaluateClassifiers(const std::deque<Classifier>& classifiers,
+void evaluateClassifiers(const std::vector<Classifier>& classifiers,
                          const std::deque<Descriptor>& descriptors,
                          std::vector<ClassifierResult>& results) {
   results.clear();
 
   CHECK(classifiers.size() == descriptors.size());
 
-  std::deque<Classifier>::const_iterator classifier;
+  std::vector<Classifier>::const_iterator classifier;
   int i = 0;
 
   for (classifier = classifiers.begin();
@@ -322,12 +204,52 @@ int main(int argc, char** argv) {
   CHECK(ok) << "Could not load descriptors from file";
   LOG(INFO) << "Loaded " << descriptors.size() << " descriptors";
 
-  // Silence output of liblinear.
-  set_print_string_function(nop);
+  CHECK(!descriptors.empty()) << "No descriptors";
+
+  // Every classifier reads the same negatives.
+  DescriptorMatrix examples;
+  listToMatrix(descriptors, examples);
+
+  int num_descriptors = descriptors.size();
+  std::vector<std::vector<int> > positives(num_descriptors);
+  for (int i = 0; i < num_descriptors; i += 1) {
+    positives[i].push_back(i);
+  }
+
+  std::vector<Classifier> classifiers;
+  if (!FLAGS_initial_classifiers.empty()) {
+    // The position of a descriptor changes when the set of tracks does.
+    CHECK(!FLAGS_ids.empty() && !FLAGS_initial_ids.empty()) <<
+        "--initial_classifiers requires --ids and --initial_ids";
+
+    std::vector<Classifier> initial;
+    ClassifierReader classifier_reader;
+    ok = loadList(FLAGS_initial_classifiers, initial, classifier_reader);
+    CHECK(ok) << "Could not load initial classifiers";
+
+    LexicalCastParser<int> parser;
+    std::vector<int> ids;
+    ok = readLinesOf(FLAGS_ids, ids, parser);
+    CHECK(ok) << "Could not load descriptor ids";
+    CHECK(int(ids.size()) == num_descriptors) <<
+        "Number of descriptors and ids differ";
+    std::vector<int> initial_ids;
+    ok = readLinesOf(FLAGS_initial_ids, initial_ids, parser);
+    CHECK(ok) << "Could not load initial classifier ids";
+    CHECK(initial_ids.size() == initial.size()) <<
+        "Number of initial classifiers and ids differ";
+
+    matchClassifiersById(initial, initial_ids, ids, classifiers);
+    LOG(INFO) << "Starting from " << initial.size() << " classifiers";
+  }
+
+  LogisticRegressionOptions options;
+  options.positive_cost = FLAGS_positive_cost;
+  options.negative_cost = FLAGS_negative_cost;
 
-  // Convert each descriptor to a training instance.
-  std::deque<Classifier> classifiers;
-  trainClassifiers(descriptors, classifiers, 0.5, 0.01);
+  // Train one classifier for each descriptor against all others.
+  ThreadPool pool(FLAGS_num_threads);
+  trainLogisticRegressions(examples, positives, options, classifiers, pool);
 
   std::vector<ClassifierResult> results;
   evaluateClassifiers(classifiers, descriptors, results);
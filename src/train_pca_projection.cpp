@@ -0,0 +1,74 @@
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <sstream>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "descriptor_matrix.hpp"
+#include "pca_projection.hpp"
+
+#include "read_lines.hpp"
+#include "feature_files.hpp"
+#include "pca_projection_writer.hpp"
+
+DEFINE_int32(num_components, 32, "Number of dimensions to project onto");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Learns a PCA projection of descriptors." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " descriptors-files projection" << std::endl;
+  usage << std::endl;
+  usage << "descriptors-files -- Input. One descriptors file per line." <<
+      std::endl;
+  usage << "projection -- Output." << std::endl;
+  usage << std::endl;
+  usage << "Every descriptor is used, one file at a time." << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string descriptors_files_file = argv[1];
+  std::string projection_file = argv[2];
+
+  bool ok;
+
+  std::vector<std::string> descriptors_files;
+  ok = readLines(descriptors_files_file, descriptors_files);
+  CHECK(ok) << "Could not load list of descriptors files";
+
+  DescriptorCovariance covariance;
+
+  std::vector<std::string>::const_iterator file;
+  for (file = descriptors_files.begin();
+       file != descriptors_files.end();
+       ++file) {
+    DescriptorMatrix descriptors;
+    ok = loadDescriptorMatrix(*file, descriptors);
+    CHECK(ok) << "Could not load descriptors \"" << *file << "\"";
+    covariance.add(descriptors);
+  }
+
+  CHECK(covariance.count() > 0) << "No descriptors to train with";
+  LOG(INFO) << "Training with " << covariance.count() << " descriptors";
+
+  PcaProjection projection;
+  projection.train(covariance, FLAGS_num_components);
+
+  PcaProjectionWriter writer;
+  ok = save(projection_file, projection, writer);
+  CHECK(ok) << "Could not save projection";
+
+  return 0;
+}
@@ -0,0 +1,123 @@
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <sstream>
+#include <algorithm>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "descriptor_matrix.hpp"
+#include "product_quantizer.hpp"
+
+#include "read_lines.hpp"
+#include "descriptor_matrix_reader.hpp"
+#include "product_quantizer_writer.hpp"
+
+DEFINE_int32(num_subspaces, 16, "Number of subspaces, one byte per code");
+DEFINE_int32(num_centers, 256, "Number of centers in each subspace");
+DEFINE_int32(max_num_training, 100000,
+    "Maximum number of descriptors to train with");
+DEFINE_int32(seed, 0, "Seed for random sampling and initialization");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Learns a product quantizer from a sample of descriptors." <<
+      std::endl;
+  usage << std::endl;
+  usage << argv[0] << " descriptors-files quantizer" << std::endl;
+  usage << std::endl;
+  usage << "descriptors-files -- Input. One descriptors file per line." <<
+      std::endl;
+  usage << "quantizer -- Output." << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+// Keeps a uniform random sample of the rows seen so far.
+// Only the sample is kept in memory, however many descriptors there are.
+void sampleRows(const DescriptorMatrix& descriptors,
+                DescriptorMatrix& sample,
+                int& num_seen,
+                boost::random::mt19937& generator) {
+  int max_num = sample.rows();
+
+  for (int i = 0; i < descriptors.rows(); i += 1) {
+    int j;
+    if (num_seen < max_num) {
+      j = num_seen;
+    } else {
+      boost::random::uniform_int_distribution<int> uniform(0, num_seen);
+      j = uniform(generator);
+    }
+
+    if (j < max_num) {
+      const float* src = descriptors.row<float>(i);
+      std::copy(src, src + descriptors.cols(), sample.row<float>(j));
+    }
+    num_seen += 1;
+  }
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string descriptors_files_file = argv[1];
+  std::string quantizer_file = argv[2];
+
+  bool ok;
+
+  std::vector<std::string> descriptors_files;
+  ok = readLines(descriptors_files_file, descriptors_files);
+  CHECK(ok) << "Could not load list of descriptors files";
+
+  boost::random::mt19937 generator(FLAGS_seed);
+  DescriptorMatrix sample;
+  int num_seen = 0;
+
+  std::vector<std::string>::const_iterator file;
+  for (file = descriptors_files.begin();
+       file != descriptors_files.end();
+       ++file) {
+    DescriptorMatrixReader reader;
+    DescriptorMatrix descriptors;
+    ok = load(*file, descriptors, reader);
+    CHECK(ok) << "Could not load descriptors \"" << *file << "\"";
+
+    if (descriptors.empty()) {
+      continue;
+    }
+    if (sample.empty()) {
+      sample.create(FLAGS_max_num_training, descriptors.cols());
+    }
+    CHECK(descriptors.cols() == sample.cols()) << "Descriptors differ in size";
+
+    sampleRows(descriptors, sample, num_seen, generator);
+  }
+
+  // Use only the rows which were filled.
+  int num_training = std::min(num_seen, FLAGS_max_num_training);
+  CHECK(num_training > 0) << "No descriptors to train with";
+  DescriptorMatrix training;
+  copyToDescriptorMatrix(sample.mat().rowRange(0, num_training), training);
+  LOG(INFO) << "Training with " << num_training << " of " << num_seen <<
+      " descriptors";
+
+  ProductQuantizer quantizer;
+  quantizer.train(training, FLAGS_num_subspaces, FLAGS_num_centers,
+      generator);
+
+  ProductQuantizerWriter writer;
+  ok = save(quantizer_file, quantizer, writer);
+  CHECK(ok) << "Could not save quantizer";
+
+  return 0;
+}
@@ -52,3 +52,14 @@ bool TranslationWarper::isValid(const double* params,
 
   return true;
 }
+
+void TranslationWarper::setIdentity(double* params) const {
+  params[0] = 0;
+  params[1] = 0;
+}
+
+void TranslationWarper::paramsFromMatrix(const cv::Mat& M,
+                                         double* params) const {
+  params[0] = M.at<double>(0, 2);
+  params[1] = M.at<double>(1, 2);
+}
@@ -5,6 +5,7 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <boost/bind.hpp>
+#include <boost/format.hpp>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include "image_point_reader.hpp"
@@ -12,57 +13,40 @@
 #include "iterator_reader.hpp"
 #include "iterator_writer.hpp"
 #include "camera_properties_reader.hpp"
-#include "distortion.hpp"
+#include "image_undistorter.hpp"
 #include "read_image.hpp"
 #include "util.hpp"
 
 DEFINE_string(output_file, "undistorted.png", "Location to save image.");
 DEFINE_bool(save, false, "Save to file?");
 DEFINE_bool(display, true, "Show matches?");
-
-struct Distort {
-  cv::Mat K;
-  cv::Mat K_inv; // to avoid inverting every iteration
-  double w;
-
-  cv::Point2d operator()(cv::Point2d x) const {
-    // Undo intrinsics.
-    cv::Mat X = imagePointToHomogeneous(x);
-    X = K_inv * X;
-
-    // Apply radial distortion.
-    x = imagePointFromHomogeneous(X);
-    x = distort(x, w);
-
-    // Redo intrinsics.
-    X = imagePointToHomogeneous(x);
-    X = K * X;
-
-    return imagePointFromHomogeneous(X);
-  }
-
-  Distort(const cv::Matx33d& K, double w) : K(), K_inv(), w(w) {
-    this->K = cv::Mat(K, true);
-    this->K_inv = this->K.inv();
-  }
-};
+DEFINE_bool(all_frames, false,
+    "Undistort every frame of a sequence? Arguments are then image-format "
+    "camera-properties output-format and each frame is saved, not shown. "
+    "The undistortion maps are computed once for all frames.");
 
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
   usage << "Removes lens distortion from an image." << std::endl;
   usage << std::endl;
   usage << argv[0] << " distorted-image camera-properties" << std::endl;
+  usage << argv[0] << " -all_frames image-format camera-properties"
+      " output-format" << std::endl;
 
   google::SetUsageMessage(usage.str());
   google::ParseCommandLineFlags(&argc, &argv, true);
   google::InitGoogleLogging(argv[0]);
 }
 
+std::string makeFilename(const std::string& format, int n) {
+  return boost::str(boost::format(format) % (n + 1));
+}
+
 int main(int argc, char** argv) {
   init(argc, argv);
 
   // Read required parameters.
-  if (argc != 3) {
+  if (argc != (FLAGS_all_frames ? 4 : 3)) {
     google::ShowUsageWithFlags(argv[0]);
     return 1;
   }
@@ -71,44 +55,42 @@ int main(int argc, char** argv) {
 
   bool ok;
 
-  // Load image.
-  cv::Mat image;
-  cv::Mat gray_image;
-  ok = readImage(image_file, image, gray_image);
-  CHECK(ok) << "Could not read image";
-
   // Load camera properties.
   CameraProperties camera;
   CameraPropertiesReader camera_reader;
   ok = load(camera_file, camera, camera_reader);
   CHECK(ok) << "Could not load camera properties";
 
-  // Build intrinsic matrix from camera.
-  cv::Matx33d K = camera.matrix();
+  ImageUndistorter undistorter(camera);
+
+  if (FLAGS_all_frames) {
+    std::string output_format = argv[3];
+    int num_frames = countFrameFiles(image_file);
+    LOG(INFO) << "Undistorting " << num_frames << " frames";
 
-  int width = camera.image_size.width;
-  int height = camera.image_size.height;
+    for (int t = 0; t < num_frames; t += 1) {
+      cv::Mat image;
+      cv::Mat gray_image;
+      ok = readImage(makeFilename(image_file, t), image, gray_image);
+      CHECK(ok) << "Could not read image";
 
-  // Construct a list of every pixel in the output image.
-  std::vector<cv::Point2f> points;
-  for (int i = 0; i < height; i += 1) {
-    for (int j = 0; j < width; j += 1) {
-      points.push_back(cv::Point2d(j, i));
+      cv::Mat undistorted;
+      undistorter.undistort(image, undistorted);
+      ok = cv::imwrite(makeFilename(output_format, t), undistorted);
+      CHECK(ok) << "Could not save image";
     }
-  }
 
-  // Apply forward transform to every pixel in the output image.
-  std::transform(points.begin(), points.end(), points.begin(),
-      Distort(K, camera.distort_w));
+    return 0;
+  }
 
-  // Not sure about this....
-  cv::Vec2f* data = static_cast<cv::Vec2f*>(
-      static_cast<void*>(&points.front()));
-  cv::Mat map = cv::Mat_<cv::Vec2f>(height, width, data);
+  // Load image.
+  cv::Mat image;
+  cv::Mat gray_image;
+  ok = readImage(image_file, image, gray_image);
+  CHECK(ok) << "Could not read image";
 
-  // Sample input image at these locations.
   cv::Mat undistorted;
-  cv::remap(image, undistorted, map, cv::Mat(), cv::INTER_LINEAR);
+  undistorter.undistort(image, undistorted);
 
   if (FLAGS_save) {
     cv::imwrite(FLAGS_output_file, undistorted);
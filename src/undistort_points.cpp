@@ -1,43 +1,21 @@
 #include <iostream>
 #include <opencv2/core/core.hpp>
 #include <boost/bind.hpp>
+#include <boost/format.hpp>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include "image_point_reader.hpp"
 #include "image_point_writer.hpp"
 #include "iterator_reader.hpp"
 #include "iterator_writer.hpp"
-#include "distortion.hpp"
 #include "camera_properties_reader.hpp"
+#include "distortion.hpp"
 #include "read_image.hpp"
 #include "util.hpp"
 
-struct Undistort {
-  cv::Mat K;
-  cv::Mat K_inv; // to avoid inverting every iteration
-  double w;
-
-  cv::Point2d operator()(cv::Point2d x) const {
-    // Undo intrinsics.
-    cv::Mat X = imagePointToHomogeneous(x);
-    X = K_inv * X;
-
-    // Apply radial distortion.
-    x = imagePointFromHomogeneous(X);
-    x = undistort(x, w);
-
-    // Redo intrinsics.
-    X = imagePointToHomogeneous(x);
-    X = K * X;
-
-    return imagePointFromHomogeneous(X);
-  }
-
-  Undistort(const cv::Matx33d& K, double w) : K(), K_inv(), w(w) {
-    this->K = cv::Mat(K, true);
-    this->K_inv = this->K.inv();
-  }
-};
+DEFINE_bool(all_frames, false,
+    "Undistort the points of every frame of a sequence? Arguments are then "
+    "formats for each frame's distorted and undistorted points.");
 
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
@@ -45,12 +23,46 @@ void init(int& argc, char**& argv) {
   usage << std::endl;
   usage << argv[0] << " distorted-points undistorted-points"
       " camera-properties" << std::endl;
+  usage << argv[0] << " -all_frames distorted-format undistorted-format"
+      " camera-properties" << std::endl;
 
   google::SetUsageMessage(usage.str());
   google::ParseCommandLineFlags(&argc, &argv, true);
   google::InitGoogleLogging(argv[0]);
 }
 
+std::string makeFilename(const std::string& format, int n) {
+  return boost::str(boost::format(format) % (n + 1));
+}
+
+// Takes points in the distorted image to the undistorted image.
+void undistortPoints(const CameraProperties& camera,
+                     const UndistortionTable& table,
+                     std::vector<cv::Point2d>& points) {
+  camera.calibrateAndUndistort(table, points, points);
+  camera.uncalibrate(points, points);
+}
+
+void undistortPointsFile(const std::string& distorted_points_file,
+                         const std::string& undistorted_points_file,
+                         const CameraProperties& camera,
+                         const UndistortionTable& table) {
+  bool ok;
+
+  // Load points.
+  std::vector<cv::Point2d> points;
+  ImagePointReader<double> point_reader;
+  ok = loadList(distorted_points_file, points, point_reader);
+  CHECK(ok) << "Could not load points";
+
+  undistortPoints(camera, table, points);
+
+  // Write out undistorted points.
+  ImagePointWriter<double> point_writer;
+  ok = saveList(undistorted_points_file, points, point_writer);
+  CHECK(ok) << "Could not save points";
+}
+
 int main(int argc, char** argv) {
   init(argc, argv);
 
@@ -65,29 +77,26 @@ int main(int argc, char** argv) {
 
   bool ok;
 
-  // Load points.
-  std::vector<cv::Point2d> points;
-  ImagePointReader<double> point_reader;
-  ok = loadList(distorted_points_file, points, point_reader);
-  CHECK(ok) << "Could not load points";
-
   // Load camera properties.
   CameraProperties camera;
   CameraPropertiesReader camera_reader;
   ok = load(camera_file, camera, camera_reader);
   CHECK(ok) << "Could not load camera";
-
-  // Build intrinsic matrix from camera.
-  cv::Matx33d K = camera.matrix();
-
-  // Undistort.
-  std::transform(points.begin(), points.end(), points.begin(),
-      Undistort(K, camera.distort_w));
-
-  // Write out undistorted points.
-  ImagePointWriter<double> point_writer;
-  ok = saveList(undistorted_points_file, points, point_writer);
-  CHECK(ok) << "Could not save points";
+  // Shared by every frame.
+  UndistortionTable table = camera.undistortionTable();
+
+  if (FLAGS_all_frames) {
+    int num_frames = countFrameFiles(distorted_points_file);
+    LOG(INFO) << "Undistorting points of " << num_frames << " frames";
+
+    for (int t = 0; t < num_frames; t += 1) {
+      undistortPointsFile(makeFilename(distorted_points_file, t),
+          makeFilename(undistorted_points_file, t), camera, table);
+    }
+  } else {
+    undistortPointsFile(distorted_points_file, undistorted_points_file,
+        camera, table);
+  }
 
   return 0;
 }
@@ -0,0 +1,92 @@
+#include "undistortable_mask.hpp"
+#include <algorithm>
+#include <cmath>
+#include "axis_aligned_ellipse.hpp"
+#include "util.hpp"
+
+UndistortableMask::UndistortableMask() : size_(), begins_(), ends_() {}
+
+UndistortableMask::UndistortableMask(const CameraProperties& camera)
+    : size_(camera.image_size), begins_(), ends_() {
+  AxisAlignedEllipse region = camera.undistortableRegion();
+  int width = size_.width;
+  int height = size_.height;
+
+  begins_.assign(height, 0);
+  ends_.assign(height, 0);
+
+  for (int y = 0; y < height; y += 1) {
+    double t = 1. - sqr((y - region.center.y) / region.b);
+    if (!(t >= 0)) {
+      continue;
+    }
+
+    // Solve the ellipse for the columns of this row, within the image.
+    double half_width = region.a * std::sqrt(t);
+    int first = std::max(std::ceil(region.center.x - half_width), 0.);
+    int last = std::min(std::floor(region.center.x + half_width),
+        width - 1.);
+
+    // Correct any rounding so that the span agrees with the ellipse exactly.
+    while (first <= last && !region.contains(cv::Point2d(first, y))) {
+      first += 1;
+    }
+    while (first > 0 && region.contains(cv::Point2d(first - 1, y))) {
+      first -= 1;
+    }
+    while (last >= first && !region.contains(cv::Point2d(last, y))) {
+      last -= 1;
+    }
+    while (last + 1 < width && region.contains(cv::Point2d(last + 1, y))) {
+      last += 1;
+    }
+
+    if (first <= last) {
+      begins_[y] = first;
+      ends_[y] = last + 1;
+    }
+  }
+}
+
+cv::Size UndistortableMask::size() const {
+  return size_;
+}
+
+int UndistortableMask::begin(int y) const {
+  return begins_[y];
+}
+
+int UndistortableMask::end(int y) const {
+  return ends_[y];
+}
+
+bool UndistortableMask::contains(const cv::Point& pixel) const {
+  // Unsigned comparison also rejects negative co-ordinates.
+  if (static_cast<unsigned>(pixel.y) >= begins_.size()) {
+    return false;
+  }
+  int x = pixel.x - begins_[pixel.y];
+  return static_cast<unsigned>(x) <
+      static_cast<unsigned>(ends_[pixel.y] - begins_[pixel.y]);
+}
+
+void UndistortableMask::filter(std::vector<cv::Point>& pixels) const {
+  std::vector<cv::Point>::iterator out = pixels.begin();
+  std::vector<cv::Point>::const_iterator pixel;
+  for (pixel = pixels.begin(); pixel != pixels.end(); ++pixel) {
+    if (contains(*pixel)) {
+      *out = *pixel;
+      ++out;
+    }
+  }
+  pixels.erase(out, pixels.end());
+}
+
+void UndistortableMask::draw(cv::Mat& image) const {
+  image = cv::Mat_<uchar>(size_, uchar(0));
+  int height = size_.height;
+  for (int y = 0; y < height; y += 1) {
+    uchar* row = image.ptr<uchar>(y);
+    std::fill(row + begins_[y], row + ends_[y], uchar(255));
+  }
+}
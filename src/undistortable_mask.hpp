@@ -0,0 +1,35 @@
+#ifndef UNDISTORTABLE_MASK_HPP_
+#define UNDISTORTABLE_MASK_HPP_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "camera_properties.hpp"
+
+// The pixels of an image which are inside the undistortable region of its
+// camera. The region is an ellipse, so each row is one span of columns.
+// Testing a pixel is two comparisons instead of evaluating the ellipse.
+class UndistortableMask {
+  public:
+    UndistortableMask();
+    explicit UndistortableMask(const CameraProperties& camera);
+
+    cv::Size size() const;
+    // Pixels [begin(y), end(y)) of row y are in the mask.
+    int begin(int y) const;
+    int end(int y) const;
+
+    bool contains(const cv::Point& pixel) const;
+    // Removes the pixels which are not in the mask, keeping the order of the
+    // rest.
+    void filter(std::vector<cv::Point>& pixels) const;
+
+    // Draws the mask as an 8-bit image which is non-zero inside.
+    void draw(cv::Mat& image) const;
+
+  private:
+    cv::Size size_;
+    std::vector<int> begins_;
+    std::vector<int> ends_;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "chunked_archive.hpp"
+
+DEFINE_bool(list, false, "Print the keys instead of extracting them?");
+
+void init(int& argc, char**& argv) {
+  std::ostringstream usage;
+  usage << "Extracts files from a chunked archive." << std::endl;
+  usage << std::endl;
+  usage << argv[0] << " archive [key ...]" << std::endl;
+  usage << std::endl;
+  usage << "key -- Name to extract to. All entries are extracted if none are"
+    " given." << std::endl;
+  google::SetUsageMessage(usage.str());
+
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc < 2) {
+    google::ShowUsageWithFlags(argv[0]);
+    std::exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  init(argc, argv);
+
+  std::string archive_file = argv[1];
+  std::vector<std::string> keys(argv + 2, argv + argc);
+
+  ChunkedArchiveReader archive;
+  bool ok = archive.open(archive_file);
+  CHECK(ok) << "Could not open archive";
+
+  if (keys.empty()) {
+    archive.keys(keys);
+  }
+
+  std::vector<std::string>::const_iterator key;
+  for (key = keys.begin(); key != keys.end(); ++key) {
+    if (FLAGS_list) {
+      std::cout << *key << std::endl;
+      continue;
+    }
+
+    std::string data;
+    ok = archive.read(*key, data);
+    CHECK(ok) << "Could not read `" << *key << "'";
+
+    std::ofstream file(key->c_str(), std::ios_base::out |
+        std::ios_base::binary | std::ios_base::trunc);
+    CHECK(file) << "Could not open `" << *key << "' for writing";
+    file.write(data.data(), data.size());
+    CHECK(file.good()) << "Could not write to `" << *key << "'";
+  }
+
+  return 0;
+}
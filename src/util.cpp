@@ -1,5 +1,13 @@
 #include "util.hpp"
 #include <fstream>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <set>
+#include <dirent.h>
+#include <boost/format.hpp>
+#include <glog/logging.h>
 
 double cond(const cv::Mat& A) {
   // Compute condition number.
@@ -8,6 +16,167 @@ double cond(const cv::Mat& A) {
   return sigma.front() / sigma.back();
 }
 
+double condFromNormalMatrix(const cv::Mat& AtA) {
+  // Singular values of A are square roots of eigenvalues of A^T A.
+  cv::Mat lambda;
+  cv::eigen(AtA, lambda);
+
+  double lambda_max = lambda.at<double>(0);
+  double lambda_min = lambda.at<double>(lambda.rows - 1);
+  if (lambda_min <= 0) {
+    return std::numeric_limits<double>::infinity();
+  }
+
+  return std::sqrt(lambda_max / lambda_min);
+}
+
 bool fileExists(const std::string& filename) {
   return std::ifstream(filename.c_str()).good();
 }
+
+namespace {
+
+std::string makeFrameFilename(const std::string& format, int t) {
+  return boost::str(boost::format(format) % (t + 1));
+}
+
+// Splits a format into directory, prefix and suffix around a single integer
+// conversion such as %d or %05d. Returns false for any other format.
+bool splitFrameFormat(const std::string& format,
+                      std::string& directory,
+                      std::string& prefix,
+                      std::string& suffix) {
+  size_t begin = std::string::npos;
+  size_t end = std::string::npos;
+
+  for (size_t i = 0; i < format.size(); i += 1) {
+    if (format[i] != '%') {
+      continue;
+    }
+    if (i + 1 < format.size() && format[i + 1] == '%') {
+      // Literal percent sign.
+      i += 1;
+      continue;
+    }
+
+    size_t j = i + 1;
+    while (j < format.size() && std::isdigit(format[j])) {
+      j += 1;
+    }
+    if (begin != std::string::npos || j == format.size() || format[j] != 'd') {
+      return false;
+    }
+    begin = i;
+    end = j + 1;
+    i = j;
+  }
+
+  if (begin == std::string::npos) {
+    return false;
+  }
+
+  size_t slash = format.rfind('/', begin);
+  if (format.find('/', end) != std::string::npos) {
+    return false;
+  }
+  if (slash == std::string::npos) {
+    directory = ".";
+    prefix = format.substr(0, begin);
+  } else {
+    directory = format.substr(0, slash);
+    prefix = format.substr(slash + 1, begin - slash - 1);
+  }
+  suffix = format.substr(end);
+
+  // Literal percent signs would need to be unescaped.
+  return prefix.find('%') == std::string::npos &&
+      suffix.find('%') == std::string::npos &&
+      directory.find('%') == std::string::npos;
+}
+
+// Finds the numbers of all files in the directory which match the format.
+bool listFrameNumbers(const std::string& format, std::set<int>& numbers) {
+  std::string directory;
+  std::string prefix;
+  std::string suffix;
+  if (!splitFrameFormat(format, directory, prefix, suffix)) {
+    return false;
+  }
+
+  DIR* dir = opendir(directory.c_str());
+  if (dir == NULL) {
+    return false;
+  }
+
+  std::string path = (directory == "." && format.compare(0, 2, "./") != 0) ?
+      "" : directory + "/";
+  const size_t MAX_DIGITS = 9;
+
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    std::string name = entry->d_name;
+    if (name.size() <= prefix.size() + suffix.size() ||
+        name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - suffix.size(), suffix.size(),
+            suffix) != 0) {
+      continue;
+    }
+
+    std::string digits = name.substr(prefix.size(),
+        name.size() - prefix.size() - suffix.size());
+    bool valid = digits.size() <= MAX_DIGITS;
+    for (size_t i = 0; valid && i < digits.size(); i += 1) {
+      valid = std::isdigit(digits[i]);
+    }
+    if (!valid) {
+      continue;
+    }
+
+    // Check padding by formatting the number again.
+    int number = std::atoi(digits.c_str());
+    if (number > 0 && makeFrameFilename(format, number - 1) == path + name) {
+      numbers.insert(number);
+    }
+  }
+
+  closedir(dir);
+  return true;
+}
+
+}
+
+int countFrameFiles(const std::string& format) {
+  std::set<int> numbers;
+  if (listFrameNumbers(format, numbers)) {
+    int n = 0;
+    while (numbers.count(n + 1) > 0) {
+      n += 1;
+    }
+    return n;
+  }
+
+  LOG(INFO) << "Could not list frames of `" << format << "', probing instead";
+
+  if (!fileExists(makeFrameFilename(format, 0))) {
+    return 0;
+  }
+
+  // Frame low exists and frame high does not.
+  int low = 0;
+  int high = 1;
+  while (fileExists(makeFrameFilename(format, high))) {
+    low = high;
+    high *= 2;
+  }
+
+  while (high - low > 1) {
+    int middle = low + (high - low) / 2;
+    if (fileExists(makeFrameFilename(format, middle))) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+
+  return high;
+}
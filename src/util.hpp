@@ -27,6 +27,11 @@ inline cv::Point2d affineTransformImagePoint(const cv::Point2d& x,
 
 double cond(const cv::Mat& A);
 
+// Returns the condition number of A given only its normal matrix A^T A.
+// Equal to cond(A) (for full column rank), but much cheaper when A has many
+// more rows than columns.
+double condFromNormalMatrix(const cv::Mat& AtA);
+
 template<class T>
 T* takeAddress(T& x);
 
@@ -38,6 +43,14 @@ U* takeAddressAndCast(T& x);
 
 bool fileExists(const std::string& filename);
 
+// Counts the consecutive frames 0, 1, ... of a sequence whose files are named
+// by boost::format(format) % (t + 1).
+//
+// If the number is the only conversion and is in the last component of the
+// path, the directory is listed once. Otherwise files are probed at doubling
+// times and then by bisection, which assumes that no frame is missing.
+int countFrameFiles(const std::string& format);
+
 #include "util.inl"
 
 #endif
@@ -0,0 +1,66 @@
+#ifndef UTIL_BOUNDED_QUEUE_HPP_
+#define UTIL_BOUNDED_QUEUE_HPP_
+
+#include <deque>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+// A first-in first-out queue of limited capacity, for passing items between
+// the stages of a pipeline which run in different threads.
+//
+// The producer calls close() when it has finished. The consumer receives
+// the remaining items and then pop() returns false.
+template<class T>
+class BoundedQueue {
+  public:
+    explicit BoundedQueue(int capacity)
+        : items_(), mutex_(), not_empty_(), not_full_(),
+          capacity_(capacity > 0 ? capacity : 1), closed_(false) {}
+
+    // Blocks while the queue is full.
+    void push(const T& item) {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (int(items_.size()) >= capacity_) {
+        not_full_.wait(lock);
+      }
+      items_.push_back(item);
+      not_empty_.notify_one();
+    }
+
+    // Blocks while the queue is empty and open.
+    // Returns false if the queue is empty and closed.
+    bool pop(T& item) {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (items_.empty() && !closed_) {
+        not_empty_.wait(lock);
+      }
+      if (items_.empty()) {
+        return false;
+      }
+      item = items_.front();
+      items_.pop_front();
+      not_full_.notify_one();
+      return true;
+    }
+
+    // Signals that no more items will be pushed.
+    void close() {
+      boost::mutex::scoped_lock lock(mutex_);
+      closed_ = true;
+      not_empty_.notify_all();
+    }
+
+  private:
+    std::deque<T> items_;
+    boost::mutex mutex_;
+    boost::condition_variable not_empty_;
+    boost::condition_variable not_full_;
+    int capacity_;
+    bool closed_;
+
+    // Non-copyable.
+    BoundedQueue(const BoundedQueue&);
+    BoundedQueue& operator=(const BoundedQueue&);
+};
+
+#endif
@@ -1,4 +1,6 @@
 #include "util/cond.hpp"
+#include <cmath>
+#include <limits>
 
 double cond(const cv::Mat& A) {
   // Compute condition number.
@@ -6,3 +8,17 @@ double cond(const cv::Mat& A) {
   cv::SVD::compute(A, sigma, cv::SVD::NO_UV);
   return sigma.front() / sigma.back();
 }
+
+double condFromNormalMatrix(const cv::Mat& AtA) {
+  // Singular values of A are square roots of eigenvalues of A^T A.
+  cv::Mat lambda;
+  cv::eigen(AtA, lambda);
+
+  double lambda_max = lambda.at<double>(0);
+  double lambda_min = lambda.at<double>(lambda.rows - 1);
+  if (lambda_min <= 0) {
+    return std::numeric_limits<double>::infinity();
+  }
+
+  return std::sqrt(lambda_max / lambda_min);
+}
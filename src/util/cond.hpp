@@ -5,4 +5,9 @@
 
 double cond(const cv::Mat& A);
 
+// Returns the condition number of A given only its normal matrix A^T A.
+// Equal to cond(A) (for full column rank), but much cheaper when A has many
+// more rows than columns.
+double condFromNormalMatrix(const cv::Mat& AtA);
+
 #endif
@@ -0,0 +1,124 @@
+#include "util/feature-scheduler.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+// Weight of the newest frame in the cost of an iteration.
+const double SMOOTHING = 0.25;
+
+// Age and texture at which a feature is half as valuable as it can be.
+const double AGE_SCALE = 10;
+const double TEXTURE_SCALE = 1e-2;
+
+// Each term outweighs every term after it.
+const double SELECTED_WEIGHT = 1e6;
+const double DEFERRED_WEIGHT = 1e3;
+
+// Orders by decreasing priority, then increasing index.
+bool higherPriority(const std::pair<double, int>& lhs,
+                    const std::pair<double, int>& rhs) {
+  if (lhs.first != rhs.first) {
+    return lhs.first > rhs.first;
+  }
+  return lhs.second < rhs.second;
+}
+
+}
+
+FeatureScheduler::FeatureScheduler(double deadline,
+                                   int min_iterations,
+                                   int max_iterations,
+                                   int num_levels)
+    : deadline_(deadline),
+      min_iterations_(std::max(std::min(min_iterations, max_iterations), 1)),
+      max_iterations_(std::max(max_iterations, 1)),
+      num_levels_(std::max(num_levels, 1)),
+      start_(0),
+      order_(),
+      iterations_(max_iterations_),
+      iteration_time_(0) {}
+
+bool FeatureScheduler::enabled() const {
+  return deadline_ > 0;
+}
+
+void FeatureScheduler::begin(double start,
+                             const std::vector<double>& priorities) {
+  start_ = start;
+  int n = priorities.size();
+
+  std::vector<std::pair<double, int> > ranked(n);
+  for (int i = 0; i < n; i += 1) {
+    ranked[i] = std::make_pair(priorities[i], i);
+  }
+  if (enabled()) {
+    std::sort(ranked.begin(), ranked.end(), higherPriority);
+  }
+  order_.resize(n);
+  for (int k = 0; k < n; k += 1) {
+    order_[k] = ranked[k].second;
+  }
+
+  // Share the iterations which fit in the deadline between the features and
+  // then the levels of each.
+  iterations_ = max_iterations_;
+  if (enabled() && iteration_time_ > 0 && n > 0) {
+    double share = deadline_ / iteration_time_ / n / num_levels_;
+    iterations_ = std::max(min_iterations_,
+        int(std::min(share, double(max_iterations_))));
+  }
+}
+
+const std::vector<int>& FeatureScheduler::order() const {
+  return order_;
+}
+
+int FeatureScheduler::iterations() const {
+  return iterations_;
+}
+
+bool FeatureScheduler::expired(double now) const {
+  return enabled() && now - start_ > deadline_;
+}
+
+void FeatureScheduler::end(double end, int num_iterations) {
+  if (num_iterations <= 0 || !(end > start_)) {
+    return;
+  }
+
+  double time = (end - start_) / num_iterations;
+  if (iteration_time_ > 0) {
+    iteration_time_ += SMOOTHING * (time - iteration_time_);
+  } else {
+    iteration_time_ = time;
+  }
+}
+
+double featurePriority(bool selected,
+                       int num_deferred,
+                       int age,
+                       double texture) {
+  // Both in [0, 1).
+  double age_value = age / (age + AGE_SCALE);
+  double texture_value = texture / (texture + TEXTURE_SCALE);
+
+  return SELECTED_WEIGHT * selected + DEFERRED_WEIGHT * num_deferred +
+      age_value + texture_value;
+}
+
+double patchTexture(const cv::Mat& patch) {
+  double sum = 0;
+  for (int i = 0; i + 1 < patch.rows; i += 1) {
+    const double* row = patch.ptr<double>(i);
+    const double* next = patch.ptr<double>(i + 1);
+    for (int j = 0; j + 1 < patch.cols; j += 1) {
+      double x = row[j + 1] - row[j];
+      double y = next[j] - row[j];
+      sum += x * x + y * y;
+    }
+  }
+
+  int n = (patch.rows - 1) * (patch.cols - 1);
+  return (n > 0) ? sum / n : 0;
+}
@@ -0,0 +1,89 @@
+#ifndef UTIL_FEATURE_SCHEDULER_HPP_
+#define UTIL_FEATURE_SCHEDULER_HPP_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+// Schedules the tracking of a frame's features against a deadline, so that
+// the time per frame stays predictable whatever the number of features.
+//
+// Features are tracked in order of decreasing priority, each with the same
+// budget of solver iterations, which is sized so that the whole list should
+// fit in the deadline. Features which have not been started when the
+// deadline passes are deferred: the caller carries them forward on their
+// prediction instead of tracking them, and ranks them higher in the next
+// frame so that none starve.
+//
+// The cost of an iteration is learnt from the frames so far. Time is in
+// seconds, from any clock, and iterations are those of all threads, so the
+// schedule holds however many threads track in parallel.
+//
+// Features are solved once at each level of a pyramid, and the limit on
+// iterations applies to each solve, so a feature's budget is divided
+// between its levels.
+//
+// A frame looks like
+//   scheduler.begin(wallTime(), priorities);
+//   for each k, in parallel:
+//     if (scheduler.expired(wallTime())) defer scheduler.order()[k]
+//     else track it with at most scheduler.iterations() iterations
+//   scheduler.end(wallTime(), total_iterations);
+class FeatureScheduler {
+  public:
+    // A deadline of zero or less disables the schedule: every feature is
+    // tracked with max_iterations and none are deferred. Iterations are per
+    // level.
+    FeatureScheduler(double deadline,
+                     int min_iterations,
+                     int max_iterations,
+                     int num_levels);
+
+    bool enabled() const;
+
+    // Begins a frame at time start. Feature i has the i-th priority.
+    void begin(double start, const std::vector<double>& priorities);
+
+    // Indices of the features in order of decreasing priority. Equal
+    // priorities keep their order.
+    const std::vector<int>& order() const;
+    // Iterations allowed to each feature at each level in this frame.
+    int iterations() const;
+    // Returns true if the deadline of the frame has passed, after which no
+    // more features should be started. May be called from any thread.
+    bool expired(double now) const;
+
+    // Ends a frame, given the number of iterations which were solved at
+    // every level.
+    void end(double end, int num_iterations);
+
+  private:
+    double deadline_;
+    int min_iterations_;
+    int max_iterations_;
+    int num_levels_;
+
+    // Of the current frame.
+    double start_;
+    std::vector<int> order_;
+    int iterations_;
+
+    // Seconds per iteration, smoothed over frames. Zero until measured.
+    double iteration_time_;
+};
+
+// Priority of a feature for FeatureScheduler. Those the user selected come
+// first, then those deferred for the most frames, then the longest-lived and
+// best-textured, whose tracks are the most valuable and the most reliable.
+//
+// Texture is the mean squared gradient of the appearance, for intensities in
+// [0, 1].
+double featurePriority(bool selected,
+                       int num_deferred,
+                       int age,
+                       double texture);
+
+// Computes the mean squared gradient of a patch of doubles, by forward
+// differences.
+double patchTexture(const cv::Mat& patch);
+
+#endif
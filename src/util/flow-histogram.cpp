@@ -0,0 +1,76 @@
+#include "util/flow-histogram.hpp"
+#include <algorithm>
+
+FlowHistogram::FlowHistogram()
+    : calls_(),
+      iterations_(),
+      residual_evaluations_(),
+      jacobian_evaluations_(),
+      solver_time_() {
+  std::fill(terminations_, terminations_ + NUM_FLOW_TERMINATIONS, 0);
+}
+
+void FlowHistogram::add(const FlowStatistics& statistics) {
+  calls_.add(statistics.num_calls);
+  iterations_.add(statistics.num_iterations);
+  residual_evaluations_.add(statistics.num_residual_evaluations);
+  jacobian_evaluations_.add(statistics.num_jacobian_evaluations);
+  solver_time_.add(statistics.solver_time * 1e6);
+  terminations_[statistics.termination] += 1;
+}
+
+void FlowHistogram::add(const FlowHistogram& other) {
+  calls_.add(other.calls_);
+  iterations_.add(other.iterations_);
+  residual_evaluations_.add(other.residual_evaluations_);
+  jacobian_evaluations_.add(other.jacobian_evaluations_);
+  solver_time_.add(other.solver_time_);
+  for (int i = 0; i < NUM_FLOW_TERMINATIONS; i += 1) {
+    terminations_[i] += other.terminations_[i];
+  }
+}
+
+void FlowHistogram::clear() {
+  calls_.clear();
+  iterations_.clear();
+  residual_evaluations_.clear();
+  jacobian_evaluations_.clear();
+  solver_time_.clear();
+  std::fill(terminations_, terminations_ + NUM_FLOW_TERMINATIONS, 0);
+}
+
+int FlowHistogram::count() const {
+  return iterations_.count();
+}
+
+void FlowHistogram::writeLine(std::ostream& stream) const {
+  stream << count() << " features, " << iterations_.mean() <<
+      " iterations (max " << iterations_.max() << "), " <<
+      solver_time_.sum() * 1e-3 << " ms solving";
+  for (int i = 0; i < NUM_FLOW_TERMINATIONS; i += 1) {
+    if (terminations_[i] > 0) {
+      stream << ", " << flowTerminationName(FlowTermination(i)) << " " <<
+          terminations_[i];
+    }
+  }
+}
+
+void FlowHistogram::write(std::ostream& stream) const {
+  stream << "calls: ";
+  calls_.write(stream);
+  stream << std::endl << "iterations: ";
+  iterations_.write(stream);
+  stream << std::endl << "residual evaluations: ";
+  residual_evaluations_.write(stream);
+  stream << std::endl << "jacobian evaluations: ";
+  jacobian_evaluations_.write(stream);
+  stream << std::endl << "solver time (us): ";
+  solver_time_.write(stream);
+  stream << std::endl;
+
+  for (int i = 0; i < NUM_FLOW_TERMINATIONS; i += 1) {
+    stream << flowTerminationName(FlowTermination(i)) << ": " <<
+        terminations_[i] << std::endl;
+  }
+}
+
@@ -0,0 +1,39 @@
+#ifndef UTIL_FLOW_HISTOGRAM_HPP_
+#define UTIL_FLOW_HISTOGRAM_HPP_
+
+#include <ostream>
+#include "util/flow-statistics.hpp"
+#include "util/histogram.hpp"
+
+// Aggregates the solver statistics of many tracked features, e.g. of one
+// frame or of a whole video, to show where tracking time goes and to choose
+// the iteration limit and tolerances.
+class FlowHistogram {
+  public:
+    FlowHistogram();
+
+    // Adds the statistics of one feature.
+    void add(const FlowStatistics& statistics);
+    void add(const FlowHistogram& other);
+    void clear();
+
+    // Number of features.
+    int count() const;
+
+    // Writes the number of features and iterations and the solver time.
+    void writeLine(std::ostream& stream) const;
+    // Writes a line for each statistic and each termination.
+    void write(std::ostream& stream) const;
+
+  private:
+    Histogram calls_;
+    Histogram iterations_;
+    Histogram residual_evaluations_;
+    Histogram jacobian_evaluations_;
+    // In microseconds.
+    Histogram solver_time_;
+    // Number of features which ended with each termination.
+    int terminations_[NUM_FLOW_TERMINATIONS];
+};
+
+#endif
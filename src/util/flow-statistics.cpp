@@ -0,0 +1,20 @@
+#include "util/flow-statistics.hpp"
+#include <glog/logging.h>
+
+namespace {
+
+const char* const TERMINATION_NAMES[NUM_FLOW_TERMINATIONS] = {
+  "converged",
+  "numerical failure",
+  "iteration limit",
+  "condition limit",
+  "invalid warp",
+  "appearance rejected"
+};
+
+}
+
+const char* flowTerminationName(FlowTermination termination) {
+  CHECK(termination >= 0 && termination < NUM_FLOW_TERMINATIONS);
+  return TERMINATION_NAMES[termination];
+}
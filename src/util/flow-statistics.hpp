@@ -0,0 +1,52 @@
+#ifndef UTIL_FLOW_STATISTICS_HPP_
+#define UTIL_FLOW_STATISTICS_HPP_
+
+#include <cstddef>
+
+// Shared by the flow solvers of the tools and of the tracking library.
+
+// Reason that the solver stopped.
+enum FlowTermination {
+  FLOW_CONVERGED,
+  FLOW_NUMERICAL_FAILURE,
+  // Not a failure unless the iteration limit is fatal.
+  FLOW_ITERATION_LIMIT,
+  FLOW_CONDITION_LIMIT,
+  // The warp left the image.
+  FLOW_INVALID_WARP,
+  // Set by the caller if the tracked patch failed the appearance check.
+  FLOW_APPEARANCE_REJECTED,
+  NUM_FLOW_TERMINATIONS
+};
+
+const char* flowTerminationName(FlowTermination termination);
+
+// Work done by the solver, accumulated over calls.
+struct FlowStatistics {
+  int num_calls;
+  int num_iterations;
+  int num_residual_evaluations;
+  int num_jacobian_evaluations;
+  // Wall time in seconds.
+  double solver_time;
+  // Of the last call.
+  FlowTermination termination;
+
+  FlowStatistics()
+      : num_calls(0),
+        num_iterations(0),
+        num_residual_evaluations(0),
+        num_jacobian_evaluations(0),
+        solver_time(0),
+        termination(FLOW_CONVERGED) {}
+};
+
+// Records why the solver stopped, if statistics are being collected.
+inline void setTermination(FlowStatistics* statistics,
+                           FlowTermination termination) {
+  if (statistics != NULL) {
+    statistics->termination = termination;
+  }
+}
+
+#endif
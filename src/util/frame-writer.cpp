@@ -0,0 +1,139 @@
+#include "util/frame-writer.hpp"
+
+ImageSequenceWriter::ImageSequenceWriter(const boost::format& format,
+                                         int offset)
+    : format_(format), offset_(offset) {}
+
+bool ImageSequenceWriter::write(int frame, const cv::Mat& image) {
+  std::string file = boost::str(boost::format(format_) % (frame + offset_));
+  return cv::imwrite(file, image);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+VideoFileWriter::VideoFileWriter(const std::string& filename,
+                                 const std::string& fourcc,
+                                 double fps)
+    : filename_(filename), fourcc_(fourcc), fps_(fps), writer_(), size_() {}
+
+bool VideoFileWriter::write(int, const cv::Mat& image) {
+  if (!writer_.isOpened()) {
+    if (fourcc_.size() != 4) {
+      return false;
+    }
+    int fourcc = CV_FOURCC(fourcc_[0], fourcc_[1], fourcc_[2], fourcc_[3]);
+    size_ = image.size();
+    bool ok = writer_.open(filename_, fourcc, fps_, size_, true);
+    if (!ok) {
+      return false;
+    }
+  }
+
+  if (image.size() != size_ || image.type() != CV_8UC3) {
+    return false;
+  }
+  writer_ << image;
+  return true;
+}
+
+bool VideoFileWriter::close() {
+  writer_.release();
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+EncoderPipeWriter::EncoderPipeWriter(const std::string& command)
+    : command_(command), pipe_(NULL), size_() {}
+
+EncoderPipeWriter::~EncoderPipeWriter() {
+  close();
+}
+
+bool EncoderPipeWriter::write(int, const cv::Mat& image) {
+  if (pipe_ == NULL) {
+    size_ = image.size();
+    boost::format command(command_);
+    // Allow the command to ignore the size.
+    command.exceptions(boost::io::all_error_bits ^
+        boost::io::too_many_args_bit);
+    std::string str = boost::str(command % size_.width % size_.height);
+    pipe_ = popen(str.c_str(), "w");
+    if (pipe_ == NULL) {
+      return false;
+    }
+  }
+
+  if (image.size() != size_ || image.type() != CV_8UC3) {
+    return false;
+  }
+
+  // Viewports of a larger image are not continuous.
+  size_t row_size = size_.width * image.elemSize();
+  for (int i = 0; i < size_.height; i += 1) {
+    if (std::fwrite(image.ptr(i), 1, row_size, pipe_) != row_size) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool EncoderPipeWriter::close() {
+  if (pipe_ == NULL) {
+    return true;
+  }
+
+  int status = pclose(pipe_);
+  pipe_ = NULL;
+  return status == 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+WindowWriter::WindowWriter(const std::string& name, int delay)
+    : name_(name), delay_(delay) {}
+
+bool WindowWriter::write(int, const cv::Mat& image) {
+  cv::imshow(name_, image);
+  cv::waitKey(delay_);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+FrameWriterList::FrameWriterList() : writers_() {}
+
+void FrameWriterList::add(FrameWriter& writer) {
+  writers_.push_back(&writer);
+}
+
+bool FrameWriterList::empty() const {
+  return writers_.empty();
+}
+
+bool FrameWriterList::write(int frame, const cv::Mat& image) {
+  bool ok = true;
+
+  std::vector<FrameWriter*>::const_iterator writer;
+  for (writer = writers_.begin(); writer != writers_.end(); ++writer) {
+    if (!(*writer)->write(frame, image)) {
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+bool FrameWriterList::close() {
+  bool ok = true;
+
+  std::vector<FrameWriter*>::const_iterator writer;
+  for (writer = writers_.begin(); writer != writers_.end(); ++writer) {
+    if (!(*writer)->close()) {
+      ok = false;
+    }
+  }
+
+  return ok;
+}
@@ -0,0 +1,105 @@
+#ifndef UTIL_FRAME_WRITER_HPP_
+#define UTIL_FRAME_WRITER_HPP_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <boost/format.hpp>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+// Receives the frames of a visualization in order.
+class FrameWriter {
+  public:
+    virtual ~FrameWriter() {}
+    // The frame number is only needed to name files.
+    virtual bool write(int frame, const cv::Mat& image) = 0;
+    // Flushes any output. Returns false if anything could not be written.
+    virtual bool close() { return true; }
+};
+
+// Saves each frame to its own image file, as the visualizers always have.
+// The format takes the frame number plus offset.
+class ImageSequenceWriter : public FrameWriter {
+  public:
+    ImageSequenceWriter(const boost::format& format, int offset);
+
+    bool write(int frame, const cv::Mat& image);
+
+  private:
+    boost::format format_;
+    int offset_;
+};
+
+// Encodes the frames into one video file with OpenCV. The writer is opened
+// on the first frame, since its size is not known until then.
+class VideoFileWriter : public FrameWriter {
+  public:
+    VideoFileWriter(const std::string& filename,
+                    const std::string& fourcc,
+                    double fps);
+
+    bool write(int frame, const cv::Mat& image);
+    bool close();
+
+  private:
+    std::string filename_;
+    std::string fourcc_;
+    double fps_;
+    cv::VideoWriter writer_;
+    cv::Size size_;
+};
+
+// Writes the raw BGR pixels of each frame to the standard input of a
+// command, for example
+//   ffmpeg -f rawvideo -pix_fmt bgr24 -s %1%x%2% -r 30 -i - out.mp4
+// The command is started on the first frame with its width and height
+// substituted for %1% and %2%.
+class EncoderPipeWriter : public FrameWriter {
+  public:
+    explicit EncoderPipeWriter(const std::string& command);
+    ~EncoderPipeWriter();
+
+    bool write(int frame, const cv::Mat& image);
+    // Waits for the command to exit. Returns false if it failed.
+    bool close();
+
+  private:
+    std::string command_;
+    FILE* pipe_;
+    cv::Size size_;
+
+    // Non-copyable.
+    EncoderPipeWriter(const EncoderPipeWriter&);
+    EncoderPipeWriter& operator=(const EncoderPipeWriter&);
+};
+
+// Shows each frame in a window. Must be used from the main thread.
+class WindowWriter : public FrameWriter {
+  public:
+    WindowWriter(const std::string& name, int delay);
+
+    bool write(int frame, const cv::Mat& image);
+
+  private:
+    std::string name_;
+    int delay_;
+};
+
+// Passes every frame to several writers in the order they were added.
+// Does not own the writers.
+class FrameWriterList : public FrameWriter {
+  public:
+    FrameWriterList();
+
+    void add(FrameWriter& writer);
+    bool empty() const;
+
+    bool write(int frame, const cv::Mat& image);
+    bool close();
+
+  private:
+    std::vector<FrameWriter*> writers_;
+};
+
+#endif
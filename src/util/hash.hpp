@@ -0,0 +1,42 @@
+#ifndef UTIL_HASH_HPP_
+#define UTIL_HASH_HPP_
+
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+// 64-bit FNV-1a, for identifying the contents of files and buffers.
+// Not for use against an adversary.
+class Hash {
+  public:
+    Hash() : value_(14695981039346656037ULL) {}
+
+    void add(const void* data, size_t size) {
+      const unsigned char* bytes = static_cast<const unsigned char*>(data);
+      for (size_t i = 0; i < size; i += 1) {
+        value_ = (value_ ^ bytes[i]) * 1099511628211ULL;
+      }
+    }
+
+    // Adds the bytes of a value, e.g. a fixed-width integer.
+    template<class T>
+    void add(T x) {
+      add(&x, sizeof(x));
+    }
+
+    // Adds the size and then the characters, so that lists of strings are
+    // unambiguous.
+    void add(const std::string& s) {
+      add(uint64_t(s.size()));
+      add(s.data(), s.size());
+    }
+
+    uint64_t value() const {
+      return value_;
+    }
+
+  private:
+    uint64_t value_;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "util/histogram.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Bin 0 is [0, 1) and bin k > 0 is [2^(k - 1), 2^k).
+int binOf(double value) {
+  if (!(value >= 1)) {
+    return 0;
+  }
+  int exponent;
+  std::frexp(value, &exponent);
+  return exponent;
+}
+
+double binBegin(int bin) {
+  return (bin == 0) ? 0 : std::ldexp(1., bin - 1);
+}
+
+double binEnd(int bin) {
+  return std::ldexp(1., bin);
+}
+
+}
+
+Histogram::Histogram() : bins_(), count_(0), sum_(0), max_(0) {}
+
+void Histogram::add(double value) {
+  int bin = binOf(value);
+  if (bin >= int(bins_.size())) {
+    bins_.resize(bin + 1, 0);
+  }
+  bins_[bin] += 1;
+
+  max_ = (count_ == 0) ? value : std::max(max_, value);
+  count_ += 1;
+  sum_ += value;
+}
+
+void Histogram::add(const Histogram& other) {
+  if (other.count_ == 0) {
+    return;
+  }
+
+  if (other.bins_.size() > bins_.size()) {
+    bins_.resize(other.bins_.size(), 0);
+  }
+  for (int i = 0; i < int(other.bins_.size()); i += 1) {
+    bins_[i] += other.bins_[i];
+  }
+
+  max_ = (count_ == 0) ? other.max_ : std::max(max_, other.max_);
+  count_ += other.count_;
+  sum_ += other.sum_;
+}
+
+void Histogram::clear() {
+  bins_.clear();
+  count_ = 0;
+  sum_ = 0;
+  max_ = 0;
+}
+
+int Histogram::count() const {
+  return count_;
+}
+
+double Histogram::sum() const {
+  return sum_;
+}
+
+double Histogram::mean() const {
+  return (count_ == 0) ? 0 : sum_ / count_;
+}
+
+double Histogram::max() const {
+  return max_;
+}
+
+void Histogram::write(std::ostream& stream) const {
+  stream << "count " << count_ << ", mean " << mean() << ", max " << max_;
+
+  for (int i = 0; i < int(bins_.size()); i += 1) {
+    if (bins_[i] > 0) {
+      stream << ", [" << binBegin(i) << ", " << binEnd(i) << "): " <<
+          bins_[i];
+    }
+  }
+}
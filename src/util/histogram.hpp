@@ -0,0 +1,36 @@
+#ifndef UTIL_HISTOGRAM_HPP_
+#define UTIL_HISTOGRAM_HPP_
+
+#include <ostream>
+#include <vector>
+
+// Counts non-negative values in bins whose width doubles:
+// [0, 1), [1, 2), [2, 4), [4, 8), ...
+//
+// Cheap enough to add a value every call of an inner loop. Histograms can be
+// merged, e.g. those of each frame into one for the whole video.
+class Histogram {
+  public:
+    Histogram();
+
+    // Negative values are counted in the first bin.
+    void add(double value);
+    void add(const Histogram& other);
+    void clear();
+
+    int count() const;
+    double sum() const;
+    double mean() const;
+    double max() const;
+
+    // Writes the count, mean and maximum, then each non-empty bin.
+    void write(std::ostream& stream) const;
+
+  private:
+    std::vector<int> bins_;
+    int count_;
+    double sum_;
+    double max_;
+};
+
+#endif
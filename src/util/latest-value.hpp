@@ -0,0 +1,100 @@
+#ifndef UTIL_LATEST_VALUE_HPP_
+#define UTIL_LATEST_VALUE_HPP_
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+// A one-slot buffer between threads which keeps only the newest value.
+//
+// Unlike BoundedQueue, the producer never blocks. A value which is replaced
+// before the consumer takes it is dropped, so a slow consumer always works
+// on recent data instead of falling further behind.
+//
+// Either side may call close(). Afterwards put() does nothing and take()
+// returns false once the slot is empty.
+template<class T>
+class LatestValue {
+  public:
+    LatestValue()
+        : value_(), mutex_(), changed_(), full_(false), closed_(false),
+          num_dropped_(0) {}
+
+    // Replaces the value. Returns false if closed.
+    bool put(const T& value) {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (closed_) {
+        return false;
+      }
+      if (full_) {
+        num_dropped_ += 1;
+      }
+      value_ = value;
+      full_ = true;
+      changed_.notify_one();
+      return true;
+    }
+
+    // Blocks until there is a value which has not been taken.
+    // Returns false if the slot is empty and closed.
+    bool take(T& value) {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (!full_ && !closed_) {
+        changed_.wait(lock);
+      }
+      return takeLocked(value);
+    }
+
+    // Returns false immediately if there is no new value.
+    bool tryTake(T& value) {
+      boost::mutex::scoped_lock lock(mutex_);
+      return takeLocked(value);
+    }
+
+    void close() {
+      boost::mutex::scoped_lock lock(mutex_);
+      closed_ = true;
+      changed_.notify_all();
+    }
+
+    bool closed() {
+      boost::mutex::scoped_lock lock(mutex_);
+      return closed_;
+    }
+
+    // Whether there is a value which has not been taken.
+    bool full() {
+      boost::mutex::scoped_lock lock(mutex_);
+      return full_;
+    }
+
+    // Number of values which were replaced without being taken.
+    int numDropped() {
+      boost::mutex::scoped_lock lock(mutex_);
+      return num_dropped_;
+    }
+
+  private:
+    bool takeLocked(T& value) {
+      if (!full_) {
+        return false;
+      }
+      value = value_;
+      // Release the slot's reference.
+      value_ = T();
+      full_ = false;
+      return true;
+    }
+
+    T value_;
+    boost::mutex mutex_;
+    boost::condition_variable changed_;
+    bool full_;
+    bool closed_;
+    int num_dropped_;
+
+    // Non-copyable.
+    LatestValue(const LatestValue&);
+    LatestValue& operator=(const LatestValue&);
+};
+
+#endif
@@ -0,0 +1,195 @@
+#include "util/memory.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <malloc.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <boost/format.hpp>
+#include "util/trace.hpp"
+
+namespace {
+
+// Updated with atomic builtins, since any thread may allocate.
+long heap_bytes = 0;
+long peak_heap_bytes = 0;
+long num_allocations = 0;
+
+#ifdef ENABLE_MEMORY_ACCOUNTING
+
+void countAllocation(void* ptr) {
+  long size = malloc_usable_size(ptr);
+  long heap = __sync_add_and_fetch(&heap_bytes, size);
+  __sync_add_and_fetch(&num_allocations, 1);
+
+  long peak = peak_heap_bytes;
+  while (heap > peak) {
+    long previous = __sync_val_compare_and_swap(&peak_heap_bytes, peak, heap);
+    if (previous == peak) {
+      break;
+    }
+    peak = previous;
+  }
+}
+
+void countFree(void* ptr) {
+  long size = malloc_usable_size(ptr);
+  __sync_sub_and_fetch(&heap_bytes, size);
+}
+
+#endif
+
+// Second field of /proc/self/statm is the resident set in pages.
+long residentBytes() {
+  std::FILE* file = std::fopen("/proc/self/statm", "r");
+  if (file == NULL) {
+    return 0;
+  }
+  long size = 0;
+  long resident = 0;
+  int num_read = std::fscanf(file, "%ld %ld", &size, &resident);
+  std::fclose(file);
+  if (num_read != 2) {
+    return 0;
+  }
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+long peakResidentBytes() {
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  // Kilobytes on Linux.
+  return usage.ru_maxrss * 1024L;
+}
+
+double megabytes(long bytes) {
+  return bytes / double(1 << 20);
+}
+
+}
+
+#ifdef ENABLE_MEMORY_ACCOUNTING
+
+#if __cplusplus >= 201103L
+#define MEMORY_THROW_BAD_ALLOC
+#define MEMORY_NO_THROW noexcept
+#else
+#define MEMORY_THROW_BAD_ALLOC throw(std::bad_alloc)
+#define MEMORY_NO_THROW throw()
+#endif
+
+// Replaces the global allocation functions of the whole program.
+
+void* operator new(std::size_t size) MEMORY_THROW_BAD_ALLOC {
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == NULL) {
+    throw std::bad_alloc();
+  }
+  countAllocation(ptr);
+  return ptr;
+}
+
+void* operator new[](std::size_t size) MEMORY_THROW_BAD_ALLOC {
+  return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) MEMORY_NO_THROW {
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr != NULL) {
+    countAllocation(ptr);
+  }
+  return ptr;
+}
+
+void* operator new[](std::size_t size,
+                     const std::nothrow_t& nothrow) MEMORY_NO_THROW {
+  return operator new(size, nothrow);
+}
+
+void operator delete(void* ptr) MEMORY_NO_THROW {
+  if (ptr == NULL) {
+    return;
+  }
+  countFree(ptr);
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) MEMORY_NO_THROW {
+  operator delete(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) MEMORY_NO_THROW {
+  operator delete(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) MEMORY_NO_THROW {
+  operator delete(ptr);
+}
+
+#ifdef __cpp_sized_deallocation
+// The size is known from malloc_usable_size() anyway.
+void operator delete(void* ptr, std::size_t) MEMORY_NO_THROW {
+  operator delete(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) MEMORY_NO_THROW {
+  operator delete(ptr);
+}
+#endif
+
+#endif
+
+MemoryUsage memoryUsage() {
+  MemoryUsage usage;
+  usage.heap = __sync_add_and_fetch(&heap_bytes, 0);
+  usage.num_allocations = __sync_add_and_fetch(&num_allocations, 0);
+  usage.resident = residentBytes();
+  usage.peak_resident = peakResidentBytes();
+  return usage;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+MemoryScope::MemoryScope(const char* name)
+    : name_(name), begin_(memoryUsage()), outer_peak_(0) {
+  // Measure the peak of this scope alone.
+  outer_peak_ = __sync_lock_test_and_set(&peak_heap_bytes, begin_.heap);
+}
+
+MemoryScope::~MemoryScope() {
+  MemoryUsage end = memoryUsage();
+  long peak = __sync_add_and_fetch(&peak_heap_bytes, 0);
+
+  std::cerr << boost::format("memory %s: heap %.1f MB (peak %.1f MB, "
+      "%+.1f MB, %ld allocations), resident %.1f MB (peak %.1f MB)") %
+      name_ % megabytes(end.heap) % megabytes(peak) %
+      megabytes(end.heap - begin_.heap) %
+      (end.num_allocations - begin_.num_allocations) %
+      megabytes(end.resident) % megabytes(end.peak_resident) << std::endl;
+
+  traceSample("heap bytes", end.heap);
+  traceSample("peak heap bytes", peak);
+  traceSample("resident bytes", end.resident);
+
+  // The enclosing scope's peak includes this one's.
+  if (outer_peak_ > peak) {
+    __sync_lock_test_and_set(&peak_heap_bytes, outer_peak_);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+MemoryStages::MemoryStages() : stage_(NULL) {}
+
+MemoryStages::~MemoryStages() {
+  delete stage_;
+}
+
+void MemoryStages::next(const char* name) {
+  delete stage_;
+  stage_ = NULL;
+  stage_ = new MemoryScope(name);
+}
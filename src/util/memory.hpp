@@ -0,0 +1,92 @@
+#ifndef UTIL_MEMORY_HPP_
+#define UTIL_MEMORY_HPP_
+
+// Accounts for the heap and resident memory used by named stages.
+//
+// Only compiled in with ENABLE_MEMORY_ACCOUNTING defined
+// (cmake -DWITH_MEMORY_ACCOUNTING=ON), which replaces the global operator
+// new and delete to count the bytes in use. Otherwise every macro expands to
+// nothing. Memory from malloc() directly, e.g. the pixels of a cv::Mat, is not
+// counted on the heap but is part of the resident set.
+//
+// At the end of each stage, a line is printed to stderr with the heap in
+// use, its peak during the stage and its change over the stage, and the
+// resident set. Naming a stage after the structure it builds attributes the
+// change to that structure. With tracing, the numbers are also sampled into
+// the trace (see util/trace.hpp).
+//
+//   MEMORY_STAGES(stages);
+//   MEMORY_NEXT_STAGE(stages, "load matches into MatchGraph");
+//   ...
+//   MEMORY_NEXT_STAGE(stages, "init FeatureSets");
+//
+//   MEMORY_SCOPE("copy of descriptors");
+//
+// Stages and scopes must be properly nested and all used from one thread,
+// although any thread may allocate.
+
+#ifdef ENABLE_MEMORY_ACCOUNTING
+
+// Reports on the rest of the enclosing scope.
+#define MEMORY_SCOPE(name) \
+    MemoryScope MEMORY_CONCAT(memory_scope_, __LINE__)(name)
+// Reports on consecutive stages, each ending where the next begins.
+#define MEMORY_STAGES(stages) MemoryStages stages
+#define MEMORY_NEXT_STAGE(stages, name) stages.next(name)
+
+#else
+
+#define MEMORY_SCOPE(name) ((void)0)
+#define MEMORY_STAGES(stages) ((void)0)
+#define MEMORY_NEXT_STAGE(stages, name) ((void)0)
+
+#endif
+
+#define MEMORY_CONCAT_(a, b) a##b
+#define MEMORY_CONCAT(a, b) MEMORY_CONCAT_(a, b)
+
+// Sizes are in bytes. The heap is zero unless accounting is compiled in.
+struct MemoryUsage {
+  long heap;
+  long num_allocations;
+  long resident;
+  // Of the whole process so far.
+  long peak_resident;
+};
+
+MemoryUsage memoryUsage();
+
+class MemoryScope {
+  public:
+    explicit MemoryScope(const char* name);
+    ~MemoryScope();
+
+  private:
+    const char* name_;
+    MemoryUsage begin_;
+    // Peak heap of the enclosing scope so far.
+    long outer_peak_;
+
+    // Non-copyable.
+    MemoryScope(const MemoryScope&);
+    MemoryScope& operator=(const MemoryScope&);
+};
+
+class MemoryStages {
+  public:
+    MemoryStages();
+    // Ends the current stage.
+    ~MemoryStages();
+
+    // Ends the current stage, if any, and begins another.
+    void next(const char* name);
+
+  private:
+    MemoryScope* stage_;
+
+    // Non-copyable.
+    MemoryStages(const MemoryStages&);
+    MemoryStages& operator=(const MemoryStages&);
+};
+
+#endif
@@ -0,0 +1,251 @@
+#include "util/metrics.hpp"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <boost/bind.hpp>
+#include "util/memory.hpp"
+
+namespace {
+
+// Number of latest observations from which quantiles are found.
+const int SUMMARY_WINDOW = 1024;
+const int NUM_QUANTILES = 3;
+const double QUANTILES[NUM_QUANTILES] = { 0.5, 0.9, 0.99 };
+
+// How often the server checks whether to stop.
+const int POLL_TIMEOUT_MS = 200;
+const int MAX_REQUEST_SIZE = 4096;
+
+// Name without labels, e.g. "queue_depth" of "queue_depth{stage=\"track\"}".
+std::string baseName(const std::string& name) {
+  return name.substr(0, name.find('{'));
+}
+
+// Labels including braces, or empty.
+std::string labels(const std::string& name) {
+  std::string::size_type begin = name.find('{');
+  return (begin == std::string::npos) ? std::string() : name.substr(begin);
+}
+
+std::string withSuffix(const std::string& name, const std::string& suffix) {
+  return baseName(name) + suffix + labels(name);
+}
+
+std::string withLabel(const std::string& name, const std::string& label) {
+  std::string existing = labels(name);
+  if (existing.empty()) {
+    return name + "{" + label + "}";
+  }
+  return baseName(name) + existing.substr(0, existing.size() - 1) + "," +
+      label + "}";
+}
+
+// Writes a TYPE line before the first series of each name.
+void writeType(std::ostream& stream,
+               const std::string& name,
+               const char* type,
+               std::string& previous) {
+  std::string base = baseName(name);
+  if (base != previous) {
+    stream << "# TYPE " << base << " " << type << std::endl;
+    previous = base;
+  }
+}
+
+void writeCounters(std::ostream& stream,
+                   const std::map<std::string, double>& metrics,
+                   const char* type) {
+  std::string previous;
+  std::map<std::string, double>::const_iterator metric;
+  for (metric = metrics.begin(); metric != metrics.end(); ++metric) {
+    writeType(stream, metric->first, type, previous);
+    stream << metric->first << " " << metric->second << std::endl;
+  }
+}
+
+bool sendAll(int connection, const std::string& data) {
+  const char* begin = data.c_str();
+  const char* end = begin + data.size();
+  while (begin < end) {
+    ssize_t n = send(connection, begin, end - begin, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    begin += n;
+  }
+  return true;
+}
+
+}
+
+Metrics::Summary::Summary() : window(), next(0), count(0), sum(0) {}
+
+Metrics::Metrics() : mutex_(), counters_(), gauges_(), summaries_() {}
+
+void Metrics::add(const std::string& name, double n) {
+  boost::mutex::scoped_lock lock(mutex_);
+  counters_[name] += n;
+}
+
+void Metrics::set(const std::string& name, double value) {
+  boost::mutex::scoped_lock lock(mutex_);
+  gauges_[name] = value;
+}
+
+void Metrics::change(const std::string& name, double n) {
+  boost::mutex::scoped_lock lock(mutex_);
+  gauges_[name] += n;
+}
+
+void Metrics::observe(const std::string& name, double seconds) {
+  boost::mutex::scoped_lock lock(mutex_);
+  Summary& summary = summaries_[name];
+
+  if (int(summary.window.size()) < SUMMARY_WINDOW) {
+    summary.window.push_back(seconds);
+  } else {
+    summary.window[summary.next] = seconds;
+    summary.next = (summary.next + 1) % SUMMARY_WINDOW;
+  }
+  summary.count += 1;
+  summary.sum += seconds;
+}
+
+void Metrics::write(std::ostream& stream) const {
+  MemoryUsage memory = memoryUsage();
+
+  boost::mutex::scoped_lock lock(mutex_);
+
+  // Counters must not lose digits to exponents.
+  std::streamsize precision = stream.precision(15);
+
+  writeCounters(stream, counters_, "counter");
+  writeCounters(stream, gauges_, "gauge");
+
+  std::string previous;
+  std::map<std::string, Summary>::const_iterator summary;
+  for (summary = summaries_.begin(); summary != summaries_.end(); ++summary) {
+    const std::string& name = summary->first;
+    writeType(stream, name, "summary", previous);
+
+    std::vector<double> window = summary->second.window;
+    std::sort(window.begin(), window.end());
+    int n = window.size();
+    for (int i = 0; i < NUM_QUANTILES && n > 0; i += 1) {
+      std::ostringstream label;
+      label << "quantile=\"" << QUANTILES[i] << "\"";
+      stream << withLabel(name, label.str()) << " " <<
+          window[int(QUANTILES[i] * (n - 1) + 0.5)] << std::endl;
+    }
+    stream << withSuffix(name, "_sum") << " " << summary->second.sum <<
+        std::endl;
+    stream << withSuffix(name, "_count") << " " << summary->second.count <<
+        std::endl;
+  }
+
+  stream << "# TYPE process_resident_memory_bytes gauge" << std::endl;
+  stream << "process_resident_memory_bytes " << memory.resident << std::endl;
+  stream << "# TYPE process_peak_resident_memory_bytes gauge" << std::endl;
+  stream << "process_peak_resident_memory_bytes " << memory.peak_resident <<
+      std::endl;
+  // Zero unless memory accounting is compiled in.
+  stream << "# TYPE process_heap_bytes gauge" << std::endl;
+  stream << "process_heap_bytes " << memory.heap << std::endl;
+
+  stream.precision(precision);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+MetricsServer::MetricsServer(const Metrics& metrics)
+    : metrics_(&metrics), socket_(-1), thread_(), mutex_(), stop_(false) {}
+
+MetricsServer::~MetricsServer() {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stop_ = true;
+  }
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  if (socket_ >= 0) {
+    close(socket_);
+  }
+}
+
+bool MetricsServer::start(int port) {
+  socket_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (socket_ < 0) {
+    return false;
+  }
+
+  int reuse = 1;
+  setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+
+  if (bind(socket_, reinterpret_cast<sockaddr*>(&address),
+        sizeof(address)) != 0 || listen(socket_, 8) != 0) {
+    close(socket_);
+    socket_ = -1;
+    return false;
+  }
+
+  thread_ = boost::thread(boost::bind(&MetricsServer::serve, this));
+  return true;
+}
+
+bool MetricsServer::stopped() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  return stop_;
+}
+
+void MetricsServer::serve() {
+  while (!stopped()) {
+    pollfd ready;
+    ready.fd = socket_;
+    ready.events = POLLIN;
+    ready.revents = 0;
+    if (poll(&ready, 1, POLL_TIMEOUT_MS) <= 0) {
+      continue;
+    }
+
+    int connection = accept(socket_, NULL, NULL);
+    if (connection < 0) {
+      continue;
+    }
+    respond(connection);
+    close(connection);
+  }
+}
+
+// Answers one request, ignoring everything but the path.
+void MetricsServer::respond(int connection) {
+  char request[MAX_REQUEST_SIZE];
+  ssize_t size = recv(connection, request, sizeof(request) - 1, 0);
+  if (size <= 0) {
+    return;
+  }
+  request[size] = '\0';
+
+  std::ostringstream response;
+  if (std::strncmp(request, "GET /metrics", 12) == 0) {
+    std::ostringstream body;
+    metrics_->write(body);
+    response << "HTTP/1.0 200 OK\r\n" <<
+        "Content-Type: text/plain; version=0.0.4\r\n" <<
+        "Content-Length: " << body.str().size() << "\r\n\r\n" << body.str();
+  } else {
+    response << "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+  }
+  sendAll(connection, response.str());
+}
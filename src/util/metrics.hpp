@@ -0,0 +1,89 @@
+#ifndef UTIL_METRICS_HPP_
+#define UTIL_METRICS_HPP_
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+// Operational metrics of a long-running program, for a monitoring system to
+// scrape while it runs.
+//
+// Names follow Prometheus, and may carry labels, e.g.
+//   metrics.add("frames_total", 1);
+//   metrics.add("features_dropped_total{reason=\"iteration limit\"}", 1);
+//   metrics.set("queue_depth{stage=\"capture\"}", 1);
+//   metrics.observe("stage_seconds{stage=\"track\"}", seconds);
+//
+// Rates such as frames per second are left to the monitoring system, e.g.
+// rate(frames_total[1m]). All methods may be called from any thread.
+class Metrics {
+  public:
+    Metrics();
+
+    // Adds to a counter, which only increases.
+    void add(const std::string& name, double n);
+    // Sets a gauge to its current value.
+    void set(const std::string& name, double value);
+    // Adds to a gauge, which may decrease.
+    void change(const std::string& name, double n);
+    // Records a duration in seconds. Quantiles are of the latest
+    // observations.
+    void observe(const std::string& name, double seconds);
+
+    // Writes every metric in the Prometheus text format, followed by the
+    // memory of the process (see util/memory.hpp).
+    void write(std::ostream& stream) const;
+
+  private:
+    // The latest observations of a duration and the totals of all of them.
+    struct Summary {
+      std::vector<double> window;
+      // Where the next observation goes once the window is full.
+      int next;
+      long count;
+      double sum;
+
+      Summary();
+    };
+
+    mutable boost::mutex mutex_;
+    std::map<std::string, double> counters_;
+    std::map<std::string, double> gauges_;
+    std::map<std::string, Summary> summaries_;
+
+    // Non-copyable.
+    Metrics(const Metrics&);
+    Metrics& operator=(const Metrics&);
+};
+
+// Serves the metrics at http://host:port/metrics from its own thread.
+class MetricsServer {
+  public:
+    explicit MetricsServer(const Metrics& metrics);
+    // Stops serving.
+    ~MetricsServer();
+
+    // Returns false if the port could not be bound.
+    bool start(int port);
+
+  private:
+    void serve();
+    void respond(int connection);
+    bool stopped() const;
+
+    const Metrics* metrics_;
+    int socket_;
+    boost::thread thread_;
+    // Set by the destructor, read by the serving thread.
+    mutable boost::mutex mutex_;
+    bool stop_;
+
+    // Non-copyable.
+    MetricsServer(const MetricsServer&);
+    MetricsServer& operator=(const MetricsServer&);
+};
+
+#endif
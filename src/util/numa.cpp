@@ -0,0 +1,117 @@
+#include "util/numa.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sched.h>
+#include <dirent.h>
+
+namespace {
+
+const char* NODE_DIRECTORY = "/sys/devices/system/node";
+
+// Returns the id of a directory named like "node3", or -1.
+int nodeId(const std::string& name) {
+  if (name.compare(0, 4, "node") != 0 || name.size() == 4) {
+    return -1;
+  }
+  char* end;
+  long id = std::strtol(name.c_str() + 4, &end, 10);
+  return (*end == '\0') ? int(id) : -1;
+}
+
+}
+
+bool parseCpuList(const std::string& text, std::vector<int>& cpus) {
+  cpus.clear();
+  std::istringstream stream(text);
+  std::string range;
+
+  while (std::getline(stream, range, ',')) {
+    // The file ends with a newline.
+    if (range.find_first_not_of(" \n") == std::string::npos) {
+      continue;
+    }
+    const char* begin = range.c_str();
+    char* end;
+    long first = std::strtol(begin, &end, 10);
+    if (end == begin || first < 0) {
+      return false;
+    }
+    long last = first;
+    if (*end == '-') {
+      begin = end + 1;
+      last = std::strtol(begin, &end, 10);
+      if (end == begin || last < first) {
+        return false;
+      }
+    }
+    while (*end == ' ' || *end == '\n') {
+      end += 1;
+    }
+    if (*end != '\0') {
+      return false;
+    }
+    for (long cpu = first; cpu <= last; cpu += 1) {
+      cpus.push_back(cpu);
+    }
+  }
+
+  return true;
+}
+
+void listNumaNodes(std::vector<NumaNode>& nodes) {
+  nodes.clear();
+
+  DIR* directory = opendir(NODE_DIRECTORY);
+  if (directory == NULL) {
+    return;
+  }
+
+  std::vector<int> ids;
+  struct dirent* entry;
+  while ((entry = readdir(directory)) != NULL) {
+    int id = nodeId(entry->d_name);
+    if (id >= 0) {
+      ids.push_back(id);
+    }
+  }
+  closedir(directory);
+  std::sort(ids.begin(), ids.end());
+
+  std::vector<int>::const_iterator id;
+  for (id = ids.begin(); id != ids.end(); ++id) {
+    std::ostringstream path;
+    path << NODE_DIRECTORY << "/node" << *id << "/cpulist";
+    std::ifstream file(path.str().c_str());
+    std::string line;
+    if (!std::getline(file, line)) {
+      continue;
+    }
+
+    NumaNode node;
+    node.id = *id;
+    // Nodes of memory alone have no CPUs to run on.
+    if (parseCpuList(line, node.cpus) && !node.cpus.empty()) {
+      nodes.push_back(node);
+    }
+  }
+}
+
+bool bindThreadToCpus(const std::vector<int>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  std::vector<int>::const_iterator cpu;
+  for (cpu = cpus.begin(); cpu != cpus.end(); ++cpu) {
+    if (*cpu < CPU_SETSIZE) {
+      CPU_SET(*cpu, &set);
+    }
+  }
+  if (CPU_COUNT(&set) == 0) {
+    return false;
+  }
+
+  // Zero is the calling thread.
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
@@ -0,0 +1,34 @@
+#ifndef UTIL_NUMA_HPP_
+#define UTIL_NUMA_HPP_
+
+#include <string>
+#include <vector>
+
+// The NUMA nodes of the machine, from /sys/devices/system/node, and pinning
+// of threads to them.
+//
+// There is no allocation by node. Linux places an anonymous page on the node
+// of the thread which first writes it, so memory which is filled by a thread
+// pinned to a node stays local to that node, e.g. descriptors loaded by the
+// workers which will search them. Pages of a mapped file are in the page
+// cache instead, on whichever node first read the file, and must be copied
+// to be local.
+
+struct NumaNode {
+  int id;
+  std::vector<int> cpus;
+};
+
+// Parses a list of CPUs such as "0-3,8-11", as in the cpulist of a node.
+// Returns false if a range is malformed.
+bool parseCpuList(const std::string& text, std::vector<int>& cpus);
+
+// Lists the nodes which have CPUs, in order of id. Empty if the machine does
+// not describe its nodes, e.g. when it is not Linux.
+void listNumaNodes(std::vector<NumaNode>& nodes);
+
+// Restricts the calling thread to a set of CPUs. Returns false if it could
+// not, in which case the thread may run anywhere as before.
+bool bindThreadToCpus(const std::vector<int>& cpus);
+
+#endif
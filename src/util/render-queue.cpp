@@ -0,0 +1,90 @@
+#include "util/render-queue.hpp"
+#include <boost/bind.hpp>
+
+RenderQueue::RenderQueue(ThreadPool& pool, FrameWriter& writer, int capacity)
+    : pool_(&pool),
+      writer_(&writer),
+      capacity_(capacity > 0 ? capacity : 1),
+      mutex_(),
+      rendered_(),
+      finished_(),
+      frames_(),
+      num_pushed_(0),
+      next_(0),
+      ok_(true) {}
+
+RenderQueue::~RenderQueue() {
+  // Tasks refer to this queue.
+  boost::mutex::scoped_lock lock(mutex_);
+  while (next_ + int(finished_.size()) < num_pushed_) {
+    rendered_.wait(lock);
+  }
+}
+
+void RenderQueue::push(const RenderTask& task) {
+  push(num_pushed_, task);
+}
+
+void RenderQueue::push(int frame, const RenderTask& task) {
+  while (num_pushed_ - next_ >= capacity_) {
+    writeNext();
+  }
+
+  int t = num_pushed_;
+  num_pushed_ += 1;
+  frames_.push_back(frame);
+  pool_->schedule(boost::bind(&RenderQueue::render, this, t, task));
+
+  // Write frames which are already done, without waiting for any.
+  while (next_ < num_pushed_) {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (finished_.find(next_) == finished_.end()) {
+        break;
+      }
+    }
+    writeNext();
+  }
+}
+
+bool RenderQueue::finish() {
+  while (next_ < num_pushed_) {
+    writeNext();
+  }
+
+  if (!writer_->close()) {
+    ok_ = false;
+  }
+  return ok_;
+}
+
+void RenderQueue::render(int t, const RenderTask& task) {
+  cv::Mat image;
+  task(image);
+
+  boost::mutex::scoped_lock lock(mutex_);
+  finished_[t] = image;
+  rendered_.notify_all();
+}
+
+void RenderQueue::writeNext() {
+  cv::Mat image;
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    std::map<int, cv::Mat>::iterator frame = finished_.find(next_);
+    while (frame == finished_.end()) {
+      rendered_.wait(lock);
+      frame = finished_.find(next_);
+    }
+    image = frame->second;
+    finished_.erase(frame);
+  }
+
+  // Write without holding the lock so that workers can keep finishing.
+  if (!writer_->write(frames_.front(), image)) {
+    ok_ = false;
+  }
+  frames_.pop_front();
+  next_ += 1;
+}
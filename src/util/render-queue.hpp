@@ -0,0 +1,65 @@
+#ifndef UTIL_RENDER_QUEUE_HPP_
+#define UTIL_RENDER_QUEUE_HPP_
+
+#include <deque>
+#include <map>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <opencv2/core/core.hpp>
+#include "util/thread-pool.hpp"
+#include "util/frame-writer.hpp"
+
+// Renders the frames of a visualization on a ThreadPool and writes them in
+// the order they were pushed.
+//
+// Frames which finish early wait in a reorder buffer. The caller's thread does
+// all of the writing, so a FrameWriter does not need to be thread-safe and
+// may show a window.
+class RenderQueue {
+  public:
+    // Draws one frame. Must only use its own arguments or shared read-only
+    // data, since several may run at once.
+    typedef boost::function<void(cv::Mat&)> RenderTask;
+
+    // At most capacity frames are rendered or waiting at a time.
+    // Does not own the pool or the writer.
+    RenderQueue(ThreadPool& pool, FrameWriter& writer, int capacity);
+    // Waits for any frames still being rendered, without writing them.
+    ~RenderQueue();
+
+    // Schedules the next frame. Writes any frames which are ready, and blocks
+    // while the buffer is full.
+    void push(const RenderTask& task);
+    // Same, but gives the frame a number other than the count of frames
+    // pushed before it, for sequences with gaps.
+    void push(int frame, const RenderTask& task);
+    // Writes the remaining frames and closes the writer. Returns false if any
+    // frame could not be written.
+    bool finish();
+
+  private:
+    void render(int t, const RenderTask& task);
+    // Blocks until the frame is rendered.
+    void writeNext();
+
+    ThreadPool* pool_;
+    FrameWriter* writer_;
+    int capacity_;
+
+    boost::mutex mutex_;
+    boost::condition_variable rendered_;
+    std::map<int, cv::Mat> finished_;
+    // Numbers of the frames which have not been written yet, in order.
+    std::deque<int> frames_;
+
+    int num_pushed_;
+    int next_;
+    bool ok_;
+
+    // Non-copyable.
+    RenderQueue(const RenderQueue&);
+    RenderQueue& operator=(const RenderQueue&);
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "util/scaling.hpp"
+#include <algorithm>
+#include <cmath>
+#include <time.h>
+
+namespace {
+
+double monotonicTime() {
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Slope of the least-squares line through (log x, log y).
+double logLogSlope(const std::vector<int>& x, const std::vector<double>& y) {
+  int n = x.size();
+  double mean_u = 0;
+  double mean_v = 0;
+  for (int i = 0; i < n; i += 1) {
+    mean_u += std::log(double(x[i])) / n;
+    mean_v += std::log(y[i]) / n;
+  }
+
+  double uv = 0;
+  double uu = 0;
+  for (int i = 0; i < n; i += 1) {
+    double u = std::log(double(x[i])) - mean_u;
+    double v = std::log(y[i]) - mean_v;
+    uv += u * v;
+    uu += u * u;
+  }
+  return (uu > 0) ? uv / uu : 0;
+}
+
+}
+
+void ScalingResult::write(std::ostream& stream) const {
+  stream << "exponent " << exponent;
+  for (int i = 0; i < int(sizes.size()); i += 1) {
+    stream << ", " << sizes[i] << ": " << seconds[i] * 1e3 << " ms";
+  }
+}
+
+ScalingResult measureScaling(ScalingTrial& trial,
+                             int first,
+                             int factor,
+                             int num_sizes,
+                             int num_repeats) {
+  ScalingResult result;
+
+  int size = first;
+  for (int i = 0; i < num_sizes; i += 1) {
+    double fastest = 0;
+    for (int j = 0; j < num_repeats; j += 1) {
+      trial.setUp(size);
+      double start = monotonicTime();
+      trial.run();
+      double seconds = monotonicTime() - start;
+      fastest = (j == 0) ? seconds : std::min(fastest, seconds);
+    }
+
+    result.sizes.push_back(size);
+    // Guard the logarithm against a clock which did not tick.
+    result.seconds.push_back(std::max(fastest, 1e-9));
+    size *= factor;
+  }
+
+  result.exponent = logLogSlope(result.sizes, result.seconds);
+  return result;
+}
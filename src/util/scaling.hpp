@@ -0,0 +1,42 @@
+#ifndef UTIL_SCALING_HPP_
+#define UTIL_SCALING_HPP_
+
+#include <ostream>
+#include <vector>
+
+// Measures how the running time of an operation grows with the size of its
+// input, so that tests can fail on asymptotic regressions which are too
+// slow to notice on small inputs.
+//
+// Each size of a geometric sequence is set up and timed several times, and
+// the fastest time is kept. The exponent k of time = c size^k is fitted by
+// least squares in log-log, e.g. about 1 for a linear operation and 2 for a
+// quadratic one. Sizes should be large enough to take at least a millisecond.
+class ScalingTrial {
+  public:
+    virtual ~ScalingTrial() {}
+
+    // Builds an input of the given size. Not timed.
+    virtual void setUp(int size) = 0;
+    // Performs the operation on the input which was set up.
+    virtual void run() = 0;
+};
+
+struct ScalingResult {
+  std::vector<int> sizes;
+  // Fastest time of each size.
+  std::vector<double> seconds;
+  double exponent;
+
+  // Writes the exponent and the time of each size.
+  void write(std::ostream& stream) const;
+};
+
+// Runs sizes first, first * factor, ... num_sizes in all.
+ScalingResult measureScaling(ScalingTrial& trial,
+                             int first,
+                             int factor,
+                             int num_sizes,
+                             int num_repeats = 3);
+
+#endif
@@ -0,0 +1,294 @@
+#include "util/thread-pool.hpp"
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include "util/numa.hpp"
+
+namespace {
+
+// Shared state of a parallelFor() call. Tasks which start after every index
+// has been taken return at once, so the call only waits for blocks which are
+// in progress. The state is shared with the tasks, which may outlive the call.
+class IndexRange {
+  public:
+    IndexRange(int begin,
+               int end,
+               int grain,
+               const ThreadPool::IndexFunction& function)
+        : mutex_(),
+          finished_(),
+          next_(begin),
+          end_(end),
+          grain_(grain),
+          num_busy_(0),
+          function_(&function) {}
+
+    // Executes blocks of indices until none remain.
+    void run() {
+      int first;
+      int last;
+
+      while (take(first, last)) {
+        for (int i = first; i < last; i += 1) {
+          (*function_)(i);
+        }
+        release();
+      }
+    }
+
+    // Blocks until every index has been taken and executed.
+    void wait() {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (next_ < end_ || num_busy_ > 0) {
+        finished_.wait(lock);
+      }
+    }
+
+  private:
+    bool take(int& first, int& last) {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      if (next_ >= end_) {
+        return false;
+      }
+
+      first = next_;
+      last = std::min(next_ + grain_, end_);
+      next_ = last;
+      num_busy_ += 1;
+
+      return true;
+    }
+
+    void release() {
+      boost::mutex::scoped_lock lock(mutex_);
+      num_busy_ -= 1;
+      if (next_ >= end_ && num_busy_ == 0) {
+        finished_.notify_all();
+      }
+    }
+
+    boost::mutex mutex_;
+    boost::condition_variable finished_;
+    int next_;
+    int end_;
+    int grain_;
+    int num_busy_;
+    const ThreadPool::IndexFunction* function_;
+};
+
+void runRange(boost::shared_ptr<IndexRange> range) {
+  range->run();
+}
+
+// One worker per core but one for the calling thread.
+int defaultNumThreads() {
+  return std::max(int(boost::thread::hardware_concurrency()) - 1, 0);
+}
+
+}
+
+ThreadPool::ThreadPool(int num_threads)
+    : tasks_(),
+      threads_(),
+      cpus_(),
+      mutex_(),
+      task_added_(),
+      task_finished_(),
+      num_threads_(num_threads < 0 ? defaultNumThreads() : num_threads),
+      num_active_(0),
+      stop_(false) {
+  start();
+}
+
+ThreadPool::ThreadPool(int num_threads, const std::vector<int>& cpus)
+    : tasks_(),
+      threads_(),
+      cpus_(cpus),
+      mutex_(),
+      task_added_(),
+      task_finished_(),
+      num_threads_(num_threads < 0 ? std::max(int(cpus.size()) - 1, 0) :
+                                     num_threads),
+      num_active_(0),
+      stop_(false) {
+  start();
+}
+
+void ThreadPool::start() {
+  for (int i = 0; i < num_threads_; i += 1) {
+    threads_.create_thread(boost::bind(&ThreadPool::work, this));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  wait();
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stop_ = true;
+  }
+  task_added_.notify_all();
+
+  threads_.join_all();
+}
+
+int ThreadPool::numThreads() const {
+  return num_threads_;
+}
+
+void ThreadPool::schedule(const Task& task) {
+  if (num_threads_ == 0) {
+    task();
+    return;
+  }
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    tasks_.push_back(task);
+  }
+  task_added_.notify_one();
+}
+
+bool ThreadPool::runPendingTask() {
+  Task task;
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (tasks_.empty()) {
+      return false;
+    }
+    task = tasks_.front();
+    tasks_.pop_front();
+    num_active_ += 1;
+  }
+
+  task();
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    num_active_ -= 1;
+  }
+  task_finished_.notify_all();
+
+  return true;
+}
+
+void ThreadPool::wait() {
+  boost::mutex::scoped_lock lock(mutex_);
+
+  while (!tasks_.empty() || num_active_ > 0) {
+    task_finished_.wait(lock);
+  }
+}
+
+void ThreadPool::parallelFor(int begin,
+                             int end,
+                             const IndexFunction& function,
+                             int grain) {
+  if (begin >= end) {
+    return;
+  }
+
+  grain = std::max(grain, 1);
+  boost::shared_ptr<IndexRange> range(
+      new IndexRange(begin, end, grain, function));
+
+  // At most one task per worker, the calling thread makes up the difference.
+  int num_tasks = std::min(num_threads_, (end - begin - 1) / grain);
+  for (int i = 0; i < num_tasks; i += 1) {
+    schedule(boost::bind(runRange, range));
+  }
+  range->run();
+
+  // Only wait for blocks of this range which other threads are executing.
+  // Unlike TaskGroup::wait(), this never runs unrelated tasks, which could
+  // try to take a lock that the caller holds, such as ARPACK's.
+  range->wait();
+}
+
+void ThreadPool::work() {
+  // Only a hint, the worker runs anywhere if it cannot be pinned.
+  if (!cpus_.empty()) {
+    bindThreadToCpus(cpus_);
+  }
+
+  while (true) {
+    Task task;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      while (tasks_.empty() && !stop_) {
+        task_added_.wait(lock);
+      }
+
+      if (tasks_.empty()) {
+        // Stopped and nothing left to do.
+        return;
+      }
+
+      task = tasks_.front();
+      tasks_.pop_front();
+      num_active_ += 1;
+    }
+
+    task();
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      num_active_ -= 1;
+    }
+    task_finished_.notify_all();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+TaskGroup::TaskGroup(ThreadPool& pool)
+    : pool_(&pool), mutex_(), finished_(), num_tasks_(0) {}
+
+TaskGroup::~TaskGroup() {
+  wait();
+}
+
+void TaskGroup::run(const ThreadPool::Task& task) {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    num_tasks_ += 1;
+  }
+  pool_->schedule(boost::bind(&TaskGroup::runTask, this, task));
+}
+
+void TaskGroup::runTask(const ThreadPool::Task& task) {
+  task();
+
+  // Notify while locked so that the group is not destroyed until this task
+  // has stopped using it.
+  boost::mutex::scoped_lock lock(mutex_);
+  num_tasks_ -= 1;
+  finished_.notify_all();
+}
+
+void TaskGroup::wait() {
+  // The tasks of this group may be queued behind others. Executing queued
+  // tasks rather than blocking means that a worker which waits here does
+  // not leave its own tasks with no thread to run them.
+  while (true) {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (num_tasks_ == 0) {
+        return;
+      }
+    }
+    if (!pool_->runPendingTask()) {
+      break;
+    }
+  }
+
+  // Every task of the group has been taken by some thread.
+  boost::mutex::scoped_lock lock(mutex_);
+  while (num_tasks_ > 0) {
+    finished_.wait(lock);
+  }
+}
@@ -0,0 +1,143 @@
+#ifndef UTIL_THREAD_POOL_HPP_
+#define UTIL_THREAD_POOL_HPP_
+
+#include <deque>
+#include <map>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+// A fixed set of worker threads which execute tasks from a shared queue.
+//
+// With zero threads, tasks are executed immediately by the calling thread.
+// Tasks may themselves call parallelFor() or wait for a TaskGroup. A thread
+// in parallelFor() executes indices of its own range until none remain, and
+// a thread which waits for a TaskGroup executes queued tasks meanwhile.
+class ThreadPool {
+  public:
+    typedef boost::function<void()> Task;
+    typedef boost::function<void(int)> IndexFunction;
+
+    // With a negative number, starts one thread per core but one, since the
+    // calling thread also works in parallelFor(). Tools pass their
+    // --num_threads flag, so --num_threads=-1 uses every core.
+    explicit ThreadPool(int num_threads);
+    // Same as above, but every worker is pinned to the given CPUs, e.g. those
+    // of one NUMA node (see util/numa.hpp). With a negative number, starts
+    // one thread per CPU but one.
+    ThreadPool(int num_threads, const std::vector<int>& cpus);
+    // Waits for all tasks to finish.
+    ~ThreadPool();
+
+    // Returns the number of worker threads.
+    int numThreads() const;
+
+    // Adds a task to the queue.
+    void schedule(const Task& task);
+    // Executes the next task of the queue in the calling thread.
+    // Returns false if the queue was empty.
+    bool runPendingTask();
+
+    // Blocks until the queue is empty and all workers are idle.
+    void wait();
+
+    // Calls function(i) for every i in [begin, end) and waits for completion.
+    // Indices are handed out dynamically in blocks of size grain.
+    // The calling thread also does work.
+    // Only waits for its own indices, so several threads may share the pool.
+    // Never executes other tasks, so it may be called with a lock held.
+    void parallelFor(int begin,
+                     int end,
+                     const IndexFunction& function,
+                     int grain = 1);
+
+  private:
+    void work();
+
+    void start();
+
+    std::deque<Task> tasks_;
+    boost::thread_group threads_;
+    // Empty unless the workers are pinned.
+    std::vector<int> cpus_;
+    boost::mutex mutex_;
+    // Signalled when a task is added or the pool is stopped.
+    boost::condition_variable task_added_;
+    // Signalled when a worker becomes idle.
+    boost::condition_variable task_finished_;
+    int num_threads_;
+    int num_active_;
+    bool stop_;
+
+    // Non-copyable.
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+};
+
+// Tasks of a pool which are waited for together, e.g.
+//   TaskGroup group(pool);
+//   group.run(boost::bind(solveLeft, ...));
+//   group.run(boost::bind(solveRight, ...));
+//   group.wait();
+// Results are written by the tasks to where the caller asks. Only waits for
+// its own tasks, so several threads may share the pool.
+class TaskGroup {
+  public:
+    explicit TaskGroup(ThreadPool& pool);
+    // Waits for the tasks to finish.
+    ~TaskGroup();
+
+    void run(const ThreadPool::Task& task);
+    // Blocks until every task of the group has finished.
+    void wait();
+
+  private:
+    void runTask(const ThreadPool::Task& task);
+
+    ThreadPool* pool_;
+    boost::mutex mutex_;
+    boost::condition_variable finished_;
+    int num_tasks_;
+
+    // Non-copyable.
+    TaskGroup(const TaskGroup&);
+    TaskGroup& operator=(const TaskGroup&);
+};
+
+// Scratch storage with one value per thread, e.g. buffers which the
+// function of parallelFor() reuses rather than allocating for every index.
+// Each value is default-constructed the first time its thread asks for it,
+// and is kept until this is destroyed, so that values can be combined once
+// the threads have finished.
+template<class T>
+class PerThread {
+  public:
+    typedef std::map<boost::thread::id, T> Values;
+
+    PerThread() : values_(), mutex_() {}
+
+    // The value of the calling thread. Locks briefly, so it is better taken
+    // once per index than once per inner loop.
+    T& local() {
+      boost::mutex::scoped_lock lock(mutex_);
+      return values_[boost::this_thread::get_id()];
+    }
+
+    // Not to be used while other threads may call local().
+    Values& values() {
+      return values_;
+    }
+
+  private:
+    // Elements of a map are not moved by insertion.
+    Values values_;
+    boost::mutex mutex_;
+
+    // Non-copyable.
+    PerThread(const PerThread&);
+    PerThread& operator=(const PerThread&);
+};
+
+#endif
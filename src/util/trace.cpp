@@ -0,0 +1,306 @@
+#include "util/trace.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <boost/format.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace {
+
+struct Event {
+  const char* name;
+  double begin;
+  double duration;
+};
+
+struct Sample {
+  const char* name;
+  double time;
+  double value;
+};
+
+// Written only by its own thread, and read at exit.
+struct Buffer {
+  int thread;
+  std::vector<Event> events;
+  std::vector<Sample> samples;
+  std::map<const char*, double> counters;
+};
+
+struct Summary {
+  int count;
+  double total;
+  double max;
+
+  Summary() : count(0), total(0), max(0) {}
+};
+
+// Buffers are never freed, since they are read after their threads exit.
+void keepBuffer(Buffer*) {}
+
+// Read by every thread, so accessed with atomic builtins.
+int enabled_flag = 0;
+double origin = 0;
+std::string trace_file;
+
+// Guards the list of buffers.
+boost::mutex mutex;
+std::vector<Buffer*> buffers;
+boost::thread_specific_ptr<Buffer> local(keepBuffer);
+
+bool enabled() {
+  return __atomic_load_n(&enabled_flag, __ATOMIC_ACQUIRE) != 0;
+}
+
+void setEnabled(bool value) {
+  __atomic_store_n(&enabled_flag, value ? 1 : 0, __ATOMIC_RELEASE);
+}
+
+double monotonicTime() {
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e6 + t.tv_nsec * 1e-3;
+}
+
+Buffer& localBuffer() {
+  Buffer* buffer = local.get();
+  if (buffer == NULL) {
+    buffer = new Buffer();
+    local.reset(buffer);
+
+    boost::mutex::scoped_lock lock(mutex);
+    buffer->thread = buffers.size();
+    buffers.push_back(buffer);
+  }
+  return *buffer;
+}
+
+std::string escape(const char* name) {
+  std::string str;
+  for (const char* c = name; *c != '\0'; ++c) {
+    if (*c == '"' || *c == '\\') {
+      str += '\\';
+    }
+    str += *c;
+  }
+  return str;
+}
+
+void writeJson(std::ostream& stream) {
+  stream << "{\"traceEvents\":[";
+  bool first = true;
+
+  std::vector<Buffer*>::const_iterator buffer;
+  for (buffer = buffers.begin(); buffer != buffers.end(); ++buffer) {
+    std::vector<Event>::const_iterator event;
+    for (event = (*buffer)->events.begin();
+         event != (*buffer)->events.end();
+         ++event) {
+      stream << (first ? "" : ",") << std::endl;
+      stream << boost::format("{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,"
+          "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}") % escape(event->name) %
+          (*buffer)->thread % event->begin % event->duration;
+      first = false;
+    }
+  }
+
+  for (buffer = buffers.begin(); buffer != buffers.end(); ++buffer) {
+    std::vector<Sample>::const_iterator sample;
+    for (sample = (*buffer)->samples.begin();
+         sample != (*buffer)->samples.end();
+         ++sample) {
+      stream << (first ? "" : ",") << std::endl;
+      stream << boost::format("{\"name\":\"%s\",\"ph\":\"C\",\"pid\":0,"
+          "\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%g}}") %
+          escape(sample->name) % (*buffer)->thread % sample->time %
+          sample->value;
+      first = false;
+    }
+  }
+
+  // Counters are totalled over threads and given as one sample at the end.
+  std::map<std::string, double> counters;
+  for (buffer = buffers.begin(); buffer != buffers.end(); ++buffer) {
+    std::map<const char*, double>::const_iterator counter;
+    for (counter = (*buffer)->counters.begin();
+         counter != (*buffer)->counters.end();
+         ++counter) {
+      counters[counter->first] += counter->second;
+    }
+  }
+
+  std::map<std::string, double>::const_iterator counter;
+  for (counter = counters.begin(); counter != counters.end(); ++counter) {
+    stream << (first ? "" : ",") << std::endl;
+    stream << boost::format("{\"name\":\"%s\",\"ph\":\"C\",\"pid\":0,"
+        "\"tid\":0,\"ts\":%.3f,\"args\":{\"value\":%g}}") %
+        escape(counter->first.c_str()) % traceTime() % counter->second;
+    first = false;
+  }
+
+  stream << std::endl << "]}" << std::endl;
+}
+
+bool hasLargerTotal(const std::pair<std::string, Summary>& lhs,
+                    const std::pair<std::string, Summary>& rhs) {
+  return lhs.second.total > rhs.second.total;
+}
+
+void writeSummary(std::ostream& stream) {
+  std::map<std::string, Summary> summaries;
+  std::map<std::string, double> counters;
+
+  std::vector<Buffer*>::const_iterator buffer;
+  for (buffer = buffers.begin(); buffer != buffers.end(); ++buffer) {
+    std::vector<Event>::const_iterator event;
+    for (event = (*buffer)->events.begin();
+         event != (*buffer)->events.end();
+         ++event) {
+      Summary& summary = summaries[event->name];
+      summary.count += 1;
+      summary.total += event->duration;
+      summary.max = std::max(summary.max, event->duration);
+    }
+
+    std::map<const char*, double>::const_iterator counter;
+    for (counter = (*buffer)->counters.begin();
+         counter != (*buffer)->counters.end();
+         ++counter) {
+      counters[counter->first] += counter->second;
+    }
+  }
+
+  // Most expensive first.
+  std::vector<std::pair<std::string, Summary> > sorted(summaries.begin(),
+      summaries.end());
+  std::stable_sort(sorted.begin(), sorted.end(), hasLargerTotal);
+
+  stream << boost::format("%-32s %10s %12s %12s %12s") % "scope" % "count" %
+      "total (ms)" % "mean (ms)" % "max (ms)" << std::endl;
+  std::vector<std::pair<std::string, Summary> >::const_iterator row;
+  for (row = sorted.begin(); row != sorted.end(); ++row) {
+    const Summary& summary = row->second;
+    stream << boost::format("%-32s %10d %12.3f %12.3f %12.3f") % row->first %
+        summary.count % (summary.total * 1e-3) %
+        (summary.total * 1e-3 / summary.count) % (summary.max * 1e-3) <<
+        std::endl;
+  }
+
+  if (!counters.empty()) {
+    stream << boost::format("%-32s %10s") % "counter" % "total" << std::endl;
+    std::map<std::string, double>::const_iterator counter;
+    for (counter = counters.begin(); counter != counters.end(); ++counter) {
+      stream << boost::format("%-32s %10g") % counter->first %
+          counter->second << std::endl;
+    }
+  }
+}
+
+// Called at exit. Any threads still running must not record more events.
+void finish() {
+  setEnabled(false);
+  boost::mutex::scoped_lock lock(mutex);
+
+  if (!trace_file.empty()) {
+    std::ofstream file(trace_file.c_str());
+    if (file) {
+      writeJson(file);
+    }
+    if (!file) {
+      std::cerr << "Could not write trace to \"" << trace_file << "\"" <<
+          std::endl;
+    }
+  }
+
+  writeSummary(std::cerr);
+}
+
+}
+
+void traceInit(const std::string& filename) {
+  if (enabled()) {
+    return;
+  }
+
+  trace_file = filename;
+  origin = monotonicTime();
+  setEnabled(true);
+  std::atexit(finish);
+}
+
+bool traceEnabled() {
+  return enabled();
+}
+
+double traceTime() {
+  return monotonicTime() - origin;
+}
+
+void traceEvent(const char* name, double begin, double end) {
+  if (!enabled()) {
+    return;
+  }
+
+  Event event;
+  event.name = name;
+  event.begin = begin;
+  event.duration = end - begin;
+  localBuffer().events.push_back(event);
+}
+
+void traceCount(const char* name, double n) {
+  if (!enabled()) {
+    return;
+  }
+
+  localBuffer().counters[name] += n;
+}
+
+void traceSample(const char* name, double value) {
+  if (!enabled()) {
+    return;
+  }
+
+  Sample sample;
+  sample.name = name;
+  sample.time = traceTime();
+  sample.value = value;
+  localBuffer().samples.push_back(sample);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+TraceScope::TraceScope(const char* name)
+    : name_(name), begin_(enabled() ? traceTime() : 0) {}
+
+TraceScope::~TraceScope() {
+  if (enabled()) {
+    traceEvent(name_, begin_, traceTime());
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+TraceStages::TraceStages() : name_(NULL), begin_(0) {}
+
+TraceStages::~TraceStages() {
+  if (name_ != NULL) {
+    traceEvent(name_, begin_, traceTime());
+  }
+}
+
+void TraceStages::next(const char* name) {
+  double now = traceTime();
+  if (name_ != NULL) {
+    traceEvent(name_, begin_, now);
+  }
+
+  name_ = name;
+  begin_ = now;
+}
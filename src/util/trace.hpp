@@ -0,0 +1,95 @@
+#ifndef UTIL_TRACE_HPP_
+#define UTIL_TRACE_HPP_
+
+#include <string>
+
+// Records how long named scopes take and the totals of named counters.
+//
+// Only compiled in with ENABLE_TRACE defined (cmake -DWITH_TRACE=ON).
+// Otherwise every macro expands to nothing and its arguments are not
+// evaluated. Nothing is recorded until TRACE_INIT() is called.
+//
+// Each thread appends to its own buffer, so recording takes no lock after
+// the first event of a thread. At exit, the events are written as Chrome
+// trace-event JSON (for chrome://tracing) and a summary of each name is
+// printed to stderr. Names must be string literals.
+//
+//   TRACE_INIT(FLAGS_trace);
+//   TRACE_SCOPE("match pair");
+//   TRACE_COUNT("matches", matches.size());
+//
+//   TRACE_STAGES(stages);
+//   TRACE_NEXT_STAGE(stages, "load");
+//   ...
+//   TRACE_NEXT_STAGE(stages, "save");
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef ENABLE_TRACE
+
+// Starts recording. The trace is written to filename at exit, unless it is
+// empty, and the summary is always printed.
+#define TRACE_INIT(filename) traceInit(filename)
+// Times the rest of the enclosing scope.
+#define TRACE_SCOPE(name) \
+    TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+// Adds n to a counter.
+#define TRACE_COUNT(name, n) traceCount(name, n)
+// Times consecutive stages of a scope, each ending where the next begins.
+#define TRACE_STAGES(stages) TraceStages stages
+#define TRACE_NEXT_STAGE(stages, name) stages.next(name)
+
+#else
+
+#define TRACE_INIT(filename) ((void)0)
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_COUNT(name, n) ((void)0)
+#define TRACE_STAGES(stages) ((void)0)
+#define TRACE_NEXT_STAGE(stages, name) ((void)0)
+
+#endif
+
+void traceInit(const std::string& filename);
+bool traceEnabled();
+// Microseconds since traceInit().
+double traceTime();
+// Records an event which began at time begin (from traceTime()).
+void traceEvent(const char* name, double begin, double end);
+void traceCount(const char* name, double n);
+// Records the value of a quantity at this time, unlike a counter's total.
+void traceSample(const char* name, double value);
+
+class TraceScope {
+  public:
+    explicit TraceScope(const char* name);
+    ~TraceScope();
+
+  private:
+    const char* name_;
+    double begin_;
+
+    // Non-copyable.
+    TraceScope(const TraceScope&);
+    TraceScope& operator=(const TraceScope&);
+};
+
+class TraceStages {
+  public:
+    TraceStages();
+    // Ends the current stage.
+    ~TraceStages();
+
+    // Ends the current stage, if any, and begins another.
+    void next(const char* name);
+
+  private:
+    const char* name_;
+    double begin_;
+
+    // Non-copyable.
+    TraceStages(const TraceStages&);
+    TraceStages& operator=(const TraceStages&);
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "vertex_subgraph.hpp"
+#include <algorithm>
+#include <glog/logging.h>
+#include "match_graph.hpp"
+
+VertexSubgraph::VertexSubgraph(const MatchGraph& graph)
+    : graph_(&graph), root_(this), vertices_(graph.numVertices()),
+      children_() {
+  for (int u = 0; u < graph.numVertices(); u += 1) {
+    vertices_[u] = u;
+  }
+}
+
+VertexSubgraph::VertexSubgraph(const MatchGraph& graph, VertexSubgraph& root)
+    : graph_(&graph), root_(&root), vertices_(), children_() {}
+
+VertexSubgraph::~VertexSubgraph() {
+  std::vector<VertexSubgraph*>::iterator child;
+  for (child = children_.begin(); child != children_.end(); ++child) {
+    delete *child;
+  }
+}
+
+const MatchGraph& VertexSubgraph::graph() const {
+  return *graph_;
+}
+
+VertexSubgraph& VertexSubgraph::root() {
+  return *root_;
+}
+
+VertexSubgraph& VertexSubgraph::create_subgraph() {
+  VertexSubgraph* child = new VertexSubgraph(*graph_, *root_);
+  root_->children_.push_back(child);
+  return *child;
+}
+
+int VertexSubgraph::numVertices() const {
+  return vertices_.size();
+}
+
+const std::vector<int>& VertexSubgraph::vertices() const {
+  return vertices_;
+}
+
+int VertexSubgraph::local_to_global(int v) const {
+  return vertices_[v];
+}
+
+int VertexSubgraph::global_to_local(int u) const {
+  std::vector<int>::const_iterator vertex = std::lower_bound(
+      vertices_.begin(), vertices_.end(), u);
+  CHECK(vertex != vertices_.end() && *vertex == u) << "Vertex " << u <<
+      " is not in the subgraph";
+  return vertex - vertices_.begin();
+}
+
+void VertexSubgraph::addVertex(int u) {
+  CHECK(0 <= u && u < graph_->numVertices());
+  if (vertices_.empty() || vertices_.back() < u) {
+    vertices_.push_back(u);
+    return;
+  }
+
+  std::vector<int>::iterator vertex = std::lower_bound(vertices_.begin(),
+      vertices_.end(), u);
+  if (*vertex != u) {
+    vertices_.insert(vertex, u);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+size_t num_vertices(const VertexSubgraph& subgraph) {
+  return subgraph.numVertices();
+}
+
+size_t num_edges(const VertexSubgraph& subgraph) {
+  const MatchGraph& graph = subgraph.graph();
+  const std::vector<int>& vertices = subgraph.vertices();
+  if (int(vertices.size()) == graph.numVertices()) {
+    return graph.numEdges();
+  }
+
+  // Each edge is found from both ends.
+  size_t num_ends = 0;
+  std::vector<int>::const_iterator vertex;
+  for (vertex = vertices.begin(); vertex != vertices.end(); ++vertex) {
+    const int* neighbors = graph.neighbors(*vertex);
+    int degree = graph.degree(*vertex);
+    for (int i = 0; i < degree; i += 1) {
+      num_ends += std::binary_search(vertices.begin(), vertices.end(),
+          neighbors[i]);
+    }
+  }
+
+  return num_ends / 2;
+}
+
+void add_vertex(int u, VertexSubgraph& subgraph) {
+  subgraph.addVertex(u);
+}
@@ -0,0 +1,60 @@
+#ifndef VERTEX_SUBGRAPH_HPP_
+#define VERTEX_SUBGRAPH_HPP_
+
+#include <cstddef>
+#include <vector>
+
+class MatchGraph;
+
+// A subgraph of a MatchGraph, held as the list of its vertices alone.
+//
+// Has the members and free functions of boost::subgraph which a recursive
+// cut uses, but creating one copies no edges: its edges are those of the
+// MatchGraph between its vertices. Local vertices are numbered in the order
+// of the vertices of the MatchGraph. Every subgraph is owned by the root.
+class VertexSubgraph {
+  public:
+    // The root, with every vertex of the graph.
+    explicit VertexSubgraph(const MatchGraph& graph);
+    ~VertexSubgraph();
+
+    const MatchGraph& graph() const;
+    VertexSubgraph& root();
+
+    // Creates an empty subgraph. Not thread-safe.
+    VertexSubgraph& create_subgraph();
+
+    int numVertices() const;
+    // Vertices in the MatchGraph, sorted.
+    const std::vector<int>& vertices() const;
+
+    // Vertex in the MatchGraph of a local vertex.
+    int local_to_global(int v) const;
+    // Local vertex of a vertex of the MatchGraph, which must be present.
+    int global_to_local(int u) const;
+
+    // Adding vertices in order is cheapest.
+    void addVertex(int u);
+
+  private:
+    VertexSubgraph(const MatchGraph& graph, VertexSubgraph& root);
+
+    const MatchGraph* graph_;
+    VertexSubgraph* root_;
+    std::vector<int> vertices_;
+    // Of the root only.
+    std::vector<VertexSubgraph*> children_;
+
+    // Non-copyable.
+    VertexSubgraph(const VertexSubgraph&);
+    VertexSubgraph& operator=(const VertexSubgraph&);
+};
+
+// As for boost::subgraph, found by argument-dependent lookup.
+size_t num_vertices(const VertexSubgraph& subgraph);
+// Edges of the MatchGraph between vertices of the subgraph.
+size_t num_edges(const VertexSubgraph& subgraph);
+// Adds a vertex of the MatchGraph.
+void add_vertex(int u, VertexSubgraph& subgraph);
+
+#endif
@@ -5,6 +5,8 @@
 #include "videoseg/region.hpp"
 #include <opencv2/core/core.hpp>
 
+class ThreadPool;
+
 namespace videoseg {
 
 // Fill a region with a solid color.
@@ -29,6 +31,38 @@ void copyAndBlendRegion(const Rasterization& region,
                         double alpha,
                         cv::Mat& dst);
 
+// How drawRegions() draws one region.
+struct RegionDrawing {
+  enum Mode {
+    // Fill with the color.
+    FILL,
+    // Copy pixels of the source.
+    COPY,
+    // Copy pixels of the source blended with the color.
+    BLEND
+  };
+
+  const Rasterization* region;
+  Mode mode;
+  cv::Vec3b color;
+  // Weight of the color when blending.
+  double alpha;
+
+  RegionDrawing();
+  RegionDrawing(const Rasterization& region,
+                Mode mode,
+                cv::Vec3b color,
+                double alpha);
+};
+
+// Draws every region of a frame, in order, as the functions above. Divides
+// the rows amongst the threads of the pool if one is given. The source is only
+// read by COPY and BLEND.
+void drawRegions(const vector<RegionDrawing>& regions,
+                 const cv::Mat& src,
+                 cv::Mat& dst,
+                 ThreadPool* pool);
+
 }
 
 #endif
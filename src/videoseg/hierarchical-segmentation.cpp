@@ -5,6 +5,7 @@
  */
 
 #include "videoseg/hierarchical-segmentation.hpp"
+#include "videoseg/region.hpp"
 
 #include <algorithm>
 #include <cstdio>
@@ -349,66 +350,19 @@ void MergeRasterization(const Rasterization& lhs,
                         Rasterization* merged) {
   //ASSURE_LOG(merged);
 
-  RepeatedPtrField<ScanInterval>::const_iterator lhs_scan = lhs.scan_inter().begin();
-  RepeatedPtrField<ScanInterval>::const_iterator rhs_scan = rhs.scan_inter().begin();
+  // Merge as packed intervals, converting to protobuf only at the boundary.
+  IntervalArray lhs_intervals;
+  IntervalArray rhs_intervals;
+  rasterizationToIntervals(lhs, lhs_intervals);
+  rasterizationToIntervals(rhs, rhs_intervals);
 
-  RepeatedPtrField<ScanInterval>::const_iterator lhs_end = lhs.scan_inter().end();
-  RepeatedPtrField<ScanInterval>::const_iterator rhs_end = rhs.scan_inter().end();
+  vector<const IntervalArray*> inputs(2);
+  inputs[0] = &lhs_intervals;
+  inputs[1] = &rhs_intervals;
 
-  vector<int> interval_offsets;
-  while (lhs_scan != lhs_end || rhs_scan != rhs_end) {
-    const int lhs_y = (lhs_scan == lhs_end ? 1 << 30 : lhs_scan->y());
-    const int rhs_y = (rhs_scan == rhs_end ? 1 << 30 : rhs_scan->y());
-
-    if (lhs_y < rhs_y) {
-      merged->add_scan_inter()->CopyFrom(*lhs_scan++);
-    } else if (rhs_y < lhs_y) {
-      merged->add_scan_inter()->CopyFrom(*rhs_scan++);
-    } else {
-      // y-coords are equal.
-      //ASSERT_LOG(lhs_y == rhs_y);
-
-      interval_offsets.clear();
-      bool left_cond, right_cond;
-      while ( (left_cond = (lhs_scan != lhs_end && lhs_scan->y() == lhs_y)) ||
-              (right_cond = (rhs_scan != rhs_end && rhs_scan->y() == rhs_y)) ) {
-        const int lhs_x = left_cond ? lhs_scan->left_x() : 1 << 30;
-        const int rhs_x = right_cond ? rhs_scan->left_x() : 1 << 30;
-        if (lhs_x < rhs_x) {
-          interval_offsets.push_back(lhs_scan->left_x());
-          interval_offsets.push_back(lhs_scan->right_x());
-          ++lhs_scan;
-        } else {
-          interval_offsets.push_back(rhs_scan->left_x());
-          interval_offsets.push_back(rhs_scan->right_x());
-          ++rhs_scan;
-        }
-      }
-
-      int k = 0, l = 0, sz_k = interval_offsets.size();
-      while (k < sz_k) {
-        // Last interval -> insert and break.
-        if (k + 2 == sz_k) {
-          ScanInterval* scan_inter = merged->add_scan_inter();
-          scan_inter->set_y(lhs_y);
-          scan_inter->set_left_x(interval_offsets[l]);
-          scan_inter->set_right_x(interval_offsets[k + 1]);
-          break;
-        } else if (interval_offsets[k + 2] - 1 == interval_offsets[k + 1]) {
-          // Connected -> skip.
-          k += 2;
-        } else {
-          // Not, connected: Reset and add.
-          ScanInterval* scan_inter = merged->add_scan_inter();
-          scan_inter->set_y(lhs_y);
-          scan_inter->set_left_x(interval_offsets[l]);
-          scan_inter->set_right_x(interval_offsets[k + 1]);
-          k += 2;
-          l = k;
-        }
-      }
-    }
-  }
+  IntervalArray merged_intervals;
+  mergeIntervals(inputs, merged_intervals);
+  intervalsToRasterization(merged_intervals, *merged);
 }
 
 void MergeRasterization3D(const Rasterization3D& lhs,
@@ -790,6 +744,7 @@ void BuildGlobalHierarchy(const Hierarchy& chunk_hierarchy,
     // Merge Levels.
     HierarchyLevel merged_level;
     MergeHierarchyLevel(level_1, level_2, &merged_level);
+    global_hierarchy->Mutable(level)->Swap(&merged_level);
   }
 }
 
@@ -897,11 +852,14 @@ bool ScanIntervalsNeighbored(const ScanInterval& lhs,
 int ConnectedComponents(const Rasterization& raster,
                         vector<Rasterization>* components) {
   const int scan_inter_size = raster.scan_inter_size();
+  if (scan_inter_size == 0) {
+    return 0;
+  }
 
   // Compute disjoint sets.
   vector<int> ranks(scan_inter_size);
   vector<int> parents(scan_inter_size);
-  vector<int> elements;
+  vector<int> elements(scan_inter_size);
   boost::disjoint_sets<int*, int*> classes(&ranks[0], &parents[0]);
 
   int last_change_idx;
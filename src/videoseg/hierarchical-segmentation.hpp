@@ -10,6 +10,7 @@
 #include "videoseg/using.hpp"
 #include "videoseg/hierarchical-segmentation.pb.h"
 
+#include <algorithm>
 #include <boost/shared_ptr.hpp>
 #include <opencv2/core/core_c.h>
 
@@ -6,7 +6,12 @@
 
 #include "videoseg/io.hpp"
 #include "videoseg/hierarchical-segmentation.hpp"
+#include <cstring>
 #include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 typedef unsigned char uchar;
 
@@ -135,7 +140,52 @@ void SegmentationWriter::FlushAndReopen(const string& filename) {
   OpenFile();
 }
 
+bool MappedFile::Open(const string& filename) {
+  Close();
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat status;
+  if (fstat(fd, &status) != 0 || status.st_size == 0) {
+    close(fd);
+    return false;
+  }
+
+  void* data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  data_ = static_cast<const char*>(data);
+  size_ = status.st_size;
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_ != NULL) {
+    munmap(const_cast<char*>(data_), size_);
+    data_ = NULL;
+    size_ = 0;
+  }
+}
+
 bool SegmentationReader::OpenFileAndReadHeaders() {
+  file_offsets_.clear();
+  time_stamps_.clear();
+  curr_frame_ = 0;
+
+  if (mapped_) {
+    return ReadHeadersFromMapping();
+  } else {
+    return ReadHeadersFromStream();
+  }
+}
+
+bool SegmentationReader::ReadHeadersFromStream() {
   // Open file.
   //LOG(INFO_V1) << "Reading segmentation from file " << filename_;
   ifs_.open(filename_.c_str(), std::ios_base::in | std::ios_base::binary);
@@ -195,18 +245,101 @@ bool SegmentationReader::OpenFileAndReadHeaders() {
   return true;
 }
 
+namespace {
+
+// Reads a value at an offset of the mapping and advances the offset.
+template <class T> bool ReadMapped(const MappedFile& file,
+                                   int64_t* offset,
+                                   T* value) {
+  if (*offset < 0 || *offset + int64_t(sizeof(T)) > int64_t(file.size())) {
+    return false;
+  }
+  memcpy(value, file.data() + *offset, sizeof(T));
+  *offset += sizeof(T);
+  return true;
+}
+
+} // namespace
+
+bool SegmentationReader::ReadHeadersFromMapping() {
+  if (!mapping_.Open(filename_)) {
+    //LOG(ERROR) << "Could not map segmentation file " << filename_ << "\n";
+    return false;
+  }
+
+  // Walk the chunk headers without touching the frames.
+  int64_t offset = 0;
+  while (true) {
+    char header_type[4];
+    if (!ReadMapped(mapping_, &offset, &header_type)) {
+      return false;
+    }
+
+    if (memcmp(header_type, "TERM", 4) == 0) {
+      break;
+    }
+    if (memcmp(header_type, "CHNK", 4) != 0) {
+      return false;
+    }
+
+    int32_t header_id;
+    int32_t num_frames_in_chunk;
+    if (!ReadMapped(mapping_, &offset, &header_id) ||
+        !ReadMapped(mapping_, &offset, &num_frames_in_chunk) ||
+        num_frames_in_chunk < 0) {
+      return false;
+    }
+
+    for (int f = 0; f < num_frames_in_chunk; ++f) {
+      int64_t frame_offset;
+      if (!ReadMapped(mapping_, &offset, &frame_offset)) {
+        return false;
+      }
+      file_offsets_.push_back(frame_offset);
+    }
+
+    for (int f = 0; f < num_frames_in_chunk; ++f) {
+      int64_t timestamp;
+      if (!ReadMapped(mapping_, &offset, &timestamp)) {
+        return false;
+      }
+      time_stamps_.push_back(timestamp);
+    }
+
+    int64_t next_header_pos;
+    if (!ReadMapped(mapping_, &offset, &next_header_pos) ||
+        next_header_pos < offset) {
+      return false;
+    }
+    offset = next_header_pos;
+  }
+
+  return true;
+}
+
+const char* SegmentationReader::MappedFrame(int frame, int* size) const {
+  int64_t offset = file_offsets_[frame];
+  char header_type[4];
+  int32_t frame_size;
+  if (!ReadMapped(mapping_, &offset, &header_type) ||
+      memcmp(header_type, "SEGD", 4) != 0 ||
+      !ReadMapped(mapping_, &offset, &frame_size) ||
+      frame_size < 0 ||
+      offset + frame_size > int64_t(mapping_.size())) {
+    return NULL;
+  }
+
+  *size = frame_size;
+  return mapping_.data() + offset;
+}
+
 void SegmentationReader::SegmentationResolution(int* width, int* height) {
   //ASSURE_LOG(width);
   //ASSURE_LOG(height);
 
   const int curr_playhead = curr_frame_;
-  SeekToFrame(0);
-  int frame_sz = ReadNextFrameSize();
-  vector<unsigned char> buffer(frame_sz);
-  ReadNextFrame(&buffer[0]);
-
   SegmentationDesc segmentation;
-  segmentation.ParseFromArray(&buffer[0], buffer.size());
+  ReadFrame(0, &segmentation);
 
   *width = segmentation.frame_width();
   *height = segmentation.frame_height();
@@ -222,6 +355,13 @@ void SegmentationReader::SeekToFrame(int frame) {
 }
 
 int SegmentationReader::ReadNextFrameSize() {
+  if (mapped_) {
+    if (MappedFrame(curr_frame_, &frame_sz_) == NULL) {
+      return -1;
+    }
+    return frame_sz_;
+  }
+
   // Seek to next frame (to skip chunk headers).
   ifs_.seekg(file_offsets_[curr_frame_]);
   char header_type[5] = {0, 0, 0, 0, 0};
@@ -236,8 +376,39 @@ int SegmentationReader::ReadNextFrameSize() {
 }
 
 void SegmentationReader::ReadNextFrame(uchar* data) {
-  ifs_.read(ToCharPtr(data), frame_sz_);
+  if (mapped_) {
+    int size;
+    const char* frame = MappedFrame(curr_frame_, &size);
+    if (frame != NULL) {
+      memcpy(data, frame, frame_sz_);
+    }
+  } else {
+    ifs_.read(ToCharPtr(data), frame_sz_);
+  }
   ++curr_frame_;
 }
 
+bool SegmentationReader::ReadFrame(int frame, SegmentationDesc* desc) {
+  //ASSURE_LOG(frame < file_offsets_.size()) << "Requested frame out of bound.";
+  bool ok;
+  if (mapped_) {
+    // Parse in place.
+    int size;
+    const char* data = MappedFrame(frame, &size);
+    ok = (data != NULL && desc->ParseFromArray(data, size));
+  } else {
+    SeekToFrame(frame);
+    int size = ReadNextFrameSize();
+    if (size < 0) {
+      return false;
+    }
+    vector<uchar> buffer(size);
+    ReadNextFrame(buffer.empty() ? NULL : &buffer[0]);
+    ok = desc->ParseFromArray(buffer.empty() ? NULL : &buffer[0], size);
+  }
+
+  curr_frame_ = frame + 1;
+  return ok;
+}
+
 } // namespace videoseg
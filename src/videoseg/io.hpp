@@ -51,6 +51,29 @@ namespace videoseg {
 
 class SegmentationDesc;
 
+// A file mapped read-only into memory.
+class MappedFile {
+public:
+  MappedFile() : data_(NULL), size_(0) {}
+  ~MappedFile() { Close(); }
+
+  // Returns false if file could not be opened or is empty.
+  bool Open(const string& filename);
+  void Close();
+
+  bool IsOpen() const { return data_ != NULL; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  const char* data_;
+  size_t size_;
+
+  // Non-copyable.
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+};
+
 // Usage (user supplied variables in caps).
 // SegmentationWriter writer(FILENAME);
 // writer.OpenFile();
@@ -102,6 +125,12 @@ private:
 // Usage (user supplied variables in caps):
 // SegmentationReader reader(FILE_NAME);
 // reader.OpenFileAndReadHeaders();
+// for (int i = 0; i < reader.NumFrames(); ++i) {
+//   reader.ReadFrame(i, &SEGMENTATION);
+//   // Process segmentation...
+// }
+//
+// or, copying each frame into a buffer,
 // while (reader.RemainingFrames()) {
 //   int frame_sz = reader.ReadNextFrameSize();
 //   vector<unsigned char> buffer(frame_sz);
@@ -116,8 +145,12 @@ private:
 
 class SegmentationReader {
 public:
-  SegmentationReader(const string& filename) :
-      curr_frame_(0), filename_(filename) {}
+  // If mapped, the file is mapped into memory and frames are parsed
+  // directly from it instead of being read through a stream.
+  SegmentationReader(const string& filename, bool mapped = false) :
+      frame_sz_(0), curr_frame_(0), filename_(filename), mapped_(mapped) {}
+  // Builds the offset of every frame in the file, so that any frame can be
+  // read without reading those before it.
   bool OpenFileAndReadHeaders();
 
   // Reads and parses first frame, returns resolution, seeks back to current playhead.
@@ -128,14 +161,24 @@ public:
   int ReadNextFrameSize();
   void ReadNextFrame(unsigned char* data);
 
+  // Parses a frame and moves the playhead after it. Reusing the same desc for
+  // each frame avoids reallocating its fields. Returns false if the frame is
+  // malformed.
+  bool ReadFrame(int frame, SegmentationDesc* desc);
+
   const vector<int64_t>& TimeStamps() { return time_stamps_; }
   void SeekToFrame(int frame);
 
   int NumFrames() const { return file_offsets_.size(); }
   int RemainingFrames() const { return NumFrames() - curr_frame_; }
 
-  void CloseFile() { ifs_.close(); }
+  void CloseFile() { ifs_.close(); mapping_.Close(); }
 private:
+  bool ReadHeadersFromStream();
+  bool ReadHeadersFromMapping();
+  // Returns the frame and its size within the mapping, or NULL.
+  const char* MappedFrame(int frame, int* size) const;
+
   vector<int64_t> file_offsets_;
   vector<int64_t> time_stamps_;
 
@@ -143,7 +186,9 @@ private:
   int curr_frame_;
 
   string filename_;
+  bool mapped_;
   std::ifstream ifs_;
+  MappedFile mapping_;
 };
 
 }
@@ -0,0 +1,90 @@
+#include "videoseg/label-runs.hpp"
+#include <algorithm>
+#include <cstring>
+#include <boost/format.hpp>
+
+namespace videoseg {
+
+namespace {
+
+// Raster order of runs.
+bool runBefore(const LabelRun& lhs, const LabelRun& rhs) {
+  if (lhs.y != rhs.y) {
+    return lhs.y < rhs.y;
+  }
+  return lhs.left < rhs.left;
+}
+
+}
+
+void frameToLabelRuns(const VideoSegmentation::Frame& frame,
+                      vector<LabelRun>& runs) {
+  typedef RepeatedPtrField<VideoSegmentation::Frame::Region> RegionList;
+  typedef RepeatedPtrField<ScanInterval> IntervalList;
+  runs.clear();
+
+  const RegionList& regions = frame.regions();
+  RegionList::const_iterator region;
+
+  for (region = regions.begin(); region != regions.end(); ++region) {
+    const IntervalList& intervals = region->raster().scan_inter();
+    IntervalList::const_iterator interval;
+
+    for (interval = intervals.begin(); interval != intervals.end();
+        ++interval) {
+      LabelRun run;
+      run.y = interval->y();
+      run.left = interval->left_x();
+      run.right = interval->right_x();
+      run.label = region->id();
+      runs.push_back(run);
+    }
+  }
+
+  // Each region is already in raster order.
+  std::sort(runs.begin(), runs.end(), runBefore);
+}
+
+int findLabel(const vector<LabelRun>& runs, cv::Point pos) {
+  // Find the last run which starts at or before the pixel.
+  LabelRun key;
+  key.y = pos.y;
+  key.left = pos.x;
+  vector<LabelRun>::const_iterator run = std::upper_bound(runs.begin(),
+      runs.end(), key, runBefore);
+
+  if (run == runs.begin()) {
+    return -1;
+  }
+  --run;
+
+  if (run->y != pos.y || pos.x > run->right) {
+    return -1;
+  }
+  return run->label;
+}
+
+void encodeLabelRuns(const vector<LabelRun>& runs, string& data) {
+  data.resize(runs.size() * sizeof(LabelRun));
+  if (!runs.empty()) {
+    std::memcpy(&data[0], &runs.front(), data.size());
+  }
+}
+
+bool decodeLabelRuns(const string& data, vector<LabelRun>& runs) {
+  if (data.size() % sizeof(LabelRun) != 0) {
+    return false;
+  }
+
+  runs.resize(data.size() / sizeof(LabelRun));
+  if (!runs.empty()) {
+    std::memcpy(&runs.front(), data.data(), data.size());
+  }
+  return true;
+}
+
+string makeLabelRunsKey(int t) {
+  return boost::str(boost::format("%d") % t);
+}
+
+} // namespace videoseg
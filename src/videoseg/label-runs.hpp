@@ -0,0 +1,41 @@
+#ifndef VIDEOSEG_LABEL_RUNS_HPP_
+#define VIDEOSEG_LABEL_RUNS_HPP_
+
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+#include "videoseg/using.hpp"
+#include "videoseg/segmentation.pb.h"
+
+namespace videoseg {
+
+// A run of pixels with one label along a row of a flat segmentation.
+//
+// Each frame is stored as a packed array of runs in raster order, which is
+// the layout in which pixels are queried, so that decoding is one copy and
+// looking up a pixel is one binary search.
+struct LabelRun {
+  int32_t y;
+  int32_t left;
+  int32_t right;
+  int32_t label;
+};
+
+// Outputs the runs of every region of the frame in raster order.
+void frameToLabelRuns(const VideoSegmentation::Frame& frame,
+                      vector<LabelRun>& runs);
+
+// Returns the label of the pixel, or -1 if it is in no run.
+int findLabel(const vector<LabelRun>& runs, cv::Point pos);
+
+// Packs the runs into bytes, for example to store each frame as one entry of
+// a ChunkedArchive. Values are in the byte order of the machine.
+void encodeLabelRuns(const vector<LabelRun>& runs, string& data);
+// Returns false if the data is not a whole number of runs.
+bool decodeLabelRuns(const string& data, vector<LabelRun>& runs);
+
+// Key of the entry of frame t when stored one frame per entry.
+string makeLabelRunsKey(int t);
+
+} // namespace videoseg
+
+#endif
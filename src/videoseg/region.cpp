@@ -1,5 +1,6 @@
 #include "videoseg/region.hpp"
 #include <algorithm>
+#include <stdint.h>
 #include <glog/logging.h>
 
 namespace videoseg {
@@ -34,26 +35,6 @@ struct IntervalBefore {
   }
 };
 
-inline bool intervalBefore(const ScanInterval& lhs, const ScanInterval& rhs) {
-  if (lhs.y() < rhs.y()) {
-    return true;
-  } else if (rhs.y() < lhs.y()) {
-    return false;
-  } else {
-    if (lhs.left_x() < rhs.left_x()) {
-      return true;
-    } else if (rhs.left_x() < lhs.left_x()) {
-      return false;
-    } else {
-      if (lhs.right_x() < rhs.right_x()) {
-        return true;
-      } else {
-        return false;
-      }
-    }
-  }
-}
-
 bool regionContains(const Rasterization& region, cv::Point pos) {
   typedef RepeatedPtrField<ScanInterval> IntervalList;
   const IntervalList& intervals = region.scan_inter();
@@ -64,98 +45,169 @@ bool regionContains(const Rasterization& region, cv::Point pos) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-struct PositionInIntervalList {
+int IntervalArray::size() const {
+  return y.size();
+}
+
+void IntervalArray::clear() {
+  y.clear();
+  left.clear();
+  right.clear();
+}
+
+void IntervalArray::reserve(int n) {
+  y.reserve(n);
+  left.reserve(n);
+  right.reserve(n);
+}
+
+void IntervalArray::push_back(int y, int left, int right) {
+  this->y.push_back(y);
+  this->left.push_back(left);
+  this->right.push_back(right);
+}
+
+void IntervalArray::swap(IntervalArray& other) {
+  y.swap(other.y);
+  left.swap(other.left);
+  right.swap(other.right);
+}
+
+void rasterizationToIntervals(const Rasterization& region,
+                              IntervalArray& intervals) {
   typedef RepeatedPtrField<ScanInterval> IntervalList;
-  // Interval list and a position within that list.
-  const IntervalList* intervals;
+  const IntervalList& list = region.scan_inter();
+
+  intervals.clear();
+  intervals.reserve(list.size());
+
   IntervalList::const_iterator interval;
+  for (interval = list.begin(); interval != list.end(); ++interval) {
+    intervals.push_back(interval->y(), interval->left_x(),
+        interval->right_x());
+  }
+}
 
-  // Ordered by ScanInterval ordering of element under cursor.
-  bool operator<(const PositionInIntervalList& other) const {
-    // Note order is reversed since STL implements a max heap not a min heap.
-    return intervalBefore(*other.interval, *interval);
+void intervalsToRasterization(const IntervalArray& intervals,
+                              Rasterization& region) {
+  RepeatedPtrField<ScanInterval>& list = *region.mutable_scan_inter();
+  int n = intervals.size();
+  list.Reserve(list.size() + n);
+
+  for (int i = 0; i < n; i += 1) {
+    ScanInterval* interval = list.Add();
+    interval->set_y(intervals.y[i]);
+    interval->set_left_x(intervals.left[i]);
+    interval->set_right_x(intervals.right[i]);
   }
+}
 
-  PositionInIntervalList(const IntervalList& intervals)
-      : intervals(&intervals), interval(intervals.begin()) {}
+namespace {
+
+// Position within one of the interval lists being merged.
+struct IntervalCursor {
+  // Row and left end packed so that intervals compare as one integer.
+  int64_t key;
+  int input;
+  int position;
+
+  // Note order is reversed since STL implements a max heap not a min heap.
+  bool operator<(const IntervalCursor& other) const {
+    return other.key < key;
+  }
 
-  static PositionInIntervalList make(const Rasterization* region) {
-    CHECK_GT(region->scan_inter().size(), 0) << "List must be non-empty";
-    return PositionInIntervalList(region->scan_inter());
+  static int64_t makeKey(const IntervalArray& intervals, int i) {
+    // Flip the sign bit so that the left end orders as unsigned.
+    return (int64_t(intervals.y[i]) << 32) |
+        (uint32_t(intervals.left[i]) ^ 0x80000000u);
   }
 };
 
-void mergeRegions(const vector<const Rasterization*>& regions,
-                  Rasterization& result) {
-  typedef RepeatedPtrField<ScanInterval> ScanIntervalList;
+}
+
+void mergeIntervals(const vector<const IntervalArray*>& inputs,
+                    IntervalArray& result) {
+  IntervalArray merged;
+  int total = 0;
 
-  // Construct a priority queue of the regions.
-  typedef vector<PositionInIntervalList> Heap;
-  vector<PositionInIntervalList> heap;
-  std::transform(regions.begin(), regions.end(), std::back_inserter(heap),
-      PositionInIntervalList::make);
+  // Construct a priority queue of the non-empty lists.
+  vector<IntervalCursor> heap;
+  heap.reserve(inputs.size());
+
+  for (int k = 0; k < int(inputs.size()); k += 1) {
+    const IntervalArray& input = *inputs[k];
+    total += input.size();
+
+    if (input.size() > 0) {
+      IntervalCursor cursor;
+      cursor.key = IntervalCursor::makeKey(input, 0);
+      cursor.input = k;
+      cursor.position = 0;
+      heap.push_back(cursor);
+    }
+  }
   std::make_heap(heap.begin(), heap.end());
+  merged.reserve(total);
 
-  ScanIntervalList intervals;
-  ScanInterval interval;
-  bool first = true;
+  // Current interval, not yet added.
+  bool have_interval = false;
+  int y = 0;
+  int left = 0;
+  int right = 0;
 
-  // Merge scan intervals until heap is empty.
   while (!heap.empty()) {
     std::pop_heap(heap.begin(), heap.end());
-    PositionInIntervalList cursor = heap.back();
-    heap.pop_back();
+    IntervalCursor& cursor = heap.back();
+    const IntervalArray& input = *inputs[cursor.input];
+    int i = cursor.position;
 
-    if (!first) {
-      bool touch;
-
-      if (interval.y() != cursor.interval->y()) {
-        // Interval at cursor does not have same y coordinate.
-        touch = false;
-      } else {
-        // Interval at cursor shares same y coordinate.
-        if (interval.right_x() < cursor.interval->left_x() - 1) {
-          // Previous interval ends before new interval begins.
-          touch = false;
-        } else {
-          // Intervals touch.
-          touch = true;
-        }
-      }
-
-      if (touch) {
-        // Merge the two intervals.
-        interval.set_right_x(cursor.interval->right_x());
-      } else {
-        // Add old interval to list and start a new interval.
-        intervals.Add()->Swap(&interval);
-        interval = *cursor.interval;
-      }
+    if (have_interval && input.y[i] == y && input.left[i] <= right + 1) {
+      // Intervals touch. Merge the two.
+      right = std::max(right, input.right[i]);
     } else {
-      // Start a new interval.
-      interval = *cursor.interval;
+      if (have_interval) {
+        merged.push_back(y, left, right);
+      }
+      y = input.y[i];
+      left = input.left[i];
+      right = input.right[i];
+      have_interval = true;
     }
 
     // Advance position in list.
-    ++cursor.interval;
-
-    if (cursor.interval != cursor.intervals->end()) {
-      // More scan lines remain for this region, add cursor back into heap.
-      heap.push_back(cursor);
+    cursor.position += 1;
+    if (cursor.position < input.size()) {
+      cursor.key = IntervalCursor::makeKey(input, cursor.position);
       std::push_heap(heap.begin(), heap.end());
     } else {
-      // Reached end of this cursor.
-      // Check if it was the last region remaining.
-      if (heap.empty()) {
-        // Add last interval to the list.
-        intervals.Add()->Swap(&interval);
-      }
+      heap.pop_back();
     }
+  }
+
+  if (have_interval) {
+    merged.push_back(y, left, right);
+  }
+
+  result.swap(merged);
+}
 
-    first = false;
+void mergeRegions(const vector<const Rasterization*>& regions,
+                  Rasterization& result) {
+  // Convert to packed intervals once at the boundary.
+  vector<IntervalArray> inputs(regions.size());
+  vector<const IntervalArray*> pointers(regions.size());
+
+  for (int k = 0; k < int(regions.size()); k += 1) {
+    rasterizationToIntervals(*regions[k], inputs[k]);
+    pointers[k] = &inputs[k];
   }
 
-  result.mutable_scan_inter()->Swap(&intervals);
+  IntervalArray merged;
+  mergeIntervals(pointers, merged);
+
+  // Constructed in place, on the arena of the result if it has one.
+  result.mutable_scan_inter()->Clear();
+  intervalsToRasterization(merged, result);
 }
 
 }
@@ -13,6 +13,33 @@ bool regionContains(const Rasterization& region, cv::Point pos);
 void mergeRegions(const vector<const Rasterization*>& regions,
                   Rasterization& result);
 
+// Scan intervals of a region as packed arrays, ordered by row and then by left
+// end, so that regions can be merged without a message per interval.
+struct IntervalArray {
+  vector<int> y;
+  vector<int> left;
+  vector<int> right;
+
+  int size() const;
+  void clear();
+  void reserve(int n);
+  void push_back(int y, int left, int right);
+  void swap(IntervalArray& other);
+};
+
+// Replaces the contents of intervals.
+void rasterizationToIntervals(const Rasterization& region,
+                              IntervalArray& intervals);
+
+// Appends the intervals to the region.
+void intervalsToRasterization(const IntervalArray& intervals,
+                              Rasterization& region);
+
+// Merges any number of interval lists, joining intervals in the same row which
+// overlap or touch.
+void mergeIntervals(const vector<const IntervalArray*>& inputs,
+                    IntervalArray& result);
+
 }
 
 #endif
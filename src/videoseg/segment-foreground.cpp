@@ -1,18 +1,23 @@
 #include <iostream>
+#include <algorithm>
 #include <sstream>
-#include <fstream>
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include "videoseg/region.hpp"
 #include "videoseg/draw-region.hpp"
 #include "videoseg/tree.hpp"
 #include "videoseg/segmentation.hpp"
+#include "videoseg/segmentation-stream.hpp"
 #include "util/random-color.hpp"
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
 using namespace videoseg;
 
+DEFINE_int32(max_frames, 0,
+    "Number of frames of regions to keep in memory at once, loaded from the "
+    "over-segmentation when displayed. Zero loads all frames at the start.");
+
 const int FOREGROUND_LABEL = 0;
 const int BACKGROUND_LABEL = 1;
 
@@ -31,10 +36,8 @@ void setPixelOwners(const Rasterization& region,
 
   IntervalList::const_iterator interval;
   for (interval = intervals.begin(); interval != intervals.end(); ++interval) {
-    int i = interval->y();
-    for (int j = interval->left_x(); j <= interval->right_x(); j += 1) {
-      owners(i, j) = vertex;
-    }
+    VertexIndex* row = owners[interval->y()];
+    std::fill(row + interval->left_x(), row + interval->right_x() + 1, vertex);
   }
 }
 
@@ -92,8 +95,7 @@ struct DrawRegion : public VisitRegion {
 };
 
 void drawRegion(VertexIndex index,
-                const SegmentationTree& tree,
-                int t,
+                const FrameRegions& regions,
                 cv::Mat& dst,
                 bool foreground,
                 const cv::Mat& src,
@@ -104,7 +106,7 @@ void drawRegion(VertexIndex index,
   // Function to draw region.
   DrawRegion draw(dst, foreground, src, color, active, preview, owner_map,
       index);
-  visitRegions(index, tree, t, draw);
+  regions.visit(index, draw);
 }
 
 void init(int& argc, char**& argv) {
@@ -129,8 +131,7 @@ void renderFrame(const map<VertexIndex, int>& leaves,
                  bool have_active_leaf,
                  VertexIndex active_leaf,
                  bool preview,
-                 const SegmentationTree& tree,
-                 int t,
+                 const FrameRegions& regions,
                  cv::Mat& display,
                  const ColorMap& colors,
                  const cv::Mat& image,
@@ -147,7 +148,7 @@ void renderFrame(const map<VertexIndex, int>& leaves,
     CHECK(it != colors.end()) << "No color found for vertex";
     cv::Vec3b color = it->second;
 
-    drawRegion(index, tree, t, display, foreground, image, color, selected,
+    drawRegion(index, regions, display, foreground, image, color, selected,
         preview, owners);
   }
 }
@@ -243,8 +244,22 @@ int main(int argc, char** argv) {
   int height;
   SegmentationTree tree;
   VertexIndex root;
-  ok = loadSegmentation(over_seg_file, tree, root, num_frames, width, height);
-  CHECK(ok) << "Could not load segmentation";
+  scoped_ptr<SegmentationFrameCache> frames;
+
+  if (FLAGS_max_frames > 0) {
+    ok = loadSegmentationHierarchy(over_seg_file, tree, root, num_frames, width,
+        height);
+    CHECK(ok) << "Could not load segmentation";
+
+    frames.reset(new SegmentationFrameCache(over_seg_file, tree,
+        FLAGS_max_frames));
+    ok = frames->open();
+    CHECK(ok) << "Could not open segmentation";
+  } else {
+    ok = loadSegmentation(over_seg_file, tree, root, num_frames, width,
+        height);
+    CHECK(ok) << "Could not load segmentation";
+  }
 
   // Current segmentation stored as list of leaves.
   map<VertexIndex, int> leaves;
@@ -269,6 +284,9 @@ int main(int argc, char** argv) {
     }
   }
 
+  // Regions of the displayed frame.
+  FrameRegions regions(tree);
+
   cv::Mat image;
 
   // Display first frame.
@@ -305,8 +323,16 @@ int main(int argc, char** argv) {
       need_to_read_image = false;
     }
 
+    if (regions.frame() != t) {
+      if (frames) {
+        ok = frames->require(t);
+        CHECK(ok) << "Could not load regions of frame " << t;
+      }
+      regions.setFrame(t);
+    }
+
     // Show image.
-    renderFrame(leaves, have_active_leaf, active_leaf, preview, tree, t,
+    renderFrame(leaves, have_active_leaf, active_leaf, preview, regions,
         display, colors, image, owners);
     cv::imshow(WINDOW_NAME, display);
 
@@ -371,14 +397,19 @@ int main(int argc, char** argv) {
     }
   }
 
-  LOG(INFO) << "Flattening segmentation...";
-  VideoSegmentation foreground_seg;
-  flattenHierarchicalSegmentation(tree, leaves, 2, num_frames, foreground_seg);
-
-  LOG(INFO) << "Saving segmentation...";
-  std::ofstream ofs(foreground_seg_file.c_str(),
-      std::ios::out | std::ios::trunc | std::ios::binary);
-  ok = foreground_seg.SerializeToOstream(&ofs);
+  LOG(INFO) << "Flattening and saving segmentation...";
+  // Frames are written as they are flattened.
+  VideoSegmentationStreamWriter writer;
+  ok = writer.open(foreground_seg_file);
+  CHECK(ok) << "Could not open output";
+
+  if (frames) {
+    flattenHierarchicalSegmentation(tree, leaves, 2, num_frames, *frames,
+        writer);
+  } else {
+    flattenHierarchicalSegmentation(tree, leaves, 2, num_frames, writer);
+  }
+  ok = writer.close();
   CHECK(ok) << "Could not save output";
 
   return 0;
@@ -0,0 +1,106 @@
+#include "videoseg/segmentation-stream.hpp"
+#include <algorithm>
+#include <climits>
+#include <glog/logging.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/wire_format_lite.h>
+
+using google::protobuf::uint8;
+using google::protobuf::uint32;
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::StringOutputStream;
+using google::protobuf::internal::WireFormatLite;
+
+namespace videoseg {
+
+namespace {
+
+// Tag of each element of VideoSegmentation::frames.
+const uint32 FRAME_TAG = WireFormatLite::MakeTag(
+    VideoSegmentation::kFramesFieldNumber,
+    WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+
+}
+
+VideoSegmentationStreamWriter::VideoSegmentationStreamWriter()
+    : stream_(), buffer_() {}
+
+bool VideoSegmentationStreamWriter::open(const string& filename) {
+  stream_.open(filename.c_str(), std::ios::trunc | std::ios::binary);
+  return stream_.good();
+}
+
+bool VideoSegmentationStreamWriter::close() {
+  // Frames which are still buffered are written now.
+  stream_.close();
+  return !stream_.fail();
+}
+
+bool VideoSegmentationStreamWriter::write(
+    const VideoSegmentation::Frame& frame) {
+  buffer_.clear();
+  {
+    StringOutputStream output(&buffer_);
+    CodedOutputStream coded(&output);
+    coded.WriteTag(FRAME_TAG);
+    coded.WriteVarint32(frame.ByteSize());
+    frame.SerializeWithCachedSizes(&coded);
+    if (coded.HadError()) {
+      return false;
+    }
+  }
+
+  stream_.write(buffer_.data(), buffer_.size());
+  return stream_.good();
+}
+
+VideoSegmentationStreamReader::VideoSegmentationStreamReader()
+    : file_(), offset_(0) {}
+
+bool VideoSegmentationStreamReader::open(const string& filename) {
+  offset_ = 0;
+  return file_.Open(filename);
+}
+
+void VideoSegmentationStreamReader::close() {
+  file_.Close();
+  offset_ = 0;
+}
+
+bool VideoSegmentationStreamReader::read(VideoSegmentation::Frame& frame) {
+  CHECK(file_.IsOpen()) << "File is not open";
+
+  if (offset_ >= file_.size()) {
+    // Reached end.
+    return false;
+  }
+
+  // A new coded stream per frame avoids its limit on the total size, and on
+  // the size of the array.
+  size_t remaining = std::min(file_.size() - offset_, size_t(INT_MAX));
+  CodedInputStream coded(
+      reinterpret_cast<const uint8*>(file_.data() + offset_), remaining);
+
+  uint32 tag = coded.ReadTag();
+  if (tag != FRAME_TAG) {
+    LOG(WARNING) << "Unexpected field in segmentation (tag " << tag << ")";
+    return false;
+  }
+
+  uint32 size;
+  if (!coded.ReadVarint32(&size)) {
+    return false;
+  }
+
+  CodedInputStream::Limit limit = coded.PushLimit(size);
+  bool ok = frame.ParseFromCodedStream(&coded) &&
+            coded.ConsumedEntireMessage();
+  coded.PopLimit(limit);
+
+  offset_ += coded.CurrentPosition();
+  return ok;
+}
+
+} // namespace videoseg
@@ -0,0 +1,55 @@
+#ifndef VIDEOSEG_SEGMENTATION_STREAM_HPP_
+#define VIDEOSEG_SEGMENTATION_STREAM_HPP_
+
+#include <fstream>
+#include "videoseg/using.hpp"
+#include "videoseg/segmentation.pb.h"
+#include "videoseg/io.hpp"
+
+namespace videoseg {
+
+// Writes the frames of a flat segmentation one at a time, as they are
+// completed.
+//
+// Each frame is written as the encoding of one element of
+// VideoSegmentation::frames, which is a length-delimited Frame message preceded
+// by its field tag. The file is therefore also a valid serialized
+// VideoSegmentation at every frame boundary.
+class VideoSegmentationStreamWriter {
+  public:
+    VideoSegmentationStreamWriter();
+
+    bool open(const string& filename);
+    // Returns false if the buffered frames could not be written.
+    bool close();
+
+    // Appends a frame to the file.
+    bool write(const VideoSegmentation::Frame& frame);
+
+  private:
+    std::ofstream stream_;
+    string buffer_;
+};
+
+// Reads the frames of a flat segmentation one at a time, parsing each directly
+// from the mapped file. Works for files written by
+// VideoSegmentationStreamWriter or by serializing a whole VideoSegmentation.
+class VideoSegmentationStreamReader {
+  public:
+    VideoSegmentationStreamReader();
+
+    bool open(const string& filename);
+    void close();
+
+    // Returns false at the end of the file or if a frame could not be parsed.
+    bool read(VideoSegmentation::Frame& frame);
+
+  private:
+    MappedFile file_;
+    // Position of the next frame in the file.
+    size_t offset_;
+};
+
+} // namespace videoseg
+
+#endif
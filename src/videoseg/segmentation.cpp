@@ -1,5 +1,6 @@
 #include "videoseg/segmentation.hpp"
 #include "videoseg/region.hpp"
+#include "videoseg/segmentation-stream.hpp"
 #include <glog/logging.h>
 
 namespace videoseg {
@@ -17,66 +18,113 @@ struct GetDescendantRegions : public VisitRegion {
   GetDescendantRegions(RegionList& regions) : regions(&regions) {}
 };
 
-void getDescendantRegions(VertexIndex index,
-                          const SegmentationTree& tree,
-                          int t,
-                          vector<const Rasterization*>& regions) {
-  GetDescendantRegions get_descendants(regions);
-  visitRegions(index, tree, t, get_descendants);
+// Flattens the current frame of the regions.
+void flattenFrame(const FrameRegions& frame_regions,
+                  const map<VertexIndex, int>& leaves,
+                  int num_labels,
+                  VideoSegmentation::Frame& frame) {
+  typedef vector<const Rasterization*> RegionList;
+  deque<RegionList> region_lists(num_labels);
+
+  // Iterate through leaves to get list of regions belonging to each label.
+  map<VertexIndex, int>::const_iterator leaf;
+  for (leaf = leaves.begin(); leaf != leaves.end(); ++leaf) {
+    VertexIndex index = leaf->first;
+    int label = leaf->second;
+    CHECK(0 <= label && label < num_labels) << "Label out of range";
+
+    GetDescendantRegions get_descendants(region_lists.at(label));
+    frame_regions.visit(index, get_descendants);
+  }
+
+  int label = 0;
+
+  // Iterate through regions.
+  deque<RegionList>::const_iterator region_list;
+  for (region_list = region_lists.begin();
+      region_list != region_lists.end();
+      ++region_list) {
+    // Merge regions into a new region with an ID.
+    VideoSegmentation::Frame::Region* region = frame.add_regions();
+    region->set_id(label);
+    mergeRegions(*region_list, *region->mutable_raster());
+
+    // Keep region only if non-empty.
+    if (region->raster().scan_inter().size() == 0) {
+      frame.mutable_regions()->RemoveLast();
+    }
+
+    label += 1;
+  }
 }
 
+// Flattens every frame into either a message or a stream.
 void flattenHierarchicalSegmentation(const SegmentationTree& tree,
                                      const map<VertexIndex, int>& leaves,
                                      int num_labels,
                                      int num_frames,
-                                     VideoSegmentation& segmentation) {
-  typedef vector<const Rasterization*> RegionList;
+                                     SegmentationFrameCache* frames,
+                                     VideoSegmentation* segmentation,
+                                     VideoSegmentationStreamWriter* writer) {
+  FrameRegions frame_regions(tree);
 
   for (int t = 0; t < num_frames; t += 1) {
-    deque<RegionList> region_lists(num_labels);
-
-    // Iterate through leaves to get list of regions belonging to each label.
-    map<VertexIndex, int>::const_iterator leaf;
-    for (leaf = leaves.begin(); leaf != leaves.end(); ++leaf) {
-      VertexIndex index = leaf->first;
-      int label = leaf->second;
-      CHECK(0 <= label && label < num_labels) << "Label out of range";
-
-      getDescendantRegions(index, tree, t, region_lists.at(label));
+    if (frames != NULL) {
+      bool ok = frames->require(t);
+      CHECK(ok) << "Could not load regions of frame " << t;
     }
-
-    RepeatedPtrField<VideoSegmentation::Frame::Region> regions;
-    int label = 0;
-
-    // Iterate through regions.
-    deque<RegionList>::const_iterator region_list;
-    for (region_list = region_lists.begin();
-        region_list != region_lists.end();
-        ++region_list) {
-      // Merge regions and add to list.
-      Rasterization rasterization;
-      mergeRegions(*region_list, rasterization);
-
-      // Add region if non-empty.
-      if (rasterization.scan_inter().size() > 0) {
-        // Create a region with an ID.
-        VideoSegmentation::Frame::Region region;
-        region.set_id(label);
-        region.mutable_raster()->Swap(&rasterization);
-        // Add to list.
-        regions.Add()->Swap(&region);
-      }
-
-      label += 1;
+    frame_regions.setFrame(t);
+
+    if (segmentation != NULL) {
+      // Constructed in place, on the arena of the segmentation if it has one.
+      flattenFrame(frame_regions, leaves, num_labels,
+          *segmentation->add_frames());
+    } else {
+      // Only one frame is in memory at a time.
+      VideoSegmentation::Frame frame;
+      flattenFrame(frame_regions, leaves, num_labels, frame);
+      bool ok = writer->write(frame);
+      CHECK(ok) << "Could not write frame " << t;
     }
+  }
+}
 
-    // Put list of regions into an image segmentation.
-    VideoSegmentation::Frame frame;
-    frame.mutable_regions()->Swap(&regions);
+void flattenHierarchicalSegmentation(const SegmentationTree& tree,
+                                     const map<VertexIndex, int>& leaves,
+                                     int num_labels,
+                                     int num_frames,
+                                     VideoSegmentation& segmentation) {
+  flattenHierarchicalSegmentation(tree, leaves, num_labels, num_frames, NULL,
+      &segmentation, NULL);
+}
 
-    // Add ImageSegmentation to VideoSegmentation.
-    segmentation.mutable_frames()->Add()->Swap(&frame);
-  }
+void flattenHierarchicalSegmentation(const SegmentationTree& tree,
+                                     const map<VertexIndex, int>& leaves,
+                                     int num_labels,
+                                     int num_frames,
+                                     SegmentationFrameCache& frames,
+                                     VideoSegmentation& segmentation) {
+  flattenHierarchicalSegmentation(tree, leaves, num_labels, num_frames,
+      &frames, &segmentation, NULL);
+}
+
+void flattenHierarchicalSegmentation(const SegmentationTree& tree,
+                                     const map<VertexIndex, int>& leaves,
+                                     int num_labels,
+                                     int num_frames,
+                                     VideoSegmentationStreamWriter& writer) {
+  flattenHierarchicalSegmentation(tree, leaves, num_labels, num_frames, NULL,
+      NULL, &writer);
+}
+
+void flattenHierarchicalSegmentation(const SegmentationTree& tree,
+                                     const map<VertexIndex, int>& leaves,
+                                     int num_labels,
+                                     int num_frames,
+                                     SegmentationFrameCache& frames,
+                                     VideoSegmentationStreamWriter& writer) {
+  flattenHierarchicalSegmentation(tree, leaves, num_labels, num_frames,
+      &frames, NULL, &writer);
 }
 
 }
@@ -22,6 +22,30 @@ void flattenHierarchicalSegmentation(const SegmentationTree& tree,
                                      int num_labels,
                                      int num_frames,
                                      VideoSegmentation& flat);
+// Requires each frame from a cache before flattening it, for a tree loaded by
+// loadSegmentationHierarchy().
+void flattenHierarchicalSegmentation(const SegmentationTree& tree,
+                                     const map<VertexIndex, int>& leaves,
+                                     int num_labels,
+                                     int num_frames,
+                                     SegmentationFrameCache& frames,
+                                     VideoSegmentation& flat);
+
+class VideoSegmentationStreamWriter;
+
+// Same as above, writing each frame as soon as it is flattened so that only
+// one is in memory at a time.
+void flattenHierarchicalSegmentation(const SegmentationTree& tree,
+                                     const map<VertexIndex, int>& leaves,
+                                     int num_labels,
+                                     int num_frames,
+                                     VideoSegmentationStreamWriter& writer);
+void flattenHierarchicalSegmentation(const SegmentationTree& tree,
+                                     const map<VertexIndex, int>& leaves,
+                                     int num_labels,
+                                     int num_frames,
+                                     SegmentationFrameCache& frames,
+                                     VideoSegmentationStreamWriter& writer);
 
 }
 
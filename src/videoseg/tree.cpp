@@ -86,6 +86,7 @@ void addToHierarchy(SegmentationTree& tree,
         if (level == 0) {
           // Create leaf node.
           tree[vertex].setIsLeaf(true);
+          tree[vertex].leaf().id = id;
         } else {
           // Create non-leaf node.
           tree[vertex].setIsLeaf(false);
@@ -172,28 +173,61 @@ void addToHierarchy(SegmentationTree& tree,
   }
 }
 
-// Loads the full hierarchy from a sequence.
-void loadHierarchy(SegmentationTree& tree,
-                   VertexIndex& root,
-                   VertexMapList& lookups,
-                   SegmentationReader& reader) {
+// Loads the full hierarchy from a sequence, reading each frame once. The
+// regions of the leaves are copied into the tree only if load_regions is set.
+void loadTree(SegmentationTree& tree,
+              VertexIndex& root,
+              SegmentationReader& reader,
+              bool load_regions) {
+  typedef RepeatedPtrField<Region2D> RegionList;
+
   // Keep track of top nodes in an ordered list (for finding and removing).
   // Come back and create single root node at the end.
   set<VertexIndex> roots;
+  // A vertex lookup for each level of the hierarchy.
+  VertexMapList lookups;
+  // Frames in which each leaf appears. Interior nodes are given these frames
+  // once the hierarchy is complete, since later frames may re-parent roots.
+  map<VertexIndex, vector<int> > leaf_frames;
+
+  // Each frame is parsed onto the arena, which is reset for the next.
+  Arena arena;
 
-  // Read hierarchy.
   for (int t = 0; t < reader.NumFrames(); t += 1) {
-    // Load segmentation of next frame from file.
-    SegmentationDesc segmentation;
-    vector<unsigned char> buffer(reader.ReadNextFrameSize());
-    reader.ReadNextFrame(&buffer[0]);
-    segmentation.ParseFromArray(&buffer[0], buffer.size());
+    // Load segmentation of frame from file.
+    arena.Reset();
+    SegmentationDesc& segmentation =
+        *Arena::CreateMessage<SegmentationDesc>(&arena);
+    bool ok = reader.ReadFrame(t, &segmentation);
+    CHECK(ok) << "Could not parse segmentation of frame " << t;
 
     // Has hierarchy changed? (or first frame)
     if (t == segmentation.hierarchy_frame_idx()) {
       LOG(INFO) << "Updating hierarchy at frame " << t;
       addToHierarchy(tree, roots, lookups, segmentation.hierarchy());
     }
+
+    // Iterate through regions in this frame.
+    const RegionList& regions = segmentation.region();
+    RegionList::const_iterator region;
+
+    for (region = regions.begin(); region != regions.end(); ++region) {
+      CHECK(!lookups.empty()) << "Region in frame " << t <<
+          " precedes hierarchy";
+      const VertexMap& leaf_lookup = lookups.front();
+
+      // Find node.
+      VertexMap::const_iterator it = leaf_lookup.find(region->id());
+      CHECK(it != leaf_lookup.end()) << "Could not find leaf node in tree";
+      VertexIndex index = it->second;
+      leaf_frames[index].push_back(t);
+
+      if (load_regions) {
+        // Copy region into tree.
+        VideoRegion::FrameList& frames = tree[index].leaf().region.frames();
+        frames[t] = region->raster();
+      }
+    }
   }
 
   if (boost::num_vertices(tree) > 0) {
@@ -216,57 +250,21 @@ void loadHierarchy(SegmentationTree& tree,
   } else {
     LOG(WARNING) << "Tree is empty";
   }
-}
-
-// Fills in a full hierarchy with regions.
-void loadRegions(SegmentationTree& tree,
-                 VertexIndex root,
-                 const VertexMap& leaf_lookup,
-                 SegmentationReader& reader) {
-  typedef RepeatedPtrField<Region2D> RegionList;
 
-  for (int t = 0; t < reader.NumFrames(); t += 1) {
-    // Load segmentation of next frame from file.
-    SegmentationDesc segmentation;
-    vector<unsigned char> buffer(reader.ReadNextFrameSize());
-    reader.ReadNextFrame(&buffer[0]);
-    segmentation.ParseFromArray(&buffer[0], buffer.size());
+  // Step up hierarchy from each leaf to ensure that frame sets are correct.
+  map<VertexIndex, vector<int> >::const_iterator leaf;
 
-    // Iterate through regions in this frame.
-    const RegionList& regions = segmentation.region();
-    RegionList::const_iterator region;
-
-    for (region = regions.begin(); region != regions.end(); ++region) {
-      // Find element in first level.
-      int id = region->id();
-
-      // Find node.
-      VertexMap::const_iterator it = leaf_lookup.find(id);
-      CHECK(it != leaf_lookup.end()) << "Could not find leaf node in tree";
-      VertexIndex index = it->second;
-      SegmentationNode& node = tree[index];
+  for (leaf = leaf_frames.begin(); leaf != leaf_frames.end(); ++leaf) {
+    const vector<int>& frames = leaf->second;
+    VertexIndex index = leaf->first;
 
-      // Copy region into tree.
-      VideoRegion::FrameList& frames = node.leaf().region.frames();
-      frames[t] = region->raster();
+    while (boost::in_degree(index, tree) > 0) {
+      // Get parent.
+      SegmentationTree::in_edge_iterator edge;
+      boost::tie(edge, boost::tuples::ignore) = boost::in_edges(index, tree);
+      index = boost::source(*edge, tree);
 
-      // Now step up hierarchy to ensure that frame sets are correct.
-      bool reached_root = false;
-
-      while (!reached_root) {
-        if (boost::in_degree(index, tree) == 0) {
-          reached_root = true;
-        } else {
-          // Get parent.
-          SegmentationTree::in_edge_iterator edge;
-          boost::tie(edge, boost::tuples::ignore) = boost::in_edges(index,
-              tree);
-          index = boost::source(*edge, tree);
-
-          // Ensure that frame is in set.
-          tree[index].interior().frames.insert(t);
-        }
-      }
+      tree[index].interior().frames.insert(frames.begin(), frames.end());
     }
   }
 }
@@ -276,9 +274,10 @@ bool loadSegmentation(const string& filename,
                       VertexIndex& root,
                       int& num_frames,
                       int& width,
-                      int& height) {
+                      int& height,
+                      bool load_regions) {
   // Read segmentation file.
-  SegmentationReader reader(filename);
+  SegmentationReader reader(filename, true);
   bool ok = reader.OpenFileAndReadHeaders();
   if (!ok) {
     LOG(WARNING) << "Could not read headers from \"" << filename << "\"";
@@ -288,29 +287,141 @@ bool loadSegmentation(const string& filename,
   num_frames = reader.NumFrames();
   LOG(INFO) << "Contains " << num_frames << " frames";
 
-  // Load segmentation of next frame from file.
+  // Load segmentation of first frame from file.
   SegmentationDesc segmentation;
-  vector<unsigned char> buffer(reader.ReadNextFrameSize());
-  reader.ReadNextFrame(&buffer[0]);
-  segmentation.ParseFromArray(&buffer[0], buffer.size());
+  ok = reader.ReadFrame(0, &segmentation);
+  if (!ok) {
+    LOG(WARNING) << "Could not parse first frame of \"" << filename << "\"";
+    return false;
+  }
 
   width = segmentation.frame_width();
   height = segmentation.frame_height();
 
-  // A vertex lookup for each level of the hierarchy.
-  VertexMapList lookups;
+  LOG(INFO) << "Loading hierarchy" << (load_regions ? " and regions" : "") <<
+      "...";
+  loadTree(tree, root, reader, load_regions);
+
+  return true;
+}
+
+bool loadSegmentation(const string& filename,
+                      SegmentationTree& tree,
+                      VertexIndex& root,
+                      int& num_frames,
+                      int& width,
+                      int& height) {
+  return loadSegmentation(filename, tree, root, num_frames, width, height,
+      true);
+}
+
+bool loadSegmentationHierarchy(const string& filename,
+                               SegmentationTree& tree,
+                               VertexIndex& root,
+                               int& num_frames,
+                               int& width,
+                               int& height) {
+  return loadSegmentation(filename, tree, root, num_frames, width, height,
+      false);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SegmentationFrameCache
+
+SegmentationFrameCache::SegmentationFrameCache(const string& filename,
+                                               SegmentationTree& tree,
+                                               int max_frames)
+    : reader_(new SegmentationReader(filename, true)),
+      tree_(&tree),
+      max_frames_(max_frames),
+      leaves_(),
+      frames_(),
+      frame_leaves_() {
+  CHECK(max_frames > 0) << "Must keep at least one frame";
+}
+
+SegmentationFrameCache::~SegmentationFrameCache() {}
+
+bool SegmentationFrameCache::open() {
+  bool ok = reader_->OpenFileAndReadHeaders();
+  if (!ok) {
+    return false;
+  }
 
-  LOG(INFO) << "Loading hierarchy...";
-  reader.SeekToFrame(0);
-  loadHierarchy(tree, root, lookups, reader);
+  // Index the leaves by region ID.
+  leaves_.clear();
+  SegmentationTree::vertex_iterator vertex;
+  SegmentationTree::vertex_iterator end;
+  boost::tie(vertex, end) = boost::vertices(*tree_);
 
-  LOG(INFO) << "Loading regions...";
-  reader.SeekToFrame(0);
-  loadRegions(tree, root, lookups.front(), reader);
+  for (; vertex != end; ++vertex) {
+    const SegmentationNode& node = (*tree_)[*vertex];
+    if (node.isLeaf()) {
+      leaves_[node.leaf().id] = *vertex;
+    }
+  }
 
   return true;
 }
 
+bool SegmentationFrameCache::require(int t) {
+  typedef RepeatedPtrField<Region2D> RegionList;
+
+  list<int>::iterator frame = std::find(frames_.begin(), frames_.end(), t);
+  if (frame != frames_.end()) {
+    // Already loaded. Mark as most recently used.
+    frames_.splice(frames_.begin(), frames_, frame);
+    return true;
+  }
+
+  Arena arena;
+  SegmentationDesc& segmentation =
+      *Arena::CreateMessage<SegmentationDesc>(&arena);
+  bool ok = reader_->ReadFrame(t, &segmentation);
+  if (!ok) {
+    LOG(WARNING) << "Could not parse segmentation of frame " << t;
+    return false;
+  }
+
+  // Make room for the new frame.
+  while (int(frames_.size()) >= max_frames_) {
+    unload(frames_.back());
+    frames_.pop_back();
+  }
+
+  vector<VertexIndex>& leaves = frame_leaves_[t];
+  const RegionList& regions = segmentation.region();
+  RegionList::const_iterator region;
+
+  for (region = regions.begin(); region != regions.end(); ++region) {
+    map<int, VertexIndex>::const_iterator it = leaves_.find(region->id());
+    CHECK(it != leaves_.end()) << "Could not find leaf node in tree";
+
+    // Copy region into tree.
+    VideoRegion::FrameList& frames =
+        (*tree_)[it->second].leaf().region.frames();
+    frames[t] = region->raster();
+    leaves.push_back(it->second);
+  }
+
+  frames_.push_front(t);
+  return true;
+}
+
+void SegmentationFrameCache::unload(int t) {
+  map<int, vector<VertexIndex> >::iterator it = frame_leaves_.find(t);
+  CHECK(it != frame_leaves_.end());
+
+  const vector<VertexIndex>& leaves = it->second;
+  vector<VertexIndex>::const_iterator leaf;
+
+  for (leaf = leaves.begin(); leaf != leaves.end(); ++leaf) {
+    (*tree_)[*leaf].leaf().region.frames().erase(t);
+  }
+
+  frame_leaves_.erase(it);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // visitRegions
 
@@ -384,4 +495,86 @@ void visitRegions(VertexIndex index,
       color_property_map, terminator);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// FrameRegions
+
+bool FrameRegions::Region::operator<(int other) const {
+  return number < other;
+}
+
+FrameRegions::FrameRegions(const SegmentationTree& tree)
+    : tree_(&tree), t_(-1), leaves_(), ranges_(), regions_() {
+  SegmentationTree::vertex_iterator vertex;
+  SegmentationTree::vertex_iterator end;
+  boost::tie(vertex, end) = boost::vertices(tree);
+  int next = 0;
+
+  for (; vertex != end; ++vertex) {
+    if (boost::in_degree(*vertex, tree) == 0) {
+      next = numberLeaves(*vertex, next);
+    }
+  }
+}
+
+int FrameRegions::numberLeaves(VertexIndex index, int next) {
+  int first = next;
+
+  if ((*tree_)[index].isLeaf()) {
+    leaves_.push_back(index);
+    next += 1;
+  } else {
+    SegmentationTree::out_edge_iterator edge;
+    SegmentationTree::out_edge_iterator end;
+    boost::tie(edge, end) = boost::out_edges(index, *tree_);
+
+    for (; edge != end; ++edge) {
+      next = numberLeaves(boost::target(*edge, *tree_), next);
+    }
+  }
+
+  ranges_[index] = Range(first, next);
+  return next;
+}
+
+void FrameRegions::setFrame(int t) {
+  t_ = t;
+  regions_.clear();
+
+  int number = 0;
+  vector<VertexIndex>::const_iterator leaf;
+
+  for (leaf = leaves_.begin(); leaf != leaves_.end(); ++leaf) {
+    const VideoRegion::FrameList& frames =
+        (*tree_)[*leaf].leaf().region.frames();
+    VideoRegion::FrameList::const_iterator frame = frames.find(t);
+
+    if (frame != frames.end()) {
+      Region region;
+      region.number = number;
+      region.leaf = *leaf;
+      region.region = &frame->second;
+      regions_.push_back(region);
+    }
+
+    number += 1;
+  }
+}
+
+int FrameRegions::frame() const {
+  return t_;
+}
+
+void FrameRegions::visit(VertexIndex index, VisitRegion& function) const {
+  map<VertexIndex, Range>::const_iterator range = ranges_.find(index);
+  CHECK(range != ranges_.end()) << "Node not in tree";
+
+  vector<Region>::const_iterator region = std::lower_bound(regions_.begin(),
+      regions_.end(), range->second.first);
+
+  for (; region != regions_.end() && region->number < range->second.second;
+      ++region) {
+    function(region->leaf, *region->region);
+  }
+}
+
 }
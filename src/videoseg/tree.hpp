@@ -16,6 +16,8 @@ class SegmentationNode {
     };
 
     struct Leaf {
+      // ID of the region in the segmentation file.
+      int id;
       VideoRegion region;
     };
 
@@ -47,6 +49,8 @@ typedef boost::adjacency_list<boost::setS,
 
 typedef SegmentationTree::vertex_descriptor VertexIndex;
 
+class SegmentationReader;
+
 // Load segmentation from file.
 bool loadSegmentation(const string& filename,
                       SegmentationTree& tree,
@@ -55,6 +59,59 @@ bool loadSegmentation(const string& filename,
                       int& width,
                       int& height);
 
+// Loads only the hierarchy and the frames spanned by each interior node. The
+// regions of the leaves are loaded by a SegmentationFrameCache when needed.
+bool loadSegmentationHierarchy(const string& filename,
+                               SegmentationTree& tree,
+                               VertexIndex& root,
+                               int& num_frames,
+                               int& width,
+                               int& height);
+
+// Keeps the regions of the most recently used frames in the leaves of a tree
+// from loadSegmentationHierarchy(), parsing each frame from the mapped file
+// when it is first required. Memory is bounded by the number of frames kept,
+// however long the video.
+//
+// Usage:
+// SegmentationFrameCache frames(filename, tree, max_frames);
+// frames.open();
+// frames.require(t);
+// visitRegions(root, tree, t, function);
+class SegmentationFrameCache {
+  public:
+    // The tree must outlive the cache.
+    SegmentationFrameCache(const string& filename,
+                           SegmentationTree& tree,
+                           int max_frames);
+    ~SegmentationFrameCache();
+
+    // Returns false if the file could not be opened.
+    bool open();
+
+    // Loads the regions of frame t into the leaves if they are not already,
+    // removing those of the least recently required frame if the cache is
+    // full. Returns false if the frame could not be read.
+    bool require(int t);
+
+  private:
+    void unload(int t);
+
+    scoped_ptr<SegmentationReader> reader_;
+    SegmentationTree* tree_;
+    int max_frames_;
+    // Leaf with each region ID.
+    map<int, VertexIndex> leaves_;
+    // Loaded frames, most recently required first.
+    list<int> frames_;
+    // Leaves with a region in each loaded frame.
+    map<int, vector<VertexIndex> > frame_leaves_;
+
+    // Non-copyable.
+    SegmentationFrameCache(const SegmentationFrameCache&);
+    SegmentationFrameCache& operator=(const SegmentationFrameCache&);
+};
+
 // Functor interface for performing an operation on a region.
 class VisitRegion {
   public:
@@ -64,12 +121,62 @@ class VisitRegion {
 };
 
 // Method for visiting all regions which belong to descendants of a node and
-// appear in frame t.
+// appear in frame t. If the regions are loaded lazily, frame t must have been
+// required.
 void visitRegions(VertexIndex index,
                   const SegmentationTree& tree,
                   int t,
                   VisitRegion& function);
 
+// The regions which appear in one frame, in an order such that those below
+// any node are contiguous. Built once per frame by a pass over the leaves, so
+// that visiting the regions below many nodes costs a search per node rather
+// than a traversal of the tree.
+//
+// Usage:
+// FrameRegions regions(tree);
+// regions.setFrame(t);
+// regions.visit(index, function);
+class FrameRegions {
+  public:
+    // Numbers the leaves below every root in depth-first order. The tree must
+    // outlive this and its shape must not change.
+    explicit FrameRegions(const SegmentationTree& tree);
+
+    // Collects the regions of frame t. If the regions are loaded lazily,
+    // frame t must have been required, and they remain valid only until it is
+    // unloaded.
+    void setFrame(int t);
+    // Returns -1 before the first frame is set.
+    int frame() const;
+
+    // Same as visitRegions(index, tree, frame(), function).
+    void visit(VertexIndex index, VisitRegion& function) const;
+
+  private:
+    typedef std::pair<int, int> Range;
+
+    struct Region {
+      // Depth-first number of the leaf.
+      int number;
+      VertexIndex leaf;
+      const Rasterization* region;
+
+      bool operator<(int other) const;
+    };
+
+    int numberLeaves(VertexIndex index, int next);
+
+    const SegmentationTree* tree_;
+    int t_;
+    // Leaves in depth-first order.
+    vector<VertexIndex> leaves_;
+    // Numbers of the first leaf below each node and one past its last.
+    map<VertexIndex, Range> ranges_;
+    // Regions present in the current frame, ordered by number.
+    vector<Region> regions_;
+};
+
 } // namespace videoseg
 
 #include "videoseg/tree.inl"
@@ -9,6 +9,7 @@
 #include <utility>
 #include <boost/unordered_map.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <google/protobuf/arena.h>
 #include <google/protobuf/repeated_field.h>
 #include <string>
 
@@ -22,6 +23,7 @@ using std::map;
 using std::pair;
 using boost::unordered_map;
 using boost::scoped_ptr;
+using google::protobuf::Arena;
 using google::protobuf::RepeatedField;
 using google::protobuf::RepeatedPtrField;
 using std::string;
@@ -1,17 +1,20 @@
 #include "videoseg/using.hpp"
 #include <sstream>
-#include <fstream>
 #include <opencv2/highgui/highgui.hpp>
 #include <glog/logging.h>
 #include <gflags/gflags.h>
 #include <boost/format.hpp>
 #include "videoseg/segmentation.hpp"
 #include "videoseg/draw-region.hpp"
+#include "videoseg/segmentation-stream.hpp"
+#include "util/thread-pool.hpp"
 
 using namespace videoseg;
 
 DEFINE_bool(display, true, "Show segmentation in window");
 DEFINE_string(save, "", "Directory to save frames to, ignored if empty");
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads to draw each frame with, 0 to draw serially");
 
 const int FOREGROUND_LABEL = 0;
 const int BACKGROUND_LABEL = 1;
@@ -20,10 +23,11 @@ string makeFilename(const string& format, int n) {
   return boost::str(boost::format(format) % n);
 }
 
-void visualizeSegmentation(const VideoSegmentation& segmentation,
+void visualizeSegmentation(VideoSegmentationStreamReader& segmentation,
                            cv::VideoCapture& capture,
                            bool display,
-                           const string& save) {
+                           const string& save,
+                           ThreadPool& pool) {
   typedef map<int, cv::Vec3b> ColorMap;
   ColorMap colors;
 
@@ -32,16 +36,15 @@ void visualizeSegmentation(const VideoSegmentation& segmentation,
   int n = 0;
   bool first = true;
 
-  typedef RepeatedPtrField<VideoSegmentation::Frame> FrameList;
-  const FrameList& frames = segmentation.frames();
-  FrameList::const_iterator frame = frames.begin();
-
   // Memory that is re-used every loop.
   cv::Mat image;
   cv::Mat visualization;
+  // Only the current frame of the segmentation is in memory.
+  VideoSegmentation::Frame frame;
+  vector<RegionDrawing> drawings;
 
   // Read frames of video.
-  while (!end && frame != frames.end()) {
+  while (!end && segmentation.read(frame)) {
     // Read next frame.
     bool ok = capture.read(image);
     if (!ok) {
@@ -52,21 +55,20 @@ void visualizeSegmentation(const VideoSegmentation& segmentation,
 
     visualization.create(image.size(), cv::DataType<cv::Vec3b>::type);
 
-    // Render each region.
+    // Render every region at once.
     typedef RepeatedPtrField<VideoSegmentation::Frame::Region> RegionList;
-    const RegionList& regions = frame->regions();
+    const RegionList& regions = frame.regions();
 
+    drawings.clear();
     RegionList::const_iterator region;
     for (region = regions.begin(); region != regions.end(); ++region) {
-      // Function to draw region.
       bool foreground = (region->id() == FOREGROUND_LABEL);
-
-      if (foreground) {
-        copyRegion(region->raster(), image, visualization);
-      } else {
-        fillRegion(region->raster(), visualization, cv::Vec3b(0, 0, 0));
-      }
+      RegionDrawing::Mode mode = foreground ? RegionDrawing::COPY :
+          RegionDrawing::FILL;
+      drawings.push_back(RegionDrawing(region->raster(), mode,
+            cv::Vec3b(0, 0, 0), 0));
     }
+    drawRegions(drawings, image, visualization, &pool);
 
     if (display) {
       cv::imshow("Tracks", visualization);
@@ -78,7 +80,6 @@ void visualizeSegmentation(const VideoSegmentation& segmentation,
       cv::imwrite(file, visualization);
     }
 
-    ++frame;
     n += 1;
   }
 
@@ -107,17 +108,10 @@ int main(int argc, char** argv) {
 
   bool ok;
 
-  // Load segmentation from file.
-  VideoSegmentation segmentation;
-  {
-    std::ifstream ifs(foreground_file.c_str(), std::ios::binary);
-    if (!ifs) {
-      LOG(FATAL) << "Could not open segmentation file";
-    }
-    ok = segmentation.ParseFromIstream(&ifs);
-    if (!ok) {
-      LOG(FATAL) << "Could not parse segmentation from file";
-    }
+  // Frames of the segmentation are parsed as they are displayed.
+  VideoSegmentationStreamReader segmentation;
+  if (!segmentation.open(foreground_file)) {
+    LOG(FATAL) << "Could not open segmentation file";
   }
 
   // Open video stream.
@@ -127,7 +121,9 @@ int main(int argc, char** argv) {
     LOG(FATAL) << "Could not open video stream";
   }
 
-  visualizeSegmentation(segmentation, capture, FLAGS_display, FLAGS_save);
+  ThreadPool pool(FLAGS_num_threads);
+  visualizeSegmentation(segmentation, capture, FLAGS_display, FLAGS_save,
+      pool);
 
   return 0;
 }
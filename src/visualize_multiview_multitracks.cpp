@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <utility>
 #include <string>
 #include <cstdlib>
 #include <sstream>
@@ -5,13 +7,14 @@
 #include <glog/logging.h>
 #include <boost/lexical_cast.hpp>
 #include <boost/format.hpp>
+#include <boost/bind.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
 #include "multiview_track.hpp"
 #include "multiview_track_list.hpp"
 #include "random_color.hpp"
 #include "sift_position.hpp"
-#include "draw_sift_position.hpp"
+#include "draw_batch.hpp"
 
 #include "multiview_track_list_reader.hpp"
 #include "default_reader.hpp"
@@ -19,6 +22,9 @@
 #include "iterator_reader.hpp"
 #include "sift_position_reader.hpp"
 #include "read_image.hpp"
+#include "util/thread-pool.hpp"
+#include "util/frame-writer.hpp"
+#include "util/render-queue.hpp"
 
 typedef std::vector<SiftPosition> FeatureSet;
 
@@ -29,10 +35,22 @@ const double LINE_THICKNESS = 2;
 DEFINE_string(output_format, "%d.png", "Location to save image.");
 DEFINE_bool(save, false, "Save to file?");
 DEFINE_bool(display, true, "Show in window?");
+DEFINE_string(video, "", "Video file to encode frames into, empty to disable");
+DEFINE_string(fourcc, "XVID", "Codec of --video");
+DEFINE_double(fps, 30, "Frame rate of --video");
+DEFINE_string(encoder, "",
+    "Command to pipe raw BGR frames to, with %1% and %2% for the width and "
+    "height, empty to disable");
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads to render with, 0 to render serially");
+DEFINE_int32(max_buffered, 8,
+    "Maximum number of frames rendered ahead of being written");
 
 DEFINE_bool(show_matches, true, "Show cross-view matches?");
 DEFINE_bool(exclude_single_view, true, "Show multi-view tracks that aren't?");
 DEFINE_bool(show_trails, false, "Show point trails within view?");
+DEFINE_int32(max_tracks, 0,
+    "Draw only this many of the longest tracks, 0 to draw all");
 
 struct Collage {
   cv::Mat image;
@@ -44,10 +62,6 @@ struct Collage {
   }
 };
 
-std::string makeTimeFilename(const std::string& format, int time) {
-  return boost::str(boost::format(format) % (time + 1));
-}
-
 std::string makeFrameFilename(const std::string& format,
                               const std::string& view,
                               int time) {
@@ -68,6 +82,33 @@ void removeSingleViewTracks(const MultiviewTrackList<FeatureSet>& input,
   }
 }
 
+// Keeps the tracks with the most image features, in their original order.
+void selectLongestTracks(const MultiviewTrackList<FeatureSet>& input,
+                         int max_tracks,
+                         MultiviewTrackList<FeatureSet>& output) {
+  int num_tracks = input.numTracks();
+
+  // Order by descending number of features, then index.
+  std::vector<std::pair<int, int> > lengths;
+  for (int i = 0; i < num_tracks; i += 1) {
+    lengths.push_back(std::make_pair(-input.track(i).numImageFeatures(), i));
+  }
+  int n = std::min(num_tracks, max_tracks);
+  std::partial_sort(lengths.begin(), lengths.begin() + n, lengths.end());
+
+  std::vector<int> selected;
+  for (int i = 0; i < n; i += 1) {
+    selected.push_back(lengths[i].second);
+  }
+  std::sort(selected.begin(), selected.end());
+
+  output = MultiviewTrackList<FeatureSet>(input.numViews());
+  std::vector<int>::const_iterator index;
+  for (index = selected.begin(); index != selected.end(); ++index) {
+    output.push_back(input.track(*index));
+  }
+}
+
 void init(int& argc, char**& argv) {
   std::ostringstream usage;
   usage << "Visualizes multi-view tracks." << std::endl;
@@ -118,23 +159,18 @@ bool loadImages(const std::string& image_format,
   return true;
 }
 
-void drawFeatures(cv::Mat& image, 
-                  const FeatureSet& features,
-                  const cv::Scalar& color) {
-  FeatureSet::const_iterator feature;
-  for (feature = features.begin(); feature != features.end(); ++feature) {
-    drawSiftPosition(image, *feature, color, LINE_THICKNESS);
-  }
-}
-
-void drawFeatureSets(cv::Mat& image,
-                     const std::map<int, FeatureSet>& features,
-                     const std::vector<cv::Scalar>& colors) {
+void addFeatureSets(DrawBatch& batch,
+                    const std::map<int, FeatureSet>& features) {
   typedef std::map<int, FeatureSet> Subset;
 
   Subset::const_iterator pair;
   for (pair = features.begin(); pair != features.end(); ++pair) {
-    drawFeatures(image, pair->second, colors[pair->first]);
+    FeatureSet::const_iterator feature;
+    for (feature = pair->second.begin();
+         feature != pair->second.end();
+         ++feature) {
+      batch.addSiftPosition(*feature, pair->first);
+    }
   }
 }
 
@@ -167,6 +203,7 @@ void drawFeaturesInAllViews(
     Collage& collage,
     const std::vector<cv::Scalar>& colors) {
   int num_views = collage.offsets.size();
+  DrawBatch batch;
 
   // Render features in each view.
   for (int view = 0; view < num_views; view += 1) {
@@ -177,7 +214,9 @@ void drawFeaturesInAllViews(
     std::map<int, FeatureSet> subset;
     getFeaturesInView(features, view, subset);
 
-    drawFeatureSets(viewport, subset, colors);
+    batch.clear();
+    addFeatureSets(batch, subset);
+    batch.draw(viewport, colors, LINE_THICKNESS);
   }
 }
 
@@ -243,6 +282,40 @@ void drawTrailsInAllViews(
 }
 */
 
+typedef std::map<int, std::map<int, FeatureSet> > FeatureMap;
+
+// Loads and draws one frame. Called by RenderQueue.
+void renderFrame(const std::string& image_format,
+                 const std::vector<std::string>& views,
+                 const std::vector<cv::Scalar>& colors,
+                 int time,
+                 const FeatureMap& features,
+                 cv::Mat& image) {
+  // Load image for each view.
+  Collage collage;
+  bool ok = loadImages(image_format, time, views, collage);
+  CHECK(ok) << "Could not load images for frame " << time;
+
+  // Visualize all features.
+  drawFeaturesInAllViews(features, collage, colors);
+
+  /*
+  // Visualize inter-view matches.
+  if (FLAGS_show_matches) {
+    drawInterViewMatches(features, collage, colors);
+  }
+  */
+
+  /*
+  // Visualize optical flow trails.
+  if (FLAGS_show_trails) {
+    drawTrailsInAllViews(iterator, collage, colors);
+  }
+  */
+
+  image = collage.image;
+}
+
 int main(int argc, char** argv) {
   init(argc, argv);
 
@@ -280,58 +353,64 @@ int main(int argc, char** argv) {
     tracks.swap(multi);
   }
 
+  // Too many tracks to draw interactively.
+  if (FLAGS_max_tracks > 0 && tracks.numTracks() > FLAGS_max_tracks) {
+    MultiviewTrackList<FeatureSet> longest;
+    selectLongestTracks(tracks, FLAGS_max_tracks, longest);
+    tracks.swap(longest);
+    LOG(INFO) << "Drawing the longest " << tracks.numTracks() << " tracks";
+  }
+
   // Generate a color for each track.
   std::vector<cv::Scalar> colors;
   for (int i = 0; i < tracks.numTracks(); i += 1) {
     colors.push_back(randomColor(BRIGHTNESS, SATURATION));
   }
 
-  // Iterate through time.
-  MultiViewTimeIterator<FeatureSet> iterator(tracks);
+  // Outputs, which receive the frames in order.
+  ImageSequenceWriter image_writer(boost::format(FLAGS_output_format), 1);
+  VideoFileWriter video_writer(FLAGS_video, FLAGS_fourcc, FLAGS_fps);
+  EncoderPipeWriter encoder_writer(FLAGS_encoder);
+  WindowWriter window_writer("tracks", 10);
+
+  FrameWriterList writers;
+  if (FLAGS_save) {
+    writers.add(image_writer);
+  }
+  if (!FLAGS_video.empty()) {
+    writers.add(video_writer);
+  }
+  if (!FLAGS_encoder.empty()) {
+    writers.add(encoder_writer);
+  }
+  if (FLAGS_display) {
+    writers.add(window_writer);
+  }
+
+  // Iterate through time, visiting only the points in each frame.
+  MultiviewTimeIndex<FeatureSet> time_index(tracks);
+  MultiViewTimeIterator<FeatureSet> iterator(time_index);
+
+  // Frames are drawn in parallel and written in order.
+  ThreadPool pool(FLAGS_num_threads);
+  RenderQueue queue(pool, writers, FLAGS_max_buffered);
 
   for (int time = 0; time < num_frames; time += 1) {
     LOG(INFO) << time;
 
     // Get points at this time instant, indexed by feature number.
-    std::map<int, std::map<int, FeatureSet> > features;
+    FeatureMap features;
     iterator.get(features);
 
-    // Load image for each view.
-    Collage collage;
-    ok = loadImages(image_format, time, views, collage);
-    CHECK(ok) << "Could not load images";
-
-    // Visualize all features.
-    drawFeaturesInAllViews(features, collage, colors);
-
-    /*
-    // Visualize inter-view matches.
-    if (FLAGS_show_matches) {
-      drawInterViewMatches(features, collage, colors);
-    }
-    */
-
-    /*
-    // Visualize optical flow trails.
-    if (FLAGS_show_trails) {
-      drawTrailsInAllViews(iterator, collage, colors);
-    }
-    */
-
-    if (FLAGS_save) {
-      std::string output_file = makeTimeFilename(FLAGS_output_format, time);
-      ok = cv::imwrite(output_file, collage.image);
-      CHECK(ok) << "Could not save image";
-    }
-
-    if (FLAGS_display) {
-      cv::imshow("tracks", collage.image);
-      cv::waitKey(10);
-    }
+    queue.push(boost::bind(renderFrame, boost::cref(image_format),
+          boost::cref(views), boost::cref(colors), time, features, _1));
 
     iterator.next();
   }
 
+  ok = queue.finish();
+  CHECK(ok) << "Could not write frames";
+
   CHECK(iterator.end()) << "Did not reach end of tracks";
 
   return 0;
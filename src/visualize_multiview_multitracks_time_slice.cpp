@@ -11,7 +11,7 @@
 #include "multiview_track_list.hpp"
 #include "random_color.hpp"
 #include "sift_position.hpp"
-#include "draw_sift_position.hpp"
+#include "draw_batch.hpp"
 
 #include "multiview_track_list_reader.hpp"
 #include "default_reader.hpp"
@@ -174,11 +174,10 @@ bool loadBackground(Collage& collage,
   return true;
 }
 
-void drawTrack(cv::Mat& image,
-               const Track<FeatureSet>& track,
-               const cv::Scalar& color,
-               int pixels_per_tick,
-               int radius) {
+void addTrack(DrawBatch& batch,
+              const Track<FeatureSet>& track,
+              int pixels_per_tick,
+              int radius) {
   int half = (pixels_per_tick - 1) / 2;
 
   Track<FeatureSet>::const_iterator point;
@@ -192,26 +191,54 @@ void drawTrack(cv::Mat& image,
 
     for (feature = features.begin(); feature != features.end(); ++feature) {
       cv::Point center(t * pixels_per_tick + half, feature->y);
-      cv::circle(image, center, radius, color, LINE_THICKNESS);
+      batch.addCircle(center, radius, 0);
     }
   }
 }
 
+// Draws the track over the background in each view. Returns the region of
+// each viewport that was drawn on, so that it can be restored.
 void drawMultiviewTrack(Collage& collage,
                         const MultiviewTrack<FeatureSet>& track,
                         const cv::Scalar& color,
                         int pixels_per_tick,
-                        int radius) {
+                        int radius,
+                        std::vector<cv::Rect>& regions) {
+  std::vector<cv::Scalar> colors(1, color);
+  regions.clear();
+
   MultiviewTrack<FeatureSet>::const_iterator view;
   int c = 0;
 
   for (view = track.begin(); view != track.end(); ++view) {
+    DrawBatch batch;
+    addTrack(batch, *view, pixels_per_tick, radius);
+
     cv::Mat viewport = collage.viewport(c);
-    drawTrack(viewport, *view, color, pixels_per_tick, radius);
+    batch.draw(viewport, colors, LINE_THICKNESS);
+    regions.push_back(batch.bounds(collage.size, LINE_THICKNESS));
     c += 1;
   }
 }
 
+// Copies the regions of each viewport back from the background.
+void restoreBackground(Collage& collage,
+                       const Collage& background,
+                       const std::vector<cv::Rect>& regions) {
+  int num_views = regions.size();
+
+  for (int c = 0; c < num_views; c += 1) {
+    const cv::Rect& region = regions[c];
+    if (region.area() == 0) {
+      continue;
+    }
+
+    cv::Rect rect(collage.offsets[c] + region.tl(), region.size());
+    cv::Mat dst = collage.image(rect);
+    background.image(rect).copyTo(dst);
+  }
+}
+
 int main(int argc, char** argv) {
   init(argc, argv);
 
@@ -255,21 +282,22 @@ int main(int argc, char** argv) {
     tracks.swap(multi);
   }
 
-  // Render tracks through time.
+  // Render tracks through time. Each track only changes a small part of the
+  // background, so restore that part instead of copying the whole collage.
+  Collage collage = background;
+  std::vector<cv::Rect> regions;
   MultiviewTrackList<FeatureSet>::const_iterator track;
   int i = 0;
 
   for (track = tracks.begin(); track != tracks.end(); ++track) {
     LOG(INFO) << "Feature " << (i + 1) << " of " << tracks.numTracks();
 
-    // Copy background.
-    Collage collage = background;
-
     // Pick a random color.
     cv::Scalar color = randomColor(BRIGHTNESS, SATURATION);
 
     // Draw multi-view track.
-    drawMultiviewTrack(collage, *track, color, pixels_per_tick, radius);
+    drawMultiviewTrack(collage, *track, color, pixels_per_tick, radius,
+        regions);
 
     if (FLAGS_display) {
       cv::imshow("collage", collage.image);
@@ -282,6 +310,7 @@ int main(int argc, char** argv) {
       CHECK(ok) << "Could not write image";
     }
 
+    restoreBackground(collage, background, regions);
     i += 1;
   }
 
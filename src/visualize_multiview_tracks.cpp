@@ -6,6 +6,7 @@
 #include <glog/logging.h>
 #include <boost/lexical_cast.hpp>
 #include <boost/format.hpp>
+#include <boost/bind.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
 #include "multiview_track.hpp"
@@ -18,6 +19,9 @@
 #include "read_lines.hpp"
 #include "scale_space_position_reader.hpp"
 #include "read_image.hpp"
+#include "util/thread-pool.hpp"
+#include "util/frame-writer.hpp"
+#include "util/render-queue.hpp"
 
 const double SATURATION = 0.99;
 const double BRIGHTNESS = 0.99;
@@ -28,6 +32,16 @@ DEFINE_int32(radius, 5, "Base radius");
 DEFINE_string(output_format, "%d.png", "Location to save image.");
 DEFINE_bool(save, false, "Save to file?");
 DEFINE_bool(display, true, "Show in window?");
+DEFINE_string(video, "", "Video file to encode frames into, empty to disable");
+DEFINE_string(fourcc, "XVID", "Codec of --video");
+DEFINE_double(fps, 30, "Frame rate of --video");
+DEFINE_string(encoder, "",
+    "Command to pipe raw BGR frames to, with %1% and %2% for the width and "
+    "height, empty to disable");
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads to render with, 0 to render serially");
+DEFINE_int32(max_buffered, 8,
+    "Maximum number of frames rendered ahead of being written");
 
 DEFINE_bool(show_matches, true, "Show cross-view matches?");
 DEFINE_bool(exclude_single_view, true, "Show multi-view tracks that aren't?");
@@ -43,10 +57,6 @@ struct Collage {
   }
 };
 
-std::string makeTimeFilename(const std::string& format, int time) {
-  return boost::str(boost::format(format) % (time + 1));
-}
-
 std::string makeFrameFilename(const std::string& format,
                               const std::string& view,
                               int time) {
@@ -240,6 +250,37 @@ void drawTrailsInAllViews(
   }
 }
 
+typedef std::map<int, std::map<int, ScaleSpacePosition> > FeatureMap;
+
+// Loads and draws one frame. Called by RenderQueue.
+void renderFrame(const std::string& image_format,
+                 const std::vector<std::string>& views,
+                 const std::vector<cv::Scalar>& colors,
+                 int time,
+                 const FeatureMap& features,
+                 const MultiViewTimeIterator<ScaleSpacePosition>& iterator,
+                 cv::Mat& image) {
+  // Load image for each view.
+  Collage collage;
+  bool ok = loadImages(image_format, time, views, collage);
+  CHECK(ok) << "Could not load images for frame " << time;
+
+  // Visualize all features.
+  drawFeaturesInAllViews(features, collage, colors);
+
+  // Visualize inter-view matches.
+  if (FLAGS_show_matches) {
+    drawInterViewMatches(features, collage, colors);
+  }
+
+  // Visualize optical flow trails.
+  if (FLAGS_show_trails) {
+    drawTrailsInAllViews(iterator, collage, colors);
+  }
+
+  image = collage.image;
+}
+
 int main(int argc, char** argv) {
   init(argc, argv);
 
@@ -282,48 +323,51 @@ int main(int argc, char** argv) {
     colors.push_back(randomColor(BRIGHTNESS, SATURATION));
   }
 
-  // Iterate through time.
-  MultiViewTimeIterator<ScaleSpacePosition> iterator(tracks);
+  // Outputs, which receive the frames in order.
+  ImageSequenceWriter image_writer(boost::format(FLAGS_output_format), 1);
+  VideoFileWriter video_writer(FLAGS_video, FLAGS_fourcc, FLAGS_fps);
+  EncoderPipeWriter encoder_writer(FLAGS_encoder);
+  WindowWriter window_writer("tracks", 10);
+
+  FrameWriterList writers;
+  if (FLAGS_save) {
+    writers.add(image_writer);
+  }
+  if (!FLAGS_video.empty()) {
+    writers.add(video_writer);
+  }
+  if (!FLAGS_encoder.empty()) {
+    writers.add(encoder_writer);
+  }
+  if (FLAGS_display) {
+    writers.add(window_writer);
+  }
+
+  // Iterate through time, visiting only the points in each frame.
+  MultiviewTimeIndex<ScaleSpacePosition> time_index(tracks);
+  MultiViewTimeIterator<ScaleSpacePosition> iterator(time_index);
+
+  // Frames are drawn in parallel and written in order.
+  ThreadPool pool(FLAGS_num_threads);
+  RenderQueue queue(pool, writers, FLAGS_max_buffered);
 
   for (int time = 0; time < num_frames; time += 1) {
     LOG(INFO) << time;
 
     // Get points at this time instant, indexed by feature number.
-    std::map<int, std::map<int, ScaleSpacePosition> > features;
+    FeatureMap features;
     iterator.get(features);
 
-    // Load image for each view.
-    Collage collage;
-    ok = loadImages(image_format, time, views, collage);
-    CHECK(ok) << "Could not load images";
-
-    // Visualize all features.
-    drawFeaturesInAllViews(features, collage, colors);
-
-    // Visualize inter-view matches.
-    if (FLAGS_show_matches) {
-      drawInterViewMatches(features, collage, colors);
-    }
-
-    // Visualize optical flow trails.
-    if (FLAGS_show_trails) {
-      drawTrailsInAllViews(iterator, collage, colors);
-    }
-
-    if (FLAGS_save) {
-      std::string output_file = makeTimeFilename(FLAGS_output_format, time);
-      ok = cv::imwrite(output_file, collage.image);
-      CHECK(ok) << "Could not save image";
-    }
-
-    if (FLAGS_display) {
-      cv::imshow("tracks", collage.image);
-      cv::waitKey(10);
-    }
+    queue.push(boost::bind(renderFrame, boost::cref(image_format),
+          boost::cref(views), boost::cref(colors), time, features, iterator,
+          _1));
 
     iterator.next();
   }
 
+  ok = queue.finish();
+  CHECK(ok) << "Could not write frames";
+
   CHECK(iterator.end()) << "Did not reach end of tracks";
 
   return 0;
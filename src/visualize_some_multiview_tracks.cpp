@@ -7,6 +7,7 @@
 #include <glog/logging.h>
 #include <boost/lexical_cast.hpp>
 #include <boost/format.hpp>
+#include <boost/bind.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
 #include "random.hpp"
@@ -23,6 +24,9 @@
 #include "read_lines.hpp"
 #include "sift_position_reader.hpp"
 #include "read_image.hpp"
+#include "util/thread-pool.hpp"
+#include "util/frame-writer.hpp"
+#include "util/render-queue.hpp"
 
 const double SATURATION = 0.99;
 const double BRIGHTNESS = 0.99;
@@ -39,6 +43,15 @@ const cv::Scalar TIME_LINE_COLOR(100, 100, 100);
 DEFINE_string(output_format, "%d-%d.png", "Location to save image.");
 DEFINE_bool(save, false, "Save to file?");
 DEFINE_bool(display, true, "Show in window?");
+DEFINE_string(video, "",
+    "Video file to encode each movie into, which takes the movie number, "
+    "empty to disable");
+DEFINE_string(fourcc, "XVID", "Codec of --video");
+DEFINE_double(fps, 30, "Frame rate of --video");
+DEFINE_int32(num_threads, 0,
+    "Number of worker threads to render with, 0 to render serially");
+DEFINE_int32(max_buffered, 8,
+    "Maximum number of frames rendered ahead of being written");
 
 DEFINE_bool(show_matches, false, "Show cross-view matches?");
 DEFINE_bool(exclude_single_view, true, "Show multi-view tracks that aren't?");
@@ -513,52 +526,58 @@ void drawTimeSlices(const MultiviewTrackList<SiftPosition>& tracks,
   }
 }
 
-std::string makeTimeFilename(boost::format format, int time) {
-  return boost::str(format % (time + 1));
+typedef std::map<int, std::map<int, SiftPosition> > FeatureMap;
+
+// Loads and draws one frame of a movie. Called by RenderQueue.
+void renderFrame(const MultiviewTrackList<SiftPosition>& tracks,
+                 const std::vector<cv::Scalar>& colors,
+                 int num_frames,
+                 const std::vector<const FileStream*>& image_streams,
+                 int t,
+                 const FeatureMap& features,
+                 cv::Mat& image) {
+  // Load image for each view.
+  Collage collage;
+  bool ok = loadImages(image_streams, t, num_frames, collage);
+  CHECK(ok) << "Could not load images for frame " << t;
+
+  // Visualize all features.
+  drawFeaturesInAllViews(features, collage, colors);
+
+  // Visualize all features.
+  drawTimeSlices(tracks, collage, colors, t);
+
+  image = collage.image;
 }
 
 void drawMovie(const MultiviewTrackList<SiftPosition>& tracks,
                const std::vector<cv::Scalar>& colors,
                int num_frames,
                const std::vector<const FileStream*>& image_streams,
-               bool show_matches,
-               bool show_trails,
-               bool display,
-               bool save,
-               boost::format output_format) {
-  // Iterate through time.
-  MultiViewTimeIterator<SiftPosition> iterator(tracks);
+               ThreadPool& pool,
+               FrameWriter& writer) {
+  // Iterate through time, visiting only the points in each frame.
+  MultiviewTimeIndex<SiftPosition> time_index(tracks);
+  MultiViewTimeIterator<SiftPosition> iterator(time_index);
+
+  // Frames are drawn in parallel and written in order.
+  RenderQueue queue(pool, writer, FLAGS_max_buffered);
 
   for (int t = 0; t < num_frames; t += 1) {
     // Get points at this time instant, indexed by feature number.
-    std::map<int, std::map<int, SiftPosition> > features;
+    FeatureMap features;
     iterator.get(features);
 
-    // Load image for each view.
-    Collage collage;
-    bool ok = loadImages(image_streams, t, num_frames, collage);
-    CHECK(ok) << "Could not load images";
-
-    // Visualize all features.
-    drawFeaturesInAllViews(features, collage, colors);
-
-    // Visualize all features.
-    drawTimeSlices(tracks, collage, colors, t);
-
-    if (save) {
-      std::string output_file = makeTimeFilename(output_format, t);
-      ok = cv::imwrite(output_file, collage.image);
-      CHECK(ok) << "Could not save image";
-    }
-
-    if (display) {
-      cv::imshow("tracks", collage.image);
-      cv::waitKey(10);
-    }
+    queue.push(boost::bind(renderFrame, boost::cref(tracks),
+          boost::cref(colors), num_frames, boost::cref(image_streams), t,
+          features, _1));
 
     iterator.next();
   }
 
+  bool ok = queue.finish();
+  CHECK(ok) << "Could not write frames";
+
   CHECK(iterator.end()) << "Did not reach end of tracks";
 }
 
@@ -651,6 +670,8 @@ int main(int argc, char** argv) {
   splitIntoSubsets(list, subsets, MIN_CLEARANCE, MAX_NUM_TRACKS,
       MAX_NUM_VIDEOS);
 
+  ThreadPool pool(FLAGS_num_threads);
+
   int i = 0;
   std::deque<MultiviewTrackList<SiftPosition> >::const_iterator subset;
   for (subset = subsets.begin(); subset != subsets.end(); ++subset) {
@@ -660,10 +681,26 @@ int main(int argc, char** argv) {
     std::vector<cv::Scalar> colors;
     evenlySpacedColors(subset->numTracks(), SATURATION, BRIGHTNESS, colors);
 
+    // Outputs of this movie, which receive the frames in order.
+    ImageSequenceWriter image_writer(boost::format(FLAGS_output_format) % i,
+        1);
+    VideoFileWriter video_writer(FLAGS_video.empty() ? std::string() :
+        boost::str(boost::format(FLAGS_video) % i), FLAGS_fourcc, FLAGS_fps);
+    WindowWriter window_writer("tracks", 10);
+
+    FrameWriterList writers;
+    if (FLAGS_save) {
+      writers.add(image_writer);
+    }
+    if (!FLAGS_video.empty()) {
+      writers.add(video_writer);
+    }
+    if (FLAGS_display) {
+      writers.add(window_writer);
+    }
+
     // Draw movie.
-    drawMovie(*subset, colors, num_frames, image_streams, FLAGS_show_matches,
-        FLAGS_show_trails, FLAGS_display, FLAGS_save,
-        boost::format(FLAGS_output_format) % i);
+    drawMovie(*subset, colors, num_frames, image_streams, pool, writers);
 
     i += 1;
   }
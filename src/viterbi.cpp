@@ -1,10 +1,163 @@
 #include "viterbi.hpp"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <boost/thread/mutex.hpp>
 #include <glog/logging.h>
+#include "util/thread-pool.hpp"
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// 2048 doubles of f are 16KB, which stays in L1 cache for every row of a block.
+const int COLUMN_BLOCK_SIZE = 2048;
+// Rows are handed to threads in blocks.
+const int ROW_BLOCK_SIZE = 64;
+
+// Finds the minimum of f[q] + g[q] over q in [0, n) and the first q at which
+// it occurs. n must be positive.
+inline void minPlus(const double* f,
+                    const double* g,
+                    int n,
+                    double& min,
+                    int& arg) {
+  int q = 0;
+  min = f[0] + g[0];
+  arg = 0;
+
+#if defined(__AVX__)
+  if (n >= 8) {
+    // Each lane keeps the minimum of every fourth element. The comparison is
+    // strict, so each lane keeps its first minimum.
+    __m256d index = _mm256_set_pd(3, 2, 1, 0);
+    __m256d best_index = index;
+    __m256d best = _mm256_add_pd(_mm256_loadu_pd(f), _mm256_loadu_pd(g));
+    const __m256d step = _mm256_set1_pd(4);
+
+    for (q = 4; q + 4 <= n; q += 4) {
+      index = _mm256_add_pd(index, step);
+      __m256d x = _mm256_add_pd(_mm256_loadu_pd(f + q), _mm256_loadu_pd(g + q));
+      __m256d less = _mm256_cmp_pd(x, best, _CMP_LT_OQ);
+      best = _mm256_blendv_pd(best, x, less);
+      best_index = _mm256_blendv_pd(best_index, index, less);
+    }
+
+    double values[4];
+    double indices[4];
+    _mm256_storeu_pd(values, best);
+    _mm256_storeu_pd(indices, best_index);
+
+    // Take the earliest of equal minima.
+    min = values[0];
+    arg = int(indices[0]);
+    for (int i = 1; i < 4; i += 1) {
+      if (values[i] < min || (values[i] == min && int(indices[i]) < arg)) {
+        min = values[i];
+        arg = int(indices[i]);
+      }
+    }
+  }
+#elif defined(__SSE2__)
+  if (n >= 4) {
+    __m128d index = _mm_set_pd(1, 0);
+    __m128d best_index = index;
+    __m128d best = _mm_add_pd(_mm_loadu_pd(f), _mm_loadu_pd(g));
+    const __m128d step = _mm_set1_pd(2);
+
+    for (q = 2; q + 2 <= n; q += 2) {
+      index = _mm_add_pd(index, step);
+      __m128d x = _mm_add_pd(_mm_loadu_pd(f + q), _mm_loadu_pd(g + q));
+      __m128d less = _mm_cmplt_pd(x, best);
+      best = _mm_or_pd(_mm_and_pd(less, x), _mm_andnot_pd(less, best));
+      best_index = _mm_or_pd(_mm_and_pd(less, index),
+          _mm_andnot_pd(less, best_index));
+    }
+
+    double values[2];
+    double indices[2];
+    _mm_storeu_pd(values, best);
+    _mm_storeu_pd(indices, best_index);
+
+    min = values[0];
+    arg = int(indices[0]);
+    if (values[1] < min || (values[1] == min && int(indices[1]) < arg)) {
+      min = values[1];
+      arg = int(indices[1]);
+    }
+  }
+#endif
+
+  // Remaining elements come after every element seen so far.
+  for (; q < n; q += 1) {
+    double d_q = f[q] + g[q];
+    if (d_q < min) {
+      min = d_q;
+      arg = q;
+    }
+  }
+}
+
+// Computes the distance transform for rows [begin, end).
+// Columns are visited in blocks so that each block of f is re-used by all
+// rows while it is in cache.
+void distanceTransformRows(const std::vector<double>& f,
+                           const cv::Mat& g,
+                           int begin,
+                           int end,
+                           double* d,
+                           int* arg) {
+  int n = f.size();
 
+  for (int q0 = 0; q0 < n; q0 += COLUMN_BLOCK_SIZE) {
+    int q1 = std::min(q0 + COLUMN_BLOCK_SIZE, n);
+
+    for (int p = begin; p < end; p += 1) {
+      double d_p;
+      int q_p;
+      minPlus(&f[q0], g.ptr<double>(p) + q0, q1 - q0, d_p, q_p);
+
+      // Earlier blocks win ties.
+      if (q0 == 0 || d_p < d[p]) {
+        d[p] = d_p;
+        arg[p] = q0 + q_p;
+      }
+    }
+  }
+}
+
+// Computes one block of rows of the distance transform.
+class DistanceTransformBlock {
+  public:
+    DistanceTransformBlock(const std::vector<double>& f,
+                           const cv::Mat& g,
+                           double* d,
+                           int* arg)
+        : f_(&f), g_(&g), d_(d), arg_(arg) {}
+
+    void operator()(int block) const {
+      int begin = block * ROW_BLOCK_SIZE;
+      int end = std::min(begin + ROW_BLOCK_SIZE, g_->rows);
+      distanceTransformRows(*f_, *g_, begin, end, d_, arg_);
+    }
+
+  private:
+    const std::vector<double>* f_;
+    const cv::Mat* g_;
+    double* d_;
+    int* arg_;
+};
+
+// Runs in parallel if a pool is given.
 void distanceTransform(const std::vector<double>& f,
                        const cv::Mat& g,
                        std::vector<double>& d,
-                       std::vector<int>& arg) {
+                       std::vector<int>& arg,
+                       ThreadPool* pool) {
   CHECK(g.type() == cv::DataType<double>::type);
   int n = f.size();
   int m = g.rows;
@@ -12,38 +165,46 @@ void distanceTransform(const std::vector<double>& f,
 
   d.assign(m, 0);
   arg.assign(m, -1);
+  if (m == 0 || n == 0) {
+    return;
+  }
 
   // From p to q.
-  for (int p = 0; p < m; p += 1) {
-    double d_star = 0;
-    int q_star = -1;
-
-    for (int q = 0; q < n; q += 1) {
-      double d_pq = f[q] + g.at<double>(p, q);
-
-      if (q == 0 || d_pq < d_star) {
-        d_star = d_pq;
-        q_star = q;
-      }
-    }
-
-    d[p] = d_star;
-    arg[p] = q_star;
+  int num_blocks = (m + ROW_BLOCK_SIZE - 1) / ROW_BLOCK_SIZE;
+  if (pool == NULL || pool->numThreads() == 0 || num_blocks < 2) {
+    distanceTransformRows(f, g, 0, m, &d.front(), &arg.front());
+  } else {
+    DistanceTransformBlock block(f, g, &d.front(), &arg.front());
+    pool->parallelFor(0, num_blocks, block);
   }
 }
 
+// Buffers which are re-used from one chain to the next.
+struct ViterbiWorkspace {
+  std::vector<std::vector<int> > args;
+  std::vector<double> f;
+  std::vector<double> d;
+};
+
 double solveViterbi(const std::deque<std::vector<double> >& g,
                     const std::vector<cv::Mat>& h,
-                    std::vector<int>& x) {
+                    std::vector<int>& x,
+                    ThreadPool* pool,
+                    ViterbiWorkspace& workspace) {
   int n = g.size();
-  std::deque<std::vector<int> > args(n - 1);
+  // Never shrink, so that earlier chains' buffers are kept.
+  std::vector<std::vector<int> >& args = workspace.args;
+  if (int(args.size()) < n - 1) {
+    args.resize(n - 1);
+  }
 
-  std::vector<double> f = g[0];
+  std::vector<double>& f = workspace.f;
+  std::vector<double>& d = workspace.d;
+  f.assign(g[0].begin(), g[0].end());
 
   for (int i = 0; i < n - 1; i += 1) {
     // Compute distance transform for next variable.
-    std::vector<double> d;
-    distanceTransform(f, h[i], d, args[i]);
+    distanceTransform(f, h[i], d, args[i], pool);
 
     int k = g[i + 1].size();
     f.assign(k, 0);
@@ -76,64 +237,413 @@ double solveViterbi(const std::deque<std::vector<double> >& g,
   return f_star;
 }
 
+// Workspaces shared by the threads of a batch. Each thread takes one for as
+// long as it solves a chain, so there are at most as many as threads.
+class WorkspaceList {
+  public:
+    WorkspaceList() : mutex_(), workspaces_(), free_() {}
+
+    ViterbiWorkspace& acquire() {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (free_.empty()) {
+        // Elements of a deque do not move when it grows at the end.
+        workspaces_.push_back(ViterbiWorkspace());
+        return workspaces_.back();
+      }
+      ViterbiWorkspace& workspace = *free_.back();
+      free_.pop_back();
+      return workspace;
+    }
+
+    void release(ViterbiWorkspace& workspace) {
+      boost::mutex::scoped_lock lock(mutex_);
+      free_.push_back(&workspace);
+    }
+
+  private:
+    boost::mutex mutex_;
+    std::deque<ViterbiWorkspace> workspaces_;
+    std::vector<ViterbiWorkspace*> free_;
+};
+
+// Solves one chain of a batch.
+class SolveViterbiFunction {
+  public:
+    SolveViterbiFunction(const std::vector<ViterbiProblem>& problems,
+                         std::vector<std::vector<int> >& x,
+                         std::vector<double>& values,
+                         WorkspaceList& workspaces)
+        : problems_(&problems),
+          x_(&x),
+          values_(&values),
+          workspaces_(&workspaces) {}
+
+    void operator()(int i) const {
+      const ViterbiProblem& problem = (*problems_)[i];
+      ViterbiWorkspace& workspace = workspaces_->acquire();
+      // The chains are the parallel work, not the rows.
+      (*values_)[i] = solveViterbi(*problem.g, *problem.h, (*x_)[i], NULL,
+          workspace);
+      workspaces_->release(workspace);
+    }
+
+  private:
+    const std::vector<ViterbiProblem>* problems_;
+    std::vector<std::vector<int> >* x_;
+    std::vector<double>* values_;
+    WorkspaceList* workspaces_;
+};
+
+}
+
+void distanceTransform(const std::vector<double>& f,
+                       const cv::Mat& g,
+                       std::vector<double>& d,
+                       std::vector<int>& arg) {
+  distanceTransform(f, g, d, arg, NULL);
+}
+
+void distanceTransform(const std::vector<double>& f,
+                       const cv::Mat& g,
+                       std::vector<double>& d,
+                       std::vector<int>& arg,
+                       ThreadPool& pool) {
+  distanceTransform(f, g, d, arg, &pool);
+}
+
+double solveViterbi(const std::deque<std::vector<double> >& g,
+                    const std::vector<cv::Mat>& h,
+                    std::vector<int>& x) {
+  ViterbiWorkspace workspace;
+  return solveViterbi(g, h, x, NULL, workspace);
+}
+
+double solveViterbi(const std::deque<std::vector<double> >& g,
+                    const std::vector<cv::Mat>& h,
+                    std::vector<int>& x,
+                    ThreadPool& pool) {
+  ViterbiWorkspace workspace;
+  return solveViterbi(g, h, x, &pool, workspace);
+}
+
+ViterbiProblem::ViterbiProblem() : g(NULL), h(NULL) {}
+
+ViterbiProblem::ViterbiProblem(const std::deque<std::vector<double> >& g,
+                               const std::vector<cv::Mat>& h)
+    : g(&g), h(&h) {}
+
+void solveViterbiBatch(const std::vector<ViterbiProblem>& problems,
+                       std::vector<std::vector<int> >& x,
+                       std::vector<double>& values,
+                       ThreadPool& pool,
+                       int grain) {
+  int n = problems.size();
+  x.resize(n);
+  values.assign(n, 0);
+
+  WorkspaceList workspaces;
+  pool.parallelFor(0, n, SolveViterbiFunction(problems, x, values, workspaces),
+      grain);
+}
+
+namespace {
+
+// Orders partial solutions by value, then by label.
+struct LessValue {
+  bool operator()(const std::pair<double, int>& lhs,
+                  const std::pair<double, int>& rhs) const {
+    return lhs < rhs;
+  }
+};
+
+// Keeps the beam_width smallest values of f. The labels of the beam are put
+// in order in states and their values in values. Returns the smallest value
+// outside the beam, or +inf if nothing was pruned.
+double selectBeam(const std::vector<double>& f,
+                  int beam_width,
+                  std::vector<int>& states,
+                  std::vector<double>& values) {
+  int k = f.size();
+  double pruned = std::numeric_limits<double>::infinity();
+  states.clear();
+
+  if (k <= beam_width) {
+    for (int j = 0; j < k; j += 1) {
+      states.push_back(j);
+    }
+  } else {
+    std::vector<std::pair<double, int> > order(k);
+    for (int j = 0; j < k; j += 1) {
+      order[j] = std::make_pair(f[j], j);
+    }
+    std::nth_element(order.begin(), order.begin() + beam_width, order.end(),
+        LessValue());
+    pruned = std::min_element(order.begin() + beam_width, order.end(),
+        LessValue())->first;
+
+    for (int j = 0; j < beam_width; j += 1) {
+      states.push_back(order[j].second);
+    }
+    // Visit labels in order so that ties are broken as in solveViterbi().
+    std::sort(states.begin(), states.end());
+  }
+
+  values.clear();
+  std::vector<int>::const_iterator state;
+  for (state = states.begin(); state != states.end(); ++state) {
+    values.push_back(f[*state]);
+  }
+
+  return pruned;
+}
+
+// Returns the minimum of a table.
+double minimum(const std::vector<double>& f) {
+  return *std::min_element(f.begin(), f.end());
+}
+
+double minimum(const cv::Mat& h) {
+  double h_min;
+  cv::minMaxLoc(h, &h_min, NULL, NULL, NULL);
+  return h_min;
+}
+
+}
+
+double solveViterbiBeam(const std::deque<std::vector<double> >& g,
+                        const std::vector<cv::Mat>& h,
+                        int beam_width,
+                        std::vector<int>& x,
+                        double* lower_bound) {
+  CHECK(!g.empty());
+  CHECK(beam_width > 0);
+  int n = g.size();
+
+  // Labels of the partial solutions kept for each variable, and the position
+  // of the minimizer of each one in the beam of the previous variable.
+  std::vector<std::vector<int> > states(n);
+  std::vector<std::vector<int> > back(n);
+  // Smallest value pruned from each variable.
+  std::vector<double> pruned(n, std::numeric_limits<double>::infinity());
+
+  std::vector<double> values;
+  std::vector<double> f = g[0];
+
+  for (int i = 0; i < n - 1; i += 1) {
+    pruned[i] = selectBeam(f, beam_width, states[i], values);
+    const std::vector<int>& beam = states[i];
+    int b = beam.size();
+
+    if (i > 0) {
+      // Only keep the minimizers of partial solutions in the beam.
+      std::vector<int> kept(b);
+      for (int j = 0; j < b; j += 1) {
+        kept[j] = back[i][beam[j]];
+      }
+      back[i].swap(kept);
+    }
+
+    CHECK(h[i].type() == cv::DataType<double>::type);
+    CHECK(h[i].cols == int(g[i].size()));
+    int k = g[i + 1].size();
+    CHECK(h[i].rows == k);
+
+    // Distance transform from the beam alone.
+    std::vector<int> arg(k, -1);
+    f.assign(k, 0);
+    for (int p = 0; p < k; p += 1) {
+      const double* row = h[i].ptr<double>(p);
+      double d = 0;
+      int arg_p = -1;
+
+      for (int q = 0; q < b; q += 1) {
+        double e = values[q] + row[beam[q]];
+        if (q == 0 || e < d) {
+          d = e;
+          arg_p = q;
+        }
+      }
+
+      f[p] = d + g[i + 1][p];
+      arg[p] = arg_p;
+    }
+
+    back[i + 1].swap(arg);
+  }
+
+  // Every state of the final variable is considered.
+  int k = g[n - 1].size();
+  double f_star = 0;
+  int j_star = -1;
+
+  for (int j = 0; j < k; j += 1) {
+    if (j == 0 || f[j] < f_star) {
+      f_star = f[j];
+      j_star = j;
+    }
+  }
+
+  // Trace solutions back. The minimizers of the final variable are indexed
+  // by label, the rest by position in the beam.
+  x.assign(n, -1);
+  x[n - 1] = j_star;
+  if (n > 1) {
+    int position = back[n - 1][j_star];
+    for (int i = n - 2; i >= 0; i -= 1) {
+      x[i] = states[i][position];
+      if (i > 0) {
+        position = back[i][position];
+      }
+    }
+  }
+
+  if (lower_bound != NULL) {
+    // A solution which leaves the beam at variable i costs at least the
+    // smallest pruned value plus the smallest possible cost of the rest.
+    double bound = f_star;
+    double rest = 0;
+    for (int i = n - 2; i >= 0; i -= 1) {
+      rest += minimum(g[i + 1]) + minimum(h[i]);
+      bound = std::min(bound, pruned[i] + rest);
+    }
+    *lower_bound = bound;
+  }
+
+  return f_star;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
-void quadraticDistanceTransform(const std::vector<double>& f,
-                                std::vector<double>& d,
-                                std::vector<int>& arg) {
-  d.clear();
-  arg.clear();
-  int n = f.size();
+namespace {
+
+// Computes the distance transform of f[0, n) with cost w (p - q)^2 into d
+// and arg. The lower envelope is built in v and z, which must have room for
+// n elements, so that callers can re-use them from one call to the next.
+void quadraticDistanceTransform(const double* f,
+                                int n,
+                                double w,
+                                int* v,
+                                double* z,
+                                double* d,
+                                int* arg) {
+  if (n == 0) {
+    return;
+  }
 
   // Indices of parabolas in the lower envelope.
-  std::vector<int> v;
-  v.push_back(0);
+  int num_v = 1;
+  v[0] = 0;
 
   // Intersections of parabolas.
-  std::vector<double> z;
+  int num_z = 0;
 
   for (int q = 1; q < n; q += 1) {
     bool found = false;
 
     while (!found) {
       // Find intersection with last parabola.
-      int v_k = v.back();
-      double s = ((f[q] + q * q) - (f[v_k] + v_k * v_k)) / (2 * q - 2 *  v_k);
+      int v_k = v[num_v - 1];
+      double s = ((f[q] + w * q * q) - (f[v_k] + w * v_k * v_k)) /
+          (2 * w * (q - v_k));
 
-      if (z.empty()) {
+      if (num_z == 0) {
         // The lower bound contains one parabola and no intersections.
         found = true;
       } else {
-        if (s > z.back()) {
+        if (s > z[num_z - 1]) {
           // This intersection occurs after the last one.
           found = true;
         }
       }
 
       if (found) {
-        z.push_back(s);
-        v.push_back(q);
+        z[num_z] = s;
+        num_z += 1;
+        v[num_v] = q;
+        num_v += 1;
       } else {
-        z.pop_back();
-        v.pop_back();
+        num_z -= 1;
+        num_v -= 1;
       }
     }
   }
 
   // The current parabola is v[k], the current bound is z[k].
   int k = 0;
-  int max_k = z.size();
 
   for (int q = 0; q < n; q += 1) {
-    while (k < max_k && z[k] < q) {
+    while (k < num_z && z[k] < q) {
       k += 1;
     }
 
-    double y = (q - v[k]) * (q - v[k]) + f[v[k]];
+    d[q] = w * (q - v[k]) * (q - v[k]) + f[v[k]];
+    arg[q] = v[k];
+  }
+}
+
+// Computes the distance transform of f[0, n) with cost w |p - q| into d and
+// arg by passing forwards then backwards.
+void linearDistanceTransform(const double* f,
+                             int n,
+                             double w,
+                             double* d,
+                             int* arg) {
+  if (n == 0) {
+    return;
+  }
+
+  d[0] = f[0];
+  arg[0] = 0;
+  for (int q = 1; q < n; q += 1) {
+    if (d[q - 1] + w < f[q]) {
+      d[q] = d[q - 1] + w;
+      arg[q] = arg[q - 1];
+    } else {
+      d[q] = f[q];
+      arg[q] = q;
+    }
+  }
+
+  for (int q = n - 2; q >= 0; q -= 1) {
+    if (d[q + 1] + w < d[q]) {
+      d[q] = d[q + 1] + w;
+      arg[q] = arg[q + 1];
+    }
+  }
+}
+
+// Computes the untruncated distance transform of one line.
+// v and z are only used by quadratic costs.
+void gridDistanceTransform(const GridCost& cost,
+                           const double* f,
+                           int n,
+                           int* v,
+                           double* z,
+                           double* d,
+                           int* arg) {
+  if (cost.kind == GridCost::QUADRATIC) {
+    quadraticDistanceTransform(f, n, cost.weight, v, z, d, arg);
+  } else {
+    linearDistanceTransform(f, n, cost.weight, d, arg);
+  }
+}
+
+}
 
-    d.push_back(y);
-    arg.push_back(v[k]);
+void quadraticDistanceTransform(const std::vector<double>& f,
+                                std::vector<double>& d,
+                                std::vector<int>& arg) {
+  int n = f.size();
+  d.resize(n);
+  arg.resize(n);
+  if (n == 0) {
+    return;
   }
+
+  std::vector<int> v(n);
+  std::vector<double> z(n);
+  quadraticDistanceTransform(&f.front(), n, 1, &v.front(), &z.front(),
+      &d.front(), &arg.front());
 }
 
 double solveViterbiQuadratic(const std::deque<std::vector<double> >& g,
@@ -181,78 +691,466 @@ double solveViterbiQuadratic(const std::deque<std::vector<double> >& g,
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void quadraticDistanceTransform2D(const cv::Mat& f, cv::Mat& d, cv::Mat& arg) {
+namespace {
+
+// Columns are transposed into tiles of this width so that the column pass
+// reads contiguous memory.
+const int COLUMN_TILE_SIZE = 16;
+
+// Distance transforms one block of rows of f into d and j_star.
+class GridDistanceTransformRows {
+  public:
+    GridDistanceTransformRows(const GridCost& cost,
+                              const cv::Mat& f,
+                              cv::Mat& d,
+                              cv::Mat& j_star)
+        : cost_(cost), f_(&f), d_(&d), j_star_(&j_star) {}
+
+    void operator()(int block) const {
+      int begin = block * ROW_BLOCK_SIZE;
+      int end = std::min(begin + ROW_BLOCK_SIZE, f_->rows);
+      int n = f_->cols;
+
+      // Shared by every row of the block.
+      std::vector<int> v(n);
+      std::vector<double> z(n);
+
+      for (int i = begin; i < end; i += 1) {
+        gridDistanceTransform(cost_, f_->ptr<double>(i), n, &v.front(),
+            &z.front(), d_->ptr<double>(i), j_star_->ptr<int>(i));
+      }
+    }
+
+  private:
+    GridCost cost_;
+    const cv::Mat* f_;
+    cv::Mat* d_;
+    cv::Mat* j_star_;
+};
+
+// Distance transforms one tile of columns of d in place and finds the
+// minimizers using the minimizers j_star of the row pass.
+class GridDistanceTransformColumns {
+  public:
+    GridDistanceTransformColumns(const GridCost& cost,
+                                 cv::Mat& d,
+                                 const cv::Mat& j_star,
+                                 cv::Mat& arg)
+        : cost_(cost), d_(&d), j_star_(&j_star), arg_(&arg) {}
+
+    void operator()(int tile) const {
+      int m = d_->rows;
+      int begin = tile * COLUMN_TILE_SIZE;
+      int end = std::min(begin + COLUMN_TILE_SIZE, d_->cols);
+      int width = end - begin;
+
+      // Transpose the tile so that each column is contiguous.
+      std::vector<double> columns(width * m);
+      for (int i = 0; i < m; i += 1) {
+        const double* row = d_->ptr<double>(i) + begin;
+        for (int j = 0; j < width; j += 1) {
+          columns[j * m + i] = row[j];
+        }
+      }
+
+      std::vector<int> v(m);
+      std::vector<double> z(m);
+      std::vector<double> y(width * m);
+      std::vector<int> i_star(width * m);
+
+      for (int j = 0; j < width; j += 1) {
+        gridDistanceTransform(cost_, &columns[j * m], m, &v.front(),
+            &z.front(), &y[j * m], &i_star[j * m]);
+      }
+
+      // Transpose back.
+      for (int i = 0; i < m; i += 1) {
+        double* row = d_->ptr<double>(i) + begin;
+        cv::Vec2i* args = arg_->ptr<cv::Vec2i>(i) + begin;
+
+        for (int j = 0; j < width; j += 1) {
+          int i_dash = i_star[j * m + i];
+          int j_dash = j_star_->at<int>(i_dash, begin + j);
+          row[j] = y[j * m + i];
+          args[j] = cv::Vec2i(i_dash, j_dash);
+        }
+      }
+    }
+
+  private:
+    GridCost cost_;
+    cv::Mat* d_;
+    const cv::Mat* j_star_;
+    cv::Mat* arg_;
+};
+
+// Computes the untruncated distance transform of the rows and then the
+// columns. Runs in parallel if a pool is given.
+void separableDistanceTransform2D(const cv::Mat& f,
+                                  const GridCost& cost,
+                                  cv::Mat& d,
+                                  cv::Mat& arg,
+                                  ThreadPool* pool) {
   CHECK(f.type() == cv::DataType<double>::type);
 
-  // Distance transform for j given i.
+  // The result must not share memory with the input.
   d.create(f.rows, f.cols, cv::DataType<double>::type);
+  if (d.data == f.data) {
+    d = cv::Mat(f.rows, f.cols, cv::DataType<double>::type);
+  }
+  arg.create(f.rows, f.cols, cv::DataType<cv::Vec2i>::type);
+  if (f.rows == 0 || f.cols == 0) {
+    return;
+  }
+
+  // Distance transform for j given i.
   cv::Mat j_star(f.rows, f.cols, cv::DataType<int>::type);
 
-  // Distance transform each row.
-  for (int i = 0; i < f.rows; i += 1) {
-    // Extract row.
-    std::vector<double> g(f.cols);
-    for (int j = 0; j < f.cols; j += 1) {
-      g[j] = f.at<double>(i, j);
+  int num_row_blocks = (f.rows + ROW_BLOCK_SIZE - 1) / ROW_BLOCK_SIZE;
+  int num_tiles = (f.cols + COLUMN_TILE_SIZE - 1) / COLUMN_TILE_SIZE;
+  GridDistanceTransformRows rows(cost, f, d, j_star);
+  GridDistanceTransformColumns columns(cost, d, j_star, arg);
+
+  if (pool == NULL || pool->numThreads() == 0) {
+    for (int block = 0; block < num_row_blocks; block += 1) {
+      rows(block);
     }
+    for (int tile = 0; tile < num_tiles; tile += 1) {
+      columns(tile);
+    }
+  } else {
+    // The column pass needs every row to be finished.
+    pool->parallelFor(0, num_row_blocks, rows);
+    pool->parallelFor(0, num_tiles, columns);
+  }
+}
+
+// Runs in parallel if a pool is given.
+void quadraticDistanceTransform2D(const cv::Mat& f,
+                                  cv::Mat& d,
+                                  cv::Mat& arg,
+                                  ThreadPool* pool) {
+  separableDistanceTransform2D(f, GridCost(GridCost::QUADRATIC, 1), d, arg,
+      pool);
+}
+
+}
+
+void quadraticDistanceTransform2D(const cv::Mat& f, cv::Mat& d, cv::Mat& arg) {
+  quadraticDistanceTransform2D(f, d, arg, NULL);
+}
+
+void quadraticDistanceTransform2D(const cv::Mat& f,
+                                  cv::Mat& d,
+                                  cv::Mat& arg,
+                                  ThreadPool& pool) {
+  quadraticDistanceTransform2D(f, d, arg, &pool);
+}
+
+namespace {
+
+// Runs in parallel if a pool is given.
+double solveViterbiQuadratic2D(const std::vector<cv::Mat>& g,
+                               std::vector<cv::Vec2i>& x,
+                               ThreadPool* pool) {
+  CHECK(!g.empty());
+
+  int n = g.size();
+  cv::Size size = g.front().size();
+
+  cv::Mat f = g[0];
+  std::vector<cv::Mat> args(n - 1);
+
+  for (int i = 0; i < n - 1; i += 1) {
+    // Compute distance transform for next variable.
+    cv::Mat d;
+    quadraticDistanceTransform2D(f, d, args[i], pool);
+    f = d + g[i + 1];
+  }
+
+  // Find arg in final table.
+  x.assign(n, cv::Vec2i::all(-1));
+  double f_star;
+  cv::Point point;
+  cv::minMaxLoc(f, &f_star, NULL, &point, NULL);
+  // Convert from (x, y) back to (i, j).
+  x[n - 1] = cv::Vec2i(point.y, point.x);
+
+  // Trace solutions back.
+  for (int i = n - 1; i > 0; i -= 1) {
+    x[i - 1] = args[i - 1].at<cv::Vec2i>(x[i]);
+  }
+
+  return f_star;
+}
+
+}
+
+double solveViterbiQuadratic2D(const std::vector<cv::Mat>& g,
+                               std::vector<cv::Vec2i>& x) {
+  return solveViterbiQuadratic2D(g, x, NULL);
+}
+
+double solveViterbiQuadratic2D(const std::vector<cv::Mat>& g,
+                               std::vector<cv::Vec2i>& x,
+                               ThreadPool& pool) {
+  return solveViterbiQuadratic2D(g, x, &pool);
+}
+
+namespace {
+
+// Solves a chain keeping only every k-th forward table, with k about sqrt(n).
+// The argmin tables of each segment are recomputed from its first table
+// during the trace back, so every step is computed twice.
+//
+// A Chain provides
+//   typedef State, the table f of one variable,
+//   typedef Arg, the argmin table of one step,
+//   typedef Variable, the value of one variable,
+//   length(),
+//   initial(f), which sets f to the table of the first variable,
+//   step(i, f, next, arg), which computes the table of variable i + 1,
+//   minimum(f, x), which finds the minimizer of the last table,
+//   trace(arg, x), which gives the minimizer of variable i given that of i + 1.
+template<class Chain>
+double solveCheckpointed(const Chain& chain,
+                         std::vector<typename Chain::Variable>& x) {
+  typedef typename Chain::State State;
+  typedef typename Chain::Arg Arg;
+  typedef typename Chain::Variable Variable;
+
+  int n = chain.length();
+  CHECK(n > 0);
+  int interval = std::max(1, int(std::ceil(std::sqrt(double(n)))));
+
+  // Table of variable s * interval for each segment s.
+  std::deque<State> checkpoints;
+  State f;
+  chain.initial(f);
+
+  for (int i = 0; i < n - 1; i += 1) {
+    if (i % interval == 0) {
+      checkpoints.push_back(f);
+    }
+    State next;
+    Arg arg;
+    chain.step(i, f, next, arg);
+    f = next;
+  }
+  if (checkpoints.empty()) {
+    checkpoints.push_back(f);
+  }
+
+  x.assign(n, Variable());
+  double f_star = chain.minimum(f, x[n - 1]);
 
-    // Find distance transform.
-    std::vector<double> y;
-    std::vector<int> x;
-    quadraticDistanceTransform(g, y, x);
+  // Trace back one segment at a time, starting from the last.
+  for (int s = checkpoints.size() - 1; s >= 0; s -= 1) {
+    int begin = s * interval;
+    int end = std::min(begin + interval, n - 1);
 
-    for (int j = 0; j < f.cols; j += 1) {
-      d.at<double>(i, j) = y[j];
-      j_star.at<int>(i, j) = x[j];
+    std::vector<Arg> args(end - begin);
+    State f = checkpoints[s];
+    for (int i = begin; i < end; i += 1) {
+      State next;
+      chain.step(i, f, next, args[i - begin]);
+      f = next;
     }
+
+    for (int i = end; i > begin; i -= 1) {
+      x[i - 1] = chain.trace(args[i - 1 - begin], x[i]);
+    }
+
+    // Release the table as soon as its segment is done.
+    checkpoints.pop_back();
   }
 
-  cv::Mat i_star(f.rows, f.cols, cv::DataType<int>::type);
+  return f_star;
+}
+
+// The chain of solveViterbiQuadratic2D().
+class Quadratic2DChain {
+  public:
+    typedef cv::Mat State;
+    typedef cv::Mat Arg;
+    typedef cv::Vec2i Variable;
+
+    // The pool may be NULL.
+    Quadratic2DChain(const UnaryTerms2D& g, ThreadPool* pool)
+        : g_(&g), pool_(pool) {}
+
+    int length() const {
+      return g_->length();
+    }
+
+    void initial(cv::Mat& f) const {
+      g_->get(0, f);
+    }
+
+    void step(int i, const cv::Mat& f, cv::Mat& next, cv::Mat& arg) const {
+      cv::Mat d;
+      quadraticDistanceTransform2D(f, d, arg, pool_);
+      cv::Mat g;
+      g_->get(i + 1, g);
+      next = d + g;
+    }
+
+    double minimum(const cv::Mat& f, cv::Vec2i& x) const {
+      double f_star;
+      cv::Point point;
+      cv::minMaxLoc(f, &f_star, NULL, &point, NULL);
+      // Convert from (x, y) back to (i, j).
+      x = cv::Vec2i(point.y, point.x);
+      return f_star;
+    }
 
-  // Distance transform each column.
-  for (int j = 0; j < f.cols; j += 1) {
-    // Copy column into vector.
-    std::vector<double> g(f.rows);
-    for (int i = 0; i < f.rows; i += 1) {
-      g[i] = d.at<double>(i, j);
+    cv::Vec2i trace(const cv::Mat& arg, const cv::Vec2i& x) const {
+      return arg.at<cv::Vec2i>(x);
     }
 
-    // Find distance transform.
-    std::vector<double> y;
-    std::vector<int> x;
-    quadraticDistanceTransform(g, y, x);
+  private:
+    const UnaryTerms2D* g_;
+    ThreadPool* pool_;
+};
+
+}
+
+UnaryTerms2D::~UnaryTerms2D() {}
+
+VectorUnaryTerms2D::VectorUnaryTerms2D(const std::vector<cv::Mat>& g)
+    : g_(&g) {}
+
+int VectorUnaryTerms2D::length() const {
+  return g_->size();
+}
+
+void VectorUnaryTerms2D::get(int i, cv::Mat& g) const {
+  g = (*g_)[i];
+}
+
+double solveViterbiQuadratic2DCheckpointed(const UnaryTerms2D& g,
+                                           std::vector<cv::Vec2i>& x) {
+  return solveCheckpointed(Quadratic2DChain(g, NULL), x);
+}
+
+double solveViterbiQuadratic2DCheckpointed(const UnaryTerms2D& g,
+                                           std::vector<cv::Vec2i>& x,
+                                           ThreadPool& pool) {
+  return solveCheckpointed(Quadratic2DChain(g, &pool), x);
+}
+
+double solveViterbiQuadratic2DCheckpointed(const std::vector<cv::Mat>& g,
+                                           std::vector<cv::Vec2i>& x) {
+  CHECK(!g.empty());
+  return solveViterbiQuadratic2DCheckpointed(VectorUnaryTerms2D(g), x);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+GridCost::GridCost()
+    : kind(QUADRATIC),
+      weight(1),
+      truncation(std::numeric_limits<double>::infinity()) {}
+
+GridCost::GridCost(Kind kind, double weight)
+    : kind(kind),
+      weight(weight),
+      truncation(std::numeric_limits<double>::infinity()) {}
+
+GridCost::GridCost(Kind kind, double weight, double truncation)
+    : kind(kind), weight(weight), truncation(truncation) {}
+
+namespace {
+
+void checkGridCost(const GridCost& cost) {
+  if (cost.kind == GridCost::QUADRATIC) {
+    // The lower envelope divides by the weight.
+    CHECK(cost.weight > 0) << "Quadratic weight must be positive";
+  } else {
+    CHECK(cost.weight >= 0) << "Linear weight must not be negative";
+  }
+  CHECK(cost.truncation >= 0) << "Truncation must not be negative";
+}
+
+// Jumping from the minimum of f costs the truncation. Ties keep the
+// untruncated minimizer.
+void truncateDistanceTransform(const std::vector<double>& f,
+                               double truncation,
+                               std::vector<double>& d,
+                               std::vector<int>& arg) {
+  if (truncation == std::numeric_limits<double>::infinity()) {
+    return;
+  }
+  int q_star = std::min_element(f.begin(), f.end()) - f.begin();
+  double jump = f[q_star] + truncation;
 
-    for (int i = 0; i < f.rows; i += 1) {
-      d.at<double>(i, j) = y[i];
-      i_star.at<int>(i, j) = x[i];
+  int n = f.size();
+  for (int p = 0; p < n; p += 1) {
+    if (jump < d[p]) {
+      d[p] = jump;
+      arg[p] = q_star;
     }
   }
+}
 
-  arg.create(f.rows, f.cols, cv::DataType<cv::Vec2i>::type);
+void truncateDistanceTransform2D(const cv::Mat& f,
+                                 double truncation,
+                                 cv::Mat& d,
+                                 cv::Mat& arg) {
+  if (truncation == std::numeric_limits<double>::infinity()) {
+    return;
+  }
+  double f_min;
+  cv::Point point;
+  cv::minMaxLoc(f, &f_min, NULL, &point, NULL);
+  if (point.x == -1 && point.y == -1) {
+    // minMaxLoc does not work with +inf, and nothing is gained by jumping.
+    return;
+  }
+  double jump = f_min + truncation;
+  cv::Vec2i q_star(point.y, point.x);
+
+  for (int i = 0; i < d.rows; i += 1) {
+    double* d_i = d.ptr<double>(i);
+    cv::Vec2i* arg_i = arg.ptr<cv::Vec2i>(i);
 
-  for (int i = 0; i < f.rows; i += 1) {
-    for (int j = 0; j < f.cols; j += 1) {
-      int i_dash = i_star.at<int>(i, j);
-      int j_dash = j_star.at<int>(i_dash, j);
-      arg.at<cv::Vec2i>(i, j) = cv::Vec2i(i_dash, j_dash);
+    for (int j = 0; j < d.cols; j += 1) {
+      if (jump < d_i[j]) {
+        d_i[j] = jump;
+        arg_i[j] = q_star;
+      }
     }
   }
 }
 
-double solveViterbiQuadratic2D(const std::vector<cv::Mat>& g,
-                               std::vector<cv::Vec2i>& x) {
+// Runs in parallel if a pool is given.
+void gridDistanceTransform2D(const cv::Mat& f,
+                             const GridCost& cost,
+                             cv::Mat& d,
+                             cv::Mat& arg,
+                             ThreadPool* pool) {
+  checkGridCost(cost);
+  separableDistanceTransform2D(f, cost, d, arg, pool);
+  if (f.rows > 0 && f.cols > 0) {
+    truncateDistanceTransform2D(f, cost.truncation, d, arg);
+  }
+}
+
+// Runs in parallel if a pool is given.
+double solveViterbiGrid2D(const std::vector<cv::Mat>& g,
+                          const GridCost& cost,
+                          std::vector<cv::Vec2i>& x,
+                          ThreadPool* pool) {
   CHECK(!g.empty());
 
   int n = g.size();
-  cv::Size size = g.front().size();
-
   cv::Mat f = g[0];
   std::vector<cv::Mat> args(n - 1);
 
   for (int i = 0; i < n - 1; i += 1) {
     // Compute distance transform for next variable.
     cv::Mat d;
-    quadraticDistanceTransform2D(f, d, args[i]);
+    gridDistanceTransform2D(f, cost, d, args[i], pool);
     f = d + g[i + 1];
   }
 
@@ -261,6 +1159,11 @@ double solveViterbiQuadratic2D(const std::vector<cv::Mat>& g,
   double f_star;
   cv::Point point;
   cv::minMaxLoc(f, &f_star, NULL, &point, NULL);
+  if (point.x == -1 && point.y == -1) {
+    // minMaxLoc does not work with +inf.
+    f_star = std::numeric_limits<double>::infinity();
+    point = cv::Point(0, 0);
+  }
   // Convert from (x, y) back to (i, j).
   x[n - 1] = cv::Vec2i(point.y, point.x);
 
@@ -272,6 +1175,99 @@ double solveViterbiQuadratic2D(const std::vector<cv::Mat>& g,
   return f_star;
 }
 
+}
+
+void gridDistanceTransform(const std::vector<double>& f,
+                           const GridCost& cost,
+                           std::vector<double>& d,
+                           std::vector<int>& arg) {
+  checkGridCost(cost);
+  int n = f.size();
+  d.resize(n);
+  arg.resize(n);
+  if (n == 0) {
+    return;
+  }
+
+  std::vector<int> v(n);
+  std::vector<double> z(n);
+  gridDistanceTransform(cost, &f.front(), n, &v.front(), &z.front(),
+      &d.front(), &arg.front());
+  truncateDistanceTransform(f, cost.truncation, d, arg);
+}
+
+void gridDistanceTransform2D(const cv::Mat& f,
+                             const GridCost& cost,
+                             cv::Mat& d,
+                             cv::Mat& arg) {
+  gridDistanceTransform2D(f, cost, d, arg, NULL);
+}
+
+void gridDistanceTransform2D(const cv::Mat& f,
+                             const GridCost& cost,
+                             cv::Mat& d,
+                             cv::Mat& arg,
+                             ThreadPool& pool) {
+  gridDistanceTransform2D(f, cost, d, arg, &pool);
+}
+
+double solveViterbiGrid(const std::deque<std::vector<double> >& g,
+                        const GridCost& cost,
+                        std::vector<int>& x) {
+  CHECK(!g.empty());
+  int n = g.size();
+  int k = g[0].size();
+  std::deque<std::vector<int> > args(n - 1);
+
+  std::vector<double> f = g[0];
+  std::vector<double> d;
+
+  for (int i = 0; i < n - 1; i += 1) {
+    CHECK(int(g[i + 1].size()) == k) << "Grid sizes differ";
+    // Compute distance transform for next variable.
+    gridDistanceTransform(f, cost, d, args[i]);
+
+    for (int j = 0; j < k; j += 1) {
+      f[j] = d[j] + g[i + 1][j];
+    }
+  }
+
+  x.assign(n, -1);
+
+  // Find minimum element in final table.
+  double f_star = 0;
+  int j_star = -1;
+
+  for (int j = 0; j < k; j += 1) {
+    if (j == 0 || f[j] < f_star) {
+      f_star = f[j];
+      j_star = j;
+    }
+  }
+
+  x[n - 1] = j_star;
+
+  // Trace solutions back.
+  for (int i = n - 1; i > 0; i -= 1) {
+    x[i - 1] = args[i - 1][x[i]];
+  }
+
+  return f_star;
+}
+
+double solveViterbiGrid2D(const std::vector<cv::Mat>& g,
+                          const GridCost& cost,
+                          std::vector<cv::Vec2i>& x) {
+  return solveViterbiGrid2D(g, cost, x, NULL);
+}
+
+double solveViterbiGrid2D(const std::vector<cv::Mat>& g,
+                          const GridCost& cost,
+                          std::vector<cv::Vec2i>& x,
+                          ThreadPool& pool) {
+  return solveViterbiGrid2D(g, cost, x, &pool);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 MixedVariable::MixedVariable() : set(-1), two_d(-1, -1), one_d(-1) {}
@@ -342,156 +1338,240 @@ void distanceTransform1D2D(const std::vector<double>& f,
   arg = cv::Mat(vec_arg, true).reshape(1, p);
 }
 
-double solveViterbiPartialQuadratic2D(
-    const std::vector<cv::Mat>& g_A,
-    const std::deque<std::vector<double> >& g_B,
-    const std::vector<cv::Mat>& h_AB,
-    const std::vector<cv::Mat>& h_BA,
-    const std::vector<cv::Mat>& h_BB,
-    std::vector<MixedVariable>& x) {
-  // Check sequences of unary terms have same length.
-  int n = g_A.size();
-  CHECK(g_B.size() == n);
-  // Check binary terms are appropriate length.
-  CHECK(h_BB.size() == n - 1);
-  CHECK(h_AB.size() == n - 1);
-  CHECK(h_BA.size() == n - 1);
-
-  // Initialize partial solutions to unary term.
-  cv::Mat f_A = g_A[0];
-  std::vector<double> f_B = g_B[0];
-
-  // Minimizer of each update.
-  std::deque<std::deque<std::vector<MixedVariable> > > args_A;
-  std::deque<std::vector<MixedVariable> > args_B;
-
-  for (int i = 0; i < n - 1; i += 1) {
-    // Compute distance transform.
-    cv::Mat d_AA;
-    cv::Mat args_AA;
-    quadraticDistanceTransform2D(f_A, d_AA, args_AA);
-
-    std::vector<double> d_AB;
-    std::vector<cv::Vec2i> args_AB;
-    distanceTransform2D1D(f_A, h_AB[i], d_AB, args_AB);
-
-    cv::Mat d_BA;
-    cv::Mat args_BA;
-    distanceTransform1D2D(f_B, h_BA[i], d_BA, args_BA);
+namespace {
+
+// Tables of the partial solutions ending in either set.
+struct PartialQuadratic2DState {
+  cv::Mat A;
+  std::vector<double> B;
+};
+
+// Minimizers of one step of solveViterbiPartialQuadratic2D().
+struct PartialQuadratic2DArg {
+  std::deque<std::vector<MixedVariable> > A;
+  std::vector<MixedVariable> B;
+};
+
+// The terms of solveViterbiPartialQuadratic2D().
+class PartialQuadratic2DChain {
+  public:
+    typedef PartialQuadratic2DState State;
+    typedef PartialQuadratic2DArg Arg;
+    typedef MixedVariable Variable;
+
+    PartialQuadratic2DChain(const std::vector<cv::Mat>& g_A,
+                            const std::deque<std::vector<double> >& g_B,
+                            const std::vector<cv::Mat>& h_AB,
+                            const std::vector<cv::Mat>& h_BA,
+                            const std::vector<cv::Mat>& h_BB)
+        : g_A_(&g_A), g_B_(&g_B), h_AB_(&h_AB), h_BA_(&h_BA), h_BB_(&h_BB) {
+      // Check sequences of unary terms have same length.
+      int n = g_A.size();
+      CHECK(g_B.size() == n);
+      // Check binary terms are appropriate length.
+      CHECK(h_BB.size() == n - 1);
+      CHECK(h_AB.size() == n - 1);
+      CHECK(h_BA.size() == n - 1);
+    }
 
-    std::vector<double> d_BB;
-    std::vector<int> args_BB;
-    distanceTransform(f_B, h_BB[i], d_BB, args_BB);
+    int length() const {
+      return g_A_->size();
+    }
 
-    // Take min over the two sets.
+    void initial(State& f) const {
+      // Initialize partial solutions to unary term.
+      f.A = (*g_A_)[0];
+      f.B = (*g_B_)[0];
+    }
 
-    // Dimensions of distance transform component.
-    int p = g_A[i].rows;
-    int q = g_A[i].cols;
+    void step(int i, const State& f, State& next, Arg& arg) const;
+    double minimum(const State& f, MixedVariable& x) const;
+    MixedVariable trace(const Arg& arg, const MixedVariable& x) const;
+
+  private:
+    const std::vector<cv::Mat>* g_A_;
+    const std::deque<std::vector<double> >* g_B_;
+    const std::vector<cv::Mat>* h_AB_;
+    const std::vector<cv::Mat>* h_BA_;
+    const std::vector<cv::Mat>* h_BB_;
+};
+
+void PartialQuadratic2DChain::step(int i,
+                                   const State& f,
+                                   State& next,
+                                   Arg& arg) const {
+  const std::vector<cv::Mat>& g_A = *g_A_;
+  const std::deque<std::vector<double> >& g_B = *g_B_;
+
+  // Compute distance transform.
+  cv::Mat d_AA;
+  cv::Mat args_AA;
+  quadraticDistanceTransform2D(f.A, d_AA, args_AA, NULL);
+
+  std::vector<double> d_AB;
+  std::vector<cv::Vec2i> args_AB;
+  distanceTransform2D1D(f.A, (*h_AB_)[i], d_AB, args_AB);
+
+  cv::Mat d_BA;
+  cv::Mat args_BA;
+  distanceTransform1D2D(f.B, (*h_BA_)[i], d_BA, args_BA);
+
+  std::vector<double> d_BB;
+  std::vector<int> args_BB;
+  distanceTransform(f.B, (*h_BB_)[i], d_BB, args_BB, NULL);
+
+  // Take min over the two sets.
+
+  // Dimensions of distance transform component.
+  int p = g_A[i].rows;
+  int q = g_A[i].cols;
+
+  if (g_A[i].empty() || g_A[i + 1].empty()) {
+    p = 0;
+    q = 0;
+  } else {
+    CHECK(g_A[i].rows == g_A[i + 1].rows);
+    CHECK(g_A[i].cols == g_A[i + 1].cols);
+  }
 
-    if (g_A[i].empty() || g_A[i + 1].empty()) {
-      p = 0;
-      q = 0;
-    } else {
-      CHECK(g_A[i].rows == g_A[i + 1].rows);
-      CHECK(g_A[i].cols == g_A[i + 1].cols);
-    }
-
-    cv::Mat d_A = cv::Mat_<double>(p, q);
-    std::deque<std::vector<MixedVariable> > args_A_i(p);
-    for (int u = 0; u < p; u += 1) {
-      args_A_i[u].assign(q, MixedVariable());
-    }
-
-    for (int u = 0; u < p; u += 1) {
-      for (int v = 0; v < q; v += 1) {
-        if (d_BA.at<double>(u, v) < d_AA.at<double>(u, v)) {
-          d_A.at<double>(u, v) = d_BA.at<double>(u, v);
-          args_A_i[u][v].set = 1;
-          args_A_i[u][v].one_d = args_BA.at<int>(u, v);
-        } else {
-          d_A.at<double>(u, v) = d_AA.at<double>(u, v);
-          args_A_i[u][v].set = 0;
-          args_A_i[u][v].two_d = args_AA.at<cv::Vec2i>(u, v);
-        }
-      }
-    }
+  cv::Mat d_A = cv::Mat_<double>(p, q);
+  std::deque<std::vector<MixedVariable> > args_A_i(p);
+  for (int u = 0; u < p; u += 1) {
+    args_A_i[u].assign(q, MixedVariable());
+  }
 
-    int k_B = g_B[i + 1].size();
-    std::vector<double> d_B(k_B);
-    std::vector<MixedVariable> args_B_i(k_B);
-    for (int u = 0; u < k_B; u += 1) {
-      if (d_BB[u] < d_AB[u]) {
-        d_B[u] = d_BB[u];
-        args_B_i[u].set = 1;
-        args_B_i[u].one_d = args_BB[u];
+  for (int u = 0; u < p; u += 1) {
+    for (int v = 0; v < q; v += 1) {
+      if (d_BA.at<double>(u, v) < d_AA.at<double>(u, v)) {
+        d_A.at<double>(u, v) = d_BA.at<double>(u, v);
+        args_A_i[u][v].set = 1;
+        args_A_i[u][v].one_d = args_BA.at<int>(u, v);
       } else {
-        d_B[u] = d_AB[u];
-        args_B_i[u].set = 0;
-        args_B_i[u].two_d = args_AB[u];
+        d_A.at<double>(u, v) = d_AA.at<double>(u, v);
+        args_A_i[u][v].set = 0;
+        args_A_i[u][v].two_d = args_AA.at<cv::Vec2i>(u, v);
       }
     }
+  }
 
-    args_A.push_back(args_A_i);
-    args_B.push_back(args_B_i);
-
-    // Add unary terms to result of distance transform.
-    f_A = d_A + g_A[i + 1];
-    f_B.assign(k_B, 0);
-    for (int u = 0; u < k_B; u += 1) {
-      f_B[u] = d_B[u] + g_B[i + 1][u];
+  int k_B = g_B[i + 1].size();
+  std::vector<double> d_B(k_B);
+  std::vector<MixedVariable> args_B_i(k_B);
+  for (int u = 0; u < k_B; u += 1) {
+    if (d_BB[u] < d_AB[u]) {
+      d_B[u] = d_BB[u];
+      args_B_i[u].set = 1;
+      args_B_i[u].one_d = args_BB[u];
+    } else {
+      d_B[u] = d_AB[u];
+      args_B_i[u].set = 0;
+      args_B_i[u].two_d = args_AB[u];
     }
   }
 
-  x.assign(n, MixedVariable());
-  double f_star;
+  arg.A.swap(args_A_i);
+  arg.B.swap(args_B_i);
 
+  // Add unary terms to result of distance transform.
+  next.A = d_A + g_A[i + 1];
+  next.B.assign(k_B, 0);
+  for (int u = 0; u < k_B; u += 1) {
+    next.B[u] = d_B[u] + g_B[i + 1][u];
+  }
+}
+
+double PartialQuadratic2DChain::minimum(const State& f,
+                                        MixedVariable& x) const {
   // Find minimum element in final table.
-  {
-    double f_star_A = 0;
-    cv::Point point;
-    cv::minMaxLoc(f_A, &f_star_A, NULL, &point, NULL);
-    if (point.x == -1 && point.y == -1) {
-      // minMaxLoc does not work with infinities.
-      point = cv::Point(0, 0);
-      f_star_A = std::numeric_limits<double>::infinity();
-    }
-    cv::Vec2i x_star_A(point.y, point.x);
-
-    double f_star_B = 0;
-    int x_star_B = -1;
-    int k_B = g_B[n - 1].size();
-    for (int u = 0; u < k_B; u += 1) {
-      if (u == 0 || f_B[u] < f_star_B) {
-        f_star_B = f_B[u];
-        x_star_B = u;
-      }
-    }
+  double f_star_A = 0;
+  cv::Point point;
+  cv::minMaxLoc(f.A, &f_star_A, NULL, &point, NULL);
+  if (point.x == -1 && point.y == -1) {
+    // minMaxLoc does not work with infinities.
+    point = cv::Point(0, 0);
+    f_star_A = std::numeric_limits<double>::infinity();
+  }
+  cv::Vec2i x_star_A(point.y, point.x);
 
-    if (f_star_B < f_star_A) {
-      f_star = f_star_B;
-      x[n - 1].set = 1;
-      x[n - 1].one_d = x_star_B;
-    } else {
-      f_star = f_star_A;
-      x[n - 1].set = 0;
-      x[n - 1].two_d = x_star_A;
+  double f_star_B = 0;
+  int x_star_B = -1;
+  int k_B = f.B.size();
+  for (int u = 0; u < k_B; u += 1) {
+    if (u == 0 || f.B[u] < f_star_B) {
+      f_star_B = f.B[u];
+      x_star_B = u;
     }
   }
 
+  x = MixedVariable();
+  if (f_star_B < f_star_A) {
+    x.set = 1;
+    x.one_d = x_star_B;
+    return f_star_B;
+  } else {
+    x.set = 0;
+    x.two_d = x_star_A;
+    return f_star_A;
+  }
+}
+
+MixedVariable PartialQuadratic2DChain::trace(const Arg& arg,
+                                             const MixedVariable& x) const {
+  if (x.set == 0) {
+    cv::Vec2i index = x.two_d;
+    return arg.A[index[0]][index[1]];
+  } else {
+    return arg.B[x.one_d];
+  }
+}
+
+}
+
+double solveViterbiPartialQuadratic2D(
+    const std::vector<cv::Mat>& g_A,
+    const std::deque<std::vector<double> >& g_B,
+    const std::vector<cv::Mat>& h_AB,
+    const std::vector<cv::Mat>& h_BA,
+    const std::vector<cv::Mat>& h_BB,
+    std::vector<MixedVariable>& x) {
+  PartialQuadratic2DChain chain(g_A, g_B, h_AB, h_BA, h_BB);
+  int n = chain.length();
+
+  PartialQuadratic2DState f;
+  chain.initial(f);
+
+  // Minimizer of each update.
+  std::deque<PartialQuadratic2DArg> args(n - 1);
+
+  for (int i = 0; i < n - 1; i += 1) {
+    PartialQuadratic2DState next;
+    chain.step(i, f, next, args[i]);
+    f.A = next.A;
+    f.B.swap(next.B);
+  }
+
+  x.assign(n, MixedVariable());
+  double f_star = chain.minimum(f, x[n - 1]);
+
   // Trace solutions back.
   for (int i = n - 1; i > 0; i -= 1) {
-    if (x[i].set == 0) {
-      cv::Vec2i index = x[i].two_d;
-      x[i - 1] = args_A[i - 1][index[0]][index[1]];
-    } else {
-      x[i - 1] = args_B[i - 1][x[i].one_d];
-    }
+    x[i - 1] = chain.trace(args[i - 1], x[i]);
   }
 
   return f_star;
 }
 
+double solveViterbiPartialQuadratic2DCheckpointed(
+    const std::vector<cv::Mat>& g_A,
+    const std::deque<std::vector<double> >& g_B,
+    const std::vector<cv::Mat>& h_AB,
+    const std::vector<cv::Mat>& h_BA,
+    const std::vector<cv::Mat>& h_BB,
+    std::vector<MixedVariable>& x) {
+  return solveCheckpointed(
+      PartialQuadratic2DChain(g_A, g_B, h_AB, h_BA, h_BB), x);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 SplitVariable::SplitVariable() : set(-1), index(-1, -1) {}
@@ -538,103 +1618,153 @@ void distanceTransform2D(const cv::Mat& f,
   arg = cv::Mat(vec_arg, true).reshape(1, m);
 }
 
-double solveViterbiSplitQuadratic2D(
-    const std::vector<cv::Mat>& g_A,
-    const std::vector<cv::Mat>& g_B,
-    std::vector<SplitVariable>& x) {
-  // Check sequences of unary terms have same length.
-  int length = g_A.size();
-  CHECK(g_B.size() == length);
+namespace {
+
+// Tables of the partial solutions ending in either set.
+struct SplitQuadratic2DState {
+  cv::Mat A;
+  cv::Mat B;
+};
+
+// Minimizers of one step of solveViterbiSplitQuadratic2D().
+struct SplitQuadratic2DArg {
+  std::deque<std::vector<SplitVariable> > A;
+  std::deque<std::vector<SplitVariable> > B;
+};
+
+// The terms of solveViterbiSplitQuadratic2D().
+class SplitQuadratic2DChain {
+  public:
+    typedef SplitQuadratic2DState State;
+    typedef SplitQuadratic2DArg Arg;
+    typedef SplitVariable Variable;
+
+    // The pool may be NULL.
+    SplitQuadratic2DChain(const UnaryTerms2D& g_A,
+                          const UnaryTerms2D& g_B,
+                          ThreadPool* pool)
+        : g_A_(&g_A), g_B_(&g_B), pool_(pool) {
+      // Check sequences of unary terms have same length.
+      CHECK(g_A.length() == g_B.length());
+    }
 
-  // Initialize partial solutions to unary term.
-  cv::Mat f_A = g_A[0].clone();
-  cv::Mat f_B = g_B[0].clone();
+    int length() const {
+      return g_A_->length();
+    }
 
-  // Currently only support quadratic distance transforms of same dimension.
-  CHECK(f_A.rows == f_B.rows);
-  CHECK(f_A.cols == f_B.cols);
-  int p = f_A.rows;
-  int q = f_A.cols;
+    void initial(State& f) const {
+      // Initialize partial solutions to unary term.
+      cv::Mat g_A;
+      g_A_->get(0, g_A);
+      f.A = g_A.clone();
+      cv::Mat g_B;
+      g_B_->get(0, g_B);
+      f.B = g_B.clone();
+
+      // Currently only support quadratic distance transforms of same
+      // dimension.
+      CHECK(f.A.rows == f.B.rows);
+      CHECK(f.A.cols == f.B.cols);
+    }
 
-  // Minimizer of each update.
-  std::deque<std::deque<std::vector<SplitVariable> > > args_A;
-  std::deque<std::deque<std::vector<SplitVariable> > > args_B;
+    void step(int t, const State& f, State& next, Arg& arg) const;
+    double minimum(const State& f, SplitVariable& x) const;
 
-  for (int t = 0; t < length - 1; t += 1) {
-    // Compute distance transform.
-    cv::Mat d_AA;
-    cv::Mat args_AA;
-    quadraticDistanceTransform2D(f_A, d_AA, args_AA);
-
-    cv::Mat d_AB;
-    cv::Mat args_AB;
-    quadraticDistanceTransform2D(f_A, d_AB, args_AB);
-
-    cv::Mat d_BA;
-    cv::Mat args_BA;
-    quadraticDistanceTransform2D(f_B, d_BA, args_BA);
-
-    cv::Mat d_BB;
-    cv::Mat args_BB;
-    quadraticDistanceTransform2D(f_B, d_BB, args_BB);
-
-    // Take min transitioning from either set to A.
-    cv::Mat d_A = cv::Mat_<double>(p, q);
-    std::deque<std::vector<SplitVariable> > args_A_t(p);
-    for (int u = 0; u < p; u += 1) {
-      args_A_t[u].assign(q, SplitVariable());
-    }
-
-    for (int u = 0; u < p; u += 1) {
-      for (int v = 0; v < q; v += 1) {
-        if (d_AA.at<double>(u, v) <= d_BA.at<double>(u, v)) {
-          d_A.at<double>(u, v) = d_AA.at<double>(u, v);
-          args_A_t[u][v].set = 0;
-          args_A_t[u][v].index = args_AA.at<cv::Vec2i>(u, v);
-        } else {
-          d_A.at<double>(u, v) = d_BA.at<double>(u, v);
-          args_A_t[u][v].set = 1;
-          args_A_t[u][v].index = args_BA.at<cv::Vec2i>(u, v);
-        }
+    SplitVariable trace(const Arg& arg, const SplitVariable& x) const {
+      cv::Vec2i index = x.index;
+      if (x.set == 0) {
+        return arg.A[index[0]][index[1]];
+      } else {
+        return arg.B[index[0]][index[1]];
       }
     }
 
-    // Take min transitioning from either set to B.
-    cv::Mat d_B = cv::Mat_<double>(p, q);
-    std::deque<std::vector<SplitVariable> > args_B_t(p);
-    for (int u = 0; u < p; u += 1) {
-      args_B_t[u].assign(q, SplitVariable());
-    }
+  private:
+    const UnaryTerms2D* g_A_;
+    const UnaryTerms2D* g_B_;
+    ThreadPool* pool_;
+};
+
+void SplitQuadratic2DChain::step(int t,
+                                 const State& f,
+                                 State& next,
+                                 Arg& arg) const {
+  int p = f.A.rows;
+  int q = f.A.cols;
+
+  // Compute distance transform. Transitions from a set are the same
+  // whichever set they go to.
+  cv::Mat d_AA;
+  cv::Mat args_AA;
+  quadraticDistanceTransform2D(f.A, d_AA, args_AA, pool_);
+  const cv::Mat& d_AB = d_AA;
+  const cv::Mat& args_AB = args_AA;
+
+  cv::Mat d_BA;
+  cv::Mat args_BA;
+  quadraticDistanceTransform2D(f.B, d_BA, args_BA, pool_);
+  const cv::Mat& d_BB = d_BA;
+  const cv::Mat& args_BB = args_BA;
+
+  // Take min transitioning from either set to A.
+  cv::Mat d_A = cv::Mat_<double>(p, q);
+  std::deque<std::vector<SplitVariable> > args_A_t(p);
+  for (int u = 0; u < p; u += 1) {
+    args_A_t[u].assign(q, SplitVariable());
+  }
 
-    for (int u = 0; u < p; u += 1) {
-      for (int v = 0; v < q; v += 1) {
-        if (d_AB.at<double>(u, v) <= d_BB.at<double>(u, v)) {
-          d_B.at<double>(u, v) = d_AB.at<double>(u, v);
-          args_B_t[u][v].set = 0;
-          args_B_t[u][v].index = args_AB.at<cv::Vec2i>(u, v);
-        } else {
-          d_B.at<double>(u, v) = d_BB.at<double>(u, v);
-          args_B_t[u][v].set = 1;
-          args_B_t[u][v].index = args_BB.at<cv::Vec2i>(u, v);
-        }
+  for (int u = 0; u < p; u += 1) {
+    for (int v = 0; v < q; v += 1) {
+      if (d_AA.at<double>(u, v) <= d_BA.at<double>(u, v)) {
+        d_A.at<double>(u, v) = d_AA.at<double>(u, v);
+        args_A_t[u][v].set = 0;
+        args_A_t[u][v].index = args_AA.at<cv::Vec2i>(u, v);
+      } else {
+        d_A.at<double>(u, v) = d_BA.at<double>(u, v);
+        args_A_t[u][v].set = 1;
+        args_A_t[u][v].index = args_BA.at<cv::Vec2i>(u, v);
       }
     }
+  }
 
-    args_A.push_back(args_A_t);
-    args_B.push_back(args_B_t);
+  // Take min transitioning from either set to B.
+  cv::Mat d_B = cv::Mat_<double>(p, q);
+  std::deque<std::vector<SplitVariable> > args_B_t(p);
+  for (int u = 0; u < p; u += 1) {
+    args_B_t[u].assign(q, SplitVariable());
+  }
 
-    // Add unary terms to result of distance transform.
-    f_A = d_A + g_A[t + 1];
-    f_B = d_B + g_B[t + 1];
+  for (int u = 0; u < p; u += 1) {
+    for (int v = 0; v < q; v += 1) {
+      if (d_AB.at<double>(u, v) <= d_BB.at<double>(u, v)) {
+        d_B.at<double>(u, v) = d_AB.at<double>(u, v);
+        args_B_t[u][v].set = 0;
+        args_B_t[u][v].index = args_AB.at<cv::Vec2i>(u, v);
+      } else {
+        d_B.at<double>(u, v) = d_BB.at<double>(u, v);
+        args_B_t[u][v].set = 1;
+        args_B_t[u][v].index = args_BB.at<cv::Vec2i>(u, v);
+      }
+    }
   }
 
-  x.assign(length, SplitVariable());
-  double f_star;
+  arg.A.swap(args_A_t);
+  arg.B.swap(args_B_t);
 
+  // Add unary terms to result of distance transform.
+  cv::Mat g_A;
+  g_A_->get(t + 1, g_A);
+  next.A = d_A + g_A;
+  cv::Mat g_B;
+  g_B_->get(t + 1, g_B);
+  next.B = d_B + g_B;
+}
+
+double SplitQuadratic2DChain::minimum(const State& f, SplitVariable& x) const {
   // Find minimum element in final table.
   double f_star_A = 0;
   cv::Point point;
-  cv::minMaxLoc(f_A, &f_star_A, NULL, &point, NULL);
+  cv::minMaxLoc(f.A, &f_star_A, NULL, &point, NULL);
   if (point.x == -1 && point.y == -1) {
     // minMaxLoc does not work with +inf.
     f_star_A = std::numeric_limits<double>::infinity();
@@ -643,7 +1773,7 @@ double solveViterbiSplitQuadratic2D(
   cv::Vec2i x_star_A(point.y, point.x);
 
   double f_star_B = 0;
-  cv::minMaxLoc(f_B, &f_star_B, NULL, &point, NULL);
+  cv::minMaxLoc(f.B, &f_star_B, NULL, &point, NULL);
   if (point.x == -1 && point.y == -1) {
     // minMaxLoc does not work with +inf.
     f_star_B = std::numeric_limits<double>::infinity();
@@ -651,25 +1781,86 @@ double solveViterbiSplitQuadratic2D(
   }
   cv::Vec2i x_star_B(point.y, point.x);
 
+  x = SplitVariable();
   if (f_star_A <= f_star_B) {
-    f_star = f_star_A;
-    x[length - 1].set = 0;
-    x[length - 1].index = x_star_A;
+    x.set = 0;
+    x.index = x_star_A;
+    return f_star_A;
   } else {
-    f_star = f_star_B;
-    x[length - 1].set = 1;
-    x[length - 1].index = x_star_B;
+    x.set = 1;
+    x.index = x_star_B;
+    return f_star_B;
   }
+}
+
+// Runs in parallel if a pool is given.
+double solveViterbiSplitQuadratic2D(
+    const std::vector<cv::Mat>& g_A,
+    const std::vector<cv::Mat>& g_B,
+    std::vector<SplitVariable>& x,
+    ThreadPool* pool) {
+  VectorUnaryTerms2D terms_A(g_A);
+  VectorUnaryTerms2D terms_B(g_B);
+  SplitQuadratic2DChain chain(terms_A, terms_B, pool);
+  int length = chain.length();
+
+  SplitQuadratic2DState f;
+  chain.initial(f);
+
+  // Minimizer of each update.
+  std::deque<SplitQuadratic2DArg> args(length - 1);
+
+  for (int t = 0; t < length - 1; t += 1) {
+    SplitQuadratic2DState next;
+    chain.step(t, f, next, args[t]);
+    f = next;
+  }
+
+  x.assign(length, SplitVariable());
+  double f_star = chain.minimum(f, x[length - 1]);
 
   // Trace solutions back.
   for (int t = length - 1; t > 0; t -= 1) {
-    cv::Vec2i index = x[t].index;
-    if (x[t].set == 0) {
-      x[t - 1] = args_A[t - 1][index[0]][index[1]];
-    } else {
-      x[t - 1] = args_B[t - 1][index[0]][index[1]];
-    }
+    x[t - 1] = chain.trace(args[t - 1], x[t]);
   }
 
   return f_star;
 }
+
+}
+
+double solveViterbiSplitQuadratic2D(
+    const std::vector<cv::Mat>& g_A,
+    const std::vector<cv::Mat>& g_B,
+    std::vector<SplitVariable>& x) {
+  return solveViterbiSplitQuadratic2D(g_A, g_B, x, NULL);
+}
+
+double solveViterbiSplitQuadratic2D(
+    const std::vector<cv::Mat>& g_A,
+    const std::vector<cv::Mat>& g_B,
+    std::vector<SplitVariable>& x,
+    ThreadPool& pool) {
+  return solveViterbiSplitQuadratic2D(g_A, g_B, x, &pool);
+}
+
+double solveViterbiSplitQuadratic2DCheckpointed(const UnaryTerms2D& g_A,
+                                                const UnaryTerms2D& g_B,
+                                                std::vector<SplitVariable>& x) {
+  return solveCheckpointed(SplitQuadratic2DChain(g_A, g_B, NULL), x);
+}
+
+double solveViterbiSplitQuadratic2DCheckpointed(const UnaryTerms2D& g_A,
+                                                const UnaryTerms2D& g_B,
+                                                std::vector<SplitVariable>& x,
+                                                ThreadPool& pool) {
+  return solveCheckpointed(SplitQuadratic2DChain(g_A, g_B, &pool), x);
+}
+
+double solveViterbiSplitQuadratic2DCheckpointed(
+    const std::vector<cv::Mat>& g_A,
+    const std::vector<cv::Mat>& g_B,
+    std::vector<SplitVariable>& x) {
+  return solveViterbiSplitQuadratic2DCheckpointed(VectorUnaryTerms2D(g_A),
+      VectorUnaryTerms2D(g_B), x);
+}
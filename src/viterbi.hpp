@@ -2,6 +2,8 @@
 #include <deque>
 #include <opencv2/core/core.hpp>
 
+class ThreadPool;
+
 // Computes d(p) = min_q [ f(q) + g(p, q) ]
 //
 // p can take {0, ..., m - 1}
@@ -9,16 +11,62 @@
 // f is length n
 // g is m x n
 //
-// Finishes in O(mn) time
+// Finishes in O(mn) time. Uses SSE2 or AVX where available.
+// The minimizer is the first q which attains the minimum.
 void distanceTransform(const std::vector<double>& f,
                        const cv::Mat& g,
                        std::vector<double>& d,
                        std::vector<int>& arg);
+// Divides the rows between the threads of a pool.
+void distanceTransform(const std::vector<double>& f,
+                       const cv::Mat& g,
+                       std::vector<double>& d,
+                       std::vector<int>& arg,
+                       ThreadPool& pool);
 
 // g[i] contains unary terms, h[i] contains binary terms
 double solveViterbi(const std::deque<std::vector<double> >& g,
                     const std::vector<cv::Mat>& h,
                     std::vector<int>& x);
+// Computes each distance transform in parallel.
+double solveViterbi(const std::deque<std::vector<double> >& g,
+                    const std::vector<cv::Mat>& h,
+                    std::vector<int>& x,
+                    ThreadPool& pool);
+
+// Terms of one chain for solveViterbiBatch(). Does not own them.
+struct ViterbiProblem {
+  const std::deque<std::vector<double> >* g;
+  const std::vector<cv::Mat>* h;
+
+  ViterbiProblem();
+  ViterbiProblem(const std::deque<std::vector<double> >& g,
+                 const std::vector<cv::Mat>& h);
+};
+
+// Solves many independent chains at once. Chains are handed to the threads
+// of the pool in blocks of grain, and each thread re-uses its buffers from
+// one chain to the next. The minimum of chain i is values[i], its minimizer
+// is x[i].
+void solveViterbiBatch(const std::vector<ViterbiProblem>& problems,
+                       std::vector<std::vector<int> >& x,
+                       std::vector<double>& values,
+                       ThreadPool& pool,
+                       int grain = 1);
+
+// Approximates solveViterbi() keeping only the beam_width best partial
+// solutions of each variable, in O(k B) time per variable rather than O(k^2).
+//
+// If lower_bound is not NULL, it is set to a lower bound on the true minimum
+// computed from the smallest pruned value of each variable plus the smallest
+// unary and binary terms of the rest of the chain. The solution is optimal if
+// the bound equals the returned value. Computing the bound visits every
+// element of h once.
+double solveViterbiBeam(const std::deque<std::vector<double> >& g,
+                        const std::vector<cv::Mat>& h,
+                        int beam_width,
+                        std::vector<int>& x,
+                        double* lower_bound);
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -32,9 +80,104 @@ double solveViterbiQuadratic(const std::deque<std::vector<double> >& g,
                              std::vector<int>& x);
 
 void quadraticDistanceTransform2D(const cv::Mat& f, cv::Mat& d, cv::Mat& arg);
+// Transforms blocks of rows and then tiles of columns in parallel.
+void quadraticDistanceTransform2D(const cv::Mat& f,
+                                  cv::Mat& d,
+                                  cv::Mat& arg,
+                                  ThreadPool& pool);
 
 double solveViterbiQuadratic2D(const std::vector<cv::Mat>& g,
                                std::vector<cv::Vec2i>& x);
+double solveViterbiQuadratic2D(const std::vector<cv::Mat>& g,
+                               std::vector<cv::Vec2i>& x,
+                               ThreadPool& pool);
+
+// Provides the unary terms of a chain one at a time, so that they do not all
+// have to be in memory at once.
+class UnaryTerms2D {
+  public:
+    virtual ~UnaryTerms2D();
+    virtual int length() const = 0;
+    // May be called more than once for each i.
+    virtual void get(int i, cv::Mat& g) const = 0;
+};
+
+// Unary terms which are all in memory. Does not copy the list.
+class VectorUnaryTerms2D : public UnaryTerms2D {
+  public:
+    explicit VectorUnaryTerms2D(const std::vector<cv::Mat>& g);
+    int length() const;
+    void get(int i, cv::Mat& g) const;
+
+  private:
+    const std::vector<cv::Mat>* g_;
+};
+
+// Same as solveViterbiQuadratic2D() but only keeps the forward table of every
+// sqrt(n)-th variable. The argmin tables of each segment are recomputed during
+// the trace back, which doubles the computation. Memory is O(sqrt(n) HW)
+// rather than O(n HW) for n tables of size H x W, plus the unary terms.
+double solveViterbiQuadratic2DCheckpointed(const UnaryTerms2D& g,
+                                           std::vector<cv::Vec2i>& x);
+double solveViterbiQuadratic2DCheckpointed(const UnaryTerms2D& g,
+                                           std::vector<cv::Vec2i>& x,
+                                           ThreadPool& pool);
+double solveViterbiQuadratic2DCheckpointed(const std::vector<cv::Mat>& g,
+                                           std::vector<cv::Vec2i>& x);
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Pairwise cost which only depends on the offset between labels on a grid.
+// LINEAR is w |p - q|, the L1 distance in 2D. QUADRATIC is w |p - q|^2.
+// The cost is min(c, T) if there is a truncation T.
+struct GridCost {
+  enum Kind {
+    LINEAR,
+    QUADRATIC
+  };
+
+  Kind kind;
+  double weight;
+  // +inf if not truncated.
+  double truncation;
+
+  GridCost();
+  GridCost(Kind kind, double weight);
+  GridCost(Kind kind, double weight, double truncation);
+};
+
+// Computes d(p) = min_q [ f(q) + cost(p - q) ] for p, q in {0, ..., n - 1}
+// in O(n) time without constructing the n x n matrix of costs.
+void gridDistanceTransform(const std::vector<double>& f,
+                           const GridCost& cost,
+                           std::vector<double>& d,
+                           std::vector<int>& arg);
+
+// Same for a 2D grid. arg contains cv::Vec2i.
+void gridDistanceTransform2D(const cv::Mat& f,
+                             const GridCost& cost,
+                             cv::Mat& d,
+                             cv::Mat& arg);
+void gridDistanceTransform2D(const cv::Mat& f,
+                             const GridCost& cost,
+                             cv::Mat& d,
+                             cv::Mat& arg,
+                             ThreadPool& pool);
+
+// Same as solveViterbi() with h[i](p, q) = cost(p - q).
+// Every variable must have the same number of labels.
+double solveViterbiGrid(const std::deque<std::vector<double> >& g,
+                        const GridCost& cost,
+                        std::vector<int>& x);
+
+// Same as solveViterbiQuadratic2D() with any grid cost.
+double solveViterbiGrid2D(const std::vector<cv::Mat>& g,
+                          const GridCost& cost,
+                          std::vector<cv::Vec2i>& x);
+double solveViterbiGrid2D(const std::vector<cv::Mat>& g,
+                          const GridCost& cost,
+                          std::vector<cv::Vec2i>& x,
+                          ThreadPool& pool);
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -70,6 +213,16 @@ double solveViterbiPartialQuadratic2D(
     const std::vector<cv::Mat>& h_BB,
     std::vector<MixedVariable>& x);
 
+// Keeps only every sqrt(n)-th forward table and recomputes the rest, as for
+// solveViterbiQuadratic2DCheckpointed().
+double solveViterbiPartialQuadratic2DCheckpointed(
+    const std::vector<cv::Mat>& g_A,
+    const std::deque<std::vector<double> >& g_B,
+    const std::vector<cv::Mat>& h_AB,
+    const std::vector<cv::Mat>& h_BA,
+    const std::vector<cv::Mat>& h_BB,
+    std::vector<MixedVariable>& x);
+
 ////////////////////////////////////////////////////////////////////////////////
 
 struct SplitVariable {
@@ -84,3 +237,22 @@ double solveViterbiSplitQuadratic2D(
     const std::vector<cv::Mat>& g_A,
     const std::vector<cv::Mat>& g_B,
     std::vector<SplitVariable>& x);
+double solveViterbiSplitQuadratic2D(
+    const std::vector<cv::Mat>& g_A,
+    const std::vector<cv::Mat>& g_B,
+    std::vector<SplitVariable>& x,
+    ThreadPool& pool);
+
+// Keeps only every sqrt(n)-th forward table and recomputes the rest, as for
+// solveViterbiQuadratic2DCheckpointed().
+double solveViterbiSplitQuadratic2DCheckpointed(const UnaryTerms2D& g_A,
+                                                const UnaryTerms2D& g_B,
+                                                std::vector<SplitVariable>& x);
+double solveViterbiSplitQuadratic2DCheckpointed(const UnaryTerms2D& g_A,
+                                                const UnaryTerms2D& g_B,
+                                                std::vector<SplitVariable>& x,
+                                                ThreadPool& pool);
+double solveViterbiSplitQuadratic2DCheckpointed(
+    const std::vector<cv::Mat>& g_A,
+    const std::vector<cv::Mat>& g_B,
+    std::vector<SplitVariable>& x);
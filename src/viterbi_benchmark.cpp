@@ -0,0 +1,74 @@
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <opencv2/core/core.hpp>
+#include "viterbi.hpp"
+#include "util/thread-pool.hpp"
+
+namespace {
+
+// Computes d(p) = min_q [f(q) + g(p, q)] for an n x n problem.
+void BM_DistanceTransform(benchmark::State& state) {
+  int n = state.range(0);
+
+  std::vector<double> f(n);
+  cv::randn(f, 0, 1);
+  cv::Mat g(n, n, cv::DataType<double>::type);
+  cv::randn(g, 0, 1);
+
+  std::vector<double> d;
+  std::vector<int> arg;
+  while (state.KeepRunning()) {
+    distanceTransform(f, g, d, arg);
+    benchmark::DoNotOptimize(d.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * n * n);
+}
+
+BENCHMARK(BM_DistanceTransform)->RangeMultiplier(4)->Range(64, 4096);
+
+// Same problem divided amongst threads. Arguments are n and the number of
+// threads.
+void BM_DistanceTransformParallel(benchmark::State& state) {
+  int n = state.range(0);
+  ThreadPool pool(state.range(1));
+
+  std::vector<double> f(n);
+  cv::randn(f, 0, 1);
+  cv::Mat g(n, n, cv::DataType<double>::type);
+  cv::randn(g, 0, 1);
+
+  std::vector<double> d;
+  std::vector<int> arg;
+  while (state.KeepRunning()) {
+    distanceTransform(f, g, d, arg, pool);
+    benchmark::DoNotOptimize(d.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * n * n);
+}
+
+BENCHMARK(BM_DistanceTransformParallel)
+    ->ArgsProduct({ benchmark::CreateRange(256, 4096, 4), { 2, 4, 8 } })
+    ->UseRealTime();
+
+// Quadratic distance transform of an n x n grid.
+void BM_QuadraticDistanceTransform2D(benchmark::State& state) {
+  int n = state.range(0);
+
+  cv::Mat f(n, n, cv::DataType<double>::type);
+  cv::randu(f, 0, 100);
+
+  cv::Mat d;
+  cv::Mat arg;
+  while (state.KeepRunning()) {
+    quadraticDistanceTransform2D(f, d, arg);
+    benchmark::DoNotOptimize(d.data);
+  }
+
+  state.SetItemsProcessed(state.iterations() * n * n);
+}
+
+BENCHMARK(BM_QuadraticDistanceTransform2D)->RangeMultiplier(2)->Range(32, 1024);
+
+}
@@ -1,10 +1,60 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <map>
 #include <vector>
 #include <deque>
 #include <gtest/gtest.h>
 #include <glog/logging.h>
 #include <opencv2/core/core.hpp>
 #include "viterbi.hpp"
+#include "seeded_viterbi.hpp"
 #include "util.hpp"
+#include "scaling_test.hpp"
+#include "util/thread-pool.hpp"
+
+// Rounded values produce many ties, which must go to the first minimizer.
+TEST(DistanceTransform, VersusNaive) {
+  int m = 200;
+  int n = 2500;
+
+  std::vector<double> f(n);
+  cv::randn(f, 0, 2);
+  cv::Mat g = cv::Mat_<double>(m, n);
+  cv::randn(g, 0, 2);
+  for (int q = 0; q < n; q += 1) {
+    f[q] = std::floor(f[q]);
+  }
+  g.convertTo(g, cv::DataType<int>::type);
+  g.convertTo(g, cv::DataType<double>::type);
+
+  std::vector<double> d;
+  std::vector<int> arg;
+  distanceTransform(f, g, d, arg);
+
+  ThreadPool pool(4);
+  std::vector<double> d_parallel;
+  std::vector<int> arg_parallel;
+  distanceTransform(f, g, d_parallel, arg_parallel, pool);
+
+  for (int p = 0; p < m; p += 1) {
+    double d_naive = 0;
+    int arg_naive = -1;
+    for (int q = 0; q < n; q += 1) {
+      double d_pq = f[q] + g.at<double>(p, q);
+      if (q == 0 || d_pq < d_naive) {
+        d_naive = d_pq;
+        arg_naive = q;
+      }
+    }
+
+    ASSERT_EQ(d_naive, d[p]);
+    ASSERT_EQ(arg_naive, arg[p]);
+    ASSERT_EQ(d_naive, d_parallel[p]);
+    ASSERT_EQ(arg_naive, arg_parallel[p]);
+  }
+}
 
 TEST(SolveViterbi, VersusExhaustive) {
   int n = 4;
@@ -56,6 +106,146 @@ TEST(SolveViterbi, VersusExhaustive) {
   }
 }
 
+// Chains of different lengths and sizes exercise the re-used buffers.
+TEST(SolveViterbiBatch, VersusSolveViterbi) {
+  int num_problems = 50;
+
+  std::vector<std::deque<std::vector<double> > > g(num_problems);
+  std::vector<std::vector<cv::Mat> > h(num_problems);
+  std::vector<ViterbiProblem> problems;
+
+  for (int i = 0; i < num_problems; i += 1) {
+    int n = 2 + i % 5;
+    std::vector<int> k(n);
+    for (int j = 0; j < n; j += 1) {
+      k[j] = 10 + (3 * i + 7 * j) % 20;
+    }
+
+    for (int j = 0; j < n; j += 1) {
+      std::vector<double> tmp(k[j]);
+      cv::randn(tmp, 0, 1);
+      g[i].push_back(std::vector<double>());
+      g[i].back().swap(tmp);
+    }
+    for (int j = 0; j < n - 1; j += 1) {
+      h[i].push_back(cv::Mat_<double>(k[j + 1], k[j]));
+      cv::randn(h[i].back(), 0, 1);
+    }
+
+    problems.push_back(ViterbiProblem(g[i], h[i]));
+  }
+
+  ThreadPool pool(4);
+  std::vector<std::vector<int> > x_batch;
+  std::vector<double> f_batch;
+  solveViterbiBatch(problems, x_batch, f_batch, pool);
+
+  ASSERT_EQ(num_problems, int(x_batch.size()));
+  ASSERT_EQ(num_problems, int(f_batch.size()));
+
+  for (int i = 0; i < num_problems; i += 1) {
+    std::vector<int> x;
+    double f = solveViterbi(g[i], h[i], x);
+
+    ASSERT_EQ(f, f_batch[i]);
+    ASSERT_EQ(x, x_batch[i]);
+  }
+}
+
+TEST(SolveViterbiBeam, VersusSolveViterbi) {
+  int n = 20;
+  int k = 40;
+
+  std::deque<std::vector<double> > g;
+  std::vector<cv::Mat> h;
+  for (int i = 0; i < n; i += 1) {
+    std::vector<double> tmp(k);
+    cv::randn(tmp, 0, 1);
+    g.push_back(std::vector<double>());
+    g.back().swap(tmp);
+  }
+  for (int i = 0; i < n - 1; i += 1) {
+    h.push_back(cv::Mat_<double>(k, k));
+    cv::randn(h.back(), 0, 1);
+  }
+
+  std::vector<int> x;
+  double f = solveViterbi(g, h, x);
+
+  // A beam as wide as the label set is exact.
+  std::vector<int> x_beam;
+  double lower_bound;
+  double f_beam = solveViterbiBeam(g, h, k, x_beam, &lower_bound);
+  ASSERT_EQ(f, f_beam);
+  ASSERT_EQ(x, x_beam);
+  ASSERT_EQ(f, lower_bound);
+
+  for (int beam_width = 1; beam_width < k; beam_width *= 2) {
+    f_beam = solveViterbiBeam(g, h, beam_width, x_beam, &lower_bound);
+    ASSERT_LE(lower_bound, f);
+    ASSERT_LE(f, f_beam);
+
+    // The value is attained by the solution.
+    double f_x = g[0][x_beam[0]];
+    for (int i = 1; i < n; i += 1) {
+      f_x += g[i][x_beam[i]] + h[i - 1].at<double>(x_beam[i], x_beam[i - 1]);
+    }
+    ASSERT_NEAR(f_beam, f_x, 1e-9);
+  }
+}
+
+TEST(SolveViterbiGrid, VersusSolveViterbi) {
+  int n = 30;
+  int k = 50;
+
+  GridCost costs[] = {
+    GridCost(GridCost::LINEAR, 0.3),
+    GridCost(GridCost::LINEAR, 0.3, 2.),
+    GridCost(GridCost::QUADRATIC, 0.1),
+    GridCost(GridCost::QUADRATIC, 0.1, 2.)
+  };
+  int num_costs = sizeof(costs) / sizeof(costs[0]);
+
+  std::deque<std::vector<double> > g;
+  for (int i = 0; i < n; i += 1) {
+    std::vector<double> tmp(k);
+    cv::randn(tmp, 0, 1);
+    g.push_back(std::vector<double>());
+    g.back().swap(tmp);
+  }
+
+  for (int c = 0; c < num_costs; c += 1) {
+    const GridCost& cost = costs[c];
+
+    // Construct the equivalent dense pairwise terms.
+    cv::Mat h_i = cv::Mat_<double>(k, k);
+    for (int p = 0; p < k; p += 1) {
+      for (int q = 0; q < k; q += 1) {
+        double e = std::abs(p - q);
+        if (cost.kind == GridCost::QUADRATIC) {
+          e = e * e;
+        }
+        h_i.at<double>(p, q) = std::min(cost.weight * e, cost.truncation);
+      }
+    }
+    std::vector<cv::Mat> h(n - 1, h_i);
+
+    std::vector<int> x;
+    double f = solveViterbi(g, h, x);
+
+    std::vector<int> x_grid;
+    double f_grid = solveViterbiGrid(g, cost, x_grid);
+
+    // Sums are accumulated in a different order.
+    ASSERT_NEAR(f, f_grid, 1e-9);
+    double f_x = g[0][x_grid[0]];
+    for (int i = 1; i < n; i += 1) {
+      f_x += g[i][x_grid[i]] + h[i - 1].at<double>(x_grid[i], x_grid[i - 1]);
+    }
+    ASSERT_NEAR(f_grid, f_x, 1e-9);
+  }
+}
+
 TEST(SolveViterbiQuadratic, VersusExhaustive) {
   int n = 4;
   int k = 30;
@@ -163,6 +353,32 @@ TEST(SolveViterbiQuadratic2D, VersusExhaustive) {
   }
 }
 
+TEST(QuadraticDistanceTransform2D, ParallelVersusSerial) {
+  // More than one block of rows and one tile of columns.
+  int m = 150;
+  int n = 75;
+
+  cv::Mat f = cv::Mat_<double>(m, n);
+  cv::randn(f, 0, 10);
+  f.at<double>(0, 0) = std::numeric_limits<double>::infinity();
+
+  cv::Mat d;
+  cv::Mat arg;
+  quadraticDistanceTransform2D(f, d, arg);
+
+  ThreadPool pool(4);
+  cv::Mat d_parallel;
+  cv::Mat arg_parallel;
+  quadraticDistanceTransform2D(f, d_parallel, arg_parallel, pool);
+
+  for (int i = 0; i < m; i += 1) {
+    for (int j = 0; j < n; j += 1) {
+      ASSERT_EQ(d.at<double>(i, j), d_parallel.at<double>(i, j));
+      ASSERT_EQ(arg.at<cv::Vec2i>(i, j), arg_parallel.at<cv::Vec2i>(i, j));
+    }
+  }
+}
+
 TEST(SolveViterbiQuadratic2D, VersusNaive) {
   int n = 256;
   int kx = 7;
@@ -220,6 +436,32 @@ TEST(SolveViterbiQuadratic2D, VersusNaive) {
   }
 }
 
+TEST(SolveViterbiQuadratic2DCheckpointed, VersusFull) {
+  int m = 9;
+  int n = 13;
+
+  // Lengths with and without a partial last segment.
+  for (int length = 1; length <= 50; length += 7) {
+    std::vector<cv::Mat> g(length);
+    for (int i = 0; i < length; i += 1) {
+      g[i] = cv::Mat_<double>(m, n);
+      cv::randn(g[i], 0, 1);
+    }
+
+    std::vector<cv::Vec2i> x_full;
+    double f_full = solveViterbiQuadratic2D(g, x_full);
+
+    std::vector<cv::Vec2i> x;
+    double f = solveViterbiQuadratic2DCheckpointed(g, x);
+
+    ASSERT_EQ(f_full, f);
+    ASSERT_EQ(x_full.size(), x.size());
+    for (int i = 0; i < length; i += 1) {
+      ASSERT_EQ(x_full[i], x[i]);
+    }
+  }
+}
+
 TEST(SolveViterbiPartialQuadratic2D, VersusNaive) {
   int n = 257;
   int k_B = 13;
@@ -521,3 +763,141 @@ TEST(SolveViterbiSplitQuadratic2D, Basic) {
     ASSERT_EQ(index, x[t].index);
   }
 }
+
+TEST(SolveViterbiSplitQuadratic2DCheckpointed, VersusFull) {
+  int length = 101;
+  int m = 13;
+  int n = 17;
+
+  std::vector<cv::Mat> g_A(length);
+  std::vector<cv::Mat> g_B(length);
+  for (int i = 0; i < length; i += 1) {
+    g_A[i] = cv::Mat_<double>(m, n);
+    cv::randn(g_A[i], 0, 1);
+    g_B[i] = cv::Mat_<double>(m, n);
+    cv::randn(g_B[i], 0, 1);
+  }
+
+  std::vector<SplitVariable> x_full;
+  double f_full = solveViterbiSplitQuadratic2D(g_A, g_B, x_full);
+
+  std::vector<SplitVariable> x;
+  double f = solveViterbiSplitQuadratic2DCheckpointed(g_A, g_B, x);
+
+  ASSERT_EQ(f_full, f);
+  ASSERT_EQ(x_full.size(), x.size());
+  for (int t = 0; t < length; t += 1) {
+    ASSERT_EQ(x_full[t].set, x[t].set);
+    ASSERT_EQ(x_full[t].index, x[t].index);
+  }
+}
+
+// Solves with seeds by making every other position impossible.
+double solveSeededNaive(const std::vector<cv::Mat>& g,
+                        const std::map<int, cv::Vec2i>& seeds,
+                        std::vector<cv::Vec2i>& x) {
+  std::vector<cv::Mat> constrained(g);
+  std::map<int, cv::Vec2i>::const_iterator seed;
+  for (seed = seeds.begin(); seed != seeds.end(); ++seed) {
+    int t = seed->first;
+    cv::Vec2i x_t = seed->second;
+    constrained[t] = cv::Mat_<double>(g[t].size(),
+        std::numeric_limits<double>::infinity());
+    constrained[t].at<double>(x_t[0], x_t[1]) = g[t].at<double>(x_t[0], x_t[1]);
+  }
+  return solveViterbiQuadratic2D(constrained, x);
+}
+
+TEST(SeededViterbiQuadratic2D, VersusSolveViterbiQuadratic2D) {
+  int n = 40;
+  int m = 11;
+  int k = 13;
+
+  std::vector<cv::Mat> g(n);
+  for (int t = 0; t < n; t += 1) {
+    g[t] = cv::Mat_<double>(m, k);
+    cv::randn(g[t], 0, 10);
+  }
+
+  SeededViterbiQuadratic2D solver(g);
+  std::map<int, cv::Vec2i> seeds;
+
+  // Add, move and remove seeds.
+  for (int i = 0; i < 12; i += 1) {
+    int t = (7 * i + 3) % n;
+    if (i % 4 == 3) {
+      solver.removeSeed(t);
+      seeds.erase(t);
+    } else {
+      cv::Vec2i x_t((5 * i) % m, (3 * i + 1) % k);
+      solver.setSeed(t, x_t);
+      seeds[t] = x_t;
+    }
+
+    std::vector<cv::Vec2i> x;
+    double f = solver.solve(x);
+
+    std::vector<cv::Vec2i> x_naive;
+    double f_naive = solveSeededNaive(g, seeds, x_naive);
+
+    ASSERT_NEAR(f_naive, f, 1e-6);
+    std::map<int, cv::Vec2i>::const_iterator seed;
+    for (seed = seeds.begin(); seed != seeds.end(); ++seed) {
+      ASSERT_EQ(seed->second, x[seed->first]);
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+class DistanceTransformTrial : public ScalingTrial {
+  public:
+    DistanceTransformTrial() : f_(), d_(), arg_() {}
+
+    void setUp(int n) {
+      std::vector<double> f(n);
+      cv::randu(f, 0, n);
+      f_.swap(f);
+    }
+
+    void run() {
+      quadraticDistanceTransform(f_, d_, arg_);
+    }
+
+  private:
+    std::vector<double> f_;
+    std::vector<double> d_;
+    std::vector<int> arg_;
+};
+
+// The lower envelope of parabolas is linear, a regression to the brute-force
+// minimum would be quadratic.
+TEST(DistanceTransformScaling, Linear) {
+  DistanceTransformTrial trial;
+  expectExponentBelow(trial, 1 << 16, 1.3);
+}
+
+// Images of a fixed number of rows and a growing number of columns.
+class DistanceTransform2DTrial : public ScalingTrial {
+  public:
+    DistanceTransform2DTrial() : f_(), d_(), arg_() {}
+
+    void setUp(int n) {
+      f_.create(64, n, cv::DataType<double>::type);
+      cv::randu(f_, 0, n);
+    }
+
+    void run() {
+      quadraticDistanceTransform2D(f_, d_, arg_);
+    }
+
+  private:
+    cv::Mat f_;
+    cv::Mat d_;
+    cv::Mat arg_;
+};
+
+TEST(DistanceTransform2DScaling, LinearInPixels) {
+  DistanceTransform2DTrial trial;
+  expectExponentBelow(trial, 1 << 10, 1.3);
+}
@@ -0,0 +1,518 @@
+#include "vocabulary_tree.hpp"
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <glog/logging.h>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include "fixed_descriptor.hpp"
+#include "random.hpp"
+#include "util/thread-pool.hpp"
+
+VocabularyPosting::VocabularyPosting() : image(-1), feature(-1) {}
+
+VocabularyPosting::VocabularyPosting(int image, int feature)
+    : image(image), feature(feature) {}
+
+ImageScore::ImageScore() : image(-1), score(0) {}
+
+ImageScore::ImageScore(int image, double score) : image(image), score(score) {}
+
+VocabularyTree::Node::Node() : first_child(-1), num_children(0), word(-1) {}
+
+VocabularyTree::Node::Node(int first_child, int num_children)
+    : first_child(first_child), num_children(num_children), word(-1) {}
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Nodes with at least this many points run k-means in parallel. Smaller
+// nodes are divided serially, each as one task of the pool.
+const int MIN_PARALLEL_NODE_SIZE = 16384;
+
+// A node of a tree being built, whose points are [begin, end) of the order.
+struct BuildNode {
+  int first_child;
+  int num_children;
+  int begin;
+  int end;
+  std::vector<double> center;
+
+  BuildNode(int begin, int end)
+      : first_child(-1), num_children(0), begin(begin), end(end), center() {}
+};
+
+// Divides the nodes of a tree as tasks of a pool.
+//
+// The points are a single permutation of their indices, which dividing a
+// node partitions in place, so that the points of every node are a range of
+// it. The children of a node are divided concurrently. Each node draws its
+// random numbers from a stream of its parent's, so the tree does not depend
+// on the number of threads, although the order in which nodes are numbered
+// does.
+class TreeBuilder {
+  public:
+    TreeBuilder(const std::vector<const KMeansPoint*>& points,
+                int k,
+                const VocabularyTree::LeafTest& leaf_test,
+                const KMeansOptions& options,
+                ThreadPool* pool)
+        : points_(&points),
+          k_(k),
+          leaf_test_(&leaf_test),
+          options_(&options),
+          pool_(pool),
+          order_(points.size()),
+          nodes_(),
+          mutex_() {
+      for (int i = 0; i < int(order_.size()); i += 1) {
+        order_[i] = i;
+      }
+    }
+
+    void build(int num_dimensions, uint32_t seed) {
+      nodes_.assign(1, BuildNode(0, order_.size()));
+      nodes_.front().center.assign(num_dimensions, 0.);
+      divide(0, seed);
+    }
+
+    const std::deque<BuildNode>& nodes() const {
+      return nodes_;
+    }
+
+    const std::vector<int>& order() const {
+      return order_;
+    }
+
+    void divide(int node, uint32_t seed) {
+      int begin;
+      int end;
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        begin = nodes_[node].begin;
+        end = nodes_[node].end;
+      }
+      int n = end - begin;
+      const int* first = &order_[0] + begin;
+
+      if (n < k_ || leaf_test_->isLeaf(first, first + n)) {
+        return;
+      }
+
+      std::vector<const KMeansPoint*> subset;
+      subset.reserve(n);
+      for (int i = begin; i < end; i += 1) {
+        subset.push_back((*points_)[order_[i]]);
+      }
+
+      std::deque<std::vector<double> > centers;
+      std::vector<int> labels;
+      boost::random::mt19937 generator(seed);
+      if (pool_ != NULL && n >= MIN_PARALLEL_NODE_SIZE) {
+        seededKMeans(subset, k_, *options_, centers, labels, generator,
+            *pool_);
+      } else {
+        seededKMeans(subset, k_, *options_, centers, labels, generator);
+      }
+      std::vector<const KMeansPoint*>().swap(subset);
+
+      int num_children = centers.size();
+      if (num_children < 2) {
+        // Could not be divided.
+        return;
+      }
+
+      // Partition the range by label, keeping the order within each child.
+      std::vector<int> offsets(num_children + 1, 0);
+      for (int j = 0; j < n; j += 1) {
+        offsets[labels[j] + 1] += 1;
+      }
+      for (int c = 0; c < num_children; c += 1) {
+        offsets[c + 1] += offsets[c];
+      }
+      std::vector<int> partitioned(n);
+      std::vector<int> next(offsets.begin(), offsets.end() - 1);
+      for (int j = 0; j < n; j += 1) {
+        partitioned[next[labels[j]]] = order_[begin + j];
+        next[labels[j]] += 1;
+      }
+      std::copy(partitioned.begin(), partitioned.end(),
+          order_.begin() + begin);
+      std::vector<int>().swap(partitioned);
+
+      DLOG(INFO) << "Divided " << n << " points into " << num_children <<
+          " clusters";
+
+      int first_child;
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        first_child = nodes_.size();
+        nodes_[node].first_child = first_child;
+        nodes_[node].num_children = num_children;
+        for (int c = 0; c < num_children; c += 1) {
+          nodes_.push_back(BuildNode(begin + offsets[c],
+                begin + offsets[c + 1]));
+          nodes_.back().center.swap(centers[c]);
+        }
+      }
+
+      if (pool_ == NULL) {
+        for (int c = 0; c < num_children; c += 1) {
+          divide(first_child + c, streamSeed(seed, c));
+        }
+      } else {
+        TaskGroup group(*pool_);
+        for (int c = 0; c < num_children; c += 1) {
+          group.run(boost::bind(&TreeBuilder::divide, this, first_child + c,
+                streamSeed(seed, c)));
+        }
+        group.wait();
+      }
+    }
+
+  private:
+    const std::vector<const KMeansPoint*>* points_;
+    int k_;
+    const VocabularyTree::LeafTest* leaf_test_;
+    const KMeansOptions* options_;
+    ThreadPool* pool_;
+    // Each node partitions only its own range, so the ranges of different
+    // tasks never overlap.
+    std::vector<int> order_;
+    // Grows as nodes are divided. References stay valid, but access is
+    // locked since growing changes the deque itself.
+    std::deque<BuildNode> nodes_;
+    boost::mutex mutex_;
+};
+
+// Descends to the leaf whose centers are nearest at each level.
+class LeafFinder {
+  public:
+    LeafFinder(const std::vector<VocabularyTree::Node>& nodes,
+               const cv::Mat& centers,
+               const double* descriptor)
+        : nodes_(&nodes), centers_(&centers), descriptor_(descriptor),
+          leaf_(0) {}
+
+    template<int N>
+    void operator()(Dimension<N> dimension) {
+      int node = 0;
+      while ((*nodes_)[node].num_children > 0) {
+        int first = (*nodes_)[node].first_child;
+        int num_children = (*nodes_)[node].num_children;
+        int nearest = -1;
+        double min = 0;
+
+        for (int c = first; c < first + num_children; c += 1) {
+          double distance = squaredDistance(dimension, descriptor_,
+              centers_->ptr<double>(c));
+
+          if (nearest < 0 || distance < min) {
+            nearest = c;
+            min = distance;
+          }
+        }
+
+        node = nearest;
+      }
+
+      leaf_ = node;
+    }
+
+    int leaf() const {
+      return leaf_;
+    }
+
+  private:
+    const std::vector<VocabularyTree::Node>* nodes_;
+    const cv::Mat* centers_;
+    const double* descriptor_;
+    int leaf_;
+};
+
+bool compareScores(const ImageScore& lhs, const ImageScore& rhs) {
+  return lhs.score > rhs.score;
+}
+
+}
+
+VocabularyTree::VocabularyTree() {}
+
+void VocabularyTree::build(const std::vector<const KMeansPoint*>& points,
+                           const std::vector<VocabularyPosting>& postings,
+                           int k,
+                           const LeafTest& leaf_test,
+                           boost::random::mt19937& generator,
+                           std::vector<std::vector<int> >& words) {
+  build(points, postings, k, leaf_test, generator, words, KMeansOptions(),
+      NULL);
+}
+
+void VocabularyTree::build(const std::vector<const KMeansPoint*>& points,
+                           const std::vector<VocabularyPosting>& postings,
+                           int k,
+                           const LeafTest& leaf_test,
+                           boost::random::mt19937& generator,
+                           std::vector<std::vector<int> >& words,
+                           const KMeansOptions& options,
+                           ThreadPool& pool) {
+  build(points, postings, k, leaf_test, generator, words, options, &pool);
+}
+
+void VocabularyTree::build(const std::vector<const KMeansPoint*>& points,
+                           const std::vector<VocabularyPosting>& postings,
+                           int k,
+                           const LeafTest& leaf_test,
+                           boost::random::mt19937& generator,
+                           std::vector<std::vector<int> >& words,
+                           const KMeansOptions& options,
+                           ThreadPool* pool) {
+  CHECK(!points.empty());
+  CHECK(points.size() == postings.size());
+  CHECK(k > 1);
+
+  int num_dimensions = points.front()->vector().size();
+  TreeBuilder builder(points, k, leaf_test, options, pool);
+  builder.build(num_dimensions, generator());
+  const std::deque<BuildNode>& built = builder.nodes();
+  const std::vector<int>& order = builder.order();
+
+  // Number the nodes breadth first, which keeps the children of each node
+  // contiguous and does not depend on the order in which they were divided.
+  std::vector<int> numbering;
+  std::queue<int> queue;
+  queue.push(0);
+  nodes_.assign(1, Node());
+  while (!queue.empty()) {
+    int current = queue.front();
+    queue.pop();
+    numbering.push_back(current);
+
+    const BuildNode& node = built[current];
+    if (node.num_children > 0) {
+      nodes_[numbering.size() - 1] = Node(nodes_.size(), node.num_children);
+      for (int c = 0; c < node.num_children; c += 1) {
+        nodes_.push_back(Node());
+        queue.push(node.first_child + c);
+      }
+    }
+  }
+
+  centers_.create(nodes_.size(), num_dimensions, cv::DataType<double>::type);
+  for (int n = 0; n < int(nodes_.size()); n += 1) {
+    const std::vector<double>& center = built[numbering[n]].center;
+    std::copy(center.begin(), center.end(), centers_.ptr<double>(n));
+  }
+
+  numberWords();
+
+  words.assign(numWords(), std::vector<int>());
+  postings_.assign(numWords(), std::vector<VocabularyPosting>());
+  for (int n = 0; n < int(nodes_.size()); n += 1) {
+    int word = nodes_[n].word;
+    if (word < 0) {
+      continue;
+    }
+
+    const BuildNode& node = built[numbering[n]];
+    words[word].assign(order.begin() + node.begin, order.begin() + node.end);
+    std::vector<int>::const_iterator i;
+    for (i = words[word].begin(); i != words[word].end(); ++i) {
+      postings_[word].push_back(postings[*i]);
+    }
+  }
+
+  computeWeights();
+  LOG(INFO) << "Built tree of " << numNodes() << " nodes and " << numWords() <<
+      " words";
+}
+
+bool VocabularyTree::empty() const {
+  return nodes_.empty();
+}
+
+int VocabularyTree::numNodes() const {
+  return nodes_.size();
+}
+
+int VocabularyTree::numWords() const {
+  return postings_.size();
+}
+
+int VocabularyTree::numImages() const {
+  return image_norms_.size();
+}
+
+int VocabularyTree::quantize(const Descriptor& descriptor) const {
+  CHECK(int(descriptor.data.size()) == centers_.cols) <<
+      "Descriptor differs in size";
+  return quantize(&descriptor.data.front());
+}
+
+int VocabularyTree::quantize(const double* descriptor) const {
+  CHECK(!empty()) << "Tree has not been built";
+
+  // Choose the distance kernel once for the whole descent.
+  LeafFinder finder(nodes_, centers_, descriptor);
+  dispatchDimension(centers_.cols, finder);
+  return nodes_[finder.leaf()].word;
+}
+
+const std::vector<VocabularyPosting>& VocabularyTree::postings(
+    int word) const {
+  return postings_[word];
+}
+
+void VocabularyTree::scoreImages(const std::deque<Descriptor>& descriptors,
+                                 int max_num,
+                                 std::vector<ImageScore>& scores) const {
+  // Count the words of the query.
+  std::map<int, int> query;
+  std::deque<Descriptor>::const_iterator descriptor;
+  for (descriptor = descriptors.begin();
+       descriptor != descriptors.end();
+       ++descriptor) {
+    query[quantize(*descriptor)] += 1;
+  }
+
+  scoreWords(query, max_num, scores);
+}
+
+void VocabularyTree::scoreImages(const cv::Mat& descriptors,
+                                 int max_num,
+                                 std::vector<ImageScore>& scores) const {
+  CHECK(descriptors.empty() || descriptors.cols == centers_.cols) <<
+      "Descriptors differ in size";
+  cv::Mat converted;
+  descriptors.convertTo(converted, cv::DataType<double>::type);
+
+  std::map<int, int> query;
+  for (int i = 0; i < converted.rows; i += 1) {
+    query[quantize(converted.ptr<double>(i))] += 1;
+  }
+
+  scoreWords(query, max_num, scores);
+}
+
+void VocabularyTree::scoreWords(const std::map<int, int>& query,
+                                int max_num,
+                                std::vector<ImageScore>& scores) const {
+  scores.clear();
+
+  // Accumulate dot products over the images in each word.
+  std::vector<double> dot(numImages(), 0.);
+  double query_norm = 0;
+  std::map<int, int>::const_iterator word;
+  for (word = query.begin(); word != query.end(); ++word) {
+    double weight = word->second * idf_[word->first];
+    query_norm += weight * weight;
+
+    const std::vector<std::pair<int, int> >& counts = counts_[word->first];
+    std::vector<std::pair<int, int> >::const_iterator count;
+    for (count = counts.begin(); count != counts.end(); ++count) {
+      dot[count->first] += weight * count->second * idf_[word->first];
+    }
+  }
+  query_norm = std::sqrt(query_norm);
+
+  for (int i = 0; i < numImages(); i += 1) {
+    if (dot[i] > 0) {
+      scores.push_back(ImageScore(i, dot[i] / (query_norm * image_norms_[i])));
+    }
+  }
+
+  int n = std::min(int(scores.size()), max_num);
+  std::partial_sort(scores.begin(), scores.begin() + n, scores.end(),
+      compareScores);
+  scores.resize(n);
+}
+
+const std::vector<VocabularyTree::Node>& VocabularyTree::nodes() const {
+  return nodes_;
+}
+
+const cv::Mat& VocabularyTree::centers() const {
+  return centers_;
+}
+
+bool VocabularyTree::set(
+    const std::vector<Node>& nodes,
+    const cv::Mat& centers,
+    const std::vector<std::vector<VocabularyPosting> >& postings) {
+  if (nodes.empty() || int(nodes.size()) != centers.rows) {
+    return false;
+  }
+  for (int n = 0; n < int(nodes.size()); n += 1) {
+    const Node& node = nodes[n];
+    if (node.num_children > 0 && (node.first_child <= n ||
+          node.first_child + node.num_children > int(nodes.size()))) {
+      return false;
+    }
+  }
+
+  nodes_ = nodes;
+  centers.convertTo(centers_, cv::DataType<double>::type);
+  numberWords();
+
+  if (numWords() != int(postings.size())) {
+    nodes_.clear();
+    return false;
+  }
+  postings_ = postings;
+
+  computeWeights();
+  return true;
+}
+
+void VocabularyTree::numberWords() {
+  int num_words = 0;
+  std::vector<Node>::iterator node;
+  for (node = nodes_.begin(); node != nodes_.end(); ++node) {
+    if (node->num_children == 0) {
+      node->word = num_words;
+      num_words += 1;
+    } else {
+      node->word = -1;
+    }
+  }
+  postings_.resize(num_words);
+}
+
+void VocabularyTree::computeWeights() {
+  int num_words = numWords();
+  int num_images = 0;
+
+  counts_.assign(num_words, std::vector<std::pair<int, int> >());
+  for (int w = 0; w < num_words; w += 1) {
+    std::map<int, int> counts;
+    std::vector<VocabularyPosting>::const_iterator posting;
+    for (posting = postings_[w].begin();
+         posting != postings_[w].end();
+         ++posting) {
+      counts[posting->image] += 1;
+      num_images = std::max(num_images, posting->image + 1);
+    }
+    counts_[w].assign(counts.begin(), counts.end());
+  }
+
+  // Words which occur in every image carry no information.
+  idf_.assign(num_words, 0.);
+  for (int w = 0; w < num_words; w += 1) {
+    if (!counts_[w].empty()) {
+      idf_[w] = std::log(double(num_images) / counts_[w].size());
+    }
+  }
+
+  image_norms_.assign(num_images, 0.);
+  for (int w = 0; w < num_words; w += 1) {
+    std::vector<std::pair<int, int> >::const_iterator count;
+    for (count = counts_[w].begin(); count != counts_[w].end(); ++count) {
+      double weight = count->second * idf_[w];
+      image_norms_[count->first] += weight * weight;
+    }
+  }
+  for (int i = 0; i < num_images; i += 1) {
+    image_norms_[i] = std::sqrt(image_norms_[i]);
+  }
+}
@@ -0,0 +1,138 @@
+#ifndef VOCABULARY_TREE_HPP_
+#define VOCABULARY_TREE_HPP_
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <utility>
+#include <boost/random/mersenne_twister.hpp>
+#include <opencv2/core/core.hpp>
+#include "kmeans.hpp"
+#include "descriptor.hpp"
+
+// Identifies a descriptor which was used to build a vocabulary tree.
+struct VocabularyPosting {
+  int image;
+  int feature;
+
+  VocabularyPosting();
+  VocabularyPosting(int image, int feature);
+};
+
+struct ImageScore {
+  int image;
+  double score;
+
+  ImageScore();
+  ImageScore(int image, double score);
+};
+
+// A tree of cluster centers found by hierarchical k-means.
+//
+// Each leaf is a visual word. Every word has a list of the descriptors which
+// were clustered into it, from which descriptors and images can be retrieved
+// without comparing against everything.
+class VocabularyTree {
+  public:
+    // Decides when a set of points should not be divided any further.
+    // May be called concurrently for different sets.
+    class LeafTest {
+      public:
+        virtual ~LeafTest() {}
+        // Takes the indices of the points [first, last).
+        virtual bool isLeaf(const int* first, const int* last) const = 0;
+    };
+
+    struct Node {
+      // Children are contiguous. Leaves have no children.
+      int first_child;
+      int num_children;
+      // -1 if not a leaf.
+      int word;
+
+      Node();
+      Node(int first_child, int num_children);
+    };
+
+    VocabularyTree();
+
+    // Splits the points into k clusters until every subset is a leaf.
+    // Postings identify each point. Outputs the points in each word.
+    void build(const std::vector<const KMeansPoint*>& points,
+               const std::vector<VocabularyPosting>& postings,
+               int k,
+               const LeafTest& leaf_test,
+               boost::random::mt19937& generator,
+               std::vector<std::vector<int> >& words);
+    // Seeds and restarts k-means at each node as in the options. Nodes are
+    // divided as tasks of the pool, and large ones run k-means in parallel.
+    void build(const std::vector<const KMeansPoint*>& points,
+               const std::vector<VocabularyPosting>& postings,
+               int k,
+               const LeafTest& leaf_test,
+               boost::random::mt19937& generator,
+               std::vector<std::vector<int> >& words,
+               const KMeansOptions& options,
+               ThreadPool& pool);
+
+    bool empty() const;
+    int numNodes() const;
+    int numWords() const;
+    int numImages() const;
+
+    // Descends to the leaf whose centers are nearest at each level.
+    int quantize(const Descriptor& descriptor) const;
+    int quantize(const double* descriptor) const;
+
+    // Finds the descriptors in the same word.
+    const std::vector<VocabularyPosting>& postings(int word) const;
+
+    // Ranks images by the TF-IDF similarity of their words to a set of
+    // descriptors. Returns at most max_num images in decreasing order.
+    void scoreImages(const std::deque<Descriptor>& descriptors,
+                     int max_num,
+                     std::vector<ImageScore>& scores) const;
+    // Takes one descriptor per row.
+    void scoreImages(const cv::Mat& descriptors,
+                     int max_num,
+                     std::vector<ImageScore>& scores) const;
+
+    // For reading and writing.
+    // The center of node i is row i. The root has no center.
+    const std::vector<Node>& nodes() const;
+    const cv::Mat& centers() const;
+    // Postings are assigned to words, which are numbered in order of node.
+    bool set(const std::vector<Node>& nodes,
+             const cv::Mat& centers,
+             const std::vector<std::vector<VocabularyPosting> >& postings);
+
+  private:
+    // Divides nodes in parallel if a pool is given.
+    void build(const std::vector<const KMeansPoint*>& points,
+               const std::vector<VocabularyPosting>& postings,
+               int k,
+               const LeafTest& leaf_test,
+               boost::random::mt19937& generator,
+               std::vector<std::vector<int> >& words,
+               const KMeansOptions& options,
+               ThreadPool* pool);
+    // Takes the number of occurrences of each word.
+    void scoreWords(const std::map<int, int>& words,
+                    int max_num,
+                    std::vector<ImageScore>& scores) const;
+    // Assigns words to leaves in order of node.
+    void numberWords();
+    // Computes the inverse document frequencies and the norm of each image.
+    void computeWeights();
+
+    std::vector<Node> nodes_;
+    cv::Mat centers_;
+    std::vector<std::vector<VocabularyPosting> > postings_;
+
+    // Number of postings of each image in each word.
+    std::vector<std::vector<std::pair<int, int> > > counts_;
+    std::vector<double> idf_;
+    std::vector<double> image_norms_;
+};
+
+#endif
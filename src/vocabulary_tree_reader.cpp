@@ -0,0 +1,50 @@
+#include "vocabulary_tree_reader.hpp"
+#include <glog/logging.h>
+#include "matrix_reader.hpp"
+
+VocabularyTreeReader::~VocabularyTreeReader() {}
+
+bool VocabularyTreeReader::read(const cv::FileNode& node,
+                                VocabularyTree& tree) {
+  if (node.type() != cv::FileNode::MAP) {
+    return false;
+  }
+
+  cv::Mat children;
+  cv::Mat centers;
+  cv::Mat postings;
+  if (!readMatrix(node["nodes"], children) ||
+      !readMatrix(node["centers"], centers) ||
+      !readMatrix(node["postings"], postings)) {
+    return false;
+  }
+  if (children.cols != 2 || (!postings.empty() && postings.cols != 3)) {
+    LOG(WARNING) << "Unexpected size of nodes or postings";
+    return false;
+  }
+  children.convertTo(children, cv::DataType<int>::type);
+  postings.convertTo(postings, cv::DataType<int>::type);
+
+  std::vector<VocabularyTree::Node> nodes;
+  int num_words = 0;
+  for (int i = 0; i < children.rows; i += 1) {
+    nodes.push_back(VocabularyTree::Node(children.at<int>(i, 0),
+          children.at<int>(i, 1)));
+    if (nodes.back().num_children == 0) {
+      num_words += 1;
+    }
+  }
+
+  std::vector<std::vector<VocabularyPosting> > lists(num_words);
+  for (int i = 0; i < postings.rows; i += 1) {
+    int word = postings.at<int>(i, 0);
+    if (word < 0 || word >= num_words) {
+      LOG(WARNING) << "Posting has invalid word " << word;
+      return false;
+    }
+    lists[word].push_back(VocabularyPosting(postings.at<int>(i, 1),
+          postings.at<int>(i, 2)));
+  }
+
+  return tree.set(nodes, centers, lists);
+}
@@ -0,0 +1,13 @@
+#ifndef VOCABULARY_TREE_READER_HPP_
+#define VOCABULARY_TREE_READER_HPP_
+
+#include "vocabulary_tree.hpp"
+#include "reader.hpp"
+
+class VocabularyTreeReader : public Reader<VocabularyTree> {
+  public:
+    ~VocabularyTreeReader();
+    bool read(const cv::FileNode& node, VocabularyTree& tree);
+};
+
+#endif
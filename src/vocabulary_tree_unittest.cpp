@@ -0,0 +1,255 @@
+#include "vocabulary_tree.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <opencv2/core/core.hpp>
+#include "util/thread-pool.hpp"
+#include "vocabulary_tree_reader.hpp"
+#include "vocabulary_tree_writer.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+const int DIMENSION = 8;
+const int NUM_IMAGES = 4;
+// Each image has its own clusters, far from those of the other images.
+const int CLUSTERS_PER_IMAGE = 2;
+const int POINTS_PER_CLUSTER = 25;
+const int K = 2;
+
+const int NUM_CLUSTERS = NUM_IMAGES * CLUSTERS_PER_IMAGE;
+
+class VectorPoint : public KMeansPoint {
+  public:
+    explicit VectorPoint(const std::vector<double>& x) : x_(x) {}
+    const std::vector<double>& vector() const { return x_; }
+
+  private:
+    std::vector<double> x_;
+};
+
+// Points of each image around its clusters, with the cluster of each.
+struct Dataset {
+  std::deque<VectorPoint> storage;
+  std::vector<const KMeansPoint*> points;
+  std::vector<VocabularyPosting> postings;
+  std::vector<int> clusters;
+
+  Dataset() : storage(), points(), postings(), clusters() {
+    boost::random::mt19937 generator(4);
+    boost::random::normal_distribution<double> noise;
+
+    for (int c = 0; c < NUM_CLUSTERS; c += 1) {
+      int image = c / CLUSTERS_PER_IMAGE;
+      for (int i = 0; i < POINTS_PER_CLUSTER; i += 1) {
+        std::vector<double> x(DIMENSION);
+        for (int d = 0; d < DIMENSION; d += 1) {
+          // Images are far apart, and their clusters are nearer.
+          x[d] = 100 * (d == image) + 20 * (d == NUM_IMAGES + c % 2) +
+              noise(generator);
+        }
+        storage.push_back(VectorPoint(x));
+        postings.push_back(VocabularyPosting(image, i));
+        clusters.push_back(c);
+      }
+    }
+
+    for (int i = 0; i < int(storage.size()); i += 1) {
+      points.push_back(&storage[i]);
+    }
+  }
+
+  // One row per point of the image.
+  cv::Mat imageDescriptors(int image) const {
+    int n = CLUSTERS_PER_IMAGE * POINTS_PER_CLUSTER;
+    cv::Mat descriptors(n, DIMENSION, cv::DataType<double>::type);
+    for (int i = 0; i < n; i += 1) {
+      const std::vector<double>& x = points[image * n + i]->vector();
+      std::copy(x.begin(), x.end(), descriptors.ptr<double>(i));
+    }
+    return descriptors;
+  }
+};
+
+// Divides until every point is in the same cluster.
+class ClusterLeafTest : public VocabularyTree::LeafTest {
+  public:
+    explicit ClusterLeafTest(const std::vector<int>& clusters)
+        : clusters_(&clusters) {}
+
+    bool isLeaf(const int* first, const int* last) const {
+      for (const int* i = first; i != last; ++i) {
+        if ((*clusters_)[*i] != (*clusters_)[*first]) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+  private:
+    const std::vector<int>* clusters_;
+};
+
+void buildTree(const Dataset& data,
+               VocabularyTree& tree,
+               std::vector<std::vector<int> >& words) {
+  ClusterLeafTest leaf_test(data.clusters);
+  boost::random::mt19937 generator(1);
+  tree.build(data.points, data.postings, K, leaf_test, generator, words);
+}
+
+void expectSameTree(const VocabularyTree& expected,
+                    const VocabularyTree& actual) {
+  ASSERT_EQ(expected.numNodes(), actual.numNodes());
+  ASSERT_EQ(expected.numWords(), actual.numWords());
+  EXPECT_EQ(expected.numImages(), actual.numImages());
+
+  for (int n = 0; n < expected.numNodes(); n += 1) {
+    const VocabularyTree::Node& a = expected.nodes()[n];
+    const VocabularyTree::Node& b = actual.nodes()[n];
+    EXPECT_EQ(a.first_child, b.first_child) << "Node " << n;
+    EXPECT_EQ(a.num_children, b.num_children) << "Node " << n;
+    EXPECT_EQ(a.word, b.word) << "Node " << n;
+    for (int d = 0; d < DIMENSION; d += 1) {
+      EXPECT_DOUBLE_EQ(expected.centers().at<double>(n, d),
+          actual.centers().at<double>(n, d));
+    }
+  }
+
+  for (int w = 0; w < expected.numWords(); w += 1) {
+    const std::vector<VocabularyPosting>& a = expected.postings(w);
+    const std::vector<VocabularyPosting>& b = actual.postings(w);
+    ASSERT_EQ(a.size(), b.size());
+    for (int i = 0; i < int(a.size()); i += 1) {
+      EXPECT_EQ(a[i].image, b[i].image);
+      EXPECT_EQ(a[i].feature, b[i].feature);
+    }
+  }
+}
+
+// Tree file in a fresh temporary directory, removed with the fixture.
+class VocabularyTreeTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      char directory[] = "/tmp/vocabulary-tree-XXXXXX";
+      ASSERT_TRUE(mkdtemp(directory) != NULL);
+      directory_ = directory;
+      tree_file_ = directory_ + "/tree.yaml";
+    }
+
+    virtual void TearDown() {
+      std::remove(tree_file_.c_str());
+      rmdir(directory_.c_str());
+    }
+
+    std::string directory_;
+    std::string tree_file_;
+};
+
+}
+
+TEST(VocabularyTree, WordsAreClustersOfPoints) {
+  Dataset data;
+  VocabularyTree tree;
+  EXPECT_TRUE(tree.empty());
+  std::vector<std::vector<int> > words;
+  buildTree(data, tree, words);
+
+  EXPECT_FALSE(tree.empty());
+  ASSERT_EQ(tree.numWords(), int(words.size()));
+  EXPECT_GE(tree.numWords(), NUM_CLUSTERS);
+  EXPECT_EQ(NUM_IMAGES, tree.numImages());
+  EXPECT_EQ(tree.numNodes(), tree.centers().rows);
+
+  // Every point is in exactly one word, which it quantizes to.
+  std::vector<int> num_words(data.points.size(), 0);
+  for (int w = 0; w < int(words.size()); w += 1) {
+    ASSERT_FALSE(words[w].empty());
+    ASSERT_EQ(words[w].size(), tree.postings(w).size());
+    for (int j = 0; j < int(words[w].size()); j += 1) {
+      int i = words[w][j];
+      num_words[i] += 1;
+      EXPECT_EQ(data.clusters[words[w][0]], data.clusters[i]);
+      EXPECT_EQ(w, tree.quantize(&data.points[i]->vector().front()));
+
+      const VocabularyPosting& posting = tree.postings(w)[j];
+      EXPECT_EQ(data.postings[i].image, posting.image);
+      EXPECT_EQ(data.postings[i].feature, posting.feature);
+    }
+  }
+  EXPECT_EQ(std::vector<int>(data.points.size(), 1), num_words);
+}
+
+TEST(VocabularyTree, ScoresImageOfItsOwnDescriptors) {
+  Dataset data;
+  VocabularyTree tree;
+  std::vector<std::vector<int> > words;
+  buildTree(data, tree, words);
+
+  for (int image = 0; image < NUM_IMAGES; image += 1) {
+    // No other image shares a word, so the image is the only match, and
+    // identical word counts are the greatest similarity.
+    std::vector<ImageScore> scores;
+    tree.scoreImages(data.imageDescriptors(image), NUM_IMAGES, scores);
+    ASSERT_EQ(1u, scores.size());
+    EXPECT_EQ(image, scores[0].image);
+    EXPECT_NEAR(1, scores[0].score, 1e-12);
+
+    tree.scoreImages(data.imageDescriptors(image), 0, scores);
+    EXPECT_TRUE(scores.empty());
+  }
+}
+
+TEST(VocabularyTree, SameForAnyNumberOfThreads) {
+  Dataset data;
+  VocabularyTree serial;
+  std::vector<std::vector<int> > serial_words;
+  buildTree(data, serial, serial_words);
+
+  ClusterLeafTest leaf_test(data.clusters);
+  ThreadPool pool(3);
+  VocabularyTree tree;
+  std::vector<std::vector<int> > words;
+  boost::random::mt19937 generator(1);
+  tree.build(data.points, data.postings, K, leaf_test, generator, words,
+      KMeansOptions(), pool);
+
+  expectSameTree(serial, tree);
+  EXPECT_TRUE(serial_words == words);
+}
+
+TEST_F(VocabularyTreeTest, WritesAndReads) {
+  Dataset data;
+  VocabularyTree tree;
+  std::vector<std::vector<int> > words;
+  buildTree(data, tree, words);
+
+  VocabularyTreeWriter writer;
+  ASSERT_TRUE(save(tree_file_, tree, writer));
+
+  VocabularyTree loaded;
+  VocabularyTreeReader reader;
+  ASSERT_TRUE(load(tree_file_, loaded, reader));
+  expectSameTree(tree, loaded);
+
+  for (int i = 0; i < int(data.points.size()); i += 1) {
+    const double* x = &data.points[i]->vector().front();
+    EXPECT_EQ(tree.quantize(x), loaded.quantize(x));
+  }
+
+  std::vector<ImageScore> expected;
+  std::vector<ImageScore> scores;
+  tree.scoreImages(data.imageDescriptors(1), NUM_IMAGES, expected);
+  loaded.scoreImages(data.imageDescriptors(1), NUM_IMAGES, scores);
+  ASSERT_EQ(expected.size(), scores.size());
+  for (int i = 0; i < int(scores.size()); i += 1) {
+    EXPECT_EQ(expected[i].image, scores[i].image);
+    EXPECT_DOUBLE_EQ(expected[i].score, scores[i].score);
+  }
+}
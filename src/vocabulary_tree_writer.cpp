@@ -0,0 +1,36 @@
+#include "vocabulary_tree_writer.hpp"
+
+VocabularyTreeWriter::~VocabularyTreeWriter() {}
+
+void VocabularyTreeWriter::write(cv::FileStorage& file,
+                                 const VocabularyTree& tree) {
+  // One row of (first child, number of children) per node.
+  const std::vector<VocabularyTree::Node>& nodes = tree.nodes();
+  cv::Mat children(nodes.size(), 2, cv::DataType<int>::type);
+  for (int i = 0; i < int(nodes.size()); i += 1) {
+    children.at<int>(i, 0) = nodes[i].first_child;
+    children.at<int>(i, 1) = nodes[i].num_children;
+  }
+
+  // One row of (word, image, feature) per posting.
+  int num_postings = 0;
+  for (int w = 0; w < tree.numWords(); w += 1) {
+    num_postings += tree.postings(w).size();
+  }
+  cv::Mat postings(num_postings, 3, cv::DataType<int>::type);
+  int i = 0;
+  for (int w = 0; w < tree.numWords(); w += 1) {
+    const std::vector<VocabularyPosting>& list = tree.postings(w);
+    std::vector<VocabularyPosting>::const_iterator posting;
+    for (posting = list.begin(); posting != list.end(); ++posting) {
+      postings.at<int>(i, 0) = w;
+      postings.at<int>(i, 1) = posting->image;
+      postings.at<int>(i, 2) = posting->feature;
+      i += 1;
+    }
+  }
+
+  file << "nodes" << children;
+  file << "centers" << tree.centers();
+  file << "postings" << postings;
+}
@@ -0,0 +1,13 @@
+#ifndef VOCABULARY_TREE_WRITER_HPP_
+#define VOCABULARY_TREE_WRITER_HPP_
+
+#include "vocabulary_tree.hpp"
+#include "writer.hpp"
+
+class VocabularyTreeWriter : public Writer<VocabularyTree> {
+  public:
+    ~VocabularyTreeWriter();
+    void write(cv::FileStorage& file, const VocabularyTree& tree);
+};
+
+#endif
@@ -1,5 +1,10 @@
 #include "warp.hpp"
+#include <cmath>
 #include <opencv2/imgproc/imgproc.hpp>
+#include <glog/logging.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 void samplePatch(const Warp& warp,
                  const cv::Mat& image,
@@ -46,6 +51,131 @@ void samplePatchAffine(const cv::Mat& src,
   //warpAffine(src, dst, Q, size);
 }
 
+namespace {
+
+// Bilinearly interpolates an image at (j + a, i + b), 0 <= a, b < 1,
+// where all four neighbours are known to lie within the image.
+inline double interpolateInterior(const cv::Mat& image,
+                                  int i,
+                                  int j,
+                                  double a,
+                                  double b) {
+  const double* row0 = image.ptr<double>(i) + j;
+  const double* row1 = image.ptr<double>(i + 1) + j;
+
+#ifdef __SSE2__
+  // The horizontal neighbours are adjacent in memory.
+  __m128d wx = _mm_set_pd(a, 1. - a);
+  __m128d top = _mm_mul_pd(_mm_loadu_pd(row0), _mm_set1_pd(1. - b));
+  __m128d bottom = _mm_mul_pd(_mm_loadu_pd(row1), _mm_set1_pd(b));
+  __m128d t = _mm_mul_pd(_mm_add_pd(top, bottom), wx);
+  return _mm_cvtsd_f64(_mm_add_sd(t, _mm_unpackhi_pd(t, t)));
+#else
+  return (1. - b) * ((1. - a) * row0[0] + a * row0[1]) +
+                b * ((1. - a) * row1[0] + a * row1[1]);
+#endif
+}
+
+// Returns the pixel value, or zero outside the image.
+inline double pixelOrZero(const cv::Mat& image, int i, int j) {
+  if (i < 0 || i >= image.rows || j < 0 || j >= image.cols) {
+    return 0.;
+  }
+  return image.at<double>(i, j);
+}
+
+// Bilinearly interpolates an image near its boundary.
+inline double interpolateBoundary(const cv::Mat& image,
+                                  int i,
+                                  int j,
+                                  double a,
+                                  double b) {
+  return (1. - b) * ((1. - a) * pixelOrZero(image, i, j) +
+                           a  * pixelOrZero(image, i, j + 1)) +
+                b * ((1. - a) * pixelOrZero(image, i + 1, j) +
+                           a  * pixelOrZero(image, i + 1, j + 1));
+}
+
+// Samples a set of images at the same warped positions.
+void sampleAffineLinear(const cv::Mat* const* src,
+                        cv::Mat* const* dst,
+                        int num_images,
+                        const cv::Mat& M,
+                        int width) {
+  const cv::Size size = src[0]->size();
+  for (int k = 0; k < num_images; k += 1) {
+    CHECK(src[k]->type() == cv::DataType<double>::type);
+    CHECK(src[k]->size() == size);
+    dst[k]->create(width, width, cv::DataType<double>::type);
+  }
+
+  double offset = (width - 1) / 2.;
+  double m00 = M.at<double>(0, 0);
+  double m01 = M.at<double>(0, 1);
+  double m02 = M.at<double>(0, 2);
+  double m10 = M.at<double>(1, 0);
+  double m11 = M.at<double>(1, 1);
+  double m12 = M.at<double>(1, 2);
+
+  for (int v = 0; v < width; v += 1) {
+    double dv = v - offset;
+
+    for (int u = 0; u < width; u += 1) {
+      double du = u - offset;
+
+      // Source position is computed once for all images.
+      double x = m00 * du + m01 * dv + m02;
+      double y = m10 * du + m11 * dv + m12;
+      int j = std::floor(x);
+      int i = std::floor(y);
+      double a = x - j;
+      double b = y - i;
+
+      bool interior = (i >= 0 && i + 1 < size.height &&
+                       j >= 0 && j + 1 < size.width);
+
+      for (int k = 0; k < num_images; k += 1) {
+        double value;
+        if (interior) {
+          value = interpolateInterior(*src[k], i, j, a, b);
+        } else {
+          value = interpolateBoundary(*src[k], i, j, a, b);
+        }
+        dst[k]->at<double>(v, u) = value;
+      }
+    }
+  }
+}
+
+}
+
+void samplePatchAndGradientsAffine(const cv::Mat& src,
+                                   const cv::Mat& ddx_src,
+                                   const cv::Mat& ddy_src,
+                                   cv::Mat& dst,
+                                   cv::Mat& ddx_dst,
+                                   cv::Mat& ddy_dst,
+                                   const cv::Mat& M,
+                                   int width) {
+  const cv::Mat* srcs[3] = { &src, &ddx_src, &ddy_src };
+  cv::Mat* dsts[3] = { &dst, &ddx_dst, &ddy_dst };
+  sampleAffineLinear(srcs, dsts, 3, M, width);
+}
+
+void samplePatchAffineLinear(const cv::Mat& src,
+                             cv::Mat& dst,
+                             const cv::Mat& M,
+                             int width) {
+  const cv::Mat* srcs[1] = { &src };
+  cv::Mat* dsts[1] = { &dst };
+  sampleAffineLinear(srcs, dsts, 1, M, width);
+}
+
+bool isLinearInterpolation(int interpolation) {
+  return (interpolation == cv::INTER_LINEAR ||
+          interpolation == cv::INTER_AREA);
+}
+
 #if 0
 // Unused. Implemented as a sanity check.
 // This is what the OpenCV documentation says it is doing, but I could only
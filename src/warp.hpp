@@ -60,4 +60,29 @@ void samplePatchAffine(const cv::Mat& src,
                        bool invert,
                        int interpolation);
 
+// Extracts square patches of an image and its two derivatives after applying
+// an affine warp, using bilinear interpolation and a zero border.
+// Equivalent to calling samplePatchAffine() on each image with the same
+// matrix (invert = false), but each source position is computed only once.
+// All images must be double precision and the same size.
+// Outputs which already have the correct size are written in place.
+void samplePatchAndGradientsAffine(const cv::Mat& src,
+                                   const cv::Mat& ddx_src,
+                                   const cv::Mat& ddy_src,
+                                   cv::Mat& dst,
+                                   cv::Mat& ddx_dst,
+                                   cv::Mat& ddy_dst,
+                                   const cv::Mat& M,
+                                   int width);
+
+// Single-image version of samplePatchAndGradientsAffine().
+void samplePatchAffineLinear(const cv::Mat& src,
+                             cv::Mat& dst,
+                             const cv::Mat& M,
+                             int width);
+
+// Returns whether the bilinear sampling functions implement an interpolation
+// method. (OpenCV treats INTER_AREA as INTER_LINEAR for affine warps.)
+bool isLinearInterpolation(int interpolation);
+
 #endif
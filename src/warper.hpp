@@ -35,6 +35,14 @@ class Warper {
     virtual bool isValid(const double* params,
                          const cv::Size& image_size,
                          int radius) const = 0;
+
+    // Sets the parameters to those of the identity warp.
+    virtual void setIdentity(double* params) const = 0;
+
+    // Recovers the parameters from a matrix representation of the warp.
+    // The matrix must be in the class of warps described by the warper,
+    // for example the composition of two warps of the same class.
+    virtual void paramsFromMatrix(const cv::Mat& M, double* params) const = 0;
 };
 
 #endif
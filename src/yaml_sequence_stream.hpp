@@ -0,0 +1,102 @@
+#ifndef YAML_SEQUENCE_STREAM_HPP_
+#define YAML_SEQUENCE_STREAM_HPP_
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "reader.hpp"
+#include "sequence_sink.hpp"
+
+// Reads a block sequence from a YAML file written by cv::FileStorage a few
+// elements at a time, so that the node tree of the whole document is never
+// built at once.
+//
+// The sequence is named "list" in the map at a path of keys from the root, as
+// read by readSequenceToSink(). For example, the path is empty for loadList()
+// and is "tracks" for loadMultiviewTrackList(). Elements are returned in
+// chunks. Each chunk is a small document holding a sequence named "list"
+// that can be parsed by cv::FileStorage.
+class YamlSequenceStream {
+  public:
+    // Approximate number of bytes of text per chunk.
+    static const size_t CHUNK_SIZE = 1 << 20;
+
+    YamlSequenceStream();
+
+    // Returns false if the file is not YAML or the sequence could not be
+    // streamed, in which case the file should be loaded in full.
+    bool open(const std::string& filename,
+              const std::vector<std::string>& path);
+
+    // A document of the scalars at the top level before the sequence.
+    const std::string& header() const;
+
+    // Returns false when there are no more elements.
+    bool next(std::string& chunk);
+
+  private:
+    bool nextLine();
+
+    std::ifstream file_;
+    std::string header_;
+    // Line which has been read but not consumed.
+    std::string line_;
+    bool have_line_;
+    int indent_;
+    bool done_;
+};
+
+// Parses the elements of a chunk of a YamlSequenceStream straight from its
+// text, when they are maps of numbers and sequences of numbers, as written for
+// points, features and matches. This is several times faster than building
+// the node tree of the chunk and looking up every key of every element.
+//
+// The keys of the first element are matched to fields once. Every later
+// element must have the same keys in the same order, so that each key is only
+// compared with the one expected.
+class FieldParser {
+  public:
+    explicit FieldParser(const std::vector<std::string>& keys);
+
+    // Parses the element at the start of the text and advances past it.
+    // Returns false if it is not a map of the keys.
+    bool parse(const char*& text, FieldValues& values);
+
+  private:
+    bool parseKey(const char*& text, int position);
+    bool parseValue(const char*& text, FieldValues& values, int field);
+
+    std::vector<std::string> keys_;
+    // Field of each key in the order they are written.
+    std::vector<int> order_;
+    bool resolved_;
+};
+
+// Reads every element of the sequence at the path of keys into a sink.
+// Falls back to parsing the whole file if it cannot be streamed.
+//
+// Chunks of elements whose reader lists its fields are parsed by FieldParser,
+// and by cv::FileStorage if that fails.
+template<class T>
+bool streamSequence(const std::string& filename,
+                    const std::vector<std::string>& path,
+                    Reader<T>& reader,
+                    SequenceSink<T>& sink);
+
+// Same as above with an open stream.
+template<class T>
+bool streamSequence(YamlSequenceStream& stream,
+                    Reader<T>& reader,
+                    SequenceSink<T>& sink);
+
+// Reads every element of the sequence named "list" in a map into a sink.
+// Named apart from readSequence() in iterator_reader.hpp, whose output
+// iterator would otherwise be deduced as the derived type of the sink.
+template<class T>
+bool readSequenceToSink(const cv::FileNode& node,
+                        Reader<T>& reader,
+                        SequenceSink<T>& sink);
+
+#include "yaml_sequence_stream.inl"
+
+#endif
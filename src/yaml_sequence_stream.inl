@@ -0,0 +1,457 @@
+#include <cctype>
+#include <glog/logging.h>
+#include "parse_number.hpp"
+
+namespace yaml_sequence_stream {
+
+// The start of every chunk.
+const char CHUNK_HEADER[] = "%YAML:1.0\nlist:\n";
+
+inline int indentOf(const std::string& line) {
+  size_t indent = line.find_first_not_of(' ');
+  return (indent == std::string::npos) ? -1 : int(indent);
+}
+
+// Tests whether a line is exactly "key:" after the indent.
+inline bool isKey(const std::string& line, const std::string& key) {
+  int indent = indentOf(line);
+  if (indent < 0) {
+    return false;
+  }
+
+  size_t end = line.find_last_not_of(" \r");
+  return line.compare(indent, end + 1 - indent, key + ":") == 0;
+}
+
+inline bool isItem(const std::string& line, int indent) {
+  return indentOf(line) == indent && line[indent] == '-';
+}
+
+inline const char* skipSpace(const char* text) {
+  while (*text == ' ' || *text == '\t' || *text == '\r' || *text == '\n') {
+    text += 1;
+  }
+  return text;
+}
+
+// Tests whether a number is followed by a character which may end it.
+inline bool endsNumber(char c) {
+  return c == '\0' || c == ' ' || c == '\t' || c == '\r' || c == '\n' ||
+         c == ',' || c == ']' || c == '}';
+}
+
+inline bool isKeyChar(char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// Parses every element of a chunk by the fields of a reader. Returns false if
+// any element could not be, in which case the elements are incomplete.
+template<class T>
+bool readFields(const std::string& chunk,
+                FieldParser& parser,
+                Reader<T>& reader,
+                FieldValues& values,
+                std::vector<T>& elements) {
+  elements.clear();
+
+  size_t header = sizeof(CHUNK_HEADER) - 1;
+  CHECK(chunk.compare(0, header, CHUNK_HEADER) == 0);
+  const char* text = skipSpace(chunk.c_str() + header);
+
+  while (*text != '\0') {
+    elements.push_back(T());
+    if (!parser.parse(text, values)) {
+      return false;
+    }
+    if (!reader.readFields(values, elements.back())) {
+      return false;
+    }
+    text = skipSpace(text);
+  }
+
+  return true;
+}
+
+}
+
+inline FieldParser::FieldParser(const std::vector<std::string>& keys)
+    : keys_(keys), order_(), resolved_(false) {}
+
+inline bool FieldParser::parse(const char*& text, FieldValues& values) {
+  using namespace yaml_sequence_stream;
+
+  const char* p = skipSpace(text);
+  if (*p != '-') {
+    return false;
+  }
+  // Maps are written in block style, or in flow style within braces.
+  p = skipSpace(p + 1);
+  bool flow = (*p == '{');
+  if (flow) {
+    p = skipSpace(p + 1);
+  }
+
+  int num_fields = keys_.size();
+  values.values.clear();
+  values.first.assign(num_fields, -1);
+  values.last.assign(num_fields, -1);
+  if (!resolved_) {
+    order_.clear();
+  }
+
+  int position = 0;
+  // A block map ends at the next element or the end of the chunk.
+  while (flow ? (*p != '}') : (*p != '-' && *p != '\0')) {
+    if (flow && position > 0) {
+      if (*p != ',') {
+        return false;
+      }
+      p = skipSpace(p + 1);
+    }
+
+    if (!parseKey(p, position)) {
+      return false;
+    }
+    if (!parseValue(p, values, order_[position])) {
+      return false;
+    }
+    position += 1;
+    p = skipSpace(p);
+  }
+  if (flow) {
+    p += 1;
+  }
+
+  if (position != num_fields) {
+    return false;
+  }
+
+  resolved_ = true;
+  text = p;
+  return true;
+}
+
+inline bool FieldParser::parseKey(const char*& text, int position) {
+  const char* end = text;
+  while (yaml_sequence_stream::isKeyChar(*end)) {
+    end += 1;
+  }
+  if (end == text || *end != ':') {
+    return false;
+  }
+  size_t length = end - text;
+
+  if (resolved_) {
+    // Only compare with the key of the first element at this position.
+    if (position >= int(order_.size())) {
+      return false;
+    }
+    const std::string& key = keys_[order_[position]];
+    if (key.size() != length || key.compare(0, length, text, length) != 0) {
+      return false;
+    }
+  } else {
+    int field = 0;
+    int num_fields = keys_.size();
+    while (field < num_fields &&
+           keys_[field].compare(0, std::string::npos, text, length) != 0) {
+      field += 1;
+    }
+    if (field == num_fields) {
+      return false;
+    }
+    order_.push_back(field);
+  }
+
+  text = end + 1;
+  return true;
+}
+
+inline bool FieldParser::parseValue(const char*& text,
+                                    FieldValues& values,
+                                    int field) {
+  using namespace yaml_sequence_stream;
+
+  if (values.first[field] >= 0) {
+    // Repeated key.
+    return false;
+  }
+  values.first[field] = values.values.size();
+
+  const char* p = text;
+  while (*p == ' ') {
+    p += 1;
+  }
+
+  double x;
+  if (*p == '[') {
+    // Long sequences are wrapped over several lines.
+    bool first = true;
+    for (p = skipSpace(p + 1); *p != ']'; p = skipSpace(p)) {
+      if (!first) {
+        if (*p != ',') {
+          return false;
+        }
+        p = skipSpace(p + 1);
+      }
+      if (!parseNumber(p, x) || !endsNumber(*p)) {
+        return false;
+      }
+      values.values.push_back(x);
+      first = false;
+    }
+    p += 1;
+  } else {
+    if (!parseNumber(p, x) || !endsNumber(*p)) {
+      return false;
+    }
+    values.values.push_back(x);
+  }
+
+  values.last[field] = values.values.size();
+  text = p;
+  return true;
+}
+
+inline YamlSequenceStream::YamlSequenceStream()
+    : file_(), header_(), line_(), have_line_(false), indent_(-1),
+      done_(true) {}
+
+inline bool YamlSequenceStream::nextLine() {
+  if (have_line_) {
+    have_line_ = false;
+    return true;
+  }
+
+  while (std::getline(file_, line_)) {
+    // Skip blank lines.
+    if (yaml_sequence_stream::indentOf(line_) >= 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+inline bool YamlSequenceStream::open(const std::string& filename,
+                                     const std::vector<std::string>& path) {
+  using namespace yaml_sequence_stream;
+
+  file_.close();
+  file_.clear();
+  file_.open(filename.c_str());
+  header_ = "%YAML:1.0\n";
+  have_line_ = false;
+  done_ = true;
+
+  if (!file_ || !std::getline(file_, line_) ||
+      line_.compare(0, 5, "%YAML") != 0) {
+    return false;
+  }
+
+  std::vector<std::string> keys(path);
+  keys.push_back("list");
+
+  // Find each key in turn among the entries of the previous key's map.
+  // Entries of other keys are skipped.
+  int parent = -1;
+  int level = -1;
+  std::vector<std::string>::const_iterator key = keys.begin();
+  while (key != keys.end()) {
+    if (!nextLine()) {
+      return false;
+    }
+    if (line_.compare(0, 3, "---") == 0) {
+      continue;
+    }
+
+    int indent = indentOf(line_);
+    if (indent <= parent) {
+      // Left the map without finding the key.
+      return false;
+    }
+    if (level < 0) {
+      level = indent;
+    }
+    if (indent < level) {
+      return false;
+    }
+    if (indent > level) {
+      continue;
+    }
+
+    if (isKey(line_, *key)) {
+      parent = indent;
+      level = -1;
+      ++key;
+    } else if (parent < 0 && line_.find(':') != line_.size() - 1) {
+      // Keep scalars at the top level, such as the number of views.
+      header_ += line_ + "\n";
+    }
+  }
+
+  // The first element sets the indent of the sequence.
+  if (!nextLine()) {
+    return true;
+  }
+
+  indent_ = indentOf(line_);
+  have_line_ = true;
+  if (indent_ <= parent) {
+    if (isItem(line_, indent_)) {
+      // Elements at the same indent as the key are valid but unexpected.
+      return false;
+    }
+    return true;
+  }
+  if (!isItem(line_, indent_)) {
+    return false;
+  }
+
+  done_ = false;
+  return true;
+}
+
+inline const std::string& YamlSequenceStream::header() const {
+  return header_;
+}
+
+inline bool YamlSequenceStream::next(std::string& chunk) {
+  using namespace yaml_sequence_stream;
+
+  if (done_) {
+    return false;
+  }
+
+  chunk = CHUNK_HEADER;
+  bool first = true;
+
+  while (nextLine()) {
+    int indent = indentOf(line_);
+
+    if (indent < indent_ || (indent == indent_ && line_[indent] != '-')) {
+      // End of the sequence.
+      done_ = true;
+      return !first;
+    }
+
+    if (isItem(line_, indent_) && !first && chunk.size() >= CHUNK_SIZE) {
+      // Start the next chunk with this element.
+      have_line_ = true;
+      return true;
+    }
+
+    chunk += line_;
+    chunk += '\n';
+    first = false;
+  }
+
+  done_ = true;
+  return !first;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+template<class T>
+bool readSequenceToSink(const cv::FileNode& node,
+                        Reader<T>& reader,
+                        SequenceSink<T>& sink) {
+  // Check node is not empty.
+  if (node.type() == cv::FileNode::NONE) {
+    LOG(WARNING) << "Empty file node";
+    return false;
+  }
+
+  // Check node is a map.
+  if (node.type() != cv::FileNode::MAP) {
+    LOG(WARNING) << "Expected file node to be a map";
+    return false;
+  }
+
+  const cv::FileNode& child = node["list"];
+
+  // Check that child is a sequence.
+  if (child.type() != cv::FileNode::SEQ) {
+    LOG(WARNING) << "Expected file node to be a sequence";
+    return false;
+  }
+
+  for (cv::FileNodeIterator it = child.begin(); it != child.end(); ++it) {
+    T x;
+    if (!reader.read(*it, x)) {
+      return false;
+    }
+    sink.add(x);
+  }
+
+  return true;
+}
+
+template<class T>
+bool streamSequence(YamlSequenceStream& stream,
+                    Reader<T>& reader,
+                    SequenceSink<T>& sink) {
+  std::string chunk;
+
+  std::vector<std::string> keys;
+  bool fields = reader.fields(keys);
+  FieldParser parser(keys);
+  FieldValues values;
+  std::vector<T> elements;
+
+  while (stream.next(chunk)) {
+    if (fields) {
+      if (yaml_sequence_stream::readFields(chunk, parser, reader, values,
+            elements)) {
+        typename std::vector<T>::iterator element;
+        for (element = elements.begin(); element != elements.end();
+             ++element) {
+          sink.add(*element);
+        }
+        continue;
+      }
+
+      // Parse the rest of the sequence by its node tree.
+      fields = false;
+    }
+
+    cv::FileStorage file(chunk,
+        cv::FileStorage::READ + cv::FileStorage::MEMORY);
+    if (!file.isOpened()) {
+      LOG(WARNING) << "Could not parse part of sequence";
+      return false;
+    }
+
+    if (!readSequenceToSink(file.root(), reader, sink)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+template<class T>
+bool streamSequence(const std::string& filename,
+                    const std::vector<std::string>& path,
+                    Reader<T>& reader,
+                    SequenceSink<T>& sink) {
+  YamlSequenceStream stream;
+  if (stream.open(filename, path)) {
+    return streamSequence(stream, reader, sink);
+  }
+
+  // Parse the whole document.
+  cv::FileStorage file(filename, cv::FileStorage::READ);
+  if (!file.isOpened()) {
+    LOG(WARNING) << "Could not open `" << filename << "' for reading";
+    return false;
+  }
+
+  cv::FileNode node = file.root();
+  std::vector<std::string>::const_iterator key;
+  for (key = path.begin(); key != path.end(); ++key) {
+    node = node[*key];
+  }
+
+  return readSequenceToSink(node, reader, sink);
+}
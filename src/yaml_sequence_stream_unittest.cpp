@@ -0,0 +1,226 @@
+#include "yaml_sequence_stream.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <opencv2/core/core.hpp>
+#include "image_point_reader.hpp"
+#include "sequence_sink.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+const int NUM_ELEMENTS = 50;
+const int DESCRIPTOR_SIZE = 40;
+
+// Values which cv::FileStorage writes in each of its forms: integers as "1.",
+// others as "%.16e", and special values as ".Nan" and ".Inf".
+double testValue(int i) {
+  switch (i % 8) {
+    case 0:
+      return i;
+    case 1:
+      return -0.;
+    case 2:
+      return 0.1 * i;
+    case 3:
+      return 1e23;
+    case 4:
+      return 1.2345678901234567e+02 * i;
+    case 5:
+      return std::numeric_limits<double>::quiet_NaN();
+    case 6:
+      return -std::numeric_limits<double>::infinity();
+    default:
+      return -1. / 3 * i;
+  }
+}
+
+// Writes a sequence of maps of numbers and sequences of numbers, in block
+// style or in flow style.
+void writeList(const std::string& filename, bool flow) {
+  cv::FileStorage file(filename, cv::FileStorage::WRITE);
+  file << "list" << "[";
+  for (int i = 0; i < NUM_ELEMENTS; i += 1) {
+    file << (flow ? "{:" : "{");
+    file << "x" << testValue(i);
+    file << "y" << testValue(i + 3);
+    file << "size" << i;
+    file << "d" << "[:";
+    for (int j = 0; j < DESCRIPTOR_SIZE; j += 1) {
+      file << testValue(i + j);
+    }
+    file << "]";
+    file << "}";
+  }
+  file << "]";
+}
+
+std::vector<std::string> testKeys() {
+  std::vector<std::string> keys;
+  keys.push_back("d");
+  keys.push_back("size");
+  keys.push_back("x");
+  keys.push_back("y");
+  return keys;
+}
+
+// Compares doubles to the bit, except that every NaN is the same.
+bool sameValue(double a, double b) {
+  if (a != a && b != b) {
+    return true;
+  }
+  return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+// Expects the values which FieldParser found to be those of the node.
+void expectSameFields(const cv::FileNode& node,
+                      const std::vector<std::string>& keys,
+                      const FieldValues& values) {
+  for (int field = 0; field < int(keys.size()); field += 1) {
+    cv::FileNode child = node[keys[field]];
+    ASSERT_FALSE(child.empty()) << keys[field];
+    const double* begin = values.begin(field);
+
+    if (child.isSeq()) {
+      ASSERT_EQ(int(child.size()), values.size(field)) << keys[field];
+      for (int i = 0; i < int(child.size()); i += 1) {
+        double expected = child[i];
+        EXPECT_TRUE(sameValue(expected, begin[i]))
+            << keys[field] << "[" << i << "]: " << expected << " != " <<
+            begin[i];
+      }
+    } else {
+      ASSERT_EQ(1, values.size(field)) << keys[field];
+      double expected = child;
+      EXPECT_TRUE(sameValue(expected, begin[0]))
+          << keys[field] << ": " << expected << " != " << begin[0];
+    }
+  }
+}
+
+// YAML file in a fresh temporary directory, removed with the fixture.
+class YamlSequenceStreamTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      char directory[] = "/tmp/yaml-sequence-stream-XXXXXX";
+      ASSERT_TRUE(mkdtemp(directory) != NULL);
+      directory_ = directory;
+      filename_ = directory_ + "/list.yaml";
+    }
+
+    virtual void TearDown() {
+      std::remove(filename_.c_str());
+      rmdir(directory_.c_str());
+    }
+
+    // Parses every chunk of the file with FieldParser and with
+    // cv::FileStorage, and expects the same values.
+    void expectSameAsFileStorage() {
+      YamlSequenceStream stream;
+      ASSERT_TRUE(stream.open(filename_, std::vector<std::string>()));
+
+      std::vector<std::string> keys = testKeys();
+      FieldParser parser(keys);
+      FieldValues values;
+      int num_elements = 0;
+      std::string chunk;
+
+      while (stream.next(chunk)) {
+        cv::FileStorage file(chunk,
+            cv::FileStorage::READ + cv::FileStorage::MEMORY);
+        ASSERT_TRUE(file.isOpened());
+        cv::FileNode list = file["list"];
+        ASSERT_TRUE(list.isSeq());
+
+        // Past the header of the chunk.
+        const char* text = chunk.c_str() + chunk.find("list:\n") + 6;
+        cv::FileNodeIterator node;
+        for (node = list.begin(); node != list.end(); ++node) {
+          ASSERT_TRUE(parser.parse(text, values)) << "Element " <<
+              num_elements;
+          expectSameFields(*node, keys, values);
+          num_elements += 1;
+        }
+        while (*text == ' ' || *text == '\n') {
+          text += 1;
+        }
+        EXPECT_EQ('\0', *text);
+      }
+
+      EXPECT_EQ(NUM_ELEMENTS, num_elements);
+    }
+
+    std::string directory_;
+    std::string filename_;
+};
+
+}
+
+TEST_F(YamlSequenceStreamTest, BlockMapsMatchFileStorage) {
+  writeList(filename_, false);
+  expectSameAsFileStorage();
+}
+
+TEST_F(YamlSequenceStreamTest, FlowMapsMatchFileStorage) {
+  writeList(filename_, true);
+  expectSameAsFileStorage();
+}
+
+TEST_F(YamlSequenceStreamTest, StreamsSameElementsAsNodeTree) {
+  std::vector<cv::Point2d> points;
+  for (int i = 0; i < NUM_ELEMENTS; i += 1) {
+    points.push_back(cv::Point2d(testValue(i), testValue(i + 3)));
+  }
+  {
+    cv::FileStorage file(filename_, cv::FileStorage::WRITE);
+    file << "list" << "[";
+    for (int i = 0; i < NUM_ELEMENTS; i += 1) {
+      file << "{:" << "x" << points[i].x << "y" << points[i].y << "}";
+    }
+    file << "]";
+  }
+
+  ImagePointReader<double> reader;
+  std::vector<cv::Point2d> streamed;
+  ContainerSink<cv::Point2d, std::vector<cv::Point2d> > streamed_sink(
+      streamed);
+  ASSERT_TRUE(streamSequence(filename_, std::vector<std::string>(), reader,
+        streamed_sink));
+
+  std::vector<cv::Point2d> parsed;
+  ContainerSink<cv::Point2d, std::vector<cv::Point2d> > parsed_sink(parsed);
+  cv::FileStorage file(filename_, cv::FileStorage::READ);
+  ASSERT_TRUE(readSequenceToSink(file.root(), reader, parsed_sink));
+
+  ASSERT_EQ(parsed.size(), streamed.size());
+  for (int i = 0; i < int(parsed.size()); i += 1) {
+    EXPECT_TRUE(sameValue(parsed[i].x, streamed[i].x)) << i;
+    EXPECT_TRUE(sameValue(parsed[i].y, streamed[i].y)) << i;
+  }
+}
+
+TEST(FieldParser, RejectsElementsWithOtherKeys) {
+  std::vector<std::string> keys = testKeys();
+  FieldParser parser(keys);
+  FieldValues values;
+
+  const char* text = "- { x:1., y:2., size:3, d:[ 4., 5. ] }\n"
+                     "- { x:1., y:2., d:[ 4. ], size:3 }\n";
+  ASSERT_TRUE(parser.parse(text, values));
+  EXPECT_EQ(2, values.size(0));
+  EXPECT_EQ(5, values.begin(0)[1]);
+  // Keys in another order than the first element's.
+  EXPECT_FALSE(parser.parse(text, values));
+
+  FieldParser missing(keys);
+  text = "- { x:1., y:2., size:3 }\n";
+  EXPECT_FALSE(missing.parse(text, values));
+
+  FieldParser repeated(keys);
+  text = "- { x:1., x:2., size:3, d:[] }\n";
+  EXPECT_FALSE(repeated.parse(text, values));
+}